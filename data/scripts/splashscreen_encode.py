@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""
+Converts a binary PPM (P6, 8-bit RGB) image to src/video_display/splashscreen.h.
+
+The pixels are stored as a QOI op stream (3 channels, without the QOI
+header and end marker) which is decoded lazily by get_splashscreen_rgb().
+
+usage:
+  splashscreen_encode.py splash.ppm > src/video_display/splashscreen.h
+"""
+
+import sys
+
+QOI_OP_INDEX = 0x00
+QOI_OP_DIFF = 0x40
+QOI_OP_LUMA = 0x80
+QOI_OP_RUN = 0xc0
+QOI_OP_RGB = 0xfe
+
+
+def read_ppm(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    fields = []
+    pos = 0
+    while len(fields) < 4:
+        while data[pos:pos + 1].isspace():
+            pos += 1
+        if data[pos:pos + 1] == b'#':
+            pos = data.index(b'\n', pos)
+            continue
+        start = pos
+        while not data[pos:pos + 1].isspace():
+            pos += 1
+        fields.append(data[start:pos])
+    if fields[0] != b'P6' or int(fields[3]) != 255:
+        sys.exit("Only 8-bit binary PPM (P6) is supported!")
+    width, height = int(fields[1]), int(fields[2])
+    pixels = data[pos + 1:pos + 1 + width * height * 3]
+    if len(pixels) != width * height * 3:
+        sys.exit("Truncated PPM file!")
+    return width, height, pixels
+
+
+def qoi_hash(px):
+    return (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64
+
+
+def wrap(val):
+    return (val + 128) % 256 - 128
+
+
+def encode(pixels):
+    out = bytearray()
+    index = [None] * 64
+    prev = (0, 0, 0)
+    run = 0
+    count = len(pixels) // 3
+    for i in range(count):
+        px = tuple(pixels[i * 3:i * 3 + 3])
+        if px == prev:
+            run += 1
+            if run == 62 or i == count - 1:
+                out.append(QOI_OP_RUN | (run - 1))
+                run = 0
+            continue
+        if run > 0:
+            out.append(QOI_OP_RUN | (run - 1))
+            run = 0
+        h = qoi_hash(px)
+        if index[h] == px:
+            out.append(QOI_OP_INDEX | h)
+        else:
+            index[h] = px
+            dr = wrap(px[0] - prev[0])
+            dg = wrap(px[1] - prev[1])
+            db = wrap(px[2] - prev[2])
+            if -2 <= dr <= 1 and -2 <= dg <= 1 and -2 <= db <= 1:
+                out.append(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2
+                           | (db + 2))
+            elif -32 <= dg <= 31 and -8 <= dr - dg <= 7 and -8 <= db - dg <= 7:
+                out.append(QOI_OP_LUMA | (dg + 32))
+                out.append((dr - dg + 8) << 4 | (db - dg + 8))
+            else:
+                out.append(QOI_OP_RGB)
+                out += bytes(px)
+        prev = px
+    return out
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    width, height, pixels = read_ppm(sys.argv[1])
+    qoi = encode(pixels)
+    print("/*  Generated by data/scripts/splashscreen_encode.py - do not edit."
+          "  */\n")
+    print(f"static const unsigned int splash_width = {width};")
+    print(f"static const unsigned int splash_height = {height};\n")
+    print("/*  QOI op stream (RGB, no header), decode with "
+          "get_splashscreen_rgb()  */")
+    print("static const unsigned char splash_qoi[] = {")
+    for i in range(0, len(qoi), 16):
+        print("\t" + ", ".join(f"0x{b:02x}" for b in qoi[i:i + 16]) + ",")
+    print("};")
+
+
+if __name__ == '__main__':
+    main()
@@ -91,10 +91,18 @@ struct dxt_encoder
     GLuint texture_id;
 
 #ifdef USE_PBO_DXT_ENCODER
-    // PBO
-    GLuint pbo_in;
-    GLuint pbo_out;
+    // PBO ring - frame is uploaded from pbo_in[i] and read back to pbo_out[i]
+    GLuint pbo_in[DXT_ENCODER_MAX_IN_FLIGHT];
+    GLuint pbo_out[DXT_ENCODER_MAX_IN_FLIGHT];
+    // persistently mapped pbo_in (ARB_buffer_storage) or NULL
+    GLubyte *pbo_in_ptr[DXT_ENCODER_MAX_IN_FLIGHT];
+#else
+    unsigned char *readback[DXT_ENCODER_MAX_IN_FLIGHT];
 #endif
+    int readback_size;
+    // slot to be used by next started frame
+    int slot_next;
+    int in_flight;
 
     // Compressed texture
     GLuint texture_compressed_id;
@@ -136,6 +144,7 @@ struct dxt_encoder
 };
 
 static int dxt_prepare_yuv422_shader(struct dxt_encoder *encoder);
+static void dxt_encoder_render(struct dxt_encoder* encoder, int texture);
 
 static int dxt_prepare_yuv422_shader(struct dxt_encoder *encoder) {
         encoder->yuv422_to_444_fp = 0;    
@@ -265,17 +274,43 @@ dxt_encoder_create(enum dxt_type type, int width, int height, enum dxt_format fo
         bpp = 4;
     }
 
-    glGenBuffersARB(1, &encoder->pbo_in); //Allocate PBO
-    glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, encoder->pbo_in);
-    glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB,width*height*bpp,0,GL_STREAM_DRAW_ARB);
-    glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
-        
-    glGenBuffersARB(1, &encoder->pbo_out); //Allocate PBO
-    glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, encoder->pbo_out);
-    glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, ((width + 3) / 4 * 4) * ((height + 3) / 4 * 4)  / (encoder->type == DXT_TYPE_DXT5_YCOCG ? 1 : 2), 0, GL_STREAM_READ_ARB);
-    glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
-    
 #endif
+    encoder->readback_size = ((width + 3) / 4 * 4) * ((height + 3) / 4 * 4)  / (encoder->type == DXT_TYPE_DXT5_YCOCG ? 1 : 2);
+    encoder->slot_next = 0;
+    encoder->in_flight = 0;
+
+    for (int i = 0; i < DXT_ENCODER_MAX_IN_FLIGHT; ++i) {
+#ifdef USE_PBO_DXT_ENCODER
+        glGenBuffersARB(1, &encoder->pbo_in[i]); //Allocate PBO
+        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, encoder->pbo_in[i]);
+        encoder->pbo_in_ptr[i] = NULL;
+#if defined GL_ARB_buffer_storage && ! defined HAVE_MACOSX
+        // the slot is rewritten only after its readback is finished (so
+        // the upload has completed), no other synchronization is needed
+        if (GLEW_ARB_buffer_storage) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER_ARB, width*height*bpp, NULL, flags);
+            encoder->pbo_in_ptr[i] = (GLubyte *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, 0, width*height*bpp, flags);
+            if (encoder->pbo_in_ptr[i] == NULL) { // immutable storage, recreate
+                glDeleteBuffersARB(1, &encoder->pbo_in[i]);
+                glGenBuffersARB(1, &encoder->pbo_in[i]);
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, encoder->pbo_in[i]);
+            }
+        }
+#endif
+        if (encoder->pbo_in_ptr[i] == NULL) {
+            glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB,width*height*bpp,0,GL_STREAM_DRAW_ARB);
+        }
+        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+        glGenBuffersARB(1, &encoder->pbo_out[i]); //Allocate PBO
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, encoder->pbo_out[i]);
+        glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, encoder->readback_size, 0, GL_STREAM_READ_ARB);
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+#else
+        encoder->readback[i] = (unsigned char *) malloc(encoder->readback_size);
+#endif
+    }
     
     GLuint fbo_tex;
     glGenTextures(1, &fbo_tex); 
@@ -461,10 +496,74 @@ dxt_encoder_buffer_allocate(struct dxt_encoder* encoder, unsigned char** image_c
     return 0;
 }
 
+/**
+ * Uploads the image to currently bound texture (through the PBO of the
+ * current slot - unless the image was already written to its persistent
+ * mapping).
+ */
+static void
+dxt_encoder_upload(struct dxt_encoder* encoder, const DXT_IMAGE_TYPE* image, int data_size,
+        int width, GLenum format, GLenum type)
+{
+#ifdef USE_PBO_DXT_ENCODER
+    const int slot = encoder->slot_next;
+    glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, encoder->pbo_in[slot]);
+    if (encoder->pbo_in_ptr[slot] != NULL) {
+        if (image != encoder->pbo_in_ptr[slot]) {
+            memcpy(encoder->pbo_in_ptr[slot], image, data_size);
+        }
+    } else {
+        // orphan the previous storage to not wait for the GPU
+        glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, data_size, 0, GL_STREAM_DRAW_ARB);
+        GLubyte *ptr = (GLubyte*)glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+        if(ptr)
+        {
+            // update data directly on the mapped buffer
+            memcpy(ptr, image, data_size);
+            glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB); // release pointer to mapping buffer
+        }
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, encoder->height, format, type, 0);
+    glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+#else
+    (void) data_size;
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, encoder->height, format, type, image);
+#endif
+}
+
+/** Documented at declaration */
+DXT_IMAGE_TYPE*
+dxt_encoder_get_upload_buffer(struct dxt_encoder* encoder)
+{
+    if (encoder->in_flight == DXT_ENCODER_MAX_IN_FLIGHT) {
+        return NULL;
+    }
+#ifdef USE_PBO_DXT_ENCODER
+    return encoder->pbo_in_ptr[encoder->slot_next];
+#else
+    return NULL;
+#endif
+}
+
 /** Documented at declaration */
 int
 dxt_encoder_compress(struct dxt_encoder* encoder, DXT_IMAGE_TYPE* image, unsigned char* image_compressed)
-{        
+{
+    assert(encoder->in_flight == 0);
+    if (dxt_encoder_compress_start(encoder, image) != 0) {
+        return -1;
+    }
+    return dxt_encoder_compress_finish(encoder, image_compressed);
+}
+
+/** Documented at declaration */
+int
+dxt_encoder_compress_start(struct dxt_encoder* encoder, DXT_IMAGE_TYPE* image)
+{
+    if (encoder->in_flight == DXT_ENCODER_MAX_IN_FLIGHT) {
+        return -1;
+    }
+
 #ifdef RTDXT_DEBUG
     glBeginQuery(GL_TIME_ELAPSED_EXT, encoder->queries[0]);
 #endif
@@ -477,10 +576,6 @@ dxt_encoder_compress(struct dxt_encoder* encoder, DXT_IMAGE_TYPE* image, unsigne
     GPA_BeginPass();
     GPA_BeginSample(0);
 #endif
-#ifdef USE_PBO_DXT_ENCODER
-    GLubyte *ptr;
-#endif
-
     int data_size = encoder->width * encoder->height;
     switch(encoder->format) {
             case DXT_FORMAT_YUV422:
@@ -504,20 +599,7 @@ dxt_encoder_compress(struct dxt_encoder* encoder, DXT_IMAGE_TYPE* image, unsigne
                         glPushAttrib(GL_VIEWPORT_BIT);
                         glViewport( 0, 0, encoder->width, encoder->height);
                 
-#ifdef USE_PBO_DXT_ENCODER
-                        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, encoder->pbo_in); // current pbo
-                        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, encoder->width / 2, encoder->height,  GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, 0);
-                        glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, data_size, 0, GL_STREAM_DRAW_ARB);
-                        ptr = (GLubyte*)glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
-                        if(ptr)
-                        {
-                            // update data directly on the mapped buffer
-                            memcpy(ptr, image, data_size); 
-                            glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB); // release pointer to mapping buffer
-                        }
-#else
-                        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, encoder->width / 2, encoder->height,  GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, image);
-#endif
+                        dxt_encoder_upload(encoder, image, data_size, encoder->width / 2, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV);
                         glUseProgram(encoder->yuv422_to_444_program);
 #ifdef RTDXT_DEBUG
     glEndQuery(GL_TIME_ELAPSED_EXT);
@@ -560,38 +642,12 @@ dxt_encoder_compress(struct dxt_encoder* encoder, DXT_IMAGE_TYPE* image, unsigne
                 case DXT_FORMAT_YUV:
                 case DXT_FORMAT_RGBA:
                         glBindTexture(GL_TEXTURE_2D, encoder->texture_id);
-#ifdef USE_PBO_DXT_ENCODER
-                        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, encoder->pbo_in); // current pbo
-                        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, encoder->width, encoder->height, GL_RGBA, DXT_IMAGE_GL_TYPE, 0);
-                        glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, data_size, 0, GL_STREAM_DRAW_ARB);
-                        ptr = (GLubyte*)glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
-                        if(ptr)
-                        {
-                            // update data directly on the mapped buffer
-                            memcpy(ptr, image, data_size); 
-                            glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB); // release pointer to mapping buffer
-                        }
-#else
-                        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, encoder->width, encoder->height, GL_RGBA, DXT_IMAGE_GL_TYPE, image);
-#endif
+                        dxt_encoder_upload(encoder, image, data_size, encoder->width, GL_RGBA, DXT_IMAGE_GL_TYPE);
 
                         break;
                 case DXT_FORMAT_RGB:
                         glBindTexture(GL_TEXTURE_2D, encoder->texture_id);
-#ifdef USE_PBO_DXT_ENCODER
-                        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, encoder->pbo_in); // current pbo
-                        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, encoder->width, encoder->height, GL_RGB, GL_UNSIGNED_BYTE, 0);
-                        glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, data_size, 0, GL_STREAM_DRAW_ARB);
-                        ptr = (GLubyte*)glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
-                        if(ptr)
-                        {
-                            // update data directly on the mapped buffer
-                            memcpy(ptr, image, data_size); 
-                            glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB); // release pointer to mapping buffer
-                        }
-#else
-                        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, encoder->width, encoder->height, GL_RGB, GL_UNSIGNED_BYTE, image);
-#endif
+                        dxt_encoder_upload(encoder, image, data_size, encoder->width, GL_RGB, GL_UNSIGNED_BYTE);
                         break;
     }
 #ifdef RTDXT_DEBUG
@@ -609,17 +665,24 @@ dxt_encoder_compress(struct dxt_encoder* encoder, DXT_IMAGE_TYPE* image, unsigne
     GPA_BeginSample(2);
 #endif
 
-    return dxt_encoder_compress_texture(encoder, encoder->texture_id, image_compressed);
+    dxt_encoder_render(encoder, encoder->texture_id);
+    return 0;
 }
 
-
 int
 dxt_encoder_compress_texture(struct dxt_encoder* encoder, int texture, unsigned char* image_compressed)
 {
-#ifdef USE_PBO_DXT_ENCODER
-    GLubyte *ptr;
-#endif
+    assert(encoder->in_flight == 0);
+    dxt_encoder_render(encoder, texture);
+    return dxt_encoder_compress_finish(encoder, image_compressed);
+}
 
+/**
+ * Compresses the texture and starts the readback to the current slot
+ */
+static void
+dxt_encoder_render(struct dxt_encoder* encoder, int texture)
+{
     glBindTexture(GL_TEXTURE_2D, texture);
 
     glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT); 
@@ -664,29 +727,23 @@ dxt_encoder_compress_texture(struct dxt_encoder* encoder, int texture, unsigned
 #ifdef USE_PBO_DXT_ENCODER
     // Read back
     // read pixels from framebuffer to PBO
-    // glReadPixels() should return immediately.
-    glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, encoder->pbo_out);
+    // glReadPixels() should return immediately, the PBO is mapped in
+    // dxt_encoder_compress_finish()
+    glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, encoder->pbo_out[encoder->slot_next]);
     if ( encoder->type == DXT_TYPE_DXT5_YCOCG )
         glReadPixels(0, 0, (encoder->width + 3) / 4, (encoder->height + 3) / 4, GL_RGBA_INTEGER_EXT, GL_UNSIGNED_INT, 0);
     else
         glReadPixels(0, 0, (encoder->width + 3) / 4, (encoder->height + 3) / 4 , GL_RGBA_INTEGER_EXT, GL_UNSIGNED_SHORT, 0);
 
-    // map the PBO to process its data by CPU
-    glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, encoder->pbo_out);
-    ptr = (GLubyte*)glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB,
-                                            GL_READ_ONLY_ARB);
-    if(ptr)
-    {
-        memcpy(image_compressed, ptr, ((encoder->width + 3) / 4 * 4) * ((encoder->height + 3) / 4 * 4) / (encoder->type == DXT_TYPE_DXT5_YCOCG ? 1 : 2));
-        glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
-    }
-
     // back to conventional pixel operation
     glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
 #else
         glReadPixels(0, 0, (encoder->width + 3) / 4, (encoder->height + 3) / 4, GL_RGBA_INTEGER_EXT,
-                        encoder->type == DXT_TYPE_DXT5_YCOCG ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT, image_compressed);
+                        encoder->type == DXT_TYPE_DXT5_YCOCG ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT,
+                        encoder->readback[encoder->slot_next]);
 #endif
+    encoder->slot_next = (encoder->slot_next + 1) % DXT_ENCODER_MAX_IN_FLIGHT;
+    encoder->in_flight += 1;
 
         
 #ifdef RTDXT_DEBUG_HOST
@@ -716,8 +773,40 @@ dxt_encoder_compress_texture(struct dxt_encoder* encoder, int texture, unsigned
     GPA_EndSample();
     GPA_EndPass();
 #endif
-    
+}
+
+/** Documented at declaration */
+int
+dxt_encoder_compress_finish(struct dxt_encoder* encoder, unsigned char* image_compressed)
+{
+    if (encoder->in_flight == 0) {
+        return -1;
+    }
+    const int slot = (encoder->slot_next - encoder->in_flight + DXT_ENCODER_MAX_IN_FLIGHT) % DXT_ENCODER_MAX_IN_FLIGHT;
+    encoder->in_flight -= 1;
+#ifdef USE_PBO_DXT_ENCODER
+    // map the PBO to process its data by CPU (waits for the readback)
+    glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, encoder->pbo_out[slot]);
+    GLubyte *ptr = (GLubyte*)glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB,
+                                            GL_READ_ONLY_ARB);
+    if(ptr)
+    {
+        memcpy(image_compressed, ptr, encoder->readback_size);
+        glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+    }
+    glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    return ptr ? 0 : -1;
+#else
+    memcpy(image_compressed, encoder->readback[slot], encoder->readback_size);
     return 0;
+#endif
+}
+
+/** Documented at declaration */
+int
+dxt_encoder_in_flight(struct dxt_encoder* encoder)
+{
+    return encoder->in_flight;
 }
 
 /** Documented at declaration */
@@ -759,6 +848,14 @@ dxt_encoder_destroy(struct dxt_encoder* encoder)
     glDeleteShader(encoder->shader_fragment_compress);
     glDeleteShader(encoder->shader_vertex_compress);
     glDeleteProgram(encoder->program_compress);
+#ifdef USE_PBO_DXT_ENCODER
+    glDeleteBuffersARB(DXT_ENCODER_MAX_IN_FLIGHT, encoder->pbo_in);
+    glDeleteBuffersARB(DXT_ENCODER_MAX_IN_FLIGHT, encoder->pbo_out);
+#else
+    for (int i = 0; i < DXT_ENCODER_MAX_IN_FLIGHT; ++i) {
+        free(encoder->readback[i]);
+    }
+#endif
     free(encoder);
     return 0;
 }
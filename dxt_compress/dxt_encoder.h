@@ -83,6 +83,52 @@ dxt_encoder_compress(struct dxt_encoder* encoder, DXT_IMAGE_TYPE* image, unsigne
 int
 dxt_encoder_compress_texture(struct dxt_encoder* encoder, int texture, unsigned char* image_compressed);
 
+/**
+ * Maximal number of frames started by dxt_encoder_compress_start() and not
+ * yet fetched by dxt_encoder_compress_finish()
+ */
+#define DXT_ENCODER_MAX_IN_FLIGHT 3
+
+/**
+ * Returns buffer where the next image passed to dxt_encoder_compress_start()
+ * may be written to avoid a copy (persistently mapped pixel buffer). The
+ * memory is write-combined so it should be written sequentially and not read.
+ *
+ * @param encoder Encoder structure
+ * @return buffer pointer or NULL if not available
+ */
+DXT_IMAGE_TYPE*
+dxt_encoder_get_upload_buffer(struct dxt_encoder* encoder);
+
+/**
+ * Starts compression of the image and the asynchronous readback of the result,
+ * which is fetched later with dxt_encoder_compress_finish() (in the order the
+ * frames were started), so that multiple frames may be in flight.
+ *
+ * @param encoder Encoder structure
+ * @param image Image data
+ * @return 0 if succeeds, otherwise nonzero (eg. DXT_ENCODER_MAX_IN_FLIGHT exceeded)
+ */
+int
+dxt_encoder_compress_start(struct dxt_encoder* encoder, DXT_IMAGE_TYPE* image);
+
+/**
+ * Waits for the oldest frame started with dxt_encoder_compress_start()
+ *
+ * @param encoder Encoder structure
+ * @param image_compressed Pointer to buffer where compressed image data will be placed
+ * @return 0 if succeeds, otherwise nonzero (eg. no frame in flight)
+ */
+int
+dxt_encoder_compress_finish(struct dxt_encoder* encoder, unsigned char* image_compressed);
+
+/**
+ * @param encoder Encoder structure
+ * @return number of the frames started and not finished
+ */
+int
+dxt_encoder_in_flight(struct dxt_encoder* encoder);
+
 /**
  * Free buffer for compressed image
  * 
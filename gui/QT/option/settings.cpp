@@ -352,6 +352,9 @@ std::string Settings::getPreviewParams() const{
 	out += getOption("video.source").getLaunchOption();
 	out += " -d preview";
 	out += ":key=" + getSessRndKey();
+#ifdef __linux__
+	out += ":shm";
+#endif
 	out += " --audio-filter controlport_stats#discard";
 	out += getOption("audio.source").getLaunchOption();
 	out += getOption("audio.source.channels").getLaunchOption();
@@ -184,6 +184,48 @@ void gpu_encode_upgrade (char * source_data,int *OUTBUF, int * PCM,int param_k,i
     return;
 }
 
+/**
+ * Encodes the frame resident in the device memory - the LDGM header (hdr)
+ * is uploaded, the frame data are copied on the device and the whole buffer
+ * (data and parity) is then downloaded at once to out_buf (should be pinned).
+ */
+void gpu_encode_dev(char *out_buf, const char *hdr, int hdr_size, const char *data_dev, int data_size,
+        int *OUTBUF, int *PCM, int param_k, int param_m, int w_f, int packet_size, int buf_size)
+{
+    int blocksize = packet_size/sizeof(int);
+
+    cudaMemset(OUTBUF, 0, buf_size);
+    cudaMemcpy(OUTBUF, hdr, hdr_size, cudaMemcpyHostToDevice);
+    cudaMemcpy((char *) OUTBUF + hdr_size, data_dev, data_size, cudaMemcpyDeviceToDevice);
+    cuda_check_error("upload OUTBUF");
+
+    if(blocksize>256){
+        if(blocksize>1024)  blocksize=1024;
+        frame_encode_int_big <<< param_m, blocksize, packet_size >>> (OUTBUF,PCM, param_k, param_m, w_f, packet_size);
+        cuda_check_error("frame_encode_int_big");
+
+        frame_encode_staircase<<< 1, blocksize, packet_size >>> (OUTBUF, PCM, param_k, param_m, w_f, packet_size);
+        cuda_check_error("frame_encode_staircase");
+
+        cudaMemcpy(out_buf, OUTBUF, buf_size, cudaMemcpyDeviceToHost);
+        cuda_check_error("memcpy out_buf");
+    }
+    else{
+        frame_encode_int <<< param_m, blocksize, packet_size >>> (OUTBUF,PCM, param_k, param_m, w_f, packet_size);
+        cuda_check_error("frame_encode_int");
+
+        cudaMemcpy(out_buf, OUTBUF, buf_size, cudaMemcpyDeviceToHost);
+        cuda_check_error("memcpy out_buf");
+
+        for ( int m = 1; m < param_m; ++m)
+        {
+            char *prev_parity = out_buf + (param_k + m - 1) * packet_size;
+            char *parity_packet = out_buf + (param_k + m) * packet_size;
+            xor_using_sse2(prev_parity, parity_packet, packet_size);
+        }
+    }
+}
+
 #define CHECK_CUDA(cmd) do { \
         cudaError_t err = cmd; \
         if (err != cudaSuccess) {\
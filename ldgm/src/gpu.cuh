@@ -17,6 +17,9 @@ extern "C" {
 
 void gpu_encode_upgrade (char* source_data,int *OUTBUF, int * PCM,int param_k,int param_m,int w_f,int packet_size ,int buf_size);
 
+void gpu_encode_dev(char *out_buf, const char *hdr, int hdr_size, const char *data_dev, int data_size,
+        int *OUTBUF, int *PCM, int param_k, int param_m, int w_f, int packet_size, int buf_size);
+
 void gpu_decode_upgrade(char *data, int * PCM,int* SYNC_VEC,int* ERROR_VEC, int not_done, int *frame_size,int *, int*,int M,int K,int w_f,int buf_size,int packet_size);
 
 #ifdef __cplusplus
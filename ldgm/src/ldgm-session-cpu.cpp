@@ -16,7 +16,9 @@
  * =====================================================================================
  */
 
+#include <algorithm>
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #if defined __SSE2__ || _M_IX86_FP == 2
@@ -54,85 +56,155 @@ static inline void *aligned_malloc(size_t size, size_t alignment)
 #endif
 
 
-static char*
-xor_using_sse (char* source, char* dest, int packet_size)
-{
-    // int a = 0;
-    // int II = packet_size % 16;
-    // a=II*16;
-    // // uint64_t* p1 = (uint64_t*) (source);
-    // // uint64_t* p2 = (uint64_t*) (dest);
-
-    // __int128* p1 = (__int128*) (source);
-    // __int128* p2 = (__int128*) (dest);
-
-    // for(int i=0; i<II; i++){
-    //     *p2 ^= *p1;
-    //     p2++;
-    //     p1++;
-    // }
-    // while(a<packet_size){
-    //     *(dest + a) ^= *(source+a);
-    //     a++;
-    // }
-    //First, do as many 128-bit XORs as possible
-    int iter_bytes_16 = 0;
-    int iter_bytes_4 = 0;
-    int iter_bytes_1 = 0;
-#if defined __SSE2__ || _M_IX86_FP == 2
-    iter_bytes_16 = (packet_size/16)*16;
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#define LDGM_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
 
-    if ( iter_bytes_16 > 0)
-    {
+#define ENC_STRIPE_WORKING_SET (256 * 1024) ///< data of all source symbols in one encoder stripe
+#define ENC_STRIPE_MIN 512
 
-        //    printf ( "iter_bytes: %d\n", iter_bytes );
-        __m128i* wrd_ptr = (__m128i *)(void *) source;
-        __m128i* wrd_end = (__m128i *)(void *) (source + iter_bytes_16);
-        __m128i* dst_ptr = (__m128i *)(void *) dest;
+/**
+ * dst = src[0] ^ src[1] ^ ... ^ src[count - 1], count >= 1
+ *
+ * XORing all sources at once keeps the accumulator in registers so dst is
+ * written only once.
+ */
+typedef void (*xor_sources_t)(char *dst, const char *const *src, int count, int len);
 
-        //    printf ( "wrd_ptr address: %p\n", wrd_ptr );
-        do
-        {
-            __m128i xmm1 = _mm_loadu_si128(wrd_ptr);
-            __m128i xmm2 = _mm_loadu_si128(dst_ptr);
+/// processes bytes from offset i on
+static void
+xor_sources_tail (char *dst, const char *const *src, int count, int i, int len)
+{
+    for ( ; i + 8 <= len; i += 8) {
+        uint64_t acc;
+        memcpy(&acc, src[0] + i, sizeof acc);
+        for ( int j = 1; j < count; ++j) {
+            uint64_t val;
+            memcpy(&val, src[j] + i, sizeof val);
+            acc ^= val;
+        }
+        memcpy(dst + i, &acc, sizeof acc);
+    }
+    for ( ; i < len; ++i) {
+        char acc = src[0][i];
+        for ( int j = 1; j < count; ++j)
+            acc ^= src[j][i];
+        dst[i] = acc;
+    }
+}
 
-            xmm1 = _mm_xor_si128(xmm1, xmm2);     //  XOR  4 32-bit words
-            _mm_storeu_si128(dst_ptr, xmm1);
-            ++wrd_ptr;
-            ++dst_ptr;
+#if !defined __ARM_NEON && !(defined __SSE2__ || _M_IX86_FP == 2)
+static void
+xor_sources_scalar (char *dst, const char *const *src, int count, int len)
+{
+    xor_sources_tail(dst, src, count, 0, len);
+}
+#endif
 
-        } while (wrd_ptr < wrd_end);
+#if defined __SSE2__ || _M_IX86_FP == 2
+static void
+xor_sources_sse2 (char *dst, const char *const *src, int count, int len)
+{
+    int i = 0;
+    for ( ; i + 32 <= len; i += 32) {
+        __m128i acc0 = _mm_loadu_si128((const __m128i *)(const void *) (src[0] + i));
+        __m128i acc1 = _mm_loadu_si128((const __m128i *)(const void *) (src[0] + i + 16));
+        for ( int j = 1; j < count; ++j) {
+            acc0 = _mm_xor_si128(acc0, _mm_loadu_si128((const __m128i *)(const void *) (src[j] + i)));
+            acc1 = _mm_xor_si128(acc1, _mm_loadu_si128((const __m128i *)(const void *) (src[j] + i + 16)));
+        }
+        _mm_storeu_si128((__m128i *)(void *) (dst + i), acc0);
+        _mm_storeu_si128((__m128i *)(void *) (dst + i + 16), acc1);
     }
+    xor_sources_tail(dst, src, count, i, len);
+}
 #endif
-    //Check, whether further XORing is necessary
-    if ( iter_bytes_16 < packet_size )
-    {
-        char *mark_source = source + iter_bytes_16;
-        char *mark_dest = dest + iter_bytes_16;
 
-        iter_bytes_4 = ((packet_size - iter_bytes_16)/4)*4;
-
-        for ( int i = 0; i < (packet_size - iter_bytes_16)/4; i++)
-        {
-            int *s = ((int*)(void *) mark_source) + i;
-            int *d = ((int*)(void *) mark_dest) + i;
-            *d ^= *s;
+#ifdef LDGM_X86_DISPATCH
+__attribute__((target("avx2")))
+static void
+xor_sources_avx2 (char *dst, const char *const *src, int count, int len)
+{
+    int i = 0;
+    for ( ; i + 64 <= len; i += 64) {
+        __m256i acc0 = _mm256_loadu_si256((const __m256i *)(const void *) (src[0] + i));
+        __m256i acc1 = _mm256_loadu_si256((const __m256i *)(const void *) (src[0] + i + 32));
+        for ( int j = 1; j < count; ++j) {
+            acc0 = _mm256_xor_si256(acc0, _mm256_loadu_si256((const __m256i *)(const void *) (src[j] + i)));
+            acc1 = _mm256_xor_si256(acc1, _mm256_loadu_si256((const __m256i *)(const void *) (src[j] + i + 32)));
         }
+        _mm256_storeu_si256((__m256i *)(void *) (dst + i), acc0);
+        _mm256_storeu_si256((__m256i *)(void *) (dst + i + 32), acc1);
+    }
+    xor_sources_tail(dst, src, count, i, len);
+}
 
-        mark_source += iter_bytes_4;
-        mark_dest += iter_bytes_4;
-
-        iter_bytes_1 = packet_size - iter_bytes_16 - iter_bytes_4;
+__attribute__((target("avx512f")))
+static void
+xor_sources_avx512 (char *dst, const char *const *src, int count, int len)
+{
+    int i = 0;
+    for ( ; i + 128 <= len; i += 128) {
+        __m512i acc0 = _mm512_loadu_si512((const void *) (src[0] + i));
+        __m512i acc1 = _mm512_loadu_si512((const void *) (src[0] + i + 64));
+        for ( int j = 1; j < count; ++j) {
+            acc0 = _mm512_xor_si512(acc0, _mm512_loadu_si512((const void *) (src[j] + i)));
+            acc1 = _mm512_xor_si512(acc1, _mm512_loadu_si512((const void *) (src[j] + i + 64)));
+        }
+        _mm512_storeu_si512((void *) (dst + i), acc0);
+        _mm512_storeu_si512((void *) (dst + i + 64), acc1);
+    }
+    xor_sources_tail(dst, src, count, i, len);
+}
+#endif
 
-        for ( int i = 0; i < iter_bytes_1; i++)
-        {
-            *(mark_dest + i) ^= *(mark_source+i);
+#ifdef __ARM_NEON
+static void
+xor_sources_neon (char *dst, const char *const *src, int count, int len)
+{
+    int i = 0;
+    for ( ; i + 32 <= len; i += 32) {
+        uint8x16_t acc0 = vld1q_u8((const uint8_t *) src[0] + i);
+        uint8x16_t acc1 = vld1q_u8((const uint8_t *) src[0] + i + 16);
+        for ( int j = 1; j < count; ++j) {
+            acc0 = veorq_u8(acc0, vld1q_u8((const uint8_t *) src[j] + i));
+            acc1 = veorq_u8(acc1, vld1q_u8((const uint8_t *) src[j] + i + 16));
         }
+        vst1q_u8((uint8_t *) dst + i, acc0);
+        vst1q_u8((uint8_t *) dst + i + 16, acc1);
     }
+    xor_sources_tail(dst, src, count, i, len);
+}
+#endif
 
-//   printf ( "XORed: %d bytes using SSE, %d bytes as ints and %d bytes byte-per-byte.\n",iter_bytes_16, iter_bytes_4, iter_bytes_1);
+static xor_sources_t
+select_xor_sources ()
+{
+#ifdef LDGM_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return xor_sources_avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return xor_sources_avx2;
+#endif
+#ifdef __ARM_NEON
+    return xor_sources_neon;
+#elif defined __SSE2__ || _M_IX86_FP == 2
+    return xor_sources_sse2;
+#else
+    return xor_sources_scalar;
+#endif
+}
 
-    return dest;
+static void
+xor_sources (char *dst, const char *const *src, int count, int len)
+{
+    static const xor_sources_t impl = select_xor_sources();
+    impl(dst, src, count, len);
 }
 
 void *
@@ -148,44 +220,50 @@ LDGM_session_cpu::alloc_buf (int buf_size)
 
 }
 
+/**
+ * Parity symbol m is XOR of data symbols in row m of the matrix and of parity
+ * symbol m - 1 (inverted staircase). The symbols are processed in stripes
+ * sized so that the stripes of all source symbols stay in cache while all the
+ * parity symbols are computed.
+ */
 void
 LDGM_session_cpu::encode ( char* data_ptr, char* parity_ptr )
 {
-//    start encoding
-   // printf ( "packet_size: %d\n", this->packet_size );
-
-    char *parity_packet;
-
-	parity_packet = (char *) aligned_malloc(packet_size, 16);
-	if (!parity_packet)
-	{
-		printf ( "Error while using posix_memalign\n" );
-		return;
-	}
-	memset(parity_packet, 0, packet_size);
-
+    //Find out which packets to XOR
+    vector<int> row_start(param_m + 1);
+    vector<int> row_idx;
+    row_idx.reserve(param_m*(max_row_weight+2));
     for ( int m = 0; m < param_m; ++m) {
-//	printf ( "m: %d\n", m );
-
-//	printf ( "max w: %d\n", max_row_weight );
-        //Find out which packets to XOR
+        row_start[m] = row_idx.size();
         for ( int k = 0; k < max_row_weight+2; ++k) {
             int idx = pcm[m*(max_row_weight+2) + k];
-//	    printf ( "adept: %d\n", idx );
-            if (idx > -1 && idx < param_k) {
-//		printf ( "xoring idx: %d\n", idx );
-                char *ptr = data_ptr + idx*packet_size;
-                parity_packet = xor_using_sse(ptr, parity_packet, packet_size);
-            }
+            if (idx > -1 && idx < param_k)
+                row_idx.push_back(idx);
         }
-
-        //Add the new parity packet to overall parity
-        memcpy ( parity_ptr + m*packet_size, parity_packet, packet_size );
     }
+    row_start[param_m] = row_idx.size();
 
-	aligned_free(parity_packet);
+    int stripe = ENC_STRIPE_WORKING_SET / param_k / 64 * 64;
+    if (stripe < ENC_STRIPE_MIN)
+        stripe = ENC_STRIPE_MIN;
 
-    return ;
+    vector<const char *> src(max_row_weight + 3);
+    for ( int off = 0; off < packet_size; off += stripe) {
+        int len = min(stripe, packet_size - off);
+        for ( int m = 0; m < param_m; ++m) {
+            int count = 0;
+            if (m > 0)
+                src[count++] = parity_ptr + (m-1)*packet_size + off;
+            for ( int i = row_start[m]; i < row_start[m + 1]; ++i)
+                src[count++] = data_ptr + row_idx[i]*packet_size + off;
+            char *dst = parity_ptr + m*packet_size + off;
+            if (count > 0) {
+                xor_sources(dst, src.data(), count, len);
+            } else {
+                memset(dst, 0, len);
+            }
+        }
+    }
 }		/* -----  end of method LDGM_session_cpu::encode  ----- */
 
 void
@@ -245,7 +323,7 @@ void iterate ( Tanner_graph *g);
 
 char*
 LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
-                                 std::map<int, int> valid_data )
+                                 const std::vector<std::pair<int, int>> &valid_data )
 {
 //    printf ( "buf_size: %d\n", buf_size );
 
@@ -305,21 +383,8 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
      *     }
      */
 
-    //We need to merge intervals in the valid data vector
-    map <int, int> merged_intervals;
-    map<int,int>::iterator map_it;
-
-    if ( valid_data.size() != 0 )
-    {
-        for ( map_it = valid_data.begin(); map_it != valid_data.end(); )
-        {
-            int start = map_it->first;
-            int length = map_it->second;
-            while ( start + length == (++map_it)->first )
-                length += map_it->second;
-            merged_intervals.insert ( pair<int, int> (start, length) );
-        }
-    }
+    //Intervals in the valid data vector are already sorted and merged
+    const std::vector<std::pair<int, int>> &merged_intervals = valid_data;
     /*     printf ( "Valid data: \n" );
      *     for ( map_it = valid_data.begin(); map_it != valid_data.end(); ++map_it)
      *     {
@@ -344,22 +409,17 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
         it = graph.nodes.find(0);
         const auto variable_node_end_it = graph.nodes.find(param_k+param_m); // == 1st constraint node
         assert(variable_node_end_it != graph.nodes.end());
+        auto map_it = merged_intervals.begin();
         while (it != variable_node_end_it) {
             (*it).second.setDone(false);
             int node_offset = (*it).second.getDataPtr() - received;
 //	    printf ( "offset: %d\n", node_offset );
 
-            map_it = merged_intervals.begin();
-            //Find the offset in valid data which is equal, or the first offset which is
-            //lower than node offset
-            bool found = false;
-            while ( (map_it->first <= node_offset) && map_it != merged_intervals.end() )
-            {
+            //Find the last interval starting at or before the node offset (node
+            //offsets are increasing so the search continues from previous node)
+            while ( map_it + 1 != merged_intervals.end() && (map_it + 1)->first <= node_offset )
                 map_it++;
-                found = true;
-            }
-            if ( found )
-                map_it--;
+            bool found = map_it->first <= node_offset;
 
             //Next, find out if some interval covers this symbol
             if ( found && (map_it->first + map_it->second) >=
@@ -447,6 +507,7 @@ LDGM_session_cpu::iterate ( Tanner_graph *graph )
 {
     map<int, Node>::iterator it_c;
     vector<int> vec;
+    vector<const char *> srcs;
 
     //static int recovered = 0;
 
@@ -474,7 +535,6 @@ LDGM_session_cpu::iterate ( Tanner_graph *graph )
 //		printf ( "repairing first block\n" );
 //	    }
             auto &node = graph->nodes.at(r_index);
-            memset(node.getDataPtr(), 0, packet_size);
             char *r_data = node.getDataPtr();
             //find other nodes connected to this constraint node and XOR their values
             int count = 0;
@@ -483,13 +543,15 @@ LDGM_session_cpu::iterate ( Tanner_graph *graph )
             {
                 if ( *j != r_index )
                 {
-//		    printf ( "decode, packet_size: %d\n", packet_size );
-                    char *g_data = (graph->nodes.find(*j))->second.getDataPtr();
-                    //XOR
-                    xor_using_sse(g_data, r_data, packet_size);
+                    srcs.push_back((graph->nodes.find(*j))->second.getDataPtr());
                     count++;
                 }
             }
+            if ( count > 0 )
+                xor_sources(r_data, srcs.data(), count, packet_size);
+            else
+                memset(r_data, 0, packet_size);
+            srcs.clear();
             /*           //validate recovered packet
              *          for ( int i = 0; i < param_k; ++i) {
              *              if(!memcmp(r_data, lost_ptr + i*packet_size, packet_size)) {
@@ -50,7 +50,7 @@ class LDGM_session_cpu : public LDGM_session
 
 	char*                                                                             
 	    decode_frame ( char* received_data, int buf_size, int* frame_size,
-		    std::map<int, int> valid_data );
+		    const std::vector<std::pair<int, int>> &valid_data );
 
 	void
 	    iterate ( Tanner_graph *graph);
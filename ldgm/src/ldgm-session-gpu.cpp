@@ -25,6 +25,7 @@
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <vector>
 #include <cuda_runtime.h>
 
 #include "ldgm-session-gpu.h"
@@ -113,18 +114,11 @@ void LDGM_session_gpu::free_out_buf ( char *buf)
     }
 }
 
-void LDGM_session_gpu::encode ( char *source_data, char *parity )
+void LDGM_session_gpu::prepare_device_bufs ( unsigned int buf_size )
 {
-    assert(parity == source_data+param_k*get_packet_size());
-
     unsigned int w_f = max_row_weight + 2;
-    unsigned int buf_size = (param_k + param_m) * packet_size;
-
     cudaError_t error;
 
-    // error = cudaHostGetDevicePointer( &(out_buf_d), source_data, 0);
-    // cuda_check_error("out_buf_d");
-
     if(OUTBUF==NULL){
         // puts("cudaMalloc");
         cudaMalloc((void **) &OUTBUF,buf_size);
@@ -137,11 +131,6 @@ void LDGM_session_gpu::encode ( char *source_data, char *parity )
         OUTBUF_SIZE=buf_size;
     }
 
-        cudaMemcpy((void *) OUTBUF,source_data,buf_size,cudaMemcpyHostToDevice);
-    cuda_check_error("memcpy OUTBUF");
-
-
-
     if (PCM == NULL)
     {   
         // puts("cudaMalloc");      
@@ -151,10 +140,22 @@ void LDGM_session_gpu::encode ( char *source_data, char *parity )
         error = cudaMemcpy(PCM, pcm, w_f * param_m * sizeof(int), cudaMemcpyHostToDevice);
         if(error != cudaSuccess)printf("8CUDA error: %s\n", cudaGetErrorString(error));
     }
+}
+
+void LDGM_session_gpu::encode ( char *source_data, char *parity )
+{
+    assert(parity == source_data+param_k*get_packet_size());
 
+    unsigned int w_f = max_row_weight + 2;
+    unsigned int buf_size = (param_k + param_m) * packet_size;
 
+    // error = cudaHostGetDevicePointer( &(out_buf_d), source_data, 0);
+    // cuda_check_error("out_buf_d");
 
+    prepare_device_bufs(buf_size);
 
+        cudaMemcpy((void *) OUTBUF,source_data,buf_size,cudaMemcpyHostToDevice);
+    cuda_check_error("memcpy OUTBUF");
 
     gpu_encode_upgrade(source_data,OUTBUF , PCM, param_k, param_m, w_f, packet_size, buf_size);
 
@@ -162,7 +163,38 @@ void LDGM_session_gpu::encode ( char *source_data, char *parity )
 
 }
 
-char *LDGM_session_gpu::decode_frame ( char *received_data, int buf_size, int *frame_size, std::map<int, int> valid_data )
+char *LDGM_session_gpu::encode_hdr_frame_dev ( char *my_hdr, int my_hdr_size, const char *frame_dev, int frame_size, int *out_buf_size )
+{
+    const int header_size = LDGM_session::HEADER_SIZE;
+    int buf_size = set_buf_layout(my_hdr_size + frame_size);
+    *out_buf_size = buf_size;
+
+    char *out_buf = (char *) alloc_buf(buf_size);
+    if (!out_buf) {
+        return NULL;
+    }
+
+    // LDGM header (frame size) followed by the video header
+    std::vector<char> hdr(header_size + my_hdr_size);
+    int32_t overall_size = my_hdr_size + frame_size;
+    memcpy(hdr.data(), &overall_size, sizeof overall_size);
+    memcpy(hdr.data() + header_size, my_hdr, my_hdr_size);
+
+    Timer_util interval;
+    interval.start();
+
+    prepare_device_bufs(buf_size);
+    gpu_encode_dev(out_buf, hdr.data(), hdr.size(), frame_dev, frame_size, OUTBUF, PCM,
+            param_k, param_m, max_row_weight + 2, packet_size, buf_size);
+
+    interval.end();
+    this->elapsed_sum2 += interval.elapsed_time_ms();
+    this->no_frames2++;
+
+    return out_buf;
+}
+
+char *LDGM_session_gpu::decode_frame ( char *received_data, int buf_size, int *frame_size, const std::vector<std::pair<int, int>> &valid_data )
 {
     char *received = received_data;
 
@@ -172,21 +204,8 @@ char *LDGM_session_gpu::decode_frame ( char *received_data, int buf_size, int *f
     int p_size = buf_size / (param_m + param_k);
     // printf("%d p_size K: %d, M: %d, buf_size: %d, max_row_weight: %d \n",p_size,param_k,param_m,buf_size,max_row_weight);
 
-    //We need to merge intervals in the valid data vector
-    std::map <int, int> merged_intervals;
-    std::map<int, int>::iterator map_it;
-
-    if ( valid_data.size() != 0 )
-    {
-        for ( map_it = valid_data.begin(); map_it != valid_data.end(); )
-        {
-            int start = map_it->first;
-            int length = map_it->second;
-            while ( start + length == (++map_it)->first )
-                length += map_it->second;
-            merged_intervals.insert ( std::pair<int, int> (start, length) );
-        }
-    }
+    //Intervals in the valid data vector are already sorted and merged
+    const std::vector<std::pair<int, int>> &merged_intervals = valid_data;
 
     
 
@@ -213,19 +232,14 @@ char *LDGM_session_gpu::decode_frame ( char *received_data, int buf_size, int *f
        )
     {
 
+        auto map_it = merged_intervals.begin();
         for (int i = 0; i < param_k + param_m; i++)
         {
             int node_offset = i * p_size;
 
-            map_it = merged_intervals.begin();
-
-            bool found = false;
-            while ( (map_it->first <= node_offset) && map_it != merged_intervals.end() )
-            {
+            while ( map_it + 1 != merged_intervals.end() && (map_it + 1)->first <= node_offset )
                 map_it++;
-                found = true;
-            }
-            if ( found ) map_it--;
+            bool found = map_it->first <= node_offset;
 
             if ( found && (map_it->first + map_it->second) >=
                     (node_offset + p_size) )
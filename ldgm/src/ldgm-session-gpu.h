@@ -57,6 +57,9 @@ class LDGM_session_gpu : public LDGM_session
 
 	void 
 	    encode ( char* data_ptr, char* parity_ptr );
+
+	char *
+	    encode_hdr_frame_dev ( char* hdr, int hdr_size, const char* frame_dev, int frame_size, int* out_buf_size );
 	
 	void 
 	    encode_naive ( char* /* data_ptr */, char* /* parity_ptr */ ) {}
@@ -70,7 +73,7 @@ class LDGM_session_gpu : public LDGM_session
 	 void *
 		alloc_buf(int size);
 
-	char * decode_frame ( char* received_data, int buf_size, int* frame_size, std::map<int, int> valid_data );
+	char * decode_frame ( char* received_data, int buf_size, int* frame_size, const std::vector<std::pair<int, int>> &valid_data );
 	void set_data_fname(char fname[32]) { strncpy(data_fname, fname, 32); }
 
     protected:
@@ -80,6 +83,9 @@ class LDGM_session_gpu : public LDGM_session
 	/* ====================  DATA MEMBERS  ======================================= */
 	char data_fname[32];
 
+	void
+	    prepare_device_bufs ( unsigned int buf_size );
+
         std::queue<char *> freeBuffers;
         std::map<char *, size_t> bufferSizes;
 
@@ -221,13 +221,11 @@ LDGM_session::encode_frame ( char* frame, int frame_size, int* out_buf_size )
 
 }
 
-char*
-LDGM_session::encode_hdr_frame ( char *my_hdr, int my_hdr_size, char* frame, int frame_size, int* out_buf_size )
+int
+LDGM_session::set_buf_layout ( int overall_size )
 {
     int buf_size;
-    int ps;
     short header_size = LDGM_session::HEADER_SIZE;
-    int overall_size = my_hdr_size + frame_size;
     int align_coef = param_k*sizeof(int);
 
     if ( (overall_size + header_size) % align_coef == 0 )
@@ -235,11 +233,18 @@ LDGM_session::encode_hdr_frame ( char *my_hdr, int my_hdr_size, char* frame, int
     else
         buf_size = ( ( (overall_size + header_size) / align_coef  ) + 1 ) * align_coef;
 
-    ps = buf_size/param_k;
+    packet_size = buf_size/param_k;
+//    printf ( "ps: %d\n", packet_size );
+    return buf_size + param_m*packet_size;
+}
 
-    packet_size = ps;
-//    printf ( "ps: %d\n", ps );
-    buf_size += param_m*ps;
+char*
+LDGM_session::encode_hdr_frame ( char *my_hdr, int my_hdr_size, char* frame, int frame_size, int* out_buf_size )
+{
+    short header_size = LDGM_session::HEADER_SIZE;
+    int overall_size = my_hdr_size + frame_size;
+    int buf_size = set_buf_layout(overall_size);
+    int ps = packet_size;
     *out_buf_size = buf_size;
 
     void *out_buf;
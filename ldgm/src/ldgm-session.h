@@ -75,6 +75,17 @@ class LDGM_session : public Coding_session
 	char*
 	    encode_hdr_frame( char *hdr, int hdr_size, char* frame, int frame_size, int* out_buf_size );
 
+	/**
+	 * Same as encode_hdr_frame() but the frame data are in the CUDA device
+	 * memory (already uploaded by the encoder). Data and parity are
+	 * downloaded to the host at once to the returned buffer.
+	 *
+	 * @return NULL on error or if the implementation supports only host memory
+	 * */
+	virtual char*
+	    encode_hdr_frame_dev( char * /* hdr */, int /* hdr_size */, const char* /* frame_dev */,
+		    int /* frame_size */, int* /* out_buf_size */ ) { return NULL; }
+
 	virtual void
 	    encode ( char* data, char* parity ) = 0;
 	
@@ -86,7 +97,7 @@ class LDGM_session : public Coding_session
 
 	virtual char*
 	    decode_frame ( char* received_data, int buf_size, int* frame_size, 
-		    std::map<int, int>  valid_data ) = 0;
+		    const std::vector<std::pair<int, int>> &valid_data ) = 0;
 
 	void
 	    set_params ( unsigned short k,
@@ -104,6 +115,13 @@ class LDGM_session : public Coding_session
 		    
 
     protected:
+	/**
+	 * Sets packet_size for the frame of given size (including the video
+	 * header) and returns the size of the whole buffer (data + parity).
+	 * */
+	int
+	    set_buf_layout ( int overall_size );
+
 	/* ====================  DATA MEMBERS  ======================================= */
 
 	char* pcMatrix;
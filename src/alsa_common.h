@@ -39,6 +39,7 @@
 #define ALSA_COMMON_H
 
 #include <alsa/asoundlib.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -204,6 +205,119 @@ static void print_alsa_device_info(snd_pcm_t *handle, const char *module_name) {
         }
 }
 
+/**
+ * Copies frames between UG interleaved signed samples and mmapped areas (any
+ * layout, see snd_pcm_mmap_begin()). Exactly one of in (playback) and out
+ * (capture) is set. Area channels beyond ch_count are not touched.
+ */
+static inline void alsa_mmap_copy_areas(const snd_pcm_channel_area_t *areas,
+                snd_pcm_uframes_t offset, snd_pcm_uframes_t frames,
+                const char *in, char *out, int bps, int ch_count)
+{
+        const size_t frame_len = (size_t) bps * ch_count;
+        bool contiguous = bps > 1; // U8 needs signedness conversion
+        for (int c = 0; c < ch_count && contiguous; ++c) {
+                contiguous = areas[c].addr == areas[0].addr &&
+                        areas[c].step == frame_len * 8 &&
+                        areas[c].first == areas[0].first + c * bps * 8U;
+        }
+        if (contiguous && areas[0].first % 8 == 0) { // same layout as UG
+                char *dma = (char *) areas[0].addr + areas[0].first / 8 + offset * frame_len;
+                if (in != NULL) {
+                        memcpy(dma, in, frames * frame_len);
+                } else {
+                        memcpy(out, dma, frames * frame_len);
+                }
+                return;
+        }
+        for (int c = 0; c < ch_count; ++c) {
+                const size_t step = areas[c].step / 8;
+                char *dma = (char *) areas[c].addr + areas[c].first / 8 + offset * step;
+                for (snd_pcm_uframes_t i = 0; i < frames; ++i) {
+                        if (in != NULL) {
+                                memcpy(dma, in + i * frame_len + c * bps, bps);
+                                if (bps == 1) {
+                                        *dma ^= 0x80; // S8 -> U8
+                                }
+                        } else {
+                                memcpy(out + i * frame_len + c * bps, dma, bps);
+                                if (bps == 1) {
+                                        out[i * frame_len + c] ^= 0x80;
+                                }
+                        }
+                        dma += step;
+                }
+        }
+}
+
+/**
+ * Transfers frames directly from/to the DMA buffer (SND_PCM_ACCESS_MMAP_*
+ * access), counterpart of snd_pcm_readi()/snd_pcm_writei(). The stream is
+ * started if needed.
+ *
+ * @param block  wait for the device, otherwise return what was transferred
+ * @returns      transferred frames or negative ALSA error
+ */
+static inline snd_pcm_sframes_t alsa_mmap_transfer(snd_pcm_t *handle,
+                const char *in, char *out, int bps, int ch_count,
+                snd_pcm_uframes_t frames, bool block)
+{
+        snd_pcm_uframes_t done = 0;
+        while (done < frames) {
+                snd_pcm_sframes_t avail = snd_pcm_avail_update(handle);
+                if (avail < 0) {
+                        return avail;
+                }
+                if (avail == 0) {
+                        if (out != NULL && snd_pcm_state(handle) == SND_PCM_STATE_PREPARED) {
+                                int rc = snd_pcm_start(handle);
+                                if (rc < 0) {
+                                        return rc;
+                                }
+                        }
+                        if (!block) {
+                                break;
+                        }
+                        int rc = snd_pcm_wait(handle, 1000);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                        if (rc == 0) { // timeout
+                                break;
+                        }
+                        continue;
+                }
+
+                const snd_pcm_channel_area_t *areas = NULL;
+                snd_pcm_uframes_t offset = 0;
+                snd_pcm_uframes_t count = frames - done;
+                int rc = snd_pcm_mmap_begin(handle, &areas, &offset, &count);
+                if (rc < 0) {
+                        return rc;
+                }
+                const size_t pos = done * bps * ch_count;
+                alsa_mmap_copy_areas(areas, offset, count, in != NULL ? in + pos : NULL,
+                                out != NULL ? out + pos : NULL, bps, ch_count);
+                snd_pcm_sframes_t committed = snd_pcm_mmap_commit(handle, offset, count);
+                if (committed < 0) {
+                        return committed;
+                }
+                if ((snd_pcm_uframes_t) committed != count) {
+                        return -EPIPE;
+                }
+                done += count;
+
+                // unlike writei, commit doesn't start the playback
+                if (in != NULL && snd_pcm_state(handle) == SND_PCM_STATE_PREPARED) {
+                        rc = snd_pcm_start(handle);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                }
+        }
+        return done;
+}
+
 static const char *alsa_get_pcm_state_name(snd_pcm_state_t state) __attribute__((unused));
 static const char *alsa_get_pcm_state_name(snd_pcm_state_t state) {
         switch (state) {
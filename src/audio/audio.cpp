@@ -48,6 +48,8 @@
  */
 
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <cinttypes>
 #include <cstdio>
 #include <cstdlib>
@@ -70,6 +72,7 @@
 #include "audio/playback/sdi.h"
 #include "audio/resampler.hpp"
 #include "audio/utils.h"
+#include "control_socket.h"
 #include "debug.h"
 #include "host.h"
 #include "module.h"
@@ -84,6 +87,7 @@
 #include "types.h"
 #include "ug_runtime_error.hpp"
 #include "utils/color_out.h"
+#include "utils/lockfree_queue.h"
 #include "utils/net.h"
 #include "utils/sdp.h"
 #include "utils/string_view_utils.hpp"
@@ -106,6 +110,7 @@ enum audio_transport_device {
 };
 
 #define DEFAULT_AUDIO_RECV_BUF_SIZE (256 * 1024)
+#define AUDIO_SENDER_QUEUE_LEN 8 ///< captured frames waiting for encoding
 #define MOD_NAME "[audio] "
 
 struct audio_network_parameters {
@@ -162,9 +167,14 @@ struct state_audio {
         fec       *fec_state = nullptr;
         
         pthread_t audio_sender_thread_id{},
+                  audio_sender_encoder_thread_id{},
                   audio_receiver_thread_id{};
         bool audio_sender_thread_started = false,
+             audio_sender_encoder_thread_started = false,
              audio_receiver_thread_started = false;
+        /// captured (and filtered) frames passed from the capture thread
+        /// to the encoder so that capture never waits for encoding/sending
+        lockfree_queue<audio_frame2, AUDIO_SENDER_QUEUE_LEN> sender_queue;
 
         char *audio_channel_map = nullptr;
         const char *audio_scale = nullptr;
@@ -178,7 +188,7 @@ struct state_audio {
 
         double volume = 1.0; // receiver volume scale
         bool muted_receiver = false;
-        bool muted_sender = false;
+        std::atomic_bool muted_sender = false;
 
         size_t recv_buf_size = DEFAULT_AUDIO_RECV_BUF_SIZE;
 };
@@ -191,6 +201,7 @@ struct state_audio {
 typedef void (*audio_device_help_t)(void);
 
 static void *audio_sender_thread(void *arg);
+static void *audio_sender_encoder_thread(void *arg);
 static void *audio_receiver_thread(void *arg);
 static struct rtp *initialize_audio_network(struct audio_network_parameters *params);
 static struct response *audio_receiver_process_message(struct state_audio *s, struct msg_receiver *msg);
@@ -500,6 +511,13 @@ void audio_start(struct state_audio *s) {
 #endif
 
         if (s->audio_tx_mode & MODE_SENDER) {
+                if (pthread_create
+                    (&s->audio_sender_encoder_thread_id, NULL, audio_sender_encoder_thread, (void *)s) != 0) {
+                        log_msg(LOG_LEVEL_FATAL, "Error creating audio thread. Quitting\n");
+                        exit_uv(EXIT_FAIL_AUDIO);
+                } else {
+                        s->audio_sender_encoder_thread_started = true;
+                }
                 if (pthread_create
                     (&s->audio_sender_thread_id, NULL, audio_sender_thread, (void *)s) != 0) {
                         log_msg(LOG_LEVEL_FATAL, "Error creating audio thread. Quitting\n");
@@ -528,6 +546,9 @@ void audio_join(struct state_audio *s) {
                 pthread_join(s->audio_receiver_thread_id, NULL);
         if(s->audio_sender_thread_started)
                 pthread_join(s->audio_sender_thread_id, NULL);
+        if (s->audio_sender_encoder_thread_started) {
+                pthread_join(s->audio_sender_encoder_thread_id, NULL);
+        }
 }
         
 void audio_done(struct state_audio *s)
@@ -711,10 +732,45 @@ static void audio_update_recv_buf(struct state_audio *s, size_t curr_frame_len)
         }
 }
 
+/// reports receiver-side latency of the participant in low-latency mode
+static void audio_report_latency(struct control_state *control, struct rtp *network_device, struct pdb_e *cp)
+{
+        std::ostringstream oss;
+        oss << "ALATENCY playout " << std::fixed << std::setprecision(2)
+                << pbuf_get_playout_delay(cp->playout_buffer) * 1000.0;
+        double rtt = 0.0;
+        if (rtp_get_rtt(network_device, &rtt)) {
+                oss << " rtt " << rtt * 1000.0;
+        }
+        control_report_stats(control, oss.str());
+}
+
+/// @returns true if --param low-latency-audio is set, ultra is set if "=ultra"
+static bool get_low_latency_audio(bool *ultra)
+{
+        const char *low_latency = get_commandline_param("low-latency-audio");
+        *ultra = low_latency != nullptr && strcmp(low_latency, "ultra") == 0;
+        return low_latency != nullptr;
+}
+
+static void set_audio_thread_priority(const char *thread)
+{
+        if (!set_thread_realtime_priority()) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Unable to set real-time priority of %s.\n", thread);
+        }
+}
+
 static void *audio_receiver_thread(void *arg)
 {
         set_thread_name(__func__);
         struct state_audio *s = (struct state_audio *) arg;
+        bool ultra_low_latency = false;
+        const bool low_latency = get_low_latency_audio(&ultra_low_latency);
+        if (low_latency) {
+                set_audio_thread_priority(__func__);
+        }
+        auto *control = (struct control_state *) get_module(get_root_module(s->audio_receiver_module.get()), "control");
+        time_ns_t last_latency_report = 0;
         // rtp variables
         struct pdb_e *cp;
         struct audio_desc device_desc{};
@@ -746,7 +802,7 @@ static void *audio_receiver_thread(void *arg)
 
                 if (s->receiver == NET_NATIVE || s->receiver == NET_STANDARD) {
                         time_ns_t curr_time = get_time_in_ns();
-                        uint32_t ts = (curr_time - s->start_time) / 100'000 * 9; // at 90000 Hz
+                        uint32_t ts = get_local_mediatime(); // same timeline as the data (SR NTP <-> RTP mapping)
                         rtp_update(s->audio_network_device, curr_time);
                         rtp_send_ctrl(s->audio_network_device, ts, 0, curr_time);
                         struct timeval timeout;
@@ -756,7 +812,7 @@ static void *audio_receiver_thread(void *arg)
                         if ((curr_time - last_not_timeout) > NS_IN_SEC) {
                                 timeout.tv_usec = 100000;
                         } else {
-                                timeout.tv_usec = 1000; // this stuff really smells !!!
+                                timeout.tv_usec = ultra_low_latency ? 250 : 1000; // this stuff really smells !!!
                         }
                         bool ret = rtp_recv_r(s->audio_network_device, &timeout, ts);
                         if (ret) {
@@ -781,8 +837,12 @@ static void *audio_receiver_thread(void *arg)
                                                 pdb_iter_done(&it);
                                         }
 
-                                        if (get_commandline_param("low-latency-audio")) {
-                                                pbuf_set_playout_delay(cp->playout_buffer, strcmp(get_commandline_param("low-latency-audio"), "ultra") == 0 ? 0.001 :0.005);
+                                        if (low_latency) {
+                                                // small playout buffer adapting to the measured jitter
+                                                pbuf_set_playout_delay(cp->playout_buffer, ultra_low_latency ? 0.001 : 0.005);
+                                                pbuf_set_adaptive_delay(cp->playout_buffer,
+                                                                ultra_low_latency ? 0.0005 : 0.001,
+                                                                ultra_low_latency ? 0.005 : 0.020);
                                         }
                                         cp->decoder_state = audio_decoder_state_create(s);
                                         if (!cp->decoder_state) {
@@ -804,6 +864,11 @@ static void *audio_receiver_thread(void *arg)
                                                 current_pbuf = &dec_state->pbuf_data;
                                                 decoded = true;
                                         }
+                                        if (low_latency && control != nullptr && control_stats_enabled(control) &&
+                                                        curr_time - last_latency_report > NS_IN_SEC) {
+                                                audio_report_latency(control, s->audio_network_device, cp);
+                                                last_latency_report = curr_time;
+                                        }
                                 }
 
                                 pbuf_remove(cp->playout_buffer, curr_time);
@@ -985,6 +1050,27 @@ static struct response *audio_sender_process_message(struct state_audio *s, stru
                         "0x%08" PRIx32 ".\n",
                         old_ssrc, rtp_my_ssrc(s->audio_network_device));
         } break;
+        case SENDER_MSG_ADD_RECEIVER:
+                assert(s->audio_tx_mode == MODE_SENDER);
+                if (!rtp_add_destination(s->audio_network_device, msg->dest.addr,
+                                         msg->dest.rtp_port,
+                                         msg->dest.rtcp_port)) {
+                        return new_response(RESPONSE_INT_SERV_ERR,
+                                            "Adding receiver failed!");
+                }
+                MSG(NOTICE, "Added receiver %s:%d\n", msg->dest.addr,
+                    msg->dest.rtp_port);
+                break;
+        case SENDER_MSG_REMOVE_RECEIVER:
+                assert(s->audio_tx_mode == MODE_SENDER);
+                if (!rtp_remove_destination(s->audio_network_device,
+                                            msg->dest.addr, msg->dest.rtp_port,
+                                            msg->dest.rtcp_port)) {
+                        return new_response(RESPONSE_NOT_FOUND, nullptr);
+                }
+                MSG(NOTICE, "Removed receiver %s:%d\n", msg->dest.addr,
+                    msg->dest.rtp_port);
+                break;
         }
         return new_response(RESPONSE_OK, nullptr);
 }
@@ -1066,42 +1152,25 @@ static int find_codec_sample_rate(int sample_rate, const int *supported) {
         return rate_hi > 0 ? rate_hi : rate_lo;
 }
 
+/**
+ * Capture stage of the audio sender - reads, filters and demultiplexes the
+ * captured audio and passes it to audio_sender_encoder_thread(). If the
+ * encoder does not keep up, the frame is dropped rather than delaying the
+ * capture.
+ */
 static void *audio_sender_thread(void *arg)
 {
         set_thread_name(__func__);
         struct state_audio *s = (struct state_audio *) arg;
         struct audio_frame *buffer = NULL;
-        unique_ptr<audio_frame2_resampler> resampler_state;
-        try {
-                resampler_state = unique_ptr<audio_frame2_resampler>(new audio_frame2_resampler);
-        } catch (ug_runtime_error &e) {
-                log_msg(LOG_LEVEL_ERROR, MOD_NAME "%s\n", e.what());
-                exit_uv(1);
-                return NULL;
+        bool ultra_low_latency = false;
+        if (get_low_latency_audio(&ultra_low_latency)) {
+                set_audio_thread_priority(__func__);
         }
 
         printf("Audio sending started.\n");
 
         while (!s->should_exit) {
-                struct message *msg;
-                while((msg = check_message(s->audio_sender_module.get()))) {
-                        struct response *r = audio_sender_process_message(s, (struct msg_sender *) msg);
-                        free_message(msg, r);
-                }
-
-                if ((s->audio_tx_mode & MODE_RECEIVER) == 0) { // otherwise receiver thread does the stuff...
-                        time_ns_t curr_time = get_time_in_ns();
-                        uint32_t ts = (curr_time - s->start_time) / 10'0000 * 9; // at 90000 Hz
-                        rtp_update(s->audio_network_device, curr_time);
-                        rtp_send_ctrl(s->audio_network_device, ts, 0, curr_time);
-
-                        // receive RTCP
-                        struct timeval timeout;
-                        timeout.tv_sec = 0;
-                        timeout.tv_usec = 0;
-                        rtcp_recv_r(s->audio_network_device, &timeout, ts);
-                }
-
                 buffer = audio_capture_read(s->audio_capture_device);
                 if(buffer) {
                         if(s->echo_state) {
@@ -1121,46 +1190,114 @@ static void *audio_sender_thread(void *arg)
                         if(!buffer)
                                 continue;
 
-                        audio_frame2 bf_n(buffer);
-
-                        // RESAMPLE
+#ifdef HAVE_JACK_TRANS
+                        if (s->sender == NET_JACK) {
+                                jack_send(s->jack_connection, buffer);
+                                continue;
+                        }
+#endif
                         int resample_to = s->resample_to;
                         if (resample_to == 0) {
                                 const int *supp_sample_rates = audio_codec_get_supported_samplerates(s->audio_encoder);
-                                resample_to = find_codec_sample_rate(bf_n.get_sample_rate(),
+                                resample_to = find_codec_sample_rate(buffer->sample_rate,
                                                 supp_sample_rates);
                         }
-                        if (resample_to != 0 && bf_n.get_sample_rate() != resample_to) {
-                                if (bf_n.get_bps() != 2) {
-                                        bf_n.change_bps(2);
-                                }
-
-                                bf_n.resample(*resampler_state, resample_to);
+                        const bool resample = resample_to != 0 && buffer->sample_rate != resample_to;
+                        // the resampler needs 16-bit samples - convert while demultiplexing
+                        audio_frame2 bf_n(buffer, resample ? 2 : buffer->bps);
+                        if (bf_n.get_timestamp() == -1) {
+                                // keep the capture time, not the time of sending
+                                bf_n.set_timestamp(get_local_mediatime() - get_local_mediatime_offset());
                         }
-                        // COMPRESS
-                        process_statistics(s, &bf_n);
-                        // SEND
-                        if(s->sender == NET_NATIVE) {
-                                audio_frame2 *uncompressed = &bf_n;
-                                while (audio_frame2 to_send = audio_codec_compress(s->audio_encoder, uncompressed)) {
-                                        if (s->fec_state != nullptr) {
-                                                to_send = s->fec_state->encode(to_send);
-                                        }
-                                        audio_tx_send(s->tx_session, s->audio_network_device, &to_send);
-                                        uncompressed = NULL;
+                        if (!s->sender_queue.push_nonblocking(std::move(bf_n))) {
+                                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('A', 'E', 'N', 'C'), MOD_NAME
+                                                "Audio encoder too slow, dropping captured frames!\n");
+                                MSG(VERBOSE, "Dropped captured frame.\n");
+                        }
+                }
+        }
+
+        return NULL;
+}
+
+/**
+ * Encode and send stage of the audio sender - resampling, statistics,
+ * compression, FEC and sending. Also handles sender messages and RTCP, so
+ * that the RTP session and FEC state are used by this thread only.
+ */
+static void *audio_sender_encoder_thread(void *arg)
+{
+        set_thread_name(__func__);
+        struct state_audio *s = (struct state_audio *) arg;
+        unique_ptr<audio_frame2_resampler> resampler_state;
+        try {
+                resampler_state = unique_ptr<audio_frame2_resampler>(new audio_frame2_resampler);
+        } catch (ug_runtime_error &e) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "%s\n", e.what());
+                exit_uv(1);
+                return NULL;
+        }
+        bool ultra_low_latency = false;
+        if (get_low_latency_audio(&ultra_low_latency)) {
+                set_audio_thread_priority(__func__);
+        }
+        // bounds the latency of message and RTCP processing if nothing is captured
+        const auto pop_timeout = std::chrono::milliseconds(ultra_low_latency ? 1 : 10);
+
+        while (!s->should_exit) {
+                struct message *msg;
+                while((msg = check_message(s->audio_sender_module.get()))) {
+                        struct response *r = audio_sender_process_message(s, (struct msg_sender *) msg);
+                        free_message(msg, r);
+                }
+
+                if ((s->audio_tx_mode & MODE_RECEIVER) == 0) { // otherwise receiver thread does the stuff...
+                        time_ns_t curr_time = get_time_in_ns();
+                        uint32_t ts = get_local_mediatime(); // same timeline as the data (SR NTP <-> RTP mapping)
+                        rtp_update(s->audio_network_device, curr_time);
+                        rtp_send_ctrl(s->audio_network_device, ts, 0, curr_time);
+
+                        // receive RTCP
+                        struct timeval timeout;
+                        timeout.tv_sec = 0;
+                        timeout.tv_usec = 0;
+                        rtcp_recv_r(s->audio_network_device, &timeout, ts);
+                }
+
+                audio_frame2 bf_n;
+                if (!s->sender_queue.timed_pop(bf_n, pop_timeout)) {
+                        continue;
+                }
+
+                // RESAMPLE
+                int resample_to = s->resample_to;
+                if (resample_to == 0) {
+                        const int *supp_sample_rates = audio_codec_get_supported_samplerates(s->audio_encoder);
+                        resample_to = find_codec_sample_rate(bf_n.get_sample_rate(),
+                                        supp_sample_rates);
+                }
+                if (resample_to != 0 && bf_n.get_sample_rate() != resample_to) {
+                        bf_n.resample(*resampler_state, resample_to);
+                }
+                // COMPRESS
+                process_statistics(s, &bf_n);
+                // SEND
+                if(s->sender == NET_NATIVE) {
+                        audio_frame2 *uncompressed = &bf_n;
+                        while (audio_frame2 to_send = audio_codec_compress(s->audio_encoder, uncompressed)) {
+                                if (s->fec_state != nullptr) {
+                                        to_send = s->fec_state->encode(to_send);
                                 }
-                        }else if(s->sender == NET_STANDARD){
-                            audio_frame2 *uncompressed = &bf_n;
-                            while (audio_frame2 compressed = audio_codec_compress(s->audio_encoder, uncompressed)) {
-                                    //TODO to be dynamic as a function of the selected codec, now only accepting mulaw without checking errors
-                                    audio_tx_send_standard(s->tx_session, s->audio_network_device, &compressed);
-                                    uncompressed = NULL;
-                            }
+                                audio_tx_send(s->tx_session, s->audio_network_device, &to_send);
+                                uncompressed = NULL;
                         }
-#ifdef HAVE_JACK_TRANS
-                        else
-                                jack_send(s->jack_connection, buffer);
-#endif
+                }else if(s->sender == NET_STANDARD){
+                    audio_frame2 *uncompressed = &bf_n;
+                    while (audio_frame2 compressed = audio_codec_compress(s->audio_encoder, uncompressed)) {
+                            //TODO to be dynamic as a function of the selected codec, now only accepting mulaw without checking errors
+                            audio_tx_send_standard(s->tx_session, s->audio_network_device, &compressed);
+                            uncompressed = NULL;
+                    }
                 }
         }
 
@@ -75,8 +75,22 @@ extern "C" {
  * @param[in] struct rtp *
  */
 #define AUDIO_PLAYBACK_PUT_NETWORK_DEVICE   3
+/**
+ * Queries current occupancy of the playback buffer (including the
+ * device buffer if possible) and the occupancy that the device tends to
+ * keep. Used by audio decoder to compensate the clock drift,
+ * see `--param audio-drift-fix`. Optional.
+ * @param[out] struct audio_playback_buffer_status
+ */
+#define AUDIO_PLAYBACK_CTL_QUERY_BUFFER     4
 /// @}
 
+/// @see AUDIO_PLAYBACK_CTL_QUERY_BUFFER
+struct audio_playback_buffer_status {
+        int fill;   ///< buffered sample frames
+        int target; ///< requested buffered sample frames
+};
+
 struct audio_playback_info {
         device_probe_func probe;
         void *(*init)(const char *cfg); ///< @param cfg is not NULL
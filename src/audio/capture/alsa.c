@@ -79,6 +79,7 @@ struct state_alsa_capture {
         long long int captured_samples;
 
         bool non_interleaved;
+        bool mmap; ///< read directly from the DMA buffer
 };
 
 static void audio_cap_alsa_probe(struct device_info **available_devices, int *count, void (**deleter)(void *))
@@ -99,6 +100,7 @@ static void audio_cap_alsa_help(void)
         color_printf(TERM_BOLD "\t-s alsa:opts=<opts>\n\n" TERM_RESET);
         color_printf(TERM_BOLD "\t<opts>" TERM_RESET " can be in format key1=value1:key2=value2, options are:\n");
         color_printf(TERM_BOLD "\t\tframes=<frames>" TERM_RESET " number of audio frames captured at a moment\n");
+        color_printf(TERM_BOLD "\t\tmmap" TERM_RESET " read samples directly from the (mmapped) device buffer\n");
 
         printf("\nAvailable ALSA capture devices\n");
         audio_alsa_list_devices();
@@ -147,12 +149,19 @@ static void * audio_cap_alsa_init(struct module *parent, const char *cfg)
 
         /* Set period size to 128 frames or more. */
         s->frames = 128;
+        const char *low_latency = get_commandline_param("low-latency-audio");
+        if (low_latency != NULL) {
+                // 1 or 2 ms
+                s->frames = s->frame.sample_rate / (strcmp(low_latency, "ultra") == 0 ? 1000 : 500);
+        }
 
         if (opts) {
                 char *item, *save_ptr;
                 while ((item = strtok_r(opts, ":", &save_ptr)) != NULL) {
                         if (strncmp(item, "frames=", strlen("frames=")) == 0) {
                                 s->frames = atoi(item + strlen("frames="));
+                        } else if (strcmp(item, "mmap") == 0) {
+                                s->mmap = true;
                         } else {
                                 fprintf(stderr, "[ALSA cap.] Unknown option: %s\n", item);
                                 goto error;
@@ -211,7 +220,21 @@ static void * audio_cap_alsa_init(struct module *parent, const char *cfg)
                 }
         }
 
-        if (!snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_RW_INTERLEAVED)) {
+        snd_pcm_access_t access = SND_PCM_ACCESS_RW_INTERLEAVED;
+        if (s->mmap) {
+                // the mmap copy handles any layout (and channel count)
+                if (!snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_MMAP_INTERLEAVED)) {
+                        access = SND_PCM_ACCESS_MMAP_INTERLEAVED;
+                } else if (!snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_MMAP_NONINTERLEAVED)) {
+                        access = SND_PCM_ACCESS_MMAP_NONINTERLEAVED;
+                } else {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Device doesn't support mmap access, using read.\n");
+                        s->mmap = false;
+                }
+        }
+        if (s->mmap) {
+                s->non_interleaved = false;
+        } else if (!snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_RW_INTERLEAVED)) {
                 s->non_interleaved = false;
         } else if (!snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_RW_NONINTERLEAVED)) {
                 if (s->frame.ch_count > 1) {
@@ -220,6 +243,7 @@ static void * audio_cap_alsa_init(struct module *parent, const char *cfg)
                         goto error;
                 } else {
                         s->non_interleaved = true;
+                        access = SND_PCM_ACCESS_RW_NONINTERLEAVED;
                 }
         } else {
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported access mode!\n");
@@ -230,8 +254,7 @@ static void * audio_cap_alsa_init(struct module *parent, const char *cfg)
         /* Set the desired hardware parameters. */
 
         /* Access mode */
-        rc = snd_pcm_hw_params_set_access(s->handle, params,
-                s->non_interleaved ? SND_PCM_ACCESS_RW_NONINTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED);
+        rc = snd_pcm_hw_params_set_access(s->handle, params, access);
         if (rc < 0) {
                 fprintf(stderr, MOD_NAME "unable to set interleaved mode: %s\n",
                         snd_strerror(rc));
@@ -309,9 +332,9 @@ static void * audio_cap_alsa_init(struct module *parent, const char *cfg)
         s->tmp_data = malloc(s->frames  * s->min_device_channels * s->frame.bps);
 
         log_msg(LOG_LEVEL_NOTICE, "ALSA capture configuration: %d channel%s, %d Bps, %d Hz, "
-                       "%ld samples per frame.\n", s->frame.ch_count,
+                       "%ld samples per frame%s.\n", s->frame.ch_count,
                        s->frame.ch_count == 1 ? "" : "s", s->frame.bps,
-                       s->frame.sample_rate, s->frames);
+                       s->frame.sample_rate, s->frames, s->mmap ? ", mmap" : "");
 
         free(tmp);
         return s;
@@ -334,7 +357,11 @@ static struct audio_frame *audio_cap_alsa_read(void *state)
                 read_ptr[0] = s->tmp_data;
         }
 
-        if (s->non_interleaved) {
+        if (s->mmap) {
+                // demultiplexed and converted directly from the DMA buffer
+                rc = alsa_mmap_transfer(s->handle, NULL, s->frame.data, s->frame.bps,
+                                s->frame.ch_count, s->frames, true);
+        } else if (s->non_interleaved) {
                 assert(s->frame.ch_count == 1);
                 discard_data = (char *) alloca(s->frames * s->frame.bps * (s->min_device_channels-1));
                 for (unsigned int i = 1; i < s->min_device_channels; ++i) {
@@ -359,6 +386,11 @@ static struct audio_frame *audio_cap_alsa_read(void *state)
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "short read, read %d frames\n", rc);
         }
 
+        if (rc > 0 && s->mmap) {
+                s->frame.data_len = rc * s->frame.bps * s->frame.ch_count;
+                s->captured_samples += rc;
+                return &s->frame;
+        }
         if(rc > 0) {
                 if ((int) s->min_device_channels > s->frame.ch_count && s->frame.ch_count == 1) {
                         demux_channel(s->frame.data, (char *) s->tmp_data, s->frame.bps,
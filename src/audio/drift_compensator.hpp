@@ -0,0 +1,135 @@
+/**
+ * @file   audio/drift_compensator.hpp
+ *
+ * Device independent compensation of the clock drift between the sender and
+ * the audio playback device. The occupancy of the playback buffer is driven
+ * to the target value by a PI controller that outputs the ratio for the
+ * fractional resampling (see audio_frame2::resample_fake()).
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AUDIO_DRIFT_COMPENSATOR_HPP_3F1C9A52_7E4B_4D1A_B8E6_0C5D2A9F4E71
+#define AUDIO_DRIFT_COMPENSATOR_HPP_3F1C9A52_7E4B_4D1A_B8E6_0C5D2A9F4E71
+
+#include <algorithm>
+#include <cmath>
+
+class audio_drift_compensator {
+public:
+        /**
+         * @param max_ppm    maximal deviation of the resampling ratio
+         * @param step_ppm   minimal change of the ratio that is reported to
+         *                   the caller (resampler reconfiguration is not free)
+         */
+        explicit audio_drift_compensator(double max_ppm = 1000, double step_ppm = 5) :
+                m_max_dev(max_ppm / 1E6), m_step(step_ppm / 1E6) {}
+
+        void reset() {
+                m_last_time = -1;
+                m_warmup = WARMUP_SEC;
+                m_integral = 0;
+                m_reported_ratio = 1;
+        }
+
+        /**
+         * @param fill        playback buffer occupancy (sample frames)
+         * @param target      requested occupancy (sample frames)
+         * @param sample_rate playback sample rate
+         * @param now         current time in seconds
+         * @returns true if the ratio (get_ratio()) has changed significantly
+         */
+        bool update(int fill, int target, int sample_rate, double now) {
+                if (sample_rate != m_sample_rate) {
+                        reset();
+                        m_sample_rate = sample_rate;
+                }
+                if (m_last_time < 0) {
+                        m_last_time = now;
+                        m_avg_fill = fill;
+                        return false;
+                }
+                double dt = now - m_last_time;
+                m_last_time = now;
+                if (dt <= 0) {
+                        return false;
+                }
+                // the read size granularity of the device makes the instant
+                // occupancy saw-toothed so it is smoothed first
+                double alpha = std::min(dt / FILL_AVG_SEC, 1.0);
+                m_avg_fill += alpha * (fill - m_avg_fill);
+                if (m_warmup > 0) { // let the buffer settle after (re)start
+                        m_warmup -= dt;
+                        return false;
+                }
+
+                double err = (m_avg_fill - target) / sample_rate; // seconds
+                double integral = m_integral + err * dt;
+                double dev = KP * err + KI * integral;
+                // do not integrate while saturated (anti-windup)
+                if (std::fabs(dev) < m_max_dev) {
+                        m_integral = integral;
+                }
+                dev = std::clamp(dev, -m_max_dev, m_max_dev);
+                // buffer above the target - the sink consumes slower than we
+                // receive, so less samples need to be produced
+                double ratio = 1.0 - dev;
+
+                if (std::fabs(ratio - m_reported_ratio) < m_step) {
+                        return false;
+                }
+                m_reported_ratio = ratio;
+                return true;
+        }
+
+        /// @returns dst/src ratio of sample counts to be applied to the received audio
+        double get_ratio() const { return m_reported_ratio; }
+
+private:
+        static constexpr double KP = 0.1;           ///< 10 ms error -> 1000 ppm
+        static constexpr double KI = 0.0025;        ///< critically damped (KP^2 = 4 KI)
+        static constexpr double FILL_AVG_SEC = 1.0;
+        static constexpr double WARMUP_SEC = 2.0;
+
+        double m_max_dev;
+        double m_step;
+
+        int m_sample_rate = 0;
+        double m_last_time = -1;
+        double m_warmup = WARMUP_SEC;
+        double m_avg_fill = 0;
+        double m_integral = 0;
+        double m_reported_ratio = 1;
+};
+
+#endif // defined AUDIO_DRIFT_COMPENSATOR_HPP_3F1C9A52_7E4B_4D1A_B8E6_0C5D2A9F4E71
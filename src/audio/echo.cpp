@@ -50,15 +50,23 @@
 #include <speex/speex_echo.h>
 
 #include <stdlib.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <mutex>
 #include <memory>
 #include <algorithm>
 #include <chrono>
+#include <thread>
 #include "utils/ring_buffer.h"
+#include "utils/thread.h"
 #include "host.h"
 
 #define SAMPLES_PER_FRAME (1 << 9) //512, about 10ms at 48kHz, power of two for easy FFT
 #define DEFAULT_FILTER_LENGTH (48 * 500)
+#define DEFAULT_MAX_WAIT_US 5000
+#define MAX_BACKLOG_FRAMES 8 // near end frames waiting, older are passed unprocessed
+#define STATS_INTERVAL_SEC 10
 
 #define MOD_NAME "[Echo cancel] "
 
@@ -76,39 +84,62 @@ namespace {
         };
 }
 
+/*
+ * The AEC itself runs in echo_thread(). Far end samples (echo_play(), playback
+ * thread), near end samples and the result (echo_cancel(), capture thread) are
+ * passed in SPSC lock-free ring buffers, the lock is used only to sleep on the
+ * condition variables, so neither the playback nor the capture waits for the
+ * AEC (capture waits for the result at most max_wait).
+ */
 struct echo_cancellation {
         std::unique_ptr<SpeexEchoState, Echo_state_deleter> echo_state;
 
-        ring_buffer_uniq near_end_ringbuf;
-        ring_buffer_uniq far_end_ringbuf;
+        ring_buffer_uniq near_end_ringbuf; // capture -> AEC
+        ring_buffer_uniq far_end_ringbuf;  // playback -> AEC
+        ring_buffer_uniq out_ringbuf;      // AEC -> capture
 
         std::unique_ptr<spx_int16_t[]> frame_data;
-        struct audio_frame frame;
+        struct audio_frame frame; // returned by echo_cancel()
 
         int requested_delay;
-        int prefill;
+        std::atomic_int prefill; // requested by AEC, done by echo_play() (writer)
         time_point next_expected_near;
+        std::chrono::microseconds max_wait{DEFAULT_MAX_WAIT_US};
+
+        std::atomic_int sample_rate{0};       // set by capture, applied by AEC
+        std::atomic_bool drop_far{false};     // set by capture, done by AEC (reader)
+        std::atomic_uint64_t near_written{0}; // samples written by capture
+        std::atomic_uint64_t near_done{0};    // near end samples processed or dropped by AEC
 
         std::unique_ptr<struct audio_export, Export_state_deleter> exporter;
 
         std::mutex lock;
+        std::condition_variable near_cv; // near end samples available
+        std::condition_variable out_cv;  // near end samples processed
+        bool should_exit = false;
+        std::thread thread;
+
+        // statistics, AEC thread only except late
+        long long processed = 0;
+        long long bypassed = 0; // passed unprocessed (no far end samples or catching up)
+        std::atomic_llong late{0}; // capture stopped waiting for the result
+        duration max_block_time{};
+        duration total_block_time{};
+        time_point last_stats;
 };
 
 ADD_TO_PARAM("echo-cancel-dump-audio", "* echo-cancel-dump-audio\n"
                 "  Dump near end, far end and output samples in separate channels to a wav file.\n");
 
-static void reconfigure_echo (struct echo_cancellation *s, int sample_rate, int bps);
+static void reconfigure_echo (struct echo_cancellation *s, int sample_rate);
 
-static void reconfigure_echo (struct echo_cancellation *s, int sample_rate, int bps)
+/// called from the AEC thread, rings are flushed from the reader side
+static void reconfigure_echo (struct echo_cancellation *s, int sample_rate)
 {
-        UNUSED(bps);
-
-        s->frame.bps = 2;
-        s->frame.ch_count = 1;
-        s->frame.sample_rate = sample_rate;
-
-        ring_buffer_flush(s->far_end_ringbuf.get());
-        ring_buffer_flush(s->near_end_ringbuf.get());
+        ring_advance_read_idx(s->far_end_ringbuf.get(), ring_get_current_size(s->far_end_ringbuf.get()));
+        int near_bytes = ring_get_current_size(s->near_end_ringbuf.get());
+        ring_advance_read_idx(s->near_end_ringbuf.get(), near_bytes);
+        s->near_done += near_bytes / 2;
 
         speex_echo_ctl(s->echo_state.get(), SPEEX_ECHO_SET_SAMPLING_RATE, &sample_rate); // should the 3rd parameter be int?
 
@@ -119,6 +150,112 @@ static void reconfigure_echo (struct echo_cancellation *s, int sample_rate, int
         }
 }
 
+static void print_stats(struct echo_cancellation *s)
+{
+        const long long blocks = s->processed + s->bypassed;
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "%lld blocks processed, %lld bypassed, %lld late results, block time avg %.3f ms, max %.3f ms\n",
+                        s->processed, s->bypassed, s->late.exchange(0),
+                        blocks == 0 ? 0.0 : std::chrono::duration<double, std::milli>(s->total_block_time).count() / blocks,
+                        std::chrono::duration<double, std::milli>(s->max_block_time).count());
+        s->processed = s->bypassed = 0;
+        s->max_block_time = s->total_block_time = {};
+}
+
+/// processes whole frames of near end samples (AEC thread)
+static void process_near_end(struct echo_cancellation *s)
+{
+        size_t near_end_samples = ring_get_current_size(s->near_end_ringbuf.get()) / 2;
+        size_t far_end_samples = ring_get_current_size(s->far_end_ringbuf.get()) / 2;
+
+        if(far_end_samples < near_end_samples){
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Not enough far end samples (%zu near, %zu far)\n", near_end_samples, far_end_samples);
+
+                //The delay between far end and near end will always be at least
+                //recorded frame length
+                s->prefill = near_end_samples + s->requested_delay;
+        }
+
+        size_t frames_to_process = near_end_samples / SAMPLES_PER_FRAME;
+        // bound the latency - if the AEC does not keep up, the oldest frames are passed unprocessed
+        size_t frames_to_bypass = frames_to_process > MAX_BACKLOG_FRAMES ? frames_to_process - MAX_BACKLOG_FRAMES : 0;
+
+        for(size_t i = 0; i < frames_to_process; i++){
+                spx_int16_t near_arr[SAMPLES_PER_FRAME];
+                spx_int16_t far_arr[SAMPLES_PER_FRAME];
+                spx_int16_t out_arr[SAMPLES_PER_FRAME];
+                const time_point t0 = steady_clock::now();
+
+                ring_buffer_read(s->near_end_ringbuf.get(), reinterpret_cast<char *>(near_arr), SAMPLES_PER_FRAME * 2);
+                const void *export_channels[] = {near_arr, far_arr, out_arr, nullptr};
+                if(far_end_samples >= SAMPLES_PER_FRAME){
+                        ring_buffer_read(s->far_end_ringbuf.get(), reinterpret_cast<char *>(far_arr), SAMPLES_PER_FRAME * 2);
+                        far_end_samples -= SAMPLES_PER_FRAME;
+                        if (i >= frames_to_bypass) {
+                                speex_echo_cancellation(s->echo_state.get(), near_arr, far_arr, out_arr);
+                                s->processed += 1;
+                        } else {
+                                memcpy(out_arr, near_arr, sizeof out_arr);
+                                s->bypassed += 1;
+                        }
+                } else {
+                        memcpy(out_arr, near_arr, sizeof out_arr);
+                        export_channels[1] = out_arr;
+                        s->bypassed += 1;
+                }
+
+                if(s->exporter){
+                        audio_export_raw_ch(s->exporter.get(), export_channels, SAMPLES_PER_FRAME);
+                }
+
+                if (ring_get_available_write_size(s->out_ringbuf.get()) < (int) sizeof out_arr) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Output ringbuf overflow!\n");
+                } else {
+                        ring_buffer_write(s->out_ringbuf.get(), reinterpret_cast<char *>(out_arr), sizeof out_arr);
+                }
+                s->near_done += SAMPLES_PER_FRAME;
+
+                const duration block_time = steady_clock::now() - t0;
+                s->total_block_time += block_time;
+                s->max_block_time = std::max(s->max_block_time, block_time);
+        }
+}
+
+static void echo_thread(struct echo_cancellation *s)
+{
+        set_thread_name(__func__);
+        int sample_rate = 0;
+        s->last_stats = steady_clock::now();
+
+        std::unique_lock lk(s->lock);
+        while (!s->should_exit) {
+                s->near_cv.wait_for(lk, std::chrono::seconds(1), [s, sample_rate] {
+                                return s->should_exit || s->sample_rate != sample_rate
+                                        || ring_get_current_size(s->near_end_ringbuf.get()) >= SAMPLES_PER_FRAME * 2;
+                                });
+                lk.unlock();
+
+                if (s->sample_rate != sample_rate) {
+                        sample_rate = s->sample_rate;
+                        reconfigure_echo(s, sample_rate);
+                }
+                if (s->drop_far.exchange(false)) {
+                        int current = ring_get_current_size(s->far_end_ringbuf.get());
+                        //drop only whole frames
+                        current = (current / (SAMPLES_PER_FRAME * 2)) * SAMPLES_PER_FRAME * 2;
+                        ring_advance_read_idx(s->far_end_ringbuf.get(), current);
+                }
+                process_near_end(s);
+
+                if (steady_clock::now() - s->last_stats > std::chrono::seconds(STATS_INTERVAL_SEC)) {
+                        print_stats(s);
+                        s->last_stats = steady_clock::now();
+                }
+
+                lk.lock();
+                s->out_cv.notify_one();
+        }
+}
+
 #define TEXTIFY(a) TEXTIFY2(a)
 #define TEXTIFY2(a) #a
 
@@ -129,6 +266,10 @@ ADD_TO_PARAM("echo-cancel-filter-length", "* echo-cancel-filter-length=<samples>
 ADD_TO_PARAM("echo-cancel-delay", "* echo-cancel-delay=<samples>\n"
                 "  Echo cancellation additional delay added to far end in samples, should be slightly less than output device latency.\n");
 
+ADD_TO_PARAM("echo-cancel-max-wait", "* echo-cancel-max-wait=<us>\n"
+                "  Maximal time the capture waits for echo cancellation result, the rest is passed with the next frame (default "
+                TEXTIFY(DEFAULT_MAX_WAIT_US) ").\n");
+
 struct echo_cancellation * echo_cancellation_init(void)
 {
         struct echo_cancellation *s = new echo_cancellation();
@@ -148,6 +289,13 @@ struct echo_cancellation * echo_cancellation_init(void)
                         s->requested_delay = len;
         }
 
+        if(const char *param = get_commandline_param("echo-cancel-max-wait"); param != nullptr){
+                char *end;
+                long us = strtol(param, &end, 10);
+                if(end != param && us >= 0)
+                        s->max_wait = std::chrono::microseconds(us);
+        }
+
         s->echo_state.reset(speex_echo_state_init(SAMPLES_PER_FRAME, filter_length));
 
         s->frame.data = NULL;
@@ -158,28 +306,35 @@ struct echo_cancellation * echo_cancellation_init(void)
 
         s->far_end_ringbuf.reset(ring_buffer_init(ringbuf_sample_count * bps));
         s->near_end_ringbuf.reset(ring_buffer_init(ringbuf_sample_count * bps));
+        s->out_ringbuf.reset(ring_buffer_init(ringbuf_sample_count * bps));
 
         s->frame_data = std::make_unique<spx_int16_t[]>(ringbuf_sample_count);
         s->frame.data = reinterpret_cast<char *>(s->frame_data.get());
         s->frame.max_size = ringbuf_sample_count * sizeof(s->frame_data[0]);
         static_assert(sizeof(s->frame_data[0]) == bps);
 
-        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Echo cancellation initialized with filter length %d samples.\n", filter_length);
-
         s->prefill = 0;
 
+        s->thread = std::thread(echo_thread, s);
+
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Echo cancellation initialized with filter length %d samples.\n", filter_length);
+
         return s;
 }
 
 void echo_cancellation_destroy(struct echo_cancellation *s)
 {
+        {
+                std::lock_guard lk(s->lock);
+                s->should_exit = true;
+        }
+        s->near_cv.notify_one();
+        s->thread.join();
         delete s;
 }
 
 void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
 {
-        std::lock_guard lk(s->lock);
-
         if(frame->ch_count != 1) {
                 static int prints = 0;
                 if(prints++ % 100 == 0) {
@@ -189,16 +344,15 @@ void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
                 return;
         }
 
-        if(s->prefill){
-                int target = std::max(SAMPLES_PER_FRAME, (s->prefill / SAMPLES_PER_FRAME) * SAMPLES_PER_FRAME);
-                int current = ring_get_current_size(s->far_end_ringbuf.get());
+        if(int prefill = s->prefill.exchange(0); prefill != 0){
+                int target = std::max(SAMPLES_PER_FRAME, (prefill / SAMPLES_PER_FRAME) * SAMPLES_PER_FRAME);
+                int current = ring_get_current_size(s->far_end_ringbuf.get()) / 2;
                 //buffer can contain small remainder (<SAMPLES_PER_FRAME)
                 int to_fill = target - current;
-                s->prefill = 0;
                 if(to_fill < 0){
                         log_msg(LOG_LEVEL_WARNING, MOD_NAME "Pre fill requested to %d, but the buffer is already %d!\n", target, current);
                 } else {
-                        ring_advance_write_idx(s->far_end_ringbuf.get(), to_fill);
+                        ring_advance_write_idx(s->far_end_ringbuf.get(), to_fill * 2);
                         log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Pre filling far end with %d samples\n", to_fill);
                 }
         }
@@ -223,7 +377,7 @@ void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
                 int in_bytes1 = (size1 / 2) * frame->bps;
                 change_bps(static_cast<char *>(ptr1), 2, frame->data, frame->bps, in_bytes1);
                 if(ptr2){
-                        change_bps(static_cast<char *>(ptr2), 2, frame->data + in_bytes1, frame->bps, frame->data_len - in_bytes1);
+                        change_bps(static_cast<char *>(ptr2), 2, frame->data + in_bytes1, frame->bps, samples * frame->bps - in_bytes1);
                 }
 
                 ring_advance_write_idx(s->far_end_ringbuf.get(), samples * 2);
@@ -234,10 +388,6 @@ void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
 
 struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame *frame)
 {
-        struct audio_frame *res;
-
-        std::lock_guard lk(s->lock);
-
         if(frame->ch_count != 1) {
                 static int prints = 0;
                 if(prints++ % 100 == 0)
@@ -246,13 +396,15 @@ struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame
                 return frame;
         }
 
-
-        if(frame->sample_rate != s->frame.sample_rate ||
-                        frame->bps != s->frame.bps) {
-                reconfigure_echo(s, frame->sample_rate, frame->bps);
+        if(frame->sample_rate != s->frame.sample_rate) {
+                s->frame.bps = 2;
+                s->frame.ch_count = 1;
+                s->frame.sample_rate = frame->sample_rate;
+                // drop the result at the old rate (we are the reader)
+                ring_advance_read_idx(s->out_ringbuf.get(), ring_get_current_size(s->out_ringbuf.get()));
+                s->sample_rate = frame->sample_rate; // AEC thread reconfigures
         }
 
-
         size_t in_frame_samples = frame->data_len / frame->bps;
 
         size_t ringbuf_free_samples = ring_get_available_write_size(s->near_end_ringbuf.get()) / 2;
@@ -272,10 +424,7 @@ struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame
                 long long delay = std::chrono::duration_cast<std::chrono::microseconds>(diff).count();
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "Near samples late by %lldus\n", delay);
 
-                int current = ring_get_current_size(s->far_end_ringbuf.get());
-                //drop only whole frames
-                current = (current / SAMPLES_PER_FRAME) * SAMPLES_PER_FRAME;
-                ring_advance_read_idx(s->far_end_ringbuf.get(), current);
+                s->drop_far = true;
         }
         s->next_expected_near = steady_clock::now() + std::chrono::seconds(1);
 
@@ -291,61 +440,29 @@ struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame
                 int in_bytes1 = (size1 / 2) * frame->bps;
                 change_bps(static_cast<char *>(ptr1), 2, frame->data, frame->bps, in_bytes1);
                 if(ptr2){
-                        change_bps(static_cast<char *>(ptr2), 2, frame->data + in_bytes1, frame->bps, frame->data_len - in_bytes1);
+                        change_bps(static_cast<char *>(ptr2), 2, frame->data + in_bytes1, frame->bps, in_frame_samples * frame->bps - in_bytes1);
                 }
                 ring_advance_write_idx(s->near_end_ringbuf.get(), in_frame_samples * 2);
         } else {
-                ring_buffer_write(s->near_end_ringbuf.get(), frame->data, frame->data_len);
+                ring_buffer_write(s->near_end_ringbuf.get(), frame->data, in_frame_samples * 2);
         }
-
-        size_t near_end_samples = ring_get_current_size(s->near_end_ringbuf.get()) / 2;
-        size_t far_end_samples = ring_get_current_size(s->far_end_ringbuf.get()) / 2;
-
-        if(far_end_samples < near_end_samples){
-                log_msg(LOG_LEVEL_INFO, MOD_NAME "Not enough far end samples (%zu near, %zu far)\n", near_end_samples, far_end_samples);
-
-                //The delay between far end and near end will always be at least
-                //recorded frame length
-                s->prefill = in_frame_samples + s->requested_delay;
+        s->near_written += in_frame_samples;
+
+        {
+                std::unique_lock lk(s->lock);
+                s->near_cv.notify_one();
+                // wait (bounded) until all whole frames are processed
+                if (!s->out_cv.wait_for(lk, s->max_wait, [s] {
+                                        return s->near_written - s->near_done < SAMPLES_PER_FRAME;
+                                        })) {
+                        s->late += 1;
+                }
         }
 
-        size_t frames_to_process = near_end_samples / SAMPLES_PER_FRAME;
-        if(!frames_to_process){
+        int out_size = std::min(ring_get_current_size(s->out_ringbuf.get()), s->frame.max_size);
+        if (out_size == 0) {
                 return NULL;
         }
-
-        size_t out_size = frames_to_process * SAMPLES_PER_FRAME * 2;
-        assert(static_cast<size_t>(s->frame.max_size) >= out_size);
-        s->frame.data_len = out_size;
-        res = &s->frame;
-
-        spx_int16_t *out_ptr = (spx_int16_t *)(void *) s->frame.data;
-        for(size_t i = 0; i < frames_to_process; i++){
-                spx_int16_t near_arr[SAMPLES_PER_FRAME];
-                spx_int16_t far_arr[SAMPLES_PER_FRAME];
-
-                const void *export_channels[] = {near_arr, far_arr, out_ptr, nullptr};
-                if(far_end_samples >= SAMPLES_PER_FRAME){
-                        ring_buffer_read(s->far_end_ringbuf.get(), reinterpret_cast<char *>(far_arr), SAMPLES_PER_FRAME * 2);
-                        ring_buffer_read(s->near_end_ringbuf.get(), reinterpret_cast<char *>(near_arr), SAMPLES_PER_FRAME * 2);
-
-                        speex_echo_cancellation(s->echo_state.get(), near_arr, far_arr, out_ptr); 
-                        far_end_samples -= SAMPLES_PER_FRAME;
-
-                } else {
-                        ring_buffer_read(s->near_end_ringbuf.get(), reinterpret_cast<char *>(out_ptr), SAMPLES_PER_FRAME * 2);
-                        export_channels[0] = out_ptr;
-                        export_channels[1] = out_ptr;
-                        export_channels[2] = out_ptr;
-                }
-
-                if(s->exporter){
-                        audio_export_raw_ch(s->exporter.get(), export_channels, SAMPLES_PER_FRAME);
-                }
-
-                out_ptr += SAMPLES_PER_FRAME;
-        }
-
-        return res;
+        s->frame.data_len = ring_buffer_read(s->out_ringbuf.get(), s->frame.data, out_size);
+        return &s->frame;
 }
-
@@ -110,6 +110,7 @@ struct state_alsa_playback {
         snd_config_t * local_config;
 
         bool non_interleaved;
+        bool mmap; ///< write directly to the DMA buffer
         playback_mode_t playback_mode;
 
         snd_pcm_uframes_t period_size;
@@ -123,6 +124,8 @@ struct state_alsa_playback {
         audio_buffer_t *buf;
         long int audio_buf_len_ms;
 #endif
+        /// protects should_exit_thread and the speex jitter buffer,
+        /// audio_buffer is SPSC lock-free and is accessed without locking
         pthread_mutex_t lock;
         bool should_exit_thread;
         bool thread_started;
@@ -200,10 +203,11 @@ static void *worker(void *args) {
                 int start_offset;
                 int err = jitter_buffer_get(s->buf, &pkt, len, &start_offset);
 			jitter_buffer_tick(s->buf);
+                pthread_mutex_unlock(&s->lock);
 #else
+                pthread_mutex_unlock(&s->lock);
                 int ret = audio_buffer_read(s->buf, data, len);
 #endif
-                pthread_mutex_unlock(&s->lock);
 
 #ifdef USE_SPEEX_JITTER_BUFFER
                 if (err == JITTER_BUFFER_OK) {
@@ -366,6 +370,36 @@ static bool audio_play_alsa_query_format(struct state_alsa_playback *s, void *da
         return true;
 }
 
+static bool audio_play_alsa_query_buffer(struct state_alsa_playback *s, void *data, size_t *len)
+{
+        struct audio_playback_buffer_status status;
+        if (*len < sizeof status || s->handle == NULL) {
+                return false;
+        }
+        if (s->playback_mode == SYNC) {
+                snd_pcm_sframes_t delay = 0;
+                if (snd_pcm_delay(s->handle, &delay) < 0) {
+                        return false;
+                }
+                status.fill = delay;
+                status.target = s->buffer_size / 2;
+        } else {
+#ifdef USE_SPEEX_JITTER_BUFFER
+                return false;
+#else
+                if (s->buf == NULL) {
+                        return false;
+                }
+                audio_buffer_get_fill(s->buf, &status.fill, &status.target);
+                status.fill /= s->desc.bps * s->desc.ch_count;
+                status.target /= s->desc.bps * s->desc.ch_count;
+#endif
+        }
+        memcpy(data, &status, sizeof status);
+        *len = sizeof status;
+        return true;
+}
+
 static bool audio_play_alsa_ctl(void *state, int request, void *data, size_t *len)
 {
         struct state_alsa_playback *s = (struct state_alsa_playback *) state;
@@ -373,6 +407,8 @@ static bool audio_play_alsa_ctl(void *state, int request, void *data, size_t *le
         switch (request) {
         case AUDIO_PLAYBACK_CTL_QUERY_FORMAT:
                 return audio_play_alsa_query_format(s, data, len);
+        case AUDIO_PLAYBACK_CTL_QUERY_BUFFER:
+                return audio_play_alsa_query_buffer(s, data, len);
         default:
                 return false;
         }
@@ -391,8 +427,6 @@ static void alsa_play_async_callback(snd_async_handler_t *handler) {
 
         char *data = malloc(len);
 
-        pthread_mutex_lock(&s->lock);
-
         snd_pcm_sframes_t avail;
         avail = snd_pcm_avail_update(s->handle);
         while (avail >= (snd_pcm_sframes_t) s->period_size)
@@ -407,8 +441,6 @@ static void alsa_play_async_callback(snd_async_handler_t *handler) {
         }
 
         free(data);
-
-        pthread_mutex_unlock(&s->lock);
 }
 
 static void write_fill(struct state_alsa_playback *s) {
@@ -427,6 +459,8 @@ static void write_fill(struct state_alsa_playback *s) {
 
 ADD_TO_PARAM("alsa-playback-buffer", "* alsa-playback-buffer=<len>\n"
                                 "  Buffer length. Can be used to balance robustness and latency, in microseconds.\n");
+ADD_TO_PARAM("alsa-playback-mmap", "* alsa-playback-mmap\n"
+                                "  Use mmap access - write samples directly to the device buffer.\n");
 ADD_TO_PARAM("alsa-play-period-size", "* alsa-play-period-size=<frames>\n"
                                     "  ALSA playback period size in frames (default is device minimum) .\n");
 /**
@@ -484,8 +518,18 @@ static bool audio_play_alsa_reconfigure(void *state, struct audio_desc desc)
 
         /* Set the desired hardware parameters. */
 
+        s->mmap = get_commandline_param("alsa-playback-mmap") != NULL;
+        if (s->mmap) {
+                // the mmap copy handles any layout
+                if (snd_pcm_hw_params_set_access(s->handle, params, SND_PCM_ACCESS_MMAP_INTERLEAVED) < 0 &&
+                                snd_pcm_hw_params_set_access(s->handle, params, SND_PCM_ACCESS_MMAP_NONINTERLEAVED) < 0) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Device doesn't support mmap access, using write.\n");
+                        s->mmap = false;
+                }
+        }
+
         /* Interleaved mode */
-        rc = snd_pcm_hw_params_set_access(s->handle, params,
+        rc = s->mmap ? 0 : snd_pcm_hw_params_set_access(s->handle, params,
                         SND_PCM_ACCESS_RW_INTERLEAVED);
         if (rc < 0) {
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "cannot set interleaved hw access: %s\n",
@@ -675,6 +719,8 @@ static void audio_play_alsa_help(void) {
         color_printf("\t\tuse selected API ('thread' is default)\n");
         color_printf(TERM_BOLD "\talsa-playback-buffer=[<us>-]<us>\n" TERM_RESET);
         color_printf("\t\tset buffer max and optionally max (thread and async API only)\n");
+        color_printf(TERM_BOLD "\talsa-playback-mmap\n" TERM_RESET);
+        color_printf("\t\twrite samples directly to the (mmapped) device buffer\n");
         color_printf(TERM_BOLD "\taudio-buffer-len=<ablen>\n" TERM_RESET);
         color_printf("\t\tlength of UG internal ALSA buffer (in milliseconds)\n");
         printf("\n");
@@ -907,7 +953,11 @@ error:
         return NULL;
 }
 
-static int write_samples(snd_pcm_t *handle, const char *data, int bps, int ch_count, int frames, bool noninterleaved, playback_mode_t playback_mode, char *tmp_buffer) {
+static int write_samples(snd_pcm_t *handle, const char *data, int bps, int ch_count, int frames, bool noninterleaved, bool mmap, playback_mode_t playback_mode, char *tmp_buffer) {
+        if (mmap) { // muxed and converted directly to the DMA buffer
+                return alsa_mmap_transfer(handle, data, NULL, bps, ch_count, frames,
+                                playback_mode != SYNC);
+        }
         char *write_ptr[ch_count]; // for non-interleaved
         long data_len = bps * ch_count * frames;
         if (noninterleaved) {
@@ -957,7 +1007,7 @@ static void audio_play_alsa_write_frame(void *state, const struct audio_frame *f
 #endif
 
         int frames = frame->data_len / (frame->bps * frame->ch_count);
-        rc = write_samples(s->handle, frame->data, frame->bps, frame->ch_count, frames, s->non_interleaved, s->playback_mode, s->scratchpad);
+        rc = write_samples(s->handle, frame->data, frame->bps, frame->ch_count, frames, s->non_interleaved, s->mmap, s->playback_mode, s->scratchpad);
         if (rc == -EPIPE) {
                 /* EPIPE means underrun */
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "underrun occurred\n");
@@ -968,7 +1018,7 @@ static void audio_play_alsa_write_frame(void *state, const struct audio_frame *f
                         if (f + frames > s->buffer_size) {
                                 frames_to_write = s->buffer_size - frames;
                         }
-                        int rc = write_samples(s->handle, frame->data, frame->bps, frame->ch_count, frames_to_write, s->non_interleaved, s->playback_mode, s->scratchpad);
+                        int rc = write_samples(s->handle, frame->data, frame->bps, frame->ch_count, frames_to_write, s->non_interleaved, s->mmap, s->playback_mode, s->scratchpad);
                         if(rc < 0) {
                                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "error from writei: %s\n",
                                                 snd_strerror(rc));
@@ -1006,8 +1056,8 @@ static void audio_play_alsa_put_frame(void *state, const struct audio_frame *fra
         }
 
         if (s->playback_mode == THREAD || s->playback_mode == ASYNC) {
-               pthread_mutex_lock(&s->lock);
 #ifdef USE_SPEEX_JITTER_BUFFER
+                pthread_mutex_lock(&s->lock);
                 JitterBufferPacket pkt;
                 pkt.data = frame->data;
                 pkt.len = frame->data_len;
@@ -1015,10 +1065,10 @@ static void audio_play_alsa_put_frame(void *state, const struct audio_frame *fra
                 pkt.span = frame->data_len / s->desc.bps / s->desc.ch_count;
                 s->timestamp += pkt.span;
                 jitter_buffer_put(s->buf, &pkt);
+                pthread_mutex_unlock(&s->lock);
 #else
                 audio_buffer_write(s->buf, frame->data, frame->data_len);
 #endif
-                pthread_mutex_unlock(&s->lock);
         } else {
                 audio_play_alsa_write_frame(state, frame);
         }
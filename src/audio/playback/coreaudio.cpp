@@ -130,8 +130,10 @@ static OSStatus theRenderProc(void *inRefCon,
         return noErr;
 }
 
-static bool audio_play_ca_ctl(void *state [[gnu::unused]], int request, void *data, size_t *len)
+static bool audio_play_ca_ctl(void *state, int request, void *data, size_t *len)
 {
+        auto *s = static_cast<struct state_ca_playback *>(state);
+
         switch (request) {
         case AUDIO_PLAYBACK_CTL_QUERY_FORMAT:
                 if (*len >= sizeof(struct audio_desc)) {
@@ -144,6 +146,18 @@ static bool audio_play_ca_ctl(void *state [[gnu::unused]], int request, void *da
                 } else{
                         return false;
                 }
+        case AUDIO_PLAYBACK_CTL_QUERY_BUFFER: {
+                struct audio_playback_buffer_status status{};
+                if (s->buffer_fns == nullptr || s->audio_packet_size == 0 || *len < sizeof status) {
+                        return false;
+                }
+                s->buffer_fns->get_fill(s->buffer, &status.fill, &status.target);
+                status.fill /= s->audio_packet_size;
+                status.target /= s->audio_packet_size;
+                memcpy(data, &status, sizeof status);
+                *len = sizeof status;
+                return true;
+        }
         default:
                 return false;
         }
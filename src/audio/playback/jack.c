@@ -286,6 +286,19 @@ static bool audio_play_jack_ctl(void *state, int request, void *data, size_t *le
         switch (request) {
         case AUDIO_PLAYBACK_CTL_QUERY_FORMAT:
                 return audio_play_jack_query_format(s, data, len);
+        case AUDIO_PLAYBACK_CTL_QUERY_BUFFER: {
+                struct audio_playback_buffer_status status;
+                if (s->buffer_fns == NULL || *len < sizeof status) {
+                        return false;
+                }
+                s->buffer_fns->get_fill(s->data, &status.fill, &status.target);
+                const int frame_size = s->desc.ch_count * (int) sizeof(float);
+                status.fill /= frame_size;
+                status.target /= frame_size;
+                memcpy(data, &status, sizeof status);
+                *len = sizeof status;
+                return true;
+        }
         default:
                 return false;
         }
@@ -52,17 +52,26 @@
 #include "rtp/rtp.h"
 #include "transmit.h"
 #include "utils/audio_buffer.h"
+#include "utils/misc.h"
 #include "utils/thread.h"
+#include "utils/worker.h"
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <iostream>
 #include <map>
 #include <mutex>
 #include <thread>
 #include <vector>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define SAMPLE_RATE 48000
 #define BPS     2 /// @todo 4?
-#define CHANNELS 1
+#define DEFAULT_CHANNELS 1
+#define MAX_CHANNELS 16
 #define FRAMES_PER_SEC 25
 static_assert(SAMPLE_RATE % FRAMES_PER_SEC == 0, "Sample rate not divisible by frames per sec!");
 #define SAMPLES_PER_FRAME (SAMPLE_RATE / FRAMES_PER_SEC)
@@ -115,9 +124,9 @@ static void mixer_dummy_rtp_callback(struct rtp *session [[gnu::unused]], rtp_ev
 }
 
 struct am_participant {
-        am_participant(struct socket_udp_local *l, struct sockaddr_storage *ss, string const & audio_codec) {
+        am_participant(struct socket_udp_local *l, struct sockaddr_storage *ss, string const & audio_codec, int channels) {
                 assert(l != nullptr && ss != nullptr);
-                m_buffer = audio_buffer_init(SAMPLE_RATE, BPS, CHANNELS, get_commandline_param("low-latency-audio") ? 50 : 5);
+                m_buffer = audio_buffer_init(SAMPLE_RATE, BPS, channels, get_commandline_param("low-latency-audio") ? 50 : 5);
                 assert(m_buffer != NULL);
                 struct sockaddr *sa = (struct sockaddr *) ss;
                 assert(ss->ss_family == AF_INET || ss->ss_family == AF_INET6);
@@ -133,6 +142,8 @@ struct am_participant {
                         LOG(LOG_LEVEL_ERROR) << "Audio coder init failed!\n";
                         throw 1;
                 }
+                m_samples.resize(SAMPLES_PER_FRAME * channels);
+                m_frame.init(channels, AC_PCM, BPS, SAMPLE_RATE);
         }
         ~am_participant() {
                 if (m_tx_session) {
@@ -154,6 +165,8 @@ struct am_participant {
 		m_network_device = std::move(other.m_network_device);
 		m_tx_session = std::move(other.m_tx_session);
 		last_seen = std::move(other.last_seen);
+		m_samples = std::move(other.m_samples);
+		m_frame = std::move(other.m_frame);
 		other.m_audio_coder = nullptr;
 		other.m_buffer = nullptr;
 		other.m_tx_session = nullptr;
@@ -168,21 +181,9 @@ struct am_participant {
         struct rtp *m_network_device;
         struct tx *m_tx_session;
         chrono::steady_clock::time_point last_seen;
-};
-
-template<typename source_t, typename intermediate_t>
-class generic_mix_algo {
-public:
-        virtual ~generic_mix_algo() {}
-        virtual intermediate_t add_to_mix(intermediate_t dst, source_t sample) {
-                return dst + sample;
-        }
-
-        virtual intermediate_t get_mixed_without_source_sample(intermediate_t mix, source_t source_sample) {
-                return mix - source_sample;
-        }
-
-        virtual intermediate_t normalize(intermediate_t sample) = 0;
+        // used only by the mixer worker
+        vector<sample_type_source> m_samples; ///< interleaved source, mix-minus after mixing
+        audio_frame2 m_frame;                 ///< m_samples to be compressed
 };
 
 /**
@@ -192,9 +193,8 @@ public:
  * substracted with substracted source may be ok.
  */
 template<typename source_t, typename intermediate_t>
-class linear_mix_algo : public generic_mix_algo<source_t, intermediate_t> {
-public:
-        intermediate_t normalize(intermediate_t sample) override {
+struct linear_mix_algo {
+        static intermediate_t normalize(intermediate_t sample) {
                 // clamp the value since linear mixer doesn't normalize values
                 return min<intermediate_t>(max<intermediate_t>(sample, numeric_limits<source_t>::min()), numeric_limits<source_t>::max());
         }
@@ -208,11 +208,10 @@ public:
  * Threshold is 0.5.
  */
 template<typename source_t, typename intermediate_t>
-class logarithmic_mix_algo : public generic_mix_algo<source_t, intermediate_t> {
-public:
+struct logarithmic_mix_algo {
         static constexpr double t = 0.5;
         static constexpr double alpha = 5.71144;
-        intermediate_t normalize(intermediate_t sample) override {
+        static intermediate_t normalize(intermediate_t sample) {
 		if (sample >= numeric_limits<source_t>::min() / 2 &&
 				sample <= numeric_limits<source_t>::max() / 2) {
 			return sample;
@@ -224,6 +223,59 @@ public:
         }
 };
 
+/// mixed[i] += src[i]
+static void mix_add(sample_type_mixed *mixed, const sample_type_source *src, int count)
+{
+        int i = 0;
+#ifdef __SSE2__
+        for ( ; i + 8 <= count; i += 8) {
+                __m128i in = _mm_loadu_si128((const __m128i *)(const void *) (src + i));
+                // sign-extend to 32 bits
+                __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+                __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+                __m128i *dst = (__m128i *)(void *) (mixed + i);
+                _mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst), lo));
+                _mm_storeu_si128(dst + 1, _mm_add_epi32(_mm_loadu_si128(dst + 1), hi));
+        }
+#endif
+        for ( ; i < count; ++i) {
+                mixed[i] += src[i];
+        }
+}
+
+/// samples[i] = normalize(mixed[i] - samples[i]), ie. the mix without the participant
+template<typename algo>
+static void mix_minus(sample_type_source *samples, const sample_type_mixed *mixed, int count)
+{
+        for (int i = 0; i < count; ++i) {
+                samples[i] = algo::normalize(mixed[i] - samples[i]);
+        }
+}
+
+#ifdef __SSE2__
+/// linear mix only clamps - use saturating pack
+template<>
+void mix_minus<linear_mix_algo<sample_type_source, sample_type_mixed>>(sample_type_source *samples,
+                const sample_type_mixed *mixed, int count)
+{
+        static_assert(sizeof(sample_type_source) == 2 && sizeof(sample_type_mixed) == 4, "SSE2 kernel expects int16/int32");
+        int i = 0;
+        for ( ; i + 8 <= count; i += 8) {
+                __m128i *smp = (__m128i *)(void *) (samples + i);
+                __m128i in = _mm_loadu_si128(smp);
+                __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+                __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+                const __m128i *mix = (const __m128i *)(const void *) (mixed + i);
+                lo = _mm_sub_epi32(_mm_loadu_si128(mix), lo);
+                hi = _mm_sub_epi32(_mm_loadu_si128(mix + 1), hi);
+                _mm_storeu_si128(smp, _mm_packs_epi32(lo, hi));
+        }
+        for ( ; i < count; ++i) {
+                samples[i] = linear_mix_algo<sample_type_source, sample_type_mixed>::normalize(mixed[i] - samples[i]);
+        }
+}
+#endif
+
 struct state_audio_mixer final {
         state_audio_mixer(const char *cfg) {
                 if (cfg) {
@@ -237,13 +289,19 @@ struct state_audio_mixer final {
                                 } else if (strncmp(item, "algo=", strlen("algo=")) == 0) {
                                         string algo = item + strlen("algo=");
                                         if (algo == "linear") {
-                                                mixing_algorithm = decltype(mixing_algorithm)(new linear_mix_algo<sample_type_source, sample_type_mixed>());
+                                                mix_minus_func = mix_minus<linear_mix_algo<sample_type_source, sample_type_mixed>>;
                                         } else if (algo == "logarithmic") {
-                                                mixing_algorithm = decltype(mixing_algorithm)(new logarithmic_mix_algo<sample_type_source, sample_type_mixed>());
+                                                mix_minus_func = mix_minus<logarithmic_mix_algo<sample_type_source, sample_type_mixed>>;
                                         } else {
                                                 LOG(LOG_LEVEL_ERROR) << "Unknown mixing algorithm: " << algo << "\n";
                                                 throw 1;
                                         }
+                                } else if (strncmp(item, "channels=", strlen("channels=")) == 0) {
+                                        channels = atoi(item + strlen("channels="));
+                                        if (channels < 1 || channels > MAX_CHANNELS) {
+                                                LOG(LOG_LEVEL_ERROR) << "Wrong channel count: " << item + strlen("channels=") << "\n";
+                                                throw 1;
+                                        }
                                 } else {
                                         LOG(LOG_LEVEL_ERROR) << "Unknown option: " << item << "\n";
                                         throw 1;
@@ -276,11 +334,57 @@ struct state_audio_mixer final {
 
         struct socket_udp_local *recv_socket{};
         string audio_codec{"PCM"};
+        int channels = DEFAULT_CHANNELS;
 private:
+        static void *send_task(void *arg);
+        void send(am_participant *p);
+
         thread thread_id;
-        unique_ptr<generic_mix_algo<sample_type_source, sample_type_mixed>> mixing_algorithm{new linear_mix_algo<sample_type_source, sample_type_mixed>()};
+        void (*mix_minus_func)(sample_type_source *, const sample_type_mixed *, int) =
+                mix_minus<linear_mix_algo<sample_type_source, sample_type_mixed>>;
+        // worker buffers, preallocated
+        vector<sample_type_mixed> mixed;
+        vector<am_participant *> active; ///< participants mixed in current tick
 };
 
+struct mixer_send_task_data {
+        state_audio_mixer *s;
+        int first;              ///< index to state_audio_mixer::active
+        int stride;
+};
+
+/// subtracts the participant signal from the mix, compresses and sends the result
+void state_audio_mixer::send(am_participant *p)
+{
+        const int count = SAMPLES_PER_FRAME * channels;
+        mix_minus_func(p->m_samples.data(), mixed.data(), count);
+
+        const size_t ch_len = SAMPLES_PER_FRAME * sizeof(sample_type_source);
+        for (int ch = 0; ch < channels; ++ch) {
+                p->m_frame.resize(ch, ch_len);
+                auto *dst = (sample_type_source *)(void *) p->m_frame.get_data(ch);
+                const sample_type_source *src = p->m_samples.data() + ch;
+                for (int i = 0; i < SAMPLES_PER_FRAME; ++i) {
+                        dst[i] = src[i * channels];
+                }
+        }
+
+        const audio_frame2 *uncompressed = &p->m_frame;
+        while (audio_frame2 compressed = audio_codec_compress(p->m_audio_coder, uncompressed)) {
+                audio_tx_send(p->m_tx_session, p->m_network_device, &compressed);
+                uncompressed = nullptr;
+        }
+}
+
+void *state_audio_mixer::send_task(void *arg)
+{
+        auto *d = (struct mixer_send_task_data *) arg;
+        for (size_t i = d->first; i < d->s->active.size(); i += d->stride) {
+                d->s->send(d->s->active[i]);
+        }
+        return nullptr;
+}
+
 void state_audio_mixer::worker()
 {
         set_thread_name(__func__);
@@ -311,63 +415,51 @@ void state_audio_mixer::worker()
                         }
                 }
 
-                size_t data_len_source = SAMPLES_PER_FRAME * sizeof(sample_type_source) * CHANNELS;
-                vector<sample_type_mixed> mixed(SAMPLES_PER_FRAME * CHANNELS);
-                vector<audio_frame2> participant_frames(participants.size());
-                int participant_index = 0;
-
-                // mix all together
+                // the lock is held only while collecting participants, they
+                // are erased only by this thread so the pointers remain valid
+                active.clear();
                 for (auto & p : participants) {
-                        participant_frames[participant_index].init(CHANNELS, AC_PCM, BPS, SAMPLE_RATE);
-                        static_assert(CHANNELS == 1, "Currently only one channel is implemented here.");
-                        participant_frames[participant_index].resize(0, data_len_source);
-                        char *particip_data = participant_frames[participant_index].get_data(0);
-                        int ret = audio_buffer_read(p.second.m_buffer, particip_data, data_len_source);
-                        memset(particip_data, 0, data_len_source - ret);
-
-                        sample_type_source *src = (sample_type_source *)(void *) particip_data;
-                        auto dst = mixed.begin();
-                        for (int i = 0; i < SAMPLES_PER_FRAME * CHANNELS; ++i) {
-                                *dst = mixing_algorithm->add_to_mix(*dst, *src);
-                                ++dst;
-                                ++src;
-                        }
-                        participant_index++;
+                        active.push_back(&p.second);
                 }
+                plk.unlock();
 
-                // substract each source signal from the mix coming to that participant
-                for (auto & pb : participant_frames) {
-                        auto mix = mixed.begin();
-                        sample_type_source *part = (sample_type_source *)(void *) pb.get_data(0);
-                        for (int i = 0; i < SAMPLES_PER_FRAME * CHANNELS; ++i) {
-                                *part = mixing_algorithm->normalize(mixing_algorithm->get_mixed_without_source_sample(*mix, *part));
-                                ++mix;
-                                ++part;
-                        }
+                // read sources - audio_buffer is SPSC lock-free
+                const int count = SAMPLES_PER_FRAME * channels;
+                for (auto *p : active) {
+                        char *particip_data = (char *) p->m_samples.data();
+                        int len = count * sizeof(sample_type_source);
+                        int ret = audio_buffer_read(p->m_buffer, particip_data, len);
+                        memset(particip_data + ret, 0, len - ret);
                 }
 
-                // send
-                participant_index = 0;
-                for (auto & p : participants) {
-                        audio_frame2 *uncompressed = &participant_frames[participant_index];
-                        while (audio_frame2 compressed = audio_codec_compress(p.second.m_audio_coder, uncompressed)) {
-                                audio_tx_send(p.second.m_tx_session, p.second.m_network_device, &compressed);
-                                uncompressed = nullptr;
-                        }
+                // mix all together
+                mixed.assign(count, 0);
+                for (auto *p : active) {
+                        mix_add(mixed.data(), p->m_samples.data(), count);
+                }
 
-                        participant_index++;
+                // substract each source signal from the mix coming to that
+                // participant, compress and send in parallel
+                const int workers = min<int>(get_cpu_core_count(), active.size());
+                if (workers > 0) {
+                        vector<mixer_send_task_data> data(workers);
+                        for (int i = 0; i < workers; ++i) {
+                                data[i] = { this, i, workers };
+                        }
+                        task_run_parallel(send_task, workers, data.data(), sizeof data[0], nullptr);
                 }
-                plk.unlock();
         }
 }
 
 static void audio_play_mixer_help()
 {
         printf("Usage:\n"
-               "\t%s -r mixer[:codec=<codec>][:algo={linear|logarithmic}]\n"
+               "\t%s -r mixer[:codec=<codec>][:algo={linear|logarithmic}][:channels=<n>]\n"
                "\n"
                "<codec>\n"
                "\taudio codec to use\n"
+               "<n>\n"
+               "\tnumber of mixed channels (default %d)\n"
                "linear\n"
                "\tlinear sum of signals (with clamping)\n"
                "logarithmic\n"
@@ -383,7 +475,7 @@ static void audio_play_mixer_help()
                "\ton machine that is a part of the conference, you should use something like:\n"
                "\t\t%s -s <your_capture> -P 5004:5004:5010:5006\n"
                "\tfor the " PACKAGE_NAME " instance that is part of the conference (not mixer!)\n",
-               uv_argv[0], uv_argv[0]);
+               uv_argv[0], DEFAULT_CHANNELS, uv_argv[0]);
 }
 
 static void audio_play_mixer_probe(struct device_info **available_devices, int *count, void (**deleter)(void *))
@@ -414,12 +506,17 @@ static void audio_play_mixer_put_frame(void *state, const struct audio_frame *fr
 
         auto ss = *(struct sockaddr_storage *) frame->network_source;
 
-        if (s->participants.find(ss) == s->participants.end()) {
-                s->participants.emplace(ss, am_participant{s->recv_socket, &ss, s->audio_codec});
+        auto it = s->participants.find(ss);
+        if (it == s->participants.end()) {
+                it = s->participants.emplace(ss, am_participant{s->recv_socket, &ss, s->audio_codec, s->channels}).first;
         }
+        // refreshed timestamp prevents the mixer thread from erasing the
+        // participant while writing outside the lock
+        it->second.last_seen = chrono::steady_clock::now();
+        audio_buffer_t *buf = it->second.m_buffer;
+        lk.unlock();
 
-        audio_buffer_write(s->participants.at(ss).m_buffer, frame->data, frame->data_len);
-        s->participants.at(ss).last_seen = chrono::steady_clock::now();
+        audio_buffer_write(buf, frame->data, frame->data_len);
 }
 
 static void audio_play_mixer_done(void *state)
@@ -437,7 +534,7 @@ static bool audio_play_mixer_ctl(void *state, int request, void *data, size_t *l
         switch (request) {
         case AUDIO_PLAYBACK_CTL_QUERY_FORMAT:
                 if (*len >= sizeof(struct audio_desc)) {
-                        struct audio_desc desc { BPS, SAMPLE_RATE, CHANNELS, AC_PCM };
+                        struct audio_desc desc { BPS, SAMPLE_RATE, s->channels, AC_PCM };
                         memcpy(data, &desc, sizeof desc);
                         *len = sizeof desc;
                         return true;
@@ -465,9 +562,10 @@ static bool audio_play_mixer_ctl(void *state, int request, void *data, size_t *l
         }
 }
 
-static bool audio_play_mixer_reconfigure(void *state [[gnu::unused]], struct audio_desc desc)
+static bool audio_play_mixer_reconfigure(void *state, struct audio_desc desc)
 {
-        audio_desc requested{BPS, SAMPLE_RATE, CHANNELS, AC_PCM};
+        struct state_audio_mixer *s = (struct state_audio_mixer *) state;
+        audio_desc requested{BPS, SAMPLE_RATE, s->channels, AC_PCM};
         assert(desc == requested);
         return true;
 }
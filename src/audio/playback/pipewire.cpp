@@ -113,6 +113,7 @@ static void on_process(void *userdata) noexcept{
                 buf->datas[0].chunk->offset = 0;
                 buf->datas[0].chunk->stride = s->desc.ch_count * s->desc.bps;
                 buf->datas[0].chunk->size = to_write;
+                b->size = to_write / (s->desc.ch_count * s->desc.bps); // summed to pw_time::queued
 
                 pw_stream_queue_buffer(s->stream.get(), b);
         }
@@ -171,12 +172,40 @@ static bool is_format_supported(void *data, size_t *len){
         return desc.codec == AC_PCM && desc.bps >= 1 && desc.bps <= 4;
 }
 
+/**
+ * on_process() moves everything from the ring to the stream buffers so the
+ * frames queued in the stream are counted as well.
+ */
+static bool query_buffer(state_pipewire_play *s, void *data, size_t *len){
+        audio_playback_buffer_status status{};
+        if (*len < sizeof status || !s->ring_buf || !s->stream) {
+                return false;
+        }
+        pw_time time{};
+#if PW_CHECK_VERSION(0, 3, 50)
+        int ret = pw_stream_get_time_n(s->stream.get(), &time, sizeof time);
+#else
+        int ret = pw_stream_get_time(s->stream.get(), &time);
+#endif
+        if (ret < 0) {
+                return false;
+        }
+        const int frame_size = s->desc.ch_count * s->desc.bps;
+        status.fill = ring_get_current_size(s->ring_buf.get()) / frame_size + time.queued;
+        status.target = s->buf_len_ms * s->desc.sample_rate / 1000 / 2;
+        memcpy(data, &status, sizeof status);
+        *len = sizeof status;
+        return true;
+}
+
 static bool audio_play_pw_ctl(void *state, int request, void *data, size_t *len){
-        UNUSED(state);
+        auto s = static_cast<state_pipewire_play *>(state);
 
         switch (request) {
         case AUDIO_PLAYBACK_CTL_QUERY_FORMAT:
                 return is_format_supported(data, len);
+        case AUDIO_PLAYBACK_CTL_QUERY_BUFFER:
+                return query_buffer(s, data, len);
         default:
                 return false;
 
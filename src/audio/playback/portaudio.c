@@ -311,6 +311,19 @@ static bool audio_play_portaudio_ctl(void *state, int request, void *data, size_
                 } else {
                         return false;
                 }
+        case AUDIO_PLAYBACK_CTL_QUERY_BUFFER: {
+                struct state_portaudio_playback *s = state;
+                struct audio_playback_buffer_status status;
+                if (s->data == NULL || *len < sizeof status) {
+                        return false;
+                }
+                audio_buffer_get_fill(s->data, &status.fill, &status.target);
+                status.fill /= s->desc.bps * s->desc.ch_count;
+                status.target /= s->desc.bps * s->desc.ch_count;
+                memcpy(data, &status, sizeof status);
+                *len = sizeof status;
+                return true;
+        }
         default:
                 return false;
         }
@@ -330,6 +330,19 @@ static bool audio_play_wasapi_ctl(void *state, int request, void *data, size_t *
                         memcpy(data, &desc, sizeof desc);
                         *len = sizeof desc;
                         return true;
+                case AUDIO_PLAYBACK_CTL_QUERY_BUFFER: {
+                        struct audio_playback_buffer_status status{};
+                        UINT32 numFramesPadding = 0;
+                        if (s->pRenderClient == nullptr || *len < sizeof status
+                                        || s->pAudioClient->GetCurrentPadding(&numFramesPadding) != S_OK) {
+                                return false;
+                        }
+                        status.fill = numFramesPadding;
+                        status.target = s->bufferSize / 2;
+                        memcpy(data, &status, sizeof status);
+                        *len = sizeof status;
+                        return true;
+                }
                 default:
                         return false;
         }
@@ -85,20 +85,32 @@ audio_desc::operator string() const
  * @brief creates audio_frame2 from POD audio_frame
  */
 audio_frame2::audio_frame2(const struct audio_frame *old) :
+                audio_frame2(old, old ? old->bps : 0)
+{
+}
+
+/**
+ * @brief creates audio_frame2 from POD audio_frame with bps change
+ *
+ * Channels are demultiplexed and converted in a single pass.
+ */
+audio_frame2::audio_frame2(const struct audio_frame *old, int new_bps) :
                 channels(old ? old->ch_count : 0)
 {
         if (old == nullptr) {
                 return;
         }
-        desc.bps = old->bps;
+        desc.bps = new_bps;
         desc.sample_rate = old->sample_rate;
         desc.codec = AC_PCM;
+        vector<char *> out_ch(old->ch_count);
         for (int i = 0; i < old->ch_count; i++) {
-                resize(i, old->data_len / old->ch_count);
-                char *data = channels[i].data.get();
-                demux_channel(data, old->data, old->bps, old->data_len,
-                              old->ch_count, i);
+                resize(i, old->data_len / old->ch_count / old->bps * new_bps);
+                out_ch[i] = channels[i].data.get();
         }
+        static const bool dither = get_commandline_param("no-dither") == nullptr;
+        interleaved2noninterleaved_change_bps(out_ch.data(), new_bps, old->data,
+                        old->bps, old->data_len, old->ch_count, dither);
         if ((old->flags & TIMESTAMP_VALID) != 0) {
                 timestamp = old->timestamp;
         }
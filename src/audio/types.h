@@ -149,6 +149,7 @@ public:
         audio_frame2(audio_frame2 const &) = delete;
         audio_frame2(audio_frame2 &&) = default;
         explicit audio_frame2(const struct audio_frame *);
+        audio_frame2(const struct audio_frame *, int new_bps);
         audio_frame2& operator=(audio_frame2 const &) = delete;
         audio_frame2& operator=(audio_frame2 &&) = default;
         explicit operator bool() const;
@@ -48,6 +48,7 @@
 #include <climits>
 #include <cmath>
 #include <cstring>
+#include <type_traits>
 
 #include "audio/codec.h"
 #include "audio/types.h"
@@ -61,6 +62,15 @@
 #error "This code will not run with a big-endian machine. Please report a bug to " PACKAGE_BUGREPORT " if you reach here."
 #endif // WORDS_BIGENDIAN
 
+#if (defined __x86_64__ || defined __i386__) && (defined __GNUC__ || defined __clang__)
+/// AVX2 variants compiled regardless of -march, selected at runtime
+#define X86_SIMD_DISPATCH 1
+#include <immintrin.h>
+#endif
+#if defined __ARM_NEON && defined __aarch64__
+#include <arm_neon.h>
+#endif
+
 using std::clamp;
 using std::max;
 using std::numeric_limits;
@@ -69,8 +79,6 @@ using std::string;
 using std::unique_ptr;
 using std::vector;
 
-static int32_t format_from_in_bps(const char *in, int bps);
-static void format_to_out_bps(char *out, int bps, int32_t out_value);
 
 /**
  * Loads sample with BPS width and returns it cast to
@@ -87,20 +95,39 @@ template<> int32_t load_sample<2>(const char *data) {
 }
 
 template<> int32_t load_sample<3>(const char *data) {
-        int32_t in_value = 0;
-        memcpy(&in_value, data, 3);
-
-        if ((in_value & 1U<<23U) != 0U) { // negative
-                in_value |= 0xFF000000U;
-        }
-
-        return in_value;
+        // composed from bytes - memcpy() to a partially written int32_t
+        // causes store-forwarding stalls (~10x slower)
+        const auto *d = reinterpret_cast<const unsigned char *>(data);
+        return (int32_t) ((uint32_t) d[0] | (uint32_t) d[1] << 8U
+                        | (uint32_t) (int32_t) (signed char) d[2] << 16U);
 }
 
 template<> int32_t load_sample<4>(const char *data) {
         return *reinterpret_cast<const int32_t *>(data);
 }
 
+/// stores (unscaled) sample to BPS wide container, inverse of load_sample()
+template<int BPS> static void store_sample(char *data, int32_t val) {
+        memcpy(data, &val, BPS);
+}
+
+/**
+ * Calls f with std::integral_constant<int, bps> so that per-sample loops
+ * can be instantiated for each sample width (fixed-size copies instead of
+ * memcpy() calls with runtime size).
+ */
+template<typename F> static void dispatch_bps(int bps, F &&f) {
+        switch (bps) {
+        case 1: f(std::integral_constant<int, 1>{}); return;
+        case 2: f(std::integral_constant<int, 2>{}); return;
+        case 3: f(std::integral_constant<int, 3>{}); return;
+        case 4: f(std::integral_constant<int, 4>{}); return;
+        default:
+                LOG(LOG_LEVEL_FATAL) << "Wrong BPS " << bps << "\n";
+                abort();
+        }
+}
+
 /**
  * @brief Calculates mean and peak RMS from audio samples
  *
@@ -260,6 +287,24 @@ void change_bps(char *out, int out_bps, const char *in, int in_bps, int in_len /
         change_bps2(out, out_bps, in, in_bps, in_len, dither);
 }
 
+template<int IN_BPS, int OUT_BPS>
+static void change_bps_tmpl(char *out, const char *in, int samples, bool dither)
+{
+        if constexpr (IN_BPS < OUT_BPS) {
+                for (int i = 0; i < samples; i++) {
+                        store_sample<OUT_BPS>(out + i * OUT_BPS, load_sample<IN_BPS>(in + i * IN_BPS) << (OUT_BPS * 8 - IN_BPS * 8));
+                }
+        } else if (dither) {
+                for (int i = 0; i < samples; i++) {
+                        store_sample<OUT_BPS>(out + i * OUT_BPS, downshift_with_dither(load_sample<IN_BPS>(in + i * IN_BPS), IN_BPS * 8 - OUT_BPS * 8));
+                }
+        } else {
+                for (int i = 0; i < samples; i++) {
+                        store_sample<OUT_BPS>(out + i * OUT_BPS, load_sample<IN_BPS>(in + i * IN_BPS) >> (IN_BPS * 8 - OUT_BPS * 8));
+                }
+        }
+}
+
 void change_bps2(char *out, int out_bps, const char *in, int in_bps, int in_len /* bytes */, bool dither)
 {
         assert ((unsigned int) out_bps <= sizeof(int32_t));
@@ -270,37 +315,13 @@ void change_bps2(char *out, int out_bps, const char *in, int in_bps, int in_len
                 return;
         }
 
-        if (in_bps < out_bps ) {
-                for (int i = 0; i < in_len / in_bps; i++) {
-                        int32_t in_value = format_from_in_bps(in, in_bps);
-                        int32_t out_value = in_value << (out_bps * 8 - in_bps * 8);
-                        format_to_out_bps(out, out_bps, out_value);
-                        in += in_bps;
-                        out += out_bps;
-                }
-                return;
-        }
-
-        // downsampling
-        if (dither) {
-                const int downshift = in_bps * 8 - out_bps * 8;
-                for (int i = 0; i < in_len / in_bps; i++) {
-                        int32_t in_value = format_from_in_bps(in, in_bps);
-                        int32_t out_value = downshift_with_dither(in_value, downshift);
-                        format_to_out_bps(out, out_bps, out_value);
-                        in += in_bps;
-                        out += out_bps;
-                }
-                return;
-        }
-        // no dithering
-        for (int i = 0; i < in_len / in_bps; i++) {
-                int32_t in_value = format_from_in_bps(in, in_bps);
-                int32_t out_value = in_value >> (in_bps * 8 - out_bps * 8);
-                format_to_out_bps(out, out_bps, out_value);
-                in += in_bps;
-                out += out_bps;
-        }
+        dispatch_bps(in_bps, [&](auto in_b) {
+                dispatch_bps(out_bps, [&](auto out_b) {
+                        if constexpr (in_b.value != out_b.value) {
+                                change_bps_tmpl<in_b.value, out_b.value>(out, in, in_len / in_bps, dither);
+                        }
+                });
+        });
 }
 
 void copy_channel(char *out, const char *in, int bps, int in_len /* bytes */, int out_channel_count)
@@ -333,91 +354,63 @@ void audio_frame_multiply_channel(struct audio_frame *frame, int new_channel_cou
 
 void demux_channel(char *out, char *in, int bps, int in_len, int in_stream_channels, int pos_in_stream)
 {
-        int samples = in_len / (in_stream_channels * bps);
-        int i;
-
-        assert (bps <= 4);
-
-        in += pos_in_stream * bps;
-
-        for (i = 0; i < samples; ++i) {
-                memcpy(out, in, bps);
-
-                out += bps;
-                in += in_stream_channels * bps;
-
-        }
+        remux_channel(out, in, bps, in_len, in_stream_channels, 1, pos_in_stream, 0);
 }
 
 void remux_channel(char *out, const char *in, int bps, int in_len, int in_stream_channels, int out_stream_channels, int pos_in_stream, int pos_out_stream)
 {
         int samples = in_len / (in_stream_channels * bps);
-        int i;
-
-        assert (bps <= 4);
 
         in += pos_in_stream * bps;
         out += pos_out_stream * bps;
 
-        for (i = 0; i < samples; ++i) {
-                memcpy(out, in, bps);
-
-                out += bps * out_stream_channels;
-                in += bps * in_stream_channels;
-
-        }
+        dispatch_bps(bps, [&](auto b) {
+                constexpr int BPS = b.value;
+                for (int i = 0; i < samples; ++i) {
+                        memcpy(out + (ptrdiff_t) i * BPS * out_stream_channels,
+                                        in + (ptrdiff_t) i * BPS * in_stream_channels, BPS);
+                }
+        });
 }
 
 void mux_channel(char *out, const char *in, int bps, int in_len, int out_stream_channels, int pos_in_stream, double scale)
 {
         int samples = in_len / bps;
-        int i;
-        
-        assert (bps <= 4);
-
-        out += pos_in_stream * bps;
 
-        if(scale == 1.0) {
-                for (i = 0; i < samples; ++i) {
-                        memcpy(out, in, bps);
-
-                        in += bps;
-                        out += out_stream_channels * bps;
+        if (scale == 1.0) {
+                remux_channel(out, in, bps, in_len, 1, out_stream_channels, 0, pos_in_stream);
+                return;
+        }
 
-                }
-        } else {
-                for (i = 0; i < samples; ++i) {
-                        int32_t in_value = format_from_in_bps(in, bps);
+        out += pos_in_stream * bps;
 
+        dispatch_bps(bps, [&](auto b) {
+                constexpr int BPS = b.value;
+                for (int i = 0; i < samples; ++i) {
+                        int32_t in_value = load_sample<BPS>(in + (ptrdiff_t) i * BPS);
                         in_value *= scale;
-
-                        format_to_out_bps(out, bps, in_value);
-
-                        in += bps;
-                        out += out_stream_channels * bps;
+                        store_sample<BPS>(out + (ptrdiff_t) i * BPS * out_stream_channels, in_value);
                 }
-        }
+        });
 }
 
 void mux_and_mix_channel(char *out, const char *in, int bps, int in_len, int out_stream_channels, int pos_in_stream, double scale)
 {
-        int i;
-
-        assert (bps <= 4);
+        const int samples = in_len / bps;
 
         out += pos_in_stream * bps;
 
-        for(i = 0; i < in_len / bps; i++) {
-                int32_t in_value = format_from_in_bps(in, bps);
-                int32_t out_value = format_from_in_bps(out, bps);
-
-                int32_t new_value = (double)in_value * scale + out_value;
-
-                format_to_out_bps(out, bps, new_value);
-
-                in += bps;
-                out += out_stream_channels * bps;
-        }
+        dispatch_bps(bps, [&](auto b) {
+                constexpr int BPS = b.value;
+                for (int i = 0; i < samples; i++) {
+                        char *dst = out + (ptrdiff_t) i * BPS * out_stream_channels;
+                        int32_t in_value = load_sample<BPS>(in + (ptrdiff_t) i * BPS);
+                        int32_t out_value = load_sample<BPS>(dst);
+                        int32_t new_value = scale == 1.0 ? (int32_t) ((uint32_t) in_value + (uint32_t) out_value)
+                                : (int32_t) ((double) in_value * scale + out_value);
+                        store_sample<BPS>(dst, new_value);
+                }
+        });
 }
 
 template<int BPS>
@@ -454,6 +447,96 @@ double get_avg_volume(char *data, int bps, int sample_count, int stream_channels
 
 const float INT_MAX_FLT = nexttowardf((float) INT_MAX, INT_MAX); // max int representable as float
 
+/*
+ * SIMD variants of float2int()/int2float() - return number of processed
+ * items, the rest is converted by the scalar code. Items are processed
+ * element-wise so that the conversion can be done in situ.
+ */
+#ifdef __SSE2__
+static int float2int_sse2(int32_t *out, const float *in, int items)
+{
+        const __m128 lo = _mm_set1_ps(-1.0F);
+        const __m128 hi = _mm_set1_ps(1.0F);
+        const __m128 mul = _mm_set1_ps(INT_MAX_FLT);
+        int i = 0;
+        for ( ; i + 4 <= items; i += 4) {
+                __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), lo), hi);
+                _mm_storeu_si128((__m128i *)(void *) (out + i), _mm_cvttps_epi32(_mm_mul_ps(v, mul)));
+        }
+        return i;
+}
+
+static int int2float_sse2(float *out, const int32_t *in, int items)
+{
+        const __m128 div = _mm_set1_ps((float) INT_MAX);
+        int i = 0;
+        for ( ; i + 4 <= items; i += 4) {
+                __m128 v = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(const void *) (in + i)));
+                _mm_storeu_ps(out + i, _mm_div_ps(v, div));
+        }
+        return i;
+}
+#endif // defined __SSE2__
+
+#ifdef X86_SIMD_DISPATCH
+__attribute__((target("avx2")))
+static int float2int_avx2(int32_t *out, const float *in, int items)
+{
+        const __m256 lo = _mm256_set1_ps(-1.0F);
+        const __m256 hi = _mm256_set1_ps(1.0F);
+        const __m256 mul = _mm256_set1_ps(INT_MAX_FLT);
+        int i = 0;
+        for ( ; i + 8 <= items; i += 8) {
+                __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i), lo), hi);
+                _mm256_storeu_si256((__m256i *)(void *) (out + i), _mm256_cvttps_epi32(_mm256_mul_ps(v, mul)));
+        }
+        return i;
+}
+
+__attribute__((target("avx2")))
+static int int2float_avx2(float *out, const int32_t *in, int items)
+{
+        const __m256 div = _mm256_set1_ps((float) INT_MAX);
+        int i = 0;
+        for ( ; i + 8 <= items; i += 8) {
+                __m256 v = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(const void *) (in + i)));
+                _mm256_storeu_ps(out + i, _mm256_div_ps(v, div));
+        }
+        return i;
+}
+
+static bool have_avx2() {
+        static const bool ret = [] {
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2") != 0;
+        }();
+        return ret;
+}
+#endif // defined X86_SIMD_DISPATCH
+
+#if defined __ARM_NEON && defined __aarch64__
+static int float2int_neon(int32_t *out, const float *in, int items)
+{
+        const float32x4_t mul = vdupq_n_f32(INT_MAX_FLT);
+        int i = 0;
+        for ( ; i + 4 <= items; i += 4) {
+                float32x4_t v = vminq_f32(vmaxq_f32(vld1q_f32(in + i), vdupq_n_f32(-1.0F)), vdupq_n_f32(1.0F));
+                vst1q_s32(out + i, vcvtq_s32_f32(vmulq_f32(v, mul)));
+        }
+        return i;
+}
+
+static int int2float_neon(float *out, const int32_t *in, int items)
+{
+        const float32x4_t div = vdupq_n_f32((float) INT_MAX);
+        int i = 0;
+        for ( ; i + 4 <= items; i += 4) {
+                vst1q_f32(out + i, vdivq_f32(vcvtq_f32_s32(vld1q_s32(in + i)), div));
+        }
+        return i;
+}
+#endif
+
 /**
  * Can be used in situ.
  */
@@ -463,6 +546,21 @@ void float2int(char *out, const char *in, int len)
         int32_t *outi = (int32_t *)(void *) out;
         int items = len / sizeof(int32_t);
 
+        int done = 0;
+#ifdef X86_SIMD_DISPATCH
+        if (have_avx2()) {
+                done = float2int_avx2(outi, inf, items);
+        }
+#endif
+#ifdef __SSE2__
+        done += float2int_sse2(outi + done, inf + done, items - done);
+#elif defined __ARM_NEON && defined __aarch64__
+        done = float2int_neon(outi, inf, items);
+#endif
+        inf += done;
+        outi += done;
+        items -= done;
+
         while(items-- > 0) {
                 float sample = *inf++;
                 if(sample > 1.0) sample = 1.0;
@@ -477,6 +575,21 @@ void int2float(char *out, const char *in, int len)
         float *outf = (float *)(void *) out;
         int items = len / sizeof(int32_t);
 
+        int done = 0;
+#ifdef X86_SIMD_DISPATCH
+        if (have_avx2()) {
+                done = int2float_avx2(outf, ini, items);
+        }
+#endif
+#ifdef __SSE2__
+        done += int2float_sse2(outf + done, ini + done, items - done);
+#elif defined __ARM_NEON && defined __aarch64__
+        done = int2float_neon(outf, ini, items);
+#endif
+        ini += done;
+        outf += done;
+        items -= done;
+
         while(items-- > 0) {
                 *outf++ = (float) *ini++ / (float) INT_MAX;
         }
@@ -512,44 +625,89 @@ void audio_channel_demux(const audio_frame2 *frame, int index, audio_channel *ch
         channel->sample_rate = frame->get_sample_rate();
 }
 
-/// reads sample at specified BPS and returns it in i32 container (not scaled)
-static int32_t
-format_from_in_bps(const char *in, int bps)
+#ifdef __SSE2__
+/// stereo int16/int32 deinterleaving, @returns number of processed frames
+static int interleaved2noninterleaved_stereo_sse2(char **out_ch, const char *in, int bps, int frames)
 {
-        switch (bps) {
-                case 1: return load_sample<1>(in);
-                case 2: return load_sample<2>(in);
-                case 3: return load_sample<3>(in);
-                case 4: return load_sample<4>(in);
-                default: abort();
+        int i = 0;
+        if (bps == 2) {
+                auto *l = (int16_t *)(void *) out_ch[0];
+                auto *r = (int16_t *)(void *) out_ch[1];
+                for ( ; i + 8 <= frames; i += 8) {
+                        __m128i a = _mm_loadu_si128((const __m128i *)(const void *) (in + (ptrdiff_t) i * 4));
+                        __m128i b = _mm_loadu_si128((const __m128i *)(const void *) (in + (ptrdiff_t) i * 4 + 16));
+                        // values are sign-extended, so the saturating pack is lossless
+                        __m128i left = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+                                        _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+                        __m128i right = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+                        _mm_storeu_si128((__m128i *)(void *) (l + i), left);
+                        _mm_storeu_si128((__m128i *)(void *) (r + i), right);
+                }
+        } else if (bps == 4) {
+                auto *l = (float *)(void *) out_ch[0];
+                auto *r = (float *)(void *) out_ch[1];
+                for ( ; i + 4 <= frames; i += 4) {
+                        __m128 a = _mm_loadu_ps((const float *)(const void *) (in + (ptrdiff_t) i * 8));
+                        __m128 b = _mm_loadu_ps((const float *)(const void *) (in + (ptrdiff_t) i * 8 + 16));
+                        _mm_storeu_ps(l + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+                        _mm_storeu_ps(r + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+                }
         }
+        return i;
 }
-
-/**
- * writes out_value in i32 container at specified bps
- *
- * out_value is not scaled, so allowed range eg. for bps = 2 is [-32768..32767]
- */
-static void
-format_to_out_bps(char *out, int bps, int32_t out_value)
-{
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-        memcpy(out, &out_value, bps);
-#else
-        memcpy(out, (char *) &out_value + 4 - bps, bps);
 #endif
-}
 
 void
 interleaved2noninterleaved2(char **out_ch, const char *in, int bps, int in_len,
                             int channel_count)
 {
-        for (int i = 0; i < in_len / channel_count / bps; ++i) {
-                for (int ch = 0; ch < channel_count; ++ch) {
-                        memcpy(out_ch[ch] + (ptrdiff_t) i * bps, in, bps);
-                        in += bps;
+        const int frames = in_len / channel_count / bps;
+        int i = 0;
+#ifdef __SSE2__
+        if (channel_count == 2) {
+                i = interleaved2noninterleaved_stereo_sse2(out_ch, in, bps, frames);
+                in += (ptrdiff_t) i * 2 * bps;
+        }
+#endif
+        dispatch_bps(bps, [&](auto b) {
+                constexpr int BPS = b.value;
+                for ( ; i < frames; ++i) {
+                        for (int ch = 0; ch < channel_count; ++ch) {
+                                memcpy(out_ch[ch] + (ptrdiff_t) i * BPS, in, BPS);
+                                in += BPS;
+                        }
                 }
+        });
+}
+
+void
+interleaved2noninterleaved_change_bps(char **out_ch, int out_bps, const char *in,
+                                      int in_bps, int in_len, int channel_count,
+                                      bool dither)
+{
+        if (in_bps == out_bps) {
+                interleaved2noninterleaved2(out_ch, in, in_bps, in_len, channel_count);
+                return;
         }
+        const int frames = in_len / channel_count / in_bps;
+        dispatch_bps(in_bps, [&](auto in_b) {
+                dispatch_bps(out_bps, [&](auto out_b) {
+                        constexpr int IN = in_b.value;
+                        constexpr int OUT = out_b.value;
+                        for (int i = 0; i < frames; ++i) {
+                                for (int ch = 0; ch < channel_count; ++ch) {
+                                        int32_t val = load_sample<IN>(in + ((ptrdiff_t) i * channel_count + ch) * IN);
+                                        if constexpr (IN < OUT) {
+                                                val <<= OUT * 8 - IN * 8;
+                                        } else if constexpr (IN > OUT) {
+                                                val = dither ? downshift_with_dither(val, IN * 8 - OUT * 8)
+                                                        : val >> (IN * 8 - OUT * 8);
+                                        }
+                                        store_sample<OUT>(out_ch[ch] + (ptrdiff_t) i * OUT, val);
+                                }
+                        }
+                });
+        });
 }
 
 void
@@ -108,6 +108,13 @@ void interleaved2noninterleaved2(char **out, const char *in, int bps,
                                  int in_len /* bytes */, int channel_count);
 void interleaved2noninterleaved_float(char **out, const char *in, int in_bps,
                                  int in_len /* bytes */, int channel_count);
+/**
+ * Deinterleaves all channels and changes bps in a single pass, equivalent
+ * of interleaved2noninterleaved2() followed by change_bps2() of every channel.
+ */
+void interleaved2noninterleaved_change_bps(char **out, int out_bps, const char *in,
+                                 int in_bps, int in_len /* bytes */,
+                                 int channel_count, bool dither);
 
 /*
  * Additional function that allosw mixing channels
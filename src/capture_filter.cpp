@@ -3,7 +3,7 @@
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2014-2021 CESNET, z. s. p. o.
+ * Copyright (c) 2014-2026 CESNET, z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -41,19 +41,57 @@
 #include "config_win32.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "capture_filter.h"
 #include "debug.h"
+#include "host.h"
 #include "lib_common.h"
 #include "module.h"
 #include "utils/color_out.h"
+#include "utils/frame_drops.h"
+#include "utils/frame_trace.h"
 #include "utils/list.h"
+#include "utils/macros.h"
+#include "utils/parallel_conv.h"
+#include "utils/thread.h"
+#include "utils/vf_split.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
+#include "video_codec.h"
+
+#define MOD_NAME "[capture filter] "
+#define ASYNC_PARAM_NAME "capture-filter-async"
+#define DEFAULT_ASYNC_QUEUE_LEN 2
 
 using namespace std;
 
 struct capture_filter {
         struct module mod;
         struct simple_linked_list *filters;
+        void *fused_pool; ///< output of fused row kernels
+
+        /// @name asynchronous mode
+        /// filters run in the worker, capture_filter() only enqueues the
+        /// input and returns a frame filtered previously (if there is any)
+        /// @{
+        bool async;
+        size_t queue_len;
+        thread worker;
+        mutex lock;
+        condition_variable in_cv;
+        deque<struct video_frame *> in_queue;
+        deque<struct video_frame *> out_queue;
+        bool should_exit;
+        long long dropped_in;
+        long long dropped_out;
+        /// @}
 };
 
 struct capture_filter_instance {
@@ -99,6 +137,35 @@ static int create_filter(struct capture_filter *s, char *cfg)
         return 0;
 }
 
+static struct video_frame *run_filters(struct capture_filter *s, struct video_frame *frame);
+
+static void async_worker(struct capture_filter *s)
+{
+        set_thread_name("capture_filter");
+        unique_lock<mutex> lk(s->lock);
+        while (true) {
+                s->in_cv.wait(lk, [s] { return s->should_exit || !s->in_queue.empty(); });
+                if (s->should_exit) {
+                        break;
+                }
+                struct video_frame *in = s->in_queue.front();
+                s->in_queue.pop_front();
+                lk.unlock();
+                struct video_frame *out = run_filters(s, in);
+                lk.lock();
+                if (out == nullptr) {
+                        continue;
+                }
+                if (s->out_queue.size() >= s->queue_len) { // not collected by capture
+                        VIDEO_FRAME_DISPOSE(s->out_queue.front());
+                        s->out_queue.pop_front();
+                        s->dropped_out += 1;
+                        frame_drop_record(FRAME_DROP_FILTER_BUSY, 1);
+                }
+                s->out_queue.push_back(out);
+        }
+}
+
 int capture_filter_init(struct module *parent, const char *cfg, struct capture_filter **state)
 {
         if (cfg && (strcasecmp(cfg, "help") == 0 || strcasecmp(cfg, "fullhelp") == 0)) {
@@ -112,13 +179,13 @@ int capture_filter_init(struct module *parent, const char *cfg, struct capture_f
                 return 1;
         }
 
-        struct capture_filter *s = (struct capture_filter *) calloc(1, sizeof(struct capture_filter));
+        auto *s = new struct capture_filter();
         char *item, *save_ptr;
-        assert(s);
         char *filter_list_str = NULL,
              *tmp = NULL;
 
         s->filters = simple_linked_list_init();
+        s->fused_pool = video_frame_pool_init(video_desc{}, 0);
 
         module_init_default(&s->mod);
         s->mod.cls = MODULE_CLASS_FILTER;
@@ -133,9 +200,8 @@ int capture_filter_init(struct module *parent, const char *cfg, struct capture_f
 
                         int ret = create_filter(s, filter_name);
                         if (ret != 0) {
-                                module_done(&s->mod);
+                                capture_filter_destroy(s);
                                 free(tmp);
-                                free(s);
                                 return ret;
                         }
                         filter_list_str = NULL;
@@ -144,6 +210,20 @@ int capture_filter_init(struct module *parent, const char *cfg, struct capture_f
 
         free(tmp);
 
+        if (const char *async = get_commandline_param(ASYNC_PARAM_NAME);
+                        async != nullptr && simple_linked_list_size(s->filters) > 0) {
+                s->async = true;
+                s->queue_len = strlen(async) > 0 ? atoi(async) : DEFAULT_ASYNC_QUEUE_LEN;
+                if (s->queue_len == 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong queue length: %s\n", async);
+                        capture_filter_destroy(s);
+                        return -1;
+                }
+                s->worker = thread(async_worker, s);
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Running asynchronously, queue length %zu.\n",
+                                s->queue_len);
+        }
+
         *state = s;
 
         return 0;
@@ -153,6 +233,25 @@ void capture_filter_destroy(struct capture_filter *state)
 {
         struct capture_filter *s = state;
 
+        if (s->async) {
+                {
+                        lock_guard<mutex> lk(s->lock);
+                        s->should_exit = true;
+                }
+                s->in_cv.notify_one();
+                s->worker.join();
+                for (auto *queue : { &s->in_queue, &s->out_queue }) {
+                        for (auto *f : *queue) {
+                                VIDEO_FRAME_DISPOSE(f);
+                        }
+                }
+                if (s->dropped_in > 0 || s->dropped_out > 0) {
+                        log_msg(LOG_LEVEL_INFO, MOD_NAME "Dropped %lld frames waiting for "
+                                        "filtering and %lld filtered frames.\n",
+                                        s->dropped_in, s->dropped_out);
+                }
+        }
+
         while(simple_linked_list_size(s->filters) > 0) {
                 struct capture_filter_instance *inst = (struct capture_filter_instance *) simple_linked_list_pop(s->filters);
                 inst->functions->done(inst->state);
@@ -160,10 +259,11 @@ void capture_filter_destroy(struct capture_filter *state)
         }
 
         simple_linked_list_destroy(s->filters);
+        video_frame_pool_destroy(s->fused_pool);
 
         module_done(&s->mod);
 
-        free(state);
+        delete s;
 }
 
 static struct response *process_message(struct capture_filter *s, struct msg_universal *msg)
@@ -209,23 +309,184 @@ static struct response *process_message(struct capture_filter *s, struct msg_uni
         return new_response(RESPONSE_OK, NULL);
 }
 
-struct video_frame *capture_filter(struct capture_filter *state, struct video_frame *frame) {
-        struct capture_filter *s = state;
+struct fused_pass {
+        vector<struct capture_filter_instance *> stages;
+        vector<struct video_desc> in_desc; ///< input desc of every stage
+        int last_processing = -1; ///< last stage with process_row (writes the output)
+        size_t max_linesize = 0;
+        const struct video_frame *in;
+        struct video_frame *out;
+};
+
+static void fused_pass_rows(int y_start, int y_end, void *udata)
+{
+        auto *p = static_cast<struct fused_pass *>(udata);
+        const int height = p->in->tiles[0].height;
+        const int width = p->in->tiles[0].width;
+        const size_t in_linesize = vc_get_linesize(width, p->in->color_spec);
+        const size_t out_linesize = vc_get_linesize(width, p->out->color_spec);
+        vector<unsigned char> row_buf[2];
+        if (p->last_processing > 0) {
+                row_buf[0].resize(p->max_linesize + MAX_PADDING);
+                row_buf[1].resize(p->max_linesize + MAX_PADDING);
+        }
 
+        for (int y = y_start; y < y_end; ++y) {
+                int src_y = y;
+                for (auto it = p->stages.rbegin(); it != p->stages.rend(); ++it) {
+                        const auto *k = (*it)->functions->row_kernel;
+                        if (k->map_row != nullptr) {
+                                src_y = k->map_row((*it)->state, src_y, height);
+                        }
+                }
+                const unsigned char *src = (const unsigned char *) p->in->tiles[0].data + src_y * in_linesize;
+                unsigned char *dst_row = (unsigned char *) p->out->tiles[0].data + y * out_linesize;
+                if (p->last_processing == -1) {
+                        memcpy(dst_row, src, out_linesize);
+                        continue;
+                }
+                int buf_idx = 0;
+                for (int i = 0; i <= p->last_processing; ++i) {
+                        const auto *k = p->stages[i]->functions->row_kernel;
+                        if (k->process_row == nullptr) {
+                                continue;
+                        }
+                        unsigned char *dst = i == p->last_processing ? dst_row : row_buf[buf_idx++ % 2].data();
+                        k->process_row(p->stages[i]->state, dst, src, width);
+                        src = dst;
+                }
+        }
+}
+
+/**
+ * Runs consecutive filters with row kernels in a single pass over the frame
+ * @returns filtered frame, nullptr if the stages cannot be fused for the
+ * input format (in is kept untouched then)
+ */
+static struct video_frame *run_fused(struct capture_filter *s,
+                vector<struct capture_filter_instance *> const &stages, struct video_frame *in)
+{
+        if (in->tile_count != 1 || codec_is_planar(in->color_spec) || is_codec_opaque(in->color_spec)) {
+                return nullptr;
+        }
+        struct fused_pass p{};
+        p.stages = stages;
+        struct video_desc desc = video_desc_from_frame(in);
+        for (unsigned i = 0; i < stages.size(); ++i) {
+                const auto *k = stages[i]->functions->row_kernel;
+                p.in_desc.push_back(desc);
+                if (!k->configure(stages[i]->state, &desc) || desc.width != p.in_desc[0].width
+                                || desc.height != p.in_desc[0].height || codec_is_planar(desc.color_spec)) {
+                        return nullptr;
+                }
+                if (k->process_row != nullptr) {
+                        p.last_processing = i;
+                }
+                p.max_linesize = max<size_t>(p.max_linesize, vc_get_linesize(desc.width, desc.color_spec));
+        }
+
+        video_frame_pool_reconfigure(s->fused_pool, desc, 0);
+        p.in = in;
+        p.out = video_frame_pool_get_disposable_frame(s->fused_pool);
+        vf_copy_metadata(p.out, in);
+        parallel_rows(in->tiles[0].height, fused_pass_rows, &p, 0);
+        log_msg_once(LOG_LEVEL_VERBOSE, to_fourcc('C', 'F', 'F', 'U'),
+                        MOD_NAME "Running %zu filters fused in a single pass.\n", stages.size());
+        VIDEO_FRAME_DISPOSE(in);
+        return p.out;
+}
+
+static struct video_frame *run_filters(struct capture_filter *s, struct video_frame *frame) {
         struct message *msg;
         while ((msg = check_message(&s->mod))) {
                 struct response *r = process_message(s, (struct msg_universal *) msg);
                 free_message(msg, r);
         }
 
+        // filters may not copy metadata
+        const struct frame_trace_stamps stamps = frame_trace_save(frame);
+        vector<struct capture_filter_instance *> fusable;
+        auto flush_fusable = [&]() {
+                if (!fusable.empty() && frame != nullptr) {
+                        frame = vf_make_contiguous(frame);
+                }
+                if (fusable.size() >= 2) {
+                        if (struct video_frame *out = run_fused(s, fusable, frame)) {
+                                frame = out;
+                                fusable.clear();
+                                return;
+                        }
+                }
+                for (auto *inst : fusable) {
+                        if (frame != nullptr) {
+                                frame = inst->functions->filter(inst->state, frame);
+                                if (frame == nullptr) {
+                                        frame_drop_record(FRAME_DROP_FILTER, 1);
+                                }
+                        }
+                }
+                fusable.clear();
+        };
+
         for(void *it = simple_linked_list_it_init(s->filters);
                         it != NULL;
            ) {
                 struct capture_filter_instance *inst = (struct capture_filter_instance *) simple_linked_list_it_next(&it);
-                frame = inst->functions->filter(inst->state, frame);
-                if(!frame)
+                if (inst->functions->row_kernel != nullptr) {
+                        fusable.push_back(inst);
+                        continue;
+                }
+                flush_fusable();
+                if (!frame)
+                        return NULL;
+                // filters expect contiguous tiles, split may produce strided ones
+                frame = inst->functions->filter(inst->state, vf_make_contiguous(frame));
+                if(!frame) {
+                        frame_drop_record(FRAME_DROP_FILTER, 1);
                         return NULL;
+                }
+        }
+        flush_fusable();
+        if (frame != nullptr) {
+                frame_trace_restore(frame, stamps);
         }
         return frame;
 }
 
+struct video_frame *capture_filter(struct capture_filter *state, struct video_frame *frame) {
+        struct capture_filter *s = state;
+        if (!s->async) {
+                return run_filters(s, frame);
+        }
+
+        if (frame->callbacks.dispose == nullptr) { // valid only until next grab
+                const struct frame_trace_stamps stamps = frame_trace_save(frame);
+                frame = vf_get_copy(frame);
+                frame_trace_restore(frame, stamps);
+                frame->callbacks.dispose = vf_free;
+        }
+        struct video_frame *out = nullptr;
+        {
+                lock_guard<mutex> lk(s->lock);
+                if (s->in_queue.size() >= s->queue_len) { // filters slower than capture
+                        log_msg_once(LOG_LEVEL_WARNING, to_fourcc('C', 'F', 'D', 'R'),
+                                        MOD_NAME "Filters cannot keep up, dropping frames!\n");
+                        VIDEO_FRAME_DISPOSE(s->in_queue.front());
+                        s->in_queue.pop_front();
+                        s->dropped_in += 1;
+                        frame_drop_record(FRAME_DROP_FILTER_BUSY, 1);
+                }
+                s->in_queue.push_back(frame);
+                if (!s->out_queue.empty()) {
+                        out = s->out_queue.front();
+                        s->out_queue.pop_front();
+                }
+        }
+        s->in_cv.notify_one();
+        return out;
+}
+
+ADD_TO_PARAM(ASYNC_PARAM_NAME, "* " ASYNC_PARAM_NAME "[=<queue_len>]\n"
+                "  Run capture filters in a separate thread with bounded queues\n"
+                "  (default length " TOSTRING(DEFAULT_ASYNC_QUEUE_LEN) "). Filtered frame\n"
+                "  is returned on next grab.\n");
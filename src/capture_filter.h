@@ -38,13 +38,38 @@
 #ifndef CAPTURE_FILTER_H_
 #define CAPTURE_FILTER_H_
 
-#define CAPTURE_FILTER_ABI_VERSION 3
+#define CAPTURE_FILTER_ABI_VERSION 4
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
 struct module;
+struct video_desc;
+
+/**
+ * @brief Optional row kernel of a per-pixel filter
+ *
+ * Consecutive filters in a chain that all provide the kernel are executed in
+ * a single fused pass per frame - rows are processed in bands in parallel and
+ * intermediate results stay in per-thread row buffers. The filter must keep
+ * the frame dimensions and its filter() must still be implemented (used if
+ * it cannot be fused).
+ */
+struct capture_filter_row_kernel {
+        /// @param[in,out] desc input format, output format on return
+        /// @retval false  format not supported by the kernel
+        bool (*configure)(void *state, struct video_desc *desc);
+        /// @returns input row index to be used for the output row y, NULL if identity
+        int (*map_row)(void *state, int y, int height);
+        /// @brief processes one row of width pixels, NULL if the filter only
+        /// remaps the rows; may be called concurrently from multiple threads
+        void (*process_row)(void *state, unsigned char *dst, const unsigned char *src, int width);
+};
 
 struct capture_filter_info {
         /// @brief Initializes capture filter
@@ -67,6 +92,7 @@ struct capture_filter_info {
         /// This behavior may change towards use of shared_ptr<video_frame>
         /// in future.
         struct video_frame *(*filter)(void *state, struct video_frame *f);
+        const struct capture_filter_row_kernel *row_kernel; ///< optional, may be NULL
 };
 
 struct capture_filter;
@@ -45,6 +45,7 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
@@ -53,7 +54,9 @@
 
 struct state_capture_filter_change_pixfmt {
         codec_t to_codec;
+        decoder_t row_decoder; ///< set by row_configure()
         void *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+        void *pool;
 };
 
 static int init(struct module *parent, const char *cfg, void **state)
@@ -75,13 +78,16 @@ static int init(struct module *parent, const char *cfg, void **state)
                 return -1;
         }
 
+        s->pool = video_frame_pool_init((struct video_desc){ 0 }, 0);
         *state = s;
         return 0;
 }
 
 static void done(void *state)
 {
-        free(state);
+        struct state_capture_filter_change_pixfmt *s = state;
+        video_frame_pool_destroy(s->pool);
+        free(s);
 }
 
 static struct video_frame *filter(void *state, struct video_frame *in)
@@ -95,14 +101,15 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to find decoder!\n");
                 return NULL;
         }
-        struct video_frame *out = vf_alloc_desc(desc);
+        struct video_frame *out = NULL;
         if (s->vo_pp_out_buffer) {
+                out = vf_alloc_desc(desc);
                 out->tiles[0].data = s->vo_pp_out_buffer;
+                out->callbacks.dispose = vf_free;
         } else {
-                out->tiles[0].data = malloc(out->tiles[0].data_len);
-                out->callbacks.data_deleter = vf_data_deleter;
+                video_frame_pool_reconfigure(s->pool, desc, 0);
+                out = video_frame_pool_get_disposable_frame(s->pool);
         }
-        out->callbacks.dispose = vf_free;
 
         unsigned char *in_data = (unsigned char *) in->tiles[0].data;
         unsigned char *out_data = (unsigned char *) out->tiles[0].data;
@@ -121,16 +128,39 @@ static struct video_frame *filter(void *state, struct video_frame *in)
 }
 
 
+static bool row_configure(void *state, struct video_desc *desc)
+{
+        struct state_capture_filter_change_pixfmt *s = state;
+        s->row_decoder = get_decoder_from_to(desc->color_spec, s->to_codec);
+        if (s->row_decoder == NULL) {
+                return false;
+        }
+        desc->color_spec = s->to_codec;
+        return true;
+}
+
+static void row_process(void *state, unsigned char *dst, const unsigned char *src, int width)
+{
+        struct state_capture_filter_change_pixfmt *s = state;
+        s->row_decoder(dst, src, vc_get_linesize(width, s->to_codec), DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+}
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         struct state_capture_filter_change_pixfmt *s = state;
         s->vo_pp_out_buffer = buffer;
 }
 
+static const struct capture_filter_row_kernel row_kernel = {
+        .configure = row_configure,
+        .process_row = row_process,
+};
+
 static const struct capture_filter_info capture_filter_change_pixfmt = {
         .init = init,
         .done = done,
         .filter = filter,
+        .row_kernel = &row_kernel,
 };
 
 // coverity[leaked_storage:SUPPRESS]
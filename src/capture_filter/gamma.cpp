@@ -41,34 +41,169 @@
 #include "config_win32.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
-#include <stdexcept>
-#include <thread>
+#include <limits>
+#include <string>
 #include <vector>
 
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
 #include "capture_filter.h"
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
-#include "utils/worker.h"
+#include "utils/parallel_conv.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
 
 constexpr const char *MOD_NAME = "[gamma cap. f.] ";
+constexpr int MAX_CUBE_SIZE = 256;
 
 using std::cout;
-using std::exception;
 using std::numeric_limits;
+using std::string;
 using std::vector;
-using std::thread;
+
+/**
+ * 3D LUT (Adobe/Resolve .cube) applied with tetrahedral interpolation in
+ * 16.16 fixed point, eg. for HDR->SDR tone-mapping
+ */
+struct cube_lut {
+        int size = 0;
+        vector<uint16_t> table; ///< size^3 RGB triplets, R index changing fastest (+1 padding)
+        uint32_t pos8[256];     ///< precomputed pos16() for 8-bit input values
+        uint64_t pos_scale = 0;
+        int tetra_off[8][2];    ///< offsets of the 2 inner tetrahedron vertices
+
+        bool load(const char *filename);
+
+        /// @param r, g, b  16.16 lattice positions
+        void lookup(uint32_t r, uint32_t g, uint32_t b, uint32_t out[4]) const {
+                // the last lattice point is reached as the end of the last cell
+                const uint32_t last = size - 2;
+                uint32_t ir = std::min(r >> 16, last), ig = std::min(g >> 16, last), ib = std::min(b >> 16, last);
+                uint32_t fr = r - (ir << 16), fg = g - (ig << 16), fb = b - (ib << 16);
+                const uint16_t *c000 = &table[3 * ((ib * size + ig) * size + ir)];
+                // the tetrahedron is given by the order of the fractions, the
+                // weights are their differences
+                const uint32_t hi = std::max(std::max(fr, fg), fb);
+                const uint32_t lo = std::min(std::min(fr, fg), fb);
+                const uint32_t mid = fr + fg + fb - hi - lo;
+                const uint32_t w0 = 65536 - hi, w1 = hi - mid, w2 = mid - lo, w3 = lo;
+                const int *off = tetra_off[(fr > fg) << 2 | (fg > fb) << 1 | (fr > fb)];
+                const uint16_t *c1 = c000 + off[0];
+                const uint16_t *c2 = c000 + off[1];
+                const uint16_t *c111 = c000 + 3 * (1 + size + size * size);
+#ifdef __SSE4_1__
+                // all 3 components at once, the table is padded so that
+                // loading 4 items is safe (the 4th is ignored)
+                __m128i sum = _mm_set1_epi32(32768);
+                sum = _mm_add_epi32(sum, _mm_mullo_epi32(_mm_set1_epi32(w0), _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *) c000))));
+                sum = _mm_add_epi32(sum, _mm_mullo_epi32(_mm_set1_epi32(w1), _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *) c1))));
+                sum = _mm_add_epi32(sum, _mm_mullo_epi32(_mm_set1_epi32(w2), _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *) c2))));
+                sum = _mm_add_epi32(sum, _mm_mullo_epi32(_mm_set1_epi32(w3), _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *) c111))));
+                _mm_storeu_si128((__m128i *) out, _mm_srli_epi32(sum, 16));
+#else
+                for (int i = 0; i < 3; ++i) {
+                        // weights sum to 65536 so the sum fits 32 bits
+                        out[i] = (w0 * c000[i] + w1 * c1[i] + w2 * c2[i] + w3 * c111[i] + 32768) >> 16;
+                }
+#endif
+        }
+
+        /// lattice position of a 16-bit value
+        uint32_t pos16(uint32_t val) const {
+                return (val * pos_scale + (1U << 15)) >> 16;
+        }
+};
+
+bool cube_lut::load(const char *filename)
+{
+        FILE *f = fopen(filename, "r");
+        if (f == nullptr) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Cannot open " << filename << ": " << strerror(errno) << "\n";
+                return false;
+        }
+        double domain_min[3] = { 0.0, 0.0, 0.0 };
+        double domain_max[3] = { 1.0, 1.0, 1.0 };
+        size_t count = 0;
+        char line[1024];
+        bool ok = true;
+        while (ok && fgets(line, sizeof line, f) != nullptr) {
+                double rgb[3];
+                if (line[0] == '#' || strspn(line, " \t\r\n") == strlen(line)
+                                || strncmp(line, "TITLE", 5) == 0) {
+                        continue;
+                }
+                if (sscanf(line, "LUT_3D_SIZE %d", &size) == 1) {
+                        ok = size >= 2 && size <= MAX_CUBE_SIZE && table.empty();
+                        if (ok) {
+                                table.resize(3 * size * size * size + 1);
+                        }
+                } else if (sscanf(line, "DOMAIN_MIN %lf %lf %lf", &domain_min[0], &domain_min[1], &domain_min[2]) == 3
+                                || sscanf(line, "DOMAIN_MAX %lf %lf %lf", &domain_max[0], &domain_max[1], &domain_max[2]) == 3) {
+                        continue;
+                } else if (sscanf(line, "%lf %lf %lf", &rgb[0], &rgb[1], &rgb[2]) == 3) {
+                        ok = !table.empty() && count + 3 < table.size();
+                        for (int i = 0; ok && i < 3; ++i) {
+                                double val = (rgb[i] - domain_min[i]) / (domain_max[i] - domain_min[i]);
+                                val = val < 0.0 ? 0.0 : val > 1.0 ? 1.0 : val;
+                                table[count++] = lround(val * numeric_limits<uint16_t>::max());
+                        }
+                } else {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Unsupported line in " << filename << ": " << line;
+                        ok = false;
+                }
+        }
+        fclose(f);
+        if (!ok || table.empty() || count != table.size() - 1) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Wrong or unsupported (only 3D) LUT file " << filename << "!\n";
+                return false;
+        }
+        pos_scale = ((uint64_t) (size - 1) << 32) / 65535;
+        for (int i = 0; i < 256; ++i) {
+                pos8[i] = pos16(i * 257);
+        }
+        // indexed by (fr > fg) << 2 | (fg > fb) << 1 | (fr > fb), items
+        // are the vertex offsets of the largest fraction and of the largest two
+        const int sr = 3, sg = 3 * size, sb = 3 * size * size;
+        const int off[8][2] = {
+                { sb, sb + sg }, // b >= g >= r
+                { sb, sb + sg }, // impossible
+                { sg, sg + sb }, // g > b >= r
+                { sg, sg + sr }, // g >= r > b
+                { sb, sb + sr }, // b >= r > g
+                { sr, sr + sb }, // r > b >= g
+                { sr, sr + sg }, // impossible
+                { sr, sr + sg }, // r > g > b
+        };
+        memcpy(tetra_off, off, sizeof tetra_off);
+        LOG(LOG_LEVEL_INFO) << MOD_NAME << "Loaded " << size << "^3 3D LUT.\n";
+        return true;
+}
 
 struct state_capture_filter_gamma {
 public:
         int out_depth; ///< 0, 8 or 16 (0 menas keep)
+        int row_in_depth = 0; ///< set by row_configure()
+        int row_out_depth = 0;
         void *vo_pp_out_buffer{}; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+        void *pool = video_frame_pool_init(video_desc{}, 0);
+        cube_lut cube; ///< used instead of gamma if cube.size != 0
 
-        explicit state_capture_filter_gamma(double gamma, int out_depth) : out_depth(out_depth) {
+        explicit state_capture_filter_gamma(int out_depth) : out_depth(out_depth) {}
+
+        void init_gamma(double gamma) {
                 for (int i = 0; i <= numeric_limits<uint8_t>::max(); ++i) { // 8->8
                         lut8.push_back(pow(static_cast<double>(i)
                                         / numeric_limits<uint8_t>::max(), gamma)
@@ -91,54 +226,68 @@ public:
                 }
         }
 
-        void apply_gamma(int in_depth, int out_depth, size_t in_len, void const * __restrict in, void * __restrict out) {
+        /// processes one row of width RGB/RG48 pixels
+        void apply_row(int in_depth, int out_depth, int width, void const * __restrict in, void * __restrict out) const {
+                if (cube.size != 0) {
+                        if (in_depth == CHAR_BIT) {
+                                cube_row8(width, static_cast<const uint8_t *>(in), out_depth, out);
+                        } else {
+                                cube_row16(width, static_cast<const uint16_t *>(in), out_depth, out);
+                        }
+                        return;
+                }
+                size_t len = 3 * width;
                 if (in_depth == CHAR_BIT && out_depth == CHAR_BIT) {
-                        apply_lut<uint8_t, uint8_t>(in_len, lut8, in, out);
+                        lut_row<uint8_t, uint8_t>(len, lut8, in, out);
                 } else if (in_depth == 2 * CHAR_BIT && out_depth == 2 * CHAR_BIT) {
-                        apply_lut<uint16_t, uint16_t>(in_len, lut16, in, out);
+                        lut_row<uint16_t, uint16_t>(len, lut16, in, out);
                 } else if (in_depth == CHAR_BIT && out_depth == 2 * CHAR_BIT) {
-                        apply_lut<uint8_t, uint16_t>(in_len, lut8_16, in, out);
-                } else if (in_depth == 2 * CHAR_BIT && out_depth == CHAR_BIT) {
-                        apply_lut<uint16_t, uint8_t>(in_len, lut16_8, in, out);
+                        lut_row<uint8_t, uint16_t>(len, lut8_16, in, out);
                 } else {
-                        throw exception();
+                        assert(in_depth == 2 * CHAR_BIT && out_depth == CHAR_BIT);
+                        lut_row<uint16_t, uint8_t>(len, lut16_8, in, out);
                 }
         }
 
 private:
         template<typename inT, typename outT>
-        struct data {
-                size_t len;
-                const vector<outT> &lut;
-                const inT *in;
-                outT *out;
-        };
-
-        template<typename inT, typename outT>
-        static void *compute(void *arg) {
-                auto *d = static_cast<struct data<inT, outT> *>(arg);
-                for (size_t i = 0; i < d->len; ++i) {
-                        d->out[i] = d->lut[d->in[i]];
+        static void lut_row(size_t len, const vector<outT> &lut, const void *in, void *out) {
+                const auto *in_data = static_cast<const inT *>(in);
+                auto *out_data = static_cast<outT *>(out);
+                for (size_t i = 0; i < len; ++i) {
+                        out_data[i] = lut[in_data[i]];
                 }
-                return nullptr;
         }
 
-        template<typename inT, typename outT> void apply_lut(size_t in_len, const vector<outT> &lut, void const *in, void *out)
-        {
-                auto *in_data = static_cast<const inT*>(in);
-                auto *out_data = static_cast<outT*>(out);
-                unsigned int cpus = thread::hardware_concurrency();
-                in_len /= sizeof(inT);
-                vector<data<inT, outT>> d;
-                vector<task_result_handle_t> handles(cpus);
-                for (unsigned int i = 0; i < cpus; i++) {
-                        d.push_back({in_len / cpus, lut, in_data + i * (in_len / cpus), out_data + i * (in_len / cpus)});
+        static void store(const uint32_t rgb[4], int out_depth, void *out, int x) {
+                if (out_depth == CHAR_BIT) {
+                        auto *dst = static_cast<uint8_t *>(out) + 3 * x;
+                        for (int i = 0; i < 3; ++i) {
+                                dst[i] = (rgb[i] * 255 + 32767) / 65535;
+                        }
+                } else {
+                        auto *dst = static_cast<uint16_t *>(out) + 3 * x;
+                        for (int i = 0; i < 3; ++i) {
+                                dst[i] = rgb[i];
+                        }
                 }
-                for (unsigned int i = 0; i < cpus; i++) {
-                        handles[i] = task_run_async(state_capture_filter_gamma::compute<inT, outT>, static_cast<void *>(&(d[i])));
+        }
+
+        void cube_row8(int width, const uint8_t *in, int out_depth, void *out) const {
+                for (int x = 0; x < width; ++x) {
+                        uint32_t rgb[4];
+                        const uint8_t *px = in + 3 * x;
+                        cube.lookup(cube.pos8[px[0]], cube.pos8[px[1]], cube.pos8[px[2]], rgb);
+                        store(rgb, out_depth, out, x);
                 }
-                for (unsigned int i = 0; i < cpus; i++) {
-                        wait_task(handles[i]);
+        }
+
+        void cube_row16(int width, const uint16_t *in, int out_depth, void *out) const {
+                for (int x = 0; x < width; ++x) {
+                        uint32_t rgb[4];
+                        const uint16_t *px = in + 3 * x;
+                        cube.lookup(cube.pos16(px[0]), cube.pos16(px[1]), cube.pos16(px[2]), rgb);
+                        store(rgb, out_depth, out, x);
                 }
         }
 
@@ -153,42 +302,75 @@ static auto init(struct module *parent, const char *cfg, void **state)
         UNUSED(parent);
 
         if (strlen(cfg) == 0 || strcmp(cfg, "help") == 0) {
-                col() << "Performs gamma transformation.\n\n"
+                col() << "Performs gamma transformation or applies a 3D LUT.\n\n"
                        "usage:\n";
                 col() << "\t" << SBOLD("-F gamma:value[:8|:16]") << "\n";
+                col() << "\t" << SBOLD("-F gamma:cube=<file>[:8|:16]") << "\n";
                 col() << "where:\n";
                 col() << SBOLD("8|16")
                      << " - force output to 8 (16) bits regardless the input\n";
+                col() << SBOLD("cube")
+                     << " - 3D LUT in .cube format (eg. HDR->SDR tone-mapping)\n";
                 return 1;
         }
-        char *endptr = nullptr;
-        errno = 0;
-        double gamma = strtod(cfg, &endptr);
 
-        if (gamma <= 0.0 || errno != 0 || (*endptr != '\0' && *endptr != ':')) {
-                LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Using gamma value " << gamma << "\n";
+        string config = cfg;
+        long int bits = 0;
+        if (size_t colon = config.find_last_of(':'); colon != string::npos
+                        && (config.substr(colon + 1) == "8" || config.substr(colon + 1) == "16")) {
+                bits = stol(config.substr(colon + 1));
+                config.resize(colon);
+        } else if (config.find("cube=") != 0 && colon != string::npos) {
+                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Wrong number of bits (only 8 or 16)!\n";
+                return -1;
         }
 
-        long int bits = 0;
-        if (*endptr != '\0') {
-                endptr += 1;
-                errno = 0;
-                bits = strtol(endptr, &endptr, 0);
-                if ((bits != 8 && bits != 16) || *endptr != '\0') {
-                        LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Wrong number of bits (only 8 or 16)!\n";
+        auto *s = new state_capture_filter_gamma(bits);
+
+        if (config.find("cube=") == 0) {
+                if (!s->cube.load(config.c_str() + strlen("cube="))) {
+                        delete s;
                         return -1;
                 }
+        } else {
+                char *endptr = nullptr;
+                errno = 0;
+                double gamma = strtod(config.c_str(), &endptr);
+                if (gamma <= 0.0 || errno != 0 || *endptr != '\0') {
+                        LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Using gamma value " << gamma << "\n";
+                }
+                s->init_gamma(gamma);
         }
 
-        auto *s = new state_capture_filter_gamma(gamma, bits);
-
         *state = s;
         return 0;
 }
 
 static void done(void *state)
 {
-        delete static_cast<state_capture_filter_gamma *>(state);
+        auto *s = static_cast<state_capture_filter_gamma *>(state);
+        video_frame_pool_destroy(s->pool);
+        delete s;
+}
+
+struct filter_data {
+        const state_capture_filter_gamma *s;
+        const struct video_frame *in;
+        struct video_frame *out;
+        int in_depth;
+        int out_depth;
+};
+
+static void filter_rows(int y_start, int y_end, void *udata)
+{
+        auto *d = static_cast<filter_data *>(udata);
+        const size_t in_linesize = vc_get_linesize(d->in->tiles[0].width, d->in->color_spec);
+        const size_t out_linesize = vc_get_linesize(d->out->tiles[0].width, d->out->color_spec);
+        for (int y = y_start; y < y_end; ++y) {
+                d->s->apply_row(d->in_depth, d->out_depth, d->in->tiles[0].width,
+                                d->in->tiles[0].data + y * in_linesize,
+                                d->out->tiles[0].data + y * out_linesize);
+        }
 }
 
 static auto filter(void *state, struct video_frame *in) -> video_frame *
@@ -204,38 +386,62 @@ static auto filter(void *state, struct video_frame *in) -> video_frame *
         if (s->out_depth != 0) {
                 out_desc.color_spec = s->out_depth == 8 ? RGB : RG48;
         }
-        struct video_frame *out = vf_alloc_desc(out_desc);
+        struct video_frame *out = nullptr;
         if (s->vo_pp_out_buffer != nullptr) {
+                out = vf_alloc_desc(out_desc);
                 out->tiles[0].data = (char *) s->vo_pp_out_buffer;
+                out->callbacks.dispose = vf_free;
         } else {
-                out->tiles[0].data = (char *) malloc(out->tiles[0].data_len);
-                out->callbacks.data_deleter = vf_data_deleter;
+                video_frame_pool_reconfigure(s->pool, out_desc, 0);
+                out = video_frame_pool_get_disposable_frame(s->pool);
         }
-        out->callbacks.dispose = vf_free;
 
-        try {
-                s->apply_gamma(get_bits_per_component(in->color_spec), get_bits_per_component(out_desc.color_spec), in->tiles[0].data_len, in->tiles[0].data, out->tiles[0].data);
-        } catch(...) {
-                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Only 8-bit and 16-bit codecs are currently supported!\n";
-                vf_free(out);
-                out = nullptr;
-        }
+        filter_data d{ s, in, out, get_bits_per_component(in->color_spec),
+                get_bits_per_component(out_desc.color_spec) };
+        parallel_rows(in->tiles[0].height, filter_rows, &d, 0);
 
         VIDEO_FRAME_DISPOSE(in);
 
         return out;
 }
 
+static bool row_configure(void *state, struct video_desc *desc)
+{
+        auto *s = static_cast<state_capture_filter_gamma *>(state);
+        if (desc->color_spec != RGB && desc->color_spec != RG48) {
+                return false;
+        }
+        s->row_in_depth = get_bits_per_component(desc->color_spec);
+        if (s->out_depth != 0) {
+                desc->color_spec = s->out_depth == 8 ? RGB : RG48;
+        }
+        s->row_out_depth = get_bits_per_component(desc->color_spec);
+        return true;
+}
+
+static void row_process(void *state, unsigned char *dst, const unsigned char *src, int width)
+{
+        auto *s = static_cast<state_capture_filter_gamma *>(state);
+        s->apply_row(s->row_in_depth, s->row_out_depth, width, src, dst);
+}
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         auto *s = (state_capture_filter_gamma *) state;
         s->vo_pp_out_buffer = buffer;
 }
 
+static const struct capture_filter_row_kernel row_kernel = {
+        .configure = row_configure,
+        .map_row = nullptr,
+        .process_row = row_process,
+};
+
 static const struct capture_filter_info capture_filter_gamma = {
         .init = init,
         .done = done,
         .filter = filter,
+        .row_kernel = &row_kernel,
 };
 
 REGISTER_MODULE(gamma, &capture_filter_gamma, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
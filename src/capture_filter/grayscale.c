@@ -45,6 +45,7 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
@@ -55,6 +56,7 @@ static struct video_frame *filter(void *state, struct video_frame *in);
 
 struct state_grayscale {
         char *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+        void *pool;
 };
 
 static int init(struct module *parent, const char *cfg, void **state)
@@ -64,13 +66,26 @@ static int init(struct module *parent, const char *cfg, void **state)
                 color_printf(TRED(TBOLD("grayscale")) " converts image to grayscale, takes no arguments\n");
                 return strcmp(cfg, "help") == 0 ? 1 : -1;
         }
-        *state = calloc(1, sizeof(struct state_grayscale));
+        struct state_grayscale *s = calloc(1, sizeof(struct state_grayscale));
+        s->pool = video_frame_pool_init((struct video_desc){ 0 }, 0);
+        *state = s;
         return 0;
 }
 
 static void done(void *state)
 {
-        free(state);
+        struct state_grayscale *s = state;
+        video_frame_pool_destroy(s->pool);
+        free(s);
+}
+
+static void grayscale_UYVY(unsigned char *out_data, const unsigned char *in_data, size_t pixels)
+{
+        for (size_t i = 0; i < pixels; ++i) {
+                *out_data++ = 127;
+                in_data++;
+                *out_data++ = *in_data++;
+        }
 }
 
 static struct video_frame *filter(void *state, struct video_frame *in)
@@ -81,29 +96,38 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 log_msg(LOG_LEVEL_WARNING, "Cannot create grayscale from other codec than UYVY!\n");
                 return in;
         }
-        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in));
+        struct video_frame *out = NULL;
         if (s->vo_pp_out_buffer) {
+                out = vf_alloc_desc(video_desc_from_frame(in));
                 out->tiles[0].data = s->vo_pp_out_buffer;
+                out->callbacks.dispose = vf_free;
         } else {
-                out->tiles[0].data = (char *) malloc(out->tiles[0].data_len);
-                out->callbacks.data_deleter = vf_data_deleter;
+                video_frame_pool_reconfigure(s->pool, video_desc_from_frame(in), 0);
+                out = video_frame_pool_get_disposable_frame(s->pool);
         }
-        out->callbacks.dispose = vf_free;
 
         unsigned char *in_data = (unsigned char *) in->tiles[0].data;
         unsigned char *out_data = (unsigned char *) out->tiles[0].data;
 
-        for (unsigned int i = 0; i < in->tiles[0].width * in->tiles[0].height; ++i) {
-                *out_data++ = 127;
-                in_data++;
-                *out_data++ = *in_data++;
-        }
+        grayscale_UYVY(out_data, in_data, (size_t) in->tiles[0].width * in->tiles[0].height);
 
         VIDEO_FRAME_DISPOSE(in);
 
         return out;
 }
 
+static bool row_configure(void *state, struct video_desc *desc)
+{
+        UNUSED(state);
+        return desc->color_spec == UYVY;
+}
+
+static void row_process(void *state, unsigned char *dst, const unsigned char *src, int width)
+{
+        UNUSED(state);
+        grayscale_UYVY(dst, src, width);
+}
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         struct state_grayscale *s = state;
@@ -111,10 +135,16 @@ static void vo_pp_set_out_buffer(void *state, char *buffer)
 }
 
 
+static const struct capture_filter_row_kernel row_kernel = {
+        .configure = row_configure,
+        .process_row = row_process,
+};
+
 static const struct capture_filter_info capture_filter_grayscale = {
         .init = init,
         .done = done,
         .filter = filter,
+        .row_kernel = &row_kernel,
 };
 
 REGISTER_MODULE(grayscale, &capture_filter_grayscale, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -45,6 +45,7 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/macros.h"
+#include "utils/overlay.h"
 #include "utils/pam.h"
 #include "video.h"
 #include "video_codec.h"
@@ -57,6 +58,8 @@ struct state_capture_filter_logo {
         unsigned int height;
         int x;
         int y;
+        struct overlay *overlay; ///< logo prepared for overlay_codec
+        codec_t overlay_codec;
 };
 
 static int init(struct module *parent, const char *cfg, void **state);
@@ -146,34 +149,55 @@ static void done(void *state)
 {
         struct state_capture_filter_logo *s = (struct state_capture_filter_logo *)
                 state;
+        overlay_destroy(s->overlay);
         free(s->logo);
         free(s);
 }
 
+/// blends the cached premultiplied logo directly in the frame pixel format
+static bool blend_overlay(struct state_capture_filter_logo *s, struct video_frame *in, int rect_x, int rect_y)
+{
+        if (!overlay_pixfmt_supported(in->color_spec)) {
+                return false;
+        }
+        if (s->overlay == NULL || s->overlay_codec != in->color_spec) {
+                overlay_destroy(s->overlay);
+                s->overlay = overlay_create(s->logo, s->width, s->height, in->color_spec, false);
+                s->overlay_codec = in->color_spec;
+        }
+        overlay_blend(s->overlay, in->tiles[0].data, in->tiles[0].width, in->tiles[0].height,
+                        vc_get_linesize(in->tiles[0].width, in->color_spec), rect_x, rect_y);
+        return true;
+}
+
 static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_capture_filter_logo *s = (struct state_capture_filter_logo *)
                 state;
+        int rect_x = s->x;
+        int rect_y = s->y;
+
+        if (rect_x < 0 || rect_x + s->width > in->tiles[0].width) {
+                rect_x = in->tiles[0].width - s->width;
+        }
+        if (rect_y < 0 || rect_y + s->height > in->tiles[0].height) {
+                rect_y = in->tiles[0].height - s->height;
+        }
+        if (rect_x >= 0 && rect_y >= 0 && blend_overlay(s, in, rect_x, rect_y)) {
+                return in;
+        }
+
         decoder_t decoder, coder;
         decoder = get_decoder_from_to(in->color_spec, RGB);
         coder = get_decoder_from_to(RGB, in->color_spec);
-        int rect_x = s->x;
-        int rect_y = s->y;
         assert(coder != NULL && decoder != NULL);
 
         if (decoder == NULL || coder == NULL)
                 return in;
 
-        if (rect_x < 0 || rect_x + s->width > in->tiles[0].width) {
-                rect_x = in->tiles[0].width - s->width;
-        }
         assert(get_pf_block_bytes(in->color_spec) > 0);
         rect_x = (rect_x / get_pf_block_bytes(in->color_spec)) * get_pf_block_bytes(in->color_spec);
 
-        if (rect_y < 0 || rect_y + s->height > in->tiles[0].height) {
-                rect_y = in->tiles[0].height - s->height;
-        }
-
         if (rect_x < 0 || rect_y < 0)
                 return in;
 
@@ -220,6 +244,7 @@ static const struct capture_filter_info capture_filter_logo = {
         init,
         done,
         filter,
+        NULL,
 };
 
 REGISTER_MODULE(logo, &capture_filter_logo, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
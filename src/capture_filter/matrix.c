@@ -46,6 +46,7 @@
 #include "lib_common.h"
 #include "utils/color_out.h"
 #include "utils/macros.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
@@ -56,6 +57,7 @@ struct state_capture_filter_matrix {
         double transform_matrix[9];
         bool check_bounds;
         void *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+        void *pool;
 };
 
 static int init(struct module *parent, const char *cfg, void **state)
@@ -105,13 +107,16 @@ static int init(struct module *parent, const char *cfg, void **state)
                 return -1;
         }
 
+        s->pool = video_frame_pool_init((struct video_desc){ 0 }, 0);
         *state = s;
         return 0;
 }
 
 static void done(void *state)
 {
-        free(state);
+        struct state_capture_filter_matrix *s = state;
+        video_frame_pool_destroy(s->pool);
+        free(s);
 }
 
 static struct video_frame *filter(void *state, struct video_frame *in)
@@ -121,14 +126,15 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         if (in->color_spec == UYVY) {
                 desc.color_spec = RGB;
         }
-        struct video_frame *out = vf_alloc_desc(desc);
+        struct video_frame *out = NULL;
         if (s->vo_pp_out_buffer) {
+                out = vf_alloc_desc(desc);
                 out->tiles[0].data = s->vo_pp_out_buffer;
+                out->callbacks.dispose = vf_free;
         } else {
-                out->tiles[0].data = malloc(out->tiles[0].data_len);
-                out->callbacks.data_deleter = vf_data_deleter;
+                video_frame_pool_reconfigure(s->pool, desc, 0);
+                out = video_frame_pool_get_disposable_frame(s->pool);
         }
-        out->callbacks.dispose = vf_free;
 
         if (s->check_bounds) {
                 if (in->color_spec == UYVY) {
@@ -214,7 +220,7 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 } else {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Only UYVY, RGB or RG48 is currently supported!\n");
                         VIDEO_FRAME_DISPOSE(in);
-                        vf_free(out);
+                        VIDEO_FRAME_DISPOSE(out);
                         return NULL;
                 }
         } else {
@@ -289,7 +295,7 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 } else {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Only UYVY, RGB or RG48 is currently supported!\n");
                         VIDEO_FRAME_DISPOSE(in);
-                        vf_free(out);
+                        VIDEO_FRAME_DISPOSE(out);
                         return NULL;
                 }
         }
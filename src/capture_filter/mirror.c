@@ -45,6 +45,7 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
@@ -55,6 +56,7 @@ static struct video_frame *filter(void *state, struct video_frame *in);
 
 struct state_mirror {
         char *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+        void *pool;
 };
 
 static int init(struct module *parent, const char *cfg, void **state)
@@ -64,13 +66,17 @@ static int init(struct module *parent, const char *cfg, void **state)
                 color_printf(TRED(TBOLD("mirror")) " capture filter flips the video horizontally (across vertical axis), takes no arguments\n");
                 return strcmp(cfg, "help") == 0 ? 1 : -1;
         }
-        *state = calloc(1, sizeof(struct state_mirror));
+        struct state_mirror *s = calloc(1, sizeof(struct state_mirror));
+        s->pool = video_frame_pool_init((struct video_desc){ 0 }, 0);
+        *state = s;
         return 0;
 }
 
 static void done(void *state)
 {
-        free(state);
+        struct state_mirror *s = state;
+        video_frame_pool_destroy(s->pool);
+        free(s);
 }
 
 static void mirror_line_UYVY(unsigned char *dst, const unsigned char *src, int linesize)
@@ -101,14 +107,15 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 return in;
         }
 
-        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in));
+        struct video_frame *out = NULL;
         if (s->vo_pp_out_buffer) {
+                out = vf_alloc_desc(video_desc_from_frame(in));
                 out->tiles[0].data = s->vo_pp_out_buffer;
+                out->callbacks.dispose = vf_free;
         } else {
-                out->tiles[0].data = (char *) malloc(out->tiles[0].data_len);
-                out->callbacks.data_deleter = vf_data_deleter;
+                video_frame_pool_reconfigure(s->pool, video_desc_from_frame(in), 0);
+                out = video_frame_pool_get_disposable_frame(s->pool);
         }
-        out->callbacks.dispose = vf_free;
 
         unsigned char *in_data = (unsigned char *) in->tiles[0].data;
         unsigned char *out_data = (unsigned char *) out->tiles[0].data;
@@ -123,16 +130,34 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         return out;
 }
 
+static bool row_configure(void *state, struct video_desc *desc)
+{
+        UNUSED(state);
+        return desc->color_spec == UYVY;
+}
+
+static void row_process(void *state, unsigned char *dst, const unsigned char *src, int width)
+{
+        UNUSED(state);
+        mirror_line_UYVY(dst, src, vc_get_linesize(width, UYVY));
+}
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         struct state_mirror *s = state;
         s->vo_pp_out_buffer = buffer;
 }
 
+static const struct capture_filter_row_kernel row_kernel = {
+        .configure = row_configure,
+        .process_row = row_process,
+};
+
 static const struct capture_filter_info capture_filter_mirror = {
         .init = init,
         .done = done,
         .filter = filter,
+        .row_kernel = &row_kernel,
 };
 
 REGISTER_MODULE(mirror, &capture_filter_mirror, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
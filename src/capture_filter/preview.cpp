@@ -70,6 +70,7 @@
 
 #define DEFAULT_SCALE_W 960
 #define DEFAULT_SCALE_H 540
+#define DEFAULT_SHM_SLOTS 4
 
 struct module;
 
@@ -97,6 +98,10 @@ struct state_preview_filter{
 
         ipc_frame_conv_func_t ipc_conv = ipc_frame_from_ug_frame;
 
+        int shm_slots = 0;
+        unsigned every = 1; ///< publish only every n-th frame
+        unsigned frame_counter = 0;
+
         clk::duration frame_time;
         clk::time_point next_frame = clk::now();
 
@@ -118,6 +123,10 @@ static void worker(struct state_preview_filter *s, std::string path){
                                 sleep(1);
                                 continue;
                         }
+                        if(s->shm_slots > 0 && !ipc_frame_writer_enable_shm(writer.get(), s->shm_slots)){
+                                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('c', 'f', 'p', 's'),
+                                                MOD_NAME "Shared memory not supported, using socket.\n");
+                        }
                 }
 
                 {
@@ -143,13 +152,16 @@ static void worker(struct state_preview_filter *s, std::string path){
 static void show_help(){
         col() << "preview capture filter\n";
         col() << "usage:\n";
-        col() << TBOLD(TRED("\t--capture-filter preview") "[:path=<path>][:target_size=<w>x<h>]\n\n");
+        col() << TBOLD(TRED("\t--capture-filter preview") "[:path=<path>][:target_size=<w>x<h>][:hq|:box][:every=<n>][:shm[=<slots>]]\n\n");
         col() << "options:\n";
         col() << TBOLD("\tpath=<path>")           << "\tpath to unix socket to connect to. Default is \""
                 << get_temp_dir() << DEFAULT_PREVIEW_FILENAME "\"\n";
         col() << TBOLD("\ttarget_size=<w>x<h>")<< "\tScales the video frame so that the total number of pixel is around <w>x<h>. If -1x-1 is passed, no scaling takes place."
                 << " Defaults are " TOSTRING(DEFAULT_SCALE_W) "x" TOSTRING(DEFAULT_SCALE_H) ".\n";
         col() << TBOLD("\thq")           << "\tUse higher quality downscale\n";
+        col() << TBOLD("\tbox")          << "\tAverage the downscaled pixels (box filter), MJPG is not decompressed but previewed from JPEG DC coefficients\n";
+        col() << TBOLD("\tevery=<n>")    << "\tPublish only every n-th frame\n";
+        col() << TBOLD("\tshm[=<slots>]") << "\tPass frames in a shared-memory ring (default " TOSTRING(DEFAULT_SHM_SLOTS) " slots) instead of the socket, Linux only\n";
 }
 
 static int init(struct module *parent, const char *cfg, void **state){
@@ -182,6 +194,19 @@ static int init(struct module *parent, const char *cfg, void **state){
                         parse_num(tokenize(val, 'x'), s->target_height);
                 } else if(key == "hq"){
                         s->ipc_conv = ipc_frame_from_ug_frame_hq;
+                } else if(key == "box"){
+                        s->ipc_conv = ipc_frame_from_ug_frame_box;
+                } else if(key == "every"){
+                        if(!parse_num(val, s->every) || s->every == 0){
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong frame interval\n");
+                                return -1;
+                        }
+                } else if(key == "shm"){
+                        s->shm_slots = DEFAULT_SHM_SLOTS;
+                        if(!val.empty() && (!parse_num(val, s->shm_slots) || s->shm_slots < 2)){
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong number of shm slots\n");
+                                return -1;
+                        }
                 } else if(key == "rate_limit"){
                         double limit = 1;
                         parse_num(val, limit);
@@ -216,6 +241,9 @@ static void done(void *state){
 static struct video_frame *filter(void *state, struct video_frame *in){
         struct state_preview_filter *s = (state_preview_filter *) state;
 
+        if(s->frame_counter++ % s->every != 0)
+                return in;
+
         auto now = clk::now();
         if(now < s->next_frame)
                 return in;
@@ -256,6 +284,7 @@ static const struct capture_filter_info capture_filter_preview = {
         .init = init,
         .done = done,
         .filter = filter,
+        .row_kernel = nullptr,
 };
 
 REGISTER_HIDDEN_MODULE(preview, &capture_filter_preview, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -45,17 +45,23 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "capture_filter.h"
 #include "capture_filter/resize_utils.h"
+#include "capture_filter/resize_yuv.h"
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
 #include "utils/macros.h"
 #include "utils/parallel_conv.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
@@ -70,11 +76,15 @@ static struct video_frame *filter(void *state, struct video_frame *in);
 
 struct state_resize {
     struct resize_param param;
+    int native_algo;
+    bool force_opencv;
+    struct resize_yuv *yuv; ///< native resizer, NULL if OpenCV is used
     struct video_desc saved_desc;
     struct video_desc out_desc;
     char *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
     decoder_t decoder;
     struct video_frame *dec_frame;
+    void *pool;
 };
 
 static void usage() {
@@ -93,23 +103,47 @@ static void usage() {
     color_printf(
         "\nOptions:\n"
         "\t" TBOLD(
-            "algo") " - scaling algorithm to use (list with `algo:help`)\n");
+            "algo") " - scaling algorithm to use (list with `algo:help`)\n"
+        "\t" TBOLD("opencv") " - resize with OpenCV (converts to RGB)\n");
+    color_printf("\nYUV formats (%s) are resized natively and keep their "
+                 "pixel format,\n", "UYVY, YUYV, v210, I420");
+#ifdef HAVE_RESIZE_OPENCV
+    color_printf("other formats are converted to RGB and resized with "
+                 "OpenCV.\n");
+#else
+    color_printf("other formats are converted to one of those (OpenCV "
+                 "backend is not compiled in).\n");
+#endif
     color_printf("\n");
 }
 
 static int
-parse_fmt(char *cfg, struct resize_param *param)
+parse_fmt(char *cfg, struct state_resize *s)
 {
+    struct resize_param *param = &s->param;
     char *save_ptr = NULL;
     char *item     = NULL;
     while ((item = strtok_r(cfg, ":", &save_ptr))) {
         cfg = NULL;
         if (IS_KEY_PREFIX(item, "algorithm")) {
-            param->algo = resize_algo_from_string(strchr(item, '=') + 1);
-            if (param->algo < 0) {
-                    return param->algo == RESIZE_ALGO_HELP_SHOWN ? 1 : -1;
+            const char *name = strchr(item, '=') + 1;
+            s->native_algo   = resize_yuv_algo_from_string(name);
+            if (s->native_algo < 0) {
+                    return s->native_algo == RESIZE_ALGO_HELP_SHOWN ? 1 : -1;
             }
+#ifdef HAVE_RESIZE_OPENCV
+            param->algo = resize_algo_from_string(name);
+#endif
+            continue;
+        }
+        if (strcmp(item, "opencv") == 0) {
+#ifdef HAVE_RESIZE_OPENCV
+            s->force_opencv = true;
             continue;
+#else
+            MSG(ERROR, "OpenCV backend not compiled in!\n");
+            return -1;
+#endif
         }
         if (!isdigit(item[0]) && item[0] != '.') {
             log_msg(LOG_LEVEL_ERROR,
@@ -147,22 +181,24 @@ parse_fmt(char *cfg, struct resize_param *param)
 static int init(struct module * parent, const char *cfg, void **state)
 {
     UNUSED(parent);
-    struct resize_param param = { .algo = RESIZE_ALGO_DFL };
 
     if(strcasecmp(cfg, "help") == 0) {
         usage();
         return 1;
     }
 
+    struct state_resize *s = calloc(1, sizeof(struct state_resize));
+    s->param.algo  = RESIZE_ALGO_DFL;
+    s->native_algo = RESIZE_ALGO_DFL;
     char *fmt = strdup(cfg);
-    const int rc = parse_fmt(fmt, &param);
+    const int rc = parse_fmt(fmt, s);
     free(fmt);
     if (rc != 0) {
+        free(s);
         return rc;
     }
 
-    struct state_resize *s = calloc(1, sizeof(struct state_resize));
-    s->param = param;
+    s->pool = video_frame_pool_init((struct video_desc){ 0 }, 0);
 
     *state = s;
     return 0;
@@ -173,13 +209,17 @@ cleanup_common(struct state_resize *s)
 {
     vf_free(s->dec_frame);
     s->dec_frame = NULL;
+    resize_yuv_destroy(s->yuv);
+    s->yuv = NULL;
 }
 
 static void
 done(void *state)
 {
-    cleanup_common((struct state_resize *) state);
-    free(state);
+    struct state_resize *s = state;
+    cleanup_common(s);
+    video_frame_pool_destroy(s->pool);
+    free(s);
 }
 
 static bool
@@ -190,9 +230,19 @@ reconfigure_if_needed(struct state_resize *s, const struct video_frame *in)
     }
     struct video_desc dec_desc         = video_desc_from_frame(in);
     s->out_desc                        = video_desc_from_frame(in);
+    const codec_t native_codecs[] = { RESIZE_YUV_SUPPORTED_PIXFMT_INIT,
+                                      VIDEO_CODEC_NONE };
+#ifdef HAVE_RESIZE_OPENCV
     const codec_t supp_in_codecs[] = { RESIZE_SUPPORTED_PIXFMT_INIT,
                                            VIDEO_CODEC_NONE };
-    if (codec_is_in_set(in->color_spec, supp_in_codecs)) {
+    const bool native = !s->force_opencv &&
+                        codec_is_in_set(in->color_spec, native_codecs);
+#else
+    const codec_t *supp_in_codecs = native_codecs;
+    const bool native = true;
+#endif
+    if (codec_is_in_set(in->color_spec, supp_in_codecs) ||
+        (native && codec_is_in_set(in->color_spec, native_codecs))) {
         dec_desc.color_spec = in->color_spec;
         s->decoder = vc_memcpy;
     } else {
@@ -205,8 +255,12 @@ reconfigure_if_needed(struct state_resize *s, const struct video_frame *in)
             return false;
         }
     }
-    s->out_desc.color_spec =
-        get_bits_per_component(dec_desc.color_spec) == DEPTH8 ? RGB : RG48;
+    if (native) {
+        s->out_desc.color_spec = dec_desc.color_spec;
+    } else {
+        s->out_desc.color_spec =
+            get_bits_per_component(dec_desc.color_spec) == DEPTH8 ? RGB : RG48;
+    }
     MSG(INFO, "Decoding through %s to output pixfmt %s.\n",
         get_codec_name(dec_desc.color_spec),
         get_codec_name(s->out_desc.color_spec));
@@ -220,6 +274,19 @@ reconfigure_if_needed(struct state_resize *s, const struct video_frame *in)
     }
     s->saved_desc = video_desc_from_frame(in);
     cleanup_common(s);
+    if (native) {
+        // all natively supported formats are chroma subsampled
+        s->out_desc.width &= ~1U;
+        s->out_desc.height &= ~1U;
+        s->yuv = resize_yuv_init(
+            dec_desc.color_spec, (int) dec_desc.width, (int) dec_desc.height,
+            (int) s->out_desc.width, (int) s->out_desc.height,
+            s->param.mode == USE_DIMENSIONS, s->native_algo);
+        if (s->yuv == NULL) {
+            s->saved_desc = (struct video_desc){ 0 };
+            return false;
+        }
+    }
     if (s->decoder != vc_memcpy) {
         s->dec_frame               = vf_alloc_desc_data(dec_desc);
     }
@@ -237,12 +304,14 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         return NULL;
     }
 
-    struct video_frame *out_frame = vf_alloc_desc(s->out_desc);
+    struct video_frame *out_frame = NULL;
     if (s->vo_pp_out_buffer) {
+        out_frame = vf_alloc_desc(s->out_desc);
         out_frame->tiles[0].data = s->vo_pp_out_buffer;
+        out_frame->callbacks.dispose = vf_free;
     } else {
-        out_frame->tiles[0].data = (char *) malloc(out_frame->tiles[0].data_len);
-        out_frame->callbacks.data_deleter = vf_data_deleter;
+        video_frame_pool_reconfigure(s->pool, s->out_desc, 0);
+        out_frame = video_frame_pool_get_disposable_frame(s->pool);
     }
 
     for (unsigned int i = 0; i < out_frame->tile_count; i++) {
@@ -257,15 +326,20 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         struct video_frame *const in_frame =
             s->decoder == vc_memcpy ? in : s->dec_frame;
 
+        if (s->yuv != NULL) {
+            resize_yuv_frame(s->yuv, in_frame->tiles[i].data,
+                             out_frame->tiles[i].data);
+            continue;
+        }
+#ifdef HAVE_RESIZE_OPENCV
         resize_frame(in_frame->tiles[i].data, in_frame->color_spec,
                      out_frame->tiles[i].data, (int) in_frame->tiles[i].width,
                      (int) in_frame->tiles[i].height, &s->param);
+#endif
     }
 
     VIDEO_FRAME_DISPOSE(in);
 
-    out_frame->callbacks.dispose = vf_free;
-
     return out_frame;
 }
 
@@ -279,6 +353,7 @@ static const struct capture_filter_info capture_filter_resize = {
     init,
     done,
     filter,
+    NULL,
 };
 
 REGISTER_MODULE(resize, &capture_filter_resize, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
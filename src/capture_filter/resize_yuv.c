@@ -0,0 +1,656 @@
+/**
+ * @file   capture_filter/resize_yuv.c
+ *
+ * Native (OpenCV-independent) resizer operating directly on YUV pixel
+ * formats with separable polyphase filters.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * The resize is done in two separable passes - horizontal pass filters every
+ * input row (unpacked to 16-bit planes) to the destination width, vertical
+ * pass then combines the filtered rows and packs the result back to the
+ * original pixel format. Both passes run multi-threaded over bands of rows.
+ *
+ * Filter coefficients are precomputed per destination sample (polyphase) in
+ * fixed point, when downscaling the kernel is stretched by the scale factor
+ * so that the result is properly antialiased. Both filters have SSE2 paths
+ * (pmaddwd of 16-bit samples with the coefficients), the scalar code is used
+ * for the remainders and on other architectures.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "capture_filter/resize_utils.h"
+#include "capture_filter/resize_yuv.h"
+#include "debug.h"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/parallel_conv.h"
+#include "video_codec.h"
+
+#define MOD_NAME "[resize] "
+#define COEF_BITS 14
+#define MAX_PLANES 3
+#define V210_GROUP 6 ///< pixels per one v210 block
+#define SIMD_TAPS 8  ///< int16 coefficients per one 128-bit register
+#define PAD_WIDTH(w) (((w) + 2 * V210_GROUP - 1) / (2 * V210_GROUP) * (2 * V210_GROUP))
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+enum resize_yuv_algo {
+        ALGO_NEAREST,
+        ALGO_LINEAR,
+        ALGO_CUBIC,
+        ALGO_AREA,
+        ALGO_LANCZOS4,
+};
+#define DEFAULT_ALGO ALGO_LINEAR
+
+static const struct {
+        const char *name;
+        double radius; ///< kernel support (half-width) for scale 1:1
+} algos[] = {
+        [ALGO_NEAREST]  = { "nearest",  0.5 },
+        [ALGO_LINEAR]   = { "linear",   1.0 },
+        [ALGO_CUBIC]    = { "cubic",    2.0 },
+        [ALGO_AREA]     = { "area",     0.5 },
+        [ALGO_LANCZOS4] = { "lanczos4", 4.0 },
+};
+
+struct filter_table {
+        int taps;
+        int stride;     ///< coefficients per destination sample (taps padded to SIMD width)
+        int *start;     ///< first source sample for every destination sample
+        int16_t *coef;  ///< coefficients per destination sample
+};
+
+struct resize_plane {
+        int in_w, in_h;
+        int out_w, out_h;
+        size_t in_offset, out_offset;    ///< plane offsets (planar formats only)
+        int pad_w;                       ///< allocated width of row buffers
+        int rect_x, rect_y, rect_w, rect_h; ///< destination area (rest is letterbox)
+        uint16_t black;
+        struct filter_table h, v;
+        uint16_t *tmp; ///< horizontally filtered rows (rect_w x in_h)
+};
+
+struct resize_yuv {
+        codec_t codec;
+        int maxval;
+        int sub_v; ///< vertical chroma subsampling
+        int in_width, in_height;
+        int out_width, out_height;
+        struct resize_plane p[MAX_PLANES];
+
+        const char *in; ///< currently processed frame (for pass callbacks)
+        char *out;
+};
+
+int
+resize_yuv_algo_from_string(const char *str)
+{
+        if (strcmp(str, "help") == 0) {
+                color_printf("Available resize algorithms:\n");
+                for (unsigned i = 0; i < sizeof algos / sizeof algos[0]; ++i) {
+                        color_printf("\t" TBOLD("%s") "%s\n", algos[i].name,
+                                     i == DEFAULT_ALGO ? " (default)" : "");
+                }
+                return RESIZE_ALGO_HELP_SHOWN;
+        }
+        for (unsigned i = 0; i < sizeof algos / sizeof algos[0]; ++i) {
+                if (strcmp(algos[i].name, str) == 0) {
+                        return (int) i;
+                }
+        }
+        return RESIZE_ALGO_UNKN;
+}
+
+static double
+kernel(enum resize_yuv_algo algo, double x)
+{
+        x = fabs(x);
+        switch (algo) {
+        case ALGO_NEAREST:
+        case ALGO_AREA:
+                return x < 0.5 ? 1.0 : x == 0.5 ? 0.5 : 0.0;
+        case ALGO_LINEAR:
+                return x < 1.0 ? 1.0 - x : 0.0;
+        case ALGO_CUBIC: {
+                const double a = -0.75; // the same as OpenCV uses
+                if (x < 1.0) {
+                        return ((a + 2) * x - (a + 3)) * x * x + 1;
+                }
+                if (x < 2.0) {
+                        return ((a * x - 5 * a) * x + 8 * a) * x - 4 * a;
+                }
+                return 0.0;
+        }
+        case ALGO_LANCZOS4:
+                if (x < 1e-9) {
+                        return 1.0;
+                }
+                if (x >= 4.0) {
+                        return 0.0;
+                }
+                return 4.0 * sin(M_PI * x) * sin(M_PI * x / 4.0) /
+                       (M_PI * M_PI * x * x);
+        }
+        abort();
+}
+
+static void
+free_table(struct filter_table *t)
+{
+        free(t->start);
+        free(t->coef);
+        t->start = NULL;
+        t->coef  = NULL;
+}
+
+/**
+ * Computes fixed-point coefficients mapping in_len source samples to out_len
+ * destination ones. Taps falling outside the source are folded to the edge
+ * samples so that every window is contiguous and lies within the source.
+ */
+static void
+build_table(struct filter_table *t, int in_len, int out_len,
+            enum resize_yuv_algo algo)
+{
+        const double scale   = (double) in_len / out_len;
+        const double fscale  = MAX(scale, 1.0);
+        const double support = algos[algo].radius * fscale;
+        const double win_d   = ceil(2 * support);
+        const int    win     = algo == ALGO_NEAREST ? 1 : (int) win_d + 1;
+
+        t->taps   = MIN(win, in_len);
+        t->stride = (t->taps + SIMD_TAPS - 1) / SIMD_TAPS * SIMD_TAPS;
+        t->start  = malloc(out_len * sizeof *t->start);
+        t->coef   = calloc((size_t) out_len * t->stride, sizeof *t->coef);
+        double *w      = malloc(win * sizeof *w);
+        double *folded = malloc(t->taps * sizeof *folded);
+
+        for (int i = 0; i < out_len; ++i) {
+                const double center = (i + 0.5) * scale - 0.5;
+                int16_t *c = t->coef + (size_t) i * t->stride;
+                if (algo == ALGO_NEAREST) {
+                        const double pos = floor((i + 0.5) * scale);
+                        t->start[i] = CLAMP((int) pos, 0, in_len - 1);
+                        c[0]        = 1 << COEF_BITS;
+                        continue;
+                }
+                const double first_d = floor(center - support) + 1;
+                const int first = (int) first_d;
+                const int start = CLAMP(first, 0, in_len - t->taps);
+                t->start[i] = start;
+
+                double sum = 0;
+                for (int k = 0; k < win; ++k) {
+                        w[k] = kernel(algo, (first + k - center) / fscale);
+                        sum += w[k];
+                }
+                if (sum <= 0) {
+                        sum = 1;
+                }
+                for (int k = 0; k < t->taps; ++k) {
+                        folded[k] = 0;
+                }
+                for (int k = 0; k < win; ++k) {
+                        const int idx = CLAMP(first + k, 0, in_len - 1) - start;
+                        folded[idx] += w[k] / sum;
+                }
+                int isum = 0;
+                int peak = 0;
+                for (int k = 0; k < t->taps; ++k) {
+                        const long val = lround(folded[k] * (1 << COEF_BITS));
+                        c[k] = (int16_t) val;
+                        isum += c[k];
+                        if (c[k] > c[peak]) {
+                                peak = k;
+                        }
+                }
+                c[peak] += (1 << COEF_BITS) - isum; // make the sum exact
+        }
+        free(w);
+        free(folded);
+}
+
+static void
+fill(uint16_t *restrict row, int count, uint16_t val)
+{
+        for (int x = 0; x < count; ++x) {
+                row[x] = val;
+        }
+}
+
+static void
+hfilter(const struct filter_table *t, int out_len, const uint16_t *restrict in,
+        uint16_t *restrict out, int maxval)
+{
+        const int taps   = t->taps;
+        const int stride = t->stride;
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i rnd  = _mm_set1_epi32(1 << (COEF_BITS - 1));
+        const __m128i vmax = _mm_set1_epi16((short) maxval);
+        for ( ; x + 4 <= out_len; x += 4) {
+                __m128i sum[4];
+                for (int i = 0; i < 4; ++i) {
+                        const uint16_t *src = in + t->start[x + i];
+                        const int16_t  *c   = t->coef + (size_t) (x + i) * stride;
+                        sum[i] = _mm_setzero_si128();
+                        for (int k = 0; k < stride; k += 8) {
+                                const __m128i px = _mm_loadu_si128((const __m128i *)(const void *) (src + k));
+                                const __m128i cf = _mm_loadu_si128((const __m128i *)(const void *) (c + k));
+                                sum[i] = _mm_add_epi32(sum[i], _mm_madd_epi16(px, cf));
+                        }
+                }
+                // transpose-add to [sum0, sum1, sum2, sum3]
+                const __m128i s01 = _mm_add_epi32(_mm_unpacklo_epi32(sum[0], sum[1]),
+                                                  _mm_unpackhi_epi32(sum[0], sum[1]));
+                const __m128i s23 = _mm_add_epi32(_mm_unpacklo_epi32(sum[2], sum[3]),
+                                                  _mm_unpackhi_epi32(sum[2], sum[3]));
+                __m128i res = _mm_add_epi32(_mm_unpacklo_epi64(s01, s23),
+                                            _mm_unpackhi_epi64(s01, s23));
+                res = _mm_srai_epi32(_mm_add_epi32(res, rnd), COEF_BITS);
+                res = _mm_packs_epi32(res, res);
+                res = _mm_min_epi16(_mm_max_epi16(res, _mm_setzero_si128()), vmax);
+                _mm_storel_epi64((__m128i *)(void *) (out + x), res);
+        }
+#endif
+        for ( ; x < out_len; ++x) {
+                const uint16_t *src = in + t->start[x];
+                const int16_t  *c   = t->coef + (size_t) x * stride;
+                int32_t acc = 1 << (COEF_BITS - 1);
+                for (int k = 0; k < taps; ++k) {
+                        acc += c[k] * src[k];
+                }
+                acc >>= COEF_BITS;
+                out[x] = CLAMP(acc, 0, maxval);
+        }
+}
+
+/// computes full output row y of plane p (including letterbox)
+static void
+vfilter(const struct resize_plane *p, int y, int maxval, uint16_t *restrict out)
+{
+        if (y < p->rect_y || y >= p->rect_y + p->rect_h) {
+                fill(out, p->pad_w, p->black);
+                return;
+        }
+        fill(out, p->rect_x, p->black);
+        fill(out + p->rect_x + p->rect_w, p->pad_w - p->rect_x - p->rect_w,
+             p->black);
+
+        const int width = p->rect_w;
+        const int taps  = p->v.taps;
+        const int16_t  *c   = p->v.coef + (size_t) (y - p->rect_y) * p->v.stride;
+        const uint16_t *src =
+            p->tmp + (size_t) p->v.start[y - p->rect_y] * width;
+        uint16_t *restrict dst = out + p->rect_x;
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i rnd  = _mm_set1_epi32(1 << (COEF_BITS - 1));
+        const __m128i vmax = _mm_set1_epi16((short) maxval);
+        const __m128i zero = _mm_setzero_si128();
+        for ( ; x + 8 <= width; x += 8) {
+                __m128i lo = rnd;
+                __m128i hi = rnd;
+                int k = 0;
+                // 2 taps at once - interleaved rows multiplied by coef pair
+                for ( ; k + 2 <= taps; k += 2) {
+                        const __m128i r0 = _mm_loadu_si128((const __m128i *)(const void *) (src + (size_t) k * width + x));
+                        const __m128i r1 = _mm_loadu_si128((const __m128i *)(const void *) (src + (size_t) (k + 1) * width + x));
+                        const __m128i cc = _mm_set1_epi32((int) ((uint16_t) c[k] | (uint32_t) (uint16_t) c[k + 1] << 16));
+                        lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(r0, r1), cc));
+                        hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(r0, r1), cc));
+                }
+                if (k < taps) {
+                        const __m128i r0 = _mm_loadu_si128((const __m128i *)(const void *) (src + (size_t) k * width + x));
+                        const __m128i cc = _mm_set1_epi32((uint16_t) c[k]);
+                        lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(r0, zero), cc));
+                        hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(r0, zero), cc));
+                }
+                __m128i res = _mm_packs_epi32(_mm_srai_epi32(lo, COEF_BITS),
+                                              _mm_srai_epi32(hi, COEF_BITS));
+                res = _mm_min_epi16(_mm_max_epi16(res, zero), vmax);
+                _mm_storeu_si128((__m128i *)(void *) (dst + x), res);
+        }
+#endif
+        for ( ; x < width; ++x) {
+                int32_t acc = 1 << (COEF_BITS - 1);
+                for (int k = 0; k < taps; ++k) {
+                        acc += c[k] * src[(size_t) k * width + x];
+                }
+                acc >>= COEF_BITS;
+                dst[x] = CLAMP(acc, 0, maxval);
+        }
+}
+
+static void
+unpack_row(const struct resize_yuv *s, int y, uint16_t **row, bool chroma)
+{
+        const int width = s->in_width;
+        uint16_t *restrict y_row  = row[0];
+        uint16_t *restrict cb_row = row[1];
+        uint16_t *restrict cr_row = row[2];
+        const unsigned char *src =
+            (const unsigned char *) s->in +
+            (size_t) y * vc_get_linesize(width, s->codec);
+
+        switch (s->codec) {
+        case UYVY:
+        case YUYV: {
+                const int yoff = s->codec == UYVY ? 1 : 0;
+                const int coff = 1 - yoff;
+                for (int i = 0; i < width / 2; ++i) {
+                        cb_row[i]        = src[4 * i + coff];
+                        y_row[2 * i]     = src[4 * i + yoff];
+                        cr_row[i]        = src[4 * i + 2 + coff];
+                        y_row[2 * i + 1] = src[4 * i + 2 + yoff];
+                }
+                if (width % 2 == 1) {
+                        y_row[width - 1]  = y_row[width - 2];
+                        cb_row[width / 2] = cb_row[width / 2 - 1];
+                        cr_row[width / 2] = cr_row[width / 2 - 1];
+                }
+                break;
+        }
+        case v210: {
+                const uint32_t *in32 = (const void *) src;
+                for (int i = 0; i < (width + V210_GROUP - 1) / V210_GROUP; ++i) {
+                        const uint32_t w0 = *in32++;
+                        const uint32_t w1 = *in32++;
+                        const uint32_t w2 = *in32++;
+                        const uint32_t w3 = *in32++;
+                        cb_row[3 * i]     = w0 & 0x3FF;
+                        y_row[6 * i]      = (w0 >> 10) & 0x3FF;
+                        cr_row[3 * i]     = (w0 >> 20) & 0x3FF;
+                        y_row[6 * i + 1]  = w1 & 0x3FF;
+                        cb_row[3 * i + 1] = (w1 >> 10) & 0x3FF;
+                        y_row[6 * i + 2]  = (w1 >> 20) & 0x3FF;
+                        cr_row[3 * i + 1] = w2 & 0x3FF;
+                        y_row[6 * i + 3]  = (w2 >> 10) & 0x3FF;
+                        cb_row[3 * i + 2] = (w2 >> 20) & 0x3FF;
+                        y_row[6 * i + 4]  = w3 & 0x3FF;
+                        cr_row[3 * i + 2] = (w3 >> 10) & 0x3FF;
+                        y_row[6 * i + 5]  = (w3 >> 20) & 0x3FF;
+                }
+                break;
+        }
+        case I420:
+                for (int i = 0; i < (chroma ? MAX_PLANES : 1); ++i) {
+                        const int py = i == 0 ? y : y / 2;
+                        const unsigned char *line =
+                            (const unsigned char *) s->in +
+                            s->p[i].in_offset + (size_t) py * s->p[i].in_w;
+                        for (int x = 0; x < s->p[i].in_w; ++x) {
+                                row[i][x] = line[x];
+                        }
+                }
+                break;
+        default:
+                abort();
+        }
+}
+
+static void
+pack_row(const struct resize_yuv *s, int y, uint16_t *const *row, bool chroma)
+{
+        const int width = s->out_width;
+        const uint16_t *y_row  = row[0];
+        const uint16_t *cb_row = row[1];
+        const uint16_t *cr_row = row[2];
+        unsigned char *dst = (unsigned char *) s->out +
+                             (size_t) y * vc_get_linesize(width, s->codec);
+
+        switch (s->codec) {
+        case UYVY:
+        case YUYV: {
+                const int yoff = s->codec == UYVY ? 1 : 0;
+                const int coff = 1 - yoff;
+                for (int i = 0; i < width / 2; ++i) {
+                        dst[4 * i + coff]     = cb_row[i];
+                        dst[4 * i + yoff]     = y_row[2 * i];
+                        dst[4 * i + 2 + coff] = cr_row[i];
+                        dst[4 * i + 2 + yoff] = y_row[2 * i + 1];
+                }
+                break;
+        }
+        case v210: {
+                uint32_t *out32 = (void *) dst;
+                for (int i = 0; i < (width + V210_GROUP - 1) / V210_GROUP; ++i) {
+                        *out32++ = cb_row[3 * i] | y_row[6 * i] << 10 |
+                                   (uint32_t) cr_row[3 * i] << 20;
+                        *out32++ = y_row[6 * i + 1] | cb_row[3 * i + 1] << 10 |
+                                   (uint32_t) y_row[6 * i + 2] << 20;
+                        *out32++ = cr_row[3 * i + 1] | y_row[6 * i + 3] << 10 |
+                                   (uint32_t) cb_row[3 * i + 2] << 20;
+                        *out32++ = y_row[6 * i + 4] | cr_row[3 * i + 2] << 10 |
+                                   (uint32_t) y_row[6 * i + 5] << 20;
+                }
+                break;
+        }
+        case I420:
+                for (int i = 0; i < (chroma ? MAX_PLANES : 1); ++i) {
+                        const int py = i == 0 ? y : y / 2;
+                        unsigned char *line = (unsigned char *) s->out +
+                                              s->p[i].out_offset +
+                                              (size_t) py * s->p[i].out_w;
+                        for (int x = 0; x < s->p[i].out_w; ++x) {
+                                line[x] = row[i][x];
+                        }
+                }
+                break;
+        default:
+                abort();
+        }
+}
+
+static void
+alloc_rows(const struct resize_yuv *s, uint16_t **row)
+{
+        for (int i = 0; i < MAX_PLANES; ++i) {
+                // SIMD_TAPS slack - horizontal filter reads whole stride
+                row[i] = calloc(MAX(PAD_WIDTH(s->p[i].in_w), s->p[i].pad_w) +
+                                    SIMD_TAPS,
+                                sizeof(uint16_t));
+        }
+}
+
+static void
+free_rows(uint16_t **row)
+{
+        for (int i = 0; i < MAX_PLANES; ++i) {
+                free(row[i]);
+        }
+}
+
+static void
+horizontal_pass(int y_start, int y_end, void *udata)
+{
+        struct resize_yuv *s = udata;
+        uint16_t *row[MAX_PLANES];
+        alloc_rows(s, row);
+        for (int y = y_start; y < y_end; ++y) {
+                const bool chroma = y % s->sub_v == 0;
+                unpack_row(s, y, row, chroma);
+                for (int i = 0; i < (chroma ? MAX_PLANES : 1); ++i) {
+                        struct resize_plane *p = &s->p[i];
+                        const int py = i == 0 ? y : y / s->sub_v;
+                        hfilter(&p->h, p->rect_w, row[i],
+                                p->tmp + (size_t) py * p->rect_w, s->maxval);
+                }
+        }
+        free_rows(row);
+}
+
+static void
+vertical_pass(int y_start, int y_end, void *udata)
+{
+        struct resize_yuv *s = udata;
+        uint16_t *row[MAX_PLANES];
+        alloc_rows(s, row);
+        for (int y = y_start; y < y_end; ++y) {
+                const bool chroma = y % s->sub_v == 0;
+                for (int i = 0; i < (chroma ? MAX_PLANES : 1); ++i) {
+                        const int py = i == 0 ? y : y / s->sub_v;
+                        vfilter(&s->p[i], py, s->maxval, row[i]);
+                }
+                pack_row(s, y, row, chroma);
+        }
+        free_rows(row);
+}
+
+void
+resize_yuv_frame(struct resize_yuv *s, const char *in, char *out)
+{
+        DEBUG_TIMER_START(resize_yuv);
+        s->in  = in;
+        s->out = out;
+        parallel_rows(s->in_height, horizontal_pass, s, 0);
+        parallel_rows(s->out_height, vertical_pass, s, 0);
+        DEBUG_TIMER_STOP(resize_yuv);
+}
+
+struct resize_yuv *
+resize_yuv_init(codec_t codec, int in_width, int in_height, int out_width,
+                int out_height, bool keep_aspect, int algo)
+{
+        const codec_t supported[] = { RESIZE_YUV_SUPPORTED_PIXFMT_INIT,
+                                      VIDEO_CODEC_NONE };
+        if (!codec_is_in_set(codec, supported)) {
+                MSG(ERROR, "Pixel format %s not supported by the native resizer!\n",
+                    get_codec_name(codec));
+                return NULL;
+        }
+        if (in_width < 2 || in_height < 2 || out_width < 2 || out_height < 2 ||
+            out_width % 2 != 0 || out_height % 2 != 0) {
+                MSG(ERROR, "Wrong dimensions %dx%d->%dx%d (output must be even)!\n",
+                    in_width, in_height, out_width, out_height);
+                return NULL;
+        }
+        if (algo == RESIZE_ALGO_DFL) {
+                algo = DEFAULT_ALGO;
+                MSG(NOTICE, "using resize algorithm: %s\n", algos[algo].name);
+        }
+
+        struct resize_yuv *s = calloc(1, sizeof *s);
+        s->codec      = codec;
+        s->maxval     = (1 << get_bits_per_component(codec)) - 1;
+        s->sub_v      = codec == I420 ? 2 : 1;
+        s->in_width   = in_width;
+        s->in_height  = in_height;
+        s->out_width  = out_width;
+        s->out_height = out_height;
+
+        // luma destination rectangle, kept even to map exactly to chroma
+        int rect_x = 0;
+        int rect_y = 0;
+        int rect_w = out_width;
+        int rect_h = out_height;
+        const double in_aspect  = (double) in_width / in_height;
+        const double out_aspect = (double) out_width / out_height;
+        if (keep_aspect && in_aspect > out_aspect) {
+                const double h = out_width / in_aspect;
+                rect_h = MAX((int) h & ~1, 2);
+                rect_y = (out_height - rect_h) / 2 & ~1;
+        } else if (keep_aspect && in_aspect < out_aspect) {
+                const double w = out_height * in_aspect;
+                rect_w = MAX((int) w & ~1, 2);
+                rect_x = (out_width - rect_w) / 2 & ~1;
+        }
+
+        const int depth = get_bits_per_component(codec);
+        size_t in_offset  = 0;
+        size_t out_offset = 0;
+        for (int i = 0; i < MAX_PLANES; ++i) {
+                struct resize_plane *p = &s->p[i];
+                const int sub_h = i == 0 ? 1 : 2;
+                const int sub_v = i == 0 ? 1 : s->sub_v;
+                p->in_w   = (in_width + sub_h - 1) / sub_h;
+                p->in_h   = (in_height + sub_v - 1) / sub_v;
+                p->out_w  = out_width / sub_h;
+                p->out_h  = out_height / sub_v;
+                p->pad_w  = PAD_WIDTH(out_width) / sub_h;
+                p->in_offset  = in_offset;
+                p->out_offset = out_offset;
+                in_offset += (size_t) p->in_w * p->in_h;
+                out_offset += (size_t) p->out_w * p->out_h;
+                p->rect_x = rect_x / sub_h;
+                p->rect_y = rect_y / sub_v;
+                p->rect_w = rect_w / sub_h;
+                p->rect_h = rect_h / sub_v;
+                p->black  = (i == 0 ? 16 : 128) << (depth - 8);
+                build_table(&p->h, p->in_w, p->rect_w, algo);
+                build_table(&p->v, p->in_h, p->rect_h, algo);
+                p->tmp = malloc((size_t) p->rect_w * p->in_h * sizeof *p->tmp);
+        }
+        MSG(VERBOSE, "native %s resize %dx%d->%dx%d (area %dx%d+%d+%d), "
+            "%d/%d taps\n", get_codec_name(codec), in_width, in_height,
+            out_width, out_height, rect_w, rect_h, rect_x, rect_y,
+            s->p[0].h.taps, s->p[0].v.taps);
+        return s;
+}
+
+void
+resize_yuv_destroy(struct resize_yuv *s)
+{
+        if (s == NULL) {
+                return;
+        }
+        for (int i = 0; i < MAX_PLANES; ++i) {
+                free_table(&s->p[i].h);
+                free_table(&s->p[i].v);
+                free(s->p[i].tmp);
+        }
+        free(s);
+}
+
+/* vim: set expandtab sw=8: */
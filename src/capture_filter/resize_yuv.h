@@ -0,0 +1,76 @@
+/**
+ * @file   capture_filter/resize_yuv.h
+ *
+ * Native (OpenCV-independent) resizer operating directly on YUV pixel
+ * formats with separable polyphase filters.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CAPTURE_FILTER_RESIZE_YUV_H_6C0F2A9E_41B7_4D3A_9E15_0B8D7C2F5A61
+#define CAPTURE_FILTER_RESIZE_YUV_H_6C0F2A9E_41B7_4D3A_9E15_0B8D7C2F5A61
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// pixel formats that can be resized natively (output has the same pixfmt)
+#define RESIZE_YUV_SUPPORTED_PIXFMT_INIT UYVY, YUYV, v210, I420
+
+struct resize_yuv;
+
+/**
+ * Parses the algorithm name (the same ones as the OpenCV backend accepts).
+ * @returns algorithm index or RESIZE_ALGO_UNKN/RESIZE_ALGO_HELP_SHOWN
+ */
+int resize_yuv_algo_from_string(const char *str);
+/**
+ * @param algo          algorithm from resize_yuv_algo_from_string() or
+ *                      RESIZE_ALGO_DFL
+ * @param keep_aspect   letterbox (pillarbox) the picture to out_width x
+ *                      out_height preserving the input aspect ratio
+ */
+struct resize_yuv *resize_yuv_init(codec_t codec, int in_width, int in_height,
+                                   int out_width, int out_height,
+                                   bool keep_aspect, int algo);
+/// resizes one tile, buffers have the layout given by vc_get_linesize()
+void resize_yuv_frame(struct resize_yuv *s, const char *in, char *out);
+void resize_yuv_destroy(struct resize_yuv *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined CAPTURE_FILTER_RESIZE_YUV_H_6C0F2A9E_41B7_4D3A_9E15_0B8D7C2F5A61
@@ -47,6 +47,7 @@
 #include "lib_common.h"
 #include "utils/color_out.h"
 #include "utils/vf_split.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_codec.h"
 
@@ -60,6 +61,7 @@ static struct video_frame *filter(void *state, struct video_frame *in);
 
 struct state_split {
 	int x, y;
+        void *pool;
 };
 
 static void usage() {
@@ -90,6 +92,7 @@ static int init(struct module *parent, const char *cfg, void **state)
         struct state_split *s = calloc(1, sizeof(struct state_split));
         s->x = x;
         s->y = y;
+        s->pool = video_frame_pool_init((struct video_desc){ 0 }, 0);
 
         *state = s;
         return 0;
@@ -97,7 +100,16 @@ static int init(struct module *parent, const char *cfg, void **state)
 
 static void done(void *state)
 {
-        free(state);
+        struct state_split *s = state;
+        video_frame_pool_destroy(s->pool);
+        free(s);
+}
+
+static void dispose_view(struct video_frame *f)
+{
+        struct video_frame *parent = f->callbacks.dispose_udata;
+        VIDEO_FRAME_DISPOSE(parent);
+        vf_free(f);
 }
 
 static struct video_frame *filter(void *state, struct video_frame *in)
@@ -108,9 +120,22 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         desc.tile_count = s->x * s->y;
         desc.width /= s->x;
         desc.height /= s->y;
-        struct video_frame *out = vf_alloc_desc_data(desc);
+
+        // tiles referencing the input frame (strided if s->x > 1), copied
+        // only if needed by the consumer (in compress tile workers)
+        if (in->callbacks.dispose != NULL) {
+                struct video_frame *out = vf_alloc_desc(desc);
+                vf_split_view(out, in, s->x, s->y);
+                vf_copy_metadata(out, in);
+                out->callbacks.dispose = dispose_view;
+                out->callbacks.dispose_udata = in;
+                return out;
+        }
+
+        // frame valid only until next grab - copy
+        video_frame_pool_reconfigure(s->pool, desc, 0);
+        struct video_frame *out = video_frame_pool_get_disposable_frame(s->pool);
         vf_split(out, in, s->x, s->y, 0);
-        out->callbacks.dispose = vf_free;
 
         VIDEO_FRAME_DISPOSE(in);
         return out;
@@ -44,9 +44,8 @@
 #include "control_socket.h"
 #include "compat/platform_pipe.h"
 
-#include <condition_variable>
-#include <mutex>
-#include <queue>
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <thread>
 
@@ -56,6 +55,9 @@
 #include "module.h"
 #include "rtp/net_udp.h" // socket_error
 #include "tv.h"
+#include "utils/lockfree_queue.h"
+#include "utils/mem_stats.h"
+#include "utils/metrics.h"
 #include "utils/net.h"
 #include "utils/thread.h"
 
@@ -73,6 +75,9 @@ struct client {
         fd_t fd;
         char buff[1024];
         int buff_len;
+        std::string out; ///< output not yet written (socket would block)
+        bool close_pending; ///< shut down once the output is written
+        unsigned long dropped; ///< stats/events lines dropped, client too slow
 
         struct client *prev;
         struct client *next;
@@ -83,7 +88,10 @@ enum connection_type {
         CLIENT
 };
 
-#define MAX_STAT_EVENT_QUEUE 100
+#define MAX_STAT_EVENT_QUEUE 128
+#define MAX_CLIENT_BACKLOG (64 * 1024) ///< pending output above which stats/events are dropped
+#define EXIT_DRAIN_TIMEOUT_MS 100 ///< max wait to deliver "event exit" to a client
+#define MEM_STATS_INTERVAL_S 10
 
 struct control_state {
         struct module mod;
@@ -93,17 +101,17 @@ struct control_state {
         int network_port;
         struct module *root_module;
 
-        std::mutex stats_lock;
-
         enum connection_type connection_type;
 
         fd_t socket_fd = INVALID_SOCKET;
 
         bool started;
 
+        /// stats/event lines submitted from the media threads (never blocking,
+        /// lines are dropped if full), drained by stat_event_thread
         thread stat_event_thread_id;
-        condition_variable stat_event_cv;
-        queue<string> stat_event_queue;
+        lockfree_queue<string, MAX_STAT_EVENT_QUEUE> stat_event_queue;
+        std::atomic<unsigned long> stat_event_dropped{0};
 
         bool stats_on;
         int audio_channel_report_count = 16;
@@ -113,11 +121,14 @@ struct control_state {
 #define CONTROL_CLOSE_HANDLE -2
 
 static bool parse_msg(char *buffer, int buffer_len, /* out */ char *message, int *new_buffer_len);
-static int process_msg(struct control_state *s, fd_t client_fd, char *message, struct client *clients);
+static int process_msg(struct control_state *s, struct client *client, char *message, struct client *clients);
+static void client_queue_output(struct client *c, const std::string &line);
+static void client_send_reply(struct client *c, const std::string &reply);
 static ssize_t write_all(fd_t fd, const void *buf, size_t count);
 static void * control_thread(void *args);
 static void * stat_event_thread(void *args);
-static void send_response(fd_t fd, struct response *resp);
+static void send_response(struct client *c, struct response *resp);
+static void send_http_response(struct client *c, const char *request);
 static void print_control_help();
 
 #ifndef MSG_NOSIGNAL
@@ -371,8 +382,9 @@ process_audio_message(struct module *root_module, const char *cmd)
   * @retval -1 exit thread
   * @retval -2 close handle
   */
-static int process_msg(struct control_state *s, fd_t client_fd, char *message, struct client *clients)
+static int process_msg(struct control_state *s, struct client *client, char *message, struct client *clients)
 {
+        const fd_t client_fd = client != nullptr ? client->fd : INVALID_SOCKET;
         int ret = 0;
         struct response *resp = NULL;
         char path[1024] = ""; // path for msg receiver (usually video)
@@ -380,6 +392,11 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
                                     // and video
         char buf[1048];
 
+        if (prefix_matches(message, "GET ")) { // HTTP (metrics scraping)
+                send_http_response(client, suffix(message, "GET "));
+                return CONTROL_CLOSE_HANDLE;
+        }
+
         if(prefix_matches(message, "port ")) {
                 message = suffix(message, "port ");
                 if (isdigit(message[0])) { // index is a number
@@ -424,30 +441,13 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
                 return ret;
         } else if (prefix_matches(message, "stats ") || prefix_matches(message, "event ")) {
                 if (is_internal_port(client_fd)) {
-                        struct client *cur = clients;
-                        char *new_msg = NULL;
-
-                        while (cur) {
+                        const string line = string(message) + "\r\n"; // append <CR><LF> again
+                        for (struct client *cur = clients; cur != nullptr; cur = cur->next) {
                                 if(is_internal_port(cur->fd)) { // skip local FD
-                                        cur = cur->next;
                                         continue;
                                 }
-                                if (!new_msg) {
-                                        // append <CR><LF> again
-                                        new_msg = (char *) malloc(strlen(message) + 1 + 2);
-                                        strcpy(new_msg, message);
-                                        new_msg[strlen(message)] = '\r';
-                                        new_msg[strlen(message) + 1] = '\n';
-                                        new_msg[strlen(message) + 2] = '\0';
-                                }
-
-                                int ret = write_all(cur->fd, new_msg, strlen(new_msg));
-                                if (ret != (int) strlen(new_msg)) {
-                                        log_msg(LOG_LEVEL_WARNING, "Cannot write stats/event!\n");
-                                }
-                                cur = cur->next;
+                                client_queue_output(cur, line);
                         }
-                        free(new_msg);
                         return ret;
                 } else if (prefix_matches(message, "stats ")) {
                         const char *toggle = suffix(message, "stats ");
@@ -636,6 +636,22 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
         } else if(strcmp(message, "dump-tree") == 0) {
                 dump_tree(s->root_module, 0);
                 resp = new_response(RESPONSE_OK, NULL);
+        } else if (strcasecmp(message, "devices") == 0 || prefix_matches(message, "devices ")) {
+                // the reply may be long, so the lines are sent before the status
+                string devices;
+                if (get_probed_devices(strchr(message, ' ') ? strchr(message, ' ') + 1 : "", &devices)) {
+                        for (size_t pos = 0; (pos = devices.find('\n', pos)) != string::npos; pos += 2) {
+                                devices.insert(pos, "\r");
+                        }
+                        client_send_reply(client, devices);
+                        resp = new_response(RESPONSE_OK, NULL);
+                } else {
+                        resp = new_response(RESPONSE_NOT_FOUND, "unknown class or module");
+                }
+        } else if (strcasecmp(message, "mem-stats") == 0) {
+                char report[768];
+                mem_stats_format(report, sizeof report);
+                resp = new_response(RESPONSE_OK, report);
         } else { // assume message in format "path message"
                 struct msg_universal *msg = (struct msg_universal *)
                         new_message(sizeof(struct msg_universal));
@@ -655,12 +671,16 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
                 snprintf(buf, sizeof(buf), "(unknown path: %s)", path);
                 resp = new_response(RESPONSE_INT_SERV_ERR, buf);
         }
-        send_response(client_fd, resp);
+        if (is_internal_port(client_fd)) { // nobody reads replies from the internal pipe
+                free_response(resp);
+        } else {
+                send_response(client, resp);
+        }
 
         return ret;
 }
 
-static void send_response(fd_t fd, struct response *resp)
+static void send_response(struct client *c, struct response *resp)
 {
         char buffer[1024];
 
@@ -673,14 +693,32 @@ static void send_response(fd_t fd, struct response *resp)
         }
         strcat(buffer, "\r\n");
 
-        ssize_t ret = write_all(fd, buffer, strlen(buffer));
-        if (ret < 0) {
-                socket_error("Unable to write response");
-        }
+        client_send_reply(c, buffer);
 
         free_response(resp);
 }
 
+/**
+ * Replies to a HTTP GET request line, only "/metrics" is served.
+ * @param request request line without the method, eg. "/metrics HTTP/1.1"
+ */
+static void send_http_response(struct client *c, const char *request)
+{
+        string status = "200 OK";
+        string content_type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+        string body;
+        if (strcmp(request, "/metrics") == 0 || prefix_matches(request, "/metrics ")) {
+                body = metrics_format_openmetrics();
+        } else {
+                status = "404 Not Found";
+                content_type = "text/plain";
+                body = "Not found, use /metrics\n";
+        }
+        client_send_reply(c, "HTTP/1.1 " + status + "\r\nContent-Type: " + content_type +
+                "\r\nContent-Length: " + to_string(body.length()) +
+                "\r\nConnection: close\r\n\r\n" + body);
+}
+
 static bool parse_msg(char *buffer, int buffer_len, /* out */ char *message, int *new_buffer_len)
 {
         bool ret = false;
@@ -717,8 +755,7 @@ static bool parse_msg(char *buffer, int buffer_len, /* out */ char *message, int
  * prepends itself at the head of the list
  */
 static struct client *add_client(struct client *clients, fd_t fd) {
-        struct client *new_client = (struct client *)
-                malloc(sizeof(struct client));
+        struct client *new_client = new client{};
         new_client->fd = fd;
         new_client->prev = NULL;
         new_client->next = clients;
@@ -730,6 +767,90 @@ static struct client *add_client(struct client *clients, fd_t fd) {
         return new_client;
 }
 
+/// writes as much of the pending output as possible without blocking
+static void client_flush(struct client *c)
+{
+        while (!c->out.empty()) {
+                const ssize_t w = send(c->fd, c->out.data(), c->out.size(), MSG_NOSIGNAL);
+                if (w <= 0) { // would block or error (handled when reading)
+                        return;
+                }
+                c->out.erase(0, w);
+        }
+}
+
+/**
+ * Queues a stats/event line for the client, the line is dropped if the client
+ * doesn't keep reading so that it doesn't stall the others.
+ */
+static void client_queue_output(struct client *c, const string &line)
+{
+        if (c->close_pending) {
+                return;
+        }
+        if (c->out.size() + line.size() > MAX_CLIENT_BACKLOG) {
+                if (c->dropped++ == 0) {
+                        log_msg(LOG_LEVEL_WARNING, "[control socket] Client not reading, "
+                                        "dropping stats/events.\n");
+                }
+                return;
+        }
+        if (c->dropped > 0) {
+                log_msg(LOG_LEVEL_NOTICE, "[control socket] Client reading again, %lu "
+                                "stats/events lines were dropped.\n", c->dropped);
+                c->dropped = 0;
+        }
+        c->out += line;
+        client_flush(c);
+}
+
+/**
+ * Sends a reply to a client command. The reply is queued after the pending
+ * stats/events (so that they are not interleaved) and never dropped.
+ * @param c  client or nullptr for commands received as a message ("execute"),
+ *           whose reply is printed to stdout
+ */
+static void client_send_reply(struct client *c, const string &reply)
+{
+        if (c == nullptr) {
+                write_all(1, reply.c_str(), reply.length());
+                return;
+        }
+        c->out += reply;
+        client_flush(c);
+}
+
+/// shuts the client down if requested and all its output was written
+static void client_close_if_done(struct client *c)
+{
+        if (c->close_pending && c->out.empty()) {
+                shutdown(c->fd, SHUT_RDWR);
+        }
+}
+
+/// waits at most timeout_ms until the pending output is written
+static void client_drain(struct client *c, int timeout_ms)
+{
+        const auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+        while (!c->out.empty()) {
+                const auto remaining = chrono::duration_cast<chrono::microseconds>(
+                                deadline - chrono::steady_clock::now()).count();
+                if (remaining <= 0) {
+                        return;
+                }
+                fd_set write_fds;
+                FD_ZERO(&write_fds);
+                FD_SET(c->fd, &write_fds);
+                struct timeval timeout;
+                timeout.tv_sec = remaining / 1000000;
+                timeout.tv_usec = remaining % 1000000;
+                if (select(c->fd + 1, NULL, &write_fds, NULL, &timeout) <= 0) {
+                        return;
+                }
+                client_flush(c);
+        }
+}
+
 static void process_messages(struct control_state *s)
 {
         struct message *msg;
@@ -747,7 +868,7 @@ static void process_messages(struct control_state *s)
                         }
                         free_message(msg, r);
                 } else if (strstr(m->text, "execute ") == m->text) {
-                        process_msg(s, 1, m->text + strlen("execute "), nullptr);
+                        process_msg(s, nullptr, m->text + strlen("execute "), nullptr);
                         free_message(msg, new_response(RESPONSE_OK, nullptr));
                 } else {
                         log_msg(LOG_LEVEL_WARNING, "[control] Unrecognized command: %s\n", m->text);
@@ -780,6 +901,7 @@ static void * control_thread(void *args)
         assert(s->internal_fd[0] != INVALID_SOCKET);
 
         if(s->connection_type == CLIENT) {
+                set_socket_nonblock(s->socket_fd);
                 clients = add_client(clients, s->socket_fd);
         }
         struct sockaddr_storage client_addr;
@@ -800,7 +922,9 @@ static void * control_thread(void *args)
 
                 fd_t max_fd = 0;
                 fd_set fds;
+                fd_set write_fds;
                 FD_ZERO(&fds);
+                FD_ZERO(&write_fds);
                 if (s->connection_type == SERVER) {
                         FD_SET(s->socket_fd, &fds);
                         max_fd = s->socket_fd + 1;
@@ -810,6 +934,9 @@ static void * control_thread(void *args)
 
                 while(cur) {
                         FD_SET(cur->fd, &fds);
+                        if (!cur->out.empty()) {
+                                FD_SET(cur->fd, &write_fds);
+                        }
                         if(cur->fd + 1 > max_fd) {
                                 max_fd = cur->fd + 1;
                         }
@@ -827,7 +954,7 @@ static void * control_thread(void *args)
 
                 int rc;
 
-                if ((rc = select(max_fd, &fds, NULL, NULL, timeout_ptr)) >= 1) {
+                if ((rc = select(max_fd, &fds, &write_fds, NULL, timeout_ptr)) >= 1) {
                         if(s->connection_type == SERVER && FD_ISSET(s->socket_fd, &fds)) {
                                 fd_t fd = accept(s->socket_fd, (struct sockaddr *) &client_addr, &len);
                                 if (fd == INVALID_SOCKET) {
@@ -856,6 +983,10 @@ static void * control_thread(void *args)
                         struct client *cur = clients;
 
                         while(cur) {
+                                if (FD_ISSET(cur->fd, &write_fds)) {
+                                        client_flush(cur);
+                                        client_close_if_done(cur);
+                                }
                                 if(FD_ISSET(cur->fd, &fds)) {
                                         ssize_t ret = PLATFORM_PIPE_READ(cur->fd, cur->buff + cur->buff_len,
                                                         sizeof(cur->buff) - cur->buff_len);
@@ -874,7 +1005,7 @@ static void * control_thread(void *args)
                                                         cur->next->prev = cur->prev;
                                                 }
                                                 next = cur->next;
-                                                free(cur);
+                                                delete cur;
                                                 cur = next;
                                                 continue;
                                         }
@@ -890,15 +1021,21 @@ static void * control_thread(void *args)
                 while(cur) {
                         char msg[sizeof(cur->buff) + 1];
                         int cur_buffer_len;
-                        while(parse_msg(cur->buff, cur->buff_len, msg, &cur_buffer_len)) {
+                        while (!cur->close_pending &&
+                                        parse_msg(cur->buff, cur->buff_len, msg, &cur_buffer_len)) {
                                 cur->buff_len = cur_buffer_len;
-                                int ret = process_msg(s, cur->fd, msg, clients);
+                                int ret = process_msg(s, cur, msg, clients);
                                 if(ret == CONTROL_EXIT && is_internal_port(cur->fd)) {
                                         should_exit = true;
                                 } else if(ret == CONTROL_CLOSE_HANDLE) {
-                                        shutdown(cur->fd, SHUT_RDWR);
+                                        // the reply may not have been sent yet
+                                        cur->close_pending = true;
+                                        client_close_if_done(cur);
                                 }
                         }
+                        if (cur->close_pending) {
+                                cur->buff_len = 0; // eg. HTTP headers
+                        }
                         if(cur->buff_len == sizeof(cur->buff)) {
                                 fprintf(stderr, "Socket buffer full and no delimited message. Discarding.\n");
                                 cur->buff_len = 0;
@@ -912,13 +1049,13 @@ static void * control_thread(void *args)
         struct client *cur = clients;
         while(cur) {
                 struct client *tmp = cur;
-                if (!is_internal_port(cur->fd)) {
-                        const char *msg = "event exit\r\n";
-                        write_all(cur->fd, msg, strlen(msg));
+                if (!is_internal_port(cur->fd) && !cur->close_pending) {
+                        client_send_reply(cur, "event exit\r\n");
+                        client_drain(cur, EXIT_DRAIN_TIMEOUT_MS);
                 }
                 CLOSESOCKET(cur->fd);
                 cur = cur->next;
-                free(tmp);
+                delete tmp;
         }
 
         platform_pipe_close(s->internal_fd[0]);
@@ -930,18 +1067,33 @@ static void *stat_event_thread(void *args)
 {
         set_thread_name(__func__);
         struct control_state *s = (struct control_state *) args;
+        auto next_mem_report = chrono::steady_clock::now() + chrono::seconds(MEM_STATS_INTERVAL_S);
+        unsigned long dropped_reported = 0;
 
         while (1) {
-                std::unique_lock<std::mutex> lk(s->stats_lock);
-                s->stat_event_cv.wait(lk, [s] { return s->stat_event_queue.size() > 0; });
-                string &line = s->stat_event_queue.front();
-
-                if (line.empty()) {
+                string line;
+                if (!s->stat_event_queue.timed_pop(line, next_mem_report - chrono::steady_clock::now())) {
+                        next_mem_report = chrono::steady_clock::now() + chrono::seconds(MEM_STATS_INTERVAL_S);
+                        if (s->stats_on) {
+                                char report[768];
+                                mem_stats_format(report, sizeof report);
+                                line = string("stats mem ") + report + "\r\n";
+                        }
+                        const unsigned long dropped = s->stat_event_dropped;
+                        if (dropped != dropped_reported) {
+                                log_msg(LOG_LEVEL_WARNING, "[control socket] %lu stats/events "
+                                                "dropped, control thread not keeping up.\n",
+                                                dropped - dropped_reported);
+                                dropped_reported = dropped;
+                        }
+                        if (line.empty()) {
+                                continue;
+                        }
+                } else if (line.empty()) {
                         break;
                 }
 
                 int ret = write_all(s->internal_fd[1], line.c_str(), line.length());
-                s->stat_event_queue.pop();
                 if (ret <= 0) {
                         fprintf(stderr, "Cannot write stat line!\n");
                 }
@@ -959,10 +1111,7 @@ void control_done(struct control_state *s)
         module_done(&s->mod);
 
         if(s->started) {
-                s->stats_lock.lock();
-                s->stat_event_queue.push({});
-                s->stats_lock.unlock();
-                s->stat_event_cv.notify_one();
+                s->stat_event_queue.push(string());
                 s->stat_event_thread_id.join();
 
                 int ret = write_all(s->internal_fd[1], "quit\r\n", 6);
@@ -982,17 +1131,12 @@ void control_done(struct control_state *s)
         delete s;
 }
 
-static void control_report_stats_event(struct control_state *s, const std::string &report_line)
+/// doesn't block - the line is dropped if the queue is full (logged by stat_event_thread)
+static void control_report_stats_event(struct control_state *s, std::string &&report_line)
 {
-        std::unique_lock<std::mutex> lk(s->stats_lock);
-
-        if (s->stat_event_queue.size() < MAX_STAT_EVENT_QUEUE) {
-                s->stat_event_queue.push(report_line);
-        } else {
-                log_msg(LOG_LEVEL_WARNING, "Cannot write stats/event - queue full!!!");
+        if (!s->stat_event_queue.push_nonblocking(std::move(report_line))) {
+                s->stat_event_dropped.fetch_add(1, std::memory_order_relaxed);
         }
-        lk.unlock();
-        s->stat_event_cv.notify_one();
 }
 
 void control_report_stats(struct control_state *s, const std::string &report_line)
@@ -1039,7 +1183,10 @@ static void print_control_help() {
                         TBOLD("\t[un]mute-{receiver,sender}")
                                 " - (un)mutes audio sender or receiver\n"
                         TBOLD("\tpostprocess <new_postprocess> | flush") "\n"
-                        TBOLD("\tdump-tree")"\n");
+                        TBOLD("\tdump-tree")"\n"
+                        TBOLD("\tmem-stats") " - memory held by frame pools and packet buffers\n"
+                        TBOLD("\tdevices [<class>[:<module>]]") " - probed devices (cached, see --param probe-cache-ttl)\n"
+                        TBOLD("\tGET /metrics") " - HTTP request, metrics in OpenMetrics format (for Prometheus)\n");
         color_printf("\nOther commands can be issued directly to individual "
                         "modules (see \"" TBOLD("dump-tree") "\"), eg.:\n"
                         "\t" TBOLD("capture.filter mirror") "\n"
@@ -125,8 +125,10 @@ static int openssl_decrypt(struct openssl_decrypt *decrypt,
         ciphertext += 16;
         ciphertext_len -= 20;
 
-        CHECK(EVP_CipherInit(decrypt->ctx, cipher, decrypt->key_hash, iv, 0), "Unable to initialize cipher");
+        // IV length must be set before the IV itself (OpenSSL 3 fails otherwise)
+        CHECK(EVP_CipherInit(decrypt->ctx, cipher, NULL, NULL, 0), "Unable to initialize cipher");
         CHECK(EVP_CIPHER_CTX_ctrl(decrypt->ctx, EVP_CTRL_GCM_SET_IVLEN, 16, NULL), "set IV len"); // default IV len is presumably 12 bytes
+        CHECK(EVP_CipherInit(decrypt->ctx, NULL, decrypt->key_hash, iv, 0), "Unable to set key");
 
         int out_len = 0;
         if (mode == MODE_AES128_GCM) {
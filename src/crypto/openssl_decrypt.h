@@ -42,6 +42,10 @@
 
 #define OPENSSL_DECRYPT_ABI_VERSION 1
 
+/// plaintext may be written in place, to ciphertext + this offset (the
+/// ciphertext is prefixed with its length and the IV)
+#define OPENSSL_DECRYPT_IN_PLACE_OFFSET (sizeof(uint32_t) + 16)
+
 struct openssl_decrypt;
 
 struct openssl_decrypt_info {
@@ -69,7 +73,8 @@ struct openssl_decrypt_info {
          * @param[in] ciphertext_len lenght of encrypted text
          * @param[in] aad Aditional Authenticated Data (see openssl_encrypt documentation)
          * @param[in] aad_len length of aad block
-         * @param[out] plaintext otput plaintext
+         * @param[out] plaintext otput plaintext, may alias ciphertext +
+         *                       @ref OPENSSL_DECRYPT_IN_PLACE_OFFSET
          * @retval 0 if checksum doesn't match
          * @retval >0 length of output plaintext
          */
@@ -164,9 +164,11 @@ static int openssl_encrypt(struct openssl_encrypt *encryption,
         memcpy(ciphertext + total_len, ivec, sizeof ivec);
         total_len += sizeof ivec;
 
-        CHECK(EVP_CipherInit(encryption->ctx, encryption->cipher, encryption->key_hash, ivec, 1), "Cannot initialize cipher");
-        /* Set IV length if default 12 bytes (96 bits) is not appropriate */
+        CHECK(EVP_CipherInit(encryption->ctx, encryption->cipher, NULL, NULL, 1), "Cannot initialize cipher");
+        /* Set IV length if default 12 bytes (96 bits) is not appropriate,
+         * must precede setting the IV (OpenSSL 3 fails otherwise) */
         CHECK(EVP_CIPHER_CTX_ctrl(encryption->ctx, EVP_CTRL_GCM_SET_IVLEN, sizeof ivec, NULL), "set IV len");
+        CHECK(EVP_CipherInit(encryption->ctx, NULL, encryption->key_hash, ivec, 1), "Cannot set key");
         int out_len = 0;
         if (encryption->mode == MODE_AES128_GCM) {
                 if (aad_len > 0) {
@@ -10,7 +10,7 @@
  * kernels etc.)
  */
 /*
- * Copyright (c) 2013-2024 CESNET z.s.p.o.
+ * Copyright (c) 2013-2026 CESNET z.s.p.o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -42,13 +42,42 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <cassert>
+#include <map>
+#include <mutex>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "cuda_runtime.h"
 #include "cuda_wrapper.h"
 
-typedef void *cuda_wrapper_stream_t;
+/// cached released pinned buffers limit, the rest is freed
+#define PINNED_POOL_MAX_CACHED (256 * 1024 * 1024)
+
+namespace {
+struct device_streams {
+        cudaStream_t streams[CUDA_WRAPPER_STREAM_POOL_SIZE];
+        unsigned next;
+};
+
+/**
+ * The streams and the cached buffers are intentionally not released at exit
+ * - the CUDA runtime may have been already deinitialized when the static
+ * destructors run and the driver reclaims them anyway.
+ */
+struct cuda_wrapper_pools {
+        std::mutex lock;
+        std::map<int, device_streams> streams;
+        std::multimap<size_t, void *> pinned_free; ///< by size
+        std::map<void *, size_t> pinned_sizes; ///< all allocated by the pool
+        size_t pinned_cached;
+};
+
+cuda_wrapper_pools &get_pools() {
+        static auto *pools = new cuda_wrapper_pools();
+        return *pools;
+}
+} // end of anonymous namespace
 
 static inline int map_cuda_error(cudaError_t cuda_error) {
         return (int) cuda_error;
@@ -112,6 +141,15 @@ int cuda_wrapper_memcpy(void *dst, const void *src,
                                 map_cuda_memcpy_kind(kind)));
 }
 
+int cuda_wrapper_memcpy_async(void *dst, const void *src,
+                size_t count, int kind, cuda_wrapper_stream_t stream)
+{
+        return map_cuda_error(
+                        cudaMemcpyAsync(dst, src, count,
+                                map_cuda_memcpy_kind(kind),
+                                (cudaStream_t) stream));
+}
+
 const char *cuda_wrapper_last_error_string(void)
 {
         return cudaGetErrorString(cudaGetLastError());
@@ -164,3 +202,106 @@ void cuda_wrapper_print_devices_info(void)
     }
 }
 
+
+int cuda_wrapper_stream_synchronize(cuda_wrapper_stream_t stream)
+{
+        return map_cuda_error(cudaStreamSynchronize((cudaStream_t) stream));
+}
+
+int cuda_wrapper_stream_wait_event(cuda_wrapper_stream_t stream,
+                cuda_wrapper_event_t event)
+{
+        return map_cuda_error(cudaStreamWaitEvent((cudaStream_t) stream,
+                                (cudaEvent_t) event, 0));
+}
+
+int cuda_wrapper_stream_pool_get(int device, cuda_wrapper_stream_t *stream)
+{
+        cuda_wrapper_pools &pools = get_pools();
+        std::lock_guard<std::mutex> lk(pools.lock);
+        device_streams &dev = pools.streams[device];
+        cudaStream_t &str = dev.streams[dev.next++ % CUDA_WRAPPER_STREAM_POOL_SIZE];
+        if (str == nullptr) {
+                int current = 0;
+                cudaError_t err = cudaGetDevice(&current);
+                if (err == cudaSuccess && current != device) {
+                        err = cudaSetDevice(device);
+                }
+                if (err != cudaSuccess) {
+                        return map_cuda_error(err);
+                }
+                err = cudaStreamCreateWithFlags(&str, cudaStreamNonBlocking);
+                if (current != device) {
+                        cudaSetDevice(current);
+                }
+                if (err != cudaSuccess) {
+                        str = nullptr;
+                        return map_cuda_error(err);
+                }
+        }
+        *stream = str;
+        return CUDA_WRAPPER_SUCCESS;
+}
+
+int cuda_wrapper_event_create(cuda_wrapper_event_t *event)
+{
+        return map_cuda_error(cudaEventCreateWithFlags((cudaEvent_t *) event,
+                                cudaEventDisableTiming));
+}
+
+int cuda_wrapper_event_destroy(cuda_wrapper_event_t event)
+{
+        return map_cuda_error(cudaEventDestroy((cudaEvent_t) event));
+}
+
+int cuda_wrapper_event_record(cuda_wrapper_event_t event,
+                cuda_wrapper_stream_t stream)
+{
+        return map_cuda_error(cudaEventRecord((cudaEvent_t) event,
+                                (cudaStream_t) stream));
+}
+
+int cuda_wrapper_event_synchronize(cuda_wrapper_event_t event)
+{
+        return map_cuda_error(cudaEventSynchronize((cudaEvent_t) event));
+}
+
+int cuda_wrapper_pinned_pool_alloc(void **buffer, size_t size)
+{
+        cuda_wrapper_pools &pools = get_pools();
+        std::lock_guard<std::mutex> lk(pools.lock);
+        // reuse a buffer unless it is significantly larger than requested
+        auto it = pools.pinned_free.lower_bound(size);
+        if (it != pools.pinned_free.end() && it->first <= size + size / 4) {
+                *buffer = it->second;
+                pools.pinned_cached -= it->first;
+                pools.pinned_free.erase(it);
+                return CUDA_WRAPPER_SUCCESS;
+        }
+        cudaError_t err = cudaMallocHost(buffer, size);
+        if (err != cudaSuccess) {
+                return map_cuda_error(err);
+        }
+        pools.pinned_sizes[*buffer] = size;
+        return CUDA_WRAPPER_SUCCESS;
+}
+
+void cuda_wrapper_pinned_pool_release(void *buffer)
+{
+        if (buffer == nullptr) {
+                return;
+        }
+        cuda_wrapper_pools &pools = get_pools();
+        std::lock_guard<std::mutex> lk(pools.lock);
+        auto it = pools.pinned_sizes.find(buffer);
+        assert(it != pools.pinned_sizes.end());
+        const size_t size = it->second;
+        if (pools.pinned_cached + size > PINNED_POOL_MAX_CACHED) {
+                cudaFreeHost(buffer);
+                pools.pinned_sizes.erase(it);
+                return;
+        }
+        pools.pinned_free.emplace(size, buffer);
+        pools.pinned_cached += size;
+}
+
@@ -1,9 +1,20 @@
 /**
  * @file   cuda_wrapper.h
  * @author Martin Pulec     <pulec@cesnet.cz>
+ *
+ * Besides the thin wrappers of the CUDA runtime calls, this provides state
+ * shared by all CUDA modules - a pool of non-blocking streams per device and
+ * a pool of pinned host buffers. Devices are used through their primary
+ * context (cuda_wrapper_set_device() selects it), so the memory and the
+ * events can be passed between the modules running on the same device.
+ *
+ * To chain the modules without serializing on the legacy default stream, a
+ * producer records an event at its stream, consumer waits for it with
+ * cuda_wrapper_stream_wait_event() and no module should call
+ * cudaDeviceSynchronize().
  */
 /*
- * Copyright (c) 2013-2024 CESNET z.s.p.o.
+ * Copyright (c) 2013-2026 CESNET z.s.p.o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -53,7 +64,11 @@ extern "C" {
 #define CUDA_WRAPPER_MEMCPY_DEVICE_TO_HOST 1
 /// @}
 
+/// number of the streams in the pool of each device
+#define CUDA_WRAPPER_STREAM_POOL_SIZE 4
+
 typedef void *cuda_wrapper_stream_t;
+typedef void *cuda_wrapper_event_t;
 
 int cuda_wrapper_free(void *buffer);
 int cuda_wrapper_free_host(void *buffer);
@@ -62,12 +77,38 @@ int cuda_wrapper_malloc(void **buffer, size_t data_len);
 int cuda_wrapper_malloc_host(void **buffer, size_t data_len);
 int cuda_wrapper_memcpy(void *dst, const void *src,
                 size_t count, int kind);
+int cuda_wrapper_memcpy_async(void *dst, const void *src,
+                size_t count, int kind, cuda_wrapper_stream_t stream);
 const char *cuda_wrapper_last_error_string(void);
 int cuda_wrapper_set_device(int index);
 int cuda_wrapper_get_last_error(void);
 const char * cuda_wrapper_get_error_string(int error);
 void cuda_wrapper_print_devices_info(void);
 
+int cuda_wrapper_stream_synchronize(cuda_wrapper_stream_t stream);
+int cuda_wrapper_stream_wait_event(cuda_wrapper_stream_t stream,
+                cuda_wrapper_event_t event);
+/**
+ * Returns a non-blocking stream of the device from the shared pool (round
+ * robin). The streams are owned by the pool and must not be destroyed.
+ */
+int cuda_wrapper_stream_pool_get(int device, cuda_wrapper_stream_t *stream);
+
+/// creates an event without timing (cheap to record and to wait for)
+int cuda_wrapper_event_create(cuda_wrapper_event_t *event);
+int cuda_wrapper_event_destroy(cuda_wrapper_event_t event);
+int cuda_wrapper_event_record(cuda_wrapper_event_t event,
+                cuda_wrapper_stream_t stream);
+int cuda_wrapper_event_synchronize(cuda_wrapper_event_t event);
+
+/**
+ * Allocates a pinned host buffer, reusing a buffer released to the pool if
+ * there is a suitable one (freeing pinned memory synchronizes the device).
+ * The buffer must be released with cuda_wrapper_pinned_pool_release().
+ */
+int cuda_wrapper_pinned_pool_alloc(void **buffer, size_t size);
+void cuda_wrapper_pinned_pool_release(void *buffer);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -57,6 +57,7 @@
 #include "utils/fs.h" // MAX_PATH_SIZE
 #include "utils/misc.h"
 #include "video_export.h"
+#include "video_frame.h"
 
 #define MOD_NAME "[export] "
 
@@ -346,17 +347,19 @@ void export_audio(struct exporter *s, struct audio_frame *frame)
         pthread_mutex_unlock(&s->lock);
 }
 
-void export_video(struct exporter *s, struct video_frame *frame)
+static void export_video_common(struct exporter *s, struct video_frame *frame, bool take)
 {
-        if(!s){
-                return;
-        }
-
         process_messages(s);
 
         pthread_mutex_lock(&s->lock);
         if (s->exporting) {
-                video_export(s->video_export, frame);
+                if (take) {
+                        video_export_take(s->video_export, frame);
+                } else {
+                        video_export(s->video_export, frame);
+                }
+        } else if (take) {
+                VIDEO_FRAME_DISPOSE(frame);
         }
         if (s->limit > 0) {
                 if (--s->limit == 0) {
@@ -367,3 +370,20 @@ void export_video(struct exporter *s, struct video_frame *frame)
         pthread_mutex_unlock(&s->lock);
 }
 
+void export_video(struct exporter *s, struct video_frame *frame)
+{
+        if(!s){
+                return;
+        }
+        export_video_common(s, frame, false);
+}
+
+void export_video_take(struct exporter *s, struct video_frame *frame)
+{
+        if(!s){
+                VIDEO_FRAME_DISPOSE(frame);
+                return;
+        }
+        export_video_common(s, frame, true);
+}
+
@@ -55,6 +55,8 @@ struct exporter *export_init(struct module *parent, const char *cfg, bool should
 void export_destroy(struct exporter *state);
 void export_audio(struct exporter *state, struct audio_frame *frame);
 void export_video(struct exporter *state, struct video_frame *frame);
+/// takes ownership of the frame, see video_export_take()
+void export_video_take(struct exporter *state, struct video_frame *frame);
 
 #ifdef __cplusplus
 }
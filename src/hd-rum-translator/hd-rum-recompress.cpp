@@ -45,9 +45,11 @@
 #include "config_win32.h"
 #endif
 
+#include <algorithm>
 #include <cinttypes>
 #include <chrono>
 #include <memory>
+#include <set>
 #include <thread>
 #include <string>
 
@@ -101,7 +103,7 @@ struct recompress_worker_ctx {
 struct state_recompress {
         struct module *parent;
         std::mutex mut;
-        std::map<std::string, recompress_worker_ctx> workers;
+        std::map<std::string, recompress_worker_ctx> workers; ///< by get_compress_key()
         std::vector<std::pair<std::string, int>> index_to_port;
 };
 
@@ -187,19 +189,63 @@ static void recompress_worker(struct recompress_worker_ctx *ctx){
         }
 }
 
+/**
+ * Returns key identifying encoders with equal settings. Options in the
+ * <key>=<val> form are order independent, so with unique keys they are sorted,
+ * eg. "lavc:codec=H.264:bitrate=5M" and "lavc:bitrate=5M:codec=H.264" share
+ * the encoder.
+ */
+static std::string get_compress_key(const char *compress)
+{
+        std::string cfg = compress;
+        size_t delim = cfg.find(':');
+        if (delim == std::string::npos) {
+                return cfg;
+        }
+        std::vector<std::string> opts;
+        std::string item;
+        for (size_t i = delim + 1; i < cfg.size(); ++i) {
+                if (cfg[i] == ':' && cfg[i - 1] != '\\') { // '\:' is escaped
+                        opts.push_back(item);
+                        item.clear();
+                } else {
+                        item += cfg[i];
+                }
+        }
+        opts.push_back(item);
+
+        std::set<std::string> keys;
+        for (const auto &o : opts) {
+                size_t eq = o.find('=');
+                if (eq == std::string::npos || eq == 0 || !keys.insert(o.substr(0, eq)).second) {
+                        return cfg;
+                }
+        }
+        std::sort(opts.begin(), opts.end());
+        std::string key = cfg.substr(0, delim);
+        for (const auto &o : opts) {
+                key += ":" + o;
+        }
+        return key;
+}
+
 static int move_port_to_worker(struct state_recompress *s, const char *compress,
                 recompress_output_port&& port)
 {
-        auto& worker = s->workers[compress];
+        const std::string key = get_compress_key(compress);
+        auto& worker = s->workers[key];
         if(!worker.compress){
                 worker.compress_cfg = compress;
                 int ret = compress_init(s->parent, compress, out_ptr(worker.compress));
                 if (ret != 0) {
-                        s->workers.erase(compress);
+                        s->workers.erase(key);
                         return -1;
                 }
 
                 worker.thread = std::thread(recompress_worker, &worker);
+        } else {
+                log_msg(LOG_LEVEL_NOTICE, "Port %s:%d shares encoder \"%s\" with %zu other port(s).\n",
+                                port.host.c_str(), port.tx_port, worker.compress_cfg.c_str(), worker.ports.size());
         }
 
         std::lock_guard<std::mutex> lock(worker.ports_mut);
@@ -228,7 +274,7 @@ int recompress_add_port(struct state_recompress *s, struct module *parent_rep,
                 return -1;
 
         int index_of_port = s->index_to_port.size();
-        s->index_to_port.emplace_back(compress, index_in_worker);
+        s->index_to_port.emplace_back(get_compress_key(compress), index_in_worker);
 
         return index_of_port;
 }
@@ -290,7 +336,7 @@ bool recompress_port_change_compress(struct state_recompress *s, int index,
         std::lock_guard<std::mutex> lock(s->mut);
         auto [old_compress, i] = s->index_to_port[index];
 
-        if(old_compress == new_compress)
+        if(old_compress == get_compress_key(new_compress))
                 return true;
 
         recompress_output_port port;
@@ -302,7 +348,7 @@ bool recompress_port_change_compress(struct state_recompress *s, int index,
                 return false;
         }
 
-        s->index_to_port[index] = {new_compress, index_in_worker};
+        s->index_to_port[index] = {get_compress_key(new_compress), index_in_worker};
 
         return true;
 }
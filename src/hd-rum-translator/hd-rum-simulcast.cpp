@@ -0,0 +1,415 @@
+/**
+ * @file   hd-rum-translator/hd-rum-simulcast.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "debug.h"
+#include "hd-rum-translator/hd-rum-simulcast.h"
+#include "rtp/net_udp.h"
+#include "rtp/rtp.h" // RTCP_APP_NAME_OVERLOAD
+#include "rtp/rtp_types.h"
+#include "rtp/rtpenc_h264.h"
+#include "types.h"
+#include "utils/misc.h" // format_in_si_units
+#include "video_codec.h"
+
+#define MOD_NAME "[hd-rum-simulcast] "
+
+#define RTCP_SR 200
+#define RTCP_RR 201
+#define RTCP_APP 204
+#define RTCP_BUF_LEN 1500
+
+#define LAYER_UPDATE_NS NS_IN_SEC
+#define LAYER_TIMEOUT_NS (2 * NS_IN_SEC)
+#define LOSS_THRESHOLD 13 ///< fraction lost (x/256, ~5 %) to switch down
+#define HOLDOFF_NS (2 * NS_IN_SEC) ///< minimal interval between switching down
+#define UPGRADE_NS (10 * NS_IN_SEC) ///< loss-free interval to switch up
+#define BITRATE_HEADROOM 0.9 ///< portion of the rate limit usable by a layer
+
+using std::lock_guard;
+using std::mutex;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+static uint32_t read_u32(const char *ptr)
+{
+    uint32_t val = 0;
+    memcpy(&val, ptr, sizeof val);
+    return ntohl(val);
+}
+
+/// payload types carrying UltraGrid video (incl. retransmissions, see PT_RTX)
+static bool is_video_pt(int pt)
+{
+    if (PT_IS_RTX(pt)) {
+        pt = PT_RTX_ORIG(pt);
+    }
+    return pt == PT_VIDEO || pt == PT_ENCRYPT_VIDEO || PT_VIDEO_HAS_FEC(pt);
+}
+
+/// @returns the payload offset of the RTP packet or -1 if malformed
+static int rtp_payload_offset(const char *pkt, int len)
+{
+    int off = 12 + 4 * (pkt[0] & 0x0F); // CSRCs
+    if ((pkt[0] & 0x10) != 0) { // header extension
+        if (len < off + 4) {
+            return -1;
+        }
+        off += 4 + 4 * (int) (read_u32(pkt + off) & 0xFFFF);
+    }
+    return off <= len ? off : -1;
+}
+
+/**
+ * @param pkt first packet after the end of previous frame
+ * @returns true if the receiver can start decoding with the frame
+ */
+static bool is_switch_point(const char *pkt, int len, int pt)
+{
+    if (pt != PT_VIDEO) { // FEC or encrypted, payload cannot be examined
+        return true;
+    }
+    const int off = rtp_payload_offset(pkt, len);
+    if (off < 0 || len < off + (int) sizeof(video_payload_hdr_t)) {
+        return false;
+    }
+    const char *hdr = pkt + off;
+    if ((read_u32(hdr) >> 22) != 0 || read_u32(hdr + 4) != 0) {
+        return false; // not the beginning of substream 0 (reordered)
+    }
+    uint32_t fcc = 0;
+    memcpy(&fcc, hdr + 16, sizeof fcc);
+    const codec_t codec = get_codec_from_fcc(fcc);
+    if (codec != H264 && codec != H265) {
+        return true; // other codecs are either intra-only or not examined
+    }
+    const int data_off = off + (int) sizeof(video_payload_hdr_t);
+    return rtpenc_frame_is_keyframe((const unsigned char *) pkt + data_off,
+            len - data_off, codec == H265);
+}
+
+/// compares host addresses (not ports), IPv4-mapped IPv6 equals to IPv4
+static bool same_host(const struct sockaddr *a, const struct sockaddr *b)
+{
+    auto to_in6 = [](const struct sockaddr *sa, unsigned char *addr) {
+        if (sa->sa_family == AF_INET6) {
+            memcpy(addr, &((const struct sockaddr_in6 *)(const void *) sa)->sin6_addr, 16);
+            return true;
+        }
+        if (sa->sa_family == AF_INET) {
+            memset(addr, 0, 10);
+            addr[10] = addr[11] = 0xFF;
+            memcpy(addr + 12, &((const struct sockaddr_in *)(const void *) sa)->sin_addr, 4);
+            return true;
+        }
+        return false;
+    };
+    unsigned char addr_a[16];
+    unsigned char addr_b[16];
+    return to_in6(a, addr_a) && to_in6(b, addr_b) && memcmp(addr_a, addr_b, 16) == 0;
+}
+
+layer_subscription::layer_subscription(const char *name, const struct sockaddr_storage &addr,
+        int layer, long long max_bitrate)
+    : m_name(name), m_addr(addr), m_layer(layer), m_max_bitrate(max_bitrate)
+{
+}
+
+/**
+ * Packets other than video are always forwarded. Video packets of the
+ * current layer are forwarded until the target layer reaches a switch point,
+ * the first packet after its frame end which starts a decodable frame.
+ */
+bool layer_subscription::forward(const char *pkt, int len)
+{
+    if (len < 12) {
+        return true;
+    }
+    const int full_pt = pkt[1] & 0x7F;
+    if (!is_video_pt(full_pt)) {
+        return true;
+    }
+    const bool rtx = PT_IS_RTX(full_pt);
+    const uint32_t ssrc = rtx ? RTP_RTX_SSRC(read_u32(pkt + 8)) : read_u32(pkt + 8);
+    if (ssrc == m_current) {
+        return true;
+    }
+    const int64_t target = m_target.load(std::memory_order_relaxed);
+    if (target != m_pending) {
+        m_pending = target;
+        m_target_frame_start = false;
+    }
+    if (ssrc != target || rtx) {
+        return false;
+    }
+    const bool marker = (pkt[1] & 0x80) != 0;
+    if (!m_target_frame_start || !is_switch_point(pkt, len, full_pt)) {
+        m_target_frame_start = marker;
+        return false;
+    }
+    m_current = ssrc;
+    return true;
+}
+
+bool layer_subscription::matches(const struct sockaddr *src) const
+{
+    return same_host((const struct sockaddr *) &m_addr, src);
+}
+
+void layer_subscription::feedback(uint32_t ssrc, int fract_lost, time_ns_t now)
+{
+    if (ssrc != m_target.load(std::memory_order_relaxed)) {
+        return; // report of a layer not being (or no longer) forwarded
+    }
+    if (fract_lost > LOSS_THRESHOLD) {
+        m_last_loss = now;
+    }
+    m_fract_lost = std::max(m_fract_lost, fract_lost);
+}
+
+void layer_subscription::select(const vector<simulcast_layer_info> &layers, time_ns_t now)
+{
+    if (layers.empty()) {
+        return;
+    }
+    const int worst = (int) layers.size() - 1;
+    const int layer = m_layer;
+    int idx = 0;
+    if (layer != LAYER_AUTO) {
+        idx = std::min(layer, worst);
+    } else {
+        int best = 0;
+        const long long max_bitrate = m_max_bitrate;
+        if (max_bitrate > 0) {
+            while (best < worst && layers[best].bitrate > BITRATE_HEADROOM * max_bitrate) {
+                best += 1;
+            }
+        }
+        if (m_fract_lost > LOSS_THRESHOLD) {
+            if (now - m_last_change > HOLDOFF_NS) {
+                m_level += 1;
+            }
+        } else if (now - m_last_loss > UPGRADE_NS && now - m_last_change > UPGRADE_NS) {
+            m_level -= 1;
+        }
+        m_level = std::clamp(m_level, best, worst);
+        m_fract_lost = 0;
+        idx = m_level;
+    }
+
+    if (layers[idx].ssrc != m_target.load(std::memory_order_relaxed)) {
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "%s: switching to layer %d (SSRC 0x%08" PRIx32 ", %sbps)\n",
+                m_name.c_str(), idx, layers[idx].ssrc, format_in_si_units(layers[idx].bitrate));
+        m_target = layers[idx].ssrc;
+        m_last_change = now;
+    }
+}
+
+simulcast_control::simulcast_control(int rtcp_port)
+{
+    if (rtcp_port > 0) {
+        m_rtcp_sock = udp_init_if("localhost", NULL, rtcp_port, 0, 255, false, false);
+        if (m_rtcp_sock == nullptr) {
+            log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot bind RTCP port %d, adaptive "
+                    "layer selection will not get receiver reports!\n", rtcp_port);
+        } else {
+            log_msg(LOG_LEVEL_INFO, MOD_NAME "Receiving RTCP on port %d.\n", rtcp_port);
+        }
+    }
+    m_thread = std::thread(&simulcast_control::run, this);
+}
+
+simulcast_control::~simulcast_control()
+{
+    m_should_exit = true;
+    m_thread.join();
+    if (m_rtcp_sock != nullptr) {
+        udp_exit(m_rtcp_sock);
+    }
+}
+
+void simulcast_control::account_packet(const char *pkt, int len, time_ns_t now)
+{
+    if (len < 12 || (pkt[0] & 0xC0) != 0x80) {
+        return;
+    }
+    const int pt = pkt[1] & 0x7F;
+    if (!is_video_pt(pt) || PT_IS_RTX(pt)) {
+        return;
+    }
+    auto &st = m_stats[read_u32(pkt + 8)];
+    st.bytes += len;
+    st.last_seen = now;
+}
+
+void simulcast_control::add_subscription(const shared_ptr<layer_subscription> &sub)
+{
+    lock_guard<mutex> lk(m_lock);
+    m_subscriptions.push_back(sub);
+}
+
+void simulcast_control::run()
+{
+    char buf[RTCP_BUF_LEN];
+    while (!m_should_exit) {
+        if (m_rtcp_sock == nullptr) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        } else {
+            struct timeval timeout = { 0, 100 * 1000 };
+            struct sockaddr_storage src{};
+            socklen_t src_len = sizeof src;
+            const int len = udp_recvfrom_timeout(m_rtcp_sock, buf, sizeof buf, &timeout,
+                    (struct sockaddr *) &src, &src_len);
+            if (len > 0) {
+                process_rtcp(buf, len, (struct sockaddr *) &src);
+            }
+        }
+        const time_ns_t now = get_time_in_ns();
+        if (now - m_last_update >= LAYER_UPDATE_NS) {
+            update_layers(now);
+        }
+    }
+}
+
+/**
+ * passes report blocks of RR and SR in the compound packet to the subscriptions of the source,
+ * receiver overload reports (APP "UGOL") are passed as a loss so that the replica
+ * is switched to a lower layer as well
+ */
+void simulcast_control::process_rtcp(const char *buf, int len, const struct sockaddr *src)
+{
+    vector<shared_ptr<layer_subscription>> subs;
+    {
+        lock_guard<mutex> lk(m_lock);
+        for (auto &w : m_subscriptions) {
+            if (auto sub = w.lock(); sub && sub->matches(src)) {
+                subs.push_back(std::move(sub));
+            }
+        }
+    }
+    if (subs.empty()) {
+        return;
+    }
+    const time_ns_t now = get_time_in_ns();
+    while (len >= 8) {
+        if ((buf[0] & 0xC0) != 0x80) { // not RTCP (eg. encrypted)
+            return;
+        }
+        const int count = buf[0] & 0x1F;
+        const int pt = (unsigned char) buf[1];
+        const int pkt_len = 4 * (int) ((read_u32(buf) & 0xFFFF) + 1);
+        if (pkt_len > len) {
+            return;
+        }
+        if (pt == RTCP_APP && pkt_len >= 20 && memcmp(buf + 8, RTCP_APP_NAME_OVERLOAD, 4) == 0) {
+            const int level = (int) std::min<uint32_t>(read_u32(buf + 16), 1000);
+            for (auto &sub : subs) {
+                sub->feedback(read_u32(buf + 12), level * 256 / 1000, now);
+            }
+        }
+        const int blocks = pt == RTCP_RR ? 8 : pt == RTCP_SR ? 28 : pkt_len;
+        for (int i = 0; i < count && blocks + 24 * (i + 1) <= pkt_len; ++i) {
+            const char *block = buf + blocks + 24 * i;
+            for (auto &sub : subs) {
+                sub->feedback(read_u32(block), (unsigned char) block[4], now);
+            }
+        }
+        buf += pkt_len;
+        len -= pkt_len;
+    }
+}
+
+void simulcast_control::update_layers(time_ns_t now)
+{
+    const double seconds = m_last_update == 0 ? 0 : (double) (now - m_last_update) / NS_IN_SEC;
+    m_last_update = now;
+
+    vector<simulcast_layer_info> layers;
+    vector<shared_ptr<layer_subscription>> subs;
+    {
+        lock_guard<mutex> lk(m_lock);
+        for (auto it = m_stats.begin(); it != m_stats.end(); ) {
+            if (now - it->second.last_seen > LAYER_TIMEOUT_NS) {
+                m_reported_bytes.erase(it->first);
+                it = m_stats.erase(it);
+                continue;
+            }
+            uint64_t &reported = m_reported_bytes[it->first];
+            if (seconds > 0 && reported != 0) {
+                layers.push_back({it->first, (long long) ((it->second.bytes - reported) * 8 / seconds)});
+            }
+            reported = it->second.bytes;
+            ++it;
+        }
+        for (auto it = m_subscriptions.begin(); it != m_subscriptions.end(); ) {
+            if (auto sub = it->lock()) {
+                subs.push_back(std::move(sub));
+                ++it;
+            } else { // replica removed
+                it = m_subscriptions.erase(it);
+            }
+        }
+    }
+    std::sort(layers.begin(), layers.end(),
+            [](const simulcast_layer_info &a, const simulcast_layer_info &b) {
+                return a.bitrate > b.bitrate;
+            });
+
+    if (layers.size() != m_layer_count) {
+        string desc;
+        for (auto &l : layers) {
+            char item[64];
+            snprintf(item, sizeof item, " 0x%08" PRIx32 " (%sbps)", l.ssrc,
+                    format_in_si_units(l.bitrate));
+            desc += item;
+        }
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "%zu input layer(s):%s\n", layers.size(), desc.c_str());
+        m_layer_count = layers.size();
+    }
+
+    for (auto &sub : subs) {
+        sub->select(layers, now);
+    }
+}
+
+/* vim: set sw=4 expandtab : */
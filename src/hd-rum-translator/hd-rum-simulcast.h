@@ -0,0 +1,168 @@
+/**
+ * @file   hd-rum-translator/hd-rum-simulcast.h
+ *
+ * Layer selection for simulcast input (see --param video-simulcast of uv).
+ * Instead of transcoding, a replica receives only one of the layers (SSRCs)
+ * sent by the source. The layer is selected manually or driven by the RTCP
+ * receiver reports of the replica's receiver and it is switched only at
+ * a frame start (a keyframe for H.264/HEVC), so the receiver can decode the
+ * new stream immediately.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HD_RUM_SIMULCAST_H_8C2E5B17_4A9D_4F06_9E3B_71D0A6C4F258
+#define HD_RUM_SIMULCAST_H_8C2E5B17_4A9D_4F06_9E3B_71D0A6C4F258
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tv.h"
+
+typedef struct _socket_udp socket_udp;
+
+struct simulcast_layer_info {
+    uint32_t ssrc;
+    long long bitrate; ///< bps measured at the input
+};
+
+/**
+ * Layer selection state of one replica. forward() is called by the thread
+ * sending to the replica, the rest by the control thread or the writer
+ * (set_* functions).
+ */
+class layer_subscription {
+public:
+    static constexpr int LAYER_AUTO = -1;
+
+    /**
+     * @param name        replica name for log messages
+     * @param addr        address of the receiver (matched against the
+     *                    source of the RTCP reports, port is ignored)
+     * @param layer       0 is the best layer, LAYER_AUTO for adaptive selection
+     * @param max_bitrate replica rate limit (-l), the layers exceeding it are
+     *                    not selected in the adaptive mode
+     */
+    layer_subscription(const char *name, const struct sockaddr_storage &addr, int layer,
+            long long max_bitrate);
+
+    /// @returns true if the packet should be sent to the replica
+    bool forward(const char *pkt, int len);
+
+    void set_layer(int layer) { m_layer = layer; }
+    void set_max_bitrate(long long bitrate) { m_max_bitrate = bitrate; }
+
+    bool matches(const struct sockaddr *src) const;
+    /// @param fract_lost fraction lost from RR report block (x/256)
+    void feedback(uint32_t ssrc, int fract_lost, time_ns_t now);
+    /// @param layers ordered from the best to the worst
+    void select(const std::vector<simulcast_layer_info> &layers, time_ns_t now);
+
+private:
+    std::string m_name;
+    struct sockaddr_storage m_addr;
+    std::atomic<int> m_layer;
+    std::atomic<long long> m_max_bitrate;
+    std::atomic<int64_t> m_target{-1}; ///< SSRC to be switched to, -1 none
+
+    // sending thread
+    int64_t m_current = -1;     ///< SSRC being forwarded
+    int64_t m_pending = -1;     ///< last seen m_target
+    bool m_target_frame_start = false; ///< next target packet starts a frame
+
+    // control thread
+    int m_level = 0;            ///< layer index selected in the adaptive mode
+    int m_fract_lost = 0;       ///< max from the last interval
+    time_ns_t m_last_loss = 0;
+    time_ns_t m_last_change = 0;
+};
+
+/**
+ * Measures the bitrate of the incoming layers and processes the RTCP
+ * receiver reports from the replicas' receivers in own thread.
+ */
+class simulcast_control {
+public:
+    /// @param rtcp_port port receiving the RTCP on (0 - layers are measured only)
+    explicit simulcast_control(int rtcp_port);
+    ~simulcast_control();
+    /// accounts count received packets, called by the writer
+    template <typename Pkt, typename Buf, typename Len>
+    void account(const Pkt *pkts, int count, Buf buf, Len len) {
+        const time_ns_t now = get_time_in_ns();
+        std::lock_guard<std::mutex> lk(m_lock);
+        for (int i = 0; i < count; ++i) {
+            account_packet(buf(pkts[i]), len(pkts[i]), now);
+        }
+    }
+    void add_subscription(const std::shared_ptr<layer_subscription> &sub);
+
+private:
+    void account_packet(const char *pkt, int len, time_ns_t now);
+    void run();
+    void process_rtcp(const char *buf, int len, const struct sockaddr *src);
+    void update_layers(time_ns_t now);
+
+    socket_udp *m_rtcp_sock = nullptr;
+    std::thread m_thread;
+    std::atomic<bool> m_should_exit{false};
+
+    std::mutex m_lock; ///< protects the members below
+    struct layer_stats {
+        uint64_t bytes;
+        time_ns_t last_seen;
+    };
+    std::map<uint32_t, layer_stats> m_stats;
+    std::vector<std::weak_ptr<layer_subscription>> m_subscriptions;
+
+    // control thread
+    std::map<uint32_t, uint64_t> m_reported_bytes;
+    time_ns_t m_last_update = 0;
+    size_t m_layer_count = 0; ///< at the last update, for logging
+};
+
+#endif // defined HD_RUM_SIMULCAST_H_8C2E5B17_4A9D_4F06_9E3B_71D0A6C4F258
+
+/* vim: set sw=4 expandtab : */
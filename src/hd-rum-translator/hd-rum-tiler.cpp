@@ -0,0 +1,272 @@
+/**
+ * @file   hd-rum-translator/hd-rum-tiler.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <utility>
+
+#include "debug.h"
+#include "hd-rum-translator/hd-rum-tiler.h"
+#include "rtp/rtp_types.h"
+#include "types.h"
+#include "utils/net.h"
+#include "video_codec.h"
+
+#define MOD_NAME "[hd-rum-tiler] "
+
+#define PARTICIPANT_TIMEOUT_NS (2 * NS_IN_SEC)
+
+using std::vector;
+
+static uint32_t read_u32(const char *ptr)
+{
+    uint32_t val = 0;
+    memcpy(&val, ptr, sizeof val);
+    return ntohl(val);
+}
+
+static void write_u32(char *ptr, uint32_t val)
+{
+    val = htonl(val);
+    memcpy(ptr, &val, sizeof val);
+}
+
+/// @returns the payload offset of the RTP packet or -1 if malformed
+static int rtp_payload_offset(const char *pkt, int len)
+{
+    int off = 12 + 4 * (pkt[0] & 0x0F); // CSRCs
+    if ((pkt[0] & 0x10) != 0) { // header extension
+        if (len < off + 4) {
+            return -1;
+        }
+        off += 4 + 4 * (int) (read_u32(pkt + off) & 0xFFFF);
+    }
+    return off <= len ? off : -1;
+}
+
+conference_tiler::conference_tiler(double fps)
+    : m_interval((time_ns_t) (NS_IN_SEC_DBL / fps)), m_ssrc(std::random_device{}())
+{
+}
+
+/// the participant's packets are dropped from now on
+void conference_tiler::reject(participant &p, const char *reason)
+{
+    if (!p.rejected) {
+        MSG(WARNING, "Participant %08" PRIx32 " cannot be tiled: %s\n", p.ssrc, reason);
+    }
+    p.rejected = true;
+    p.pending.clear();
+    p.complete.clear();
+}
+
+void conference_tiler::process(const char *pkt, int len, time_ns_t now, const emit_fn &emit)
+{
+    if (len < 12 || (pkt[0] & 0xC0) != 0x80) {
+        emit(pkt, len);
+        return;
+    }
+    const int pt = pkt[1] & 0x7F;
+    if (PT_IS_RTX(pt)) {
+        return; // refer to the sequence numbers of the original stream
+    }
+    if (pt != PT_VIDEO) {
+        if (PT_VIDEO_HAS_FEC(pt) || PT_VIDEO_IS_ENCRYPTED(pt)) {
+            reject(*get_participant(read_u32(pkt + 8), now), "FEC or encryption used");
+            return;
+        }
+        emit(pkt, len); // audio
+        return;
+    }
+
+    const int off = rtp_payload_offset(pkt, len);
+    if (off < 0 || len < off + (int) sizeof(video_payload_hdr_t)) {
+        return;
+    }
+    participant *p = get_participant(read_u32(pkt + 8), now);
+    if (p->rejected) {
+        return;
+    }
+    store(*p, pkt, len, off);
+    if (frame_due(now)) {
+        emit_frame(now, emit);
+    }
+}
+
+/**
+ * @returns participant with the SSRC, a new one is added if there is none
+ *          (rejected if the layout is full)
+ */
+conference_tiler::participant *conference_tiler::get_participant(uint32_t ssrc, time_ns_t now)
+{
+    for (auto &p : m_participants) {
+        if (p.ssrc == ssrc) {
+            p.last_seen = now;
+            return &p;
+        }
+    }
+
+    for (auto it = m_participants.begin(); it != m_participants.end();) {
+        if (now - it->last_seen > PARTICIPANT_TIMEOUT_NS) {
+            MSG(NOTICE, "Participant %08" PRIx32 " left.\n", it->ssrc);
+            it = m_participants.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    int tiles = 0;
+    for (auto &p : m_participants) {
+        tiles += p.rejected ? 0 : 1;
+    }
+    participant p{};
+    p.ssrc = ssrc;
+    p.last_seen = now;
+    if (tiles == CONFERENCE_TILER_MAX_TILES) {
+        reject(p, "layout is full");
+    } else {
+        MSG(NOTICE, "Participant %08" PRIx32 " added as tile %d.\n", ssrc, tiles);
+    }
+    m_participants.push_back(std::move(p));
+    return &m_participants.back();
+}
+
+/// stores the video packet, the frame becomes complete once all its bytes arrived
+void conference_tiler::store(participant &p, const char *pkt, int len, int payload_off)
+{
+    const char *hdr = pkt + payload_off;
+    const uint32_t word0 = read_u32(hdr);
+    if ((word0 >> 22) != 0) {
+        reject(p, "multiple tiles sent");
+        return;
+    }
+    const uint32_t buffer = word0 & 0x3FFFFF;
+    if (p.pending.empty() || buffer != p.buffer) {
+        p.pending.clear();
+        p.buffer = buffer;
+        p.data_len = read_u32(hdr + 8);
+        p.received = 0;
+    }
+    p.pending.emplace_back(pkt, pkt + len);
+    p.received += len - payload_off - sizeof(video_payload_hdr_t);
+    if (p.received < p.data_len) {
+        return;
+    }
+
+    uint32_t fcc = 0;
+    memcpy(&fcc, hdr + 16, sizeof fcc);
+    if (is_codec_interframe(get_codec_from_fcc(fcc))) {
+        reject(p, "not an intra-only codec");
+        return;
+    }
+    std::swap(p.complete, p.pending);
+    p.pending.clear();
+    p.desc[0] = read_u32(hdr + 12);
+    p.desc[1] = fcc;
+    p.desc[2] = read_u32(hdr + 20);
+    p.fresh = true;
+}
+
+/// @returns true if all participants sent a new frame or if the interval elapsed
+bool conference_tiler::frame_due(time_ns_t now) const
+{
+    bool any = false;
+    bool all = true;
+    for (const auto &p : m_participants) {
+        if (p.rejected || p.complete.empty()) {
+            continue;
+        }
+        any = any || p.fresh;
+        all = all && p.fresh;
+    }
+    return any && (all || now - m_last_frame >= m_interval);
+}
+
+void conference_tiler::emit_frame(time_ns_t now, const emit_fn &emit)
+{
+    const participant *ref = nullptr;
+    vector<std::pair<participant *, uint32_t>> tiles; // participant, substream
+    uint32_t substream = 0;
+    for (auto &p : m_participants) {
+        if (p.rejected) {
+            continue;
+        }
+        if (!p.complete.empty()) {
+            if (ref == nullptr) {
+                ref = &p;
+            }
+            if (p.desc[0] != ref->desc[0] || p.desc[1] != ref->desc[1]) {
+                char msg[128];
+                snprintf(msg, sizeof msg, "%" PRIu32 "x%" PRIu32 " %.4s differs from the "
+                        "first tile (%" PRIu32 "x%" PRIu32 " %.4s)", p.desc[0] >> 16,
+                        p.desc[0] & 0xFFFF, (const char *) &p.desc[1], ref->desc[0] >> 16,
+                        ref->desc[0] & 0xFFFF, (const char *) &ref->desc[1]);
+                reject(p, msg);
+                continue;
+            }
+            tiles.emplace_back(&p, substream);
+        }
+        substream += 1;
+    }
+
+    const uint32_t ts = now / 100000 * 9; // 90 kHz
+    for (size_t t = 0; t < tiles.size(); ++t) {
+        participant *p = tiles[t].first;
+        for (size_t i = 0; i < p->complete.size(); ++i) {
+            // the stored copies are rewritten in place, every field is set
+            // again when the tile is repeated
+            char *pkt = p->complete[i].data();
+            const int len = (int) p->complete[i].size();
+            const bool last = t == tiles.size() - 1 && i == p->complete.size() - 1;
+            pkt[1] = (char) ((pkt[1] & 0x7F) | (last ? 0x80 : 0));
+            pkt[2] = (char) (m_seq >> 8);
+            pkt[3] = (char) (m_seq & 0xFF);
+            m_seq += 1;
+            write_u32(pkt + 4, ts);
+            write_u32(pkt + 8, m_ssrc);
+            char *hdr = pkt + rtp_payload_offset(pkt, len);
+            write_u32(hdr, tiles[t].second << 22 | (m_buffer & 0x3FFFFF));
+            write_u32(hdr + 20, ref->desc[2]); // interlacing and fps of the output
+            emit(pkt, len);
+        }
+        p->fresh = false;
+    }
+    m_buffer += 1;
+    m_last_frame = now;
+}
+
+/* vim: set sw=4 expandtab : */
@@ -0,0 +1,111 @@
+/**
+ * @file   hd-rum-translator/hd-rum-tiler.h
+ *
+ * Compressed-domain conference (-r <w>:<h>[:<fps>] -R passthrough). Instead
+ * of decoding the participants, compositing and re-encoding, the last
+ * complete frame of every participant is forwarded as one tile (substream) of
+ * a common output stream - only the RTP header (SSRC, sequence number,
+ * timestamp) and the substream and buffer index in the UltraGrid payload
+ * header (see format_video_header()) are rewritten, the payload is untouched.
+ * The receivers display the tiles as a grid (-M tiled-2x2, 3D for 2).
+ *
+ * The participants must send a single tile of the same size and pixel
+ * format without FEC and encryption (the payload header would not be
+ * accessible). Because a tile is repeated until the participant sends a new
+ * frame, only uncompressed video and intra-only codecs can be tiled.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HD_RUM_TILER_H_5E0B7C24_9A31_4D8F_B6E2_3F1C8D07A94B
+#define HD_RUM_TILER_H_5E0B7C24_9A31_4D8F_B6E2_3F1C8D07A94B
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "tv.h"
+
+#define CONFERENCE_TILER_MAX_TILES 4 ///< max. substreams of the receiver (tiled-2x2)
+
+class conference_tiler {
+public:
+    using emit_fn = std::function<void(const char *pkt, int len)>;
+
+    /// @param fps output frame rate if some participant doesn't send new frames
+    explicit conference_tiler(double fps);
+    /**
+     * Processes one received packet. Packets other than participants' video
+     * are passed to emit unchanged, the assembled output frame is passed
+     * packet by packet when all participants sent a new frame or when the
+     * output frame interval elapsed.
+     */
+    void process(const char *pkt, int len, time_ns_t now, const emit_fn &emit);
+
+private:
+    struct participant {
+        uint32_t ssrc;
+        uint32_t buffer;      ///< buffer index of the frame being received
+        uint32_t data_len;    ///< length of the frame being received
+        uint32_t received;    ///< payload bytes of the frame being received
+        std::vector<std::vector<char>> pending;  ///< packets of the frame being received
+        std::vector<std::vector<char>> complete; ///< last complete frame
+        uint32_t desc[3];     ///< size, FourCC and fps words of complete
+        bool fresh;           ///< complete not yet emitted
+        bool rejected;        ///< cannot be tiled, reported
+        time_ns_t last_seen;
+    };
+
+    participant *get_participant(uint32_t ssrc, time_ns_t now);
+    void reject(participant &p, const char *reason);
+    void store(participant &p, const char *pkt, int len, int payload_off);
+    bool frame_due(time_ns_t now) const;
+    void emit_frame(time_ns_t now, const emit_fn &emit);
+
+    std::vector<participant> m_participants; ///< in the tile order
+    time_ns_t m_interval;
+    time_ns_t m_last_frame = 0;
+    uint32_t m_ssrc;
+    uint16_t m_seq = 0;
+    uint32_t m_buffer = 0;
+};
+
+#endif // defined HD_RUM_TILER_H_5E0B7C24_9A31_4D8F_B6E2_3F1C8D07A94B
+
+/* vim: set sw=4 expandtab : */
@@ -45,18 +45,25 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>                              // for min
 #include <atomic>                                 // for atomic, memory_order
 #include <cassert>                                // for assert
 #include <cctype>                                 // for isdigit
 #include <cinttypes>
+#include <chrono>
 #include <climits>
+#include <condition_variable>
 #include <csignal>                                // for sigaction, signal
+#include <cstddef>                                // for max_align_t
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <ctime>                                  // for localtime, strftime
 #include <getopt.h>
 #include <memory>                                 // for shared_ptr, operator!=
+#include <mutex>
+#include <new>
 #include <pthread.h>
 #include <stdexcept>                              // for invalid_argument
 #include <string>
@@ -69,6 +76,8 @@
 #include "debug.h"
 #include "hd-rum-translator/hd-rum-decompress.h"
 #include "hd-rum-translator/hd-rum-recompress.h"
+#include "hd-rum-translator/hd-rum-simulcast.h"
+#include "hd-rum-translator/hd-rum-tiler.h"
 #include "host.h"
 #include "lib_common.h"
 #include "messaging.h"
@@ -80,7 +89,10 @@
 #include "utils/misc.h" // format_in_si_units, unit_evaluate
 #include "utils/net.h"
 
+using std::condition_variable;
 using std::invalid_argument;
+using std::lock_guard;
+using std::mutex;
 using std::stoi;
 using std::string;
 using std::to_string;
@@ -100,12 +112,419 @@ static char *get_replica_mod_name(const char *addr, uint16_t tx_port){
         return name;
 }
 
+#define MAX_PKT_SIZE 10000
+#define SEND_BATCH 64 ///< max packets forwarded to a replica at once
+#define DEFAULT_CONFERENCE_FPS 30.0 ///< conference passthrough frame rate if not given
+#define RECV_BATCH 64 ///< max packets read from the input socket at once
+#define DEFAULT_REPLICA_QUEUE_LEN 4096 ///< packets, see replica_queue
+#define REPORT_INTERVAL_NS (5 * NS_IN_SEC)
+
+#ifdef _WIN32
+struct wsa_aux_storage {
+    WSAOVERLAPPED *overlapped;
+    int ref;
+};
+#define ALIGNMENT std::alignment_of<wsa_aux_storage>::value
+#define OFFSET ((MAX_PKT_SIZE + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
+#define SIZE (OFFSET + sizeof(wsa_aux_storage))
+#else
+#define SIZE MAX_PKT_SIZE
+#endif
+
+/**
+ * Reference-counted packet buffers of SIZE bytes. A buffer is returned to its
+ * slab for reuse once the last reference is dropped, so that the holders
+ * (ring slots, asynchronous WSA sends) can share the received data without
+ * copying.
+ */
+class packet_slab {
+public:
+    ~packet_slab() {
+        for (auto *h : free_list) {
+            h->~hdr();
+            free(h);
+        }
+    }
+    /// @returns buffer with a single reference
+    char *alloc() {
+        {
+            lock_guard<mutex> lk(lock);
+            if (!free_list.empty()) {
+                hdr *h = free_list.back();
+                free_list.pop_back();
+                h->refs.store(1, std::memory_order_relaxed);
+                return (char *) (h + 1);
+            }
+        }
+        hdr *h = new (malloc(sizeof(hdr) + SIZE)) hdr{{1}, this};
+        return (char *) (h + 1);
+    }
+    static void ref(char *buf) {
+        header(buf)->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    static void unref(char *buf) {
+        hdr *h = header(buf);
+        if (h->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            lock_guard<mutex> lk(h->slab->lock);
+            h->slab->free_list.push_back(h);
+        }
+    }
+    /// @returns true if someone else than the caller holds the buffer
+    static bool shared(char *buf) {
+        return header(buf)->refs.load(std::memory_order_acquire) > 1;
+    }
+
+private:
+    struct alignas(std::max_align_t) hdr {
+        std::atomic<int> refs;
+        packet_slab *slab;
+    };
+    static hdr *header(char *buf) { return (hdr *)(void *) buf - 1; }
+
+    mutex lock; ///< protects free_list
+    vector<hdr *> free_list;
+};
+
+struct item {
+    long size;
+    char *buf; ///< from packet_slab, the ring holds one reference
+    time_ns_t recv_time; ///< same for the whole received batch
+};
+
+/**
+ * Per-replica telemetry. Every counter is written only by the thread sending
+ * to the replica at the moment (plain load + store, no locked instructions on
+ * the hot path) and read by the writer when reporting, see report_replicas().
+ */
+struct replica_stats {
+    std::atomic<uint64_t> packets{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> errors{0};       ///< failed send calls
+    std::atomic<uint64_t> drops{0};        ///< packets dropped on queue overflow
+    std::atomic<uint64_t> residency_ns{0}; ///< sum over sent packets since reception
+    std::atomic<uint64_t> residency_max_ns{0}; ///< reset by the reporter
+    std::atomic<int> queue_depth{0};       ///< replica_queue length
+
+    static void add(std::atomic<uint64_t> &counter, uint64_t val) {
+        counter.store(counter.load(std::memory_order_relaxed) + val, std::memory_order_relaxed);
+    }
+    /// accounts count sent packets, the oldest one at index 0
+    template <typename Pkt, typename Len, typename Time>
+    void sent(const Pkt *pkts, int count, Len len, Time recv_time, bool error) {
+        const time_ns_t now = get_time_in_ns();
+        uint64_t total = 0;
+        uint64_t residency = 0;
+        for (int i = 0; i < count; ++i) {
+            total += len(pkts[i]);
+            residency += now - recv_time(pkts[i]);
+        }
+        add(packets, count);
+        add(bytes, total);
+        add(residency_ns, residency);
+        if (error) {
+            add(errors, 1);
+        }
+        const uint64_t oldest = now - recv_time(pkts[0]);
+        if (oldest > residency_max_ns.load(std::memory_order_relaxed)) {
+            residency_max_ns.store(oldest, std::memory_order_relaxed);
+        }
+    }
+};
+
+/**
+ * Wakes up the consumers sleeping until any of the packet rings sharing the
+ * doorbell has data. Rung by producers, notifies only if somebody sleeps.
+ */
+class ring_doorbell {
+public:
+    void ring() {
+        if (waiters.load() > 0) {
+            lock_guard<mutex> lk(lock);
+            cv.notify_all();
+        }
+    }
+    template <typename Pred> void wait(Pred ready) {
+        std::unique_lock<mutex> lk(lock);
+        waiters += 1;
+        cv.wait(lk, ready);
+        waiters -= 1;
+    }
+
+private:
+    mutex lock;
+    condition_variable cv;
+    std::atomic<int> waiters{0};
+};
+
+/**
+ * Lock-free ring of received packets with a single producer (a receiving
+ * thread) and several consumers (the writer and fan-out workers). Each
+ * consumer reads all the packets with its own cursor, a slot is reused once
+ * the slowest consumer has passed it. Cursors are monotonic packet counters.
+ *
+ * The waiting side sleeps on a condition variable that is notified only if
+ * someone actually sleeps, which happens at most once per batch. Consumers
+ * wait on a doorbell shared by all rings.
+ *
+ * A slot buffer still referenced by somebody else when the slot is about to
+ * be refilled (see fill_slot()) is left to its holders and replaced.
+ */
+class packet_ring {
+public:
+    packet_ring(int size, int consumers, ring_doorbell &bell) : size(size), items(new item[size]),
+            cursors(new cursor[consumers]), consumers(consumers), bell(bell) {
+        for (int i = 0; i < size; ++i) {
+            items[i].size = 0;
+            items[i].buf = slab.alloc();
+        }
+    }
+    ~packet_ring() {
+        for (int i = 0; i < size; ++i) {
+            packet_slab::unref(items[i].buf);
+        }
+    }
+    struct item *slot(uint64_t pos) { return &items[pos % size]; }
+    /// @returns free slot at pos (from tail()) with an unshared buffer
+    struct item *fill_slot(uint64_t pos) {
+        struct item *it = slot(pos);
+        if (packet_slab::shared(it->buf)) {
+            packet_slab::unref(it->buf);
+            it->buf = slab.alloc();
+        }
+        return it;
+    }
+
+    /// @returns number of slots the producer may fill at tail()
+    int writable() const {
+        uint64_t min_head = cursors[0].head.load(std::memory_order_acquire);
+        for (int i = 1; i < consumers; ++i) {
+            min_head = std::min(min_head, cursors[i].head.load(std::memory_order_acquire));
+        }
+        return size - (int) (tail_pos.load(std::memory_order_relaxed) - min_head);
+    }
+    uint64_t tail() const { return tail_pos.load(std::memory_order_relaxed); }
+    /// makes count slots after tail() visible to consumers
+    void publish(int count) {
+        tail_pos.store(tail_pos.load(std::memory_order_relaxed) + count);
+        bell.ring();
+    }
+    /// blocks until there is a free slot or timeout elapses
+    void wait_space(std::chrono::milliseconds timeout) {
+        std::unique_lock<mutex> lk(lock);
+        space_waiters += 1;
+        space_cv.wait_for(lk, timeout, [this] { return writable() > 0; });
+        space_waiters -= 1;
+    }
+
+    /// @returns position of the next item to be read by the consumer
+    uint64_t head(int consumer) const {
+        return cursors[consumer].head.load(std::memory_order_relaxed);
+    }
+    /// @returns number of items published after pos
+    int readable(uint64_t pos) const { return (int) (tail_pos.load() - pos); }
+    /// returns count slots read by the consumer to the producer
+    void consume(int consumer, int count) {
+        cursors[consumer].head.store(head(consumer) + count);
+        if (space_waiters.load() > 0) {
+            lock_guard<mutex> lk(lock);
+            space_cv.notify_one();
+        }
+    }
+
+private:
+    struct alignas(64) cursor {
+        std::atomic<uint64_t> head{0};
+    };
+    packet_slab slab; ///< must outlive items
+    const int size;
+    std::unique_ptr<item[]> items;
+    alignas(64) std::atomic<uint64_t> tail_pos{0};
+    std::unique_ptr<cursor[]> cursors;
+    const int consumers;
+    ring_doorbell &bell; ///< wakes consumers
+
+    mutex lock; ///< only for sleeping
+    condition_variable space_cv;
+    std::atomic<int> space_waiters{0};
+};
+
+/**
+ * Own packet queue of a replica sent by a dedicated thread, so that a slow
+ * receiver doesn't hold back the others. Sending is optionally shaped with a
+ * token bucket. If the queue overflows, the oldest frame (packets up to the
+ * next RTP marker bit) is dropped - the one not being sent yet if possible,
+ * so that receivers get complete frames.
+ */
+class replica_queue {
+public:
+    replica_queue(struct udp_sendto_batch *batch, replica_stats &stats, const string &name, int max_len, long long bitrate)
+        : batch(batch), stats(stats), name(name), max_len(max_len) {
+        set_rate(bitrate);
+        thread = std::thread(&replica_queue::run, this);
+    }
+    ~replica_queue() {
+        {
+            lock_guard<mutex> lk(lock);
+            should_exit = true;
+        }
+        cv.notify_one();
+        thread.join();
+        for (auto &p : queue) {
+            packet_slab::unref(p.buf);
+        }
+    }
+    /// @param bitrate in bps, RATE_UNLIMITED or a non-positive value to disable shaping
+    void set_rate(long long bitrate) {
+        rate.store(bitrate > 0 ? bitrate : 0);
+    }
+    /// enqueues the packets, the queue holds a reference to each buffer
+    void push(struct item *const *items, int count) {
+        {
+            lock_guard<mutex> lk(lock);
+            for (int i = 0; i < count; ++i) {
+                if ((int) queue.size() >= max_len) {
+                    drop_oldest_frame();
+                }
+                packet_slab::ref(items[i]->buf);
+                queue.push_back({items[i]->buf, (int) items[i]->size, items[i]->recv_time});
+            }
+            stats.queue_depth.store(queue.size(), std::memory_order_relaxed);
+        }
+        cv.notify_one();
+    }
+
+private:
+    struct queued_pkt {
+        char *buf;
+        int len;
+        time_ns_t recv_time;
+    };
+    static bool is_frame_end(const char *buf, int len) {
+        return len >= 12 && (buf[1] & 0x80) != 0; // RTP marker bit
+    }
+    /// must be called with lock held
+    void drop_oldest_frame() {
+        size_t start = 0;
+        if (mid_frame) { // skip rest of the frame being sent
+            while (start < queue.size() && !is_frame_end(queue[start].buf, queue[start].len)) {
+                start += 1;
+            }
+            start += 1;
+            if (start >= queue.size()) {
+                start = 0;
+            }
+        }
+        size_t end = start;
+        while (end < queue.size()) {
+            const bool last = is_frame_end(queue[end].buf, queue[end].len);
+            packet_slab::unref(queue[end++].buf);
+            if (last) {
+                break;
+            }
+        }
+        if (start == 0) {
+            mid_frame = false;
+        }
+        queue.erase(queue.begin() + start, queue.begin() + end);
+        dropped_packets += end - start;
+        dropped_frames += 1;
+        replica_stats::add(stats.drops, end - start);
+    }
+    void run() {
+        using clock = std::chrono::steady_clock;
+        auto last_refill = clock::now();
+        auto last_report = last_refill;
+        double tokens = 0; // bytes
+        unsigned long long reported_frames = 0;
+        queued_pkt pkts[SEND_BATCH];
+        char *bufs[SEND_BATCH];
+        int lens[SEND_BATCH];
+        std::unique_lock<mutex> lk(lock);
+        while (true) {
+            cv.wait(lk, [this] { return should_exit || !queue.empty(); });
+            if (should_exit) {
+                return;
+            }
+            const long long bitrate = rate.load();
+            int count = 0;
+            auto now = clock::now();
+            if (bitrate == 0) {
+                while (count < SEND_BATCH && count < (int) queue.size()) {
+                    pkts[count] = queue[count];
+                    count += 1;
+                }
+            } else {
+                const double bucket = std::max(bitrate / 8 / 100.0, 2.0 * MAX_PKT_SIZE); // 10 ms
+                tokens = std::min(bucket, tokens + bitrate / 8.0
+                                * std::chrono::duration<double>(now - last_refill).count());
+                while (count < SEND_BATCH && count < (int) queue.size()
+                                && tokens >= queue[count].len) {
+                    tokens -= queue[count].len;
+                    pkts[count] = queue[count];
+                    count += 1;
+                }
+                if (count == 0) { // wait for tokens
+                    last_refill = now;
+                    const double missing = queue.front().len - tokens;
+                    cv.wait_for(lk, std::chrono::duration<double>(missing * 8 / bitrate),
+                                    [this] { return should_exit; });
+                    continue;
+                }
+            }
+            last_refill = now;
+            queue.erase(queue.begin(), queue.begin() + count);
+            stats.queue_depth.store(queue.size(), std::memory_order_relaxed);
+            mid_frame = !is_frame_end(pkts[count - 1].buf, pkts[count - 1].len);
+            const unsigned long long frames = dropped_frames;
+            const unsigned long long packets = dropped_packets;
+            lk.unlock();
+
+            for (int i = 0; i < count; ++i) {
+                bufs[i] = pkts[i].buf;
+                lens[i] = pkts[i].len;
+            }
+            const bool error = udp_sendto_batch(batch, bufs, lens, count) < 0;
+            if (error) {
+                perror("Hd-rum-translator send");
+            }
+            stats.sent(pkts, count, [](const queued_pkt &p) { return p.len; },
+                            [](const queued_pkt &p) { return p.recv_time; }, error);
+            for (int i = 0; i < count; ++i) {
+                packet_slab::unref(bufs[i]);
+            }
+            if (now - last_report > std::chrono::seconds(5) && frames != reported_frames) {
+                MSG(WARNING, "%s: queue overflow, dropped %llu frames (%llu packets) so far\n",
+                                name.c_str(), frames, packets);
+                reported_frames = frames;
+                last_report = now;
+            }
+
+            lk.lock();
+        }
+    }
+
+    struct udp_sendto_batch *batch;
+    replica_stats &stats;
+    string name;
+    int max_len; ///< in packets
+    std::atomic<long long> rate{0}; ///< bps, 0 - unlimited
+    std::thread thread;
+
+    mutex lock; ///< protects the members below
+    condition_variable cv;
+    std::deque<queued_pkt> queue;
+    bool should_exit = false;
+    bool mid_frame = false; ///< part of the first frame in queue was already sent
+    unsigned long long dropped_frames = 0;
+    unsigned long long dropped_packets = 0;
+};
+
 struct replica {
-    replica(const char *addr, uint16_t rx_port, uint16_t tx_port, int bufsize, struct module *parent, int force_ip_version) {
+    replica(const char *addr, const char *iface, uint16_t rx_port, uint16_t tx_port, int bufsize, struct module *parent, int force_ip_version) {
         magic = REPLICA_MAGIC;
         host = addr;
         m_tx_port = tx_port;
-        sock = std::shared_ptr<socket_udp>(udp_init(addr, rx_port, tx_port, 255, force_ip_version, false), udp_exit);
+        sock = std::shared_ptr<socket_udp>(udp_init_if(addr, iface, rx_port, tx_port, 255, force_ip_version, false), udp_exit);
         int mode = 0;
         int res = resolve_addrinfo(addr, tx_port, &sockaddr, &sockaddr_len, &mode);
         if (!sock || res != 0) {
@@ -125,9 +544,18 @@ struct replica {
 
     ~replica() {
         assert(magic == REPLICA_MAGIC);
+        queue = nullptr;
+        if (batch != nullptr) {
+            udp_sendto_batch_done(batch);
+        }
         module_done(&mod);
     }
 
+    /// must be called after the socket is finally set
+    void init_batch() {
+        batch = udp_sendto_batch_init(sock.get(), (struct sockaddr *) &sockaddr, sockaddr_len);
+    }
+
     struct module mod;
     uint32_t magic;
     string host;
@@ -138,51 +566,68 @@ struct replica {
         USE_SOCK,
         RECOMPRESS
     };
-    enum type_t type;
+    std::atomic<type_t> type; ///< changed by writer, read by fan-out workers
     std::shared_ptr<socket_udp> sock;
     sockaddr_storage sockaddr;
     socklen_t sockaddr_len;
+    struct udp_sendto_batch *batch = nullptr;
+    replica_stats stats;
+    /// own queue, if set the packets are sent by it instead of the writer or
+    /// fan-out workers; changed only with the fan-out workers locked
+    std::unique_ptr<replica_queue> queue;
+    /// simulcast layer selection, all packets are forwarded if not set;
+    /// changed only with the fan-out workers locked
+    std::shared_ptr<layer_subscription> layers;
+    long long bitrate = RATE_UNLIMITED; ///< forwarding rate limit
+
+    /// values at the last report, see report_replicas()
+    struct {
+        uint64_t packets, bytes, errors, drops, residency_ns;
+    } reported{};
+};
+
+/**
+ * Sender thread forwarding the packets to a subset of the replicas (see
+ * fanout_rebalance()). Each worker reads the packet queue independently so
+ * that a slow destination doesn't delay replicas served by the other workers.
+ */
+struct fanout_worker {
+    std::thread thread;
+    mutex lock; ///< protects replicas
+    vector<replica *> replicas;
 };
 
 struct hd_rum_translator_state {
     hd_rum_translator_state() {
         init_root_module(&mod);
-        pthread_mutex_init(&qempty_mtx, NULL);
-        pthread_mutex_init(&qfull_mtx, NULL);
-        pthread_cond_init(&qempty_cond, NULL);
-        pthread_cond_init(&qfull_cond, NULL);
     }
     ~hd_rum_translator_state() {
-        pthread_mutex_destroy(&qempty_mtx);
-        pthread_mutex_destroy(&qfull_mtx);
-        pthread_cond_destroy(&qempty_cond);
-        pthread_cond_destroy(&qfull_cond);
         module_done(&mod);
     }
     struct module mod;
     int bufsize = 0;
     struct control_state *control_state = nullptr;
-    struct item *queue = nullptr;
-    struct item *qhead = nullptr;
-    struct item *qtail = nullptr;
-    int qempty = 1;
-    int qfull = 0;
-    pthread_mutex_t qempty_mtx;
-    pthread_mutex_t qfull_mtx;
-    pthread_cond_t qempty_cond;
-    pthread_cond_t qfull_cond;
+    ring_doorbell qbell;
+    vector<std::unique_ptr<packet_ring>> queues; ///< one per receiving thread
+    std::atomic<uint64_t> received_bytes{0};
+    std::atomic<uint64_t> received_packets{0};
 
     vector<replica *> replicas;
+    vector<std::unique_ptr<fanout_worker>> fanout; ///< empty if the writer sends itself
     std::shared_ptr<socket_udp> server_socket;
     void *decompress = nullptr;
     struct state_recompress *recompress = nullptr;
+    int rtcp_port = 0; ///< receiver reports for the simulcast layer selection
+    std::unique_ptr<simulcast_control> simulcast; ///< created with the first subscription
+    /// compressed-domain conference (-R passthrough), the forwarding replicas
+    /// receive its output instead of the input packets
+    std::unique_ptr<conference_tiler> tiler;
+    packet_slab tiler_slab; ///< tiler output packets, must outlive replicas' queues
 };
 
 /*
  * Prototypes
  */
-static struct item *qinit(int qsize);
-static void qdestroy(struct item *queue);
 static void *writer(void *arg);
 
 static void signal_handler(int signum)
@@ -218,65 +663,225 @@ static void signal_handler(int signum)
     exit_uv(0);
 }
 
-#define MAX_PKT_SIZE 10000
+/**
+ * Collects up to SEND_BATCH items starting at head that are already in the
+ * queue, stops before the poisoned pill.
+ */
+static int qcollect(packet_ring *q, uint64_t head, struct item **items)
+{
+    const int avail = std::min(q->readable(head), SEND_BATCH);
+    int count = 0;
+    while (count < avail && q->slot(head + count)->size != 0) {
+        items[count] = q->slot(head + count);
+        count += 1;
+    }
+    return count;
+}
 
-#ifdef _WIN32
-struct wsa_aux_storage {
-    WSAOVERLAPPED *overlapped;
-    int ref;
-};
-#define ALIGNMENT std::alignment_of<wsa_aux_storage>::value
-#define OFFSET ((MAX_PKT_SIZE + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
-#define SIZE (OFFSET + sizeof(wsa_aux_storage))
-#else
-#define SIZE MAX_PKT_SIZE
-#endif
+/**
+ * Passes one batch of packets from every ring to process(items, count) and
+ * sleeps if there was none. Consumes the poisoned pills.
+ *
+ * @returns false once the pills of all rings were consumed
+ */
+template <typename F>
+static bool qprocess(struct hd_rum_translator_state *s, int consumer, int *finished, F &&process)
+{
+    struct item *items[SEND_BATCH];
+    bool processed = false;
+    for (auto &q : s->queues) {
+        const uint64_t head = q->head(consumer);
+        const int count = qcollect(q.get(), head, items);
+        if (count > 0) {
+            process(items, count);
+            q->consume(consumer, count);
+            processed = true;
+        } else if (q->readable(head) > 0) { // poisoned pill
+            q->consume(consumer, 1);
+            *finished += 1;
+        }
+    }
+    if (*finished == (int) s->queues.size()) {
+        return false;
+    }
+    if (!processed) {
+        s->qbell.wait([s, consumer] {
+            for (auto &q : s->queues) {
+                if (q->readable(q->head(consumer)) > 0) {
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+    return true;
+}
 
-struct item {
-    struct item *next;
-    long size;
-    char *buf;
-};
+/**
+ * Leaves out the packets of simulcast layers not subscribed by the replica.
+ * @returns number of items stored to selected
+ */
+static int select_layer(struct replica *r, struct item *const *items, int count, struct item **selected)
+{
+    int selected_count = 0;
+    for (int i = 0; i < count; ++i) {
+        if (r->layers->forward(items[i]->buf, items[i]->size)) {
+            selected[selected_count++] = items[i];
+        }
+    }
+    return selected_count;
+}
 
-static struct item *qinit(int qsize)
+/// sends the items to every forwarding replica with a single batched call
+static void send_to_replicas(const vector<replica *> &replicas, struct item *const *items, int count)
 {
-    struct item *queue;
-    int i;
+    char *bufs[SEND_BATCH];
+    int lens[SEND_BATCH];
+    for (int i = 0; i < count; ++i) {
+        bufs[i] = items[i]->buf;
+        lens[i] = items[i]->size;
+    }
+    struct item *selected[SEND_BATCH];
+    char *selected_bufs[SEND_BATCH];
+    int selected_lens[SEND_BATCH];
+    for (auto *r : replicas) {
+        if (r->type == replica::type_t::USE_SOCK) {
+            struct item *const *fwd_items = items;
+            char **fwd_bufs = bufs;
+            int *fwd_lens = lens;
+            int fwd_count = count;
+            if (r->layers) {
+                fwd_count = select_layer(r, items, count, selected);
+                if (fwd_count == 0) {
+                    continue;
+                }
+                for (int i = 0; i < fwd_count; ++i) {
+                    selected_bufs[i] = selected[i]->buf;
+                    selected_lens[i] = selected[i]->size;
+                }
+                fwd_items = selected;
+                fwd_bufs = selected_bufs;
+                fwd_lens = selected_lens;
+            }
+            if (r->queue) {
+                r->queue->push(fwd_items, fwd_count);
+                continue;
+            }
+            const bool error = udp_sendto_batch(r->batch, fwd_bufs, fwd_lens, fwd_count) < 0;
+            if (error) {
+                perror("Hd-rum-translator send");
+            }
+            r->stats.sent(fwd_items, fwd_count, [](const item *it) { return it->size; },
+                    [](const item *it) { return it->recv_time; }, error);
+        }
+    }
+}
 
-    if (qsize <= 0) {
-        fprintf(stderr, "wrong packet queue size %d items\n", qsize);
-        return nullptr;
+/**
+ * Passes the packets through the conference tiler and sends its output to the
+ * forwarding replicas.
+ */
+static void tiler_forward(struct hd_rum_translator_state *s, struct item *const *items, int count)
+{
+    struct item out[SEND_BATCH];
+    struct item *out_ptrs[SEND_BATCH];
+    int out_count = 0;
+    auto flush = [&]() {
+        send_to_replicas(s->replicas, out_ptrs, out_count);
+        for (int i = 0; i < out_count; ++i) {
+            packet_slab::unref(out[i].buf);
+        }
+        out_count = 0;
+    };
+    for (int i = 0; i < count; ++i) {
+        const time_ns_t recv_time = items[i]->recv_time;
+        s->tiler->process(items[i]->buf, (int) items[i]->size, recv_time,
+                [&](const char *pkt, int len) {
+                    char *buf = s->tiler_slab.alloc();
+                    memcpy(buf, pkt, len);
+                    out[out_count] = { len, buf, recv_time };
+                    out_ptrs[out_count] = &out[out_count];
+                    if (++out_count == SEND_BATCH) {
+                        flush();
+                    }
+                });
+    }
+    if (out_count > 0) {
+        flush();
     }
+}
 
-    printf("initializing packet queue for %d items\n", qsize);
+/**
+ * Distributes the replicas among fan-out workers evenly. Called by the writer
+ * when the set of replicas changes.
+ */
+static vector<std::unique_lock<mutex>> fanout_lock(struct hd_rum_translator_state *s)
+{
+    vector<std::unique_lock<mutex>> locks;
+    for (auto &w : s->fanout) {
+        locks.emplace_back(w->lock);
+    }
+    return locks;
+}
 
-    queue = (struct item *) calloc(qsize, sizeof(struct item));
-    if (queue == NULL) {
-        fprintf(stderr, "not enough memory\n");
-        exit(2);
+static void fanout_rebalance(struct hd_rum_translator_state *s)
+{
+    if (s->fanout.empty()) {
+        return;
+    }
+    auto locks = fanout_lock(s);
+    for (auto &w : s->fanout) {
+        w->replicas.clear();
     }
+    for (unsigned int i = 0; i < s->replicas.size(); ++i) {
+        s->fanout[i % s->fanout.size()]->replicas.push_back(s->replicas[i]);
+    }
+}
 
-    for (i = 0; i < qsize; i++) {
-        queue[i].buf = (char *) malloc(SIZE);
-        queue[i].next = queue + i + 1;
+static void fanout_worker_run(struct hd_rum_translator_state *s, struct fanout_worker *w, int consumer)
+{
+    int finished = 0;
+    while (qprocess(s, consumer, &finished, [w](struct item *const *items, int count) {
+                lock_guard<mutex> lk(w->lock);
+                send_to_replicas(w->replicas, items, count);
+            })) {
     }
-    queue[qsize - 1].next = queue;
+}
 
-    return queue;
+/// @param spec "auto" or index of the simulcast layer (0 is the best)
+static bool parse_layer(const char *spec, int *layer)
+{
+    if (strcasecmp(spec, "auto") == 0) {
+        *layer = layer_subscription::LAYER_AUTO;
+        return true;
+    }
+    char *end = nullptr;
+    const long val = strtol(spec, &end, 10);
+    if (end == spec || *end != '\0' || val < 0 || val > INT_MAX) {
+        MSG(ERROR, "Wrong simulcast layer: %s\n", spec);
+        return false;
+    }
+    *layer = (int) val;
+    return true;
 }
 
-static void qdestroy(struct item *queue)
+/**
+ * Subscribes the replica to a simulcast layer instead of forwarding all of
+ * them. Called by the writer (or before it is started).
+ */
+static void replica_set_layer(struct hd_rum_translator_state *s, struct replica *r, int layer)
 {
-    if (queue == nullptr) {
+    if (r->layers) {
+        r->layers->set_layer(layer);
         return;
     }
-
-    struct item *q = queue;
-    do {
-        free(q->buf);
-        q = q->next;
-    } while (q != queue);
-    free(queue);
+    if (!s->simulcast) {
+        s->simulcast = std::make_unique<simulcast_control>(s->rtcp_port);
+    }
+    auto sub = std::make_shared<layer_subscription>(r->mod.name, r->sockaddr, layer, r->bitrate);
+    s->simulcast->add_subscription(sub);
+    auto locks = fanout_lock(s);
+    r->layers = std::move(sub);
 }
 
 #define prefix_matches(x,y) strncasecmp(x, y, strlen(y)) == 0
@@ -299,6 +904,38 @@ static struct response *change_replica_type(struct hd_rum_translator_state *s,
         } else {
             log_msg(LOG_LEVEL_ERROR, "Failed to change port %d compression. Port removed.\n", index);
         }
+    } else if (prefix_matches(data->text, "rate ")) {
+        long long int bitrate = 0;
+        if (!parse_bitrate(data->text + strlen("rate "), &bitrate)) {
+            return new_response(RESPONSE_BAD_REQUEST, NULL);
+        }
+        r->bitrate = bitrate;
+        if (r->layers) {
+            r->layers->set_max_bitrate(bitrate);
+        }
+        if (r->queue) {
+            r->queue->set_rate(bitrate);
+        } else {
+            auto locks = fanout_lock(s);
+            r->queue = std::make_unique<replica_queue>(r->batch, r->stats, r->mod.name,
+                    DEFAULT_REPLICA_QUEUE_LEN, bitrate);
+        }
+        if (bitrate > 0) {
+            log_msg(LOG_LEVEL_NOTICE, "Output port %d forwarding rate set to %sbps.\n", index,
+                    format_in_si_units(bitrate));
+        } else {
+            log_msg(LOG_LEVEL_NOTICE, "Output port %d forwarding rate unlimited.\n", index);
+        }
+        return new_response(RESPONSE_OK, NULL);
+    } else if (prefix_matches(data->text, "layer ")) {
+        int layer = 0;
+        if (!parse_layer(data->text + strlen("layer "), &layer)) {
+            return new_response(RESPONSE_BAD_REQUEST, NULL);
+        }
+        replica_set_layer(s, r, layer);
+        log_msg(LOG_LEVEL_NOTICE, "Output port %d simulcast layer set to %s.\n", index,
+                data->text + strlen("layer "));
+        return new_response(RESPONSE_OK, NULL);
     } else {
         fprintf(stderr, "Unknown replica type \"%s\"\n", data->text);
         return new_response(RESPONSE_BAD_REQUEST, NULL);
@@ -317,21 +954,23 @@ static VOID CALLBACK wsa_deleter(DWORD /* dwErrorCode */,
     struct wsa_aux_storage *aux = (struct wsa_aux_storage *)(void *) ((char *) lpOverlapped->hEvent + OFFSET);
     if (--aux->ref == 0) {
         free(aux->overlapped);
-        free(lpOverlapped->hEvent);
+        packet_slab::unref((char *) lpOverlapped->hEvent);
     }
 }
 #endif
 
 static int create_output_port(struct hd_rum_translator_state *s,
         const char *addr, int rx_port, int tx_port, int bufsize, int force_ip_version,
-        const char *compression, int mtu, const char *fec, int bitrate, bool use_server_sock = false)
+        const char *compression, int mtu, const char *fec, int bitrate, const char *mcast_if,
+        bool use_server_sock = false)
 {
         struct replica *rep;
         try {
-            rep = new replica(addr, rx_port, tx_port, bufsize, &s->mod, force_ip_version);
+            rep = new replica(addr, mcast_if, rx_port, tx_port, bufsize, &s->mod, force_ip_version);
             if(use_server_sock){
                     rep->sock = s->server_socket;
             }
+            rep->init_batch();
         } catch (string const & s) {
             fputs(s.c_str(), stderr);
             const char *err_msg = "cannot create output port (wrong address?)";
@@ -359,12 +998,51 @@ static int create_output_port(struct hd_rum_translator_state *s,
         return idx;
 }
 
+/**
+ * Reports traffic of each replica since the last call to the control socket
+ * (and log in verbose mode). Called by the writer every REPORT_INTERVAL_NS.
+ */
+static void report_replicas(struct hd_rum_translator_state *s)
+{
+    for (auto *r : s->replicas) {
+        auto &st = r->stats;
+        auto &last = r->reported;
+        const uint64_t packets = st.packets.load(std::memory_order_relaxed);
+        const uint64_t bytes = st.bytes.load(std::memory_order_relaxed);
+        const uint64_t errors = st.errors.load(std::memory_order_relaxed);
+        const uint64_t drops = st.drops.load(std::memory_order_relaxed);
+        const uint64_t residency_ns = st.residency_ns.load(std::memory_order_relaxed);
+        const uint64_t residency_max_ns = st.residency_max_ns.exchange(0, std::memory_order_relaxed);
+        const uint64_t sent = packets - last.packets;
+        const uint64_t residency_avg_us = sent == 0 ? 0 : (residency_ns - last.residency_ns) / sent / US_IN_NS;
+
+        std::string report = string("reflector_tx ") + r->mod.name
+            + " packets " + to_string(sent)
+            + " bytes " + to_string(bytes - last.bytes)
+            + " errors " + to_string(errors - last.errors)
+            + " drops " + to_string(drops - last.drops)
+            + " queue " + to_string(st.queue_depth.load(std::memory_order_relaxed))
+            + " residency_avg_us " + to_string(residency_avg_us)
+            + " residency_max_us " + to_string(residency_max_ns / US_IN_NS);
+        MSG(VERBOSE, "%s\n", report.c_str());
+        control_report_stats(s->control_state, report);
+        last = {packets, bytes, errors, drops, residency_ns};
+    }
+}
+
 static void *writer(void *arg)
 {
     struct hd_rum_translator_state *s =
         (struct hd_rum_translator_state *) arg;
+    int finished = 0;
+    time_ns_t last_report = get_time_in_ns();
 
     while (1) {
+        if (get_time_in_ns() - last_report > REPORT_INTERVAL_NS) {
+            report_replicas(s);
+            last_report = get_time_in_ns();
+        }
+
         // first check messages
         for (unsigned int i = 0; i < s->replicas.size(); i++) {
             struct message *msg;
@@ -402,8 +1080,10 @@ static void *writer(void *arg)
                 }
                 if (index >= 0) {
                     recompress_remove_port(s->recompress, index);
-                    delete s->replicas[index];
+                    replica *removed = s->replicas[index];
                     s->replicas.erase(s->replicas.begin() + index);
+                    fanout_rebalance(s);
+                    delete removed;
                     log_msg(LOG_LEVEL_NOTICE, "Deleted output port %d.\n", index);
                 }
             } else if (strncasecmp(msg->text, "create-port", strlen("create-port")) == 0) {
@@ -440,12 +1120,13 @@ static void *writer(void *arg)
 
                 int idx = create_output_port(s,
                         host, 0, tx_port, s->bufsize, false,
-                        compress, 1500, nullptr, RATE_UNLIMITED, s->server_socket != nullptr);
+                        compress, 1500, nullptr, RATE_UNLIMITED, nullptr, s->server_socket != nullptr);
 
                 if(idx < 0) {
                     free_message((struct message *) msg, new_response(RESPONSE_INT_SERV_ERR, "Cannot create output port."));
                     continue;
                 }
+                fanout_rebalance(s);
 
                 if(compress)
                     log_msg(LOG_LEVEL_NOTICE, "Created new transcoding output port %s:%d:0x%08" PRIx32 ".\n", host, tx_port, recompress_get_port_ssrc(s->recompress, idx));
@@ -460,70 +1141,87 @@ static void *writer(void *arg)
         }
 
         // then process incoming packets
-        while (s->qhead != s->qtail) {
-            if(s->qhead->size == 0) { // poisoned pill
-                return NULL;
+        bool more = qprocess(s, 0, &finished, [s](struct item *const *items, int count) {
+            if (s->simulcast) {
+                s->simulcast->account(items, count, [](const item *it) { return it->buf; },
+                        [](const item *it) { return (int) it->size; });
+            }
+
+            if (s->tiler) {
+                tiler_forward(s, items, count);
+                return;
             }
 
             // pass it for transcoding if needed
             if (recompress_get_num_active_ports(s->recompress) > 0) {
-                ssize_t ret = hd_rum_decompress_write(s->decompress, s->qhead->buf, s->qhead->size);
-                if (ret < 0) {
-                    perror("hd_rum_decompress_write");
+                for (int i = 0; i < count; ++i) {
+                    ssize_t ret = hd_rum_decompress_write(s->decompress, items[i]->buf, items[i]->size);
+                    if (ret < 0) {
+                        perror("hd_rum_decompress_write");
+                    }
                 }
             }
 
             // distribute it to output ports that don't need transcoding
+            // (unless done by fan-out workers)
 #ifdef _WIN32
-            // send it asynchronously in MSW (performance optimalization)
-            SleepEx(0, TRUE); // allow system to call our completion routines in APC
-            int ref = 0;
-            for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    ref++;
+            for (int j = 0; j < count; ++j) {
+                struct item *it = items[j];
+                // send it asynchronously in MSW (performance optimalization)
+                SleepEx(0, TRUE); // allow system to call our completion routines in APC
+                int ref = 0;
+                vector<char> fwd(s->replicas.size());
+                for (unsigned int i = 0; i < s->replicas.size(); i++) {
+                    struct replica *r = s->replicas[i];
+                    fwd[i] = r->type == replica::type_t::USE_SOCK && !r->queue
+                            && (!r->layers || r->layers->forward(it->buf, it->size));
+                    if (fwd[i]) {
+                        ref++;
+                    }
                 }
-            }
-            struct wsa_aux_storage *aux = (struct wsa_aux_storage *)(void *) ((char *) s->qhead->buf + OFFSET);
-            memset(aux, 0, sizeof *aux);
-            aux->overlapped = (WSAOVERLAPPED *) calloc(ref, sizeof(WSAOVERLAPPED));
-            aux->ref = ref;
-            int overlapped_idx = 0;
-            for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    aux->overlapped[overlapped_idx].hEvent = s->qhead->buf;
-                    ssize_t ret = udp_sendto_wsa_async(s->replicas[i]->sock.get(), s->qhead->buf, s->qhead->size,
-                                    wsa_deleter, &aux->overlapped[overlapped_idx], (sockaddr *) &s->replicas[i]->sockaddr, s->replicas[i]->sockaddr_len);
-                    if (ret < 0) {
-                        perror("Hd-rum-translator send");
+                if (ref == 0) {
+                    continue;
+                }
+                // the packet is referenced until the last send completes
+                packet_slab::ref(it->buf);
+                struct wsa_aux_storage *aux = (struct wsa_aux_storage *)(void *) ((char *) it->buf + OFFSET);
+                memset(aux, 0, sizeof *aux);
+                aux->overlapped = (WSAOVERLAPPED *) calloc(ref, sizeof(WSAOVERLAPPED));
+                aux->ref = ref;
+                int overlapped_idx = 0;
+                for (unsigned int i = 0; i < s->replicas.size(); i++) {
+                    if (fwd[i]) {
+                        aux->overlapped[overlapped_idx].hEvent = it->buf;
+                        ssize_t ret = udp_sendto_wsa_async(s->replicas[i]->sock.get(), it->buf, it->size,
+                                        wsa_deleter, &aux->overlapped[overlapped_idx], (sockaddr *) &s->replicas[i]->sockaddr, s->replicas[i]->sockaddr_len);
+                        if (ret < 0) {
+                            perror("Hd-rum-translator send");
+                        }
+                        s->replicas[i]->stats.sent(&it, 1, [](const item *it) { return it->size; },
+                                [](const item *it) { return it->recv_time; }, ret < 0);
+                        overlapped_idx += 1;
                     }
-                    overlapped_idx += 1;
                 }
             }
-            // reallocate the buffer since the last one will be freeed automaticaly
-            s->qhead->buf = (char *) malloc(SIZE);
-#else
-            for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    ssize_t ret = udp_sendto(s->replicas[i]->sock.get(), s->qhead->buf, s->qhead->size, (sockaddr *) &s->replicas[i]->sockaddr, s->replicas[i]->sockaddr_len);
-                    if (ret < 0) {
-                        perror("Hd-rum-translator send");
+            struct item *selected[SEND_BATCH];
+            for (auto *r : s->replicas) {
+                if (r->type == replica::type_t::USE_SOCK && r->queue) {
+                    if (!r->layers) {
+                        r->queue->push(items, count);
+                    } else if (int n = select_layer(r, items, count, selected); n > 0) {
+                        r->queue->push(selected, n);
                     }
                 }
             }
+#else
+            if (s->fanout.empty()) {
+                send_to_replicas(s->replicas, items, count);
+            }
 #endif
-            s->qhead = s->qhead->next;
-
-            pthread_mutex_lock(&s->qfull_mtx);
-            s->qfull = 0;
-            pthread_cond_signal(&s->qfull_cond);
-            pthread_mutex_unlock(&s->qfull_mtx);
+        });
+        if (!more) {
+            return NULL;
         }
-
-        pthread_mutex_lock(&s->qempty_mtx);
-        if (s->qempty)
-            pthread_cond_wait(&s->qempty_cond, &s->qempty_mtx);
-        s->qempty = 1;
-        pthread_mutex_unlock(&s->qempty_mtx);
     }
 
     return NULL;
@@ -553,21 +1251,39 @@ static void usage(const char *progname) {
              "port\n"
           << SBOLD("\t--conference|-r <width>:<height>[:fps]")
           << " - enable combining of multiple inputs, increases latency\n"
-          << SBOLD("\t--conference-compression|-R <compression>")
-          << " - compression for conference participants\n"
+          << SBOLD("\t--conference-compression|-R <compression>|passthrough")
+          << " - compression for conference participants,\n\t\t "
+          << SBOLD("passthrough") << " tiles the received intra-coded "
+             "frames without transcoding\n"
           << SBOLD("\t--capture-filter|-F <cfg_string>")
           << " - apply video capture filter to incoming video\n"
+          << SBOLD("\t--fanout-threads|-T <n>")
+          << " - number of threads forwarding packets to the hosts (default "
+             "1)\n"
+          << SBOLD("\t--receive-threads|-M <n>")
+          << " - number of threads receiving with own SO_REUSEPORT socket, "
+             "sources\n\t\t are distributed by flow hash (Linux only, "
+             "default 1)\n"
           << SBOLD("\t--param|-O") << " - additional parameters\n"
           << SBOLD("\t--help|-h\n") << SBOLD("\t--verbose|-V\n") << SBOLD("\t-v")
           << " - print version\n";
     col() << "and " << SUNDERLINE("hostX_options") << " may be:\n"
           << SBOLD("\t-P [<rx_port>:]<tx_port>")
           << " - TX port to be used (optionally also RX)\n"
+          << SBOLD("\t-I <iface>")
+          << " - outgoing interface if the host is a multicast group\n"
           << SBOLD("\t-c <compression>") << " - compression\n"
+          << SBOLD("\t-l <limiting_bitrate>") << " - bitrate to be shaped to\n"
+          << SBOLD("\t-q <packets>")
+          << " - forward through own queue of given length (default "
+          << DEFAULT_REPLICA_QUEUE_LEN
+          << " if -l is given),\n\t\t oldest frames are dropped on overflow\n"
+          << SBOLD("\t-s <layer>|auto")
+          << " - forward only one simulcast layer (0 is the best), " << SBOLD("auto")
+          << "\n\t\t selects it by receiver reports and " << SBOLD("-l") << "\n"
           << "\tFollowing options will be used only if " << SUNDERLINE("'-c'")
           << " parameter is set:\n"
           << SBOLD("\t-m <mtu>") << " - MTU size\n"
-          << SBOLD("\t-l <limiting_bitrate>") << " - bitrate to be shaped to\n"
           << SBOLD("\t-f <fec>")
           << " - FEC that will be used for transmission.\n"
           << SBOLD("\t-4/-6") << " - force IPv4/IPv6\n";
@@ -578,6 +1294,18 @@ static void usage(const char *progname) {
            "set, simple packet retransmission is used. Compression can be "
            "also 'none'\n"
            "for uncompressed transmission (see 'uv -c help' for list).\n");
+    printf("\nIf the host is a multicast group, the stream is sent only once and\n"
+           "replicated by the network, which scales better than many unicast hosts.\n"
+           "Receivers may join it source-specifically with '--param "
+           "udp-mcast-source=<addr>'.\n");
+    printf("\nWith '-R passthrough', up to %d conference participants sending the same\n"
+           "resolution in an intra-only codec (JPEG, J2K...) without FEC are forwarded as\n"
+           "tiles of one stream (display it with '-M tiled-2x2'), width and height given\n"
+           "to '-r' are not used.\n", CONFERENCE_TILER_MAX_TILES);
+    printf("\nIf the source sends simulcast ('--param video-simulcast'), the layers (SSRCs)\n"
+           "are ordered by bitrate and switched at keyframes. The receiver reports needed\n"
+           "by the 'auto' selection are received on port+1, so the receivers should use\n"
+           "the reflector port as the TX port (UltraGrid default).\n");
 }
 
 struct host_opts {
@@ -588,7 +1316,10 @@ struct host_opts {
     const char *compression;
     char *fec;
     long long int bitrate;
+    int queue_len; ///< forwarding queue, 0 - none
     int force_ip_version;
+    const char *mcast_if; ///< multicast outgoing interface
+    const char *layer; ///< simulcast layer, NULL to forward all
 };
 
 struct cmdline_parameters {
@@ -603,8 +1334,21 @@ struct cmdline_parameters {
     const char *capture_filter = NULL;
     int log_level = -1;
     const char *conference_compression = nullptr;
+    int fanout_threads = 1;
+    int receive_threads = 1;
 };
 
+/// @param arg conference config <width>:<height>[:<fps>]
+static double get_conference_fps(const char *arg)
+{
+    const char *fps = strchr(arg, ':');
+    fps = fps == nullptr ? nullptr : strchr(fps + 1, ':');
+    if (fps == nullptr || atof(fps + 1) <= 0) {
+        return DEFAULT_CONFERENCE_FPS;
+    }
+    return atof(fps + 1);
+}
+
 /// unit_evaluate() is similar but uses SI prefixes
 static int
 parse_size(const char *sz_str) noexcept(false)
@@ -643,9 +1387,11 @@ static int parse_global_opts(int argc, char **argv,
                 {"blend",                   no_argument,       nullptr, 'B'},
                 { "capture-filter",         required_argument, nullptr, 'F'},
                 { "list-modules",           required_argument, nullptr, 'L'},
+                { "receive-threads",        required_argument, nullptr, 'M'},
                 { "param",                  required_argument, nullptr, 'O'},
                 { "conference-compression", required_argument, nullptr, 'R'},
                 { "server",                 required_argument, nullptr, 'S'},
+                { "fanout-threads",         required_argument, nullptr, 'T'},
                 { "verbose",                optional_argument, nullptr, 'V'},
                 { "capabilities",           no_argument,       nullptr, 'b'},
                 { "help",                   no_argument,       nullptr, 'h'},
@@ -654,7 +1400,7 @@ static int parse_global_opts(int argc, char **argv,
                 { "version",                no_argument,       nullptr, 'v'},
                 { nullptr,                  0,                 nullptr, 0  }
         };
-        const char *const optstring = "+BF:LO:R:S:Vbhn:r:v";
+        const char *const optstring = "+BF:LM:O:R:S:T:Vbhn:r:v";
 
         int ch = 0;
         while ((ch = getopt_long(argc, argv, optstring, getopt_options,
@@ -684,6 +1430,22 @@ static int parse_global_opts(int argc, char **argv,
                 case 'S':
                         parsed->server_port = stoi(optarg);
                         break;
+                case 'T':
+                        parsed->fanout_threads = stoi(optarg);
+                        if (parsed->fanout_threads <= 0) {
+                                throw ug_runtime_error(
+                                    string("fan-out thread count must be "
+                                           "positive: ") + optarg);
+                        }
+                        break;
+                case 'M':
+                        parsed->receive_threads = stoi(optarg);
+                        if (parsed->receive_threads <= 0) {
+                                throw ug_runtime_error(
+                                    string("receive thread count must be "
+                                           "positive: ") + optarg);
+                        }
+                        break;
                 case 'F':
                         parsed->capture_filter = optarg;
                         break;
@@ -760,7 +1522,7 @@ parse_fmt(int argc, char **argv,
             parsed->hosts[parsed->host_count].bitrate = RATE_UNLIMITED;
             parsed->hosts[parsed->host_count].mtu     = 1500;
 
-            const char *const optstring = "+46P:c:f:l:m:";
+            const char *const optstring = "+46I:P:c:f:l:m:q:s:";
             int               ch        = 0;
             while ((ch = getopt(argc, argv, optstring)) != -1) {
                     switch (ch) {
@@ -775,6 +1537,9 @@ parse_fmt(int argc, char **argv,
                                         stoi(optarg);
                             }
                             break;
+                    case 'I':
+                            parsed->hosts[parsed->host_count].mcast_if = optarg;
+                            break;
                     case 'm':
                             parsed->hosts[parsed->host_count].mtu = stoi(optarg);
                             break;
@@ -791,6 +1556,16 @@ parse_fmt(int argc, char **argv,
                                     return -1;
                             }
                             break;
+                    case 'q':
+                            parsed->hosts[parsed->host_count].queue_len = stoi(optarg);
+                            if (parsed->hosts[parsed->host_count].queue_len <= 0) {
+                                    MSG(ERROR, "Queue length must be positive!\n");
+                                    return -1;
+                            }
+                            break;
+                    case 's':
+                            parsed->hosts[parsed->host_count].layer = optarg;
+                            break;
                     case '4':
                             parsed->hosts[parsed->host_count].force_ip_version = 4;
                             break;
@@ -824,10 +1599,11 @@ static void hd_rum_translator_deinit(struct hd_rum_translator_state *s) {
     for (unsigned int i = 0; i < s->replicas.size(); i++) {
         delete s->replicas[i];
     }
+    s->simulcast = nullptr;
 
     control_done(s->control_state);
 
-    qdestroy(s->queue);
+    s->queues.clear();
 }
 
 static bool sockaddr_equal(struct sockaddr_storage *a, struct sockaddr_storage *b){
@@ -868,7 +1644,9 @@ public:
                     worker_thread.join();
         }
 
+        /// called by the receiving threads and the server socket worker
         void tick(sockaddr_storage& sin, socklen_t addrlen){
+                lock_guard<mutex> lk(lock);
                 struct timeval t;
                 gettimeofday(&t, NULL);
                 bool seen = false;
@@ -937,6 +1715,7 @@ public:
         }
 
 private:
+        mutex lock; ///< protects participants
         std::vector<Conf_participant> participants;
         struct module& mod;
         std::string compression;
@@ -959,6 +1738,73 @@ private:
         }
 };
 
+/**
+ * Receives packets from one of the input sockets into its ring until
+ * should_exit is set, then passes the poisoned pill.
+ */
+static void receiver_run(struct hd_rum_translator_state *s, socket_udp *sock, packet_ring *q,
+        Participant_manager *participant_mgr, const volatile bool *should_exit)
+{
+    char *bufs[RECV_BATCH];
+    int lens[RECV_BATCH];
+    struct sockaddr_storage sin[RECV_BATCH];
+    socklen_t addrlen[RECV_BATCH];
+    while (!*should_exit) {
+        const int count = std::min(q->writable(), RECV_BATCH);
+        if (count == 0) {
+            q->wait_space(std::chrono::milliseconds(100));
+            continue;
+        }
+        for (int i = 0; i < count; ++i) {
+            bufs[i] = q->fill_slot(q->tail() + i)->buf;
+            addrlen[i] = sizeof sin[i];
+        }
+        struct timeval timeout = { 0, 100000 };
+        const int received = udp_recvfrom_batch_timeout(sock, bufs, lens, MAX_PKT_SIZE, count, &timeout,
+                participant_mgr ? sin : nullptr, addrlen);
+        if (received == 0) {
+            continue;
+        }
+
+        uint64_t bytes = 0;
+        const time_ns_t now = get_time_in_ns();
+        for (int i = 0; i < received; ++i) {
+            q->slot(q->tail() + i)->size = lens[i];
+            q->slot(q->tail() + i)->recv_time = now;
+            if (participant_mgr) {
+                participant_mgr->tick(sin[i], addrlen[i]);
+            }
+            bytes += lens[i];
+        }
+        q->publish(received);
+        s->received_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        s->received_packets.fetch_add(received, std::memory_order_relaxed);
+    }
+
+    // pass poisoned pill to the workers
+    while (q->writable() == 0) {
+        q->wait_space(std::chrono::milliseconds(100));
+    }
+    q->slot(q->tail())->size = 0;
+    q->publish(1);
+}
+
+/// logs the input bitrate and reports it to the control socket
+static void report_received(struct hd_rum_translator_state *s, uint64_t bytes, uint64_t packets, double seconds)
+{
+    unsigned long long int bps = bytes / seconds;
+    char tim_str[20] = "";
+    time_t tim = time(NULL);
+    struct tm *tmp = localtime(&tim);
+    if (tmp) {
+        strftime(tim_str, sizeof(tim_str), "%F %T", tmp);
+    }
+    log_msg(LOG_LEVEL_INFO, "[%s] Received %llu bytes in %g seconds = %sbps\n", tim_str,
+            (unsigned long long) bytes, seconds, format_in_si_units(bps * 8));
+    control_report_stats(s->control_state, "reflector_rx " + to_string(bytes) + " bytes "
+            + to_string(packets) + " packets " + to_string(bps * 8) + " bps");
+}
+
 static void hd_rum_translator_should_exit_callback(void *arg) {
     volatile auto *should_exit = (volatile bool *) arg;
     *should_exit = true;
@@ -982,7 +1828,6 @@ int main(int argc, char **argv)
     int qsize;
     socket_udp *sock_in = nullptr;
     pthread_t thread;
-    int err = 0;
     int i;
     struct cmdline_parameters params = {};
 
@@ -1043,8 +1888,8 @@ int main(int argc, char **argv)
 
     printf("using UDP send and receive buffer size of %d bytes\n", state.bufsize);
 
-    state.qhead = state.qtail = state.queue = qinit(qsize);
-    if (!state.qhead) {
+    if (qsize <= 0) {
+        fprintf(stderr, "wrong packet queue size %d items\n", qsize);
         EXIT(EXIT_FAILURE);
     }
 
@@ -1060,6 +1905,7 @@ int main(int argc, char **argv)
     }
 
     printf("listening on *:%d\n", udp_get_udp_rx_port(sock_in));
+    state.rtcp_port = udp_get_udp_rx_port(sock_in) + 1;
 
     if (params.control_port != -1) {
         if (control_init(params.control_port, params.control_connection_type, &state.control_state, &state.mod, 0) != 0) {
@@ -1089,7 +1935,15 @@ int main(int argc, char **argv)
             }
     }
 
-    if(params.out_conf.mode == CONFERENCE && !params.conference_compression){
+    if (params.out_conf.mode == CONFERENCE && params.conference_compression != nullptr
+            && strcmp(params.conference_compression, "passthrough") == 0) {
+        state.tiler = std::make_unique<conference_tiler>(get_conference_fps(params.out_conf.arg));
+        params.conference_compression = nullptr; // participants get the forwarded tiles
+        if (params.fanout_threads > 1) {
+            MSG(WARNING, "Fan-out threads are not used with the conference passthrough.\n");
+            params.fanout_threads = 1;
+        }
+    } else if(params.out_conf.mode == CONFERENCE && !params.conference_compression){
             params.conference_compression = "libavcodec";
     }
 
@@ -1108,10 +1962,69 @@ int main(int argc, char **argv)
 
         int idx = create_output_port(&state,
                 h.addr, rx_port, tx_port, state.bufsize, h.force_ip_version,
-                h.compression, h.mtu, h.compression ? h.fec : nullptr, h.bitrate);
+                h.compression, h.mtu, h.compression ? h.fec : nullptr, h.bitrate, h.mcast_if);
         if(idx < 0) {
             EXIT(EXIT_FAILURE);
         }
+        struct replica *r = state.replicas[idx];
+        r->bitrate = h.bitrate;
+        if (h.layer != nullptr) {
+            int layer = 0;
+            if (h.compression) {
+                MSG(ERROR, "Simulcast layer selection cannot be combined with compression!\n");
+                EXIT(EXIT_FAILURE);
+            }
+            if (!parse_layer(h.layer, &layer)) {
+                EXIT(EXIT_FAILURE);
+            }
+            replica_set_layer(&state, r, layer);
+        }
+        if (!h.compression && (h.bitrate > 0 || h.queue_len > 0)) {
+            r->queue = std::make_unique<replica_queue>(r->batch, r->stats, r->mod.name,
+                    h.queue_len > 0 ? h.queue_len : DEFAULT_REPLICA_QUEUE_LEN, h.bitrate);
+        }
+    }
+
+#ifndef __linux__
+    if (params.receive_threads > 1) {
+        MSG(WARNING, "Multiple receiving threads supported only in Linux, using one.\n");
+        params.receive_threads = 1;
+    }
+#endif
+#ifdef _WIN32
+    if (params.fanout_threads > 1) {
+        MSG(WARNING, "Multiple fan-out threads not supported in MSW, using one.\n");
+        params.fanout_threads = 1;
+    }
+#endif
+    if (params.fanout_threads > 1) {
+        for (i = 0; i < params.fanout_threads; ++i) {
+            state.fanout.emplace_back(new fanout_worker);
+        }
+        fanout_rebalance(&state);
+        MSG(INFO, "Using %d fan-out threads.\n", params.fanout_threads);
+    }
+
+    vector<socket_udp *> socks_in{sock_in};
+    for (i = 1; i < params.receive_threads; ++i) {
+        socket_udp *sock = udp_init_if("localhost", NULL, udp_get_udp_rx_port(sock_in), 0, 255, false, false);
+        if (sock == nullptr) {
+            MSG(ERROR, "Cannot create additional input socket!\n");
+            break;
+        }
+        udp_set_recv_buf(sock, state.bufsize);
+        socks_in.push_back(sock);
+    }
+    if (socks_in.size() > 1) {
+        MSG(INFO, "Using %zu receiving threads.\n", socks_in.size());
+    }
+
+    printf("initializing packet queue for %d items\n", qsize);
+    for (unsigned int i = 0; i < socks_in.size(); ++i) {
+        state.queues.emplace_back(std::make_unique<packet_ring>(qsize, 1 + (int) state.fanout.size(), state.qbell));
+    }
+    for (unsigned int i = 0; i < state.fanout.size(); ++i) {
+        state.fanout[i]->thread = std::thread(fanout_worker_run, &state, state.fanout[i].get(), i + 1);
     }
 
     if (pthread_create(&thread, NULL, writer, (void *) &state)) {
@@ -1119,12 +2032,6 @@ int main(int argc, char **argv)
         EXIT(2);
     }
 
-    uint64_t received_data = 0;
-    struct timeval t0;
-    gettimeofday(&t0, NULL);
-
-    unsigned long long int last_data = 0ull;
-
     Participant_manager participant_mgr(state.mod, params.conference_compression);
 
     if(state.server_socket){
@@ -1133,78 +2040,46 @@ int main(int argc, char **argv)
 
     volatile bool should_exit = false;
     register_should_exit_callback(&state.mod, hd_rum_translator_should_exit_callback, const_cast<bool *>(&should_exit));
-    /* main loop */
-    while (!should_exit) {
-        while (state.qtail->next != state.qhead && !should_exit) {
-            struct timeval timeout = { 1, 0 };
-
-            struct sockaddr_storage sin = {};
-            socklen_t addrlen = sizeof(sin);
-            state.qtail->size = udp_recvfrom_timeout(sock_in, state.qtail->buf, SIZE, &timeout, (sockaddr *) &sin, &addrlen);
-            if(state.qtail->size <= 0)
-                break;
-
-            struct timeval t;
-            gettimeofday(&t, NULL);
-
-            if(params.out_conf.mode == CONFERENCE){
-                    participant_mgr.tick(sin, addrlen);
-            }
-
-            received_data += state.qtail->size;
-
-            state.qtail = state.qtail->next;
 
-            pthread_mutex_lock(&state.qempty_mtx);
-            state.qempty = 0;
-            pthread_cond_signal(&state.qempty_cond);
-            pthread_mutex_unlock(&state.qempty_mtx);
+    vector<std::thread> receivers;
+    for (unsigned int i = 0; i < socks_in.size(); ++i) {
+        receivers.emplace_back(receiver_run, &state, socks_in[i], state.queues[i].get(),
+                params.out_conf.mode == CONFERENCE ? &participant_mgr : nullptr, &should_exit);
+    }
 
-            double seconds = tv_diff(t, t0);
-            if (seconds > 5.0) {
-                unsigned long long int cur_data = (received_data - last_data);
-                unsigned long long int bps = cur_data / seconds;
-                char tim_str[20];
-                time_t tim = time(NULL);
-                struct tm *tmp = localtime(&tim);
-                if (tmp) {
-                    strftime(tim_str, sizeof(tim_str), "%F %T", tmp);
-                }
-                log_msg(LOG_LEVEL_INFO, "[%s] Received %llu bytes in %g seconds = %sbps\n", tim_str, cur_data, seconds, format_in_si_units(bps * 8));
-                t0 = t;
-                last_data = received_data;
+    /* main loop - statistics only, receiving is done by the receivers */
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t last_bytes = 0;
+    uint64_t last_packets = 0;
+    while (!should_exit) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        auto t = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(t - t0).count();
+        if (seconds > 5.0) {
+            const uint64_t bytes = state.received_bytes.load(std::memory_order_relaxed);
+            const uint64_t packets = state.received_packets.load(std::memory_order_relaxed);
+            if (bytes != last_bytes) {
+                report_received(&state, bytes - last_bytes, packets - last_packets, seconds);
             }
+            t0 = t;
+            last_bytes = bytes;
+            last_packets = packets;
         }
-
-        if (state.qtail->size <= 0)
-            continue;
-
-        pthread_mutex_lock(&state.qfull_mtx);
-        if (state.qfull)
-            pthread_cond_wait(&state.qfull_cond, &state.qfull_mtx);
-        state.qfull = 1;
-        pthread_mutex_unlock(&state.qfull_mtx);
     }
 
-    if (state.qtail->size < 0 && !should_exit) {
-        printf("read: %s\n", strerror(err));
-        EXIT(2);
+    for (auto &r : receivers) {
+        r.join();
     }
-
-    // pass poisoned pill to the worker
-    state.qtail->size = 0;
-    state.qtail = state.qtail->next;
-
-    pthread_mutex_lock(&state.qempty_mtx);
-    state.qempty = 0;
-    pthread_cond_signal(&state.qempty_cond);
-    pthread_mutex_unlock(&state.qempty_mtx);
-
     alarm(5);
     pthread_join(thread, NULL);
+    for (auto &w : state.fanout) {
+        w->thread.join();
+    }
 
     hd_rum_translator_deinit(&state);
-    udp_exit(sock_in);
+    for (auto *sock : socks_in) {
+        udp_exit(sock);
+    }
     common_cleanup(init);
     unregister_should_exit_callback(&state.mod, hd_rum_translator_should_exit_callback, const_cast<bool *>(&should_exit));
 
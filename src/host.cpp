@@ -47,6 +47,7 @@
 #ifndef _WIN32
 #include <execinfo.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #endif // defined _WIN32
 
 #if __GLIBC__ == 2 && __GLIBC_MINOR__ < 27
@@ -68,6 +69,7 @@
 #include "lib_common.h"
 #include "messaging.h"
 #include "module.h"
+#include "tv.h"
 #include "utils/color_out.h"
 #include "utils/fs.h"
 #include "utils/misc.h" // ug_strerror
@@ -89,11 +91,15 @@
 #include <iomanip>
 #include <iostream>
 #include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <fstream>
 #include <string>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #if defined HAVE_X || defined BUILD_LIBRARIES
 #include <dlfcn.h>
@@ -126,6 +132,7 @@ using std::ifstream;
 using std::left;
 using std::list;
 using std::make_tuple;
+using std::make_unique;
 using std::max;
 using std::mutex;
 using std::pair;
@@ -136,6 +143,7 @@ using std::to_string;
 using std::tuple;
 using std::unordered_map;
 using std::unique_lock;
+using std::vector;
 
 unsigned int audio_capture_channels = 0;
 unsigned int audio_capture_bps = 0;
@@ -440,7 +448,7 @@ struct init_data *common_preinit(int argc, char *argv[])
         }
 #endif
 
-        struct init_data init{};
+        auto init = make_unique<init_data>(); // opened_libs must not move, modules may be loaded lazily
 #ifdef _WIN32
         WSADATA wsaData;
         int err = WSAStartup(MAKEWORD(2, 2), &wsaData);
@@ -460,7 +468,7 @@ struct init_data *common_preinit(int argc, char *argv[])
         // is perhaps better variant (Portaudio would accept that).
         const bool init_com = !tok_in_argv(argv, "screen:unregister_elevated");
         if (init_com) {
-                com_initialize(&init.com_initialized, nullptr);
+                com_initialize(&init->com_initialized, nullptr);
         }
 
         // warn in W10 "legacy" terminal emulators
@@ -477,7 +485,7 @@ struct init_data *common_preinit(int argc, char *argv[])
 #endif
 
         if (strstr(argv[0], "run_tests") == nullptr) {
-                open_all("ultragrid_*.so", init.opened_libs); // load modules
+                open_all("ultragrid_*.so", init->opened_libs); // load modules
         }
 
         ug_rand_init();
@@ -492,7 +500,7 @@ struct init_data *common_preinit(int argc, char *argv[])
         fec_init();
 #endif
 
-        return new init_data{ std::move(init) };
+        return init.release();
 }
 
 struct state_root {
@@ -596,8 +604,8 @@ int get_exit_status(struct module *root_mod) {
 
 using module_info_map = std::map<std::string, const void *>;
 
-static void print_device(std::string purpose, std::string const & mod, const device_info& device){
-        cout << "[capability][device] {"
+static void print_device(std::ostream &out, std::string purpose, std::string const & mod, const device_info& device){
+        out << "[capability][device] {"
                 "\"purpose\":" << std::quoted(purpose) << ", "
                 "\"module\":" << std::quoted(mod) << ", "
                 "\"device\":" << std::quoted(device.dev) << ", "
@@ -611,61 +619,112 @@ static void print_device(std::string purpose, std::string const & mod, const dev
                         break;
                 }
                 if (j > 0) {
-                        printf(", ");
+                        out << ", ";
                 }
-                std::cout << "{\"name\":" << std::quoted(device.modes[j].name) << ", "
+                out << "{\"name\":" << std::quoted(device.modes[j].name) << ", "
                         "\"opts\":" << device.modes[j].id << "}";
         }
-        std::cout << "]";
+        out << "]";
 
-        std::cout << ", \"options\": [";
+        out << ", \"options\": [";
         for(unsigned int j = 0; j < std::size(device.options); j++) {
                 if (device.options[j].key[0] == '\0') { // last item
                         break;
                 }
                 if (j > 0) {
-                        printf(", ");
+                        out << ", ";
                 }
-                cout << "{"
+                out << "{"
                     "\"display_name\":" << std::quoted(device.options[j].display_name) << ", "
                     "\"display_desc\":" << std::quoted(device.options[j].display_desc) << ", "
                     "\"key\":" << std::quoted(device.options[j].key) << ", "
                     "\"opt_str\":" << std::quoted(device.options[j].opt_str) << ", "
                     "\"is_boolean\":\"" << (device.options[j].is_boolean ? "t" : "f") << "\"}";
         }
-        std::cout << "]";
+        out << "]";
 
-        std::cout << "}\n";
+        out << "}\n";
 }
 
+#define PROBE_CACHE_TTL_DEFAULT 30
+ADD_TO_PARAM("probe-cache-ttl", "* probe-cache-ttl=<s>\n"
+                "  Validity of cached device probe results used by the control socket \"devices\"\n"
+                "  query (default " TOSTRING(PROBE_CACHE_TTL_DEFAULT) " s, 0 disables the cache), on Linux the cache is\n"
+                "  also invalidated when a device node is added or removed.\n");
+
+/**
+ * @returns stamp that changes when a device is plugged or unplugged (Linux
+ * only - the directory mtime changes when a node is added or removed),
+ * empty if not available
+ */
+static string get_hotplug_stamp()
+{
+        string ret;
+#ifdef __linux__
+        for (const char *dir : { "/dev", "/dev/snd", "/dev/dri", "/dev/blackmagic" }) {
+                struct stat st{};
+                if (stat(dir, &st) == 0) {
+                        ret += to_string(st.st_mtim.tv_sec) + "." + to_string(st.st_mtim.tv_nsec) + " ";
+                }
+        }
+#endif
+        return ret;
+}
+
+/// formatted probe results of a module ("<purpose>:<module>" as a key)
+struct probe_cache_entry {
+        string lines;
+        time_ns_t probed;
+        string hotplug_stamp;
+};
+static mutex probe_cache_lock;
+static std::map<string, probe_cache_entry> probe_cache;
+
 template<typename T>
-static void probe_device(std::string_view cap_str, std::string const & name, const void *mod){
+static void probe_device(std::ostream &out, std::string_view cap_str, std::string const & name, const void *mod){
+        const string key = string(cap_str) + ":" + name;
+        const char *ttl_param = get_commandline_param("probe-cache-ttl");
+        const time_ns_t ttl = (ttl_param != nullptr ? atof(ttl_param) : PROBE_CACHE_TTL_DEFAULT) * NS_IN_SEC;
+        const string stamp = get_hotplug_stamp();
+        std::lock_guard<mutex> lk(probe_cache_lock); // serializes also the probes
+        auto it = probe_cache.find(key);
+        if (it != probe_cache.end() && get_time_in_ns() - it->second.probed < ttl &&
+                        it->second.hotplug_stamp == stamp) {
+                out << it->second.lines;
+                return;
+        }
+
         auto vdi = static_cast<T>(mod);
         int count = 0;
         struct device_info *devices = nullptr;
         void (*deleter)(void *) = nullptr;
         vdi->probe(&devices, &count, &deleter);
+        std::ostringstream oss;
         for (int i = 0; i < count; ++i) {
-                print_device(std::string(cap_str), name, devices[i]);
+                print_device(oss, std::string(cap_str), name, devices[i]);
         }
         deleter ? deleter(devices) : free(devices);
+        out << oss.str();
+        if (ttl > 0) {
+                probe_cache[key] = { oss.str(), get_time_in_ns(), stamp };
+        }
 }
 
-static void probe_compress(std::string const & name, const void *mod) noexcept {
+static void probe_compress(std::ostream &out, std::string const & name, const void *mod) noexcept {
         auto vci = static_cast<const struct video_compress_info *>(mod);
 
         if(vci->get_module_info){
                 auto module_info = vci->get_module_info();
-                cout << "[capability][video_compress] {"
+                out << "[capability][video_compress] {"
                         "\"name\":" << std::quoted(name) << ", "
                         "\"options\": [";
 
                 int i = 0;
                 for(const auto& opt : module_info.opts){
                         if(i++ > 0)
-                                cout << ", ";
+                                out << ", ";
 
-                        cout << "{"
+                        out << "{"
                                 "\"display_name\":" << std::quoted(opt.display_name) << ", "
                                 "\"display_desc\":" << std::quoted(opt.display_desc) << ", "
                                 "\"key\":" << std::quoted(opt.key) << ", "
@@ -673,30 +732,30 @@ static void probe_compress(std::string const & name, const void *mod) noexcept {
                                 "\"is_boolean\":\"" << (opt.is_boolean ? "t" : "f") << "\"}";
                 }
 
-                cout << "], "
+                out << "], "
                         "\"codecs\": [";
 
                 int j = 0;
                 for(const auto& c : module_info.codecs){
                         if(j++ > 0)
-                                cout << ", ";
+                                out << ", ";
 
-                        cout << "{\"name\":" << std::quoted(c.name) << ", "
+                        out << "{\"name\":" << std::quoted(c.name) << ", "
                                 "\"priority\": " << c.priority << ", "
                                 "\"encoders\":[";
 
                         int z = 0;
                         for(const auto& e : c.encoders){
                                 if(z++ > 0)
-                                        cout << ", ";
+                                        out << ", ";
 
-                                cout << "{\"name\":" << std::quoted(e.name) << ", "
+                                out << "{\"name\":" << std::quoted(e.name) << ", "
                                         "\"opt_str\":" << std::quoted(e.opt_str) << "}";
                         }
-                        cout << "]}";
+                        out << "]}";
                 }
 
-                cout << "]}" << std::endl;
+                out << "]}" << std::endl;
 
         }
 }
@@ -706,23 +765,23 @@ const static struct {
         std::string_view cap_str;
         enum library_class cls;
         int abi_ver;
-        void (*probe_print)(std::string name, const void *);
+        void (*probe_print)(std::ostream &out, std::string name, const void *);
 } mod_classes[] = {
         {"Compressions", "compress",
                 LIBRARY_CLASS_VIDEO_COMPRESS, VIDEO_COMPRESS_ABI_VERSION,
-                [](std::string name, const void *m) { probe_compress(name, m); }},
+                [](std::ostream &out, std::string name, const void *m) { probe_compress(out, name, m); }},
         {"Capture filters", "capture_filter",
                 LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION,
                 nullptr},
         {"Capturers", "capture",
                 LIBRARY_CLASS_VIDEO_CAPTURE, VIDEO_CAPTURE_ABI_VERSION,
-                [](std::string name, const void *m){ probe_device<const video_capture_info *>("capture", name, m); }},
+                [](std::ostream &out, std::string name, const void *m){ probe_device<const video_capture_info *>(out, "capture", name, m); }},
         {"Displays", "display",
                 LIBRARY_CLASS_VIDEO_DISPLAY, VIDEO_DISPLAY_ABI_VERSION,
-                [](std::string name, const void *m){ probe_device<const video_display_info *>("video_disp", name, m); }},
+                [](std::ostream &out, std::string name, const void *m){ probe_device<const video_display_info *>(out, "video_disp", name, m); }},
         {"Audio capturers", "audio_cap",
                 LIBRARY_CLASS_AUDIO_CAPTURE, AUDIO_CAPTURE_ABI_VERSION,
-                [](std::string name, const void *m){ probe_device<const audio_capture_info *>("audio_cap", name, m); }},
+                [](std::ostream &out, std::string name, const void *m){ probe_device<const audio_capture_info *>(out, "audio_cap", name, m); }},
         {"Audio filters", "audio_filter",
                 LIBRARY_CLASS_AUDIO_FILTER, AUDIO_FILTER_ABI_VERSION,
                 nullptr},
@@ -731,7 +790,7 @@ const static struct {
                 nullptr},
         {"Audio playback", "audio_play",
                 LIBRARY_CLASS_AUDIO_PLAYBACK, AUDIO_PLAYBACK_ABI_VERSION,
-                [](std::string name, const void *m){ probe_device<const audio_playback_info *>("audio_play", name, m); }},
+                [](std::ostream &out, std::string name, const void *m){ probe_device<const audio_playback_info *>(out, "audio_play", name, m); }},
 };
 
 
@@ -741,7 +800,7 @@ static void probe_all(std::map<enum library_class, module_info_map>& class_mod_m
                 for(const auto& mod : class_mod_map[mod_class.cls]){
                         if(!mod_class.probe_print)
                                 continue;
-                        mod_class.probe_print(mod.first, mod.second);
+                        mod_class.probe_print(cout, mod.first, mod.second);
                 }
         }
 }
@@ -782,7 +841,7 @@ void print_capabilities(const char *cfg)
                 auto mod_sv = tokenize(conf, ':');
 
                 enum library_class cls = LIBRARY_CLASS_UNDEFINED;
-                void (*probe_print)(std::string name, const void *) = nullptr;
+                void (*probe_print)(std::ostream &out, std::string name, const void *) = nullptr;
                 for(const auto& i : mod_classes){
                         if(i.cap_str == class_sv){
                                 cls = i.cls;
@@ -804,13 +863,47 @@ void print_capabilities(const char *cfg)
                 }
 
                 if(probe_print)
-                        probe_print(std::string(mod_sv), modinfo->second);
+                        probe_print(cout, std::string(mod_sv), modinfo->second);
 
         }
 
         cout << "[capability][end]" << endl;
 }
 
+/**
+ * Probes devices (classes with a probe function except compressions), the
+ * results are cached (see the probe-cache-ttl param) so that this can be
+ * polled eg. by the control socket "devices" query.
+ *
+ * @param cfg       empty for all classes, "<class>" or "<class>:<module>"
+ *                  (class as in --capabilities, eg. "capture")
+ * @param[out] out  "[capability][device]" lines
+ * @retval false    unknown class or module
+ */
+bool get_probed_devices(const char *cfg, std::string *out)
+{
+        std::string_view conf(cfg);
+        auto class_sv = tokenize(conf, ':');
+        auto mod_sv = tokenize(conf, ':');
+        std::ostringstream oss;
+        bool found = false;
+        for (const auto &mod_class : mod_classes) {
+                if (mod_class.probe_print == nullptr || mod_class.cls == LIBRARY_CLASS_VIDEO_COMPRESS ||
+                                (!class_sv.empty() && class_sv != mod_class.cap_str)) {
+                        continue;
+                }
+                for (const auto &mod : get_libraries_for_class(mod_class.cls, mod_class.abi_ver)) {
+                        if (!mod_sv.empty() && mod_sv != mod.first) {
+                                continue;
+                        }
+                        mod_class.probe_print(oss, mod.first, mod.second);
+                        found = true;
+                }
+        }
+        *out = oss.str();
+        return found;
+}
+
 const char *get_version_details()
 {
         return
@@ -864,6 +957,51 @@ void set_commandline_param(const char *key, const char *val)
         commandline_params[key] = val;
 }
 
+static thread_local unsigned int init_tile_index;
+
+void set_init_tile_index(unsigned int tile_idx)
+{
+        init_tile_index = tile_idx;
+}
+
+unsigned int get_init_tile_index(void)
+{
+        return init_tile_index;
+}
+
+ADD_TO_PARAM("tile-cuda-devices", "* tile-cuda-devices=<d0>[,<d1>...]\n"
+                "  CUDA device used by (de)compression of individual tiles (tile index modulo the list\n"
+                "  length), default is round-robin over --cuda-device with other devices being a fallback\n");
+unsigned int get_cuda_devices_for_tile(unsigned int tile_idx, unsigned int *devices)
+{
+        if (const char *map = get_commandline_param("tile-cuda-devices")) {
+                vector<unsigned int> assigned;
+                char *tmp = strdup(map);
+                char *save_ptr = nullptr;
+                char *item = tmp;
+                while ((item = strtok_r(item, ",", &save_ptr)) != nullptr) {
+                        char *endptr = nullptr;
+                        long dev = strtol(item, &endptr, 10);
+                        if (*endptr != '\0' || dev < 0) {
+                                log_msg(LOG_LEVEL_ERROR, "Wrong CUDA device in tile-cuda-devices: %s\n", item);
+                                assigned.clear();
+                                break;
+                        }
+                        assigned.push_back(dev);
+                        item = nullptr;
+                }
+                free(tmp);
+                if (!assigned.empty()) {
+                        devices[0] = assigned[tile_idx % assigned.size()];
+                        return 1;
+                }
+        }
+        for (unsigned int i = 0; i < cuda_devices_count; ++i) {
+                devices[i] = cuda_devices[(tile_idx + i) % cuda_devices_count];
+        }
+        return cuda_devices_count;
+}
+
 int get_audio_delay(void)
 {
         return audio_offset > 0 ? audio_offset : -video_offset;
@@ -1253,7 +1391,9 @@ ADD_TO_PARAM("color", "* color=CT\n"
                 "  [experimental] Color space to use, C - colorimetry: 0 - undefined, 1 - BT.709, 2 - BT.2020/2100, 3 - P3; T - transfer fn: 0 - undefined, 1 - 709, 2 - HLG; 3 - PQ (signalized to GLFW on mac, NDI receiver)\n");
 ADD_TO_PARAM("low-latency-audio", "* low-latency-audio[=ultra]\n"
                 "  Try to reduce audio latency at the expense of worse reliability\n"
-                "  Add ultra for even more aggressive setting.\n");
+                "  (small adaptive receiver buffer, real-time audio threads, 2 ms ALSA\n"
+                "  capture period, latency reported to control socket stats as ALATENCY)\n"
+                "  Add ultra for even more aggressive setting (1 ms period).\n");
 ADD_TO_PARAM("window-title", "* window-title=<title>\n"
                 "  Use alternative window title (SDL/GL only)\n");
 
@@ -98,6 +98,26 @@ extern unsigned int cuda_devices[];
 extern unsigned int cuda_devices_count;
 extern bool cuda_devices_explicit; ///< --cuda-device/-D specified expilcitly
 
+/**
+ * @name Per-tile CUDA device assignment
+ * Tiled video (eg. 8K as 4x4K) has a separate (de)compress state for every
+ * tile. The framework announces the tile index with set_init_tile_index()
+ * before initializing the state so that the module may pick the CUDA device
+ * with get_cuda_devices_for_tile(get_init_tile_index(), ...).
+ * @{
+ */
+void set_init_tile_index(unsigned int tile_idx);
+unsigned int get_init_tile_index(void);
+/**
+ * @param[out] devices  CUDA devices to be used for the tile in the order of
+ *                      preference, at least MAX_CUDA_DEVICES items
+ * @returns number of devices stored, 1 if the tile has a device explicitly
+ *          assigned by --param tile-cuda-devices, otherwise all cuda_devices
+ *          are returned, beginning with the one assigned round-robin
+ */
+unsigned int get_cuda_devices_for_tile(unsigned int tile_idx, unsigned int *devices);
+/// @}
+
 #define MODE_SENDER   (1U<<0U)
 #define MODE_RECEIVER (1U<<1U)
 
@@ -170,6 +190,7 @@ void hang_signal_handler(int sig);
 #include <string>
 #include <unordered_map>
 extern std::unordered_map<std::string, std::string> commandline_params;
+bool get_probed_devices(const char *cfg, std::string *out);
 #endif
 
 #define MERGE_(a,b)  a##b
@@ -18,6 +18,8 @@ struct drm_prime_frame{
         uint32_t offsets[4];
         uint64_t modifiers[4];
 
+        int in_fence_fd; ///< sync_file fence signalled when the buffer is ready for scanout, -1 if none (implicit sync)
+
         struct AVFrame *av_frame;
 };
 
@@ -129,6 +129,28 @@ hw_accel_to_ug_pixfmt(enum hw_accel_type type)
         return VIDEO_CODEC_NONE;
 }
 
+/**
+ * @returns true if the hw. decoded surfaces of given type can be passed in
+ * ugc without being downloaded (either natively or exported)
+ */
+bool
+hw_accel_can_output(enum hw_accel_type type, codec_t ugc)
+{
+        if (type == HWACCEL_NONE || ugc == VIDEO_CODEC_NONE) {
+                return false;
+        }
+        if (hw_accel_to_ug_pixfmt(type) == ugc) {
+                return true;
+        }
+#ifdef HWACC_VAAPI
+        // VAAPI surfaces are exported as dmabufs, see av_vaapi_to_ug_drm_prime()
+        if (type == HWACCEL_VAAPI && ugc == DRM_PRIME) {
+                return true;
+        }
+#endif
+        return false;
+}
+
 void hwaccel_state_init(struct hw_accel_state *hwaccel){
         hwaccel->type = HWACCEL_NONE;
         hwaccel->copy = false;
@@ -59,6 +59,7 @@ extern "C" {
 enum hw_accel_type hw_accel_from_pixfmt(enum AVPixelFormat);
 enum hw_accel_type hw_accel_from_str(const char *str);
 codec_t hw_accel_to_ug_pixfmt(enum hw_accel_type type);
+bool hw_accel_can_output(enum hw_accel_type type, codec_t ugc);
 const char *hw_accel_to_str(enum hw_accel_type type);
 
 /**
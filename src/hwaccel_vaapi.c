@@ -280,7 +280,6 @@ int vaapi_init(struct AVCodecContext *s,
                 struct hw_accel_state *state,
                 codec_t out_codec)
 {
-        (void)(out_codec);
         struct vaapi_ctx *ctx = calloc(1, sizeof(struct vaapi_ctx));
         if(!ctx){
                 return -1;
@@ -326,7 +325,8 @@ int vaapi_init(struct AVCodecContext *s,
                 goto fail;
         }
         state->type = HWACCEL_VAAPI;
-        state->copy = true;
+        // DRM_PRIME - surfaces are exported as dmabufs, see av_vaapi_to_ug_drm_prime()
+        state->copy = out_codec != DRM_PRIME;
         state->ctx = ctx;
         state->uninit = vaapi_uninit;
 
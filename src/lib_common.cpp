@@ -45,15 +45,25 @@
 #include <dlfcn.h>
 #include <glob.h>
 #include <libgen.h>
+#include <sys/stat.h>
 #endif
 
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #include "debug.h"
 #include "host.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/fs.h"
 
 #define MOD_NAME "[lib] "
 
@@ -173,49 +183,11 @@ static int running_from_path(char * uv_argv[]) {
 }
 #endif
 
-void open_all(const char *pattern, list<void *> &libs) {
-#ifdef BUILD_LIBRARIES
-        char path[512];
-        glob_t glob_buf;
-
-        /* binary not from $PATH */
-        if (!running_from_path(uv_argv)) {
-                char *tmp = strdup(uv_argv[0]);
-                char *dir = dirname(tmp);
-                snprintf(path, sizeof(path), "%s/../lib/ultragrid/%s", dir, pattern);
-                free(tmp);
-        } else {
-                snprintf(path, sizeof(path), LIB_DIR "/ultragrid/%s", pattern);
-        }
-
-        glob(path, 0, NULL, &glob_buf);
-
-        for(unsigned int i = 0; i < glob_buf.gl_pathc; ++i) {
-                void *handle = dlopen(glob_buf.gl_pathv[i], RTLD_NOW|RTLD_GLOBAL);
-                if (!handle) {
-                        char *error = dlerror();
-                        MSG(WARNING, "Library %s opening warning: %s \n",
-                            glob_buf.gl_pathv[i], error);
-                        char *filename = basename(glob_buf.gl_pathv[i]);
-                        if (filename && error) {
-                                lib_errors.emplace(filename, error);
-                        }
-                        continue;
-                }
-                libs.push_back(handle);
-        }
-
-        globfree(&glob_buf);
-#else
-        UNUSED(libs);
-        UNUSED(pattern);
-#endif
-}
-
 struct lib_info {
         const void *data;
         int abi_version;
         bool hidden;
+        string path; ///< (lazy) module file, empty for a statically linked module
 };
 
 // http://stackoverflow.com/questions/1801892/making-mapfind-operation-case-insensitive
@@ -247,20 +219,361 @@ static auto& get_libmap(){
         return libraries;
 }
 
+/// protects the libmap since modules may be loaded lazily from multiple threads
+static recursive_mutex libmap_lock;
+
+#ifdef BUILD_LIBRARIES
+#define MODULE_REGISTRY_FILE "ultragrid_modules.cache"
+#define MODULE_REGISTRY_VERSION 1
+ADD_TO_PARAM("module-registry", "* module-registry=no|<file>\n"
+                "  Module registry (cache of module file to module names mapping) that allows\n"
+                "  loading modules only on demand. It is used from the module directory\n"
+                "  (" MODULE_REGISTRY_FILE ", may be generated on install by running uv --list-modules)\n"
+                "  or from the user cache directory, where it is created on the first run. It is\n"
+                "  regenerated when the modules or the executable change. \"no\" loads all modules.\n");
+
+static const char *loading_file; ///< file being dlopen()ed, for register_library()
+static list<void *> *opened_libs;
+static set<string> failed_files; ///< files not loadable when the used registry was written
+
+struct module_file {
+        long long mtime;
+        long long size;
+        bool operator==(const module_file &o) const { return mtime == o.mtime && size == o.size; }
+};
+
+/// stamp of the running executable to invalidate the registry after rebuild
+static string get_exec_stamp()
+{
+        char path[MAX_PATH_SIZE];
+        struct stat st{};
+        if (!get_exec_path(path) || stat(path, &st) != 0) {
+                return {};
+        }
+        return to_string((long long) st.st_mtime) + " " + to_string((long long) st.st_size);
+}
+
+static vector<string> get_registry_paths(const char *module_dir)
+{
+        if (const char *req = get_commandline_param("module-registry")) {
+                return { req };
+        }
+        vector<string> ret{ string(module_dir) + "/" MODULE_REGISTRY_FILE };
+        if (const char *cache = getenv("XDG_CACHE_HOME")) {
+                ret.push_back(string(cache) + "/ultragrid/" MODULE_REGISTRY_FILE);
+        } else if (const char *home = getenv("HOME")) {
+                ret.push_back(string(home) + "/.cache/ultragrid/" MODULE_REGISTRY_FILE);
+        }
+        return ret;
+}
+
+/**
+ * Registry format (text, one item per line):
+ * - header: "UG-modules <version> <exec_stamp>"
+ * - "F <mtime> <size> <path>" - module file
+ * - "E <dlopen error>" - the preceding file cannot be loaded
+ * - "M <class> <abi> <hidden> <name>" - module registered by the preceding file
+ *
+ * @retval true if the registry matches files and the modules were registered
+ *              as lazy entries
+ */
+static bool read_registry(const string &filename, const map<string, module_file> &files)
+{
+        ifstream in(filename);
+        string line;
+        if (!getline(in, line) || line != "UG-modules " + to_string(MODULE_REGISTRY_VERSION)
+                        + " " + get_exec_stamp()) {
+                return false;
+        }
+        map<string, module_file> reg_files;
+        struct lazy_module {
+                int cls, abi, hidden;
+                string name, path;
+        };
+        vector<lazy_module> modules;
+        map<string, string> errors;
+        string cur_path;
+        while (getline(in, line)) {
+                istringstream iss(line);
+                char type = 0;
+                iss >> type;
+                if (type == 'F') {
+                        module_file f{};
+                        iss >> f.mtime >> f.size;
+                        iss.ignore(1);
+                        getline(iss, cur_path);
+                        reg_files[cur_path] = f;
+                } else if (type == 'E') {
+                        iss.ignore(1);
+                        getline(iss, errors[cur_path]);
+                } else if (type == 'M') {
+                        lazy_module m{};
+                        iss >> m.cls >> m.abi >> m.hidden >> m.name;
+                        m.path = cur_path;
+                        modules.push_back(m);
+                } else {
+                        return false;
+                }
+                if (!iss && !iss.eof()) {
+                        return false;
+                }
+        }
+        if (reg_files != files) {
+                MSG(VERBOSE, "Module registry %s is outdated.\n", filename.c_str());
+                return false;
+        }
+        auto &libmap = get_libmap();
+        for (auto &m : modules) {
+                auto &cls_map = libmap[(enum library_class) m.cls];
+                if (cls_map.find(m.name) == cls_map.end()) {
+                        cls_map[m.name] = { nullptr, m.abi, m.hidden != 0, m.path };
+                }
+        }
+        for (auto &e : errors) {
+                char *tmp = strdup(e.first.c_str());
+                lib_errors.emplace(basename(tmp), e.second);
+                free(tmp);
+                failed_files.insert(e.first);
+        }
+        MSG(VERBOSE, "Using module registry %s (%zu modules).\n", filename.c_str(), modules.size());
+        return true;
+}
+
+static void write_registry(const vector<string> &filenames, const map<string, module_file> &files,
+                const map<string, string> &errors)
+{
+        ostringstream oss;
+        oss << "UG-modules " << MODULE_REGISTRY_VERSION << " " << get_exec_stamp() << "\n";
+        for (auto &f : files) {
+                oss << "F " << f.second.mtime << " " << f.second.size << " " << f.first << "\n";
+                if (auto it = errors.find(f.first); it != errors.end()) {
+                        string err = it->second;
+                        replace(err.begin(), err.end(), '\n', ' ');
+                        oss << "E " << err << "\n";
+                }
+                for (auto &cls : get_libmap()) {
+                        for (auto &mod : cls.second) {
+                                if (mod.second.path == f.first) {
+                                        oss << "M " << cls.first << " " << mod.second.abi_version << " "
+                                                << mod.second.hidden << " " << mod.first << "\n";
+                                }
+                        }
+                }
+        }
+        for (auto &filename : filenames) {
+                char *tmp = strdup(filename.c_str());
+                string dir = dirname(tmp);
+                free(tmp);
+                if (filename != filenames.at(0) && mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+                        continue;
+                }
+                string tmp_name = filename + "." + to_string(getpid());
+                ofstream out(tmp_name);
+                if (!(out << oss.str()) || (out.close(), !out) || rename(tmp_name.c_str(), filename.c_str()) != 0) {
+                        unlink(tmp_name.c_str());
+                        continue;
+                }
+                MSG(VERBOSE, "Module registry written to %s.\n", filename.c_str());
+                return;
+        }
+        MSG(VERBOSE, "Cannot write module registry.\n");
+}
+
+/**
+ * dlopen()s the module file, the modules are registered by its constructors
+ * @param lazy_bind the file was already successfully loaded with RTLD_NOW when
+ *                  the registry was written, so lazy binding is safe
+ */
+static bool open_module_file(const char *path, bool lazy_bind, map<string, string> *errors)
+{
+        loading_file = path;
+        void *handle = dlopen(path, (lazy_bind ? RTLD_LAZY : RTLD_NOW) | RTLD_GLOBAL);
+        loading_file = nullptr;
+        if (!handle) {
+                char *error = dlerror();
+                MSG(WARNING, "Library %s opening warning: %s \n", path, error);
+                char *tmp = strdup(path);
+                char *filename = basename(tmp);
+                if (filename && error) {
+                        lib_errors[filename] = error;
+                        if (errors != nullptr) {
+                                (*errors)[path] = error;
+                        }
+                }
+                free(tmp);
+                return false;
+        }
+        opened_libs->push_back(handle);
+        return true;
+}
+
+/**
+ * Loads the file of a lazy registry entry (and thus all modules in it).
+ * @note libmap_lock must be held
+ */
+static void load_lazy(const string &path)
+{
+        bool ok = open_module_file(path.c_str(), true, nullptr);
+        // remove entries that were not registered (failed load or runtime condition)
+        for (auto &cls : get_libmap()) {
+                for (auto it = cls.second.begin(); it != cls.second.end();) {
+                        if (it->second.data == nullptr && it->second.path == path) {
+                                if (ok) {
+                                        MSG(VERBOSE, "Module %s not registered by %s.\n",
+                                            it->first.c_str(), path.c_str());
+                                }
+                                it = cls.second.erase(it);
+                        } else {
+                                ++it;
+                        }
+                }
+        }
+}
+
+/**
+ * Retries loading a file that failed when the registry was written (the
+ * dependencies may have been installed since).
+ * @param filename file basename, nullptr for all failed files
+ * @retval true a file was loaded
+ * @note libmap_lock must be held
+ */
+static bool retry_failed(const char *filename)
+{
+        bool loaded = false;
+        for (auto it = failed_files.begin(); it != failed_files.end();) {
+                char *tmp = strdup(it->c_str());
+                const bool match = filename == nullptr || strcmp(basename(tmp), filename) == 0;
+                free(tmp);
+                if (!match) {
+                        ++it;
+                        continue;
+                }
+                if (open_module_file(it->c_str(), false, nullptr)) {
+                        char *tmp = strdup(it->c_str());
+                        lib_errors.erase(basename(tmp));
+                        free(tmp);
+                        loaded = true;
+                }
+                it = failed_files.erase(it);
+        }
+        return loaded;
+}
+
+/**
+ * loads all lazy entries of class cls (all classes if cls is nullptr)
+ * @note libmap_lock must be held
+ */
+static void load_lazy_all(const enum library_class *cls)
+{
+        set<string> paths;
+        for (auto &c : get_libmap()) {
+                if (cls != nullptr && c.first != *cls) {
+                        continue;
+                }
+                for (auto &mod : c.second) {
+                        if (mod.second.data == nullptr) {
+                                paths.insert(mod.second.path);
+                        }
+                }
+        }
+        for (auto &path : paths) {
+                load_lazy(path);
+        }
+        if (cls == nullptr) {
+                retry_failed(nullptr);
+        }
+}
+#endif // defined BUILD_LIBRARIES
+
+/**
+ * Loads the modules matching pattern. If a valid module registry exists, the
+ * modules are only registered and loaded when first requested by
+ * load_library() (or get_libraries_for_class()), otherwise all modules are
+ * loaded and the registry is written.
+ */
+void open_all(const char *pattern, list<void *> &libs) {
+#ifdef BUILD_LIBRARIES
+        char path[512];
+        glob_t glob_buf;
+
+        /* binary not from $PATH */
+        if (!running_from_path(uv_argv)) {
+                char *tmp = strdup(uv_argv[0]);
+                char *dir = dirname(tmp);
+                snprintf(path, sizeof(path), "%s/../lib/ultragrid/%s", dir, pattern);
+                free(tmp);
+        } else {
+                snprintf(path, sizeof(path), LIB_DIR "/ultragrid/%s", pattern);
+        }
+
+        glob(path, 0, NULL, &glob_buf);
+
+        map<string, module_file> files;
+        for(unsigned int i = 0; i < glob_buf.gl_pathc; ++i) {
+                struct stat st{};
+                if (stat(glob_buf.gl_pathv[i], &st) == 0) {
+                        files[glob_buf.gl_pathv[i]] = { (long long) st.st_mtime, (long long) st.st_size };
+                }
+        }
+        globfree(&glob_buf);
+
+        lock_guard<recursive_mutex> lk(libmap_lock);
+        opened_libs = &libs;
+        const char *req = get_commandline_param("module-registry");
+        const bool use_registry = req == nullptr || strcmp(req, "no") != 0;
+        char *tmp = strdup(path);
+        const vector<string> registry_paths = get_registry_paths(dirname(tmp));
+        free(tmp);
+        if (use_registry) {
+                for (auto &registry : registry_paths) {
+                        if (read_registry(registry, files)) {
+                                return;
+                        }
+                }
+        }
+
+        map<string, string> errors;
+        for (auto &f : files) {
+                open_module_file(f.first.c_str(), false, &errors);
+        }
+        if (use_registry) {
+                write_registry(registry_paths, files, errors);
+        }
+#else
+        UNUSED(libs);
+        UNUSED(pattern);
+#endif
+}
+
 void register_library(const char *name, const void *data, enum library_class cls, int abi_version, int hidden)
 {
+        lock_guard<recursive_mutex> lk(libmap_lock);
         auto& map = get_libmap()[cls];
-        if (map.find(name) != map.end()) {
+        auto it = map.find(name);
+        if (it != map.end() && it->second.data != nullptr) {
                 LOG(LOG_LEVEL_ERROR) << "Module \"" << name << "\" (class " << cls << ") multiple initialization!\n";
         }
-        map[name] = {data, abi_version, static_cast<bool>(hidden)};
+        string path;
+#ifdef BUILD_LIBRARIES
+        if (loading_file != nullptr) {
+                path = loading_file;
+        }
+#endif
+        map[name] = {data, abi_version, static_cast<bool>(hidden), path};
 }
 
 const void *load_library(const char *name, enum library_class cls, int abi_version)
 {
+        lock_guard<recursive_mutex> lk(libmap_lock);
         auto it_cls = get_libmap().find(cls);
         if (it_cls != get_libmap().end()) {
                 auto it_module = it_cls->second.find(name);
+#ifdef BUILD_LIBRARIES
+                if (it_module != it_cls->second.end() && it_module->second.data == nullptr) {
+                        load_lazy(string(it_module->second.path)); // copy - the entry may be erased
+                        it_module = it_cls->second.find(name);
+                }
+#endif
                 if (it_module != it_cls->second.end()) {
                         const auto& mod_pair = it_module->second;
                         if (mod_pair.abi_version == abi_version) {
@@ -282,6 +595,11 @@ const void *load_library(const char *name, enum library_class cls, int abi_versi
                 }
 
                 filename += name + string(".so");
+#ifdef BUILD_LIBRARIES
+                if (retry_failed(filename.c_str())) {
+                        return load_library(name, cls, abi_version);
+                }
+#endif
 
                 if (lib_errors.find(filename) != lib_errors.end()) {
                         LOG(LOG_LEVEL_WARNING) << filename << ": " << lib_errors.find(filename)->second << "\n";
@@ -308,6 +626,10 @@ void list_modules(enum library_class cls, int abi_version, bool full) {
 bool list_all_modules() {
         bool ret = true;
 
+        lock_guard<recursive_mutex> lk(libmap_lock);
+#ifdef BUILD_LIBRARIES
+        load_lazy_all(nullptr);
+#endif
         auto& libraries = get_libmap();
         for (auto cls_it = library_class_info.begin(); cls_it != library_class_info.end();
                         ++cls_it) {
@@ -336,6 +658,10 @@ bool list_all_modules() {
 map<string, const void *> get_libraries_for_class(enum library_class cls, int abi_version, bool include_hidden)
 {
         map<string, const void *> ret;
+        lock_guard<recursive_mutex> lk(libmap_lock);
+#ifdef BUILD_LIBRARIES
+        load_lazy_all(&cls);
+#endif
         auto& libraries = get_libmap();
         auto it = libraries.find(cls);
         if (it != libraries.end()) {
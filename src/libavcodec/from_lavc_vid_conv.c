@@ -46,6 +46,7 @@
 
 #include <assert.h>
 #include <libavutil/pixfmt.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/hwcontext_drm.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -65,9 +66,22 @@
 #include "utils/worker.h" // task_run_parallel
 #include "video.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #ifdef __SSE3__
 #include "pmmintrin.h"
 #endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+#if defined __ARM_NEON && defined __aarch64__
+#include <arm_neon.h>
+#define HAVE_NEON_CONV 1
+#endif
 
 #define MOD_NAME "[from_lavc_vid_conv] "
 
@@ -99,7 +113,17 @@ static void nv12_to_uyvy(char * __restrict dst_buffer, AVFrame * __restrict in_f
                 char *src_cbcr = (char *) in_frame->data[1] + in_frame->linesize[1] * (y / 2);
                 char *dst = dst_buffer + pitch * y;
 
-                OPTIMIZED_FOR (int x = 0; x < width / 2; ++x) {
+                int x = 0;
+#ifdef HAVE_NEON_CONV
+                for ( ; x + 8 <= width / 2; x += 8) { // 16 pixels
+                        uint8x16x2_t uyvy = { { vld1q_u8((uint8_t *) src_cbcr), vld1q_u8((uint8_t *) src_y) } };
+                        vst2q_u8((uint8_t *) dst, uyvy);
+                        src_cbcr += 16;
+                        src_y += 16;
+                        dst += 32;
+                }
+#endif
+                OPTIMIZED_FOR ( ; x < width / 2; ++x) {
                         *dst++ = *src_cbcr++;
                         *dst++ = *src_y++;
                         *dst++ = *src_cbcr++;
@@ -1739,7 +1763,41 @@ static void p010le_to_v210(char * __restrict dst_buffer, AVFrame * __restrict in
                 uint32_t *dst1 = (uint32_t *)(void *)(dst_buffer + (y * 2) * pitch);
                 uint32_t *dst2 = (uint32_t *)(void *)(dst_buffer + (y * 2 + 1) * pitch);
 
-                OPTIMIZED_FOR (int x = 0; x < width / 6; ++x) {
+                int x = 0;
+#ifdef __SSSE3__
+                // 6 pixels (4 v210 words) per iteration, 8 samples loaded
+                const __m128i a_c = _mm_setr_epi8(0, 1, -1, -1, -1, -1, -1, -1, 6, 7, -1, -1, -1, -1, -1, -1);
+                const __m128i a_y = _mm_setr_epi8(-1, -1, -1, -1, 2, 3, -1, -1, -1, -1, -1, -1, 8, 9, -1, -1);
+                const __m128i b_c = _mm_setr_epi8(-1, -1, -1, -1, 4, 5, -1, -1, -1, -1, -1, -1, 10, 11, -1, -1);
+                const __m128i b_y = a_c;
+                const __m128i c_c = _mm_setr_epi8(2, 3, -1, -1, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1, -1, -1);
+                const __m128i c_y = b_c;
+                for ( ; x + 8 <= width; x += 6) {
+                        const __m128i cbcr = _mm_loadu_si128((const __m128i *)(const void *) src_cbcr);
+                        const __m128i ca = _mm_shuffle_epi8(cbcr, a_c);
+                        const __m128i cb = _mm_shuffle_epi8(cbcr, b_c);
+                        const __m128i cc = _mm_shuffle_epi8(cbcr, c_c);
+#define P010_TO_V210_LINE(src_y, dst) do { \
+                        const __m128i luma = _mm_loadu_si128((const __m128i *)(const void *) (src_y)); \
+                        const __m128i a = _mm_or_si128(ca, _mm_shuffle_epi8(luma, a_y)); \
+                        const __m128i b = _mm_or_si128(cb, _mm_shuffle_epi8(luma, b_y)); \
+                        const __m128i c = _mm_or_si128(cc, _mm_shuffle_epi8(luma, c_y)); \
+                        __m128i w = _mm_srli_epi32(a, 6); \
+                        w = _mm_or_si128(w, _mm_slli_epi32(_mm_srli_epi32(b, 6), 10)); \
+                        w = _mm_or_si128(w, _mm_slli_epi32(_mm_srli_epi32(c, 6), 20)); \
+                        _mm_storeu_si128((__m128i *)(void *) (dst), w); \
+                } while (0)
+                        P010_TO_V210_LINE(src_y1, dst1);
+                        P010_TO_V210_LINE(src_y2, dst2);
+#undef P010_TO_V210_LINE
+                        src_cbcr += 6;
+                        src_y1 += 6;
+                        src_y2 += 6;
+                        dst1 += 4;
+                        dst2 += 4;
+                }
+#endif
+                OPTIMIZED_FOR ( ; x + 6 <= width; x += 6) {
                         uint32_t w0_0, w0_1, w0_2, w0_3;
                         uint32_t w1_0, w1_1, w1_2, w1_3;
 
@@ -1801,7 +1859,25 @@ static void p010le_to_uyvy(char * __restrict dst_buffer, AVFrame * __restrict in
                 uint8_t *dst1 = (uint8_t *)(void *)(dst_buffer + (y * 2) * pitch);
                 uint8_t *dst2 = (uint8_t *)(void *)(dst_buffer + (y * 2 + 1) * pitch);
 
-                OPTIMIZED_FOR (int x = 0; x < width / 2; ++x) {
+                int x = 0;
+#ifdef HAVE_NEON_CONV
+                for ( ; x + 8 <= width / 2; x += 8) { // 16 pixels
+                        uint8x16_t cbcr = vcombine_u8(vshrn_n_u16(vld1q_u16(src_cbcr), 8),
+                                        vshrn_n_u16(vld1q_u16(src_cbcr + 8), 8));
+                        uint8x16x2_t uyvy1 = { { cbcr, vcombine_u8(vshrn_n_u16(vld1q_u16(src_y1), 8),
+                                        vshrn_n_u16(vld1q_u16(src_y1 + 8), 8)) } };
+                        uint8x16x2_t uyvy2 = { { cbcr, vcombine_u8(vshrn_n_u16(vld1q_u16(src_y2), 8),
+                                        vshrn_n_u16(vld1q_u16(src_y2 + 8), 8)) } };
+                        vst2q_u8(dst1, uyvy1);
+                        vst2q_u8(dst2, uyvy2);
+                        src_cbcr += 16;
+                        src_y1 += 16;
+                        src_y2 += 16;
+                        dst1 += 32;
+                        dst2 += 32;
+                }
+#endif
+                OPTIMIZED_FOR ( ; x < width / 2; ++x) {
                         uint8_t tmp;
                         // U
                         tmp = *src_cbcr++ >> 8;
@@ -1821,6 +1897,141 @@ static void p010le_to_uyvy(char * __restrict dst_buffer, AVFrame * __restrict in
         }
 }
 
+static void p010le_to_y216(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
+                int width, int height, int pitch, const int * __restrict rgb_shift)
+{
+        UNUSED(rgb_shift);
+        assert((uintptr_t) in_frame->data[0] % 2 == 0);
+        assert((uintptr_t) in_frame->data[1] % 2 == 0);
+        assert((uintptr_t) dst_buffer % 2 == 0 && pitch % 2 == 0);
+        for(int y = 0; y < height / 2; ++y) {
+                uint16_t *src_y1 = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y * 2);
+                uint16_t *src_y2 = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * (y * 2 + 1));
+                uint16_t *src_cbcr = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
+                uint16_t *dst1 = (uint16_t *)(void *)(dst_buffer + (y * 2) * pitch);
+                uint16_t *dst2 = (uint16_t *)(void *)(dst_buffer + (y * 2 + 1) * pitch);
+
+                int x = 0;
+#ifdef __SSE2__
+                for ( ; x + 8 <= width; x += 8) {
+                        const __m128i cbcr = _mm_loadu_si128((const __m128i *)(const void *) src_cbcr);
+                        const __m128i y1 = _mm_loadu_si128((const __m128i *)(const void *) src_y1);
+                        const __m128i y2 = _mm_loadu_si128((const __m128i *)(const void *) src_y2);
+                        _mm_storeu_si128((__m128i *)(void *) dst1, _mm_unpacklo_epi16(y1, cbcr));
+                        _mm_storeu_si128((__m128i *)(void *) (dst1 + 8), _mm_unpackhi_epi16(y1, cbcr));
+                        _mm_storeu_si128((__m128i *)(void *) dst2, _mm_unpacklo_epi16(y2, cbcr));
+                        _mm_storeu_si128((__m128i *)(void *) (dst2 + 8), _mm_unpackhi_epi16(y2, cbcr));
+                        src_cbcr += 8;
+                        src_y1 += 8;
+                        src_y2 += 8;
+                        dst1 += 16;
+                        dst2 += 16;
+                }
+#endif
+                OPTIMIZED_FOR ( ; x + 2 <= width; x += 2) {
+                        *dst1++ = *src_y1++;
+                        *dst2++ = *src_y2++;
+                        *dst1++ = *src_cbcr;
+                        *dst2++ = *src_cbcr++;
+                        *dst1++ = *src_y1++;
+                        *dst2++ = *src_y2++;
+                        *dst1++ = *src_cbcr;
+                        *dst2++ = *src_cbcr++;
+                }
+        }
+}
+
+/// @param y 10-bit luma; cb, cr - 10-bit chroma with subtracted offset
+static inline void p010_pixel_to_r10k(unsigned char *dst, comp_type_t y, comp_type_t cb, comp_type_t cr)
+{
+        y = Y_SCALE * (y - (1<<6));
+        comp_type_t r = YCBCR_TO_R_709_SCALED(y, cb, cr) >> COMP_BASE;
+        comp_type_t g = YCBCR_TO_G_709_SCALED(y, cb, cr) >> COMP_BASE;
+        comp_type_t b = YCBCR_TO_B_709_SCALED(y, cb, cr) >> COMP_BASE;
+        r = CLAMP_FULL(r, 10);
+        g = CLAMP_FULL(g, 10);
+        b = CLAMP_FULL(b, 10);
+        dst[0] = r >> 2;
+        dst[1] = (r & 0x3) << 6 | g >> 4;
+        dst[2] = (g & 0xF) << 4 | b >> 6;
+        dst[3] = (b & 0x3F) << 2 | 0x3U;
+}
+
+#ifdef __SSE4_1__
+/// SIMD variant of p010_pixel_to_r10k() for 4 pixels, chroma terms are precomputed
+static inline __m128i p010_to_r10k_sse(__m128i y, __m128i r_c, __m128i g_c, __m128i b_c)
+{
+        const __m128i foot = _mm_set1_epi32(FULL_FOOT(10));
+        const __m128i head = _mm_set1_epi32(FULL_HEAD(10));
+        y = _mm_mullo_epi32(_mm_sub_epi32(y, _mm_set1_epi32(1<<6)), _mm_set1_epi32(Y_SCALE));
+        __m128i r = _mm_srai_epi32(_mm_add_epi32(y, r_c), COMP_BASE);
+        __m128i g = _mm_srai_epi32(_mm_add_epi32(y, g_c), COMP_BASE);
+        __m128i b = _mm_srai_epi32(_mm_add_epi32(y, b_c), COMP_BASE);
+        r = _mm_min_epi32(_mm_max_epi32(r, foot), head);
+        g = _mm_min_epi32(_mm_max_epi32(g, foot), head);
+        b = _mm_min_epi32(_mm_max_epi32(b, foot), head);
+        // bytes: R9-R2 | R1-R0 G9-G4 | G3-G0 B9-B6 | B5-B0 11
+        __m128i w = _mm_srli_epi32(r, 2);
+        w = _mm_or_si128(w, _mm_slli_epi32(_mm_and_si128(r, _mm_set1_epi32(0x3)), 14));
+        w = _mm_or_si128(w, _mm_slli_epi32(_mm_srli_epi32(g, 4), 8));
+        w = _mm_or_si128(w, _mm_slli_epi32(_mm_and_si128(g, _mm_set1_epi32(0xF)), 20));
+        w = _mm_or_si128(w, _mm_slli_epi32(_mm_srli_epi32(b, 6), 16));
+        w = _mm_or_si128(w, _mm_slli_epi32(_mm_and_si128(b, _mm_set1_epi32(0x3F)), 26));
+        return _mm_or_si128(w, _mm_set1_epi32(0x03000000));
+}
+#endif
+
+static void p010le_to_r10k(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
+                int width, int height, int pitch, const int * __restrict rgb_shift)
+{
+        UNUSED(rgb_shift);
+        assert((uintptr_t) in_frame->data[0] % 2 == 0);
+        assert((uintptr_t) in_frame->data[1] % 2 == 0);
+        for(int y = 0; y < height / 2; ++y) {
+                uint16_t *src_y1 = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y * 2);
+                uint16_t *src_y2 = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * (y * 2 + 1));
+                uint16_t *src_cbcr = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
+                unsigned char *dst1 = (unsigned char *) dst_buffer + (y * 2) * pitch;
+                unsigned char *dst2 = (unsigned char *) dst_buffer + (y * 2 + 1) * pitch;
+
+                int x = 0;
+#ifdef __SSE4_1__
+                const __m128i cb_sel[2] = {
+                        _mm_setr_epi8(0, 1, -1, -1, 0, 1, -1, -1, 4, 5, -1, -1, 4, 5, -1, -1),
+                        _mm_setr_epi8(8, 9, -1, -1, 8, 9, -1, -1, 12, 13, -1, -1, 12, 13, -1, -1),
+                };
+                const __m128i cr_sel[2] = {
+                        _mm_setr_epi8(2, 3, -1, -1, 2, 3, -1, -1, 6, 7, -1, -1, 6, 7, -1, -1),
+                        _mm_setr_epi8(10, 11, -1, -1, 10, 11, -1, -1, 14, 15, -1, -1, 14, 15, -1, -1),
+                };
+                const __m128i c_off = _mm_set1_epi32(1<<9);
+                for ( ; x + 8 <= width; x += 8) { // 8 pixels of both lines sharing chroma
+                        const __m128i cbcr = _mm_srli_epi16(_mm_loadu_si128((const __m128i *)(const void *) (src_cbcr + x)), 6);
+                        const __m128i y1 = _mm_srli_epi16(_mm_loadu_si128((const __m128i *)(const void *) (src_y1 + x)), 6);
+                        const __m128i y2 = _mm_srli_epi16(_mm_loadu_si128((const __m128i *)(const void *) (src_y2 + x)), 6);
+                        for (int i = 0; i < 2; ++i) {
+                                const __m128i cb = _mm_sub_epi32(_mm_shuffle_epi8(cbcr, cb_sel[i]), c_off);
+                                const __m128i cr = _mm_sub_epi32(_mm_shuffle_epi8(cbcr, cr_sel[i]), c_off);
+                                const __m128i r_c = _mm_mullo_epi32(cr, _mm_set1_epi32(SCALED(R_CR(KR_709, KB_709))));
+                                const __m128i g_c = _mm_add_epi32(_mm_mullo_epi32(cb, _mm_set1_epi32(SCALED(G_CB(KR_709, KB_709)))),
+                                                _mm_mullo_epi32(cr, _mm_set1_epi32(SCALED(G_CR(KR_709, KB_709)))));
+                                const __m128i b_c = _mm_mullo_epi32(cb, _mm_set1_epi32(SCALED(B_CB(KR_709, KB_709))));
+                                const __m128i y1_32 = _mm_cvtepu16_epi32(i == 0 ? y1 : _mm_srli_si128(y1, 8));
+                                const __m128i y2_32 = _mm_cvtepu16_epi32(i == 0 ? y2 : _mm_srli_si128(y2, 8));
+                                _mm_storeu_si128((__m128i *)(void *) (dst1 + 4 * x + 16 * i), p010_to_r10k_sse(y1_32, r_c, g_c, b_c));
+                                _mm_storeu_si128((__m128i *)(void *) (dst2 + 4 * x + 16 * i), p010_to_r10k_sse(y2_32, r_c, g_c, b_c));
+                        }
+                }
+#endif
+                OPTIMIZED_FOR ( ; x < width; ++x) {
+                        const comp_type_t cb = (src_cbcr[x / 2 * 2] >> 6) - (1<<9);
+                        const comp_type_t cr = (src_cbcr[x / 2 * 2 + 1] >> 6) - (1<<9);
+                        p010_pixel_to_r10k(dst1 + 4 * (ptrdiff_t) x, src_y1[x] >> 6, cb, cr);
+                        p010_pixel_to_r10k(dst2 + 4 * (ptrdiff_t) x, src_y2[x] >> 6, cb, cr);
+                }
+        }
+}
+
 #if P210_PRESENT
 static void p210le_to_uyvy(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
                 int width, int height, int pitch, const int * __restrict rgb_shift)
@@ -2044,11 +2255,45 @@ static void hw_drm_recycle_callback(struct video_frame *frame){
                 struct drm_prime_frame *drm_frame = (struct drm_prime_frame *)(void *) frame->tiles[i].data;
                 av_frame_free(&drm_frame->av_frame);
                 memset(drm_frame, 0, sizeof(struct drm_prime_frame));
+                drm_frame->in_fence_fd = -1;
         }
 
         frame->callbacks.recycle = NULL;
 }
 
+#ifndef DRM_FORMAT_NV12 // not to depend on libdrm headers (drm_fourcc.h)
+#define DRM_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | \
+                ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+#define DRM_FORMAT_R8     DRM_FOURCC('R', '8', ' ', ' ')
+#define DRM_FORMAT_R16    DRM_FOURCC('R', '1', '6', ' ')
+#define DRM_FORMAT_GR88   DRM_FOURCC('G', 'R', '8', '8')
+#define DRM_FORMAT_GR1616 DRM_FOURCC('G', 'R', '3', '2')
+#define DRM_FORMAT_NV12   DRM_FOURCC('N', 'V', '1', '2')
+#define DRM_FORMAT_P010   DRM_FOURCC('P', '0', '1', '0')
+#endif
+
+/**
+ * VAAPI exports planes as separate layers (eg. R8 + GR88 for NV12),
+ * the framebuffer needs the format of the whole frame.
+ */
+static uint32_t drm_format_from_layers(const AVDRMFrameDescriptor *desc)
+{
+        if (desc->nb_layers == 1) {
+                return desc->layers[0].format;
+        }
+        if (desc->nb_layers == 2) {
+                const uint32_t y = desc->layers[0].format;
+                const uint32_t uv = desc->layers[1].format;
+                if (y == DRM_FORMAT_R8 && uv == DRM_FORMAT_GR88) {
+                        return DRM_FORMAT_NV12;
+                }
+                if (y == DRM_FORMAT_R16 && uv == DRM_FORMAT_GR1616) {
+                        return DRM_FORMAT_P010;
+                }
+        }
+        return 0;
+}
+
 static void av_drm_prime_to_ug_drm_prime(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
                 int width, int height, int pitch, const int * __restrict rgb_shift)
 {
@@ -2061,11 +2306,16 @@ static void av_drm_prime_to_ug_drm_prime(char * __restrict dst_buffer, AVFrame *
 
         struct drm_prime_frame *out = (struct drm_prime_frame *)(void *) dst_buffer;
         memset(out, 0, sizeof(struct drm_prime_frame));
+        out->in_fence_fd = -1;
 
 
         AVDRMFrameDescriptor *av_drm_frame = (struct AVDRMFrameDescriptor *) in_frame->data[0];
-        assert(av_drm_frame->nb_layers == 1);
-        AVDRMLayerDescriptor *layer = &av_drm_frame->layers[0];
+        out->drm_format = drm_format_from_layers(av_drm_frame);
+        if (out->drm_format == 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported DRM PRIME layer layout (%d layers)\n",
+                                av_drm_frame->nb_layers);
+                return;
+        }
 
         out->fd_count = av_drm_frame->nb_objects;
 
@@ -2073,20 +2323,51 @@ static void av_drm_prime_to_ug_drm_prime(char * __restrict dst_buffer, AVFrame *
                 out->dmabuf_fds[i] = av_drm_frame->objects[i].fd;
         }
 
-        out->planes = layer->nb_planes;
-        out->drm_format = layer->format;
-
-        for(int i = 0; i < layer->nb_planes; i++){
-                out->fd_indices[i] = layer->planes[i].object_index;
-                out->modifiers[i] = av_drm_frame->objects[layer->planes[i].object_index].format_modifier;
-                out->offsets[i] = layer->planes[i].offset;
-                out->pitches[i] = layer->planes[i].pitch;
+        for (int l = 0; l < av_drm_frame->nb_layers; l++) {
+                AVDRMLayerDescriptor *layer = &av_drm_frame->layers[l];
+                for(int i = 0; i < layer->nb_planes && out->planes < 4; i++){
+                        const int p = out->planes++;
+                        out->fd_indices[p] = layer->planes[i].object_index;
+                        out->modifiers[p] = av_drm_frame->objects[layer->planes[i].object_index].format_modifier;
+                        out->offsets[p] = layer->planes[i].offset;
+                        out->pitches[p] = layer->planes[i].pitch;
+                }
         }
 
         out->av_frame = av_frame_clone(in_frame);
         callbacks->recycle = hw_drm_recycle_callback; 
 }
 
+#ifdef HWACC_VAAPI
+/**
+ * Maps VAAPI surface as DRM PRIME (vaExportSurfaceHandle) - no copy, the
+ * mapped frame keeps reference to the surface.
+ */
+static void av_vaapi_to_ug_drm_prime(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
+                int width, int height, int pitch, const int * __restrict rgb_shift)
+{
+        memset(dst_buffer, 0, sizeof(struct drm_prime_frame));
+        ((struct drm_prime_frame *)(void *) dst_buffer)->in_fence_fd = -1;
+
+        AVFrame *mapped = av_frame_alloc();
+        if (mapped == NULL) {
+                return;
+        }
+        mapped->format = AV_PIX_FMT_DRM_PRIME;
+        int ret = av_hwframe_map(mapped, in_frame, AV_HWFRAME_MAP_READ | AV_HWFRAME_MAP_DIRECT);
+        if (ret < 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot map VAAPI frame to DRM PRIME: %s\n",
+                                av_err2str(ret));
+                av_frame_free(&mapped);
+                return;
+        }
+        mapped->opaque = in_frame->opaque;
+
+        av_drm_prime_to_ug_drm_prime(dst_buffer, mapped, width, height, pitch, rgb_shift);
+        av_frame_free(&mapped);
+}
+#endif
+
 static void ayuv64_to_uyvy(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
                 int width, int height, int pitch, const int * __restrict rgb_shift)
 {
@@ -2284,6 +2565,8 @@ static const struct av_to_uv_conversion av_to_uv_conversions[] = {
 #endif
         {AV_PIX_FMT_P010LE, v210, p010le_to_v210},
         {AV_PIX_FMT_P010LE, UYVY, p010le_to_uyvy},
+        {AV_PIX_FMT_P010LE, Y216, p010le_to_y216},
+        {AV_PIX_FMT_P010LE, R10k, p010le_to_r10k},
         // 8-bit YUV
         {AV_PIX_FMT_YUV420P, v210, yuv420p_to_v210},
         {AV_PIX_FMT_YUV420P, UYVY, yuv420p_to_uyvy},
@@ -2367,6 +2650,9 @@ static const struct av_to_uv_conversion av_to_uv_conversions[] = {
         {AV_PIX_FMT_VDPAU, HW_VDPAU, av_vdpau_to_ug_vdpau},
 #endif
         {AV_PIX_FMT_DRM_PRIME, DRM_PRIME, av_drm_prime_to_ug_drm_prime},
+#ifdef HWACC_VAAPI
+        {AV_PIX_FMT_VAAPI, DRM_PRIME, av_vaapi_to_ug_drm_prime},
+#endif
 };
 #define AV_TO_UV_CONVERSION_COUNT (sizeof av_to_uv_conversions / sizeof av_to_uv_conversions[0])
 static const struct av_to_uv_conversion *av_to_uv_conversions_end = av_to_uv_conversions + AV_TO_UV_CONVERSION_COUNT;
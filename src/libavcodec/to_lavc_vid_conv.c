@@ -55,8 +55,10 @@
 #include "host.h"
 #include "libavcodec/to_lavc_vid_conv.h"
 #include "libavcodec/to_lavc_vid_conv_cuda.h"
+#include "pixfmt_conv.h"
 #include "utils/macros.h" // OPTIMIZED_FOR
 #include "utils/parallel_conv.h"
+#include "utils/stream_copy.h"
 #include "utils/worker.h"
 #include "video.h"
 
@@ -1657,9 +1659,36 @@ struct to_lavc_vid_conv {
         decoder_t           decoder;
         pixfmt_callback_t   pixfmt_conv_callback;
 
+        /// fused conversion - decoder output is processed by
+        /// pixfmt_conv_callback in bands of band_height lines so that
+        /// the intermediate stays in cache (NULL if not used)
+        unsigned char      *band_buf; ///< thread_count bands of band_size B
+        size_t              band_size;
+        int                 band_height;
+        struct AVFrame    **band_frames; ///< per-thread band out_frame wrappers
+
         struct to_lavc_vid_conv_cuda *cuda_conv_state;
 };
 
+#define FUSED_BAND_SIZE (256 * 1024) ///< target intermediate size per thread
+
+ADD_TO_PARAM("lavc-no-fused-conv",
+                "* lavc-no-fused-conv\n"
+                "  Do not fuse 2-step pixel format conversion to libavcodec (decode whole frame first)\n");
+
+static void destroy_fused_conv(struct to_lavc_vid_conv *s)
+{
+        if (s->band_frames != NULL) {
+                for (int i = 0; i < s->thread_count; ++i) {
+                        av_frame_free(&s->band_frames[i]);
+                }
+        }
+        free(s->band_frames);
+        free(s->band_buf);
+        s->band_frames = NULL;
+        s->band_buf = NULL;
+}
+
 static void to_lavc_memcpy_data(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
 {
         struct to_lavc_vid_conv *s = out_frame->opaque;
@@ -1670,12 +1699,40 @@ static void to_lavc_memcpy_data(AVFrame * __restrict out_frame, const unsigned c
                         break;
                 }
                 for (ptrdiff_t y = 0; y < height; ++y) {
-                        memcpy(out_frame->data[comp] + y * out_frame->linesize[comp], in_data + y * linesize,
+                        ug_stream_copy(out_frame->data[comp] + y * out_frame->linesize[comp], in_data + y * linesize,
                                         linelength);
                 }
         }
 }
 
+static void init_fused_conv(struct to_lavc_vid_conv *s)
+{
+        const int dec_linesize =
+            vc_get_linesize(s->out_frame->width, s->decoded_codec);
+        s->band_height = MAX(FUSED_BAND_SIZE / dec_linesize & ~1, 2);
+        s->band_size = (size_t) s->band_height * dec_linesize + MAX_PADDING;
+        s->band_buf = malloc(s->band_size * s->thread_count);
+        s->band_frames = calloc(s->thread_count, sizeof *s->band_frames);
+        if (s->band_buf == NULL || s->band_frames == NULL) {
+                goto fail;
+        }
+        for (int i = 0; i < s->thread_count; ++i) {
+                if ((s->band_frames[i] = av_frame_alloc()) == NULL) {
+                        goto fail;
+                }
+                memcpy(s->band_frames[i]->linesize, s->out_frame->linesize,
+                       sizeof s->out_frame->linesize);
+                s->band_frames[i]->opaque = s->out_frame->opaque;
+        }
+        MSG(VERBOSE, "using fused conversion in bands of %d lines\n",
+            s->band_height);
+        return;
+fail:
+        MSG(WARNING, "Cannot allocate fused conversion buffers, using "
+                     "2-step conversion\n");
+        destroy_fused_conv(s);
+}
+
 struct to_lavc_vid_conv *to_lavc_vid_conv_init(codec_t in_pixfmt, int width, int height, enum AVPixelFormat out_pixfmt, int thread_count) {
         int ret = 0;
         struct to_lavc_vid_conv *s = (struct to_lavc_vid_conv *) calloc(1, sizeof *s);
@@ -1760,6 +1817,12 @@ struct to_lavc_vid_conv *to_lavc_vid_conv_init(codec_t in_pixfmt, int width, int
 
         s->pixfmt_conv_callback = select_pixfmt_callback(out_pixfmt, s->decoded_codec);
 
+        if (s->decoder != vc_memcpy && s->pixfmt_conv_callback != NULL &&
+            !codec_is_planar(s->decoded_codec) &&
+            get_commandline_param("lavc-no-fused-conv") == NULL) {
+                init_fused_conv(s);
+        }
+
         return s;
 };
 
@@ -1797,6 +1860,71 @@ static void *pixfmt_conv_task(void *arg) {
         return NULL;
 }
 
+struct fused_conv_task_data {
+        struct to_lavc_vid_conv *s;
+        AVFrame *out_frame;  ///< slice of s->out_frame
+        AVFrame *band_frame; ///< wrapper for the processed band of out_frame
+        unsigned char *band;
+        const char *in_data;
+        int height;
+};
+
+/**
+ * Decodes the slice to UG intermediate in bands of s->band_height lines,
+ * each immediately converted to AVFrame while still hot in cache.
+ */
+static void *fused_conv_task(void *arg) {
+        struct fused_conv_task_data *d = arg;
+        struct to_lavc_vid_conv *s = d->s;
+        const int width = s->out_frame->width;
+        const int src_linesize = vc_get_linesize(width, s->in_pixfmt);
+        const int dec_linesize = vc_get_linesize(width, s->decoded_codec);
+        const int log2_chroma_h =
+            av_pix_fmt_desc_get(s->out_frame->format)->log2_chroma_h;
+
+        for (int y = 0; y < d->height; y += s->band_height) {
+                const int lines = MIN(s->band_height, d->height - y);
+                for (int l = 0; l < lines; ++l) {
+                        s->decoder(d->band + (ptrdiff_t) l * dec_linesize,
+                                   (const unsigned char *) d->in_data +
+                                       (ptrdiff_t) (y + l) * src_linesize,
+                                   dec_linesize, DEFAULT_R_SHIFT,
+                                   DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+                }
+                for (int i = 0; i < AV_NUM_DATA_POINTERS; ++i) {
+                        if (d->out_frame->data[i] == NULL) {
+                                d->band_frame->data[i] = NULL;
+                                continue;
+                        }
+                        // planes 1 and 2 are chroma (alpha is not subsampled)
+                        const int row = i == 1 || i == 2 ? y >> log2_chroma_h : y;
+                        d->band_frame->data[i] = d->out_frame->data[i] +
+                                                 (ptrdiff_t) row *
+                                                     d->out_frame->linesize[i];
+                }
+                s->pixfmt_conv_callback(d->band_frame, d->band, width, lines);
+        }
+        return NULL;
+}
+
+static void fused_conv(struct to_lavc_vid_conv *s, const char *in_data)
+{
+        struct fused_conv_task_data data[s->thread_count];
+        const int height = s->out_frame->height / s->thread_count & ~1; // height needs to be even
+        const int src_linesize = vc_get_linesize(s->out_frame->width, s->in_pixfmt);
+        for (int i = 0; i < s->thread_count; ++i) {
+                data[i].s = s;
+                data[i].out_frame = s->out_frame_parts[i];
+                data[i].band_frame = s->band_frames[i];
+                data[i].band = s->band_buf + i * s->band_size;
+                data[i].in_data = in_data + (ptrdiff_t) i * height * src_linesize;
+                data[i].height = i < s->thread_count - 1
+                                     ? height
+                                     : s->out_frame->height - height * (s->thread_count - 1);
+        }
+        task_run_parallel(fused_conv_task, s->thread_count, data, sizeof data[0], NULL);
+}
+
 /// @return AVFrame with converted data (if needed); valid until next to_lavc_vid_conv()
 ///         call or to_lavc_vid_conv_destroy()
 struct AVFrame *to_lavc_vid_conv(struct to_lavc_vid_conv *s, char *in_data) {
@@ -1811,6 +1939,12 @@ struct AVFrame *to_lavc_vid_conv(struct to_lavc_vid_conv *s, char *in_data) {
         }
 
         time_ns_t t0 = get_time_in_ns();
+        if (s->band_buf != NULL) {
+                fused_conv(s, in_data);
+                MSG(DEBUG2, "duration fused pixfmt change: %f ms\n",
+                    (get_time_in_ns() - t0) / NS_IN_MS_DBL);
+                return s->out_frame;
+        }
         if (s->decoder != vc_memcpy) {
                 int src_linesize = vc_get_linesize(s->out_frame->width, s->in_pixfmt);
                 int dst_linesize = vc_get_linesize(s->out_frame->width, s->decoded_codec);
@@ -1883,6 +2017,7 @@ void to_lavc_vid_conv_destroy(struct to_lavc_vid_conv **s_p) {
                 av_frame_free(&s->out_frame_parts[i]);
         }
         free(s->out_frame_parts);
+        destroy_fused_conv(s);
         av_frame_free(&s->out_frame);
         av_frame_free(&s->tmp_frame);
         free(s->decoded);
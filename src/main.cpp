@@ -97,9 +97,11 @@
 #include "tv.h"
 #include "ug_runtime_error.hpp"
 #include "utils/color_out.h"
+#include "utils/frame_pacer.h"
 #include "utils/misc.h"
 #include "utils/nat.h"
 #include "utils/net.h"
+#include "utils/numa.h"
 #include "utils/sdp.h"
 #include "utils/string.h"
 #include "utils/string_view_utils.hpp"
@@ -322,6 +324,9 @@ print_fps(const char *prefix, steady_clock::time_point *t0, int *frames,
         *frames = 0;
 }
 
+ADD_TO_PARAM("capture-pacing", "* capture-pacing=<ms>\n"
+                "  Smooth bursty capture (NDI, RTSP, file) to the nominal frame rate,\n"
+                "  delaying the frames by at most <ms> milliseconds.\n");
 /**
  * This function captures video and possibly compresses it.
  * It then delegates sending to another thread.
@@ -331,6 +336,7 @@ print_fps(const char *prefix, steady_clock::time_point *t0, int *frames,
 static void *capture_thread(void *arg)
 {
         set_thread_name(__func__);
+        ug_numa_bind_thread();
 
         struct state_uv *uv = (struct state_uv *) arg;
         assert(uv->magic == state_uv::state_magic);
@@ -339,6 +345,9 @@ static void *capture_thread(void *arg)
         int frames = 0;
         const char              *print_fps_prefix =
             vidcap_get_fps_print_prefix(uv->capture_device);
+        const char *pacing = get_commandline_param("capture-pacing");
+        struct frame_pacer *pacer = frame_pacer_init(
+            pacing != nullptr ? llround(atof(pacing) * NS_IN_MS) : 0);
 
         while (!uv->should_exit_capture) {
                 /* Capture and transmit video... */
@@ -353,6 +362,7 @@ static void *capture_thread(void *arg)
                 if (tx_frame == nullptr) {
                         continue;
                 }
+                frame_pacer_wait(pacer, tx_frame->fps);
                 print_fps(print_fps_prefix, &t0, &frames, tx_frame->fps);
                 // tx_frame = vf_get_copy(tx_frame);
                 bool                    wait_for_cur_uncompressed_frame = false;
@@ -383,6 +393,7 @@ static void *capture_thread(void *arg)
         }
 
         wait_obj_done(wait_obj);
+        frame_pacer_done(pacer);
 
         return NULL;
 }
@@ -1426,6 +1437,7 @@ int main(int argc, char *argv[])
                 params["bitrate"].ll = opt.bitrate;
                 params["start_time"].ll = start_time;
                 params["video_delay"].vptr = (volatile void *) &video_offset;
+                params["simulcast"].str = get_commandline_param("video-simulcast");
 
                 // UltraGrid RTP
                 params["decoder_mode"].l = (long) opt.decoder_mode;
@@ -45,10 +45,13 @@
 
 #include "messaging.h"
 
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <unordered_map>
 
 #include "debug.h"
@@ -58,6 +61,7 @@
 
 #define MAX_MESSAGES 100
 #define MAX_MESSAGES_FOR_NOT_EXISTING_RECV 10
+#define MAX_CACHED_PATHS 64
 #define MOD_NAME "[messaging] "
 
 using namespace std;
@@ -94,6 +98,46 @@ struct pair_msg_path {
         struct message *msg;
         char path[];
 };
+
+/// receiver resolved by send_message_common(), valid while generation is current
+struct cached_receiver {
+        struct module *root;
+        struct module *receiver;
+        uint64_t generation;
+};
+thread_local unordered_map<string, cached_receiver> receiver_cache;
+}
+
+/**
+ * Module message queue. Senders push the messages to a lock-free LIFO stack,
+ * the receiver takes the whole stack when its FIFO list drains. The count
+ * allows check_message() to return with a single load if there is no message,
+ * so that it can be polled cheaply.
+ */
+struct module_mailbox {
+        atomic<struct message *> incoming{nullptr};
+        atomic<int> count{0};
+        mutex lock;                      ///< protects pending
+        struct message *pending = nullptr; ///< FIFO of messages taken from incoming
+};
+
+struct module_mailbox *module_mailbox_create()
+{
+        return new module_mailbox();
+}
+
+void module_mailbox_destroy(struct module_mailbox *mb)
+{
+        delete mb;
+}
+
+static void mailbox_push(struct module_mailbox *mb, struct message *msg)
+{
+        msg->next = mb->incoming.load(memory_order_relaxed);
+        while (!mb->incoming.compare_exchange_weak(msg->next, msg, memory_order_release,
+                                memory_order_relaxed)) {
+        }
+        mb->count.fetch_add(1, memory_order_release);
 }
 
 void free_message_for_child(void *m, struct response *r) {
@@ -136,9 +180,20 @@ static struct response *send_message_common(struct module *root, const char *con
                 msg->priv_data = new shared_ptr<struct responder>(responder);
         }
 
-        pthread_mutex_lock(&receiver->lock);
+        uint64_t generation = 0;
+        auto cached = receiver_cache.find(const_path);
+        if (cached != receiver_cache.end() && cached->second.root == root &&
+                        module_lock_if_current(cached->second.receiver, cached->second.generation)) {
+                receiver = cached->second.receiver;
+        } else {
+                cached = receiver_cache.end();
+                // taken before the lookup - if a module is removed during it,
+                // the cache entry becomes invalid
+                generation = module_tree_generation();
+                pthread_mutex_lock(&receiver->lock);
+        }
 
-        while ((item = strtok_r(path, ".", &save_ptr))) {
+        while (cached == receiver_cache.end() && (item = strtok_r(path, ".", &save_ptr))) {
                 path = NULL;
                 struct module *old_receiver = receiver;
 
@@ -200,19 +255,21 @@ static struct response *send_message_common(struct module *root, const char *con
 
         free(tmp);
 
+        if (cached == receiver_cache.end()) {
+                if (receiver_cache.size() >= MAX_CACHED_PATHS) {
+                        receiver_cache.clear();
+                }
+                receiver_cache[const_path] = { root, receiver, generation };
+        }
+
         //pthread_mutex_guard guard(receiver->lock, lock_guard_retain_ownership_t());
 
-        pthread_mutex_lock(&receiver->msg_queue_lock);
-        int size = simple_linked_list_size(receiver->msg_queue);
-        pthread_mutex_unlock(&receiver->msg_queue_lock);
-        if (size >= MAX_MESSAGES) {
-                struct message *m = (struct message *) simple_linked_list_pop(receiver->msg_queue);
+        if (receiver->msg_queue->count.load(memory_order_relaxed) >= MAX_MESSAGES) {
+                struct message *m = check_message(receiver);
                 free_message(m, new_response(RESPONSE_INT_SERV_ERR, "Too many unprocessed messages"));
                 printf("Dropping some messages for %s - queue full.\n", const_path);
         }
-        pthread_mutex_lock(&receiver->msg_queue_lock);
-        simple_linked_list_append(receiver->msg_queue, msg);
-        pthread_mutex_unlock(&receiver->msg_queue_lock);
+        mailbox_push(receiver->msg_queue, msg);
 
         if (receiver->new_message) {
                 receiver->new_message(receiver);
@@ -282,15 +339,12 @@ void module_check_undelivered_messages(struct module *node)
 
 void module_store_message(struct module *node, struct message *m)
 {
-        pthread_mutex_guard guard(node->msg_queue_lock);
-        simple_linked_list_append(node->msg_queue, m);
+        mailbox_push(node->msg_queue, m);
 }
 
 struct response *send_message_to_receiver(struct module *receiver, struct message *msg)
 {
-        pthread_mutex_lock(&receiver->msg_queue_lock);
-        simple_linked_list_append(receiver->msg_queue, msg);
-        pthread_mutex_unlock(&receiver->msg_queue_lock);
+        mailbox_push(receiver->msg_queue, msg);
 
         pthread_mutex_guard guard(receiver->lock);
         if (receiver->new_message) {
@@ -391,14 +445,33 @@ const char *response_status_to_text(int status)
         return NULL;
 }
 
+/**
+ * @returns oldest message for the module, NULL if there is none
+ *
+ * If there is no message, it doesn't lock anything, so it can be polled.
+ */
 struct message *check_message(struct module *mod)
 {
-        pthread_mutex_guard guard(mod->msg_queue_lock);
-
-        if(simple_linked_list_size(mod->msg_queue) > 0) {
-                return (struct message *) simple_linked_list_pop(mod->msg_queue);
-        } else {
+        struct module_mailbox *mb = mod->msg_queue;
+        if (mb->count.load(memory_order_acquire) == 0) {
                 return NULL;
         }
+
+        lock_guard<mutex> lk(mb->lock);
+        if (mb->pending == nullptr) { // reverse the stack to get FIFO
+                struct message *m = mb->incoming.exchange(nullptr, memory_order_acquire);
+                while (m != nullptr) {
+                        struct message *next = m->next;
+                        m->next = mb->pending;
+                        mb->pending = m;
+                        m = next;
+                }
+        }
+        struct message *ret = mb->pending;
+        if (ret != nullptr) {
+                mb->pending = ret->next;
+                mb->count.fetch_sub(1, memory_order_relaxed);
+        }
+        return ret;
 }
 
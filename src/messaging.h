@@ -78,6 +78,7 @@ struct message {
         // except from messaging.cpp
         void (*send_response)(void *priv_data, struct response *);
         void *priv_data;
+        struct message *next; ///< link in module mailbox
 };
 
 enum msg_sender_type {
@@ -90,6 +91,8 @@ enum msg_sender_type {
         SENDER_MSG_CHANGE_FEC,
         SENDER_MSG_QUERY_VIDEO_MODE,
         SENDER_MSG_RESET_SSRC,
+        SENDER_MSG_ADD_RECEIVER,    ///< additional receiver (fan-out), uses dest
+        SENDER_MSG_REMOVE_RECEIVER, ///< uses dest
 };
 
 struct msg_sender {
@@ -102,6 +105,11 @@ struct msg_sender {
                 };
                 char receiver[128];
                 char fec_cfg[1024];
+                struct {
+                        char addr[128];
+                        int rtp_port;
+                        int rtcp_port;
+                } dest;
         };
 };
 
@@ -178,6 +186,9 @@ const char *response_status_to_text(int status);
 
 struct message *check_message(struct module *);
 
+struct module_mailbox *module_mailbox_create(void);
+void module_mailbox_destroy(struct module_mailbox *mb);
+
 void free_message_for_child(void *m, struct response *r);
 
 #ifdef __cplusplus
@@ -45,6 +45,11 @@
 
 #define MOD_NAME "[module] "
 
+/// protects module_tree_gen
+static pthread_mutex_t module_tree_lock = PTHREAD_MUTEX_INITIALIZER;
+/// incremented whenever a module is removed from the tree
+static uint64_t module_tree_gen;
+
 void module_init_default(struct module *module_data)
 {
         int ret = 0;
@@ -54,12 +59,11 @@ void module_init_default(struct module *module_data)
         ret |= pthread_mutexattr_init(&attr);
         ret |= pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
         ret |= pthread_mutex_init(&module_data->lock, &attr);
-        ret |= pthread_mutex_init(&module_data->msg_queue_lock, &attr);
         ret |= pthread_mutexattr_destroy(&attr);
         assert(ret == 0 && "Unable to create mutex or set attributes");
 
         module_data->children = simple_linked_list_init();
-        module_data->msg_queue = simple_linked_list_init();
+        module_data->msg_queue = module_mailbox_create();
         module_data->msg_queue_children = simple_linked_list_init();
 
         module_data->magic = MODULE_MAGIC;
@@ -107,6 +111,11 @@ void module_done(struct module *module_data)
                 assert(found);
                 module_mutex_unlock(&module_data->parent->lock);
         }
+        // after the removal so that a path resolved by a walk started
+        // before this point gets invalidated (see send_message_common())
+        pthread_mutex_lock(&module_tree_lock);
+        module_tree_gen += 1;
+        pthread_mutex_unlock(&module_tree_lock);
 
         // we assume that deleter may dealloc space where are structure stored
         module_mutex_lock(&module_data->lock);
@@ -133,18 +142,18 @@ void module_done(struct module *module_data)
         }
         simple_linked_list_destroy(tmp.children);
 
-        if(simple_linked_list_size(tmp.msg_queue) > 0) {
+        struct message *msg = check_message(&tmp);
+        if (msg != NULL) {
                 fprintf(stderr, "Warning: Message queue not empty!\n");
                 if (log_level >= LOG_LEVEL_VERBOSE) {
                         printf("Path: ");
                         dump_parents(&tmp);
                 }
-                struct message *m;
-                while ((m = check_message(&tmp))) {
-                        free_message(m, NULL);
-                }
+                do {
+                        free_message(msg, NULL);
+                } while ((msg = check_message(&tmp)));
         }
-        simple_linked_list_destroy(tmp.msg_queue);
+        module_mailbox_destroy(tmp.msg_queue);
 
         while (simple_linked_list_size(tmp.msg_queue_children) > 0) {
                 struct message *m = simple_linked_list_pop(tmp.msg_queue_children);
@@ -422,4 +431,36 @@ bool module_get_path_str(struct module *mod, char *buf, size_t buflen) {
         return true;
 }
 
+/**
+ * @returns current generation of the module tree - changes whenever a module is
+ *          removed, so that a module pointer obtained at the given generation
+ *          may be reused while it is current (see module_lock_if_current())
+ */
+uint64_t
+module_tree_generation(void)
+{
+        pthread_mutex_lock(&module_tree_lock);
+        uint64_t ret = module_tree_gen;
+        pthread_mutex_unlock(&module_tree_lock);
+        return ret;
+}
+
+/**
+ * Locks mod->lock if no module has been removed since generation was obtained
+ * by module_tree_generation(), so that mod is still valid.
+ *
+ * Only try-lock is used not to block the module removal (nor to introduce
+ * a lock-order dependency), false is returned also if mod->lock is held by
+ * another thread.
+ */
+bool
+module_lock_if_current(struct module *mod, uint64_t generation)
+{
+        pthread_mutex_lock(&module_tree_lock);
+        bool ret = generation == module_tree_gen &&
+                   pthread_mutex_trylock(&mod->lock) == 0;
+        pthread_mutex_unlock(&module_tree_lock);
+        return ret;
+}
+
 /* vim: set expandtab sw=8: */
@@ -68,8 +68,11 @@
 #include "utils/macros.h"
 
 #include <pthread.h>
-#ifndef __cplusplus
+#ifdef __cplusplus
+#include <cstdint>
+#else
 #include <stdalign.h>
+#include <stdint.h>
 #endif
 
 #ifdef __cplusplus
@@ -98,6 +101,7 @@ enum module_class {
 };
 
 struct module;
+struct module_mailbox;
 struct simple_linked_list;
 
 typedef void (*module_deleter_t)(struct module *);
@@ -105,8 +109,9 @@ typedef void (*notify_t)(struct module *);
 
 /**
  * @struct module
- * Only members cls, deleter, priv_data and msg_queue may be directly touched
- * by user. The others should be considered private.
+ * Only members cls, deleter and priv_data may be directly touched by user.
+ * The others should be considered private, messages are read with
+ * check_message().
  */
 struct module {
         alignas(8) uint32_t magic;
@@ -118,8 +123,7 @@ struct module {
         module_deleter_t deleter;
         notify_t new_message; ///< if set, notifies module that new message is in queue, receiver lock is hold during the call
 
-        pthread_mutex_t msg_queue_lock; // protects msg_queue
-        struct simple_linked_list *msg_queue;
+        struct module_mailbox *msg_queue; ///< see messaging.cpp
 
         struct simple_linked_list *msg_queue_children; ///< messages for childern that were not delivered
 
@@ -147,6 +151,8 @@ const char *module_class_name(enum module_class cls);
 void        append_message_path(char *buf, int buflen,
                                 const enum module_class *modules);
 bool module_get_path_str(struct module *mod, char *buf, size_t buflen);
+uint64_t module_tree_generation(void);
+bool module_lock_if_current(struct module *mod, uint64_t generation);
 
 #ifdef __cplusplus
 class module_raii{
@@ -35,3 +35,15 @@ void ntp64_time(uint32_t * ntp_sec, uint32_t * ntp_frac)
         tmp = now.tv_usec;
         *ntp_frac = (tmp << 12) + (tmp << 8) - ((tmp * 3650) >> 6);
 }
+
+void ns_to_ntp64(int64_t ns, uint32_t *ntp_sec, uint32_t *ntp_frac)
+{
+        *ntp_sec = (uint32_t) (ns / 1000000000 + SECS_BETWEEN_1900_1970);
+        *ntp_frac = (uint32_t) (((uint64_t) (ns % 1000000000) << 32) / 1000000000);
+}
+
+int64_t ntp64_to_ns(uint32_t ntp_sec, uint32_t ntp_frac)
+{
+        return (int64_t) (ntp_sec - SECS_BETWEEN_1900_1970) * 1000000000 +
+               (int64_t) (((uint64_t) ntp_frac * 1000000000) >> 32);
+}
@@ -27,6 +27,9 @@ extern "C" {
 #define  ntp32_sub(now, then) ((now) > (then)) ? ((now) - (then)) : (((now) - (then)) + 0x7fffffff)
 
 void     ntp64_time(uint32_t *ntp_sec, uint32_t *ntp_frac);
+/* conversions from/to ns since the Unix epoch (get_time_in_ns() clock) */
+void     ns_to_ntp64(int64_t ns, uint32_t *ntp_sec, uint32_t *ntp_frac);
+int64_t  ntp64_to_ns(uint32_t ntp_sec, uint32_t ntp_frac);
 
 #if defined(__cplusplus)
 }
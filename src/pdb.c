@@ -71,18 +71,24 @@
 
 #define PDB_MAGIC	0x10101010
 #define PDB_NODE_MAGIC	0x01010101
+#define PDB_INIT_SIZE	16
 
+/* The database is an open addressing hash table (linear probing) keyed */
+/* by the SSRC that is kept at most half full. The nodes are also linked */
+/* in a list in the order of insertion, which is used by the iterators. */
 typedef struct s_pdb_node {
         uint32_t key;
         void *data;
-        struct s_pdb_node *parent;
-        struct s_pdb_node *left;
-        struct s_pdb_node *right;
+        struct s_pdb_node *prev;
+        struct s_pdb_node *next;
         uint32_t magic;
 } pdb_node_t;
 
 struct pdb {
-        pdb_node_t *root;
+        pdb_node_t **table;
+        uint32_t mask;          /* table size - 1, size is a power of 2 */
+        pdb_node_t *head;
+        pdb_node_t *tail;
         uint32_t magic;
         int count;
         volatile int *delay_ms;
@@ -92,39 +98,25 @@ struct pdb {
 /* Debugging functions...                                                    */
 /*****************************************************************************/
 
-#define BTREE_MAGIC      0x10101010
-#define BTREE_NODE_MAGIC 0x01010101
-
-#ifdef DEBUG
-static
-#ifndef __APPLE__
-__thread
-#endif
-int pdb_count;
-
-static void pdb_validate_node(pdb_node_t * node, pdb_node_t * parent)
-{
-        assert(node->magic == BTREE_NODE_MAGIC);
-        assert(node->parent == parent);
-        pdb_count++;
-        if (node->left != NULL) {
-                pdb_validate_node(node->left, node);
-        }
-        if (node->right != NULL) {
-                pdb_validate_node(node->right, node);
-        }
-}
-#endif
-
 static void pdb_validate(struct pdb *t)
 {
-        assert(t->magic == BTREE_MAGIC);
+        assert(t->magic == PDB_MAGIC);
 #ifdef DEBUG
-        pdb_count = 0;
-        if (t->root != NULL) {
-                pdb_validate_node(t->root, NULL);
+        int count = 0;
+        for (uint32_t i = 0; i <= t->mask; i++) {
+                if (t->table[i] != NULL) {
+                        assert(t->table[i]->magic == PDB_NODE_MAGIC);
+                        count++;
+                }
         }
-        assert(pdb_count == t->count);
+        assert(count == t->count);
+        count = 0;
+        for (pdb_node_t *x = t->head; x != NULL; x = x->next) {
+                assert(x->prev == NULL ? x == t->head : x->prev->next == x);
+                assert(x->next == NULL ? x == t->tail : x->next->prev == x);
+                count++;
+        }
+        assert(count == t->count);
 #endif
 }
 
@@ -132,111 +124,94 @@ static void pdb_validate(struct pdb *t)
 /* Utility functions                                                         */
 /*****************************************************************************/
 
-static pdb_node_t *pdb_min(pdb_node_t * x)
+static inline uint32_t pdb_hash(uint32_t key)
 {
-        if (x == NULL) {
-                return NULL;
-        }
-        while (x->left) {
-                x = x->left;
-        }
-        return x;
+        /* SSRCs need not be uniformly distributed, mix the bits first */
+        /* (finalizer of MurmurHash3).                                 */
+        key ^= key >> 16;
+        key *= 0x85ebca6bU;
+        key ^= key >> 13;
+        key *= 0xc2b2ae35U;
+        key ^= key >> 16;
+        return key;
 }
 
-static pdb_node_t *pdb_successor(pdb_node_t * x)
+static pdb_node_t **pdb_search(struct pdb *tree, uint32_t key)
 {
-        pdb_node_t *y;
-
-        if (x->right != NULL) {
-                return pdb_min(x->right);
-        }
-
-        y = x->parent;
-        while (y != NULL && x == y->right) {
-                x = y;
-                y = y->parent;
+        /* Returns the slot holding key or the empty slot where it   */
+        /* would be inserted.                                        */
+        uint32_t i = pdb_hash(key) & tree->mask;
+        while (tree->table[i] != NULL && tree->table[i]->key != key) {
+                i = (i + 1) & tree->mask;
         }
-
-        return y;
+        return &tree->table[i];
 }
 
-static pdb_node_t *pdb_search(pdb_node_t * x, uint32_t key)
+static bool pdb_grow(struct pdb *tree)
 {
-        while (x != NULL && key != x->key) {
-                if (key < x->key) {
-                        x = x->left;
-                } else {
-                        x = x->right;
-                }
+        uint32_t size = 2 * (tree->mask + 1);
+        pdb_node_t **table = calloc(size, sizeof(pdb_node_t *));
+        if (table == NULL) {
+                return false;
         }
-        return x;
+        free(tree->table);
+        tree->table = table;
+        tree->mask = size - 1;
+        for (pdb_node_t *x = tree->head; x != NULL; x = x->next) {
+                *pdb_search(tree, x->key) = x;
+        }
+        return true;
 }
 
 static void pdb_insert_node(struct pdb *tree, pdb_node_t * z)
 {
-        pdb_node_t *x, *y;
-
         pdb_validate(tree);
-        y = NULL;
-        x = tree->root;
-        while (x != NULL) {
-                y = x;
-                assert(z->key != x->key);
-                if (z->key < x->key) {
-                        x = x->left;
-                } else {
-                        x = x->right;
-                }
-        }
-
-        z->parent = y;
-        if (y == NULL) {
-                tree->root = z;
-        } else if (z->key < y->key) {
-                y->left = z;
+        pdb_node_t **slot = pdb_search(tree, z->key);
+        assert(*slot == NULL);
+        *slot = z;
+        z->prev = tree->tail;
+        z->next = NULL;
+        if (tree->tail != NULL) {
+                tree->tail->next = z;
         } else {
-                y->right = z;
+                tree->head = z;
         }
+        tree->tail = z;
         tree->count++;
         pdb_validate(tree);
 }
 
-static pdb_node_t *pdb_delete_node(struct pdb *tree, pdb_node_t * z)
+static void pdb_delete_node(struct pdb *tree, pdb_node_t ** slot)
 {
-        pdb_node_t *x, *y;
-
         pdb_validate(tree);
-        if (z->left == NULL || z->right == NULL) {
-                y = z;
+        pdb_node_t *z = *slot;
+        if (z->prev != NULL) {
+                z->prev->next = z->next;
         } else {
-                y = pdb_successor(z);
+                tree->head = z->next;
         }
-
-        if (y->left != NULL) {
-                x = y->left;
+        if (z->next != NULL) {
+                z->next->prev = z->prev;
         } else {
-                x = y->right;
+                tree->tail = z->prev;
         }
 
-        if (x != NULL) {
-                x->parent = y->parent;
-        }
-
-        if (y->parent == NULL) {
-                tree->root = x;
-        } else if (y == y->parent->left) {
-                y->parent->left = x;
-        } else {
-                y->parent->right = x;
+        /* Backward shift deletion - move back the following entries */
+        /* of the cluster that would become unreachable otherwise.    */
+        uint32_t i = slot - tree->table;
+        tree->table[i] = NULL;
+        for (uint32_t j = (i + 1) & tree->mask; tree->table[j] != NULL;
+             j = (j + 1) & tree->mask) {
+                uint32_t k = pdb_hash(tree->table[j]->key) & tree->mask;
+                if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+                        continue;
+                }
+                tree->table[i] = tree->table[j];
+                tree->table[j] = NULL;
+                i = j;
         }
-
-        z->key = y->key;
-        z->data = y->data;
-
         tree->count--;
-
         pdb_validate(tree);
-        return y;
 }
 
 /*****************************************************************************/
@@ -247,8 +222,15 @@ struct pdb *pdb_init(volatile int *delay_ms)
         if (db != NULL) {
                 db->magic = PDB_MAGIC;
                 db->count = 0;
-                db->root = NULL;
+                db->head = NULL;
+                db->tail = NULL;
+                db->mask = PDB_INIT_SIZE - 1;
+                db->table = calloc(PDB_INIT_SIZE, sizeof(pdb_node_t *));
                 db->delay_ms = delay_ms;
+                if (db->table == NULL) {
+                        free(db);
+                        return NULL;
+                }
         }
         return db;
 }
@@ -258,18 +240,13 @@ void pdb_destroy(struct pdb **db_p)
         struct pdb *db = *db_p;
 
         pdb_validate(db);
-        if (db->root != NULL) {
-                pdb_iter_t it;
-                struct pdb_e *cp = pdb_iter_init(db, &it);
-                while (cp != NULL) {
-                        struct pdb_e *item = NULL;
-                        pdb_remove(db, cp->ssrc, &item);
-                        cp = pdb_iter_next(&it);
-                        pdb_destroy_item(item);
-                }
-                pdb_iter_done(&it);
+        while (db->head != NULL) {
+                struct pdb_e *item = NULL;
+                pdb_remove(db, db->head->key, &item);
+                pdb_destroy_item(item);
         }
 
+        free(db->table);
         free(db);
         *db_p = NULL;
 }
@@ -305,11 +282,14 @@ int pdb_add(struct pdb *db, uint32_t ssrc)
         struct pdb_e *i;
 
         pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
-        if (x != NULL) {
+        if (*pdb_search(db, ssrc) != NULL) {
                 debug_msg("Item already exists - ssrc %x\n", ssrc);
                 return 1;
         }
+        if (2 * (db->count + 1) > (int) db->mask + 1 && !pdb_grow(db)) {
+                debug_msg("Unable to grow database - ssrc %x\n", ssrc);
+                return 2;
+        }
 
         i = pdb_create_item(ssrc, db->delay_ms);
         if (i == NULL) {
@@ -320,10 +300,7 @@ int pdb_add(struct pdb *db, uint32_t ssrc)
         x = (pdb_node_t *) malloc(sizeof(pdb_node_t));
         x->key = ssrc;
         x->data = i;
-        x->parent = NULL;
-        x->left = NULL;
-        x->right = NULL;
-        x->magic = BTREE_NODE_MAGIC;
+        x->magic = PDB_NODE_MAGIC;
         pdb_insert_node(db, x);
         debug_msg("Added participant %x\n", ssrc);
         return 0;
@@ -336,7 +313,7 @@ struct pdb_e *pdb_get(struct pdb *db, uint32_t ssrc)
         pdb_node_t *x;
 
         pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
+        x = *pdb_search(db, ssrc);
         if (x != NULL) {
                 return x->data;
         }
@@ -346,23 +323,20 @@ struct pdb_e *pdb_get(struct pdb *db, uint32_t ssrc)
 int pdb_remove(struct pdb *db, uint32_t ssrc, struct pdb_e **item)
 {
         /* Remove the item indexed by ssrc. Return zero on success.   */
+        pdb_node_t **slot;
         pdb_node_t *x;
 
         pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
+        slot = pdb_search(db, ssrc);
+        x = *slot;
         if (x == NULL) {
-                debug_msg("Item not on tree - ssrc %ul\n", ssrc);
+                debug_msg("Item not in database - ssrc %x\n", ssrc);
                 *item = NULL;
                 return 1;
         }
 
-        /* Note value that gets freed is not necessarily the the same as node
-         * that gets removed from tree since there is an optimization to avoid
-         * pointer updates in tree which means sometimes we just copy key and
-         * data from one node to another.  
-         */
         *item = x->data;
-        x = pdb_delete_node(db, x);
+        pdb_delete_node(db, slot);
         free(x);
         return 0;
 }
@@ -392,17 +366,17 @@ void pdb_destroy_item(struct pdb_e *item)
 
 struct pdb_e *pdb_iter_init(struct pdb *db, pdb_iter_t *it)
 {
-        if (db->root == NULL) {
+        *it = db->head;
+        if (*it == NULL) {
                 return NULL;    /* The database is empty */
         }
-        *it = (pdb_node_t *) pdb_min(db->root);
         return ((pdb_node_t *) *it)->data;
 }
 
 struct pdb_e *pdb_iter_next(pdb_iter_t *it)
 {
         assert(*it != NULL);
-        *it = (pdb_node_t *)pdb_successor((pdb_node_t *)*it);
+        *it = ((pdb_node_t *) *it)->next;
         if (*it == NULL) {
                 return NULL;
         }
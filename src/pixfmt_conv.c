@@ -59,24 +59,69 @@
 #include "config_win32.h"
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "color.h"
 #include "compat/qsort_s.h"
 #include "debug.h"
+#include "host.h"
 #include "pixfmt_conv.h"
+#include "tv.h"
+#include "utils/fs.h"
 #include "utils/macros.h" // to_fourcc, OPTIMEZED_FOR, CLAMP
+#include "utils/stream_copy.h"
 #include "video_codec.h"
 
 #ifdef __SSSE3__
 #include "tmmintrin.h"
 #endif
 
+#if (defined __x86_64__ || defined __i386__) && (defined __GNUC__ || defined __clang__)
+/// AVX2/AVX-512 variants compiled regardless of -march, selected at runtime
+#define X86_SIMD_DISPATCH 1
+#include <immintrin.h>
+#endif
+#if defined __ARM_NEON && defined __aarch64__
+/// NEON variants (AArch64 only - table lookups are not in ARMv7 NEON)
+#define NEON_DISPATCH 1
+#include <arm_neon.h>
+#endif
+#if defined X86_SIMD_DISPATCH || defined NEON_DISPATCH
+#define SIMD_DISPATCH 1
+#endif
+
 #ifdef WORDS_BIGENDIAN
 #define BYTE_SWAP(x) (3 - x)
 #else
 #define BYTE_SWAP(x) x
 #endif
 
+#if defined __GNUC__
+#define RGB_SHIFT_IMPL static inline __attribute__((always_inline))
+#else
+#define RGB_SHIFT_IMPL static inline
+#endif
+/**
+ * Defines decoder <name> (prefix with static as needed) that calls
+ * <name>_impl() with the default RGB shifts passed as constants if the
+ * requested ones match (almost always the case). The always-inlined body is
+ * then compiled with the shifts and alpha mask folded, which lets the
+ * compiler vectorize the loop. Other shifts take the generic variant.
+ */
+#define DEFINE_RGB_SHIFT_SPECIALIZED(name) \
+void name(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, \
+                int gshift, int bshift) \
+{ \
+        if (rshift == DEFAULT_R_SHIFT && gshift == DEFAULT_G_SHIFT && bshift == DEFAULT_B_SHIFT) { \
+                name ## _impl(dst, src, dst_len, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT); \
+        } else { \
+                name ## _impl(dst, src, dst_len, rshift, gshift, bshift); \
+        } \
+}
+
 /**
  * @brief Converts v210 to UYVY
  * @param[out] dst     4-byte aligned output buffer where UYVY will be stored
@@ -208,8 +253,8 @@ static void vc_copylineYUYV(unsigned char * __restrict dst, const unsigned char
  * @param[in]  gshift  destination green shift
  * @param[in]  bshift  destination blue shift
  */
-static void
-vc_copyliner10k(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
+RGB_SHIFT_IMPL void
+vc_copyliner10k_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
                 int gshift, int bshift)
 {
         struct {
@@ -275,6 +320,7 @@ vc_copyliner10k(unsigned char * __restrict dst, const unsigned char * __restrict
                 len -= 4;
         }
 }
+static DEFINE_RGB_SHIFT_SPECIALIZED(vc_copyliner10k)
 
 static void
 vc_copyliner10ktoRG48(unsigned char * __restrict dst, const unsigned char * __restrict src, int dstlen, int rshift,
@@ -420,8 +466,8 @@ vc_copylineR12LtoRGB(unsigned char * __restrict dst, const unsigned char * __res
  * @param[in]  gshift  destination green shift
  * @param[in]  bshift  destination blue shift
  */
-static void
-vc_copylineR12L(unsigned char *dst, const unsigned char *src, int dstlen, int rshift,
+RGB_SHIFT_IMPL void
+vc_copylineR12L_impl(unsigned char *dst, const unsigned char *src, int dstlen, int rshift,
                 int gshift, int bshift)
 {
         assert((uintptr_t) dst % sizeof(uint32_t) == 0);
@@ -498,6 +544,7 @@ vc_copylineR12L(unsigned char *dst, const unsigned char *src, int dstlen, int rs
                 *d++ = alpha_mask | (r << rshift) | (g << gshift) | (b << bshift);
         }
 }
+static DEFINE_RGB_SHIFT_SPECIALIZED(vc_copylineR12L)
 
 /**
  * @brief Changes color channels' order in RGBA
@@ -840,7 +887,7 @@ void vc_copylineUYVYtoGrayscale(unsigned char * __restrict dst, const unsigned c
  * @brief Converts RGB to RGBA
  * @copydetails vc_copyliner10k
  */
-void vc_copylineRGBtoRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+RGB_SHIFT_IMPL void vc_copylineRGBtoRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
 {
         register unsigned int r, g, b;
         register uint32_t *d = (uint32_t *)(void *) dst;
@@ -854,6 +901,7 @@ void vc_copylineRGBtoRGBA(unsigned char * __restrict dst, const unsigned char *
                 *d++ = alpha_mask | (r << rshift) | (g << gshift) | (b << bshift);
         }
 }
+DEFINE_RGB_SHIFT_SPECIALIZED(vc_copylineRGBtoRGBA)
 
 /**
  * @brief Converts RGB(A) into UYVY
@@ -976,7 +1024,7 @@ static void vc_copylineUYVYtoRG48(unsigned char * __restrict dst, const unsigned
  * @param[out] dst     output buffer for RGBA
  * @param[in]  src     input buffer with UYVY
  */
-static void vc_copylineUYVYtoRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+RGB_SHIFT_IMPL void vc_copylineUYVYtoRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
                 int gshift, int bshift) {
         assert((uintptr_t) dst % sizeof(uint32_t) == 0);
         uint32_t *dst32 = (uint32_t *)(void *) dst;
@@ -1003,6 +1051,7 @@ static void vc_copylineUYVYtoRGBA(unsigned char * __restrict dst, const unsigned
                 *dst32++ = alpha_mask | r << rshift | g << gshift | b << bshift;
         }
 }
+static DEFINE_RGB_SHIFT_SPECIALIZED(vc_copylineUYVYtoRGBA)
 
 /**
  * @brief Converts UYVY to RGB using SSE.
@@ -1784,7 +1833,7 @@ static void vc_copylineY416toRGB(unsigned char * __restrict dst, const unsigned
         }
 }
 
-static void vc_copylineY416toRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+RGB_SHIFT_IMPL void vc_copylineY416toRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
                 int gshift, int bshift)
 {
         assert((uintptr_t) src % 2 == 0);
@@ -1809,6 +1858,7 @@ static void vc_copylineY416toRGBA(unsigned char * __restrict dst, const unsigned
                 *out++ = alpha_mask | r << rshift | g << gshift | b << bshift;
         }
 }
+static DEFINE_RGB_SHIFT_SPECIALIZED(vc_copylineY416toRGBA)
 
 static void vc_copylineRG48toR10k(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
                 int gshift, int bshift)
@@ -1847,7 +1897,7 @@ static void vc_copylineRG48toRGB(unsigned char * __restrict dst, const unsigned
         }
 }
 
-static void vc_copylineRG48toRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+RGB_SHIFT_IMPL void vc_copylineRG48toRGBA_impl(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
                 int gshift, int bshift)
 {
         assert((uintptr_t) dst % sizeof(uint32_t) == 0);
@@ -1858,6 +1908,7 @@ static void vc_copylineRG48toRGBA(unsigned char * __restrict dst, const unsigned
                 src += 6;
         }
 }
+static DEFINE_RGB_SHIFT_SPECIALIZED(vc_copylineRG48toRGBA)
 
 /**
  * @brief Converts RGB to UYVY.
@@ -2280,7 +2331,7 @@ void vc_memcpy(unsigned char * __restrict dst, const unsigned char * __restrict
         UNUSED(gshift);
         UNUSED(bshift);
 
-        memcpy(dst, src, dst_len);
+        ug_stream_copy(dst, src, dst_len);
 }
 
 static void vc_copylineRGBAtoR10k(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
@@ -2716,6 +2767,406 @@ static void vc_copylineY416toV210(unsigned char * __restrict dst, const unsigned
         }
 }
 
+#ifdef X86_SIMD_DISPATCH
+/*
+ * SIMD variants of some 10-bit line decoders. They are compiled with
+ * function-level target attributes so that generic (baseline x86-64) builds
+ * contain them, get_decoder_from_to() selects them according to CPUID.
+ * Full vectors are processed here, remaining pixels by the scalar version.
+ */
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512BW __attribute__((target("avx512f,avx512bw")))
+
+/// packs 3 bytes from every 32-bit word of v210 (already shifted to 8 bits)
+#define V210_TO_UYVY_SHUF \
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1
+
+/**
+ * shuffle masks for 2-source packing - every 32-bit word of source
+ * holds first 2 16-bit components in "t" and the third one in low half of "c";
+ * result has 12 16-bit components in order given by the output format.
+ */
+#define V210_TO_Y216_T1 2, 3, 0, 1, 4, 5, -1, -1, -1, -1, 6, 7, 10, 11, 8, 9
+#define V210_TO_Y216_C1 -1, -1, -1, -1, -1, -1, 0, 1, 4, 5, -1, -1, -1, -1, -1, -1
+#define V210_TO_Y216_T2 12, 13, -1, -1, -1, -1, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1
+#define V210_TO_Y216_C2 -1, -1, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+#define R10K_TO_RG48_T1 0, 1, 2, 3, -1, -1, 4, 5, 6, 7, -1, -1, 8, 9, 10, 11
+#define R10K_TO_RG48_C1 -1, -1, -1, -1, 0, 1, -1, -1, -1, -1, 4, 5, -1, -1, -1, -1
+#define R10K_TO_RG48_T2 -1, -1, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+#define R10K_TO_RG48_C2 8, 9, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1
+#define BYTE_SWAP_32_SHUF 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+#define DUP_LANE(...) __VA_ARGS__, __VA_ARGS__
+
+/// stores 2 lanes of 24 B (16 B from lo + 8 B from hi) as 48 contiguous bytes
+TARGET_AVX2 static inline void store_2x24_avx2(unsigned char *dst, __m256i lo, __m256i hi)
+{
+        _mm_storeu_si128((__m128i *)(void *) dst, _mm256_castsi256_si128(lo));
+        _mm_storel_epi64((__m128i *)(void *) (dst + 16), _mm256_castsi256_si128(hi));
+        _mm_storeu_si128((__m128i *)(void *) (dst + 24), _mm256_extracti128_si256(lo, 1));
+        _mm_storel_epi64((__m128i *)(void *) (dst + 40), _mm256_extracti128_si256(hi, 1));
+}
+
+/// @copydoc vc_copylinev210
+TARGET_AVX2 static void vc_copylinev210_avx2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i shuf = _mm256_setr_epi8(DUP_LANE(V210_TO_UYVY_SHUF));
+        const __m256i perm = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 0, 0);
+        const __m256i store_mask = _mm256_setr_epi32(-1, -1, -1, -1, -1, -1, 0, 0);
+        while (dst_len >= 24) {
+                __m256i w = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                __m256i b = _mm256_or_si256(_mm256_or_si256(
+                                        _mm256_and_si256(_mm256_srli_epi32(w, 2), _mm256_set1_epi32(0xFF)),
+                                        _mm256_and_si256(_mm256_srli_epi32(w, 4), _mm256_set1_epi32(0xFF00))),
+                                _mm256_and_si256(_mm256_srli_epi32(w, 6), _mm256_set1_epi32(0xFF0000)));
+                b = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(b, shuf), perm);
+                _mm256_maskstore_epi32((int *)(void *) dst, store_mask, b);
+                src += 32;
+                dst += 24;
+                dst_len -= 24;
+        }
+        vc_copylinev210(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/// @copydoc vc_copylinev210
+TARGET_AVX512BW static void vc_copylinev210_avx512(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m512i shuf = _mm512_broadcast_i32x4(_mm_setr_epi8(V210_TO_UYVY_SHUF));
+        const __m512i perm = _mm512_setr_epi32(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0, 0, 0, 0);
+        while (dst_len >= 48) {
+                __m512i w = _mm512_loadu_si512(src);
+                __m512i b = _mm512_or_si512(_mm512_or_si512(
+                                        _mm512_and_si512(_mm512_srli_epi32(w, 2), _mm512_set1_epi32(0xFF)),
+                                        _mm512_and_si512(_mm512_srli_epi32(w, 4), _mm512_set1_epi32(0xFF00))),
+                                _mm512_and_si512(_mm512_srli_epi32(w, 6), _mm512_set1_epi32(0xFF0000)));
+                b = _mm512_permutexvar_epi32(perm, _mm512_shuffle_epi8(b, shuf));
+                _mm512_mask_storeu_epi32(dst, 0x0FFF, b);
+                src += 64;
+                dst += 48;
+                dst_len -= 48;
+        }
+        vc_copylinev210_avx2(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/// @copydoc vc_copylinev210
+TARGET_AVX2 static void vc_copylineV210toY216_avx2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i t1 = _mm256_setr_epi8(DUP_LANE(V210_TO_Y216_T1));
+        const __m256i c1 = _mm256_setr_epi8(DUP_LANE(V210_TO_Y216_C1));
+        const __m256i t2 = _mm256_setr_epi8(DUP_LANE(V210_TO_Y216_T2));
+        const __m256i c2 = _mm256_setr_epi8(DUP_LANE(V210_TO_Y216_C2));
+        while (dst_len >= 48) {
+                __m256i w = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                // 1st and 2nd component of every word as 16-bit values, 3rd separately
+                __m256i t = _mm256_or_si256(
+                                _mm256_and_si256(_mm256_slli_epi32(w, 6), _mm256_set1_epi32(0xFFC0)),
+                                _mm256_and_si256(_mm256_slli_epi32(w, 12), _mm256_set1_epi32((int) 0xFFC00000)));
+                __m256i c = _mm256_and_si256(_mm256_srli_epi32(w, 14), _mm256_set1_epi32(0xFFC0));
+                store_2x24_avx2(dst,
+                                _mm256_or_si256(_mm256_shuffle_epi8(t, t1), _mm256_shuffle_epi8(c, c1)),
+                                _mm256_or_si256(_mm256_shuffle_epi8(t, t2), _mm256_shuffle_epi8(c, c2)));
+                src += 32;
+                dst += 48;
+                dst_len -= 48;
+        }
+        vc_copylineV210toY216(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/**
+ * Stores 4 lanes of 24 B (16 B from lo + 8 B from hi) as 96 contiguous bytes.
+ */
+TARGET_AVX512BW static inline void store_4x24_avx512(unsigned char *dst, __m512i lo, __m512i hi)
+{
+        // indices >= 16 select from hi
+        const __m512i idx1 = _mm512_setr_epi32(0, 1, 2, 3, 16, 17, 4, 5, 6, 7, 20, 21, 8, 9, 10, 11);
+        const __m512i idx2 = _mm512_setr_epi32(24, 25, 12, 13, 14, 15, 28, 29, 0, 0, 0, 0, 0, 0, 0, 0);
+        _mm512_storeu_si512(dst, _mm512_permutex2var_epi32(lo, idx1, hi));
+        _mm512_mask_storeu_epi32(dst + 64, 0x00FF, _mm512_permutex2var_epi32(lo, idx2, hi));
+}
+
+/// @copydoc vc_copylinev210
+TARGET_AVX512BW static void vc_copylineV210toY216_avx512(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m512i t1 = _mm512_broadcast_i32x4(_mm_setr_epi8(V210_TO_Y216_T1));
+        const __m512i c1 = _mm512_broadcast_i32x4(_mm_setr_epi8(V210_TO_Y216_C1));
+        const __m512i t2 = _mm512_broadcast_i32x4(_mm_setr_epi8(V210_TO_Y216_T2));
+        const __m512i c2 = _mm512_broadcast_i32x4(_mm_setr_epi8(V210_TO_Y216_C2));
+        while (dst_len >= 96) {
+                __m512i w = _mm512_loadu_si512(src);
+                __m512i t = _mm512_or_si512(
+                                _mm512_and_si512(_mm512_slli_epi32(w, 6), _mm512_set1_epi32(0xFFC0)),
+                                _mm512_and_si512(_mm512_slli_epi32(w, 12), _mm512_set1_epi32((int) 0xFFC00000)));
+                __m512i c = _mm512_and_si512(_mm512_srli_epi32(w, 14), _mm512_set1_epi32(0xFFC0));
+                store_4x24_avx512(dst,
+                                _mm512_or_si512(_mm512_shuffle_epi8(t, t1), _mm512_shuffle_epi8(c, c1)),
+                                _mm512_or_si512(_mm512_shuffle_epi8(t, t2), _mm512_shuffle_epi8(c, c2)));
+                src += 64;
+                dst += 96;
+                dst_len -= 96;
+        }
+        vc_copylineV210toY216_avx2(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/// @copydoc vc_copyliner10k
+TARGET_AVX2 static void vc_copyliner10ktoRG48_avx2(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m256i bswap = _mm256_setr_epi8(DUP_LANE(BYTE_SWAP_32_SHUF));
+        const __m256i t1 = _mm256_setr_epi8(DUP_LANE(R10K_TO_RG48_T1));
+        const __m256i c1 = _mm256_setr_epi8(DUP_LANE(R10K_TO_RG48_C1));
+        const __m256i t2 = _mm256_setr_epi8(DUP_LANE(R10K_TO_RG48_T2));
+        const __m256i c2 = _mm256_setr_epi8(DUP_LANE(R10K_TO_RG48_C2));
+        while (dst_len >= 48) {
+                // R10k is big-endian RRRRRRRR RRGGGGGG GGGGBBBB BBBBBBXX
+                __m256i w = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(const void *) src), bswap);
+                __m256i t = _mm256_or_si256(
+                                _mm256_and_si256(_mm256_srli_epi32(w, 16), _mm256_set1_epi32(0xFFC0)),
+                                _mm256_and_si256(_mm256_slli_epi32(w, 10), _mm256_set1_epi32((int) 0xFFC00000)));
+                __m256i c = _mm256_and_si256(_mm256_slli_epi32(w, 4), _mm256_set1_epi32(0xFFC0));
+                store_2x24_avx2(dst,
+                                _mm256_or_si256(_mm256_shuffle_epi8(t, t1), _mm256_shuffle_epi8(c, c1)),
+                                _mm256_or_si256(_mm256_shuffle_epi8(t, t2), _mm256_shuffle_epi8(c, c2)));
+                src += 32;
+                dst += 48;
+                dst_len -= 48;
+        }
+        vc_copyliner10ktoRG48(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/// @copydoc vc_copyliner10k
+TARGET_AVX512BW static void vc_copyliner10ktoRG48_avx512(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const __m512i bswap = _mm512_broadcast_i32x4(_mm_setr_epi8(BYTE_SWAP_32_SHUF));
+        const __m512i t1 = _mm512_broadcast_i32x4(_mm_setr_epi8(R10K_TO_RG48_T1));
+        const __m512i c1 = _mm512_broadcast_i32x4(_mm_setr_epi8(R10K_TO_RG48_C1));
+        const __m512i t2 = _mm512_broadcast_i32x4(_mm_setr_epi8(R10K_TO_RG48_T2));
+        const __m512i c2 = _mm512_broadcast_i32x4(_mm_setr_epi8(R10K_TO_RG48_C2));
+        while (dst_len >= 96) {
+                __m512i w = _mm512_shuffle_epi8(_mm512_loadu_si512(src), bswap);
+                __m512i t = _mm512_or_si512(
+                                _mm512_and_si512(_mm512_srli_epi32(w, 16), _mm512_set1_epi32(0xFFC0)),
+                                _mm512_and_si512(_mm512_slli_epi32(w, 10), _mm512_set1_epi32((int) 0xFFC00000)));
+                __m512i c = _mm512_and_si512(_mm512_slli_epi32(w, 4), _mm512_set1_epi32(0xFFC0));
+                store_4x24_avx512(dst,
+                                _mm512_or_si512(_mm512_shuffle_epi8(t, t1), _mm512_shuffle_epi8(c, c1)),
+                                _mm512_or_si512(_mm512_shuffle_epi8(t, t2), _mm512_shuffle_epi8(c, c2)));
+                src += 64;
+                dst += 96;
+                dst_len -= 96;
+        }
+        vc_copyliner10ktoRG48_avx2(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+#endif // defined X86_SIMD_DISPATCH
+
+#ifdef NEON_DISPATCH
+/*
+ * NEON variants of frequently used line decoders, AArch64 always has NEON so
+ * these are selected unconditionally. As with the x86 variants, the tail is
+ * processed by the scalar version.
+ */
+
+/// @copydoc vc_copylinev210
+static void vc_copylineYUYV_neon(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        while (dst_len >= 16) {
+                vst1q_u8(dst, vrev16q_u8(vld1q_u8(src)));
+                src += 16;
+                dst += 16;
+                dst_len -= 16;
+        }
+        vc_copylineYUYV(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/// @copydoc vc_copylinev210
+static void vc_copylinev210_neon(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        static const uint8_t shuf[16] = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0xFF, 0xFF, 0xFF, 0xFF };
+        const uint8x16_t idx = vld1q_u8(shuf);
+        while (dst_len >= 12) {
+                uint32x4_t w = vld1q_u32((const uint32_t *)(const void *) src);
+                uint32x4_t b = vorrq_u32(vorrq_u32(
+                                        vandq_u32(vshrq_n_u32(w, 2), vdupq_n_u32(0xFF)),
+                                        vandq_u32(vshrq_n_u32(w, 4), vdupq_n_u32(0xFF00))),
+                                vandq_u32(vshrq_n_u32(w, 6), vdupq_n_u32(0xFF0000)));
+                uint8x16_t packed = vqtbl1q_u8(vreinterpretq_u8_u32(b), idx);
+                vst1_u8(dst, vget_low_u8(packed));
+                vst1q_lane_u32((uint32_t *)(void *) (dst + 8), vreinterpretq_u32_u8(packed), 2);
+                src += 16;
+                dst += 12;
+                dst_len -= 12;
+        }
+        vc_copylinev210(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/// @copydoc vc_copylinev210
+static void vc_copylineUYVYtoV210_neon(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        static const uint8_t shuf_a[16] = { 0, 0xFF, 0xFF, 0xFF, 3, 0xFF, 0xFF, 0xFF, 6, 0xFF, 0xFF, 0xFF, 9, 0xFF, 0xFF, 0xFF };
+        const uint8x16_t idx_a = vld1q_u8(shuf_a);
+        // unused indices wrap over 0xFF, the bytes are masked out by hi_mask
+        const uint8x16_t idx_b = vaddq_u8(idx_a, vdupq_n_u8(1));
+        const uint8x16_t idx_c = vaddq_u8(idx_a, vdupq_n_u8(2));
+        const uint8x16_t hi_mask = vreinterpretq_u8_u32(vdupq_n_u32(0xFF));
+        // 16 B are read for 12 B processed, so the last group is left to the scalar version
+        while (dst_len >= 32) {
+                uint8x16_t in = vld1q_u8(src);
+                uint32x4_t a = vreinterpretq_u32_u8(vandq_u8(vqtbl1q_u8(in, idx_a), hi_mask));
+                uint32x4_t b = vreinterpretq_u32_u8(vandq_u8(vqtbl1q_u8(in, idx_b), hi_mask));
+                uint32x4_t c = vreinterpretq_u32_u8(vandq_u8(vqtbl1q_u8(in, idx_c), hi_mask));
+                uint32x4_t w = vorrq_u32(vorrq_u32(vshlq_n_u32(a, 2), vshlq_n_u32(b, 12)), vshlq_n_u32(c, 22));
+                vst1q_u32((uint32_t *)(void *) dst, w);
+                src += 12;
+                dst += 16;
+                dst_len -= 16;
+        }
+        vc_copylineUYVYtoV210(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/**
+ * Computes RGB of 16 pixels from 8 UYVY macropixels. Rec. 709 in 6-bit fixed
+ * point, same as vc_copylineUYVYtoRGB_SSE() (including its inaccuracies).
+ */
+static inline uint8x16x3_t uyvy_to_rgb_neon(uint8x8x4_t in)
+{
+        const int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(in.val[0])), vdupq_n_s16(128));
+        const int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(in.val[2])), vdupq_n_s16(128));
+        const int16x8_t rv = vmulq_n_s16(v, 115); // 1.793 << 6
+        const int16x8_t gv = vmulq_n_s16(v, 34);  // 0.534 << 6
+        const int16x8_t gu = vmulq_n_s16(u, 14);  // 0.213 << 6
+        const int16x8_t bu = vmulq_n_s16(u, 135); // 2.115 << 6
+        uint8x8_t r[2];
+        uint8x8_t g[2];
+        uint8x8_t b[2];
+        for (int i = 0; i < 2; ++i) {
+                int16x8_t y = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(in.val[1 + 2 * i])), vdupq_n_s16(16));
+                y = vmulq_n_s16(y, 74); // 1.164 << 6
+                // saturating narrow clamps to 0..255
+                r[i] = vqshrun_n_s16(vqaddq_s16(y, rv), 6);
+                g[i] = vqshrun_n_s16(vqsubq_s16(vqsubq_s16(y, gv), gu), 6);
+                b[i] = vqshrun_n_s16(vqaddq_s16(y, bu), 6);
+        }
+        // interleave even (Y0) and odd (Y1) pixels
+        uint8x8x2_t rr = vzip_u8(r[0], r[1]);
+        uint8x8x2_t gg = vzip_u8(g[0], g[1]);
+        uint8x8x2_t bb = vzip_u8(b[0], b[1]);
+        uint8x16x3_t ret;
+        ret.val[0] = vcombine_u8(rr.val[0], rr.val[1]);
+        ret.val[1] = vcombine_u8(gg.val[0], gg.val[1]);
+        ret.val[2] = vcombine_u8(bb.val[0], bb.val[1]);
+        return ret;
+}
+
+/**
+ * @brief Converts UYVY to RGB using NEON.
+ * @copydetails vc_copylineUYVYtoRGB_SSE
+ */
+static void vc_copylineUYVYtoRGB_neon(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        while (dst_len >= 48) {
+                vst3q_u8(dst, uyvy_to_rgb_neon(vld4_u8(src)));
+                src += 32;
+                dst += 48;
+                dst_len -= 48;
+        }
+        vc_copylineUYVYtoRGB(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/**
+ * @brief Converts UYVY to RGBA using NEON.
+ * @copydetails vc_copylineUYVYtoRGB_SSE
+ * Only byte-aligned shifts are vectorized, others are passed to scalar version.
+ */
+static void vc_copylineUYVYtoRGBA_neon(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        if (rshift % 8 == 0 && gshift % 8 == 0 && bshift % 8 == 0 &&
+                        rshift != gshift && rshift != bshift && gshift != bshift) {
+                while (dst_len >= 64) {
+                        uint8x16x3_t rgb = uyvy_to_rgb_neon(vld4_u8(src));
+                        uint8x16x4_t out = { { vdupq_n_u8(0xFF), vdupq_n_u8(0xFF), vdupq_n_u8(0xFF), vdupq_n_u8(0xFF) } };
+                        out.val[rshift / 8] = rgb.val[0];
+                        out.val[gshift / 8] = rgb.val[1];
+                        out.val[bshift / 8] = rgb.val[2];
+                        vst4q_u8(dst, out);
+                        src += 32;
+                        dst += 64;
+                        dst_len -= 64;
+                }
+        }
+        vc_copylineUYVYtoRGBA(dst, src, dst_len, rshift, gshift, bshift);
+}
+#endif // defined NEON_DISPATCH
+
+#ifdef SIMD_DISPATCH
+enum simd_isa {
+        SIMD_AVX2,
+        SIMD_AVX512BW,
+        SIMD_NEON,
+};
+
+static const struct {
+        decoder_t decoder;
+        codec_t in;
+        codec_t out;
+        enum simd_isa isa;
+} simd_decoders[] = { // preferred first
+#ifdef X86_SIMD_DISPATCH
+        { vc_copylinev210_avx512,        v210,  UYVY, SIMD_AVX512BW },
+        { vc_copylinev210_avx2,          v210,  UYVY, SIMD_AVX2 },
+        { vc_copylineV210toY216_avx512,  v210,  Y216, SIMD_AVX512BW },
+        { vc_copylineV210toY216_avx2,    v210,  Y216, SIMD_AVX2 },
+        { vc_copyliner10ktoRG48_avx512,  R10k,  RG48, SIMD_AVX512BW },
+        { vc_copyliner10ktoRG48_avx2,    R10k,  RG48, SIMD_AVX2 },
+#endif
+#ifdef NEON_DISPATCH
+        { vc_copylineYUYV_neon,          YUYV,  UYVY, SIMD_NEON },
+        { vc_copylineYUYV_neon,          UYVY,  YUYV, SIMD_NEON },
+        { vc_copylinev210_neon,          v210,  UYVY, SIMD_NEON },
+        { vc_copylineUYVYtoV210_neon,    UYVY,  v210, SIMD_NEON },
+        { vc_copylineUYVYtoRGB_neon,     UYVY,  RGB,  SIMD_NEON },
+        { vc_copylineUYVYtoRGBA_neon,    UYVY,  RGBA, SIMD_NEON },
+#endif
+};
+
+static bool simd_isa_supported(enum simd_isa isa) {
+        switch (isa) {
+#ifdef X86_SIMD_DISPATCH
+        case SIMD_AVX2:
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2");
+        case SIMD_AVX512BW:
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+#ifdef NEON_DISPATCH
+        case SIMD_NEON:
+                return true;
+#endif
+        default:
+                return false;
+        }
+}
+
+static decoder_t get_simd_decoder(codec_t in, codec_t out) {
+        for (unsigned i = 0; i < sizeof simd_decoders / sizeof simd_decoders[0]; ++i) {
+                if (simd_decoders[i].in == in && simd_decoders[i].out == out &&
+                                simd_isa_supported(simd_decoders[i].isa)) {
+                        return simd_decoders[i].decoder;
+                }
+        }
+        return NULL;
+}
+#endif // defined SIMD_DISPATCH
+
 struct decoder_item {
         decoder_t decoder;
         codec_t in;
@@ -2793,6 +3244,13 @@ decoder_t get_decoder_from_to(codec_t in, codec_t out) {
                 return vc_memcpy;
         }
 
+#ifdef SIMD_DISPATCH
+        decoder_t simd = get_simd_decoder(in, out);
+        if (simd != NULL) {
+                return simd;
+        }
+#endif
+
         for (unsigned int i = 0; i < sizeof(decoders)/sizeof(struct decoder_item); ++i) {
                 if (decoders[i].in == in && decoders[i].out == out) {
                         return decoders[i].decoder;
@@ -2802,19 +3260,145 @@ decoder_t get_decoder_from_to(codec_t in, codec_t out) {
         return NULL;
 }
 
+#define COST_MEASURE_WIDTH 1920
+#define COST_MEASURE_HEIGHT 32
+#define COST_MEASURE_ROUNDS 3
+#define COST_CACHE_FILE "ultragrid-conv-cost.txt"
+
+/**
+ * Measures cost of a line decoder.
+ *
+ * @returns best of COST_MEASURE_ROUNDS rounds in ns per pixel, -1 if there
+ * is no decoder from in to out
+ */
+double measure_decoder_cost(codec_t in, codec_t out, int width, int height)
+{
+        decoder_t decode = get_decoder_from_to(in, out);
+        if (decode == NULL) {
+                return -1;
+        }
+        const int in_linesize = vc_get_linesize(width, in);
+        const int out_linesize = vc_get_linesize(width, out);
+        unsigned char *in_buf = malloc((size_t) in_linesize * height + MAX_PADDING);
+        unsigned char *out_buf = malloc((size_t) out_linesize * height + MAX_PADDING);
+        for (size_t i = 0; i < (size_t) in_linesize * height + MAX_PADDING; ++i) {
+                in_buf[i] = i * 7919U >> 3U;
+        }
+
+        time_ns_t best = INT64_MAX;
+        for (int round = 0; round < COST_MEASURE_ROUNDS; ++round) {
+                time_ns_t start = get_time_in_ns();
+                for (int y = 0; y < height; ++y) {
+                        decode(out_buf + (size_t) y * out_linesize, in_buf + (size_t) y * in_linesize,
+                                        out_linesize, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+                }
+                best = MIN(best, get_time_in_ns() - start);
+        }
+        free(in_buf);
+        free(out_buf);
+
+        return (double) best / ((double) width * height);
+}
+
+/// measured ns/pixel, 0 - unknown (cost selection off or not measured)
+static double conv_cost[VIDEO_CODEC_COUNT][VIDEO_CODEC_COUNT];
+static pthread_once_t conv_cost_once = PTHREAD_ONCE_INIT;
+
+static bool load_conv_cost(const char *path) {
+        FILE *f = fopen(path, "r");
+        if (f == NULL) {
+                return false;
+        }
+        char line[1024];
+        int loaded = 0;
+        while (fgets(line, sizeof line, f) != NULL) {
+                char in_name[128];
+                char out_name[128];
+                double cost = 0;
+                if (line[0] == '#' || sscanf(line, "%127s %127s %lf", in_name, out_name, &cost) != 3) {
+                        continue;
+                }
+                codec_t in = get_codec_from_name(in_name);
+                codec_t out = get_codec_from_name(out_name);
+                if (in != VIDEO_CODEC_NONE && out != VIDEO_CODEC_NONE && cost > 0) {
+                        conv_cost[in][out] = cost;
+                        loaded += 1;
+                }
+        }
+        fclose(f);
+        return loaded > 0;
+}
+
+static void measure_conv_cost(const char *path) {
+        log_msg(LOG_LEVEL_NOTICE, "Measuring pixel format conversion costs...\n");
+        for (unsigned int i = 0; i < sizeof decoders / sizeof decoders[0]; ++i) {
+                double cost = measure_decoder_cost(decoders[i].in, decoders[i].out,
+                                COST_MEASURE_WIDTH, COST_MEASURE_HEIGHT);
+                conv_cost[decoders[i].in][decoders[i].out] = MAX(cost, 1e-6);
+        }
+        FILE *f = fopen(path, "w");
+        if (f == NULL) {
+                log_msg(LOG_LEVEL_WARNING, "Cannot write conversion cost cache %s\n", path);
+                return;
+        }
+        fprintf(f, "# <in> <out> <ns per pixel>\n");
+        for (unsigned int i = 0; i < sizeof decoders / sizeof decoders[0]; ++i) {
+                fprintf(f, "%s %s %f\n", get_codec_name(decoders[i].in),
+                                get_codec_name(decoders[i].out),
+                                conv_cost[decoders[i].in][decoders[i].out]);
+        }
+        fclose(f);
+}
+
+ADD_TO_PARAM("conv-cost", "* conv-cost[=measure]\n"
+                "  Select among pixel formats of equal quality by measured conversion\n"
+                "  cost (cached in temporary directory, \"measure\" forces new measurement)\n");
+static void init_conv_cost(void) {
+        const char *param = get_commandline_param("conv-cost");
+        if (param == NULL) {
+                return;
+        }
+        char path[MAX_PATH_SIZE];
+        snprintf(path, sizeof path, "%s%s", get_temp_dir(), COST_CACHE_FILE);
+        if (strcmp(param, "measure") == 0 || !load_conv_cost(path)) {
+                measure_conv_cost(path);
+        }
+}
+
+/**
+ * @returns measured cost of conversion in ns per pixel, 0 if not known
+ * (selection by cost not enabled or there is no such decoder)
+ */
+double get_decoder_cost(codec_t in, codec_t out) {
+        pthread_once(&conv_cost_once, init_conv_cost);
+        return conv_cost[in][out];
+}
+
+struct best_decoder_cmp_data {
+        codec_t in;
+        struct pixfmt_desc src_desc;
+};
+
 // less is better
-static QSORT_S_COMP_DEFINE(best_decoder_cmp, a, b, desc_src) {
+static QSORT_S_COMP_DEFINE(best_decoder_cmp, a, b, cmp_data) {
         codec_t codec_a = *(const codec_t *) a;
         codec_t codec_b = *(const codec_t *) b;
-        struct pixfmt_desc *src_desc = desc_src;
+        struct best_decoder_cmp_data *data = cmp_data;
         struct pixfmt_desc desc_a = get_pixfmt_desc(codec_a);
         struct pixfmt_desc desc_b = get_pixfmt_desc(codec_b);
 
-        int ret = compare_pixdesc(&desc_a, &desc_b, src_desc);
+        int ret = compare_pixdesc(&desc_a, &desc_b, &data->src_desc);
         if (ret != 0) {
                 return ret;
         }
 
+        // same quality - prefer the cheaper one if measured
+        double cost_a = get_decoder_cost(data->in, codec_a);
+        double cost_b = get_decoder_cost(data->in, codec_b);
+        if (cost_a > 0 && cost_b > 0 && cost_a != cost_b) {
+                return cost_a < cost_b ? -1 : 1;
+        }
+
         return (int) codec_a - (int) codec_b;
 }
 
@@ -2843,8 +3427,8 @@ decoder_t get_best_decoder_from(codec_t in, const codec_t *out_candidates, codec
         if (count == 0) {
                 return NULL;
         }
-        struct pixfmt_desc src_desc = get_pixfmt_desc(in);
-        qsort_s(candidates, count, sizeof(codec_t), best_decoder_cmp, &src_desc);
+        struct best_decoder_cmp_data cmp_data = { in, get_pixfmt_desc(in) };
+        qsort_s(candidates, count, sizeof(codec_t), best_decoder_cmp, &cmp_data);
         *out = candidates[0];
         return get_decoder_from_to(in, *out);
 }
@@ -97,6 +97,8 @@ typedef decoder_func_t *decoder_t;
 
 decoder_t        get_decoder_from_to(codec_t in, codec_t out) __attribute__((const));
 decoder_t        get_best_decoder_from(codec_t in, const codec_t *out_candidates, codec_t *out);
+double           get_decoder_cost(codec_t in, codec_t out);
+double           measure_decoder_cost(codec_t in, codec_t out, int width, int height);
 
 decoder_func_t vc_copylineRGBA;
 decoder_func_t vc_copylineToRGBA_inplace;
@@ -55,8 +55,10 @@
 #include "rtp/ptime.h"
 #include "rtp/pbuf.h"
 #include "rtp/audio_decoders.h"
+#include "rtp/av_sync.h"
 #include "audio/audio_playback.h"
 #include "audio/codec.h"
+#include "audio/drift_compensator.hpp"
 #include "audio/resampler.hpp"
 #include "audio/types.h"
 #include "audio/utils.h"
@@ -65,6 +67,7 @@
 #include "ug_runtime_error.hpp"
 #include "utils/color_out.h"
 #include "utils/macros.h"
+#include "utils/metrics.h"
 #include "utils/packet_counter.h"
 #include "utils/worker.h"
 
@@ -85,7 +88,6 @@ using std::chrono::seconds;
 using std::chrono::steady_clock;
 using std::fixed;
 using std::hex;
-using std::map;
 using std::ostringstream;
 using std::pair;
 using std::setprecision;
@@ -195,6 +197,8 @@ struct state_audio_decoder {
         struct timeval t0;
 
         struct packet_counter *packet_counter;
+        struct metric *metric_received; ///< bytes
+        struct metric *metric_lost;     ///< bytes
 
         unsigned int channel_remapping:1;
         struct channel_map channel_map;
@@ -227,6 +231,9 @@ struct state_audio_decoder {
 
         audio_frame2 resample_remainder;
         std::atomic_uint64_t req_resample_to{0}; // hi 32 - numerator; lo 32 - denominator
+
+        bool drift_fix = false; ///< compensate clock drift from playback buffer occupancy
+        audio_drift_compensator drift_compensator;
 };
 
 constexpr double VOL_UP = 1.1;
@@ -277,6 +284,9 @@ static void audio_decoder_process_message(struct module *m)
 
 ADD_TO_PARAM("soft-resample", "* soft-resample=<num>/<den>\n"
                 "  Resample to specified sampling rate, eg. 12288128/256 for 48000.5 Hz\n");
+ADD_TO_PARAM("audio-drift-fix", "* audio-drift-fix\n"
+                "  Compensate sender/playback device clock drift by adaptive resampling\n"
+                "  driven by the playback buffer occupancy (if the device supports that)\n");
 
 void *audio_decoder_init(char *audio_channel_map, const char *audio_scale, const char *encryption, audio_playback_ctl_t c, void *p_state, struct module *parent)
 {
@@ -308,9 +318,28 @@ void *audio_decoder_init(char *audio_channel_map, const char *audio_scale, const
                 assert(strchr(val, '/') != nullptr);
                 s->req_resample_to = strtoll(val, NULL, 0) << 32LLU | strtoll(strchr(val, '/') + 1, NULL, 0);
         }
+        if (get_commandline_param("audio-drift-fix") != nullptr) {
+                s->drift_fix = true;
+#ifdef HAVE_SOXR
+                // SoX changes the ratio smoothly, Speex resampler is recreated
+                if (commandline_params.find("resampler") == commandline_params.end()) {
+                        MSG(INFO, "Using SoxR resampler by default when audio drift fix is enabled.\n");
+                        commandline_params["resampler"] = "soxr";
+                        s->resampler = audio_frame2_resampler();
+                }
+#endif
+                if (s->resampler.align_bps(2) <= 0) {
+                        MSG(WARNING, "Audio drift fix disabled - no resampler available!\n");
+                        s->drift_fix = false;
+                }
+        }
 
         gettimeofday(&s->t0, NULL);
         s->packet_counter = packet_counter_init(0);
+        s->metric_received = metric_register(METRIC_COUNTER, "ug_audio_dec_received_bytes",
+                        "Received audio bytes.", nullptr);
+        s->metric_lost = metric_register(METRIC_COUNTER, "ug_audio_dec_lost_bytes",
+                        "Lost audio bytes (before FEC).", nullptr);
 
         s->audio_decompress = NULL;
 
@@ -443,6 +472,8 @@ void audio_decoder_destroy(void *state)
         assert(s->magic == AUDIO_DECODER_MAGIC);
 
         packet_counter_destroy(s->packet_counter);
+        metric_unregister(s->metric_received);
+        metric_unregister(s->metric_lost);
         audio_codec_done(s->audio_decompress);
 
         if (s->dec_funcs) {
@@ -568,10 +599,51 @@ static bool audio_decoder_reconfigure(struct state_audio_decoder *decoder, struc
         }
 
         decoder->resample_remainder = {};
+        if (decoder->drift_fix) {
+                decoder->drift_compensator.reset();
+                decoder->req_resample_to = 0;
+        }
         return true;
 }
 
-static bool audio_fec_decode(struct pbuf_audio_data *s, vector<pair<vector<char>, map<int, int>>> &fec_data, uint32_t fec_params, audio_frame2 &received_frame)
+/**
+ * Updates the requested resampling ratio according to the playback buffer
+ * occupancy if audio-drift-fix is enabled.
+ */
+static void audio_drift_fix_update(struct state_audio_decoder *decoder, int sample_rate)
+{
+        struct audio_playback_buffer_status status;
+        size_t len = sizeof status;
+        if (!decoder->audio_playback_ctl_func(decoder->audio_playback_state, AUDIO_PLAYBACK_CTL_QUERY_BUFFER, &status, &len)) {
+                return;
+        }
+        if (!decoder->drift_compensator.update(status.fill, status.target, sample_rate,
+                                get_time_in_ns() / NS_IN_SEC_DBL)) {
+                return;
+        }
+        constexpr unsigned long long den = 1U << 8U;
+        const auto num = (unsigned long long) llround(sample_rate * decoder->drift_compensator.get_ratio() * den);
+        decoder->req_resample_to = num << ADEC_CH_RATE_SHIFT | den;
+        MSG(VERBOSE, "Drift fix: buffer %d/%d frames, resampling to %.3f Hz\n",
+                        status.fill, status.target, (double) num / den);
+}
+
+/**
+ * Reports the expected playout time of the frame to A/V sync - the currently
+ * buffered audio is played first (if the device can tell its amount).
+ */
+static void audio_av_sync_report(struct state_audio_decoder *decoder, uint32_t ssrc, uint32_t rtp_ts, int sample_rate)
+{
+        time_ns_t presentation_time = get_time_in_ns();
+        struct audio_playback_buffer_status status;
+        size_t len = sizeof status;
+        if (decoder->audio_playback_ctl_func(decoder->audio_playback_state, AUDIO_PLAYBACK_CTL_QUERY_BUFFER, &status, &len)) {
+                presentation_time += (time_ns_t) status.fill * NS_IN_SEC / sample_rate;
+        }
+        av_sync_report(AV_SYNC_AUDIO, ssrc, rtp_ts, 90000, presentation_time);
+}
+
+static bool audio_fec_decode(struct pbuf_audio_data *s, vector<pair<vector<char>, fec_ranges>> &fec_data, uint32_t fec_params, audio_frame2 &received_frame)
 {
         struct state_audio_decoder *decoder = s->decoder;
         fec_desc fec_desc { FEC_RS, fec_params >> 19U, (fec_params >> 6U) & 0x1FFFU, fec_params & 0x3F };
@@ -591,6 +663,7 @@ static bool audio_fec_decode(struct pbuf_audio_data *s, vector<pair<vector<char>
         int channel = 0;
         for (auto & c : fec_data) {
                 char *out = nullptr;
+                fec_ranges_normalize(c.second);
                 int out_len = 0;
                 if (decoder->fec_state->decode(c.first.data(), c.first.size(), &out, &out_len, c.second)) {
                         if (!desc) {
@@ -624,6 +697,28 @@ static bool audio_fec_decode(struct pbuf_audio_data *s, vector<pair<vector<char>
         return true;
 }
 
+/**
+ * Splits received PT_AUDIO_BUNDLE data (channel lengths followed by the
+ * channels, see audio_payload_hdr_t) to received_frame channels.
+ */
+static bool audio_bundle_unpack(const vector<char> &bundle, int ch_count, audio_frame2 &received_frame)
+{
+        const size_t lengths_len = ch_count * sizeof(uint32_t);
+        size_t pos = lengths_len;
+        for (int i = 0; i < ch_count; ++i) {
+                uint32_t len = 0;
+                memcpy(&len, bundle.data() + i * sizeof(uint32_t), sizeof len);
+                len = ntohl(len);
+                if (pos + len > bundle.size()) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Malformed audio bundle!\n");
+                        return false;
+                }
+                received_frame.replace(i, 0, bundle.data() + pos, len);
+                pos += len;
+        }
+        return true;
+}
+
 int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_stats *)
 {
         struct pbuf_audio_data *s = (struct pbuf_audio_data *) pbuf_data;
@@ -651,8 +746,11 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                         decoder->saved_desc.bps,
                         decoder->saved_desc.sample_rate);
         received_frame.set_timestamp(cdata->data->ts);
-        vector<pair<vector<char>, map<int, int>>> fec_data;
+        const uint32_t ssrc = cdata->data->ssrc;
+        vector<pair<vector<char>, fec_ranges>> fec_data;
         uint32_t fec_params = 0;
+        vector<char> bundle;
+        bool bundle_lengths_received = false; ///< bundle is unusable without channel lengths
 
         while (cdata != NULL) {
                 char *data;
@@ -733,11 +831,28 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                         decoder->packet_counter = packet_counter_init(input_channels);
                 }
 
-                if (PT_AUDIO_HAS_FEC(pt)) {
+                if (PT_AUDIO_IS_BUNDLE(pt)) {
+                        int bps = (ntohl(audio_hdr[3]) >> 26) / 8;
+                        uint32_t audio_tag = ntohl(audio_hdr[4]);
+
+                        if (!audio_decoder_reconfigure(decoder, s, received_frame, input_channels, bps, sample_rate, audio_tag)) {
+                                return FALSE;
+                        }
+                        if (buffer_len < input_channels * sizeof(uint32_t) || offset > buffer_len || length > buffer_len - offset) {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Malformed audio bundle packet!\n");
+                                return FALSE;
+                        }
+                        bundle.resize(buffer_len);
+                        memcpy(bundle.data() + offset, data, length);
+                        if (offset == 0 && length >= input_channels * sizeof(uint32_t)) {
+                                bundle_lengths_received = true;
+                        }
+                        channel = 0; // whole bundle is counted as a single substream
+                } else if (PT_AUDIO_HAS_FEC(pt)) {
                         fec_data.resize(input_channels);
                         fec_data[channel].first.resize(buffer_len);
                         fec_params = ntohl(audio_hdr[3]);
-                        fec_data[channel].second[offset] = length;
+                        fec_data[channel].second.emplace_back(offset, length);
                         memcpy(fec_data[channel].first.data() + offset, data, length);
                 } else {
                         int bps = (ntohl(audio_hdr[3]) >> 26) / 8;
@@ -767,6 +882,16 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
 
         decoder->summary.update(bufnum);
 
+        if (!bundle.empty()) {
+                if (!bundle_lengths_received) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Audio bundle header lost, dropping frame.\n");
+                        return FALSE;
+                }
+                if (!audio_bundle_unpack(bundle, input_channels, received_frame)) {
+                        return FALSE;
+                }
+        }
+
         if (fec_params != 0) {
                 if (!audio_fec_decode(s, fec_data, fec_params, received_frame)) {
                         return FALSE;
@@ -779,6 +904,13 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                 return FALSE;
         }
 
+        if (decoder->drift_fix) {
+                audio_drift_fix_update(decoder, s->buffer.sample_rate);
+        }
+        if (av_sync_enabled()) {
+                audio_av_sync_report(decoder, ssrc, received_frame.get_timestamp(), s->buffer.sample_rate);
+        }
+
         // Perform a variable rate resample if any output device has requested it
         if (decoder->req_resample_to != 0 || s->buffer.sample_rate != decompressed.get_sample_rate()) {
                 int resampler_bps = decoder->resampler.align_bps(decompressed.get_bps());
@@ -880,6 +1012,8 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                 d->bytes_received = packet_counter_get_total_bytes(decoder->packet_counter);
                 d->bytes_expected = packet_counter_get_all_bytes(decoder->packet_counter);
                 d->muted_receiver = decoder->muted;
+                metric_inc(decoder->metric_received, d->bytes_received);
+                metric_inc(decoder->metric_lost, std::max(d->bytes_expected - d->bytes_received, 0L));
 
                 task_run_async_detached(adec_compute_and_print_stats, d);
 
@@ -0,0 +1,200 @@
+/**
+ * @file   rtp/av_sync.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // defined HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <mutex>
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/av_sync.h"
+
+#define MOD_NAME "[av_sync] "
+
+using std::map;
+using std::mutex;
+using std::unique_lock;
+
+ADD_TO_PARAM("av-sync", "* av-sync[=<bias_ms>]\n"
+                "  Synchronize received audio and video automatically using RTCP sender\n"
+                "  reports, optionally keeping audio <bias_ms> behind video. Overrides\n"
+                "  manually set A/V delay.\n");
+
+namespace {
+constexpr time_ns_t WINDOW = 2 * NS_IN_SEC; ///< measurement interval
+constexpr time_ns_t SETTLE = 1 * NS_IN_SEC; ///< let the frames with old delay drain
+constexpr time_ns_t SR_TIMEOUT = 30 * NS_IN_SEC;
+constexpr int MIN_SAMPLES = 10;
+constexpr double HYSTERESIS_MS = 10;
+constexpr int MAX_DELAY_MS = 2000;
+constexpr long long SECS_BETWEEN_1900_1970 = 2208988800LL;
+
+struct sender_report {
+        uint32_t rtp_ts;
+        double ntp_ns;      ///< sender wall clock (Unix epoch) corresponding to rtp_ts
+        time_ns_t received; ///< local time
+};
+
+struct stream_state {
+        uint32_t ssrc = 0;
+        double latency_sum = 0; ///< sum of (local presentation - sender time)
+        int count = 0;
+};
+
+struct state_av_sync {
+        mutex lock;
+        map<uint32_t, sender_report> sr;
+        stream_state streams[2];
+        time_ns_t window_start = 0;
+        time_ns_t settle_until = 0;
+};
+
+state_av_sync *get_state() {
+        static state_av_sync s;
+        return &s;
+}
+
+int get_bias_ms() {
+        static const int bias = [] {
+                const char *val = get_commandline_param("av-sync");
+                return val != nullptr ? atoi(val) : 0;
+        }();
+        return bias;
+}
+
+void reset_window(state_av_sync *s, time_ns_t now) {
+        for (auto &st : s->streams) {
+                st.latency_sum = 0;
+                st.count = 0;
+        }
+        s->window_start = now;
+}
+
+/**
+ * Compares average latencies of both streams and delays the one that is ahead.
+ */
+void evaluate(state_av_sync *s, time_ns_t now) {
+        const stream_state &a = s->streams[AV_SYNC_AUDIO];
+        const stream_state &v = s->streams[AV_SYNC_VIDEO];
+        const double lat_a = a.latency_sum / a.count;
+        const double lat_v = v.latency_sum / v.count;
+        // currently applied delay is already included in the measured latencies
+        const double change_ms = (lat_v - lat_a) / NS_IN_MS + get_bias_ms();
+        MSG(VERBOSE, "audio latency %.2f ms, video latency %.2f ms (if the clocks are synchronized)\n",
+                        lat_a / NS_IN_MS, lat_v / NS_IN_MS);
+        reset_window(s, now);
+        if (std::fabs(change_ms) < HYSTERESIS_MS) {
+                return;
+        }
+        const int delay = std::clamp(get_audio_delay() + (int) lround(change_ms),
+                        -MAX_DELAY_MS, MAX_DELAY_MS);
+        if (delay == get_audio_delay()) {
+                return;
+        }
+        set_audio_delay(delay);
+        s->settle_until = now + SETTLE;
+}
+} // end of anonymous namespace
+
+bool av_sync_enabled(void)
+{
+        static const bool enabled = get_commandline_param("av-sync") != nullptr;
+        return enabled;
+}
+
+void av_sync_put_sr(uint32_t ssrc, uint32_t ntp_sec, uint32_t ntp_frac, uint32_t rtp_ts)
+{
+        if (!av_sync_enabled()) {
+                return;
+        }
+        state_av_sync *s = get_state();
+        const time_ns_t now = get_time_in_ns();
+        unique_lock<mutex> lk(s->lock);
+        for (auto it = s->sr.begin(); it != s->sr.end(); ) { // remove gone senders
+                it = now - it->second.received > SR_TIMEOUT ? s->sr.erase(it) : std::next(it);
+        }
+        s->sr[ssrc] = { rtp_ts, (ntp_sec - SECS_BETWEEN_1900_1970) * NS_IN_SEC_DBL
+                + ntp_frac * (NS_IN_SEC_DBL / 4294967296.0), now };
+}
+
+void av_sync_report(enum av_sync_stream stream, uint32_t ssrc, uint32_t rtp_ts,
+                int clock_rate, time_ns_t presentation_time)
+{
+        if (!av_sync_enabled()) {
+                return;
+        }
+        state_av_sync *s = get_state();
+        const time_ns_t now = get_time_in_ns();
+        unique_lock<mutex> lk(s->lock);
+        auto it = s->sr.find(ssrc);
+        if (it == s->sr.end()) { // no SR received yet
+                return;
+        }
+        stream_state &st = s->streams[stream];
+        if (st.ssrc != ssrc) {
+                MSG(VERBOSE, "Using %s stream 0x%08" PRIx32 ".\n",
+                                stream == AV_SYNC_AUDIO ? "audio" : "video", ssrc);
+                st.ssrc = ssrc;
+                reset_window(s, now);
+        }
+        if (now < s->settle_until) {
+                s->window_start = now;
+                return;
+        }
+        const double sender_time = it->second.ntp_ns
+                + (int32_t) (rtp_ts - it->second.rtp_ts) * (NS_IN_SEC_DBL / clock_rate);
+        st.latency_sum += presentation_time - sender_time;
+        st.count += 1;
+
+        if (now - s->window_start >= WINDOW) {
+                if (s->streams[AV_SYNC_AUDIO].count >= MIN_SAMPLES
+                                && s->streams[AV_SYNC_VIDEO].count >= MIN_SAMPLES) {
+                        evaluate(s, now);
+                } else {
+                        reset_window(s, now);
+                }
+        }
+}
@@ -0,0 +1,82 @@
+/**
+ * @file   rtp/av_sync.h
+ *
+ * Automatic audio/video synchronization. RTP timestamps of both received
+ * streams are mapped to the sender wall clock using RTCP sender reports and
+ * compared with the local presentation time. The stream that is ahead is then
+ * delayed with set_audio_delay() so that no latency is added to the other one.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_AV_SYNC_H_6E2A4C1D_93B7_4F58_A0D2_7C1E5B8F3A94
+#define RTP_AV_SYNC_H_6E2A4C1D_93B7_4F58_A0D2_7C1E5B8F3A94
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stdint.h>
+#else
+#include <cstdint>
+#endif
+
+#include "tv.h" // time_ns_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum av_sync_stream {
+        AV_SYNC_AUDIO,
+        AV_SYNC_VIDEO,
+};
+
+/// @returns true if enabled by "--param av-sync"
+bool av_sync_enabled(void);
+/**
+ * Stores NTP <-> RTP timestamp mapping of a sender (RTCP SR).
+ */
+void av_sync_put_sr(uint32_t ssrc, uint32_t ntp_sec, uint32_t ntp_frac, uint32_t rtp_ts);
+/**
+ * Reports the time when the data with given RTP timestamp are presented.
+ *
+ * @param clock_rate         RTP clock rate of the stream (90000 for UltraGrid native)
+ * @param presentation_time  local time as returned by get_time_in_ns()
+ */
+void av_sync_report(enum av_sync_stream stream, uint32_t ssrc, uint32_t rtp_ts,
+                int clock_rate, time_ns_t presentation_time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined RTP_AV_SYNC_H_6E2A4C1D_93B7_4F58_A0D2_7C1E5B8F3A94
@@ -43,6 +43,7 @@
 #include "config_win32.h"
 #endif
 
+#include <algorithm>
 #include <string>
 
 #include "debug.h"
@@ -126,6 +127,72 @@ fec *fec::create_from_desc(struct fec_desc desc) noexcept
 
 }
 
+void fec_ranges_normalize(fec_ranges &ranges)
+{
+        if (ranges.size() < 2) {
+                return;
+        }
+        // packets are usually passed from pbuf in descending order
+        if (std::is_sorted(ranges.rbegin(), ranges.rend())) {
+                std::reverse(ranges.begin(), ranges.end());
+        } else if (!std::is_sorted(ranges.begin(), ranges.end())) {
+                std::sort(ranges.begin(), ranges.end());
+        }
+        size_t last = 0;
+        for (size_t i = 1; i < ranges.size(); ++i) {
+                auto &prev = ranges[last];
+                if (ranges[i].first <= prev.first + prev.second) {
+                        prev.second = std::max(prev.second, ranges[i].first + ranges[i].second - prev.first);
+                } else {
+                        ranges[++last] = ranges[i];
+                }
+        }
+        ranges.resize(last + 1);
+}
+
+int fec_ranges_sum(const fec_ranges &ranges)
+{
+        int ret = 0;
+        for (const auto &r : ranges) {
+                ret += r.second;
+        }
+        return ret;
+}
+
+fec_progress::fec_progress(const struct fec_desc &desc, int buf_len)
+{
+        const unsigned int n = desc.k + desc.m;
+        if ((desc.type != FEC_LDGM && desc.type != FEC_RS) || desc.k == 0 ||
+                        buf_len <= 0 || buf_len % n != 0) {
+                return;
+        }
+        m_ss = buf_len / n;
+        m_needed = desc.k;
+        bool any_symbol = desc.type == FEC_RS;
+#ifndef HAVE_ZFEC
+        any_symbol = false; // dummy RS decoder passes just the systematic part
+#endif
+        m_received.resize(any_symbol ? n : desc.k);
+}
+
+bool fec_progress::add(int offset, int len)
+{
+        if (m_decodable || m_ss == 0 || offset < 0 || len <= 0) {
+                return m_decodable;
+        }
+        const int end = offset + len;
+        for (size_t sym = offset / m_ss; sym < m_received.size() && offset < end; ++sym) {
+                const int sym_end = (int) (sym + 1) * m_ss;
+                const int chunk = min(end, sym_end) - offset;
+                if (m_received[sym] < m_ss && (m_received[sym] += chunk) >= m_ss) {
+                        m_complete += 1;
+                }
+                offset += chunk;
+        }
+        m_decodable = m_complete >= m_needed;
+        return m_decodable;
+}
+
 int fec::pt_from_fec_type(enum tx_media_type media_type, enum fec_type fec_type, bool encrypted) throw()
 {
         if (media_type == TX_MEDIA_VIDEO) {
@@ -42,12 +42,44 @@
 #include "types.h"
 
 #ifdef __cplusplus
-#include <map>
 #include <memory>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 struct video_frame;
 
+/**
+ * Received parts of a FEC-protected buffer as (offset, length) pairs. May be
+ * filled in any order, fec::decode() expects ranges normalized with
+ * fec_ranges_normalize() (sorted by offset, adjacent ranges merged).
+ */
+using fec_ranges = std::vector<std::pair<int, int>>;
+void fec_ranges_normalize(fec_ranges &ranges);
+int fec_ranges_sum(const fec_ranges &ranges);
+
+/**
+ * Tracks received symbols of a FEC-protected buffer while its packets arrive
+ * so that the receiver can find out that the buffer can already be decoded
+ * although the rest of the packets (typically parity) has not arrived yet.
+ *
+ * For RS that is any k complete symbols, for LDGM the whole systematic part
+ * (peeling decodability is not evaluated incrementally).
+ */
+class fec_progress {
+public:
+        fec_progress(const struct fec_desc &desc, int buf_len);
+        /// @returns true if the buffer is (already) decodable
+        bool add(int offset, int len);
+        bool decodable() const { return m_decodable; }
+private:
+        int m_ss = 0;                  ///< symbol size, 0 if unknown
+        unsigned int m_needed = 0;     ///< complete symbols needed to decode
+        unsigned int m_complete = 0;
+        std::vector<int> m_received;   ///< received bytes of counted symbols
+        bool m_decodable = false;
+};
+
 struct fec {
         virtual std::shared_ptr<video_frame> encode(std::shared_ptr<video_frame>) = 0;
         virtual audio_frame2 encode(audio_frame2 const &) {
@@ -61,7 +93,7 @@ struct fec {
          *               can be read, set len to a non-zero value.
          */
         virtual bool decode(char *in, int in_len, char **out, int *out_len,
-                        const std::map<int, int> &) = 0;
+                        const fec_ranges &) = 0;
         virtual ~fec() {}
 
         static fec *create_from_config(const char *str) noexcept;
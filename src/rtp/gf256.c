@@ -0,0 +1,337 @@
+/**
+ * @file   rtp/gf256.c
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/gf256.h"
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#define GF256_X86 1
+#include <immintrin.h>
+#if defined __clang__
+#define GF256_GFNI (__clang_major__ >= 12)
+#else
+#define GF256_GFNI (__GNUC__ >= 11)
+#endif
+#else
+#define GF256_X86 0
+#define GF256_GFNI 0
+#endif
+
+#define MOD_NAME "[gf256] "
+#define GF256_POLY 0x11D      ///< x^8+x^4+x^3+x^2+1, same as zfec
+#define LINCOMB_BLOCK 4096    ///< destination block processed by gf256_region_lincomb()
+
+typedef void (*mul_add_t)(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+static uint8_t gf_exp[510];
+static uint8_t gf_log[256];
+static uint8_t gf_mul_tab[256][256];
+static uint64_t gf_affine[256]; ///< GF(2) 8x8 bit matrices for GF2P8AFFINEQB
+static mul_add_t mul_add_impl;
+static const char *impl_name;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static void mul_add_scalar(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        const uint8_t *tab = gf_mul_tab[c];
+        for (size_t i = 0; i < len; ++i) {
+                dst[i] ^= tab[src[i]];
+        }
+}
+
+#if GF256_X86
+/*
+ * Split-table multiplication - product of c with the low and high nibbles is
+ * looked up by PSHUFB from two 16-entry tables and the results are XORed.
+ */
+__attribute__((target("ssse3")))
+static void mul_add_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        const __m128i tlo = _mm_loadu_si128((const __m128i *)(const void *) gf_mul_tab[c]);
+        uint8_t hi[16];
+        for (int i = 0; i < 16; ++i) {
+                hi[i] = gf_mul_tab[c][i << 4];
+        }
+        const __m128i thi = _mm_loadu_si128((const __m128i *)(const void *) hi);
+        const __m128i mask = _mm_set1_epi8(0x0F);
+        size_t i = 0;
+        for ( ; i + 16 <= len; i += 16) {
+                __m128i x = _mm_loadu_si128((const __m128i *)(const void *) (src + i));
+                __m128i l = _mm_shuffle_epi8(tlo, _mm_and_si128(x, mask));
+                __m128i h = _mm_shuffle_epi8(thi, _mm_and_si128(_mm_srli_epi64(x, 4), mask));
+                __m128i d = _mm_loadu_si128((const __m128i *)(void *) (dst + i));
+                _mm_storeu_si128((__m128i *)(void *) (dst + i), _mm_xor_si128(d, _mm_xor_si128(l, h)));
+        }
+        mul_add_scalar(dst + i, src + i, c, len - i);
+}
+
+__attribute__((target("avx2")))
+static void mul_add_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        uint8_t hi[16];
+        for (int i = 0; i < 16; ++i) {
+                hi[i] = gf_mul_tab[c][i << 4];
+        }
+        const __m256i tlo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(const void *) gf_mul_tab[c]));
+        const __m256i thi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(const void *) hi));
+        const __m256i mask = _mm256_set1_epi8(0x0F);
+        size_t i = 0;
+        for ( ; i + 32 <= len; i += 32) {
+                __m256i x = _mm256_loadu_si256((const __m256i *)(const void *) (src + i));
+                __m256i l = _mm256_shuffle_epi8(tlo, _mm256_and_si256(x, mask));
+                __m256i h = _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask));
+                __m256i d = _mm256_loadu_si256((const __m256i *)(void *) (dst + i));
+                _mm256_storeu_si256((__m256i *)(void *) (dst + i), _mm256_xor_si256(d, _mm256_xor_si256(l, h)));
+        }
+        mul_add_scalar(dst + i, src + i, c, len - i);
+}
+
+#if GF256_GFNI
+/*
+ * GF2P8MULB uses the AES polynomial so an affine transformation (multiplication
+ * by c is linear over GF(2)) with precomputed bit matrix is used instead.
+ */
+__attribute__((target("gfni,avx2")))
+static void mul_add_gfni(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        const __m256i a = _mm256_set1_epi64x((long long) gf_affine[c]);
+        size_t i = 0;
+        for ( ; i + 32 <= len; i += 32) {
+                __m256i x = _mm256_loadu_si256((const __m256i *)(const void *) (src + i));
+                __m256i d = _mm256_loadu_si256((const __m256i *)(void *) (dst + i));
+                _mm256_storeu_si256((__m256i *)(void *) (dst + i),
+                                _mm256_xor_si256(d, _mm256_gf2p8affine_epi64_epi8(x, a, 0)));
+        }
+        mul_add_scalar(dst + i, src + i, c, len - i);
+}
+#endif // GF256_GFNI
+#endif // GF256_X86
+
+static const struct {
+        const char *name;
+        mul_add_t fn;
+} impls[] = {
+#if GF256_X86
+#if GF256_GFNI
+        { "gfni", mul_add_gfni },
+#endif
+        { "avx2", mul_add_avx2 },
+        { "ssse3", mul_add_ssse3 },
+#endif
+        { "scalar", mul_add_scalar },
+};
+
+static int impl_supported(const char *name)
+{
+#if GF256_X86
+        __builtin_cpu_init();
+#if GF256_GFNI
+        if (strcmp(name, "gfni") == 0) {
+                return __builtin_cpu_supports("gfni") && __builtin_cpu_supports("avx2");
+        }
+#endif
+        if (strcmp(name, "avx2") == 0) {
+                return __builtin_cpu_supports("avx2");
+        }
+        if (strcmp(name, "ssse3") == 0) {
+                return __builtin_cpu_supports("ssse3");
+        }
+#endif
+        return strcmp(name, "scalar") == 0;
+}
+
+static void init_tables(void)
+{
+        unsigned x = 1;
+        for (int i = 0; i < 255; ++i) {
+                gf_exp[i] = gf_exp[i + 255] = x;
+                gf_log[x] = i;
+                x <<= 1;
+                if (x & 0x100) {
+                        x ^= GF256_POLY;
+                }
+        }
+        for (int a = 0; a < 256; ++a) {
+                for (int b = 0; b < 256; ++b) {
+                        gf_mul_tab[a][b] = a == 0 || b == 0 ? 0 : gf_exp[gf_log[a] + gf_log[b]];
+                }
+        }
+        // row i of the matrix (byte 7 - i) selects input bits contributing to output bit i
+        for (int c = 0; c < 256; ++c) {
+                uint64_t m = 0;
+                for (int i = 0; i < 8; ++i) {
+                        unsigned row = 0;
+                        for (int j = 0; j < 8; ++j) {
+                                row |= ((gf_mul_tab[c][1 << j] >> i) & 1U) << j;
+                        }
+                        m |= (uint64_t) row << (8 * (7 - i));
+                }
+                gf_affine[c] = m;
+        }
+}
+
+/// @param name implementation name, NULL to select the best supported one
+static int select_impl(const char *name)
+{
+        for (size_t i = 0; i < sizeof impls / sizeof impls[0]; ++i) {
+                if (name != NULL && strcmp(name, impls[i].name) != 0) {
+                        continue;
+                }
+                if (impl_supported(impls[i].name)) {
+                        mul_add_impl = impls[i].fn;
+                        impl_name = impls[i].name;
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+static void gf256_do_init(void)
+{
+        init_tables();
+
+        const char *req = get_commandline_param("rs-simd");
+        if (req != NULL && !select_impl(req)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Implementation \"%s\" not available, using autodetected.\n", req);
+        }
+        if (mul_add_impl == NULL) {
+                select_impl(NULL);
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using %s implementation.\n", impl_name);
+}
+
+void gf256_init(void)
+{
+        pthread_once(&init_once, gf256_do_init);
+}
+
+const char *gf256_impl_name(void)
+{
+        gf256_init();
+        return impl_name;
+}
+
+uint8_t gf256_mul(uint8_t a, uint8_t b)
+{
+        return gf_mul_tab[a][b];
+}
+
+uint8_t gf256_inv(uint8_t a)
+{
+        return gf_exp[255 - gf_log[a]];
+}
+
+int gf256_invert_matrix(uint8_t *m, int k)
+{
+        uint8_t *inv = calloc((size_t) k * k, 1);
+        for (int i = 0; i < k; ++i) {
+                inv[i * k + i] = 1;
+        }
+        int ret = 0;
+        for (int col = 0; col < k; ++col) {
+                int pivot = col;
+                while (pivot < k && m[pivot * k + col] == 0) {
+                        pivot++;
+                }
+                if (pivot == k) {
+                        ret = -1;
+                        break;
+                }
+                if (pivot != col) {
+                        for (int j = 0; j < k; ++j) {
+                                uint8_t t = m[col * k + j];
+                                m[col * k + j] = m[pivot * k + j];
+                                m[pivot * k + j] = t;
+                                t = inv[col * k + j];
+                                inv[col * k + j] = inv[pivot * k + j];
+                                inv[pivot * k + j] = t;
+                        }
+                }
+                const uint8_t *scale = gf_mul_tab[gf256_inv(m[col * k + col])];
+                for (int j = 0; j < k; ++j) {
+                        m[col * k + j] = scale[m[col * k + j]];
+                        inv[col * k + j] = scale[inv[col * k + j]];
+                }
+                for (int row = 0; row < k; ++row) {
+                        uint8_t c = m[row * k + col];
+                        if (row == col || c == 0) {
+                                continue;
+                        }
+                        mul_add_impl(m + row * k, m + col * k, c, k);
+                        mul_add_impl(inv + row * k, inv + col * k, c, k);
+                }
+        }
+        if (ret == 0) {
+                memcpy(m, inv, (size_t) k * k);
+        }
+        free(inv);
+        return ret;
+}
+
+void gf256_region_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+        if (c == 0) {
+                return;
+        }
+        mul_add_impl(dst, src, c, len);
+}
+
+void gf256_region_lincomb(uint8_t *dst, const uint8_t *const *src,
+                const uint8_t *coeffs, int count, size_t len)
+{
+        for (size_t off = 0; off < len; off += LINCOMB_BLOCK) {
+                size_t blk = len - off < LINCOMB_BLOCK ? len - off : LINCOMB_BLOCK;
+                memset(dst + off, 0, blk);
+                for (int j = 0; j < count; ++j) {
+                        if (coeffs[j] != 0) {
+                                mul_add_impl(dst + off, src[j] + off, coeffs[j], blk);
+                        }
+                }
+        }
+}
+
+ADD_TO_PARAM("rs-simd", "* rs-simd=gfni|avx2|ssse3|scalar\n"
+                "  Force Reed-Solomon GF(2^8) implementation (default is the best supported).\n");
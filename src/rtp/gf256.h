@@ -0,0 +1,89 @@
+/**
+ * @file   rtp/gf256.h
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * GF(2^8) arithmetic used by the Reed-Solomon FEC (rtp/rs.cpp).
+ *
+ * The field uses the same generator polynomial as zfec (x^8+x^4+x^3+x^2+1),
+ * so that data encoded with the zfec coding matrix can be processed by the
+ * region functions below. Region operations are dispatched at runtime to
+ * the best available implementation (GFNI, AVX2 or SSSE3 split-table PSHUFB,
+ * scalar table lookup), which may be overriden by "--param rs-simd=<impl>".
+ */
+
+#ifndef RTP_GF256_H_
+#define RTP_GF256_H_
+
+#ifndef __cplusplus
+#include <stddef.h>
+#include <stdint.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// must be called before other functions, thread-safe, can be called repeatedly
+void        gf256_init(void);
+/// @returns name of selected region implementation
+const char *gf256_impl_name(void);
+
+uint8_t gf256_mul(uint8_t a, uint8_t b);
+/// @returns multiplicative inverse of nonzero a
+uint8_t gf256_inv(uint8_t a);
+/**
+ * Inverts a k*k row-major matrix in place.
+ * @retval 0 on success, -1 if the matrix is singular
+ */
+int     gf256_invert_matrix(uint8_t *m, int k);
+
+/// dst[i] ^= c * src[i]
+void    gf256_region_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+/**
+ * dst = sum_j coeffs[j] * src[j] for j < count (dst is overwritten)
+ *
+ * Processes the sources in blocks so that the destination stays in cache.
+ */
+void    gf256_region_lincomb(uint8_t *dst, const uint8_t *const *src,
+                const uint8_t *coeffs, int count, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined RTP_GF256_H_
@@ -69,7 +69,6 @@
 #include "video.h"
 
 using std::endl;
-using std::map;
 using std::ostringstream;
 using std::setprecision;
 using std::shared_ptr;
@@ -239,7 +238,7 @@ ldgm::ldgm(unsigned int k, unsigned int m, unsigned int c, unsigned int seed)
         init(k, m, c, seed);
 }
 
-bool ldgm::decode(char *frame, int size, char **out, int *out_size, const map<int, int> &packets) {
+bool ldgm::decode(char *frame, int size, char **out, int *out_size, const fec_ranges &packets) {
         char *decoded;
         decoded = m_coding_session->decode_frame(frame, size, out_size, packets);
         if (*out_size > 0) {
@@ -442,8 +441,19 @@ shared_ptr<video_frame> ldgm::encode(shared_ptr<video_frame> tx_frame)
                 check_packet_size(tx_frame->tiles[i].data_len, m_k);
 
                 int out_size;
-                char *output = m_coding_session->encode_hdr_frame((char *) video_hdr, sizeof(video_hdr),
-                                tx_frame->tiles[i].data, tx_frame->tiles[i].data_len, &out_size);
+                char *output = nullptr;
+                if (tx_frame->mem_location == CUDA_MEM) {
+                        output = m_coding_session->encode_hdr_frame_dev((char *) video_hdr, sizeof(video_hdr),
+                                        tx_frame->tiles[i].data, tx_frame->tiles[i].data_len, &out_size);
+                        if (output == nullptr) {
+                                MSG(ERROR, "Cannot encode frame in device memory, "
+                                                "use \"--param ldgm-device=GPU\".\n");
+                                return {};
+                        }
+                } else {
+                        output = m_coding_session->encode_hdr_frame((char *) video_hdr, sizeof(video_hdr),
+                                        tx_frame->tiles[i].data, tx_frame->tiles[i].data_len, &out_size);
+                }
 
                 out->tiles[i].data = output;
                 out->tiles[i].data_len = out_size;
@@ -39,14 +39,13 @@
 
 #define LDGM_MAXIMAL_SIZE_RATIO 1
 
-#include <map>
 #include <memory>
 
 #include "fec.h"
 
 #define DEFAULT_LDGM_SEED 1
 
-#define LDGM_GPU_API_VERSION 1
+#define LDGM_GPU_API_VERSION 2
 
 class LDGM_session;
 struct video_frame;
@@ -58,7 +57,7 @@ struct ldgm : public fec{
         void set_params(unsigned int k, unsigned int m, unsigned int c, unsigned int seed);
         std::shared_ptr<video_frame> encode(std::shared_ptr<video_frame>);
         bool decode(char *in, int in_len, char **out, int *len,
-                const std::map<int, int> &);
+                const fec_ranges &);
 
 private:
         void init(unsigned int k, unsigned int m, unsigned int c, unsigned int seed = DEFAULT_LDGM_SEED);
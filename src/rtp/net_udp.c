@@ -50,6 +50,7 @@
 
 #include <pthread.h>
 #include <stdalign.h>
+#include <stdatomic.h>
 
 #include "debug.h"
 #include "host.h"
@@ -58,7 +59,10 @@
 #include "compat/vsnprintf.h"
 #include "net_udp.h"
 #include "rtp.h"
-#include "utils/list.h"
+#include "rtp/net_udp_uring.h"
+#include "rtp/net_udp_xdp.h"
+#include "rtp/pkt_pool.h"
+#include "tv.h"
 #include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/net.h"
@@ -69,10 +73,42 @@
 #include "addrinfo.h"
 #endif
 
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
+#include <linux/sock_diag.h> // SK_MEMINFO_DROPS
+#include <linux/sockios.h>   // SIOCOUTQ
+#include <sys/ioctl.h>
+#include <poll.h>
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#endif
+
 #define DEFAULT_MAX_UDP_READER_QUEUE_LEN (1920/3*8*1080/1152) //< 10-bit FullHD frame divided by 1280 MTU packets (minus headers)
+#define MAX_UDP_RECV_BATCH 64 ///< max datagrams read with single recvmmsg() call
+#define UDP_RECV_BATCH_REPORT_INTERVAL_NS (10 * NS_IN_SEC)
+#define MAX_UDP_SEND_BATCH 64 ///< max datagrams sent with single sendmmsg() call
+#define UDP_SEND_BATCH_MAX_IOV 3 ///< RTP header, payload header, data
+#define MAX_UDP_FANOUT 16 ///< max number of SO_REUSEPORT receiving sockets
+#define UDP_GSO_MAX_LEN 65000 ///< max len of a GSO super-packet (IP_MAXPACKET minus headers)
+#define UDP_DEST_MAX_ERRORS 50 ///< additional destination is disabled after this many failed sends
 
 static int resolve_address(socket_udp *s, const char *addr, uint16_t tx_port);
+struct udp_dest;
+static void udp_dest_error(struct udp_dest *dest);
 static void *udp_reader(void *arg);
+#ifdef __linux__
+static struct udp_xdp *udp_init_xdp(socket_udp *s, const char *cfg);
+static void udp_zerocopy_done(struct socket_udp_local *l);
+static bool udp_init_fanout(socket_udp *s, const char *cfg, int ttl);
+static void *udp_fanout_reader(void *arg);
+static bool udp_read_errqueue_reports(struct socket_udp_local *l);
+static void udp_read_errqueue(struct socket_udp_local *l);
+static void udp_init_rx_timestamps(socket_udp *s, const char *cfg);
+#endif
 
 #define IPv4	4
 #define IPv6	6
@@ -130,11 +166,20 @@ struct item {
     int size;
     struct sockaddr *src_addr;
     socklen_t addrlen;
+    time_ns_t recv_time; ///< kernel timestamp if enabled, otherwise reader time
 };
 
 #define ALIGNED_SOCKADDR_STORAGE_OFF ((RTP_MAX_PACKET_LEN + alignof(struct sockaddr_storage) - 1) / alignof(struct sockaddr_storage) * alignof(struct sockaddr_storage))
 #define ALIGNED_ITEM_OFF (((ALIGNED_SOCKADDR_STORAGE_OFF + sizeof(struct sockaddr_storage)) + alignof(struct item) - 1) / alignof(struct item) * alignof(struct item))
 
+#ifdef __linux__
+enum udp_rx_tstamp {
+        UDP_RX_TSTAMP_NONE,
+        UDP_RX_TSTAMP_SW, ///< SO_TIMESTAMPNS
+        UDP_RX_TSTAMP_HW, ///< SO_TIMESTAMPING, NIC with software fallback
+};
+#endif
+
 /*
  * Local part of the socket
  *
@@ -151,14 +196,67 @@ struct socket_udp_local {
 
         // for multithreaded receiving
         pthread_t thread_id;
-        struct simple_linked_list *packets;
+        /// single-producer (reader) single-consumer ring of received packets
+        struct item **ring;
+        size_t ring_mask; ///< ring size - 1 (size is a power of 2)
         unsigned int max_packets;
+        _Atomic size_t ring_head; ///< consumer position
+        _Atomic size_t ring_tail; ///< producer position
+        // lock and CVs are used only to put the idle side to sleep and wake it
         pthread_mutex_t lock;
         pthread_cond_t boss_cv;
         pthread_cond_t reader_cv;
+        _Atomic bool boss_waiting;
+        _Atomic bool reader_waiting;
+        bool boss_wakeup; ///< udp_wake() called, protected by lock
+        _Atomic long long queue_full; ///< reader stalls on the full ring
+        /// number of datagrams read at once by the reader (recvmmsg), 1 -
+        /// batching disabled; may be changed by udp_set_recv_batch()
+        _Atomic int recv_batch;
+        /// pool for packets allocated by the reader, NULL - malloc
+        struct rtp_pkt_pool *_Atomic pkt_pool;
+#ifdef __linux__
+        struct udp_xdp *xdp; ///< AF_XDP receive socket, NULL if not used
+        struct udp_uring *uring; ///< io_uring receive, NULL if not used
+        /// additional SO_REUSEPORT sockets with own reader threads feeding the ring
+        struct udp_reader_src *fanout;
+        int fanout_count;
+        pthread_mutex_t producer_lock; ///< serializes ring producers if fanout_count > 0
+        enum udp_rx_tstamp rx_tstamp; ///< kernel receive timestamps (udp-rx-timestamps)
+#endif
 
         bool should_exit;
         fd_t should_exit_fd[2];
+
+        bool txtime; ///< SO_TXTIME enabled on tx_fd
+#ifdef __linux__
+        _Atomic int txtime_errors; ///< read from error queue, not yet reported
+        struct udp_zerocopy *zc; ///< MSG_ZEROCOPY state, NULL if disabled
+        /// all zero-copy sends with lower ID have completed - the error queue
+        /// may also be read by the reader thread, see udp_reader_spurious_wakeup()
+        _Atomic uint32_t zc_completed;
+        _Atomic long long zc_copied; ///< sends that the kernel completed by copying
+#endif
+};
+
+/// receiving end of a reader thread
+struct udp_reader_src {
+        socket_udp *s;
+        fd_t fd;
+        bool pooled; ///< allocate from the packet pool (permitted for single thread only)
+        pthread_t thread_id; ///< fan-out readers only
+};
+
+/// additional destination the sent datagrams are replicated to, see udp_add_dest()
+struct udp_dest {
+        struct sockaddr_storage addr;
+        socklen_t len;
+        int refcount;
+        int errors;
+        bool disabled; ///< too many errors, not sent to until removed
+#ifdef __linux__
+        fd_t pmtu_fd; ///< see udp_enable_pmtu_discovery(), INVALID_SOCKET if not used
+#endif
 };
 
 /*
@@ -169,6 +267,9 @@ struct _socket_udp {
         socklen_t sock_len;
         unsigned int ifindex; ///< iface index for multicast
 
+        struct udp_dest *dests;
+        int dest_count;
+
         struct socket_udp_local *local;
         bool local_is_slave; // whether is the local
 
@@ -179,11 +280,53 @@ struct _socket_udp {
         bool overlapping_active;
         int overlapped_max;
         int overlapped_count;
+#elif defined __linux__
+        struct udp_send_batch *send_batch;
+        uint64_t next_txtime; ///< departure time of next packet (CLOCK_MONOTONIC ns), 0 - unset
+        bool pmtu_discovery; ///< pmtu_fd valid, see udp_enable_pmtu_discovery()
+        fd_t pmtu_fd; ///< connected to the destination, used to query path MTU
 #endif
 };
 
+#ifdef __linux__
+/// deferred release of memory referenced by a zero-copy send
+struct udp_zc_entry {
+        uint32_t needed; ///< release when all sends with lower ID completed
+        void (*release)(void *);
+        void *arg;
+};
+
+struct udp_zerocopy {
+        struct udp_zc_entry *entries; ///< ring ordered by needed
+        size_t first;
+        size_t count;
+        size_t alloc;
+        uint32_t next_id;   ///< notification ID of the next zero-copy send
+        long long sends;
+};
+
+/// packets queued by udp_sendv() between udp_async_start() and udp_async_wait()
+struct udp_send_batch {
+        bool active;
+        bool gso; ///< use UDP_SEGMENT for runs of equally sized packets
+        int count;
+        struct mmsghdr msgs[MAX_UDP_SEND_BATCH];
+        struct iovec iov[MAX_UDP_SEND_BATCH][UDP_SEND_BATCH_MAX_IOV];
+        void *dispose_udata[MAX_UDP_SEND_BATCH];
+        char control[MAX_UDP_SEND_BATCH][CMSG_SPACE(sizeof(uint64_t))];
+};
+#endif
+
 static void udp_clean_async_state(socket_udp *s);
 
+#ifdef __linux__
+/// control buffer size for SCM_TIMESTAMPNS or SCM_TIMESTAMPING
+#define UDP_TSTAMP_CONTROL_LEN CMSG_SPACE(sizeof(struct scm_timestamping))
+/// kernel timestamps differing more from the current time are not trusted
+/// (eg. unsynchronized NIC clock)
+#define UDP_TSTAMP_MAX_SKEW_NS NS_IN_SEC
+#endif
+
 #ifdef _WIN32
 /* Want to use both Winsock 1 and 2 socket options, but since
 * IPv6 support requires Winsock 2 we have to add own backwards
@@ -364,23 +507,104 @@ static bool udp_addr_valid4(const char *dst)
         return false;
 }
 
+/**
+ * Joins source-specific multicast (SSM, RFC 4607) group if udp-mcast-source
+ * is given.
+ *
+ * @retval 0  SSM not requested, any-source join should be done
+ * @retval 1  joined (or left)
+ * @retval -1 error
+ */
+static int udp_mcast_source_membership(int fd, bool join, const struct sockaddr *group, socklen_t group_len,
+                unsigned int ifindex)
+{
+        const char *source = get_commandline_param("udp-mcast-source");
+        if (source == NULL) {
+                return 0;
+        }
+#ifdef MCAST_JOIN_SOURCE_GROUP
+        struct group_source_req gsr;
+        memset(&gsr, 0, sizeof gsr);
+        gsr.gsr_interface = ifindex;
+        memcpy(&gsr.gsr_group, group, group_len);
+        socklen_t source_len = 0;
+        int mode = group->sa_family == AF_INET ? IPv4 : IPv6;
+        if (resolve_addrinfo(source, 0, &gsr.gsr_source, &source_len, &mode) != 0) {
+                return -1;
+        }
+        const int level = group->sa_family == AF_INET ? IPPROTO_IP : IPPROTO_IPV6;
+        if (SETSOCKOPT(fd, level, join ? MCAST_JOIN_SOURCE_GROUP : MCAST_LEAVE_SOURCE_GROUP,
+                                (char *) &gsr, sizeof gsr) != 0) {
+                socket_error(join ? "setsockopt MCAST_JOIN_SOURCE_GROUP" : "setsockopt MCAST_LEAVE_SOURCE_GROUP");
+                return -1;
+        }
+        if (join) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Joined source-specific multicast group (source %s).\n", source);
+        }
+        return 1;
+#else
+        UNUSED(fd), UNUSED(join), UNUSED(group), UNUSED(group_len), UNUSED(ifindex);
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Source-specific multicast is not supported on this platform!\n");
+        return -1;
+#endif
+}
+
+/// receive only datagrams of groups joined by the socket, not by any socket
+/// bound to the same port (Linux default)
+static void udp_mcast_disable_all(int rx_fd, bool ipv6)
+{
+#ifdef __linux__
+        int val = 0;
+        if (!ipv6) {
+                if (SETSOCKOPT(rx_fd, IPPROTO_IP, IP_MULTICAST_ALL, (char *) &val, sizeof val) != 0) {
+                        socket_error("setsockopt IP_MULTICAST_ALL");
+                }
+        } else {
+#ifdef IPV6_MULTICAST_ALL
+                if (SETSOCKOPT(rx_fd, IPPROTO_IPV6, IPV6_MULTICAST_ALL, (char *) &val, sizeof val) != 0) {
+                        socket_error("setsockopt IPV6_MULTICAST_ALL");
+                }
+#endif
+        }
+#else
+        UNUSED(rx_fd), UNUSED(ipv6);
+#endif
+}
+
 static bool udp_join_mcast_grp4(unsigned long addr, int rx_fd, int tx_fd, int ttl, unsigned int ifindex)
 {
         if (IN_MULTICAST(ntohl(addr))) {
 #ifndef _WIN32
                 char loop = 1;
 #endif
+#ifdef __linux__
+                struct ip_mreqn imr = { .imr_ifindex = (int) ifindex };
+#else
                 struct ip_mreq imr;
-
+#ifdef _WIN32
+                imr.imr_interface.s_addr = htonl(ifindex); // 0.0.0.<ifindex> is interpreted as an index
+#else
+                imr.imr_interface.s_addr = INADDR_ANY;
+                if (ifindex != 0) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Multicast interface selection for IPv4 is not supported on this platform.\n");
+                }
+#endif
+#endif
                 imr.imr_multiaddr.s_addr = addr;
-                imr.imr_interface.s_addr = ifindex;
 
-                if (SETSOCKOPT
+                struct sockaddr_in group = { .sin_family = AF_INET };
+                group.sin_addr.s_addr = addr;
+                const int ssm = udp_mcast_source_membership(rx_fd, true, (struct sockaddr *) &group, sizeof group, ifindex);
+                if (ssm < 0) {
+                        return false;
+                }
+                if (ssm == 0 && SETSOCKOPT
                     (rx_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char *)&imr,
-                     sizeof(struct ip_mreq)) != 0) {
+                     sizeof imr) != 0) {
                         socket_error("setsockopt IP_ADD_MEMBERSHIP");
                         return false;
                 }
+                udp_mcast_disable_all(rx_fd, false);
 #ifndef _WIN32
                 if (SETSOCKOPT
                     (tx_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop,
@@ -399,9 +623,10 @@ static bool udp_join_mcast_grp4(unsigned long addr, int rx_fd, int tx_fd, int tt
                 } else {
                         log_msg(LOG_LEVEL_WARNING, "Using IPv4 multicast but not setting TTL.\n");
                 }
+                // outgoing interface for multi-homed hosts
                 if (SETSOCKOPT
                     (tx_fd, IPPROTO_IP, IP_MULTICAST_IF,
-                     (char *)&ifindex, sizeof(ifindex)) != 0) {
+                     (char *)&imr, sizeof imr) != 0) {
                         socket_error("setsockopt IP_MULTICAST_IF");
                         return false;
                 }
@@ -409,9 +634,14 @@ static bool udp_join_mcast_grp4(unsigned long addr, int rx_fd, int tx_fd, int tt
         return true;
 }
 
-static void udp_leave_mcast_grp4(unsigned long addr, int fd)
+static void udp_leave_mcast_grp4(unsigned long addr, int fd, unsigned int ifindex)
 {
         if (IN_MULTICAST(ntohl(addr))) {
+                struct sockaddr_in group = { .sin_family = AF_INET };
+                group.sin_addr.s_addr = addr;
+                if (udp_mcast_source_membership(fd, false, (struct sockaddr *) &group, sizeof group, ifindex) != 0) {
+                        return;
+                }
                 struct ip_mreq imr;
                 imr.imr_multiaddr.s_addr = addr;
                 imr.imr_interface.s_addr = INADDR_ANY;
@@ -484,12 +714,18 @@ static bool udp_join_mcast_grp6(struct in6_addr sin6_addr, int rx_fd, int tx_fd,
                 imr.ipv6mr_interface = ifindex;
 #endif
 
-                if (SETSOCKOPT
+                struct sockaddr_in6 group = { .sin6_family = AF_INET6, .sin6_addr = sin6_addr };
+                const int ssm = udp_mcast_source_membership(rx_fd, true, (struct sockaddr *) &group, sizeof group, ifindex);
+                if (ssm < 0) {
+                        return false;
+                }
+                if (ssm == 0 && SETSOCKOPT
                     (rx_fd, IPPROTO_IPV6, IPV6_ADD_MEMBERSHIP, (char *)&imr,
                      sizeof(struct ipv6_mreq)) != 0) {
                         socket_error("setsockopt IPV6_ADD_MEMBERSHIP");
                         return false;
                 }
+                udp_mcast_disable_all(rx_fd, true);
 
                 if (SETSOCKOPT
                     (tx_fd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, (char *)&loop,
@@ -530,6 +766,10 @@ static void udp_leave_mcast_grp6(struct in6_addr sin6_addr, int fd, unsigned int
                 imr.ipv6mr_multiaddr = sin6_addr;
                 imr.ipv6mr_interface = ifindex;
 #endif
+                struct sockaddr_in6 group = { .sin6_family = AF_INET6, .sin6_addr = sin6_addr };
+                if (udp_mcast_source_membership(fd, false, (struct sockaddr *) &group, sizeof group, ifindex) != 0) {
+                        return;
+                }
 
                 if (SETSOCKOPT
                     (fd, IPPROTO_IPV6, IPV6_DROP_MEMBERSHIP, (char *)&imr,
@@ -764,6 +1004,43 @@ static bool set_sock_opts_and_bind(fd_t fd, bool ipv6, uint16_t rx_port, int ttl
 ADD_TO_PARAM("udp-queue-len",
                 "* udp-queue-len=<l>\n"
                 "  Use different queue size than default DEFAULT_MAX_UDP_READER_QUEUE_LEN\n");
+#ifdef __linux__
+ADD_TO_PARAM("udp-disable-send-batch",
+                "* udp-disable-send-batch\n"
+                "  Send each datagram with a separate syscall instead of batching them with sendmmsg()\n");
+ADD_TO_PARAM("udp-gso",
+                "* udp-gso\n"
+                "  Use UDP segmentation offload (UDP_SEGMENT) for batched equally sized datagrams\n");
+#endif
+ADD_TO_PARAM("udp-recv-batch",
+                "* udp-recv-batch=<n>\n"
+                "  Receive up to <n> datagrams per wakeup in the UDP reader thread with\n"
+                "  recvmmsg() (Linux only, default 1 - disabled)\n");
+#ifdef __linux__
+ADD_TO_PARAM("udp-xdp",
+                "* udp-xdp=<iface>[:<queue>]\n"
+                "  Receive with AF_XDP socket bound to RX <queue> (default 0) of <iface>. The\n"
+                "  UDP port should be steered to the queue, eg. with `ethtool -N <iface> flow-type\n"
+                "  udp4 dst-port <port> action <queue>`. An XDP program redirects only datagrams\n"
+                "  for the port, other traffic of the queue (ARP, RTCP) goes to the network stack.\n");
+ADD_TO_PARAM("udp-reuseport",
+                "* udp-reuseport=<n>[:hash]\n"
+                "  Receive with <n> SO_REUSEPORT sockets, each with own reader thread. Datagrams\n"
+                "  are steered by video substream (tile) index unless \"hash\" is given (kernel\n"
+                "  flow hash, for multiple senders). Unicast only.\n");
+ADD_TO_PARAM("udp-rx-timestamps",
+                "* udp-rx-timestamps[=hw]\n"
+                "  Timestamp received datagrams by the kernel (SO_TIMESTAMPNS) so that jitter\n"
+                "  and latency measure the network instead of the receiving threads; \"hw\" uses\n"
+                "  NIC timestamps (SO_TIMESTAMPING, the NIC clock must be synchronized to the\n"
+                "  system clock, eg. by phc2sys, and RX timestamping enabled by hwstamp_ctl)\n");
+ADD_TO_PARAM("udp-io-uring",
+                "* udp-io-uring\n"
+                "  Receive in the UDP reader thread with io_uring multishot recvmsg instead\n"
+                "  of select() and recvfrom()/recvmmsg()\n");
+#endif
+ADD_TO_PARAM("udp-mcast-source", "* udp-mcast-source=<addr>\n"
+                "  Join the multicast group as source-specific (SSM, 232.0.0.0/8 or ff3x::/32) with given source.\n");
 #ifdef _WIN32
 ADD_TO_PARAM("udp-disable-multi-socket",
                 "* udp-disable-multi-socket\n"
@@ -792,12 +1069,14 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
         int ret;
         socket_udp *s = (socket_udp *) calloc(1, sizeof *s);
         s->local = (struct socket_udp_local*) calloc(1, sizeof(*s->local));
-        s->local->packets = simple_linked_list_init();
         s->local->rx_fd =
                 s->local->tx_fd = INVALID_SOCKET;
         pthread_mutex_init(&s->local->lock, NULL);
         pthread_cond_init(&s->local->boss_cv, NULL);
         pthread_cond_init(&s->local->reader_cv, NULL);
+#ifdef __linux__
+        pthread_mutex_init(&s->local->producer_lock, NULL);
+#endif
 
         assert(force_ip_version == 0 || force_ip_version == 4 || force_ip_version == 6);
         s->local->mode = force_ip_version;
@@ -887,6 +1166,21 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                 abort();
         }
 
+#ifdef __linux__
+        if (multithreaded && get_commandline_param("udp-xdp")) {
+                if ((s->local->xdp = udp_init_xdp(s, get_commandline_param("udp-xdp"))) == NULL) {
+                        goto error;
+                }
+        }
+        if (multithreaded && get_commandline_param("udp-reuseport") != NULL) {
+                if (is_addr_multicast(addr)) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Fan-out receive is not supported for multicast.\n");
+                } else if (!udp_init_fanout(s, get_commandline_param("udp-reuseport"), ttl)) {
+                        goto error;
+                }
+        }
+#endif
+
         s->local->multithreaded = multithreaded;
         if (multithreaded) {
                 if (!get_commandline_param("udp-queue-len")) {
@@ -894,8 +1188,35 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                 } else {
                         s->local->max_packets = atoi(get_commandline_param("udp-queue-len"));
                 }
+                size_t ring_size = 1;
+                while (ring_size < MAX(s->local->max_packets, 2)) {
+                        ring_size <<= 1;
+                }
+                s->local->ring = (struct item **) calloc(ring_size, sizeof s->local->ring[0]);
+                s->local->ring_mask = ring_size - 1;
+                s->local->recv_batch = 1;
+                if (get_commandline_param("udp-recv-batch")) {
+                        udp_set_recv_batch(s, atoi(get_commandline_param("udp-recv-batch")));
+                }
                 platform_pipe_init(s->local->should_exit_fd);
+#ifdef __linux__
+                if (get_commandline_param("udp-io-uring") != NULL && s->local->xdp == NULL) {
+                        s->local->uring = udp_uring_init(s->local->rx_fd, s->local->should_exit_fd[0],
+                                        RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE);
+                        if (s->local->uring == NULL) {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot use io_uring, falling back to select().\n");
+                        }
+                }
+                if (get_commandline_param("udp-rx-timestamps") != NULL) {
+                        udp_init_rx_timestamps(s, get_commandline_param("udp-rx-timestamps"));
+                }
+#endif
                 pthread_create(&s->local->thread_id, NULL, udp_reader, s);
+#ifdef __linux__
+                for (int i = 0; i < s->local->fanout_count; ++i) {
+                        pthread_create(&s->local->fanout[i].thread_id, NULL, udp_fanout_reader, &s->local->fanout[i]);
+                }
+#endif
         }
 
         return s;
@@ -964,6 +1285,27 @@ void udp_fd_zero_r(struct udp_fd_r *fd_struct)
         fd_struct->max_fd = 0;
 }
 
+static size_t udp_ring_size(struct socket_udp_local *l)
+{
+        return atomic_load_explicit(&l->ring_tail, memory_order_acquire) -
+               atomic_load_explicit(&l->ring_head, memory_order_acquire);
+}
+
+/// consumer side, ring must not be empty
+static struct item *udp_ring_pop(struct socket_udp_local *l)
+{
+        const size_t head = atomic_load_explicit(&l->ring_head, memory_order_relaxed);
+        assert(atomic_load_explicit(&l->ring_tail, memory_order_acquire) != head);
+        struct item *it = l->ring[head & l->ring_mask];
+        atomic_store(&l->ring_head, head + 1);
+        if (atomic_load(&l->reader_waiting)) {
+                pthread_mutex_lock(&l->lock);
+                pthread_mutex_unlock(&l->lock);
+                pthread_cond_signal(&l->reader_cv);
+        }
+        return it;
+}
+
 /**
  * udp_exit:
  * @s: UDP session to be terminated.
@@ -978,7 +1320,7 @@ void udp_exit(socket_udp * s)
         }
         switch (s->local->mode) {
         case IPv4:
-                udp_leave_mcast_grp4(((struct sockaddr_in *)&s->sock)->sin_addr.s_addr, s->local->rx_fd);
+                udp_leave_mcast_grp4(((struct sockaddr_in *)&s->sock)->sin_addr.s_addr, s->local->rx_fd, s->ifindex);
                 break;
         case IPv6:
                 udp_leave_mcast_grp6(((struct sockaddr_in6 *)&s->sock)->sin6_addr, s->local->rx_fd, s->ifindex);
@@ -990,28 +1332,56 @@ void udp_exit(socket_udp * s)
                         char c = 0;
                         int ret = PLATFORM_PIPE_WRITE(s->local->should_exit_fd[1], &c, 1);
                         assert (ret == 1);
+                        pthread_mutex_lock(&s->local->lock);
                         s->local->should_exit = true;
-                        pthread_cond_signal(&s->local->reader_cv);
+                        pthread_mutex_unlock(&s->local->lock);
+                        pthread_cond_broadcast(&s->local->reader_cv);
                         pthread_join(s->local->thread_id, NULL);
-                        while (simple_linked_list_size(s->local->packets) > 0) {
-                                struct item *item = (struct item *) simple_linked_list_pop(s->local->packets);
-                                free(item->buf);
+#ifdef __linux__
+                        for (int i = 0; i < s->local->fanout_count; ++i) {
+                                pthread_join(s->local->fanout[i].thread_id, NULL);
+                        }
+#endif
+                        while (udp_ring_size(s->local) > 0) {
+                                rtp_pkt_free(udp_ring_pop(s->local)->buf);
                         }
+                        free(s->local->ring);
+                        platform_pipe_close(s->local->should_exit_fd[0]);
                         platform_pipe_close(s->local->should_exit_fd[1]);
                 }
+#ifdef __linux__
+                udp_xdp_done(s->local->xdp);
+                udp_uring_done(s->local->uring);
+                udp_zerocopy_done(s->local);
+                for (int i = 0; i < s->local->fanout_count; ++i) {
+                        CLOSESOCKET(s->local->fanout[i].fd);
+                }
+                free(s->local->fanout);
+                pthread_mutex_destroy(&s->local->producer_lock);
+#endif
                 CLOSESOCKET(s->local->rx_fd);
                 if (s->local->tx_fd != s->local->rx_fd) {
                         CLOSESOCKET(s->local->tx_fd);
                 }
-                simple_linked_list_destroy(s->local->packets);
                 pthread_mutex_destroy(&s->local->lock);
                 pthread_cond_destroy(&s->local->boss_cv);
                 pthread_cond_destroy(&s->local->reader_cv);
                 free(s->local);
         }
 
+#ifdef __linux__
+        if (s->pmtu_discovery) {
+                CLOSESOCKET(s->pmtu_fd);
+        }
+        for (int i = 0; i < s->dest_count; ++i) {
+                if (s->dests[i].pmtu_fd != INVALID_SOCKET) {
+                        CLOSESOCKET(s->dests[i].pmtu_fd);
+                }
+        }
+#endif
         udp_clean_async_state(s);
 
+        free(s->dests);
         free(s);
 }
 
@@ -1031,8 +1401,18 @@ int udp_send(socket_udp * s, char *buffer, int buflen)
         assert(buffer != NULL);
         assert(buflen > 0);
 
-        return sendto(s->local->tx_fd, buffer, buflen, 0, (struct sockaddr *)&s->sock,
+        int ret = sendto(s->local->tx_fd, buffer, buflen, 0, (struct sockaddr *)&s->sock,
                       s->sock_len);
+        for (int i = 0; i < s->dest_count; ++i) {
+                if (s->dests[i].disabled) {
+                        continue;
+                }
+                if (sendto(s->local->tx_fd, buffer, buflen, 0, (struct sockaddr *) &s->dests[i].addr,
+                                        s->dests[i].len) < 0) {
+                        udp_dest_error(&s->dests[i]);
+                }
+        }
+        return ret;
 }
 
 int udp_sendto(socket_udp * s, char *buffer, int buflen, struct sockaddr *dst_addr, socklen_t addrlen)
@@ -1040,6 +1420,86 @@ int udp_sendto(socket_udp * s, char *buffer, int buflen, struct sockaddr *dst_ad
         return sendto(s->local->tx_fd, buffer, buflen, 0, dst_addr, addrlen);
 }
 
+/**
+ * Prepared batch of datagrams sent to a single destination, see
+ * udp_sendto_batch(). Message headers are built once and reused.
+ */
+struct udp_sendto_batch {
+        socket_udp *s;
+        struct sockaddr_storage addr;
+        socklen_t addrlen;
+        bool disabled; ///< udp-disable-send-batch - send datagrams one by one
+#ifdef __linux__
+        struct mmsghdr msgs[MAX_UDP_SEND_BATCH];
+        struct iovec iov[MAX_UDP_SEND_BATCH];
+#endif
+};
+
+struct udp_sendto_batch *udp_sendto_batch_init(socket_udp *s, struct sockaddr *dst_addr, socklen_t addrlen)
+{
+        assert(addrlen <= sizeof(struct sockaddr_storage));
+        struct udp_sendto_batch *b = calloc(1, sizeof *b);
+        b->s = s;
+        memcpy(&b->addr, dst_addr, addrlen);
+        b->addrlen = addrlen;
+        b->disabled = get_commandline_param("udp-disable-send-batch") != NULL;
+#ifdef __linux__
+        for (int i = 0; i < MAX_UDP_SEND_BATCH; ++i) {
+                b->msgs[i].msg_hdr.msg_name = &b->addr;
+                b->msgs[i].msg_hdr.msg_namelen = addrlen;
+                b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+                b->msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+#endif
+        return b;
+}
+
+void udp_sendto_batch_done(struct udp_sendto_batch *b)
+{
+        free(b);
+}
+
+/**
+ * Sends count datagrams to the destination of the batch - with sendmmsg() on
+ * Linux, one by one elsewhere.
+ *
+ * @returns 0 on success, -1 if some of the datagrams could not be sent
+ */
+int udp_sendto_batch(struct udp_sendto_batch *b, char *const *buffers, const int *lens, int count)
+{
+        int ret = 0;
+#ifdef __linux__
+        if (!b->disabled) {
+                int sent = 0;
+                while (sent < count) {
+                        const int n = MIN(count - sent, MAX_UDP_SEND_BATCH);
+                        for (int i = 0; i < n; ++i) {
+                                b->iov[i].iov_base = buffers[sent + i];
+                                b->iov[i].iov_len = lens[sent + i];
+                        }
+                        int done = 0;
+                        while (done < n) {
+                                int r = sendmmsg(b->s->local->tx_fd, b->msgs + done, n - done, 0);
+                                if (r <= 0) {
+                                        ret = -1;
+                                        r = 1; // skip the failing datagram
+                                }
+                                done += r;
+                        }
+                        sent += n;
+                }
+                return ret;
+        }
+#endif
+        for (int i = 0; i < count; ++i) {
+                if (sendto(b->s->local->tx_fd, buffers[i], lens[i], 0,
+                                        (struct sockaddr *) &b->addr, b->addrlen) < 0) {
+                        ret = -1;
+                }
+        }
+        return ret;
+}
+
 #ifdef _WIN32
 int udp_sendv(socket_udp * s, LPWSABUF vector, int count, void *d)
 {
@@ -1048,6 +1508,14 @@ int udp_sendv(socket_udp * s, LPWSABUF vector, int count, void *d)
         assert(!s->overlapping_active || s->overlapped_count < s->overlapped_max);
 
 	DWORD bytesSent;
+        for (int i = 0; i < s->dest_count; ++i) { // replicas are sent synchronously
+                if (!s->dests[i].disabled &&
+                    WSASendTo(s->local->tx_fd, vector, count, &bytesSent, 0,
+                              (struct sockaddr *) &s->dests[i].addr,
+                              s->dests[i].len, NULL, NULL) != 0) {
+                        udp_dest_error(&s->dests[i]);
+                }
+        }
 	int ret = WSASendTo(s->local->tx_fd, vector, count, &bytesSent, 0,
 		(struct sockaddr *) &s->sock,
 		s->sock_len, s->overlapping_active ? &s->overlapped[s->overlapped_count] : NULL, NULL);
@@ -1064,12 +1532,44 @@ int udp_sendv(socket_udp * s, LPWSABUF vector, int count, void *d)
         }
 }
 #else
+#ifdef __linux__
+static bool udp_sendv_enqueue(socket_udp *s, struct iovec *vector, int count, void *d);
+
+/// adds SCM_TXTIME control message to msg if departure time is set
+static void udp_set_txtime_cmsg(socket_udp *s, struct msghdr *msg, char control[static CMSG_SPACE(sizeof(uint64_t))])
+{
+        if (!s->local->txtime || s->next_txtime == 0) {
+                return;
+        }
+        memset(control, 0, CMSG_SPACE(sizeof(uint64_t)));
+        msg->msg_control = control;
+        msg->msg_controllen = CMSG_SPACE(sizeof(uint64_t));
+        struct cmsghdr *cm = CMSG_FIRSTHDR(msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_TXTIME;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+        memcpy(CMSG_DATA(cm), &s->next_txtime, sizeof(uint64_t));
+        s->next_txtime = 0;
+}
+#endif
+
 int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
 {
         struct msghdr msg;
 
         assert(s != NULL);
 
+#ifdef __linux__
+        if (s->send_batch != NULL && s->send_batch->active &&
+            udp_sendv_enqueue(s, vector, count, d)) {
+                int len = 0;
+                for (int i = 0; i < count; ++i) {
+                        len += (int) vector[i].iov_len;
+                }
+                return len;
+        }
+#endif
+
         msg.msg_name = (void *) & s->sock;
         msg.msg_namelen = s->sock_len;
         msg.msg_iov = vector;
@@ -1078,115 +1578,647 @@ int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
         msg.msg_control = 0;
         msg.msg_controllen = 0;
         msg.msg_flags = 0;
+#ifdef __linux__
+        char control[CMSG_SPACE(sizeof(uint64_t))];
+        udp_set_txtime_cmsg(s, &msg, control);
+#endif
 
         int ret = sendmsg(s->local->tx_fd, &msg, 0);
+        for (int i = 0; i < s->dest_count; ++i) {
+                if (s->dests[i].disabled) {
+                        continue;
+                }
+                msg.msg_name = &s->dests[i].addr;
+                msg.msg_namelen = s->dests[i].len;
+                if (sendmsg(s->local->tx_fd, &msg, 0) < 0) {
+                        udp_dest_error(&s->dests[i]);
+                }
+        }
         free(d);
         return ret;
 }
 #endif // _WIN32
 
+static uint8_t *udp_reader_alloc_packet(socket_udp *s, bool pooled)
+{
+        return (uint8_t *) rtp_pkt_alloc(pooled ? s->local->pkt_pool : NULL, ALIGNED_ITEM_OFF + sizeof(struct item));
+}
+
+/// wakes up the consumer if it waits for data
+static void udp_reader_notify(struct socket_udp_local *l)
+{
+        if (atomic_load(&l->boss_waiting)) {
+                pthread_mutex_lock(&l->lock);
+                pthread_mutex_unlock(&l->lock);
+                pthread_cond_signal(&l->boss_cv);
+        }
+}
+
 /**
- * When receiving data in separate thread, this function fetches data
- * from socket and puts it in queue.
+ * Waits until there is a space in the ring.
+ * @retval false if the reader should exit
  */
-static void *udp_reader(void *arg)
+static bool udp_reader_wait_space(struct socket_udp_local *l)
 {
-        set_thread_name(__func__);
-        socket_udp *s = (socket_udp *) arg;
-
-        while (1) {
-                fd_set fds;
-                FD_ZERO(&fds);
-                FD_SET(s->local->rx_fd, &fds);
-                FD_SET(s->local->should_exit_fd[0], &fds);
-                int nfds = MAX(s->local->rx_fd, s->local->should_exit_fd[0]) + 1;
+        if (udp_ring_size(l) < l->max_packets) {
+                return !l->should_exit;
+        }
+        atomic_fetch_add_explicit(&l->queue_full, 1, memory_order_relaxed);
+        pthread_mutex_lock(&l->lock);
+        atomic_store(&l->reader_waiting, true);
+        while (udp_ring_size(l) >= l->max_packets && !l->should_exit) {
+                pthread_cond_wait(&l->reader_cv, &l->lock);
+        }
+        atomic_store(&l->reader_waiting, false);
+        pthread_mutex_unlock(&l->lock);
+        return !l->should_exit;
+}
 
-                int rc = select(nfds, &fds, NULL, NULL, NULL);
-                if (rc <= 0) {
-                        socket_error("select");
-                        continue;
+/**
+ * Enqueues received packets to the ring. The consumer is woken up (if idle)
+ * once per call.
+ *
+ * @retval false if the reader should exit (unqueued packets are freed)
+ */
+static bool udp_reader_enqueue(socket_udp *s, uint8_t **packets, const int *sizes, const socklen_t *addrlens,
+                const time_ns_t *recv_times, int count)
+{
+        struct socket_udp_local *l = s->local;
+        const time_ns_t now = get_time_in_ns();
+#ifdef __linux__
+        const bool mp = l->fanout_count > 0; // multiple producers
+        if (mp) {
+                pthread_mutex_lock(&l->producer_lock);
+        }
+#endif
+        for (int i = 0; i < count; ++i) {
+                if (!udp_reader_wait_space(l)) {
+                        for ( ; i < count; ++i) {
+                                rtp_pkt_free(packets[i]);
+                        }
+#ifdef __linux__
+                        if (mp) {
+                                pthread_mutex_unlock(&l->producer_lock);
+                        }
+#endif
+                        return false;
                 }
-                if (FD_ISSET(s->local->should_exit_fd[0], &fds)) {
-                        break;
+                struct sockaddr *src_addr = (struct sockaddr *)(void *)(packets[i] + ALIGNED_SOCKADDR_STORAGE_OFF);
+                struct item *it = (struct item *)(void *)(packets[i] + ALIGNED_ITEM_OFF);
+                *it = (struct item){packets[i], sizes[i], src_addr, addrlens[i],
+                        recv_times != NULL && recv_times[i] != 0 ? recv_times[i] : now};
+                const size_t tail = atomic_load_explicit(&l->ring_tail, memory_order_relaxed);
+                l->ring[tail & l->ring_mask] = it;
+                atomic_store(&l->ring_tail, tail + 1);
+                if (udp_ring_size(l) >= l->max_packets) { // going to wait, let the consumer run
+                        udp_reader_notify(l);
                 }
-                uint8_t *packet = (uint8_t *) malloc(ALIGNED_ITEM_OFF + sizeof(struct item));
-                uint8_t *buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
-                struct sockaddr *src_addr = (struct sockaddr *)(void *)(packet + ALIGNED_SOCKADDR_STORAGE_OFF);
-                socklen_t addrlen = sizeof(struct sockaddr_storage);
-                int size = recvfrom(s->local->rx_fd, (char *) buffer,
-                                RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
-                                0, src_addr, &addrlen);
-
-                if (size <= 0) {
-                        /// @todo
-                        /// In MSW, this block is called as often as packet is sent if
-                        /// we got WSAECONNRESET error (noone is listening). This can have
-                        /// negative performance impact.
-                        socket_error("recvfrom");
-                        free(packet);
+        }
+#ifdef __linux__
+        if (mp) {
+                pthread_mutex_unlock(&l->producer_lock);
+        }
+#endif
+
+        udp_reader_notify(l);
+        return true;
+}
+
+#ifdef __linux__
+/**
+ * @returns kernel receive timestamp (get_time_in_ns() clock) from the control
+ *          messages of a received datagram, 0 if there is none or it is off
+ */
+static time_ns_t udp_cmsg_recv_time(struct msghdr *m)
+{
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(m); c != NULL; c = CMSG_NXTHDR(m, c)) {
+                if (c->cmsg_level != SOL_SOCKET) {
                         continue;
                 }
-
-                pthread_mutex_lock(&s->local->lock);
-                while (simple_linked_list_size(s->local->packets) >= (int) s->local->max_packets && !s->local->should_exit) {
-                        pthread_cond_wait(&s->local->reader_cv, &s->local->lock);
+                struct timespec ts = { 0, 0 };
+                if (c->cmsg_type == SCM_TIMESTAMPNS) {
+                        memcpy(&ts, CMSG_DATA(c), sizeof ts);
+                } else if (c->cmsg_type == SCM_TIMESTAMPING) {
+                        struct scm_timestamping tss;
+                        memcpy(&tss, CMSG_DATA(c), sizeof tss);
+                        // raw hardware timestamp, software if the NIC didn't stamp it
+                        ts = tss.ts[2].tv_sec != 0 ? tss.ts[2] : tss.ts[0];
+                } else {
+                        continue;
                 }
-                if (s->local->should_exit) {
-                        free(packet);
-                        pthread_mutex_unlock(&s->local->lock);
-                        break;
+                const time_ns_t recv_time = ts.tv_sec * NS_IN_SEC + ts.tv_nsec;
+                const time_ns_t skew = get_time_in_ns() - recv_time;
+                if (skew > UDP_TSTAMP_MAX_SKEW_NS || skew < -UDP_TSTAMP_MAX_SKEW_NS) {
+                        log_msg_once(LOG_LEVEL_WARNING, to_fourcc('U', 'R', 'T', 'S'),
+                                        MOD_NAME "Receive timestamps differ from the system clock by "
+                                        "%.3f s, not using them.\n", (double) skew / NS_IN_SEC_DBL);
+                        return 0;
                 }
-
-                struct item *i = (struct item *)(void *)(packet + ALIGNED_ITEM_OFF);
-                *i = (struct item){packet, size, src_addr, addrlen};
-                simple_linked_list_append(s->local->packets, i);
-
-                pthread_mutex_unlock(&s->local->lock);
-                pthread_cond_signal(&s->local->boss_cv);
+                return recv_time;
         }
+        return 0;
+}
 
-        platform_pipe_close(s->local->should_exit_fd[0]);
-
-        return NULL;
+/**
+ * Enables kernel (or NIC with cfg "hw") receive timestamps on the receiving
+ * sockets, the timestamps are read by the reader threads.
+ */
+static void udp_init_rx_timestamps(socket_udp *s, const char *cfg)
+{
+        struct socket_udp_local *l = s->local;
+        const bool hw = strcmp(cfg, "hw") == 0;
+        const int optname = hw ? SO_TIMESTAMPING : SO_TIMESTAMPNS;
+        const int val = hw ? SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+                        SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE : 1;
+        if (l->xdp != NULL || l->uring != NULL) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Receive timestamps are not supported "
+                                "with AF_XDP or io_uring, timestamping in the reader thread.\n");
+                return;
+        }
+        if (SETSOCKOPT(l->rx_fd, SOL_SOCKET, optname, &val, sizeof val) != 0) {
+                socket_error("setsockopt SO_TIMESTAMP%s", hw ? "ING" : "NS");
+                return;
+        }
+        for (int i = 0; i < l->fanout_count; ++i) {
+                if (SETSOCKOPT(l->fanout[i].fd, SOL_SOCKET, optname, &val, sizeof val) != 0) {
+                        socket_error("setsockopt SO_TIMESTAMP%s", hw ? "ING" : "NS");
+                }
+        }
+        l->rx_tstamp = hw ? UDP_RX_TSTAMP_HW : UDP_RX_TSTAMP_SW;
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using %s receive timestamps.\n", hw ? "hardware" : "kernel");
 }
 
-static int udp_do_recv(socket_udp * s, char *buffer, int buflen, int flags, struct sockaddr *src_addr, socklen_t *addrlen)
+/**
+ * The socket is shared with the sender, so select() reports it readable also
+ * when there are SO_TXTIME or MSG_ZEROCOPY reports in the error queue. These
+ * are consumed here (the sender releases the data on its next call). Otherwise
+ * back off shortly instead of spinning (or blocking in recv, which would also
+ * prevent the thread from exiting).
+ */
+static void udp_reader_spurious_wakeup(const struct udp_reader_src *r)
 {
-        /* Reads data into the buffer, returning the number of bytes read.   */
-        /* If no data is available, this returns the value zero immediately. */
-        /* Note: since we don't care about the source address of the packet  */
-        /* we receive, this function becomes protocol independent.           */
-        int len;
+        if (r->fd == r->s->local->tx_fd && udp_read_errqueue_reports(r->s->local)) {
+                return;
+        }
+        struct timespec ts = { 0, 100 * 1000 };
+        nanosleep(&ts, NULL);
+}
 
-        assert(buffer != NULL);
-        assert(buflen > 0);
+struct udp_recv_batch_stats {
+        time_ns_t last_report;
+        long long calls;
+        long long packets;
+        long long full; ///< number of calls that filled whole batch
+};
 
-        len = recvfrom(s->local->rx_fd, buffer, buflen, flags, src_addr, addrlen);
-        if (len > 0) {
-                return len;
+static void udp_reader_report_batch(struct udp_recv_batch_stats *st, int batch)
+{
+        const time_ns_t now = get_time_in_ns();
+        if (st->last_report == 0) {
+                st->last_report = now;
+                return;
         }
-        if (errno != ECONNREFUSED) {
-                socket_error("recvfrom");
+        if (now - st->last_report < UDP_RECV_BATCH_REPORT_INTERVAL_NS || st->calls == 0) {
+                return;
         }
-        return 0;
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "recvmmsg batch fill: %.1f/%d datagrams avg, %.1f%% batches full (%lld calls)\n",
+                        (double) st->packets / st->calls, batch, 100.0 * st->full / st->calls, st->calls);
+        *st = (struct udp_recv_batch_stats){ .last_report = now };
 }
 
 /**
- * udp_peek:
- * @s: UDP session.
- * @buffer: buffer to read data into.
- * @buflen: length of @buffer.
- * 
- * Reads from datagram queue associated with UDP session. The data is left
- * in the queue, for future reading using udp_recv().
+ * Reads up to batch datagrams with single syscall. Packet buffers are
+ * preallocated in packets slots. Slots that were not used are kept for next
+ * call.
  *
- * Return value: number of bytes read, returns 0 if no data is available.
- **/
-int udp_peek(socket_udp * s, char *buffer, int buflen)
+ * @retval false if the reader should exit
+ */
+static bool udp_reader_recv_batch(const struct udp_reader_src *r, uint8_t *packets[MAX_UDP_RECV_BATCH], int batch, struct udp_recv_batch_stats *st)
 {
-        return udp_do_recv(s, buffer, buflen, MSG_PEEK, 0, 0);
-}
-
+        socket_udp *s = r->s;
+        struct mmsghdr msgs[MAX_UDP_RECV_BATCH];
+        struct iovec iovecs[MAX_UDP_RECV_BATCH];
+        const bool tstamp = s->local->rx_tstamp != UDP_RX_TSTAMP_NONE;
+        alignas(struct cmsghdr) char control[MAX_UDP_RECV_BATCH][UDP_TSTAMP_CONTROL_LEN];
+
+        for (int i = 0; i < batch; ++i) {
+                if (packets[i] == NULL) {
+                        packets[i] = udp_reader_alloc_packet(s, r->pooled);
+                }
+                iovecs[i].iov_base = packets[i] + RTP_PACKET_HEADER_SIZE;
+                iovecs[i].iov_len = RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE;
+                memset(&msgs[i].msg_hdr, 0, sizeof msgs[i].msg_hdr);
+                msgs[i].msg_hdr.msg_name = packets[i] + ALIGNED_SOCKADDR_STORAGE_OFF;
+                msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+                msgs[i].msg_hdr.msg_iov = &iovecs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+                if (tstamp) {
+                        msgs[i].msg_hdr.msg_control = control[i];
+                        msgs[i].msg_hdr.msg_controllen = sizeof control[i];
+                }
+        }
+
+        int ret = recvmmsg(r->fd, msgs, batch, MSG_DONTWAIT, NULL);
+        if (ret == 0) { // empty batch, errno is not set
+                return true;
+        }
+        if (ret < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        socket_error("recvmmsg");
+                } else {
+                        udp_reader_spurious_wakeup(r);
+                }
+                return true;
+        }
+
+        int sizes[MAX_UDP_RECV_BATCH];
+        socklen_t addrlens[MAX_UDP_RECV_BATCH];
+        time_ns_t recv_times[MAX_UDP_RECV_BATCH];
+        for (int i = 0; i < ret; ++i) {
+                sizes[i] = (int) msgs[i].msg_len;
+                addrlens[i] = msgs[i].msg_hdr.msg_namelen;
+                recv_times[i] = tstamp ? udp_cmsg_recv_time(&msgs[i].msg_hdr) : 0;
+        }
+        st->calls += 1;
+        st->packets += ret;
+        st->full += ret == batch;
+        udp_reader_report_batch(st, batch);
+
+        bool cont = udp_reader_enqueue(s, packets, sizes, addrlens,
+                        s->local->rx_tstamp != UDP_RX_TSTAMP_NONE ? recv_times : NULL, ret);
+        // move unused preallocated slots to the beginning
+        memmove(packets, packets + ret, (MAX_UDP_RECV_BATCH - ret) * sizeof packets[0]);
+        memset(packets + MAX_UDP_RECV_BATCH - ret, 0, ret * sizeof packets[0]);
+        return cont;
+}
+#endif // defined __linux__
+
+static bool udp_reader_recv_single(const struct udp_reader_src *r)
+{
+        socket_udp *s = r->s;
+        uint8_t *packet = udp_reader_alloc_packet(s, r->pooled);
+        uint8_t *buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
+        struct sockaddr *src_addr = (struct sockaddr *)(void *)(packet + ALIGNED_SOCKADDR_STORAGE_OFF);
+        socklen_t addrlen = sizeof(struct sockaddr_storage);
+        time_ns_t recv_time = 0;
+#ifdef __linux__
+        struct iovec iov = { buffer, RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE };
+        alignas(struct cmsghdr) char control[UDP_TSTAMP_CONTROL_LEN];
+        struct msghdr msg = { .msg_name = src_addr, .msg_namelen = addrlen,
+                .msg_iov = &iov, .msg_iovlen = 1 };
+        if (s->local->rx_tstamp != UDP_RX_TSTAMP_NONE) {
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof control;
+        }
+        int size = recvmsg(r->fd, &msg, MSG_DONTWAIT); // see udp_reader_spurious_wakeup()
+        if (size > 0) {
+                addrlen = msg.msg_namelen;
+                recv_time = s->local->rx_tstamp != UDP_RX_TSTAMP_NONE ? udp_cmsg_recv_time(&msg) : 0;
+        }
+#else
+        int size = recvfrom(r->fd, (char *) buffer,
+                        RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
+                        0, src_addr, &addrlen);
+#endif
+
+        if (size <= 0) {
+#ifdef __linux__
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        rtp_pkt_free(packet);
+                        udp_reader_spurious_wakeup(r);
+                        return true;
+                }
+#endif
+                /// @todo
+                /// In MSW, this block is called as often as packet is sent if
+                /// we got WSAECONNRESET error (noone is listening). This can have
+                /// negative performance impact.
+                socket_error("recvfrom");
+                rtp_pkt_free(packet);
+                return true;
+        }
+
+        return udp_reader_enqueue(s, &packet, &size, &addrlen, &recv_time, 1);
+}
+
+#ifdef __linux__
+/// collects packets received by the AF_XDP or io_uring backend
+struct udp_reader_collect {
+        socket_udp *s;
+        uint8_t *packets[MAX_UDP_RECV_BATCH];
+        int sizes[MAX_UDP_RECV_BATCH];
+        socklen_t addrlens[MAX_UDP_RECV_BATCH];
+        int count;
+};
+
+static void udp_reader_collect_packet(void *udata, const unsigned char *data,
+                                      int len, const struct sockaddr *src,
+                                      socklen_t src_len)
+{
+        struct udp_reader_collect *r = udata;
+        if (len > RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Dropping oversized datagram (%d B)\n", len);
+                return;
+        }
+        uint8_t *packet = udp_reader_alloc_packet(r->s, true);
+        memcpy(packet + RTP_PACKET_HEADER_SIZE, data, len);
+        memcpy(packet + ALIGNED_SOCKADDR_STORAGE_OFF, src, src_len);
+        r->packets[r->count] = packet;
+        r->sizes[r->count] = len;
+        r->addrlens[r->count] = src_len;
+        r->count += 1;
+}
+
+static bool udp_reader_recv_xdp(socket_udp *s)
+{
+        struct udp_reader_collect r = { .s = s };
+        udp_xdp_recv_batch(s->local->xdp, MAX_UDP_RECV_BATCH, udp_reader_collect_packet, &r);
+        if (r.count == 0) {
+                return true;
+        }
+        return udp_reader_enqueue(s, r.packets, r.sizes, r.addrlens, NULL, r.count);
+}
+
+/// @retval false if the reader should exit
+static bool udp_reader_recv_uring(socket_udp *s)
+{
+        struct udp_reader_collect r = { .s = s };
+        const int ret = udp_uring_recv(s->local->uring, MAX_UDP_RECV_BATCH, udp_reader_collect_packet, &r);
+        const bool cont = r.count == 0 || udp_reader_enqueue(s, r.packets, r.sizes, r.addrlens, NULL, r.count);
+        return cont && ret >= 0;
+}
+
+/**
+ * @param cfg <iface>[:<queue>]
+ */
+static struct udp_xdp *udp_init_xdp(socket_udp *s, const char *cfg)
+{
+        char ifname[IF_NAMESIZE] = "";
+        int queue = 0;
+        const char *colon = strchr(cfg, ':');
+        const size_t ifname_len = colon ? (size_t) (colon - cfg) : strlen(cfg);
+        if (ifname_len == 0 || ifname_len >= sizeof ifname) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong udp-xdp interface: %s\n", cfg);
+                return NULL;
+        }
+        memcpy(ifname, cfg, ifname_len);
+        if (colon != NULL) {
+                queue = atoi(colon + 1);
+        }
+
+        return udp_xdp_init(ifname, queue, socket_get_recv_port(s->local->rx_fd),
+                        s->local->mode == IPv6);
+}
+#endif // defined __linux__
+
+/**
+ * Receives from the reader's socket (plus AF_XDP socket for the main reader)
+ * and puts the data in the queue until the exit is requested.
+ */
+static void udp_reader_loop(const struct udp_reader_src *r)
+{
+        socket_udp *s = r->s;
+        const bool primary = r->fd == s->local->rx_fd;
+#ifdef __linux__
+        uint8_t *batch_packets[MAX_UDP_RECV_BATCH] = { NULL };
+        struct udp_recv_batch_stats batch_stats = { 0 };
+        struct udp_xdp *xdp = primary ? s->local->xdp : NULL;
+#else
+        UNUSED(primary);
+#endif
+
+        while (1) {
+                fd_set fds;
+                FD_ZERO(&fds);
+                FD_SET(r->fd, &fds);
+                FD_SET(s->local->should_exit_fd[0], &fds);
+                int nfds = MAX(r->fd, s->local->should_exit_fd[0]) + 1;
+#ifdef __linux__
+                if (xdp != NULL) {
+                        FD_SET(udp_xdp_fd(xdp), &fds);
+                        nfds = MAX(nfds, udp_xdp_fd(xdp) + 1);
+                }
+#endif
+
+                int rc = select(nfds, &fds, NULL, NULL, NULL);
+                if (rc <= 0) {
+                        socket_error("select");
+                        continue;
+                }
+                if (FD_ISSET(s->local->should_exit_fd[0], &fds)) {
+                        break;
+                }
+                bool cont = true;
+#ifdef __linux__
+                if (xdp != NULL && FD_ISSET(udp_xdp_fd(xdp), &fds)) {
+                        cont = udp_reader_recv_xdp(s);
+                }
+                if (!cont) {
+                        break;
+                }
+                if (!FD_ISSET(r->fd, &fds)) {
+                        continue;
+                }
+                const int batch = s->local->recv_batch;
+                if (batch > 1) {
+                        cont = udp_reader_recv_batch(r, batch_packets, batch, &batch_stats);
+                } else
+#endif
+                {
+                        cont = udp_reader_recv_single(r);
+                }
+                if (!cont) {
+                        break;
+                }
+        }
+
+#ifdef __linux__
+        for (int i = 0; i < MAX_UDP_RECV_BATCH; ++i) {
+                rtp_pkt_free(batch_packets[i]);
+        }
+#endif
+}
+
+/**
+ * When receiving data in separate thread, this function fetches data
+ * from socket and puts it in queue.
+ */
+static void *udp_reader(void *arg)
+{
+        set_thread_name(__func__);
+        socket_udp *s = (socket_udp *) arg;
+#ifdef __linux__
+        if (s->local->uring != NULL) {
+                while (udp_reader_recv_uring(s)) {
+                }
+                return NULL;
+        }
+#endif
+        // with fan-out, the pool is not used as there are multiple allocating threads
+        struct udp_reader_src r = { .s = s, .fd = s->local->rx_fd,
+#ifdef __linux__
+                .pooled = s->local->fanout_count == 0,
+#else
+                .pooled = true,
+#endif
+        };
+        udp_reader_loop(&r);
+        return NULL;
+}
+
+#ifdef __linux__
+static void *udp_fanout_reader(void *arg)
+{
+        set_thread_name(__func__);
+        udp_reader_loop((struct udp_reader_src *) arg);
+        return NULL;
+}
+
+/**
+ * Attaches classic BPF reuseport program selecting the socket by the video
+ * substream (tile) index - bits 22-31 of the first word of the video (or FEC)
+ * payload header that follows the 12 B RTP header.
+ */
+static bool udp_fanout_attach_cbpf(fd_t fd, int count)
+{
+        struct sock_filter code[] = {
+                { BPF_LD | BPF_W | BPF_ABS, 0, 0, 12 },
+                { BPF_ALU | BPF_RSH | BPF_K, 0, 0, 22 },
+                { BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t) count },
+                { BPF_RET | BPF_A, 0, 0, 0 },
+        };
+        struct sock_fprog prog = { .len = sizeof code / sizeof code[0], .filter = code };
+        if (SETSOCKOPT(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof prog) != 0) {
+                socket_error("setsockopt SO_ATTACH_REUSEPORT_CBPF");
+                return false;
+        }
+        return true;
+}
+
+/**
+ * Opens additional sockets bound to the same port as rx_fd, forming a
+ * SO_REUSEPORT group whose members are read by separate threads.
+ *
+ * @param cfg <n>[:hash]
+ */
+static bool udp_init_fanout(socket_udp *s, const char *cfg, int ttl)
+{
+        const int count = atoi(cfg);
+        const bool hash = strstr(cfg, ":hash") != NULL;
+        if (count < 1 || count > MAX_UDP_FANOUT) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong number of fan-out sockets: %s (1-%d)\n", cfg, MAX_UDP_FANOUT);
+                return false;
+        }
+        const uint16_t port = socket_get_recv_port(s->local->rx_fd);
+        s->local->fanout = (struct udp_reader_src *) calloc(count - 1, sizeof s->local->fanout[0]);
+        for (int i = 0; i < count - 1; ++i) {
+                struct udp_reader_src *r = &s->local->fanout[s->local->fanout_count];
+                r->s = s;
+                r->fd = socket(s->sock.ss_family, SOCK_DGRAM, 0);
+                if (r->fd == INVALID_SOCKET) {
+                        socket_error("Unable to initialize fan-out socket");
+                        return false;
+                }
+                if (!set_sock_opts_and_bind(r->fd, s->local->mode == IPv6, port, ttl)) {
+                        CLOSESOCKET(r->fd);
+                        return false;
+                }
+                s->local->fanout_count += 1;
+        }
+        if (!hash && !udp_fanout_attach_cbpf(s->local->rx_fd, count)) {
+                return false;
+        }
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Receiving port %u with %d sockets (steering: %s)\n",
+                        port, count, hash ? "flow hash" : "substream");
+        return true;
+}
+#endif // defined __linux__
+
+/**
+ * Sets pool that packets received by the reader thread of a multithreaded
+ * socket are allocated from. Buffers are released with rtp_pkt_free().
+ *
+ * @param pool pool or NULL to use malloc
+ */
+void udp_set_pkt_pool(socket_udp *s, struct rtp_pkt_pool *pool)
+{
+        s->local->pkt_pool = pool;
+}
+
+/// @returns size of a packet buffer allocated by the reader thread
+size_t udp_get_recv_pkt_size(void)
+{
+        return ALIGNED_ITEM_OFF + sizeof(struct item);
+}
+
+/**
+ * Sets number of datagrams that the reader thread of a multithreaded socket
+ * reads at once with recvmmsg(). Can be changed also when receiving is in
+ * progress.
+ *
+ * @param count number of datagrams, 1 disables batching
+ * @retval false if batching is not supported (not Linux or socket not
+ *               multithreaded) or count is out of range
+ */
+bool udp_set_recv_batch(socket_udp *s, int count)
+{
+        if (count < 1 || count > MAX_UDP_RECV_BATCH) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Receive batch size must be in range 1-%d, got %d!\n", MAX_UDP_RECV_BATCH, count);
+                return false;
+        }
+#ifdef __linux__
+        if (!s->local->multithreaded) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Receive batching is supported only for multithreaded sockets.\n");
+                return false;
+        }
+        s->local->recv_batch = count;
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Receive batch size set to %d.\n", count);
+        return true;
+#else
+        if (count > 1) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Receive batching is supported only in Linux.\n");
+        }
+        return count == 1;
+#endif
+}
+
+static int udp_do_recv(socket_udp * s, char *buffer, int buflen, int flags, struct sockaddr *src_addr, socklen_t *addrlen)
+{
+        /* Reads data into the buffer, returning the number of bytes read.   */
+        /* If no data is available, this returns the value zero immediately. */
+        /* Note: since we don't care about the source address of the packet  */
+        /* we receive, this function becomes protocol independent.           */
+        int len;
+
+        assert(buffer != NULL);
+        assert(buflen > 0);
+
+        len = recvfrom(s->local->rx_fd, buffer, buflen, flags, src_addr, addrlen);
+        if (len > 0) {
+                return len;
+        }
+        if (errno != ECONNREFUSED) {
+                socket_error("recvfrom");
+        }
+        return 0;
+}
+
+/**
+ * udp_peek:
+ * @s: UDP session.
+ * @buffer: buffer to read data into.
+ * @buflen: length of @buffer.
+ * 
+ * Reads from datagram queue associated with UDP session. The data is left
+ * in the queue, for future reading using udp_recv().
+ *
+ * Return value: number of bytes read, returns 0 if no data is available.
+ **/
+int udp_peek(socket_udp * s, char *buffer, int buflen)
+{
+        return udp_do_recv(s, buffer, buflen, MSG_PEEK, 0, 0);
+}
+
 /**
  * @brief
  * Checks whether there are data ready to read in socket
@@ -1198,7 +2230,12 @@ bool udp_not_empty(socket_udp * s, struct timeval *timeout)
 {
         assert(s->local->multithreaded);
 
+        if (udp_ring_size(s->local) > 0) {
+                return true;
+        }
+
         pthread_mutex_lock(&s->local->lock);
+        atomic_store(&s->local->boss_waiting, true);
         if (timeout) {
                 struct timeval tv;
                 gettimeofday(&tv, NULL);
@@ -1210,19 +2247,37 @@ bool udp_not_empty(socket_udp * s, struct timeval *timeout)
                 }
                 struct timespec tmout_ts = { tv.tv_sec, tv.tv_usec * 1000 };
                 int rc = 0;
-                while (rc != ETIMEDOUT && simple_linked_list_size(s->local->packets) == 0) {
+                while (rc != ETIMEDOUT && udp_ring_size(s->local) == 0 &&
+                       !s->local->boss_wakeup) {
                         rc = pthread_cond_timedwait(&s->local->boss_cv, &s->local->lock, &tmout_ts);
                 }
         } else {
-                while (simple_linked_list_size(s->local->packets) == 0) {
+                while (udp_ring_size(s->local) == 0 && !s->local->boss_wakeup) {
                         pthread_cond_wait(&s->local->boss_cv, &s->local->lock);
                 }
         }
-        bool ret = simple_linked_list_size(s->local->packets) > 0;
+        atomic_store(&s->local->boss_waiting, false);
+        s->local->boss_wakeup = false;
+        bool ret = udp_ring_size(s->local) > 0;
         pthread_mutex_unlock(&s->local->lock);
         return ret;
 }
 
+/**
+ * Interrupts udp_not_empty() waiting in another thread (or the next call if
+ * none is waiting). No-op for a socket without the reader thread.
+ */
+void udp_wake(socket_udp *s)
+{
+        if (!s->local->multithreaded) {
+                return;
+        }
+        pthread_mutex_lock(&s->local->lock);
+        s->local->boss_wakeup = true;
+        pthread_cond_signal(&s->local->boss_cv);
+        pthread_mutex_unlock(&s->local->lock);
+}
+
 /**
  * udp_recv:
  * @s: UDP session.
@@ -1251,7 +2306,8 @@ int udp_recvfrom(socket_udp *s, char *buffer, int buflen, struct sockaddr *src_a
  * Receives data from multithreaded socket.
  *
  * @param[in] s       UDP socket state
- * @param[out] buffer data received from socket. Must be freed by caller!
+ * @param[out] buffer data received from socket. Must be freed by caller with
+ *                    rtp_pkt_free()!
  * @returns           length of the received datagram
  */
 int udp_recvfrom_data(socket_udp * s, char **buffer,
@@ -1260,8 +2316,7 @@ int udp_recvfrom_data(socket_udp * s, char **buffer,
         assert(s->local->multithreaded);
         int ret;
 
-        pthread_mutex_lock(&s->local->lock);
-        struct item *it = (struct item *)(simple_linked_list_pop(s->local->packets));
+        struct item *it = udp_ring_pop(s->local);
         *buffer = (char *) it->buf;
         if(src_addr){
                 if(it->src_addr){
@@ -1273,15 +2328,22 @@ int udp_recvfrom_data(socket_udp * s, char **buffer,
         }
         ret = it->size;
 
-        pthread_mutex_unlock(&s->local->lock);
-        pthread_cond_signal(&s->local->reader_cv);
-
         return ret;
 }
 int udp_recv_data(socket_udp * s, char **buffer){
         return udp_recvfrom_data(s, buffer, NULL, NULL);
 }
 
+/**
+ * @param buffer packet returned by udp_recv_data() or udp_recvfrom_data()
+ * @returns receive time (get_time_in_ns() clock) - kernel timestamp with
+ *          udp-rx-timestamps, otherwise the time the reader thread read it
+ */
+time_ns_t udp_recv_data_time(const char *buffer)
+{
+        return ((const struct item *)(const void *) (buffer + ALIGNED_ITEM_OFF))->recv_time;
+}
+
 #ifndef _WIN32
 int udp_recvv(socket_udp * s, struct msghdr *m)
 {
@@ -1465,6 +2527,15 @@ udp_set_buf(socket_udp *s, int sockopt, int size)
                 socket_error("Unable to set socket buffer size");
                 return false;
         }
+#ifdef __linux__
+        for (int i = 0; sockopt == SO_RCVBUF && i < s->local->fanout_count; ++i) {
+                if (SETSOCKOPT(s->local->fanout[i].fd, SOL_SOCKET, sockopt,
+                               (sockopt_t) &size, sizeof(size)) != 0) {
+                        socket_error("Unable to set socket buffer size");
+                        return false;
+                }
+        }
+#endif
 
         int       opt      = 0;
         socklen_t opt_size = sizeof opt;
@@ -1494,6 +2565,40 @@ udp_set_send_buf(socket_udp *s, int size)
         return udp_set_buf(s, SO_SNDBUF, size);
 }
 
+#if defined __linux__ && defined SO_MEMINFO
+/// @returns sk_drops of the socket, -1 if not available
+static long long
+udp_get_socket_drops(fd_t fd)
+{
+        uint32_t meminfo[SK_MEMINFO_VARS] = { 0 };
+        socklen_t len = sizeof meminfo;
+        if (getsockopt(fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) != 0 ||
+            len <= SK_MEMINFO_DROPS * sizeof meminfo[0]) {
+                return -1;
+        }
+        return meminfo[SK_MEMINFO_DROPS];
+}
+#endif
+
+/**
+ * Kernel drops are read with SO_MEMINFO (the same counter as "drops" in
+ * /proc/net/udp), Linux only.
+ */
+void
+udp_get_rx_drops(socket_udp *s, struct udp_rx_drops *drops)
+{
+        drops->socket     = -1;
+        drops->queue_full = atomic_load_explicit(&s->local->queue_full,
+                                                 memory_order_relaxed);
+#if defined __linux__ && defined SO_MEMINFO
+        drops->socket = udp_get_socket_drops(s->local->rx_fd);
+        for (int i = 0; drops->socket != -1 && i < s->local->fanout_count; ++i) {
+                const long long val = udp_get_socket_drops(s->local->fanout[i].fd);
+                drops->socket = val == -1 ? -1 : drops->socket + val;
+        }
+#endif
+}
+
 /*
  * TODO: This should be definitely removed. We need to solve audio burst avoidance first.
  */
@@ -1548,34 +2653,705 @@ void udp_async_start(socket_udp *s, int nr_packets)
 
         s->overlapped_count = 0;
         s->overlapping_active = true;
+#elif defined __linux__
+        UNUSED(nr_packets);
+        if (s->local->zc != NULL) {
+                udp_read_errqueue(s->local);
+        }
+        if (get_commandline_param("udp-disable-send-batch") != NULL) {
+                return;
+        }
+        if (s->send_batch == NULL) {
+                s->send_batch = (struct udp_send_batch *) calloc(1, sizeof *s->send_batch);
+                s->send_batch->gso = get_commandline_param("udp-gso") != NULL;
+        }
+        s->send_batch->active = true;
 #else
         UNUSED(nr_packets);
         UNUSED(s);
 #endif
 }
 
-void udp_async_wait(socket_udp *s)
+#ifdef __linux__
+static void udp_zc_push(struct udp_zerocopy *zc, uint32_t needed, void (*release)(void *), void *arg)
 {
-#ifdef _WIN32
-        if (!s->overlapping_active)
-                return;
-        for(int i = 0; i < s->overlapped_count; i += WSA_MAXIMUM_WAIT_EVENTS)
-        {
-                int count = WSA_MAXIMUM_WAIT_EVENTS;
-                if (s->overlapped_count - i < WSA_MAXIMUM_WAIT_EVENTS)
-                        count = s->overlapped_count - i;
-                DWORD ret = WSAWaitForMultipleEvents(count, s->overlapped_events + i, TRUE, INFINITE, TRUE);
-                if (ret == WSA_WAIT_FAILED) {
-                        socket_error("WSAWaitForMultipleEvents");
+        if (zc->count == zc->alloc) {
+                size_t alloc = MAX(2 * zc->alloc, 256);
+                struct udp_zc_entry *entries = (struct udp_zc_entry *) malloc(alloc * sizeof entries[0]);
+                for (size_t i = 0; i < zc->count; ++i) {
+                        entries[i] = zc->entries[(zc->first + i) % zc->alloc];
                 }
+                free(zc->entries);
+                zc->entries = entries;
+                zc->alloc = alloc;
+                zc->first = 0;
         }
-        for (int i = 0; i < s->overlapped_count; i++) {
-                if (WSAResetEvent(s->overlapped[i].hEvent) == FALSE) {
-                        socket_error("WSAResetEvent");
+        zc->entries[(zc->first + zc->count) % zc->alloc] = (struct udp_zc_entry){ needed, release, arg };
+        zc->count += 1;
+}
+
+static void udp_zc_release_completed(struct socket_udp_local *l)
+{
+        struct udp_zerocopy *zc = l->zc;
+        const uint32_t completed = atomic_load_explicit(&l->zc_completed, memory_order_acquire);
+        while (zc->count > 0) {
+                struct udp_zc_entry *e = &zc->entries[zc->first];
+                if ((int32_t) (completed - e->needed) < 0) {
+                        break;
                 }
-                free(s->dispose_udata[i]);
+                e->release(e->arg);
+                zc->first = (zc->first + 1) % zc->alloc;
+                zc->count -= 1;
+        }
+}
+
+/**
+ * Reads the tx socket error queue - counts SO_TXTIME drops and records
+ * MSG_ZEROCOPY completions. Thread-safe, may be called also by the reader.
+ *
+ * @retval true if there was a report in the queue
+ */
+static bool udp_read_errqueue_reports(struct socket_udp_local *l)
+{
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+        bool ret = false;
+        while (1) {
+                char data[1];
+                struct iovec iov = { data, sizeof data };
+                struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1,
+                        .msg_control = control, .msg_controllen = sizeof control };
+                if (recvmsg(l->tx_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+                        return ret;
+                }
+                ret = true;
+                for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+                        struct sock_extended_err err;
+                        memcpy(&err, CMSG_DATA(cm), sizeof err);
+#ifdef SO_EE_ORIGIN_TXTIME
+                        if (err.ee_origin == SO_EE_ORIGIN_TXTIME) {
+                                atomic_fetch_add_explicit(&l->txtime_errors, 1, memory_order_relaxed);
+                        }
+#endif
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+                        // range [ee_info, ee_data] of notification IDs completed
+                        if (err.ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                                if ((err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0) {
+                                        atomic_fetch_add_explicit(&l->zc_copied,
+                                                        err.ee_data - err.ee_info + 1, memory_order_relaxed);
+                                }
+                                // completions are reported in order for a UDP socket but
+                                // the two threads may process them in different order
+                                uint32_t completed = atomic_load_explicit(&l->zc_completed, memory_order_relaxed);
+                                while ((int32_t) (err.ee_data + 1 - completed) > 0 &&
+                                                !atomic_compare_exchange_weak_explicit(&l->zc_completed,
+                                                        &completed, err.ee_data + 1,
+                                                        memory_order_release, memory_order_relaxed)) {
+                                }
+                        }
+#endif
+                }
+        }
+}
+
+/**
+ * Reads the tx socket error queue and releases data of completed zero-copy
+ * sends. Must be called from the sending thread.
+ */
+static void udp_read_errqueue(struct socket_udp_local *l)
+{
+        udp_read_errqueue_reports(l);
+        if (l->zc != NULL) {
+                udp_zc_release_completed(l);
+        }
+}
+
+/**
+ * Frees data associated with sent packets. If the packets were sent with
+ * MSG_ZEROCOPY, it is deferred until the kernel reports the completion.
+ *
+ * @param shared_id packets were sent by a single call (GSO) and thus share
+ *                  single notification ID
+ */
+static void udp_send_batch_dispose(socket_udp *s, int start, int count, bool zerocopy, bool shared_id)
+{
+        struct udp_send_batch *b = s->send_batch;
+        struct udp_zerocopy *zc = s->local->zc;
+        for (int i = start; i < start + count; ++i) {
+                if (!zerocopy) {
+                        if (zc != NULL) { // other copies of the packet may still be pinned by zero-copy sends
+                                udp_zc_push(zc, zc->next_id, free, b->dispose_udata[i]);
+                        } else {
+                                free(b->dispose_udata[i]);
+                        }
+                        continue;
+                }
+                if (!shared_id || i == start) {
+                        zc->next_id += 1;
+                        zc->sends += 1;
+                }
+                udp_zc_push(zc, zc->next_id, free, b->dispose_udata[i]);
+        }
+}
+
+static int udp_msg_len(const struct msghdr *m)
+{
+        int len = 0;
+        for (size_t i = 0; i < m->msg_iovlen; ++i) {
+                len += (int) m->msg_iov[i].iov_len;
+        }
+        return len;
+}
+
+#ifdef UDP_SEGMENT
+/**
+ * Sends a run of packets starting at idx as one GSO datagram. All packets in
+ * the run must be of equal size except the last one, which may be shorter.
+ *
+ * @returns number of packets sent, 0 on GSO failure (GSO is then disabled)
+ */
+static int udp_send_batch_gso(socket_udp *s, int idx, int flags)
+{
+        struct udp_send_batch *b = s->send_batch;
+        const int seg_size = udp_msg_len(&b->msgs[idx].msg_hdr);
+        struct iovec iov[MAX_UDP_SEND_BATCH * UDP_SEND_BATCH_MAX_IOV];
+        int iovcnt = 0;
+        int total = 0;
+        int n = 0;
+        while (idx + n < b->count && total + seg_size <= UDP_GSO_MAX_LEN) {
+                const struct msghdr *m = &b->msgs[idx + n].msg_hdr;
+                const int len = udp_msg_len(m);
+                if (len > seg_size) {
+                        break;
+                }
+                memcpy(iov + iovcnt, m->msg_iov, m->msg_iovlen * sizeof iov[0]);
+                iovcnt += (int) m->msg_iovlen;
+                total += len;
+                n += 1;
+                if (len < seg_size) { // shorter packet must be the last one
+                        break;
+                }
+        }
+        if (n <= 1) {
+                return 0;
+        }
+
+        char control[CMSG_SPACE(sizeof(uint16_t))] = { 0 };
+        struct msghdr msg = { .msg_name = &s->sock, .msg_namelen = s->sock_len,
+                .msg_iov = iov, .msg_iovlen = iovcnt,
+                .msg_control = control, .msg_controllen = sizeof control };
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_UDP;
+        cm->cmsg_type = UDP_SEGMENT;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        *((uint16_t *)(void *) CMSG_DATA(cm)) = seg_size;
+
+        if (sendmsg(s->local->tx_fd, &msg, flags) == -1) {
+                if (errno == ENOBUFS && flags != 0) { // zero-copy limit reached, try regular send
+                        return 0;
+                }
+                socket_error("sendmsg UDP_SEGMENT - disabling GSO");
+                b->gso = false;
+                return 0;
+        }
+        return n;
+}
+#endif // defined UDP_SEGMENT
+
+/// sends all queued packets and frees their associated data
+static void udp_send_batch_flush(socket_udp *s)
+{
+        struct udp_send_batch *b = s->send_batch;
+        const int zc_flags = s->local->zc != NULL ? MSG_ZEROCOPY : 0;
+        int sent = 0;
+        while (sent < b->count) {
+#ifdef UDP_SEGMENT
+                if (b->gso && !s->local->txtime && s->dest_count == 0) { // GSO run would share single departure time (and destination)
+                        int ret = udp_send_batch_gso(s, sent, zc_flags);
+                        if (ret > 0) {
+                                udp_send_batch_dispose(s, sent, ret, zc_flags != 0, true);
+                                sent += ret;
+                                continue;
+                        }
+                }
+#endif
+                const int count = b->gso && !s->local->txtime && s->dest_count == 0 ? 1 : b->count - sent;
+                int flags = zc_flags;
+                int ret = sendmmsg(s->local->tx_fd, b->msgs + sent, count, flags);
+                if (ret <= 0 && errno == ENOBUFS && flags != 0) {
+                        // optmem exhausted by pending notifications - reap them and copy this time
+                        udp_read_errqueue(s->local);
+                        flags = 0;
+                        ret = sendmmsg(s->local->tx_fd, b->msgs + sent, count, flags);
+                }
+                if (ret <= 0) {
+                        void *name = b->msgs[sent].msg_hdr.msg_name;
+                        if (name == &s->sock) {
+                                socket_error("sendmmsg");
+                        } else {
+                                udp_dest_error((struct udp_dest *)(void *)((char *) name - offsetof(struct udp_dest, addr)));
+                        }
+                        ret = 1; // skip the failing packet
+                        flags = 0;
+                }
+                udp_send_batch_dispose(s, sent, ret, flags != 0, false);
+                sent += ret;
+        }
+        b->count = 0;
+        if (zc_flags != 0) {
+                udp_read_errqueue(s->local);
+        }
+}
+
+static void udp_enqueue_msg(socket_udp *s, struct iovec *vector, int count,
+                struct sockaddr_storage *addr, socklen_t addrlen, void *d)
+{
+        struct udp_send_batch *b = s->send_batch;
+        memcpy(b->iov[b->count], vector, count * sizeof vector[0]);
+        struct msghdr *m = &b->msgs[b->count].msg_hdr;
+        memset(m, 0, sizeof *m);
+        m->msg_name = addr;
+        m->msg_namelen = addrlen;
+        m->msg_iov = b->iov[b->count];
+        m->msg_iovlen = count;
+        b->dispose_udata[b->count] = d;
+        b->count += 1;
+}
+
+/**
+ * Queues the packet, once for the primary destination and once for every
+ * additional one (they share the iovecs, data is released with the last copy).
+ *
+ * @retval false packet cannot be queued and must be sent directly
+ */
+static bool udp_sendv_enqueue(socket_udp *s, struct iovec *vector, int count, void *d)
+{
+        struct udp_send_batch *b = s->send_batch;
+        int copies = 1;
+        for (int i = 0; i < s->dest_count; ++i) {
+                copies += s->dests[i].disabled ? 0 : 1;
+        }
+        if (count > UDP_SEND_BATCH_MAX_IOV || copies > MAX_UDP_SEND_BATCH) {
+                udp_send_batch_flush(s); // keep the order
+                return false;
+        }
+        if (b->count + copies > MAX_UDP_SEND_BATCH) {
+                udp_send_batch_flush(s);
+        }
+        const int first = b->count;
+        udp_enqueue_msg(s, vector, count, &s->sock, s->sock_len, copies == 1 ? d : NULL);
+        udp_set_txtime_cmsg(s, &b->msgs[first].msg_hdr, b->control[first]);
+        for (int i = 0; i < s->dest_count; ++i) {
+                if (s->dests[i].disabled) {
+                        continue;
+                }
+                const int idx = b->count;
+                udp_enqueue_msg(s, vector, count, &s->dests[i].addr, s->dests[i].len,
+                                idx == first + copies - 1 ? d : NULL);
+                if (b->msgs[first].msg_hdr.msg_controllen > 0) { // same departure time
+                        memcpy(b->control[idx], b->control[first], sizeof b->control[idx]);
+                        b->msgs[idx].msg_hdr.msg_control = b->control[idx];
+                        b->msgs[idx].msg_hdr.msg_controllen = b->msgs[first].msg_hdr.msg_controllen;
+                }
+        }
+        return true;
+}
+#endif // defined __linux__
+
+/**
+ * Enables kernel-paced transmission - each packet may then carry its departure
+ * time set with udp_set_next_txtime() and the spacing is done by the fq (or
+ * etf) qdisc or the NIC.
+ *
+ * @retval false SO_TXTIME is not supported
+ */
+bool udp_enable_txtime(socket_udp *s)
+{
+#if defined __linux__ && defined SO_TXTIME
+        if (s->local->txtime) {
+                return true;
+        }
+        struct sock_txtime cfg = { .clockid = CLOCK_MONOTONIC, .flags = SOF_TXTIME_REPORT_ERRORS };
+        if (SETSOCKOPT(s->local->tx_fd, SOL_SOCKET, SO_TXTIME, &cfg, sizeof cfg) != 0) {
+                socket_error("setsockopt SO_TXTIME");
+                return false;
+        }
+        s->local->txtime = true;
+        return true;
+#else
+        UNUSED(s);
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "SO_TXTIME is not supported in this platform!\n");
+        return false;
+#endif
+}
+
+/**
+ * Sets departure time of the next packet sent with udp_sendv().
+ * @param txtime time in CLOCK_MONOTONIC nanoseconds
+ */
+void udp_set_next_txtime(socket_udp *s, uint64_t txtime)
+{
+#ifdef __linux__
+        s->next_txtime = txtime;
+#else
+        UNUSED(s), UNUSED(txtime);
+#endif
+}
+
+/**
+ * Reads the socket error queue and returns number of packets that the kernel
+ * reported as dropped because of missed (or invalid) departure time.
+ */
+int udp_get_txtime_errors(socket_udp *s)
+{
+#ifdef __linux__
+        if (!s->local->txtime) {
+                return 0;
+        }
+        udp_read_errqueue(s->local);
+        return atomic_exchange_explicit(&s->local->txtime_errors, 0, memory_order_relaxed);
+#else
+        UNUSED(s);
+        return 0;
+#endif
+}
+
+#ifdef __linux__
+/// @returns path MTU cached by the kernel for the route of the connected socket
+static int udp_query_path_mtu(fd_t fd, bool ipv6)
+{
+        int mtu = -1;
+        socklen_t len = sizeof mtu;
+        if (ipv6 ? getsockopt(fd, IPPROTO_IPV6, IPV6_MTU, &mtu, &len)
+                 : getsockopt(fd, IPPROTO_IP, IP_MTU, &mtu, &len)) {
+                socket_error("getsockopt IP_MTU");
+                return -1;
+        }
+        return mtu;
+}
+
+/**
+ * Sends DF datagrams of the currently known path MTU (but at most max_mtu)
+ * until no ICMP error arrives in PMTU_PROBE_TIMEOUT_MS. The probes are zeroed
+ * so that the receiver drops them as an invalid RTP (version 0).
+ */
+static int udp_probe_path_mtu(fd_t fd, bool ipv6, int max_mtu)
+{
+        enum {
+                PMTU_PROBE_ATTEMPTS = 4,
+                PMTU_PROBE_TIMEOUT_MS = 100,
+        };
+        const int hdr_len = (ipv6 ? 40 : 20) + 8;
+        int mtu = udp_query_path_mtu(fd, ipv6);
+        char *probe = (char *) calloc(1, MAX(max_mtu, hdr_len));
+        for (int i = 0; i < PMTU_PROBE_ATTEMPTS && mtu > hdr_len; ++i) {
+                if (send(fd, probe, MIN(mtu, max_mtu) - hdr_len, 0) == -1 &&
+                    errno != EMSGSIZE) {
+                        socket_error("PMTU probe");
+                        break;
+                }
+                struct pollfd pfd = { .fd = fd, .events = 0 };
+                if (poll(&pfd, 1, PMTU_PROBE_TIMEOUT_MS) <= 0) {
+                        break; // no ICMP - probe passed (or was silently dropped)
+                }
+                int err = 0;
+                socklen_t len = sizeof err;
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len); // clear
+                const int new_mtu = udp_query_path_mtu(fd, ipv6);
+                if (new_mtu == mtu) {
+                        break; // other error than "fragmentation needed"
+                }
+                mtu = new_mtu;
+        }
+        free(probe);
+        return mtu < 0 ? mtu : MIN(mtu, max_mtu);
+}
+
+/// @returns socket connected to addr to probe and query path MTU, INVALID_SOCKET on error
+static fd_t udp_pmtu_socket(socket_udp *s, const struct sockaddr_storage *addr, socklen_t len)
+{
+        const bool ipv6 = s->local->mode == IPv6;
+        const int val = ipv6 ? IPV6_PMTUDISC_PROBE : IP_PMTUDISC_PROBE;
+        fd_t fd = socket(addr->ss_family, SOCK_DGRAM, 0);
+        if (fd == INVALID_SOCKET) {
+                socket_error("PMTU socket");
+                return INVALID_SOCKET;
+        }
+        if (SETSOCKOPT(fd, ipv6 ? IPPROTO_IPV6 : IPPROTO_IP,
+                        ipv6 ? IPV6_MTU_DISCOVER : IP_MTU_DISCOVER, &val, sizeof val) != 0 ||
+            connect(fd, (const struct sockaddr *) addr, len) != 0) {
+                socket_error("PMTU socket setup");
+                CLOSESOCKET(fd);
+                return INVALID_SOCKET;
+        }
+        return fd;
+}
+#endif
+
+/**
+ * Enables path MTU discovery - the DF bit is set on the sent datagrams
+ * (IP_PMTUDISC_PROBE, no local fragmentation) and the path to the primary
+ * and to every additional destination (udp_add_dest()) is probed at once with
+ * datagrams of up to max_mtu bytes. Routers with a smaller MTU answer with
+ * ICMP errors that lower the path MTU cached by the kernel, the value can be
+ * then read with udp_get_path_mtu().
+ *
+ * Probing blocks for up to 400 ms per destination, so this should be called
+ * when the socket is set up, not from the sending thread. Destinations added
+ * afterwards are not probed, just their path MTU is watched.
+ *
+ * @returns probed path MTU (minimum of the destinations, at most max_mtu),
+ *          -1 if not supported
+ */
+int udp_enable_pmtu_discovery(socket_udp *s, int max_mtu)
+{
+#if defined __linux__ && defined IP_PMTUDISC_PROBE && defined IPV6_PMTUDISC_PROBE
+        const bool ipv6 = s->local->mode == IPv6;
+        if (!s->pmtu_discovery) {
+                const int val = ipv6 ? IPV6_PMTUDISC_PROBE : IP_PMTUDISC_PROBE;
+                if (SETSOCKOPT(s->local->tx_fd, ipv6 ? IPPROTO_IPV6 : IPPROTO_IP,
+                                ipv6 ? IPV6_MTU_DISCOVER : IP_MTU_DISCOVER, &val, sizeof val) != 0) {
+                        socket_error("setsockopt IP_MTU_DISCOVER");
+                        return -1;
+                }
+                if ((s->pmtu_fd = udp_pmtu_socket(s, &s->sock, s->sock_len)) == INVALID_SOCKET) {
+                        return -1;
+                }
+                for (int i = 0; i < s->dest_count; ++i) {
+                        s->dests[i].pmtu_fd = udp_pmtu_socket(s, &s->dests[i].addr, s->dests[i].len);
+                }
+                s->pmtu_discovery = true;
+        }
+        int mtu = udp_probe_path_mtu(s->pmtu_fd, ipv6, max_mtu);
+        for (int i = 0; i < s->dest_count; ++i) {
+                if (s->dests[i].disabled || s->dests[i].pmtu_fd == INVALID_SOCKET) {
+                        continue;
+                }
+                const int dest_mtu = udp_probe_path_mtu(s->dests[i].pmtu_fd, ipv6, max_mtu);
+                if (dest_mtu > 0) {
+                        mtu = mtu < 0 ? dest_mtu : MIN(mtu, dest_mtu);
+                }
+        }
+        return mtu;
+#else
+        UNUSED(s), UNUSED(max_mtu);
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Path MTU discovery is not supported in this platform!\n");
+        return -1;
+#endif
+}
+
+/**
+ * @returns path MTU towards the destinations (the minimum) as currently known
+ *          by the kernel (lowered by ICMP errors triggered by the sent
+ *          traffic), -1 if udp_enable_pmtu_discovery() was not successfully
+ *          called
+ */
+int udp_get_path_mtu(socket_udp *s)
+{
+#ifdef __linux__
+        if (!s->pmtu_discovery) {
+                return -1;
+        }
+        const bool ipv6 = s->local->mode == IPv6;
+        int mtu = udp_query_path_mtu(s->pmtu_fd, ipv6);
+        for (int i = 0; i < s->dest_count; ++i) {
+                if (s->dests[i].disabled || s->dests[i].pmtu_fd == INVALID_SOCKET) {
+                        continue;
+                }
+                const int dest_mtu = udp_query_path_mtu(s->dests[i].pmtu_fd, ipv6);
+                if (dest_mtu > 0) {
+                        mtu = mtu < 0 ? dest_mtu : MIN(mtu, dest_mtu);
+                }
+        }
+        return mtu;
+#else
+        UNUSED(s);
+        return -1;
+#endif
+}
+
+/**
+ * @returns bytes queued in the send buffer of the socket (not yet passed to
+ *          the NIC), -1 if not supported
+ */
+int udp_get_send_backlog(socket_udp *s)
+{
+#if defined __linux__ && defined SIOCOUTQ
+        int queued = 0;
+        if (ioctl(s->local->tx_fd, SIOCOUTQ, &queued) != 0) {
+                return -1;
+        }
+        return queued;
+#else
+        UNUSED(s);
+        return -1;
+#endif
+}
+
+/**
+ * Enables MSG_ZEROCOPY for packets sent in async (batched) mode. Packet data
+ * are then referenced by the kernel after udp_async_wait() returns, so the
+ * caller must keep them unchanged until the release callback passed to
+ * udp_zerocopy_hold() is called.
+ *
+ * @retval false zero-copy is not supported
+ */
+bool udp_enable_zerocopy(socket_udp *s)
+{
+#if defined __linux__ && defined SO_ZEROCOPY && defined SO_EE_ORIGIN_ZEROCOPY
+        if (s->local->zc != NULL) {
+                return true;
+        }
+        int on = 1;
+        if (SETSOCKOPT(s->local->tx_fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof on) != 0) {
+                socket_error("setsockopt SO_ZEROCOPY");
+                return false;
+        }
+        s->local->zc = (struct udp_zerocopy *) calloc(1, sizeof *s->local->zc);
+        return true;
+#else
+        UNUSED(s);
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "MSG_ZEROCOPY is not supported in this platform!\n");
+        return false;
+#endif
+}
+
+/// @returns whether udp_enable_zerocopy() was successfully called
+bool udp_zerocopy_enabled(socket_udp *s)
+{
+#ifdef __linux__
+        return s->local->zc != NULL;
+#else
+        UNUSED(s);
+        return false;
+#endif
+}
+
+/**
+ * Calls release(arg) once all the packets sent so far have been completed
+ * by the kernel (immediately if zero-copy is disabled). Must be called from
+ * the sending thread.
+ */
+void udp_zerocopy_hold(socket_udp *s, void (*release)(void *), void *arg)
+{
+#ifdef __linux__
+        struct udp_zerocopy *zc = s->local->zc;
+        if (zc != NULL) {
+                udp_zc_push(zc, zc->next_id, release, arg);
+                udp_read_errqueue(s->local);
+                return;
+        }
+#else
+        UNUSED(s);
+#endif
+        release(arg);
+}
+
+#ifdef __linux__
+/**
+ * Waits (up to 1 s) for outstanding zero-copy completions. Held data are
+ * released even on timeout - the kernel keeps its own reference to the
+ * pages, so only the content of still queued packets may get altered.
+ */
+static void udp_zerocopy_drain(struct socket_udp_local *l)
+{
+        struct udp_zerocopy *zc = l->zc;
+        const time_ns_t deadline = get_time_in_ns() + NS_IN_SEC;
+        udp_read_errqueue(l);
+        while (zc->count > 0 && get_time_in_ns() < deadline) {
+                struct pollfd pfd = { .fd = l->tx_fd, .events = POLLERR };
+                poll(&pfd, 1, 1);
+                udp_read_errqueue(l);
+        }
+        if (zc->count > 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Zero-copy: %u sends not completed in time\n",
+                                zc->next_id - atomic_load(&l->zc_completed));
+                atomic_store(&l->zc_completed, zc->next_id);
+                udp_zc_release_completed(l);
+        }
+}
+#endif
+
+/**
+ * Blocks until all the packets sent so far have been completed by the kernel
+ * (and data held by udp_zerocopy_hold() released). Afterwards, the caller
+ * may reuse the memory passed to udp_sendv(). No-op if zero-copy is disabled.
+ */
+void udp_zerocopy_wait(socket_udp *s)
+{
+#ifdef __linux__
+        if (s->local->zc != NULL) {
+                udp_zerocopy_drain(s->local);
+        }
+#else
+        UNUSED(s);
+#endif
+}
+
+#ifdef __linux__
+static void udp_zerocopy_done(struct socket_udp_local *l)
+{
+        struct udp_zerocopy *zc = l->zc;
+        if (zc == NULL) {
+                return;
+        }
+        udp_zerocopy_drain(l);
+        const long long copied = atomic_load_explicit(&l->zc_copied, memory_order_relaxed);
+        if (zc->sends > 0) {
+                log_msg(copied > zc->sends / 2 ? LOG_LEVEL_WARNING : LOG_LEVEL_VERBOSE,
+                                MOD_NAME "Zero-copy: %lld sends, %.1f%% completed by copying "
+                                "(NIC without scatter-gather or loopback?)\n",
+                                zc->sends, 100.0 * copied / zc->sends);
+        }
+        free(zc->entries);
+        free(zc);
+        l->zc = NULL;
+}
+#endif
+
+/**
+ * Sends packets queued since udp_async_start() without ending the async
+ * section. Useful for the traffic shaping - caller sends a burst of packets,
+ * then flushes and waits. No-op if there is nothing queued.
+ */
+void udp_async_flush(socket_udp *s)
+{
+#ifdef __linux__
+        if (s->send_batch != NULL && s->send_batch->count > 0) {
+                udp_send_batch_flush(s);
+        }
+#else
+        UNUSED(s);
+#endif
+}
+
+void udp_async_wait(socket_udp *s)
+{
+#ifdef _WIN32
+        if (!s->overlapping_active)
+                return;
+        for(int i = 0; i < s->overlapped_count; i += WSA_MAXIMUM_WAIT_EVENTS)
+        {
+                int count = WSA_MAXIMUM_WAIT_EVENTS;
+                if (s->overlapped_count - i < WSA_MAXIMUM_WAIT_EVENTS)
+                        count = s->overlapped_count - i;
+                DWORD ret = WSAWaitForMultipleEvents(count, s->overlapped_events + i, TRUE, INFINITE, TRUE);
+                if (ret == WSA_WAIT_FAILED) {
+                        socket_error("WSAWaitForMultipleEvents");
+                }
+        }
+        for (int i = 0; i < s->overlapped_count; i++) {
+                if (WSAResetEvent(s->overlapped[i].hEvent) == FALSE) {
+                        socket_error("WSAResetEvent");
+                }
+                free(s->dispose_udata[i]);
         }
         s->overlapping_active = false;
+#elif defined __linux__
+        if (s->send_batch == NULL || !s->send_batch->active) {
+                return;
+        }
+        udp_async_flush(s);
+        s->send_batch->active = false;
 #else
         UNUSED(s);
 #endif
@@ -1590,11 +3366,109 @@ static void udp_clean_async_state(socket_udp *s)
         free(s->overlapped);
         free(s->overlapped_events);
         free(s->dispose_udata);
+#elif defined __linux__
+        if (s->send_batch != NULL) {
+                udp_async_flush(s);
+                free(s->send_batch);
+        }
 #else
         UNUSED(s);
 #endif
 }
 
+/// IPv6 sockets are dual-stack - resolve also IPv4 addresses (as v4-mapped)
+static int udp_dest_mode(socket_udp *s)
+{
+        return s->local->mode == IPv6 ? 0 : s->local->mode;
+}
+
+/**
+ * Adds a destination the datagrams are sent to in addition to the primary one
+ * (fan-out). Adding an already present destination only increments its
+ * reference count.
+ *
+ * Must not be called concurrently with sending (eg. between udp_async_start()
+ * and udp_async_wait()).
+ */
+bool udp_add_dest(socket_udp *s, const char *addr, uint16_t tx_port)
+{
+        struct sockaddr_storage sa;
+        socklen_t len = 0;
+        int mode = udp_dest_mode(s);
+        if (resolve_addrinfo(addr, tx_port, &sa, &len, &mode) != 0) {
+                return false;
+        }
+        for (int i = 0; i < s->dest_count; ++i) {
+                if (s->dests[i].len == len && memcmp(&s->dests[i].addr, &sa, len) == 0) {
+                        s->dests[i].refcount += 1;
+                        return true;
+                }
+        }
+        struct udp_dest *dests = realloc(s->dests, (s->dest_count + 1) * sizeof *dests);
+        if (dests == NULL) {
+                return false;
+        }
+        s->dests = dests;
+        memset(&s->dests[s->dest_count], 0, sizeof s->dests[0]);
+        memcpy(&s->dests[s->dest_count].addr, &sa, len);
+        s->dests[s->dest_count].len = len;
+        s->dests[s->dest_count].refcount = 1;
+#ifdef __linux__
+        s->dests[s->dest_count].pmtu_fd = s->pmtu_discovery
+                ? udp_pmtu_socket(s, &sa, len) : INVALID_SOCKET;
+#endif
+        s->dest_count += 1;
+#ifdef __linux__
+        if (s->send_batch != NULL && s->send_batch->gso) {
+                verbose_msg(MOD_NAME "Not using GSO with multiple destinations.\n");
+        }
+#endif
+        return true;
+}
+
+/// @copydetails udp_add_dest
+bool udp_remove_dest(socket_udp *s, const char *addr, uint16_t tx_port)
+{
+        struct sockaddr_storage sa;
+        socklen_t len = 0;
+        int mode = udp_dest_mode(s);
+        if (resolve_addrinfo(addr, tx_port, &sa, &len, &mode) != 0) {
+                return false;
+        }
+        for (int i = 0; i < s->dest_count; ++i) {
+                if (s->dests[i].len != len || memcmp(&s->dests[i].addr, &sa, len) != 0) {
+                        continue;
+                }
+                if (--s->dests[i].refcount == 0) {
+#ifdef __linux__
+                        if (s->dests[i].pmtu_fd != INVALID_SOCKET) {
+                                CLOSESOCKET(s->dests[i].pmtu_fd);
+                        }
+#endif
+                        memmove(&s->dests[i], &s->dests[i + 1], (s->dest_count - i - 1) * sizeof s->dests[0]);
+                        s->dest_count -= 1;
+                }
+                return true;
+        }
+        return false;
+}
+
+int udp_get_dest_count(socket_udp *s)
+{
+        return s->dest_count;
+}
+
+/// stops sending to a destination that persistently fails (client gone)
+static void udp_dest_error(struct udp_dest *dest)
+{
+        if (++dest->errors < UDP_DEST_MAX_ERRORS || dest->disabled) {
+                return;
+        }
+        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Sending to %s repeatedly failed, disabling the destination.\n",
+                        get_sockaddr_str((struct sockaddr *) &dest->addr));
+        dest->disabled = true;
+}
+
 bool udp_is_ipv6(socket_udp *s)
 {
         return s->local->mode == IPv6 && !IN6_IS_ADDR_V4MAPPED(&((struct sockaddr_in6 *) &s->sock)->sin6_addr);
@@ -1726,7 +3600,7 @@ int udp_recvfrom_timeout(socket_udp *s, char *buffer, int buflen,
                         if (len > 0) {
                                 memcpy(buffer, data, len);
                         }
-                        free(data);
+                        rtp_pkt_free(data);
                 }
         } else {
                 udp_fd_zero_r(&fd);
@@ -1743,6 +3617,67 @@ int udp_recvfrom_timeout(socket_udp *s, char *buffer, int buflen,
         return len;
 }
 
+/**
+ * Receives up to count datagrams into buffers, waiting at most timeout for
+ * the first one. The rest is read only if already queued in the socket (with
+ * a single recvmmsg() call on Linux).
+ *
+ * @param lens      received datagram sizes
+ * @param src_addrs optional array of count source addresses
+ * @param addrlens  lengths of src_addrs (must be set if src_addrs is given)
+ * @returns number of received datagrams, 0 on timeout or error
+ */
+int udp_recvfrom_batch_timeout(socket_udp *s, char *const *buffers, int *lens, int buflen, int count,
+                struct timeval *timeout,
+                struct sockaddr_storage *src_addrs, socklen_t *addrlens)
+{
+#ifdef __linux__
+        if (!s->local->multithreaded && count > 1) {
+                struct udp_fd_r fd;
+                udp_fd_zero_r(&fd);
+                udp_fd_set_r(s, &fd);
+                if (udp_select_r(timeout, &fd) <= 0 || !udp_fd_isset_r(s, &fd)) {
+                        return 0;
+                }
+                struct mmsghdr msgs[MAX_UDP_RECV_BATCH];
+                struct iovec iov[MAX_UDP_RECV_BATCH];
+                count = MIN(count, MAX_UDP_RECV_BATCH);
+                memset(msgs, 0, count * sizeof msgs[0]);
+                for (int i = 0; i < count; ++i) {
+                        iov[i].iov_base = buffers[i];
+                        iov[i].iov_len = buflen;
+                        msgs[i].msg_hdr.msg_iov = &iov[i];
+                        msgs[i].msg_hdr.msg_iovlen = 1;
+                        if (src_addrs != NULL) {
+                                msgs[i].msg_hdr.msg_name = &src_addrs[i];
+                                msgs[i].msg_hdr.msg_namelen = addrlens[i];
+                        }
+                }
+                int ret = recvmmsg(s->local->rx_fd, msgs, count, MSG_DONTWAIT, NULL);
+                if (ret <= 0) {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                                socket_error("recvmmsg");
+                        }
+                        return 0;
+                }
+                for (int i = 0; i < ret; ++i) {
+                        lens[i] = (int) msgs[i].msg_len;
+                        if (src_addrs != NULL) {
+                                addrlens[i] = msgs[i].msg_hdr.msg_namelen;
+                        }
+                }
+                return ret;
+        }
+#endif
+        if (count <= 0) {
+                return 0;
+        }
+        lens[0] = udp_recvfrom_timeout(s, buffers[0], buflen, timeout,
+                        src_addrs ? (struct sockaddr *) &src_addrs[0] : NULL,
+                        src_addrs ? &addrlens[0] : NULL);
+        return lens[0] > 0 ? 1 : 0;
+}
+
 int udp_recv_timeout(socket_udp *s, char *buffer, int buflen, struct timeval *timeout)
 {
         return udp_recvfrom_timeout(s, buffer, buflen, timeout, NULL, NULL);
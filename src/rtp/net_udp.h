@@ -50,8 +50,11 @@
 #include <stdbool.h>
 #endif
 
+#include "tv.h"
+
 typedef struct _socket_udp socket_udp; 
 struct socket_udp_local;
+struct rtp_pkt_pool;
 
 #if defined(__cplusplus)
 extern "C" {
@@ -71,12 +74,31 @@ int         udp_recv_timeout(socket_udp *s, char *buffer, int buflen, struct tim
 int         udp_recvfrom_timeout(socket_udp *s, char *buffer, int buflen,
                 struct timeval *timeout,
                 struct sockaddr *src_addr, socklen_t *addrlen);
+int         udp_recvfrom_batch_timeout(socket_udp *s, char *const *buffers, int *lens, int buflen, int count,
+                struct timeval *timeout,
+                struct sockaddr_storage *src_addrs, socklen_t *addrlens);
 int         udp_recvfrom(socket_udp *s, char *buffer, int buflen, struct sockaddr *src_addr, socklen_t *addrlen);
 int         udp_send(socket_udp *s, char *buffer, int buflen);
 int         udp_sendto(socket_udp *s, char *buffer, int buflen, struct sockaddr *dst_addr, socklen_t addrlen);
 
+struct udp_sendto_batch;
+struct udp_sendto_batch *udp_sendto_batch_init(socket_udp *s, struct sockaddr *dst_addr, socklen_t addrlen);
+int         udp_sendto_batch(struct udp_sendto_batch *b, char *const *buffers, const int *lens, int count);
+void        udp_sendto_batch_done(struct udp_sendto_batch *b);
+
 int         udp_recvv(socket_udp *s, struct msghdr *m);
 void        udp_async_start(socket_udp *s, int nr_packets);
+void        udp_async_flush(socket_udp *s);
+bool        udp_enable_txtime(socket_udp *s);
+void        udp_set_next_txtime(socket_udp *s, uint64_t txtime);
+int         udp_get_txtime_errors(socket_udp *s);
+int         udp_enable_pmtu_discovery(socket_udp *s, int max_mtu);
+int         udp_get_path_mtu(socket_udp *s);
+int         udp_get_send_backlog(socket_udp *s);
+bool        udp_enable_zerocopy(socket_udp *s);
+bool        udp_zerocopy_enabled(socket_udp *s);
+void        udp_zerocopy_hold(socket_udp *s, void (*release)(void *), void *arg);
+void        udp_zerocopy_wait(socket_udp *s);
 void        udp_async_wait(socket_udp *s);
 #ifdef _WIN32
 int         udp_sendv(socket_udp *s, LPWSABUF vector, int count, void *d);
@@ -97,6 +119,13 @@ bool        udp_set_recv_buf(socket_udp *s, int size);
 bool        udp_set_send_buf(socket_udp *s, int size);
 void        udp_flush_recv_buf(socket_udp *s);
 
+/// cumulative receive-side drops of the socket
+struct udp_rx_drops {
+        long long socket;     ///< dropped by the kernel (socket buffer overflow), -1 if unknown
+        long long queue_full; ///< times the reader thread stalled on a full queue (udp-queue-len)
+};
+void        udp_get_rx_drops(socket_udp *s, struct udp_rx_drops *drops);
+
 struct udp_fd_r {
         fd_set rfd;
         fd_t max_fd;
@@ -110,9 +139,17 @@ int         udp_fd_isset_r(socket_udp *s, struct udp_fd_r *);
 int         udp_recv_data(socket_udp * s, char **buffer);
 int         udp_recvfrom_data(socket_udp * s, char **buffer,
                 struct sockaddr *src_addr, socklen_t *addrlen);
+time_ns_t   udp_recv_data_time(const char *buffer);
 bool        udp_not_empty(socket_udp *s, struct timeval *timeout);
+void        udp_wake(socket_udp *s);
+bool        udp_set_recv_batch(socket_udp *s, int count);
+void        udp_set_pkt_pool(socket_udp *s, struct rtp_pkt_pool *pool);
+size_t      udp_get_recv_pkt_size(void);
 int         udp_port_pair_is_free(int force_ip_version, int even_port);
 bool        udp_is_ipv6(socket_udp *s);
+bool        udp_add_dest(socket_udp *s, const char *addr, uint16_t tx_port);
+bool        udp_remove_dest(socket_udp *s, const char *addr, uint16_t tx_port);
+int         udp_get_dest_count(socket_udp *s);
 
 void        socket_error(const char *msg, ...);
 
@@ -0,0 +1,272 @@
+/**
+ * @file   rtp/net_udp_uring.c
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "rtp/net_udp_uring.h"
+
+#define MOD_NAME "[io_uring] "
+
+#ifdef HAVE_LIBURING
+#include <errno.h>
+#include <liburing.h>
+#include <poll.h>
+
+#define URING_ENTRIES 64
+#define URING_NR_BUFS 512 ///< provided buffers, must be a power of 2
+#define URING_BUF_GROUP 0
+
+enum {
+        URING_REQ_RECV = 1,
+        URING_REQ_EXIT = 2,
+};
+
+struct udp_uring {
+        struct io_uring ring;
+        bool ring_initialized;
+        bool ring_disabled; ///< created with IORING_SETUP_R_DISABLED, see udp_uring_recv()
+        struct io_uring_buf_ring *br;
+        unsigned char *bufs;
+        size_t buf_len;
+        int fd;
+        int exit_fd;
+        struct msghdr msg; ///< multishot recvmsg template (name length)
+};
+
+static bool udp_uring_arm(struct udp_uring *u, int req)
+{
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&u->ring);
+        if (sqe == NULL) {
+                io_uring_submit(&u->ring);
+                if ((sqe = io_uring_get_sqe(&u->ring)) == NULL) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Submission queue full!\n");
+                        return false;
+                }
+        }
+        if (req == URING_REQ_RECV) {
+                io_uring_prep_recvmsg_multishot(sqe, u->fd, &u->msg, 0);
+                sqe->flags |= IOSQE_BUFFER_SELECT;
+                sqe->buf_group = URING_BUF_GROUP;
+        } else {
+                io_uring_prep_poll_add(sqe, u->exit_fd, POLLIN);
+        }
+        io_uring_sqe_set_data64(sqe, req);
+        return true;
+}
+
+struct udp_uring *udp_uring_init(int fd, int exit_fd, size_t max_len)
+{
+        struct udp_uring *u = calloc(1, sizeof *u);
+        u->fd = fd;
+        u->exit_fd = exit_fd;
+        u->msg.msg_namelen = sizeof(struct sockaddr_storage);
+        u->buf_len = sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_storage) + max_len;
+
+        // SINGLE_ISSUER ring is bound to the thread that enables it, which
+        // must be the reader, not this one (see udp_uring_recv())
+        struct io_uring_params params = { .flags = IORING_SETUP_SINGLE_ISSUER |
+                IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED };
+        int ret = io_uring_queue_init_params(URING_ENTRIES, &u->ring, &params);
+        if (ret == -EINVAL) { // kernel older than 6.1
+                ret = io_uring_queue_init(URING_ENTRIES, &u->ring, 0);
+        } else {
+                u->ring_disabled = true;
+        }
+        if (ret < 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create ring: %s\n", strerror(-ret));
+                goto error;
+        }
+        u->ring_initialized = true;
+
+        u->br = io_uring_setup_buf_ring(&u->ring, URING_NR_BUFS, URING_BUF_GROUP, 0, &ret);
+        if (u->br == NULL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot register buffer ring: %s\n", strerror(-ret));
+                goto error;
+        }
+        u->bufs = malloc(URING_NR_BUFS * u->buf_len);
+        for (int i = 0; i < URING_NR_BUFS; ++i) {
+                io_uring_buf_ring_add(u->br, u->bufs + i * u->buf_len, u->buf_len, i,
+                                io_uring_buf_ring_mask(URING_NR_BUFS), i);
+        }
+        io_uring_buf_ring_advance(u->br, URING_NR_BUFS);
+
+        if (!udp_uring_arm(u, URING_REQ_EXIT) || !udp_uring_arm(u, URING_REQ_RECV)) {
+                goto error;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using io_uring multishot receive.\n");
+        return u;
+error:
+        udp_uring_done(u);
+        return NULL;
+}
+
+/// releases the ring - with SINGLE_ISSUER, it must be done by the issuer thread
+static void udp_uring_release(struct udp_uring *u)
+{
+        if (!u->ring_initialized) {
+                return;
+        }
+        if (u->br != NULL) {
+                io_uring_free_buf_ring(&u->ring, u->br, URING_NR_BUFS, URING_BUF_GROUP);
+                u->br = NULL;
+        }
+        io_uring_queue_exit(&u->ring);
+        u->ring_initialized = false;
+}
+
+static int udp_uring_recv_batch(struct udp_uring *u, int max,
+                                udp_uring_packet_cb cb, void *udata)
+{
+        int ret = io_uring_submit_and_wait(&u->ring, 1);
+        if (ret < 0 && ret != -EINTR) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wait failed: %s\n", strerror(-ret));
+                return -1;
+        }
+
+        struct io_uring_cqe *cqe = NULL;
+        unsigned head = 0;
+        unsigned seen = 0;
+        int returned = 0;
+        int delivered = 0;
+        bool exit = false;
+        bool rearm = false;
+        io_uring_for_each_cqe(&u->ring, head, cqe) {
+                seen += 1;
+                if (io_uring_cqe_get_data64(cqe) == URING_REQ_EXIT) {
+                        exit = true;
+                        continue;
+                }
+                if ((cqe->flags & IORING_CQE_F_MORE) == 0) { // multishot terminated
+                        rearm = true;
+                }
+                if (cqe->res < 0) {
+                        if (cqe->res != -ENOBUFS) { // ENOBUFS - all buffers in use, just rearm
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "recvmsg: %s\n", strerror(-cqe->res));
+                        }
+                        continue;
+                }
+                if ((cqe->flags & IORING_CQE_F_BUFFER) == 0) {
+                        continue;
+                }
+                const unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                unsigned char *buf = u->bufs + bid * u->buf_len;
+                struct io_uring_recvmsg_out *o = io_uring_recvmsg_validate(buf, cqe->res, &u->msg);
+                if (o != NULL && (o->flags & MSG_TRUNC) == 0) {
+                        cb(udata, io_uring_recvmsg_payload(o, &u->msg),
+                                        (int) io_uring_recvmsg_payload_length(o, cqe->res, &u->msg),
+                                        io_uring_recvmsg_name(o), o->namelen);
+                        delivered += 1;
+                }
+                io_uring_buf_ring_add(u->br, buf, u->buf_len, bid,
+                                io_uring_buf_ring_mask(URING_NR_BUFS), returned++);
+                if (delivered == max) {
+                        break;
+                }
+        }
+        io_uring_buf_ring_advance(u->br, returned);
+        io_uring_cq_advance(&u->ring, seen);
+
+        if (exit) {
+                return -1;
+        }
+        if (rearm && !udp_uring_arm(u, URING_REQ_RECV)) { // submitted by next call
+                return -1;
+        }
+        return delivered;
+}
+
+int udp_uring_recv(struct udp_uring *u, int max, udp_uring_packet_cb cb,
+                   void *udata)
+{
+        if (!u->ring_initialized) {
+                return -1;
+        }
+        if (u->ring_disabled) { // first call - make this thread the issuer
+                const int ret = io_uring_enable_rings(&u->ring);
+                if (ret < 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot enable ring: %s\n", strerror(-ret));
+                        udp_uring_release(u);
+                        return -1;
+                }
+                u->ring_disabled = false;
+        }
+        const int ret = udp_uring_recv_batch(u, max, cb, udata);
+        if (ret < 0) {
+                udp_uring_release(u);
+        }
+        return ret;
+}
+
+void udp_uring_done(struct udp_uring *u)
+{
+        if (u == NULL) {
+                return;
+        }
+        udp_uring_release(u);
+        free(u->bufs);
+        free(u);
+}
+
+#else // ! defined HAVE_LIBURING
+
+struct udp_uring *udp_uring_init(int fd, int exit_fd, size_t max_len)
+{
+        UNUSED(fd), UNUSED(exit_fd), UNUSED(max_len);
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "UltraGrid was compiled without io_uring support (liburing)!\n");
+        return NULL;
+}
+
+int udp_uring_recv(struct udp_uring *u, int max, udp_uring_packet_cb cb,
+                   void *udata)
+{
+        UNUSED(u), UNUSED(max), UNUSED(cb), UNUSED(udata);
+        return -1;
+}
+
+void udp_uring_done(struct udp_uring *u)
+{
+        UNUSED(u);
+}
+
+#endif // defined HAVE_LIBURING
@@ -0,0 +1,91 @@
+/**
+ * @file   rtp/net_udp_uring.h
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * io_uring receive backend for the UDP reader thread (Linux, liburing).
+ *
+ * A multishot recvmsg request with a ring of provided buffers is kept armed
+ * on the socket, together with a poll request on the reader exit pipe, so
+ * that the reader thread needs a single io_uring_enter() per wakeup instead
+ * of select() followed by recvfrom()/recvmmsg().
+ */
+
+#ifndef RTP_NET_UDP_URING_H_
+#define RTP_NET_UDP_URING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct udp_uring;
+
+/**
+ * Called for every received datagram. Data are valid only for the
+ * duration of the call.
+ */
+typedef void (*udp_uring_packet_cb)(void *udata, const unsigned char *data,
+                                    int len, const struct sockaddr *src,
+                                    socklen_t src_len);
+
+/**
+ * @param fd      socket to receive from
+ * @param exit_fd fd that becomes readable when the reader should exit
+ * @param max_len maximal datagram length, longer are dropped
+ * @returns       state or NULL on error (or if unsupported)
+ */
+struct udp_uring *udp_uring_init(int fd, int exit_fd, size_t max_len);
+/**
+ * Waits for received datagrams and passes at most max of them to cb.
+ *
+ * The thread of the first call becomes the only one that may use the ring.
+ * When -1 is returned, the ring is released (still by that thread) and
+ * udp_uring_done() then only frees the state.
+ *
+ * @returns number of datagrams passed to cb, -1 if exit_fd was signaled
+ *          or on unrecoverable error
+ */
+int               udp_uring_recv(struct udp_uring *u, int max,
+                                 udp_uring_packet_cb cb, void *udata);
+void              udp_uring_done(struct udp_uring *u);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined RTP_NET_UDP_URING_H_
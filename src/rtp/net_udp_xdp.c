@@ -0,0 +1,466 @@
+/**
+ * @file   rtp/net_udp_xdp.c
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "rtp/net_udp_xdp.h"
+
+#define MOD_NAME "[AF_XDP] "
+
+#ifdef HAVE_XDP
+#include <arpa/inet.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include <errno.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/udp.h>
+#include <xdp/xsk.h>
+
+#define XDP_NUM_FRAMES 4096
+#define XDP_FRAME_SIZE XSK_UMEM__DEFAULT_FRAME_SIZE
+#define IP_FRAG_MASK 0x3FFF ///< MF flag + fragment offset
+#define XDP_PROG_MAX_INSNS 48
+
+#define XDP_INSN(opc, dreg, sreg, offset, immediate) ((struct bpf_insn){ \
+                .code = (opc), .dst_reg = (dreg), .src_reg = (sreg), .off = (offset), .imm = (immediate) })
+#define XDP_LDX(size, dreg, sreg, offset) XDP_INSN(BPF_LDX | BPF_MEM | (size), dreg, sreg, offset, 0)
+#define XDP_ALU_IMM(op, dreg, immediate) XDP_INSN(BPF_ALU64 | (op) | BPF_K, dreg, 0, 0, immediate)
+#define XDP_ALU_REG(op, dreg, sreg) XDP_INSN(BPF_ALU64 | (op) | BPF_X, dreg, sreg, 0, 0)
+#define XDP_JMP_IMM(op, dreg, immediate, offset) XDP_INSN(BPF_JMP | (op) | BPF_K, dreg, 0, offset, immediate)
+#define XDP_JMP_REG(op, dreg, sreg, offset) XDP_INSN(BPF_JMP | (op) | BPF_X, dreg, sreg, offset, 0)
+
+struct udp_xdp {
+        void *umem_area;
+        size_t umem_size;
+        struct xsk_umem *umem;
+        struct xsk_ring_prod fq;
+        struct xsk_ring_cons cq;
+        struct xsk_socket *xsk;
+        struct xsk_ring_cons rx;
+        uint16_t port; ///< network byte order
+        bool ipv6_src;
+        int ifindex;
+        int xsks_map_fd; ///< XSKMAP indexed by RX queue, -1 if not created
+        int prog_fd; ///< our XDP program, -1 if not loaded
+        bool prog_attached;
+};
+
+/**
+ * Fills the XDP program that redirects UDP datagrams destined to port (and
+ * not fragmented) to the AF_XDP socket of the receiving queue and passes all
+ * other frames (ARP, RTCP, other ports...) to the network stack:
+ *
+ *     if (eth/ipv4 or eth/ipv6 + udp && udp.dest == port)
+ *             return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS);
+ *     return XDP_PASS;
+ *
+ * Frames with 802.1Q tag or IPv6 extension headers are passed as well.
+ *
+ * @param port network byte order
+ * @returns    number of instructions
+ */
+static int udp_xdp_prog_insns(struct bpf_insn *insns, int xsks_map_fd,
+                              uint16_t port, bool ipv6)
+{
+        enum { // instruction indices of jump targets
+                L_IPV6 = 21,
+                L_UDP = 28,
+                L_PASS = 39,
+        };
+        const size_t eth_len = sizeof(struct ethhdr);
+        const size_t ip_len = sizeof(struct iphdr);
+        const size_t ip6_len = sizeof(struct ipv6hdr);
+        int i = 0;
+#define EMIT(insn) do { insns[i] = (insn); i += 1; } while (0)
+        // r1 - ctx, r2 - data (and then current header), r3 - data_end
+        EMIT(XDP_LDX(BPF_W, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data)));
+        EMIT(XDP_LDX(BPF_W, BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end)));
+        EMIT(XDP_ALU_REG(BPF_MOV, BPF_REG_4, BPF_REG_2));
+        EMIT(XDP_ALU_IMM(BPF_ADD, BPF_REG_4, eth_len));
+        EMIT(XDP_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, L_PASS - i - 1));
+        EMIT(XDP_LDX(BPF_H, BPF_REG_5, BPF_REG_2, offsetof(struct ethhdr, h_proto)));
+        EMIT(XDP_JMP_IMM(BPF_JNE, BPF_REG_5, htons(ETH_P_IP), L_IPV6 - i - 1));
+        // IPv4
+        EMIT(XDP_ALU_REG(BPF_MOV, BPF_REG_4, BPF_REG_2));
+        EMIT(XDP_ALU_IMM(BPF_ADD, BPF_REG_4, eth_len + ip_len));
+        EMIT(XDP_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, L_PASS - i - 1));
+        EMIT(XDP_LDX(BPF_B, BPF_REG_5, BPF_REG_2, eth_len + offsetof(struct iphdr, protocol)));
+        EMIT(XDP_JMP_IMM(BPF_JNE, BPF_REG_5, IPPROTO_UDP, L_PASS - i - 1));
+        EMIT(XDP_LDX(BPF_H, BPF_REG_5, BPF_REG_2, eth_len + offsetof(struct iphdr, frag_off)));
+        EMIT(XDP_ALU_IMM(BPF_AND, BPF_REG_5, htons(IP_FRAG_MASK)));
+        EMIT(XDP_JMP_IMM(BPF_JNE, BPF_REG_5, 0, L_PASS - i - 1));
+        EMIT(XDP_LDX(BPF_B, BPF_REG_5, BPF_REG_2, eth_len)); // version + IHL
+        EMIT(XDP_ALU_IMM(BPF_AND, BPF_REG_5, 0xF));
+        EMIT(XDP_ALU_IMM(BPF_LSH, BPF_REG_5, 2));
+        EMIT(XDP_ALU_IMM(BPF_ADD, BPF_REG_2, eth_len));
+        EMIT(XDP_ALU_REG(BPF_ADD, BPF_REG_2, BPF_REG_5));
+        EMIT(XDP_INSN(BPF_JMP | BPF_JA, 0, 0, L_UDP - i - 1, 0));
+        // IPv6 (only if the socket accepts it)
+        assert(i == L_IPV6);
+        EMIT(ipv6 ? XDP_JMP_IMM(BPF_JNE, BPF_REG_5, htons(ETH_P_IPV6), L_PASS - i - 1)
+                : XDP_INSN(BPF_JMP | BPF_JA, 0, 0, L_PASS - i - 1, 0));
+        EMIT(XDP_ALU_REG(BPF_MOV, BPF_REG_4, BPF_REG_2));
+        EMIT(XDP_ALU_IMM(BPF_ADD, BPF_REG_4, eth_len + ip6_len));
+        EMIT(XDP_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, L_PASS - i - 1));
+        EMIT(XDP_LDX(BPF_B, BPF_REG_5, BPF_REG_2, eth_len + offsetof(struct ipv6hdr, nexthdr)));
+        EMIT(XDP_JMP_IMM(BPF_JNE, BPF_REG_5, IPPROTO_UDP, L_PASS - i - 1));
+        EMIT(XDP_ALU_IMM(BPF_ADD, BPF_REG_2, eth_len + ip6_len));
+        // UDP
+        assert(i == L_UDP);
+        EMIT(XDP_ALU_REG(BPF_MOV, BPF_REG_4, BPF_REG_2));
+        EMIT(XDP_ALU_IMM(BPF_ADD, BPF_REG_4, sizeof(struct udphdr)));
+        EMIT(XDP_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, L_PASS - i - 1));
+        EMIT(XDP_LDX(BPF_H, BPF_REG_5, BPF_REG_2, offsetof(struct udphdr, dest)));
+        EMIT(XDP_JMP_IMM(BPF_JNE, BPF_REG_5, port, L_PASS - i - 1));
+        EMIT(XDP_LDX(BPF_W, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, rx_queue_index)));
+        EMIT(XDP_INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, xsks_map_fd));
+        EMIT(XDP_INSN(0, 0, 0, 0, 0)); // upper half of the 64-bit immediate
+        EMIT(XDP_ALU_IMM(BPF_MOV, BPF_REG_3, XDP_PASS)); // if the queue has no socket
+        EMIT(XDP_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map));
+        EMIT(XDP_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+        // pass to the network stack
+        assert(i == L_PASS);
+        EMIT(XDP_ALU_IMM(BPF_MOV, BPF_REG_0, XDP_PASS));
+        EMIT(XDP_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+#undef EMIT
+        assert(i <= XDP_PROG_MAX_INSNS);
+        return i;
+}
+
+/**
+ * Creates the XSKMAP and loads the program from udp_xdp_prog_insns(). The
+ * program is attached in udp_xdp_init() after the socket is in the map.
+ */
+static bool udp_xdp_load_prog(struct udp_xdp *x, int queue)
+{
+        x->xsks_map_fd = bpf_map_create(BPF_MAP_TYPE_XSKMAP, "ug_xsks", sizeof(int),
+                        sizeof(int), queue + 1, NULL);
+        if (x->xsks_map_fd < 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create XSKMAP: %s\n", strerror(errno));
+                x->xsks_map_fd = -1;
+                return false;
+        }
+        struct bpf_insn insns[XDP_PROG_MAX_INSNS];
+        const int insn_cnt = udp_xdp_prog_insns(insns, x->xsks_map_fd, x->port, x->ipv6_src);
+        char verifier_log[4096] = "";
+        LIBBPF_OPTS(bpf_prog_load_opts, opts, .log_buf = verifier_log,
+                        .log_size = sizeof verifier_log, .log_level = 1);
+        x->prog_fd = bpf_prog_load(BPF_PROG_TYPE_XDP, "ug_udp_redir", "BSD",
+                        insns, insn_cnt, &opts);
+        if (x->prog_fd < 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot load XDP program: %s\n%s\n",
+                                strerror(errno), verifier_log);
+                x->prog_fd = -1;
+                return false;
+        }
+        return true;
+}
+
+struct udp_xdp *udp_xdp_init(const char *ifname, int queue, uint16_t port,
+                             bool ipv6_src)
+{
+        struct udp_xdp *x = calloc(1, sizeof *x);
+        x->port = htons(port);
+        x->ipv6_src = ipv6_src;
+        x->xsks_map_fd = x->prog_fd = -1;
+        if ((x->ifindex = (int) if_nametoindex(ifname)) == 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown interface %s\n", ifname);
+                goto error;
+        }
+        if (!udp_xdp_load_prog(x, queue)) {
+                goto error;
+        }
+        x->umem_size = (size_t) XDP_NUM_FRAMES * XDP_FRAME_SIZE;
+        x->umem_area = mmap(NULL, x->umem_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (x->umem_area == MAP_FAILED) {
+                log_perror(LOG_LEVEL_ERROR, MOD_NAME "mmap");
+                x->umem_area = NULL;
+                goto error;
+        }
+
+        const struct xsk_umem_config umem_cfg = {
+                .fill_size = XDP_NUM_FRAMES,
+                .comp_size = XSK_RING_CONS__DEFAULT_NUM_DESCS,
+                .frame_size = XDP_FRAME_SIZE,
+                .frame_headroom = XSK_UMEM__DEFAULT_FRAME_HEADROOM,
+        };
+        int ret = xsk_umem__create(&x->umem, x->umem_area, x->umem_size,
+                        &x->fq, &x->cq, &umem_cfg);
+        if (ret != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create UMEM: %s\n", strerror(-ret));
+                goto error;
+        }
+
+        // the default libxdp program would redirect all traffic of the queue
+        const struct xsk_socket_config xsk_cfg = {
+                .rx_size = XSK_RING_CONS__DEFAULT_NUM_DESCS,
+                .libxdp_flags = XSK_LIBXDP_FLAGS__INHIBIT_PROG_LOAD,
+                .bind_flags = XDP_USE_NEED_WAKEUP,
+        };
+        ret = xsk_socket__create(&x->xsk, ifname, queue, x->umem, &x->rx,
+                        NULL, &xsk_cfg);
+        if (ret != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot bind to %s queue %d: %s\n",
+                                ifname, queue, strerror(-ret));
+                goto error;
+        }
+        if ((ret = xsk_socket__update_xskmap(x->xsk, x->xsks_map_fd)) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot insert socket to XSKMAP: %s\n", strerror(-ret));
+                goto error;
+        }
+
+        // all frames are owned by the kernel (the fill ring) except while processed
+        uint32_t idx = 0;
+        if (xsk_ring_prod__reserve(&x->fq, XDP_NUM_FRAMES, &idx) != XDP_NUM_FRAMES) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot populate fill ring!\n");
+                goto error;
+        }
+        for (int i = 0; i < XDP_NUM_FRAMES; ++i) {
+                *xsk_ring_prod__fill_addr(&x->fq, idx++) = (uint64_t) i * XDP_FRAME_SIZE;
+        }
+        xsk_ring_prod__submit(&x->fq, XDP_NUM_FRAMES);
+
+        if ((ret = bpf_xdp_attach(x->ifindex, x->prog_fd, XDP_FLAGS_UPDATE_IF_NOEXIST, NULL)) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot attach XDP program to %s (other one attached?): %s\n",
+                                ifname, strerror(-ret));
+                goto error;
+        }
+        x->prog_attached = true;
+
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Receiving UDP port %u from %s queue %d\n",
+                        port, ifname, queue);
+        return x;
+error:
+        udp_xdp_done(x);
+        return NULL;
+}
+
+int udp_xdp_fd(struct udp_xdp *x)
+{
+        return xsk_socket__fd(x->xsk);
+}
+
+static void udp_xdp_wakeup(struct udp_xdp *x)
+{
+        if (xsk_ring_prod__needs_wakeup(&x->fq)) {
+                recvfrom(xsk_socket__fd(x->xsk), NULL, 0, MSG_DONTWAIT, NULL, NULL);
+        }
+}
+
+/**
+ * @retval true if the frame was a datagram for us and was passed to cb
+ */
+static bool udp_xdp_parse(struct udp_xdp *x, const unsigned char *frame,
+                          uint32_t len, udp_xdp_packet_cb cb, void *udata)
+{
+        struct ethhdr eth;
+        if (len < sizeof eth) {
+                return false;
+        }
+        memcpy(&eth, frame, sizeof eth);
+        uint16_t proto = eth.h_proto;
+        size_t off = sizeof eth;
+        if (proto == htons(ETH_P_8021Q) || proto == htons(ETH_P_8021AD)) {
+                if (len < off + 4) {
+                        return false;
+                }
+                memcpy(&proto, frame + off + 2, sizeof proto);
+                off += 4;
+        }
+
+        struct sockaddr_storage src = { 0 };
+        struct sockaddr_in *sin = (struct sockaddr_in *)(void *) &src;
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)(void *) &src;
+        socklen_t src_len = 0;
+        in_port_t *src_port = NULL;
+        if (proto == htons(ETH_P_IP)) {
+                struct iphdr ip;
+                if (len < off + sizeof ip) {
+                        return false;
+                }
+                memcpy(&ip, frame + off, sizeof ip);
+                if (ip.protocol != IPPROTO_UDP || (ip.frag_off & htons(IP_FRAG_MASK)) != 0) {
+                        return false;
+                }
+                off += ip.ihl * 4;
+                if (x->ipv6_src) {
+                        sin6->sin6_family = AF_INET6;
+                        sin6->sin6_addr.s6_addr[10] = 0xFF;
+                        sin6->sin6_addr.s6_addr[11] = 0xFF;
+                        memcpy(&sin6->sin6_addr.s6_addr[12], &ip.saddr, sizeof ip.saddr);
+                        src_port = &sin6->sin6_port;
+                        src_len = sizeof *sin6;
+                } else {
+                        sin->sin_family = AF_INET;
+                        sin->sin_addr.s_addr = ip.saddr;
+                        src_port = &sin->sin_port;
+                        src_len = sizeof *sin;
+                }
+        } else if (proto == htons(ETH_P_IPV6) && x->ipv6_src) {
+                struct ipv6hdr ip6;
+                if (len < off + sizeof ip6) {
+                        return false;
+                }
+                memcpy(&ip6, frame + off, sizeof ip6);
+                if (ip6.nexthdr != IPPROTO_UDP) { // extension headers not handled
+                        return false;
+                }
+                off += sizeof ip6;
+                sin6->sin6_family = AF_INET6;
+                memcpy(&sin6->sin6_addr, &ip6.saddr, sizeof sin6->sin6_addr);
+                src_port = &sin6->sin6_port;
+                src_len = sizeof *sin6;
+        } else {
+                return false;
+        }
+
+        struct udphdr udp;
+        if (len < off + sizeof udp) {
+                return false;
+        }
+        memcpy(&udp, frame + off, sizeof udp);
+        off += sizeof udp;
+        const int payload_len = (int) ntohs(udp.len) - (int) sizeof udp;
+        if (udp.dest != x->port || payload_len < 0 || off + payload_len > len) {
+                return false;
+        }
+        *src_port = udp.source;
+        cb(udata, frame + off, payload_len, (struct sockaddr *)(void *) &src, src_len);
+        return true;
+}
+
+int udp_xdp_recv_batch(struct udp_xdp *x, int max, udp_xdp_packet_cb cb,
+                       void *udata)
+{
+        uint32_t idx_rx = 0;
+        const uint32_t rcvd = xsk_ring_cons__peek(&x->rx, max, &idx_rx);
+        if (rcvd == 0) {
+                udp_xdp_wakeup(x);
+                return 0;
+        }
+        // cannot fail - the fill ring is large enough for all frames
+        uint32_t idx_fq = 0;
+        while (xsk_ring_prod__reserve(&x->fq, rcvd, &idx_fq) != rcvd) {
+                udp_xdp_wakeup(x);
+        }
+
+        int delivered = 0;
+        for (uint32_t i = 0; i < rcvd; ++i) {
+                const struct xdp_desc *desc = xsk_ring_cons__rx_desc(&x->rx, idx_rx++);
+                const unsigned char *frame = xsk_umem__get_data(x->umem_area, desc->addr);
+                delivered += udp_xdp_parse(x, frame, desc->len, cb, udata);
+                *xsk_ring_prod__fill_addr(&x->fq, idx_fq++) = xsk_umem__extract_addr(desc->addr);
+        }
+        xsk_ring_prod__submit(&x->fq, rcvd);
+        xsk_ring_cons__release(&x->rx, rcvd);
+        udp_xdp_wakeup(x);
+        return delivered;
+}
+
+void udp_xdp_done(struct udp_xdp *x)
+{
+        if (x == NULL) {
+                return;
+        }
+        if (x->prog_attached) { // detach only if it is still ours
+                LIBBPF_OPTS(bpf_xdp_attach_opts, opts, .old_prog_fd = x->prog_fd);
+                bpf_xdp_detach(x->ifindex, XDP_FLAGS_REPLACE, &opts);
+        }
+        if (x->prog_fd != -1) {
+                close(x->prog_fd);
+        }
+        if (x->xsk != NULL) {
+                xsk_socket__delete(x->xsk);
+        }
+        if (x->xsks_map_fd != -1) {
+                close(x->xsks_map_fd);
+        }
+        if (x->umem != NULL) {
+                xsk_umem__delete(x->umem);
+        }
+        if (x->umem_area != NULL) {
+                munmap(x->umem_area, x->umem_size);
+        }
+        free(x);
+}
+
+#else // ! defined HAVE_XDP
+
+struct udp_xdp *udp_xdp_init(const char *ifname, int queue, uint16_t port,
+                             bool ipv6_src)
+{
+        UNUSED(ifname), UNUSED(queue), UNUSED(port), UNUSED(ipv6_src);
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "UltraGrid was compiled without AF_XDP support (libxdp)!\n");
+        return NULL;
+}
+
+int udp_xdp_fd(struct udp_xdp *x)
+{
+        UNUSED(x);
+        return -1;
+}
+
+int udp_xdp_recv_batch(struct udp_xdp *x, int max, udp_xdp_packet_cb cb,
+                       void *udata)
+{
+        UNUSED(x), UNUSED(max), UNUSED(cb), UNUSED(udata);
+        return 0;
+}
+
+void udp_xdp_done(struct udp_xdp *x)
+{
+        UNUSED(x);
+}
+
+#endif // defined HAVE_XDP
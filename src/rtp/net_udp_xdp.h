@@ -0,0 +1,95 @@
+/**
+ * @file   rtp/net_udp_xdp.h
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * AF_XDP receive backend for the UDP reader thread (Linux, libxdp).
+ *
+ * The socket is bound to a single NIC RX queue. An XDP program attached to
+ * the interface redirects UDP datagrams destined to the given port to the
+ * socket, bypassing the kernel network stack; other traffic (ARP, RTCP,...)
+ * is passed to the stack. The port should be steered to the queue by the
+ * NIC, eg.:
+ *
+ *     ethtool -N eth0 flow-type udp4 dst-port 5004 action 2
+ *
+ * Fragmented IP datagrams, 802.1Q tagged frames and IPv6 with extension
+ * headers are left to the network stack.
+ */
+
+#ifndef RTP_NET_UDP_XDP_H_
+#define RTP_NET_UDP_XDP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct udp_xdp;
+
+/**
+ * Called for every received datagram. Data are valid only for the
+ * duration of the call.
+ */
+typedef void (*udp_xdp_packet_cb)(void *udata, const unsigned char *data,
+                                  int len, const struct sockaddr *src,
+                                  socklen_t src_len);
+
+/**
+ * @param ifname   name of the interface
+ * @param queue    NIC RX queue to bind to
+ * @param port     destination UDP port to accept (host byte order)
+ * @param ipv6_src report sources as (v4-mapped) IPv6 addresses
+ * @returns        state or NULL on error (or if unsupported)
+ */
+struct udp_xdp *udp_xdp_init(const char *ifname, int queue, uint16_t port,
+                             bool ipv6_src);
+/// @returns file descriptor that can be waited for in select()/poll()
+int             udp_xdp_fd(struct udp_xdp *x);
+/**
+ * Processes at most max received frames without blocking.
+ * @returns number of datagrams passed to cb
+ */
+int             udp_xdp_recv_batch(struct udp_xdp *x, int max,
+                                   udp_xdp_packet_cb cb, void *udata);
+void            udp_xdp_done(struct udp_xdp *x);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined RTP_NET_UDP_XDP_H_
@@ -64,9 +64,12 @@
 #include "rtp/rtp_callback.h"
 #include "rtp/ptime.h"
 #include "rtp/pbuf.h"
+#include "rtp/pkt_pool.h"
 #include "tv.h"
 #include "utils/color_out.h"
 #include "utils/macros.h"
+#include "utils/mem_stats.h"
+#include "utils/metrics.h"
 
 #define PBUF_MAGIC	0xcafebabe
 
@@ -74,30 +77,77 @@ enum {
         DEFAULT_STATS_INTERVAL = 128,
         STAT_INT_MIN_DIVISOR   = sizeof(unsigned long long) * CHAR_BIT,
         WRAPAROUND_THRESHOLD   = 900000, // 10 sec with 90 kHz clock
+        PBUF_HASH_BITS         = 6,
+        PBUF_HASH_SIZE         = 1 << PBUF_HASH_BITS,
+        PBUF_SEQ_MARGIN        = 8,  ///< room for reordered packets preceding the first received one
+        PBUF_INITIAL_UNITS     = 32,
+        PBUF_MAX_UNITS         = 1 << 15,
+        ADAPT_JITTER_MULT      = 4,    ///< adaptive delay covers completion latency + this * jitter
+        ADAPT_MARGIN_US        = 1000,
+        ADAPT_DECAY            = 32,   ///< delay shrinks by 1/ADAPT_DECAY of the excess per frame
+        PTS_OFFSET_DECAY       = 1024, ///< RTP->local clock offset follows increases by 1/PTS_OFFSET_DECAY per frame
+        NACK_MAX_PENDING       = 1024, ///< max. tracked missing packets (longer gaps are not requested)
+        NACK_MAX_TRIES         = 3,
+        NACK_RTT_DECAY         = 8,
 };
+#define NACK_REORDER_NS (500 * 1000)     ///< do not request immediately, the packet may be just reordered
+#define NACK_MIN_RETRY_NS (5 * NS_IN_MS)
+#define PTS_OFFSET_RESET_NS (NS_IN_SEC) ///< offset increase considered to be a stream discontinuity
 static_assert(DEFAULT_STATS_INTERVAL % STAT_INT_MIN_DIVISOR == 0,
                 "STATS_INTERVAL must be divisible by (sizeof(ull) * CHAR_BIT)");
 #define MOD_NAME "[Pbuf] "
 
+/**
+ * Packets of the frame are stored in the units array indexed by the sequence
+ * number relative to base_seq so that insertion is O(1) regardless of packet
+ * order. The cdata list (descending seqno order) passed to the decoder is
+ * built from the array lazily when the frame is decoded.
+ */
 struct pbuf_node {
         struct pbuf_node *nxt;
         struct pbuf_node *prv;
+        struct pbuf_node *hash_nxt; ///< next node in the same pbuf::slots bucket
         uint32_t rtp_timestamp; /* RTP timestamp for the frame           */
         time_ns_t arrival_time;    /* Arrival time of first packet in frame */
         time_ns_t playout_time;    /* Playout time for the frame            */
         time_ns_t deletion_time;   /* Deletion time for the frame            */
-        struct coded_data *cdata;       /*                                       */
+        time_ns_t presentation_time; /* Target presentation time (jitter-free) */
+        struct coded_data *cdata;       /* head of the list (valid if linked)    */
+        struct coded_data *units;
+        int units_alloc;
+        int lo, hi;             /* lowest/highest used index in units    */
+        uint16_t base_seq;      /* sequence number of units[0]           */
+        bool linked;
+        void *placed;           /* pbuf_placement frame context          */
         int decoded;            /* Non-zero if we've decoded this frame  */
         int mbit;               /* determines if mbit of frame had been seen */
         uint32_t magic;         /* For debugging                         */
         bool completed;
+        bool ready;             /* can be decoded before completion (pbuf_placement::place) */
 };
 
 struct pbuf {
         struct pbuf_node *frst;
         struct pbuf_node *last;
+        struct pbuf_node *slots[PBUF_HASH_SIZE]; ///< frames hashed by RTP timestamp
         long long int playout_delay_us;
         volatile int *offset_ms;
+        const struct pbuf_placement *placement;
+        void *placement_udata;
+
+        // adaptive playout delay (enabled if adapt_max_us > 0)
+        long long int adapt_min_us, adapt_max_us;
+        long long int adapt_delay_us;   ///< current delay
+        double jitter_ns;               ///< RFC 3550-style inter-arrival jitter of frames
+        double completion_ns;           ///< smoothed frame completion latency
+        time_ns_t last_arrival;
+        uint32_t last_arrival_ts;
+
+        // mapping of RTP timestamps to local clock (presentation time)
+        bool rtp_clock_valid;
+        uint32_t rtp_clock_last_ts;
+        int64_t rtp_clock_ext;          ///< extended (unwrapped) RTP timestamp
+        time_ns_t rtp_clock_offset;     ///< local time - RTP time of the least delayed frame
 
         // for statistics
         int stats_interval;
@@ -111,9 +161,33 @@ struct pbuf {
         int out_of_order_pkts;
         int max_out_of_order_dist;
         int dups; // duplicite packets
+        int late_pkts; ///< belonging to an already removed frame - discarded
+        int dropped_pkts; ///< not stored (duplicate, out of range or out of memory)
+
+        struct mem_gauge *gauge; ///< packets held
+        struct pbuf_metrics {
+                struct metric *expected, *received, *dups, *reordered;
+                struct metric *late, *dropped;
+                struct metric *playout_delay;
+        } metrics; ///< registered with the first packet (SSRC label)
+
+        // selective retransmission requests (enabled if nacks != NULL)
+        struct pbuf_nack {
+                uint16_t seq;
+                int tries;
+                time_ns_t next;         ///< time of the next request
+                time_ns_t sent;         ///< time of the first request
+                time_ns_t deadline;     ///< playout time of the frame
+        } *nacks;
+        int nack_count;
+        bool nack_seq_valid;
+        uint16_t nack_max_seq;          ///< highest sequence number received
+        time_ns_t nack_deadline;        ///< playout time of the frame of the packet with nack_max_seq
+        double nack_rtt_ns;             ///< smoothed (first) request -> retransmission delay
+        int nack_requested, nack_recovered;
 };
 
-static void free_cdata(struct coded_data *head);
+static void free_pnode(struct pbuf *playout_buf, struct pbuf_node *node);
 static int frame_complete(struct pbuf_node *frame);
 
 /*********************************************************************************/
@@ -144,7 +218,8 @@ static void pbuf_validate(struct pbuf *playout_buf)
                 } else {
                         assert(cpb = playout_buf->last);
                 }
-                if (cpb->cdata != NULL) {
+                assert(cpb->lo <= cpb->hi && cpb->hi < cpb->units_alloc);
+                if (cpb->linked && cpb->cdata != NULL) {
                         /* We have coded data... check all the pointers on that list too */
                         ccd = cpb->cdata;
                         pcd = NULL;
@@ -186,6 +261,7 @@ struct pbuf *pbuf_init(volatile int *delay_ms)
                 playout_buf->playout_delay_us = 0.032 * 1000 * 1000;
                 playout_buf->last_report_seq = -1;
                 playout_buf->stats_interval = DEFAULT_STATS_INTERVAL;
+                playout_buf->gauge = mem_gauge_register("pbuf");
         } else {
                 debug_msg("Failed to allocate memory for playout buffer\n");
         }
@@ -208,73 +284,164 @@ void pbuf_destroy(struct pbuf *playout_buf) {
                 struct pbuf_node *curr = playout_buf->frst;
                 while (curr != NULL) {
                         struct pbuf_node *temp = curr->nxt;
-                        if (curr == playout_buf->frst) {
-                                playout_buf->frst = curr->nxt;
-                        }
-                        if (curr == playout_buf->last) {
-                                playout_buf->last = curr->prv;
-                        }
-                        if (curr->nxt != NULL) {
-                                curr->nxt->prv = curr->prv;
-                        }
-                        if (curr->prv != NULL) {
-                                curr->prv->nxt = curr->nxt;
-                        }
-                        free_cdata(curr->cdata);
-                        free(curr);
+                        free_pnode(playout_buf, curr);
                         curr = temp;
                 }
+                mem_gauge_unregister(playout_buf->gauge);
+                metric_unregister(playout_buf->metrics.expected);
+                metric_unregister(playout_buf->metrics.received);
+                metric_unregister(playout_buf->metrics.dups);
+                metric_unregister(playout_buf->metrics.reordered);
+                metric_unregister(playout_buf->metrics.late);
+                metric_unregister(playout_buf->metrics.dropped);
+                metric_unregister(playout_buf->metrics.playout_delay);
+                free(playout_buf->nacks);
                 free(playout_buf);
         }
 }
 
+/// size accounted to the gauge (header + payload, the buffer itself is
+/// accounted by the packet pool)
+static long long pbuf_pkt_size(const rtp_packet *pkt)
+{
+        return RTP_PACKET_HEADER_SIZE + pkt->data_len;
+}
+
+static unsigned pbuf_hash(uint32_t rtp_timestamp)
+{
+        return (rtp_timestamp * 2654435761U) >> (32 - PBUF_HASH_BITS);
+}
+
+static struct pbuf_node *pbuf_find(struct pbuf *playout_buf, uint32_t rtp_timestamp)
+{
+        struct pbuf_node *curr = playout_buf->slots[pbuf_hash(rtp_timestamp)];
+        while (curr != NULL && curr->rtp_timestamp != rtp_timestamp) {
+                curr = curr->hash_nxt;
+        }
+        return curr;
+}
+
+/// appends the node to the end of the playout buffer
+static void pbuf_add_node(struct pbuf *playout_buf, struct pbuf_node *node)
+{
+        node->prv = playout_buf->last;
+        if (playout_buf->last != NULL) {
+                playout_buf->last->nxt = node;
+                playout_buf->last->completed = true;
+        } else {
+                playout_buf->frst = node;
+        }
+        playout_buf->last = node;
+
+        struct pbuf_node **slot = &playout_buf->slots[pbuf_hash(node->rtp_timestamp)];
+        node->hash_nxt = *slot;
+        *slot = node;
+}
+
+static void pbuf_remove_node(struct pbuf *playout_buf, struct pbuf_node *node)
+{
+        if (node == playout_buf->frst) {
+                playout_buf->frst = node->nxt;
+        }
+        if (node == playout_buf->last) {
+                playout_buf->last = node->prv;
+        }
+        if (node->nxt != NULL) {
+                node->nxt->prv = node->prv;
+        }
+        if (node->prv != NULL) {
+                node->prv->nxt = node->nxt;
+        }
+        struct pbuf_node **slot = &playout_buf->slots[pbuf_hash(node->rtp_timestamp)];
+        while (*slot != node) {
+                slot = &(*slot)->hash_nxt;
+        }
+        *slot = node->hash_nxt;
+        free_pnode(playout_buf, node);
+}
+
+/**
+ * Makes room for index idx in node->units, moving the contents if the index
+ * precedes the array start (packet older than the first one received).
+ *
+ * @returns adjusted index or -1 if the packet cannot be stored
+ */
+static int reserve_unit(struct pbuf_node *node, int idx)
+{
+        int shift = 0;
+        if (idx < 0) {
+                shift = -idx + PBUF_SEQ_MARGIN;
+        }
+        int needed = MAX(idx + shift, node->hi + shift) + 1;
+        if (needed > PBUF_MAX_UNITS) {
+                return -1;
+        }
+        if (needed > node->units_alloc) {
+                int new_alloc = MIN(MAX(needed, 2 * node->units_alloc), PBUF_MAX_UNITS);
+                struct coded_data *units = realloc(node->units, new_alloc * sizeof *units);
+                if (units == NULL) {
+                        return -1;
+                }
+                memset(units + node->units_alloc, 0,
+                       (new_alloc - node->units_alloc) * sizeof *units);
+                node->units = units;
+                node->units_alloc = new_alloc;
+        }
+        if (shift > 0) {
+                memmove(node->units + node->lo + shift, node->units + node->lo,
+                        (node->hi - node->lo + 1) * sizeof node->units[0]);
+                memset(node->units + node->lo, 0, shift * sizeof node->units[0]);
+                node->base_seq -= shift;
+                node->lo += shift;
+                node->hi += shift;
+        }
+        return idx + shift;
+}
+
 /** Add "pkt" to the frame represented by "node". The "node" has
  * previously been created, and has some coded data already...
  *
- * New arrivals are filed to the list in descending sequence number order
+ * @retval false if the packet was dropped
  */
-static void add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
+static bool add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
 {
         assert(node->rtp_timestamp == pkt->ts);
-        assert(node->cdata != NULL);
 
-        struct coded_data *tmp = (struct coded_data *) malloc(sizeof(struct coded_data));
-        if (tmp == NULL) {
-                /* this is bad, out of memory, drop the packet... */
-                free(pkt);
-                return;
+        int idx = reserve_unit(node, (int16_t) (pkt->seq - node->base_seq));
+        if (idx == -1 || node->units[idx].data != NULL) {
+                /* out of memory, out of range or duplicate - drop the packet */
+                rtp_pkt_free(pkt);
+                return false;
         }
-
-        tmp->seqno = pkt->seq;
-        tmp->data = pkt;
+        node->units[idx].seqno = pkt->seq;
+        node->units[idx].data = pkt;
+        node->lo = MIN(node->lo, idx);
+        node->hi = MAX(node->hi, idx);
         node->mbit |= pkt->m;
-        if((int16_t)(tmp->seqno - node->cdata->seqno) > 0){
-                tmp->prv = NULL;
-                tmp->nxt = node->cdata;
-                node->cdata->prv = tmp;
-                node->cdata = tmp;
-        } else {
-                struct coded_data *curr = node->cdata;
-                struct coded_data *prv = NULL;
-                while (curr != NULL &&  ((int16_t)(tmp->seqno - curr->seqno) < 0)){
-                        prv = curr;
-                        curr = curr->nxt;
-                }
-                if (curr == NULL) {
-                        tmp->nxt = NULL;
-                        tmp->prv = prv;
-                        prv->nxt = tmp;
-                }else if ((int16_t)(tmp->seqno - curr->seqno) > 0){
-                        tmp->nxt = curr;
-                        tmp->prv = curr->prv;
-                        tmp->prv->nxt = tmp;
-                        curr->prv = tmp;
+        node->linked = false;
+        return true;
+}
+
+/// builds the coded_data list (descending seqno order) from node->units
+static void link_coded_units(struct pbuf_node *node)
+{
+        struct coded_data *prv = NULL;
+        node->cdata = NULL;
+        for (int i = node->hi; i >= node->lo; --i) {
+                struct coded_data *curr = &node->units[i];
+                if (curr->data == NULL) {
+                        continue;
+                }
+                curr->prv = prv;
+                curr->nxt = NULL;
+                if (prv != NULL) {
+                        prv->nxt = curr;
                 } else {
-                        /* this is bad, something went terribly wrong... */
-                        free(pkt);
-                        free(tmp);
+                        node->cdata = curr;
                 }
+                prv = curr;
         }
+        node->linked = true;
 }
 
 static struct pbuf_node *create_new_pnode(rtp_packet * pkt, long long playout_delay_us)
@@ -284,24 +451,25 @@ static struct pbuf_node *create_new_pnode(rtp_packet * pkt, long long playout_de
                 tmp->magic = PBUF_MAGIC;
                 tmp->rtp_timestamp = pkt->ts;
                 tmp->mbit = pkt->m;
-                tmp->playout_time =
-                        tmp->arrival_time = get_time_in_ns();
+                tmp->playout_time = tmp->arrival_time =
+                        pkt->recv_time != 0 ? pkt->recv_time : get_time_in_ns();
                 tmp->playout_time += playout_delay_us * 1000;
                 tmp->deletion_time = tmp->playout_time + playout_delay_us * 1000;
 
-                tmp->cdata = (struct coded_data *) malloc(sizeof(struct coded_data));
-                if (tmp->cdata != NULL) {
-                        tmp->cdata->nxt = NULL;
-                        tmp->cdata->prv = NULL;
-                        tmp->cdata->seqno = pkt->seq;
-                        tmp->cdata->data = pkt;
+                tmp->units = calloc(PBUF_INITIAL_UNITS, sizeof(struct coded_data));
+                if (tmp->units != NULL) {
+                        tmp->units_alloc = PBUF_INITIAL_UNITS;
+                        tmp->base_seq = pkt->seq - PBUF_SEQ_MARGIN;
+                        tmp->lo = tmp->hi = PBUF_SEQ_MARGIN;
+                        tmp->units[PBUF_SEQ_MARGIN].seqno = pkt->seq;
+                        tmp->units[PBUF_SEQ_MARGIN].data = pkt;
                 } else {
-                        free(pkt);
+                        rtp_pkt_free(pkt);
                         free(tmp);
                         return NULL;
                 }
         } else {
-                free(pkt);
+                rtp_pkt_free(pkt);
         }
         return tmp;
 }
@@ -342,10 +510,34 @@ static void compute_longest_gap(int *longest_gap, int *accumulated_loss, unsigne
         }
 }
 
+static void pbuf_register_metrics(struct pbuf_metrics *m, uint32_t ssrc)
+{
+        char labels[32];
+        snprintf(labels, sizeof labels, "ssrc=\"0x%08" PRIx32 "\"", ssrc);
+        m->expected = metric_register(METRIC_COUNTER, "ug_rx_packets_expected",
+                                      "Expected RTP packets (by sequence number).", labels);
+        m->received = metric_register(METRIC_COUNTER, "ug_rx_packets_received",
+                                      "Received RTP packets.", labels);
+        m->dups = metric_register(METRIC_COUNTER, "ug_rx_packets_duplicate",
+                                  "Duplicate RTP packets.", labels);
+        m->reordered = metric_register(METRIC_COUNTER, "ug_rx_packets_reordered",
+                                       "Out-of-order RTP packets.", labels);
+        m->late = metric_register(METRIC_COUNTER, "ug_rx_packets_late",
+                                  "RTP packets of already removed frames (discarded).", labels);
+        m->dropped = metric_register(METRIC_COUNTER, "ug_rx_packets_dropped",
+                                     "RTP packets dropped by the playout buffer (duplicate, "
+                                     "out of range or out of memory).", labels);
+        m->playout_delay = metric_register(METRIC_GAUGE, "ug_rx_playout_delay_seconds",
+                                           "Playout buffer delay.", labels);
+}
+
 static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt)
 {
         // collect statistics
         if (playout_buf->last_report_seq == -1) { // init
+                if (playout_buf->metrics.expected == NULL) {
+                        pbuf_register_metrics(&playout_buf->metrics, pkt->ssrc);
+                }
                 playout_buf->last_seq = pkt->seq - 1;
                 playout_buf->last_report_seq = pkt->seq / playout_buf->stats_interval * playout_buf->stats_interval;
                 for (uint16_t i = playout_buf->last_report_seq; i != pkt->seq; ++i) {
@@ -356,6 +548,7 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
         unsigned long long current_bit = 1ull << (pkt->seq % NUMBER_WORD_BITS);
         if ((playout_buf->packets[pkt->seq / NUMBER_WORD_BITS] & ~current_bit) > current_bit) {
                 playout_buf->out_of_order_pkts += 1;
+                metric_inc(playout_buf->metrics.reordered, 1);
                 int dist = ((pkt->seq + (1<<16U)) - playout_buf->last_seq) % (1<<16U);
                 dist = dist < 1<<15U ? dist : abs(dist - (1<<16U));
                 playout_buf->max_out_of_order_dist = MAX(playout_buf->max_out_of_order_dist, dist);
@@ -363,12 +556,15 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
         playout_buf->last_seq = pkt->seq;
         if (playout_buf->packets[pkt->seq / NUMBER_WORD_BITS] & current_bit) {
                 playout_buf->dups += 1;
+                metric_inc(playout_buf->metrics.dups, 1);
         }
         playout_buf->packets[pkt->seq / NUMBER_WORD_BITS] |= current_bit;
         uint16_t dist = (uint16_t) (pkt->seq - playout_buf->last_report_seq);
         if (dist >= playout_buf->stats_interval * 2 && dist < 1U<<15U) {
                 uint16_t report_seq_until = (uint16_t) ((pkt->seq / playout_buf->stats_interval * playout_buf->stats_interval) - playout_buf->stats_interval); // sum up only up to current-playout_buf->stats_interval to be able to catch out-of-order packets
                 int accumulated_loss = 0;
+                const int expected_before = playout_buf->expected_pkts;
+                const int received_before = playout_buf->received_pkts;
                 for (uint16_t i = playout_buf->last_report_seq;
                                 i != report_seq_until; i += NUMBER_WORD_BITS) {
                         playout_buf->expected_pkts += NUMBER_WORD_BITS;
@@ -377,6 +573,10 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
                         playout_buf->packets[i / NUMBER_WORD_BITS] = 0;
                 }
 
+                metric_inc(playout_buf->metrics.expected,
+                           playout_buf->expected_pkts - expected_before);
+                metric_inc(playout_buf->metrics.received,
+                           playout_buf->received_pkts - received_before);
                 playout_buf->received_pkts_cum += playout_buf->received_pkts;
                 playout_buf->expected_pkts_cum += playout_buf->expected_pkts;
 
@@ -397,6 +597,24 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
                 if (playout_buf->dups > 0) {
                         snprintf(oo_dups_str + strlen(oo_dups_str), sizeof oo_dups_str - strlen(oo_dups_str), ", %d dups", playout_buf->dups);
                 }
+                if (playout_buf->late_pkts > 0 || playout_buf->dropped_pkts > 0) {
+                        snprintf(oo_dups_str + strlen(oo_dups_str), sizeof oo_dups_str - strlen(oo_dups_str), ", %d late, %d dropped", playout_buf->late_pkts, playout_buf->dropped_pkts);
+                }
+                struct rtp_pkt_pool *pool = rtp_pkt_get_pool(pkt);
+                if (pool != NULL) {
+                        snprintf(oo_dups_str + strlen(oo_dups_str), sizeof oo_dups_str - strlen(oo_dups_str), ", pkt pool high-water %zu", rtp_pkt_pool_get_high_water(pool));
+                }
+                if (playout_buf->adapt_max_us > 0) {
+                        snprintf(oo_dups_str + strlen(oo_dups_str), sizeof oo_dups_str - strlen(oo_dups_str), ", playout delay %.1f ms", playout_buf->adapt_delay_us / 1000.0);
+                }
+                metric_set(playout_buf->metrics.playout_delay,
+                           (playout_buf->adapt_max_us > 0 ? playout_buf->adapt_delay_us
+                                                          : playout_buf->playout_delay_us) / 1e6);
+                if (playout_buf->nacks != NULL) {
+                        snprintf(oo_dups_str + strlen(oo_dups_str), sizeof oo_dups_str - strlen(oo_dups_str), ", %d NACKed, %d recovered (RTT %.1f ms)",
+                                        playout_buf->nack_requested, playout_buf->nack_recovered, playout_buf->nack_rtt_ns / NS_IN_MS);
+                        playout_buf->nack_requested = playout_buf->nack_recovered = 0;
+                }
                 log_msg(LOG_LEVEL_INFO, "SSRC 0x%08" PRIx32 ": %d/%d packets received (%s%.4f%%" TERM_FG_RESET "), %d lost, max loss %d%s\n",
                                 pkt->ssrc, playout_buf->received_pkts, playout_buf->expected_pkts, (loss_pct < 100.0 ? TERM_FG_RED : ""), loss_pct,
                                 playout_buf->expected_pkts - playout_buf->received_pkts, playout_buf->longest_gap, oo_dups_str);
@@ -414,85 +632,215 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
                 playout_buf->out_of_order_pkts = 0;
                 playout_buf->max_out_of_order_dist = 0;
                 playout_buf->dups = 0;
+                playout_buf->late_pkts = 0;
+                playout_buf->dropped_pkts = 0;
         }
 }
 
-void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
+static long long int get_playout_delay_us(const struct pbuf *playout_buf)
 {
-        struct pbuf_node *tmp;
+        return playout_buf->adapt_max_us > 0 ? playout_buf->adapt_delay_us
+                                             : playout_buf->playout_delay_us;
+}
 
-        pbuf_validate(playout_buf);
-        pbuf_process_stats(playout_buf, pkt);
+/// updates inter-arrival jitter with the new frame (first packet arrival)
+static void pbuf_update_jitter(struct pbuf *playout_buf, const struct pbuf_node *node)
+{
+        if (playout_buf->adapt_max_us == 0) {
+                return;
+        }
+        if (playout_buf->last_arrival != 0) {
+                double d = (double) (node->arrival_time - playout_buf->last_arrival) -
+                           (double) (uint32_t) (node->rtp_timestamp - playout_buf->last_arrival_ts) *
+                                   NS_IN_SEC / 90000;
+                playout_buf->jitter_ns += (fabs(d) - playout_buf->jitter_ns) / 16;
+        }
+        playout_buf->last_arrival = node->arrival_time;
+        playout_buf->last_arrival_ts = node->rtp_timestamp;
+}
 
-        if (playout_buf->frst == NULL && playout_buf->last == NULL) {
-                /* playout buffer is empty - add new frame */
-                playout_buf->frst = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
-                playout_buf->last = playout_buf->frst;
+/**
+ * Adjusts the adaptive delay after a frame has been completed (M-bit received).
+ * The delay grows immediately but shrinks slowly.
+ */
+static void pbuf_adapt_delay(struct pbuf *playout_buf, const struct pbuf_node *node)
+{
+        if (playout_buf->adapt_max_us == 0) {
                 return;
         }
+        const double completion = (double) (get_time_in_ns() - node->arrival_time);
+        if (completion > playout_buf->completion_ns) {
+                playout_buf->completion_ns = completion;
+        } else {
+                playout_buf->completion_ns += (completion - playout_buf->completion_ns) / 16;
+        }
+        long long int target_us = (long long int) ((playout_buf->completion_ns +
+                                ADAPT_JITTER_MULT * playout_buf->jitter_ns) / 1000) + ADAPT_MARGIN_US;
+        target_us = MAX(MIN(target_us, playout_buf->adapt_max_us), playout_buf->adapt_min_us);
+        if (target_us > playout_buf->adapt_delay_us) {
+                playout_buf->adapt_delay_us = target_us;
+        } else {
+                playout_buf->adapt_delay_us -= (playout_buf->adapt_delay_us - target_us) / ADAPT_DECAY;
+        }
+}
+
+/**
+ * Computes presentation time of a new frame from its RTP timestamp. Unlike
+ * playout time, which is derived from the arrival time of the first packet,
+ * it is not affected by network jitter - the RTP clock is mapped to the local
+ * clock by the offset of the least delayed frame seen so far. The offset
+ * slowly follows increases to compensate for clock drift.
+ */
+static void pbuf_set_presentation_time(struct pbuf *playout_buf, struct pbuf_node *node,
+                long long playout_delay_us)
+{
+        if (!playout_buf->rtp_clock_valid) {
+                playout_buf->rtp_clock_ext = node->rtp_timestamp;
+        } else {
+                playout_buf->rtp_clock_ext += (int32_t) (node->rtp_timestamp - playout_buf->rtp_clock_last_ts);
+        }
+        playout_buf->rtp_clock_last_ts = node->rtp_timestamp;
+        const int64_t ext = playout_buf->rtp_clock_ext;
+        const time_ns_t rtp_ns = ext / 9 * 100000 + ext % 9 * 100000 / 9; // 90 kHz -> ns
+        const time_ns_t offset = node->arrival_time - rtp_ns;
+        if (!playout_buf->rtp_clock_valid || offset < playout_buf->rtp_clock_offset ||
+                        offset - playout_buf->rtp_clock_offset > PTS_OFFSET_RESET_NS) {
+                playout_buf->rtp_clock_offset = offset;
+                playout_buf->rtp_clock_valid = true;
+        } else {
+                playout_buf->rtp_clock_offset += (offset - playout_buf->rtp_clock_offset) / PTS_OFFSET_DECAY;
+        }
+        node->presentation_time = rtp_ns + playout_buf->rtp_clock_offset + playout_delay_us * 1000;
+}
 
-        if (playout_buf->last->rtp_timestamp == pkt->ts) {
-                if (playout_buf->last->decoded) {
+/**
+ * Records gaps in the sequence numbers as packets to be requested and removes
+ * the entries of packets that eventually arrived.
+ *
+ * @param deadline playout time of the frame the packet belongs to (0 if unknown)
+ */
+static void pbuf_nack_track(struct pbuf *playout_buf, uint16_t seq, time_ns_t deadline)
+{
+        if (!playout_buf->nack_seq_valid) {
+                playout_buf->nack_seq_valid = true;
+                playout_buf->nack_max_seq = seq;
+                playout_buf->nack_deadline = deadline;
+                return;
+        }
+        const time_ns_t now = get_time_in_ns();
+        const uint16_t dist = seq - playout_buf->nack_max_seq;
+        if (dist == 0) {
+                return;
+        }
+        if (dist < 1U << 15U) { // in order, possibly with a gap
+                // the missing packets belong either to the previous or to
+                // the current frame, the earlier deadline is used
+                if (dist - 1 <= NACK_MAX_PENDING - playout_buf->nack_count) {
+                        for (uint16_t i = playout_buf->nack_max_seq + 1; i != seq; ++i) {
+                                playout_buf->nacks[playout_buf->nack_count++] = (struct pbuf_nack){
+                                        i, 0, now + NACK_REORDER_NS, 0, playout_buf->nack_deadline };
+                        }
+                }
+                playout_buf->nack_max_seq = seq;
+                playout_buf->nack_deadline = deadline;
+                return;
+        }
+        for (int i = 0; i < playout_buf->nack_count; ++i) { // reordered or retransmitted
+                struct pbuf_nack *n = &playout_buf->nacks[i];
+                if (n->seq != seq) {
+                        continue;
+                }
+                if (n->tries > 0) {
+                        playout_buf->nack_recovered += 1;
+                        playout_buf->nack_rtt_ns += (now - n->sent - playout_buf->nack_rtt_ns) / NACK_RTT_DECAY;
+                }
+                *n = playout_buf->nacks[--playout_buf->nack_count];
+                return;
+        }
+}
+
+void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
+{
+        const uint16_t seq = pkt->seq;
+        struct pbuf_node *node = NULL;
+        pbuf_validate(playout_buf);
+        pbuf_process_stats(playout_buf, pkt);
+
+        node = pbuf_find(playout_buf, pkt->ts);
+        if (node != NULL) {
+                if (node->decoded && !node->ready) {
                         log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Late data for already decoded frame!\n");
                 }
-                /* Packet belongs to last frame in playout_buf this is the */
-                /* most likely scenario - although...                      */
-                add_coded_unit(playout_buf->last, pkt);
-        } else {
-                if (playout_buf->last->rtp_timestamp < pkt->ts ||
-                    playout_buf->last->rtp_timestamp - pkt->ts >
-                        UINT32_MAX - WRAPAROUND_THRESHOLD) {
-                        /* Packet belongs to a new frame... */
-                        tmp = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
-                        playout_buf->last->nxt = tmp;
-                        playout_buf->last->completed = true;
-                        tmp->prv = playout_buf->last;
-                        playout_buf->last = tmp;
+                const bool mbit = pkt->m && !node->mbit;
+                if (add_coded_unit(node, pkt)) {
+                        mem_gauge_add(playout_buf->gauge, pbuf_pkt_size(pkt), 1);
+                        if (node->placed != NULL) {
+                                node->ready = playout_buf->placement->place(playout_buf->placement_udata,
+                                                node->placed, pkt);
+                        }
+                        if (mbit) {
+                                pbuf_adapt_delay(playout_buf, node);
+                        }
                 } else {
-                        bool discard_pkt = false;
-                        /* Packet belongs to a previous frame... */
-                        if (playout_buf->frst->rtp_timestamp > pkt->ts ||
-                            pkt->ts - playout_buf->frst->rtp_timestamp >
-                                UINT32_MAX - WRAPAROUND_THRESHOLD) {
-                                debug_msg("A very old packet - discarded\n");
-                                discard_pkt = true;
-                        } else {
-                                debug_msg
-                                    ("A packet for a previous frame, but might still be useful\n");
-                                struct pbuf_node *curr = playout_buf->last;
-                                while(curr != playout_buf->frst && curr->rtp_timestamp > pkt->ts){
-                                        curr = curr->prv;
-                                }
-                                if (curr->rtp_timestamp == pkt->ts) {
-                                        /* Packet belongs to a previous existing frame... */
-                                        add_coded_unit(curr, pkt);
-                                } else {
-                                        /* Packet belongs to a frame that is not present */
-                                        discard_pkt = true;
-                                }
+                        playout_buf->dropped_pkts += 1;
+                        metric_inc(playout_buf->metrics.dropped, 1);
+                }
+        } else if (playout_buf->last == NULL ||
+                   playout_buf->last->rtp_timestamp < pkt->ts ||
+                   playout_buf->last->rtp_timestamp - pkt->ts >
+                       UINT32_MAX - WRAPAROUND_THRESHOLD) {
+                /* Packet belongs to a new frame... */
+                const long long delay_us = get_playout_delay_us(playout_buf) +
+                        1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0);
+                node = create_new_pnode(pkt, delay_us);
+                if (node != NULL) {
+                        pbuf_set_presentation_time(playout_buf, node, delay_us);
+                        mem_gauge_add(playout_buf->gauge, pbuf_pkt_size(pkt), 1);
+                        pbuf_update_jitter(playout_buf, node);
+                        pbuf_add_node(playout_buf, node);
+                        if (playout_buf->placement != NULL) {
+                                node->placed = playout_buf->placement->frame_init(
+                                                playout_buf->placement_udata, pkt);
                         }
-                        if (discard_pkt) {
-                                if (pkt->m) {
-                                        debug_msg
-                                                ("Oops... dropped packet with M bit set\n");
-                                }
-                                free(pkt);
+                        if (node->placed != NULL) {
+                                node->ready = playout_buf->placement->place(playout_buf->placement_udata,
+                                                node->placed, pkt);
+                        }
+                        if (node->mbit) {
+                                pbuf_adapt_delay(playout_buf, node);
                         }
                 }
+        } else {
+                /* Packet belongs to a previous frame that is not present */
+                /* (either very old or already removed)...               */
+                debug_msg("A packet for a missing previous frame - discarded\n");
+                playout_buf->late_pkts += 1;
+                metric_inc(playout_buf->metrics.late, 1);
+                if (pkt->m) {
+                        debug_msg("Oops... dropped packet with M bit set\n");
+                }
+                rtp_pkt_free(pkt);
+        }
+        if (playout_buf->nacks != NULL) {
+                pbuf_nack_track(playout_buf, seq, node != NULL ? node->playout_time : 0);
         }
         pbuf_validate(playout_buf);
 }
 
-static void free_cdata(struct coded_data *head)
+static void free_pnode(struct pbuf *playout_buf, struct pbuf_node *node)
 {
-        struct coded_data *tmp;
-
-        while (head != NULL) {
-                free(head->data);
-                tmp = head;
-                head = head->nxt;
-                free(tmp);
+        if (node->placed != NULL) {
+                playout_buf->placement->frame_done(node->placed);
+        }
+        for (int i = node->lo; i <= node->hi; ++i) {
+                if (node->units[i].data != NULL) {
+                        mem_gauge_add(playout_buf->gauge,
+                                      -pbuf_pkt_size(node->units[i].data), -1);
+                        rtp_pkt_free(node->units[i].data);
+                }
         }
+        free(node->units);
+        free(node);
 }
 
 void pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time)
@@ -509,20 +857,7 @@ void pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time)
         while (curr != NULL) {
                 temp = curr->nxt;
                 if (curr_time > curr->deletion_time && frame_complete(curr)) {
-                        if (curr == playout_buf->frst) {
-                                playout_buf->frst = curr->nxt;
-                        }
-                        if (curr == playout_buf->last) {
-                                playout_buf->last = curr->prv;
-                        }
-                        if (curr->nxt != NULL) {
-                                curr->nxt->prv = curr->prv;
-                        }
-                        if (curr->prv != NULL) {
-                                curr->prv->nxt = curr->nxt;
-                        }
-                        free_cdata(curr->cdata);
-                        free(curr);
+                        pbuf_remove_node(playout_buf, curr);
                 } else {
                         /* The playout buffer is stored in order, so once  */
                         /* we see one packet that has not yet reached it's */
@@ -565,18 +900,31 @@ pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
         /* Find the first complete frame that has reached it's playout */
         /* time, and decode it into the framebuffer. Mark the frame as */
         /* decoded, but otherwise leave it in the playout buffer.      */
+        /* Frames reported ready by the placement hooks are decoded    */
+        /* immediately unless an older frame is still waiting for its  */
+        /* playout time (to keep the order).                           */
         struct pbuf_node *curr;
+        bool older_pending = false;
 
         pbuf_validate(playout_buf);
 
         curr = playout_buf->frst;
         while (curr != NULL) {
+                const bool early = curr->ready && !older_pending;
+                if (!curr->decoded && curr_time <= curr->playout_time) {
+                        older_pending = true;
+                }
                 if (!curr->decoded 
-                                && curr_time > curr->playout_time
+                                && (curr_time > curr->playout_time || early)
                    ) {
-                        if (frame_complete(curr)) {
+                        if (frame_complete(curr) || curr->ready) {
                                 struct pbuf_stats stats = { playout_buf->received_pkts_cum,
-                                        playout_buf->expected_pkts_cum };
+                                        playout_buf->expected_pkts_cum, curr->placed,
+                                        curr->presentation_time };
+                                curr->placed = NULL; // ownership passed to decode_func
+                                if (!curr->linked) {
+                                        link_coded_units(curr);
+                                }
                                 int ret = decode_func(curr->cdata, data, &stats);
                                 curr->decoded = 1;
                                 return ret;
@@ -594,8 +942,131 @@ pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
         return 0;
 }
 
+/**
+ * Computes when pbuf_decode(), pbuf_remove() or pbuf_get_nacks() will have
+ * something to do next without a new packet being inserted, so that the
+ * receiver can sleep until then.
+ *
+ * @param curr_time the time passed to the last pbuf_decode() call
+ * @returns the time of the next event (may be in the past - immediately),
+ *          LLONG_MAX if there is none
+ */
+time_ns_t pbuf_next_event(const struct pbuf *playout_buf, time_ns_t curr_time)
+{
+        time_ns_t next = LLONG_MAX;
+        bool older_pending = false;
+
+        for (struct pbuf_node *curr = playout_buf->frst; curr != NULL; curr = curr->nxt) {
+                if (curr->decoded) {
+                        continue;
+                }
+                if (curr->ready && !older_pending) { // decoded early
+                        return curr_time;
+                }
+                if (curr_time <= curr->playout_time) {
+                        older_pending = true;
+                }
+                // see pbuf_decode() - incomplete frames are given up 1 s after the playout time
+                const time_ns_t due = frame_complete(curr) || curr->ready
+                                              ? curr->playout_time
+                                              : curr->playout_time + 1 * NS_IN_SEC;
+                next = MIN(next, due + 1);
+        }
+        if (playout_buf->frst != NULL && frame_complete(playout_buf->frst)) {
+                next = MIN(next, playout_buf->frst->deletion_time + 1);
+        }
+        for (int i = 0; i < playout_buf->nack_count; ++i) {
+                const struct pbuf_nack *n = &playout_buf->nacks[i];
+                // see pbuf_get_nacks() for the conditions
+                if (n->tries < NACK_MAX_TRIES &&
+                    n->next + playout_buf->nack_rtt_ns < n->deadline) {
+                        next = MIN(next, n->next);
+                }
+        }
+        return next;
+}
+
 void pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay)
 {
         playout_buf->playout_delay_us = playout_delay * 1000 * 1000;
 }
 
+/**
+ * Sets hooks that are called for every stored packet. The placement context
+ * of a frame is then passed to decode function in pbuf_stats::placed.
+ */
+void pbuf_set_placement(struct pbuf *playout_buf, const struct pbuf_placement *placement, void *udata)
+{
+        for (struct pbuf_node *curr = playout_buf->frst; curr != NULL; curr = curr->nxt) {
+                if (curr->placed != NULL) {
+                        playout_buf->placement->frame_done(curr->placed);
+                        curr->placed = NULL;
+                }
+        }
+        playout_buf->placement = placement;
+        playout_buf->placement_udata = udata;
+}
+
+/**
+ * Enables adaptive playout delay - the delay is computed from the measured
+ * frame completion latency and inter-arrival jitter and kept in the range
+ * [min_delay, max_delay] (in seconds). The delay set by
+ * pbuf_set_playout_delay() is then ignored.
+ */
+/**
+ * @returns current playout delay in seconds (the adaptive one if enabled)
+ */
+/**
+ * Enables tracking of lost packets for selective retransmission, see
+ * pbuf_get_nacks().
+ */
+void pbuf_enable_nack(struct pbuf *playout_buf)
+{
+        if (playout_buf->nacks == NULL) {
+                playout_buf->nacks = calloc(NACK_MAX_PENDING, sizeof *playout_buf->nacks);
+        }
+}
+
+/**
+ * Returns sequence numbers of missing packets that should be requested now -
+ * those that can still arrive before the playout time of their frame given
+ * the measured retransmission delay. Requests are repeated if unanswered.
+ *
+ * @returns number of sequence numbers written to seqs
+ */
+int pbuf_get_nacks(struct pbuf *playout_buf, time_ns_t curr_time, uint16_t *seqs, int max)
+{
+        const time_ns_t retry_ns = MAX(2 * playout_buf->nack_rtt_ns, NACK_MIN_RETRY_NS);
+        int count = 0;
+        for (int i = 0; i < playout_buf->nack_count; ) {
+                struct pbuf_nack *n = &playout_buf->nacks[i];
+                if (curr_time > n->deadline) { // too late, remove
+                        *n = playout_buf->nacks[--playout_buf->nack_count];
+                        continue;
+                }
+                if (count < max && n->tries < NACK_MAX_TRIES && curr_time >= n->next &&
+                                curr_time + playout_buf->nack_rtt_ns < n->deadline) {
+                        seqs[count++] = n->seq;
+                        if (n->tries++ == 0) {
+                                n->sent = curr_time;
+                        }
+                        n->next = curr_time + retry_ns;
+                        playout_buf->nack_requested += 1;
+                }
+                i += 1;
+        }
+        return count;
+}
+
+double pbuf_get_playout_delay(const struct pbuf *playout_buf)
+{
+        return get_playout_delay_us(playout_buf) / 1000.0 / 1000.0;
+}
+
+void pbuf_set_adaptive_delay(struct pbuf *playout_buf, double min_delay, double max_delay)
+{
+        playout_buf->adapt_min_us = min_delay * 1000 * 1000;
+        playout_buf->adapt_max_us = MAX(max_delay * 1000 * 1000, 1);
+        playout_buf->adapt_delay_us = MAX(MIN(playout_buf->playout_delay_us,
+                                playout_buf->adapt_max_us), playout_buf->adapt_min_us);
+}
@@ -78,6 +78,26 @@ struct coded_data {
 struct pbuf_stats {
         long long int received_pkts_cum;
         long long int expected_pkts_cum;
+        void *placed; ///< frame context from pbuf_placement::frame_init (or NULL), owned by decode function
+        time_ns_t presentation_time; ///< target presentation time of the frame (get_time_in_ns() clock)
+};
+
+/**
+ * Optional consumer hooks that allow copying packet payloads to the
+ * destination buffer as the packets arrive instead of at decode time.
+ */
+struct pbuf_placement {
+        /// @returns context of a frame starting with pkt or NULL to not place the frame
+        void *(*frame_init)(void *udata, const rtp_packet *pkt);
+        /**
+         * called for every stored (non-duplicate) packet of the frame including the first one
+         * @returns true if the frame can be decoded already (eg. enough FEC symbols were
+         *          received) - it is then passed to the decode function without waiting for
+         *          the rest of the frame and the playout time
+         */
+        bool  (*place)(void *udata, void *frame_ctx, const rtp_packet *pkt);
+        /// disposes context of a frame that has not been passed to the decode function
+        void  (*frame_done)(void *frame_ctx);
 };
 
 /* The playout buffer */
@@ -120,7 +140,13 @@ int 	 	 pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
                              decode_frame_t decode_func, void *data);
                              //struct video_frame *framebuffer, int i, struct state_decoder *decoder);
 void		 pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time);
+time_ns_t	 pbuf_next_event(const struct pbuf *playout_buf, time_ns_t curr_time);
 void		 pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay);
+void		 pbuf_set_adaptive_delay(struct pbuf *playout_buf, double min_delay, double max_delay);
+double		 pbuf_get_playout_delay(const struct pbuf *playout_buf);
+void		 pbuf_set_placement(struct pbuf *playout_buf, const struct pbuf_placement *placement, void *udata);
+void		 pbuf_enable_nack(struct pbuf *playout_buf);
+int		 pbuf_get_nacks(struct pbuf *playout_buf, time_ns_t curr_time, uint16_t *seqs, int max);
 
 #ifdef __cplusplus
 }
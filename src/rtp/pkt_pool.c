@@ -0,0 +1,161 @@
+/**
+ * @file   rtp/pkt_pool.c
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "rtp/pkt_pool.h"
+#include "utils/mem_stats.h"
+
+union pkt_hdr {
+        struct {
+                struct rtp_pkt_pool *pool;
+                union pkt_hdr *next;
+        };
+        max_align_t align; ///< keep the buffer aligned as malloc would do
+};
+
+struct rtp_pkt_pool {
+        size_t size;
+        /// 1 for the owner + 1 for every buffer in use
+        atomic_size_t refs;
+        size_t high_water;
+        struct mem_gauge *gauge; ///< allocated (pooled) buffers
+
+        union pkt_hdr *cache; ///< owned by the allocating thread
+        _Atomic(union pkt_hdr *) returned; ///< lock-free stack of returned buffers
+};
+
+struct rtp_pkt_pool *rtp_pkt_pool_create(size_t size)
+{
+        struct rtp_pkt_pool *pool = calloc(1, sizeof *pool);
+        pool->size = size;
+        atomic_init(&pool->refs, 1);
+        atomic_init(&pool->returned, NULL);
+        pool->gauge = mem_gauge_register("rtp_pkt_pool");
+        return pool;
+}
+
+static void free_list(struct rtp_pkt_pool *pool, union pkt_hdr *it)
+{
+        while (it != NULL) {
+                union pkt_hdr *next = it->next;
+                mem_gauge_add(pool->gauge, -(long long) (sizeof *it + pool->size), -1);
+                free(it);
+                it = next;
+        }
+}
+
+static void pool_unref(struct rtp_pkt_pool *pool)
+{
+        if (atomic_fetch_sub_explicit(&pool->refs, 1, memory_order_acq_rel) != 1) {
+                return;
+        }
+        free_list(pool, pool->cache);
+        free_list(pool, atomic_load(&pool->returned));
+        mem_gauge_unregister(pool->gauge);
+        free(pool);
+}
+
+void rtp_pkt_pool_destroy(struct rtp_pkt_pool *pool)
+{
+        if (pool == NULL) {
+                return;
+        }
+        pool_unref(pool);
+}
+
+void *rtp_pkt_alloc(struct rtp_pkt_pool *pool, size_t size)
+{
+        union pkt_hdr *hdr = NULL;
+        if (pool == NULL || size > pool->size) {
+                hdr = malloc(sizeof *hdr + size);
+                hdr->pool = NULL;
+                return hdr + 1;
+        }
+
+        if (pool->cache == NULL) {
+                pool->cache = atomic_exchange_explicit(&pool->returned, NULL, memory_order_acquire);
+        }
+        if (pool->cache != NULL) {
+                hdr = pool->cache;
+                pool->cache = hdr->next;
+        } else {
+                hdr = malloc(sizeof *hdr + pool->size);
+                hdr->pool = pool;
+                mem_gauge_add(pool->gauge, sizeof *hdr + pool->size, 1);
+        }
+        const size_t in_use = atomic_fetch_add_explicit(&pool->refs, 1, memory_order_relaxed);
+        if (in_use > pool->high_water) {
+                pool->high_water = in_use;
+        }
+        return hdr + 1;
+}
+
+void rtp_pkt_free(void *pkt)
+{
+        if (pkt == NULL) {
+                return;
+        }
+        union pkt_hdr *hdr = (union pkt_hdr *) pkt - 1;
+        struct rtp_pkt_pool *pool = hdr->pool;
+        if (pool == NULL) {
+                free(hdr);
+                return;
+        }
+        union pkt_hdr *head = atomic_load_explicit(&pool->returned, memory_order_relaxed);
+        do {
+                hdr->next = head;
+        } while (!atomic_compare_exchange_weak_explicit(&pool->returned, &head, hdr,
+                                memory_order_release, memory_order_relaxed));
+        pool_unref(pool);
+}
+
+struct rtp_pkt_pool *rtp_pkt_get_pool(const void *pkt)
+{
+        return ((const union pkt_hdr *) pkt - 1)->pool;
+}
+
+size_t rtp_pkt_pool_get_high_water(const struct rtp_pkt_pool *pool)
+{
+        return pool->high_water;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file   rtp/pkt_pool.h
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Fixed-size pool for received RTP packet buffers.
+ *
+ * Packets are allocated by a single thread (the network reader) and returned
+ * from any thread (usually the decoder, when the frame is removed from the
+ * playout buffer). Returned buffers are pushed to a lock-free stack that is
+ * taken over as a whole by the allocating thread once its private cache
+ * is exhausted, so neither side takes a lock.
+ *
+ * Every buffer carries a hidden header so that rtp_pkt_free() can be used
+ * regardless whether the buffer came from a pool or from malloc (pool NULL).
+ */
+
+#ifndef RTP_PKT_POOL_H_
+#define RTP_PKT_POOL_H_
+
+#ifndef __cplusplus
+#include <stddef.h>
+#else
+#include <cstddef>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rtp_pkt_pool;
+
+/**
+ * @param size size of the pooled buffers; allocations of bigger size are
+ *             passed to malloc
+ */
+struct rtp_pkt_pool *rtp_pkt_pool_create(size_t size);
+/**
+ * Releases the pool. Buffers that are still in use remain valid, the pool is
+ * deallocated when the last of them is returned.
+ */
+void   rtp_pkt_pool_destroy(struct rtp_pkt_pool *pool);
+/**
+ * Must be called from a single thread for the given pool.
+ * @param pool may be NULL, then the buffer is malloc()ed
+ */
+void  *rtp_pkt_alloc(struct rtp_pkt_pool *pool, size_t size);
+/// thread-safe, accepts NULL
+void   rtp_pkt_free(void *pkt);
+/// @returns pool the buffer was allocated from (or NULL)
+struct rtp_pkt_pool *rtp_pkt_get_pool(const void *pkt);
+/// @returns maximal number of buffers simultaneously in use
+size_t rtp_pkt_pool_get_high_water(const struct rtp_pkt_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined RTP_PKT_POOL_H_
@@ -43,6 +43,7 @@
 
 #include "config.h"
 #include "debug.h"
+#include "rtp/gf256.h"
 #include "rtp/rs.h"
 #include "rtp/rtp_types.h"
 #include "transmit.h"
@@ -83,6 +84,7 @@ rs::rs(unsigned int k, unsigned int n)
 #ifdef HAVE_ZFEC
         state = fec_new(m_k, m_n);
         assert(state != NULL);
+        gf256_init();
 #else
         LOG(LOG_LEVEL_ERROR) << "zfec support is not compiled in, error correction is disabled\n";
 #endif
@@ -115,6 +117,7 @@ rs::rs(const char *c_cfg)
 #ifdef HAVE_ZFEC
         state = fec_new(m_k, m_n);
         assert(state != NULL);
+        gf256_init();
 #else
         throw ug_runtime_error("zfec support is not compiled in");
 #endif
@@ -154,30 +157,7 @@ shared_ptr<video_frame> rs::encode(shared_ptr<video_frame> in)
                 memcpy(out_data + sizeof(len32) + hdr_len, data, len);
                 memset(out_data + sizeof(len32) + hdr_len + len, 0, ss * m_k - (sizeof(len32) + hdr_len + len));
 
-#if 0
-                void *src[MAX_K];
-                for (int k = 0; k < m_k; ++k) {
-                        src[k] = *out + ss * k;
-                }
-
-                for (int m = 0; m < m_n - m_k; ++m) {
-                        fec_encode(state, src, *out + ss * (m_k + m), m, ss);
-                }
-#else
-                void *src[MAX_K];
-                for (unsigned int k = 0; k < m_k; ++k) {
-                        src[k] = out_data + ss * k;
-                }
-                void *dst[MAX_N];
-                unsigned int dst_idx[MAX_N];
-                for (unsigned int m = 0; m < m_n-m_k; ++m) {
-                        dst[m] = out_data + ss * (m_k + m);
-                        dst_idx[m] = m_k + m;
-                }
-
-                fec_encode((const fec_t *)state, (gf **) src,
-                                (gf **) dst, dst_idx, m_n-m_k, ss);
-#endif
+                encode_parity(out_data, ss);
 
                 out->tiles[i].data_len = buffer_len;
                 out->fec_params = fec_desc(FEC_RS, m_k, m_n - m_k, 0, 0, ss);
@@ -221,20 +201,7 @@ audio_frame2 rs::encode(const audio_frame2 &in)
 
                 out.set_fec_params(i, fec_desc(FEC_RS, m_k, m_n - m_k, 0, 0, ss));
 
-                void *src[MAX_K];
-                for (unsigned int k = 0; k < m_k; ++k) {
-                        src[k] = out.get_data(i) + ss * k;
-                }
-
-                void *dst[MAX_N];
-                unsigned int dst_idx[MAX_N];
-                for (unsigned int m = 0; m < m_n-m_k; ++m) {
-                        dst[m] = out.get_data(i) + ss * (m_k + m);
-                        dst_idx[m] = m_k + m;
-                }
-
-                fec_encode((const fec_t *)state, (gf **) src,
-                                (gf **) dst, dst_idx, m_n-m_k, ss);
+                encode_parity(out.get_data(i), ss);
         }
 
         return out;
@@ -244,6 +211,28 @@ audio_frame2 rs::encode(const audio_frame2 &in)
 #endif // defined HAVE_ZFEC
 }
 
+#ifdef HAVE_ZFEC
+/**
+ * Computes parity symbols of buffer containing m_k data symbols of size ss
+ * followed by space for m_n - m_k parity symbols.
+ *
+ * Uses zfec encoding matrix with our (SIMD) GF(2^8) region operations, which
+ * gives the same output as fec_encode().
+ */
+void rs::encode_parity(char *buf, int ss)
+{
+        const gf *enc_matrix = ((const fec_t *) state)->enc_matrix;
+        const uint8_t *src[MAX_K];
+        for (unsigned int k = 0; k < m_k; ++k) {
+                src[k] = (uint8_t *) buf + ss * k;
+        }
+        for (unsigned int m = m_k; m < m_n; ++m) {
+                gf256_region_lincomb((uint8_t *) buf + ss * m, src,
+                                enc_matrix + m * m_k, m_k, ss);
+        }
+}
+#endif // defined HAVE_ZFEC
+
 /**
  * Returns symbol size (?) for given headers len and with configured m_k
  */
@@ -254,9 +243,9 @@ int rs::get_ss(int hdr_len, int len) {
 /**
  * @returns stored buffer data length or 0 if first packet (header) is missing
  */
-uint32_t rs::get_buf_len(const char *buf, std::map<int, int> const & c_m)
+uint32_t rs::get_buf_len(const char *buf, const fec_ranges &ranges)
 {
-        if (auto it = c_m.find(0); it != c_m.end() && it->second >= 4) {
+        if (!ranges.empty() && ranges[0].first == 0 && ranges[0].second >= 4) {
                 uint32_t out_sz;
                 memcpy(&out_sz, buf, sizeof(out_sz));
                 return out_sz;
@@ -265,29 +254,15 @@ uint32_t rs::get_buf_len(const char *buf, std::map<int, int> const & c_m)
 }
 
 bool rs::decode(char *in, int in_len, char **out, int *len,
-                std::map<int, int> const & c_m)
+                const fec_ranges &m)
 {
-        std::map<int, int> m = c_m; // make private copy
         unsigned int ss = in_len / m_n;
 
-        // compact neighbouring segments
-        for (auto it = m.begin(); it != m.end(); ++it) {
-                int start = it->first;
-                int size = it->second;
-
-                auto neighbour = m.end();
-                while ((neighbour = m.find(start + size)) != m.end()) {
-                        it->second += neighbour->second;
-                        size = it->second;
-                        m.erase(neighbour);
-                }
-        }
-
+        // neighbouring segments are already compacted (normalized ranges)
         if (state == nullptr) { // zfec was not compiled in - dummy mode
-                *len = get_buf_len(in, c_m);
+                *len = get_buf_len(in, m);
                 *out = (char *) in + sizeof(uint32_t);
-                auto fst_sgmt = m.find(0);
-                return fst_sgmt != m.end() && (unsigned) fst_sgmt->second >= ss * m_k;
+                return !m.empty() && m[0].first == 0 && (unsigned) m[0].second >= ss * m_k;
         }
 
 #ifdef HAVE_ZFEC
@@ -375,32 +350,38 @@ bool rs::decode(char *in, int in_len, char **out, int *len,
         //fprintf(stderr, "       %d\n", i);
 
         if (i != m_k) {
-                *len = get_buf_len(in, c_m);
+                *len = get_buf_len(in, m);
                 *out = (char *) in + sizeof(uint32_t);
                 return false;
         }
 
-        char **output = (char **) malloc(m_k * sizeof(char *));
-        for (unsigned int i = 0; i < m_k; ++i) {
-                output[i] = (char *) malloc(ss);
-        }
-
-        fec_decode((const fec_t *) state, (const gf *const *) pkt,
-                        (gf *const *) output, index, ss);
-
-        i = 0;
-        for (unsigned int j = 0; j < m_k; ++j) {
-                if (repaired_slots.test(j)) {
-                        memcpy((void *) (in + j * ss), output[i], ss);
-                        i++;
+        if (repaired_slots.any()) {
+                // same as fec_decode() - rows of the encoding matrix of received
+                // symbols are inverted; missing symbols are written directly to
+                // their slots (they don't alias any of the input symbols)
+                const gf *enc_matrix = ((const fec_t *) state)->enc_matrix;
+                std::unique_ptr<uint8_t[]> dec_matrix(new uint8_t[m_k * m_k]());
+                for (unsigned int j = 0; j < m_k; ++j) {
+                        if (index[j] < m_k) {
+                                dec_matrix[j * m_k + j] = 1;
+                        } else {
+                                memcpy(&dec_matrix[j * m_k], enc_matrix + index[j] * m_k, m_k);
+                        }
+                }
+                if (gf256_invert_matrix(dec_matrix.get(), m_k) != 0) {
+                        *len = get_buf_len(in, m);
+                        *out = (char *) in + sizeof(uint32_t);
+                        return false;
+                }
+                for (unsigned int j = 0; j < m_k; ++j) {
+                        if (repaired_slots.test(j)) {
+                                gf256_region_lincomb((uint8_t *) in + j * ss,
+                                                (const uint8_t *const *) pkt,
+                                                &dec_matrix[j * m_k], m_k, ss);
+                        }
                 }
         }
 
-        for (unsigned int i = 0; i < m_k; ++i) {
-                free(output[i]);
-        }
-        free(output);
-
         uint32_t out_sz;
         memcpy(&out_sz, in, sizeof(out_sz));
         //fprintf(stderr, "       %d\n", out_sz);
@@ -39,7 +39,6 @@
 #define __RS_H__
 
 #include <cstdint>
-#include <map>
 #include <memory>
 
 #include "fec.h"
@@ -53,11 +52,12 @@ struct rs : public fec {
         std::shared_ptr<video_frame> encode(std::shared_ptr<video_frame> frame) override;
         virtual audio_frame2 encode(audio_frame2 const &) override;
         bool decode(char *in, int in_len, char **out, int *len,
-                const std::map<int, int> &) override;
+                const fec_ranges &) override;
 
 private:
         int get_ss(int hdr_len, int len);
-        uint32_t get_buf_len(const char *buf, std::map<int, int> const & c_m);
+        void encode_parity(char *buf, int ss);
+        uint32_t get_buf_len(const char *buf, const fec_ranges &ranges);
         void *state = nullptr;
         unsigned int m_k, m_n;
 };
@@ -77,7 +77,9 @@
 #endif // defined HAVE_CONFIG_H
 
 #include <errno.h>
+#include <pthread.h>
 #include <inttypes.h>
+#include <sched.h>
 #include <stdatomic.h>
 
 #include "memory.h"
@@ -89,9 +91,13 @@
 #include "crypto/md5.h"
 #include "ntp.h"
 #include "rtp.h"
+#include "rtp/pkt_pool.h"
+#include "rtp/rtp_types.h"
+#include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/net.h"
 #include "utils/random.h"
+#include "utils/thread.h"
 
 #undef max
 #undef min
@@ -140,6 +146,9 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
 #define RTCP_BYE  203
 #define RTCP_APP  204
 #define RTCP_RX   205
+#define RTCP_RTPFB 205 /* RFC 4585 transport layer feedback, shares PT with the (unused) legacy RX */
+#define RTCP_RTPFB_FMT_NACK 1
+#define RTCP_NACK_MAX_FCI 64
 
 typedef struct {
 #ifdef WORDS_BIGENDIAN
@@ -188,23 +197,14 @@ typedef struct {
         } r;
 } rtcp_t;
 
-typedef struct _rtcp_rr_wrapper {
-        struct _rtcp_rr_wrapper *next;
-        struct _rtcp_rr_wrapper *prev;
-        uint32_t reporter_ssrc;
-        rtcp_rr *rr;
-        rtcp_rx *rx;
-        time_ns_t ts;     /* Arrival time of this RR */
-} rtcp_rr_wrapper;
-
 /*
  * The RTP database contains source-specific information needed 
  * to make it all work. 
  */
 
 typedef struct _source {
-        struct _source *next;
-        struct _source *prev;
+        struct _source *next;   /* list of all sources in the session, used */
+        struct _source *prev;   /* for iteration (lookup uses session->db)  */
         uint32_t ssrc;
         char *sdes_cname;
         char *sdes_name;
@@ -217,9 +217,9 @@ typedef struct _source {
         rtcp_sr * _Atomic sr;
         uint32_t last_sr_sec;
         uint32_t last_sr_frac;
-        time_ns_t last_active;
+        _Atomic time_ns_t last_active;
         int should_advertise_sdes;      /* TRUE if this source is a CSRC which we need to advertise SDES for */
-        int sender;
+        _Atomic int sender;     /* set also by the data path, see source_set_sender() */
         int got_bye;            /* TRUE if we've received an RTCP bye from this source */
         uint32_t base_seq;
         uint16_t max_seq;
@@ -231,19 +231,26 @@ typedef struct _source {
         int probation;
         uint32_t jitter;
         uint32_t transit;
+        /* the reception statistics above (base_seq to transit) are written by */
+        /* the data path without the session lock, rx_gen is their seqlock   */
+        _Atomic uint32_t rx_gen;
+        uint32_t seq_inits;     /* init_seq() calls, written as the above      */
+        uint32_t seq_inits_seen; /* seq_inits when the priors were last reset */
+        rtcp_rr *rr;            /* Last reception report about us from this source */
+        rtcp_rx *rx;
+        time_ns_t rr_ts;        /* Arrival time of the rr */
         uint32_t magic;         /* For debugging... */
 } source;
 
-/* The size of the hash table used to hold the source database. */
-/* Should be large enough that we're unlikely to get collisions */
-/* when sources are added, but not too large that we waste too  */
-/* much memory. Sedgewick ("Algorithms", 2nd Ed, Addison-Wesley */
-/* 1988) suggests that this should be around 1/10th the number  */
-/* of entries that we expect to have in the database and should */
-/* be a prime number. Everything continues to work if this is   */
-/* too low, it just goes slower... for now we assume around 100 */
-/* participants is a sensible limit so we set this to 11.       */
-#define RTP_DB_SIZE	11
+/* The source database is an open addressing hash table (linear probing) */
+/* of pointers to the sources, which are additionally linked in a list to */
+/* allow cheap iteration and deletion while iterating. The table grows so */
+/* that it is at most half full, so the lookups remain O(1) even in large */
+/* conferences (eg. reflector with hundreds of participants).             */
+#define RTP_DB_INIT_SIZE 16
+
+/* Number of the sources cached for the data path (a power of 2) */
+#define RX_CACHE_SIZE 16
 
 /*
  *  Options for an RTP session are stored in the "options" struct.
@@ -256,6 +263,7 @@ typedef struct {
         int reuse_bufs;
         int record_source;
         int send_back;
+        struct rtp_pkt_pool *pkt_pool; ///< set by RTP_OPT_PACKET_POOL
 } options;
 
 /*
@@ -278,8 +286,9 @@ struct rtp {
         bool send_rtcp_to_origin; /* whether send RTCP reports to rtcp_dest */
         uint32_t my_ssrc;
         int last_advertised_csrc;
-        source *db[RTP_DB_SIZE];
-        rtcp_rr_wrapper rr[RTP_DB_SIZE][RTP_DB_SIZE];   /* Indexed by [hash(reporter)][hash(reportee)] */
+        source *db_head;        /* List of all sources */
+        source **db;            /* Hash table indexing db_head, NULL if empty */
+        uint32_t db_mask;       /* Size of db minus one (size is a power of 2) */
         options *opt;
         uint8_t *userdata;
         int invalid_rtp_count;
@@ -288,7 +297,7 @@ struct rtp {
         int csrc_count;
         int ssrc_count;
         int ssrc_count_prev;    /* ssrc_count at the time we last recalculated our RTCP interval */
-        int sender_count;
+        _Atomic int sender_count;
         int initial_rtcp;
         int sending_bye;        /* TRUE if we're in the process of sending a BYE packet */
         double avg_rtcp_size;
@@ -303,6 +312,7 @@ struct rtp {
         int sdes_count_sec;
         int sdes_count_ter;
         uint16_t rtp_seq;
+        struct rtp *stream_owner; ///< session whose RTP stream is sent (striping), NULL - own
         uint32_t rtp_pcount;
         uint32_t rtp_bcount;
         uint64_t rtp_bytes_sent;
@@ -331,9 +341,58 @@ struct rtp {
         rtp_callback callback;
         struct msghdr *mhdr;
         bool mt_recv; /* whether the receiver uses separate thread for receiving */
+        /* (report count << 8) | fraction lost of the last RR on our stream,
+         * written by RTCP receiving thread, read by the sender */
+        _Atomic uint32_t loss_report;
+        /* round-trip time from the last RR on our stream in 1/65536 s,
+         * 0 if not known; same access as loss_report */
+        _Atomic uint32_t rtt;
+        /* (report count << 16) | overload level (per mille of dropped frames)
+         * of the last "UGOL" APP report on our stream, same access as
+         * loss_report */
+        _Atomic uint32_t overload_report;
+        struct rtx_buffer *rtx; /* sent packets kept for retransmission, NULL if disabled */
+        /* RTCP handled by own thread, see rtp_ctrl_thread_start() */
+        bool ctrl_thread_running;
+        pthread_t ctrl_thread;
+        pthread_mutex_t ctrl_lock; /* source database while the thread runs, see rx_source_acquire() */
+        _Atomic bool ctrl_should_exit;
+        uint32_t (*ctrl_get_rtp_ts)(void);
+        /* events for the receiving thread, see rtp_member_event() */
+        struct ctrl_event *ctrl_events;
+        struct ctrl_event **ctrl_events_tail;
+        _Atomic bool ctrl_events_pending;
+        /* sources looked up by the data path indexed by SSRC, and a counter */
+        /* odd while it uses one, see rx_source_acquire()                    */
+        source * _Atomic rx_cache[RX_CACHE_SIZE];
+        _Atomic uint32_t rx_epoch;
         uint32_t magic;         /* For debugging...  */
 };
 
+/*
+ * Retransmission buffer (RFC 4588) - the payload of the last sent packets
+ * indexed by sequence number. Filled by the sending thread, read when
+ * processing a NACK in the RTCP receiving thread.
+ */
+struct rtx_packet {
+        uint16_t seq;
+        uint8_t pt;
+        uint8_t m;
+        uint32_t ts;
+        int len;
+        int alloc;
+        uint8_t *data;          /* payload header + payload */
+};
+
+struct rtx_buffer {
+        pthread_mutex_t lock;
+        int count;
+        struct rtx_packet *pkts;
+        uint16_t seq;           /* sequence number of the RTX stream */
+        long long retransmitted;
+        long long unavailable;
+};
+
 static inline int filter_event(struct rtp *session, uint32_t ssrc)
 {
         return session->opt->filter_my_packets
@@ -343,187 +402,92 @@ static inline int filter_event(struct rtp *session, uint32_t ssrc)
 static uint32_t next_csrc(struct rtp *session)
 {
         int cc = 0;
-        for (int chain = 0; chain < RTP_DB_SIZE; chain++) {
-                /* Check that the linked lists making up the chains in */
-                /* the hash table are correctly linked together...     */
-                for (source *s = session->db[chain]; s != NULL; s = s->next) {
-                        if (!s->should_advertise_sdes)
-                                continue;
-
-                        if (cc != session->last_advertised_csrc) {
-                                cc++;
-                                continue;
-                        }
+        for (source *s = session->db_head; s != NULL; s = s->next) {
+                if (!s->should_advertise_sdes)
+                        continue;
 
-                        session->last_advertised_csrc++;
-                        if (session->last_advertised_csrc == session->csrc_count) {
-                                session->last_advertised_csrc = 0;
-                        }
-                        /* This returns each source marked "should_advertise_sdes" in turn. */
-                        return s->ssrc;
+                if (cc != session->last_advertised_csrc) {
+                        cc++;
+                        continue;
+                }
+
+                session->last_advertised_csrc++;
+                if (session->last_advertised_csrc == session->csrc_count) {
+                        session->last_advertised_csrc = 0;
                 }
+                /* This returns each source marked "should_advertise_sdes" in turn. */
+                return s->ssrc;
         }
         /* We should never get here... */
         abort();
 }
 
-static inline int ssrc_hash(uint32_t ssrc)
+static inline uint32_t ssrc_hash(uint32_t ssrc)
 {
         /* Hash from an ssrc to a position in the source database.   */
-        /* Assumes that ssrc values are uniformly distributed, which */
-        /* should be true but probably isn't (Rosenberg has reported */
-        /* that many implementations generate ssrc values which are  */
-        /* not uniformly distributed over the space, and the H.323   */
-        /* spec requires that they are non-uniformly distributed).   */
-        /* This routine is written as a function rather than inline  */
-        /* code to allow it to be made smart in future: probably we  */
-        /* should run MD5 on the ssrc and derive a hash value from   */
-        /* that, to ensure it's more uniformly distributed?          */
-        return ssrc % RTP_DB_SIZE;
+        /* SSRC values should be uniformly distributed, but probably */
+        /* aren't (Rosenberg has reported that many implementations  */
+        /* generate ssrc values which are not uniformly distributed  */
+        /* over the space, and the H.323 spec requires that they are */
+        /* non-uniformly distributed), so the bits are mixed first   */
+        /* (finalizer of MurmurHash3) before masking the low bits.   */
+        ssrc ^= ssrc >> 16;
+        ssrc *= 0x85ebca6bU;
+        ssrc ^= ssrc >> 13;
+        ssrc *= 0xc2b2ae35U;
+        ssrc ^= ssrc >> 16;
+        return ssrc;
 }
 
-static void insert_rr(struct rtp *session, uint32_t reporter_ssrc, rtcp_rr * rr,
-                      rtcp_rx * rx)
+static void db_index_insert(source **db, uint32_t mask, source *s)
 {
-        /* Insert the reception report into the receiver report      */
-        /* database. This database is a two dimensional table of     */
-        /* rr_wrappers indexed by hashes of reporter_ssrc and        */
-        /* reportee_src.  The rr_wrappers in the database are        */
-        /* sentinels to reduce conditions in list operations.        */
-        /* The ts is used to determine when to timeout this rr.      */
-
-        rtcp_rr_wrapper *cur, *start;
-
-        start = &session->rr[ssrc_hash(reporter_ssrc)][ssrc_hash(rr->ssrc)];
-        cur = start->next;
-
-        while (cur != start) {
-                if (cur->reporter_ssrc == reporter_ssrc
-                    && cur->rr->ssrc == rr->ssrc) {
-                        /* Replace existing entry in the database  */
-                        free(cur->rr);
-                        if (cur->rx)
-                                free(cur->rx);
-                        cur->rr = rr;
-                        cur->rx = rx;
-                        cur->ts = get_time_in_ns();
-                        return;
-                }
-                cur = cur->next;
+        uint32_t i = ssrc_hash(s->ssrc) & mask;
+        while (db[i] != NULL) {
+                i = (i + 1) & mask;
         }
-
-        /* No entry in the database so create one now. */
-        cur = (rtcp_rr_wrapper *) malloc(sizeof(rtcp_rr_wrapper));
-        cur->reporter_ssrc = reporter_ssrc;
-        cur->rr = rr;
-        cur->rx = rx;
-        cur->ts = get_time_in_ns();
-        /* Fix links */
-        cur->next = start->next;
-        cur->next->prev = cur;
-        cur->prev = start;
-        cur->prev->next = cur;
-
-        debug_msg("Created new rr entry for 0x%08" PRIx32 " from source 0x%08" PRIx32 "\n",
-                  rr->ssrc, reporter_ssrc);
+        db[i] = s;
 }
 
-static void remove_rr(struct rtp *session, uint32_t ssrc)
+static bool db_grow(struct rtp *session)
 {
-        /* Remove any RRs from "s" which refer to "ssrc" as either   */
-        /* reporter or reportee.                                     */
-        rtcp_rr_wrapper *start, *cur, *tmp;
-        int i;
-
-        /* Remove rows, i.e. ssrc == reporter_ssrc                   */
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                start = &session->rr[ssrc_hash(ssrc)][i];
-                cur = start->next;
-                while (cur != start) {
-                        if (cur->reporter_ssrc == ssrc) {
-                                tmp = cur;
-                                cur = cur->prev;
-                                tmp->prev->next = tmp->next;
-                                tmp->next->prev = tmp->prev;
-                                free(tmp->rr);
-                                free(tmp);
-                        }
-                        cur = cur->next;
-                }
-        }
-
-        /* Remove columns, i.e.  ssrc == reporter_ssrc */
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                start = &session->rr[i][ssrc_hash(ssrc)];
-                cur = start->next;
-                while (cur != start) {
-                        if (cur->rr->ssrc == ssrc) {
-                                tmp = cur;
-                                cur = cur->prev;
-                                tmp->prev->next = tmp->next;
-                                tmp->next->prev = tmp->prev;
-                                free(tmp->rr);
-                                free(tmp);
-                        }
-                        cur = cur->next;
-                }
+        /* Rehash to a table of double size, the sources are taken from */
+        /* the list so the old table is not needed for that.            */
+        uint32_t size = session->db == NULL ? RTP_DB_INIT_SIZE : 2 * (session->db_mask + 1);
+        source **db = calloc(size, sizeof(source *));
+        if (db == NULL) {
+                return false;
         }
-}
-
-static void timeout_rr(struct rtp *session, time_ns_t curr_ts)
-{
-        /* Timeout any reception reports which have been in the database for more than 3 */
-        /* times the RTCP reporting interval without refresh.                            */
-        rtcp_rr_wrapper *start, *cur, *tmp;
-        rtp_event event;
-        int i, j;
-
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                for (j = 0; j < RTP_DB_SIZE; j++) {
-                        start = &session->rr[i][j];
-                        cur = start->next;
-                        while (cur != start) {
-                                if (curr_ts - cur->ts >
-                                    session->rtcp_interval * 3 * NS_IN_SEC) {
-                                        /* Signal the application... */
-                                        if (!filter_event
-                                            (session, cur->reporter_ssrc)) {
-                                                event.ssrc = cur->reporter_ssrc;
-                                                event.type = RR_TIMEOUT;
-                                                event.data = cur->rr;
-                                                session->callback(session,
-                                                                  &event);
-                                        }
-                                        /* Delete this reception report... */
-                                        tmp = cur;
-                                        cur = cur->prev;
-                                        tmp->prev->next = tmp->next;
-                                        tmp->next->prev = tmp->prev;
-                                        free(tmp->rr);
-                                        free(tmp);
-                                }
-                                cur = cur->next;
-                        }
-                }
+        for (source *s = session->db_head; s != NULL; s = s->next) {
+                db_index_insert(db, size - 1, s);
         }
+        free(session->db);
+        session->db = db;
+        session->db_mask = size - 1;
+        return true;
 }
 
-static const rtcp_rr *get_rr(struct rtp *session, uint32_t reporter_ssrc,
-                             uint32_t reportee_ssrc)
+static void db_index_remove(struct rtp *session, source *s)
 {
-        rtcp_rr_wrapper *cur, *start;
-
-        start =
-            &session->rr[ssrc_hash(reporter_ssrc)][ssrc_hash(reportee_ssrc)];
-        cur = start->next;
-        while (cur != start) {
-                if (cur->reporter_ssrc == reporter_ssrc &&
-                    cur->rr->ssrc == reportee_ssrc) {
-                        return cur->rr;
+        /* Linear probing with backward shift deletion, so there are no */
+        /* tombstones and the lookups don't degrade with the source churn. */
+        const uint32_t mask = session->db_mask;
+        uint32_t i = ssrc_hash(s->ssrc) & mask;
+        while (session->db[i] != s) {
+                assert(session->db[i] != NULL);
+                i = (i + 1) & mask;
+        }
+        session->db[i] = NULL;
+        for (uint32_t j = (i + 1) & mask; session->db[j] != NULL; j = (j + 1) & mask) {
+                uint32_t k = ssrc_hash(session->db[j]->ssrc) & mask;
+                /* Move the entry to the hole unless its home slot k lies */
+                /* cyclically in (i, j], ie. it is reachable without it.  */
+                if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+                        continue;
                 }
-                cur = cur->next;
+                session->db[i] = session->db[j];
+                session->db[j] = NULL;
+                i = j;
         }
-        return NULL;
 }
 
 static inline void check_source(source * s)
@@ -536,6 +500,20 @@ static inline void check_source(source * s)
 #endif
 }
 
+static source *db_lookup(struct rtp *session, uint32_t ssrc)
+{
+        if (session->db == NULL) {
+                return NULL;
+        }
+        for (uint32_t i = ssrc_hash(ssrc) & session->db_mask; session->db[i] != NULL;
+             i = (i + 1) & session->db_mask) {
+                if (session->db[i]->ssrc == ssrc) {
+                        return session->db[i];
+                }
+        }
+        return NULL;
+}
+
 static inline void check_database(struct rtp *session)
 {
         /* This routine performs a sanity check on the database. */
@@ -544,7 +522,6 @@ static inline void check_database(struct rtp *session)
 #if defined DEBUG && ! defined SUPPRESS_BUGS
         source *s;
         int source_count;
-        int chain;
 
         assert(session != NULL);
         assert(session->magic == 0xfeedface);
@@ -553,40 +530,40 @@ static inline void check_database(struct rtp *session)
         /* performed during initialisation whilst creating the */
         /* source entry for my_ssrc.                           */
         if (session->ssrc_count > 0) {
-                for (s = session->db[ssrc_hash(session->my_ssrc)]; s != NULL;
-                     s = s->next) {
-                        if (s->ssrc == session->my_ssrc) {
-                                break;
-                        }
-                }
-                assert(s != NULL);
+                assert(db_lookup(session, session->my_ssrc) != NULL);
         }
 
         source_count = 0;
-        for (chain = 0; chain < RTP_DB_SIZE; chain++) {
-                /* Check that the linked lists making up the chains in */
-                /* the hash table are correctly linked together...     */
-                for (s = session->db[chain]; s != NULL; s = s->next) {
-                        check_source(s);
-                        source_count++;
-                        if (s->prev == NULL) {
-                                assert(s == session->db[chain]);
-                        } else {
-                                assert(s->prev->next == s);
-                        }
-                        if (s->next != NULL) {
-                                assert(s->next->prev == s);
-                        }
-                        /* Check that the SR is for this source... */
-                        if (s->sr != NULL) {
-                                /// @bug Fails here presumably on race condition (when struct rtp used by 2 threads)
-                                assert(s->sr->ssrc == s->ssrc);
-                        }
+        /* Check that the list of the sources is correctly linked */
+        /* together and that all its members are in the table...  */
+        for (s = session->db_head; s != NULL; s = s->next) {
+                check_source(s);
+                source_count++;
+                if (s->prev == NULL) {
+                        assert(s == session->db_head);
+                } else {
+                        assert(s->prev->next == s);
+                }
+                if (s->next != NULL) {
+                        assert(s->next->prev == s);
+                }
+                assert(db_lookup(session, s->ssrc) == s);
+                /* Check that the SR is for this source... */
+                if (s->sr != NULL) {
+                        /// @bug Fails here presumably on race condition (when struct rtp used by 2 threads)
+                        assert(s->sr->ssrc == s->ssrc);
                 }
         }
         /* Check that the number of entries in the hash table  */
         /* matches session->ssrc_count                         */
         assert(source_count == session->ssrc_count);
+        if (session->db != NULL) {
+                source_count = 0;
+                for (uint32_t i = 0; i <= session->db_mask; ++i) {
+                        source_count += session->db[i] != NULL;
+                }
+                assert(source_count == session->ssrc_count);
+        }
 #else
         UNUSED(session);
 #endif
@@ -597,31 +574,183 @@ static inline source *get_source(struct rtp *session, uint32_t ssrc)
         source *s;
 
         check_database(session);
-        for (s = session->db[ssrc_hash(ssrc)]; s != NULL; s = s->next) {
-                if (s->ssrc == ssrc) {
-                        check_source(s);
-                        return s;
+        s = db_lookup(session, ssrc);
+        if (s != NULL) {
+                check_source(s);
+        }
+        return s;
+}
+
+static void free_rr(source *s)
+{
+        free(s->rr);
+        free(s->rx);
+        s->rr = NULL;
+        s->rx = NULL;
+}
+
+static void insert_rr(struct rtp *session, uint32_t reporter_ssrc, rtcp_rr * rr,
+                      rtcp_rx * rx)
+{
+        /* Insert the reception report into the receiver report      */
+        /* database. Only the reports about ourselves are kept (that */
+        /* is what rtp_get_rr() is used for), one per reporter in    */
+        /* its entry of the source database, so the storage grows    */
+        /* linearly with the number of participants. The reports     */
+        /* about third parties are available just to the callback.   */
+        /* The ts is used to determine when to timeout this rr.      */
+        source *s = get_source(session, reporter_ssrc);
+
+        if (s == NULL || rr->ssrc != session->my_ssrc) {
+                free(rr);
+                free(rx);
+                return;
+        }
+        if (s->rr == NULL) {
+                debug_msg("Created new rr entry for 0x%08" PRIx32 " from source 0x%08" PRIx32 "\n",
+                          rr->ssrc, reporter_ssrc);
+        }
+        free_rr(s);
+        s->rr = rr;
+        s->rx = rx;
+        s->rr_ts = get_time_in_ns();
+}
+
+static void timeout_rr(struct rtp *session, time_ns_t curr_ts)
+{
+        /* Timeout any reception reports which have been in the database for more than 3 */
+        /* times the RTCP reporting interval without refresh.                            */
+        rtp_event event;
+
+        for (source *s = session->db_head; s != NULL; s = s->next) {
+                if (s->rr == NULL ||
+                    curr_ts - s->rr_ts <= session->rtcp_interval * 3 * NS_IN_SEC) {
+                        continue;
                 }
+                /* Signal the application... */
+                if (!filter_event(session, s->ssrc)) {
+                        event.ssrc = s->ssrc;
+                        event.type = RR_TIMEOUT;
+                        event.data = s->rr;
+                        session->callback(session, &event);
+                }
+                /* Delete this reception report... */
+                free_rr(s);
+        }
+}
+
+static const rtcp_rr *get_rr(struct rtp *session, uint32_t reporter_ssrc,
+                             uint32_t reportee_ssrc)
+{
+        source *s = get_source(session, reporter_ssrc);
+
+        if (s != NULL && s->rr != NULL && s->rr->ssrc == reportee_ssrc) {
+                return s->rr;
         }
         return NULL;
 }
 
+/* see rtp_ctrl_thread_start(), no-op if the RTCP thread doesn't run */
+static inline void rtp_ctrl_lock(struct rtp *session)
+{
+        if (session->ctrl_thread_running) {
+                pthread_mutex_lock(&session->ctrl_lock);
+        }
+}
+
+static inline void rtp_ctrl_unlock(struct rtp *session)
+{
+        if (session->ctrl_thread_running) {
+                pthread_mutex_unlock(&session->ctrl_lock);
+        }
+}
+
+struct ctrl_event {
+        struct ctrl_event *next;
+        rtp_event event;
+        char data[];            /* copy of event.data */
+};
+
+/*
+ * Passes an event changing the participants (SOURCE_CREATED, SOURCE_DELETED,
+ * RX_SDES) to the application. While the RTCP thread runs, the events are
+ * queued (under ctrl_lock) and delivered by the receiving thread, so that the
+ * application's participant database is used by that thread only.
+ */
+static void rtp_member_event(struct rtp *session, rtp_event *e, size_t data_len)
+{
+        if (!session->ctrl_thread_running) {
+                session->callback(session, e);
+                return;
+        }
+        struct ctrl_event *ce = malloc(sizeof *ce + data_len);
+        ce->next = NULL;
+        ce->event = *e;
+        if (data_len > 0) {
+                memcpy(ce->data, e->data, data_len);
+                ce->event.data = ce->data;
+        }
+        *session->ctrl_events_tail = ce;
+        session->ctrl_events_tail = &ce->next;
+        session->ctrl_events_pending = true;
+}
+
+/* delivers the events queued by rtp_member_event(), receiving thread only */
+static void rtp_member_events_deliver(struct rtp *session)
+{
+        if (!session->ctrl_events_pending) {
+                return;
+        }
+        rtp_ctrl_lock(session);
+        struct ctrl_event *ce = session->ctrl_events;
+        session->ctrl_events = NULL;
+        session->ctrl_events_tail = &session->ctrl_events;
+        session->ctrl_events_pending = false;
+        rtp_ctrl_unlock(session);
+        while (ce != NULL) {
+                struct ctrl_event *next = ce->next;
+                session->callback(session, &ce->event);
+                free(ce);
+                ce = next;
+        }
+}
+
+/*
+ * Called by delete_source() before freeing s. The data path may have looked
+ * up s before it was removed from the database, in that case this waits
+ * until it is done with the packet (rx_source_release()).
+ */
+static void rx_source_retire(struct rtp *session, source *s)
+{
+        source *cached = s;
+        atomic_compare_exchange_strong(&session->rx_cache[s->ssrc & (RX_CACHE_SIZE - 1)],
+                                       &cached, NULL);
+        const uint32_t epoch = session->rx_epoch;
+        while (epoch % 2 == 1 && session->rx_epoch == epoch) {
+                sched_yield();
+        }
+}
+
 static source *really_create_source(struct rtp *session, uint32_t ssrc,
                                     int probation, source * s)
 {
         /* Create a new source entry, and add it to the database.    */
-        /* The database is a hash table, using the separate chaining */
-        /* algorithm.                                                */
+        /* The database is an open addressing hash table, which is   */
+        /* kept at most half full.                                   */
         rtp_event event;
-        int h;
 
         check_database(session);
+        if (2 * (session->ssrc_count + 1) > (int) session->db_mask + 1 || session->db == NULL) {
+                if (!db_grow(session)) {
+                        log_msg(LOG_LEVEL_ERROR, "[RTP] Cannot grow source database!\n");
+                        return NULL;
+                }
+        }
         /* This is a new source, we have to create it... */
-        h = ssrc_hash(ssrc);
         s = (source *) malloc(sizeof(source));
         memset(s, 0, sizeof(source));
         s->magic = 0xc001feed;
-        s->next = session->db[h];
+        s->next = session->db_head;
         s->ssrc = ssrc;
         if (probation) {
                 /* This is a probationary source, which only counts as */
@@ -633,10 +762,11 @@ static source *really_create_source(struct rtp *session, uint32_t ssrc,
 
         s->last_active = get_time_in_ns();
         /* Now, add it to the database... */
-        if (session->db[h] != NULL) {
-                session->db[h]->prev = s;
+        if (session->db_head != NULL) {
+                session->db_head->prev = s;
         }
-        session->db[ssrc_hash(ssrc)] = s;
+        session->db_head = s;
+        db_index_insert(session->db, session->db_mask, s);
         session->ssrc_count++;
         check_database(session);
 
@@ -649,7 +779,7 @@ static source *really_create_source(struct rtp *session, uint32_t ssrc,
                         event.ssrc = ssrc;
                         event.type = SOURCE_CREATED;
                         event.data = NULL;
-                        session->callback(session, &event);
+                        rtp_member_event(session, &event, 0);
                 }
         }
 
@@ -673,17 +803,16 @@ static void delete_source(struct rtp *session, uint32_t ssrc)
 {
         /* Remove a source from the RTP database... */
         source *s = get_source(session, ssrc);
-        int h = ssrc_hash(ssrc);
         rtp_event event;
         time_ns_t event_ts = get_time_in_ns();
 
         assert(s != NULL);      /* Deleting a source which doesn't exist is an error... */
 
         check_source(s);
-        check_database(session);
-        if (session->db[h] == s) {
-                /* It's the first entry in this chain... */
-                session->db[h] = s->next;
+        db_index_remove(session, s);
+        if (session->db_head == s) {
+                /* It's the first entry in the list... */
+                session->db_head = s->next;
                 if (s->next != NULL) {
                         s->next->prev = NULL;
                 }
@@ -713,8 +842,7 @@ static void delete_source(struct rtp *session, uint32_t ssrc)
                 free(s->sdes_priv);
         if (s->sr != NULL)
                 free(s->sr);
-
-        remove_rr(session, ssrc);
+        free_rr(s);
 
         /* Reduce our SSRC count, and perform reverse reconsideration on the RTCP */
         /* reporting interval (draft-ietf-avt-rtp-new-05.txt, section 6.3.4). To  */
@@ -755,12 +883,97 @@ static void delete_source(struct rtp *session, uint32_t ssrc)
                 event.ssrc = ssrc;
                 event.type = SOURCE_DELETED;
                 event.data = NULL;
-                session->callback(session, &event);
+                rtp_member_event(session, &event, 0);
         }
+        rx_source_retire(session, s);
         free(s);
         check_database(session);
 }
 
+/*
+ * The data path (rtp_process_data()) may run in other thread than the RTCP
+ * processing (see rtp_ctrl_thread_start()). It takes the session lock only to
+ * look up a source not in session->rx_cache and to change the database, the
+ * per-packet state shared with the RTCP side is updated as follows.
+ */
+
+static inline void source_set_sender(struct rtp *session, source *s)
+{
+        if (!s->sender && !atomic_exchange(&s->sender, TRUE)) {
+                session->sender_count++;
+        }
+}
+
+static inline void source_clear_sender(struct rtp *session, source *s)
+{
+        if (atomic_exchange(&s->sender, FALSE)) {
+                session->sender_count--;
+        }
+}
+
+/* the data path is the only writer of the reception statistics */
+static inline void source_rx_write_begin(source *s)
+{
+        atomic_store_explicit(&s->rx_gen, atomic_load_explicit(&s->rx_gen, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+}
+
+static inline void source_rx_write_end(source *s)
+{
+        atomic_store_explicit(&s->rx_gen, atomic_load_explicit(&s->rx_gen, memory_order_relaxed) + 1,
+                              memory_order_release);
+}
+
+struct source_rx_stats {
+        int extended_max;
+        int expected;
+        int received;
+        uint32_t jitter;
+        uint32_t seq_inits;
+};
+
+static void source_rx_snapshot(source *s, struct source_rx_stats *st)
+{
+        uint32_t gen;
+
+        do {
+                while ((gen = atomic_load_explicit(&s->rx_gen, memory_order_acquire)) % 2 == 1) {
+                        /* the writer is in the middle of an update */
+                }
+                st->extended_max = s->cycles + s->max_seq;
+                st->expected = st->extended_max - s->base_seq + 1;
+                st->received = s->received;
+                st->jitter = s->jitter;
+                st->seq_inits = s->seq_inits;
+                atomic_thread_fence(memory_order_acquire);
+        } while (atomic_load_explicit(&s->rx_gen, memory_order_relaxed) != gen);
+}
+
+/* Takes the statistics of s and returns the fraction lost since the last */
+/* call (RTCP side). Much of this is taken from A.3 of                   */
+/* draft-ietf-avt-rtp-new-01.txt                                         */
+static int source_fract_lost(source *s, struct source_rx_stats *st)
+{
+        source_rx_snapshot(s, st);
+        if (st->seq_inits != s->seq_inits_seen) {
+                /* init_seq() restarted the counting */
+                s->seq_inits_seen = st->seq_inits;
+                s->expected_prior = 0;
+                s->received_prior = 0;
+        }
+        int expected_interval = st->expected - s->expected_prior;
+        int received_interval = st->received - s->received_prior;
+        int lost_interval = expected_interval - received_interval;
+
+        s->expected_prior = st->expected;
+        s->received_prior = st->received;
+        if (expected_interval == 0 || lost_interval <= 0) {
+                return 0;
+        }
+        return (lost_interval << 8) / expected_interval;
+}
+
 static inline void init_seq(source * s, uint16_t seq)
 {
         /* Taken from draft-ietf-avt-rtp-new-01.txt */
@@ -770,8 +983,7 @@ static inline void init_seq(source * s, uint16_t seq)
         s->bad_seq = RTP_SEQ_MOD + 1;
         s->cycles = 0;
         s->received = 0;
-        s->received_prior = 0;
-        s->expected_prior = 0;
+        s->seq_inits++;         /* the priors are reset by source_fract_lost() */
 }
 
 static int update_seq(source * s, uint16_t seq)
@@ -1037,7 +1249,6 @@ struct rtp *rtp_init_if(const char *addr, const char *iface,
                         int force_ip_version, bool multithreaded)
 {
         struct rtp *session;
-        int i, j;
         char *cname;
         char *hname;
 
@@ -1066,7 +1277,7 @@ struct rtp *rtp_init_if(const char *addr, const char *iface,
         memset(session, 0, sizeof(struct rtp));
 
         session->magic = 0xfeedface;
-        session->opt = (options *) malloc(sizeof(options));
+        session->opt = (options *) calloc(1, sizeof(options));
         session->userdata = userdata;
         session->mt_recv = multithreaded;
         session->send_rtcp_to_origin =
@@ -1142,20 +1353,9 @@ struct rtp *rtp_init_if(const char *addr, const char *iface,
         /* Calculate when we're supposed to send our first RTCP packet... */
         session->next_rtcp_send_time += rtcp_interval(session) * NS_IN_SEC;
 
-        /* Initialise the source database... */
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                session->db[i] = NULL;
-        }
+        /* The source database is allocated with the first source... */
         session->last_advertised_csrc = 0;
 
-        /* Initialize sentinels in rr table */
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                for (j = 0; j < RTP_DB_SIZE; j++) {
-                        session->rr[i][j].next = &session->rr[i][j];
-                        session->rr[i][j].prev = &session->rr[i][j];
-                }
-        }
-
         /* Create a database entry for ourselves... */
         create_source(session, session->my_ssrc, FALSE);
         cname = get_cname(session->rtp_socket);
@@ -1172,7 +1372,6 @@ struct rtp *rtp_init_if(const char *addr, const char *iface,
 rtp_t rtp_init_with_udp_socket(struct socket_udp_local *l, struct sockaddr *sa, socklen_t len, rtp_callback callback)
 {
         struct rtp *session;
-        int i, j;
         char *cname;
         char *hname;
         int ttl = 127;        /*  FIXME */
@@ -1182,7 +1381,7 @@ rtp_t rtp_init_with_udp_socket(struct socket_udp_local *l, struct sockaddr *sa,
         memset(session, 0, sizeof(struct rtp));
 
         session->magic = 0xfeedface;
-        session->opt = (options *) malloc(sizeof(options));
+        session->opt = (options *) calloc(1, sizeof(options));
         // socket is not designated to receiving
         session->userdata = 0;
         session->mt_recv = false;
@@ -1234,20 +1433,9 @@ rtp_t rtp_init_with_udp_socket(struct socket_udp_local *l, struct sockaddr *sa,
         /* Calculate when we're supposed to send our first RTCP packet... */
         session->next_rtcp_send_time += NS_IN_SEC * rtcp_interval(session);
 
-        /* Initialise the source database... */
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                session->db[i] = NULL;
-        }
+        /* The source database is allocated with the first source... */
         session->last_advertised_csrc = 0;
 
-        /* Initialize sentinels in rr table */
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                for (j = 0; j < RTP_DB_SIZE; j++) {
-                        session->rr[i][j].next = &session->rr[i][j];
-                        session->rr[i][j].prev = &session->rr[i][j];
-                }
-        }
-
         /* Create a database entry for ourselves... */
         create_source(session, session->my_ssrc, FALSE);
         cname = get_cname(session->rtp_socket);
@@ -1275,21 +1463,18 @@ rtp_t rtp_init_with_udp_socket(struct socket_udp_local *l, struct sockaddr *sa,
 bool rtp_set_my_ssrc(struct rtp *session, uint32_t ssrc)
 {
         source *s;
-        uint32_t h;
 
         if (session->ssrc_count != 1 && session->sender_count != 0) {
                 return false;
         }
         /* Remove existing source */
-        h = ssrc_hash(session->my_ssrc);
-        s = session->db[h];
-        session->db[h] = NULL;
+        s = get_source(session, session->my_ssrc);
+        db_index_remove(session, s);
         /* Fill in new ssrc       */
         session->my_ssrc = ssrc;
         s->ssrc = ssrc;
-        h = ssrc_hash(ssrc);
         /* Put source back        */
-        session->db[h] = s;
+        db_index_insert(session->db, session->db_mask, s);
         return true;
 }
 
@@ -1326,6 +1511,25 @@ bool rtp_set_option(struct rtp *session, rtp_option optname, int optval)
                         session->opt->record_source = TRUE;
                 }
                 break;
+        case RTP_OPT_RECV_BATCH:
+                return udp_set_recv_batch(session->rtp_socket, optval);
+        case RTP_OPT_PACKET_POOL:
+                if (optval && session->opt->pkt_pool == NULL) {
+                        session->opt->pkt_pool = rtp_pkt_pool_create(
+                            MAX(udp_get_recv_pkt_size(),
+                                RTP_MAX_PACKET_LEN +
+                                    sizeof(struct sockaddr_storage)));
+                } else if (!optval && session->opt->pkt_pool != NULL) {
+                        if (session->mt_recv) {
+                                udp_set_pkt_pool(session->rtp_socket, NULL);
+                        }
+                        rtp_pkt_pool_destroy(session->opt->pkt_pool);
+                        session->opt->pkt_pool = NULL;
+                }
+                if (session->mt_recv) {
+                        udp_set_pkt_pool(session->rtp_socket, session->opt->pkt_pool);
+                }
+                break;
         default:
                 debug_msg
                     ("Ignoring unknown option (%d) in call to rtp_set_option().\n",
@@ -1361,6 +1565,9 @@ bool rtp_get_option(struct rtp *session, rtp_option optname, int *optval)
         case RTP_OPT_REUSE_PACKET_BUFS:
                 *optval = session->opt->reuse_bufs;
                 break;
+        case RTP_OPT_PACKET_POOL:
+                *optval = session->opt->pkt_pool != NULL;
+                break;
         default:
                 *optval = 0;
                 debug_msg
@@ -1386,6 +1593,29 @@ uint8_t *rtp_get_userdata(struct rtp * session)
         return session->userdata;
 }
 
+/**
+ * Makes the session send the packets as a part of the owner's RTP stream -
+ * it takes over the owner's SSRC and the sequence numbers, statistics and
+ * retransmission history are shared. Used to stripe one stream over multiple
+ * links, the receiver sees them as a single (slightly reordered) stream.
+ *
+ * The stripe does not send RTCP by itself, report of the owner covers it. It
+ * may be called repeatedly (eg. when the owner session was recreated).
+ */
+bool rtp_set_stream_owner(struct rtp *session, struct rtp *owner)
+{
+        if (owner == session) {
+                session->stream_owner = NULL;
+                return true;
+        }
+        if (session->my_ssrc != owner->my_ssrc &&
+            !rtp_set_my_ssrc(session, owner->my_ssrc)) {
+                return false;
+        }
+        session->stream_owner = owner;
+        return true;
+}
+
 /**
  * rtp_my_ssrc:
  * @session: The RTP Session.
@@ -1467,34 +1697,97 @@ static void compute_loss_intervals(struct rtp *session, rtp_packet * packet)
 
 }
 
+/*
+ * Looks up (or creates if requested) the source of a data packet for the data
+ * path, which uses it until rx_source_release(). The sources are cached in
+ * session->rx_cache, so that the session lock is taken only on a miss.
+ */
+static source *rx_source_acquire(struct rtp *session, uint32_t ssrc, bool create,
+                                 int probation)
+{
+        source * _Atomic *slot = &session->rx_cache[ssrc & (RX_CACHE_SIZE - 1)];
+
+        session->rx_epoch++;
+        source *s = *slot;
+        if (s != NULL && s->ssrc == ssrc) {
+                if (create) {
+                        s->last_active = get_time_in_ns();
+                }
+                return s;
+        }
+        /* not in the cache - lock, but not while holding an odd epoch, */
+        /* which the RTCP thread may wait for with the lock held        */
+        session->rx_epoch++;
+        rtp_ctrl_lock(session);
+        s = create ? create_source(session, ssrc, probation) : get_source(session, ssrc);
+        if (s != NULL) {
+                *slot = s;
+        }
+        session->rx_epoch++;    /* still locked, so s cannot be deleted yet */
+        rtp_ctrl_unlock(session);
+        return s;
+}
+
+static inline void rx_source_release(struct rtp *session)
+{
+        session->rx_epoch++;
+}
+
+/* updates the reception statistics of s, returns false if the packet is to */
+/* be ignored (source on probation)                                         */
+static bool rx_source_update(struct rtp *session, uint32_t curr_rtp_ts,
+                             rtp_packet * packet, source * s)
+{
+        int d, transit;
+
+        source_rx_write_begin(s);
+        if (!session->opt->promiscuous_mode && s->probation == -1) {
+                s->probation = MIN_SEQUENTIAL;
+                s->max_seq = packet->seq - 1;
+        }
+        const bool accept = update_seq(s, packet->seq) || session->opt->promiscuous_mode;
+        if (accept) {
+                uint32_t arrival_ts = curr_rtp_ts;
+                if (packet->recv_time != 0) {
+                        // receive time rather than the one of the receiving loop
+                        // iteration so that the jitter doesn't include our scheduling
+                        arrival_ts = get_local_mediatime() -
+                                     (uint32_t) ((get_time_in_ns() - packet->recv_time) * 9 / 100000);
+                }
+                transit = arrival_ts - packet->ts;
+                d = transit - s->transit;
+                s->transit = transit;
+                if (d < 0) {
+                        d = -d;
+                }
+                s->jitter += d - ((s->jitter + 8) / 16);
+        }
+        source_rx_write_end(s);
+        if (accept) {
+                source_set_sender(session, s);
+        }
+        return accept;
+}
+
 static void
-process_rtp(struct rtp *session, uint32_t curr_rtp_ts, rtp_packet * packet,
-            source * s)
+process_rtp(struct rtp *session, rtp_packet * packet)
 {
-        int i, d, transit;
+        int i;
         rtp_event event;
 
         if (packet->cc > 0) {
+                rtp_ctrl_lock(session);
                 for (i = 0; i < packet->cc; i++) {
                         create_source(session, packet->csrc[i], FALSE);
                 }
-        }
-        /* Update the source database... */
-        if (s->sender == FALSE) {
-                s->sender = TRUE;
-                session->sender_count++;
+                rtp_ctrl_unlock(session);
         }
 
         if (session->tfrc_on)
                 compute_loss_intervals(session, packet);
 
-        transit = curr_rtp_ts - packet->ts;
-        d = transit - s->transit;
-        s->transit = transit;
-        if (d < 0) {
-                d = -d;
-        }
-        s->jitter += d - ((s->jitter + 8) / 16);
+        /* SOURCE_CREATED of a new source must precede its first packet */
+        rtp_member_events_deliver(session);
 
         /* Callback to the application to process the packet... */
         if (!filter_event(session, packet->ssrc)) {
@@ -1507,6 +1800,38 @@ process_rtp(struct rtp *session, uint32_t curr_rtp_ts, rtp_packet * packet,
         }
 }
 
+/**
+ * Restores the original packet from a RTX one (RFC 4588) and passes it to the
+ * application. RTX packets are not accounted to the RTP statistics of the
+ * source (they would be seen as duplicates/misordered otherwise).
+ */
+static void process_rtx(struct rtp *session, rtp_packet *packet)
+{
+        rtp_event event;
+
+        if (packet->data_len > RTP_RTX_OVERHEAD) {
+                const uint8_t *osn = (const uint8_t *) packet->data;
+                packet->seq = osn[0] << 8 | osn[1];
+                packet->pt = PT_RTX_ORIG(packet->pt);
+                packet->ssrc = RTP_RTX_SSRC(packet->ssrc);
+                packet->data += RTP_RTX_OVERHEAD;
+                packet->data_len -= RTP_RTX_OVERHEAD;
+                source *s = rx_source_acquire(session, packet->ssrc, false, FALSE);
+                rx_source_release(session);
+                rtp_member_events_deliver(session);
+                if (s != NULL && !filter_event(session, packet->ssrc)) {
+                        event.ssrc = packet->ssrc;
+                        event.type = RX_RTP;
+                        event.data = (void *)packet;    /* The callback function MUST free this! */
+                        session->callback(session, &event);
+                        return;
+                }
+        }
+        if (!session->opt->reuse_bufs) {
+                rtp_pkt_free(packet);
+        }
+}
+
 void rtp_set_recv_iov(struct rtp *session, struct msghdr *m)
 {
         session->mhdr = m;
@@ -1526,9 +1851,10 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
         if (session->mt_recv) {
                 buflen = udp_recv_data(session->rtp_socket, (char **) &packet);
                 buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
+                packet->recv_time = udp_recv_data_time((char *) packet);
         } else {
                 if (!session->opt->reuse_bufs || (packet == NULL)) {
-                        packet = (rtp_packet *) malloc(RTP_MAX_PACKET_LEN + (session->opt->record_source ? sizeof(struct sockaddr_storage) : 0));
+                        packet = (rtp_packet *) rtp_pkt_alloc(session->opt->pkt_pool, RTP_MAX_PACKET_LEN + (session->opt->record_source ? sizeof(struct sockaddr_storage) : 0));
                         buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
                 }
                 struct sockaddr_storage *sin = NULL;
@@ -1542,7 +1868,9 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
                                         RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
                                         (struct sockaddr *) sin, sin ? &addrlen : 0);
                 if (buflen <= 0) {
-                        free(packet);
+                        rtp_pkt_free(packet);
+                } else {
+                        packet->recv_time = get_time_in_ns();
                 }
         }
 
@@ -1621,34 +1949,23 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
                 packet->data += ((packet->extn_len + 1) * 4);
                 packet->data_len -= ((packet->extn_len + 1) * 4);
         }
+        if (PT_IS_RTX(packet->pt) && !session->tfrc_on) {
+                process_rtx(session, packet);
+                return;
+        }
         if (validate_rtp(session, packet, buflen, vlen)) {
-                source *s = NULL;
-
-                if (session->opt->wait_for_rtcp) {
-                        s = create_source(session, packet->ssrc, TRUE);
-                } else {
-                        s = get_source(session, packet->ssrc);
-                }
-                if (session->opt->promiscuous_mode) {
-                        if (s == NULL) {
-                                create_source(session, packet->ssrc,
-                                              FALSE);
-                                s = get_source(session, packet->ssrc);
-                        }
-                        update_seq(s, packet->seq);
-                        process_rtp(session, curr_rtp_ts, packet, s);
-                        return; /* We don't free "packet", that's done by the callback function... */
+                /* unknown sources are created if waiting for RTCP (as */
+                /* probationary) or in the promiscuous mode            */
+                source *s = rx_source_acquire(session, packet->ssrc,
+                                              session->opt->wait_for_rtcp || session->opt->promiscuous_mode,
+                                              session->opt->wait_for_rtcp);
+                const bool accept = s != NULL && rx_source_update(session, curr_rtp_ts, packet, s);
+                rx_source_release(session);
+                if (accept) {
+                        process_rtp(session, packet);
+                        return; /* we don't free "packet", that's done by the callback function... */
                 }
                 if (s != NULL) {
-                        if (s->probation == -1) {
-                                s->probation = MIN_SEQUENTIAL;
-                                s->max_seq = packet->seq - 1;
-                        }
-                        if (update_seq(s, packet->seq)) {
-                                process_rtp(session, curr_rtp_ts,
-                                            packet, s);
-                                return; /* we don't free "packet", that's done by the callback function... */
-                        }
                         /* This source is still on probation... */
                         debug_msg("RTP packet from probationary source ignored...\n");
                 } else {
@@ -1660,7 +1977,7 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
         }
 
         if (!session->opt->reuse_bufs) {
-                free(packet);
+                rtp_pkt_free(packet);
         }
 }
 
@@ -1886,6 +2203,19 @@ static void process_report_blocks(struct rtp *session, rtcp_t * packet,
                                 session->callback(session, &event);
                         }
 
+                        if (rr->ssrc == session->my_ssrc && ssrc != session->my_ssrc) {
+                                uint32_t cnt = (atomic_load_explicit(&session->loss_report, memory_order_relaxed) >> 8) + 1;
+                                if (rr->lsr != 0) {
+                                        uint32_t now_sec, now_frac;
+                                        ntp64_time(&now_sec, &now_frac);
+                                        uint32_t rtt = ntp64_to_ntp32(now_sec, now_frac) - rr->lsr - rr->dlsr;
+                                        if (rtt < 10 * 65536U) { // ignore nonsense (clock/report mismatch)
+                                                atomic_store_explicit(&session->rtt, rtt == 0 ? 1 : rtt, memory_order_relaxed);
+                                        }
+                                }
+                                atomic_store_explicit(&session->loss_report, cnt << 8 | rr->fract_lost, memory_order_relaxed);
+                        }
+
                         /* Store the RR for later use... */
                         insert_rr(session, ssrc, rr, rx);
                 }
@@ -1907,10 +2237,7 @@ static void process_rtcp_sr(struct rtp *session, rtcp_t * packet)
         }
 
         /* Mark as an active sender, if we get a sender report... */
-        if (s->sender == FALSE) {
-                s->sender = TRUE;
-                session->sender_count++;
-        }
+        source_set_sender(session, s);
 
         /* Process the SR... */
         sr = malloc(sizeof(rtcp_sr));
@@ -2020,8 +2347,7 @@ static void process_rtcp_sdes(struct rtp *session, rtcp_t * packet)
                                                 event.ssrc = sd->ssrc;
                                                 event.type = RX_SDES;
                                                 event.data = (void *)rsp;
-                                                session->callback(session,
-                                                                  &event);
+                                                rtp_member_event(session, &event, rsp->length + 2);
                                         }
                                 } else {
                                         debug_msg
@@ -2068,6 +2394,68 @@ static void process_rtcp_bye(struct rtp *session, rtcp_t * packet)
         }
 }
 
+static void rtx_retransmit(struct rtp *session, uint16_t seq)
+{
+        struct rtx_buffer *b = session->rtx;
+        uint8_t buffer[RTP_MAX_PACKET_LEN];
+
+        pthread_mutex_lock(&b->lock);
+        struct rtx_packet *p = &b->pkts[seq % b->count];
+        if (p->data == NULL || p->seq != seq) {
+                b->unavailable += 1;
+                pthread_mutex_unlock(&b->lock);
+                return;
+        }
+        /* RTX payload (RFC 4588) is the original sequence number followed */
+        /* by the original payload, the RTX stream has its own SSRC and PT. */
+        buffer[0] = 2 << 6;
+        buffer[1] = (uint8_t) (p->m << 7 | PT_RTX(p->pt));
+        uint16_t rtx_seq = htons(b->seq++);
+        uint32_t ts = htonl(p->ts);
+        uint32_t ssrc = htonl(RTP_RTX_SSRC(session->my_ssrc));
+        uint16_t osn = htons(seq);
+        memcpy(buffer + 2, &rtx_seq, sizeof rtx_seq);
+        memcpy(buffer + 4, &ts, sizeof ts);
+        memcpy(buffer + 8, &ssrc, sizeof ssrc);
+        memcpy(buffer + 12, &osn, sizeof osn);
+        memcpy(buffer + 12 + RTP_RTX_OVERHEAD, p->data, p->len);
+        const int len = 12 + RTP_RTX_OVERHEAD + p->len;
+        b->retransmitted += 1;
+        pthread_mutex_unlock(&b->lock);
+
+        if (udp_send(session->rtp_socket, (char *) buffer, len) == -1) {
+                log_msg(LOG_LEVEL_WARNING, "sending RTX packet: %s\n", ug_strerror(errno));
+        }
+}
+
+static void process_rtcp_nack(struct rtp *session, rtcp_t * packet)
+{
+        /* Generic NACK (RFC 4585, section 6.2.1) - sender SSRC, media */
+        /* source SSRC and list of PID (16 bit) + BLP (16 bit) items.  */
+        const uint32_t *words = (const uint32_t *)(const void *) &packet->r;
+        const int len = ntohs(packet->common.length); /* words after the header */
+
+        if (len < 2 || ntohl(words[1]) != session->my_ssrc) {
+                return;
+        }
+        if (session->rtx == NULL) {
+                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('N', 'A', 'C', 'K'), "Received NACK but retransmission is not "
+                                "enabled on this side (\"--param rtp-arq\").\n");
+                return;
+        }
+        for (int i = 2; i < len; ++i) {
+                const uint32_t fci = ntohl(words[i]);
+                const uint16_t pid = fci >> 16U;
+                const uint16_t blp = fci & 0xFFFFU;
+                rtx_retransmit(session, pid);
+                for (int j = 0; j < 16; ++j) {
+                        if (blp & (1U << j)) {
+                                rtx_retransmit(session, pid + j + 1);
+                        }
+                }
+        }
+}
+
 static void process_rtcp_app(struct rtp *session, rtcp_t * packet)
 {
         uint32_t ssrc;
@@ -2102,6 +2490,18 @@ static void process_rtcp_app(struct rtp *session, rtcp_t * packet)
         data_len = (app->length - 2) * 4;
         memcpy(app->data, packet->r.app.data, data_len);
 
+        if (memcmp(app->name, RTCP_APP_NAME_OVERLOAD, 4) == 0 && data_len >= 8) {
+                uint32_t media_ssrc;
+                uint32_t level;
+                memcpy(&media_ssrc, app->data, sizeof media_ssrc);
+                memcpy(&level, app->data + 4, sizeof level);
+                if (ntohl(media_ssrc) == session->my_ssrc) {
+                        uint32_t cnt = (atomic_load_explicit(&session->overload_report, memory_order_relaxed) >> 16) + 1;
+                        atomic_store_explicit(&session->overload_report, cnt << 16 | MIN(ntohl(level), 1000),
+                                        memory_order_relaxed);
+                }
+        }
+
         /* Callback to the application to process the app packet... */
         if (!filter_event(session, ssrc)) {
                 event.ssrc = ssrc;
@@ -2173,7 +2573,11 @@ static void rtp_process_ctrl(struct rtp *session, uint8_t * buffer, int buflen)
                                         }
                                         process_rtcp_rr(session, packet);
                                         break;
-                                case RTCP_RX:
+                                case RTCP_RX: /* == RTCP_RTPFB */
+                                        if (packet->common.count == RTCP_RTPFB_FMT_NACK && !session->tfrc_on) {
+                                                process_rtcp_nack(session, packet);
+                                                break;
+                                        }
                                         /* am not sending up a RX_RTCP_START... */
                                         process_rtcp_rx(session, packet);
                                         if (session->tfrc_on) {
@@ -2322,7 +2726,8 @@ bool rtp_recv(struct rtp *session, struct timeval *timeout, uint32_t curr_rtp_ts
  * Reentrant variant of rtp_recv()
  *
  * Currently, this function is the only one of rtp_recv family eligible for multithreaded
- * receiving.
+ * receiving. If the RTCP thread runs (rtp_ctrl_thread_start()), only RTP
+ * packets are received and the events queued by the thread are delivered.
  *
  * @param session     the session pointer (returned by rtp_init())
  * @param timeout     the amount of time that rtcp_recv() is allowed to block
@@ -2337,12 +2742,16 @@ bool rtp_recv_r(struct rtp *session, struct timeval *timeout, uint32_t curr_rtp_
         struct udp_fd_r fd;
         
         check_database(session);
+        rtp_member_events_deliver(session);
         if (session->mt_recv) {
                 bool ret = false;
                 if (udp_not_empty(session->rtp_socket, timeout)) {
                         rtp_recv_data(session, curr_rtp_ts);
                         ret = true;
                 }
+                if (session->ctrl_thread_running) {
+                        return ret;
+                }
                 udp_fd_zero_r(&fd);
                 udp_fd_set_r(session->rtcp_socket, &fd);
                 struct timeval no_wait_tv = { .tv_sec = 0, .tv_usec = 0 };
@@ -2362,12 +2771,14 @@ bool rtp_recv_r(struct rtp *session, struct timeval *timeout, uint32_t curr_rtp_
         } else {
                 udp_fd_zero_r(&fd);
                 udp_fd_set_r(session->rtp_socket, &fd);
-                udp_fd_set_r(session->rtcp_socket, &fd);
+                if (!session->ctrl_thread_running) {
+                        udp_fd_set_r(session->rtcp_socket, &fd);
+                }
                 if (udp_select_r(timeout, &fd) > 0) {
                         if (udp_fd_isset_r(session->rtp_socket, &fd)) {
                                 rtp_recv_data(session, curr_rtp_ts);
                         }
-                        if (udp_fd_isset_r(session->rtcp_socket, &fd)) {
+                        if (!session->ctrl_thread_running && udp_fd_isset_r(session->rtcp_socket, &fd)) {
                                 uint8_t buffer[RTP_MAX_PACKET_LEN];
                                 int buflen;
                                 session->rtcp_dest_len = sizeof(session->rtcp_dest);
@@ -2385,6 +2796,18 @@ bool rtp_recv_r(struct rtp *session, struct timeval *timeout, uint32_t curr_rtp_
         return false;
 }
 
+/**
+ * Makes rtp_recv_r() waiting in another thread return immediately (or the
+ * next call if none is waiting). Effective only for multithreaded receiving,
+ * otherwise rtp_recv_r() returns after its timeout.
+ */
+void rtp_recv_wake(struct rtp *session)
+{
+        if (session->mt_recv) {
+                udp_wake(session->rtp_socket);
+        }
+}
+
 /**
  * Similar to rtp_recv_r(), expect that it only receives data from RTCP socket.
  * This should be used when the socket acts as a sender only, therefore
@@ -2418,6 +2841,94 @@ bool rtcp_recv_r(struct rtp *session, struct timeval *timeout, uint32_t curr_rtp
         return false;
 }
 
+static void *rtp_ctrl_thread(void *arg)
+{
+        struct rtp *session = arg;
+        uint8_t buffer[RTP_MAX_PACKET_LEN];
+
+        set_thread_name("rtcp");
+        while (!session->ctrl_should_exit) {
+                /* the exit flag is checked at least every 100 ms, RTCP
+                 * reports are scheduled with the same granularity */
+                struct timeval timeout = { .tv_sec = 0, .tv_usec = 100000 };
+                struct udp_fd_r fd;
+                udp_fd_zero_r(&fd);
+                udp_fd_set_r(session->rtcp_socket, &fd);
+                const bool readable = udp_select_r(&timeout, &fd) > 0 &&
+                                      udp_fd_isset_r(session->rtcp_socket, &fd);
+
+                while (readable) {
+                        session->rtcp_dest_len = sizeof(session->rtcp_dest);
+                        int buflen = udp_recvfrom(session->rtcp_socket, (char *) buffer,
+                                        RTP_MAX_PACKET_LEN,
+                                        (struct sockaddr *) &session->rtcp_dest, &session->rtcp_dest_len);
+                        if (buflen <= 0) {
+                                break;
+                        }
+                        pthread_mutex_lock(&session->ctrl_lock);
+                        rtp_process_ctrl(session, buffer, buflen);
+                        pthread_mutex_unlock(&session->ctrl_lock);
+                        struct timeval no_wait = { 0, 0 };
+                        udp_fd_zero_r(&fd);
+                        udp_fd_set_r(session->rtcp_socket, &fd);
+                        if (udp_select_r(&no_wait, &fd) <= 0) {
+                                break;
+                        }
+                }
+                const time_ns_t curr_time = get_time_in_ns();
+                pthread_mutex_lock(&session->ctrl_lock);
+                rtp_update(session, curr_time);
+                rtp_send_ctrl(session, session->ctrl_get_rtp_ts(), NULL, curr_time);
+                pthread_mutex_unlock(&session->ctrl_lock);
+        }
+        return NULL;
+}
+
+/**
+ * Moves the RTCP processing of the session - receiving and processing the
+ * control packets, rtp_update() and rtp_send_ctrl() - to own thread, so that
+ * rtp_recv_r() handles RTP data only. The events changing the participants
+ * (SOURCE_CREATED, SOURCE_DELETED, RX_SDES) are still passed to the callback
+ * by the receiving thread (from rtp_recv_r()), the other RTCP events are
+ * passed from the RTCP thread.
+ *
+ * Must be called from the thread calling rtp_recv_r().
+ *
+ * @param get_rtp_ts function returning current time in media timestamp units
+ *                   (used for SR)
+ */
+bool rtp_ctrl_thread_start(struct rtp *session, uint32_t (*get_rtp_ts)(void))
+{
+        if (session->ctrl_thread_running) {
+                return true;
+        }
+        session->ctrl_get_rtp_ts = get_rtp_ts;
+        session->ctrl_should_exit = false;
+        session->ctrl_events = NULL;
+        session->ctrl_events_tail = &session->ctrl_events;
+        pthread_mutex_init(&session->ctrl_lock, NULL);
+        session->ctrl_thread_running = true; // already checked by the thread
+        if (pthread_create(&session->ctrl_thread, NULL, rtp_ctrl_thread, session) != 0) {
+                log_msg(LOG_LEVEL_ERROR, "[RTP] Cannot create RTCP thread!\n");
+                session->ctrl_thread_running = false;
+                pthread_mutex_destroy(&session->ctrl_lock);
+                return false;
+        }
+        return true;
+}
+
+static void rtp_ctrl_thread_stop(struct rtp *session)
+{
+        if (!session->ctrl_thread_running) {
+                return;
+        }
+        session->ctrl_should_exit = true;
+        pthread_join(session->ctrl_thread, NULL);
+        session->ctrl_thread_running = false;
+        rtp_member_events_deliver(session);
+        pthread_mutex_destroy(&session->ctrl_lock);
+}
+
 /**
  * rtp_recv_poll_r:
  * The meaning is as above with except that this function polls for first
@@ -2696,7 +3207,9 @@ const rtcp_sr *rtp_get_sr(struct rtp *session, uint32_t ssrc)
  * @reportee: participant included in receiver report
  * 
  * Retrieve the latest receiver report on @reportee made by @reporter.
- * Provides an indication of other receivers reception service.
+ * Provides an indication of other receivers reception service. Only
+ * the reports about the own SSRC (rtp_my_ssrc()) are retained, the
+ * others are available just to the callback (RX_RR event).
  * 
  * Return value: A pointer to a rtcp_rr structure on success, NULL
  * otherwise.  The pointer must not be freed.
@@ -2708,6 +3221,60 @@ const rtcp_rr *rtp_get_rr(struct rtp *session, uint32_t reporter,
         return get_rr(session, reporter, reportee);
 }
 
+/**
+ * rtp_get_loss_report:
+ * @session: the session pointer (returned by rtp_init())
+ * @count: number of receiver reports on our stream received so far (wraps)
+ * @fract_lost: fraction lost (/256) from the last of the reports
+ *
+ * Thread-safe, can be called while another thread processes RTCP.
+ *
+ * Return value: false if no receiver report on our stream was received yet.
+ **/
+bool rtp_get_loss_report(struct rtp *session, uint32_t *count, uint8_t *fract_lost)
+{
+        uint32_t val = atomic_load_explicit(&session->loss_report, memory_order_relaxed);
+        *count = val >> 8;
+        *fract_lost = val & 0xFFU;
+        return *count != 0;
+}
+
+/**
+ * rtp_get_overload_report:
+ * @session: the session pointer (returned by rtp_init())
+ * @count: number of overload reports on our stream received so far (wraps)
+ * @level: per mille of frames the receiver dropped in the last report interval
+ *
+ * Thread-safe similarly to rtp_get_loss_report(), see rtp_send_overload_report().
+ *
+ * Return value: false if no overload report on our stream was received yet.
+ **/
+bool rtp_get_overload_report(struct rtp *session, uint32_t *count, int *level)
+{
+        uint32_t val = atomic_load_explicit(&session->overload_report, memory_order_relaxed);
+        *count = val >> 16;
+        *level = val & 0xFFFFU;
+        return *count != 0;
+}
+
+/**
+ * rtp_get_rtt:
+ * @session: the session pointer (returned by rtp_init())
+ * @rtt_sec: round-trip time computed from the last receiver report on our stream
+ *
+ * Thread-safe similarly to rtp_get_loss_report(). RTT is stored together with
+ * the loss report, ie. it is current when the report count changes.
+ *
+ * Return value: false if RTT is not known (no report or the receiver didn't
+ * receive our SR yet).
+ **/
+bool rtp_get_rtt(struct rtp *session, double *rtt_sec)
+{
+        uint32_t val = atomic_load_explicit(&session->rtt, memory_order_relaxed);
+        *rtt_sec = val / 65536.0;
+        return val != 0;
+}
+
 /**
  * rtp_send_data:
  * @session: the session pointer (returned by rtp_init())
@@ -2745,6 +3312,31 @@ int rtp_send_data(struct rtp *session, uint32_t rtp_ts, char pt, int m,
                                  data, data_len, extn, extn_len, extn_type);
 }
 
+static void rtx_store(struct rtx_buffer *b, uint16_t seq, uint8_t pt, int m, uint32_t ts,
+                      const char *phdr, int phdr_len, const char *data, int data_len)
+{
+        pthread_mutex_lock(&b->lock);
+        struct rtx_packet *p = &b->pkts[seq % b->count];
+        const int len = phdr_len + data_len;
+        if (p->alloc < len) {
+                free(p->data);
+                p->data = malloc(len);
+                p->alloc = len;
+        }
+        p->seq = seq;
+        p->pt = pt;
+        p->m = m;
+        p->ts = ts;
+        p->len = len;
+        if (phdr_len > 0) {
+                memcpy(p->data, phdr, phdr_len);
+        }
+        if (data_len > 0) {
+                memcpy(p->data + phdr_len, data, data_len);
+        }
+        pthread_mutex_unlock(&b->lock);
+}
+
 int
 rtp_send_data_hdr(struct rtp *session,
                   uint32_t rtp_ts, char pt, int m,
@@ -2809,14 +3401,18 @@ rtp_send_data_hdr(struct rtp *session,
         /* Allocate memory for the packet... */
         assert(buffer_len < RTP_MAX_PACKET_LEN);
         /* we dont always need 20 (12|16) but this seems to work. LG */
+        /* (more with the header extension) */
 #ifdef _WIN32
-        d = (uint8_t *) malloc(3 * sizeof(WSABUF) + 20 + RTP_PACKET_HEADER_SIZE);
+        d = (uint8_t *) malloc(3 * sizeof(WSABUF) + MAX(buffer_len, 20) + RTP_PACKET_HEADER_SIZE);
         send_vector = d;
         buffer = (uint8_t *) d + 3 * sizeof(WSABUF);
 #else
-        d = buffer = (uint8_t *) malloc(20 + RTP_PACKET_HEADER_SIZE);
+        d = buffer = (uint8_t *) malloc(MAX(buffer_len, 20) + RTP_PACKET_HEADER_SIZE);
 #endif
         packet = (rtp_packet *)(void *) buffer;
+        if (extn != NULL) {
+                packet->extn = buffer + RTP_PACKET_HEADER_SIZE + vlen + (4 * cc);
+        }
 
 #ifdef _WIN32
         send_vector[0].buf = (char *) (buffer + RTP_PACKET_HEADER_SIZE);
@@ -2845,7 +3441,9 @@ rtp_send_data_hdr(struct rtp *session,
         packet->cc = cc;
         packet->m = m;
         packet->pt = pt;
-        packet->seq = htons(session->rtp_seq++);
+        // striped session - the packet continues the owner's stream
+        struct rtp *const stream = session->stream_owner != NULL ? session->stream_owner : session;
+        packet->seq = htons(stream->rtp_seq++);
         packet->ts = htonl(rtp_ts);
         packet->ssrc = htonl(session->my_ssrc);
 
@@ -2913,17 +3511,22 @@ rtp_send_data_hdr(struct rtp *session,
                                          buffer_len, initVec);
         }
 
+        if (stream->rtx != NULL) {
+                rtx_store(stream->rtx, ntohs(packet->seq), pt, m, rtp_ts,
+                          phdr, phdr_len, data, data_len);
+        }
+
         rc = udp_sendv(session->rtp_socket, send_vector, send_vector_len, d);
         if (rc == -1) {
                 log_msg(LOG_LEVEL_WARNING, "sending RTP packet: %s", ug_strerror(errno));
         }
 
         /* Update the RTCP statistics... */
-        session->we_sent = TRUE;
-        session->rtp_pcount += 1;
-        session->rtp_bcount += buffer_len;
-        session->rtp_bytes_sent += buffer_len + data_len;
-        session->last_rtp_send_time = get_time_in_ns();
+        stream->we_sent = TRUE;
+        stream->rtp_pcount += 1;
+        stream->rtp_bcount += buffer_len;
+        stream->rtp_bytes_sent += buffer_len + data_len;
+        stream->last_rtp_send_time = get_time_in_ns();
 
         check_database(session);
         return rc;
@@ -2933,73 +3536,48 @@ static int format_report_blocks(rtcp_rr * rrp, int remaining_length,
                                 struct rtp *session)
 {
         int nblocks = 0;
-        int h;
         source *s;
         uint32_t now_sec;
         uint32_t now_frac;
 
-        for (h = 0; h < RTP_DB_SIZE; h++) {
-                for (s = session->db[h]; s != NULL; s = s->next) {
-                        check_source(s);
-                        if ((nblocks == 31) || (remaining_length < 24)) {
-                                break;  /* Insufficient space for more report blocks... */
+        for (s = session->db_head; s != NULL; s = s->next) {
+                check_source(s);
+                if ((nblocks == 31) || (remaining_length < 24)) {
+                        break;  /* Insufficient space for more report blocks... */
+                }
+                if (s->sender) {
+                        struct source_rx_stats st;
+                        const int fraction = source_fract_lost(s, &st);
+                        uint32_t lsr;
+                        uint32_t dlsr;
+
+                        if (s->sr == NULL) {
+                                lsr = 0;
+                                dlsr = 0;
+                        } else {
+                                ntp64_time(&now_sec, &now_frac);
+                                lsr =
+                                    ntp64_to_ntp32(s->sr->ntp_sec,
+                                                   s->sr->ntp_frac);
+                                dlsr =
+                                    ntp64_to_ntp32(now_sec,
+                                                   now_frac) -
+                                    ntp64_to_ntp32(s->last_sr_sec,
+                                                   s->last_sr_frac);
                         }
-                        if (s->sender) {
-                                /* Much of this is taken from A.3 of draft-ietf-avt-rtp-new-01.txt */
-                                int extended_max = s->cycles + s->max_seq;
-                                int expected = extended_max - s->base_seq + 1;
-                                int lost = expected - s->received;
-                                int expected_interval =
-                                    expected - s->expected_prior;
-                                int received_interval =
-                                    s->received - s->received_prior;
-                                int lost_interval =
-                                    expected_interval - received_interval;
-                                int fraction;
-                                uint32_t lsr;
-                                uint32_t dlsr;
-
-                                //printf("lost_interval %d\n", lost_interval);
-                                s->expected_prior = expected;
-                                s->received_prior = s->received;
-                                if (expected_interval == 0
-                                    || lost_interval <= 0) {
-                                        fraction = 0;
-                                } else {
-                                        fraction =
-                                            (lost_interval << 8) /
-                                            expected_interval;
-                                }
-
-                                if (s->sr == NULL) {
-                                        lsr = 0;
-                                        dlsr = 0;
-                                } else {
-                                        ntp64_time(&now_sec, &now_frac);
-                                        lsr =
-                                            ntp64_to_ntp32(s->sr->ntp_sec,
-                                                           s->sr->ntp_frac);
-                                        dlsr =
-                                            ntp64_to_ntp32(now_sec,
-                                                           now_frac) -
-                                            ntp64_to_ntp32(s->last_sr_sec,
-                                                           s->last_sr_frac);
-                                }
-                                rrp->ssrc = htonl(s->ssrc);
-                                rrp->fract_lost = fraction;
-                                rrp->total_lost = lost & 0x00ffffff;
-                                rrp->last_seq = htonl(extended_max);
-                                rrp->jitter = htonl(s->jitter / 16);
-                                rrp->lsr = htonl(lsr);
-                                rrp->dlsr = htonl(dlsr);
-                                rrp++;
-                                remaining_length -= 24;
-                                nblocks++;
-                                s->sender = FALSE;
-                                session->sender_count--;
-                                if (session->sender_count == 0) {
-                                        break;  /* No point continuing, since we've reported on all senders... */
-                                }
+                        rrp->ssrc = htonl(s->ssrc);
+                        rrp->fract_lost = fraction;
+                        rrp->total_lost = (st.expected - st.received) & 0x00ffffff;
+                        rrp->last_seq = htonl(st.extended_max);
+                        rrp->jitter = htonl(st.jitter / 16);
+                        rrp->lsr = htonl(lsr);
+                        rrp->dlsr = htonl(dlsr);
+                        rrp++;
+                        remaining_length -= 24;
+                        nblocks++;
+                        source_clear_sender(session, s);
+                        if (session->sender_count == 0) {
+                                break;  /* No point continuing, since we've reported on all senders... */
                         }
                 }
         }
@@ -3412,7 +3990,6 @@ void rtp_send_ctrl(struct rtp *session, uint32_t rtp_ts,
         if (curr_time > session->next_rtcp_send_time) {
                 /* The RTCP transmission timer has expired. The following */
                 /* implements draft-ietf-avt-rtp-new-02.txt section 6.3.6 */
-                int h;
                 source *s;
                 double new_interval =
                     rtcp_interval(session) / (session->csrc_count + 1);
@@ -3425,12 +4002,9 @@ void rtp_send_ctrl(struct rtp *session, uint32_t rtp_ts,
                                                          1)) * NS_IN_SEC;
                         /* We're starting a new RTCP reporting interval, zero out */
                         /* the per-interval statistics.                           */
-                        session->sender_count = 0;
-                        for (h = 0; h < RTP_DB_SIZE; h++) {
-                                for (s = session->db[h]; s != NULL; s = s->next) {
-                                        check_source(s);
-                                        s->sender = FALSE;
-                                }
+                        for (s = session->db_head; s != NULL; s = s->next) {
+                                check_source(s);
+                                source_clear_sender(session, s);
                         }
                 } else {
                         session->next_rtcp_send_time = new_send_time;
@@ -3453,7 +4027,6 @@ void rtp_send_ctrl(struct rtp *session, uint32_t rtp_ts,
 void rtp_update(struct rtp *session, time_ns_t curr_time)
 {
         /* Perform housekeeping on the source database... */
-        int h;
         source *s, *n;
 
         if (curr_time - session->last_update < 1 * NS_IN_SEC) {
@@ -3470,47 +4043,43 @@ void rtp_update(struct rtp *session, time_ns_t curr_time)
 
         check_database(session);
 
-        for (h = 0; h < RTP_DB_SIZE; h++) {
-                for (s = session->db[h]; s != NULL; s = n) {
-                        check_source(s);
-                        n = s->next;
-                        /* Expire sources which haven't been heard from for a int time.   */
-                        /* Section 6.2.1 of the RTP specification details the timers used. */
-
-                        /* How int since we last heard from this source?  */
-                        delay = curr_time - s->last_active;
-
-                        /* Check if we've received a BYE packet from this source.    */
-                        /* If we have, and it was received more than 2 seconds ago   */
-                        /* then the source is deleted. The arbitrary 2 second delay  */
-                        /* is to ensure that all delayed packets are received before */
-                        /* the source is timed out.                                  */
-                        if (s->got_bye && (delay > 2 * NS_IN_SEC)) {
-                                debug_msg
-                                    ("Deleting source 0x%08" PRIx32 " due to reception of BYE %f seconds ago...\n",
-                                     s->ssrc, (double) delay / NS_IN_SEC);
-                                delete_source(session, s->ssrc);
-                        }
+        for (s = session->db_head; s != NULL; s = n) {
+                check_source(s);
+                n = s->next;
+                /* Expire sources which haven't been heard from for a int time.   */
+                /* Section 6.2.1 of the RTP specification details the timers used. */
+
+                /* How int since we last heard from this source?  */
+                delay = curr_time - s->last_active;
+
+                /* Check if we've received a BYE packet from this source.    */
+                /* If we have, and it was received more than 2 seconds ago   */
+                /* then the source is deleted. The arbitrary 2 second delay  */
+                /* is to ensure that all delayed packets are received before */
+                /* the source is timed out.                                  */
+                if (s->got_bye && (delay > 2 * NS_IN_SEC)) {
+                        debug_msg
+                            ("Deleting source 0x%08" PRIx32 " due to reception of BYE %f seconds ago...\n",
+                             s->ssrc, (double) delay / NS_IN_SEC);
+                        delete_source(session, s->ssrc);
+                        continue;
+                }
 
-                        /* Sources are marked as inactive if they haven't been heard */
-                        /* from for more than 2 intervals (RTP section 6.3.5)        */
-                        if ((s->ssrc != rtp_my_ssrc(session))
-                            && (delay > (session->rtcp_interval * 2 * NS_IN_SEC))) {
-                                if (s->sender) {
-                                        s->sender = FALSE;
-                                        session->sender_count--;
-                                }
-                        }
+                /* Sources are marked as inactive if they haven't been heard */
+                /* from for more than 2 intervals (RTP section 6.3.5)        */
+                if ((s->ssrc != rtp_my_ssrc(session))
+                    && (delay > (session->rtcp_interval * 2 * NS_IN_SEC))) {
+                        source_clear_sender(session, s);
+                }
 
-                        /* If a source hasn't been heard from for more than 5 RTCP   */
-                        /* reporting intervals, we delete it from our database...    */
-                        if ((s->ssrc != rtp_my_ssrc(session))
-                            && (delay > (session->rtcp_interval * 5 * NS_IN_SEC))) {
-                                debug_msg
-                                    ("Deleting source 0x%08" PRIx32 " due to timeout...\n",
-                                     s->ssrc);
-                                delete_source(session, s->ssrc);
-                        }
+                /* If a source hasn't been heard from for more than 5 RTCP   */
+                /* reporting intervals, we delete it from our database...    */
+                if ((s->ssrc != rtp_my_ssrc(session))
+                    && (delay > (session->rtcp_interval * 5 * NS_IN_SEC))) {
+                        debug_msg
+                            ("Deleting source 0x%08" PRIx32 " due to timeout...\n",
+                             s->ssrc);
+                        delete_source(session, s->ssrc);
                 }
         }
 
@@ -3598,6 +4167,7 @@ void rtp_send_bye(struct rtp *session)
         int buflen;
         double new_interval;
 
+        rtp_ctrl_thread_stop(session);
         check_database(session);
 
         /* "...a participant which never sent an RTP or RTCP packet MUST NOT send  */
@@ -3675,21 +4245,19 @@ void rtp_done(struct rtp *session)
         int i;
         source *s, *n;
 
+        rtp_ctrl_thread_stop(session);
         check_database(session);
         /* In delete_source, check database gets called and this assumes */
         /* first added and last removed is us.                           */
-        for (i = 0; i < RTP_DB_SIZE; i++) {
-                s = session->db[i];
-                while (s != NULL) {
-                        n = s->next;
-                        if (s->ssrc != session->my_ssrc) {
-                                delete_source(session, session->db[i]->ssrc);
-                        }
-                        s = n;
+        for (s = session->db_head; s != NULL; s = n) {
+                n = s->next;
+                if (s->ssrc != session->my_ssrc) {
+                        delete_source(session, s->ssrc);
                 }
         }
 
         delete_source(session, session->my_ssrc);
+        free(session->db);
 
         /*
          * Introduce a memory leak until we add algorithm-specific
@@ -3699,8 +4267,20 @@ void rtp_done(struct rtp *session)
          }
          */
 
+        if (session->rtx != NULL) {
+                log_msg(LOG_LEVEL_VERBOSE, "[RTP] Retransmitted %lld packets, %lld requested packets were no longer available.\n",
+                        session->rtx->retransmitted, session->rtx->unavailable);
+                for (i = 0; i < session->rtx->count; ++i) {
+                        free(session->rtx->pkts[i].data);
+                }
+                free(session->rtx->pkts);
+                pthread_mutex_destroy(&session->rtx->lock);
+                free(session->rtx);
+        }
+
         udp_exit(session->rtp_socket);
         udp_exit(session->rtcp_socket);
+        rtp_pkt_pool_destroy(session->opt->pkt_pool);
         free(session->opt);
         free(session);
 }
@@ -3943,6 +4523,13 @@ rtp_get_recv_buf(struct rtp *session)
         return udp_get_recv_buf(session->rtp_socket);
 }
 
+/// @copydoc udp_get_rx_drops
+void
+rtp_get_rx_drops(struct rtp *session, struct udp_rx_drops *drops)
+{
+        udp_get_rx_drops(session->rtp_socket, drops);
+}
+
 /**
  * Sets sender buffer size
  * @param session the RTP Session
@@ -3970,42 +4557,11 @@ uint64_t rtp_get_bytes_sent(struct rtp *session)
 
 int rtp_compute_fract_lost(struct rtp *session, uint32_t ssrc)
 {
-        int h;
-        source *s;
-
-        for (h = 0; h < RTP_DB_SIZE; h++) {
-                for (s = session->db[h]; s != NULL; s = s->next) {
-                        check_source(s);
-                        if (s->ssrc == ssrc) {
-                                /* Much of this is taken from A.3 of draft-ietf-avt-rtp-new-01.txt */
-                                int extended_max = s->cycles + s->max_seq;
-                                int expected = extended_max - s->base_seq + 1;
-                                //int lost = expected - s->received;
-                                int expected_interval =
-                                    expected - s->expected_prior;
-                                int received_interval =
-                                    s->received - s->received_prior;
-                                int lost_interval =
-                                    expected_interval - received_interval;
-                                int fraction;
-                                //uint32_t lsr;
-                                //uint32_t dlsr;
-
-                                //printf("lost_interval %d\n", lost_interval);
-                                s->expected_prior = expected;
-                                s->received_prior = s->received;
-                                if (expected_interval == 0
-                                    || lost_interval <= 0) {
-                                        fraction = 0;
-                                } else {
-                                        fraction =
-                                            (lost_interval << 8) /
-                                            expected_interval;
-                                }
+        source *s = get_source(session, ssrc);
 
-                                return fraction;
-                        }
-                }
+        if (s != NULL) {
+                struct source_rx_stats st;
+                return source_fract_lost(s, &st);
         }
         return 0;
 }
@@ -4021,11 +4577,204 @@ bool rtp_is_ipv6(struct rtp *session)
         return udp_is_ipv6(session->rtp_socket);
 }
 
+bool rtp_enable_txtime(struct rtp *session)
+{
+        return udp_enable_txtime(session->rtp_socket);
+}
+
+void rtp_set_next_txtime(struct rtp *session, uint64_t txtime)
+{
+        udp_set_next_txtime(session->rtp_socket, txtime);
+}
+
+int rtp_get_txtime_errors(struct rtp *session)
+{
+        return udp_get_txtime_errors(session->rtp_socket);
+}
+
+int rtp_enable_pmtu_discovery(struct rtp *session, int max_mtu)
+{
+        return udp_enable_pmtu_discovery(session->rtp_socket, max_mtu);
+}
+
+int rtp_get_path_mtu(struct rtp *session)
+{
+        return udp_get_path_mtu(session->rtp_socket);
+}
+
+int rtp_get_send_backlog(struct rtp *session)
+{
+        return udp_get_send_backlog(session->rtp_socket);
+}
+
+bool rtp_enable_zerocopy(struct rtp *session)
+{
+        return udp_enable_zerocopy(session->rtp_socket);
+}
+
+bool rtp_zerocopy_enabled(struct rtp *session)
+{
+        return udp_zerocopy_enabled(session->rtp_socket);
+}
+
+void rtp_zerocopy_hold(struct rtp *session, void (*release)(void *), void *arg)
+{
+        udp_zerocopy_hold(session->rtp_socket, release, arg);
+}
+
+void rtp_zerocopy_wait(struct rtp *session)
+{
+        udp_zerocopy_wait(session->rtp_socket);
+}
+
+/**
+ * Keeps the last nr_packets sent packets to be retransmitted on request
+ * (RTCP generic NACK, RFC 4585) as a RTX stream (RFC 4588).
+ */
+bool rtp_enable_rtx(struct rtp *session, int nr_packets)
+{
+        if (session->rtx != NULL) {
+                return true;
+        }
+        if (session->encryption_enabled || session->tfrc_on || nr_packets <= 0) {
+                return false;
+        }
+        struct rtx_buffer *b = calloc(1, sizeof *b);
+        b->pkts = calloc(nr_packets, sizeof *b->pkts);
+        b->count = nr_packets;
+        b->seq = ug_rand();
+        pthread_mutex_init(&b->lock, NULL);
+        session->rtx = b;
+        return true;
+}
+
+/**
+ * @returns number of bytes by which the RTP payload should be shorter than
+ * the MTU allows, so that the packet can be retransmitted
+ */
+int rtp_get_rtx_overhead(struct rtp *session)
+{
+        return session->rtx != NULL ? RTP_RTX_OVERHEAD : 0;
+}
+
+/**
+ * Sends RTCP generic NACK (RFC 4585) requesting retransmission of the packets
+ * with given sequence numbers from the media source media_ssrc. The NACK is
+ * preceded by an empty RR to form a valid compound packet.
+ */
+bool rtp_send_nack(struct rtp *session, uint32_t media_ssrc, const uint16_t *seqs, int count)
+{
+        uint32_t buffer[2 + 3 + RTCP_NACK_MAX_FCI];
+        uint32_t fci[RTCP_NACK_MAX_FCI];
+        int fci_count = 0;
+
+        if (session->encryption_enabled) {
+                return false;
+        }
+        for (int i = 0; i < count; ++i) {
+                int j = 0;
+                for ( ; j < fci_count; ++j) {
+                        const uint16_t dist = seqs[i] - (fci[j] >> 16U);
+                        if (dist == 0) {
+                                break;
+                        }
+                        if (dist <= 16) {
+                                fci[j] |= 1U << (dist - 1);
+                                break;
+                        }
+                }
+                if (j == fci_count) {
+                        if (fci_count == RTCP_NACK_MAX_FCI) {
+                                break;
+                        }
+                        fci[fci_count++] = (uint32_t) seqs[i] << 16U;
+                }
+        }
+        if (fci_count == 0) {
+                return true;
+        }
+
+        rtcp_t *rr = (rtcp_t *)(void *) buffer;
+        rr->common.version = 2;
+        rr->common.p = 0;
+        rr->common.count = 0;
+        rr->common.pt = RTCP_RR;
+        rr->common.length = htons(1);
+        rr->r.rr.ssrc = htonl(session->my_ssrc);
+
+        rtcp_t *fb = (rtcp_t *)(void *) (buffer + 2);
+        fb->common.version = 2;
+        fb->common.p = 0;
+        fb->common.count = RTCP_RTPFB_FMT_NACK;
+        fb->common.pt = RTCP_RTPFB;
+        fb->common.length = htons(2 + fci_count);
+        buffer[3] = htonl(session->my_ssrc);
+        buffer[4] = htonl(media_ssrc);
+        for (int i = 0; i < fci_count; ++i) {
+                buffer[5 + i] = htonl(fci[i]);
+        }
+
+        rtcp_udp_send(session, (5 + fci_count) * sizeof(uint32_t), (char *) buffer);
+        return true;
+}
+
+/**
+ * Sends RTCP APP packet "UGOL" reporting that the receiver cannot keep up
+ * with the stream of media_ssrc - level is per mille of the frames it had to
+ * drop (0 - recovered). The data are media SSRC and level, both 32-bit. The
+ * packet is preceded by an empty RR to form a valid compound packet.
+ */
+bool rtp_send_overload_report(struct rtp *session, uint32_t media_ssrc, int level)
+{
+        uint32_t buffer[2 + 5];
+
+        if (session->encryption_enabled) {
+                return false;
+        }
+        // the buffer is shorter than rtcp_t so the headers are filled
+        // word by word: V=2, P=0, count/subtype, PT and length
+        buffer[0] = htonl(2U << 30 | RTCP_RR << 16 | 1);
+        buffer[1] = htonl(session->my_ssrc);
+        buffer[2] = htonl(2U << 30 | RTCP_APP << 16 | 4);
+        buffer[3] = htonl(session->my_ssrc);
+        memcpy(&buffer[4], RTCP_APP_NAME_OVERLOAD, 4);
+        buffer[5] = htonl(media_ssrc);
+        buffer[6] = htonl(MAX(0, MIN(level, 1000)));
+
+        rtcp_udp_send(session, sizeof buffer, (char *) buffer);
+        return true;
+}
+
+bool rtp_add_destination(struct rtp *session, const char *addr, uint16_t rtp_port, uint16_t rtcp_port)
+{
+        if (!udp_add_dest(session->rtp_socket, addr, rtp_port)) {
+                return false;
+        }
+        if (!udp_add_dest(session->rtcp_socket, addr, rtcp_port)) {
+                udp_remove_dest(session->rtp_socket, addr, rtp_port);
+                return false;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, "[RTP] Sending also to %s:%" PRIu16 " (%d destinations).\n",
+                        addr, rtp_port, udp_get_dest_count(session->rtp_socket) + 1);
+        return true;
+}
+
+bool rtp_remove_destination(struct rtp *session, const char *addr, uint16_t rtp_port, uint16_t rtcp_port)
+{
+        udp_remove_dest(session->rtcp_socket, addr, rtcp_port);
+        return udp_remove_dest(session->rtp_socket, addr, rtp_port);
+}
+
 void rtp_async_start(struct rtp *session, int nr_packets)
 {
        udp_async_start(session->rtp_socket, nr_packets);
 }
 
+void rtp_async_flush(struct rtp *session)
+{
+       udp_async_flush(session->rtp_socket);
+}
+
 void rtp_async_wait(struct rtp *session)
 {
        udp_async_wait(session->rtp_socket);
@@ -97,6 +97,7 @@ typedef struct __attribute__((packed)) {
 	uint32_t	*csrc;
 	char		*data;
 	int		 data_len;
+	int64_t		 recv_time;	/* get_time_in_ns() at reception, 0 unknown */
 	unsigned char	*extn;
 	uint16_t	 extn_len;	/* Size of the extension in 32 bit words minus one */
 	uint16_t	 extn_type;	/* Extension type field in the RTP packet header   */
@@ -235,6 +236,10 @@ typedef enum {
                                         /* end of the packet                                 */
 	RTP_OPT_SEND_BACK         = 7,  // Send to a receiver that is sending to us. Sets also
                                         // RTP_POT_RECORD_SOURCE
+	RTP_OPT_RECV_BATCH        = 8,  // Number of datagrams received at once by the reader
+                                        // thread (multithreaded session only, Linux)
+	RTP_OPT_PACKET_POOL       = 9,  // Allocate received packets from a per-session pool
+                                        // (see rtp/pkt_pool.h) instead of malloc()
 } rtp_option;
 
 struct socket_udp_local;
@@ -266,10 +271,12 @@ bool             rtp_recv(struct rtp *session,
                           struct timeval *timeout, uint32_t curr_rtp_ts) __attribute__((deprecated));
 bool             rtp_recv_r(struct rtp *session,
                           struct timeval *timeout, uint32_t curr_rtp_ts);
+void             rtp_recv_wake(struct rtp *session);
 bool             rtcp_recv_r(struct rtp *session,
                           struct timeval *timeout, uint32_t curr_rtp_ts);
 int 		 rtp_recv_poll_r(struct rtp **sessions, 
 			  struct timeval *timeout, uint32_t curr_rtp_ts);
+bool             rtp_ctrl_thread_start(struct rtp *session, uint32_t (*get_rtp_ts)(void));
 int 		 rtp_send_raw_rtp_data(struct rtp *session, char *buffer, int buffer_len);
 
 int 		 rtp_send_data(struct rtp *session, 
@@ -298,15 +305,29 @@ const char	*rtp_get_sdes(struct rtp *session, uint32_t ssrc, rtcp_sdes_type type
 
 const rtcp_sr	*rtp_get_sr(struct rtp *session, uint32_t ssrc);
 const rtcp_rr	*rtp_get_rr(struct rtp *session, uint32_t reporter, uint32_t reportee);
+bool             rtp_get_loss_report(struct rtp *session, uint32_t *count, uint8_t *fract_lost);
+bool             rtp_get_rtt(struct rtp *session, double *rtt_sec);
+
+/*
+ * Receiver overload feedback - the receiver reports the share of frames it
+ * drops because decoding or display cannot keep up (RTCP APP "UGOL"), the
+ * sender may then reduce the stream.
+ */
+#define RTCP_APP_NAME_OVERLOAD "UGOL"
+bool             rtp_send_overload_report(struct rtp *session, uint32_t media_ssrc, int level);
+bool             rtp_get_overload_report(struct rtp *session, uint32_t *count, int *level);
 
 bool             rtp_set_encryption_key(struct rtp *session, const char *passphrase);
 bool             rtp_set_my_ssrc(struct rtp *session, uint32_t ssrc);
+bool             rtp_set_stream_owner(struct rtp *session, struct rtp *owner);
 
 uint8_t		*rtp_get_userdata(struct rtp *session);
 void 		 rtp_set_recv_iov(struct rtp *session, struct msghdr *m);
 
 int              rtp_get_recv_buf(struct rtp *session);
 bool             rtp_set_recv_buf(struct rtp *session, int bufsize);
+struct udp_rx_drops;
+void             rtp_get_rx_drops(struct rtp *session, struct udp_rx_drops *drops);
 bool             rtp_set_send_buf(struct rtp *session, int bufsize);
 
 void             rtp_flush_recv_buf(struct rtp *session);
@@ -317,9 +338,59 @@ bool             rtp_is_ipv6(struct rtp *session);
 bool             rtp_has_receiver(struct rtp *session);
 
 /*
- * Async API - MSW specific
+ * Kernel-paced transmission (Linux SO_TXTIME) - departure time (CLOCK_MONOTONIC
+ * nanoseconds) set by rtp_set_next_txtime() applies to the next sent packet.
+ */
+bool             rtp_enable_txtime(struct rtp *session);
+void             rtp_set_next_txtime(struct rtp *session, uint64_t txtime);
+int              rtp_get_txtime_errors(struct rtp *session);
+
+/*
+ * Path MTU discovery - rtp_enable_pmtu_discovery() sets DF on the sent packets
+ * and probes the path to all destinations (blocking), returns the probed MTU
+ * (max. max_mtu) or -1; rtp_get_path_mtu() returns the current value as
+ * lowered by ICMP feedback.
+ */
+int              rtp_enable_pmtu_discovery(struct rtp *session, int max_mtu);
+int              rtp_get_path_mtu(struct rtp *session);
+/// @returns bytes waiting in the socket send queue, -1 if unknown
+int              rtp_get_send_backlog(struct rtp *session);
+
+/*
+ * Selective retransmission - the sender keeps the last sent packets and
+ * resends them as a RTX stream (RFC 4588) when requested by the receiver with
+ * rtp_send_nack() (RTCP generic NACK, RFC 4585).
+ */
+bool             rtp_enable_rtx(struct rtp *session, int nr_packets);
+int              rtp_get_rtx_overhead(struct rtp *session);
+bool             rtp_send_nack(struct rtp *session, uint32_t media_ssrc, const uint16_t *seqs, int count);
+
+/*
+ * Fan-out - sent RTP and RTCP packets are replicated to additional
+ * destinations (eg. RTSP clients). The packetization is done once, the copies
+ * are sent in the same batches as the packets for the primary destination.
+ * Must not be called concurrently with sending.
+ */
+bool             rtp_add_destination(struct rtp *session, const char *addr, uint16_t rtp_port, uint16_t rtcp_port);
+bool             rtp_remove_destination(struct rtp *session, const char *addr, uint16_t rtp_port, uint16_t rtcp_port);
+
+/*
+ * Zero-copy transmission (Linux MSG_ZEROCOPY) of packets sent with the async
+ * API. Data passed to rtp_send_data_hdr() must stay valid until the kernel
+ * completes the send - rtp_zerocopy_hold() calls release(arg) once all the
+ * packets sent so far are completed, rtp_zerocopy_wait() blocks until then.
+ */
+bool             rtp_enable_zerocopy(struct rtp *session);
+bool             rtp_zerocopy_enabled(struct rtp *session);
+void             rtp_zerocopy_hold(struct rtp *session, void (*release)(void *), void *arg);
+void             rtp_zerocopy_wait(struct rtp *session);
+
+/*
+ * Async API - MSW and Linux
  *
- * Using async API hugely improves performance.
+ * Using async API hugely improves performance. In MSW, overlapped I/O is used,
+ * in Linux the packets are queued and sent in batches with sendmmsg(). Queued
+ * packets can be sent out prior to rtp_async_wait() with rtp_async_flush().
  * Usage is simple - prior to sending a bulk of packets (eg. video frame), rtp_async_start()
  * is started. Then, all packets are sent as usual, exept that neither data nor headers should
  * be altered up to rtp_async_wait() call, which waits upon completition of async operations
@@ -327,6 +398,7 @@ bool             rtp_has_receiver(struct rtp *session);
  * more than nr_packet times.
  */
 void             rtp_async_start(struct rtp *session, int nr_packets);
+void             rtp_async_flush(struct rtp *session);
 void             rtp_async_wait(struct rtp *session);
 
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session);
@@ -69,6 +69,7 @@
 #include "video_codec.h"
 #include "ntp.h"
 #include "tv.h"
+#include "rtp/av_sync.h"
 #include "rtp/rtp.h"
 #include "rtp/pbuf.h"
 #include "rtp/rtp_callback.h"
@@ -213,16 +214,19 @@ void rtp_recv_callback(struct rtp *session, rtp_event * e)
         rtcp_app *pckt_app = (rtcp_app *) e->data;
         rtp_packet *pckt_rtp = (rtp_packet *) e->data;
         struct pdb *participants = (struct pdb *)rtp_get_userdata(session);
-        struct pdb_e *state = pdb_get(participants, e->ssrc);
 
         switch (e->type) {
-        case RX_RTP:
+        case RX_RTP: {
+                // RTCP events may come from the RTCP thread (rtp_ctrl_thread_start()),
+                // the participants are touched by the receiving thread only
+                struct pdb_e *state = pdb_get(participants, e->ssrc);
                 tfrc_recv_data(state->tfrc_state, get_time_in_ns(), pckt_rtp->seq,
                                pckt_rtp->data_len + 40);
                 if (pckt_rtp->data_len > 0) {   /* Only process packets that contain data... */
                         pbuf_insert(state->playout_buffer, pckt_rtp);
                 }
                 break;
+        }
         case RX_TFRC_RX:
                 /* compute TCP friendly data rate */
                 break;
@@ -230,8 +234,11 @@ void rtp_recv_callback(struct rtp *session, rtp_event * e)
                 break;
         case RX_RTCP_FINISH:
                 break;
-        case RX_SR:
+        case RX_SR: {
+                const rtcp_sr *sr = (const rtcp_sr *) e->data;
+                av_sync_put_sr(sr->ssrc, sr->ntp_sec, sr->ntp_frac, sr->rtp_ts);
                 break;
+        }
         case RX_RR:
                 process_rr(session, e);
                 break;
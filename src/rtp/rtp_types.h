@@ -71,9 +71,22 @@
 #define PT_ENCRYPT_VIDEO_RS   30
 #define PT_AUDIO_RS           35
 #define PT_ENCRYPT_AUDIO_RS   36
+#define PT_AUDIO_BUNDLE         37 ///< all channels in common packets, see audio_payload_hdr_t
+#define PT_ENCRYPT_AUDIO_BUNDLE 38
 #define PT_Unassign_Type95  95 /* reserved for future, backward compatible use with UG (metadata etc.) */
 #define PT_DynRTP_Type96    96 /* usually H.264 */
 #define PT_DynRTP_Type97    97 /* mU-law stereo amongst others */
+/*
+ * Retransmission (RTX, RFC 4588) of UltraGrid payload types uses fixed
+ * association of the PT (original + PT_RTX_OFFSET, 100-118) and the SSRC
+ * (RTP_RTX_SSRC) instead of SDP negotiation.
+ */
+#define PT_RTX_OFFSET       80
+#define PT_RTX(pt)          ((pt) + PT_RTX_OFFSET)
+#define PT_RTX_ORIG(pt)     ((pt) - PT_RTX_OFFSET)
+#define PT_IS_RTX(pt)       ((pt) >= PT_RTX(PT_VIDEO) && (pt) <= PT_RTX(PT_ENCRYPT_AUDIO_BUNDLE))
+#define RTP_RTX_SSRC(ssrc)  ((ssrc) ^ 0x80000000U) ///< maps both ways
+#define RTP_RTX_OVERHEAD    2 ///< original sequence number
 /*
  * Video payload
  *
@@ -122,6 +135,10 @@ typedef uint32_t video_payload_hdr_t[6];
  *
  * 5th word
  * bits 0 - 31 AudioTag
+ *
+ * With PT_AUDIO_BUNDLE, substream is the channel count - 1 and offset and
+ * length refer to a bundle containing all channels of the frame - channel
+ * count 32-bit channel lengths (network order) followed by the channel data.
  */
 typedef uint32_t audio_payload_hdr_t[5];
 
@@ -160,8 +177,9 @@ typedef uint32_t crypto_payload_hdr_t[1];
 typedef uint32_t mpa_hdr_t; /// RFC 2550 hdr for audio - 16b MBZ, 16b Frag_off
 
 #define PT_AUDIO_HAS_FEC(pt) ((pt) == PT_AUDIO_RS || (pt) == PT_ENCRYPT_AUDIO_RS)
-#define PT_AUDIO_IS_ENCRYPTED(pt) ((pt) == PT_ENCRYPT_AUDIO || (pt) == PT_ENCRYPT_AUDIO_RS)
-#define PT_IS_AUDIO(pt) ((pt) == PT_AUDIO || (pt) == PT_AUDIO_RS || (pt) == PT_ENCRYPT_AUDIO || (pt) == PT_ENCRYPT_AUDIO_RS)
+#define PT_AUDIO_IS_ENCRYPTED(pt) ((pt) == PT_ENCRYPT_AUDIO || (pt) == PT_ENCRYPT_AUDIO_RS || (pt) == PT_ENCRYPT_AUDIO_BUNDLE)
+#define PT_AUDIO_IS_BUNDLE(pt) ((pt) == PT_AUDIO_BUNDLE || (pt) == PT_ENCRYPT_AUDIO_BUNDLE)
+#define PT_IS_AUDIO(pt) ((pt) == PT_AUDIO || (pt) == PT_AUDIO_RS || (pt) == PT_ENCRYPT_AUDIO || (pt) == PT_ENCRYPT_AUDIO_RS || PT_AUDIO_IS_BUNDLE(pt))
 #define PT_VIDEO_HAS_FEC(pt) (pt == PT_VIDEO_LDGM || pt == PT_ENCRYPT_VIDEO_LDGM || pt == PT_VIDEO_RS || pt == PT_ENCRYPT_VIDEO_RS)
 #define PT_VIDEO_IS_ENCRYPTED(pt) (pt == PT_ENCRYPT_VIDEO || pt == PT_ENCRYPT_VIDEO_LDGM || pt == PT_ENCRYPT_VIDEO_RS)
 
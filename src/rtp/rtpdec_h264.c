@@ -74,8 +74,8 @@ int fill_coded_frame_from_sps(struct video_frame *rx_data, unsigned char *data,
  * eg. frame type - for prepending RTSP/SDP sprop-parameter-sets to I-frame and
  * parsing dimensions from SPS NAL.
  *
- * Should be run in 1st pass - it sets frame_type according to which does the
- * decoder deduce offset in 2nd pass.
+ * Run before the NAL is written - once frame_type becomes INTRA, the decoder
+ * inserts the parameter sets.
  *
  * @retval H.264 or RTP NAL type
  */
@@ -98,28 +98,50 @@ static uint8_t process_nal(uint8_t nal, struct video_frame *frame, uint8_t *data
     return type;
 }
 
-static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int pass, unsigned char **dst, uint8_t *data, int data_len) {
-    int fu_length = 0;
+/**
+ * Frame being reassembled. The NAL units are written in a single forward pass
+ * directly to the frame buffer, its capacity is checked for every write.
+ */
+struct nal_writer {
+    struct decode_data_h264 *d;
+    int len;                ///< reassembled length, may exceed the capacity (then only counted)
+    _Bool prefix_written;
+};
+
+static void append(struct nal_writer *w, const void *data, int data_len) {
+    if (w->len + data_len <= w->d->buffer_len) {
+        memcpy(w->d->frame->tiles[0].data + w->len, data, data_len);
+    }
+    w->len += data_len;
+}
+
+/**
+ * Writes the start code of a NAL unit. If the frame has just become an I-frame,
+ * parameter sets from the SDP (offset_buffer) are inserted in front of it.
+ */
+static void start_nal(struct nal_writer *w, uint8_t nal, uint8_t *data, int data_len) {
+    process_nal(nal, w->d->frame, data, data_len);
+    if (w->d->frame->frame_type == INTRA && !w->prefix_written) {
+        append(w, w->d->offset_buffer, w->d->offset_len);
+        w->prefix_written = TRUE;
+    }
+    append(w, start_sequence, sizeof start_sequence);
+}
+
+static _Bool decode_nal_unit(struct nal_writer *w, uint8_t *data, int data_len) {
     uint8_t nal = data[0];
-    uint8_t type = pass == 0 ? process_nal(nal, frame, data, data_len) : H264_NALU_HDR_GET_TYPE(nal);
+    uint8_t type = H264_NALU_HDR_GET_TYPE(nal);
     if (type >= NAL_H264_MIN && type <= NAL_H264_MAX) {
         type = H264_NAL;
     }
 
     switch (type) {
         case H264_NAL:
-            if (pass == 0) {
-                *total_length += sizeof(start_sequence) + data_len;
-            } else {
-                *dst -= data_len + sizeof(start_sequence);
-                memcpy(*dst, start_sequence, sizeof(start_sequence));
-                memcpy(*dst + sizeof(start_sequence), data, data_len);
-            }
+            start_nal(w, nal, data, data_len);
+            append(w, data, data_len);
             break;
         case RTP_STAP_A:
         {
-            int nal_sizes[100];
-            unsigned nal_count = 0;
             data++;
             data_len--;
 
@@ -131,41 +153,20 @@ static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int p
                 data += 2;
                 data_len -= 2;
 
+                if (nal_size > data_len) {
+                    error_msg("NAL size exceeds length: %u %d\n", nal_size, data_len);
+                    return FALSE;
+                }
                 log_msg(LOG_LEVEL_DEBUG2,
                         "STAP-A subpacket NAL type %d (nri: %d)\n",
                         (int) H264_NALU_HDR_GET_TYPE(data[0]),
                         (int) H264_NALU_HDR_GET_NRI(nal));
 
-                if (nal_size <= data_len) {
-                    if (pass == 0) {
-                        *total_length += sizeof(start_sequence) + nal_size;
-                        process_nal(data[0], frame, data, data_len);
-                    } else {
-                        assert(nal_count < sizeof nal_sizes / sizeof nal_sizes[0] - 1);
-                        nal_sizes[nal_count++] = nal_size;
-                    }
-                } else {
-                    error_msg("NAL size exceeds length: %u %d\n", nal_size, data_len);
-                    return FALSE;
-                }
+                start_nal(w, data[0], data, nal_size);
+                append(w, data, nal_size);
+
                 data += nal_size;
                 data_len -= nal_size;
-
-                if (data_len < 0) {
-                    error_msg("Consumed more bytes than we got! (%d)\n", data_len);
-                    return FALSE;
-                }
-
-            }
-            if (pass > 0) {
-                for (int i = nal_count - 1; i >= 0; i--) {
-                    int nal_size = nal_sizes[i];
-                    data -= nal_size;
-                    *dst -= nal_size + sizeof(start_sequence);
-                    memcpy(*dst, start_sequence, sizeof(start_sequence));
-                    memcpy(*dst + sizeof(start_sequence), data, nal_size);
-                    data -= 2;
-                }
             }
             break;
         }
@@ -182,7 +183,6 @@ static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int p
             if (data_len > 1) {
                 uint8_t fu_header = *data;
                 uint8_t start_bit = fu_header >> 7;
-                uint8_t end_bit       = (fu_header & 0x40) >> 6;
                 uint8_t nal_type = H264_NALU_HDR_GET_TYPE(fu_header);
                 uint8_t reconstructed_nal;
 
@@ -196,29 +196,11 @@ static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int p
                 data++;
                 data_len--;
 
-                if (pass == 0) {
-                    if (end_bit) {
-                        fu_length = data_len;
-                    } else {
-                        fu_length += data_len;
-                    }
-                    if (start_bit) {
-                        *total_length += sizeof(start_sequence) + sizeof(reconstructed_nal) + data_len;
-                        process_nal(reconstructed_nal, frame, data, fu_length);
-                    } else {
-                        *total_length += data_len;
-                    }
-                } else {
-                    if (start_bit) {
-                        *dst -= sizeof(start_sequence) + sizeof(reconstructed_nal) + data_len;
-                        memcpy(*dst, start_sequence, sizeof(start_sequence));
-                        memcpy(*dst + sizeof(start_sequence), &reconstructed_nal, sizeof(reconstructed_nal));
-                        memcpy(*dst + sizeof(start_sequence) + sizeof(reconstructed_nal), data, data_len);
-                    } else {
-                        *dst -= data_len;
-                        memcpy(*dst, data, data_len);
-                    }
+                if (start_bit) {
+                    start_nal(w, reconstructed_nal, data, data_len);
+                    append(w, &reconstructed_nal, sizeof reconstructed_nal);
                 }
+                append(w, data, data_len);
             } else {
                 error_msg("Too short data for FU-A H264 RTP packet\n");
                 return FALSE;
@@ -231,38 +213,36 @@ static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int p
     return TRUE;
 }
 
+/**
+ * Reassembles the frame directly to data->frame in one pass.
+ *
+ * If the frame doesn't fit data->buffer_len, FALSE is returned and
+ * data->needed_len is set so that the caller can enlarge the buffer.
+ */
 int decode_frame_h264(struct coded_data *cdata, void *decode_data) {
-    struct coded_data *orig = cdata;
-
-    int total_length = 0;
-
     struct decode_data_h264 *data = (struct decode_data_h264 *) decode_data;
-    struct video_frame *frame = data->frame;
-    frame->frame_type = BFRAME;
-
-    for (int pass = 0; pass < 2; pass++) {
-        unsigned char *dst = NULL;
+    struct nal_writer w = { data, 0, FALSE };
+    data->frame->frame_type = BFRAME;
+    data->needed_len = 0;
 
-        if (pass > 0) {
-            cdata = orig;
-            if(frame->frame_type == INTRA){
-                total_length+=data->offset_len;
-            }
-            frame->tiles[0].data_len = total_length;
-            dst = (unsigned char *) frame->tiles[0].data + total_length;
-        }
-
-        while (cdata != NULL) {
-            rtp_packet *pckt = cdata->data;
-
-            if (!decode_nal_unit(frame, &total_length, pass, &dst, (uint8_t *) pckt->data, pckt->data_len)) {
-                return FALSE;
-            }
-
-            cdata = cdata->nxt;
+    // cdata is in descending sequence number order, start from the oldest one
+    while (cdata->nxt != NULL) {
+        cdata = cdata->nxt;
+    }
+    for ( ; cdata != NULL; cdata = cdata->prv) {
+        rtp_packet *pckt = cdata->data;
+        if (!decode_nal_unit(&w, (uint8_t *) pckt->data, pckt->data_len)) {
+            return FALSE;
         }
     }
 
+    if (w.len > data->buffer_len) {
+        log_msg(LOG_LEVEL_WARNING, "H.264 frame size %d B exceeds buffer size %d B, dropping!\n",
+                w.len, data->buffer_len);
+        data->needed_len = w.len;
+        return FALSE;
+    }
+    data->frame->tiles[0].data_len = w.len;
     return TRUE;
 }
 
@@ -71,6 +71,9 @@ struct video_frame;
 
 struct decode_data_h264 {
         struct video_frame *frame;
+        int buffer_len;               ///< capacity of frame->tiles[0].data
+        int needed_len;               ///< [out] required capacity if the frame didn't fit
+        const unsigned char *offset_buffer; ///< SPS/PPS inserted before I-frame NALs
         int offset_len;
         int video_pt;
 };
@@ -131,6 +131,76 @@ rtpenc_get_first_nal(const unsigned char *src, long src_len, bool hevc)
         return nal;
 }
 
+/**
+ * @returns true if the Annex B frame contains slices and all of them are
+ * non-reference (H.264 nal_ref_idc 0, HEVC sub-layer non-reference types),
+ * so that the frame can be left out of decoding without affecting others
+ */
+bool
+rtpenc_frame_is_discardable(const unsigned char *src, long src_len, bool hevc)
+{
+        bool                 has_slice = false;
+        const unsigned char *nal       = src;
+        while ((nal = rtpenc_get_next_nal(nal, src_len - (nal - src), NULL)) !=
+               NULL) {
+                const int nalu_type = NALU_HDR_GET_TYPE(nal[0], hevc);
+                if (hevc) {
+                        if (nalu_type >= NAL_HEVC_VPS) { // non-VCL
+                                continue;
+                        }
+                        // IRAP (16-23), reserved and all odd types are reference
+                        if (nalu_type >= 16 || nalu_type % 2 == 1) {
+                                return false;
+                        }
+                } else {
+                        if (nalu_type < NAL_H264_MIN ||
+                            nalu_type > NAL_H264_IDR) { // non-VCL
+                                continue;
+                        }
+                        if (H264_NALU_HDR_GET_NRI(nal[0]) != 0) {
+                                return false;
+                        }
+                }
+                has_slice = true;
+        }
+        return has_slice;
+}
+
+/**
+ * @returns true if the Annex B data begin a frame that can be decoded
+ * independently - the first slice is IDR (H.264) or IRAP (HEVC) or it is
+ * preceded by a parameter set. The data may be truncated (eg. the first RTP
+ * packet of the frame), only NAL units up to the first slice are examined.
+ */
+bool
+rtpenc_frame_is_keyframe(const unsigned char *src, long src_len, bool hevc)
+{
+        const unsigned char *nal = src;
+        while ((nal = rtpenc_get_next_nal(nal, src_len - (nal - src), NULL)) !=
+               NULL) {
+                const int nalu_type = NALU_HDR_GET_TYPE(nal[0], hevc);
+                if (hevc) {
+                        if (nalu_type >= NAL_HEVC_VPS &&
+                            nalu_type <= NAL_HEVC_PPS) {
+                                return true;
+                        }
+                        if (nalu_type < NAL_HEVC_VPS) { // VCL
+                                return nalu_type >= 16 && nalu_type <= 23;
+                        }
+                } else {
+                        if (nalu_type == NAL_H264_SPS ||
+                            nalu_type == NAL_H264_PPS) {
+                                return true;
+                        }
+                        if (nalu_type >= NAL_H264_MIN &&
+                            nalu_type <= NAL_H264_IDR) { // VCL
+                                return nalu_type == NAL_H264_IDR;
+                        }
+                }
+        }
+        return false;
+}
+
 /// @returns name of NAL unit
 const char *
 get_nalu_name(int type)
@@ -65,6 +65,10 @@ const unsigned char *rtpenc_get_next_nal(const unsigned char *start, long len,
                                          const unsigned char **endptr);
 const unsigned char *rtpenc_get_first_nal(const unsigned char *src,
                                           long src_len, bool hevc);
+bool rtpenc_frame_is_discardable(const unsigned char *src, long src_len,
+                                 bool hevc);
+bool rtpenc_frame_is_keyframe(const unsigned char *src, long src_len,
+                              bool hevc);
 const char          *get_nalu_name(int type);
 
 #ifdef __cplusplus
@@ -107,14 +107,20 @@
 #include "messaging.h"
 #include "module.h"
 #include "pixfmt_conv.h"
+#include "rtp/av_sync.h"
 #include "rtp/fec.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
+#include "rtp/rtpenc_h264.h"
 #include "rtp/pbuf.h"
 #include "rtp/video_decoders.h"
 #include "utils/color_out.h"
+#include "utils/frame_drops.h"
+#include "utils/frame_trace.h"
+#include "utils/lockfree_queue.h"
 #include "utils/macros.h"
 #include "utils/misc.h"
+#include "utils/numa.h"
 #include "utils/synchronized_queue.h"
 #include "utils/thread.h"
 #include "utils/timed_message.h"
@@ -129,7 +135,7 @@
 #include <condition_variable>
 #include <iomanip>
 #include <iostream>
-#include <map>
+#include <list>
 #include <memory>
 #include <set>
 #include <sstream>
@@ -142,6 +148,7 @@
 #define MOD_NAME "[video dec.] "
 
 #define FRAMEBUFFER_NOT_READY(decoder) (decoder->frame == NULL && decoder->out_codec != VIDEO_CODEC_END)
+#define MAX_PIPELINE_DEPTH 4 ///< max. frames queued before FEC and decompress (decoder-pipeline-depth)
 
 using namespace std;
 using namespace std::string_literals;
@@ -165,17 +172,9 @@ static void wait_for_framebuffer_swap(struct state_video_decoder *decoder);
 static void *fec_thread(void *args);
 static void *decompress_thread(void *args);
 static void cleanup(struct state_video_decoder *decoder);
+static void decompress_cache_clear(struct state_video_decoder *decoder);
 static void decoder_process_message(struct module *);
 
-static int sum_map(map<int, int> const & m) {
-        int ret = 0;
-        for (map<int, int>::const_iterator it = m.begin();
-                        it != m.end(); ++it) {
-                ret += it->second;
-        }
-        return ret;
-}
-
 namespace {
 
 #ifdef HAVE_LIBAVCODEC_AVCODEC_H
@@ -207,6 +206,20 @@ struct line_decoder {
         unsigned int         src_linesize; ///< source linesize
 };
 
+/// payload of a received packet that is to be copied to the frame
+struct packet_payload {
+        uint32_t    data_pos;
+        const char *data;
+        int         len;
+};
+
+/// packet of the frame decrypted (in place) by decrypt_packets()
+struct decrypt_job {
+        rtp_packet        *pckt;
+        enum openssl_mode  mode;
+        int                len; ///< plaintext length, 0 if failed, -1 if not encrypted
+};
+
 struct reported_statistics_cumul {
         ~reported_statistics_cumul() {
                 print();
@@ -220,6 +233,11 @@ struct reported_statistics_cumul {
                 if (fec_ok + fec_nok + fec_corrected > 0) {
                         fec << " FEC noerr/OK/NOK: " << SBOLD(fec_ok) << "/" << SBOLD(fec_corrected) << "/" << SBOLD(fec_nok);
                 }
+                char drops_buf[STR_LEN];
+                string drops;
+                if (frame_drops_format(drops_buf, sizeof drops_buf) > 0) {
+                        drops = " (drops by stage/reason: "s + drops_buf + ")";
+                }
                 unsigned long total = displayed + dropped + missing;
                 LOG(LOG_LEVEL_INFO) << SUNDERLINE("Video dec stats") << " (cumulative): "
                         << SBOLD(total) << " total / "
@@ -227,7 +245,7 @@ struct reported_statistics_cumul {
                         << SBOLD(dropped) << " drop / "
                         << SBOLD(corrupted) << " corr / "
                         << SBOLD(missing) << " miss"
-                        << fec.str() << "\n";
+                        << fec.str() << drops << "\n";
                 if (total > 3000 && dropped * 50 >= total) { // more than 2% frames were dropped
                         log_msg_once(LOG_LEVEL_WARNING, to_fourcc('D', 'R', 'P', 'S'), MOD_NAME "Dropped %lu of %lu frames. This may be due "
                                         "to network jitter, try adding \"--param decoder-drop-policy=blocking\" if the problem persists.\n", dropped, total);
@@ -238,11 +256,11 @@ struct reported_statistics_cumul {
                         long long int diff = buffer_number -
                                 ((last_buffer_number + 1) & ((1U<<BUFNUM_BITS) - 1));
                         diff = (diff + (1U<<BUFNUM_BITS)) % (1U<<BUFNUM_BITS);
-                        if (diff < (1U<<BUFNUM_BITS) / 2) {
-                                missing += diff;
-                        } else { // frames may have been reordered, add arbitrary 1
-                                missing += 1;
+                        if (diff >= (1U<<BUFNUM_BITS) / 2) { // frames may have been reordered, add arbitrary 1
+                                diff = 1;
                         }
+                        missing += diff;
+                        frame_drop_record(FRAME_DROP_MISSING, diff);
                 }
                 last_buffer_number = buffer_number;
                 auto now = chrono::steady_clock::now();
@@ -253,6 +271,73 @@ struct reported_statistics_cumul {
         }
 };
 
+/**
+ * Keeps received frames (including tile buffers), FEC output frames and packet
+ * range lists of already processed frames so that decode_video_frame() can
+ * reuse them instead of allocating everything anew for each received frame.
+ */
+struct recv_frame_pool {
+        /// recycled per-frame data
+        struct item {
+                struct video_frame *frame = nullptr;       ///< received frame
+                struct video_frame *nofec_frame = nullptr; ///< frame without FEC, tiles point to other buffers
+                vector<unsigned int> tile_capacity;        ///< allocated size of frame tile buffers
+                vector<fec_ranges> pckt_list;              ///< received packet ranges per tile
+        };
+        ~recv_frame_pool() {
+                for (auto &i : items) {
+                        vf_free(i.frame);
+                        vf_free(i.nofec_frame);
+                }
+        }
+        item get(unsigned int tile_count) {
+                item ret;
+                {
+                        lock_guard<mutex> lk(lock);
+                        if (!items.empty()) {
+                                ret = std::move(items.back());
+                                items.pop_back();
+                        }
+                }
+                if (ret.frame != nullptr && ret.frame->tile_count != tile_count) {
+                        vf_free(ret.frame);
+                        vf_free(ret.nofec_frame);
+                        ret = {};
+                }
+                if (ret.frame == nullptr) {
+                        ret.frame = vf_alloc(tile_count);
+                        ret.frame->callbacks.data_deleter = vf_data_deleter;
+                        ret.nofec_frame = vf_alloc(tile_count);
+                        ret.tile_capacity.resize(tile_count);
+                        ret.pckt_list.resize(tile_count);
+                        return ret;
+                }
+                ret.frame->fec_params = fec_desc(FEC_NONE);
+                for (unsigned int i = 0; i < tile_count; ++i) {
+                        ret.frame->tiles[i].data_len = 0;
+                        ret.nofec_frame->tiles[i].data = nullptr;
+                        ret.nofec_frame->tiles[i].data_len = 0;
+                        ret.pckt_list[i].clear();
+                }
+                return ret;
+        }
+        void put(item &&i) {
+                {
+                        lock_guard<mutex> lk(lock);
+                        if (items.size() < MAX_POOLED) {
+                                items.push_back(std::move(i));
+                                return;
+                        }
+                }
+                vf_free(i.frame);
+                vf_free(i.nofec_frame);
+        }
+private:
+        static constexpr size_t MAX_POOLED = 2 * MAX_PIPELINE_DEPTH + 2;
+        mutex lock;
+        vector<item> items;
+};
+
 // message definitions
 struct frame_msg {
         inline frame_msg(struct control_state *c, struct reported_statistics_cumul &sr) : control(c), recv_frame(nullptr),
@@ -262,16 +347,11 @@ struct frame_msg {
         {}
         inline ~frame_msg() {
                 if (recv_frame) {
-                        int received_bytes = 0;
-                        for (unsigned int i = 0; i < recv_frame->tile_count; ++i) {
-                                received_bytes += sum_map(pckt_list[i]);
-                        }
-                        int expected_bytes = vf_get_data_len(recv_frame);
                         if (recv_frame->fec_params.type != FEC_NONE) {
                                 if (is_corrupted) {
                                         stats.fec_nok += 1;
                                 } else {
-                                        if (received_bytes == expected_bytes) {
+                                        if (systematic_part_complete()) {
                                                 stats.fec_ok += 1;
                                         } else {
                                                 stats.fec_corrected += 1;
@@ -282,14 +362,35 @@ struct frame_msg {
                         stats.displayed += is_displayed;
                         stats.dropped += !is_displayed;
                 }
+                if (pool && recv_frame && nofec_frame) {
+                        pool->put({recv_frame, nofec_frame, std::move(tile_capacity), std::move(pckt_list)});
+                        return;
+                }
                 vf_free(recv_frame);
                 vf_free(nofec_frame);
         }
+        /// @returns true if no FEC correction was needed (the frame may have been
+        ///          decoded before the parity arrived, see @ref placed_frame)
+        bool systematic_part_complete() const {
+                const unsigned int n = recv_frame->fec_params.k + recv_frame->fec_params.m;
+                for (unsigned int i = 0; i < recv_frame->tile_count; ++i) {
+                        const unsigned int len = recv_frame->tiles[i].data_len;
+                        const unsigned int systematic_len = n > 0 ? len / n * recv_frame->fec_params.k : len;
+                        if (pckt_list[i].empty() || pckt_list[i][0].first != 0 ||
+                                        (unsigned int) pckt_list[i][0].second < systematic_len) {
+                                return false;
+                        }
+                }
+                return true;
+        }
         struct control_state *control;
         vector <uint32_t> buffer_num;
         struct video_frame *recv_frame; ///< received frame with FEC and/or compression
         struct video_frame *nofec_frame; ///< frame without FEC
-        unique_ptr<map<int, int>[]> pckt_list;
+        vector<fec_ranges> pckt_list;
+        vector<unsigned int> tile_capacity; ///< allocated size of recv_frame tile buffers
+        vector<bool> tile_skipped; ///< substreams not to be decoded (empty if none) - see set_skipped_tiles()
+        shared_ptr<recv_frame_pool> pool; ///< pool to return the frames to (if set)
         unsigned long long int received_pkts_cum, expected_pkts_cum;
         struct reported_statistics_cumul &stats;
         bool is_corrupted = false;
@@ -325,12 +426,15 @@ struct state_video_decoder
                 mod.new_message = decoder_process_message;
                 module_register(&mod, parent);
                 control = (struct control_state *) get_module(get_root_module(parent), "control");
+                latency_stats = frame_latency_stats_create(control);
         }
         ~state_video_decoder() {
+                frame_latency_stats_destroy(latency_stats);
                 module_done(&mod);
         }
         struct module mod;
         struct control_state *control = {};
+        struct frame_latency_stats *latency_stats; ///< used by decompress thread
 
         thread decompress_thread_id,
                   fec_thread_id;
@@ -357,29 +461,53 @@ struct state_video_decoder
         struct line_decoder *line_decoder = NULL; ///< if the video is uncompressed and only pixelformat change
                                            ///< is neeeded, use this structure
         vector<struct state_decompress *> decompress_state; ///< state of the decompress (for every substream)
+        /// configuration of decompress_state, key of @ref decompress_cache
+        struct decompress_config {
+                struct video_desc desc{};
+                struct pixfmt_desc comp_int_prop{};
+                codec_t out_codec = VIDEO_CODEC_NONE; ///< NONE - not configured (not cacheable)
+                int rgb_shift[3]{};
+                int pitch = 0;
+                vector<struct state_decompress *> states;
+        } decompress_cfg;
+        list<decompress_config> decompress_cache; ///< recently used decompressors, most recent first
+        size_t decompress_cache_size = 0; ///< see decoder-cache param
         bool accepts_corrupted_frame = false;     ///< whether we should pass corrupted frame to decompress
         bool buffer_swapped = true; /**< variable indicating that display buffer
                               * has been processed and we can write to a new one */
         condition_variable buffer_swapped_cv; ///< condition variable associated with @ref buffer_swapped
 
-        synchronized_queue<unique_ptr<frame_msg>, 1> decompress_queue;
+        lockfree_queue<unique_ptr<frame_msg>, 1> decompress_queue;
 
         codec_t           out_codec = VIDEO_CODEC_NONE;
         int               pitch = 0;
 
-        synchronized_queue<unique_ptr<frame_msg>, 1> fec_queue;
+        lockfree_queue<unique_ptr<frame_msg>, 1> fec_queue;
 
         enum video_mode   video_mode = {} ;  ///< video mode set for this decoder
         bool          merged_fb = false; ///< flag if the display device driver requires tiled video or not
 
         timed_message<LOG_LEVEL_WARNING> slow_msg; ///< shows warning ony in certain interval
 
+        vector<vector<packet_payload>> substream_packets; ///< per-substream packets to be copied by decode_video_frame()
+        shared_ptr<recv_frame_pool> frame_pool = make_shared<recv_frame_pool>(); ///< recycled received frames
+        bool early_fec = true; ///< decode FEC frames as soon as enough symbols arrive (see @ref placed_frame)
+        vector<bool> tile_skipped; ///< substreams outside of display ROI (empty if all are shown)
+        bool skip_when_busy = true; ///< do not decompress frames that would be dropped (see @ref can_skip_decompress)
+        bool display_busy = false; ///< last frame was refused by the display (non-blocking putf)
+
         synchronized_queue<main_msg_reconfigure *, -1> msg_queue;
 
         const struct openssl_decrypt_info *dec_funcs = NULL; ///< decrypt state
         struct openssl_decrypt      *decrypt = NULL; ///< decrypt state
+        string                       passphrase; ///< to create decrypt states for workers
+        mutex                        decrypt_lock; ///< protects decrypt_spare
+        vector<struct openssl_decrypt *> decrypt_spare; ///< states not used by any worker
+        vector<decrypt_job>          decrypt_jobs; ///< packets of currently decoded frame
 
         struct reported_statistics_cumul stats = {}; ///< stats to be reported through control socket
+        atomic_ulong busy_frames{0}; ///< frames reaching the decompress thread (see video_decoder_get_busy_drops())
+        atomic_ulong busy_drops{0}; ///< frames skipped or refused because decompression or display didn't keep up
 };
 
 /**
@@ -399,6 +527,7 @@ static void wait_for_framebuffer_swap(struct state_video_decoder *decoder) {
 
 static void *fec_thread(void *args) {
         set_thread_name(__func__);
+        ug_numa_bind_thread();
         struct state_video_decoder *decoder =
                 (struct state_video_decoder *) args;
 
@@ -433,9 +562,14 @@ static void *fec_thread(void *args) {
                         }
                 }
 
-                data->nofec_frame = vf_alloc(data->recv_frame->tile_count);
+                if (data->nofec_frame == nullptr) {
+                        data->nofec_frame = vf_alloc(data->recv_frame->tile_count);
+                }
                 data->nofec_frame->ssrc = data->recv_frame->ssrc;
                 data->nofec_frame->timestamp = data->recv_frame->timestamp;
+                data->nofec_frame->presentation_time = data->recv_frame->presentation_time;
+                frame_trace_restore(data->nofec_frame,
+                                    frame_trace_save(data->recv_frame));
 
                 if (data->recv_frame->fec_params.type != FEC_NONE) {
                         bool buffer_swapped = false;
@@ -444,11 +578,17 @@ static void *fec_thread(void *args) {
                                 char *fec_out_buffer = NULL;
                                 int fec_out_len = 0;
 
-                                if (data->recv_frame->tiles[pos].data_len != (unsigned int) sum_map(data->pckt_list[pos])) {
+                                if (!data->tile_skipped.empty() && data->tile_skipped[pos]) {
+                                        data->nofec_frame->tiles[pos].data_len = 0;
+                                        data->nofec_frame->tiles[pos].data = nullptr;
+                                        continue;
+                                }
+
+                                if (data->recv_frame->tiles[pos].data_len != (unsigned int) fec_ranges_sum(data->pckt_list[pos])) {
                                         debug_msg("Frame incomplete - substream %d, buffer %d: expected %u bytes, got %u.\n", pos,
                                                         (unsigned int) data->buffer_num[pos],
                                                         data->recv_frame->tiles[pos].data_len,
-                                                        (unsigned int) sum_map(data->pckt_list[pos]));
+                                                        (unsigned int) fec_ranges_sum(data->pckt_list[pos]));
                                 }
 
                                 bool ret = fec_state->decode(data->recv_frame->tiles[pos].data,
@@ -458,10 +598,9 @@ static void *fec_thread(void *args) {
                                 if (ret == false) {
                                         data->is_corrupted = true;
                                         verbose_msg("[decoder] FEC: unable to reconstruct data.\n");
-                                        if (fec_out_len < (int) sizeof(video_payload_hdr_t)) {
-                                                goto cleanup;
-                                        }
-                                        if (decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame) {
+                                        if (fec_out_len < (int) sizeof(video_payload_hdr_t) ||
+                                            (decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame)) {
+                                                frame_drop_record(FRAME_DROP_INCOMPLETE, 1);
                                                 goto cleanup;
                                         }
                                 }
@@ -525,16 +664,19 @@ static void *fec_thread(void *args) {
                 } else { /* PT_VIDEO */
                         for(int i = 0; i < (int) decoder->max_substreams; ++i) {
                                 data->nofec_frame->tiles[i].data_len = data->recv_frame->tiles[i].data_len;
-                                data->nofec_frame->tiles[i].data = data->recv_frame->tiles[i].data;
+                                // recycled frames keep buffers of substreams not received this time
+                                data->nofec_frame->tiles[i].data = data->recv_frame->tiles[i].data_len > 0 ?
+                                        data->recv_frame->tiles[i].data : nullptr;
 
-                                if (data->recv_frame->tiles[i].data_len != (unsigned int) sum_map(data->pckt_list[i])) {
+                                if (data->recv_frame->tiles[i].data_len != (unsigned int) fec_ranges_sum(data->pckt_list[i])) {
                                         debug_msg("Frame incomplete - substream %d, buffer %d: expected %u bytes, got %u.%s\n", i,
                                                         (unsigned int) data->buffer_num[i],
                                                         data->recv_frame->tiles[i].data_len,
-                                                        (unsigned int) sum_map(data->pckt_list[i]),
+                                                        (unsigned int) fec_ranges_sum(data->pckt_list[i]),
                                                         decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame ? " dropped.\n" : "");
                                         data->is_corrupted = true;
                                         if(decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame) {
+                                                frame_drop_record(FRAME_DROP_INCOMPLETE, 1);
                                                 goto cleanup;
                                         }
                                 }
@@ -591,12 +733,43 @@ static void *decompress_worker(void *data)
         return d;
 }
 
+/**
+ * Decides if the frame can be dropped before decompression because the
+ * display did not accept the previous one. Intra-only streams (JPEG, J2K...)
+ * can skip any frame, for H.264/HEVC only the non-reference frames are skipped
+ * so that the decoder reference state is kept intact.
+ */
+static bool can_skip_decompress(struct state_video_decoder *decoder,
+                                const struct video_frame *compressed)
+{
+        if (!decoder->skip_when_busy || !decoder->display_busy ||
+            decoder->decoder_type != EXTERNAL_DECODER) {
+                return false;
+        }
+        const codec_t codec = compressed->color_spec;
+        if (!is_codec_interframe(codec)) {
+                return true;
+        }
+        if (codec != H264 && codec != H265) {
+                return false;
+        }
+        for (unsigned i = 0; i < compressed->tile_count; ++i) {
+                if (!rtpenc_frame_is_discardable(
+                        (const unsigned char *) compressed->tiles[i].data,
+                        compressed->tiles[i].data_len, codec == H265)) {
+                        return false;
+                }
+        }
+        return true;
+}
+
 ADD_TO_PARAM("decoder-drop-policy",
                 "* decoder-drop-policy=blocking|nonblock|<sec>\n"
                 "  Force specified blocking policy (default nonblock).\n"
                 "  <sec> - specifies frame timeout in seconds (can have suffixes, eg. \"20ms\")\n");
 static void *decompress_thread(void *args) {
         set_thread_name(__func__);
+        ug_numa_bind_thread();
         struct state_video_decoder *decoder =
                 (struct state_video_decoder *) args;
         int tile_width = decoder->received_vid_desc.width; // get_video_mode_tiles_x(decoder->video_mode);
@@ -625,8 +798,11 @@ static void *decompress_thread(void *args) {
                 if(!msg->recv_frame) { // poisoned
                         break;
                 }
+                decoder->busy_frames.fetch_add(1, memory_order_relaxed);
 
                 auto t0 = std::chrono::high_resolution_clock::now();
+                frame_trace_event(msg->nofec_frame->trace_id, FRAME_TRACE_DECOMPRESS_START);
+                time_ns_t decompress_end = 0;
                 unique_ptr<char[]> tmp;
 
                 if (decoder->out_codec == VIDEO_CODEC_END) {
@@ -634,6 +810,15 @@ static void *decompress_thread(void *args) {
                 }
 
                 if(decoder->decoder_type == EXTERNAL_DECODER) {
+                        if (can_skip_decompress(decoder, msg->nofec_frame)) {
+                                LOG(LOG_LEVEL_DEBUG) << MOD_NAME << "Display busy, frame skipped without decompression.\n";
+                                // give the display one frame time to catch up
+                                decoder->display_busy = false;
+                                frame_drop_record(FRAME_DROP_DECODER_SKIP, 1);
+                                decoder->busy_drops.fetch_add(1, memory_order_relaxed);
+                                goto skip_frame;
+                        }
+
                         int tile_count = get_video_mode_tiles_x(decoder->video_mode) *
                                         get_video_mode_tiles_y(decoder->video_mode);
                         vector<task_result_handle_t> handle(tile_count);
@@ -643,6 +828,10 @@ static void *decompress_thread(void *args) {
                                 data[pos].pos = pos;
                                 data[pos].compressed = msg->nofec_frame;
                                 data[pos].buffer_num = msg->buffer_num[pos];
+                                if (!msg->tile_skipped.empty() && msg->tile_skipped[pos]) {
+                                        data[pos].ret = DECODER_GOT_FRAME; // not shown, left as is
+                                        continue;
+                                }
                                 if (tmp.get()) {
                                         data[pos].out = (unsigned char *) tmp.get();
                                 } else if (decoder->merged_fb) {
@@ -662,10 +851,15 @@ static void *decompress_thread(void *args) {
                         }
                         if (tile_count > 1) {
                                 for (int pos = 0; pos < tile_count; ++pos) {
-                                        wait_task(handle[pos]);
+                                        if (handle[pos] != nullptr) {
+                                                wait_task(handle[pos]);
+                                        }
                                 }
                         }
                         for (int pos = 0; pos < tile_count; ++pos) {
+                                if (data[pos].ret != DECODER_GOT_FRAME) {
+                                        frame_drop_record(FRAME_DROP_DECODER_NO_OUTPUT, 1);
+                                }
                                 if (data[pos].ret == DECODER_GOT_CODEC) {
                                         LOG(LOG_LEVEL_NOTICE) << MOD_NAME << "Detected compression properties: " << get_pixdesc_desc(data[pos].internal_prop) << "\n";
                                         decoder->msg_queue.push(new main_msg_reconfigure(decoder->received_vid_desc, nullptr, false, data[pos].internal_prop));
@@ -687,6 +881,8 @@ static void *decompress_thread(void *args) {
                         }
                 }
 
+                frame_trace_event(msg->nofec_frame->trace_id, FRAME_TRACE_DECOMPRESS_END);
+                decompress_end = get_time_in_ns();
                 LOG(LOG_LEVEL_DEBUG) << MOD_NAME << "Decompress duration: " <<
                         duration_cast<nanoseconds>(high_resolution_clock::now() - t0).count() / 1000000.0 << " ms\n";
 
@@ -703,9 +899,24 @@ static void *decompress_thread(void *args) {
 
                         decoder->frame->ssrc = msg->nofec_frame->ssrc;
                         decoder->frame->timestamp = msg->nofec_frame->timestamp;
+                        decoder->frame->presentation_time = msg->nofec_frame->presentation_time;
+                        decoder->frame->trace_id = msg->nofec_frame->trace_id;
                         const bool ret = display_put_frame(
                             decoder->display, decoder->frame, putf_timeout);
                         msg->is_displayed = ret;
+                        if (!ret) {
+                                decoder->busy_drops.fetch_add(1, memory_order_relaxed);
+                        }
+                        if (ret) {
+                                frame_trace_event(msg->nofec_frame->trace_id, FRAME_TRACE_DISPLAY);
+                                frame_latency_stats_add(decoder->latency_stats, msg->nofec_frame,
+                                                        decompress_end, get_time_in_ns());
+                        }
+                        if (ret && av_sync_enabled()) {
+                                av_sync_report(AV_SYNC_VIDEO, msg->nofec_frame->ssrc,
+                                                msg->nofec_frame->timestamp, 90000, get_time_in_ns());
+                        }
+                        decoder->display_busy = !ret;
                         decoder->frame = display_get_frame(decoder->display);
                         assert(decoder->frame != nullptr);
                 }
@@ -731,6 +942,20 @@ static void decoder_set_video_mode(struct state_video_decoder *decoder, enum vid
                         * get_video_mode_tiles_y(decoder->video_mode);
 }
 
+ADD_TO_PARAM("decoder-pipeline-depth", "* decoder-pipeline-depth=<n>\n"
+                "  Number of received frames that may wait for FEC and decompression each\n"
+                "  (1-" TOSTRING(MAX_PIPELINE_DEPTH) ", default 1). Higher values let slow decompressors\n"
+                "  overlap with FEC at the expense of latency.\n");
+ADD_TO_PARAM("decoder-no-early-fec", "* decoder-no-early-fec\n"
+                "  Do not pass FEC-protected frames to FEC decoder as soon as enough symbols\n"
+                "  are received, wait for the whole frame and its playout time instead.\n");
+ADD_TO_PARAM("decoder-no-skip-busy", "* decoder-no-skip-busy\n"
+                "  Decompress all frames even if the display refused the previous one (by\n"
+                "  default, intra-only and H.264/HEVC non-reference frames are skipped then).\n");
+ADD_TO_PARAM("decoder-cache", "* decoder-cache=<n>\n"
+                "  Keep decompressors of <n> last stream formats so that switching back to\n"
+                "  one of them does not need to initialize the decompressor again (default 0).\n");
+
 /**
  * @brief Initializes video decompress state.
  * @param video_mode  video_mode expected to be received from network
@@ -763,6 +988,26 @@ struct state_video_decoder *video_decoder_init(struct module *parent,
                         delete s;
                         return NULL;
                 }
+                s->passphrase = encryption;
+                s->decrypt_spare.push_back(s->decrypt);
+        }
+
+        if (const char *depth_str = get_commandline_param("decoder-pipeline-depth")) {
+                const int depth = atoi(depth_str);
+                if (depth < 1 || depth > MAX_PIPELINE_DEPTH) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Pipeline depth must be in range 1-%d!\n",
+                                        MAX_PIPELINE_DEPTH);
+                        delete s;
+                        return NULL;
+                }
+                s->fec_queue.set_max_len(depth);
+                s->decompress_queue.set_max_len(depth);
+        }
+
+        s->early_fec = get_commandline_param("decoder-no-early-fec") == nullptr;
+        s->skip_when_busy = get_commandline_param("decoder-no-skip-busy") == nullptr;
+        if (const char *cache_size = get_commandline_param("decoder-cache")) {
+                s->decompress_cache_size = atoi(cache_size);
         }
 
         decoder_set_video_mode(s, video_mode);
@@ -822,6 +1067,9 @@ static auto codec_list_to_str(vector<codec_t> const &codecs) {
         return oss.str();
 }
 
+ADD_TO_PARAM("decoder-cuda-conv", "* decoder-cuda-conv\n"
+                "  Convert uncompressed pixel formats (eg. v210, R10k, R12L, Y416) with CUDA\n"
+                "  instead of the CPU line decoders (if supported).\n");
 ADD_TO_PARAM("decoder-use-codec",
                 "* decoder-use-codec=<codec>\n"
                 "  Use specified pixel format for decoding (eg. v210). This overrides automatic\n"
@@ -916,7 +1164,73 @@ void video_decoder_remove_display(struct state_video_decoder *decoder)
                 }
                 decoder->display = NULL;
                 memset(&decoder->display_desc, 0, sizeof(decoder->display_desc));
+                decompress_cache_clear(decoder); // output codecs were selected for the display
+        }
+}
+
+/**
+ * Cumulative counts of the frames that reached decompression and of those
+ * dropped there because the decoder or display was busy - input of the
+ * receiver overload reports. Thread-safe.
+ */
+void video_decoder_get_busy_drops(struct state_video_decoder *decoder,
+                unsigned long *frames, unsigned long *drops)
+{
+        *frames = decoder->busy_frames.load(memory_order_relaxed);
+        *drops = decoder->busy_drops.load(memory_order_relaxed);
+}
+
+static void decompress_cache_clear(struct state_video_decoder *decoder)
+{
+        for (auto &entry : decoder->decompress_cache) {
+                for (auto &d : entry.states) {
+                        decompress_done(d);
+                }
+        }
+        decoder->decompress_cache.clear();
+}
+
+/**
+ * Moves current decompress states to @ref state_video_decoder::decompress_cache
+ * (if enabled and the states are fully configured).
+ */
+static void decompress_cache_store(struct state_video_decoder *decoder)
+{
+        if (decoder->decompress_cache_size == 0 || decoder->decoder_type != EXTERNAL_DECODER ||
+                        decoder->decompress_cfg.out_codec == VIDEO_CODEC_NONE) {
+                return;
+        }
+        decoder->decompress_cfg.states = std::move(decoder->decompress_state);
+        decoder->decompress_state.clear();
+        decoder->decompress_cache.push_front(std::move(decoder->decompress_cfg));
+        decoder->decompress_cfg = {};
+        while (decoder->decompress_cache.size() > decoder->decompress_cache_size) {
+                for (auto &d : decoder->decompress_cache.back().states) {
+                        decompress_done(d);
+                }
+                decoder->decompress_cache.pop_back();
+        }
+}
+
+/**
+ * Takes cached decompress states for given stream format
+ * @retval true  states moved to state_video_decoder::decompress_state and
+ *               their configuration to state_video_decoder::decompress_cfg
+ */
+static bool decompress_cache_take(struct state_video_decoder *decoder,
+                struct video_desc desc, struct pixfmt_desc comp_int_prop)
+{
+        for (auto it = decoder->decompress_cache.begin(); it != decoder->decompress_cache.end(); ++it) {
+                if (video_desc_eq(it->desc, desc) && pixdesc_equals(it->comp_int_prop, comp_int_prop)) {
+                        decoder->decompress_state = std::move(it->states);
+                        decoder->decompress_cfg = std::move(*it);
+                        decoder->decompress_cfg.states.clear();
+                        decoder->decompress_cache.erase(it);
+                        decoder->decoder_type = EXTERNAL_DECODER;
+                        return true;
+                }
         }
+        return false;
 }
 
 static void cleanup(struct state_video_decoder *decoder)
@@ -947,12 +1261,15 @@ void video_decoder_destroy(struct state_video_decoder *decoder)
                 return;
 
         if (decoder->dec_funcs) {
-                decoder->dec_funcs->destroy(decoder->decrypt);
+                for (auto *d : decoder->decrypt_spare) { // includes decoder->decrypt
+                        decoder->dec_funcs->destroy(d);
+                }
         }
 
         video_decoder_remove_display(decoder);
 
         cleanup(decoder);
+        decompress_cache_clear(decoder);
 
         free(decoder->disp_supported_il);
 
@@ -1068,6 +1385,20 @@ static codec_t choose_codec_and_decoder(struct state_video_decoder *decoder, str
                 vector<codec_t> native_codecs_copy = decoder->native_codecs;
                 native_codecs_copy.push_back(VIDEO_CODEC_NONE); // this needs to be NULL-terminated
                 *decode_line = get_best_decoder_from(desc.color_spec, native_codecs_copy.data(), &out_codec);
+                if (*decode_line && get_commandline_param("decoder-cuda-conv") != nullptr) {
+                        // the same conversion but done by a (CUDA) decompress module
+                        decoder->decompress_state.resize(decoder->max_substreams);
+                        if (decompress_init_multi(desc.color_spec, get_pixfmt_desc(desc.color_spec),
+                                                out_codec, decoder->decompress_state.data(),
+                                                decoder->decompress_state.size())) {
+                                *decode_line = nullptr;
+                                decoder->decoder_type = EXTERNAL_DECODER;
+                                goto after_decoder_lookup;
+                        }
+                        decoder->decompress_state.clear();
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "No CUDA conversion %s->%s, using CPU.\n",
+                                        get_codec_name(desc.color_spec), get_codec_name(out_codec));
+                }
                 if (*decode_line) {
                         decoder->decoder_type = LINE_DECODER;
                         goto after_linedecoder_lookup;
@@ -1171,6 +1502,43 @@ static change_il_t select_il_func(enum interlacing_t in_il, enum interlacing_t *
  * @invariant
  * decoder->display != NULL
  */
+/**
+ * Marks substreams lying completely outside of the region that the display
+ * (a cropping postprocessor) actually uses. Their packets are then discarded
+ * on arrival and they are neither FEC-decoded nor decompressed.
+ */
+static void set_skipped_tiles(struct state_video_decoder *decoder,
+                              const struct video_desc &desc)
+{
+        decoder->tile_skipped.clear();
+        struct video_roi roi{};
+        size_t len = sizeof roi;
+        if (decoder->max_substreams == 1 || !decoder->merged_fb ||
+            !display_ctl_property(decoder->display, DISPLAY_PROPERTY_INPUT_ROI,
+                                  &roi, &len)) {
+                return;
+        }
+        const unsigned tiles_x = get_video_mode_tiles_x(decoder->video_mode);
+        vector<bool> skipped(decoder->max_substreams);
+        unsigned skipped_count = 0;
+        for (unsigned i = 0; i < decoder->max_substreams; ++i) {
+                const unsigned x = i % tiles_x * desc.width;
+                const unsigned y = i / tiles_x * desc.height;
+                skipped[i] = x >= roi.x + roi.width || x + desc.width <= roi.x ||
+                             y >= roi.y + roi.height || y + desc.height <= roi.y;
+                skipped_count += skipped[i];
+        }
+        if (skipped_count == 0 || skipped_count == decoder->max_substreams) {
+                return;
+        }
+        LOG(LOG_LEVEL_NOTICE) << MOD_NAME << "Decoding only "
+                << decoder->max_substreams - skipped_count << " of "
+                << decoder->max_substreams << " tiles (shown region "
+                << roi.width << "x" << roi.height << "+" << roi.x << "+"
+                << roi.y << ").\n";
+        decoder->tile_skipped = std::move(skipped);
+}
+
 static bool reconfigure_decoder(struct state_video_decoder *decoder,
                 struct video_desc desc, struct pixfmt_desc comp_int_prop)
 {
@@ -1188,12 +1556,20 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
         decoder->frame = NULL;
         video_decoder_start_threads(decoder);
 
+        decompress_cache_store(decoder);
         cleanup(decoder);
+        decoder->decompress_cfg = {};
 
         desc.tile_count = get_video_mode_tiles_x(decoder->video_mode)
                         * get_video_mode_tiles_y(decoder->video_mode);
 
-        out_codec = choose_codec_and_decoder(decoder, desc, &decode_line, comp_int_prop);
+        if (decompress_cache_take(decoder, desc, comp_int_prop)) {
+                LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Using cached decompressor for " << desc << ".\n";
+                out_codec = decoder->decompress_cfg.out_codec;
+                decode_line = nullptr;
+        } else {
+                out_codec = choose_codec_and_decoder(decoder, desc, &decode_line, comp_int_prop);
+        }
         if (out_codec == VIDEO_CODEC_NONE) {
                 LOG(LOG_LEVEL_ERROR) << "Could not find neither line conversion nor decompress from " <<
                         get_codec_name(desc.color_spec) << " to display supported formats (" << codec_list_to_str(decoder->native_codecs) << ").\n";
@@ -1332,8 +1708,12 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
                 }
         } else if (decoder->decoder_type == EXTERNAL_DECODER) {
                 int buf_size;
+                struct state_video_decoder::decompress_config &cfg = decoder->decompress_cfg;
+                // cached states don't need to be reconfigured unless the display changed something
+                const bool cached_valid = cfg.out_codec == out_codec && cfg.pitch == decoder->pitch &&
+                        memcmp(cfg.rgb_shift, display_requested_rgb_shift, sizeof cfg.rgb_shift) == 0;
 
-                for(unsigned int i = 0; i < decoder->decompress_state.size(); ++i) {
+                for(unsigned int i = 0; i < decoder->decompress_state.size() && !cached_valid; ++i) {
                         buf_size = decompress_reconfigure(decoder->decompress_state.at(i), desc,
                                         display_requested_rgb_shift[0],
                                         display_requested_rgb_shift[1],
@@ -1344,6 +1724,13 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
                                 return false;
                         }
                 }
+                if (out_codec != VIDEO_CODEC_END) {
+                        cfg.desc = desc;
+                        cfg.comp_int_prop = comp_int_prop;
+                        cfg.out_codec = out_codec;
+                        memcpy(cfg.rgb_shift, display_requested_rgb_shift, sizeof cfg.rgb_shift);
+                        cfg.pitch = decoder->pitch;
+                }
                 decoder->merged_fb = display_mode != DISPLAY_PROPERTY_VIDEO_SEPARATE_TILES;
                 int res = 0, ret;
                 size_t size = sizeof(res);
@@ -1351,8 +1738,16 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
                                 DECOMPRESS_PROPERTY_ACCEPTS_CORRUPTED_FRAME,
                                 &res, &size);
                 decoder->accepts_corrupted_frame = ret && res;
+                size = sizeof(res);
+                if (decompress_get_property(decoder->decompress_state.at(0),
+                                        DECOMPRESS_PROPERTY_OUTPUT_DELAY,
+                                        &res, &size) && res > 0) {
+                        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Decompressor output is delayed by " << res << " frame(s).\n";
+                }
         }
 
+        set_skipped_tiles(decoder, desc);
+
         // Pass metadata to receiver thread (it can tweak parameters)
         struct msg_receiver *msg = (struct msg_receiver *)
                 new_message(sizeof(struct msg_receiver));
@@ -1458,6 +1853,328 @@ static void check_for_mode_change(struct state_video_decoder *decoder,
 #define ERROR_GOTO_CLEANUP ret = FALSE; goto cleanup;
 #define max(a, b)       (((a) > (b))? (a): (b))
 
+/**
+ * Frame of an external (compressed) decoder reassembled directly as packets
+ * arrive (see @ref video_decoder_placement) so that decode_video_frame() does
+ * not need to copy the payloads again.
+ *
+ * For FEC-protected frames, just the received symbols are tracked so that the
+ * frame can be passed to FEC as soon as it is decodable.
+ */
+struct placed_frame {
+        struct video_frame *frame;
+        bool valid; ///< all packets received so far have been placed
+        vector<unique_ptr<fec_progress>> fec; ///< per substream (FEC frames only)
+        unsigned int fec_decodable;
+};
+
+static void *placed_frame_init(void *udata, const rtp_packet *pkt)
+{
+        auto *decoder = (struct state_video_decoder *) udata;
+        if ((pkt->pt == PT_VIDEO_LDGM || pkt->pt == PT_VIDEO_RS) && decoder->early_fec) {
+                auto *pf = new placed_frame{nullptr, false, {}, 0};
+                pf->fec.resize(decoder->max_substreams);
+                return pf;
+        }
+        if (decoder->decoder_type != EXTERNAL_DECODER || pkt->pt != PT_VIDEO) {
+                return nullptr;
+        }
+        auto *pf = new placed_frame{vf_alloc(decoder->max_substreams), true, {}, 0};
+        pf->frame->callbacks.data_deleter = vf_data_deleter;
+        return pf;
+}
+
+/// @returns true if all substreams of the frame can be already FEC-decoded
+static bool placed_frame_track_fec(struct placed_frame *pf, const rtp_packet *pkt)
+{
+        if (pkt->pt != PT_VIDEO_LDGM && pkt->pt != PT_VIDEO_RS) {
+                return false;
+        }
+        const auto *hdr = (const uint32_t *)(const void *) pkt->data;
+        const uint32_t substream = ntohl(hdr[0]) >> 22;
+        const uint32_t data_pos = ntohl(hdr[1]);
+        const int buffer_length = ntohl(hdr[2]);
+        const int len = pkt->data_len - (int) sizeof(fec_payload_hdr_t);
+        if (substream >= pf->fec.size()) {
+                return false;
+        }
+        auto &progress = pf->fec[substream];
+        if (!progress) {
+                const uint32_t tmp = ntohl(hdr[3]);
+                progress = unique_ptr<fec_progress>(new fec_progress(
+                                fec_desc(fec::fec_type_from_pt(pkt->pt), tmp >> 19,
+                                        0x1fff & (tmp >> 6)), buffer_length));
+        }
+        if (!progress->decodable() && progress->add(data_pos, len)) {
+                pf->fec_decodable += 1;
+        }
+        return pf->fec_decodable == pf->fec.size();
+}
+
+static bool placed_frame_place(void *udata, void *frame_ctx, const rtp_packet *pkt)
+{
+        auto *decoder = (struct state_video_decoder *) udata;
+        auto *pf = (struct placed_frame *) frame_ctx;
+        if (!pf->fec.empty()) {
+                return placed_frame_track_fec(pf, pkt);
+        }
+        if (!pf->valid) {
+                return false;
+        }
+        const auto *hdr = (const uint32_t *)(const void *) pkt->data;
+        const uint32_t substream = ntohl(hdr[0]) >> 22;
+        const uint32_t data_pos = ntohl(hdr[1]);
+        const uint32_t buffer_length = ntohl(hdr[2]);
+        const int len = pkt->data_len - (int) sizeof(video_payload_hdr_t);
+        // anything unusual is left to decode_video_frame()
+        if (decoder->decoder_type != EXTERNAL_DECODER || pkt->pt != PT_VIDEO ||
+            substream >= pf->frame->tile_count || len < 0 ||
+            data_pos + len > buffer_length) {
+                pf->valid = false;
+                return false;
+        }
+        if (substream < decoder->tile_skipped.size() &&
+            decoder->tile_skipped[substream]) {
+                return false;
+        }
+        struct tile *tile = &pf->frame->tiles[substream];
+        if (tile->data == nullptr) {
+                tile->data = (char *) malloc(buffer_length + PADDING);
+                tile->data_len = buffer_length;
+        } else if (tile->data_len != buffer_length) {
+                pf->valid = false;
+                return false;
+        }
+        memcpy(tile->data + data_pos, (const char *) hdr + sizeof(video_payload_hdr_t), len);
+        return false;
+}
+
+static void placed_frame_done(void *frame_ctx)
+{
+        auto *pf = (struct placed_frame *) frame_ctx;
+        vf_free(pf->frame);
+        delete pf;
+}
+
+const struct pbuf_placement video_decoder_placement = {
+        placed_frame_init,
+        placed_frame_place,
+        placed_frame_done,
+};
+
+/**
+ * Decodes (converts) packet payload with the line decoder to the display
+ * framebuffer tile.
+ * @returns 1 if the data were discarded because the framebuffer was too small
+ */
+static int line_decode_packet(const struct line_decoder *line_decoder,
+                struct tile *tile, uint32_t data_pos, const char *data, int len,
+                int prints)
+{
+        /* MAGIC, don't touch it, you definitely break it
+         *  *source* is data from network, *destination* is frame buffer
+         */
+
+        /* compute Y pos in source frame and convert it to
+         * byte offset in the destination frame
+         */
+        int y = (data_pos / line_decoder->src_linesize) * line_decoder->dst_pitch;
+
+        /* compute X pos in source frame */
+        int s_x = data_pos % line_decoder->src_linesize;
+
+        /* convert X pos from source frame into the destination frame.
+         * it is byte offset from the beginning of a line.
+         */
+        int d_x = s_x * line_decoder->conv_num / line_decoder->conv_den;
+
+        /* pointer to data payload in packet */
+        auto *source = (const unsigned char *)(data);
+
+        /* copy whole packet that can span several lines.
+         * we need to clip data (v210 case) or center data (RGBA, R10k cases)
+         */
+        while (len > 0) {
+                /* len id payload length in source BPP
+                 * decoder needs len in destination BPP, so convert it
+                 */
+                int l = len * line_decoder->conv_num / line_decoder->conv_den;
+
+                /* do not copy multiple lines, we need to
+                 * copy (& clip, center) line by line
+                 */
+                if (l + d_x > (int) line_decoder->dst_linesize) {
+                        l = line_decoder->dst_linesize - d_x;
+                }
+
+                /* compute byte offset in destination frame */
+                const uint32_t offset = y + d_x;
+
+                /* watch the SEGV */
+                if (l + line_decoder->base_offset + offset <= tile->data_len) {
+                        /*decode frame:
+                         * we have offset for destination
+                         * we update source contiguously
+                         * we pass {r,g,b}shifts */
+                        line_decoder->decode_line((unsigned char*)tile->data + line_decoder->base_offset + offset, source, l,
+                                        line_decoder->shifts[0], line_decoder->shifts[1],
+                                        line_decoder->shifts[2]);
+                        /* we decoded one line (or a part of one line) to the end of the line
+                         * so decrease *source* len by 1 line (or that part of the line */
+                        len -= line_decoder->src_linesize - s_x;
+                        /* jump in source by the same amount */
+                        source += line_decoder->src_linesize - s_x;
+                } else {
+                        /* this should not ever happen as we call reconfigure before each packet
+                         * iff reconfigure is needed. But if it still happens, something is terribly wrong
+                         * say it loudly
+                         */
+                        if((prints % 100) == 0) {
+                                log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
+                                                "Well this should not happened. Expect troubles pretty soon.\n");
+                        }
+                        return 1;
+                }
+                /* each new line continues from the beginning */
+                d_x = 0;        /* next line from beginning */
+                s_x = 0;
+                y += line_decoder->dst_pitch;  /* next line */
+        }
+        return 0;
+}
+
+/**
+ * Copies packet payload to the (compressed) frame tile.
+ * @returns 1 if the data were clipped because the buffer was too small
+ */
+static int copy_packet(struct tile *tile, int buffer_length, uint32_t data_pos,
+                const char *data, int len, int prints)
+{
+        int ret = 0;
+        if (data_pos + len > (unsigned) buffer_length) {
+                if((prints % 100) == 0) {
+                        log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
+                                        "Well this should not happened. Expect troubles pretty soon.\n");
+                }
+                ret = 1;
+                len = max<int>(0, buffer_length - data_pos);
+        }
+        memcpy(tile->data + data_pos, (const unsigned char *)data, len);
+        return ret;
+}
+
+/// packets of one substream copied by one worker
+struct substream_copy_task {
+        const struct line_decoder *line_decoder; ///< NULL for plain copy
+        struct tile *tile;
+        const vector<packet_payload> *packets;
+        int prints; ///< in - count of previous warnings, out - discarded packets
+};
+
+static void *substream_copy(void *arg)
+{
+        auto *task = (struct substream_copy_task *) arg;
+        const int prints = task->prints;
+        task->prints = 0;
+        for (const auto &p : *task->packets) {
+                if (task->line_decoder != nullptr) {
+                        task->prints += line_decode_packet(task->line_decoder,
+                                        task->tile, p.data_pos, p.data, p.len,
+                                        prints + task->prints);
+                } else {
+                        task->prints += copy_packet(task->tile, task->tile->data_len,
+                                        p.data_pos, p.data, p.len,
+                                        prints + task->prints);
+                }
+        }
+        return nullptr;
+}
+
+/**
+ * Copies packets collected per substream in decode_video_frame(), each
+ * substream by its own worker.
+ */
+static void decode_substreams_parallel(struct state_video_decoder *decoder,
+                struct substream_copy_task *tasks, int count, int *prints)
+{
+        for (int i = 0; i < count; ++i) {
+                tasks[i].packets = &decoder->substream_packets[i];
+                tasks[i].prints = *prints;
+        }
+        task_run_parallel(substream_copy, count, tasks, sizeof tasks[0], nullptr);
+        for (int i = 0; i < count; ++i) {
+                *prints += tasks[i].prints;
+        }
+}
+
+#define DECRYPT_BATCH 16 ///< packets decrypted by a worker at once
+
+static void decrypt_batch(size_t start, size_t end, void *udata)
+{
+        auto *decoder = (struct state_video_decoder *) udata;
+        struct openssl_decrypt *state = nullptr;
+        {
+                unique_lock<mutex> lk(decoder->decrypt_lock);
+                if (!decoder->decrypt_spare.empty()) {
+                        state = decoder->decrypt_spare.back();
+                        decoder->decrypt_spare.pop_back();
+                }
+        }
+        if (state == nullptr && decoder->dec_funcs->init(&state, decoder->passphrase.c_str()) != 0) {
+                for (size_t i = start; i < end; ++i) {
+                        decoder->decrypt_jobs[i].len = 0;
+                }
+                return;
+        }
+
+        for (size_t i = start; i < end; ++i) {
+                struct decrypt_job *job = &decoder->decrypt_jobs[i];
+                if (job->len < 0) {
+                        continue;
+                }
+                char *hdr = job->pckt->data;
+                const int media_hdr_len = job->pckt->pt == PT_ENCRYPT_VIDEO ?
+                        sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t);
+                char *ciphertext = hdr + sizeof(crypto_payload_hdr_t) + media_hdr_len;
+                // plaintext overwrites the ciphertext following the length and IV
+                job->len = decoder->dec_funcs->decrypt(state, ciphertext, job->len,
+                                hdr, media_hdr_len, ciphertext + OPENSSL_DECRYPT_IN_PLACE_OFFSET,
+                                job->mode);
+        }
+
+        unique_lock<mutex> lk(decoder->decrypt_lock);
+        decoder->decrypt_spare.push_back(state);
+}
+
+/**
+ * Decrypts all packets of the frame in batches on worker threads. The
+ * plaintext is written in place to the packet buffer, so that it can be
+ * copied to the frame in parallel as unencrypted data is.
+ *
+ * Packets with unknown payload type or cipher are left for
+ * decode_video_frame() to report.
+ */
+static void decrypt_packets(struct state_video_decoder *decoder, struct coded_data *cdata)
+{
+        decoder->decrypt_jobs.clear();
+        for ( ; cdata != nullptr; cdata = cdata->nxt) {
+                rtp_packet *pckt = cdata->data;
+                struct decrypt_job job = { pckt, MODE_AES128_NONE, -1 };
+                if (PT_VIDEO_IS_ENCRYPTED(pckt->pt)) {
+                        const size_t media_hdr_len = pckt->pt == PT_ENCRYPT_VIDEO ?
+                                sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t);
+                        const uint32_t crypto_hdr = ntohl(*(const uint32_t *)(const void *)(pckt->data + media_hdr_len));
+                        job.mode = (enum openssl_mode) (crypto_hdr >> 24);
+                        if (job.mode != MODE_AES128_NONE && job.mode <= MODE_AES128_MAX) {
+                                job.len = pckt->data_len - sizeof(crypto_payload_hdr_t) - media_hdr_len;
+                        }
+                }
+                decoder->decrypt_jobs.push_back(job);
+        }
+        task_parallel_for(decoder->decrypt_jobs.size(), DECRYPT_BATCH, 0,
+                        decrypt_batch, decoder);
+}
+
 /**
  * @brief Decodes a participant buffer representing one video frame.
  * @param cdata        PBUF buffer
@@ -1480,16 +2197,49 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
         // the following is just FEC related optimalization - normally we fill up
         // allocated buffers when we have compressed data. But in case of FEC, there
         // is just the FEC buffer present, so we point to it instead to copying
-        struct video_frame *frame = vf_alloc(max_substreams);
-        frame->callbacks.data_deleter = vf_data_deleter;
-        unique_ptr<map<int, int>[]> pckt_list(new map<int, int>[max_substreams]);
+        recv_frame_pool::item buf = decoder->frame_pool->get(max_substreams);
+        struct video_frame *frame = buf.frame;
+        vector<fec_ranges> &pckt_list = buf.pckt_list;
+        vector<unsigned int> &tile_capacity = buf.tile_capacity;
+        // payloads already copied to frame by video_decoder_placement hooks
+        bool placed = false;
+        if (stats->placed != nullptr) {
+                auto *pf = (struct placed_frame *) stats->placed;
+                if (pf->valid && pf->frame->tile_count == (unsigned) max_substreams) {
+                        vf_free(frame);
+                        frame = buf.frame = pf->frame;
+                        for (int i = 0; i < max_substreams; ++i) {
+                                tile_capacity[i] = frame->tiles[i].data ? frame->tiles[i].data_len + PADDING : 0;
+                        }
+                        placed = true;
+                } else {
+                        vf_free(pf->frame);
+                }
+                delete pf;
+        }
 
         int buffer_number = 0;
         bool buffer_swapped = false;
+        // copy (or line-decode) substreams in parallel
+        const bool parallel = max_substreams > 1;
+        unique_ptr<substream_copy_task[]> substream_tasks;
+        if (parallel) {
+                substream_tasks = unique_ptr<substream_copy_task[]>(new substream_copy_task[max_substreams]());
+                decoder->substream_packets.resize(max_substreams);
+        }
+        // the lists point to packet data owned by cdata, drop them on every return
+        struct substream_packets_clear {
+                vector<vector<packet_payload>> &lists;
+                ~substream_packets_clear() {
+                        for (auto &l : lists) {
+                                l.clear();
+                        }
+                }
+        } clear_substream_packets{decoder->substream_packets};
 
         // We have no framebuffer assigned, exitting
         if(!decoder->display) {
-                vf_free(frame);
+                decoder->frame_pool->put(std::move(buf));
                 return FALSE;
         }
 
@@ -1512,6 +2262,9 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
 
         frame->ssrc = cdata->data->ssrc;
         frame->timestamp = cdata->data->ts;
+        frame->presentation_time = stats->presentation_time;
+        frame->trace_id = 0;
+        frame->capture_time = 0;
         int pt = cdata->data->pt;
         if (PT_VIDEO_HAS_FEC(pt)) {
                 const uint32_t *hdr = (uint32_t *)(void *)cdata->data->data;
@@ -1524,7 +2277,11 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                     fec_desc(fec::fec_type_from_pt(pt), k, m, c, seed);
         }
 
-        while (cdata != NULL) {
+        if (decoder->decrypt) {
+                decrypt_packets(decoder, cdata);
+        }
+
+        for (size_t pckt_idx = 0; cdata != NULL; ++pckt_idx) {
                 int len;
                 const char *data;
                 rtp_packet *pckt = cdata->data;
@@ -1538,6 +2295,13 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                 buffer_number = tmp & 0x3fffff;
                 const int buffer_length = ntohl(hdr[2]);
 
+                if (pckt->extn != nullptr && frame->trace_id == 0 &&
+                    frame->capture_time == 0) {
+                        frame_trace_rtp_ext_parse(frame, pckt->extn_type,
+                                                  pckt->extn_len,
+                                                  pckt->extn + 4);
+                }
+
                 if (PT_VIDEO_IS_ENCRYPTED(pt)) {
                         if(!decoder->decrypt) {
                                 log_msg(LOG_LEVEL_ERROR, ENCRYPTED_ERR);
@@ -1608,18 +2372,12 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                         goto cleanup;
                 }
 
-                char plaintext[RTP_MAX_PACKET_LEN]; // will be actually shorter
-                if (PT_VIDEO_IS_ENCRYPTED(pt)) {
-                        int data_len;
-
-                        if((data_len = decoder->dec_funcs->decrypt(decoder->decrypt,
-                                        data, len,
-                                        (const char *) hdr, pt == PT_ENCRYPT_VIDEO ?
-                                        sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t),
-                                        plaintext, crypto_mode)) == 0) {
+                if (PT_VIDEO_IS_ENCRYPTED(pt)) { // already decrypted by decrypt_packets()
+                        const int data_len = decoder->decrypt_jobs[pckt_idx].len;
+                        if (data_len <= 0) {
                                 goto next_packet;
                         }
-                        data = (char *) plaintext;
+                        data += OPENSSL_DECRYPT_IN_PLACE_OFFSET;
                         len = data_len;
                 }
 
@@ -1633,14 +2391,20 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                         // hereafter, display framebuffer can be used, so we
                         // check if we got it
                         if (FRAMEBUFFER_NOT_READY(decoder)) {
-                                vf_free(frame);
+                                decoder->frame_pool->put(std::move(buf));
                                 return FALSE;
                         }
                 }
 
+                if ((pt == PT_VIDEO || pt == PT_ENCRYPT_VIDEO) &&
+                    substream < decoder->tile_skipped.size() &&
+                    decoder->tile_skipped[substream]) {
+                        goto next_packet; // outside of the shown region
+                }
+
                 buffer_num[substream] = buffer_number;
                 frame->tiles[substream].data_len = buffer_length;
-                pckt_list[substream][data_pos] = len;
+                pckt_list[substream].emplace_back(data_pos, len);
 
                 if ((pt == PT_VIDEO || pt == PT_ENCRYPT_VIDEO) && decoder->decoder_type == LINE_DECODER) {
                         struct tile *tile = NULL;
@@ -1656,103 +2420,44 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                         } else {
                                 tile = vf_get_tile(decoder->frame, 0);
                         }
-
-                        struct line_decoder *line_decoder =
-                                &decoder->line_decoder[substream];
-
                         /* End of critical section */
 
-                        /* MAGIC, don't touch it, you definitely break it
-                         *  *source* is data from network, *destination* is frame buffer
-                         */
-
-                        /* compute Y pos in source frame and convert it to
-                         * byte offset in the destination frame
-                         */
-                        int y = (data_pos / line_decoder->src_linesize) * line_decoder->dst_pitch;
-
-                        /* compute X pos in source frame */
-                        int s_x = data_pos % line_decoder->src_linesize;
-
-                        /* convert X pos from source frame into the destination frame.
-                         * it is byte offset from the beginning of a line.
-                         */
-                        int d_x = s_x * line_decoder->conv_num / line_decoder->conv_den;
-
-                        /* pointer to data payload in packet */
-                        auto *source = (const unsigned char *)(data);
-
-                        /* copy whole packet that can span several lines.
-                         * we need to clip data (v210 case) or center data (RGBA, R10k cases)
-                         */
-                        while (len > 0) {
-                                /* len id payload length in source BPP
-                                 * decoder needs len in destination BPP, so convert it
-                                 */
-                                int l = len * line_decoder->conv_num / line_decoder->conv_den;
-
-                                /* do not copy multiple lines, we need to
-                                 * copy (& clip, center) line by line
-                                 */
-                                if (l + d_x > (int) line_decoder->dst_linesize) {
-                                        l = line_decoder->dst_linesize - d_x;
-                                }
-
-                                /* compute byte offset in destination frame */
-                                const uint32_t offset = y + d_x;
-
-                                /* watch the SEGV */
-                                if (l + line_decoder->base_offset + offset <= tile->data_len) {
-                                        /*decode frame:
-                                         * we have offset for destination
-                                         * we update source contiguously
-                                         * we pass {r,g,b}shifts */
-                                        line_decoder->decode_line((unsigned char*)tile->data + line_decoder->base_offset + offset, source, l,
-                                                        line_decoder->shifts[0], line_decoder->shifts[1],
-                                                        line_decoder->shifts[2]);
-                                        /* we decoded one line (or a part of one line) to the end of the line
-                                         * so decrease *source* len by 1 line (or that part of the line */
-                                        len -= line_decoder->src_linesize - s_x;
-                                        /* jump in source by the same amount */
-                                        source += line_decoder->src_linesize - s_x;
-                                } else {
-                                        /* this should not ever happen as we call reconfigure before each packet
-                                         * iff reconfigure is needed. But if it still happens, something is terribly wrong
-                                         * say it loudly
-                                         */
-                                        if((prints % 100) == 0) {
-                                                log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
-                                                                "Well this should not happened. Expect troubles pretty soon.\n");
-                                        }
-                                        prints++;
-                                        len = 0;
-                                }
-                                /* each new line continues from the beginning */
-                                d_x = 0;        /* next line from beginning */
-                                s_x = 0;
-                                y += line_decoder->dst_pitch;  /* next line */
+                        if (parallel) {
+                                substream_tasks[substream].line_decoder = &decoder->line_decoder[substream];
+                                substream_tasks[substream].tile = tile;
+                                decoder->substream_packets[substream].push_back({data_pos, data, len});
+                        } else {
+                                prints += line_decode_packet(&decoder->line_decoder[substream],
+                                                tile, data_pos, data, len, prints);
                         }
                 } else { /* PT_VIDEO_LDGM or external decoder */
-                        if(!frame->tiles[substream].data) {
+                        if (placed && pt == PT_VIDEO && decoder->decoder_type == EXTERNAL_DECODER) {
+                                goto next_packet; // already copied on arrival
+                        }
+                        if (tile_capacity[substream] < (unsigned) buffer_length + PADDING) {
+                                free(frame->tiles[substream].data);
                                 frame->tiles[substream].data = (char *) malloc(buffer_length + PADDING);
+                                tile_capacity[substream] = buffer_length + PADDING;
                         }
 
-                        if (data_pos + len > (unsigned) buffer_length) {
-                                if((prints % 100) == 0) {
-                                        log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
-                                                        "Well this should not happened. Expect troubles pretty soon.\n");
-                                }
-                                prints++;
-                                len = max<int>(0, buffer_length - data_pos);
+                        if (parallel) {
+                                substream_tasks[substream].line_decoder = nullptr;
+                                substream_tasks[substream].tile = &frame->tiles[substream];
+                                decoder->substream_packets[substream].push_back({data_pos, data, len});
+                        } else {
+                                prints += copy_packet(&frame->tiles[substream], buffer_length,
+                                                data_pos, data, len, prints);
                         }
-                        memcpy(frame->tiles[substream].data + data_pos,
-                               (const unsigned char *)data, len);
                 }
 
 next_packet:
                 cdata = cdata->nxt;
         }
 
+        if (parallel) {
+                decode_substreams_parallel(decoder, substream_tasks.get(), max_substreams, &prints);
+        }
+
         if (FRAMEBUFFER_NOT_READY(decoder) && (pt == PT_VIDEO || pt == PT_ENCRYPT_VIDEO)) {
                 ret = FALSE;
                 goto cleanup;
@@ -1760,6 +2465,10 @@ next_packet:
 
         assert(ret == TRUE);
 
+        for (int i = 0; i < max_substreams; ++i) {
+                fec_ranges_normalize(pckt_list[i]);
+        }
+
         /// Zero missing parts of framebuffer - this may be useful for compressed video
         /// (which may be also with FEC - but we use systematic codes therefore it may
         /// benefit from that as well).
@@ -1788,11 +2497,17 @@ next_packet:
                 pbuf_data->max_frame_size =
                     max(pbuf_data->max_frame_size, frame_size);
                 // format message
+                frame_trace_event(frame->trace_id, FRAME_TRACE_RECV);
+                frame->recv_time = frame->capture_time != 0 ? get_time_in_ns() : 0;
                 unique_ptr <frame_msg> fec_msg (new frame_msg(decoder->control, decoder->stats));
                 fec_msg->buffer_num = std::move(buffer_num);
                 fec_msg->recv_frame = frame;
-                frame = NULL;
+                fec_msg->nofec_frame = buf.nofec_frame;
                 fec_msg->pckt_list = std::move(pckt_list);
+                fec_msg->tile_capacity = std::move(tile_capacity);
+                fec_msg->tile_skipped = decoder->tile_skipped;
+                fec_msg->pool = decoder->frame_pool;
+                frame = buf.frame = buf.nofec_frame = NULL;
                 fec_msg->received_pkts_cum = stats->received_pkts_cum;
                 fec_msg->expected_pkts_cum = stats->expected_pkts_cum;
 
@@ -1808,7 +2523,7 @@ next_packet:
 cleanup:
         ;
         if(ret != TRUE) {
-                vf_free(frame);
+                decoder->frame_pool->put(std::move(buf));
         }
         pbuf_data->decoded++;
 
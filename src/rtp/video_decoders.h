@@ -56,6 +56,7 @@
 struct coded_data;
 struct display;
 struct module;
+struct pbuf_placement;
 struct state_video_decoder;
 struct video_desc;
 struct video_frame;
@@ -67,12 +68,16 @@ extern "C" {
 #endif // __cplusplus
 
 int decode_video_frame(struct coded_data *received_data, void *decoder_data, struct pbuf_stats *stats);
+/// pbuf hooks reassembling compressed frames on packet arrival, udata is struct state_video_decoder
+extern const struct pbuf_placement video_decoder_placement;
 
 struct state_video_decoder *video_decoder_init(struct module *parent, enum video_mode,
                 struct display *display, const char *encryption);
 void video_decoder_destroy(struct state_video_decoder *decoder);
 bool video_decoder_register_display(struct state_video_decoder *decoder, struct display *display);
 void video_decoder_remove_display(struct state_video_decoder *decoder);
+void video_decoder_get_busy_drops(struct state_video_decoder *decoder,
+                unsigned long *frames, unsigned long *drops);
 bool parse_video_hdr(const uint32_t *hdr, struct video_desc *desc);
 
 /** @} */ // end of video_rtp_decoder
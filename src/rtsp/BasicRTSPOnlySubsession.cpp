@@ -48,6 +48,7 @@
 #include <RTSPServer.hh>
 #include <GroupsockHelper.hh>
 
+#include "host.h"
 #include "messaging.h"
 #include "utils/macros.h"
 #include "utils/sdp.h"
@@ -67,8 +68,6 @@ BasicRTSPOnlySubsession::BasicRTSPOnlySubsession(UsageEnvironment& env,
 		int audio_bps, int rtp_port, int rtp_port_audio) :
 		ServerMediaSubsession(env), fSDPLines(NULL), fReuseFirstSource(
 				reuseFirstSource), fLastStreamToken(NULL) {
-	Vdestination = NULL;
-	Adestination = NULL;
 	gethostname(fCNAME, sizeof fCNAME);
 	this->fmod = mod;
 	this->avType = avType;
@@ -83,8 +82,6 @@ BasicRTSPOnlySubsession::BasicRTSPOnlySubsession(UsageEnvironment& env,
 
 BasicRTSPOnlySubsession::~BasicRTSPOnlySubsession() {
 	delete[] fSDPLines;
-	delete Adestination;
-	delete Vdestination;
 }
 
 char const* BasicRTSPOnlySubsession::sdpLines() {
@@ -166,30 +163,40 @@ void BasicRTSPOnlySubsession::setSDPLines() {
 	}
 }
 
-void BasicRTSPOnlySubsession::getStreamParameters(unsigned /* clientSessionId */,
+void BasicRTSPOnlySubsession::getStreamParameters(unsigned clientSessionId,
 		netAddressBits clientAddress, Port const& clientRTPPort,
 		Port const& clientRTCPPort, int /* tcpSocketNum */,
 		unsigned char /* rtpChannelId */, unsigned char /* rtcpChannelId */,
 		netAddressBits& destinationAddress, uint8_t& /*destinationTTL*/,
-		Boolean& /* isMulticast */, Port& serverRTPPort, Port& serverRTCPPort,
+		Boolean& isMulticast, Port& serverRTPPort, Port& serverRTCPPort,
 		void*& /* streamToken */) {
+	if (fSDPLines == NULL) {
+		setSDPLines();
+	}
+	const char *mcast_group = get_commandline_param("rtsp-multicast");
+	if (mcast_group != NULL) {
+		// all clients share one copy of the stream
+		destinationAddress = inet_addr(mcast_group);
+		isMulticast = True;
+	} else {
+		isMulticast = False;
+	}
+	if (destinationAddress == 0) {
+		destinationAddress = clientAddress;
+	}
+	struct in_addr destinationAddr;
+	destinationAddr.s_addr = destinationAddress;
+
 	if (avType == video || avType == av) {
 		Port rtp(rtp_port);
 		serverRTPPort = rtp;
 		Port rtcp(rtp_port + 1);
 		serverRTCPPort = rtcp;
 
-		if (fSDPLines == NULL) {
-			setSDPLines();
-		}
-		if (destinationAddress == 0) {
-			destinationAddress = clientAddress;
-		}
-		struct in_addr destinationAddr;
-		destinationAddr.s_addr = destinationAddress;
-		delete Vdestination;
-		Vdestination = new Destinations(destinationAddr, clientRTPPort,
-				clientRTCPPort);
+		fVDestinations.erase(clientSessionId);
+		fVDestinations.emplace(clientSessionId, Destinations(destinationAddr,
+				isMulticast ? rtp : clientRTPPort,
+				isMulticast ? rtcp : clientRTCPPort));
 	}
 	if (avType == audio || avType == av) {
 		Port rtp(rtp_port_audio);
@@ -197,149 +204,73 @@ void BasicRTSPOnlySubsession::getStreamParameters(unsigned /* clientSessionId */
 		Port rtcp(rtp_port_audio + 1);
 		serverRTCPPort = rtcp;
 
-		if (fSDPLines == NULL) {
-			setSDPLines();
-		}
-		if (destinationAddress == 0) {
-			destinationAddress = clientAddress;
-		}
-		struct in_addr destinationAddr;
-		destinationAddr.s_addr = destinationAddress;
-		delete Adestination;
-		Adestination = new Destinations(destinationAddr, clientRTPPort,
-				clientRTCPPort);
+		fADestinations.erase(clientSessionId);
+		fADestinations.emplace(clientSessionId, Destinations(destinationAddr,
+				isMulticast ? rtp : clientRTPPort,
+				isMulticast ? rtcp : clientRTCPPort));
 	}
 }
 
-void BasicRTSPOnlySubsession::startStream(unsigned /* clientSessionId */,
+/**
+ * Adds or removes the client to/from the set of destinations of the sender.
+ * The stream is packetized once and the packets are replicated to all clients
+ * (same destination, eg. multicast group, is reference-counted).
+ */
+void BasicRTSPOnlySubsession::notifySender(bool audio,
+		enum msg_sender_type type, Destinations const& dest) {
+	char path[1024] = "";
+	enum module_class path_video[] = { MODULE_CLASS_SENDER,
+			MODULE_CLASS_NONE };
+	enum module_class path_audio[] = { MODULE_CLASS_AUDIO,
+			MODULE_CLASS_SENDER, MODULE_CLASS_NONE };
+	append_message_path(path, sizeof(path), audio ? path_audio : path_video);
+
+	struct msg_sender *msg = (struct msg_sender *) new_message(
+			sizeof(struct msg_sender));
+	msg->type = type;
+	strncpy(msg->dest.addr, inet_ntoa(dest.addr), sizeof(msg->dest.addr) - 1);
+	msg->dest.rtp_port = ntohs(dest.rtpPort.num());
+	msg->dest.rtcp_port = ntohs(dest.rtcpPort.num());
+	struct response *resp = send_message(fmod, path, (struct message *) msg);
+	free_response(resp);
+}
+
+void BasicRTSPOnlySubsession::startStream(unsigned clientSessionId,
 		void* /* streamToken */, TaskFunc* /* rtcpRRHandler */,
 		void* /* rtcpRRHandlerClientData */, unsigned short& /* rtpSeqNum */,
 		unsigned& /* rtpTimestamp */,
 		ServerRequestAlternativeByteHandler* /* serverRequestAlternativeByteHandler */,
 		void* /* serverRequestAlternativeByteHandlerClientData */) {
-	struct response *resp = NULL;
-
-	if (Vdestination != NULL) {
-		if (avType == video || avType == av) {
-			char pathV[1024];
-
-			memset(pathV, 0, sizeof(pathV));
-			enum module_class path_sender[] = { MODULE_CLASS_SENDER,
-					MODULE_CLASS_NONE };
-			append_message_path(pathV, sizeof(pathV), path_sender);
-
-			//CHANGE DST PORT
-			struct msg_sender *msgV1 = (struct msg_sender *) new_message(
-					sizeof(struct msg_sender));
-			msgV1->tx_port = ntohs(Vdestination->rtpPort.num());
-			msgV1->type = SENDER_MSG_CHANGE_PORT;
-			resp = send_message(fmod, pathV, (struct message *) msgV1);
-			free_response(resp);
-
-			//CHANGE DST ADDRESS
-			struct msg_sender *msgV2 = (struct msg_sender *) new_message(
-					sizeof(struct msg_sender));
-			strncpy(msgV2->receiver, inet_ntoa(Vdestination->addr),
-					sizeof(msgV2->receiver) - 1);
-			msgV2->type = SENDER_MSG_CHANGE_RECEIVER;
-
-			resp = send_message(fmod, pathV, (struct message *) msgV2);
-			free_response(resp);
-		}
+	auto v = fVDestinations.find(clientSessionId);
+	if (v != fVDestinations.end() && !fStarted.count(clientSessionId)) {
+		notifySender(false, SENDER_MSG_ADD_RECEIVER, v->second);
 	}
-
-	if (Adestination != NULL) {
-		if (avType == audio || avType == av) {
-			char pathA[1024];
-
-			memset(pathA, 0, sizeof(pathA));
-			enum module_class path_sender[] = { MODULE_CLASS_AUDIO,
-					MODULE_CLASS_SENDER, MODULE_CLASS_NONE };
-			append_message_path(pathA, sizeof(pathA), path_sender);
-
-			//CHANGE DST PORT
-			struct msg_sender *msgA1 = (struct msg_sender *) new_message(
-					sizeof(struct msg_sender));
-			msgA1->tx_port = ntohs(Adestination->rtpPort.num());
-			msgA1->type = SENDER_MSG_CHANGE_PORT;
-			resp = send_message(fmod, pathA, (struct message *) msgA1);
-			free_response(resp);
-			resp = NULL;
-
-			//CHANGE DST ADDRESS
-			struct msg_sender *msgA2 = (struct msg_sender *) new_message(
-					sizeof(struct msg_sender));
-			strncpy(msgA2->receiver, inet_ntoa(Adestination->addr),
-					sizeof(msgA2->receiver) - 1);
-			msgA2->type = SENDER_MSG_CHANGE_RECEIVER;
-
-			resp = send_message(fmod, pathA, (struct message *) msgA2);
-			free_response(resp);
-			resp = NULL;
-		}
+	auto a = fADestinations.find(clientSessionId);
+	if (a != fADestinations.end() && !fStarted.count(clientSessionId)) {
+		notifySender(true, SENDER_MSG_ADD_RECEIVER, a->second);
 	}
+	fStarted.insert(clientSessionId);
 }
 
-void BasicRTSPOnlySubsession::deleteStream(unsigned /* clientSessionId */,
+void BasicRTSPOnlySubsession::deleteStream(unsigned clientSessionId,
 		void*& /* streamToken */) {
-	if (Vdestination != NULL) {
-		if (avType == video || avType == av) {
-			char pathV[1024];
-			delete Vdestination;
-			Vdestination = NULL;
-			memset(pathV, 0, sizeof(pathV));
-			enum module_class path_sender[] = { MODULE_CLASS_SENDER,
-					MODULE_CLASS_NONE };
-			append_message_path(pathV, sizeof(pathV), path_sender);
-
-			//CHANGE DST PORT
-			struct msg_sender *msgV1 = (struct msg_sender *) new_message(
-					sizeof(struct msg_sender));
-			msgV1->tx_port = rtp_port;
-			msgV1->type = SENDER_MSG_CHANGE_PORT;
-			struct response *resp;
-			resp = send_message(fmod, pathV, (struct message *) msgV1);
-			free_response(resp);
-
-			//CHANGE DST ADDRESS
-			struct msg_sender *msgV2 = (struct msg_sender *) new_message(
-					sizeof(struct msg_sender));
-			strncpy(msgV2->receiver, "127.0.0.1", sizeof(msgV2->receiver) - 1);
-			msgV2->type = SENDER_MSG_CHANGE_RECEIVER;
-			resp = send_message(fmod, pathV, (struct message *) msgV2);
-			free_response(resp);
+	const bool started = fStarted.erase(clientSessionId) > 0;
+	auto v = fVDestinations.find(clientSessionId);
+	if (v != fVDestinations.end()) {
+		if (started) {
+			notifySender(false, SENDER_MSG_REMOVE_RECEIVER, v->second);
 		}
+		fVDestinations.erase(v);
 	}
-
-	if (Adestination != NULL) {
-		if (avType == audio || avType == av) {
-			char pathA[1024];
-			delete Vdestination;
-			Adestination = NULL;
-			memset(pathA, 0, sizeof(pathA));
-			enum module_class path_sender[] = { MODULE_CLASS_AUDIO,
-					MODULE_CLASS_SENDER, MODULE_CLASS_NONE };
-			append_message_path(pathA, sizeof(pathA), path_sender);
-
-			//CHANGE DST PORT
-			struct msg_sender *msgA1 = (struct msg_sender *) new_message(
-					sizeof(struct msg_sender));
-
-			//TODO: GET AUDIO PORT SET (NOT A COMMON CASE WHEN RTSP IS ENABLED: DEFAULT -> vport + 2)
-			msgA1->tx_port = rtp_port_audio;
-			msgA1->type = SENDER_MSG_CHANGE_PORT;
-			struct response *resp;
-                        resp = send_message(fmod, pathA, (struct message *) msgA1);
-			free_response(resp);
-
-			//CHANGE DST ADDRESS
-			struct msg_sender *msgA2 = (struct msg_sender *) new_message(
-					sizeof(struct msg_sender));
-			strncpy(msgA2->receiver, "127.0.0.1", sizeof(msgA2->receiver) - 1);
-			msgA2->type = SENDER_MSG_CHANGE_RECEIVER;
-			resp = send_message(fmod, pathA, (struct message *) msgA2);
-			free_response(resp);
+	auto a = fADestinations.find(clientSessionId);
+	if (a != fADestinations.end()) {
+		if (started) {
+			notifySender(true, SENDER_MSG_REMOVE_RECEIVER, a->second);
 		}
+		fADestinations.erase(a);
 	}
 }
+
+ADD_TO_PARAM("rtsp-multicast", "* rtsp-multicast=<group>\n"
+		"  RTSP server offers the stream to clients only over the multicast group instead of unicast copies.\n");
 /* vi: set noexpandtab: */
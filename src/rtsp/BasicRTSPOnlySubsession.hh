@@ -48,8 +48,12 @@
 #include <ServerMediaSession.hh>
 #endif
 
+#include <map>
+#include <set>
+
 #include "rtsp/rtsp_utils.h"
 #include "audio/types.h"
+#include "messaging.h"
 #include "module.h"
 #include "control_socket.h"
 
@@ -130,12 +134,14 @@ protected:
 protected:
 
     char* fSDPLines;
-    Destinations* Vdestination;
-    Destinations* Adestination;
+    std::map<unsigned, Destinations> fVDestinations; ///< indexed by client session ID
+    std::map<unsigned, Destinations> fADestinations;
+    std::set<unsigned> fStarted; ///< client sessions added to the sender
 
 private:
 
     void setSDPLines();
+    void notifySender(bool audio, enum msg_sender_type type, Destinations const& dest);
 
     MAYBE_UNUSED_ATTRIBUTE Boolean fReuseFirstSource;
     MAYBE_UNUSED_ATTRIBUTE void* fLastStreamToken;
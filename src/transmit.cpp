@@ -58,6 +58,8 @@
 
 #include <algorithm>
 #include <array>
+#include <cinttypes>
+#include <cmath>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -70,6 +72,7 @@
 #include "debug.h"
 #include "host.h"
 #include "lib_common.h"
+#include "messaging.h"
 #include "module.h"
 #include "rtp/fec.h"
 #include "rtp/rtp.h"
@@ -77,9 +80,14 @@
 #include "rtp/rtpenc_h264.h"
 #include "transmit.h"
 #include "tv.h"
+#include "utils/frame_drops.h"
+#include "utils/frame_trace.h"
 #include "utils/jpeg_reader.h"
+#include "utils/macros.h"
+#include "utils/metrics.h"
 #include "utils/misc.h" // unit_evaluate
 #include "utils/random.h"
+#include "utils/worker.h" // task_run_parallel
 #include "video.h"
 #include "video_codec.h"
 
@@ -89,6 +97,29 @@
 #define FEC_MAX_MULT 10
 
 #define CONTROL_PORT_BANDWIDTH_REPORT_INTERVAL_NS NS_IN_SEC
+/// packets that fit in this interval are sent as a single burst (batch) and
+/// the traffic shaper waits after the burst instead of after every packet
+#define TX_MAX_BURST_NS (20 * NS_IN_US)
+#define TX_MAX_BURST_PACKETS 64
+/// departure time of first packet of a frame with kernel pacing (SO_TXTIME)
+#define TX_TXTIME_LEAD_NS (200 * NS_IN_US)
+/// burst sent sooner than this fraction of its nominal interval exceeds the
+/// configured rate (busy-wait shaper compensating previous overshoot)
+#define TX_EXCESS_BURST_RATIO 0.9
+/// video packets are encrypted by up to this many workers in parallel
+#define TX_MAX_ENC_WORKERS 16
+#define TX_DEFAULT_ENC_WORKERS 8
+/// minimal number of packets encrypted by a worker (smaller tiles are
+/// not worth of dispatching)
+#define TX_ENC_MIN_PACKETS_PER_WORKER 64
+/// how often is path MTU rechecked for ICMP-lowered value (--param tx-pmtu)
+#define TX_PMTU_CHECK_INTERVAL_NS NS_IN_SEC
+#define TX_PMTU_MIN 576
+/// adaptive FEC (-f ldgm:auto, rs:auto) - reported loss below this is clean link
+#define FEC_AUTO_CLEAN_LOSS 0.001
+/// count of consecutive receiver reports needed to lower the redundancy
+#define FEC_AUTO_DOWN_REPORTS 5
+#define FEC_AUTO_DEFAULT_MAX_OVERHEAD 0.5
 
 #ifdef __APPLE__
 #define GET_STARTTIME gettimeofday(&start, NULL)
@@ -114,14 +145,17 @@ static void tx_done(struct module *tx);
 static uint32_t format_interl_fps_hdr_row(enum interlacing_t interlacing, double input_fps);
 
 static void
-tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
+tx_send_base(struct tx *tx, struct video_frame *frame,
+                struct rtp *const *rtp_sessions, int session_count,
                 uint32_t ts, int send_m,
                 unsigned int substream,
                 int fragment_offset);
 
 
 static bool set_fec(struct tx *tx, const char *fec);
-static void fec_check_messages(struct tx *tx);
+static bool tx_init_enc_workers(struct tx *tx, const char *passphrase);
+static void fec_check_messages(struct tx *tx, struct rtp *rtp_session);
+static bool rate_ctl_init(struct rate_ctl *rc, const char *cfg);
 
 struct rate_limit_dyn {
         unsigned long avg_frame_size;   ///< moving average
@@ -129,12 +163,96 @@ struct rate_limit_dyn {
         static constexpr int EXCESS_GAP = 4; ///< minimal gap between excessive frames
 };
 
+/**
+ * Loss-driven FEC selection - redundancy follows the loss reported in RTCP
+ * receiver reports. Redundancy is raised immediately, lowered only after
+ * FEC_AUTO_DOWN_REPORTS consecutive reports asking for less.
+ */
+struct fec_auto {
+        bool enabled;
+        enum fec_type scheme; ///< FEC_LDGM or FEC_RS
+        double max_overhead; ///< bandwidth ceiling - max. redundancy to payload ratio
+        double loss; ///< smoothed reported loss (fraction)
+        uint32_t last_report; ///< count of the last processed receiver report
+        int level; ///< current index to fec_auto_levels
+        int lower_reports; ///< consecutive reports asking for a lower level
+};
+
+/**
+ * Congestion control of the sending rate (similar to loss-based part of
+ * Google Congestion Control) driven by RTCP receiver reports - the rate is
+ * lowered by half of the reported loss if it exceeds RATE_CTL_LOSS_HIGH or
+ * by RATE_CTL_DELAY_DECREASE if RTT grows over the minimum (queues filling),
+ * it is increased by RATE_CTL_INCREASE per second while the path is clean.
+ *
+ * The rate caps the packet pacing and is announced to the encoder.
+ */
+struct rate_ctl {
+        bool enabled;
+        double min_rate; ///< [bps]
+        double max_rate;
+        double rate; ///< current target
+        uint32_t last_report; ///< count of the last processed receiver report
+        time_ns_t last_update;
+        double min_rtt; ///< lowest RTT seen [s], 0 if not yet known
+        long long enc_rate; ///< last bitrate passed to the encoder
+};
+#define RATE_CTL_LOSS_HIGH 0.10
+#define RATE_CTL_LOSS_LOW 0.02
+#define RATE_CTL_INCREASE 1.08
+#define RATE_CTL_DELAY_DECREASE 0.85
+#define RATE_CTL_RTT_SLACK 0.05 ///< RTT excess over minimum [s] considered as queueing
+#define RATE_CTL_ENC_STEP 0.10 ///< minimal relative change passed to the encoder
+#define RATE_CTL_ENC_SHARE 0.9 ///< part of the rate left to encoder (headers, FEC)
+
+/**
+ * Reaction to receiver overload reports (rtp_send_overload_report()) - for
+ * intra-only codecs, the share of frames reported as dropped by the receiver
+ * (plus OVERLOAD_HEADROOM) is not sent at all. The skipped share decays by
+ * OVERLOAD_RECOVERY per second once the reports stop or report recovery.
+ */
+struct overload_ctl {
+        uint32_t last_report; ///< count of the last processed overload report
+        time_ns_t last_update;
+        double skip;   ///< share of frames not sent, 0 - full frame rate
+        double credit; ///< accumulated share of frames to be sent
+};
+#define OVERLOAD_HEADROOM 0.05
+#define OVERLOAD_MAX_SKIP 0.9
+#define OVERLOAD_RECOVERY 0.05
+#define OVERLOAD_REPORT_TIMEOUT_NS (3 * NS_IN_SEC)
+
+/**
+ * Sender-side dropping of frames that would leave too late (--param
+ * tx-drop-late) - the link is considered saturated when the previous frame
+ * took longer to send than the frame interval or when the socket send queue
+ * (SIOCOUTQ) cannot be drained at the measured throughput before the next
+ * frame. Intra-only frames are then skipped, for inter-frame codecs the
+ * sending and encoder rate is lowered to the measured throughput instead
+ * (requires tx-rate-adapt).
+ */
+struct congest_ctl {
+        bool enabled;
+        long long last_send_ns; ///< send duration of the last frame, 0 if consumed
+        long long last_interval_ns; ///< frame interval of the last frame
+        double throughput; ///< achieved rate when sending the last frame [bps]
+        int skipped; ///< consecutive skipped frames
+};
+#define CONGEST_MAX_SKIP 4 ///< send at least every n-th frame even if late
+
+/// redundancy (FEC to payload ratio) levels used by adaptive FEC
+static const double fec_auto_levels[] = { 0.0, 0.05, 0.10, 0.15, 0.20, 0.30, 0.40, 0.50, 0.75, 1.0 };
+
 struct tx {
         struct module mod;
 
         uint32_t magic;
         enum tx_media_type media_type;
         unsigned mtu;
+        unsigned max_mtu; ///< -m value, upper bound for path MTU discovery
+        bool pmtu_discovery; ///< --param tx-pmtu
+        struct rtp *pmtu_session; ///< session the path was probed for, see tx_probe_path_mtu()
+        time_ns_t pmtu_next_check;
         double max_loss;
 
         uint32_t last_ts;
@@ -147,6 +265,10 @@ struct tx {
 
         enum fec_type fec_scheme;
         int mult_count;
+        struct fec_auto fec_auto;
+        struct rate_ctl rate_ctl;
+        struct overload_ctl overload_ctl;
+        struct congest_ctl congest_ctl;
 
         int last_fragment;
 
@@ -158,6 +280,45 @@ struct tx {
         struct openssl_encrypt *encryption;
         long long int bitrate;
         struct rate_limit_dyn dyn_rate_limit_state;
+
+        bool kernel_pacing; ///< use SO_TXTIME instead of busy-wait shaper
+        struct rtp *txtime_session; ///< session with SO_TXTIME enabled
+        uint64_t txtime_last; ///< departure time of last scheduled packet
+        long long pacing_err_ns; ///< busy-wait shaper overshoot since last report
+        long pacing_waits;
+        /// video pacing statistics since last report, updated by tx_pacer
+        struct {
+                long frames;
+                double send_ratio_sum; ///< frame send duration / frame interval
+                double send_ratio_max;
+                long bursts;
+                long excess_bursts; ///< bursts above the configured rate
+                long long max_gap_ns; ///< avg inter-packet gap of a burst
+                long long max_overslept_ns; ///< residual at the frame end
+        } pacing_stats;
+        FILE *timeline; ///< per-frame send timeline (--param tx-timeline)
+
+        // registered on the first report_stats() (SSRC label)
+        struct metric *metric_bytes;
+        // video only
+        struct metric *metric_pacing;
+        struct metric *metric_gap;
+        struct metric *metric_send_ratio;
+        struct metric *metric_excess;
+        struct metric *metric_overslept;
+
+        /// per-worker cipher contexts (EVP contexts are not thread-safe),
+        /// enc_states[0] is the encryption member
+        struct openssl_encrypt *enc_states[TX_MAX_ENC_WORKERS];
+        int enc_workers;
+        char *enc_arena; ///< encrypted packets of the currently sent tile
+        size_t enc_arena_size;
+        int *enc_lens;
+        size_t enc_lens_count;
+
+        bool audio_bundle; ///< send all channels in common packets (PT_AUDIO_BUNDLE)
+        char *bundle_buf;
+        size_t bundle_buf_size;
 		
         char tmp_packet[RTP_MAX_MTU];
 };
@@ -225,6 +386,7 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
         tx->mult_count = 1;
         tx->max_loss = 0.0;
         tx->mtu = mtu;
+        tx->max_mtu = mtu;
         tx->buffer = ug_rand() & 0x3fffff;
         tx->avg_len = tx->avg_len_last = tx->sent_frames = 0u;
         tx->fec_scheme = FEC_NONE;
@@ -249,9 +411,53 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
                         module_done(&tx->mod);
                         return NULL;
                 }
+                if (!tx_init_enc_workers(tx, encryption)) {
+                        module_done(&tx->mod);
+                        return NULL;
+                }
         }
 
         tx->bitrate = bitrate;
+        if (media_type == TX_MEDIA_VIDEO &&
+            get_commandline_param("tx-rate-adapt") != nullptr) {
+                if (!rate_ctl_init(&tx->rate_ctl,
+                                   get_commandline_param("tx-rate-adapt"))) {
+                        module_done(&tx->mod);
+                        return NULL;
+                }
+                tx->bitrate = llround(tx->rate_ctl.rate);
+        }
+
+        tx->audio_bundle = media_type == TX_MEDIA_AUDIO &&
+                           get_commandline_param("audio-tx-bundle") != nullptr;
+
+        const char *pacing = get_commandline_param("tx-pacing");
+        if (pacing != nullptr) {
+                if (strcmp(pacing, "txtime") == 0) {
+                        tx->kernel_pacing = true;
+                } else if (strcmp(pacing, "busy-wait") != 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown pacing mode: %s\n", pacing);
+                        module_done(&tx->mod);
+                        return NULL;
+                }
+        }
+
+        tx->pmtu_discovery = media_type == TX_MEDIA_VIDEO &&
+                             get_commandline_param("tx-pmtu") != nullptr;
+        tx->congest_ctl.enabled = media_type == TX_MEDIA_VIDEO &&
+                                  get_commandline_param("tx-drop-late") != nullptr;
+
+        const char *timeline = get_commandline_param("tx-timeline");
+        if (media_type == TX_MEDIA_VIDEO && timeline != nullptr) {
+                tx->timeline = fopen(timeline, "w");
+                if (tx->timeline == nullptr) {
+                        log_perror(LOG_LEVEL_ERROR, MOD_NAME "Cannot open TX timeline file");
+                        module_done(&tx->mod);
+                        return NULL;
+                }
+                fprintf(tx->timeline, "ssrc,rtp_ts,start_ns,duration_ns,frame_interval_ns,"
+                        "packets,bursts,excess_bursts,max_gap_ns,overslept_ns\n");
+        }
 
         if(parent)
                 tx->control = (struct control_state *) get_module(get_root_module(parent), "control");
@@ -259,6 +465,436 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
         return tx;
 }
 
+ADD_TO_PARAM("tx-pmtu", "* tx-pmtu\n"
+                "  Discover path MTU towards the receiver (Linux) and size video packets\n"
+                "  accordingly, -m is the upper bound (eg. -m 9000 for jumbo frames).\n");
+ADD_TO_PARAM("tx-timeline", "* tx-timeline=<file>\n"
+                "  Write per-frame video send timeline (start, duration, bursts) as CSV to the file.\n");
+
+ADD_TO_PARAM("tx-encrypt-threads", "* tx-encrypt-threads=<n>\n"
+                "  Number of threads encrypting video packets (default: number of cores, max "
+                TOSTRING(TX_DEFAULT_ENC_WORKERS) ")\n");
+/**
+ * Creates additional cipher contexts so that packets of a large tile can be
+ * encrypted in parallel (enc_states[0] is tx->encryption).
+ */
+static bool
+tx_init_enc_workers(struct tx *tx, const char *passphrase)
+{
+        tx->enc_states[0] = tx->encryption;
+        tx->enc_workers   = 1;
+        if (tx->media_type != TX_MEDIA_VIDEO) {
+                return true;
+        }
+        int workers = std::min(get_cpu_core_count(), TX_DEFAULT_ENC_WORKERS);
+        const char *threads = get_commandline_param("tx-encrypt-threads");
+        if (threads != nullptr) {
+                workers = atoi(threads);
+                if (workers < 1 || workers > TX_MAX_ENC_WORKERS) {
+                        log_msg(LOG_LEVEL_ERROR,
+                                MOD_NAME "Encryption thread count must be "
+                                "in range 1-%d!\n", TX_MAX_ENC_WORKERS);
+                        return false;
+                }
+        }
+        for (int i = 1; i < workers; ++i) {
+                if (tx->enc_funcs->init(&tx->enc_states[i], passphrase,
+                                        DEFAULT_CIPHER_MODE) != 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to "
+                                "initialize encryption\n");
+                        return false;
+                }
+                tx->enc_workers += 1;
+        }
+        MSG(VERBOSE, "Using %d encryption threads.\n", tx->enc_workers);
+        return true;
+}
+
+ADD_TO_PARAM("tx-pacing", "* tx-pacing=busy-wait|txtime\n"
+                "  Video packet pacing - busy-wait (default) or kernel pacing with SO_TXTIME\n"
+                "  (Linux, requires fq or etf qdisc on the outgoing interface).\n");
+/**
+ * @param cfg "auto[:max=<pct>]"
+ * @retval 1  adaptive FEC configured
+ * @retval 0  cfg doesn't request adaptive FEC
+ * @retval -1 invalid configuration
+ */
+static int parse_fec_auto(struct tx *tx, enum fec_type scheme, const char *cfg)
+{
+        if (cfg == nullptr || strncmp(cfg, "auto", 4) != 0 ||
+            (cfg[4] != '\0' && cfg[4] != ':')) {
+                return 0;
+        }
+        tx->fec_auto = {};
+        tx->fec_auto.scheme = scheme;
+        tx->fec_auto.max_overhead = FEC_AUTO_DEFAULT_MAX_OVERHEAD;
+        if (strncmp(cfg + 4, ":max=", 5) == 0) {
+                tx->fec_auto.max_overhead = atof(cfg + 9) / 100.0;
+        } else if (cfg[4] != '\0') {
+                MSG(ERROR, "Unknown adaptive FEC option: %s\n", cfg + 5);
+                return -1;
+        }
+        if (tx->fec_auto.max_overhead <= 0.0) {
+                MSG(ERROR, "Adaptive FEC maximal overhead must be positive!\n");
+                return -1;
+        }
+        tx->fec_auto.enabled = true;
+        return 1;
+}
+
+static void send_fec_change(struct tx *tx, const char *cfg)
+{
+        struct msg_sender *msg = (struct msg_sender *)
+                new_message(sizeof(struct msg_sender));
+        msg->type = SENDER_MSG_CHANGE_FEC;
+        snprintf(msg->fec_cfg, sizeof(msg->fec_cfg), "%s", cfg);
+        struct response *resp = send_message_to_receiver(get_parent_module(&tx->mod),
+                        (struct message *) msg);
+        free_response(resp);
+}
+
+/**
+ * Formats FEC configuration of given redundancy for the adaptive FEC.
+ */
+static void fec_auto_format_cfg(enum fec_type scheme, double overhead, char *buf, size_t buf_len)
+{
+        if (overhead == 0.0) {
+                snprintf(buf, buf_len, "flush");
+        } else if (scheme == FEC_LDGM) {
+                // LDGM requires k, m >= 64 (MINIMAL_VALUE in rtp/ldgm.cpp)
+                int k = 512;
+                int m = lround(k * overhead);
+                if (m < 64) {
+                        m = 64;
+                        k = lround(m / overhead);
+                }
+                int c = overhead < 0.25 ? 5 : overhead < 0.6 ? 6 : 8;
+                snprintf(buf, buf_len, "LDGM cfg %d:%d:%d", k, m, c);
+        } else {
+                int k = 200;
+                int n = lround(k * (1.0 + overhead));
+                if (n > 255) { // RS n is at most 255
+                        n = 255;
+                        k = lround(n / (1.0 + overhead));
+                }
+                snprintf(buf, buf_len, "RS cfg %d:%d", k, n);
+        }
+}
+
+/**
+ * Processes new receiver report (if any) and retunes FEC accordingly.
+ */
+static void fec_auto_update(struct tx *tx, struct rtp *rtp_session)
+{
+        struct fec_auto *fa = &tx->fec_auto;
+        uint32_t count = 0;
+        uint8_t fract_lost = 0;
+        if (!fa->enabled || rtp_session == nullptr ||
+            !rtp_get_loss_report(rtp_session, &count, &fract_lost) ||
+            count == fa->last_report) {
+                return;
+        }
+        fa->last_report = count;
+
+        // fast attack, slow decay
+        const double loss = fract_lost / 256.0;
+        fa->loss = loss > fa->loss ? loss : 0.8 * fa->loss + 0.2 * loss;
+
+        // LDGM is not MDS so it needs more redundancy than RS
+        const double factor = fa->scheme == FEC_LDGM ? 3.0 : 1.5;
+        const double needed = fa->loss < FEC_AUTO_CLEAN_LOSS ? 0.0 : fa->loss * factor + 0.02;
+        int target = 0;
+        for (int i = 1; i < (int) (sizeof fec_auto_levels / sizeof fec_auto_levels[0]); ++i) {
+                if (fec_auto_levels[i] > fa->max_overhead) {
+                        break;
+                }
+                target = i;
+                if (fec_auto_levels[i] >= needed) {
+                        break;
+                }
+        }
+        if (needed == 0.0) {
+                target = 0;
+        }
+
+        if (target < fa->level) {
+                if (++fa->lower_reports < FEC_AUTO_DOWN_REPORTS) {
+                        return;
+                }
+        } else if (target == fa->level) {
+                fa->lower_reports = 0;
+                return;
+        }
+        fa->lower_reports = 0;
+        fa->level = target;
+
+        char cfg[sizeof ((struct msg_sender *) nullptr)->fec_cfg];
+        fec_auto_format_cfg(fa->scheme, fec_auto_levels[target], cfg, sizeof cfg);
+        MSG(NOTICE, "Reported loss %.2f%% (smoothed %.2f%%), setting FEC redundancy to %.0f%% (%s).\n",
+                        loss * 100.0, fa->loss * 100.0, fec_auto_levels[target] * 100.0, cfg);
+        tx->fec_scheme = target == 0 ? FEC_NONE : fa->scheme;
+        send_fec_change(tx, cfg);
+}
+
+/**
+ * codecs whose encoders (lavc, J2K) change bitrate when receiving
+ * "bitrate=<n>" compress param message
+ */
+static bool rate_ctl_encoder_supported(codec_t codec)
+{
+        return codec == H264 || codec == H265 || codec == AV1 || codec == VP8 ||
+               codec == VP9 || codec == J2K || codec == J2KR;
+}
+
+static void send_compress_bitrate(struct tx *tx, long long bitrate)
+{
+        auto *msg = (struct msg_change_compress_data *) new_message(
+            sizeof(struct msg_change_compress_data));
+        msg->what = CHANGE_PARAMS;
+        snprintf(msg->config_string, sizeof msg->config_string,
+                 "bitrate=%lld", bitrate);
+        char path[1024] = "";
+        enum module_class path_compress[] = { MODULE_CLASS_COMPRESS,
+                                              MODULE_CLASS_NONE };
+        append_message_path(path, sizeof path, path_compress);
+        struct response *resp = send_message(get_parent_module(&tx->mod),
+                                             path, (struct message *) msg);
+        free_response(resp);
+}
+
+/**
+ * Sets the sending rate (already clamped to the configured bounds) and
+ * passes it to the encoder if it differs enough from the last one.
+ */
+static void rate_ctl_set_rate(struct tx *tx, double rate, codec_t codec)
+{
+        struct rate_ctl *rc = &tx->rate_ctl;
+        if (rate == rc->rate) {
+                return;
+        }
+        rc->rate = rate;
+        tx->bitrate = llround(rate);
+
+        const long long enc_rate = llround(rate * RATE_CTL_ENC_SHARE);
+        if (rate_ctl_encoder_supported(codec) &&
+            fabs((double) enc_rate - rc->enc_rate) >= rc->enc_rate * RATE_CTL_ENC_STEP) {
+                MSG(VERBOSE, "Rate control: setting encoder bitrate to %.2f Mbps\n",
+                    enc_rate / 1e6);
+                rc->enc_rate = enc_rate;
+                send_compress_bitrate(tx, enc_rate);
+        }
+}
+
+/**
+ * Processes new receiver report (if any) and updates the sending rate.
+ */
+static void rate_ctl_update(struct tx *tx, struct rtp *rtp_session,
+                            codec_t codec)
+{
+        struct rate_ctl *rc = &tx->rate_ctl;
+        uint32_t count = 0;
+        uint8_t fract_lost = 0;
+        if (!rc->enabled || rtp_session == nullptr ||
+            !rtp_get_loss_report(rtp_session, &count, &fract_lost) ||
+            count == rc->last_report) {
+                return;
+        }
+        rc->last_report = count;
+        const time_ns_t now = get_time_in_ns();
+        const double elapsed =
+            MIN((now - rc->last_update) / NS_IN_SEC_DBL, 5.0);
+        rc->last_update = now;
+
+        const double loss = fract_lost / 256.0;
+        double rtt = 0;
+        const bool rtt_known = rtp_get_rtt(rtp_session, &rtt);
+        if (rtt_known && (rc->min_rtt == 0 || rtt < rc->min_rtt)) {
+                rc->min_rtt = rtt;
+        }
+        const bool queueing =
+            rtt_known && rtt > rc->min_rtt + MAX(RATE_CTL_RTT_SLACK, rc->min_rtt / 2);
+
+        double rate = rc->rate;
+        if (loss > RATE_CTL_LOSS_HIGH) {
+                rate *= 1.0 - 0.5 * loss;
+        } else if (queueing) {
+                rate *= RATE_CTL_DELAY_DECREASE;
+        } else if (loss < RATE_CTL_LOSS_LOW) {
+                rate *= pow(RATE_CTL_INCREASE, elapsed);
+        }
+        rate = MAX(rc->min_rate, MIN(rc->max_rate, rate));
+        MSG(DEBUG, "Rate control: loss %.2f%%, RTT %.1f ms (min %.1f ms), rate %.2f Mbps\n",
+            loss * 100.0, rtt * MS_IN_SEC_DBL, rc->min_rtt * MS_IN_SEC_DBL,
+            rate / 1e6);
+        rate_ctl_set_rate(tx, rate, codec);
+}
+
+/**
+ * Processes the receiver overload reports.
+ * @returns true if the frame should be skipped
+ */
+static bool overload_ctl_skip_frame(struct tx *tx, struct rtp *rtp_session,
+                                    const struct video_frame *frame)
+{
+        struct overload_ctl *oc = &tx->overload_ctl;
+        uint32_t count = 0;
+        int level = 0;
+        const time_ns_t now = get_time_in_ns();
+        if (rtp_session != nullptr &&
+            rtp_get_overload_report(rtp_session, &count, &level) &&
+            count != oc->last_report) {
+                oc->last_report = count;
+                oc->last_update = now;
+                if (level > 0 && is_codec_interframe(frame->color_spec)) {
+                        log_msg_once(LOG_LEVEL_WARNING, to_fourcc('T', 'X', 'O', 'L'),
+                                     MOD_NAME "Receiver reports overload but %s "
+                                     "frames cannot be skipped, consider lowering "
+                                     "the bitrate, frame rate or resolution.\n",
+                                     get_codec_name(frame->color_spec));
+                        return false;
+                }
+                if (level > 0) {
+                        // the reported share was dropped from what we already send
+                        const double sent = 1.0 - oc->skip;
+                        const double skip = 1.0 - sent * (1.0 - level / 1000.0 - OVERLOAD_HEADROOM);
+                        oc->skip = MIN(OVERLOAD_MAX_SKIP, MAX(oc->skip, skip));
+                        MSG(NOTICE, "Receiver dropped %.1f%% of frames, sending "
+                                    "%.0f%% of the frames.\n",
+                            level / 10.0, (1.0 - oc->skip) * 100.0);
+                }
+        } else if (oc->skip > 0.0 &&
+                   now - oc->last_update > OVERLOAD_REPORT_TIMEOUT_NS) {
+                const double elapsed = (now - oc->last_update) / NS_IN_SEC_DBL;
+                oc->skip = MAX(0.0, oc->skip - OVERLOAD_RECOVERY * elapsed);
+                oc->last_update = now - OVERLOAD_REPORT_TIMEOUT_NS;
+                if (oc->skip == 0.0) {
+                        MSG(NOTICE, "Receiver overload gone, sending all frames.\n");
+                }
+        }
+        if (oc->skip == 0.0 || frame->fragment) {
+                return false;
+        }
+        oc->credit += 1.0 - oc->skip;
+        if (oc->credit >= 1.0) {
+                oc->credit -= 1.0;
+                return false;
+        }
+        frame_drop_record(FRAME_DROP_SEND_OVERLOAD, 1);
+        return true;
+}
+
+/**
+ * Checks whether the link keeps up with the frame rate (see struct
+ * congest_ctl).
+ * @returns true if the frame should be skipped
+ */
+static bool congest_ctl_skip_frame(struct tx *tx, struct rtp *rtp_session,
+                                   const struct video_frame *frame)
+{
+        struct congest_ctl *cc = &tx->congest_ctl;
+        if (!cc->enabled || frame->fragment || frame->fps <= 0) {
+                return false;
+        }
+        const long long interval = (long long) (NS_IN_SEC_DBL / frame->fps);
+        const int backlog = rtp_get_send_backlog(rtp_session);
+        const long long drain_ns =
+            backlog > 0 && cc->throughput > 0
+                ? (long long) (backlog * 8 / cc->throughput * NS_IN_SEC_DBL)
+                : 0;
+        const long long last_send_ns = cc->last_send_ns;
+        const bool late = (cc->last_interval_ns > 0 &&
+                           last_send_ns > cc->last_interval_ns) ||
+                          drain_ns > interval;
+        // each measured send counts once - a single slow frame skips at most one
+        cc->last_send_ns = 0;
+        if (!late) {
+                cc->skipped = 0;
+                return false;
+        }
+
+        if (is_codec_interframe(frame->color_spec)) {
+                if (!tx->rate_ctl.enabled) {
+                        log_msg_once(LOG_LEVEL_WARNING, to_fourcc('T', 'X', 'C', 'G'),
+                                     MOD_NAME "Link cannot keep up with the %s "
+                                     "stream, frames cannot be skipped - use "
+                                     "\"--param tx-rate-adapt\" to lower the "
+                                     "encoder bitrate.\n",
+                                     get_codec_name(frame->color_spec));
+                        return false;
+                }
+                const double rate =
+                    MAX(tx->rate_ctl.min_rate,
+                        MIN(tx->rate_ctl.rate, cc->throughput));
+                if (rate < tx->rate_ctl.rate) {
+                        MSG(VERBOSE, "Send queue congested (%d B), lowering "
+                                     "rate to %.2f Mbps.\n",
+                            backlog, rate / 1e6);
+                        rate_ctl_set_rate(tx, rate, frame->color_spec);
+                }
+                return false;
+        }
+
+        if (cc->skipped >= CONGEST_MAX_SKIP) {
+                cc->skipped = 0;
+                return false;
+        }
+        cc->skipped += 1;
+        MSG(DEBUG, "Skipping late frame (send queue %d B, last frame sent in "
+                   "%.2f ms).\n",
+            backlog, last_send_ns / NS_IN_MS_DBL);
+        frame_drop_record(FRAME_DROP_SEND_CONGESTION, 1);
+        return true;
+}
+
+/// records duration and achieved rate of the frame just sent
+static void congest_ctl_frame_sent(struct tx *tx,
+                                   const struct video_frame *frame,
+                                   long long duration_ns)
+{
+        struct congest_ctl *cc = &tx->congest_ctl;
+        if (!cc->enabled || frame->fps <= 0 || duration_ns <= 0) {
+                return;
+        }
+        size_t bytes = 0;
+        for (unsigned i = 0; i < frame->tile_count; ++i) {
+                bytes += frame->tiles[i].data_len;
+        }
+        cc->last_send_ns = duration_ns;
+        cc->last_interval_ns = (long long) (NS_IN_SEC_DBL / frame->fps);
+        cc->throughput = bytes * tx->mult_count * 8 / (duration_ns / NS_IN_SEC_DBL);
+}
+
+ADD_TO_PARAM("tx-drop-late", "* tx-drop-late\n"
+                "  Skip video frames that cannot be sent before the next one (saturated\n"
+                "  link, send queue backlog) for intra-only codecs, lower the rate for\n"
+                "  the others (with tx-rate-adapt).\n");
+ADD_TO_PARAM("tx-rate-adapt", "* tx-rate-adapt=<min>:<max>[:<start>]\n"
+                "  Adapt video sending rate (pacing and encoder bitrate for lavc and J2K)\n"
+                "  to loss and RTT from RTCP receiver reports within given bounds (bps).\n");
+static bool rate_ctl_init(struct rate_ctl *rc, const char *cfg)
+{
+        char *tmp = strdup(cfg);
+        char *save_ptr = nullptr;
+        const char *min = strtok_r(tmp, ":", &save_ptr);
+        const char *max = min == nullptr ? nullptr : strtok_r(nullptr, ":", &save_ptr);
+        const char *start = max == nullptr ? nullptr : strtok_r(nullptr, ":", &save_ptr);
+        if (max != nullptr) {
+                rc->min_rate = unit_evaluate(min, nullptr);
+                rc->max_rate = unit_evaluate(max, nullptr);
+                rc->rate = start != nullptr ? unit_evaluate(start, nullptr) : rc->max_rate;
+        }
+        free(tmp);
+        if (max == nullptr || rc->min_rate <= 0 || rc->max_rate < rc->min_rate ||
+            rc->rate < rc->min_rate || rc->rate > rc->max_rate) {
+                MSG(ERROR, "Wrong rate adaptation config: %s\n", cfg);
+                return false;
+        }
+        rc->enabled = true;
+        rc->enc_rate = llround(rc->rate * RATE_CTL_ENC_SHARE);
+        rc->last_update = get_time_in_ns();
+        return true;
+}
+
 static bool set_fec(struct tx *tx, const char *fec_const)
 {
         char *fec = strdup(fec_const);
@@ -278,6 +914,7 @@ static bool set_fec(struct tx *tx, const char *fec_const)
         snprintf(msg->fec_cfg, sizeof(msg->fec_cfg), "flush");
 
         tx->mult_count = 1; // default
+        tx->fec_auto.enabled = false;
         if (strcasecmp(fec, "none") == 0) {
                 tx->fec_scheme = FEC_NONE;
         } else if(strcasecmp(fec, "mult") == 0) {
@@ -289,6 +926,9 @@ static bool set_fec(struct tx *tx, const char *fec_const)
                 if(tx->media_type == TX_MEDIA_AUDIO) {
                         fprintf(stderr, "LDGM is not currently supported for audio!\n");
                         ret = false;
+                } else if (int rc = parse_fec_auto(tx, FEC_LDGM, fec_cfg); rc != 0) {
+                        tx->fec_scheme = FEC_NONE; // until loss is reported
+                        ret = rc == 1;
                 } else {
                         if(!fec_cfg || (strlen(fec_cfg) > 0 && strchr(fec_cfg, '%') == NULL)) {
                                 snprintf(msg->fec_cfg, sizeof(msg->fec_cfg), "LDGM cfg %s",
@@ -299,15 +939,26 @@ static bool set_fec(struct tx *tx, const char *fec_const)
                         tx->fec_scheme = FEC_LDGM;
                 }
         } else if(strcasecmp(fec, "RS") == 0) {
-                snprintf(msg->fec_cfg, sizeof(msg->fec_cfg), "RS cfg %s",
-                                fec_cfg ? fec_cfg : "");
-                tx->fec_scheme = FEC_RS;
+                if (int rc = parse_fec_auto(tx, FEC_RS, fec_cfg); rc != 0) {
+                        tx->fec_scheme = FEC_NONE; // until loss is reported
+                        ret = rc == 1;
+                } else {
+                        snprintf(msg->fec_cfg, sizeof(msg->fec_cfg), "RS cfg %s",
+                                        fec_cfg ? fec_cfg : "");
+                        tx->fec_scheme = FEC_RS;
+                }
         } else if(strcasecmp(fec, "help") == 0) {
                 color_printf("Usage:\n");
                 color_printf("\t" TBOLD("-f [A:|V:]{mult:count|ldgm[:params]|"
                              "rs[:params]}") "\n");
                 color_printf("\nIf neither A: or V: is speciefied, FEC is set "
-                             "to the video (backward compat).\n\n");
+                             "to the video (backward compat).\n");
+                color_printf("\n" TBOLD("ldgm:auto[:max=<pct>]") " or "
+                             TBOLD("rs:auto[:max=<pct>]") " select redundancy "
+                             "according to loss reported by the receiver,\n"
+                             "the redundancy doesn't exceed <pct> percent of "
+                             "the payload (default %d).\n\n",
+                             (int) (FEC_AUTO_DEFAULT_MAX_OVERHEAD * 100));
                 ret = false;
         } else {
                 fprintf(stderr, "Unknown FEC: %s\n", fec);
@@ -326,8 +977,10 @@ static bool set_fec(struct tx *tx, const char *fec_const)
         return ret;
 }
 
-static void fec_check_messages(struct tx *tx)
+static void fec_check_messages(struct tx *tx, struct rtp *rtp_session)
 {
+        fec_auto_update(tx, rtp_session);
+
         struct message *msg;
         while ((msg = check_message(&tx->mod))) {
                 auto *data = reinterpret_cast<struct msg_universal *>(msg);
@@ -372,6 +1025,21 @@ static void tx_done(struct module *mod)
 {
         struct tx *tx = (struct tx *) mod->priv_data;
         assert(tx->magic == TRANSMIT_MAGIC);
+        for (int i = 0; i < tx->enc_workers; ++i) {
+                tx->enc_funcs->destroy(tx->enc_states[i]);
+        }
+        free(tx->enc_arena);
+        free(tx->enc_lens);
+        free(tx->bundle_buf);
+        metric_unregister(tx->metric_bytes);
+        metric_unregister(tx->metric_pacing);
+        metric_unregister(tx->metric_gap);
+        metric_unregister(tx->metric_send_ratio);
+        metric_unregister(tx->metric_excess);
+        metric_unregister(tx->metric_overslept);
+        if (tx->timeline != nullptr) {
+                fclose(tx->timeline);
+        }
         free(tx);
 }
 
@@ -381,11 +1049,30 @@ static void tx_done(struct module *mod)
 void
 tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
 {
+        tx_send_striped(tx, frame, &rtp_session, 1);
+}
+
+/**
+ * Same as tx_send() but the packets are distributed round-robin over
+ * rtp_sessions (eg. bound to different NICs), each paced to 1/session_count
+ * of the rate. rtp_sessions[1..] must share the stream of rtp_sessions[0]
+ * (rtp_set_stream_owner()) so that the receiver reassembles a single stream.
+ */
+void
+tx_send_striped(struct tx *tx, struct video_frame *frame, struct rtp *const *rtp_sessions,
+                int session_count)
+{
+        struct rtp *rtp_session = rtp_sessions[0];
         unsigned int i;
 
         assert(!frame->fragment || tx->fec_scheme == FEC_NONE); // currently no support for FEC with fragments
         assert(!frame->fragment || frame->tile_count); // multiple tile are not currently supported for fragmented send
-        fec_check_messages(tx);
+        fec_check_messages(tx, rtp_session);
+        rate_ctl_update(tx, rtp_session, frame->color_spec);
+        if (overload_ctl_skip_frame(tx, rtp_session, frame) ||
+            congest_ctl_skip_frame(tx, rtp_session, frame)) {
+                return;
+        }
 
         uint32_t ts =
             (frame->flags & TIMESTAMP_VALID) == 0
@@ -399,6 +1086,11 @@ tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
                 tx->last_ts = ts;
         }
 
+        frame_trace_event(frame->trace_id, FRAME_TRACE_SEND_START);
+        const time_ns_t send_start = get_time_in_ns();
+        if (frame->capture_time != 0) {
+                frame->send_time = send_start;
+        }
         for(i = 0; i < frame->tile_count; ++i)
         {
                 int last = FALSE;
@@ -411,9 +1103,11 @@ tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
                 if(frame->fragment)
                         fragment_offset = vf_get_tile(frame, i)->offset;
 
-                tx_send_base(tx, frame, rtp_session, ts, last,
+                tx_send_base(tx, frame, rtp_sessions, session_count, ts, last,
                                 i, fragment_offset);
         }
+        frame_trace_event(frame->trace_id, FRAME_TRACE_SEND_END);
+        congest_ctl_frame_sent(tx, frame, get_time_in_ns() - send_start);
         tx->buffer++;
 }
 
@@ -477,7 +1171,12 @@ static uint32_t format_interl_fps_hdr_row(enum interlacing_t interlacing, double
 static inline void check_symbol_size(int fec_symbol_size, int payload_len)
 {
         thread_local static bool status_printed = false;
+        thread_local static int last_payload_len = 0;
 
+        if (payload_len != last_payload_len) { // eg. path MTU changed
+                status_printed = false;
+                last_payload_len = payload_len;
+        }
         if (status_printed && log_level < LOG_LEVEL_DEBUG2) {
                 return;
         }
@@ -523,8 +1222,11 @@ static inline int get_video_pkt_len(int mtu,
         return mtu / symbol_size * symbol_size;
 }
 
-/// @param mtu is tx->mtu - hdrs_len
-static vector<int> get_packet_sizes(struct video_frame *frame, int substream, int mtu) {
+/**
+ * Returns sizes of packets that the substream is split to.
+ * @param mtu is tx->mtu - hdrs_len
+ */
+vector<int> tx_get_packet_sizes(struct video_frame *frame, int substream, int mtu) {
         if (frame->fec_params.type != FEC_NONE) {
                 check_symbol_size(frame->fec_params.symbol_size, mtu);
         }
@@ -556,9 +1258,47 @@ static vector<int> get_packet_sizes(struct video_frame *frame, int substream, in
         return ret;
 }
 
+static void
+tx_register_metrics(struct tx *tx, struct rtp *rtp_session)
+{
+        char labels[64];
+        snprintf(labels, sizeof labels, "ssrc=\"0x%08" PRIx32 "\",media=\"%s\"",
+                 rtp_my_ssrc(rtp_session),
+                 tx->media_type == TX_MEDIA_VIDEO ? "video" : "audio");
+        tx->metric_bytes =
+            metric_register(METRIC_COUNTER, "ug_tx_bytes",
+                            "Sent bytes (payload and payload headers).", labels);
+        if (tx->media_type == TX_MEDIA_VIDEO) {
+                tx->metric_pacing = metric_register_histogram(
+                    "ug_tx_pacing_overshoot_seconds",
+                    "Overshoot of the busy-wait traffic shaper per burst.",
+                    labels, 1e-6);
+                tx->metric_gap = metric_register_histogram(
+                    "ug_tx_packet_gap_seconds",
+                    "Average inter-packet gap of a burst of the busy-wait "
+                    "traffic shaper.", labels, 1e-7);
+                tx->metric_send_ratio = metric_register_histogram(
+                    "ug_tx_frame_send_ratio",
+                    "Frame (tile) send duration relative to the frame interval.",
+                    labels, 1.0 / 64);
+                tx->metric_excess = metric_register(
+                    METRIC_COUNTER, "ug_tx_pacing_excess_bursts",
+                    "Bursts sent above the configured rate.", labels);
+                tx->metric_overslept = metric_register(
+                    METRIC_GAUGE, "ug_tx_pacing_overslept_seconds",
+                    "Busy-wait shaper delay behind the schedule at the end of "
+                    "the last frame.", labels);
+        }
+}
+
 static void
 report_stats(struct tx *tx, struct rtp *rtp_session, long data_sent)
 {
+        if (tx->metric_bytes == nullptr) {
+                tx_register_metrics(tx, rtp_session);
+        }
+        metric_inc(tx->metric_bytes, data_sent);
+
         if (!tx->control || !control_stats_enabled(tx->control)) {
                 return;
         }
@@ -578,10 +1318,85 @@ report_stats(struct tx *tx, struct rtp *rtp_session, long data_sent)
             << " " << media << " " << tx->sent_since_report;
 
         control_report_stats(tx->control, oss.str());
+
+        if (tx->media_type == TX_MEDIA_VIDEO) {
+                std::ostringstream pacing;
+                pacing << "tx_pacing " << std::hex << rtp_my_ssrc(rtp_session)
+                       << std::dec << " ";
+                if (tx->txtime_session == rtp_session) {
+                        pacing << "txtime dropped "
+                               << rtp_get_txtime_errors(rtp_session);
+                } else {
+                        pacing << "busy-wait avg_overshoot_ns "
+                               << (tx->pacing_waits == 0
+                                       ? 0
+                                       : tx->pacing_err_ns / tx->pacing_waits);
+                }
+                const auto &ps = tx->pacing_stats;
+                pacing << " frames " << ps.frames << " send_ratio_avg "
+                       << (ps.frames == 0 ? 0 : ps.send_ratio_sum / ps.frames)
+                       << " send_ratio_max " << ps.send_ratio_max << " bursts "
+                       << ps.bursts << " excess_bursts " << ps.excess_bursts
+                       << " max_gap_ns " << ps.max_gap_ns
+                       << " max_overslept_ns " << ps.max_overslept_ns;
+                control_report_stats(tx->control, pacing.str());
+                tx->pacing_err_ns = 0;
+                tx->pacing_waits = 0;
+                tx->pacing_stats = {};
+        }
+
         tx->last_stat_report  = current_time_ns;
         tx->sent_since_report = 0;
 }
 
+/**
+ * Enables SO_TXTIME for the session if kernel pacing was requested. If it
+ * cannot be enabled, falls back to busy-wait shaper.
+ */
+static bool
+tx_kernel_pacing_ready(struct tx *tx, struct rtp *rtp_session)
+{
+        if (!tx->kernel_pacing) {
+                return false;
+        }
+        if (tx->txtime_session == rtp_session) {
+                return true;
+        }
+        if (!rtp_enable_txtime(rtp_session)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot use kernel pacing, "
+                                "falling back to busy-wait.\n");
+                tx->kernel_pacing = false;
+                return false;
+        }
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Using kernel packet pacing (SO_TXTIME).\n");
+        tx->txtime_session = rtp_session;
+        tx->txtime_last = 0;
+        return true;
+}
+
+/// @returns CLOCK_MONOTONIC time in ns as used by SO_TXTIME
+static uint64_t
+get_txtime_now()
+{
+#ifdef __linux__
+        struct timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * NS_IN_SEC + ts.tv_nsec;
+#else
+        return 0;
+#endif
+}
+
+/// @returns time available to send one tile of the frame, 0 if unknown
+static long long
+get_frame_interval_ns(const struct video_frame *frame)
+{
+        if (frame->fps <= 0 || frame->tile_count == 0) {
+                return 0;
+        }
+        return (long long) (NS_IN_SEC_DBL / frame->fps / frame->tile_count);
+}
+
 /**
  * Returns inter-packet interval in nanoseconds.
  */
@@ -623,6 +1438,304 @@ get_packet_rate(struct tx *tx, struct video_frame *frame, int substream, long pa
         return packet_rate;
 }
 
+/**
+ * Traffic shaper and packet batching shared by the UltraGrid (tx_send_base())
+ * and the standard RTP (tx_send_h264(), tx_send_jpeg()) video senders.
+ *
+ * Packets are queued with the RTP async API and sent in bursts. The busy-wait
+ * shaper waits after every burst (TX_MAX_BURST_NS worth of packets), with the
+ * kernel pacing every packet gets its departure time instead. Headers and data
+ * passed to send() must be kept intact until wait() returns.
+ *
+ * Pacing statistics (bursts, inter-packet gaps, frame send duration) are
+ * accumulated to tx->pacing_stats and the metrics, wait() closes the frame.
+ */
+class tx_pacer {
+public:
+        /// @param frame_interval_ns time available to send the frame (tile)
+        tx_pacer(struct tx *tx, struct rtp *rtp_session, long packet_rate,
+                 long packet_count, long long frame_interval_ns)
+            : m_tx(tx), m_session(rtp_session), m_packet_rate(packet_rate),
+              m_frame_interval(frame_interval_ns)
+        {
+                m_kernel_paced = packet_rate > 0 &&
+                                 tx_kernel_pacing_ready(tx, rtp_session);
+                if (m_kernel_paced) {
+                        m_txtime = std::max<uint64_t>(
+                            get_txtime_now() + TX_TXTIME_LEAD_NS,
+                            tx->txtime_last + packet_rate);
+                }
+                rtp_async_start(rtp_session, (int) packet_count);
+                m_burst = packet_rate == 0 || m_kernel_paced
+                              ? TX_MAX_BURST_PACKETS
+                              : TX_MAX_BURST_NS / packet_rate;
+                m_burst = std::clamp<long>(m_burst, 1, TX_MAX_BURST_PACKETS);
+        }
+
+        /// @param extn      RTP header extension data (see utils/frame_trace.h)
+        /// @param extn_len  length of extn in words, 0 for none
+        int send(uint32_t ts, int pt, int m, char *phdr, int phdr_len,
+                 char *data, int data_len, uint32_t *extn, int extn_len)
+        {
+                if (m_sent % m_burst == 0) {
+                        GET_STARTTIME;
+                        burst_start();
+                }
+                m_ts = ts;
+                if (m_kernel_paced) {
+                        rtp_set_next_txtime(m_session, m_txtime);
+                        m_tx->txtime_last = m_txtime;
+                        m_txtime += m_packet_rate;
+                }
+                const int ret = rtp_send_data_hdr(
+                    m_session, ts, (char) pt, m, 0, nullptr, phdr, phdr_len,
+                    data, data_len, extn_len > 0 ? (char *) extn : nullptr,
+                    extn_len, FRAME_TRACE_RTP_EXT_TYPE);
+                m_sent += 1;
+
+                // TRAFFIC SHAPER
+                if (!m_kernel_paced && m != 1 && m_sent % m_burst == 0) { // wait for all but last burst
+                        rtp_async_flush(m_session);
+                        const long burst_rate = m_packet_rate * m_burst;
+                        long delta = 0;
+                        do {
+                                GET_STOPTIME;
+                                GET_DELTA;
+                        } while (burst_rate - delta - m_overslept > 0);
+                        m_overslept = -(burst_rate - delta - m_overslept);
+                        m_tx->pacing_err_ns += m_overslept;
+                        m_tx->pacing_waits += 1;
+                        metric_observe(m_tx->metric_pacing, m_overslept / NS_IN_SEC_DBL);
+                }
+                return ret;
+        }
+
+        /// waits until all queued packets are sent
+        void wait()
+        {
+                rtp_async_wait(m_session);
+                if (m_sent == 0) {
+                        return;
+                }
+                const long long duration = get_time_in_ns() - m_frame_start;
+                auto &ps = m_tx->pacing_stats;
+                if (m_frame_interval > 0) {
+                        const double ratio = (double) duration / m_frame_interval;
+                        ps.frames += 1;
+                        ps.send_ratio_sum += ratio;
+                        ps.send_ratio_max = std::max(ps.send_ratio_max, ratio);
+                        metric_observe(m_tx->metric_send_ratio, ratio);
+                }
+                ps.bursts += m_bursts;
+                ps.excess_bursts += m_excess;
+                ps.max_gap_ns = std::max(ps.max_gap_ns, m_max_gap);
+                ps.max_overslept_ns = std::max<long long>(ps.max_overslept_ns, m_overslept);
+                metric_inc(m_tx->metric_excess, m_excess);
+                metric_set(m_tx->metric_overslept, m_overslept / NS_IN_SEC_DBL);
+                if (m_tx->timeline != nullptr) {
+                        fprintf(m_tx->timeline,
+                                "%08" PRIx32 ",%" PRIu32 ",%lld,%lld,%lld,%ld,%ld,%ld,%lld,%ld\n",
+                                rtp_my_ssrc(m_session), m_ts, m_frame_start, duration,
+                                m_frame_interval, m_sent, m_bursts, m_excess, m_max_gap,
+                                m_overslept);
+                }
+        }
+
+private:
+        /// accounts the gap from the previous burst (busy-wait shaper only)
+        void burst_start()
+        {
+                const long long now = get_time_in_ns();
+                m_bursts += 1;
+                if (m_sent == 0) {
+                        m_frame_start = now;
+                } else if (!m_kernel_paced) {
+                        const long long interval = now - m_last_burst;
+                        const long long gap = interval / m_burst;
+                        m_max_gap = std::max(m_max_gap, gap);
+                        metric_observe(m_tx->metric_gap, gap / NS_IN_SEC_DBL);
+                        if (m_packet_rate > 0 && interval < m_packet_rate * m_burst *
+                                                                TX_EXCESS_BURST_RATIO) {
+                                m_excess += 1;
+                        }
+                }
+                m_last_burst = now;
+        }
+
+        struct tx *m_tx;
+        struct rtp *m_session;
+        long m_packet_rate;
+        long long m_frame_interval;
+        bool m_kernel_paced;
+        uint64_t m_txtime = 0;
+        long m_burst;
+        long m_sent = 0;
+        long m_overslept = 0;
+        // statistics
+        uint32_t m_ts = 0;
+        long long m_frame_start = 0;
+        long long m_last_burst = 0;
+        long m_bursts = 0;
+        long m_excess = 0;
+        long long m_max_gap = 0;
+#ifdef __linux__
+        struct timespec start{}, stop{};
+#elif defined __APPLE__
+        struct timeval start{}, stop{};
+#else // Windows
+        LARGE_INTEGER start{}, stop{}, freq{};
+#endif
+};
+
+struct tx_encrypt_job {
+        const struct openssl_encrypt_info *enc_funcs;
+        struct openssl_encrypt *state;
+        char *data;
+        uint32_t *rtp_headers;
+        int rtp_hdr_len;
+        int aad_len;
+        const int *packet_sizes;
+        size_t packet_count; ///< packet count of one FEC mult copy
+        long first;
+        long last;
+        char *arena;
+        size_t stride;
+        int *lens;
+};
+
+static void *
+tx_encrypt_task(void *arg)
+{
+        auto *job = (struct tx_encrypt_job *) arg;
+        uint32_t *hdr =
+            job->rtp_headers + job->first * (job->rtp_hdr_len / sizeof(uint32_t));
+        for (long i = job->first; i < job->last; ++i) {
+                job->lens[i] = job->enc_funcs->encrypt(
+                    job->state, job->data + ntohl(hdr[1]),
+                    job->packet_sizes[i % job->packet_count], (char *) hdr,
+                    job->aad_len, job->arena + i * job->stride);
+                hdr += job->rtp_hdr_len / sizeof(uint32_t);
+        }
+        return nullptr;
+}
+
+/**
+ * Encrypts all packets of the tile to tx->enc_arena, packet i is stored at
+ * offset i * stride with length tx->enc_lens[i]. Large tiles are split among
+ * the workers, each with its own cipher context.
+ *
+ * @returns stride between the packets in the arena, 0 on error
+ */
+static size_t
+tx_encrypt_packets(struct tx *tx, const struct tile *tile,
+                   uint32_t *rtp_headers, int rtp_hdr_len, int aad_len,
+                   const vector<int> &packet_sizes, long pkt_cnt)
+{
+        const size_t stride =
+            *std::max_element(packet_sizes.begin(), packet_sizes.end()) +
+            MAX_CRYPTO_EXCEED;
+        if (tx->enc_arena_size < stride * pkt_cnt) {
+                free(tx->enc_arena);
+                tx->enc_arena_size = stride * pkt_cnt;
+                tx->enc_arena      = (char *) malloc(tx->enc_arena_size);
+        }
+        if (tx->enc_lens_count < (size_t) pkt_cnt) {
+                free(tx->enc_lens);
+                tx->enc_lens_count = pkt_cnt;
+                tx->enc_lens = (int *) malloc(pkt_cnt * sizeof *tx->enc_lens);
+        }
+        if (tx->enc_arena == nullptr || tx->enc_lens == nullptr) {
+                tx->enc_arena_size = tx->enc_lens_count = 0;
+                return 0;
+        }
+
+        const int workers = (int) std::clamp<long>(
+            pkt_cnt / TX_ENC_MIN_PACKETS_PER_WORKER, 1, tx->enc_workers);
+        struct tx_encrypt_job jobs[TX_MAX_ENC_WORKERS];
+        const long per_worker = (pkt_cnt + workers - 1) / workers;
+        for (int i = 0; i < workers; ++i) {
+                jobs[i] = { tx->enc_funcs,
+                            tx->enc_states[i],
+                            tile->data,
+                            rtp_headers,
+                            rtp_hdr_len,
+                            aad_len,
+                            packet_sizes.data(),
+                            packet_sizes.size(),
+                            std::min(i * per_worker, pkt_cnt),
+                            std::min((i + 1) * per_worker, pkt_cnt),
+                            tx->enc_arena,
+                            stride,
+                            tx->enc_lens };
+        }
+        if (workers == 1) {
+                tx_encrypt_task(&jobs[0]);
+        } else {
+                task_run_parallel(tx_encrypt_task, workers, jobs,
+                                  sizeof jobs[0], nullptr);
+        }
+        return stride;
+}
+
+static void
+tx_set_path_mtu(struct tx *tx, int mtu)
+{
+        mtu = std::clamp(mtu, TX_PMTU_MIN, (int) tx->max_mtu);
+        if (mtu == (int) tx->mtu) {
+                return;
+        }
+        MSG(INFO, "Path MTU: %d B (was %u B)\n", mtu, tx->mtu);
+        tx->mtu = mtu;
+        tx->avg_len_last = 0; // let LDGM recompute symbol size for the new MTU
+}
+
+/**
+ * Probes path MTU towards the receivers of rtp_session if requested with
+ * --param tx-pmtu and sets the MTU accordingly. The probe blocks (for up to
+ * hundreds of ms), so this is called when the session is created, not when
+ * sending. Must not be called concurrently with tx_send().
+ */
+void
+tx_probe_path_mtu(struct tx *tx, struct rtp *rtp_session)
+{
+        if (!tx->pmtu_discovery) {
+                return;
+        }
+        const int mtu = rtp_enable_pmtu_discovery(rtp_session, (int) tx->max_mtu);
+        if (mtu < 0) {
+                MSG(WARNING, "Path MTU discovery failed, using "
+                             "MTU %u B.\n", tx->mtu);
+                tx->pmtu_discovery = false;
+                return;
+        }
+        tx->pmtu_session = rtp_session;
+        tx->pmtu_next_check = get_time_in_ns() + TX_PMTU_CHECK_INTERVAL_NS;
+        tx_set_path_mtu(tx, mtu);
+}
+
+/**
+ * Lowers tx->mtu if the path MTU of the session probed by tx_probe_path_mtu()
+ * was decreased by ICMP feedback. An increase is picked up only by a new probe,
+ * which would block the sending.
+ */
+static void
+tx_pmtu_update(struct tx *tx, struct rtp *rtp_session)
+{
+        if (!tx->pmtu_discovery || tx->pmtu_session != rtp_session) {
+                return;
+        }
+        const time_ns_t now = get_time_in_ns();
+        if (now < tx->pmtu_next_check) {
+                return;
+        }
+        tx->pmtu_next_check = now + TX_PMTU_CHECK_INTERVAL_NS;
+        const int mtu = rtp_get_path_mtu(rtp_session);
+        if (mtu < 0 || mtu >= (int) tx->mtu) {
+                return;
+        }
+        tx_set_path_mtu(tx, mtu);
+}
+
 static int
 get_tx_hdr_len(bool is_ipv6)
 {
@@ -631,15 +1744,22 @@ get_tx_hdr_len(bool is_ipv6)
 }
 
 static void
-tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
+tx_send_base(struct tx *tx, struct video_frame *frame,
+                struct rtp *const *rtp_sessions, int session_count,
                 uint32_t ts, int send_m,
                 unsigned int substream,
                 int fragment_offset)
 {
         assert(fragment_offset == 0); // no longer supported
+        struct rtp *rtp_session = rtp_sessions[0];
         if (!rtp_has_receiver(rtp_session)) {
                 return;
         }
+        tx_pmtu_update(tx, rtp_session);
+        bool ipv6 = false;
+        for (int i = 0; i < session_count; ++i) {
+                ipv6 = ipv6 || rtp_is_ipv6(rtp_sessions[i]);
+        }
 
         struct tile *tile = &frame->tiles[substream];
 
@@ -647,15 +1767,13 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
         uint32_t rtp_hdr[100];
         int rtp_hdr_len;
         int pt = fec_pt_from_fec_type(TX_MEDIA_VIDEO, frame->fec_params.type, tx->encryption);            /* A value specified in our packet format */
-#ifdef __linux__
-        struct timespec start, stop;
-#elif defined __APPLE__
-        struct timeval start, stop;
-#else // Windows
-	LARGE_INTEGER start, stop, freq;
-#endif
-        long delta, overslept = 0;
-        int hdrs_len = get_tx_hdr_len(rtp_is_ipv6(rtp_session));
+        int hdrs_len = get_tx_hdr_len(ipv6) +
+                       rtp_get_rtx_overhead(rtp_session);
+        uint32_t extn[FRAME_TRACE_RTP_EXT_LEN_LATENCY];
+        const int extn_len = frame_trace_rtp_ext_fill(frame, extn);
+        if (extn_len > 0) {
+                hdrs_len += 4 * (1 + extn_len);
+        }
 
         assert(tx->magic == TRANSMIT_MAGIC);
 
@@ -686,7 +1804,7 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 rtp_hdr_len += sizeof(crypto_payload_hdr_t);
         }
 
-        vector<int> packet_sizes = get_packet_sizes(frame, substream, tx->mtu - hdrs_len);
+        vector<int> packet_sizes = tx_get_packet_sizes(frame, substream, tx->mtu - hdrs_len);
         const long mult_pkt_cnt = (long) packet_sizes.size() * tx->mult_count;
         const long packet_rate =
             get_packet_rate(tx, frame, (int) substream, mult_pkt_cnt);
@@ -705,57 +1823,68 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 }
         }
 
-        if (!tx->encryption) {
-                rtp_async_start(rtp_session, mult_pkt_cnt);
+        size_t enc_stride = 0;
+        if (tx->encryption != nullptr) {
+                enc_stride = tx_encrypt_packets(
+                    tx, tile, (uint32_t *) rtp_headers, rtp_hdr_len,
+                    frame->fec_params.type != FEC_NONE
+                        ? sizeof(fec_payload_hdr_t)
+                        : sizeof(video_payload_hdr_t),
+                    packet_sizes, mult_pkt_cnt);
+                if (enc_stride == 0) {
+                        MSG(ERROR, "Cannot allocate encryption buffer!\n");
+                        free(rtp_headers);
+                        return;
+                }
         }
 
+        // send more packets at once if the shaper allows it
+        vector<tx_pacer> pacers;
+        pacers.reserve(session_count);
+        for (int i = 0; i < session_count; ++i) {
+                pacers.emplace_back(tx, rtp_sessions[i],
+                                    packet_rate * session_count,
+                                    mult_pkt_cnt / session_count + 1,
+                                    get_frame_interval_ns(frame));
+        }
         rtp_hdr_packet = (uint32_t *) rtp_headers;
         for (long i = 0; i < mult_pkt_cnt; ++i) {
-                GET_STARTTIME;
                 const int m        = i == mult_pkt_cnt - 1 ? send_m : 0;
                 char     *data     = tile->data + ntohl(rtp_hdr_packet[1]);
                 int       data_len = packet_sizes.at(i % packet_sizes.size());
 
-                char encrypted_data[RTP_MAX_PACKET_LEN + MAX_CRYPTO_EXCEED];
                 if (tx->encryption != nullptr) {
-                        data_len = tx->enc_funcs->encrypt(
-                            tx->encryption, data, data_len,
-                            (char *) rtp_hdr_packet,
-                            frame->fec_params.type != FEC_NONE
-                                ? sizeof(fec_payload_hdr_t)
-                                : sizeof(video_payload_hdr_t),
-                            encrypted_data);
-                        data = encrypted_data;
+                        data     = tx->enc_arena + i * enc_stride;
+                        data_len = tx->enc_lens[i];
                 }
 
-                rtp_send_data_hdr(rtp_session, ts, pt, m, 0, nullptr,
-                                  (char *) rtp_hdr_packet, rtp_hdr_len, data,
-                                  data_len, nullptr, 0, 0);
+                pacers[i % session_count].send(ts, pt, m, (char *) rtp_hdr_packet,
+                                               rtp_hdr_len, data, data_len,
+                                               extn, extn_len);
                 rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
-
-                // TRAFFIC SHAPER
-                if (m != 1) { // wait for all but last packet
-                        do {
-                                GET_STOPTIME;
-                                GET_DELTA;
-                        } while (packet_rate - delta - overslept > 0);
-                        overslept = -(packet_rate - delta - overslept);
-                        //fprintf(stdout, "%ld ", overslept);
-                }
         }
 
         const long data_sent = tile->data_len + rtp_hdr_len * mult_pkt_cnt;
         report_stats(tx, rtp_session, data_sent);
 
-        if (!tx->encryption) {
-                rtp_async_wait(rtp_session);
+        for (auto &pacer : pacers) {
+                pacer.wait();
         }
-        free(rtp_headers);
+        // payload headers may still be referenced by zero-copy sends (only
+        // the first session may have zero-copy enabled)
+        rtp_zerocopy_hold(rtp_session, free, rtp_headers);
 }
 
 static void audio_tx_send_chan(struct tx *tx, struct rtp *rtp_session,
                                uint32_t timestamp, const audio_frame2 *buffer,
                                int channel, bool send_m);
+static void audio_tx_send_bundle(struct tx *tx, struct rtp *rtp_session,
+                                 uint32_t timestamp, const audio_frame2 *buffer,
+                                 bool send_m);
+
+ADD_TO_PARAM("audio-tx-bundle", "* audio-tx-bundle\n"
+                "  Send all audio channels of a frame in common packets instead of\n"
+                "  a packet stream per channel (needs a receiver supporting it).\n");
 
 /* 
  * This multiplication scheme relies upon the fact, that our RTP/pbuf implementation is
@@ -769,14 +1898,23 @@ audio_tx_send(struct tx *tx, struct rtp *rtp_session,
                 return;
         }
 
-        fec_check_messages(tx);
+        fec_check_messages(tx, rtp_session);
 
         const uint32_t timestamp =
             buffer->get_timestamp() == -1
                 ? get_local_mediatime()
                 : get_local_mediatime_offset() + buffer->get_timestamp();
 
+        // FEC is computed per channel so it is sent in the legacy mode
+        const bool bundle = tx->audio_bundle &&
+                            buffer->get_fec_params(0).type == FEC_NONE;
+
         for (int iter = 0; iter < tx->mult_count; ++iter) {
+                if (bundle) {
+                        audio_tx_send_bundle(tx, rtp_session, timestamp, buffer,
+                                             iter == tx->mult_count - 1);
+                        continue;
+                }
                 for (int chan = 0; chan < buffer->get_channel_count(); ++chan) {
                         bool send_m = iter == tx->mult_count - 1 &&
                                       chan == buffer->get_channel_count() - 1;
@@ -874,6 +2012,82 @@ audio_tx_send_chan(struct tx *tx, struct rtp *rtp_session, uint32_t timestamp,
         report_stats(tx, rtp_session, data_sent);
 }
 
+/**
+ * Sends all channels of the frame as a single planar bundle (see
+ * PT_AUDIO_BUNDLE) - the payload header is the audio one with substream set
+ * to channel count - 1 and length to the length of the whole bundle.
+ */
+static void
+audio_tx_send_bundle(struct tx *tx, struct rtp *rtp_session, uint32_t timestamp,
+                     const audio_frame2 *buffer, bool send_m)
+{
+        const int ch_count = buffer->get_channel_count();
+        size_t bundle_len = ch_count * sizeof(uint32_t);
+        for (int i = 0; i < ch_count; ++i) {
+                bundle_len += buffer->get_data_len(i);
+        }
+        if (tx->bundle_buf_size < bundle_len) {
+                free(tx->bundle_buf);
+                tx->bundle_buf = (char *) malloc(bundle_len);
+                tx->bundle_buf_size = bundle_len;
+        }
+        // channel lengths followed by channel data
+        char *out = tx->bundle_buf + ch_count * sizeof(uint32_t);
+        for (int i = 0; i < ch_count; ++i) {
+                uint32_t len = htonl(buffer->get_data_len(i));
+                memcpy(tx->bundle_buf + i * sizeof(uint32_t), &len, sizeof len);
+                memcpy(out, buffer->get_data(i), buffer->get_data_len(i));
+                out += buffer->get_data_len(i);
+        }
+
+        const int pt = tx->encryption ? PT_ENCRYPT_AUDIO_BUNDLE : PT_AUDIO_BUNDLE;
+        uint32_t rtp_hdr[100];
+        int rtp_hdr_len = sizeof(audio_payload_hdr_t);
+        int hdrs_len = get_tx_hdr_len(rtp_is_ipv6(rtp_session)) + rtp_hdr_len;
+        format_audio_header(buffer, ch_count - 1, tx->buffer, rtp_hdr);
+        rtp_hdr[2] = htonl(bundle_len);
+
+        if (tx->encryption) {
+                hdrs_len += sizeof(crypto_payload_hdr_t) +
+                            tx->enc_funcs->get_overhead(tx->encryption);
+                rtp_hdr[rtp_hdr_len / sizeof(uint32_t)] =
+                    htonl(DEFAULT_CIPHER_MODE << 24);
+                rtp_hdr_len += sizeof(crypto_payload_hdr_t);
+        }
+
+        long data_sent = 0;
+        size_t pos = 0;
+        do {
+                const char *data     = tx->bundle_buf + pos;
+                int         data_len = tx->mtu - hdrs_len;
+                unsigned    m        = 0;
+                if (pos + data_len >= bundle_len) {
+                        data_len = bundle_len - pos;
+                        m = send_m ? 1 : 0;
+                }
+                rtp_hdr[1] = htonl(pos);
+                pos += data_len;
+
+                char encrypted_data[RTP_MAX_PACKET_LEN + MAX_CRYPTO_EXCEED];
+                if (tx->encryption) {
+                        data_len = tx->enc_funcs->encrypt(
+                            tx->encryption, const_cast<char *>(data), data_len,
+                            (char *) rtp_hdr,
+                            rtp_hdr_len - sizeof(crypto_payload_hdr_t),
+                            encrypted_data);
+                        data = encrypted_data;
+                }
+
+                data_sent += data_len + rtp_hdr_len;
+
+                rtp_send_data_hdr(rtp_session, timestamp, pt, m, 0, 0,
+                                  (char *) rtp_hdr, rtp_hdr_len,
+                                  const_cast<char *>(data), data_len, 0, 0, 0);
+        } while (pos < bundle_len);
+
+        report_stats(tx, rtp_session, data_sent);
+}
+
 static bool
 validate_std_audio(const audio_frame2 * buffer, int payload_size)
 {
@@ -984,6 +2198,45 @@ void audio_tx_send_standard(struct tx* tx, struct rtp *rtp_session,
 	} while (pos < data_len);
 }
 
+/// packet of the standard RTP senders, packetized prior to sending
+struct tx_std_packet {
+        uint32_t hdr[3]; ///< payload header (FU-A or RTP/JPEG header)
+        int hdr_len;
+        char *ext_hdr; ///< used instead of hdr if not NULL
+        char *data;
+        int data_len;
+        int m;
+};
+
+/**
+ * Sends packetized frame with the shared shaper, see tx_pacer.
+ *
+ * @param pace  packets should be spread to the frame time (if the rate is limited)
+ */
+static void
+tx_send_std_packets(struct tx *tx, struct video_frame *frame,
+                    struct rtp *rtp_session, uint32_t ts, int pt, bool pace,
+                    std::vector<tx_std_packet> &packets)
+{
+        if (packets.empty()) {
+                return;
+        }
+        const long packet_rate =
+            pace ? get_packet_rate(tx, frame, 0, (long) packets.size()) : 0;
+        tx_pacer pacer(tx, rtp_session, packet_rate, (long) packets.size(),
+                       get_frame_interval_ns(frame));
+        for (auto &p : packets) {
+                char *hdr = p.ext_hdr != nullptr ? p.ext_hdr
+                            : p.hdr_len > 0      ? (char *) p.hdr
+                                                 : nullptr;
+                if (pacer.send(ts, pt, p.m, hdr, p.hdr_len, p.data,
+                               p.data_len, nullptr, 0) < 0) {
+                        MSG(ERROR, "There was a problem sending the RTP packet\n");
+                }
+        }
+        pacer.wait();
+}
+
 /**
  *  H.264 standard transmission
  */
@@ -992,23 +2245,39 @@ void tx_send_h264(struct tx *tx, struct video_frame *frame,
         assert(frame->tile_count == 1); // std transmit doesn't handle more than one tile
         assert(!frame->fragment || tx->fec_scheme == FEC_NONE); // currently no support for FEC with fragments
         assert(!frame->fragment || frame->tile_count); // multiple tiles are not currently supported for fragmented send
+        rate_ctl_update(tx, rtp_session, frame->color_spec);
         uint32_t ts = get_std_video_local_mediatime();
+        if (frame->fragment &&
+            tx->last_frame_fragment_id == frame->frame_fragment_id) {
+                ts = tx->last_ts;
+        } else {
+                tx->last_frame_fragment_id = frame->frame_fragment_id;
+                tx->last_ts = ts;
+        }
+        // M bit only at the end of the last fragment
+        const bool last_fragment = !frame->fragment || frame->last_fragment;
         struct tile *tile = &frame->tiles[0];
 
 	char pt =  PT_DynRTP_Type96;
 	unsigned char hdr[2];
-	int cc = 0;
-	uint32_t csrc = 0;
 	int m = 0;
-	char *extn = 0;
-	uint16_t extn_len = 0;
-	uint16_t extn_type = 0;
 	const uint8_t *start = (uint8_t *) tile->data;
 	int data_len = tile->data_len;
 	unsigned maxPacketSize = tx->mtu - 40;
 
         const unsigned char *endptr = 0;
         const unsigned char *nal = start;
+        std::vector<tx_std_packet> packets;
+        packets.reserve(data_len / maxPacketSize + 8);
+        auto add_packet = [&](const unsigned char *phdr, int phdr_len, char *data, int len) {
+                tx_std_packet p{};
+                memcpy(p.hdr, phdr, phdr_len);
+                p.hdr_len = phdr_len;
+                p.data = data;
+                p.data_len = len;
+                p.m = m;
+                packets.push_back(p);
+        };
 
         while ((nal = rtpenc_get_next_nal(nal, data_len - (nal - start), &endptr))) {
                 unsigned int nalsize = endptr - nal;
@@ -1031,12 +2300,8 @@ void tx_send_h264(struct tx *tx, struct video_frame *frame,
 			if (curNALOffset == 0) { // case 1 or 2
 				if (nalsize	<= maxPacketSize) { // case 1
 
-					if (eof) m = 1;
-					if (rtp_send_data(rtp_session, ts, pt, m, cc, &csrc,
-							nalc, nalsize,
-							extn, extn_len, extn_type) < 0) {
-						error_msg("There was a problem sending the RTP packet\n");
-					}
+					if (eof && last_fragment) m = 1;
+					add_packet(hdr, 0, nalc, nalsize);
 					lastNALUnitFragment = true;
 				} else { // case 2
 					// We need to send the NAL unit data as FU packets.  Deliver the first
@@ -1045,12 +2310,7 @@ void tx_send_h264(struct tx *tx, struct video_frame *frame,
 					hdr[0] = (nal[0] & 0xE0) | 28; //FU indicator
 					hdr[1] = 0x80 | (nal[0] & 0x1F); // FU header (with S bit)
 
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-									(char *) hdr, 2,
-									nalc + 1, maxPacketSize - 2,
-									extn, extn_len, extn_type) < 0) {
-										error_msg("There was a problem sending the RTP packet\n");
-					}
+					add_packet(hdr, 2, nalc + 1, maxPacketSize - 2);
 					curNALOffset += maxPacketSize - 1;
 					lastNALUnitFragment = false;
 					nalsize -= maxPacketSize - 1;
@@ -1065,29 +2325,18 @@ void tx_send_h264(struct tx *tx, struct video_frame *frame,
 
 				if (nalsize + 1 > maxPacketSize) {
 					// We can't send all of the remaining data this time:
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-							(char *) hdr, 2,
-							nalc + curNALOffset,
-							maxPacketSize - 2, extn, extn_len,
-							extn_type) < 0) {
-								error_msg("There was a problem sending the RTP packet\n");
-					}
+					add_packet(hdr, 2, nalc + curNALOffset, maxPacketSize - 2);
 					curNALOffset += maxPacketSize - 2;
 					lastNALUnitFragment = false;
 					nalsize -= maxPacketSize - 2;
 
 				} else {
 					// This is the last fragment:
-					if (eof) m = 1;
+					if (eof && last_fragment) m = 1;
 
 					hdr[1] |= 0x40;// set the E bit in the FU header
 
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-									(char *) hdr, 2,
-									nalc + curNALOffset,
-									nalsize, extn, extn_len, extn_type) < 0) {
-										error_msg("There was a problem sending the RTP packet\n");
-					}
+					add_packet(hdr, 2, nalc + curNALOffset, nalsize);
 					lastNALUnitFragment = true;
 				}
 			}
@@ -1096,6 +2345,9 @@ void tx_send_h264(struct tx *tx, struct video_frame *frame,
         if (endptr != start + data_len) {
                 error_msg("No NAL found!\n");
         }
+        // fragments are already spread by the encoder, do not delay them
+        tx_send_std_packets(tx, frame, rtp_session, ts, pt, !frame->fragment,
+                            packets);
 }
 
 void tx_send_jpeg(struct tx *tx, struct video_frame *frame,
@@ -1142,6 +2394,8 @@ void tx_send_jpeg(struct tx *tx, struct video_frame *frame,
         int bytes_left = tile->data_len - ((char *) d.data - tile->data);
         int max_mtu = tx->mtu - ((rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12); // IP hdr size + UDP hdr size + RTP hdr size
 
+        std::vector<tx_std_packet> packets;
+        packets.reserve(bytes_left / max_mtu + 2);
         int fragment_offset = 0;
         do {
                 int hdr_len;
@@ -1156,18 +2410,25 @@ void tx_send_jpeg(struct tx *tx, struct video_frame *frame,
                         data_len = bytes_left;
                         m = 1;
                 }
-                jpeg_hdr[0] = htonl(type_spec << 24u | fragment_offset);
-
-                int ret = rtp_send_data_hdr(rtp_session, ts, pt, m, 0, 0,
-                                (char *) &jpeg_hdr, hdr_len,
-                                data, data_len, 0, 0, 0);
-                if (ret < 0) {
-                        log_msg(LOG_LEVEL_ERROR, "Error sending RTP/JPEG packet!\n");
+                tx_std_packet p{};
+                p.hdr_len = hdr_len;
+                if (fragment_offset == 0) { // jpeg_hdr[0] has offset 0
+                        p.ext_hdr = (char *) jpeg_hdr;
+                } else {
+                        memcpy(p.hdr, jpeg_hdr, hdr_len);
+                        p.hdr[0] = htonl(type_spec << 24u | fragment_offset);
                 }
+                p.data = data;
+                p.data_len = data_len;
+                p.m = m;
+                packets.push_back(p);
+
                 data += data_len;
                 bytes_left -= data_len;
                 fragment_offset += data_len;
         } while (bytes_left > 0);
+
+        tx_send_std_packets(tx, frame, rtp_session, ts, pt, true, packets);
 }
 
 int tx_get_buffer_id(struct tx *tx)
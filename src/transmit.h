@@ -76,8 +76,11 @@ struct video_frame;
 struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media_type,
                 const char *fec, const char *encryption, long long bitrate);
 void             tx_send(struct tx *tx_session, struct video_frame *frame, struct rtp *rtp_session);
+void             tx_send_striped(struct tx *tx_session, struct video_frame *frame,
+                struct rtp *const *rtp_sessions, int session_count);
 void             format_video_header(struct video_frame *frame, int tile_idx, int buffer_idx,
                 uint32_t *hdr);
+void             tx_probe_path_mtu(struct tx *tx_session, struct rtp *rtp_session);
 
 void tx_send_h264(struct tx *tx_session, struct video_frame *frame, struct rtp *rtp_session);
 void tx_send_jpeg(struct tx *tx_session, struct video_frame *frame, struct rtp *rtp_session);
@@ -92,10 +95,13 @@ int tx_get_buffer_id(struct tx *tx_session);
 #endif
 
 #ifdef __cplusplus
+#include <vector>
+
 class audio_frame2;
 void             audio_tx_send(struct tx *tx_session, struct rtp *rtp_session, const audio_frame2 *buffer);
 void             audio_tx_send_standard(struct tx* tx, struct rtp *rtp_session, const audio_frame2 * buffer);
 void             format_audio_header(const class audio_frame2 *frame, int channel, int buffer_idx, uint32_t *audio_hdr);
+std::vector<int> tx_get_packet_sizes(struct video_frame *frame, int substream, int mtu);
 #endif
 
 #endif // TRANSMIT_H_
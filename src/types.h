@@ -191,6 +191,14 @@ struct video_desc {
 #endif
 };
 
+/// rectangle within a (merged) video frame, in pixels
+struct video_roi {
+        unsigned int x;
+        unsigned int y;
+        unsigned int width;
+        unsigned int height;
+};
+
 typedef enum frame_type {
     INTRA = 0,
     BFRAME,
@@ -290,6 +298,14 @@ struct tile {
         /// @brief Fragment offset from tile beginning (in bytes). Used only if frame is fragmented.
         /// @see video_frame::fragment
         unsigned int         offset;
+
+        /**
+         * @brief Distance between lines in bytes, 0 if the lines are stored
+         * contiguously (the usual case).
+         * Non-zero only for tiles referencing a part of a larger frame, see
+         * vf_split_view(). data_len is then the size of the tile itself.
+         */
+        unsigned int         pitch;
 };
 
 #define FLEXIBLE_ARRAY_MEMBER 0
@@ -337,6 +353,11 @@ struct video_frame {
         };
         int64_t compress_start; ///< in ns from epoch
         int64_t compress_end;   ///< in ns from epoch
+        int64_t presentation_time; ///< target presentation time in ns (get_time_in_ns() clock), 0 if unknown
+        uint32_t trace_id; ///< frame trace ID (see utils/frame_trace.h), 0 if not traced
+        int64_t capture_time; ///< in ns from epoch, 0 if not stamped (see --param glass-latency)
+        int64_t send_time;    ///< in ns from epoch, transmission start (sender's clock)
+        int64_t recv_time;    ///< in ns from epoch, frame received (receiver)
 #define VF_METADATA_END tile_count
 
         /// tiles contain actual video frame data. A frame usually contains exactly one
@@ -41,6 +41,8 @@
 #include "config_win32.h"
 #endif
 
+#include <stdatomic.h>
+
 #include "audio/types.h"
 #include "debug.h"
 #include "host.h"
@@ -68,8 +70,9 @@ struct audio_buffer {
         int suggested_latency_ms;
 
         // moving averages
-        int in_pkt_size;
-        int out_pkt_size;
+        atomic_int in_pkt_size; ///< updated by the writer, read by the reader
+        atomic_int requested_latency_bytes; ///< updated by the reader, see audio_buffer_get_fill()
+        int out_pkt_size; ///< all following members are used by the reader only
         int avg_occupancy[2]; // at read time
         int last_underrun; // last underrun n output frames ago
         int last_overrun; // last overrun n output frames ago
@@ -85,6 +88,8 @@ struct audio_buffer *audio_buffer_init(int sample_rate, int bps, int ch_count, i
         buf->desc.ch_count = ch_count;
 
         buf->last_underrun = BUF_LAST_UNDERRUN_MAX;
+        atomic_init(&buf->in_pkt_size, 0);
+        atomic_init(&buf->requested_latency_bytes, 0);
 
         buf->ring = ring_buffer_init(sample_rate * bps * ch_count);
 
@@ -133,7 +138,9 @@ int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len)
         }
 
         int suggested_latency_bytes = buf->suggested_latency_ms * buf->desc.bps * buf->desc.ch_count * buf->desc.sample_rate / 1000;
-        int requested_latency_bytes = max(suggested_latency_bytes, 2*max(buf->in_pkt_size, buf->out_pkt_size));
+        const int in_pkt_size = atomic_load_explicit(&buf->in_pkt_size, memory_order_relaxed);
+        int requested_latency_bytes = max(suggested_latency_bytes, 2*max(in_pkt_size, buf->out_pkt_size));
+        atomic_store_explicit(&buf->requested_latency_bytes, requested_latency_bytes, memory_order_relaxed);
 
         int ret = ring_buffer_read(buf->ring, out, max_len);
 
@@ -155,32 +162,46 @@ int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len)
                 int len_drop = (1<<buf->aggressivity) * buf->desc.bps * buf->desc.ch_count * 128;
                 len_drop = min(len_drop, remaining_bytes / 2);
 
-                char *tmp = alloca(len_drop);
-                ring_buffer_read(buf->ring, tmp, len_drop);
+                ring_advance_read_idx(buf->ring, len_drop);
                 buf->last_overrun = 0;
                 log_msg(LOG_LEVEL_VERBOSE, "Dropped audio samples: req latency %d remaining %d dropped %d!\n", requested_latency_bytes, remaining_bytes, len_drop);
         } else {
                 buf->last_overrun += 1;
         }
 
-        log_msg(LOG_LEVEL_DEBUG, "buf - in a. %d, out a. %d, occ. a. [%d,%d] last under/overrun %d, %d aggressivity %d\n", buf->in_pkt_size, buf->out_pkt_size, buf->avg_occupancy[0],buf->avg_occupancy[1], buf->last_underrun, buf->last_overrun, buf->aggressivity);
+        log_msg(LOG_LEVEL_DEBUG, "buf - in a. %d, out a. %d, occ. a. [%d,%d] last under/overrun %d, %d aggressivity %d\n", in_pkt_size, buf->out_pkt_size, buf->avg_occupancy[0],buf->avg_occupancy[1], buf->last_underrun, buf->last_overrun, buf->aggressivity);
 
         return ret;
 }
 
 void audio_buffer_write(struct audio_buffer *buf, const char *in, int len)
 {
-        if (buf->in_pkt_size > 0) {
-                buf->in_pkt_size = (len + (buf->in_pkt_size * (WINDOW-1))) / WINDOW;
+        // in_pkt_size is written only by this (writer) thread
+        int in_pkt_size = atomic_load_explicit(&buf->in_pkt_size, memory_order_relaxed);
+        if (in_pkt_size > 0) {
+                in_pkt_size = (len + (in_pkt_size * (WINDOW-1))) / WINDOW;
         } else {
-                buf->in_pkt_size = len;
+                in_pkt_size = len;
         }
+        atomic_store_explicit(&buf->in_pkt_size, in_pkt_size, memory_order_relaxed);
         ring_buffer_write(buf->ring, in, len);
 }
 
+void audio_buffer_get_fill(struct audio_buffer *buf, int *fill, int *target)
+{
+        *fill = ring_get_current_size(buf->ring);
+        int requested_latency_bytes = atomic_load_explicit(&buf->requested_latency_bytes, memory_order_relaxed);
+        if (requested_latency_bytes == 0) { // reader not yet started
+                requested_latency_bytes = buf->suggested_latency_ms * buf->desc.bps * buf->desc.ch_count * buf->desc.sample_rate / 1000;
+        }
+        // keep the occupancy in the middle between underrun and dropping
+        *target = requested_latency_bytes / 2;
+}
+
 struct audio_buffer_api audio_buffer_fns = {
         (void (*)(void *)) audio_buffer_destroy,
         (int (*)(void *, char *, int)) audio_buffer_read,
         (void (*)(void *, const char *, int)) audio_buffer_write,
+        (void (*)(void *, int *, int *)) audio_buffer_get_fill,
 };
 
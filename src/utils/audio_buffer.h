@@ -42,6 +42,15 @@
 extern "C" {
 #endif
 
+/**
+ * Adaptive playback buffer dropping samples if the occupancy exceeds the
+ * requested latency.
+ *
+ * The buffer is wait-free single-producer single-consumer - one thread may
+ * call audio_buffer_write() while other calls audio_buffer_read() without
+ * any locking, so that the reader may be a real-time audio callback.
+ * Calls of the same kind must not be issued concurrently.
+ */
 struct audio_buffer;
 typedef struct audio_buffer audio_buffer_t;
 
@@ -49,12 +58,19 @@ struct audio_buffer *audio_buffer_init(int sample_rate, int bps, int ch_count, i
 void audio_buffer_destroy(struct audio_buffer *buf);
 int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len);
 void audio_buffer_write(struct audio_buffer *buf, const char *in, int len);
+/**
+ * Returns current occupancy and the occupancy that the buffer tends to keep
+ * (both in bytes), intended for the clock drift compensation. May be called
+ * from the writer thread.
+ */
+void audio_buffer_get_fill(struct audio_buffer *buf, int *fill, int *target);
 
 // used also for ring buffer;
 struct audio_buffer_api {
         void (*destroy)(void *buf);
         int (*read)(void *buf, char *out, int max_len);
         void (*write)(void *buf, const char *in, int len);
+        void (*get_fill)(void *buf, int *fill, int *target); ///< in bytes
 };
 
 extern struct audio_buffer_api audio_buffer_fns;
@@ -4,6 +4,12 @@
 #include <cuda_runtime.h>
 #include <time.h>
 
+#include "utils/cuda_pix_conv.h"
+#include "video_codec.h"
+
+#define LOG_LEVEL_ERROR 2
+extern "C" void log_msg(int log_level, const char *format, ...);
+
         __global__
 void kern_RGBtoRGBA(unsigned char *dst,
                 size_t dstPitch,
@@ -134,6 +140,158 @@ void kern_RGBAtoUYVY(unsigned char *dst,
 }
 
 
+/// one thread per 6-pixel v210 block, the incomplete tail block is skipped
+/// (same as vc_copylinev210)
+__global__
+void kern_v210toUYVY(unsigned char *dst,
+		size_t dstPitch,
+		unsigned char *src,
+		size_t srcPitch,
+		size_t width,
+		size_t height)
+{
+	const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+	const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+	if(x >= width / 6)
+		return;
+
+	if(y >= height)
+		return;
+
+	const uint4 in = ((uint4 *) (src + y * srcPitch))[x];
+	uchar4 *dst_px = (uchar4 *) (dst + y * dstPitch) + 3 * x;
+
+	dst_px[0] = make_uchar4(in.x >> 2, in.x >> 12, in.x >> 22, in.y >> 2);
+	dst_px[1] = make_uchar4(in.y >> 12, in.y >> 22, in.z >> 2, in.z >> 12);
+	dst_px[2] = make_uchar4(in.z >> 22, in.w >> 2, in.w >> 12, in.w >> 22);
+}
+
+/// one thread per output UYVY macropixel, chroma is averaged
+__global__
+void kern_Y416toUYVY(unsigned char *dst,
+		size_t dstPitch,
+		unsigned char *src,
+		size_t srcPitch,
+		size_t width,
+		size_t height)
+{
+	const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+	const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+	if(x >= width / 2)
+		return;
+
+	if(y >= height)
+		return;
+
+	const ushort4 *src_px = (ushort4 *) (src + y * srcPitch) + 2 * x;
+	uchar4 *dst_px = (uchar4 *) (dst + y * dstPitch) + x;
+
+	const ushort4 px1 = src_px[0];
+	const ushort4 px2 = src_px[1];
+
+	*dst_px = make_uchar4(((px1.x >> 8) + (px2.x >> 8)) / 2, px1.y >> 8,
+			((px1.z >> 8) + (px2.z >> 8)) / 2, px2.y >> 8);
+}
+
+__global__
+void kern_R10ktoRGBA(unsigned char *dst,
+		size_t dstPitch,
+		unsigned char *src,
+		size_t srcPitch,
+		size_t width,
+		size_t height,
+		int rshift, int gshift, int bshift)
+{
+	const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+	const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+	if(x >= width)
+		return;
+
+	if(y >= height)
+		return;
+
+	const uchar4 in = ((uchar4 *) (src + y * srcPitch))[x];
+	const uint32_t alpha_mask = 0xFFFFFFFFU ^ (0xFFU << rshift) ^ (0xFFU << gshift) ^ (0xFFU << bshift);
+
+	const uint32_t r = in.x;
+	const uint32_t g = ((in.y & 0x3FU) << 2U) | (in.z >> 6U);
+	const uint32_t b = ((in.z & 0xFU) << 4U) | (in.w >> 4U);
+
+	((uint32_t *) (dst + y * dstPitch))[x] = alpha_mask | r << rshift | g << gshift | b << bshift;
+}
+
+/**
+ * R12L is a little-endian bitstream of 12-bit R, G, B components, 8 pixels
+ * in a 36 B block
+ */
+__device__ static uint32_t
+get_R12L_comp(const unsigned char *block, int idx)
+{
+	const unsigned char *p = block + idx * 12 / 8;
+	if (idx % 2 == 0) {
+		return p[0] | (p[1] & 0xFU) << 8U;
+	}
+	return p[0] >> 4U | p[1] << 4U;
+}
+
+__global__
+void kern_R12LtoRGBA(unsigned char *dst,
+		size_t dstPitch,
+		unsigned char *src,
+		size_t srcPitch,
+		size_t width,
+		size_t height,
+		int rshift, int gshift, int bshift)
+{
+	const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+	const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+	if(x >= width)
+		return;
+
+	if(y >= height)
+		return;
+
+	const unsigned char *block = src + y * srcPitch + (x / 8) * 36;
+	const int comp = (x % 8) * 3;
+	const uint32_t alpha_mask = 0xFFFFFFFFU ^ (0xFFU << rshift) ^ (0xFFU << gshift) ^ (0xFFU << bshift);
+
+	((uint32_t *) (dst + y * dstPitch))[x] = alpha_mask |
+		(get_R12L_comp(block, comp) >> 4U) << rshift |
+		(get_R12L_comp(block, comp + 1) >> 4U) << gshift |
+		(get_R12L_comp(block, comp + 2) >> 4U) << bshift;
+}
+
+__global__
+void kern_R12LtoRG48(unsigned char *dst,
+		size_t dstPitch,
+		unsigned char *src,
+		size_t srcPitch,
+		size_t width,
+		size_t height)
+{
+	const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+	const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+	if(x >= width)
+		return;
+
+	if(y >= height)
+		return;
+
+	const unsigned char *block = src + y * srcPitch + (x / 8) * 36;
+	const int comp = (x % 8) * 3;
+	ushort3 *dst_px = (ushort3 *) (dst + y * dstPitch) + x;
+
+	*dst_px = make_ushort3(get_R12L_comp(block, comp) << 4U,
+			get_R12L_comp(block, comp + 1) << 4U,
+			get_R12L_comp(block, comp + 2) << 4U);
+}
+
+
 void cuda_RGB_to_RGBA(unsigned char *dst,
                 size_t dstPitch,
                 unsigned char *src,
@@ -193,3 +351,225 @@ void cuda_UYVY_to_RGBA(unsigned char *dst,
 
         kern_UYVYtoRGBA<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height);
 }
+
+void cuda_v210_to_UYVY(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                CUstream_st *stream){
+
+        dim3 blockSize(32,32);
+        dim3 numBlocks((width / 6 + blockSize.x - 1) / blockSize.x,
+                        (height + blockSize.y - 1) / blockSize.y);
+
+        kern_v210toUYVY<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height);
+}
+
+void cuda_Y416_to_UYVY(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                CUstream_st *stream){
+
+        dim3 blockSize(32,32);
+        dim3 numBlocks((width / 2 + blockSize.x - 1) / blockSize.x,
+                        (height + blockSize.y - 1) / blockSize.y);
+
+        kern_Y416toUYVY<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height);
+}
+
+void cuda_R10k_to_RGBA(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                int rshift, int gshift, int bshift,
+                CUstream_st *stream){
+
+        dim3 blockSize(32,32);
+        dim3 numBlocks((width + blockSize.x - 1) / blockSize.x,
+                        (height + blockSize.y - 1) / blockSize.y);
+
+        kern_R10ktoRGBA<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height,
+                        rshift, gshift, bshift);
+}
+
+void cuda_R12L_to_RGBA(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                int rshift, int gshift, int bshift,
+                CUstream_st *stream){
+
+        dim3 blockSize(32,32);
+        dim3 numBlocks((width + blockSize.x - 1) / blockSize.x,
+                        (height + blockSize.y - 1) / blockSize.y);
+
+        kern_R12LtoRGBA<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height,
+                        rshift, gshift, bshift);
+}
+
+void cuda_R12L_to_RG48(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                CUstream_st *stream){
+
+        dim3 blockSize(32,32);
+        dim3 numBlocks((width + blockSize.x - 1) / blockSize.x,
+                        (height + blockSize.y - 1) / blockSize.y);
+
+        kern_R12LtoRG48<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height);
+}
+
+struct cuda_pix_conv {
+        codec_t in;
+        codec_t out;
+        int width;
+        int height;
+        int shifts[3];
+
+        size_t src_len;
+        size_t src_pitch;
+        unsigned char *d_src;
+        unsigned char *d_dst;
+        size_t d_dst_pitch;
+        cudaStream_t stream;
+};
+
+static const struct {
+        codec_t in;
+        codec_t out;
+} cuda_pix_conv_list[] = {
+        { RGB, RGBA },
+        { RGBA, RGB },
+        { RGBA, UYVY },
+        { UYVY, RGBA },
+        { v210, UYVY },
+        { Y416, UYVY },
+        { R10k, RGBA },
+        { R12L, RGBA },
+        { R12L, RG48 },
+};
+
+bool cuda_pix_conv_supported(codec_t in, codec_t out)
+{
+        for (unsigned i = 0; i < sizeof cuda_pix_conv_list / sizeof cuda_pix_conv_list[0]; ++i) {
+                if (cuda_pix_conv_list[i].in == in && cuda_pix_conv_list[i].out == out) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+#define CHECK_CUDA(cmd, action) do { \
+        cudaError_t err = cmd; \
+        if (err != cudaSuccess) { \
+                log_msg(LOG_LEVEL_ERROR, "[cuda_pix_conv] %s: %s\n", #cmd, cudaGetErrorString(err)); \
+                action; \
+        } \
+} while (0)
+
+struct cuda_pix_conv *cuda_pix_conv_init(codec_t in, codec_t out, int width,
+                int height, int rshift, int gshift, int bshift)
+{
+        if (!cuda_pix_conv_supported(in, out)) {
+                return NULL;
+        }
+        struct cuda_pix_conv *s = (struct cuda_pix_conv *) calloc(1, sizeof *s);
+        s->in = in;
+        s->out = out;
+        s->width = width;
+        s->height = height;
+        s->shifts[0] = rshift;
+        s->shifts[1] = gshift;
+        s->shifts[2] = bshift;
+        s->src_pitch = vc_get_linesize(width, in);
+        s->src_len = s->src_pitch * height;
+
+        CHECK_CUDA(cudaStreamCreate(&s->stream), free(s); return NULL);
+        CHECK_CUDA(cudaMalloc((void **) &s->d_src, s->src_len), cuda_pix_conv_destroy(s); return NULL);
+        CHECK_CUDA(cudaMallocPitch((void **) &s->d_dst, &s->d_dst_pitch, vc_get_linesize(width, out), height),
+                        cuda_pix_conv_destroy(s); return NULL);
+        return s;
+}
+
+static bool cuda_pix_conv_run(struct cuda_pix_conv *s, const unsigned char *src)
+{
+        CHECK_CUDA(cudaMemcpyAsync(s->d_src, src, s->src_len, cudaMemcpyHostToDevice, s->stream), return false);
+
+        unsigned char *d = s->d_dst;
+        const size_t dp = s->d_dst_pitch;
+        unsigned char *sp = s->d_src;
+        const size_t spp = s->src_pitch;
+        const size_t w = s->width;
+        const size_t h = s->height;
+        switch (s->in) {
+        case RGB:  cuda_RGB_to_RGBA(d, dp, sp, spp, w, h, s->stream); break;
+        case RGBA: if (s->out == RGB) {
+                           cuda_RGBA_to_RGB(d, dp, sp, spp, w, h, s->stream);
+                   } else {
+                           cuda_RGBA_to_UYVY(d, dp, sp, spp, w, h, s->stream);
+                   }
+                   break;
+        case UYVY: cuda_UYVY_to_RGBA(d, dp, sp, spp, w, h, s->stream); break;
+        case v210: cuda_v210_to_UYVY(d, dp, sp, spp, w, h, s->stream); break;
+        case Y416: cuda_Y416_to_UYVY(d, dp, sp, spp, w, h, s->stream); break;
+        case R10k: cuda_R10k_to_RGBA(d, dp, sp, spp, w, h, s->shifts[0], s->shifts[1], s->shifts[2], s->stream); break;
+        case R12L: if (s->out == RG48) {
+                           cuda_R12L_to_RG48(d, dp, sp, spp, w, h, s->stream);
+                   } else {
+                           cuda_R12L_to_RGBA(d, dp, sp, spp, w, h, s->shifts[0], s->shifts[1], s->shifts[2], s->stream);
+                   }
+                   break;
+        default:   abort();
+        }
+        CHECK_CUDA(cudaGetLastError(), return false);
+        return true;
+}
+
+bool cuda_pix_conv_frame(struct cuda_pix_conv *s, unsigned char *dst,
+                size_t dst_pitch, const unsigned char *src)
+{
+        if (!cuda_pix_conv_run(s, src)) {
+                return false;
+        }
+        CHECK_CUDA(cudaMemcpy2DAsync(dst, dst_pitch, s->d_dst, s->d_dst_pitch,
+                                vc_get_linesize(s->width, s->out), s->height,
+                                cudaMemcpyDeviceToHost, s->stream), return false);
+        CHECK_CUDA(cudaStreamSynchronize(s->stream), return false);
+        return true;
+}
+
+unsigned char *cuda_pix_conv_frame_device(struct cuda_pix_conv *s,
+                const unsigned char *src, size_t *pitch)
+{
+        if (!cuda_pix_conv_run(s, src)) {
+                return NULL;
+        }
+        CHECK_CUDA(cudaStreamSynchronize(s->stream), return NULL);
+        *pitch = s->d_dst_pitch;
+        return s->d_dst;
+}
+
+void cuda_pix_conv_destroy(struct cuda_pix_conv *s)
+{
+        if (s == NULL) {
+                return;
+        }
+        cudaFree(s->d_src);
+        cudaFree(s->d_dst);
+        if (s->stream != NULL) {
+                cudaStreamDestroy(s->stream);
+        }
+        free(s);
+}
@@ -3,6 +3,8 @@
 #ifndef CUDA_RGB_RGBA_H
 #define CUDA_RGB_RGBA_H
 
+#include "types.h" // codec_t
+
 void cuda_RGB_to_RGBA(unsigned char *dst,
                 size_t dstPitch,
                 unsigned char *src,
@@ -35,4 +37,80 @@ void cuda_UYVY_to_RGBA(unsigned char *dst,
                 size_t height,
                 struct CUstream_st *stream);
 
+void cuda_v210_to_UYVY(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                struct CUstream_st *stream);
+
+void cuda_Y416_to_UYVY(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                struct CUstream_st *stream);
+
+void cuda_R10k_to_RGBA(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                int rshift, int gshift, int bshift,
+                struct CUstream_st *stream);
+
+void cuda_R12L_to_RGBA(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                int rshift, int gshift, int bshift,
+                struct CUstream_st *stream);
+
+void cuda_R12L_to_RG48(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                struct CUstream_st *stream);
+
+/**
+ * @defgroup cuda_pix_conv Whole-frame CUDA pixel format conversion
+ *
+ * Alternative to the CPU line decoders (decoder_t) for the formats listed by
+ * cuda_pix_conv_supported(). The source frame is uploaded, converted and
+ * either downloaded to host memory or left in device memory for a consumer
+ * that can use it directly (GPU interop).
+ * @{
+ */
+struct cuda_pix_conv;
+
+bool cuda_pix_conv_supported(codec_t in, codec_t out);
+/**
+ * @returns state or NULL if the conversion is not supported or CUDA
+ *          initialization fails
+ */
+struct cuda_pix_conv *cuda_pix_conv_init(codec_t in, codec_t out, int width,
+                int height, int rshift, int gshift, int bshift);
+/**
+ * Converts host frame src (with vc_get_linesize() pitch) to host buffer dst.
+ */
+bool cuda_pix_conv_frame(struct cuda_pix_conv *s, unsigned char *dst,
+                size_t dst_pitch, const unsigned char *src);
+/**
+ * Same as cuda_pix_conv_frame() but the result is left in device memory.
+ *
+ * @param[out] pitch pitch of the returned buffer
+ * @returns device pointer valid until next call or destroy, NULL on error
+ */
+unsigned char *cuda_pix_conv_frame_device(struct cuda_pix_conv *s,
+                const unsigned char *src, size_t *pitch);
+void cuda_pix_conv_destroy(struct cuda_pix_conv *s);
+/// @}
+
 #endif
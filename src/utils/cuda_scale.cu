@@ -0,0 +1,320 @@
+/**
+ * @file   utils/cuda_scale.cu
+ *
+ * Each thread produces one pair of horizontally adjacent output pixels (one
+ * 4:2:2 macropixel) - the source is sampled bilinearly (in the particular
+ * field, if deinterlacing), converted to the output color space if needed
+ * and packed.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <cuda_runtime.h>
+
+#include "utils/cuda_scale.h"
+#include "video_codec.h"
+
+#define LOG_LEVEL_ERROR 2
+extern "C" void log_msg(int log_level, const char *format, ...);
+
+#define CHECK_CUDA(cmd, action) do { \
+        cudaError_t err = cmd; \
+        if (err != cudaSuccess) { \
+                log_msg(LOG_LEVEL_ERROR, "[cuda_scale] %s: %s\n", #cmd, cudaGetErrorString(err)); \
+                action; \
+        } \
+} while (0)
+
+struct cuda_scale_params {
+        codec_t in;
+        codec_t out;
+        const unsigned char *src;
+        size_t src_pitch;
+        int in_width;
+        int in_height;          ///< lines of the sampled field
+        int src_line_step;      ///< 2 for bob (every other source line), 1 otherwise
+        bool blend;
+        unsigned char *dst;
+        size_t dst_pitch;
+        int out_width;
+        int out_height;
+        float scale_x;
+        float scale_y;
+};
+
+static __device__ bool is_yuv(codec_t c)
+{
+        return c == UYVY || c == YUYV || c == v210;
+}
+
+/// @returns (Y, Cb, Cr) or (R, G, B) in 8-bit range
+static __device__ float3 load_px(const cuda_scale_params &p,
+                const unsigned char *line, int x)
+{
+        switch (p.in) {
+        case UYVY: {
+                const uchar4 b = ((const uchar4 *) line)[x / 2];
+                return make_float3(x % 2 ? b.w : b.y, b.x, b.z);
+        }
+        case YUYV: {
+                const uchar4 b = ((const uchar4 *) line)[x / 2];
+                return make_float3(x % 2 ? b.z : b.x, b.y, b.w);
+        }
+        case v210: {
+                const uint4 b = ((const uint4 *) line)[x / 6];
+                uint32_t y, cb, cr;
+                switch (x % 6) {
+                case 0: y = b.x >> 10; break;
+                case 1: y = b.y; break;
+                case 2: y = b.y >> 20; break;
+                case 3: y = b.z >> 10; break;
+                case 4: y = b.w; break;
+                default: y = b.w >> 20; break;
+                }
+                switch (x % 6 / 2) {
+                case 0: cb = b.x; cr = b.x >> 20; break;
+                case 1: cb = b.y >> 10; cr = b.z; break;
+                default: cb = b.z >> 20; cr = b.w >> 10; break;
+                }
+                return make_float3((y & 0x3FFU) / 4.0F, (cb & 0x3FFU) / 4.0F,
+                                (cr & 0x3FFU) / 4.0F);
+        }
+        case RGB: {
+                const unsigned char *px = line + 3 * x;
+                return make_float3(px[0], px[1], px[2]);
+        }
+        default: { // RGBA
+                const uchar4 px = ((const uchar4 *) line)[x];
+                return make_float3(px.x, px.y, px.z);
+        }
+        }
+}
+
+static __device__ float3 lerp3(float3 a, float3 b, float t)
+{
+        return make_float3(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t,
+                        a.z + (b.z - a.z) * t);
+}
+
+static __device__ float3 load_row(const cuda_scale_params &p, int y, int x0,
+                int x1, float tx)
+{
+        const unsigned char *line = p.src + (size_t) y * p.src_line_step * p.src_pitch;
+        float3 val = lerp3(load_px(p, line, x0), load_px(p, line, x1), tx);
+        if (p.blend) {
+                const unsigned char *next = y + 1 < p.in_height ? line + p.src_pitch : line;
+                val = lerp3(val, lerp3(load_px(p, next, x0), load_px(p, next, x1), tx), 0.5F);
+        }
+        return val;
+}
+
+static __device__ float3 sample(const cuda_scale_params &p, int ox, int oy)
+{
+        const float sx = fminf(fmaxf((ox + 0.5F) * p.scale_x - 0.5F, 0.0F), p.in_width - 1);
+        const float sy = fminf(fmaxf((oy + 0.5F) * p.scale_y - 0.5F, 0.0F), p.in_height - 1);
+        const int x0 = (int) sx;
+        const int y0 = (int) sy;
+        const int x1 = min(x0 + 1, p.in_width - 1);
+        const int y1 = min(y0 + 1, p.in_height - 1);
+        const float tx = sx - x0;
+
+        return lerp3(load_row(p, y0, x0, x1, tx), load_row(p, y1, x0, x1, tx), sy - y0);
+}
+
+/// BT.709, limited range YCbCr <-> full range RGB
+static __device__ float3 yuv_to_rgb(float3 c)
+{
+        const float y = 1.164F * (c.x - 16.0F);
+        const float cb = c.y - 128.0F;
+        const float cr = c.z - 128.0F;
+        return make_float3(y + 1.793F * cr, y - 0.213F * cb - 0.533F * cr,
+                        y + 2.112F * cb);
+}
+
+static __device__ float3 rgb_to_yuv(float3 c)
+{
+        return make_float3(16.0F + 0.1826F * c.x + 0.6142F * c.y + 0.0620F * c.z,
+                        128.0F - 0.1006F * c.x - 0.3386F * c.y + 0.4392F * c.z,
+                        128.0F + 0.4392F * c.x - 0.3989F * c.y - 0.0403F * c.z);
+}
+
+static __device__ unsigned char to_u8(float val)
+{
+        return (unsigned char) fminf(fmaxf(val + 0.5F, 0.0F), 255.0F);
+}
+
+__global__ void kern_scale(cuda_scale_params p)
+{
+        const int x = 2 * ((blockIdx.x * blockDim.x) + threadIdx.x);
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if (x >= p.out_width || y >= p.out_height) {
+                return;
+        }
+
+        float3 px1 = sample(p, x, y);
+        float3 px2 = sample(p, min(x + 1, p.out_width - 1), y);
+        if (is_yuv(p.in) != is_yuv(p.out)) {
+                px1 = is_yuv(p.in) ? yuv_to_rgb(px1) : rgb_to_yuv(px1);
+                px2 = is_yuv(p.in) ? yuv_to_rgb(px2) : rgb_to_yuv(px2);
+        }
+
+        unsigned char *line = p.dst + (size_t) y * p.dst_pitch;
+        switch (p.out) {
+        case UYVY:
+                ((uchar4 *) line)[x / 2] = make_uchar4(to_u8((px1.y + px2.y) / 2),
+                                to_u8(px1.x), to_u8((px1.z + px2.z) / 2), to_u8(px2.x));
+                break;
+        case YUYV:
+                ((uchar4 *) line)[x / 2] = make_uchar4(to_u8(px1.x),
+                                to_u8((px1.y + px2.y) / 2), to_u8(px2.x),
+                                to_u8((px1.z + px2.z) / 2));
+                break;
+        case RGB: {
+                unsigned char *out = line + 3 * x;
+                out[0] = to_u8(px1.x);
+                out[1] = to_u8(px1.y);
+                out[2] = to_u8(px1.z);
+                if (x + 1 < p.out_width) {
+                        out[3] = to_u8(px2.x);
+                        out[4] = to_u8(px2.y);
+                        out[5] = to_u8(px2.z);
+                }
+                break;
+        }
+        default: // RGBA
+                ((uchar4 *) line)[x] = make_uchar4(to_u8(px1.x), to_u8(px1.y), to_u8(px1.z), 0xFF);
+                if (x + 1 < p.out_width) {
+                        ((uchar4 *) line)[x + 1] = make_uchar4(to_u8(px2.x), to_u8(px2.y), to_u8(px2.z), 0xFF);
+                }
+                break;
+        }
+}
+
+struct cuda_scale {
+        cuda_scale_params params;
+        size_t src_len;
+        size_t dst_linesize;
+        unsigned char *h_src;
+        unsigned char *d_src;
+        unsigned char *d_dst;
+        cudaStream_t stream;
+};
+
+bool cuda_scale_supported(codec_t in, codec_t out)
+{
+        const codec_t in_codecs[] = { CUDA_SCALE_IN_PIXFMT_INIT };
+        const codec_t out_codecs[] = { CUDA_SCALE_OUT_PIXFMT_INIT };
+        bool in_ok = false;
+        bool out_ok = false;
+        for (unsigned i = 0; i < sizeof in_codecs / sizeof in_codecs[0]; ++i) {
+                in_ok = in_ok || in_codecs[i] == in;
+        }
+        for (unsigned i = 0; i < sizeof out_codecs / sizeof out_codecs[0]; ++i) {
+                out_ok = out_ok || out_codecs[i] == out;
+        }
+        return in_ok && out_ok;
+}
+
+struct cuda_scale *cuda_scale_init(codec_t in, int in_width, int in_height,
+                codec_t out, int out_width, int out_height,
+                enum cuda_scale_deint deint)
+{
+        if (!cuda_scale_supported(in, out) || in_width <= 0 || in_height <= 1 ||
+                        out_width <= 0 || out_height <= 0) {
+                return NULL;
+        }
+        struct cuda_scale *s = (struct cuda_scale *) calloc(1, sizeof *s);
+        cuda_scale_params *p = &s->params;
+        p->in = in;
+        p->out = out;
+        p->src_pitch = vc_get_linesize(in_width, in);
+        p->in_width = in_width;
+        p->in_height = deint == CUDA_SCALE_DEINT_BOB ? in_height / 2 : in_height;
+        p->src_line_step = deint == CUDA_SCALE_DEINT_BOB ? 2 : 1;
+        p->blend = deint == CUDA_SCALE_DEINT_BLEND;
+        p->out_width = out_width;
+        p->out_height = out_height;
+        p->scale_x = (float) in_width / out_width;
+        p->scale_y = (float) p->in_height / out_height;
+        s->src_len = p->src_pitch * in_height;
+        s->dst_linesize = vc_get_linesize(out_width, out);
+
+        CHECK_CUDA(cudaStreamCreate(&s->stream), free(s); return NULL);
+        CHECK_CUDA(cudaMallocHost((void **) &s->h_src, s->src_len), cuda_scale_destroy(s); return NULL);
+        CHECK_CUDA(cudaMalloc((void **) &s->d_src, s->src_len), cuda_scale_destroy(s); return NULL);
+        CHECK_CUDA(cudaMallocPitch((void **) &s->d_dst, &p->dst_pitch, s->dst_linesize, out_height),
+                        cuda_scale_destroy(s); return NULL);
+        p->src = s->d_src;
+        p->dst = s->d_dst;
+        return s;
+}
+
+unsigned char *cuda_scale_get_src_buffer(struct cuda_scale *s)
+{
+        return s->h_src;
+}
+
+bool cuda_scale_frame(struct cuda_scale *s, unsigned char *dst, size_t dst_pitch)
+{
+        const cuda_scale_params *p = &s->params;
+        CHECK_CUDA(cudaMemcpyAsync(s->d_src, s->h_src, s->src_len, cudaMemcpyHostToDevice, s->stream), return false);
+
+        dim3 blockSize(32, 8);
+        dim3 numBlocks(((p->out_width + 1) / 2 + blockSize.x - 1) / blockSize.x,
+                        (p->out_height + blockSize.y - 1) / blockSize.y);
+        kern_scale<<<numBlocks, blockSize, 0, s->stream>>>(*p);
+        CHECK_CUDA(cudaGetLastError(), return false);
+
+        CHECK_CUDA(cudaMemcpy2DAsync(dst, dst_pitch, s->d_dst, p->dst_pitch,
+                                s->dst_linesize, p->out_height,
+                                cudaMemcpyDeviceToHost, s->stream), return false);
+        CHECK_CUDA(cudaStreamSynchronize(s->stream), return false);
+        return true;
+}
+
+void cuda_scale_destroy(struct cuda_scale *s)
+{
+        if (s == NULL) {
+                return;
+        }
+        cudaFreeHost(s->h_src);
+        cudaFree(s->d_src);
+        cudaFree(s->d_dst);
+        if (s->stream != NULL) {
+                cudaStreamDestroy(s->stream);
+        }
+        free(s);
+}
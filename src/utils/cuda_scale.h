@@ -0,0 +1,89 @@
+/**
+ * @file   utils/cuda_scale.h
+ *
+ * Scaling, pixel format conversion and simple deinterlacing of whole frames
+ * in a single CUDA pass.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_CUDA_SCALE_H_0B7D2E6C_5A41_4F0E_9C3D_62A8E1F4B7C9
+#define UTILS_CUDA_SCALE_H_0B7D2E6C_5A41_4F0E_9C3D_62A8E1F4B7C9
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+#include <stddef.h>
+
+#include "types.h" // codec_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CUDA_SCALE_IN_PIXFMT_INIT UYVY, YUYV, v210, RGB, RGBA
+#define CUDA_SCALE_OUT_PIXFMT_INIT UYVY, YUYV, RGB, RGBA
+
+enum cuda_scale_deint {
+        CUDA_SCALE_DEINT_NONE,
+        CUDA_SCALE_DEINT_BOB,   ///< upper field only, interpolated to full height
+        CUDA_SCALE_DEINT_BLEND, ///< each line averaged with the following one
+};
+
+struct cuda_scale;
+
+bool cuda_scale_supported(codec_t in, codec_t out);
+/**
+ * @returns state or NULL if the conversion is not supported or CUDA
+ *          initialization fails
+ */
+struct cuda_scale *cuda_scale_init(codec_t in, int in_width, int in_height,
+                codec_t out, int out_width, int out_height,
+                enum cuda_scale_deint deint);
+/**
+ * Returns page-locked host buffer (vc_get_linesize() pitch) that the caller
+ * should fill with the source frame, so that the upload can be done by DMA
+ * without an intermediate copy. Valid until cuda_scale_destroy().
+ */
+unsigned char *cuda_scale_get_src_buffer(struct cuda_scale *s);
+/**
+ * Uploads the source buffer, processes it and downloads the result to dst.
+ */
+bool cuda_scale_frame(struct cuda_scale *s, unsigned char *dst, size_t dst_pitch);
+void cuda_scale_destroy(struct cuda_scale *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_CUDA_SCALE_H_0B7D2E6C_5A41_4F0E_9C3D_62A8E1F4B7C9
@@ -0,0 +1,213 @@
+/**
+ * @file   utils/event.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <climits>
+#include <thread>
+
+#ifdef __linux__
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined _WIN32
+#include <windows.h>
+#include <synchapi.h>
+#elif defined __APPLE__
+// private, but stable and used by libc++ for std::atomic::wait
+#define UL_COMPARE_AND_WAIT 1
+#define ULF_WAKE_ALL 0x00000100
+extern "C" int __ulock_wait(uint32_t operation, void *addr, uint64_t value, uint32_t timeout_us);
+extern "C" int __ulock_wake(uint32_t operation, void *addr, uint64_t wake_value);
+#endif
+
+#include "utils/event.h"
+
+// spin limits in cpu_relax() iterations (tens of ns each)
+#define SPIN_MIN 16
+#define SPIN_MAX 1024
+#define SPIN_START 128
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex requires plain 32-bit word");
+
+static inline void cpu_relax() {
+#if defined __x86_64__ || defined __i386__
+        __builtin_ia32_pause();
+#elif defined __aarch64__ || defined __arm__
+        asm volatile("yield");
+#endif
+}
+
+/// no point in spinning on a uniprocessor - the other side cannot progress
+static bool spin_enabled() {
+        static const bool enabled = std::thread::hardware_concurrency() > 1;
+        return enabled;
+}
+
+ug_event::ug_event(bool spin) : m_spin(spin && spin_enabled() ? SPIN_START : 0)
+{
+}
+
+bool ug_event::wait(uint32_t seq, const std::chrono::nanoseconds *timeout)
+{
+        const int spin = m_spin.load(std::memory_order_relaxed);
+        if (spin > 0) {
+                for (int i = 0; i < spin; ++i) {
+                        if (get() != seq) {
+                                m_spin.store(std::min(spin * 2, SPIN_MAX), std::memory_order_relaxed);
+                                return true;
+                        }
+                        cpu_relax();
+                }
+                // the notification usually comes later than the spin, spin less next time
+                m_spin.store(std::max(spin / 2, SPIN_MIN), std::memory_order_relaxed);
+        }
+        if (get() != seq) {
+                return true;
+        }
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        const bool ret = sleep(seq, timeout);
+        m_waiters.fetch_sub(1, std::memory_order_seq_cst);
+        return ret;
+}
+
+#ifdef UG_EVENT_NATIVE
+void ug_event::wake(bool all)
+{
+        auto *addr = reinterpret_cast<uint32_t *>(&m_seq);
+#ifdef __linux__
+        syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, nullptr, nullptr, 0);
+#elif defined _WIN32
+        if (all) {
+                WakeByAddressAll(addr);
+        } else {
+                WakeByAddressSingle(addr);
+        }
+#else
+        __ulock_wake(UL_COMPARE_AND_WAIT | (all ? ULF_WAKE_ALL : 0), addr, 0);
+#endif
+}
+
+bool ug_event::sleep(uint32_t seq, const std::chrono::nanoseconds *timeout)
+{
+        auto *addr = reinterpret_cast<uint32_t *>(&m_seq);
+        const auto deadline = timeout != nullptr ? std::chrono::steady_clock::now() + *timeout
+                                                 : std::chrono::steady_clock::time_point::max();
+        // returns on a change of the word, timeout, signal or spuriously
+        while (get() == seq) {
+                std::chrono::nanoseconds remaining{};
+                if (timeout != nullptr) {
+                        remaining = deadline - std::chrono::steady_clock::now();
+                        if (remaining.count() <= 0) {
+                                return false;
+                        }
+                }
+#ifdef __linux__
+                struct timespec ts{};
+                ts.tv_sec = remaining.count() / 1000000000;
+                ts.tv_nsec = remaining.count() % 1000000000;
+                syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, seq,
+                        timeout != nullptr ? &ts : nullptr, nullptr, 0);
+#elif defined _WIN32
+                const DWORD ms = timeout != nullptr
+                        ? (DWORD) std::min<long long>((remaining.count() + 999999) / 1000000, INFINITE - 1)
+                        : INFINITE;
+                WaitOnAddress(addr, &seq, sizeof seq, ms);
+#else
+                const uint32_t us = timeout != nullptr
+                        ? (uint32_t) std::min<long long>((remaining.count() + 999) / 1000, UINT32_MAX)
+                        : 0; // 0 is infinite
+                __ulock_wait(UL_COMPARE_AND_WAIT, addr, seq, us);
+#endif
+        }
+        return true;
+}
+#else
+void ug_event::wake(bool all)
+{
+        std::lock_guard<std::mutex> lk(m_lock);
+        if (all) {
+                m_cv.notify_all();
+        } else {
+                m_cv.notify_one();
+        }
+}
+
+bool ug_event::sleep(uint32_t seq, const std::chrono::nanoseconds *timeout)
+{
+        std::unique_lock<std::mutex> lk(m_lock);
+        auto changed = [this, seq] { return get() != seq; };
+        if (timeout != nullptr) {
+                return m_cv.wait_for(lk, *timeout, changed);
+        }
+        m_cv.wait(lk, changed);
+        return true;
+}
+#endif // defined UG_EVENT_NATIVE
+
+struct ug_event *ug_event_init(bool spin)
+{
+        return new ug_event(spin);
+}
+
+void ug_event_notify_one(struct ug_event *ev)
+{
+        ev->notify_one();
+}
+
+void ug_event_notify_all(struct ug_event *ev)
+{
+        ev->notify_all();
+}
+
+void ug_event_wait_locked(struct ug_event *ev, pthread_mutex_t *lock)
+{
+        const uint32_t seq = ev->get();
+        pthread_mutex_unlock(lock);
+        ev->wait(seq);
+        pthread_mutex_lock(lock);
+}
+
+void ug_event_done(struct ug_event *ev)
+{
+        delete ev;
+}
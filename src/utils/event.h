@@ -0,0 +1,139 @@
+/**
+ * @file   utils/event.h
+ *
+ * Lightweight event for cross-thread wake-ups - an event counter sleeping on
+ * the counter word itself (futex on Linux, WaitOnAddress on Windows, ulock on
+ * macOS), so that notification without waiters is a single atomic increment
+ * and a wake-up doesn't take any lock. Optionally, the waiter spins shortly
+ * before sleeping, the spin length adapts to whether spinning pays off.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_EVENT_H_5B1F9C3E_7D24_4A86_B0E2_3C8D6A91F472
+#define UTILS_EVENT_H_5B1F9C3E_7D24_4A86_B0E2_3C8D6A91F472
+
+#if defined __linux__ || defined _WIN32 || defined __APPLE__
+#define UG_EVENT_NATIVE 1 ///< waits on the counter word, no mutex/condvar
+#endif
+
+#ifdef __cplusplus
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#ifndef UG_EVENT_NATIVE
+#include <condition_variable>
+#include <mutex>
+#endif
+
+/**
+ * Usage - the waiter takes get() before checking its condition and, if not
+ * satisfied, calls wait() with that value; the notifier changes the condition
+ * and then calls notify_one() or notify_all():
+ *
+ *     uint32_t seq = ev.get();
+ *     if (!cond) ev.wait(seq);   // loop, spurious wake-ups are possible
+ */
+class ug_event {
+public:
+        /// @param spin spin shortly before sleeping in wait()
+        explicit ug_event(bool spin = false);
+        ug_event(const ug_event &) = delete;
+        ug_event &operator=(const ug_event &) = delete;
+
+        uint32_t get() const { return m_seq.load(std::memory_order_seq_cst); }
+
+        void notify_one() {
+                m_seq.fetch_add(1, std::memory_order_seq_cst);
+                if (m_waiters.load(std::memory_order_seq_cst) != 0) {
+                        wake(false);
+                }
+        }
+        void notify_all() {
+                m_seq.fetch_add(1, std::memory_order_seq_cst);
+                if (m_waiters.load(std::memory_order_seq_cst) != 0) {
+                        wake(true);
+                }
+        }
+
+        /**
+         * Waits until get() differs from seq.
+         * @param timeout NULL for infinite
+         * @returns false on timeout
+         */
+        bool wait(uint32_t seq, const std::chrono::nanoseconds *timeout = nullptr);
+
+private:
+        void wake(bool all);
+        bool sleep(uint32_t seq, const std::chrono::nanoseconds *timeout);
+
+        std::atomic<uint32_t> m_seq{0};
+        std::atomic<int> m_waiters{0};
+        std::atomic<int> m_spin; ///< current spin limit, 0 if spinning is disabled
+#ifndef UG_EVENT_NATIVE
+        std::mutex m_lock;
+        std::condition_variable m_cv;
+#endif
+};
+#endif // __cplusplus
+
+//
+// C wrapper
+//
+#ifdef __cplusplus
+#include <cstdbool>
+extern "C" {
+#else
+#include <stdbool.h>
+#endif // __cplusplus
+
+#include <pthread.h>
+
+struct ug_event;
+
+struct ug_event *ug_event_init(bool spin);
+void ug_event_notify_one(struct ug_event *ev);
+void ug_event_notify_all(struct ug_event *ev);
+/**
+ * Counterpart of pthread_cond_wait() - the caller holds the lock protecting
+ * the waited-for condition, which must be changed under that lock before
+ * notification. Spurious wake-ups are possible.
+ */
+void ug_event_wait_locked(struct ug_event *ev, pthread_mutex_t *lock);
+void ug_event_done(struct ug_event *ev);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // defined UTILS_EVENT_H_5B1F9C3E_7D24_4A86_B0E2_3C8D6A91F472
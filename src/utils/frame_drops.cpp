@@ -0,0 +1,160 @@
+/**
+ * @file   utils/frame_drops.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#include "debug.h"
+#include "tv.h"
+#include "utils/frame_drops.h"
+#include "utils/metrics.h"
+
+#define MOD_NAME "[frame drops] "
+#define FRAME_DROPS_REPORT_INTERVAL_NS (10 * NS_IN_SEC)
+
+using std::atomic;
+using std::string;
+
+static const struct {
+        const char *stage;
+        const char *name;
+        bool expected; ///< requested by the user, reported only verbosely
+} reasons[] = { // indexed by enum frame_drop_reason
+        { "capture", "filter", true },
+        { "capture", "filter_busy", false },
+        { "send", "receiver_overload", false },
+        { "send", "congestion", false },
+        { "network", "missing", false },
+        { "network", "incomplete", false },
+        { "decode", "display_busy", false },
+        { "decode", "no_output", false },
+        { "display", "busy", false },
+        { "display", "late", false },
+};
+static_assert(sizeof reasons / sizeof reasons[0] == FRAME_DROP_REASON_COUNT,
+              "reason table incomplete");
+
+static atomic<unsigned long long> totals[FRAME_DROP_REASON_COUNT];
+static struct metric *metrics[FRAME_DROP_REASON_COUNT];
+static std::once_flag metrics_registered;
+static atomic<time_ns_t> last_report{0};
+static std::mutex report_lock;
+static unsigned long long reported[FRAME_DROP_REASON_COUNT]; ///< protected by report_lock
+
+static void register_metrics()
+{
+        for (int i = 0; i < FRAME_DROP_REASON_COUNT; ++i) {
+                const string labels = string("stage=\"") + reasons[i].stage +
+                                      "\",reason=\"" + reasons[i].name + "\"";
+                metrics[i] = metric_register(METRIC_COUNTER, "ug_frames_dropped",
+                                             "Frames dropped in the pipeline by stage and reason.",
+                                             labels.c_str());
+        }
+}
+
+static void report(time_ns_t interval)
+{
+        std::lock_guard<std::mutex> lk(report_lock);
+        string line;
+        bool unexpected = false;
+        for (int i = 0; i < FRAME_DROP_REASON_COUNT; ++i) {
+                const unsigned long long total = totals[i];
+                if (total == reported[i]) {
+                        continue;
+                }
+                line += string(line.empty() ? "" : ", ") + reasons[i].stage + "/" +
+                        reasons[i].name + " " + std::to_string(total - reported[i]);
+                unexpected = unexpected || !reasons[i].expected;
+                reported[i] = total;
+        }
+        if (line.empty()) {
+                return;
+        }
+        log_msg(unexpected ? LOG_LEVEL_WARNING : LOG_LEVEL_VERBOSE,
+                MOD_NAME "Frames dropped in last %.0f s: %s\n",
+                (double) interval / NS_IN_SEC_DBL, line.c_str());
+}
+
+void frame_drop_record(enum frame_drop_reason reason, unsigned count)
+{
+        if (count == 0) {
+                return;
+        }
+        std::call_once(metrics_registered, register_metrics);
+        totals[reason] += count;
+        metric_inc(metrics[reason], count);
+
+        const time_ns_t now = get_time_in_ns();
+        time_ns_t last = last_report;
+        if (last == 0) {
+                last_report.compare_exchange_strong(last, now);
+                return;
+        }
+        if (now - last >= FRAME_DROPS_REPORT_INTERVAL_NS &&
+            last_report.compare_exchange_strong(last, now)) {
+                report(now - last);
+        }
+}
+
+unsigned long long frame_drops_format(char *buf, size_t buflen)
+{
+        unsigned long long sum = 0;
+        size_t pos = 0;
+        if (buflen > 0) {
+                buf[0] = '\0';
+        }
+        for (int i = 0; i < FRAME_DROP_REASON_COUNT; ++i) {
+                const unsigned long long total = totals[i];
+                if (total == 0) {
+                        continue;
+                }
+                sum += total;
+                if (pos < buflen) {
+                        pos += snprintf(buf + pos, buflen - pos, "%s%s/%s %llu",
+                                        pos == 0 ? "" : " ", reasons[i].stage,
+                                        reasons[i].name, total);
+                }
+        }
+        return sum;
+}
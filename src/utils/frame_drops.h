@@ -0,0 +1,79 @@
+/**
+ * @file   utils/frame_drops.h
+ *
+ * Reason-coded accounting of the frames discarded in the pipeline. Each drop
+ * site records the reason, the counts are exported as metrics
+ * (ug_frames_dropped{stage,reason}) and the drops of the last interval are
+ * periodically logged.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_FRAME_DROPS_H_2D7B4E91_C05A_4F3E_8B16_9A4E0F7C3D52
+#define UTILS_FRAME_DROPS_H_2D7B4E91_C05A_4F3E_8B16_9A4E0F7C3D52
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C" {
+#else
+#include <stddef.h>
+#endif
+
+enum frame_drop_reason {
+        FRAME_DROP_FILTER,            ///< discarded by a capture filter (every, ratelimit...)
+        FRAME_DROP_FILTER_BUSY,       ///< async capture filter queue overflow
+        FRAME_DROP_SEND_OVERLOAD,     ///< not sent, receiver reported overload
+        FRAME_DROP_SEND_CONGESTION,   ///< not sent, would leave too late (tx-drop-late)
+        FRAME_DROP_MISSING,           ///< not received at all (gap in the frame IDs)
+        FRAME_DROP_INCOMPLETE,        ///< incomplete or not recoverable by FEC
+        FRAME_DROP_DECODER_SKIP,      ///< skipped before decompression, display busy
+        FRAME_DROP_DECODER_NO_OUTPUT, ///< decompression didn't produce a frame
+        FRAME_DROP_DISPLAY_BUSY,      ///< not accepted by the display (decoder-drop-policy)
+        FRAME_DROP_DISPLAY_LATE,      ///< late for the presentation time (display pacing)
+        FRAME_DROP_REASON_COUNT
+};
+
+/// lock-free unless a periodic report is due, thread-safe
+void frame_drop_record(enum frame_drop_reason reason, unsigned count);
+/**
+ * Formats the cumulative counts as "<stage>/<reason> <count>" pairs
+ * separated by a space, reasons without drops are omitted.
+ * @returns the number of dropped frames
+ */
+unsigned long long frame_drops_format(char *buf, size_t buflen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_FRAME_DROPS_H_2D7B4E91_C05A_4F3E_8B16_9A4E0F7C3D52
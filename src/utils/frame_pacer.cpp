@@ -0,0 +1,160 @@
+/**
+ * @file   utils/frame_pacer.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+
+#include "debug.h"
+#include "tv.h"
+#include "utils/frame_pacer.h"
+#include "utils/metrics.h"
+
+#define MOD_NAME "[capture pacing] "
+#define REPORT_INTERVAL_NS (10 * NS_IN_SEC)
+
+struct frame_pacer {
+        long long max_delay;
+        time_ns_t last_arrival = 0;
+        time_ns_t next_release = 0;
+        double jitter = 0; ///< [ns]
+        double max_deviation = 0; ///< in the current report interval [ns]
+
+        // report interval
+        time_ns_t last_report = 0;
+        long long delayed_ns = 0;
+        int frames = 0;
+        int resyncs = 0;
+
+        struct metric *jitter_metric = metric_register(
+            METRIC_GAUGE, "ug_capture_jitter_seconds",
+            "Inter-arrival jitter of the captured frames.", nullptr);
+        struct metric *delay_metric = metric_register_histogram(
+            "ug_capture_pacing_delay_seconds",
+            "Delay of the captured frames by the capture pacing.", nullptr, 1e-4);
+
+        explicit frame_pacer(long long d) : max_delay(d) {}
+        ~frame_pacer() {
+                metric_unregister(jitter_metric);
+                metric_unregister(delay_metric);
+        }
+        void report(time_ns_t now);
+};
+
+void frame_pacer::report(time_ns_t now)
+{
+        if (last_report == 0) {
+                last_report = now;
+                return;
+        }
+        if (now - last_report < REPORT_INTERVAL_NS) {
+                return;
+        }
+        if (max_delay > 0) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Source jitter %.2f ms (max deviation "
+                                "%.2f ms), average delay %.2f ms, %d resyncs\n",
+                                jitter / NS_IN_MS, max_deviation / NS_IN_MS,
+                                frames > 0 ? (double) delayed_ns / frames / NS_IN_MS : 0.0,
+                                resyncs);
+        } else {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Source jitter %.2f ms (max deviation "
+                                "%.2f ms)\n", jitter / NS_IN_MS, max_deviation / NS_IN_MS);
+        }
+        last_report = now;
+        max_deviation = 0;
+        delayed_ns = 0;
+        frames = 0;
+        resyncs = 0;
+}
+
+struct frame_pacer *frame_pacer_init(long long max_delay_ns)
+{
+        return new frame_pacer(max_delay_ns);
+}
+
+void frame_pacer_wait(struct frame_pacer *p, double fps)
+{
+        const time_ns_t now = get_time_in_ns();
+        if (fps <= 0) {
+                p->last_arrival = 0;
+                return;
+        }
+        const auto period = (time_ns_t) (NS_IN_SEC_DBL / fps);
+        if (p->last_arrival != 0) {
+                const double deviation = std::fabs((double) (now - p->last_arrival - period));
+                p->jitter += (deviation - p->jitter) / 16.0;
+                p->max_deviation = std::max(p->max_deviation, deviation);
+                metric_set(p->jitter_metric, p->jitter / NS_IN_SEC_DBL);
+        }
+        p->last_arrival = now;
+        p->report(now);
+        if (p->max_delay <= 0) {
+                return;
+        }
+
+        time_ns_t release = std::max(now, p->next_release);
+        if (release - now > p->max_delay) {
+                // the source runs faster than nominal or delivered a burst
+                // larger than the allowed delay - restart the schedule
+                release = now;
+                p->resyncs += 1;
+        }
+        p->next_release = release + period;
+        p->frames += 1;
+        p->delayed_ns += release - now;
+        metric_observe(p->delay_metric, (double) (release - now) / NS_IN_SEC_DBL);
+        if (release > now) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(release - now));
+        }
+}
+
+long long frame_pacer_get_jitter(struct frame_pacer *p)
+{
+        return std::llround(p->jitter);
+}
+
+void frame_pacer_done(struct frame_pacer *p)
+{
+        delete p;
+}
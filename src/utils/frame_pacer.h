@@ -0,0 +1,69 @@
+/**
+ * @file   utils/frame_pacer.h
+ *
+ * Smoothing of bursty frame delivery from capture sources (NDI, RTSP,
+ * file...) to the nominal frame cadence - each frame is held back until
+ * its slot in the 1/fps schedule, by at most the configured delay. The
+ * inter-arrival jitter of the source is measured also if smoothing is off.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_FRAME_PACER_H_9C4D2A71_E38B_4F15_A6D0_5B7E1C94F20A
+#define UTILS_FRAME_PACER_H_9C4D2A71_E38B_4F15_A6D0_5B7E1C94F20A
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct frame_pacer;
+
+/**
+ * @param max_delay_ns maximal delay of a frame, 0 - jitter is measured but
+ *                     frames are passed immediately
+ */
+struct frame_pacer *frame_pacer_init(long long max_delay_ns);
+/**
+ * Called on frame arrival, returns when the frame should be passed on.
+ * @param fps nominal frame rate of the source
+ */
+void frame_pacer_wait(struct frame_pacer *p, double fps);
+/// @returns smoothed inter-arrival jitter (RFC 3550 style) in ns
+long long frame_pacer_get_jitter(struct frame_pacer *p);
+void frame_pacer_done(struct frame_pacer *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_FRAME_PACER_H_9C4D2A71_E38B_4F15_A6D0_5B7E1C94F20A
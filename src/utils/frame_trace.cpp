@@ -0,0 +1,440 @@
+/**
+ * @file   utils/frame_trace.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "control_socket.h"
+#include "debug.h"
+#include "host.h"
+#include "ntp.h"
+#include "tv.h"
+#include "utils/frame_trace.h"
+#include "utils/metrics.h"
+
+#define MOD_NAME "[frame_trace] "
+#define RING_SIZE 4096 ///< events per thread, must be power of 2
+#define FLUSH_INTERVAL_MS 500
+#define LATENCY_REPORT_INTERVAL_NS (5 * NS_IN_SEC)
+
+using std::array;
+using std::atomic;
+using std::mutex;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+ADD_TO_PARAM("frame-trace", "* frame-trace=<file>[:sample=<n>]\n"
+                "  Record pipeline stages of every <n>-th frame (default 1, eg. 100 for 1 %)\n"
+                "  to <file> (Chrome trace JSON). The frame ID is sent to the receiver which\n"
+                "  records the frame with the same ID if it has frame-trace enabled as well;\n"
+                "  merge the traces with: cat tx.json; tail -n +2 rx.json\n");
+ADD_TO_PARAM("glass-latency", "* glass-latency\n"
+                "  Stamp capture time and sender stage times to video packets (20 B per\n"
+                "  packet). The receiver reports latency p50/p99/max of the stages through\n"
+                "  the control socket (\"glass_latency\" stats). Network and total latency\n"
+                "  are valid only if the clocks of the hosts are synchronized (NTP, PTP).\n");
+
+namespace {
+struct trace_event {
+        time_ns_t ts;
+        uint32_t id;
+        uint32_t stage;
+};
+
+/// single producer (owning thread) ring, read by the flushing thread
+struct thread_ring {
+        array<trace_event, RING_SIZE> events;
+        atomic<uint64_t> head{0};
+        uint64_t tail = 0; ///< flusher only
+        int tid;
+};
+
+struct stage_desc {
+        const char *name;
+        char ph; ///< b - begin, e - end, n - instant (nestable async events)
+};
+
+/// CAPTURE/RECV begin and SEND_END/DISPLAY end the "frame" slice of the process
+const stage_desc stage_descs[] = {
+        { "capture", 'n' }, { "filter", 'n' }, { "compress", 'b' },
+        { "compress", 'e' }, { "fec", 'n' }, { "send", 'b' }, { "send", 'e' },
+        { "recv", 'n' }, { "decompress", 'b' }, { "decompress", 'e' },
+        { "display", 'n' },
+};
+
+class frame_tracer {
+public:
+        frame_tracer();
+        ~frame_tracer();
+        bool enabled() const { return m_out != nullptr; }
+        uint32_t new_id();
+        void record(uint32_t id, enum frame_trace_stage stage);
+
+private:
+        thread_ring *get_ring();
+        void flush_thread();
+        void flush();
+        void write_event(const trace_event &e, int tid, const char *name, char ph);
+
+        FILE *m_out = nullptr;
+        unsigned m_sample = 1;
+        atomic<uint32_t> m_counter{0};
+        long m_pid;
+
+        mutex m_lock; ///< protects rings registration, flushing and should_exit
+        vector<unique_ptr<thread_ring>> m_rings;
+        std::condition_variable m_cv;
+        bool m_should_exit = false;
+        std::thread m_thread;
+        unsigned long long m_dropped = 0;
+};
+
+frame_tracer::frame_tracer()
+{
+        const char *cfg = get_commandline_param("frame-trace");
+        if (cfg == nullptr) {
+                return;
+        }
+        string file = cfg;
+        if (size_t pos = file.find(":sample="); pos != string::npos) {
+                m_sample = std::max(atoi(file.c_str() + pos + strlen(":sample=")), 1);
+                file.resize(pos);
+        }
+        m_out = fopen(file.c_str(), "w");
+        if (m_out == nullptr) {
+                MSG(ERROR, "Cannot open %s: %s\n", file.c_str(), strerror(errno));
+                return;
+        }
+        m_pid = getpid();
+        char hostname[256] = "";
+        gethostname(hostname, sizeof hostname - 1);
+        fprintf(m_out, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,"
+                        "\"args\":{\"name\":\"%s %ld\"}},\n", m_pid, hostname, m_pid);
+        m_thread = std::thread(&frame_tracer::flush_thread, this);
+        MSG(INFO, "Tracing each %u. frame to %s.\n", m_sample, file.c_str());
+}
+
+frame_tracer::~frame_tracer()
+{
+        if (m_out == nullptr) {
+                return;
+        }
+        {
+                std::lock_guard<mutex> lk(m_lock);
+                m_should_exit = true;
+        }
+        m_cv.notify_one();
+        m_thread.join();
+        flush();
+        if (m_dropped > 0) {
+                MSG(WARNING, "%llu events dropped (ring overflow).\n", m_dropped);
+        }
+        fclose(m_out);
+}
+
+uint32_t frame_tracer::new_id()
+{
+        uint32_t id = ++m_counter;
+        if (id == 0) { // wrap-around
+                id = ++m_counter;
+        }
+        return id % m_sample == 0 ? id : 0;
+}
+
+thread_ring *frame_tracer::get_ring()
+{
+        thread_local thread_ring *ring = nullptr;
+        if (ring == nullptr) {
+                auto new_ring = std::make_unique<thread_ring>();
+                std::lock_guard<mutex> lk(m_lock);
+                new_ring->tid = (int) m_rings.size();
+                ring = m_rings.emplace_back(std::move(new_ring)).get();
+        }
+        return ring;
+}
+
+void frame_tracer::record(uint32_t id, enum frame_trace_stage stage)
+{
+        thread_ring *ring = get_ring();
+        const uint64_t head = ring->head.load(std::memory_order_relaxed);
+        ring->events[head % RING_SIZE] = { get_time_in_ns(), id, (uint32_t) stage };
+        ring->head.store(head + 1, std::memory_order_release);
+}
+
+void frame_tracer::write_event(const trace_event &e, int tid, const char *name, char ph)
+{
+        fprintf(m_out, "{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"%c\",\"id\":%" PRIu32
+                        ",\"ts\":%lld.%03lld,\"pid\":%ld,\"tid\":%d,\"args\":{\"frame\":%" PRIu32 "}},\n",
+                        name, ph, e.id, e.ts / NS_IN_US, e.ts % NS_IN_US, m_pid, tid, e.id);
+}
+
+/// @note m_lock must be held
+void frame_tracer::flush()
+{
+        vector<trace_event> events;
+        for (auto &ring : m_rings) {
+                uint64_t head = ring->head.load(std::memory_order_acquire);
+                if (head - ring->tail > RING_SIZE) {
+                        m_dropped += head - ring->tail - RING_SIZE;
+                        ring->tail = head - RING_SIZE;
+                }
+                events.clear();
+                for (uint64_t i = ring->tail; i < head; ++i) {
+                        events.push_back(ring->events[i % RING_SIZE]);
+                }
+                // events overwritten by the producer while being copied
+                const uint64_t head_now = ring->head.load(std::memory_order_acquire);
+                const uint64_t first_valid = head_now > RING_SIZE ? head_now - RING_SIZE : 0;
+                for (uint64_t i = ring->tail; i < head; ++i) {
+                        if (i < first_valid) {
+                                m_dropped += 1;
+                                continue;
+                        }
+                        const trace_event &e = events[i - ring->tail];
+                        const stage_desc &d = stage_descs[e.stage];
+                        if (e.stage == FRAME_TRACE_CAPTURE || e.stage == FRAME_TRACE_RECV) {
+                                write_event(e, ring->tid, "frame", 'b');
+                        }
+                        write_event(e, ring->tid, d.name, d.ph);
+                        if (e.stage == FRAME_TRACE_SEND_END || e.stage == FRAME_TRACE_DISPLAY) {
+                                write_event(e, ring->tid, "frame", 'e');
+                        }
+                }
+                ring->tail = head;
+        }
+        fflush(m_out);
+}
+
+void frame_tracer::flush_thread()
+{
+        std::unique_lock<mutex> lk(m_lock);
+        while (!m_should_exit) {
+                m_cv.wait_for(lk, std::chrono::milliseconds(FLUSH_INTERVAL_MS));
+                flush();
+        }
+}
+
+frame_tracer &get_tracer()
+{
+        static frame_tracer tracer;
+        return tracer;
+}
+} // end of anonymous namespace
+
+uint32_t frame_trace_new_id(void)
+{
+        frame_tracer &tracer = get_tracer();
+        return tracer.enabled() ? tracer.new_id() : 0;
+}
+
+void frame_trace_event(uint32_t id, enum frame_trace_stage stage)
+{
+        if (id == 0) {
+                return;
+        }
+        frame_tracer &tracer = get_tracer();
+        if (tracer.enabled()) {
+                tracer.record(id, stage);
+        }
+}
+
+
+bool frame_latency_enabled(void)
+{
+        static const bool enabled = get_commandline_param("glass-latency") != nullptr;
+        return enabled;
+}
+
+/// @returns offset of stamp from the capture time in us, 0 if unknown
+static uint32_t stage_offset_us(int64_t stamp, int64_t capture_time)
+{
+        if (stamp <= capture_time) {
+                return 0;
+        }
+        return (uint32_t) std::min<int64_t>((stamp - capture_time) / NS_IN_US, UINT32_MAX);
+}
+
+int frame_trace_rtp_ext_fill(const struct video_frame *f,
+                             uint32_t ext[FRAME_TRACE_RTP_EXT_LEN_LATENCY])
+{
+        if (f->capture_time == 0) {
+                if (f->trace_id == 0) {
+                        return 0;
+                }
+                ext[0] = htonl(f->trace_id);
+                return FRAME_TRACE_RTP_EXT_LEN;
+        }
+        uint32_t ntp_sec = 0;
+        uint32_t ntp_frac = 0;
+        ns_to_ntp64(f->capture_time, &ntp_sec, &ntp_frac);
+        ext[0] = htonl(f->trace_id);
+        ext[1] = htonl(ntp_sec);
+        ext[2] = htonl(ntp_frac);
+        ext[3] = htonl(stage_offset_us(f->compress_end, f->capture_time));
+        ext[4] = htonl(stage_offset_us(f->send_time, f->capture_time));
+        return FRAME_TRACE_RTP_EXT_LEN_LATENCY;
+}
+
+void frame_trace_rtp_ext_parse(struct video_frame *f, uint16_t type,
+                               uint16_t len, const unsigned char *data)
+{
+        if (type != FRAME_TRACE_RTP_EXT_TYPE || len < FRAME_TRACE_RTP_EXT_LEN) {
+                return;
+        }
+        uint32_t ext[FRAME_TRACE_RTP_EXT_LEN_LATENCY];
+        memcpy(ext, data, std::min<int>(len, FRAME_TRACE_RTP_EXT_LEN_LATENCY) * sizeof ext[0]);
+        f->trace_id = ntohl(ext[0]);
+        if (len < FRAME_TRACE_RTP_EXT_LEN_LATENCY) {
+                return;
+        }
+        f->capture_time = ntp64_to_ns(ntohl(ext[1]), ntohl(ext[2]));
+        f->compress_end = f->capture_time + (int64_t) ntohl(ext[3]) * NS_IN_US;
+        f->send_time = f->capture_time + (int64_t) ntohl(ext[4]) * NS_IN_US;
+}
+
+struct frame_latency_stats {
+        /// reported stages, the first is measured from capture_time, NETWORK
+        /// includes the playout buffer, DECODE the FEC and decoder queues
+        enum stage { COMPRESS, TX_QUEUE, NETWORK, DECODE, DISPLAY, TOTAL, STAGE_COUNT };
+        static constexpr const char *names[STAGE_COUNT] = {
+                "compress", "tx_queue", "network", "decode", "display", "total"
+        };
+
+        explicit frame_latency_stats(struct control_state *c) : control(c) {
+                for (int i = 0; i < STAGE_COUNT; ++i) {
+                        const string labels = string("stage=\"") + names[i] + "\"";
+                        histograms[i] = metric_register_histogram(
+                            "ug_glass_latency_seconds",
+                            "Latency of the pipeline stages (see --param glass-latency).",
+                            labels.c_str(), 1e-5);
+                }
+        }
+        ~frame_latency_stats() {
+                for (auto *h : histograms) {
+                        metric_unregister(h);
+                }
+        }
+        void add(const struct video_frame *f, int64_t decompress_end, int64_t display_time);
+        void report();
+
+        struct control_state *control;
+        array<vector<int64_t>, STAGE_COUNT> samples{}; ///< in ns
+        array<struct metric *, STAGE_COUNT> histograms{};
+        time_ns_t last_report = 0;
+};
+
+void frame_latency_stats::add(const struct video_frame *f, int64_t decompress_end, int64_t display_time)
+{
+        const int64_t stamps[] = { f->capture_time, f->compress_end, f->send_time,
+                                   f->recv_time, decompress_end, display_time };
+        for (int i = 0; i < TOTAL; ++i) {
+                samples[i].push_back(stamps[i + 1] - stamps[i]);
+        }
+        samples[TOTAL].push_back(display_time - f->capture_time);
+        for (int i = 0; i < STAGE_COUNT; ++i) {
+                metric_observe(histograms[i], samples[i].back() / NS_IN_SEC_DBL);
+        }
+
+        if (last_report == 0) {
+                last_report = display_time;
+        } else if (display_time - last_report >= LATENCY_REPORT_INTERVAL_NS) {
+                report();
+                last_report = display_time;
+        }
+}
+
+void frame_latency_stats::report()
+{
+        auto ms = [](int64_t ns) { return (double) ns / NS_IN_MS_DBL; };
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(2) << "glass_latency frames "
+            << samples[TOTAL].size();
+        for (int i = 0; i < STAGE_COUNT; ++i) {
+                vector<int64_t> &v = samples[i];
+                const size_t p50 = (v.size() - 1) / 2;
+                const size_t p99 = (v.size() - 1) * 99 / 100;
+                std::nth_element(v.begin(), v.begin() + p50, v.end());
+                const int64_t val50 = v[p50];
+                std::nth_element(v.begin(), v.begin() + p99, v.end());
+                oss << " " << names[i] << " " << ms(val50) << "/" << ms(v[p99])
+                    << "/" << ms(*std::max_element(v.begin(), v.end()));
+                v.clear();
+        }
+        MSG(VERBOSE, "%s (p50/p99/max ms)\n", oss.str().c_str());
+        control_report_stats(control, oss.str());
+}
+
+struct frame_latency_stats *frame_latency_stats_create(struct control_state *control)
+{
+        return new frame_latency_stats(control);
+}
+
+void frame_latency_stats_add(struct frame_latency_stats *s,
+                             const struct video_frame *f,
+                             int64_t decompress_end, int64_t display_time)
+{
+        if (f->capture_time == 0) {
+                return;
+        }
+        s->add(f, decompress_end, display_time);
+}
+
+void frame_latency_stats_destroy(struct frame_latency_stats *s)
+{
+        delete s;
+}
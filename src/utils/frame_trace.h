@@ -0,0 +1,164 @@
+/**
+ * @file   utils/frame_trace.h
+ *
+ * Frame-correlated pipeline tracing (--param frame-trace). A sampled frame
+ * gets an ID on capture that is carried in video_frame::trace_id through the
+ * sender pipeline and in an RTP header extension to the receiver, which
+ * continues with the same ID. The stages are recorded to per-thread
+ * lock-free rings and written as Chrome trace (async events keyed by the ID)
+ * by a background thread, so that traces of the sender and the receiver can
+ * be merged and a single frame followed from capture to display.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_FRAME_TRACE_H_5E0C7A42_1B9D_4E83_A6F1_3D28B47C9E05
+#define UTILS_FRAME_TRACE_H_5E0C7A42_1B9D_4E83_A6F1_3D28B47C9E05
+
+#ifdef __cplusplus
+#include <cstdint>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+#include "types.h"
+
+/**
+ * RTP header extension type ("UT"), data words (network byte order):
+ * - 0   - trace ID (0 if the frame is not traced)
+ *
+ * and with --param glass-latency also:
+ * - 1,2 - capture time (NTP 64-bit timestamp)
+ * - 3   - compress end - capture time [us]
+ * - 4   - transmission start - capture time [us]
+ */
+#define FRAME_TRACE_RTP_EXT_TYPE 0x5554
+#define FRAME_TRACE_RTP_EXT_LEN 1
+#define FRAME_TRACE_RTP_EXT_LEN_LATENCY 5
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum frame_trace_stage {
+        FRAME_TRACE_CAPTURE,          ///< frame grabbed (sender)
+        FRAME_TRACE_FILTER,           ///< capture filter applied
+        FRAME_TRACE_COMPRESS_START,
+        FRAME_TRACE_COMPRESS_END,
+        FRAME_TRACE_FEC,              ///< FEC encoded
+        FRAME_TRACE_SEND_START,
+        FRAME_TRACE_SEND_END,         ///< all packets handed to the socket
+        FRAME_TRACE_RECV,             ///< frame left the playout buffer (receiver)
+        FRAME_TRACE_DECOMPRESS_START,
+        FRAME_TRACE_DECOMPRESS_END,
+        FRAME_TRACE_DISPLAY,          ///< passed to the display
+};
+
+/**
+ * @returns ID for a newly captured frame, 0 if the frame is not traced
+ *          (tracing disabled or the frame not sampled)
+ */
+uint32_t frame_trace_new_id(void);
+/**
+ * Records the stage of the frame. Lock-free, no-op for id 0.
+ */
+void frame_trace_event(uint32_t id, enum frame_trace_stage stage);
+
+/// @returns true if the capture time is to be stamped (--param glass-latency)
+bool frame_latency_enabled(void);
+/**
+ * Fills the RTP header extension for the frame.
+ * @returns extension length in words, 0 if no extension is to be sent
+ */
+int frame_trace_rtp_ext_fill(const struct video_frame *f,
+                             uint32_t ext[FRAME_TRACE_RTP_EXT_LEN_LATENCY]);
+/**
+ * Sets trace_id and the sender stamps (capture_time, compress_end,
+ * send_time) of a received frame from the RTP header extension.
+ * @param data extension data (after the type and length)
+ */
+void frame_trace_rtp_ext_parse(struct video_frame *f, uint16_t type,
+                               uint16_t len, const unsigned char *data);
+
+/// frame metadata used by the tracing, see frame_trace_save()
+struct frame_trace_stamps {
+        uint32_t trace_id;
+        int64_t capture_time;
+        int64_t compress_end;
+        int64_t send_time;
+        int64_t recv_time;
+};
+
+/**
+ * For stages that create a new frame without copying the metadata
+ * (filters, FEC), restore with frame_trace_restore().
+ */
+static inline struct frame_trace_stamps
+frame_trace_save(const struct video_frame *f)
+{
+        struct frame_trace_stamps st = { f->trace_id, f->capture_time, f->compress_end,
+                                         f->send_time, f->recv_time };
+        return st;
+}
+
+static inline void frame_trace_restore(struct video_frame *f,
+                                       struct frame_trace_stamps st)
+{
+        f->trace_id = st.trace_id;
+        f->capture_time = st.capture_time;
+        f->compress_end = st.compress_end;
+        f->send_time = st.send_time;
+        f->recv_time = st.recv_time;
+}
+
+struct control_state;
+/**
+ * Receiver's glass-to-glass latency statistics of the frames with the
+ * capture time stamped, per-stage p50/p99/max is periodically reported
+ * through the control socket.
+ */
+struct frame_latency_stats;
+struct frame_latency_stats *frame_latency_stats_create(struct control_state *control);
+/// called for each displayed frame, no-op if the frame has no capture time
+void frame_latency_stats_add(struct frame_latency_stats *s,
+                             const struct video_frame *f,
+                             int64_t decompress_end, int64_t display_time);
+void frame_latency_stats_destroy(struct frame_latency_stats *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_FRAME_TRACE_H_5E0C7A42_1B9D_4E83_A6F1_3D28B47C9E05
+
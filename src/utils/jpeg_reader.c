@@ -46,6 +46,7 @@
 
 #include "debug.h"
 #include "utils/jpeg_reader.h"
+#include "utils/macros.h"
 
 #define MOD_NAME "[JPEG reader] "
 
@@ -817,3 +818,288 @@ bool jpeg_get_rtp_hdr_data(uint8_t *jpeg_data, int len, struct jpeg_rtp_data *hd
 	return true;
 }
 
+
+/*
+ * DC-only decoding
+ */
+struct dc_bit_reader {
+        const uint8_t *ptr;
+        const uint8_t *end;
+        uint32_t buf;
+        int bits;
+        bool marker; ///< marker reached, feeding zeros
+};
+
+struct dc_huff_table {
+        int mincode[17];
+        int maxcode[17];
+        int valptr[17];
+        const uint8_t *symbols;
+};
+
+static void
+dc_fill_bits(struct dc_bit_reader *br)
+{
+        while (br->bits <= 24) {
+                uint32_t byte = 0;
+                if (!br->marker && br->ptr < br->end) {
+                        byte = *br->ptr;
+                        if (byte != 0xFF) {
+                                br->ptr += 1;
+                        } else if (br->ptr + 1 < br->end && br->ptr[1] == 0) {
+                                br->ptr += 2; // stuffed 0xFF
+                        } else {
+                                br->marker = true;
+                                byte = 0;
+                        }
+                }
+                br->buf |= byte << (24 - br->bits);
+                br->bits += 8;
+        }
+}
+
+static inline int
+dc_get_bits(struct dc_bit_reader *br, int count)
+{
+        if (count == 0) {
+                return 0;
+        }
+        dc_fill_bits(br);
+        int ret = (int) (br->buf >> (32 - count));
+        br->buf <<= count;
+        br->bits -= count;
+        return ret;
+}
+
+/// skips to the data following the next RSTn marker
+static void
+dc_restart(struct dc_bit_reader *br)
+{
+        while (br->ptr + 1 < br->end &&
+               !(br->ptr[0] == 0xFF && br->ptr[1] >= JPEG_MARKER_RST0 &&
+                 br->ptr[1] <= JPEG_MARKER_RST7)) {
+                br->ptr++;
+        }
+        br->ptr += 2;
+        br->buf = 0;
+        br->bits = 0;
+        br->marker = false;
+}
+
+static void
+dc_huff_build(struct dc_huff_table *t, const uint8_t *codelens,
+              const uint8_t *symbols)
+{
+        int code = 0;
+        int k = 0;
+        for (int l = 1; l <= 16; ++l) {
+                t->valptr[l] = k;
+                t->mincode[l] = code;
+                code += codelens[l - 1];
+                k += codelens[l - 1];
+                t->maxcode[l] = codelens[l - 1] != 0 ? code - 1 : -1;
+                code <<= 1;
+        }
+        t->symbols = symbols;
+}
+
+static int
+dc_huff_decode(struct dc_bit_reader *br, const struct dc_huff_table *t)
+{
+        int code = 0;
+        for (int l = 1; l <= 16; ++l) {
+                code = (code << 1) | dc_get_bits(br, 1);
+                if (code <= t->maxcode[l]) {
+                        return t->symbols[t->valptr[l] + code - t->mincode[l]];
+                }
+        }
+        return -1;
+}
+
+/**
+ * Decodes a block, only DC difference is returned, AC coefficients are
+ * entropy-decoded just to be skipped.
+ */
+static bool
+dc_decode_block(struct dc_bit_reader *br, const struct dc_huff_table *dc,
+                const struct dc_huff_table *ac, int *pred)
+{
+        int s = dc_huff_decode(br, dc);
+        if (s < 0 || s > 11) {
+                return false;
+        }
+        int diff = dc_get_bits(br, s);
+        if (s != 0 && diff < (1 << (s - 1))) {
+                diff -= (1 << s) - 1;
+        }
+        *pred += diff;
+
+        for (int k = 1; k < 64; ++k) {
+                int rs = dc_huff_decode(br, ac);
+                if (rs < 0) {
+                        return false;
+                }
+                if ((rs & 0xF) == 0) {
+                        if (rs != 0xF0) { // EOB
+                                break;
+                        }
+                        k += 15; // ZRL
+                        continue;
+                }
+                k += rs >> 4;
+                dc_get_bits(br, rs & 0xF);
+        }
+        return true;
+}
+
+static inline uint8_t
+clamp_u8(int val)
+{
+        return val < 0 ? 0 : val > 255 ? 255 : (uint8_t) val;
+}
+
+/**
+ * Creates a 1/8-resolution RGB image out of DC coefficients of baseline
+ * interleaved JPEG without IDCT (AC coefficients are skipped).
+ *
+ * @param info       JPEG properties as returned by jpeg_read_info()
+ * @param data_end   end of the JPEG data
+ * @param[out] rgb   output buffer of at least ceil(width/8) x ceil(height/8)
+ *                   packed RGB pixels
+ */
+bool
+jpeg_decode_dc_rgb(const struct jpeg_info *info, const uint8_t *data_end,
+                   uint8_t *rgb)
+{
+        if ((info->comp_count != 1 && info->comp_count != 3) ||
+            info->color_spec != JPEG_COLOR_SPEC_YCBCR || !info->interleaved) {
+                MSG(VERBOSE, "DC decode supports only interleaved YCbCr or "
+                             "grayscale JPEG!\n");
+                return false;
+        }
+
+        int sf_h[3] = { 1, 1, 1 };
+        int sf_v[3] = { 1, 1, 1 };
+        int max_h = 1;
+        int max_v = 1;
+        int dc_q[3];
+        if (info->comp_count == 3) { // 1 comp scan is always 1 block/MCU
+                for (int c = 0; c < 3; ++c) {
+                        sf_h[c] = info->sampling_factor_h[c];
+                        sf_v[c] = info->sampling_factor_v[c];
+                        if (sf_h[c] < 1 || sf_h[c] > 4 || sf_v[c] < 1 ||
+                            sf_v[c] > 4) {
+                                return false;
+                        }
+                        max_h = MAX(max_h, sf_h[c]);
+                        max_v = MAX(max_v, sf_v[c]);
+                }
+        }
+        for (int c = 0; c < info->comp_count; ++c) {
+                const uint8_t *qt = info->quantization_tables
+                                        [info->comp_table_quantization_map[c]];
+                if (qt == NULL) {
+                        return false;
+                }
+                dc_q[c] = qt[0];
+        }
+
+        struct dc_huff_table huff[4]; // lum DC, lum AC, chm DC, chm AC
+        const uint8_t *const huff_def[4][2] = {
+                { lum_dc_codelens, lum_dc_symbols },
+                { lum_ac_codelens, lum_ac_symbols },
+                { chm_dc_codelens, chm_dc_symbols },
+                { chm_ac_codelens, chm_ac_symbols },
+        };
+        const uint8_t *const huff_info[4] = { info->huff_lum_dc,
+                                              info->huff_lum_ac,
+                                              info->huff_chm_dc,
+                                              info->huff_chm_ac };
+        for (int i = 0; i < 4; ++i) {
+                if (huff_info[i][0] == 255) {
+                        dc_huff_build(&huff[i], huff_def[i][0],
+                                      huff_def[i][1]);
+                } else {
+                        dc_huff_build(&huff[i], huff_info[i],
+                                      huff_info[i] + 16);
+                }
+        }
+
+        const int mcu_x = (info->width + 8 * max_h - 1) / (8 * max_h);
+        const int mcu_y = (info->height + 8 * max_v - 1) / (8 * max_v);
+        uint8_t *planes[3] = { NULL, NULL, NULL };
+        int plane_w[3];
+        bool ret = true;
+        for (int c = 0; c < info->comp_count; ++c) {
+                plane_w[c] = mcu_x * sf_h[c];
+                planes[c] = malloc((size_t) plane_w[c] * mcu_y * sf_v[c]);
+                if (planes[c] == NULL) {
+                        ret = false;
+                        goto cleanup;
+                }
+        }
+
+        struct dc_bit_reader br = { info->data, data_end, 0, 0, false };
+        int pred[3] = { 0, 0, 0 };
+        int restarts_left = info->restart_interval;
+        for (int my = 0; my < mcu_y && ret; ++my) {
+                for (int mx = 0; mx < mcu_x && ret; ++mx) {
+                        if (info->restart_interval != 0) {
+                                if (restarts_left == 0) {
+                                        dc_restart(&br);
+                                        pred[0] = pred[1] = pred[2] = 0;
+                                        restarts_left = info->restart_interval;
+                                }
+                                restarts_left--;
+                        }
+                        for (int c = 0; c < info->comp_count && ret; ++c) {
+                                const struct dc_huff_table *dc = &huff[c == 0 ? 0 : 2];
+                                for (int v = 0; v < sf_v[c] && ret; ++v) {
+                                        for (int h = 0; h < sf_h[c]; ++h) {
+                                                if (!dc_decode_block(&br, dc, dc + 1, &pred[c])) {
+                                                        ret = false;
+                                                        break;
+                                                }
+                                                planes[c][(my * sf_v[c] + v) * plane_w[c] + mx * sf_h[c] + h] =
+                                                        clamp_u8(pred[c] * dc_q[c] / 8 + 128);
+                                        }
+                                }
+                        }
+                }
+        }
+        if (!ret) {
+                MSG(VERBOSE, "Corrupted JPEG entropy-coded data!\n");
+                goto cleanup;
+        }
+
+        const int out_w = (info->width + 7) / 8;
+        const int out_h = (info->height + 7) / 8;
+        for (int y = 0; y < out_h; ++y) {
+                const uint8_t *luma = planes[0] + (y * sf_v[0] / max_v) * plane_w[0];
+                if (info->comp_count == 1) {
+                        for (int x = 0; x < out_w; ++x) {
+                                *rgb++ = luma[x];
+                                *rgb++ = luma[x];
+                                *rgb++ = luma[x];
+                        }
+                        continue;
+                }
+                const uint8_t *cb = planes[1] + (y * sf_v[1] / max_v) * plane_w[1];
+                const uint8_t *cr = planes[2] + (y * sf_v[2] / max_v) * plane_w[2];
+                for (int x = 0; x < out_w; ++x) {
+                        // JFIF full-range YCbCr, coefficients in Q16
+                        int Y = luma[x * sf_h[0] / max_h] << 16;
+                        int Cb = cb[x * sf_h[1] / max_h] - 128;
+                        int Cr = cr[x * sf_h[2] / max_h] - 128;
+                        *rgb++ = clamp_u8((Y + 91881 * Cr + 32768) >> 16);
+                        *rgb++ = clamp_u8((Y - 22554 * Cb - 46802 * Cr + 32768) >> 16);
+                        *rgb++ = clamp_u8((Y + 116130 * Cb + 32768) >> 16);
+                }
+        }
+
+cleanup:
+        for (int c = 0; c < 3; ++c) {
+                free(planes[c]);
+        }
+        return ret;
+}
@@ -90,6 +90,8 @@ extern "C" {
 
 int jpeg_read_info(uint8_t *image, int len, struct jpeg_info *info);
 bool jpeg_get_rtp_hdr_data(uint8_t *jpeg_data, int len, struct jpeg_rtp_data *hdr_data);
+bool jpeg_decode_dc_rgb(const struct jpeg_info *info, const uint8_t *data_end,
+                        uint8_t *rgb);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,254 @@
+/**
+ * @file   utils/lockfree_queue.h
+ *
+ * Bounded lock-free MPMC queue - a drop-in replacement of synchronized_queue
+ * for queues passing frames between threads running on separate cores.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_LOCKFREE_QUEUE_H_8E41C2D7_3B9A_4F60_9D5E_A27C1F04B6E3
+#define UTILS_LOCKFREE_QUEUE_H_8E41C2D7_3B9A_4F60_9D5E_A27C1F04B6E3
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+#include "utils/event.h"
+
+namespace ug_lockfree_queue_detail {
+
+constexpr int SPIN_COUNT = 256; ///< busy-wait iterations before sleeping
+constexpr size_t CACHE_LINE = 64;
+
+/// no point in spinning on a uniprocessor - the other side cannot progress
+inline int spin_count() {
+        static const int count = std::thread::hardware_concurrency() > 1 ? SPIN_COUNT : 0;
+        return count;
+}
+
+inline void cpu_relax() {
+#if defined __x86_64__ || defined __i386__
+        __builtin_ia32_pause();
+#elif defined __aarch64__ || defined __arm__
+        asm volatile("yield");
+#endif
+}
+
+} // namespace ug_lockfree_queue_detail
+
+/**
+ * @brief bounded lock-free queue with synchronized_queue interface
+ *
+ * Array-based MPMC ring with per-cell sequence numbers (D. Vyukov; doubled
+ * so that the full and the next-lap-empty states differ even for capacity 1,
+ * which is the usual case). Blocking
+ * calls spin for a while and then sleep on ug_event, so the fast path takes
+ * no lock at all.
+ *
+ * Unlike synchronized_queue the queue must be bounded.
+ *
+ * @tparam T       type to be stored, must be default-constructible
+ * @tparam max_len capacity of the queue, can be changed with set_max_len()
+ */
+template<typename T, int max_len = 1>
+class lockfree_queue {
+        static_assert(max_len > 0, "lockfree_queue must be bounded");
+public:
+        lockfree_queue() { allocate(max_len); }
+
+        int size() {
+                const size_t head = m_dequeue_pos.load(std::memory_order_relaxed);
+                const size_t tail = m_enqueue_pos.load(std::memory_order_relaxed);
+                return tail > head ? static_cast<int>(tail - head) : 0;
+        }
+
+        /**
+         * @param len new capacity (> 0)
+         * @note Not thread-safe - the queue must be empty and not used
+         * concurrently (eg. set before the worker threads are started).
+         */
+        void set_max_len(int len) {
+                assert(len > 0 && size() == 0);
+                allocate(len);
+        }
+
+        void push(T const & message) {
+                T copy(message);
+                push(std::move(copy));
+        }
+
+        void push(T && message) {
+                for (int spin = 0; ; ++spin) {
+                        const uint32_t seq = m_not_full.get();
+                        if (try_push(message)) {
+                                break;
+                        }
+                        if (spin < ug_lockfree_queue_detail::spin_count()) {
+                                ug_lockfree_queue_detail::cpu_relax();
+                        } else {
+                                m_not_full.wait(seq, nullptr);
+                        }
+                }
+                m_not_empty.notify_all();
+        }
+
+        /**
+         * @returns false if the queue is full (message is left untouched)
+         */
+        bool push_nonblocking(T && message) {
+                if (!try_push(message)) {
+                        return false;
+                }
+                m_not_empty.notify_all();
+                return true;
+        }
+
+        T pop(bool nonblocking = false) {
+                T ret{};
+                for (int spin = 0; ; ++spin) {
+                        const uint32_t seq = m_not_empty.get();
+                        if (try_pop(ret)) {
+                                break;
+                        }
+                        if (nonblocking) {
+                                return T();
+                        }
+                        if (spin < ug_lockfree_queue_detail::spin_count()) {
+                                ug_lockfree_queue_detail::cpu_relax();
+                        } else {
+                                m_not_empty.wait(seq, nullptr);
+                        }
+                }
+                m_not_full.notify_all();
+                return ret;
+        }
+
+        template<typename Rep, typename Period>
+        bool timed_pop(T& result, std::chrono::duration<Rep, Period> const& timeout) {
+                const auto deadline = std::chrono::steady_clock::now() + timeout;
+                for (int spin = 0; ; ++spin) {
+                        const uint32_t seq = m_not_empty.get();
+                        if (try_pop(result)) {
+                                break;
+                        }
+                        if (spin < ug_lockfree_queue_detail::spin_count()) {
+                                ug_lockfree_queue_detail::cpu_relax();
+                                continue;
+                        }
+                        const std::chrono::nanoseconds remaining = deadline - std::chrono::steady_clock::now();
+                        if (remaining.count() <= 0) {
+                                return false;
+                        }
+                        m_not_empty.wait(seq, &remaining);
+                }
+                m_not_full.notify_all();
+                return true;
+        }
+
+private:
+        struct cell {
+                std::atomic<size_t> seq;
+                T data{};
+        };
+
+        void allocate(int len) {
+                m_capacity = len;
+                m_cells.reset(new cell[len]);
+                for (int i = 0; i < len; ++i) {
+                        m_cells[i].seq.store(2 * i, std::memory_order_relaxed);
+                }
+                m_enqueue_pos.store(0, std::memory_order_relaxed);
+                m_dequeue_pos.store(0, std::memory_order_relaxed);
+        }
+
+        /// moves from message only on success
+        bool try_push(T & message) {
+                size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                cell *c = nullptr;
+                while (true) {
+                        c = &m_cells[pos % m_capacity];
+                        const size_t seq = c->seq.load(std::memory_order_acquire);
+                        const intptr_t diff = (intptr_t) seq - (intptr_t) (2 * pos);
+                        if (diff == 0) {
+                                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                                        break;
+                                }
+                        } else if (diff < 0) {
+                                return false; // full
+                        } else {
+                                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                        }
+                }
+                c->data = std::move(message);
+                c->seq.store(2 * pos + 1, std::memory_order_release);
+                return true;
+        }
+
+        bool try_pop(T & result) {
+                size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                cell *c = nullptr;
+                while (true) {
+                        c = &m_cells[pos % m_capacity];
+                        const size_t seq = c->seq.load(std::memory_order_acquire);
+                        const intptr_t diff = (intptr_t) seq - (intptr_t) (2 * pos + 1);
+                        if (diff == 0) {
+                                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                                        break;
+                                }
+                        } else if (diff < 0) {
+                                return false; // empty
+                        } else {
+                                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                        }
+                }
+                result = std::move(c->data);
+                c->data = T(); // do not hold the reference in the ring
+                c->seq.store(2 * (pos + m_capacity), std::memory_order_release);
+                return true;
+        }
+
+        std::unique_ptr<cell[]> m_cells;
+        size_t m_capacity = 0;
+        alignas(ug_lockfree_queue_detail::CACHE_LINE) std::atomic<size_t> m_enqueue_pos{0};
+        alignas(ug_lockfree_queue_detail::CACHE_LINE) std::atomic<size_t> m_dequeue_pos{0};
+        alignas(ug_lockfree_queue_detail::CACHE_LINE) ug_event m_not_empty;
+        alignas(ug_lockfree_queue_detail::CACHE_LINE) ug_event m_not_full;
+};
+
+#endif // defined UTILS_LOCKFREE_QUEUE_H_8E41C2D7_3B9A_4F60_9D5E_A27C1F04B6E3
@@ -0,0 +1,136 @@
+/**
+ * @file   utils/mem_stats.c
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/mem_stats.h"
+
+enum {
+        MAX_GAUGE_NAME = 32,
+};
+
+struct mem_gauge {
+        char name[MAX_GAUGE_NAME];
+        int idx;
+        atomic_llong bytes;
+        atomic_llong items;
+        atomic_llong peak_bytes;
+        struct mem_gauge *next; ///< guarded by gauges_lock
+};
+
+static pthread_mutex_t gauges_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mem_gauge *gauges;
+static int next_idx;
+
+struct mem_gauge *mem_gauge_register(const char *name)
+{
+        struct mem_gauge *gauge = calloc(1, sizeof *gauge);
+        if (gauge == NULL) {
+                return NULL;
+        }
+        snprintf(gauge->name, sizeof gauge->name, "%s", name);
+        atomic_init(&gauge->bytes, 0);
+        atomic_init(&gauge->items, 0);
+        atomic_init(&gauge->peak_bytes, 0);
+
+        pthread_mutex_lock(&gauges_lock);
+        gauge->idx = next_idx++;
+        // append to keep the report in the registration order
+        struct mem_gauge **it = &gauges;
+        while (*it != NULL) {
+                it = &(*it)->next;
+        }
+        *it = gauge;
+        pthread_mutex_unlock(&gauges_lock);
+        return gauge;
+}
+
+void mem_gauge_unregister(struct mem_gauge *gauge)
+{
+        if (gauge == NULL) {
+                return;
+        }
+        pthread_mutex_lock(&gauges_lock);
+        struct mem_gauge **it = &gauges;
+        while (*it != gauge) {
+                it = &(*it)->next;
+        }
+        *it = gauge->next;
+        pthread_mutex_unlock(&gauges_lock);
+        free(gauge);
+}
+
+void mem_gauge_add(struct mem_gauge *gauge, long long bytes, long long items)
+{
+        if (gauge == NULL) {
+                return;
+        }
+        const long long cur =
+            atomic_fetch_add_explicit(&gauge->bytes, bytes, memory_order_relaxed) + bytes;
+        atomic_fetch_add_explicit(&gauge->items, items, memory_order_relaxed);
+        long long peak = atomic_load_explicit(&gauge->peak_bytes, memory_order_relaxed);
+        while (cur > peak && !atomic_compare_exchange_weak_explicit(
+                                 &gauge->peak_bytes, &peak, cur,
+                                 memory_order_relaxed, memory_order_relaxed)) {
+        }
+}
+
+void mem_stats_format(char *buf, size_t buflen)
+{
+        long long total = 0;
+        pthread_mutex_lock(&gauges_lock);
+        for (struct mem_gauge *it = gauges; it != NULL; it = it->next) {
+                total += atomic_load_explicit(&it->bytes, memory_order_relaxed);
+        }
+        int len = snprintf(buf, buflen, "total=%lldB", total);
+        for (struct mem_gauge *it = gauges;
+             it != NULL && len >= 0 && (size_t) len < buflen; it = it->next) {
+                len += snprintf(buf + len, buflen - len, " %s#%d=%lldB/%lld/%lldB",
+                                it->name, it->idx,
+                                atomic_load_explicit(&it->bytes, memory_order_relaxed),
+                                atomic_load_explicit(&it->items, memory_order_relaxed),
+                                atomic_load_explicit(&it->peak_bytes, memory_order_relaxed));
+        }
+        pthread_mutex_unlock(&gauges_lock);
+}
@@ -0,0 +1,81 @@
+/**
+ * @file   utils/mem_stats.h
+ *
+ * Registry of memory gauges of the individual pipeline stages (frame pools,
+ * RTP packet pool, playout buffer). Each gauge holds current number of bytes
+ * and items (frames, packets) and the peak number of bytes. The summary is
+ * reported periodically as "stats mem ..." over the control socket (if stats
+ * are enabled) and on demand with the "mem-stats" control command.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_MEM_STATS_H_2B7D4E91_8C3A_4F56_A0E2_5D19C6B8F374
+#define UTILS_MEM_STATS_H_2B7D4E91_8C3A_4F56_A0E2_5D19C6B8F374
+
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct mem_gauge;
+
+/**
+ * @param name stage name (copied), instances are distinguished by an index
+ *             appended in the report
+ */
+struct mem_gauge *mem_gauge_register(const char *name);
+/// accepts NULL
+void mem_gauge_unregister(struct mem_gauge *gauge);
+/**
+ * Adjusts the gauge by the given (possibly negative) deltas. Thread-safe and
+ * lock-free, accepts NULL.
+ */
+void mem_gauge_add(struct mem_gauge *gauge, long long bytes, long long items);
+/**
+ * Formats the registered gauges as space-separated items
+ * "<name>#<idx>=<bytes>B/<items>/<peak_bytes>B", preceded by the
+ * total ("total=<bytes>B").
+ */
+void mem_stats_format(char *buf, size_t buflen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_MEM_STATS_H_2B7D4E91_8C3A_4F56_A0E2_5D19C6B8F374
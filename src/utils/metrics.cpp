@@ -0,0 +1,239 @@
+/**
+ * @file   utils/metrics.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "utils/metrics.h"
+
+using std::atomic;
+using std::string;
+using std::vector;
+
+struct metric {
+        enum metric_type type;
+        string name;
+        string help;
+        string labels;
+        double lowest; ///< histogram only
+
+        atomic<uint64_t> count{0}; ///< counter value or histogram sample count
+        atomic<double> value{0.0}; ///< gauge value or histogram sum
+        std::array<atomic<uint64_t>, METRIC_HISTOGRAM_BUCKETS> buckets{};
+};
+
+static std::mutex metrics_lock;
+static vector<struct metric *> metrics; ///< in the registration order
+static vector<std::pair<void (*)(void *), void *>> collectors; ///< guarded by metrics_lock
+
+struct metric *metric_register(enum metric_type type, const char *name,
+                               const char *help, const char *labels)
+{
+        auto *m = new metric();
+        m->type = type;
+        m->name = name;
+        m->help = help;
+        m->labels = labels != nullptr ? labels : "";
+        m->lowest = 1.0;
+        std::lock_guard<std::mutex> lk(metrics_lock);
+        metrics.push_back(m);
+        return m;
+}
+
+struct metric *metric_register_histogram(const char *name, const char *help,
+                                         const char *labels, double lowest)
+{
+        struct metric *m = metric_register(METRIC_HISTOGRAM, name, help, labels);
+        m->lowest = lowest;
+        return m;
+}
+
+void metric_unregister(struct metric *m)
+{
+        if (m == nullptr) {
+                return;
+        }
+        {
+                std::lock_guard<std::mutex> lk(metrics_lock);
+                metrics.erase(std::find(metrics.begin(), metrics.end(), m));
+        }
+        delete m;
+}
+
+void metric_inc(struct metric *m, unsigned long long val)
+{
+        if (m == nullptr) {
+                return;
+        }
+        m->count.fetch_add(val, std::memory_order_relaxed);
+}
+
+void metric_set(struct metric *m, double val)
+{
+        if (m == nullptr) {
+                return;
+        }
+        m->value.store(val, std::memory_order_relaxed);
+}
+
+void metric_set_total(struct metric *m, unsigned long long val)
+{
+        if (m == nullptr) {
+                return;
+        }
+        m->count.store(val, std::memory_order_relaxed);
+}
+
+void metrics_add_collector(void (*collect)(void *udata), void *udata)
+{
+        std::lock_guard<std::mutex> lk(metrics_lock);
+        collectors.emplace_back(collect, udata);
+}
+
+void metric_observe(struct metric *m, double val)
+{
+        if (m == nullptr) {
+                return;
+        }
+        // bucket i holds (lowest * 2^(i-1), lowest * 2^i], 0 everything below
+        int idx = 0;
+        if (val > m->lowest) {
+                int exp = 0;
+                const double mant = frexp(val / m->lowest, &exp);
+                idx = mant == 0.5 ? exp - 1 : exp;
+        }
+        if (idx < METRIC_HISTOGRAM_BUCKETS) {
+                m->buckets[idx].fetch_add(1, std::memory_order_relaxed);
+        }
+        m->count.fetch_add(1, std::memory_order_relaxed);
+        double sum = m->value.load(std::memory_order_relaxed);
+        while (!m->value.compare_exchange_weak(sum, sum + val, std::memory_order_relaxed)) {
+        }
+}
+
+/// @param extra additional label (eg. le="1") or empty
+static string format_labels(const string &labels, const string &extra)
+{
+        if (labels.empty() && extra.empty()) {
+                return {};
+        }
+        return "{" + labels + (!labels.empty() && !extra.empty() ? "," : "") + extra + "}";
+}
+
+static void format_sample(string &out, const metric &m, const char *suffix,
+                          const string &extra_label, const char *value)
+{
+        out += m.name + suffix + format_labels(m.labels, extra_label) + " " + value + "\n";
+}
+
+static void format_metric(string &out, const metric &m)
+{
+        char val[64];
+        switch (m.type) {
+        case METRIC_COUNTER:
+                snprintf(val, sizeof val, "%" PRIu64, m.count.load(std::memory_order_relaxed));
+                format_sample(out, m, "_total", {}, val);
+                break;
+        case METRIC_GAUGE:
+                snprintf(val, sizeof val, "%.9g", m.value.load(std::memory_order_relaxed));
+                format_sample(out, m, "", {}, val);
+                break;
+        case METRIC_HISTOGRAM: {
+                // load the count first, so that the buckets don't exceed it
+                const uint64_t count = m.count.load(std::memory_order_relaxed);
+                const double sum = m.value.load(std::memory_order_relaxed);
+                uint64_t cumulative = 0;
+                for (int i = 0; i < METRIC_HISTOGRAM_BUCKETS; ++i) {
+                        cumulative += m.buckets[i].load(std::memory_order_relaxed);
+                        char le[64];
+                        snprintf(le, sizeof le, "le=\"%.9g\"", ldexp(m.lowest, i));
+                        snprintf(val, sizeof val, "%" PRIu64, std::min(cumulative, count));
+                        format_sample(out, m, "_bucket", le, val);
+                }
+                snprintf(val, sizeof val, "%" PRIu64, count);
+                format_sample(out, m, "_bucket", "le=\"+Inf\"", val);
+                format_sample(out, m, "_count", {}, val);
+                snprintf(val, sizeof val, "%.9g", sum);
+                format_sample(out, m, "_sum", {}, val);
+                break;
+        }
+        }
+}
+
+std::string metrics_format_openmetrics()
+{
+        static const char *const type_names[] = { "counter", "gauge", "histogram" };
+        vector<std::pair<void (*)(void *), void *>> collect;
+        {
+                std::lock_guard<std::mutex> lk(metrics_lock);
+                collect = collectors;
+        }
+        for (const auto &c : collect) {
+                c.first(c.second);
+        }
+        string out;
+        std::lock_guard<std::mutex> lk(metrics_lock);
+        // samples of a family must be contiguous
+        std::map<string, vector<const metric *>> families;
+        for (const auto *m : metrics) {
+                families[m->name].push_back(m);
+        }
+        for (const auto &f : families) {
+                const metric &first = *f.second[0];
+                out += "# TYPE " + f.first + " " + type_names[first.type] + "\n";
+                out += "# HELP " + f.first + " " + first.help + "\n";
+                for (const auto *m : f.second) {
+                        format_metric(out, *m);
+                }
+        }
+        out += "# EOF\n";
+        return out;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file   utils/metrics.h
+ *
+ * Registry of numeric metrics (counters, gauges and histograms) exported
+ * in the OpenMetrics (Prometheus) text format by the control socket on
+ * "GET /metrics" (HTTP). Updates are lock-free so that the metrics can be
+ * updated from the hot paths, registration takes a lock.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_METRICS_H_4A1F7C39_6D2E_4B85_9E07_C3B58D21F6A4
+#define UTILS_METRICS_H_4A1F7C39_6D2E_4B85_9E07_C3B58D21F6A4
+
+#ifdef __cplusplus
+#include <string>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum metric_type {
+        METRIC_COUNTER,
+        METRIC_GAUGE,
+        METRIC_HISTOGRAM,
+};
+
+struct metric;
+
+/**
+ * @param name   metric family name (eg. "ug_tx_bytes", "_total" is appended
+ *               to counter samples), series with the same name must have the
+ *               same type
+ * @param help   family description (the first registered is used)
+ * @param labels labels in the exposition format without braces, eg.
+ *               "ssrc=\"0x12345678\"", may be NULL
+ */
+struct metric *metric_register(enum metric_type type, const char *name,
+                               const char *help, const char *labels);
+/**
+ * Registers a histogram with logarithmic buckets, the upper bounds are
+ * lowest * 2^i (i = 0..METRIC_HISTOGRAM_BUCKETS-1) and +Inf.
+ */
+struct metric *metric_register_histogram(const char *name, const char *help,
+                                         const char *labels, double lowest);
+#define METRIC_HISTOGRAM_BUCKETS 24
+/// accepts NULL
+void metric_unregister(struct metric *m);
+
+/// increments a counter, lock-free, accepts NULL
+void metric_inc(struct metric *m, unsigned long long val);
+/// sets a counter accumulated elsewhere (eg. by the kernel), accepts NULL
+void metric_set_total(struct metric *m, unsigned long long val);
+/// sets a gauge, lock-free, accepts NULL
+void metric_set(struct metric *m, double val);
+/// adds the value to a histogram, lock-free, accepts NULL
+void metric_observe(struct metric *m, double val);
+
+/**
+ * Registers a callback called prior to each formatting of the metrics, so
+ * that values costly to keep up to date may be collected on demand. The
+ * callback may register and unregister metrics.
+ */
+void metrics_add_collector(void (*collect)(void *udata), void *udata);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+/// @returns the registered metrics in the OpenMetrics text format
+std::string metrics_format_openmetrics();
+#endif
+
+#endif // defined UTILS_METRICS_H_4A1F7C39_6D2E_4B85_9E07_C3B58D21F6A4
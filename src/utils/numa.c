@@ -0,0 +1,207 @@
+/**
+ * @file   utils/numa.c
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "host.h"
+#include "utils/misc.h"
+#include "utils/numa.h"
+#include "utils/thread.h"
+
+#define MOD_NAME "[numa] "
+
+ADD_TO_PARAM("numa-node", "* numa-node=<node>|<device>\n"
+                "  Pin pipeline threads and bind frame pool memory to NUMA node. The node\n"
+                "  can be given either as a number or as a device to take the node from -\n"
+                "  network interface (eg. eth0), V4L2 device (/dev/video0) or PCI address\n"
+                "  (0000:3b:00.0). Linux only.\n");
+
+#ifdef __linux__
+enum {
+        UG_MPOL_PREFERRED = 1, ///< MPOL_PREFERRED from numaif.h (not to depend on libnuma)
+};
+
+static int numa_node = -1;
+static cpu_set_t numa_cpus;
+static pthread_once_t numa_once = PTHREAD_ONCE_INIT;
+
+static int read_int_file(const char *path)
+{
+        FILE *f = fopen(path, "r");
+        if (f == NULL) {
+                return -1;
+        }
+        int val = -1;
+        if (fscanf(f, "%d", &val) != 1) {
+                val = -1;
+        }
+        fclose(f);
+        return val;
+}
+
+int ug_numa_node_of_device(const char *dev)
+{
+        char path[1024];
+        const char *c = dev;
+        while (isdigit((unsigned char) *c)) {
+                c++;
+        }
+        if (c != dev && *c == '\0') {
+                return atoi(dev);
+        }
+        if (strncmp(dev, "/dev/", strlen("/dev/")) == 0) {
+                snprintf(path, sizeof path, "/sys/class/video4linux/%s/device/numa_node",
+                                dev + strlen("/dev/"));
+                return read_int_file(path);
+        }
+        snprintf(path, sizeof path, "/sys/class/net/%s/device/numa_node", dev);
+        int node = read_int_file(path);
+        if (node >= 0) {
+                return node;
+        }
+        snprintf(path, sizeof path, "/sys/bus/pci/devices/%s/numa_node", dev);
+        return read_int_file(path);
+}
+
+static void numa_init(void)
+{
+        const char *param = get_commandline_param("numa-node");
+        if (param == NULL) {
+                return;
+        }
+        int node = ug_numa_node_of_device(param);
+        if (node < 0) {
+                MSG(WARNING, "Cannot determine NUMA node of %s, placement disabled.\n", param);
+                return;
+        }
+        char path[256];
+        char cpulist[4096] = "";
+        snprintf(path, sizeof path, "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *f = fopen(path, "r");
+        if (f != NULL) {
+                if (fgets(cpulist, sizeof cpulist, f) == NULL) {
+                        cpulist[0] = '\0';
+                }
+                fclose(f);
+        }
+        uint64_t mask[UG_CPULIST_MAX / 64];
+        int count = ug_parse_cpulist(cpulist, mask);
+        CPU_ZERO(&numa_cpus);
+        for (int i = 0; i < UG_CPULIST_MAX && i < CPU_SETSIZE; ++i) {
+                if (mask[i / 64] & (1ULL << (i % 64))) {
+                        CPU_SET(i, &numa_cpus);
+                }
+        }
+        if (count <= 0) {
+                MSG(WARNING, "No CPUs found for NUMA node %d, placement disabled.\n", node);
+                return;
+        }
+        MSG(INFO, "Using NUMA node %d (%d CPUs).\n", node, count);
+        numa_node = node;
+}
+
+int ug_numa_get_node(void)
+{
+        pthread_once(&numa_once, numa_init);
+        return numa_node;
+}
+
+void ug_numa_bind_thread(void)
+{
+        if (ug_numa_get_node() < 0 || thread_has_explicit_affinity()) {
+                return;
+        }
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof numa_cpus, &numa_cpus);
+        if (rc != 0) {
+                MSG(WARNING, "Cannot set thread affinity: %s\n", ug_strerror(rc));
+        }
+}
+
+void ug_numa_bind_memory(void *ptr, size_t len)
+{
+        const int node = ug_numa_get_node();
+        if (node < 0) {
+                return;
+        }
+#ifdef SYS_mbind
+        enum { BITS = 8 * sizeof(unsigned long) };
+        unsigned long mask[node / BITS + 1];
+        memset(mask, 0, sizeof mask);
+        mask[node / BITS] = 1UL << (node % BITS);
+        if (syscall(SYS_mbind, ptr, len, UG_MPOL_PREFERRED, mask,
+                                sizeof mask * 8 + 1, 0) != 0) {
+                MSG(VERBOSE, "mbind: %s\n", ug_strerror(errno));
+        }
+#else
+        (void) ptr, (void) len;
+#endif
+}
+#else
+int ug_numa_node_of_device(const char *dev)
+{
+        (void) dev;
+        return -1;
+}
+
+int ug_numa_get_node(void)
+{
+        return -1;
+}
+
+void ug_numa_bind_thread(void)
+{
+}
+
+void ug_numa_bind_memory(void *ptr, size_t len)
+{
+        (void) ptr, (void) len;
+}
+#endif
@@ -0,0 +1,70 @@
+/**
+ * @file   utils/numa.h
+ *
+ * Optional NUMA placement of the video pipeline. If configured with
+ * "--param numa-node", pipeline threads are pinned to CPUs of the selected
+ * node and frame pool buffers are bound to its memory. The node can be given
+ * directly or as a device (NIC, V4L2 device, PCI address) whose NUMA node is
+ * looked up in sysfs. Everything is a no-op if not configured or on
+ * platforms other than Linux.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_NUMA_H_6A3E9F21_4C7B_4D8E_B1A5_9E2F7C0D3B64
+#define UTILS_NUMA_H_6A3E9F21_4C7B_4D8E_B1A5_9E2F7C0D3B64
+
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @returns NUMA node of the device (see numa-node param help), -1 if unknown
+int ug_numa_node_of_device(const char *dev);
+/// @returns configured node, -1 if none
+int ug_numa_get_node(void);
+/// pins calling thread to CPUs of the configured node
+void ug_numa_bind_thread(void);
+/// binds page-aligned memory range to the configured node
+void ug_numa_bind_memory(void *ptr, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_NUMA_H_6A3E9F21_4C7B_4D8E_B1A5_9E2F7C0D3B64
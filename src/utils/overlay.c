@@ -0,0 +1,255 @@
+/**
+ * @file   utils/overlay.c
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "color.h"
+#include "utils/macros.h"
+#include "utils/overlay.h"
+#include "video_codec.h"
+
+struct overlay {
+        codec_t pixfmt;
+        int width;             ///< pixels (rounded up to the pixfmt block)
+        int height;
+        int linesize;
+        unsigned char *premult;   ///< premultiplied overlay in pixfmt
+        unsigned char *inv_alpha; ///< 255 - alpha for every byte of premult
+        int *span_start;       ///< first non-transparent byte of each line
+        int *span_end;         ///< one after the last non-transparent byte
+};
+
+/// x / 255 rounded, exact for x <= 255 * 255
+static inline unsigned
+div255(unsigned x)
+{
+        x += 128;
+        return (x + (x >> 8)) >> 8;
+}
+
+bool
+overlay_pixfmt_supported(codec_t pixfmt)
+{
+        return pixfmt == RGB || pixfmt == RGBA || pixfmt == UYVY ||
+               pixfmt == YUYV;
+}
+
+static void
+rgba_to_ycbcr(const unsigned char *px, bool ycbcr_src, int *y, int *cb,
+              int *cr)
+{
+        if (ycbcr_src) {
+                *y  = px[0];
+                *cb = px[1];
+                *cr = px[2];
+                return;
+        }
+        const comp_type_t r = px[0];
+        const comp_type_t g = px[1];
+        const comp_type_t b = px[2];
+        *y  = CLAMP_LIMITED_Y((RGB_TO_Y_709_SCALED(r, g, b) >> COMP_BASE) + 16, 8);
+        *cb = CLAMP_LIMITED_CBCR((RGB_TO_CB_709_SCALED(r, g, b) >> COMP_BASE) + 128, 8);
+        *cr = CLAMP_LIMITED_CBCR((RGB_TO_CR_709_SCALED(r, g, b) >> COMP_BASE) + 128, 8);
+}
+
+/// converts one input line (with in_width pixels) to premultiplied pixfmt
+static void
+convert_line(struct overlay *o, const unsigned char *in, int in_width,
+             bool ycbcr_src, unsigned char *pm, unsigned char *inv)
+{
+        switch (o->pixfmt) {
+        case RGB:
+        case RGBA: {
+                const int bpp = o->pixfmt == RGB ? 3 : 4;
+                for (int x = 0; x < in_width; ++x) {
+                        const unsigned a = in[4 * x + 3];
+                        for (int i = 0; i < 3; ++i) {
+                                pm[bpp * x + i]  = div255(in[4 * x + i] * a);
+                                inv[bpp * x + i] = 255 - a;
+                        }
+                        if (bpp == 4) {
+                                pm[4 * x + 3]  = a;
+                                inv[4 * x + 3] = 255 - a;
+                        }
+                }
+                break;
+        }
+        case UYVY:
+        case YUYV: {
+                const int yoff = o->pixfmt == UYVY ? 1 : 0;
+                const int coff = 1 - yoff;
+                for (int x = 0; x < o->width; x += 2) {
+                        const unsigned char transparent[4] = { 0 };
+                        const unsigned char *p0 = x < in_width ? in + 4 * x : transparent;
+                        const unsigned char *p1 = x + 1 < in_width ? in + 4 * (x + 1) : transparent;
+                        int y0, cb0, cr0, y1, cb1, cr1;
+                        rgba_to_ycbcr(p0, ycbcr_src, &y0, &cb0, &cr0);
+                        rgba_to_ycbcr(p1, ycbcr_src, &y1, &cb1, &cr1);
+                        const unsigned a0 = p0[3];
+                        const unsigned a1 = p1[3];
+                        const unsigned ac = (a0 + a1 + 1) / 2;
+                        unsigned char *d_pm  = pm + 2 * x;
+                        unsigned char *d_inv = inv + 2 * x;
+                        d_pm[yoff]      = div255(y0 * a0);
+                        d_inv[yoff]     = 255 - a0;
+                        d_pm[yoff + 2]  = div255(y1 * a1);
+                        d_inv[yoff + 2] = 255 - a1;
+                        d_pm[coff]      = div255((cb0 * a0 + cb1 * a1 + 1) / 2);
+                        d_inv[coff]     = 255 - ac;
+                        d_pm[coff + 2]  = div255((cr0 * a0 + cr1 * a1 + 1) / 2);
+                        d_inv[coff + 2] = 255 - ac;
+                }
+                break;
+        }
+        default:
+                abort();
+        }
+}
+
+struct overlay *
+overlay_create(const unsigned char *rgba, int width, int height, codec_t pixfmt,
+               bool ycbcr_src)
+{
+        if (!overlay_pixfmt_supported(pixfmt) || width <= 0 || height <= 0) {
+                return NULL;
+        }
+        struct overlay *o = calloc(1, sizeof *o);
+        const int block   = get_pf_block_pixels(pixfmt);
+        o->pixfmt         = pixfmt;
+        o->width          = (width + block - 1) / block * block;
+        o->height         = height;
+        o->linesize       = vc_get_linesize(o->width, pixfmt);
+        o->premult        = malloc((size_t) o->linesize * height);
+        o->inv_alpha      = malloc((size_t) o->linesize * height);
+        o->span_start     = malloc(height * sizeof *o->span_start);
+        o->span_end       = malloc(height * sizeof *o->span_end);
+
+        for (int y = 0; y < height; ++y) {
+                unsigned char *pm  = o->premult + (size_t) y * o->linesize;
+                unsigned char *inv = o->inv_alpha + (size_t) y * o->linesize;
+                convert_line(o, rgba + (size_t) y * width * 4, width,
+                             ycbcr_src, pm, inv);
+                int start = 0;
+                int end   = o->linesize;
+                while (start < end && inv[start] == 255) {
+                        start++;
+                }
+                while (end > start && inv[end - 1] == 255) {
+                        end--;
+                }
+                o->span_start[y] = start;
+                o->span_end[y]   = end;
+        }
+        return o;
+}
+
+static void
+blend_span(unsigned char *restrict dst, const unsigned char *restrict pm,
+           const unsigned char *restrict inv, int len)
+{
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i c128 = _mm_set1_epi16(128);
+        for ( ; x + 16 <= len; x += 16) {
+                const __m128i d = _mm_loadu_si128((const __m128i *)(const void *) (dst + x));
+                const __m128i a = _mm_loadu_si128((const __m128i *)(const void *) (inv + x));
+                const __m128i p = _mm_loadu_si128((const __m128i *)(const void *) (pm + x));
+                // d * inv / 255 (rounded) in 16-bit lanes, unsigned products fit
+                __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(a, zero)), c128);
+                __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(a, zero)), c128);
+                lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+                hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+                _mm_storeu_si128((__m128i *)(void *) (dst + x), _mm_adds_epu8(_mm_packus_epi16(lo, hi), p));
+        }
+#endif
+        for ( ; x < len; ++x) {
+                dst[x] = MIN(pm[x] + div255(dst[x] * inv[x]), 255);
+        }
+}
+
+void
+overlay_blend(const struct overlay *o, char *data, int frame_width,
+              int frame_height, int pitch, int x, int y)
+{
+        const int block = get_pf_block_pixels(o->pixfmt);
+        x = (x >= 0 ? x / block : -((-x + block - 1) / block)) * block;
+        // bytes of overlay lines skipped on the left / frame bytes available
+        const int skip = x < 0 ? vc_get_linesize(-x, o->pixfmt) : 0;
+        const int dst_off = x > 0 ? vc_get_linesize(x, o->pixfmt) : 0;
+        const int avail = vc_get_linesize(frame_width, o->pixfmt) - dst_off;
+        if (avail <= 0) {
+                return;
+        }
+        for (int line = MAX(0, -y); line < o->height && y + line < frame_height;
+             ++line) {
+                const int start = MAX(o->span_start[line], skip);
+                const int end   = MIN(o->span_end[line], skip + avail);
+                if (start >= end) {
+                        continue;
+                }
+                const size_t off = (size_t) line * o->linesize + start;
+                unsigned char *dst = (unsigned char *) data +
+                                     (size_t) (y + line) * pitch + dst_off +
+                                     (start - skip);
+                blend_span(dst, o->premult + off, o->inv_alpha + off,
+                           end - start);
+        }
+}
+
+void
+overlay_destroy(struct overlay *o)
+{
+        if (o == NULL) {
+                return;
+        }
+        free(o->premult);
+        free(o->inv_alpha);
+        free(o->span_start);
+        free(o->span_end);
+        free(o);
+}
+
+/* vim: set expandtab sw=8: */
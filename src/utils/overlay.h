@@ -0,0 +1,73 @@
+/**
+ * @file   utils/overlay.h
+ *
+ * Cached overlay (logo, text) blended over video frames. The overlay is
+ * converted to the frame pixel format and premultiplied once, blending then
+ * touches only the non-transparent parts of the overlay lines.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_OVERLAY_H_0E5C3A7D_9B21_4F6A_8D34_7A1C5E2B9F40
+#define UTILS_OVERLAY_H_0E5C3A7D_9B21_4F6A_8D34_7A1C5E2B9F40
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct overlay;
+
+bool overlay_pixfmt_supported(codec_t pixfmt);
+/**
+ * @param rgba       non-premultiplied 8-bit RGBA overlay image
+ * @param ycbcr_src  RGB channels of rgba already contain Y, Cb, Cr (used
+ *                   only for YCbCr pixfmt, RGB is converted otherwise)
+ * @returns NULL if pixfmt is not supported
+ */
+struct overlay *overlay_create(const unsigned char *rgba, int width, int height,
+                               codec_t pixfmt, bool ycbcr_src);
+/**
+ * Blends the overlay over the frame at position x, y (may be negative
+ * or partially out of the frame, x is aligned down to the pixfmt block).
+ */
+void overlay_blend(const struct overlay *o, char *data, int frame_width,
+                   int frame_height, int pitch, int x, int y);
+void overlay_destroy(struct overlay *o);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_OVERLAY_H_0E5C3A7D_9B21_4F6A_8D34_7A1C5E2B9F40
@@ -1,9 +1,9 @@
 /**
- * @file   utils/packet_conter.cpp
+ * @file   utils/packet_counter.cpp
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2012-2023 CESNET, z. s. p. o.
+ * Copyright (c) 2012-2026 CESNET, z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -42,55 +42,112 @@
 #endif // defined HAVE_CONFIG_H
 
 #include "utils/packet_counter.h"
-#include <map>
+
+#include <algorithm>
+#include <utility>
 #include <vector>
 
-using std::map;
+using std::max;
+using std::min;
+using std::pair;
 using std::vector;
 
+/**
+ * Received byte ranges are kept per substream and buffer as a sorted vector
+ * of disjoint intervals. Packets usually arrive in order, so the
+ * registration is O(1) (the last interval is extended) and both totals are
+ * maintained incrementally (O(1) queries). Duplicate and overlapping
+ * packets are counted only once. The storage is kept on clear(), so there
+ * are no allocations in the steady state.
+ */
 struct packet_counter {
         explicit packet_counter(int ns) : substream_data(ns) {}
 
-        void register_packet(int substream_id, int bufnum, int offset, int len) {
-                substream_data.at(substream_id)[bufnum][offset] = len;
+        void register_packet(int substream_id, unsigned bufnum, unsigned offset, unsigned len) {
+                if (len == 0) {
+                        return;
+                }
+                struct buffer &buf = get_buffer(substream_data.at(substream_id), bufnum);
+                const unsigned end = offset + len;
+                if (end > buf.end) {
+                        all_bytes += end - buf.end;
+                        buf.end = end;
+                }
+                auto &r = buf.ranges;
+                if (r.empty() || offset > r.back().second) { // in order with a gap
+                        r.emplace_back(offset, end);
+                        total_bytes += len;
+                        return;
+                }
+                if (offset == r.back().second) { // in order
+                        r.back().second = end;
+                        total_bytes += len;
+                        return;
+                }
+                // out of order or duplicate - merge with overlapping intervals
+                auto first = std::lower_bound(r.begin(), r.end(), offset,
+                                [](const pair<unsigned, unsigned> &i, unsigned o) { return i.second < o; });
+                auto last = first;
+                unsigned lo = offset;
+                unsigned hi = end;
+                unsigned covered = 0;
+                while (last != r.end() && last->first <= end) {
+                        covered += min(last->second, end) - max(last->first, offset);
+                        lo = min(lo, last->first);
+                        hi = max(hi, last->second);
+                        ++last;
+                }
+                total_bytes += len - covered;
+                if (first == last) {
+                        r.insert(first, { lo, hi });
+                } else {
+                        *first = { lo, hi };
+                        r.erase(first + 1, last);
+                }
         }
 
-        int get_total_bytes() {
-                int ret = 0;
-
+        void clear() {
                 for (auto &&chan : substream_data) {
-                        for (auto &&buffer : chan) {
-                                for (auto &&packet : buffer.second) {
-                                        ret += packet.second;
-                                }
+                        for (auto &buf : chan.buffers) {
+                                buf.ranges.clear();
                         }
+                        chan.used = 0;
                 }
-
-                return ret;
+                total_bytes = all_bytes = 0;
         }
 
-        int get_all_bytes() {
-                int ret = 0;
-
-                for (auto &&chan : substream_data) {
-                        for (auto &buf : chan) {
-                                if (!buf.second.empty()) {
-                                        ret += (--buf.second.end())->first +
-                                               (--buf.second.end())->second;
-                                }
+        struct buffer {
+                unsigned bufnum;
+                unsigned end; ///< end of the furthest packet
+                vector<pair<unsigned, unsigned>> ranges; ///< [start, end)
+        };
+        struct substream {
+                vector<buffer> buffers; ///< first used are valid
+                size_t used = 0;
+                size_t last = 0; ///< index of the last accessed buffer
+        };
+
+        static struct buffer &get_buffer(struct substream &s, unsigned bufnum) {
+                if (s.last < s.used && s.buffers[s.last].bufnum == bufnum) {
+                        return s.buffers[s.last];
+                }
+                for (s.last = 0; s.last < s.used; ++s.last) {
+                        if (s.buffers[s.last].bufnum == bufnum) {
+                                return s.buffers[s.last];
                         }
                 }
-
-                return ret;
-        }
-
-        void clear() {
-                for (auto &&chan : substream_data) {
-                        chan.clear();
+                if (s.used == s.buffers.size()) {
+                        s.buffers.emplace_back();
                 }
+                struct buffer &buf = s.buffers[s.used++];
+                buf.bufnum = bufnum;
+                buf.end = 0;
+                return buf;
         }
 
-        vector<map<int, map<int, int> > > substream_data;
+        vector<substream> substream_data;
+        long long total_bytes = 0; ///< received bytes
+        long long all_bytes = 0; ///< sum of buffer lengths (end of the last packet)
 };
 
 struct packet_counter *packet_counter_init(int num_substreams) {
@@ -109,12 +166,12 @@ void packet_counter_register_packet(struct packet_counter *state, unsigned int s
 
 int packet_counter_get_total_bytes(struct packet_counter *state)
 {
-        return state->get_total_bytes();
+        return (int) state->total_bytes;
 }
 
 int packet_counter_get_all_bytes(struct packet_counter *state)
 {
-        return state->get_all_bytes();
+        return (int) state->all_bytes;
 }
 
 int packet_counter_get_channels(struct packet_counter *state)
@@ -43,6 +43,11 @@
 
 #include "pam.h"
 
+#ifdef _WIN32
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
 static bool parse_pam(FILE *file, struct pam_metadata *info) {
         char line[128];
         while (fgets(line, sizeof line - 1, file) != NULL) {
@@ -138,14 +143,9 @@ static bool parse_pnm(FILE *file, char pnm_id, struct pam_metadata *info) {
         return false;
 }
 
-bool pam_read(const char *filename, struct pam_metadata *info, unsigned char **data, void *(*allocator)(size_t)) {
+/// parses the header, file is left at the image data
+static bool pam_read_header(FILE *file, const char *filename, struct pam_metadata *info) {
         char line[128];
-        errno = 0;
-        FILE *file = fopen(filename, "rb");
-        if (!file) {
-                fprintf(stderr, "Failed to open %s: %s\n", filename, strerror(errno));
-                return false;
-        }
         memset(info, 0, sizeof *info);
         if (fgets(line, 4, file) == NULL) {
                 fprintf(stderr, "File '%s' read error: %s\n", filename, strerror(errno));
@@ -159,7 +159,6 @@ bool pam_read(const char *filename, struct pam_metadata *info, unsigned char **d
                fprintf(stderr, "File '%s' doesn't seem to be valid PAM or PNM.\n", filename);
         }
         if (!parse_rc) {
-               fclose(file);
                return false;
         }
         if (info->width <= 0 || info->height <= 0) {
@@ -174,16 +173,32 @@ bool pam_read(const char *filename, struct pam_metadata *info, unsigned char **d
                 fprintf(stderr, "Unspecified/incorrect maximal value %d!\n", info->maxval);
                 parse_rc = false;
         }
-        if (data == NULL || allocator == NULL || !parse_rc) {
-                fclose(file);
-                return parse_rc;
-        }
+        return parse_rc;
+}
+
+static size_t pam_get_data_len(const struct pam_metadata *info) {
         size_t datalen = (size_t) info->depth * info->width * info->height;
         if (info->maxval == 1 && info->bitmap_pbm) {
                 datalen = (info->width + 7) / 8 * info->height;
         } else if (info->maxval > 255) {
                 datalen *= 2;
         }
+        return datalen;
+}
+
+bool pam_read(const char *filename, struct pam_metadata *info, unsigned char **data, void *(*allocator)(size_t)) {
+        errno = 0;
+        FILE *file = fopen(filename, "rb");
+        if (!file) {
+                fprintf(stderr, "Failed to open %s: %s\n", filename, strerror(errno));
+                return false;
+        }
+        bool parse_rc = pam_read_header(file, filename, info);
+        if (data == NULL || allocator == NULL || !parse_rc) {
+                fclose(file);
+                return parse_rc;
+        }
+        size_t datalen = pam_get_data_len(info);
         *data = (unsigned char *) allocator(datalen);
         if (!*data) {
                 fprintf(stderr, "Unspecified depth header field!\n");
@@ -201,6 +216,58 @@ bool pam_read(const char *filename, struct pam_metadata *info, unsigned char **d
         return true;
 }
 
+size_t pam_read_index(const char *filename, struct pam_metadata *info, size_t **offsets) {
+        errno = 0;
+        FILE *file = fopen(filename, "rb");
+        if (!file) {
+                fprintf(stderr, "Failed to open %s: %s\n", filename, strerror(errno));
+                return 0;
+        }
+        if (!pam_read_header(file, filename, info)) {
+                fclose(file);
+                return 0;
+        }
+        const size_t datalen = pam_get_data_len(info);
+        long long offset = ftello(file);
+        fseeko(file, 0, SEEK_END);
+        const long long file_len = ftello(file);
+
+        size_t count = 0;
+        size_t allocated = 0;
+        *offsets = NULL;
+        while (offset >= 0 && offset + (long long) datalen <= file_len) {
+                if (count == allocated) {
+                        allocated = allocated == 0 ? 64 : allocated * 2;
+                        size_t *tmp = (size_t *) realloc(*offsets, allocated * sizeof **offsets);
+                        if (tmp == NULL) {
+                                break;
+                        }
+                        *offsets = tmp;
+                }
+                (*offsets)[count++] = (size_t) offset;
+                // images are concatenated, all must have the same header
+                if (offset + (long long) datalen == file_len ||
+                                fseeko(file, offset + (long long) datalen, SEEK_SET) != 0) {
+                        break;
+                }
+                struct pam_metadata next;
+                if (!pam_read_header(file, filename, &next) || next.width != info->width ||
+                                next.height != info->height || next.depth != info->depth ||
+                                next.maxval != info->maxval) {
+                        fprintf(stderr, "Image %zu of '%s' differs, using first %zu images.\n",
+                                        count + 1, filename, count);
+                        break;
+                }
+                offset = ftello(file);
+        }
+        fclose(file);
+        if (count == 0) {
+                free(*offsets);
+                *offsets = NULL;
+        }
+        return count;
+}
+
 bool pam_write(const char *filename, unsigned int width, unsigned int height, int depth, int maxval, const unsigned char *data, bool pnm) {
         errno = 0;
         FILE *file = fopen(filename, "wb");
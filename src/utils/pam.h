@@ -59,6 +59,13 @@ struct pam_metadata {
 };
 
 bool pam_read(const char *filename, struct pam_metadata *info, unsigned char **data, void *(*allocator)(size_t));
+/**
+ * Indexes images of a PAM/PNM sequence (images with the same header
+ * concatenated) without reading the data (eg. to map the file).
+ * @param[out] offsets file offsets of the image data, to be freed with free()
+ * @returns number of complete images, 0 on error
+ */
+size_t pam_read_index(const char *filename, struct pam_metadata *info, size_t **offsets);
 bool pam_write(const char *filename, unsigned int width, unsigned int height, int depth, int maxval, const unsigned char *data, bool pnm);
 
 #ifdef __cplusplus
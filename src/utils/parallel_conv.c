@@ -3,7 +3,7 @@
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2021-2023 CESNET, z. s. p. o.
+ * Copyright (c) 2021-2026 CESNET, z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -36,51 +36,103 @@
  */
 
 #include <assert.h>
+#include <stdatomic.h>
 
+#include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/parallel_conv.h"
 #include "utils/worker.h"
 
+/// bands per thread - more bands than threads lets faster threads take over
+/// the work of slower ones (eg. running on a remote NUMA node)
+#define BANDS_PER_THREAD 4
+#define MIN_BAND_HEIGHT 16
+
 struct parallel_pix_conv_data {
         decoder_t decode;
         int height;
+        int band_height;
         unsigned char *out_data;
         int out_linesize;
         const unsigned char *in_data;
         int in_linesize;
+        atomic_int next_band;
 };
 
+/// every worker takes bands from the shared counter until all are processed
 static void *parallel_pix_conv_task(void *arg) {
         struct parallel_pix_conv_data *data = arg;
-        for (int y = 0; y < data->height; ++y) {
-                data->decode(data->out_data, data->in_data, data->out_linesize, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
-                data->out_data += data->out_linesize;
-                data->in_data += data->in_linesize;
+        int band = 0;
+        while ((band = atomic_fetch_add_explicit(&data->next_band, 1, memory_order_relaxed)) * data->band_height < data->height) {
+                const int y_start = band * data->band_height;
+                const int y_end = MIN(y_start + data->band_height, data->height);
+                unsigned char *out = data->out_data + (ptrdiff_t) y_start * data->out_linesize;
+                const unsigned char *in = data->in_data + (ptrdiff_t) y_start * data->in_linesize;
+                for (int y = y_start; y < y_end; ++y) {
+                        data->decode(out, in, data->out_linesize, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+                        out += data->out_linesize;
+                        in += data->in_linesize;
+                }
         }
         return NULL;
 }
 
-/// @todo utilize respawn_parallel
 void parallel_pix_conv(int height, char *out, int out_linesize, const char *in, int in_linesize, decoder_t decode, int threads)
 {
         if (threads == 0) {
                 threads = get_cpu_core_count();
         }
         assert(threads > 0);
-        struct parallel_pix_conv_data data[threads];
+        threads = MAX(MIN(threads, height / MIN_BAND_HEIGHT), 1);
 
-        for (ptrdiff_t i = 0; i < threads; ++i) {
-                data[i].decode = decode;
-                data[i].height = height / threads;
-                data[i].out_data = (unsigned char *) out + i * data[i].height * out_linesize;
-                data[i].out_linesize = out_linesize;
-                data[i].in_data = (const unsigned char *) in + i * data[i].height * in_linesize;
-                data[i].in_linesize = in_linesize;
-                if (i == threads - 1) {
-                        data[i].height = height - (threads - 1) * (height / threads);
-                }
-        }
+        struct parallel_pix_conv_data data = {
+                .decode = decode,
+                .height = height,
+                .band_height = MAX((height + threads * BANDS_PER_THREAD - 1) / (threads * BANDS_PER_THREAD), MIN_BAND_HEIGHT),
+                .out_data = (unsigned char *) out,
+                .out_linesize = out_linesize,
+                .in_data = (const unsigned char *) in,
+                .in_linesize = in_linesize,
+        };
+        atomic_init(&data.next_band, 0);
 
-        task_run_parallel(parallel_pix_conv_task, threads, data, sizeof data[0], NULL);
+        // all workers share the same data (zero stride)
+        task_run_parallel(parallel_pix_conv_task, threads, &data, 0, NULL);
 }
 
+struct parallel_rows_data {
+        parallel_rows_callback_t callback;
+        void *udata;
+        int height;
+        int band_height;
+        atomic_int next_band;
+};
+
+static void *parallel_rows_task(void *arg) {
+        struct parallel_rows_data *data = arg;
+        int band = 0;
+        while ((band = atomic_fetch_add_explicit(&data->next_band, 1, memory_order_relaxed)) * data->band_height < data->height) {
+                const int y_start = band * data->band_height;
+                data->callback(y_start, MIN(y_start + data->band_height, data->height), data->udata);
+        }
+        return NULL;
+}
+
+void parallel_rows(int height, parallel_rows_callback_t callback, void *udata, int threads)
+{
+        if (threads == 0) {
+                threads = get_cpu_core_count();
+        }
+        assert(threads > 0);
+        threads = MAX(MIN(threads, height / MIN_BAND_HEIGHT), 1);
+
+        struct parallel_rows_data data = {
+                .callback = callback,
+                .udata = udata,
+                .height = height,
+                .band_height = MAX((height + threads * BANDS_PER_THREAD - 1) / (threads * BANDS_PER_THREAD), MIN_BAND_HEIGHT),
+        };
+        atomic_init(&data.next_band, 0);
+
+        task_run_parallel(parallel_rows_task, threads, &data, 0, NULL);
+}
@@ -3,7 +3,7 @@
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2021-2023 CESNET z.s.p.o.
+ * Copyright (c) 2021-2026 CESNET z.s.p.o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -50,6 +50,15 @@ extern "C" {
  */
 void parallel_pix_conv(int height, char *out, int out_linesize, const char *in, int in_linesize, decoder_t decode, int threads);
 
+/// processes rows [y_start, y_end)
+typedef void (*parallel_rows_callback_t)(int y_start, int y_end, void *udata);
+/**
+ * Runs callback for bands of rows in parallel (with the same band
+ * scheduling as parallel_pix_conv())
+ * @param threads number of threads; use 0 to use all logical threads
+ */
+void parallel_rows(int height, parallel_rows_callback_t callback, void *udata, int threads);
+
 #ifdef __cplusplus
 }
 #endif
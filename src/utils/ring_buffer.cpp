@@ -279,9 +279,15 @@ int ring_get_available_write_size(struct ring_buffer * ring) {
         return calculate_avail_write(start, end, ring->len);
 }
 
+static void ring_buffer_get_fill(void *ring, int *fill, int *target) {
+        *fill = ring_get_current_size(static_cast<struct ring_buffer *>(ring));
+        *target = ring_get_size(static_cast<struct ring_buffer *>(ring)) / 2;
+}
+
 struct audio_buffer_api ring_buffer_fns = {
         (void (*)(void *)) ring_buffer_destroy,
         (int (*)(void *, char *, int)) ring_buffer_read,
-        (void (*)(void *, const char *, int)) ring_buffer_write
+        (void (*)(void *, const char *, int)) ring_buffer_write,
+        ring_buffer_get_fill,
 };
 
@@ -0,0 +1,106 @@
+/**
+ * @file   utils/stream_copy.c
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#elif defined __SSE2__
+#include <emmintrin.h>
+#elif defined __ARM_NEON && defined __aarch64__
+#include <arm_neon.h>
+#endif
+
+#include "utils/stream_copy.h"
+
+#if defined __ARM_NEON && defined __aarch64__
+/// how far ahead of the copied block to prefetch (bytes)
+#define PREFETCH_DIST 512
+#endif
+
+void ug_stream_copy(void *__restrict dst, const void *__restrict src, size_t len)
+{
+        if (len < UG_STREAM_COPY_THRESHOLD) {
+                memcpy(dst, src, len);
+                return;
+        }
+        unsigned char *d = dst;
+        const unsigned char *s = src;
+#if defined __AVX__ || defined __SSE2__
+#ifdef __AVX__
+        enum { ALIGN = 32, BLOCK = 128 };
+#else
+        enum { ALIGN = 16, BLOCK = 64 };
+#endif
+        // streaming stores need aligned destination
+        size_t head = (ALIGN - (uintptr_t) d % ALIGN) % ALIGN;
+        memcpy(d, s, head);
+        d += head;
+        s += head;
+        len -= head;
+        for ( ; len >= BLOCK; len -= BLOCK, d += BLOCK, s += BLOCK) {
+#ifdef __AVX__
+                __m256i v0 = _mm256_loadu_si256((const __m256i *)(const void *) s);
+                __m256i v1 = _mm256_loadu_si256((const __m256i *)(const void *) (s + 32));
+                __m256i v2 = _mm256_loadu_si256((const __m256i *)(const void *) (s + 64));
+                __m256i v3 = _mm256_loadu_si256((const __m256i *)(const void *) (s + 96));
+                _mm256_stream_si256((__m256i *)(void *) d, v0);
+                _mm256_stream_si256((__m256i *)(void *) (d + 32), v1);
+                _mm256_stream_si256((__m256i *)(void *) (d + 64), v2);
+                _mm256_stream_si256((__m256i *)(void *) (d + 96), v3);
+#else
+                __m128i v0 = _mm_loadu_si128((const __m128i *)(const void *) s);
+                __m128i v1 = _mm_loadu_si128((const __m128i *)(const void *) (s + 16));
+                __m128i v2 = _mm_loadu_si128((const __m128i *)(const void *) (s + 32));
+                __m128i v3 = _mm_loadu_si128((const __m128i *)(const void *) (s + 48));
+                _mm_stream_si128((__m128i *)(void *) d, v0);
+                _mm_stream_si128((__m128i *)(void *) (d + 16), v1);
+                _mm_stream_si128((__m128i *)(void *) (d + 32), v2);
+                _mm_stream_si128((__m128i *)(void *) (d + 48), v3);
+#endif
+        }
+        // make the streamed data visible to other threads before handing over
+        _mm_sfence();
+#elif defined __ARM_NEON && defined __aarch64__
+        // no plain non-temporal store intrinsic, at least prefetch the source
+        for ( ; len >= 64; len -= 64, d += 64, s += 64) {
+                __builtin_prefetch(s + PREFETCH_DIST, 0, 0);
+                vst1q_u8_x4(d, vld1q_u8_x4(s));
+        }
+#endif
+        memcpy(d, s, len);
+}
@@ -0,0 +1,64 @@
+/**
+ * @file   utils/stream_copy.h
+ *
+ * Copy with non-temporal (streaming) stores for large buffers that are not
+ * going to be read by the copying thread, eg. frames handed over to a display
+ * or an encoder. Unlike memcpy(), the destination doesn't evict the cache
+ * working set of the thread.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_STREAM_COPY_H_3F0C5E2A_7B1D_4C8E_9A6F_2D4B8E1C7A90
+#define UTILS_STREAM_COPY_H_3F0C5E2A_7B1D_4C8E_9A6F_2D4B8E1C7A90
+
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+/// copies shorter than this are done with regular memcpy()
+#define UG_STREAM_COPY_THRESHOLD 2048
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ug_stream_copy(void *__restrict dst, const void *__restrict src, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_STREAM_COPY_H_3F0C5E2A_7B1D_4C8E_9A6F_2D4B8E1C7A90
@@ -38,11 +38,13 @@
 #ifndef SYNCHRONIZED_QUEUE_H_
 #define SYNCHRONIZED_QUEUE_H_
 
-#include <condition_variable>
+#include <chrono>
 #include <mutex>
 #include <queue>
 #include <utility>
 
+#include "utils/event.h"
+
 struct msg {
         virtual ~msg() {}
 };
@@ -53,10 +55,12 @@ struct msg_quit : public msg {};
  * @brief simple blocking synchronized queue
  *
  * Queue blocks if it size is higher than max_len on push. It also blocks on pop call
- * if there is no element in the queue.
+ * if there is no element in the queue. The blocked threads sleep on ug_event
+ * (the lock protects just the queue itself).
  *
  * @tparam T type to be stored
- * @tparam max_len maximal length of the queue until it bloks (-1 means unlimited)
+ * @tparam max_len maximal length of the queue until it bloks (-1 means unlimited),
+ *                 can be changed in runtime with set_max_len()
  */
 template<typename T = struct msg *, int max_len = 1>
 class synchronized_queue {
@@ -67,12 +71,19 @@ public:
                 return m_queue.size();
         }
 
+        /// @param len new maximal length (-1 means unlimited)
+        void set_max_len(int len)
+        {
+                std::unique_lock<std::mutex> l(m_lock);
+                m_max_len = len;
+                l.unlock();
+                m_queue_decremented.notify_all();
+        }
+
         void push(T const & message)
         {
                 std::unique_lock<std::mutex> l(m_lock);
-                if (max_len != -1) {
-                        m_queue_decremented.wait(l, [this]{return m_queue.size() < (unsigned int) max_len;});
-                }
+                wait_not_full(l);
                 m_queue.push(message);
                 l.unlock();
                 m_queue_incremented.notify_one();
@@ -81,9 +92,7 @@ public:
         void push(T && message)
         {
                 std::unique_lock<std::mutex> l(m_lock);
-                if (max_len != -1) {
-                        m_queue_decremented.wait(l, [this]{return m_queue.size() < (unsigned int) max_len;});
-                }
+                wait_not_full(l);
                 m_queue.push(std::move(message));
                 l.unlock();
                 m_queue_incremented.notify_one();
@@ -96,7 +105,12 @@ public:
                         return T();
                 }
 
-                m_queue_incremented.wait(l, [this]{return m_queue.size() > 0;});
+                while (m_queue.size() == 0) {
+                        const uint32_t seq = m_queue_incremented.get();
+                        l.unlock();
+                        m_queue_incremented.wait(seq);
+                        l.lock();
+                }
                 T ret = std::move(m_queue.front());
                 m_queue.pop();
 
@@ -108,9 +122,17 @@ public:
         template<typename Rep, typename Period>
         bool timed_pop(T& result, std::chrono::duration<Rep, Period> const& timeout)
         {
+                const auto deadline = std::chrono::steady_clock::now() + timeout;
                 std::unique_lock<std::mutex> l(m_lock);
-                if (!m_queue_incremented.wait_for(l, timeout, [this]{return m_queue.size() > 0;})) {
-                        return false;
+                while (m_queue.size() == 0) {
+                        const std::chrono::nanoseconds remaining = deadline - std::chrono::steady_clock::now();
+                        if (remaining.count() <= 0) {
+                                return false;
+                        }
+                        const uint32_t seq = m_queue_incremented.get();
+                        l.unlock();
+                        m_queue_incremented.wait(seq, &remaining);
+                        l.lock();
                 }
                 result = std::move(m_queue.front());
                 m_queue.pop();
@@ -120,10 +142,21 @@ public:
         }
 
 private:
+        void wait_not_full(std::unique_lock<std::mutex> &l)
+        {
+                while (m_max_len != -1 && m_queue.size() >= (unsigned int) m_max_len) {
+                        const uint32_t seq = m_queue_decremented.get();
+                        l.unlock();
+                        m_queue_decremented.wait(seq);
+                        l.lock();
+                }
+        }
+
         std::queue<T>           m_queue;
+        int                     m_max_len = max_len;
         std::mutex              m_lock;
-        std::condition_variable m_queue_decremented;
-        std::condition_variable m_queue_incremented;
+        ug_event                m_queue_decremented;
+        ug_event                m_queue_incremented{true}; ///< consumers spin shortly before sleeping
 };
 
 #ifndef NO_EXTERN_MSGQ_MSG
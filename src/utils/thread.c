@@ -40,18 +40,238 @@
 #endif
 
 #include <libgen.h>
-#ifndef _WIN32
+#ifdef _WIN32
+#include <windows.h>
+#else
 #include <pthread.h>
+#include <sched.h>
 #endif
 #ifdef HAVE_SETTHREADDESCRIPTION
 #include <processthreadsapi.h>
 #endif
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "debug.h"
 #include "host.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+#include "utils/string.h"
 #include "utils/thread.h"
+#include "utils/thread_stats.h"
+
+#define MOD_NAME "[thread] "
+#define DEFAULT_MMCSS_TASK "Pro Audio"
+
+ADD_TO_PARAM("thread-affinity", "* thread-affinity=<name>[*]:[<cpus>][:fifo[=<prio>]][:mmcss[=<task>]][+...]\n"
+                "  Pin the pipeline threads of the given name (as set by set_thread_name(),\n"
+                "  eg. udp_reader, receiver_loop, compress, sender_loop, decompress_thread,\n"
+                "  '*' suffix matches a prefix) to the CPUs <cpus> (list, eg. 2-3/6) and\n"
+                "  optionally set SCHED_FIFO (priority <prio>, default maximal; TIME_CRITICAL\n"
+                "  on Windows) or register the thread in the Windows MMCSS task <task>\n"
+                "  (default \"" DEFAULT_MMCSS_TASK "\"). The first matching entry is used, it overrides\n"
+                "  numa-node for the thread. Threads created later by the thread inherit\n"
+                "  the settings unless they match an entry themselves.\n");
+
+static _Thread_local bool explicit_affinity;
+
+/// parses cpulist format, eg. "0-7,16-23"
+int ug_parse_cpulist(const char *list, uint64_t mask[UG_CPULIST_MAX / 64])
+{
+        memset(mask, 0, UG_CPULIST_MAX / 8);
+        int count = 0;
+        while (*list != '\0' && *list != '\n') {
+                char *endptr = NULL;
+                long first = strtol(list, &endptr, 10);
+                long last = first;
+                if (endptr == list || first < 0) {
+                        return -1;
+                }
+                if (*endptr == '-') {
+                        list = endptr + 1;
+                        last = strtol(list, &endptr, 10);
+                        if (endptr == list) {
+                                return -1;
+                        }
+                }
+                if (*endptr != ',' && *endptr != '\0' && *endptr != '\n') {
+                        return -1;
+                }
+                for (long i = first; i <= last && i < UG_CPULIST_MAX; ++i) {
+                        if ((mask[i / 64] & (1ULL << (i % 64))) == 0) {
+                                count += 1;
+                        }
+                        mask[i / 64] |= 1ULL << (i % 64);
+                }
+                list = *endptr == ',' ? endptr + 1 : endptr;
+        }
+        return count;
+}
+
+struct thread_policy {
+        bool has_cpus;
+        uint64_t cpus[UG_CPULIST_MAX / 64];
+        int fifo_prio;          ///< -1 not requested, 0 maximal
+        char mmcss_task[SHORT_STR]; ///< empty if not requested
+};
+
+static bool thread_name_matches(const char *pattern, size_t len, const char *name)
+{
+        if (len > 0 && pattern[len - 1] == '*') {
+                return strncmp(pattern, name, len - 1) == 0;
+        }
+        return strlen(name) == len && strncmp(pattern, name, len) == 0;
+}
+
+/**
+ * Parses the thread-affinity entry "<name>:<cpus>[:<opt>]..." if it
+ * matches the name.
+ * @retval false if the entry doesn't match or is invalid
+ */
+static bool parse_thread_policy(char *entry, const char *name, struct thread_policy *p)
+{
+        char *cpus = strchr(entry, ':');
+        if (cpus == NULL) {
+                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('T', 'A', 'F', 'S'),
+                             MOD_NAME "Wrong thread-affinity entry: %s\n", entry);
+                return false;
+        }
+        if (!thread_name_matches(entry, cpus - entry, name)) {
+                return false;
+        }
+        *cpus++ = '\0';
+        char *opts = strchr(cpus, ':');
+        if (opts != NULL) {
+                *opts++ = '\0';
+        }
+        memset(p, 0, sizeof *p);
+        p->fifo_prio = -1;
+        if (strlen(cpus) > 0) {
+                replace_all(cpus, "/", ","); // ',' separates --param items
+                if (ug_parse_cpulist(cpus, p->cpus) <= 0) {
+                        MSG(WARNING, "Wrong CPU list for thread %s: %s\n", name, cpus);
+                        return false;
+                }
+                p->has_cpus = true;
+        }
+        char *save_ptr = NULL;
+        for (char *opt = opts != NULL ? strtok_r(opts, ":", &save_ptr) : NULL; opt != NULL;
+             opt = strtok_r(NULL, ":", &save_ptr)) {
+                if (strcmp(opt, "fifo") == 0) {
+                        p->fifo_prio = 0;
+                } else if (strncmp(opt, "fifo=", strlen("fifo=")) == 0) {
+                        p->fifo_prio = atoi(opt + strlen("fifo="));
+                } else if (strcmp(opt, "mmcss") == 0) {
+                        snprintf(p->mmcss_task, sizeof p->mmcss_task, "%s", DEFAULT_MMCSS_TASK);
+                } else if (strncmp(opt, "mmcss=", strlen("mmcss=")) == 0) {
+                        snprintf(p->mmcss_task, sizeof p->mmcss_task, "%s", opt + strlen("mmcss="));
+                } else {
+                        MSG(WARNING, "Unknown thread-affinity option for thread %s: %s\n", name, opt);
+                        return false;
+                }
+        }
+        return true;
+}
+
+/// @returns true if a thread-affinity entry matches the name
+static bool get_thread_policy(const char *name, struct thread_policy *p)
+{
+        const char *cfg = get_commandline_param("thread-affinity");
+        if (cfg == NULL) {
+                return false;
+        }
+        char *tmp = strdup(cfg);
+        char *save_ptr = NULL;
+        bool found = false;
+        for (char *entry = strtok_r(tmp, "+", &save_ptr); entry != NULL && !found;
+             entry = strtok_r(NULL, "+", &save_ptr)) {
+                found = parse_thread_policy(entry, name, p);
+        }
+        free(tmp);
+        return found;
+}
+
+#ifdef _WIN32
+typedef HANDLE (WINAPI *av_set_mm_thread_characteristics_t)(LPCSTR task, LPDWORD task_index);
+
+static void register_mmcss(const char *name, const char *task)
+{
+        // loaded dynamically not to add the avrt.dll dependency
+        HMODULE avrt = LoadLibraryA("avrt.dll");
+        av_set_mm_thread_characteristics_t set_char = avrt == NULL ? NULL :
+                (av_set_mm_thread_characteristics_t) (void (*)(void))
+                GetProcAddress(avrt, "AvSetMmThreadCharacteristicsA");
+        DWORD task_index = 0;
+        if (set_char == NULL || set_char(task, &task_index) == NULL) {
+                MSG(WARNING, "Cannot register thread %s in MMCSS task %s.\n", name, task);
+                return;
+        }
+        MSG(VERBOSE, "Thread %s registered in MMCSS task %s.\n", name, task);
+}
+#endif
+
+static void apply_thread_policy(const char *name)
+{
+        struct thread_policy p;
+        if (!get_thread_policy(name, &p)) {
+                return;
+        }
+        if (p.has_cpus) {
+#ifdef __linux__
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (int i = 0; i < UG_CPULIST_MAX && i < CPU_SETSIZE; ++i) {
+                        if (p.cpus[i / 64] & (1ULL << (i % 64))) {
+                                CPU_SET(i, &set);
+                        }
+                }
+                int rc = pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+                if (rc != 0) {
+                        MSG(WARNING, "Cannot set affinity of thread %s: %s\n", name, ug_strerror(rc));
+                } else {
+                        explicit_affinity = true;
+                }
+#elif defined _WIN32
+                if (SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR) p.cpus[0]) == 0) {
+                        MSG(WARNING, "Cannot set affinity of thread %s.\n", name);
+                } else {
+                        explicit_affinity = true;
+                }
+#else
+                MSG(WARNING, "Thread affinity not supported on this platform.\n");
+#endif
+        }
+        if (p.fifo_prio >= 0) {
+#ifdef _WIN32
+                bool ok = SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+                const int max_prio = sched_get_priority_max(SCHED_FIFO);
+                const int min_prio = sched_get_priority_min(SCHED_FIFO);
+                struct sched_param sp = { .sched_priority = p.fifo_prio == 0 ? max_prio
+                                                  : MIN(MAX(p.fifo_prio, min_prio), max_prio) };
+                bool ok = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp) == 0;
+#endif
+                if (!ok) {
+                        MSG(WARNING, "Cannot set real-time priority of thread %s "
+                                        "(insufficient privileges?).\n", name);
+                }
+        }
+        if (strlen(p.mmcss_task) > 0) {
+#ifdef _WIN32
+                register_mmcss(name, p.mmcss_task);
+#else
+                MSG(VERBOSE, "MMCSS is available only on Windows, ignoring for thread %s.\n", name);
+#endif
+        }
+        MSG(VERBOSE, "Applied thread-affinity settings to thread %s.\n", name);
+}
+
+bool thread_has_explicit_affinity(void)
+{
+        return explicit_affinity;
+}
 
 #if ! defined  _WIN32 || defined HAVE_SETTHREADDESCRIPTION
 static inline char *get_argv_program_name(void) {
@@ -69,7 +289,9 @@ static inline char *get_argv_program_name(void) {
 }
 #endif
 
-void set_thread_name(const char *name) {
+void set_thread_name_src(const char *name, const char *src_file) {
+        thread_stats_register(name, src_file);
+        apply_thread_policy(name);
 #ifdef __linux__
 // thread name can have at most 16 chars (including terminating null char)
         char *prog_name = get_argv_program_name();
@@ -101,3 +323,11 @@ void set_thread_name(const char *name) {
 #endif
 }
 
+bool set_thread_realtime_priority(void) {
+#ifdef _WIN32
+        return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+        struct sched_param sp = { .sched_priority = sched_get_priority_max(SCHED_FIFO) };
+        return pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp) == 0;
+#endif
+}
@@ -38,11 +38,40 @@
 #ifndef UTILS_THREAD_H_
 #define UTILS_THREAD_H_
 
+#ifdef __cplusplus
+#include <cstdint>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+#define UG_CPULIST_MAX 1024 ///< max. CPU index + 1 for ug_parse_cpulist()
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void set_thread_name(const char *name);
+/**
+ * Names the calling thread and registers it for the thread statistics
+ * (utils/thread_stats.h), the source file identifies the owning module.
+ */
+#define set_thread_name(name) set_thread_name_src(name, __FILE__)
+void set_thread_name_src(const char *name, const char *src_file);
+/**
+ * Sets real-time (SCHED_FIFO on POSIX) priority of the calling thread.
+ * @retval false if not permitted or not supported (priority unchanged)
+ */
+bool set_thread_realtime_priority(void);
+/**
+ * @returns true if the calling thread was pinned by --param thread-affinity
+ *          (applied by set_thread_name())
+ */
+bool thread_has_explicit_affinity(void);
+/**
+ * Parses cpulist format, eg. "0-7,16-23", into a bitmap.
+ * @returns number of CPUs in the list, -1 if invalid
+ */
+int ug_parse_cpulist(const char *list, uint64_t mask[UG_CPULIST_MAX / 64]);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,176 @@
+/**
+ * @file   utils/thread_stats.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "utils/metrics.h"
+#include "utils/thread_stats.h"
+
+using std::string;
+
+#ifdef __linux__
+namespace {
+struct thread_metrics {
+        struct metric *cpu;        ///< time on CPU (schedstat)
+        struct metric *wait;       ///< time waiting on a run queue (schedstat)
+        struct metric *voluntary;  ///< context switches
+        struct metric *involuntary;
+
+        void unregister() {
+                metric_unregister(cpu);
+                metric_unregister(wait);
+                metric_unregister(voluntary);
+                metric_unregister(involuntary);
+        }
+};
+} // namespace
+
+static std::mutex thread_stats_lock;
+static std::map<long, thread_metrics> threads; ///< by TID
+
+/// "src/rtp/video_decoders.cpp" -> "rtp/video_decoders"
+static string module_from_src(const char *src_file)
+{
+        string mod = src_file;
+        const size_t src = mod.rfind("src/");
+        if (src != string::npos) {
+                mod.erase(0, src + 4);
+        }
+        const size_t ext = mod.rfind('.');
+        if (ext != string::npos && mod.find('/', ext) == string::npos) {
+                mod.erase(ext);
+        }
+        return mod;
+}
+
+/// @retval false if the thread no longer exists
+static bool read_thread_stats(long tid, const thread_metrics &m)
+{
+        char path[64];
+        snprintf(path, sizeof path, "/proc/self/task/%ld/schedstat", tid);
+        FILE *f = fopen(path, "r");
+        if (f == nullptr) {
+                return false;
+        }
+        unsigned long long run_ns = 0;
+        unsigned long long wait_ns = 0;
+        const bool ok = fscanf(f, "%llu %llu", &run_ns, &wait_ns) == 2;
+        fclose(f);
+        if (!ok) {
+                return false;
+        }
+        metric_set_total(m.cpu, run_ns);
+        metric_set_total(m.wait, wait_ns);
+
+        snprintf(path, sizeof path, "/proc/self/task/%ld/status", tid);
+        f = fopen(path, "r");
+        if (f == nullptr) {
+                return false;
+        }
+        char line[128];
+        while (fgets(line, sizeof line, f) != nullptr) {
+                unsigned long long val = 0;
+                if (sscanf(line, "voluntary_ctxt_switches: %llu", &val) == 1) {
+                        metric_set_total(m.voluntary, val);
+                } else if (sscanf(line, "nonvoluntary_ctxt_switches: %llu", &val) == 1) {
+                        metric_set_total(m.involuntary, val);
+                }
+        }
+        fclose(f);
+        return true;
+}
+
+static void collect_thread_stats(void * /* udata */)
+{
+        std::lock_guard<std::mutex> lk(thread_stats_lock);
+        for (auto it = threads.begin(); it != threads.end(); ) {
+                if (read_thread_stats(it->first, it->second)) {
+                        ++it;
+                } else {
+                        it->second.unregister();
+                        it = threads.erase(it);
+                }
+        }
+}
+
+void thread_stats_register(const char *name, const char *src_file)
+{
+        const long tid = syscall(SYS_gettid);
+        char labels[256];
+        snprintf(labels, sizeof labels, "thread=\"%s\",module=\"%s\",tid=\"%ld\"", name,
+                 module_from_src(src_file).c_str(), tid);
+        const thread_metrics m = {
+                metric_register(METRIC_COUNTER, "ug_thread_cpu_nanoseconds",
+                                "Time spent on CPU by the thread.", labels),
+                metric_register(METRIC_COUNTER, "ug_thread_runqueue_wait_nanoseconds",
+                                "Time the thread waited on a run queue to be scheduled.",
+                                labels),
+                metric_register(METRIC_COUNTER, "ug_thread_voluntary_context_switches",
+                                "Voluntary context switches (blocking) of the thread.", labels),
+                metric_register(METRIC_COUNTER, "ug_thread_involuntary_context_switches",
+                                "Involuntary context switches (preemption) of the thread.",
+                                labels),
+        };
+        static std::once_flag collector_registered;
+        std::call_once(collector_registered,
+                       [] { metrics_add_collector(collect_thread_stats, nullptr); });
+        std::lock_guard<std::mutex> lk(thread_stats_lock);
+        auto it = threads.find(tid);
+        if (it != threads.end()) {
+                it->second.unregister();
+        }
+        threads[tid] = m;
+}
+#else
+void thread_stats_register(const char * /* name */, const char * /* src_file */)
+{
+}
+#endif
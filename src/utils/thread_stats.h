@@ -0,0 +1,64 @@
+/**
+ * @file   utils/thread_stats.h
+ *
+ * Per-thread CPU time, run-queue latency and context switches of the named
+ * long-lived threads (see set_thread_name()) exported as metrics labelled
+ * with the thread name and the owning module. The values are read from
+ * /proc/self/task on Linux when the metrics are scraped, so there is no
+ * overhead for the threads themselves. Not available on other platforms.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_THREAD_STATS_H_2B7E9D41_5C3A_4F18_8D6E_A1F04C7B93E5
+#define UTILS_THREAD_STATS_H_2B7E9D41_5C3A_4F18_8D6E_A1F04C7B93E5
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Registers the calling thread, replaces previous registration of the
+ * thread (renaming). Threads that exited are removed on the next scrape.
+ *
+ * @param name     thread name (not truncated like the OS thread name)
+ * @param src_file source file of the owning module (__FILE__), the module
+ *                 name is derived from it (eg. "rtp/video_decoders")
+ */
+void thread_stats_register(const char *name, const char *src_file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_THREAD_STATS_H_2B7E9D41_5C3A_4F18_8D6E_A1F04C7B93E5
@@ -42,7 +42,9 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "utils/vf_split.h"
 #include "video.h"
@@ -109,8 +111,66 @@ void vf_split(struct video_frame *out, struct video_frame *src,
         }
 }
 
+void vf_split_view(struct video_frame *out, const struct video_frame *src,
+              unsigned int x_count, unsigned int y_count)
+{
+        assert(x_count * y_count > 0);
+        assert(src->tiles[0].width % x_count == 0u && src->tiles[0].height % y_count == 0u);
+        assert(src->tiles[0].pitch == 0);
+
+        const unsigned int width = src->tiles[0].width / x_count;
+        const unsigned int height = src->tiles[0].height / y_count;
+        const size_t src_linesize = vc_get_linesize(src->tiles[0].width, src->color_spec);
+        const size_t linesize = vc_get_linesize(width, src->color_spec);
+
+        out->color_spec = src->color_spec;
+        out->fps = src->fps;
+        for (unsigned int y = 0; y < y_count; ++y) {
+                for (unsigned int x = 0; x < x_count; ++x) {
+                        struct tile *t = &out->tiles[y * x_count + x];
+                        t->width = width;
+                        t->height = height;
+                        t->data = src->tiles[0].data + y * height * src_linesize + x * linesize;
+                        t->data_len = linesize * height;
+                        t->pitch = x_count > 1 ? src_linesize : 0;
+                }
+        }
+}
+
+bool vf_has_strided_tiles(const struct video_frame *frame)
+{
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                if (frame->tiles[i].pitch != 0) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+struct video_frame *vf_make_contiguous(struct video_frame *frame)
+{
+        if (!vf_has_strided_tiles(frame)) {
+                return frame;
+        }
+        struct video_frame *ret = vf_get_copy(frame);
+        vf_copy_metadata(ret, frame);
+        ret->callbacks.dispose = vf_free;
+        VIDEO_FRAME_DISPOSE(frame);
+        return ret;
+}
+
 using namespace std;
 
+shared_ptr<video_frame> vf_get_contiguous(shared_ptr<video_frame> frame)
+{
+        if (!frame || !vf_has_strided_tiles(frame.get())) {
+                return frame;
+        }
+        shared_ptr<video_frame> ret(vf_get_copy(frame.get()), vf_free);
+        vf_copy_metadata(ret.get(), frame.get());
+        return ret;
+}
+
 vector<shared_ptr<video_frame>> vf_separate_tiles(shared_ptr<video_frame> frame)
 {
         vector<shared_ptr<video_frame>> ret(frame->tile_count);
@@ -126,6 +186,8 @@ vector<shared_ptr<video_frame>> vf_separate_tiles(shared_ptr<video_frame> frame)
 
                 ret[i]->tiles[0].data_len = frame->tiles[i].data_len;
                 ret[i]->tiles[0].data = frame->tiles[i].data;
+                ret[i]->tiles[0].pitch = frame->tiles[i].pitch;
+                ret[i]->mem_location = frame->mem_location;
                 vf_copy_metadata(ret[i].get(), frame.get());
         }
 
@@ -159,3 +221,30 @@ shared_ptr<video_frame> vf_merge_tiles(std::vector<shared_ptr<video_frame>> cons
         return ret;
 }
 
+shared_ptr<video_frame> vf_fragment_assembler::add(const struct video_frame *fragment)
+{
+        assert(fragment->tile_count == 1);
+        if ((int) fragment->frame_fragment_id != frame_id) {
+                data.clear();
+                frame_id = fragment->frame_fragment_id;
+        }
+        const struct tile *t = &fragment->tiles[0];
+        if (data.size() < t->offset + t->data_len) {
+                data.resize(t->offset + t->data_len);
+        }
+        memcpy(data.data() + t->offset, t->data, t->data_len);
+        if (!fragment->last_fragment) {
+                return {};
+        }
+
+        struct video_desc desc = video_desc_from_frame(fragment);
+        shared_ptr<video_frame> ret(vf_alloc_desc(desc), vf_free);
+        ret->tiles[0].data = (char *) malloc(data.size());
+        memcpy(ret->tiles[0].data, data.data(), data.size());
+        ret->tiles[0].data_len = data.size();
+        ret->callbacks.data_deleter = vf_data_deleter;
+        vf_copy_metadata(ret.get(), fragment);
+        data.clear();
+        frame_id = -1;
+        return ret;
+}
@@ -38,6 +38,10 @@
 #ifndef VF_SPLIT_H_
 #define VF_SPLIT_H_
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
 struct video_frame;
 
 #ifdef __cplusplus
@@ -64,6 +68,25 @@ extern "C" {
 void vf_split(struct video_frame *out, struct video_frame *src,
               unsigned int x_count, unsigned int y_count, int preallocate);
 
+/**
+ * Same as vf_split() but without copying - tiles of out reference data of src
+ * (which must thus outlive out). If x_count > 1, the tiles are strided
+ * (tile::pitch is set to the src line size), otherwise contiguous.
+ *
+ * out must have x_count * y_count tiles.
+ */
+void vf_split_view(struct video_frame *out, const struct video_frame *src,
+              unsigned int x_count, unsigned int y_count);
+
+/// @returns true if any tile of frame is strided (see vf_split_view())
+bool vf_has_strided_tiles(const struct video_frame *frame);
+
+/**
+ * Returns frame with contiguous tiles - either the frame itself or its copy
+ * (with metadata), in which case the original is disposed.
+ */
+struct video_frame *vf_make_contiguous(struct video_frame *frame);
+
 #ifdef __cplusplus
 }
 #endif
@@ -74,6 +97,18 @@ void vf_split(struct video_frame *out, struct video_frame *src,
 
 std::vector<std::shared_ptr<video_frame>> vf_separate_tiles(std::shared_ptr<video_frame> frame);
 std::shared_ptr<video_frame> vf_merge_tiles(std::vector<std::shared_ptr<video_frame>> const & tiles);
+/// @returns frame itself if it has no strided tiles, contiguous copy otherwise
+std::shared_ptr<video_frame> vf_get_contiguous(std::shared_ptr<video_frame> frame);
+
+/// reassembles single-tile frame from its fragments (video_frame::fragment)
+class vf_fragment_assembler {
+public:
+        /// @returns whole frame when fragment is the last one, otherwise nullptr
+        std::shared_ptr<video_frame> add(const struct video_frame *fragment);
+private:
+        std::vector<char> data;
+        int frame_id = -1;
+};
 
 #endif // __cplusplus
 
@@ -35,16 +35,46 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
 #include "config_msvc.h"
 
 #include <cassert>
-#include <functional>
+#include <cstdlib>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
 #include <utility>
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_CUDA
+#include "cuda_wrapper.h"
+#endif
+#include "utils/mem_stats.h"
+#include "utils/numa.h"
 #include "video_frame_pool.h"
 
+#define MOD_NAME "[video_frame_pool] "
+
+ADD_TO_PARAM("frame-pool-hugepages", "* frame-pool-hugepages\n"
+                "  Back video frame pool buffers with 2 MB huge pages (Linux only).\n");
+ADD_TO_PARAM("frame-pool-pinned", "* frame-pool-pinned\n"
+                "  Allocate video frame pool buffers in pinned (page-locked) memory\n"
+                "  so that GPU modules can transfer them without staging.\n");
+
+struct video_frame_pool::free_frame {
+        struct video_frame *frame;
+        int generation;
+        struct free_frame *next;
+        size_t bytes; ///< allocated data of all tiles
+};
+
 void *default_data_allocator::allocate(size_t size) {
         return malloc(size);
 }
@@ -55,14 +85,149 @@ struct video_frame_pool_allocator *default_data_allocator::clone() const {
         return new default_data_allocator(*this);
 }
 
-video_frame_pool::video_frame_pool(unsigned int max_used_frames, video_frame_pool_allocator const &alloc) : m_allocator(alloc.clone()), m_generation(0), m_desc(), m_max_data_len(0), m_unreturned_frames(0), m_max_used_frames(max_used_frames) {
+void *aligned_data_allocator::allocate(size_t size) {
+        return aligned_malloc(size, m_alignment);
+}
+void aligned_data_allocator::deallocate(void *ptr) {
+        aligned_free(ptr);
+}
+struct video_frame_pool_allocator *aligned_data_allocator::clone() const {
+        return new aligned_data_allocator(*this);
+}
+
+#ifdef __linux__
+namespace {
+constexpr size_t HUGEPAGE_SIZE = 2 * 1024 * 1024;
+constexpr size_t PAGE_SIZE_4K = 4096;
+/// holds the mapping length, keeps the data cache-line aligned
+constexpr size_t MMAP_HDR_SIZE = 64;
+
+/// mmaps the buffer (bound to the NUMA node if configured)
+void *mmap_alloc(size_t size, bool huge_pages) {
+        const size_t page = huge_pages ? HUGEPAGE_SIZE : PAGE_SIZE_4K;
+        const size_t len = (size + MMAP_HDR_SIZE + page - 1) / page * page;
+        void *ptr = MAP_FAILED;
+        if (huge_pages) {
+                ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+        if (ptr == MAP_FAILED) { // no reserved huge pages, try THP
+                ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (ptr == MAP_FAILED) {
+                        return nullptr;
+                }
+#ifdef MADV_HUGEPAGE
+                if (huge_pages) {
+                        madvise(ptr, len, MADV_HUGEPAGE);
+                }
+#endif
+        }
+        // before first touch so that the pages are placed accordingly
+        ug_numa_bind_memory(ptr, len);
+        *static_cast<size_t *>(ptr) = len;
+        return static_cast<char *>(ptr) + MMAP_HDR_SIZE;
+}
+
+void mmap_free(void *ptr) {
+        if (ptr == nullptr) {
+                return;
+        }
+        char *base = static_cast<char *>(ptr) - MMAP_HDR_SIZE;
+        munmap(base, *reinterpret_cast<size_t *>(base));
+}
+
+/// used instead of default_data_allocator if NUMA node is configured
+struct numa_data_allocator : public video_frame_pool_allocator {
+        void *allocate(size_t size) override {
+                return mmap_alloc(size, false);
+        }
+        void deallocate(void *ptr) override {
+                mmap_free(ptr);
+        }
+        struct video_frame_pool_allocator *clone() const override {
+                return new numa_data_allocator(*this);
+        }
+};
+}
+
+void *hugepage_data_allocator::allocate(size_t size) {
+        return mmap_alloc(size, true);
+}
+void hugepage_data_allocator::deallocate(void *ptr) {
+        mmap_free(ptr);
+}
+#else
+void *hugepage_data_allocator::allocate(size_t size) {
+        return malloc(size);
+}
+void hugepage_data_allocator::deallocate(void *ptr) {
+        free(ptr);
+}
+#endif
+struct video_frame_pool_allocator *hugepage_data_allocator::clone() const {
+        return new hugepage_data_allocator(*this);
+}
+
+#ifdef HAVE_CUDA
+void *pinned_data_allocator::allocate(size_t size) {
+        void *ptr = nullptr;
+        if (cuda_wrapper_pinned_pool_alloc(&ptr, size) != CUDA_WRAPPER_SUCCESS) {
+                MSG(ERROR, "Cannot allocate pinned buffer: %s\n",
+                    cuda_wrapper_last_error_string());
+                return nullptr;
+        }
+        return ptr;
+}
+void pinned_data_allocator::deallocate(void *ptr) {
+        cuda_wrapper_pinned_pool_release(ptr);
+}
+#else
+void *pinned_data_allocator::allocate(size_t size) {
+        return malloc(size);
+}
+void pinned_data_allocator::deallocate(void *ptr) {
+        free(ptr);
+}
+#endif
+struct video_frame_pool_allocator *pinned_data_allocator::clone() const {
+        return new pinned_data_allocator(*this);
+}
+
+static video_frame_pool_allocator *clone_allocator(video_frame_pool_allocator const &alloc) {
+        if (dynamic_cast<default_data_allocator const *>(&alloc) == nullptr) {
+                return alloc.clone();
+        }
+        if (get_commandline_param("frame-pool-pinned") != nullptr) {
+                return new pinned_data_allocator();
+        }
+        if (get_commandline_param("frame-pool-hugepages") != nullptr) {
+                return new hugepage_data_allocator();
+        }
+#ifdef __linux__
+        if (ug_numa_get_node() >= 0) {
+                return new numa_data_allocator();
+        }
+#endif
+        return alloc.clone();
+}
+
+video_frame_pool::video_frame_pool(unsigned int max_used_frames, video_frame_pool_allocator const &alloc) : m_allocator(clone_allocator(alloc)), m_returned_frames(nullptr), m_free_frames(nullptr), m_waiters(0), m_releasing(0), m_generation(0), m_desc(), m_max_data_len(0), m_unreturned_frames(0), m_max_used_frames(max_used_frames), m_gauge(mem_gauge_register("video_frame_pool")) {
 }
 
 video_frame_pool::~video_frame_pool() {
         std::unique_lock<std::mutex> lk(m_lock);
-        remove_free_frames();
         // wait also for all frames we gave out to return us
+        m_waiters += 1;
         m_frame_returned.wait(lk, [this] {return m_unreturned_frames == 0;});
+        m_waiters -= 1;
+        lk.unlock();
+        // the last releaser may still be notifying
+        while (m_releasing > 0) {
+                std::this_thread::yield();
+        }
+        remove_free_frames();
+        mem_gauge_unregister(m_gauge);
 }
 
 void video_frame_pool::reconfigure(struct video_desc new_desc, size_t new_size) {
@@ -73,19 +238,56 @@ void video_frame_pool::reconfigure(struct video_desc new_desc, size_t new_size)
         m_generation++;
 }
 
+/// @note m_lock must be held; frames from previous generations are freed
+struct video_frame_pool::free_frame *video_frame_pool::pop_free_frame() {
+        while (true) {
+                if (m_free_frames == nullptr) {
+                        m_free_frames = m_returned_frames.exchange(nullptr);
+                        if (m_free_frames == nullptr) {
+                                return nullptr;
+                        }
+                }
+                struct free_frame *entry = m_free_frames;
+                m_free_frames = entry->next;
+                if (entry->generation == m_generation) {
+                        return entry;
+                }
+                deallocate_entry(entry);
+        }
+}
+
+/// called from the thread dropping the last reference, doesn't lock unless
+/// someone waits for the frame
+void video_frame_pool::return_frame(struct free_frame *entry) {
+        m_releasing += 1;
+        if (entry->generation != m_generation) {
+                deallocate_entry(entry);
+        } else {
+                entry->next = m_returned_frames.load(std::memory_order_relaxed);
+                while (!m_returned_frames.compare_exchange_weak(entry->next, entry)) {
+                }
+        }
+        assert(m_unreturned_frames > 0);
+        m_unreturned_frames -= 1;
+        if (m_waiters > 0) {
+                std::lock_guard<std::mutex> lk(m_lock);
+                m_frame_returned.notify_all();
+        }
+        m_releasing -= 1;
+}
+
 std::shared_ptr<video_frame> video_frame_pool::get_frame() {
         assert(m_generation != 0);
-        struct video_frame *ret = NULL;
         std::unique_lock<std::mutex> lk(m_lock);
-        if (!m_free_frames.empty()) {
-                ret = m_free_frames.front();
-                m_free_frames.pop();
-        } else if (m_max_used_frames > 0 && m_max_used_frames == m_unreturned_frames) {
-                m_frame_returned.wait(lk, [this] {return m_unreturned_frames < m_max_used_frames;});
-                assert(!m_free_frames.empty());
-                ret = m_free_frames.front();
-                m_free_frames.pop();
-        } else {
+        struct free_frame *entry = pop_free_frame();
+        while (entry == nullptr && m_max_used_frames > 0 && m_unreturned_frames >= m_max_used_frames) {
+                m_waiters += 1;
+                m_frame_returned.wait(lk, [this] {return m_returned_frames.load() != nullptr || m_unreturned_frames < m_max_used_frames;});
+                m_waiters -= 1;
+                entry = pop_free_frame();
+        }
+        if (entry == nullptr) {
+                struct video_frame *ret = NULL;
                 try {
                         ret = vf_alloc_desc(m_desc);
                         for (unsigned int i = 0; i < m_desc.tile_count; ++i) {
@@ -101,21 +303,12 @@ std::shared_ptr<video_frame> video_frame_pool::get_frame() {
                         deallocate_frame(ret);
                         throw e;
                 }
+                const size_t bytes = m_max_data_len * m_desc.tile_count;
+                entry = new free_frame{ret, m_generation, nullptr, bytes};
+                mem_gauge_add(m_gauge, bytes, 1);
         }
         m_unreturned_frames += 1;
-        return std::shared_ptr<video_frame>(ret, std::bind([this](struct video_frame *frame, int generation) {
-                                std::unique_lock<std::mutex> lk(m_lock);
-
-                                assert(m_unreturned_frames > 0);
-                                m_unreturned_frames -= 1;
-                                m_frame_returned.notify_one();
-
-                                if (this->m_generation != generation) {
-                                this->deallocate_frame(frame);
-                                } else {
-                                m_free_frames.push(frame);
-                                }
-                                }, std::placeholders::_1, m_generation));
+        return std::shared_ptr<video_frame>(entry->frame, [this, entry](struct video_frame *) { return_frame(entry); });
 }
 
 struct video_frame *video_frame_pool::get_disposable_frame() {
@@ -146,11 +339,20 @@ video_frame_pool_allocator const & video_frame_pool::get_allocator() {
 }
 
 void video_frame_pool::remove_free_frames() {
-        while (!m_free_frames.empty()) {
-                struct video_frame *frame = m_free_frames.front();
-                m_free_frames.pop();
-                deallocate_frame(frame);
+        for (struct free_frame *list : { m_free_frames, m_returned_frames.exchange(nullptr) }) {
+                while (list != nullptr) {
+                        struct free_frame *next = list->next;
+                        deallocate_entry(list);
+                        list = next;
+                }
         }
+        m_free_frames = nullptr;
+}
+
+void video_frame_pool::deallocate_entry(struct free_frame *entry) {
+        mem_gauge_add(m_gauge, -(long long) entry->bytes, -1);
+        deallocate_frame(entry->frame);
+        delete entry;
 }
 
 void video_frame_pool::deallocate_frame(struct video_frame *frame) {
@@ -162,19 +364,77 @@ void video_frame_pool::deallocate_frame(struct video_frame *frame) {
         vf_free(frame);
 }
 
-void *video_frame_pool_init(struct video_desc desc, int len) {
-        auto *out = new video_frame_pool(len, default_data_allocator());
-        out->reconfigure(desc);
+/*
+ * C API
+ *
+ * The handle holds just a reference to the pool and each frame given out
+ * holds another one, so video_frame_pool_destroy() doesn't need to wait
+ * until the frames are returned (they may still be queued downstream, eg.
+ * when a capture filter is removed at runtime). The pool itself is freed
+ * with the last returned frame.
+ */
+namespace {
+struct video_frame_pool_c_handle {
+        std::shared_ptr<video_frame_pool> pool;
+        struct video_desc desc;
+        size_t max_data_len; ///< as requested (0 - deduce)
+        size_t pool_data_len;
+};
+struct video_frame_pool_c_frame {
+        std::shared_ptr<video_frame_pool> pool; ///< must outlive frame
+        std::shared_ptr<video_frame> frame;
+};
+} // end of anonymous namespace
+
+static void *video_frame_pool_init_common(struct video_desc desc, int len,
+                                          video_frame_pool_allocator const &alloc) {
+        auto *out = new video_frame_pool_c_handle{
+                std::make_shared<video_frame_pool>(len, alloc),
+                {}, 0, 0};
+        if (desc.color_spec != VIDEO_CODEC_NONE) {
+                video_frame_pool_reconfigure(out, desc, 0);
+        }
         return (void *) out;
 }
 
+void *video_frame_pool_init(struct video_desc desc, int len) {
+        return video_frame_pool_init_common(desc, len, default_data_allocator());
+}
+
+void *video_frame_pool_init_aligned(struct video_desc desc, int len, size_t alignment) {
+        return video_frame_pool_init_common(desc, len, aligned_data_allocator(alignment));
+}
+
+void video_frame_pool_reconfigure(void *state, struct video_desc desc,
+                                  size_t max_data_len) {
+        auto *s = static_cast<video_frame_pool_c_handle *>(state);
+        if (video_desc_eq(s->desc, desc) && s->max_data_len == max_data_len) {
+                return;
+        }
+        s->pool->reconfigure(desc, max_data_len == 0 ? SIZE_MAX : max_data_len);
+        s->desc = desc;
+        s->max_data_len = max_data_len;
+        s->pool_data_len = max_data_len != 0
+                               ? max_data_len
+                               : desc.height * vc_get_linesize(desc.width,
+                                                               desc.color_spec);
+}
+
 struct video_frame *video_frame_pool_get_disposable_frame(void *state) {
-        auto *s = static_cast<video_frame_pool* >(state);
-        return s->get_disposable_frame();
+        auto *s = static_cast<video_frame_pool_c_handle *>(state);
+        auto *udata = new video_frame_pool_c_frame{ s->pool, s->pool->get_frame() };
+        struct video_frame *out = udata->frame.get();
+        for (unsigned int i = 0; i < out->tile_count; ++i) {
+                out->tiles[i].data_len = s->pool_data_len;
+        }
+        out->callbacks.dispose_udata = udata;
+        out->callbacks.dispose = [](video_frame *f) {
+                delete static_cast<video_frame_pool_c_frame *>(
+                    f->callbacks.dispose_udata);
+        };
+        return out;
 }
 
 void video_frame_pool_destroy(void *state) {
-        auto *s = static_cast<video_frame_pool* >(state);
-        delete s;
+        delete static_cast<video_frame_pool_c_handle *>(state);
 }
-
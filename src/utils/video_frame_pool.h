@@ -45,11 +45,11 @@
 
 #ifdef __cplusplus
 
+#include <atomic>
 #include <condition_variable>
 #include <cstdint>
 #include <mutex>
 #include <memory>
-#include <queue>
 
 struct video_frame_pool_allocator {
         virtual void *allocate(size_t size) = 0;
@@ -64,6 +64,47 @@ struct default_data_allocator : public video_frame_pool_allocator {
         struct video_frame_pool_allocator *clone() const override;
 };
 
+/**
+ * Backs the buffers with 2 MB huge pages (MAP_HUGETLB, if reserved by the
+ * system, transparent huge pages otherwise) to reduce TLB misses when
+ * processing large frames. Falls back to malloc() on non-Linux platforms.
+ *
+ * Used instead of default_data_allocator if "--param frame-pool-hugepages"
+ * is given.
+ */
+struct hugepage_data_allocator : public video_frame_pool_allocator {
+        void *allocate(size_t size) override;
+        void deallocate(void *ptr) override;
+        struct video_frame_pool_allocator *clone() const override;
+};
+
+/**
+ * Page-locked (pinned) host memory allocated by CUDA, so that the frames can
+ * be DMA-transferred to any GPU consumer without staging. Falls back to
+ * malloc() if compiled without CUDA.
+ *
+ * Used instead of default_data_allocator if "--param frame-pool-pinned" is
+ * given (takes precedence over frame-pool-hugepages).
+ */
+struct pinned_data_allocator : public video_frame_pool_allocator {
+        void *allocate(size_t size) override;
+        void deallocate(void *ptr) override;
+        struct video_frame_pool_allocator *clone() const override;
+};
+
+/**
+ * Buffers aligned to the given boundary, eg. for O_DIRECT reads. Not replaced
+ * by the allocators selected by "--param frame-pool-*".
+ */
+struct aligned_data_allocator : public video_frame_pool_allocator {
+        explicit aligned_data_allocator(size_t alignment) : m_alignment(alignment) {}
+        void *allocate(size_t size) override;
+        void deallocate(void *ptr) override;
+        struct video_frame_pool_allocator *clone() const override;
+private:
+        size_t m_alignment;
+};
+
 struct video_frame_pool {
         public:
                 /**
@@ -97,23 +138,58 @@ struct video_frame_pool {
                 video_frame_pool_allocator const & get_allocator();
 
         private:
+                struct free_frame;
+                struct free_frame *pop_free_frame();
+                void return_frame(struct free_frame *entry);
                 void remove_free_frames();
+                void deallocate_entry(struct free_frame *entry);
                 void deallocate_frame(struct video_frame *frame);
 
                 std::unique_ptr<video_frame_pool_allocator> m_allocator;
-                std::queue<struct video_frame *> m_free_frames;
+                /// returned frames - lock-free stack pushed by the thread
+                /// releasing a frame, taken as a whole by get_frame()
+                std::atomic<struct free_frame *> m_returned_frames;
+                struct free_frame *m_free_frames; ///< guarded by m_lock
                 std::mutex        m_lock;
                 std::condition_variable m_frame_returned;
-                int               m_generation;
+                std::atomic<int>  m_waiters;
+                std::atomic<int>  m_releasing; ///< threads in return_frame()
+                std::atomic<int>  m_generation;
                 struct video_desc m_desc;
                 size_t            m_max_data_len;
-                unsigned int      m_unreturned_frames;
+                std::atomic<unsigned int> m_unreturned_frames;
                 unsigned int      m_max_used_frames;
+                struct mem_gauge *m_gauge; ///< allocated frames
 };
 #endif //  __cplusplus
 
+/**
+ * @param desc initial format, may be zeroed (no frames until
+ *             video_frame_pool_reconfigure() is called)
+ * @param len  maximal number of frames, 0 for unlimited
+ */
 EXTERN_C void *video_frame_pool_init(struct video_desc desc, int len);
+/**
+ * Same as video_frame_pool_init() but the tile data are aligned to
+ * @ref alignment bytes (power of 2).
+ */
+EXTERN_C void *video_frame_pool_init_aligned(struct video_desc desc, int len, size_t alignment);
+/**
+ * Cheap if neither desc nor max_data_len changed since the last call, so it
+ * can be called for every frame.
+ *
+ * @param max_data_len tile data size, 0 to deduce from desc (pixel formats only)
+ */
+EXTERN_C void video_frame_pool_reconfigure(void *pool, struct video_desc desc, size_t max_data_len);
+/**
+ * @returns frame with tiles[].data_len set to the maximal length, that is
+ *          returned to the pool by VIDEO_FRAME_DISPOSE()
+ */
 EXTERN_C struct video_frame *video_frame_pool_get_disposable_frame(void *);
+/**
+ * Releases the pool handle. Does not block - frames still in use are
+ * deallocated when disposed.
+ */
 EXTERN_C void video_frame_pool_destroy(void *);
 
 #endif // VIDEO_FRAME_POOL_H_
@@ -39,31 +39,33 @@
 #define UTILS_WAIT_OBJ_H_
 
 #ifdef __cplusplus
-#include <condition_variable>
-#include <mutex>
+#include <atomic>
+
+#include "utils/event.h"
 
 struct wait_obj {
         public:
-                wait_obj() : m_val(false) {
+                wait_obj() : m_val(false), m_event(true) {
                 }
                 void wait() {
-                        std::unique_lock<std::mutex> lk(m_lock);
-                        m_cv.wait(lk, [this] { return m_val; });
+                        while (true) {
+                                const uint32_t seq = m_event.get();
+                                if (m_val.load(std::memory_order_acquire)) {
+                                        return;
+                                }
+                                m_event.wait(seq);
+                        }
                 }
                 void reset() {
-                        std::lock_guard<std::mutex> lk(m_lock);
-                        m_val = false;
+                        m_val.store(false, std::memory_order_relaxed);
                 }
                 void notify() {
-                        std::unique_lock<std::mutex> lk(m_lock);
-                        m_val = true;
-                        lk.unlock();
-                        m_cv.notify_one();
+                        m_val.store(true, std::memory_order_release);
+                        m_event.notify_all();
                 }
         private:
-                std::mutex m_lock;
-                std::condition_variable m_cv;
-                bool m_val;
+                std::atomic<bool> m_val;
+                ug_event m_event;
 };
 #endif // __cplusplus
 
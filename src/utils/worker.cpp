@@ -3,7 +3,7 @@
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2013-2024 CESNET, z. s. p. o.
+ * Copyright (c) 2013-2026 CESNET, z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -35,219 +35,282 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+/*
+ * Tasks are run by a work-stealing scheduler shared by all callers - one
+ * worker thread per CPU core, each with own deque. A task spawned from
+ * a worker is pushed to its deque (popped LIFO by the owner, stolen FIFO by
+ * the others), tasks from other threads are queued in a shared injection
+ * queue. A thread waiting for a task that has not been started yet runs it
+ * itself, so nested waits cannot deadlock and the waiter doesn't pay the
+ * wake-up latency if all workers are busy.
+ */
+
 #include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <pthread.h>
-#include <queue>
-#include <set>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "utils/macros.h" // for MAX_CPU_CORES
 #include "utils/misc.h"   // get_cpu_core_count
+#include "utils/numa.h"
 #include "utils/thread.h"
 #include "utils/worker.h"
 
+enum {
+        WS_SPIN_COUNT = 64,     ///< queue checks before a worker goes to sleep
+        PFOR_CHUNKS_PER_THREAD = 2, ///< guided chunking - remaining / (participants * this)
+};
+
+using std::atomic;
+using std::condition_variable;
+using std::deque;
+using std::lock_guard;
+using std::max;
 using std::min;
-using std::queue;
-using std::set;
+using std::mutex;
+using std::unique_lock;
 using std::vector;
 
-struct wp_worker;
+namespace {
 
-struct worker_state_observer {
-        virtual ~worker_state_observer() {}
-        virtual void notify(wp_worker *) = 0;
-};
+struct ws_task {
+        enum { QUEUED, RUNNING, DONE };
+        ws_task(runnable_t task, void *data, bool detached)
+            : m_task(task), m_data(data), m_refs(detached ? 1 : 2) {}
 
-/**
- * @brief Holds data to be passed to worker.
- */
-struct wp_task_data {
-        wp_task_data(runnable_t task, void *data, wp_worker *w, bool detached) : m_task(task), m_data(data),
-                m_result(0), m_returned(false), m_w(w), m_detached(detached) {}
         runnable_t m_task;
         void *m_data;
-        void *m_result;
-        bool m_returned;
-        struct wp_worker *m_w;
-        bool m_detached;
-};
-
-/**
- * @brief This class represents a worker that is called from within the pool
- */
-struct wp_worker {
-        wp_worker(worker_state_observer &observer) :
-                m_state_observer(observer)
-        {
-                int ret;
-                ret = pthread_mutex_init(&m_lock, NULL);
-                assert(ret == 0);
-                ret = pthread_cond_init(&m_task_ready_cv, NULL);
-                assert(ret == 0);
-                ret = pthread_cond_init(&m_task_completed_cv, NULL);
-                assert(ret == 0);
-
-                ret = pthread_create(&m_thread_id, NULL, wp_worker::enter_loop, this);
-                assert(ret == 0);
+        void *m_result = nullptr;
+        atomic<int> m_state{QUEUED};
+        atomic<int> m_refs; ///< queue + handle (if not detached)
+
+        mutex m_lock;
+        condition_variable m_done_cv;
+
+        /// runs the task unless it has been already claimed by another thread
+        bool try_run() {
+                int expected = QUEUED;
+                if (!m_state.compare_exchange_strong(expected, RUNNING)) {
+                        return false;
+                }
+                void *res = m_task(m_data);
+                lock_guard<mutex> lk(m_lock);
+                m_result = res;
+                m_state = DONE;
+                m_done_cv.notify_all();
+                return true;
         }
-        ~wp_worker() {
-                wp_task_data *poisoned = new wp_task_data(NULL, NULL, this, false);
-                this->push(poisoned);
-
-                pthread_join(m_thread_id, NULL);
-                pthread_mutex_destroy(&m_lock);
-                pthread_cond_destroy(&m_task_ready_cv);
-                pthread_cond_destroy(&m_task_completed_cv);
+        void release() {
+                if (--m_refs == 0) {
+                        delete this;
+                }
         }
-        static void      *enter_loop(void *args);
-        void              run();
-
-        void              push(wp_task_data *);
-        void             *pop(wp_task_data *);
+};
 
-        queue<wp_task_data*> m_data;
-        pthread_mutex_t   m_lock;
-        pthread_cond_t    m_task_ready_cv;
-        pthread_cond_t    m_task_completed_cv;
-        pthread_t         m_thread_id;
+/// deque of one worker (or the injection queue)
+struct ws_queue {
+        mutex lock;
+        deque<ws_task *> tasks;
+};
 
-        worker_state_observer &m_state_observer;
+class ws_scheduler {
+public:
+        ws_scheduler();
+        ~ws_scheduler();
+        void submit(ws_task *t);
+        /// @returns worker count (the threads executing tasks, excl. waiters)
+        int worker_count() const { return (int) m_workers.size(); }
+
+private:
+        void run(int idx);
+        ws_task *find_task(int idx);
+        static ws_task *pop_back(ws_queue &q);
+        static ws_task *pop_front(ws_queue &q);
+
+        vector<std::thread> m_workers;
+        std::unique_ptr<ws_queue[]> m_local; ///< per-worker deques
+        ws_queue m_injected;                 ///< tasks from non-worker threads
+        atomic<long> m_pending{0};           ///< queued tasks in all deques
+        atomic<int> m_sleepers{0};
+        mutex m_sleep_lock;
+        condition_variable m_wake_cv;
+        bool m_should_exit = false;          ///< protected by m_sleep_lock
+
+        static thread_local ws_scheduler *current; ///< set for the workers
+        static thread_local int current_idx;
 };
 
-void *wp_worker::enter_loop(void *args) {
-        set_thread_name("worker");
-        wp_worker *instance = (wp_worker *) args;
-        instance->run();
+thread_local ws_scheduler *ws_scheduler::current = nullptr;
+thread_local int ws_scheduler::current_idx = -1;
 
-        return NULL;
+ws_scheduler::ws_scheduler()
+{
+        const int count = max(min(get_cpu_core_count(), (int) MAX_CPU_CORES), 1);
+        m_local = std::make_unique<ws_queue[]>(count);
+        for (int i = 0; i < count; ++i) {
+                m_workers.emplace_back(&ws_scheduler::run, this, i);
+        }
 }
 
-void wp_worker::run() {
-        while(1) {
-                struct wp_task_data *data;
-                pthread_mutex_lock(&m_lock);
-                while(m_data.empty()) {
-                        pthread_cond_wait(&m_task_ready_cv, &m_lock);
-                }
-                data = m_data.front();
-                m_data.pop();
-                pthread_mutex_unlock(&m_lock);
-
-                // poisoned pill
-                if(data->m_task == NULL) {
-                        delete data;
-                        return;
-                }
-
-                void *res = data->m_task(data->m_data);
-
-                pthread_mutex_lock(&m_lock);
-                data->m_result = res;
-                data->m_returned = true;
-                pthread_cond_signal(&m_task_completed_cv);
-                m_state_observer.notify(this);
-                if (data->m_detached) {
-                        delete data;
-                }
-                pthread_mutex_unlock(&m_lock);
+ws_scheduler::~ws_scheduler()
+{
+        {
+                lock_guard<mutex> lk(m_sleep_lock);
+                m_should_exit = true;
+        }
+        m_wake_cv.notify_all();
+        for (auto &t : m_workers) {
+                t.join();
         }
 }
 
-void wp_worker::push(wp_task_data *data) {
-        pthread_mutex_lock(&m_lock);
-        assert(m_data.size() == 0);
-        m_data.push(data);
-        pthread_mutex_unlock(&m_lock);
-        pthread_cond_signal(&m_task_ready_cv);
+void ws_scheduler::submit(ws_task *t)
+{
+        ws_queue &q = current == this ? m_local[current_idx] : m_injected;
+        {
+                lock_guard<mutex> lk(q.lock);
+                q.tasks.push_back(t);
+        }
+        m_pending += 1;
+        if (m_sleepers > 0) {
+                lock_guard<mutex> lk(m_sleep_lock);
+                m_wake_cv.notify_one();
+        }
 }
 
-void *wp_worker::pop(wp_task_data *d) {
-        void *res = NULL;
-
-        pthread_mutex_lock(&m_lock);
-        while(!d->m_returned) {
-                pthread_cond_wait(&m_task_completed_cv, &m_lock);
+ws_task *ws_scheduler::pop_back(ws_queue &q)
+{
+        lock_guard<mutex> lk(q.lock);
+        if (q.tasks.empty()) {
+                return nullptr;
         }
-        res = d->m_result;
-        delete d;
-        pthread_mutex_unlock(&m_lock);
+        ws_task *t = q.tasks.back();
+        q.tasks.pop_back();
+        return t;
+}
 
-        return res;
+ws_task *ws_scheduler::pop_front(ws_queue &q)
+{
+        lock_guard<mutex> lk(q.lock);
+        if (q.tasks.empty()) {
+                return nullptr;
+        }
+        ws_task *t = q.tasks.front();
+        q.tasks.pop_front();
+        return t;
 }
 
-static void func_delete(wp_worker *arg) {
-        delete arg;
+ws_task *ws_scheduler::find_task(int idx)
+{
+        if (m_pending == 0) {
+                return nullptr;
+        }
+        ws_task *t = pop_back(m_local[idx]);
+        if (t == nullptr) {
+                t = pop_front(m_injected);
+        }
+        const int count = worker_count();
+        for (int i = 1; i < count && t == nullptr; ++i) {
+                t = pop_front(m_local[(idx + i) % count]);
+        }
+        if (t != nullptr) {
+                m_pending -= 1;
+        }
+        return t;
 }
 
-class worker_pool : public worker_state_observer
+void ws_scheduler::run(int idx)
 {
-        public:
-                worker_pool() {
-                        pthread_mutex_init(&m_lock, NULL);
-                        pthread_cond_init(&m_worker_finished, NULL);
+        set_thread_name("worker");
+        ug_numa_bind_thread();
+        current = this;
+        current_idx = idx;
+        int idle = 0;
+        while (true) {
+                if (ws_task *t = find_task(idx)) {
+                        t->try_run();
+                        t->release();
+                        idle = 0;
+                        continue;
                 }
-
-                ~worker_pool() {
-                        pthread_mutex_lock(&m_lock);
-                        while (m_occupied_workers.size() > 0) {
-                                pthread_cond_wait(&m_worker_finished, &m_lock);
-                        }
-                        pthread_mutex_unlock(&m_lock);
-
-                        for_each(m_empty_workers.begin(),
-                                        m_empty_workers.end(), func_delete);
-                        pthread_cond_destroy(&m_worker_finished);
-                        pthread_mutex_destroy(&m_lock);
+                if (++idle < WS_SPIN_COUNT) {
+                        std::this_thread::yield();
+                        continue;
                 }
-
-                void notify(wp_worker *w) {
-                        pthread_mutex_lock(&m_lock);
-                        m_occupied_workers.erase(w);
-                        m_empty_workers.insert(w);
-                        pthread_mutex_unlock(&m_lock);
-                        pthread_cond_signal(&m_worker_finished);
+                unique_lock<mutex> lk(m_sleep_lock);
+                m_sleepers += 1;
+                m_wake_cv.wait(lk, [this] { return m_pending > 0 || m_should_exit; });
+                m_sleepers -= 1;
+                if (m_should_exit && m_pending == 0) {
+                        return;
                 }
+        }
+}
 
-                task_result_handle_t run_async(runnable_t task, void *data, bool detached);
-                void *wait_task(task_result_handle_t handle);
+ws_scheduler &scheduler()
+{
+        static ws_scheduler instance;
+        return instance;
+}
 
-        private:
-                set<wp_worker*>    m_empty_workers;
-                set<wp_worker*>    m_occupied_workers;
-                pthread_mutex_t m_lock;
-                pthread_cond_t     m_worker_finished;
+/// state of a task_parallel_for(), shared with the helper tasks that may
+/// outlive the call (those that didn't get any chunk)
+struct pfor_state {
+        pfor_state(parallel_for_callback_t c, void *ud, size_t cnt, size_t gr, int part)
+            : callback(c), udata(ud), count(cnt), grain(gr), participants(part),
+              refs(part) {}
+        parallel_for_callback_t callback;
+        void *udata;
+        size_t count;
+        size_t grain;
+        int participants;
+        atomic<size_t> next{0};
+        atomic<size_t> done{0};
+        atomic<int> refs;
+        mutex lock;
+        condition_variable done_cv;
+
+        /// @returns false if there is no chunk left
+        bool run_chunk() {
+                size_t start = next.load();
+                size_t len = 0;
+                do {
+                        if (start >= count) {
+                                return false;
+                        }
+                        const size_t remaining = count - start;
+                        len = min(max(grain, remaining / (participants * PFOR_CHUNKS_PER_THREAD)),
+                                  remaining);
+                } while (!next.compare_exchange_weak(start, start + len));
+                callback(start, start + len, udata);
+                if (done.fetch_add(len) + len == count) {
+                        lock_guard<mutex> lk(lock);
+                        done_cv.notify_all();
+                }
+                return true;
+        }
+        void release() {
+                if (--refs == 0) {
+                        delete this;
+                }
+        }
 };
 
-task_result_handle_t worker_pool::run_async(runnable_t task, void *data, bool detached)
+void *pfor_helper(void *arg)
 {
-        wp_worker *w;
-        pthread_mutex_lock(&m_lock);
-        if(m_empty_workers.empty()) {
-                m_empty_workers.insert(new wp_worker(*this));
+        auto *s = static_cast<pfor_state *>(arg);
+        while (s->run_chunk()) {
         }
-        set<wp_worker*>::iterator it = m_empty_workers.begin();
-        assert(it != m_empty_workers.end());
-        w = *it;
-        /// @todo: really weird - it seems like that 'it' instead of 'w' caused some problems
-        m_empty_workers.erase(w);
-        m_occupied_workers.insert(w);
-
-        wp_task_data *d = new wp_task_data(task, data, w, detached);
-        w->push(d);
-        pthread_mutex_unlock(&m_lock);
-
-        return d;
-}
-
-void *worker_pool::wait_task(task_result_handle_t handle)
-{
-        wp_task_data *d = (wp_task_data *) handle;
-        wp_worker *w = d->m_w;
-        return w->pop(d);
+        s->release();
+        return nullptr;
 }
 
-static class worker_pool instance;
+} // namespace
 
 /**
  * @brief Runs task asynchronously.
@@ -261,7 +324,9 @@ static class worker_pool instance;
  */
 task_result_handle_t task_run_async(runnable_t task, void *data)
 {
-        return instance.run_async(task, data, false);
+        auto *t = new ws_task(task, data, false);
+        scheduler().submit(t);
+        return t;
 }
 
 /**
@@ -274,12 +339,110 @@ task_result_handle_t task_run_async(runnable_t task, void *data)
  */
 void task_run_async_detached(runnable_t task, void *data)
 {
-        instance.run_async(task, data, true);
+        scheduler().submit(new ws_task(task, data, true));
 }
 
+/**
+ * Waits for the task started by task_run_async(), runs it in the calling
+ * thread if no worker has picked it up yet.
+ * @returns the value returned by the task
+ */
 void *wait_task(task_result_handle_t handle)
 {
-        return instance.wait_task(handle);
+        auto *t = static_cast<ws_task *>(handle);
+        if (!t->try_run()) {
+                unique_lock<mutex> lk(t->m_lock);
+                t->m_done_cv.wait(lk, [t] { return t->m_state == ws_task::DONE; });
+        }
+        void *res = t->m_result;
+        t->release();
+        return res;
+}
+
+/**
+ * Processes items [0, count) in chunks by the calling thread and up to
+ * max_threads - 1 workers. The chunks are guided - proportional to the
+ * remaining count, but at least grain items.
+ *
+ * @param max_threads maximal number of threads processing the items, 0 - all
+ *                    workers
+ */
+void task_parallel_for(size_t count, size_t grain, int max_threads,
+                       parallel_for_callback_t callback, void *udata)
+{
+        if (count == 0) {
+                return;
+        }
+        grain = max<size_t>(grain, 1);
+        const int workers = scheduler().worker_count();
+        int participants = max_threads <= 0 ? workers + 1 : max_threads;
+        participants = (int) min<size_t>(participants, (count + grain - 1) / grain);
+        if (participants <= 1) {
+                callback(0, count, udata);
+                return;
+        }
+        auto *s = new pfor_state(callback, udata, count, grain, participants);
+        for (int i = 1; i < participants; ++i) {
+                task_run_async_detached(pfor_helper, s);
+        }
+        while (s->run_chunk()) {
+        }
+        if (s->done != count) { // chunks being processed by the helpers
+                unique_lock<mutex> lk(s->lock);
+                s->done_cv.wait(lk, [s, count] { return s->done == count; });
+        }
+        s->release();
+}
+
+struct task_group {
+        vector<ws_task *> tasks;
+};
+
+struct task_group *task_group_create(void)
+{
+        return new task_group();
+}
+
+/// runs the task asynchronously as a part of the group
+void task_group_run(struct task_group *g, runnable_t task, void *data)
+{
+        g->tasks.push_back(static_cast<ws_task *>(task_run_async(task, data)));
+}
+
+/// waits for all tasks of the group (running those not yet started)
+void task_group_wait(struct task_group *g)
+{
+        for (ws_task *t : g->tasks) {
+                wait_task(t);
+        }
+        g->tasks.clear();
+}
+
+/// waits for the group and destroys it
+void task_group_destroy(struct task_group *g)
+{
+        if (g == nullptr) {
+                return;
+        }
+        task_group_wait(g);
+        delete g;
+}
+
+struct run_parallel_data {
+        runnable_t task;
+        char *data;
+        size_t data_size;
+        void **res;
+};
+static void run_parallel_items(size_t start, size_t end, void *udata)
+{
+        auto *d = static_cast<run_parallel_data *>(udata);
+        for (size_t i = start; i < end; ++i) {
+                void *ret = d->task(d->data + i * d->data_size);
+                if (d->res != nullptr) {
+                        d->res[i] = ret;
+                }
+        }
 }
 
 /**
@@ -294,34 +457,27 @@ void *wait_task(task_result_handle_t handle)
 void task_run_parallel(runnable_t task, int worker_count, void *data, size_t data_size, void **res)
 {
         if (worker_count == 1) {
-                task(data);
-                return;
-        }
-
-        vector<task_result_handle_t> tasks(worker_count);
-        for (int i = 0; i < worker_count; ++i) {
-                tasks[i] = task_run_async(task, (void *)((char *) data + i * data_size));
-        }
-        for (int i = 0; i < worker_count; ++i) {
+                void *ret = task(data);
                 if (res != nullptr) {
-                        res[i] = wait_task(tasks[i]);
-                } else {
-                        wait_task(tasks[i]);
+                        res[0] = ret;
                 }
+                return;
         }
+        run_parallel_data d{task, static_cast<char *>(data), data_size, res};
+        task_parallel_for(worker_count, 1, worker_count, run_parallel_items, &d);
 }
 
 struct respawn_parallel_data {
         respawn_parallel_callback_t c;
-        void *in;
-        void *out;
-        size_t data_len;
+        char *in;
+        char *out;
+        size_t size;
         void *udata;
 };
-static void *respawn_parallel_task(void *arg) {
-        auto data = (struct respawn_parallel_data *) arg;
-        data->c(data->in, data->out, data->data_len, data->udata);
-        return NULL;
+static void respawn_parallel_chunk(size_t start, size_t end, void *udata) {
+        auto *d = static_cast<respawn_parallel_data *>(udata);
+        d->c(d->in + start * d->size, d->out + start * d->size, (end - start) * d->size,
+             d->udata);
 }
 /**
  * Automatically respawns threads to convert in to out
@@ -332,19 +488,8 @@ static void *respawn_parallel_task(void *arg) {
 void respawn_parallel(void *in, void *out, size_t nmemb, size_t size, respawn_parallel_callback_t c, void *udata)
 {
         const int threads = min<int>(get_cpu_core_count(), MAX_CPU_CORES);
-        struct respawn_parallel_data data[MAX_CPU_CORES];
-
-        for (int i = 0; i < threads; ++i) {
-                data[i].c = c;
-                data[i].in = (char *) in + i * (nmemb / threads) * size;
-                data[i].out = (char *) out + i * (nmemb / threads) * size;
-                data[i].data_len = (nmemb / threads) * size;
-                data[i].udata = udata;
-                if (i == threads - 1) {
-                        data[i].data_len = size * (nmemb - (threads - 1) * (nmemb / threads));
-                }
-        }
-
-        task_run_parallel(respawn_parallel_task, threads, data, sizeof data[0], NULL);
+        respawn_parallel_data d{c, static_cast<char *>(in), static_cast<char *>(out), size, udata};
+        // at least 1/4 of the per-thread share not to split small inputs too much
+        task_parallel_for(nmemb, max<size_t>(nmemb / (4 * (size_t) threads), 1), threads,
+                          respawn_parallel_chunk, &d);
 }
-
@@ -3,7 +3,7 @@
  * @author Martin Pulec     <martin.pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2013-2023 CESNET, z. s. p. o.
+ * Copyright (c) 2013-2026 CESNET, z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -61,6 +61,17 @@ void task_run_parallel(runnable_t task, int worker_count, void *data, size_t dat
 typedef void (*respawn_parallel_callback_t)(void *in, void *out, size_t data_len, void *udata);
 void respawn_parallel(void *in, void *out, size_t nmemb, size_t size, respawn_parallel_callback_t c, void *udata);
 
+/// processes items [start, end)
+typedef void (*parallel_for_callback_t)(size_t start, size_t end, void *udata);
+void task_parallel_for(size_t count, size_t grain, int max_threads,
+                       parallel_for_callback_t callback, void *udata);
+
+struct task_group;
+struct task_group *task_group_create(void);
+void task_group_run(struct task_group *g, runnable_t task, void *data);
+void task_group_wait(struct task_group *g);
+void task_group_destroy(struct task_group *g);
+
 #ifdef __cplusplus
 }
 #endif
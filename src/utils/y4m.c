@@ -39,6 +39,11 @@
 
 #include "y4m.h"
 
+#ifdef _WIN32
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
 static bool y4m_process_chroma_type(char *c, struct y4m_metadata *info) {
         info->bitdepth = 8;
         if (strcmp(c, "444alpha") == 0) {
@@ -74,17 +79,12 @@ static size_t y4m_get_data_len(const struct y4m_metadata *info) {
         return ret * (info->bitdepth > 8 ? 2 : 1);
 }
 
-size_t y4m_read(const char *filename, struct y4m_metadata *info, unsigned char **data, void *(*allocator)(size_t)) {
-        FILE *file = fopen(filename, "rb");
-        if (!file) {
-                fprintf(stderr, "Failed to open %s: %s\n", filename, strerror(errno));
-                return 0;
-        }
+/// parses the stream header and the first frame header, file is left at the frame data
+static bool y4m_read_header(FILE *file, const char *filename, struct y4m_metadata *info) {
         char item[129];
         if (fscanf(file, "%128s", item) != 1 || strcmp(item, "YUV4MPEG2") != 0) {
                fprintf(stderr, "File '%s' doesn't seem to be valid Y4M.\n", filename);
-               fclose(file);
-               return 0;
+               return false;
         }
         memset(info, 0, sizeof *info);
         info->width = info->height = info->bitdepth = info->subsampling = 0;
@@ -94,8 +94,7 @@ size_t y4m_read(const char *filename, struct y4m_metadata *info, unsigned char *
                         case 'H': info->height = atoi(item + 1); break;
                         case 'C':
                                   if (!y4m_process_chroma_type(item + 1, info)) {
-                                          fclose(file);
-                                          return 0;
+                                          return false;
                                   }
                                   break;
                         case 'X':
@@ -105,7 +104,16 @@ size_t y4m_read(const char *filename, struct y4m_metadata *info, unsigned char *
                         // F, I, A currently ignored
                 }
         }
-        if (getc(file) != '\n') { // after FRAME
+        return getc(file) == '\n'; // after FRAME
+}
+
+size_t y4m_read(const char *filename, struct y4m_metadata *info, unsigned char **data, void *(*allocator)(size_t)) {
+        FILE *file = fopen(filename, "rb");
+        if (!file) {
+                fprintf(stderr, "Failed to open %s: %s\n", filename, strerror(errno));
+                return 0;
+        }
+        if (!y4m_read_header(file, filename, info)) {
                 fclose(file);
                 return 0;
         }
@@ -132,6 +140,53 @@ size_t y4m_read(const char *filename, struct y4m_metadata *info, unsigned char *
         return datalen;
 }
 
+size_t y4m_read_index(const char *filename, struct y4m_metadata *info, size_t **offsets) {
+        FILE *file = fopen(filename, "rb");
+        if (!file) {
+                fprintf(stderr, "Failed to open %s: %s\n", filename, strerror(errno));
+                return 0;
+        }
+        size_t datalen = 0;
+        if (!y4m_read_header(file, filename, info) || (datalen = y4m_get_data_len(info)) == 0) {
+                fclose(file);
+                return 0;
+        }
+        long long offset = ftello(file);
+        fseeko(file, 0, SEEK_END);
+        const long long file_len = ftello(file);
+
+        size_t count = 0;
+        size_t allocated = 0;
+        *offsets = NULL;
+        while (offset >= 0 && offset + (long long) datalen <= file_len) {
+                if (count == allocated) {
+                        allocated = allocated == 0 ? 64 : allocated * 2;
+                        size_t *tmp = (size_t *) realloc(*offsets, allocated * sizeof **offsets);
+                        if (tmp == NULL) {
+                                break;
+                        }
+                        *offsets = tmp;
+                }
+                (*offsets)[count++] = (size_t) offset;
+                // next frame header - "FRAME" optionally followed by parameters
+                char item[6] = "";
+                if (fseeko(file, offset + (long long) datalen, SEEK_SET) != 0 ||
+                                fread(item, 1, 5, file) != 5 || strcmp(item, "FRAME") != 0) {
+                        break;
+                }
+                int ch = 0;
+                while ((ch = getc(file)) != '\n' && ch != EOF)
+                        ;
+                offset = ch == '\n' ? ftello(file) : -1;
+        }
+        fclose(file);
+        if (count == 0) {
+                free(*offsets);
+                *offsets = NULL;
+        }
+        return count;
+}
+
 bool y4m_write(const char *filename, const struct y4m_metadata *info, const unsigned char *data) {
         errno = 0;
         FILE *file = fopen(filename, "wb");
@@ -67,6 +67,12 @@ struct y4m_metadata {
  * @returns number of raw image data
  */
 size_t y4m_read(const char *filename, struct y4m_metadata *info, unsigned char **data, void *(*allocator)(size_t));
+/**
+ * Indexes frames of a Y4M sequence without reading the data (eg. to map the file).
+ * @param[out] offsets file offsets of the frame data, to be freed with free()
+ * @returns number of complete frames, 0 on error
+ */
+size_t y4m_read_index(const char *filename, struct y4m_metadata *info, size_t **offsets);
 bool y4m_write(const char *filename, const struct y4m_metadata *info, const unsigned char *data);
 
 #ifdef __cplusplus
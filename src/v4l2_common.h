@@ -42,8 +42,10 @@
 
 #include <linux/videodev2.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 #include "types.h"
 
@@ -110,10 +112,33 @@ static struct {
 };
 
 struct v4l2_buffer_data {
-        void *start;
-        size_t length;
+        unsigned num_planes; ///< 1 unless multi-planar API is used
+        struct {
+                void *start;
+                size_t length;
+                int dmabuf_fd; ///< exported by VIDIOC_EXPBUF, -1 if not
+        } planes[VIDEO_MAX_PLANES];
 };
 
+static void unmap_v4l2_buffers(struct v4l2_buffer_data *buffers, int count) {
+        for (int i = 0; i < count; ++i) {
+                for (unsigned p = 0; p < buffers[i].num_planes; ++p) {
+                        if (buffers[i].planes[p].dmabuf_fd != -1) {
+                                close(buffers[i].planes[p].dmabuf_fd);
+                        }
+                        if (buffers[i].planes[p].start &&
+                                        munmap(buffers[i].planes[p].start, buffers[i].planes[p].length) == -1) {
+                                log_perror(LOG_LEVEL_ERROR, MOD_NAME "munmap");
+                        }
+                }
+                buffers[i].num_planes = 0;
+        }
+}
+
+/**
+ * Requests and maps (all planes of) the buffers and queues them.
+ * Buffer type may be either single or multi-planar.
+ */
 static _Bool set_v4l2_buffers(int fd, struct v4l2_requestbuffers *reqbuf, struct v4l2_buffer_data *buffers) {
         if (ioctl (fd, VIDIOC_REQBUFS, reqbuf) != 0) {
                 if (errno == EINVAL)
@@ -130,30 +155,46 @@ static _Bool set_v4l2_buffers(int fd, struct v4l2_requestbuffers *reqbuf, struct
                 return 0;
         }
 
+        const _Bool mplane = V4L2_TYPE_IS_MULTIPLANAR(reqbuf->type);
         for (unsigned int i = 0; i < reqbuf->count; i++) {
+                struct v4l2_plane planes[VIDEO_MAX_PLANES];
                 struct v4l2_buffer buf;
                 memset(&buf, 0, sizeof(buf));
+                memset(planes, 0, sizeof planes);
                 buf.type = reqbuf->type;
                 buf.memory = V4L2_MEMORY_MMAP;
                 buf.index = i;
+                if (mplane) {
+                        buf.m.planes = planes;
+                        buf.length = VIDEO_MAX_PLANES;
+                }
 
                 if (-1 == ioctl (fd, VIDIOC_QUERYBUF, &buf)) {
                         log_perror(LOG_LEVEL_ERROR, MOD_NAME "VIDIOC_QUERYBUF");
                         return 0;
                 }
 
-                buffers[i].length = buf.length; /* remember for munmap() */
-
-                buffers[i].start = mmap(NULL, buf.length,
-                                PROT_READ | PROT_WRITE, /* recommended */
-                                MAP_SHARED,             /* recommended */
-                                fd, buf.m.offset);
-
-                if (MAP_FAILED == buffers[i].start) {
-                        /* If you do not exit here you should unmap() and free()
-                           the buffers mapped so far. */
-                        log_perror(LOG_LEVEL_ERROR, MOD_NAME "mmap");
-                        return 0;
+                buffers[i].num_planes = mplane ? buf.length : 1;
+                for (unsigned p = 0; p < buffers[i].num_planes; ++p) {
+                        buffers[i].planes[p].start = NULL;
+                        buffers[i].planes[p].dmabuf_fd = -1;
+                }
+                for (unsigned p = 0; p < buffers[i].num_planes; ++p) {
+                        /* remember for munmap() */
+                        buffers[i].planes[p].length = mplane ? planes[p].length : buf.length;
+
+                        buffers[i].planes[p].start = mmap(NULL, buffers[i].planes[p].length,
+                                        PROT_READ | PROT_WRITE, /* recommended */
+                                        MAP_SHARED,             /* recommended */
+                                        fd, mplane ? planes[p].m.mem_offset : buf.m.offset);
+
+                        if (MAP_FAILED == buffers[i].planes[p].start) {
+                                /* the buffers mapped so far are unmapped by
+                                   unmap_v4l2_buffers() */
+                                buffers[i].planes[p].start = NULL;
+                                log_perror(LOG_LEVEL_ERROR, MOD_NAME "mmap");
+                                return 0;
+                        }
                 }
 
                 buf.flags = 0;
@@ -185,7 +226,7 @@ static int try_open_v4l2_device(int log_level, const char *dev_name, int cap) {
         }
 
         if (!(capability.device_caps & cap)) {
-                const char *cap_str = cap == V4L2_CAP_VIDEO_CAPTURE ? "capture" : "playback";
+                const char *cap_str = (cap & V4L2_CAP_VIDEO_OUTPUT) ? "playback" : "capture";
                 log_msg(log_level, MOD_NAME "%s, %s can't %s\n",capability.card,capability.bus_info, cap_str);
                 close(fd);
                 return -1;
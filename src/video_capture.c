@@ -62,6 +62,8 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "module.h"
+#include "tv.h"                    // for get_time_in_ns
+#include "utils/frame_trace.h"
 #include "utils/macros.h"
 #include "video_capture.h"
 #include "video_capture_params.h"
@@ -220,8 +222,16 @@ struct video_frame *vidcap_grab(struct vidcap *state, struct audio_frame **audio
         assert(state->magic == VIDCAP_MAGIC);
         struct video_frame *frame;
         frame = state->funcs->grab(state->state, audio);
-        if (frame != NULL)
-                frame = capture_filter(state->capture_filter, frame);
+        if (frame == NULL) {
+                return NULL;
+        }
+        frame->trace_id = frame_trace_new_id();
+        frame->capture_time = frame_latency_enabled() ? get_time_in_ns() : 0;
+        frame_trace_event(frame->trace_id, FRAME_TRACE_CAPTURE);
+        frame = capture_filter(state->capture_filter, frame);
+        if (frame != NULL) { // may be an earlier frame for an async filter
+                frame_trace_event(frame->trace_id, FRAME_TRACE_FILTER);
+        }
         return frame;
 }
 
@@ -5,7 +5,7 @@
  * @brief Aggregate video capture driver
  */
 /*
- * Copyright (c) 2012-2023 CESNET z.s.p.o.
+ * Copyright (c) 2012-2026 CESNET z.s.p.o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -40,43 +40,189 @@
 #include "config_unix.h"
 #include "config_win32.h"
 
+#include <assert.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
 #include "debug.h"
 #include "host.h"
 #include "lib_common.h"
+#include "tv.h"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/thread.h"
 #include "video.h"
 #include "video_capture.h"
 
-#include "tv.h"
-
 #include "audio/types.h"
 
-#include <stdio.h>
-#include <stdlib.h>
-
-/* prototypes of functions defined in this module */
-static void show_help(void);
+#define MOD_NAME "[aggregate] "
+enum {
+        QUEUE_LEN       = 3,   ///< per-device frames waiting for assembly
+        GRAB_TIMEOUT_MS = 100,
+};
 
 static void show_help()
 {
-        printf("Aggregate capture\n");
-        printf("Usage\n");
-        printf("\t-t aggregate -t <dev1_config> -t <dev2_config> ....]\n");
-        printf("\t\twhere devn_config is a complete configuration string of device involved in an aggregate device\n");
-
+        color_printf("Aggregate capture\n");
+        color_printf("Usage\n");
+        color_printf(TBOLD(TRED("\t-t aggregate") "[:skew=<ms>]") " -t <dev1_config> -t <dev2_config> ....\n");
+        color_printf("\t\twhere devn_config is a complete configuration string of device involved in an aggregate device\n");
+        color_printf(TBOLD("\tskew") " - maximal timestamp difference of assembled tiles (default half of a frame period)\n");
+        color_printf("\nDevices are grabbed concurrently, each by its own thread. If all\n"
+                     "devices timestamp frames, tiles are aligned by the timestamps and\n"
+                     "late frames are dropped.\n");
 }
 
+struct vidcap_aggregate_state;
+
+struct aggregate_device {
+        struct vidcap *dev;
+        pthread_t thread;
+        struct vidcap_aggregate_state *parent;
+        int idx;
+
+        struct video_frame *queue[QUEUE_LEN];
+        int queue_head;
+        int queue_len;
+        /// a frame without dispose callback was handed out - the device
+        /// overwrites it on next grab so it must not be grabbed until released
+        bool borrowed;
+        long long dropped;
+};
+
 struct vidcap_aggregate_state {
-        struct vidcap     **devices;
+        struct aggregate_device *devices;
         int                 devices_cnt;
+        bool                threads_started;
+
+        pthread_mutex_t     lock;
+        pthread_cond_t      frame_ready_cv;  ///< signals boss
+        pthread_cond_t      frame_released_cv; ///< signals workers
+        bool                should_exit;
 
         struct video_frame      **captured_frames;
         struct video_frame       *frame; 
         int frames;
         struct       timeval t, t0;
+        int64_t      skew; ///< in 90 kHz units, -1 for half of frame period
 
         int          audio_source_index;
+        struct audio_frame audio_acc; ///< filled by the audio source thread
+        struct audio_frame audio_out; ///< handed out by grab
 };
 
+/// @note called with s->lock held
+static void
+release_frame(struct aggregate_device *d, struct video_frame *frame)
+{
+        if (frame == NULL) {
+                return;
+        }
+        if (frame->callbacks.dispose != NULL) {
+                VIDEO_FRAME_DISPOSE(frame);
+                return;
+        }
+        d->borrowed = false;
+        pthread_cond_broadcast(&d->parent->frame_released_cv);
+}
+
+/// @note called with s->lock held
+static struct video_frame *
+queue_pop(struct aggregate_device *d)
+{
+        assert(d->queue_len > 0);
+        struct video_frame *ret = d->queue[d->queue_head];
+        d->queue_head = (d->queue_head + 1) % QUEUE_LEN;
+        d->queue_len -= 1;
+        return ret;
+}
+
+/// @note called with s->lock held
+static void
+accumulate_audio(struct vidcap_aggregate_state *s, int idx,
+                 struct audio_frame *audio)
+{
+        if (s->audio_source_index == -1) {
+                MSG(NOTICE, "Locking device #%d as an audio source.\n", idx);
+                s->audio_source_index = idx;
+        }
+        if (s->audio_source_index != idx) {
+                return;
+        }
+        struct audio_frame *acc = &s->audio_acc;
+        if (acc->data_len + audio->data_len > acc->max_size) {
+                if (acc->data_len > 0) {
+                        MSG(DEBUG, "Audio not consumed, dropping %d B.\n",
+                            acc->data_len);
+                        acc->data_len = 0;
+                }
+                if (audio->data_len > acc->max_size) {
+                        free(acc->data);
+                        acc->max_size = 4 * audio->data_len;
+                        acc->data = malloc(acc->max_size);
+                }
+        }
+        if (acc->data_len == 0) {
+                acc->bps = audio->bps;
+                acc->ch_count = audio->ch_count;
+                acc->sample_rate = audio->sample_rate;
+                acc->timestamp = audio->timestamp;
+                acc->flags = audio->flags;
+        }
+        memcpy(acc->data + acc->data_len, audio->data, audio->data_len);
+        acc->data_len += audio->data_len;
+}
+
+static void *
+grab_thread(void *arg)
+{
+        struct aggregate_device *d = arg;
+        struct vidcap_aggregate_state *s = d->parent;
+        char thread_name[16];
+        snprintf(thread_name, sizeof thread_name, "aggregate_cap%d", d->idx);
+        set_thread_name(thread_name);
+
+        pthread_mutex_lock(&s->lock);
+        while (!s->should_exit) {
+                while (!s->should_exit && d->borrowed) {
+                        pthread_cond_wait(&s->frame_released_cv, &s->lock);
+                }
+                if (s->should_exit) {
+                        break;
+                }
+                pthread_mutex_unlock(&s->lock);
+
+                struct audio_frame *audio = NULL;
+                struct video_frame *frame = vidcap_grab(d->dev, &audio);
+
+                pthread_mutex_lock(&s->lock);
+                if (audio != NULL) {
+                        accumulate_audio(s, d->idx, audio);
+                        AUDIO_FRAME_DISPOSE(audio);
+                }
+                if (frame == NULL) {
+                        continue;
+                }
+                if (d->queue_len == QUEUE_LEN) { // keep the newest frames
+                        release_frame(d, queue_pop(d));
+                        d->dropped += 1;
+                }
+                if (frame->callbacks.dispose == NULL) {
+                        d->borrowed = true;
+                }
+                d->queue[(d->queue_head + d->queue_len) % QUEUE_LEN] = frame;
+                d->queue_len += 1;
+                pthread_cond_signal(&s->frame_ready_cv);
+        }
+        pthread_mutex_unlock(&s->lock);
+        return NULL;
+}
 
 static void vidcap_aggregate_probe(struct device_info **cards, int *count, void (**deleter)(void *))
 {
@@ -85,14 +231,37 @@ static void vidcap_aggregate_probe(struct device_info **cards, int *count, void
         *deleter = free;
 }
 
+static bool
+parse_fmt(struct vidcap_aggregate_state *s, const char *fmt)
+{
+        char *tmp = strdup(fmt);
+        char *save_ptr = NULL;
+        char *item = NULL;
+        char *cfg = tmp;
+        bool ret = true;
+        while ((item = strtok_r(cfg, ":", &save_ptr)) != NULL) {
+                cfg = NULL;
+                if (IS_KEY_PREFIX(item, "skew")) {
+                        s->skew = atof(strchr(item, '=') + 1) * 90;
+                } else {
+                        if (strcmp(item, "help") != 0) {
+                                MSG(ERROR, "Unknown option: %s\n", item);
+                        }
+                        ret = false;
+                        break;
+                }
+        }
+        free(tmp);
+        return ret;
+}
+
+static void vidcap_aggregate_done(void *state);
+
 static int
 vidcap_aggregate_init(struct vidcap_params *params, void **state)
 {
 	struct vidcap_aggregate_state *s;
 
-	printf("vidcap_aggregate_init\n");
-
-
         s = (struct vidcap_aggregate_state *) calloc(1, sizeof(struct vidcap_aggregate_state));
 	if(s == NULL) {
 		printf("Unable to allocate aggregate capture state\n");
@@ -101,15 +270,23 @@ vidcap_aggregate_init(struct vidcap_params *params, void **state)
 
         s->audio_source_index = -1;
         s->frames = 0;
+        s->skew = -1;
         gettimeofday(&s->t0, NULL);
-
-        if(vidcap_params_get_fmt(params) && strcmp(vidcap_params_get_fmt(params), "") != 0) {
-                show_help();
-                free(s);
-                return VIDCAP_INIT_NOERR;
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_cond_init(&s->frame_ready_cv, NULL);
+        pthread_cond_init(&s->frame_released_cv, NULL);
+
+        if (vidcap_params_get_fmt(params) &&
+            !parse_fmt(s, vidcap_params_get_fmt(params))) {
+                const bool help =
+                    strcmp(vidcap_params_get_fmt(params), "help") == 0;
+                if (help) {
+                        show_help();
+                }
+                vidcap_aggregate_done(s);
+                return help ? VIDCAP_INIT_NOERR : VIDCAP_INIT_FAIL;
         }
 
-
         s->devices_cnt = 0;
         struct vidcap_params *tmp = params;
         while((tmp = vidcap_params_get_next(tmp))) {
@@ -119,7 +296,8 @@ vidcap_aggregate_init(struct vidcap_params *params, void **state)
                         break;
         }
 
-        s->devices = calloc(s->devices_cnt, sizeof(struct vidcap *));
+        s->devices = calloc(s->devices_cnt, sizeof s->devices[0]);
+        s->captured_frames = calloc(s->devices_cnt, sizeof(struct video_frame *));
         tmp = params;
         for (int i = 0; i < s->devices_cnt; ++i) {
                 tmp = vidcap_params_get_next(tmp);
@@ -128,33 +306,28 @@ vidcap_aggregate_init(struct vidcap_params *params, void **state)
                         vidcap_params_set_flags(tmp, vidcap_params_get_flags(params));
                 }
 
-                int ret = initialize_video_capture(vidcap_params_get_parent(params), (struct vidcap_params *) tmp, &s->devices[i]);
+                s->devices[i].parent = s;
+                s->devices[i].idx = i;
+                int ret = initialize_video_capture(vidcap_params_get_parent(params), (struct vidcap_params *) tmp, &s->devices[i].dev);
                 if(ret != 0) {
-                        fprintf(stderr, "[aggregate] Unable to initialize device %d (%s:%s).\n",
+                        MSG(ERROR, "Unable to initialize device %d (%s:%s).\n",
                                         i, vidcap_params_get_driver(tmp),
                                         vidcap_params_get_fmt(tmp));
-                        goto error;
+                        vidcap_aggregate_done(s);
+                        return VIDCAP_INIT_FAIL;
                 }
         }
 
-        s->captured_frames = calloc(s->devices_cnt, sizeof(struct video_frame *));
-
         s->frame = vf_alloc(s->devices_cnt);
-        
-        *state = s;
-	return VIDCAP_INIT_OK;
 
-error:
-        if(s->devices) {
-                int i;
-                for (i = 0u; i < s->devices_cnt; ++i) {
-                        if(s->devices[i]) {
-                                 vidcap_done(s->devices[i]);
-                        }
-                }
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                pthread_create(&s->devices[i].thread, NULL, grab_thread,
+                               &s->devices[i]);
         }
-        free(s);
-        return VIDCAP_INIT_FAIL;
+        s->threads_started = true;
+
+        *state = s;
+	return VIDCAP_INIT_OK;
 }
 
 static void
@@ -164,68 +337,161 @@ vidcap_aggregate_done(void *state)
 
 	assert(s != NULL);
 
-	if (s != NULL) {
-                int i;
-		for (i = 0; i < s->devices_cnt; ++i) {
-                         vidcap_done(s->devices[i]);
-		}
-	}
-        
+        if (s->threads_started) {
+                pthread_mutex_lock(&s->lock);
+                s->should_exit = true;
+                pthread_cond_broadcast(&s->frame_released_cv);
+                pthread_mutex_unlock(&s->lock);
+                for (int i = 0; i < s->devices_cnt; ++i) {
+                        pthread_join(s->devices[i].thread, NULL);
+                }
+        }
+
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct aggregate_device *d = &s->devices[i];
+                if (d->dev == NULL) {
+                        continue;
+                }
+                release_frame(d, s->captured_frames[i]);
+                while (d->queue_len > 0) {
+                        release_frame(d, queue_pop(d));
+                }
+                if (d->dropped > 0) {
+                        MSG(INFO, "Device #%d: %lld frames dropped.\n", i,
+                            d->dropped);
+                }
+                vidcap_done(d->dev);
+        }
+
+        pthread_cond_destroy(&s->frame_released_cv);
+        pthread_cond_destroy(&s->frame_ready_cv);
+        pthread_mutex_destroy(&s->lock);
+        free(s->audio_acc.data);
+        free(s->audio_out.data);
+        free(s->captured_frames);
+        free(s->devices);
         vf_free(s->frame);
         free(s);
 }
 
+/**
+ * Waits until every device has a frame and drops those that are older than
+ * the newest head by more than the skew tolerance (if all are timestamped).
+ * @note called with s->lock held
+ * @retval false on timeout
+ */
+static bool
+wait_aligned_frames(struct vidcap_aggregate_state *s)
+{
+        struct timespec deadline;
+        timespec_get(&deadline, TIME_UTC);
+        ts_add_nsec(&deadline, GRAB_TIMEOUT_MS * NS_IN_MS);
+
+        while (true) {
+                bool all_ready = true;
+                bool all_timestamped = true;
+                int64_t newest = INT64_MIN;
+                for (int i = 0; i < s->devices_cnt; ++i) {
+                        struct aggregate_device *d = &s->devices[i];
+                        if (d->queue_len == 0) {
+                                all_ready = false;
+                                break;
+                        }
+                        struct video_frame *head = d->queue[d->queue_head];
+                        if ((head->flags & TIMESTAMP_VALID) == 0) {
+                                all_timestamped = false;
+                        }
+                        newest = MAX(newest, head->timestamp);
+                }
+                if (!all_ready) {
+                        if (pthread_cond_timedwait(&s->frame_ready_cv,
+                                                   &s->lock, &deadline) != 0) {
+                                return false;
+                        }
+                        continue;
+                }
+                if (!all_timestamped || s->devices_cnt == 1) {
+                        return true;
+                }
+
+                struct video_frame *first = s->devices[0].queue[s->devices[0].queue_head];
+                const int64_t skew = s->skew >= 0 ? s->skew
+                                     : (int64_t) (90000 / first->fps / 2);
+                bool dropped = false;
+                for (int i = 0; i < s->devices_cnt; ++i) {
+                        struct aggregate_device *d = &s->devices[i];
+                        struct video_frame *head = d->queue[d->queue_head];
+                        if (newest - head->timestamp > skew) {
+                                MSG(DEBUG, "Dropping frame of device #%d "
+                                           "(%" PRId64 " ticks late).\n",
+                                    i, newest - head->timestamp);
+                                release_frame(d, queue_pop(d));
+                                d->dropped += 1;
+                                dropped = true;
+                        }
+                }
+                if (!dropped) {
+                        return true;
+                }
+        }
+}
+
 static struct video_frame *
 vidcap_aggregate_grab(void *state, struct audio_frame **audio)
 {
 	struct vidcap_aggregate_state *s = (struct vidcap_aggregate_state *) state;
-        struct audio_frame *audio_frame = NULL;
-        struct video_frame *frame = NULL;
 
+        *audio = NULL;
+
+        pthread_mutex_lock(&s->lock);
         for (int i = 0; i < s->devices_cnt; ++i) {
-                VIDEO_FRAME_DISPOSE(s->captured_frames[i]);
+                release_frame(&s->devices[i], s->captured_frames[i]);
+                s->captured_frames[i] = NULL;
         }
 
-        *audio = NULL;
+        if (!wait_aligned_frames(s)) {
+                pthread_mutex_unlock(&s->lock);
+                return NULL;
+        }
 
+        bool format_mismatch = false;
         for (int i = 0; i < s->devices_cnt; ++i) {
-                frame = NULL;
-                while(!frame) {
-                        frame = vidcap_grab(s->devices[i], &audio_frame);
-                }
+                struct video_frame *frame = queue_pop(&s->devices[i]);
+                s->captured_frames[i] = frame;
                 if (i == 0) {
                         s->frame->color_spec = frame->color_spec;
                         s->frame->interlacing = frame->interlacing;
                         s->frame->fps = frame->fps;
-                }
-                if (s->audio_source_index == -1 && audio_frame != NULL) {
-                        fprintf(stderr, "[aggregate] Locking device #%d as an audio source.\n",
-                                        i);
-                        s->audio_source_index = i;
-                }
-                if (s->audio_source_index == i) {
-                        *audio = audio_frame;
+                        s->frame->timestamp = frame->timestamp;
+                        s->frame->flags = frame->flags & TIMESTAMP_VALID;
                 }
                 if (frame->color_spec != s->frame->color_spec ||
                                 frame->fps != s->frame->fps ||
                                 frame->interlacing != s->frame->interlacing) {
-                        fprintf(stderr, "[aggregate] Different format detected: ");
-                        if(frame->color_spec != s->frame->color_spec)
-                                fprintf(stderr, "codec");
-                        if(frame->interlacing != s->frame->interlacing)
-                                fprintf(stderr, "interlacing");
-                        if(frame->fps != s->frame->fps)
-                                fprintf(stderr, "FPS (%.2f and %.2f)", frame->fps, s->frame->fps);
-                        fprintf(stderr, "\n");
-                        
-                        return NULL;
+                        MSG(ERROR, "Different format detected: %s%s%s\n",
+                            frame->color_spec != s->frame->color_spec ? "codec " : "",
+                            frame->interlacing != s->frame->interlacing ? "interlacing " : "",
+                            frame->fps != s->frame->fps ? "FPS" : "");
+                        format_mismatch = true;
                 }
                 vf_get_tile(s->frame, i)->width = vf_get_tile(frame, 0)->width;
                 vf_get_tile(s->frame, i)->height = vf_get_tile(frame, 0)->height;
                 vf_get_tile(s->frame, i)->data_len = vf_get_tile(frame, 0)->data_len;
                 vf_get_tile(s->frame, i)->data = vf_get_tile(frame, 0)->data;
-                s->captured_frames[i] = frame;
         }
+        if (!format_mismatch && s->audio_acc.data_len > 0) {
+                struct audio_frame tmp = s->audio_out;
+                s->audio_out = s->audio_acc;
+                s->audio_acc = tmp;
+                s->audio_acc.data_len = 0;
+                *audio = &s->audio_out;
+        }
+
+        pthread_mutex_unlock(&s->lock);
+        if (format_mismatch) {
+                return NULL;
+        }
+
         s->frames++;
         gettimeofday(&s->t, NULL);
         double seconds = tv_diff(s->t, s->t0);    
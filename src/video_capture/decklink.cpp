@@ -47,6 +47,7 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cctype>                  // for isdigit
 #include <chrono>
@@ -83,6 +84,7 @@
 #include "utils/color_out.h"
 #include "utils/macros.h"
 #include "utils/math.h"
+#include "utils/video_frame_pool.h"
 #include "utils/windows.h"
 #include "video.h"
 #include "video_capture.h"
@@ -142,11 +144,13 @@ using std::mutex;
 #define CALL_AND_CHECK(cmd, ...) CALL_AND_CHECK_CHOOSER(__VA_ARGS__)(cmd, __VA_ARGS__)
 
 class VideoDelegate;
+class FramePoolAllocator;
 
 struct device_state {
         IDeckLink                  *deckLink              = nullptr;
         IDeckLinkInput             *deckLinkInput         = nullptr;
         unique_ptr<VideoDelegate>  delegate;
+        FramePoolAllocator         *allocator             = nullptr;
         IDeckLinkProfileAttributes *deckLinkAttributes    = nullptr;
         IDeckLinkConfiguration     *deckLinkConfiguration = nullptr;
         string                      device_id = "0"; // either numeric value or device name
@@ -205,6 +209,66 @@ static void cleanup_common(struct vidcap_decklink_state *s);
 static list<tuple<int, string, string, string>> get_input_modes (IDeckLink* deckLink);
 static void print_input_modes (IDeckLink* deckLink);
 
+/**
+ * Capture buffers of the card are allocated from a video_frame_pool, so they
+ * get the pool's memory (pinned, huge-page or NUMA-local according to the
+ * frame-pool-* params) and are recycled - the SDI DMA then goes directly to
+ * that memory and the captured frames are lent to the pipeline as they are.
+ */
+class FramePoolAllocator : public IDeckLinkMemoryAllocator {
+public:
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID *) override { return E_NOINTERFACE; }
+        ULONG STDMETHODCALLTYPE AddRef(void) override {
+                return ++mRefCount;
+        }
+        ULONG STDMETHODCALLTYPE Release(void) override {
+                ULONG newRefValue = --mRefCount;
+                if (newRefValue == 0) {
+                        delete this;
+                }
+                return newRefValue;
+        }
+
+        HRESULT STDMETHODCALLTYPE AllocateBuffer(uint32_t bufferSize, void **allocatedBuffer) override {
+                unique_lock<mutex> lk(mLock);
+                if (bufferSize != mBufferSize) {
+                        mPool.reconfigure(video_desc{bufferSize, 1, VIDEO_CODEC_NONE, 0, PROGRESSIVE, 1}, bufferSize);
+                        mBufferSize = bufferSize;
+                }
+                shared_ptr<video_frame> frame;
+                try {
+                        frame = mPool.get_frame();
+                } catch (exception &e) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME "Cannot allocate capture buffer: " << e.what() << "\n";
+                        return E_OUTOFMEMORY;
+                }
+                *allocatedBuffer = frame->tiles[0].data;
+                mLent.emplace(*allocatedBuffer, std::move(frame));
+                return S_OK;
+        }
+        HRESULT STDMETHODCALLTYPE ReleaseBuffer(void *buffer) override {
+                unique_lock<mutex> lk(mLock);
+                return mLent.erase(buffer) == 1 ? S_OK : E_INVALIDARG; // returns the frame to pool
+        }
+        HRESULT STDMETHODCALLTYPE Commit(void) override {
+                return S_OK;
+        }
+        HRESULT STDMETHODCALLTYPE Decommit(void) override {
+                unique_lock<mutex> lk(mLock);
+                // drop free buffers, lent ones are freed when released
+                mPool.reconfigure(video_desc{mBufferSize, 1, VIDEO_CODEC_NONE, 0, PROGRESSIVE, 1}, mBufferSize);
+                return S_OK;
+        }
+
+private:
+        virtual ~FramePoolAllocator() = default;
+        atomic<ULONG>                 mRefCount{1};
+        mutex                         mLock;
+        video_frame_pool              mPool;
+        uint32_t                      mBufferSize{};
+        map<void *, shared_ptr<video_frame>> mLent; ///< must be destroyed before mPool
+};
+
 class VideoDelegate : public IDeckLinkInputCallback {
 private:
 	int32_t                       mRefCount{};
@@ -389,7 +453,7 @@ VideoDelegate::VideoInputFrameArrived (IDeckLinkVideoInputFrame *videoFrame, IDe
         }
 
         if (videoFrame && newFrameReady == 1 && (!nosig || !lastFrame)) {
-                /// @todo videoFrame should be actually retained until the data are processed
+                // the frame is additionally retained by frames lent in grab (get_lent_frame())
                 videoFrame->GetBytes(&pixelFrame);
 
                 RELEASE_IF_NOT_NULL(lastFrame);
@@ -1148,6 +1212,12 @@ bool device_state::init(struct vidcap_decklink_state *s, struct tile *t, BMDAudi
         // Query the DeckLink for its configuration interface
         BMD_CHECK(deckLink->QueryInterface(IID_IDeckLinkInput, (void**)&deckLinkInput), "Could not obtain the IDeckLinkInput interface", INIT_ERR());
 
+        // must be set before the video input is enabled
+        allocator = new FramePoolAllocator();
+        if (HRESULT result = deckLinkInput->SetVideoInputFrameMemoryAllocator(allocator); result != S_OK) {
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME "Cannot set capture buffer allocator, using the driver one: " << bmd_hresult_to_string(result) << "\n";
+        }
+
         // Query the DeckLink for its configuration interface
         BMD_CHECK(deckLinkInput->QueryInterface(IID_IDeckLinkConfiguration, (void**)&deckLinkConfiguration), "Could not obtain the IDeckLinkConfiguration interface", INIT_ERR());
 
@@ -1463,6 +1533,7 @@ static void cleanup_common(struct vidcap_decklink_state *s) {
                 RELEASE_IF_NOT_NULL(s->state[i].deckLinkConfiguration);
                 RELEASE_IF_NOT_NULL(s->state[i].deckLinkAttributes);
                 RELEASE_IF_NOT_NULL(s->state[i].deckLinkInput);
+                RELEASE_IF_NOT_NULL(s->state[i].allocator);
                 RELEASE_IF_NOT_NULL(s->state[i].deckLink);
         }
 
@@ -1598,22 +1669,76 @@ static audio_frame *process_new_audio_packets(struct vidcap_decklink_state *s) {
         return &s->audio;
 }
 
-static void postprocess_frame(struct vidcap_decklink_state *s) {
+static void postprocess_frame(struct vidcap_decklink_state *s, struct video_frame *frame) {
         if (s->codec == RGBA) {
-                for (unsigned i = 0; i < s->frame->tile_count; ++i) {
-                        vc_copylineToRGBA_inplace((unsigned char*) s->frame->tiles[i].data,
-                                        (unsigned char*)s->frame->tiles[i].data,
-                                        s->frame->tiles[i].data_len, 16, 8, 0);
+                for (unsigned i = 0; i < frame->tile_count; ++i) {
+                        vc_copylineToRGBA_inplace((unsigned char*) frame->tiles[i].data,
+                                        (unsigned char*)frame->tiles[i].data,
+                                        frame->tiles[i].data_len, 16, 8, 0);
                 }
         }
         if (s->codec == R10k && get_commandline_param(R10K_FULL_OPT) == nullptr) {
-                for (unsigned i = 0; i < s->frame->tile_count; ++i) {
-                        r10k_limited_to_full(s->frame->tiles[i].data, s->frame->tiles[i].data,
-                                        s->frame->tiles[i].data_len);
+                for (unsigned i = 0; i < frame->tile_count; ++i) {
+                        r10k_limited_to_full(frame->tiles[i].data, frame->tiles[i].data,
+                                        frame->tiles[i].data_len);
                 }
         }
 }
 
+static void dispose_lent_frame(struct video_frame *frame) {
+        auto *held = static_cast<vector<IDeckLinkVideoFrame *> *>(frame->callbacks.dispose_udata);
+        for (auto *f : *held) {
+                f->Release();
+        }
+        delete held;
+        vf_free(frame);
+}
+
+/**
+ * Creates a frame pointing to the data of the last captured DeckLink frames.
+ * Those are retained until the returned frame is disposed so that the buffers
+ * are not reused by the card while still being processed.
+ *
+ * Lock needs to be hold during the call.
+ *
+ * @returns frame or NULL if some tile is missing
+ */
+static struct video_frame *get_lent_frame(struct vidcap_decklink_state *s) {
+        vector<pair<void *, IDeckLinkVideoFrame *>> tiles;
+        if (s->stereo) {
+                tiles.emplace_back(s->state[0].delegate->pixelFrame, s->state[0].delegate->lastFrame);
+                tiles.emplace_back(s->state[0].delegate->pixelFrameRight, s->state[0].delegate->rightEyeFrame);
+        } else {
+                for (int i = 0; i < s->devices_cnt; ++i) {
+                        tiles.emplace_back(s->state[i].delegate->pixelFrame, s->state[i].delegate->lastFrame);
+                }
+        }
+        for (auto &t : tiles) {
+                if (t.first == nullptr || t.second == nullptr) {
+                        return nullptr;
+                }
+        }
+
+        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(s->frame));
+        vf_copy_metadata(out, s->frame);
+        auto *held = new vector<IDeckLinkVideoFrame *>();
+        for (unsigned i = 0; i < out->tile_count; ++i) {
+                out->tiles[i] = s->frame->tiles[i];
+                out->tiles[i].data = (char *) tiles[i].first;
+                tiles[i].second->AddRef();
+                held->push_back(tiles[i].second);
+        }
+        out->callbacks.dispose = dispose_lent_frame;
+        out->callbacks.dispose_udata = held;
+
+        out->timecode = s->state[0].delegate->timecode;
+        out->timestamp =
+            ((int64_t)s->state[0].delegate->frameTime * 90000 +
+             s->frameRateScale - 1) /
+            s->frameRateScale;
+        return out;
+}
+
 static struct video_frame *
 vidcap_decklink_grab(void *state, struct audio_frame **audio)
 {
@@ -1686,42 +1811,17 @@ vidcap_decklink_grab(void *state, struct audio_frame **audio)
 
         *audio = process_new_audio_packets(s); // return audio even if there is no video to avoid
                                                //  hoarding and then dropping of audio packets
+        struct video_frame *out = frame_ready ? get_lent_frame(s) : nullptr;
 // UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UN //
 	lk.unlock();
 
-	if(!frame_ready)
+	if (out == nullptr)
 		return NULL;
 
-        /* count returned tiles */
-        int count = 0;
-        if(s->stereo) {
-                if (s->state[0].delegate->pixelFrame != NULL &&
-                                s->state[0].delegate->pixelFrameRight != NULL) {
-                        s->frame->tiles[0].data = (char*)s->state[0].delegate->pixelFrame;
-                        s->frame->tiles[1].data = (char*)s->state[0].delegate->pixelFrameRight;
-                        ++count;
-                } // else count == 0 -> return NULL
-        } else {
-                for (i = 0; i < s->devices_cnt; ++i) {
-                        if (s->state[i].delegate->pixelFrame == NULL) {
-                                break;
-                        }
-                        s->frame->tiles[i].data = (char*)s->state[i].delegate->pixelFrame;
-                        ++count;
-                }
-        }
-        if (count < s->devices_cnt) {
-                return NULL;
-        }
-        postprocess_frame(s);
+        postprocess_frame(s, out);
 
         s->frames++;
-        s->frame->timecode = s->state[0].delegate->timecode;
-        s->frame->timestamp =
-            ((int64_t)s->state[0].delegate->frameTime * 90000 +
-             s->frameRateScale - 1) /
-            s->frameRateScale;
-        return s->frame;
+        return out;
 }
 
 /* function from DeckLink SDK sample DeviceList */
@@ -55,6 +55,9 @@
 #include <inttypes.h>
 #include <libavcodec/avcodec.h>
 #include <libavcodec/version.h>
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 87, 100)
+#include <libavcodec/bsf.h>
+#endif
 #include <libavformat/avformat.h>
 #include <libavformat/version.h>
 #include <libavutil/avutil.h>
@@ -67,6 +70,7 @@
 #include "audio/types.h"
 #include "audio/utils.h"
 #include "debug.h"
+#include "hwaccel_libav_common.h"
 #include "lib_common.h"
 #include "libavcodec/from_lavc_vid_conv.h"
 #include "libavcodec/lavc_common.h"
@@ -76,6 +80,7 @@
 #include "playback.h"
 #include "types.h"
 #include "utils/color_out.h"
+#include "utils/event.h"
 #include "utils/fs.h"
 #include "utils/list.h"
 #include "utils/macros.h"
@@ -90,10 +95,23 @@ static const double AUDIO_RATIO = 1.05; ///< at this ratio the audio frame can b
 enum {
         AUD_BUF_LEN_SEC = 60,
         FILE_DEFAULT_QUEUE_LEN = 20,
+        FILE_DEFAULT_PREFETCH = 64, ///< demuxed packets
 };
 #define MAGIC to_fourcc('u', 'g', 'l', 'f')
 #define MOD_NAME "[File cap.] "
 
+enum demuxed_packet_type {
+        DEMUX_PKT,
+        DEMUX_REWIND, ///< demuxer looped to the beginning
+        DEMUX_EOF,
+};
+
+struct demuxed_packet {
+        enum demuxed_packet_type type;
+        int gen; ///< vidcap_state_lavf_decoder::demux_gen when read
+        AVPacket *pkt; ///< DEMUX_PKT only
+};
+
 struct vidcap_state_lavf_decoder {
         struct module mod;
         char *src_filename;
@@ -104,6 +122,13 @@ struct vidcap_state_lavf_decoder {
 
         struct SwsContext *sws_ctx;
         av_to_uv_convert_t *conv_uv;
+        enum AVPixelFormat conv_in_fmt; ///< input of sws_ctx/conv_uv
+
+        char *hwaccel_name; ///< NULL - SW decode, "" - any available
+        AVBufferRef *hw_device_ctx;
+        enum AVPixelFormat hw_pix_fmt; ///< AV_PIX_FMT_NONE if not HW decoding
+        struct hw_accel_state hwaccel;
+        AVBSFContext *bsf; ///< nodecode - converts H.264/HEVC to Annex B
 
         bool failed;
         bool loop;
@@ -130,28 +155,41 @@ struct vidcap_state_lavf_decoder {
 
         pthread_t thread_id;
         pthread_mutex_t lock;
-        pthread_cond_t new_frame_ready;
-        pthread_cond_t frame_consumed;
+        struct ug_event *new_frame_ready;
+        struct ug_event *frame_consumed; ///< also signalled on new packets to wake the worker
         struct timeval last_frame;
         struct timeval last_stream_stat;
 
         bool should_exit;
 
+        pthread_t demux_thread_id;
+        pthread_mutex_t demux_lock; ///< fmt_ctx access (demuxing, seeking)
+        pthread_cond_t packet_consumed;
+        struct simple_linked_list *packet_queue; ///< struct demuxed_packet, guarded by lock
+        int max_packet_queue_len;
+        int demux_gen; ///< incremented on seek; written with both lock and demux_lock held
+        bool demux_ended; ///< guarded by lock
+
         long long audio_frames;
         long long video_frames;
 };
 
 static void flush_captured_data(struct vidcap_state_lavf_decoder *s);
+static bool setup_conversion(struct vidcap_state_lavf_decoder *s,
+                             enum AVPixelFormat in_fmt);
 
 static void vidcap_file_show_help(bool full) {
         color_printf("Usage:\n");
-        color_printf(TERM_BOLD TERM_FG_RED "\t-t file:<name>" TERM_FG_RESET "[:loop][:nodecode][:codec=<c>][:seek=<sec>]%s\n" TERM_RESET,
-                        full ? "[:opportunistic_audio][:queue=<len>][:threads=<n>[FS]]" : "");
+        color_printf(TERM_BOLD TERM_FG_RED "\t-t file:<name>" TERM_FG_RESET "[:loop][:nodecode][:hwaccel[=<type>]][:codec=<c>][:seek=<sec>]%s\n" TERM_RESET,
+                        full ? "[:opportunistic_audio][:queue=<len>][:prefetch=<pkts>][:threads=<n>[FS]]" : "");
         color_printf("where\n");
         color_printf(TERM_BOLD "\tloop\n" TERM_RESET);
         color_printf("\t\tloop the playback\n");
         color_printf(TERM_BOLD "\tnodecode\n" TERM_RESET);
         color_printf("\t\tdon't decompress the video (may not work because required data for correct decompess are in container or UG doesn't recognize the codec)\n");
+        color_printf("\t\tH.264/HEVC is converted to Annex B, so that it can be sent as-is with the same lavc compression\n");
+        color_printf(TERM_BOLD "\thwaccel\n" TERM_RESET);
+        color_printf("\t\tdecode with HW acceleration (eg. vaapi, cuda), default is any available, \"hwaccel=help\" to list\n");
         color_printf(TERM_BOLD "\tcodec\n" TERM_RESET);
         color_printf("\t\tcodec to decode to\n");
         if (full) {
@@ -159,6 +197,8 @@ static void vidcap_file_show_help(bool full) {
                 color_printf("\t\tgrab audio if not present but do not fail if not\n");
                 color_printf(TERM_BOLD "\tqueue\n" TERM_RESET);
                 color_printf("\t\tmax queue len (default: %d), increasing may help if video stutters\n", FILE_DEFAULT_QUEUE_LEN);
+                color_printf(TERM_BOLD "\tprefetch\n" TERM_RESET);
+                color_printf("\t\tnumber of packets demuxed ahead (default: %d)\n", FILE_DEFAULT_PREFETCH);
                 color_printf(TERM_BOLD "\tthreads\n" TERM_RESET);
                 color_printf("\t\tnumber of threads (0 is default), 'S' and/or 'F' to use slice/frame threads, use at least one flag\n");
         } else {
@@ -166,6 +206,19 @@ static void vidcap_file_show_help(bool full) {
         }
 }
 
+static void free_demuxed_packet(struct demuxed_packet *p) {
+        av_packet_free(&p->pkt);
+        free(p);
+}
+
+/// @note s->lock must be held
+static void flush_demuxed_packets(struct vidcap_state_lavf_decoder *s) {
+        struct demuxed_packet *p = NULL;
+        while ((p = simple_linked_list_pop(s->packet_queue)) != NULL) {
+                free_demuxed_packet(p);
+        }
+}
+
 static void flush_captured_data(struct vidcap_state_lavf_decoder *s) {
         struct video_frame *f = NULL;
         while ((f = simple_linked_list_pop(s->video_frame_queue)) != NULL) {
@@ -180,6 +233,9 @@ static void flush_captured_data(struct vidcap_state_lavf_decoder *s) {
         if (s->vid_ctx) {
                 avcodec_flush_buffers(s->vid_ctx);
         }
+        if (s->bsf) {
+                av_bsf_flush(s->bsf);
+        }
         if (s->aud_ctx) {
                 avcodec_flush_buffers(s->aud_ctx);
         }
@@ -203,12 +259,20 @@ static void vidcap_file_common_cleanup(struct vidcap_state_lavf_decoder *s) {
         av_to_uv_conversion_destroy(&s->conv_uv);
 
         flush_captured_data(s);
+        av_bsf_free(&s->bsf);
+        hwaccel_state_reset(&s->hwaccel);
+        av_buffer_unref(&s->hw_device_ctx);
+        free(s->hwaccel_name);
         ring_buffer_destroy(s->audio_data);
+        flush_demuxed_packets(s);
+        simple_linked_list_destroy(s->packet_queue);
 
         pthread_mutex_destroy(&s->audio_frame_lock);
         pthread_mutex_destroy(&s->lock);
-        pthread_cond_destroy(&s->frame_consumed);
-        pthread_cond_destroy(&s->new_frame_ready);
+        pthread_mutex_destroy(&s->demux_lock);
+        pthread_cond_destroy(&s->packet_consumed);
+        ug_event_done(s->frame_consumed);
+        ug_event_done(s->new_frame_ready);
         free(s->src_filename);
         module_done(&s->mod);
         simple_linked_list_destroy(s->video_frame_queue);
@@ -317,7 +381,7 @@ static void vidcap_file_process_audio_pkt(struct vidcap_state_lavf_decoder *s,
                 pthread_mutex_lock(&s->lock);
                 simple_linked_list_append(s->video_frame_queue, vid_frm);
                 pthread_mutex_unlock(&s->lock);
-                pthread_cond_signal(&s->new_frame_ready);
+                ug_event_notify_one(s->new_frame_ready);
                 vid_frm = simple_linked_list_pop(s->vid_frm_noaud);
         }
 }
@@ -362,18 +426,24 @@ static void vidcap_file_process_messages(struct vidcap_state_lavf_decoder *s) {
                         s->last_vid_pts =
                             MAX(s->last_vid_pts + (sec * tb.den) / tb.num,
                                 st->start_time);
+                        pthread_mutex_lock(&s->demux_lock);
                         CHECK_FF(
                             avformat_seek_file(s->fmt_ctx, s->video_stream_idx,
                                                INT64_MIN, s->last_vid_pts,
                                                INT64_MAX, AVSEEK_FLAG_FRAME),
                             {});
+                        s->demux_gen += 1; // packets being read are stale now
+                        pthread_mutex_unlock(&s->demux_lock);
                         log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Seeking to %s\n",
                                 get_current_position_str(s));
+                        flush_demuxed_packets(s);
                         flush_captured_data(s);
                         s->ended = false;
+                        s->demux_ended = false;
+                        pthread_cond_signal(&s->packet_consumed);
                 } else if (strcmp(msg->text, "pause") == 0) {
                         s->paused = !s->paused;
-                        pthread_cond_signal(&s->new_frame_ready);
+                        ug_event_notify_one(s->new_frame_ready);
                         log_msg(LOG_LEVEL_NOTICE, MOD_NAME "%s\n", s->paused ? "paused" : "unpaused");
                 } else if (strcmp(msg->text, "quit") == 0) {
                         exit_uv(0);
@@ -387,17 +457,48 @@ static void vidcap_file_process_messages(struct vidcap_state_lavf_decoder *s) {
         }
 }
 
+static void vidcap_file_dispose_pkt_frame(struct video_frame *f) {
+        AVPacket *pkt = f->callbacks.dispose_udata;
+        av_packet_free(&pkt);
+        vf_free(f);
+}
+
+/// nodecode - the frame references the packet data (no copy)
+static struct video_frame *get_undecoded_frame(struct vidcap_state_lavf_decoder *s,
+                              AVPacket *pkt) {
+        AVPacket *out_pkt = av_packet_alloc();
+        if (s->bsf != NULL) {
+                int ret = av_bsf_send_packet(s->bsf, pkt);
+                if (ret == 0) {
+                        ret = av_bsf_receive_packet(s->bsf, out_pkt);
+                }
+                if (ret != 0) {
+                        if (ret != AVERROR(EAGAIN)) {
+                                print_libav_error(LOG_LEVEL_WARNING, MOD_NAME "Bitstream filter", ret);
+                        }
+                        av_packet_free(&out_pkt);
+                        return NULL;
+                }
+        } else {
+                av_packet_move_ref(out_pkt, pkt);
+        }
+        struct video_frame *out = vf_alloc_desc(s->video_desc);
+        out->flags |= TIMESTAMP_VALID;
+        out->tiles[0].data_len = out_pkt->size;
+        out->tiles[0].data = (char *) out_pkt->data;
+        out->frame_type = (out_pkt->flags & AV_PKT_FLAG_KEY) != 0 ? INTRA : OTHER;
+        out->seq = out_pkt->pts < 0 ? UINT32_MAX : MIN(out_pkt->pts, UINT32_MAX);
+        out->duration = out_pkt->duration;
+        out->callbacks.dispose = vidcap_file_dispose_pkt_frame;
+        out->callbacks.dispose_udata = out_pkt;
+        return out;
+}
+
 static struct video_frame *process_video_pkt(struct vidcap_state_lavf_decoder *s,
                               AVPacket *pkt, AVFrame *frame) {
         s->last_vid_pts = pkt->pts == AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
         if (s->no_decode) {
-                struct video_frame *out = vf_alloc_desc(s->video_desc);
-                out->callbacks.data_deleter = vf_data_deleter;
-                out->callbacks.dispose = vf_free;
-                out->tiles[0].data_len = pkt->size;
-                out->tiles[0].data = malloc(pkt->size);
-                memcpy(out->tiles[0].data, pkt->data, pkt->size);
-                return out;
+                return get_undecoded_frame(s, pkt);
         }
         time_ns_t t0 = get_time_in_ns();
         int ret = avcodec_send_packet(s->vid_ctx, pkt);
@@ -416,6 +517,15 @@ static struct video_frame *process_video_pkt(struct vidcap_state_lavf_decoder *s
                 print_decoder_error(MOD_NAME "recv - ", ret);
                 return NULL;
         }
+#ifdef HWACC_COMMON_IMPL
+        if (frame->format == s->hw_pix_fmt) {
+                transfer_frame(&s->hwaccel, frame);
+        }
+#endif
+        // HW decoders output the transferred format (eg. NV12) known only now
+        if (frame->format != s->conv_in_fmt && !setup_conversion(s, frame->format)) {
+                return NULL;
+        }
         struct video_frame *out = vf_alloc_desc_data(s->video_desc);
         out->flags |= TIMESTAMP_VALID;
 
@@ -465,21 +575,95 @@ static void print_packet_info(const AVPacket *pkt, const AVStream *st) {
                 pts_val, dts_val, pkt->duration, tb.num, tb.den, pkt->size);
 }
 
-#define FAIL_WORKER { pthread_mutex_lock(&s->lock); s->failed = true; pthread_mutex_unlock(&s->lock); pthread_cond_signal(&s->new_frame_ready); return NULL; }
+#define FAIL_WORKER { pthread_mutex_lock(&s->lock); s->failed = true; pthread_mutex_unlock(&s->lock); ug_event_notify_one(s->new_frame_ready); return NULL; }
+static void push_demuxed_packet(struct vidcap_state_lavf_decoder *s,
+                                enum demuxed_packet_type type, int gen,
+                                AVPacket *pkt) {
+        struct demuxed_packet *p = malloc(sizeof *p);
+        p->type = type;
+        p->gen = gen;
+        p->pkt = pkt;
+        pthread_mutex_lock(&s->lock);
+        if (type == DEMUX_EOF && gen == s->demux_gen) {
+                s->demux_ended = true;
+        }
+        simple_linked_list_append(s->packet_queue, p);
+        pthread_mutex_unlock(&s->lock);
+        ug_event_notify_one(s->frame_consumed);
+}
+
+/**
+ * Reads the packets ahead of the decoding worker so that the I/O and demuxing
+ * latency doesn't add to the decoding time. Seeking is done by the worker,
+ * packets read before it are marked by the previous demux_gen.
+ */
+static void *vidcap_file_demux(void *state) {
+        set_thread_name(__func__);
+        struct vidcap_state_lavf_decoder *s = (struct vidcap_state_lavf_decoder *) state;
+
+        while (true) {
+                pthread_mutex_lock(&s->lock);
+                while (!s->should_exit &&
+                       (s->demux_ended || simple_linked_list_size(s->packet_queue) >=
+                                                  s->max_packet_queue_len)) {
+                        pthread_cond_wait(&s->packet_consumed, &s->lock);
+                }
+                if (s->should_exit) {
+                        pthread_mutex_unlock(&s->lock);
+                        break;
+                }
+                pthread_mutex_unlock(&s->lock);
+
+                AVPacket *pkt = av_packet_alloc();
+                enum demuxed_packet_type type = DEMUX_PKT;
+                pthread_mutex_lock(&s->demux_lock);
+                const int gen = s->demux_gen;
+                int ret = av_read_frame(s->fmt_ctx, pkt);
+                if (ret == AVERROR_EOF) {
+                        av_packet_free(&pkt);
+                        type = DEMUX_EOF;
+                        if (s->loop) {
+                                CHECK_FF(avio_seek(s->fmt_ctx->pb, s->video_stream_idx, SEEK_SET), {}); // handle single JPEG loop, inspired by libavformat's seek_frame_generic because img_read_seek (AVInputFormat::read_seek) doesn't do the job - seeking is inmplemeted just in img2dec if VideoDemuxData::loop == 1
+                                CHECK_FF(avformat_seek_file(s->fmt_ctx, -1, INT64_MIN, s->fmt_ctx->start_time, INT64_MAX, 0),
+                                         { pthread_mutex_unlock(&s->demux_lock); FAIL_WORKER });
+                                type = DEMUX_REWIND;
+                        }
+                }
+                pthread_mutex_unlock(&s->demux_lock);
+                if (ret < 0 && ret != AVERROR_EOF) {
+                        av_packet_free(&pkt);
+                        CHECK_FF(ret, FAIL_WORKER); // error other than EOF
+                }
+
+                if (type == DEMUX_PKT) {
+                        if (log_level >= LOG_LEVEL_DEBUG) {
+                                print_packet_info(
+                                    pkt, s->fmt_ctx->streams[pkt->stream_index]);
+                        }
+                        if (pkt->stream_index != s->audio_stream_idx &&
+                            pkt->stream_index != s->video_stream_idx) {
+                                av_packet_free(&pkt);
+                                continue;
+                        }
+                }
+                push_demuxed_packet(s, type, gen, pkt);
+        }
+
+        return NULL;
+}
+
 static void *vidcap_file_worker(void *state) {
         set_thread_name(__func__);
         struct vidcap_state_lavf_decoder *s = (struct vidcap_state_lavf_decoder *) state;
-        AVPacket *pkt = av_packet_alloc();
         AVFrame *frame = av_frame_alloc();
 
-        pkt->size = 0;
-        pkt->data = 0;
         while (true) {
                 pthread_mutex_lock(&s->lock);
                 while (!s->should_exit && !s->new_msg &&
                        (simple_linked_list_size(s->video_frame_queue) >
-                           s->max_queue_len || s->ended)) {
-                        pthread_cond_wait(&s->frame_consumed, &s->lock);
+                           s->max_queue_len || s->ended ||
+                        simple_linked_list_size(s->packet_queue) == 0)) {
+                        ug_event_wait_locked(s->frame_consumed, &s->lock);
                 }
                 if (s->should_exit) {
                         pthread_mutex_unlock(&s->lock);
@@ -491,53 +675,53 @@ static void *vidcap_file_worker(void *state) {
                         pthread_mutex_unlock(&s->lock);
                         continue;
                 }
+                struct demuxed_packet *dp = simple_linked_list_pop(s->packet_queue);
                 pthread_mutex_unlock(&s->lock);
+                pthread_cond_signal(&s->packet_consumed);
 
-                av_packet_unref(pkt);
-                int ret = av_read_frame(s->fmt_ctx, pkt);
-                if (ret == AVERROR_EOF) {
-                        if (s->loop) {
-                                CHECK_FF(avio_seek(s->fmt_ctx->pb, s->video_stream_idx, SEEK_SET), {}); // handle single JPEG loop, inspired by libavformat's seek_frame_generic because img_read_seek (AVInputFormat::read_seek) doesn't do the job - seeking is inmplemeted just in img2dec if VideoDemuxData::loop == 1
-                                CHECK_FF(avformat_seek_file(s->fmt_ctx, -1, INT64_MIN, s->fmt_ctx->start_time, INT64_MAX, 0), FAIL_WORKER);
-                                flush_captured_data(s);
-                                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Rewinding the file.\n");
-                                continue;
-                        } else {
-                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Playback ended.\n");
-                                s->ended = true;
-                                continue;
-                        }
+                if (dp->gen != s->demux_gen) { // read before seek
+                        free_demuxed_packet(dp);
+                        continue;
                 }
-                CHECK_FF(ret, FAIL_WORKER); // check the retval of av_read_frame for error other than EOF
-
-                if (log_level >= LOG_LEVEL_DEBUG) {
-                        print_packet_info(
-                            pkt, s->fmt_ctx->streams[pkt->stream_index]);
+                if (dp->type == DEMUX_REWIND) {
+                        flush_captured_data(s);
+                        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Rewinding the file.\n");
+                        free_demuxed_packet(dp);
+                        continue;
+                }
+                if (dp->type == DEMUX_EOF) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Playback ended.\n");
+                        s->ended = true;
+                        free_demuxed_packet(dp);
+                        continue;
                 }
 
+                AVPacket *pkt = dp->pkt;
                 if (pkt->stream_index == s->audio_stream_idx) {
                         vidcap_file_process_audio_pkt(s, pkt, frame);
                 } else if (pkt->stream_index == s->video_stream_idx) {
                         struct video_frame *out =
                             process_video_pkt(s, pkt, frame);
                         if (!out) {
+                                free_demuxed_packet(dp);
                                 continue;
                         }
                         if (s->audio_stream_idx != -1 && out->seq != UINT32_MAX) {
                                 if (!have_audio_for_video(s, out->seq, out->duration)) {
                                         simple_linked_list_append(s->vid_frm_noaud,
                                                                   out);
+                                        free_demuxed_packet(dp);
                                         continue;
                                 }
                         }
                         pthread_mutex_lock(&s->lock);
                         simple_linked_list_append(s->video_frame_queue, out);
                         pthread_mutex_unlock(&s->lock);
-                        pthread_cond_signal(&s->new_frame_ready);
+                        ug_event_notify_one(s->new_frame_ready);
                 }
+                free_demuxed_packet(dp);
         }
 
-        av_packet_free(&pkt);
         av_frame_free(&frame);
 
         return NULL;
@@ -562,6 +746,19 @@ static bool vidcap_file_parse_fmt(struct vidcap_state_lavf_decoder *s, const cha
                         s->loop = true;
                 } else if (strcmp(item, "nodecode") == 0) {
                         s->no_decode = true;
+                } else if (IS_PREFIX(item, "hwaccel")) {
+#ifdef HWACC_COMMON_IMPL
+                        const char *name = strchr(item, '=') != NULL ? strchr(item, '=') + 1 : "";
+                        if (strcmp(name, "help") == 0) {
+                                hw_accel_from_str(name);
+                                return false;
+                        }
+                        free(s->hwaccel_name);
+                        s->hwaccel_name = strdup(name);
+#else
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Compiled without HW acceleration support!\n");
+                        return false;
+#endif
                 } else if (strcmp(item, "opportunistic_audio") == 0) {
                         *opportunistic_audio = true;
                 } else if (strncmp(item, "codec=", strlen("codec=")) == 0) {
@@ -572,6 +769,8 @@ static bool vidcap_file_parse_fmt(struct vidcap_state_lavf_decoder *s, const cha
                         }
                 } else if (strncmp(item, "queue=", strlen("queue=")) == 0) {
                         s->max_queue_len = atoi(item + strlen("queue="));
+                } else if (IS_KEY_PREFIX(item, "prefetch")) {
+                        s->max_packet_queue_len = MAX(atoi(strchr(item, '=') + 1), 1);
                 } else if (strncmp(item, "threads=", strlen("threads=")) == 0) {
                         char *endptr = NULL;
                         long count = strtol(item + strlen("threads="), &endptr, 0);
@@ -588,13 +787,78 @@ static bool vidcap_file_parse_fmt(struct vidcap_state_lavf_decoder *s, const cha
         return true;
 }
 
-static AVCodecContext *vidcap_file_open_dec_ctx(const AVCodec *dec, AVStream *st, int thread_count, int thread_type) {
+#ifdef HWACC_COMMON_IMPL
+static enum AVPixelFormat get_hw_format(AVCodecContext *ctx, const enum AVPixelFormat *fmts) {
+        struct vidcap_state_lavf_decoder *s = ctx->opaque;
+        for (const enum AVPixelFormat *it = fmts; *it != AV_PIX_FMT_NONE; ++it) {
+                if (*it == s->hw_pix_fmt) {
+                        return *it;
+                }
+        }
+        log_msg_once(LOG_LEVEL_WARNING, to_fourcc('F', 'C', 'H', 'W'),
+                     MOD_NAME "HW decoding not offered for the stream, using SW.\n");
+        return avcodec_default_get_format(ctx, fmts);
+}
+
+/**
+ * Finds a HW config of the decoder matching s->hwaccel_name (any if empty) and
+ * creates the device. Falls back to SW decoding if none is usable.
+ */
+static void setup_hwaccel(struct vidcap_state_lavf_decoder *s, const AVCodec *dec) {
+        enum AVHWDeviceType type = AV_HWDEVICE_TYPE_NONE;
+        if (strlen(s->hwaccel_name) > 0) {
+                type = av_hwdevice_find_type_by_name(s->hwaccel_name);
+                if (type == AV_HWDEVICE_TYPE_NONE) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Unknown HW acceleration %s, using SW decoding.\n",
+                                s->hwaccel_name);
+                        return;
+                }
+        }
+        for (int i = 0;; ++i) {
+                const AVCodecHWConfig *config = avcodec_get_hw_config(dec, i);
+                if (config == NULL) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "No usable HW acceleration for %s, using SW decoding.\n",
+                                dec->name);
+                        return;
+                }
+                if ((config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX) == 0 ||
+                    (type != AV_HWDEVICE_TYPE_NONE && config->device_type != type)) {
+                        continue;
+                }
+                if (create_hw_device_ctx(config->device_type, &s->hw_device_ctx) != 0) {
+                        continue;
+                }
+                s->hw_pix_fmt = config->pix_fmt;
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Using %s HW decoding.\n",
+                        av_hwdevice_get_type_name(config->device_type));
+                break;
+        }
+        s->hwaccel.type = hw_accel_from_pixfmt(s->hw_pix_fmt);
+        s->hwaccel.copy = true;
+        s->hwaccel.tmp_frame = av_frame_alloc();
+}
+#endif
+
+/**
+ * @param hw_s state with HW device to decode with, NULL for SW decoding
+ */
+static AVCodecContext *vidcap_file_open_dec_ctx(const AVCodec *dec, AVStream *st, int thread_count, int thread_type,
+                struct vidcap_state_lavf_decoder *hw_s) {
         AVCodecContext *dec_ctx = avcodec_alloc_context3(dec);
         if (!dec_ctx) {
                 return NULL;
         }
         dec_ctx->thread_count = thread_count;
         dec_ctx->thread_type = thread_type;
+#ifdef HWACC_COMMON_IMPL
+        if (hw_s != NULL && hw_s->hw_device_ctx != NULL) {
+                dec_ctx->hw_device_ctx = av_buffer_ref(hw_s->hw_device_ctx);
+                dec_ctx->get_format = get_hw_format;
+                dec_ctx->opaque = hw_s;
+        }
+#else
+        (void) hw_s;
+#endif
 
         /* Copy codec parameters from input stream to output codec context */
         if (avcodec_parameters_to_context(dec_ctx, st->codecpar) < 0) {
@@ -618,7 +882,7 @@ static void vidcap_file_new_message(struct module *mod) {
         pthread_mutex_lock(&s->lock);
         s->new_msg = true;
         pthread_mutex_unlock(&s->lock);
-        pthread_cond_signal(&s->frame_consumed);
+        ug_event_notify_one(s->frame_consumed);
 }
 
 static void vidcap_file_should_exit(void *state) {
@@ -626,8 +890,9 @@ static void vidcap_file_should_exit(void *state) {
         pthread_mutex_lock(&s->lock);
         s->should_exit = true;
         pthread_mutex_unlock(&s->lock);
-        pthread_cond_signal(&s->new_frame_ready);
-        pthread_cond_signal(&s->frame_consumed);
+        ug_event_notify_one(s->new_frame_ready);
+        ug_event_notify_one(s->frame_consumed);
+        pthread_cond_signal(&s->packet_consumed);
 }
 
 static void seek_start(struct vidcap_state_lavf_decoder *s) {
@@ -662,6 +927,69 @@ static enum interlacing_t get_field_order(enum AVFieldOrder av_fo) {
         }
 }
 
+static bool setup_conversion(struct vidcap_state_lavf_decoder *s,
+                             enum AVPixelFormat in_fmt) {
+        av_to_uv_conversion_destroy(&s->conv_uv);
+        sws_freeContext(s->sws_ctx);
+        s->sws_ctx = NULL;
+        s->conv_in_fmt = AV_PIX_FMT_NONE;
+
+        s->conv_uv = get_av_to_uv_conversion(in_fmt, s->video_desc.color_spec);
+        if (s->conv_uv) {
+                s->conv_in_fmt = in_fmt;
+                return true;
+        }
+        // else swscale needed
+        enum AVPixelFormat target_pixfmt =
+            get_ug_to_av_pixfmt(s->video_desc.color_spec);
+        if (target_pixfmt == AV_PIX_FMT_NONE) {
+                log_msg(LOG_LEVEL_ERROR,
+                        MOD_NAME "Cannot find suitable AVPixelFormat "
+                                 "for swscale conversion!\n");
+                return false;
+        }
+        s->sws_ctx = sws_getContext(s->video_desc.width, s->video_desc.height,
+                                    in_fmt, s->video_desc.width,
+                                    s->video_desc.height, target_pixfmt, 0,
+                                    NULL, NULL, NULL);
+        if (s->sws_ctx == NULL) {
+                log_msg(LOG_LEVEL_ERROR,
+                        MOD_NAME "Cannot find neither UltraGrid nor "
+                                 "swscale conversion!\n");
+                return false;
+        }
+        s->conv_in_fmt = in_fmt;
+        return true;
+}
+
+/**
+ * UltraGrid expects H.264/HEVC in Annex B while MP4/MKV store it
+ * length-prefixed, so convert (the filters pass Annex B input unchanged).
+ */
+static bool setup_annexb_bsf(struct vidcap_state_lavf_decoder *s, const AVStream *st) {
+        const char *name = NULL;
+        switch (st->codecpar->codec_id) {
+        case AV_CODEC_ID_H264:
+                name = "h264_mp4toannexb";
+                break;
+        case AV_CODEC_ID_HEVC:
+                name = "hevc_mp4toannexb";
+                break;
+        default:
+                return true;
+        }
+        const AVBitStreamFilter *filter = av_bsf_get_by_name(name);
+        if (filter == NULL) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Bitstream filter %s not available, passing packets as they are.\n", name);
+                return true;
+        }
+        CHECK_FF(av_bsf_alloc(filter, &s->bsf), return false;);
+        CHECK_FF(avcodec_parameters_copy(s->bsf->par_in, st->codecpar), return false;);
+        s->bsf->time_base_in = st->time_base;
+        CHECK_FF(av_bsf_init(s->bsf), return false;);
+        return true;
+}
+
 static bool setup_video(struct vidcap_state_lavf_decoder *s) {
         AVStream *st = s->fmt_ctx->streams[s->video_stream_idx];
         s->video_desc.width = st->codecpar->width;
@@ -678,11 +1006,16 @@ static bool setup_video(struct vidcap_state_lavf_decoder *s) {
                         return false;
                 }
                 s->video_desc.interlacing = PROGRESSIVE;
-                return true;
+                return setup_annexb_bsf(s, st);
         }
         const AVCodec *dec = avcodec_find_decoder(st->codecpar->codec_id);
+#ifdef HWACC_COMMON_IMPL
+        if (s->hwaccel_name != NULL && dec != NULL) {
+                setup_hwaccel(s, dec);
+        }
+#endif
         s->vid_ctx =
-            vidcap_file_open_dec_ctx(dec, st, s->thread_count, s->thread_type);
+            vidcap_file_open_dec_ctx(dec, st, s->thread_count, s->thread_type, s);
         if (!s->vid_ctx) {
                 return false;
         }
@@ -695,31 +1028,10 @@ static bool setup_video(struct vidcap_state_lavf_decoder *s) {
                 s->video_desc.color_spec =
                     UYVY; // fallback, swscale will perhaps be used
         }
-        s->conv_uv = get_av_to_uv_conversion(s->vid_ctx->pix_fmt,
-                                             s->video_desc.color_spec);
-        if (s->conv_uv) {
-                return true;
-        }
-        // else swscale needed
-        enum AVPixelFormat target_pixfmt =
-            get_ug_to_av_pixfmt(s->video_desc.color_spec);
-        if (target_pixfmt == AV_PIX_FMT_NONE) {
-                log_msg(LOG_LEVEL_ERROR,
-                        MOD_NAME "Cannot find suitable AVPixelFormat "
-                                 "for swscale conversion!\n");
-                return false;
+        if (s->hw_pix_fmt != AV_PIX_FMT_NONE) {
+                return true; // set up for the first transferred frame
         }
-        s->sws_ctx = sws_getContext(s->video_desc.width, s->video_desc.height,
-                                    s->vid_ctx->pix_fmt, s->video_desc.width,
-                                    s->video_desc.height, target_pixfmt, 0,
-                                    NULL, NULL, NULL);
-        if (s->sws_ctx == NULL) {
-                log_msg(LOG_LEVEL_ERROR,
-                        MOD_NAME "Cannot find neither UltraGrid nor "
-                                 "swscale conversion!\n");
-                return false;
-        }
-        return true;
+        return setup_conversion(s, s->vid_ctx->pix_fmt);
 }
 
 static int get_ach_count(int file_channels) {
@@ -758,6 +1070,11 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
         struct vidcap_state_lavf_decoder *s = calloc(1, sizeof (struct vidcap_state_lavf_decoder));
         s->video_frame_queue = simple_linked_list_init();
         s->vid_frm_noaud = simple_linked_list_init();
+        s->packet_queue = simple_linked_list_init();
+        s->max_packet_queue_len = FILE_DEFAULT_PREFETCH;
+        s->conv_in_fmt = AV_PIX_FMT_NONE;
+        s->hw_pix_fmt = AV_PIX_FMT_NONE;
+        hwaccel_state_init(&s->hwaccel);
         s->audio_stream_idx = -1;
         s->video_stream_idx = -1;
         s->audio_end_ts = AV_NOPTS_VALUE;
@@ -766,8 +1083,10 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
         s->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
         CHECK(pthread_mutex_init(&s->audio_frame_lock, NULL));
         CHECK(pthread_mutex_init(&s->lock, NULL));
-        CHECK(pthread_cond_init(&s->frame_consumed, NULL));
-        CHECK(pthread_cond_init(&s->new_frame_ready, NULL));
+        CHECK(pthread_mutex_init(&s->demux_lock, NULL));
+        CHECK(pthread_cond_init(&s->packet_consumed, NULL));
+        s->frame_consumed = ug_event_init(false);
+        s->new_frame_ready = ug_event_init(true);
         module_init_default(&s->mod);
         s->mod.priv_magic = MAGIC;
         s->mod.cls = MODULE_CLASS_DATA;
@@ -807,7 +1126,7 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
                 }
                 if (s->audio_stream_idx >= 0) {
                         s->aud_ctx = vidcap_file_open_dec_ctx(dec,
-                                        s->fmt_ctx->streams[s->audio_stream_idx], s->thread_count, s->thread_type);
+                                        s->fmt_ctx->streams[s->audio_stream_idx], s->thread_count, s->thread_type, NULL);
 
                         if (s->aud_ctx == NULL) {
                                 vidcap_file_common_cleanup(s);
@@ -852,6 +1171,7 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
         playback_register_keyboard_ctl(&s->mod);
         register_should_exit_callback(&s->mod, vidcap_file_should_exit, s);
 
+        pthread_create(&s->demux_thread_id, NULL, vidcap_file_demux, s);
         pthread_create(&s->thread_id, NULL, vidcap_file_worker, s);
 
         *state = s;
@@ -866,6 +1186,7 @@ static void vidcap_file_done(void *state) {
         vidcap_file_should_exit(s);
 
         pthread_join(s->thread_id, NULL);
+        pthread_join(s->demux_thread_id, NULL);
 
         vidcap_file_common_cleanup(s);
 }
@@ -1004,7 +1325,7 @@ vidcap_file_grab(void *state, struct audio_frame **audio)
         pthread_mutex_lock(&s->lock);
         while ((simple_linked_list_size(s->video_frame_queue) == 0 || s->paused) &&
                !s->failed && !s->should_exit) {
-                pthread_cond_wait(&s->new_frame_ready, &s->lock);
+                ug_event_wait_locked(s->new_frame_ready, &s->lock);
         }
         if (s->failed || s->should_exit) {
                 pthread_mutex_unlock(&s->lock);
@@ -1012,7 +1333,7 @@ vidcap_file_grab(void *state, struct audio_frame **audio)
         }
         out = simple_linked_list_pop(s->video_frame_queue);
         pthread_mutex_unlock(&s->lock);
-        pthread_cond_signal(&s->frame_consumed);
+        ug_event_notify_one(s->frame_consumed);
 
         out->timestamp =
             (uint32_t) ((double) s->video_frames * kHz90 / s->video_desc.fps);
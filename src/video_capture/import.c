@@ -64,23 +64,31 @@
 #include "utils/fs.h"
 #include "utils/macros.h"
 #include "utils/ring_buffer.h"
+#include "utils/video_frame_pool.h"
 #include "utils/worker.h"
 #include "video.h"
 #include "video_capture.h"
 #include "video_export.h"
 
+#include <errno.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <stdbool.h>
 #include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-#define BUFFER_LEN_MAX 40
+#define DEFAULT_PREFETCH 40
+#define ALLOC_ALIGN 512
+#define ALIGN_LEN(len) (((len) + ALLOC_ALIGN - 1) / ALLOC_ALIGN * ALLOC_ALIGN)
 #define MAX_CLIENTS 16
 
 #define VIDCAP_IMPORT_ID 0x76FA7F6D
@@ -88,24 +96,39 @@
 #define PIPE "/tmp/ultragrid_import.fifo"
 
 #define MAX_NUMBER_WORKERS 100
+#define DEFAULT_FF_STEP 8
 #define MOD_NAME "[import] "
 
-struct processed_entry;
-struct tile_data {
-        char *data;
-        int data_len;
-};
-
 struct processed_entry {
         struct processed_entry *next;
-        int count;
-        struct tile_data tiles[];
+        struct video_frame *frame; ///< from the pool or the container
+};
+
+/**
+ * Single-file container written by video_export with
+ * "--param video-export-container", mapped to memory. The returned frames
+ * point directly to the mapping, which is unmapped when the last of them is
+ * disposed.
+ */
+struct import_container {
+        atomic_int refcount; ///< import state + frames in use
+        char *data;
+        size_t data_len;
+        struct video_export_index_entry *index;
+        size_t index_count;
+        unsigned int tile_count;
+        uint32_t first_frame;
+        bool dense; ///< index[i] is tile i % tile_count of frame first_frame + i / tile_count
+        bool keyframes; ///< keyframes flagged, otherwise all frames are treated as such
+        long page_size;
 };
 
 typedef enum {
         SEEK,
         FINALIZE,
-        PAUSE
+        PAUSE,
+        FAST_FORWARD, ///< data - int frame step (1 - normal speed)
+        LOOP_POINTS,  ///< data - long[2], range [start, end) of frames
 } import_message_t;
 
 struct import_message;
@@ -179,8 +202,19 @@ struct vidcap_import_state {
         bool loop;
         bool o_direct;
         int video_reading_threads_count;
+        int prefetch; ///< max frames read ahead (queued + in flight)
+        void *pool; ///< video_frame_pool the files are read into
+        struct import_container *container; ///< NULL if reading individual files
+        size_t pool_data_len; ///< touched by video_reading_thread only
         bool should_exit_at_end;
         double force_fps;
+
+        int ff_step_requested; ///< last fast-forward factor requested by the user
+
+        // touched by video_reading_thread only
+        int ff_step; ///< frames advanced per frame played
+        long loop_start; ///< loop points (container only), end is exclusive
+        long loop_end;
 };
 
 static void * audio_reading_thread(void *args);
@@ -193,6 +227,8 @@ static void vidcap_import_new_message(struct module *);
 static void process_msg(struct vidcap_import_state *state, const char *message);
 
 static void cleanup_common(struct vidcap_import_state *s);
+static bool container_open(const char *directory, struct import_container **container);
+static void container_release(struct import_container *c);
 
 static void message_queue_clear(struct message_queue *queue) {
         queue->head = queue->tail = NULL;
@@ -380,6 +416,7 @@ static bool initialize_import(struct vidcap_import_state *s, char *tmp, FILE **i
         module_register(&s->mod, s->parent);
 
         s->video_reading_threads_count = 1; // default is single threaded
+        s->prefetch = DEFAULT_PREFETCH;
 
         char *save_ptr = NULL;
         char *suffix;
@@ -406,6 +443,13 @@ static bool initialize_import(struct vidcap_import_state *s, char *tmp, FILE **i
                                         strlen("mt_reading="));
                         assert(s->video_reading_threads_count <=
                                         MAX_NUMBER_WORKERS);
+                } else if (strstr(suffix, "prefetch=") == suffix) {
+                        s->prefetch = atoi(strchr(suffix, '=') + 1);
+                        if (s->prefetch <= 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong prefetch depth: %s\n",
+                                        suffix);
+                                return false;
+                        }
                 } else if (strcmp(suffix, "o_direct") == 0) {
                         s->o_direct = true;
                 } else if (strcmp(suffix, "noaudio") == 0) {
@@ -465,10 +509,17 @@ static bool initialize_import(struct vidcap_import_state *s, char *tmp, FILE **i
                 }
                 s->video_frame_count = s->video_frame_count == 0 ? frame_count : MIN(s->video_frame_count, frame_count);
 
-                s->video_desc.tile_count = get_tile_count(s->directory, s->video_desc.color_spec, &s->tile_delim);
+                if (!container_open(s->directory, &s->container)) {
+                        return false;
+                }
+                s->video_desc.tile_count = s->container != NULL
+                        ? s->container->tile_count
+                        : (unsigned int) get_tile_count(s->directory, s->video_desc.color_spec, &s->tile_delim);
                 if (s->video_desc.tile_count == 0) {
                         return false;
                 }
+                s->ff_step = s->ff_step_requested = 1;
+                s->loop_end = s->video_frame_count;
         }
 
         // override metadata fps setting
@@ -483,6 +534,10 @@ static bool initialize_import(struct vidcap_import_state *s, char *tmp, FILE **i
                 }
         }
         if (s->has_video) {
+                // O_DIRECT needs the buffers aligned to the logical block size
+                s->pool = s->o_direct
+                        ? video_frame_pool_init_aligned((struct video_desc) { 0 }, 0, ALLOC_ALIGN)
+                        : video_frame_pool_init((struct video_desc) { 0 }, 0);
                 if (pthread_create(&s->video_thread_id, NULL, video_reading_thread, (void *) s) != 0) {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to create thread.\n");
                         return false;
@@ -492,6 +547,9 @@ static bool initialize_import(struct vidcap_import_state *s, char *tmp, FILE **i
         gettimeofday(&s->prev_time, NULL);
 
         playback_register_keyboard_ctl(&s->mod);
+        if (s->has_video && !keycontrol_register_key(&s->mod, 'f', "fast-forward", "playback fast-forward toggle")) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot register fast-forward key control!\n");
+        }
 
         return true;
 }
@@ -502,10 +560,16 @@ vidcap_import_init(struct vidcap_params *params, void **state)
         char *tmp = strdup(vidcap_params_get_fmt(params));
         if (strlen(tmp) == 0 || strcmp(tmp, "help") == 0) {
                 color_printf("Import usage:\n"
-                                TERM_BOLD TERM_FG_RED "\t<directory>" TERM_FG_RESET "{:loop|:mt_reading=<nr_threads>|:o_direct|:exit_at_end|:fps=<fps>|frames=<n>|:disable_audio}\n" TERM_RESET
+                                TERM_BOLD TERM_FG_RED "\t<directory>" TERM_FG_RESET "{:loop|:mt_reading=<nr_threads>|:prefetch=<depth>|:o_direct|:exit_at_end|:fps=<fps>|frames=<n>|:disable_audio}\n" TERM_RESET
                                 "where\n"
                                 TERM_BOLD "\t<fps>" TERM_RESET " - overrides FPS from sequence metadata\n"
-                                TERM_BOLD "\t<n>  " TERM_RESET " - use only N first frames fron sequence (if less than available frames)\n");
+                                TERM_BOLD "\t<n>  " TERM_RESET " - use only N first frames fron sequence (if less than available frames)\n"
+                                TERM_BOLD "\t<nr_threads>" TERM_RESET " - number of files read in parallel\n"
+                                TERM_BOLD "\t<depth>" TERM_RESET " - number of frames read ahead (default %d)\n"
+                                "\nBesides seeking, recordings with " VIDEO_EXPORT_CONTAINER_INDEX " (--param video-export-container)\n"
+                                "accept control messages \"fast-forward [<factor>]\" (keyframes only for inter-frame\n"
+                                "codecs) and, without audio, \"loop <start>[s] <end>[s]\" (looped without reopening).\n",
+                                DEFAULT_PREFETCH);
                 free(tmp);
                 return VIDCAP_INIT_NOERR;
         }
@@ -575,10 +639,7 @@ static void free_entry(struct processed_entry *entry)
         if (entry == NULL) {
                 return;
         }
-        for (int i = 0; i < entry->count; ++i) {
-                aligned_free(entry->tiles[i].data);
-        }
-
+        VIDEO_FRAME_DISPOSE(entry->frame);
         free(entry);
 }
 
@@ -606,6 +667,10 @@ static int flush_processed(struct processed_entry *list)
 
 static void cleanup_common(struct vidcap_import_state *s) {
         flush_processed(s->head);
+        if (s->pool != NULL) {
+                video_frame_pool_destroy(s->pool);
+        }
+        container_release(s->container);
 
         free(s->directory);
 
@@ -674,6 +739,37 @@ static void vidcap_import_new_message(struct module *mod) {
         }
 }
 
+/**
+ * parses frame count or time (with suffix 's') to frames
+ * @param[out] endptr  end of the parsed spec
+ */
+static long parse_frame_spec(const struct vidcap_import_state *s, const char *spec, char **endptr)
+{
+        const double val = strtod(spec, endptr);
+        if (**endptr == 's') {
+                *endptr += 1;
+                return (long) (val * s->video_desc.fps);
+        }
+        return (long) val;
+}
+
+/// sends message with a copy of data to the video reading thread only
+static void send_video_message(struct vidcap_import_state *s, import_message_t type,
+                const void *data, size_t data_len)
+{
+        struct import_message *msg = (struct import_message *) malloc(sizeof(struct import_message));
+        msg->type = type;
+        msg->data = malloc(data_len);
+        memcpy(msg->data, data, data_len);
+        msg->data_len = data_len;
+        msg->next = NULL;
+
+        pthread_mutex_lock(&s->lock);
+        import_send_message(msg, &s->message_queue);
+        pthread_mutex_unlock(&s->lock);
+        pthread_cond_signal(&s->worker_cv);
+}
+
 static void process_msg(struct vidcap_import_state *s, const char *message)
 {
         if(strcasecmp(message, "pause") == 0) {
@@ -740,6 +836,29 @@ static void process_msg(struct vidcap_import_state *s, const char *message)
                         pthread_mutex_unlock(&s->audio_state.lock);
                         pthread_cond_signal(&s->audio_state.worker_cv);
                 }
+        } else if (strncasecmp(message, "fast-forward", strlen("fast-forward")) == 0) {
+                // without the factor, toggles between the normal and default speed
+                const char *factor = message + strlen("fast-forward");
+                int step = atoi(factor);
+                if (step <= 0) {
+                        step = s->ff_step_requested > 1 ? 1 : DEFAULT_FF_STEP;
+                }
+                s->ff_step_requested = step;
+                if (step > 1 && s->container == NULL && is_codec_interframe(s->video_desc.color_spec)) {
+                        log_msg_once(LOG_LEVEL_WARNING, to_fourcc('I', 'M', 'F', 'F'), MOD_NAME "Recording "
+                                        "without container index, fast-forward cannot skip to keyframes.\n");
+                }
+                send_video_message(s, FAST_FORWARD, &step, sizeof step);
+        } else if (strncasecmp(message, "loop ", strlen("loop ")) == 0) {
+                long points[2];
+                char *end = NULL;
+                if (s->container == NULL || s->audio_state.has_audio) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Loop points need a container without audio!\n");
+                        return;
+                }
+                points[0] = parse_frame_spec(s, message + strlen("loop "), &end);
+                points[1] = parse_frame_spec(s, end, &end);
+                send_video_message(s, LOOP_POINTS, points, sizeof points);
         } else if(strcasecmp(message, "quit") == 0) {
                 exit_uv(0);
         } else {
@@ -825,36 +944,289 @@ static void * audio_reading_thread(void *args)
         return NULL;
 }
 
+static void vidcap_import_dispose_container_frame(struct video_frame *frame);
+
+static void container_release(struct import_container *c)
+{
+        if (c == NULL || atomic_fetch_sub(&c->refcount, 1) > 1) {
+                return;
+        }
+#ifndef _WIN32
+        if (c->data != NULL) {
+                munmap(c->data, c->data_len);
+        }
+        if (c->index != NULL) {
+                munmap(c->index, c->index_count * sizeof c->index[0]);
+        }
+#endif
+        free(c);
+}
+
+#ifndef _WIN32
+static void *map_file(const char *name, size_t *len)
+{
+        int fd = open(name, O_RDONLY);
+        if (fd == -1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot open %s: %s\n", name, strerror(errno));
+                return NULL;
+        }
+        struct stat sb;
+        void *ret = NULL;
+        if (fstat(fd, &sb) != 0 || sb.st_size == 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot map empty file %s\n", name);
+        } else {
+                // private - downstream may modify the frames in place
+                ret = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+                if (ret == MAP_FAILED) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot map %s: %s\n", name, strerror(errno));
+                        ret = NULL;
+                }
+                *len = sb.st_size;
+        }
+        close(fd);
+        return ret;
+}
+#endif
+
+/**
+ * @param[out] container the container if present in the directory, NULL otherwise
+ * @retval false the container is present but invalid
+ */
+static bool container_open(const char *directory, struct import_container **container)
+{
+        *container = NULL;
+        char name[MAX_PATH_SIZE];
+        snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_CONTAINER_INDEX, directory);
+        struct stat sb;
+        if (stat(name, &sb) != 0) {
+                return true;
+        }
+#ifdef _WIN32
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Reading " VIDEO_EXPORT_CONTAINER_DATA " not supported on this platform!\n");
+        return false;
+#else
+        struct import_container *c = calloc(1, sizeof *c);
+        atomic_init(&c->refcount, 1);
+        c->page_size = sysconf(_SC_PAGESIZE);
+
+        size_t index_len = 0;
+        c->index = map_file(name, &index_len);
+        if (c->index == NULL) {
+                container_release(c);
+                return false;
+        }
+        c->index_count = index_len / sizeof c->index[0];
+        snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_CONTAINER_DATA, directory);
+        c->data = map_file(name, &c->data_len);
+        if (c->data == NULL || index_len % sizeof c->index[0] != 0) {
+                if (c->data != NULL) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Truncated container index!\n");
+                }
+                container_release(c);
+                return false;
+        }
+        for (size_t i = 0; i < c->index_count; ++i) {
+                const struct video_export_index_entry *e = &c->index[i];
+                if (e->offset > c->data_len || e->data_len > c->data_len - e->offset ||
+                                (i > 0 && e->frame < c->index[i - 1].frame)) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Corrupted container index entry %zu!\n", i);
+                        container_release(c);
+                        return false;
+                }
+                if (e->frame == c->index[0].frame) {
+                        c->tile_count = MAX(c->tile_count, e->tile + 1);
+                }
+                c->keyframes = c->keyframes || (e->flags & VIDEO_EXPORT_INDEX_KEYFRAME) != 0;
+        }
+        c->first_frame = c->index_count > 0 ? c->index[0].frame : 1;
+        c->dense = c->tile_count > 0;
+        for (size_t i = 0; i < c->index_count && c->dense; ++i) {
+                c->dense = c->index[i].frame == c->first_frame + i / c->tile_count &&
+                        c->index[i].tile == i % c->tile_count;
+        }
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Reading from container, %zu tiles indexed%s.\n",
+                        c->index_count, c->dense ? "" : " (sparse)");
+        *container = c;
+        return true;
+#endif
+}
+
+/**
+ * @returns position of the first index entry of the frame (0-based frame
+ * index) or of the next exported one, constant time if the index is dense
+ */
+static size_t container_find(const struct import_container *c, long index)
+{
+        const uint32_t frame_idx = index + 1;
+        if (c->dense) {
+                if (frame_idx < c->first_frame) {
+                        return 0;
+                }
+                return MIN((size_t) (frame_idx - c->first_frame) * c->tile_count, c->index_count);
+        }
+        // entries are ordered by frame
+        size_t lo = 0;
+        size_t hi = c->index_count;
+        while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (c->index[mid].frame < frame_idx) {
+                        lo = mid + 1;
+                } else {
+                        hi = mid;
+                }
+        }
+        return lo;
+}
+
+static bool container_is_keyframe(const struct import_container *c, size_t pos)
+{
+        return !c->keyframes || (c->index[pos].flags & VIDEO_EXPORT_INDEX_KEYFRAME) != 0;
+}
+
+/// @returns the last keyframe at or before the frame (or the frame itself if there is none)
+static long container_keyframe_before(const struct import_container *c, long index)
+{
+        if (!c->keyframes) {
+                return index;
+        }
+        for (size_t pos = MIN(container_find(c, index), c->index_count - 1); ; --pos) {
+                if (c->index[pos].frame <= index + 1 && container_is_keyframe(c, pos)) {
+                        return (long) c->index[pos].frame - 1;
+                }
+                if (pos == 0) {
+                        return index;
+                }
+        }
+}
+
+/// @returns the first keyframe in [index, end), end if there is none
+static long container_keyframe_after(const struct import_container *c, long index, long end)
+{
+        for (size_t pos = container_find(c, index); pos < c->index_count; ) {
+                const long frame = (long) c->index[pos].frame - 1;
+                if (frame >= end) {
+                        break;
+                }
+                if (container_is_keyframe(c, pos)) {
+                        return frame;
+                }
+                pos = c->dense ? pos + c->tile_count : container_find(c, frame + 1);
+        }
+        return end;
+}
+
+/// @returns frame pointing to the mapped data, NULL if the frame was not exported
+static struct video_frame *container_get_frame(struct vidcap_import_state *s, long index)
+{
+        struct import_container *c = s->container;
+        const uint32_t frame_idx = index + 1;
+        const size_t lo = container_find(c, index);
+        if (lo + s->video_desc.tile_count > c->index_count) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Frame %ld missing in container.\n", index + 1);
+                return NULL;
+        }
+        const struct video_export_index_entry *e = &c->index[lo];
+        for (unsigned int i = 0; i < s->video_desc.tile_count; ++i) {
+                if (e[i].frame != frame_idx || e[i].tile != i) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Frame %ld missing in container.\n", index + 1);
+                        return NULL;
+                }
+        }
+
+        struct video_frame *frame = vf_alloc_desc(s->video_desc);
+        for (unsigned int i = 0; i < s->video_desc.tile_count; ++i) {
+                frame->tiles[i].data = c->data + e[i].offset;
+                frame->tiles[i].data_len = e[i].data_len;
+#ifndef _WIN32
+                // start the read-ahead now that the frame is prefetched
+                const size_t start = e[i].offset / c->page_size * c->page_size;
+                madvise(c->data + start, e[i].offset + e[i].data_len - start, MADV_WILLNEED);
+#endif
+        }
+        atomic_fetch_add(&c->refcount, 1);
+        frame->callbacks.dispose = vidcap_import_dispose_container_frame;
+        frame->callbacks.dispose_udata = c;
+        return frame;
+}
+
+static void vidcap_import_dispose_container_frame(struct video_frame *frame)
+{
+        container_release((struct import_container *) frame->callbacks.dispose_udata);
+        vf_free(frame);
+}
+
 struct video_reader_data {
         char file_name_prefix[512];
         char file_name_suffix[512];
         char tile_delim;
         unsigned int tile_count;
-        struct processed_entry *entry;
+        struct video_frame *frame; ///< from the pool, NULL on failure
         bool o_direct;
 };
 
-#define ALLOC_ALIGN 512
+static void get_tile_name(const struct video_reader_data *data, unsigned int i,
+                char *name, size_t name_len)
+{
+        char tile_idx[3] = "";
+        if (data->tile_count > 1) {
+                snprintf(tile_idx, sizeof tile_idx, "%c%d", data->tile_delim, i);
+        }
+        snprintf(name, name_len, "%s%s.%s", data->file_name_prefix, tile_idx,
+                        data->file_name_suffix);
+}
+
+/**
+ * Fills the reader data for frame at index and takes a frame from the pool
+ * that is large enough for all tiles (the pool grows if needed). Runs in the
+ * reading thread only, which is the only one touching the pool.
+ */
+static bool prepare_read(struct vidcap_import_state *s, long index,
+                struct video_reader_data *data)
+{
+        data->o_direct = s->o_direct;
+        data->tile_count = s->video_desc.tile_count;
+        data->tile_delim = s->tile_delim;
+        snprintf(data->file_name_prefix, sizeof(data->file_name_prefix),
+                        "%s/%08ld", s->directory, index + 1);
+        strncpy(data->file_name_suffix,
+                        get_codec_file_extension(s->video_desc.color_spec),
+                        sizeof(data->file_name_suffix) - 1);
+        data->file_name_suffix[sizeof data->file_name_suffix - 1] = '\0';
+        data->frame = NULL;
+
+        size_t max_len = 0;
+        for (unsigned int i = 0; i < data->tile_count; i++) {
+                char name[1048];
+                get_tile_name(data, i, name, sizeof name);
+                struct stat sb;
+                if (stat(name, &sb) != 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot stat %s: %s\n",
+                                        name, strerror(errno));
+                        return false;
+                }
+                max_len = MAX(max_len, (size_t) sb.st_size);
+        }
+        // reads are done in ALLOC_ALIGN multiples (O_DIRECT)
+        max_len = ALIGN_LEN(max_len);
+        if (max_len > s->pool_data_len) {
+                // grow with a margin to avoid reallocating the pool for
+                // each slightly bigger compressed frame
+                s->pool_data_len = ALIGN_LEN(MAX(max_len, s->pool_data_len + s->pool_data_len / 4));
+                video_frame_pool_reconfigure(s->pool, s->video_desc, s->pool_data_len);
+        }
+        data->frame = video_frame_pool_get_disposable_frame(s->pool);
+        return true;
+}
 
 static void *video_reader_callback(void *arg)
 {
         struct video_reader_data *data =
                 (struct video_reader_data *) arg;
-       
-        data->entry = (struct processed_entry *) calloc(1, sizeof(struct processed_entry) + data->tile_count * sizeof(struct tile_data));
-        assert(data->entry != NULL);
-        data->entry->next = NULL;
-        data->entry->count = data->tile_count;
 
         for (unsigned int i = 0; i < data->tile_count; i++) {
+                struct tile *tile = &data->frame->tiles[i];
                 char name[1048];
-                char tile_idx[3] = "";
-                if (data->tile_count > 1) {
-                        snprintf(tile_idx, sizeof tile_idx, "%c%d", data->tile_delim, i);
-	        }
-                snprintf(name, sizeof(name), "%s%s.%s",
-                                data->file_name_prefix, tile_idx,
-                                data->file_name_suffix);
+                get_tile_name(data, i, name, sizeof name);
 
                 struct stat sb;
 
@@ -870,65 +1242,140 @@ static void *video_reader_callback(void *arg)
                 int fd = open(name, flags);
                 if(fd == -1) {
                         perror("open");
-                        return NULL;
+                        goto error;
                 }
                 if (fstat(fd, &sb)) {
                         perror("fstat");
                         close(fd);
-                        free_entry(data->entry);
-                        return NULL;
+                        goto error;
+                }
+                if ((size_t) ALIGN_LEN(sb.st_size) > tile->data_len) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "%s changed while reading!\n", name);
+                        close(fd);
+                        goto error;
                 }
 
-                data->entry->tiles[i].data_len = sb.st_size;
-                const int aligned_data_len = (data->entry->tiles[i].data_len + ALLOC_ALIGN - 1)
-                        / ALLOC_ALIGN * ALLOC_ALIGN;
-                // alignment needed when using O_DIRECT flag
-                data->entry->tiles[i].data = (char *)
-                        aligned_malloc(aligned_data_len, ALLOC_ALIGN);
-                assert(data->entry->tiles[i].data != NULL);
-
+                tile->data_len = sb.st_size;
                 ssize_t bytes = 0;
                 do {
-                        ssize_t res = read(fd, data->entry->tiles[i].data + bytes,
-                                        (data->entry->tiles[i].data_len - bytes + ALLOC_ALIGN - 1)
-                                        / ALLOC_ALIGN * ALLOC_ALIGN);
+                        ssize_t res = read(fd, tile->data + bytes,
+                                        ALIGN_LEN(tile->data_len - bytes));
                         if (res <= 0) {
                                 perror("read");
-                                for (unsigned int i = 0; i < data->tile_count; i++) {
-                                        aligned_free(data->entry->tiles[i].data);
-                                }
-                                free(data->entry);
                                 close(fd);
-                                return NULL;
+                                goto error;
                         }
                         bytes += res;
-                } while (bytes < data->entry->tiles[i].data_len);
+                } while (bytes < (ssize_t) tile->data_len);
 
                 close(fd);
         }
 
         return data;
+error:
+        VIDEO_FRAME_DISPOSE(data->frame);
+        data->frame = NULL;
+        return data;
+}
+
+/**
+ * Waits for all reads in flight and discards them.
+ * @returns number of discarded frames
+ */
+static int drain_reads(task_result_handle_t *task_handle, int *first, int *in_flight)
+{
+        int discarded = 0;
+        for ( ; *in_flight > 0; --*in_flight) {
+                struct video_reader_data *data =
+                        (struct video_reader_data *) wait_task(task_handle[*first]);
+                *first = (*first + 1) % MAX_NUMBER_WORKERS;
+                VIDEO_FRAME_DISPOSE(data->frame);
+                discarded += 1;
+        }
+        return discarded;
 }
 
+/// the container is looped by the reading thread without restarting it (audio would get out of sync)
+static bool loop_in_place(const struct vidcap_import_state *s)
+{
+        return s->loop && s->container != NULL && !s->audio_state.has_audio;
+}
+
+/// @returns index of the frame to be read after the one at index
+static long next_frame(const struct vidcap_import_state *s, long index)
+{
+        index += s->ff_step;
+        if (s->ff_step > 1 && s->container != NULL) { // skip to keyframes
+                index = container_keyframe_after(s->container, index, s->video_frame_count);
+        }
+        if (loop_in_place(s) && index >= s->loop_end) {
+                index = s->loop_start;
+        }
+        return index;
+}
+
+static void enqueue_frame(struct vidcap_import_state *s, struct video_frame *frame)
+{
+        struct processed_entry *entry = (struct processed_entry *) malloc(sizeof *entry);
+        entry->next = NULL;
+        entry->frame = frame;
+
+        pthread_mutex_lock(&s->lock);
+        if(s->head) {
+                s->tail->next = entry;
+                s->tail = entry;
+        } else {
+                s->head = s->tail = entry;
+        }
+        s->queue_len += 1;
+
+        pthread_mutex_unlock(&s->lock);
+        pthread_cond_signal(&s->boss_cv);
+}
+
+/**
+ * Keeps up to video_reading_threads_count reads in flight while the queue
+ * together with them is shorter than the prefetch depth. The reads are
+ * collected in submission order as soon as the oldest one completes, so that
+ * a single slow read doesn't stall the others.
+ *
+ * Frames from a container are mapped instead of read (with the read-ahead
+ * hinted to the kernel), so they are queued directly. The container index
+ * also lets seek land on a keyframe, fast-forward by keyframes and loop
+ * between loop points in the thread.
+ */
 static void * video_reading_thread(void *args)
 {
 	struct vidcap_import_state 	*s = (struct vidcap_import_state *) args;
-        long index = 0;
+        long index = 0; ///< next frame to be submitted for reading
 
         bool paused = false;
 
-        ///while(index < s->video_frame_count && !s->finish_threads) {
+        struct video_reader_data data_reader[MAX_NUMBER_WORKERS];
+        task_result_handle_t task_handle[MAX_NUMBER_WORKERS];
+        int first = 0; ///< oldest read in flight (index to the arrays above)
+        int in_flight = 0;
+        const int max_in_flight = MIN(s->video_reading_threads_count, s->prefetch);
+
         while(1) {
+                int to_submit = 0;
                 {
                         pthread_mutex_lock(&s->lock);
-                        while((s->queue_len >= BUFFER_LEN_MAX - 1 || index >= s->video_frame_count || paused)
-                                       && s->message_queue.len == 0) {
+                        while((s->queue_len >= s->prefetch || index >= s->video_frame_count || paused)
+                                       && in_flight == 0 && s->message_queue.len == 0) {
                                 if (index >= s->video_frame_count) {
                                         s->finished = true;
                                 }
                                 pthread_cond_wait(&s->worker_cv, &s->lock);
                         }
 
+                        int discarded = 0;
+                        if (s->message_queue.len > 0 && in_flight > 0) {
+                                pthread_mutex_unlock(&s->lock);
+                                discarded = drain_reads(task_handle, &first, &in_flight);
+                                pthread_mutex_lock(&s->lock);
+                        }
+
                         while(s->message_queue.len > 0) {
                                 struct import_message *msg = pop_message(&s->message_queue);
                                 if(msg->type == FINALIZE) {
@@ -939,7 +1386,8 @@ static void * video_reading_thread(void *args)
                                         paused = !paused;
                                         printf("Toggle pause\n");
 
-                                        index -= flush_processed(s->head);
+                                        index -= flush_processed(s->head) + discarded;
+                                        discarded = 0;
                                         s->queue_len = 0;
                                         s->head = s->tail = NULL;
 
@@ -957,64 +1405,76 @@ static void * video_reading_thread(void *args)
                                                 index = data->offset;
                                         }
                                         index = MIN(MAX(0L, index), s->video_frame_count - 1);
+                                        if (s->container != NULL) {
+                                                index = container_keyframe_before(s->container, index);
+                                        }
                                         printf("Current index: frame %ld\n", index);
                                         free(data);
+                                } else if (msg->type == FAST_FORWARD) {
+                                        s->ff_step = *(int *) msg->data;
+                                        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Playback speed %dx%s.\n", s->ff_step,
+                                                        s->ff_step > 1 && s->container != NULL && s->container->keyframes
+                                                        ? " (keyframes only)" : "");
+                                        free(msg->data);
+                                        free(msg);
+                                } else if (msg->type == LOOP_POINTS) {
+                                        const long *points = (const long *) msg->data;
+                                        s->loop_start = MIN(MAX(0L, points[0]), s->video_frame_count - 1);
+                                        s->loop_end = MIN(MAX(s->loop_start + 1, points[1]), s->video_frame_count);
+                                        s->loop_start = container_keyframe_before(s->container, s->loop_start);
+                                        s->loop = true;
+                                        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Looping frames %ld-%ld.\n",
+                                                        s->loop_start + 1, s->loop_end);
+                                        if (index < s->loop_start || index >= s->loop_end) {
+                                                flush_processed(s->head);
+                                                s->queue_len = 0;
+                                                s->head = s->tail = NULL;
+                                                index = s->loop_start;
+                                        }
+                                        free(msg->data);
+                                        free(msg);
                                 } else {
                                         fprintf(stderr, "Unknown message type: %d!\n", msg->type);
                                         abort();
                                 }
                         }
+                        if (!paused) {
+                                to_submit = MIN(max_in_flight - in_flight,
+                                                s->prefetch - s->queue_len - in_flight);
+                                to_submit = MIN(to_submit, s->video_frame_count - index);
+                        }
                         pthread_mutex_unlock(&s->lock);
                 }
 
-                /// @todo are these checks necessary?
-                index = MIN(MAX(0L, index), s->video_frame_count - 1);
-
-                struct video_reader_data data_reader[MAX_NUMBER_WORKERS];
-                task_result_handle_t task_handle[MAX_NUMBER_WORKERS];
-
-                int number_workers = s->video_reading_threads_count;
-                if (index + number_workers >= s->video_frame_count) {
-                        number_workers = s->video_frame_count - index;
-                }
-                // run workers
-                for (int i = 0; i < number_workers; ++i) {
-                        struct video_reader_data *data =
-                                &data_reader[i];
-                        data->o_direct = s->o_direct;
-                        data->tile_count = s->video_desc.tile_count;
-                        data->tile_delim = s->tile_delim;
-                        snprintf(data->file_name_prefix, sizeof(data->file_name_prefix),
-                                        "%s/%08ld", s->directory, index + i + 1);
-                        strncpy(data->file_name_suffix,
-                                        get_codec_file_extension(s->video_desc.color_spec),
-                                        sizeof(data->file_name_suffix));
-                        data->entry = NULL;
-                        task_handle[i] = task_run_async(video_reader_callback, data);
-                }
-
-                // wait for workers to finish
-                for (int i = 0; i < number_workers; ++i) {
-                        struct video_reader_data *data =
-                                (struct video_reader_data *)
-                                wait_task(task_handle[i]);
-                        if (!data || data->entry == NULL)
-                                continue;
-                        {
-                                pthread_mutex_lock(&s->lock);
-                                if(s->head) {
-                                        s->tail->next = data->entry;
-                                        s->tail = data->entry;
-                                } else {
-                                        s->head = s->tail = data->entry;
+                for (int i = 0; i < to_submit && index < s->video_frame_count;
+                                ++i, index = next_frame(s, index)) {
+                        if (s->container != NULL) {
+                                struct video_frame *frame = container_get_frame(s, index);
+                                if (frame != NULL) {
+                                        enqueue_frame(s, frame);
                                 }
-                                s->queue_len += 1;
-
-                                pthread_mutex_unlock(&s->lock);
-                                pthread_cond_signal(&s->boss_cv);
+                                continue;
+                        }
+                        int slot = (first + in_flight) % MAX_NUMBER_WORKERS;
+                        if (!prepare_read(s, index, &data_reader[slot])) {
+                                continue;
                         }
+                        task_handle[slot] = task_run_async(video_reader_callback,
+                                        &data_reader[slot]);
+                        in_flight += 1;
+                }
+
+                if (in_flight == 0) {
+                        continue;
+                }
+                // collect the oldest read
+                struct video_reader_data *data =
+                        (struct video_reader_data *) wait_task(task_handle[first]);
+                first = (first + 1) % MAX_NUMBER_WORKERS;
+                in_flight -= 1;
+                if (data->frame != NULL) {
+                        enqueue_frame(s, data->frame);
                 }
-                index += number_workers;
         }
 
         return NULL;
@@ -1054,11 +1514,6 @@ static void reset_import(struct vidcap_import_state *s)
         }
 }
 
-static void vidcap_import_dispose_video_frame(struct video_frame *frame) {
-        free_entry((struct processed_entry *) frame->callbacks.dispose_udata);
-        vf_free(frame);
-}
-
 static unsigned long long get_req_bytes(struct vidcap_import_state *s) {
         long long int requested_samples = (long long int) (s->audio_state.video_frames_played + 0) *
                 s->audio_frame.sample_rate / s->video_desc.fps - s->audio_state.played_samples;
@@ -1112,14 +1567,8 @@ vidcap_import_grab(void *state, struct audio_frame **audio)
                 pthread_mutex_unlock(&s->lock);
                 pthread_cond_signal(&s->worker_cv);
 
-                ret = vf_alloc_desc(s->video_desc);
-                ret->callbacks.dispose = vidcap_import_dispose_video_frame;
-                ret->callbacks.dispose_udata = current;
-                for (unsigned int i = 0; i < s->video_desc.tile_count; ++i) {
-                        ret->tiles[i].data_len =
-                                current->tiles[i].data_len;
-                        ret->tiles[i].data = current->tiles[i].data;
-                }
+                ret = current->frame;
+                free(current);
         }
 
         // audio
@@ -64,6 +64,7 @@
 #include "ndi_common.h"
 #include "utils/color_out.h"
 #include "utils/macros.h" // OPTIMIZED_FOR
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_capture.h"
 
@@ -97,6 +98,11 @@ struct vidcap_state_ndi {
 
         NDIlib_video_frame_v2_t field_0{}; ///< stored to asssemble interleaved interlaced video together with field 1
 
+        /// output frames for formats that need conversion or field weaving,
+        /// the other are passed wrapping the NDI buffer
+        video_frame_pool pool;
+        struct video_desc pool_desc{};
+
         string requested_name; // if not empty recv from requested NDI name
         string requested_url; // if not empty recv from requested URL (either addr or addr:port)
         NDIlib_find_create_t find_create_settings{true, nullptr, nullptr};
@@ -526,7 +532,11 @@ static struct video_frame *vidcap_ndi_grab(void *state, struct audio_frame **aud
                 }
 
                 if (convert != nullptr) {
-                        out = vf_alloc_desc_data(out_desc);
+                        if (!video_desc_eq(out_desc, s->pool_desc)) {
+                                s->pool.reconfigure(out_desc, vc_get_datalen(out_desc.width, out_desc.height, out_desc.color_spec));
+                                s->pool_desc = out_desc;
+                        }
+                        out = s->pool.get_disposable_frame();
                         int stride = video_frame.line_stride_in_bytes != 0 ? video_frame.line_stride_in_bytes : vc_get_linesize(video_frame.xres, out_desc.color_spec);
                         int field_count = video_frame.frame_format_type == NDIlib_frame_format_type_field_1 ? 2 : 1;
                         if (field_count > 1) {
@@ -542,7 +552,6 @@ static struct video_frame *vidcap_ndi_grab(void *state, struct audio_frame **aud
                                 convert(out, video_frame.p_data, stride, 0, 1);
                         }
                         s->NDIlib->recv_free_video_v2(s->pNDI_recv, &video_frame);
-                        out->callbacks.dispose = vf_free;
                 } else {
                         out = vf_alloc_desc(out_desc);
                         out->tiles[0].data = reinterpret_cast<char*>(video_frame.p_data);
@@ -40,12 +40,14 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <cinttypes>
 #include <iostream>
 #include <chrono>
 #include <cassert>
 #include <algorithm>
 #include <vector>
 #include <mutex>
+#include <set>
 #include <unistd.h>
 #include <pipewire/pipewire.h>
 #include <pipewire/version.h>
@@ -55,9 +57,11 @@
 #include <spa/debug/types.h>
 
 #include "debug.h"
+#include "hwaccel_drm.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
 #include "utils/dbus_portal.hpp"
+#include "utils/macros.h"
 #include "utils/synchronized_queue.h"
 #include "utils/profile_timer.hpp"
 #include "video_frame.h"
@@ -74,9 +78,27 @@ static constexpr int MAX_BUFFERS_PW = 10;
 static constexpr int QUEUE_SIZE = 3;
 static constexpr int DEFAULT_EXPECTING_FPS = 30;
 
+// DRM format modifiers from drm_fourcc.h (not to depend on libdrm headers)
+static constexpr uint64_t MOD_LINEAR = 0;
+static constexpr uint64_t MOD_INVALID = 0x00ffffffffffffffULL;
+
+static constexpr uint32_t drm_fourcc(char a, char b, char c, char d){
+        return (uint32_t) a | (uint32_t) b << 8U | (uint32_t) c << 16U | (uint32_t) d << 24U;
+}
+
 struct frame_deleter{ void operator()(video_frame *f){ vf_free(f); } };
 using unique_frame = std::unique_ptr<video_frame, frame_deleter>;
 
+/**
+ * Tile data of a DRM_PRIME frame. Consumers see only the drm_prime_frame,
+ * the PipeWire buffer holding the dmabufs is lent to the frame until it
+ * is returned to the stream by return_lent_buffer().
+ */
+struct pw_dmabuf_frame {
+        drm_prime_frame drm;
+        pw_buffer *buffer;
+};
+
 struct vcap_pw_state { 
         pipewire_state_common pw;
 
@@ -98,6 +120,10 @@ struct vcap_pw_state {
         pw_stream_uniq stream;
         spa_hook_uniq stream_listener;
         struct spa_video_info format = {};
+        bool format_has_modifier = false;
+
+        /// buffers currently lent to DRM_PRIME frames, guarded by the pw loop lock
+        std::set<pw_buffer *> lent_buffers;
 
         enum class Mode {
                 Generic,
@@ -109,6 +135,7 @@ struct vcap_pw_state {
                 std::string restore_file = "";
                 uint32_t fps = 0;
                 bool crop = true;
+                bool dmabuf = false;
                 std::string target = "";
         } user_options;
 
@@ -124,6 +151,22 @@ static void on_stream_state_changed(void * /*state*/, enum pw_stream_state old,
 }
 
 
+/**
+ * @returns DRM fourcc of the PipeWire format, 0 if there is no equivalent
+ * (SPA formats name the byte order, DRM ones a little-endian word)
+ */
+static uint32_t drm_fourcc_from_pw_fmt(spa_video_format fmt){
+        switch(fmt){
+        case SPA_VIDEO_FORMAT_BGRx: return drm_fourcc('X', 'R', '2', '4');
+        case SPA_VIDEO_FORMAT_BGRA: return drm_fourcc('A', 'R', '2', '4');
+        case SPA_VIDEO_FORMAT_RGBx: return drm_fourcc('X', 'B', '2', '4');
+        case SPA_VIDEO_FORMAT_RGBA: return drm_fourcc('A', 'B', '2', '4');
+        case SPA_VIDEO_FORMAT_UYVY: return drm_fourcc('U', 'Y', 'V', 'Y');
+        case SPA_VIDEO_FORMAT_YUY2: return drm_fourcc('Y', 'U', 'Y', 'V');
+        default: return 0;
+        }
+}
+
 static void on_stream_param_changed(void *state, uint32_t id, const struct spa_pod *param) {
         auto s = static_cast<vcap_pw_state *>(state);
         LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "param changed:\n";
@@ -143,8 +186,12 @@ static void on_stream_param_changed(void *state, uint32_t id, const struct spa_p
 
         auto& raw_format = s->format.info.raw;
         spa_format_video_raw_parse(param, &raw_format);
+        s->format_has_modifier = spa_pod_find_prop(param, nullptr, SPA_FORMAT_VIDEO_modifier) != nullptr;
 
         log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Got format: %s\n", spa_debug_type_find_name(spa_type_video_format, raw_format.format));
+        if (s->format_has_modifier) {
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Using DMA-BUF buffers, modifier 0x%" PRIx64 "\n", raw_format.modifier);
+        }
 
         s->desc.width = raw_format.size.width;
         s->desc.height = raw_format.size.height;
@@ -176,16 +223,29 @@ static void on_stream_param_changed(void *state, uint32_t id, const struct spa_p
         const struct spa_pod *params[3] = {};
         int n_params = 0;
 
-        params[n_params++] = static_cast<spa_pod *>(spa_pod_builder_add_object(&builder,
-                SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
-                SPA_PARAM_BUFFERS_buffers,
-                SPA_POD_CHOICE_RANGE_Int(DEFAULT_BUFFERS_PW, MIN_BUFFERS_PW, MAX_BUFFERS_PW),
-                SPA_PARAM_BUFFERS_blocks, SPA_POD_Int(1),
-                SPA_PARAM_BUFFERS_size, SPA_POD_Int(size),
-                SPA_PARAM_BUFFERS_stride, SPA_POD_Int(linesize),
-                SPA_PARAM_BUFFERS_dataType,
-                SPA_POD_CHOICE_FLAGS_Int((1 << SPA_DATA_MemPtr)))
-        );
+        if (s->format_has_modifier) {
+                /* Up to QUEUE_SIZE buffers may be lent to frames, keep at
+                 * least one for the producer. Size and stride of the dmabufs
+                 * are given by the producer (modifier dependent). */
+                params[n_params++] = static_cast<spa_pod *>(spa_pod_builder_add_object(&builder,
+                        SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+                        SPA_PARAM_BUFFERS_buffers,
+                        SPA_POD_CHOICE_RANGE_Int(QUEUE_SIZE + 1, MIN_BUFFERS_PW, MAX_BUFFERS_PW),
+                        SPA_PARAM_BUFFERS_dataType,
+                        SPA_POD_CHOICE_FLAGS_Int((1 << SPA_DATA_DmaBuf)))
+                );
+        } else {
+                params[n_params++] = static_cast<spa_pod *>(spa_pod_builder_add_object(&builder,
+                        SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+                        SPA_PARAM_BUFFERS_buffers,
+                        SPA_POD_CHOICE_RANGE_Int(DEFAULT_BUFFERS_PW, MIN_BUFFERS_PW, MAX_BUFFERS_PW),
+                        SPA_PARAM_BUFFERS_blocks, SPA_POD_Int(1),
+                        SPA_PARAM_BUFFERS_size, SPA_POD_Int(size),
+                        SPA_PARAM_BUFFERS_stride, SPA_POD_Int(linesize),
+                        SPA_PARAM_BUFFERS_dataType,
+                        SPA_POD_CHOICE_FLAGS_Int((1 << SPA_DATA_MemPtr)))
+                );
+        }
         
         if(s->user_options.crop) {
                 params[n_params++] = static_cast<spa_pod *>(spa_pod_builder_add_object(&builder,
@@ -240,6 +300,71 @@ static void pw_frame_to_uv_frame_memcpy(video_frame *dst, spa_buffer *src, spa_v
         dst->tiles[0].data_len = linesize * height;
 }
 
+/**
+ * Fills a DRM_PRIME frame with the dmabufs of the PipeWire buffer without
+ * touching the pixels. The buffer stays lent to the frame.
+ */
+static bool pw_frame_to_uv_frame_dmabuf(vcap_pw_state *s, video_frame *dst, pw_buffer *buffer, const spa_region *crop){
+        auto& raw_format = s->format.info.raw;
+        spa_buffer *src = buffer->buffer;
+
+        auto out = reinterpret_cast<pw_dmabuf_frame *>(dst->tiles[0].data);
+        memset(out, 0, sizeof *out);
+        out->drm.in_fence_fd = -1;
+        out->drm.drm_format = drm_fourcc_from_pw_fmt(raw_format.format);
+        if (out->drm.drm_format == 0 || src->n_datas > 4) {
+                log_msg_once(LOG_LEVEL_ERROR, to_fourcc('P', 'W', 'D', 'F'), MOD_NAME "Unsupported DMA-BUF format %s!\n",
+                                spa_debug_type_find_name(spa_type_video_format, raw_format.format));
+                return false;
+        }
+
+        out->drm.fd_count = out->drm.planes = src->n_datas;
+        for (unsigned i = 0; i < src->n_datas; i++) {
+                out->drm.dmabuf_fds[i] = src->datas[i].fd;
+                out->drm.fd_indices[i] = i;
+                out->drm.pitches[i] = src->datas[i].chunk->stride;
+                out->drm.offsets[i] = src->datas[i].chunk->offset;
+                out->drm.modifiers[i] = raw_format.modifier;
+        }
+
+        unsigned width = raw_format.size.width;
+        unsigned height = raw_format.size.height;
+        if (crop) {
+                out->drm.offsets[0] += crop->position.y * out->drm.pitches[0]
+                        + vc_get_linesize(crop->position.x, uv_codec_from_pw_fmt(raw_format.format));
+                width = crop->size.width;
+                height = crop->size.height;
+        }
+
+        out->buffer = buffer;
+        s->lent_buffers.insert(buffer);
+
+        dst->tiles[0].width = width;
+        dst->tiles[0].height = height;
+        dst->tiles[0].data_len = sizeof(drm_prime_frame);
+        return true;
+}
+
+/**
+ * Returns the PipeWire buffer lent to a DRM_PRIME frame back to the stream
+ * (unless it was removed by renegotiation meanwhile).
+ */
+static void return_lent_buffer(vcap_pw_state *s, video_frame *f){
+        if (f->color_spec != DRM_PRIME) {
+                return;
+        }
+        auto lent = reinterpret_cast<pw_dmabuf_frame *>(f->tiles[0].data);
+        if (lent->buffer == nullptr) {
+                return;
+        }
+
+        pipewire_thread_loop_lock_guard lock(s->pw.pipewire_loop.get());
+        if (s->lent_buffers.erase(lent->buffer) > 0) {
+                pw_stream_queue_buffer(s->stream.get(), lent->buffer);
+        }
+        lent->buffer = nullptr;
+}
+
 static void on_process(void *state) {
         PROFILE_FUNC;
 
@@ -253,10 +378,13 @@ static void on_process(void *state) {
                 
                 assert(buffer->buffer != nullptr);
                 assert(buffer->buffer->datas != nullptr);
-                assert(buffer->buffer->n_datas == 1);
-                assert(buffer->buffer->datas[0].data != nullptr);
+                const bool dmabuf = buffer->buffer->datas[0].type == SPA_DATA_DmaBuf;
+                assert(dmabuf || buffer->buffer->n_datas == 1);
+                assert(dmabuf || buffer->buffer->datas[0].data != nullptr);
 
-                if(buffer->buffer->datas[0].chunk == nullptr || buffer->buffer->datas[0].chunk->size == 0) {
+                // some producers do not fill chunk size of dmabufs
+                if(buffer->buffer->datas[0].chunk == nullptr || (!dmabuf && buffer->buffer->datas[0].chunk->size == 0)
+                                || (buffer->buffer->datas[0].chunk->flags & SPA_CHUNK_FLAG_CORRUPTED) != 0) {
                         LOG(LOG_LEVEL_DEBUG) << MOD_NAME "dropping - empty pw frame " << "\n";
                         pw_stream_queue_buffer(s->stream.get(), buffer);
                         continue;
@@ -283,6 +411,12 @@ static void on_process(void *state) {
                            crop_region = &meta_crop_region->region;
                 }
 
+                // cropping a dmabuf by offset is possible only within a linear single-plane buffer
+                if (crop_region && dmabuf && (s->format.info.raw.modifier != MOD_LINEAR || buffer->buffer->n_datas != 1)) {
+                        log_msg_once(LOG_LEVEL_WARNING, to_fourcc('P', 'W', 'D', 'C'), MOD_NAME "Cannot crop tiled DMA-BUF, passing the whole buffer.\n");
+                        crop_region = nullptr;
+                }
+
                 if(crop_region){
                         //Update desc so that we don't reallocate on each frame
                         //TODO: Figure what to do when we can't actually crop (MJPEG)
@@ -290,11 +424,31 @@ static void on_process(void *state) {
                         s->desc.height = crop_region->size.height;
                 }
 
-                if(!next_frame || !video_desc_eq(video_desc_from_frame(next_frame.get()), s->desc)){
+                video_desc desc = s->desc;
+                if (dmabuf) {
+                        desc.color_spec = DRM_PRIME;
+                }
+                if(!next_frame || !video_desc_eq(video_desc_from_frame(next_frame.get()), desc)){
                         log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Desc changed, allocating new video_frame\n");
-                        next_frame.reset(vf_alloc_desc_data(s->desc));
+                        if (dmabuf) {
+                                next_frame.reset(vf_alloc_desc(desc));
+                                next_frame->tiles[0].data = static_cast<char *>(calloc(1, sizeof(pw_dmabuf_frame)));
+                                next_frame->callbacks.data_deleter = vf_data_deleter;
+                        } else {
+                                next_frame.reset(vf_alloc_desc_data(desc));
+                        }
                 }
 
+                if (dmabuf) {
+                        if (pw_frame_to_uv_frame_dmabuf(s, next_frame.get(), buffer, crop_region)) {
+                                s->sending_frames.push(std::move(next_frame));
+                        } else {
+                                pw_stream_queue_buffer(s->stream.get(), buffer);
+                                std::lock_guard<std::mutex> lock(s->mut);
+                                s->blank_frames.push_back(std::move(next_frame));
+                        }
+                        continue;
+                }
 
                 auto& raw_format = s->format.info.raw;
 
@@ -319,9 +473,11 @@ static void on_add_buffer(void * /*state*/, struct pw_buffer *)
         LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "pipewire: add_buffer\n";
 }
 
-static void on_remove_buffer(void * /*state*/, struct pw_buffer *)
+static void on_remove_buffer(void *state, struct pw_buffer *buffer)
 {
         LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "pipewire: remove_buffer\n";
+        // the frame still holding the buffer must not queue it back
+        static_cast<vcap_pw_state *>(state)->lent_buffers.erase(buffer);
 }
 
 static const struct pw_stream_events stream_events = {
@@ -392,22 +548,57 @@ static int start_pipewire(vcap_pw_state *s)
         auto framerate_min = SPA_FRACTION(0, 1);
         auto framerate_max = SPA_FRACTION(600, 1);
 
-        const int n_params = 1;
-        params[0] = static_cast<spa_pod *> (spa_pod_builder_add_object(
-                        &pod_builder, SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+        /* With dmabuf, the first (preferred) format requires the modifier
+         * property, so producers not able to export DMA-BUFs fall back to the
+         * second one with memory buffers. Linear and implicit modifiers are
+         * offered - those can be imported by any consumer of DRM_PRIME. */
+        int n_params = 0;
+        for (bool with_modifier : { true, false }) {
+                if (with_modifier && !s->user_options.dmabuf) {
+                        continue;
+                }
+                struct spa_pod_frame object_frame;
+                spa_pod_builder_push_object(&pod_builder, &object_frame, SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat);
+                spa_pod_builder_add(&pod_builder,
                         SPA_FORMAT_mediaType, SPA_POD_Id(SPA_MEDIA_TYPE_video),
                         SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
-                        SPA_FORMAT_VIDEO_format,
-                        SPA_POD_CHOICE_ENUM_Id(8, 
-                                SPA_VIDEO_FORMAT_UYVY,
-                                SPA_VIDEO_FORMAT_UYVY,
-                                SPA_VIDEO_FORMAT_RGB,
-                                SPA_VIDEO_FORMAT_RGBA,
-                                SPA_VIDEO_FORMAT_RGBx,
-                                SPA_VIDEO_FORMAT_YUY2,
-                                SPA_VIDEO_FORMAT_BGRA,
-                                SPA_VIDEO_FORMAT_BGRx
-                                ),
+                        0);
+                if (with_modifier) {
+                        spa_pod_builder_add(&pod_builder,
+                                SPA_FORMAT_VIDEO_format,
+                                SPA_POD_CHOICE_ENUM_Id(7,
+                                        SPA_VIDEO_FORMAT_BGRx,
+                                        SPA_VIDEO_FORMAT_BGRx,
+                                        SPA_VIDEO_FORMAT_BGRA,
+                                        SPA_VIDEO_FORMAT_RGBx,
+                                        SPA_VIDEO_FORMAT_RGBA,
+                                        SPA_VIDEO_FORMAT_UYVY,
+                                        SPA_VIDEO_FORMAT_YUY2
+                                        ),
+                                0);
+                        struct spa_pod_frame choice_frame;
+                        spa_pod_builder_prop(&pod_builder, SPA_FORMAT_VIDEO_modifier, SPA_POD_PROP_FLAG_MANDATORY);
+                        spa_pod_builder_push_choice(&pod_builder, &choice_frame, SPA_CHOICE_Enum, 0);
+                        spa_pod_builder_long(&pod_builder, MOD_LINEAR);
+                        spa_pod_builder_long(&pod_builder, MOD_LINEAR);
+                        spa_pod_builder_long(&pod_builder, MOD_INVALID);
+                        spa_pod_builder_pop(&pod_builder, &choice_frame);
+                } else {
+                        spa_pod_builder_add(&pod_builder,
+                                SPA_FORMAT_VIDEO_format,
+                                SPA_POD_CHOICE_ENUM_Id(8,
+                                        SPA_VIDEO_FORMAT_UYVY,
+                                        SPA_VIDEO_FORMAT_UYVY,
+                                        SPA_VIDEO_FORMAT_RGB,
+                                        SPA_VIDEO_FORMAT_RGBA,
+                                        SPA_VIDEO_FORMAT_RGBx,
+                                        SPA_VIDEO_FORMAT_YUY2,
+                                        SPA_VIDEO_FORMAT_BGRA,
+                                        SPA_VIDEO_FORMAT_BGRx
+                                        ),
+                                0);
+                }
+                spa_pod_builder_add(&pod_builder,
                         SPA_FORMAT_VIDEO_size,
                         SPA_POD_CHOICE_RANGE_Rectangle(
                                         &size_rect_def,
@@ -417,9 +608,12 @@ static int start_pipewire(vcap_pw_state *s)
                         SPA_POD_CHOICE_RANGE_Fraction(
                                         &framerate_def,
                                         &framerate_min,
-                                        &framerate_max)
-        ));
+                                        &framerate_max),
+                        0);
+                params[n_params++] = static_cast<spa_pod *>(spa_pod_builder_pop(&pod_builder, &object_frame));
+        }
 
+        // dmabufs are not mapped (MAP_BUFFERS maps only mappable ones)
         auto flags = PW_STREAM_FLAG_MAP_BUFFERS |
                 PW_STREAM_FLAG_DONT_RECONNECT;
 
@@ -466,9 +660,10 @@ static void show_screen_help() {
         };
 
         std::cout << "Screen capture using PipeWire and ScreenCast freedesktop portal API\n";
-        std::cout << "Usage: -t screen_pw[:cursor|:nocrop|:fps=<fps>|:restore=<token_file>]]\n";
+        std::cout << "Usage: -t screen_pw[:cursor|:nocrop|:dmabuf|:fps=<fps>|:restore=<token_file>]]\n";
         param("cursor") << "make the cursor visible (default hidden)\n";
         param("nocrop") << "when capturing a window do not crop out the empty background\n";
+        param("dmabuf") << "negotiate DMA-BUF buffers and pass them as DRM_PRIME frames without a copy\n\t\t(only for consumers able to import DRM_PRIME, eg. -d drm)\n";
         param("<fps>") << "prefered FPS passed to PipeWire (PipeWire may ignore it)\n";
         param("<token_file>") << "restore the selected window/display from a file.\n\t\tIf not possible, display the selection dialog and save the token to the file specified.\n";
 }
@@ -476,7 +671,9 @@ static void show_screen_help() {
 static void show_generic_help(){
         color_printf("Pipewire video capture.\n");
         color_printf("Usage\n");
-        color_printf(TERM_BOLD TERM_FG_RED "\t-t pipewire" TERM_FG_RESET "[:fps=<fps>][:target=<device>]\n" TERM_RESET);
+        color_printf(TERM_BOLD TERM_FG_RED "\t-t pipewire" TERM_FG_RESET "[:fps=<fps>][:target=<device>][:dmabuf]\n" TERM_RESET);
+        color_printf("\n");
+        color_printf(TERM_BOLD "\tdmabuf" TERM_RESET " - negotiate DMA-BUF buffers and pass them as DRM_PRIME frames without a copy\n");
         color_printf("\n");
 
         color_printf("Devices:\n");
@@ -500,6 +697,8 @@ static int parse_params(struct vidcap_params *params, vcap_pw_state *s) {
                                 s->user_options.show_cursor = true;
                         } else if (param == "nocrop") {
                                 s->user_options.crop = false;
+                        } else if (param == "dmabuf") {
+                                s->user_options.dmabuf = true;
                         } else {
                                 auto split_index = param.find('=');
                                 if(split_index != std::string::npos && split_index != 0){
@@ -603,6 +802,13 @@ static void vidcap_screen_pw_done(void *state)
 
         {
                 pipewire_thread_loop_lock_guard lock(s->pw.pipewire_loop.get());
+                // lent buffers must be returned while the stream still exists
+                if (s->in_flight_frame) {
+                        return_lent_buffer(s, s->in_flight_frame.get());
+                }
+                while (unique_frame f = s->sending_frames.pop(true)) {
+                        return_lent_buffer(s, f.get());
+                }
                 pw_stream_disconnect(s->stream.get());
         }
 
@@ -620,6 +826,8 @@ static struct video_frame *vidcap_screen_pw_grab(void *state, struct audio_frame
         *audio = nullptr;
    
         if(s->in_flight_frame.get() != nullptr){
+                return_lent_buffer(s, s->in_flight_frame.get());
+                std::lock_guard<std::mutex> lock(s->mut);
                 s->blank_frames.push_back(std::move(s->in_flight_frame));
         }
 
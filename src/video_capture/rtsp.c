@@ -199,6 +199,7 @@ struct video_rtsp_state {
 
     unsigned int h264_offset_len;
     unsigned char *h264_offset_buffer;
+    int frame_buf_len; ///< capacity of the reassembled H.264 frames
 
     int pt;
 };
@@ -300,6 +301,18 @@ int decode_frame_by_pt(struct coded_data *cdata, void *decode_data, struct pbuf_
     }
 }
 
+static void rtsp_frame_data_deleter(struct video_frame *frame) {
+    aligned_free(frame->tiles[0].data);
+}
+
+static struct video_frame *alloc_frame(struct video_rtsp_state *s) {
+    struct video_frame *frame = vf_alloc_desc(s->desc);
+    frame->tiles[0].data = (char *) aligned_malloc(s->frame_buf_len + MAX_PADDING, 64);
+    assert(frame->tiles[0].data != NULL);
+    frame->callbacks.data_deleter = rtsp_frame_data_deleter;
+    return frame;
+}
+
 static void *
 vidcap_rtsp_thread(void *arg) {
     struct rtsp_state *s;
@@ -307,7 +320,9 @@ vidcap_rtsp_thread(void *arg) {
 
     time_ns_t start_time = get_time_in_ns();
 
-    struct video_frame *frame = vf_alloc_desc_data(s->vrtsp_state.desc);
+    // initial estimate, grown if a frame doesn't fit
+    s->vrtsp_state.frame_buf_len = MAX((int) (s->vrtsp_state.desc.width * s->vrtsp_state.desc.height), 1000 * 1000);
+    struct video_frame *frame = alloc_frame(&s->vrtsp_state);
 
     while (!s->should_exit) {
         time_ns_t curr_time = get_time_in_ns();
@@ -326,10 +341,19 @@ vidcap_rtsp_thread(void *arg) {
             while (cp != NULL) {
                 struct decode_data_h264 d;
                 d.frame = frame;
+                d.buffer_len = s->vrtsp_state.frame_buf_len;
+                d.offset_buffer = s->vrtsp_state.h264_offset_buffer;
                 d.offset_len = s->vrtsp_state.h264_offset_len;
                 d.video_pt = s->vrtsp_state.pt;
-                if (pbuf_decode(cp->playout_buffer, curr_time,
-                            decode_frame_by_pt, &d))
+                d.needed_len = 0;
+                _Bool decoded = pbuf_decode(cp->playout_buffer, curr_time,
+                            decode_frame_by_pt, &d);
+                if (d.needed_len > 0) { // too small, enlarge for next frames
+                    s->vrtsp_state.frame_buf_len = MAX(d.needed_len, 2 * s->vrtsp_state.frame_buf_len);
+                    vf_free(frame);
+                    frame = alloc_frame(&s->vrtsp_state);
+                }
+                if (decoded)
                 {
                     pthread_mutex_lock(&s->vrtsp_state.lock);
                     while (s->vrtsp_state.out_frame != NULL && !s->should_exit) {
@@ -339,7 +363,7 @@ vidcap_rtsp_thread(void *arg) {
                     }
                     if (s->vrtsp_state.out_frame == NULL) {
                         s->vrtsp_state.out_frame = frame;
-                        frame = vf_alloc_desc_data(s->vrtsp_state.desc); // alloc new
+                        frame = alloc_frame(&s->vrtsp_state); // alloc new
                         if (s->vrtsp_state.boss_waiting)
                             pthread_cond_signal(&s->vrtsp_state.boss_cv);
                         pthread_mutex_unlock(&s->vrtsp_state.lock);
@@ -416,10 +440,6 @@ vidcap_rtsp_grab(void *state, struct audio_frame **audio) {
             pthread_mutex_unlock(&s->vrtsp_state.lock);
             pthread_cond_signal(&s->vrtsp_state.worker_cv);
 
-            if(s->vrtsp_state.h264_offset_len>0 && frame->frame_type == INTRA){
-                    memcpy(frame->tiles[0].data, s->vrtsp_state.h264_offset_buffer, s->vrtsp_state.h264_offset_len);
-            }
-
             if (s->vrtsp_state.decompress) {
                 struct video_desc curr_desc = video_desc_from_frame(frame);
                 curr_desc.color_spec = H264;
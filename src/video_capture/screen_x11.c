@@ -35,8 +35,14 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 /**
- * @todo
- * The XGetImage() is a bit slow, consider using XShm as OBS does.
+ * @file
+ * The screen is grabbed with XShmGetImage() into a small pool of shared
+ * memory segments if MIT-SHM is available (local display), otherwise with
+ * XGetImage(). Grabbing runs in a separate thread so that it overlaps
+ * with the processing of the previous frame.
+ *
+ * With XDamage, frames where neither the screen nor the cursor changed
+ * may be skipped (option "damage").
  */
 
 #ifdef HAVE_CONFIG_H
@@ -66,10 +72,20 @@
 #ifdef HAVE_XFIXES
 #include <X11/extensions/Xfixes.h>
 #endif // HAVE_XFIXES
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif // HAVE_XSHM
+#ifdef HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#endif // HAVE_XDAMAGE
 #include <X11/Xutil.h>
 
 #define MOD_NAME "[screen capture] "
 #define QUEUE_SIZE_MAX 3
+#define DAMAGE_POLL_US 5000
+#define DAMAGE_KEEPALIVE_NS NS_IN_SEC ///< send at least 1 frame per second even if unchanged
 
 /* prototypes of functions defined in this module */
 static void show_help(void);
@@ -79,16 +95,27 @@ static void show_help()
 {
         printf("Screen capture\n");
         printf("Usage\n");
-        printf("\t-t screen[:fps=<fps>][:display=<d>][:geometry=WxH[+x[+y]]|:size=WxH]\n");
+        printf("\t-t screen[:fps=<fps>][:display=<d>][:geometry=WxH[+x[+y]]|:size=WxH][:noshm][:damage]\n");
         printf("\t\t<fps> - preferred grabbing fps (otherwise unlimited)\n");
         printf("\t\tdisplay - display to capture (including the colon!)\n");
         printf("\t\tgeomoetry | size - viewport to use (both option mean the same - size is just a convenient name)\n");
+        printf("\t\tnoshm - do not use MIT-SHM extension (XGetImage is used)\n");
+        printf("\t\tdamage - skip frames if the screen didn't change (XDamage)\n");
+#ifndef HAVE_XSHM
+        printf("\t\t\t(compiled without MIT-SHM support)\n");
+#endif
+#ifndef HAVE_XDAMAGE
+        printf("\t\t\t(compiled without XDamage support)\n");
+#endif
 }
 
 struct grabbed_data;
 
 struct grabbed_data {
         XImage *data;
+#ifdef HAVE_XSHM
+        XShmSegmentInfo shm; ///< shmaddr is NULL if not using SHM
+#endif
         struct grabbed_data *next;
 };
 
@@ -101,6 +128,16 @@ struct vidcap_screen_x11_state {
 
         struct grabbed_data * volatile head, * volatile tail;
         volatile int queue_len;
+        struct grabbed_data *free_items; ///< SHM images to be reused
+
+        bool use_shm;
+        bool use_damage;
+#ifdef HAVE_XDAMAGE
+        Damage damage;
+        int damage_event_base;
+#endif
+        time_ns_t last_grab_time;
+        int last_cursor_x, last_cursor_y;
 
         pthread_mutex_t lock;
         pthread_cond_t worker_cv;
@@ -168,29 +205,190 @@ static bool initialize(struct vidcap_screen_x11_state *s) {
 
         s->tile->data = (char *) malloc(s->tile->data_len);
 
+#ifdef HAVE_XSHM
+        if (s->use_shm && !XShmQueryExtension(s->dpy)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "MIT-SHM not available, using XGetImage.\n");
+                s->use_shm = false;
+        }
+#else
+        s->use_shm = false;
+#endif
+        if (s->use_damage) {
+#ifdef HAVE_XDAMAGE
+                int error_base = 0;
+                if (XDamageQueryExtension(s->dpy, &s->damage_event_base, &error_base)) {
+                        s->damage = XDamageCreate(s->dpy, s->root, XDamageReportNonEmpty);
+                } else {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "XDamage not available, grabbing all frames.\n");
+                        s->use_damage = false;
+                }
+#else
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Compiled without XDamage, grabbing all frames.\n");
+                s->use_damage = false;
+#endif
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using %s%s.\n", s->use_shm ? "XShmGetImage" : "XGetImage",
+                        s->use_damage ? " with XDamage" : "");
+
         pthread_create(&s->worker_id, NULL, grab_thread, s);
 
         return true;
 }
 
 
+#ifdef HAVE_XSHM
+static bool shm_attach_failed;
+
+static int shm_error_handler(Display *dpy, XErrorEvent *ev)
+{
+        (void) dpy, (void) ev;
+        shm_attach_failed = true;
+        return 0;
+}
+
+/// @returns SHM image or NULL on failure (eg. remote X server)
+static struct grabbed_data *alloc_shm_item(struct vidcap_screen_x11_state *s)
+{
+        struct grabbed_data *item = calloc(1, sizeof *item);
+        const int screen = DefaultScreen(s->dpy);
+        item->data = XShmCreateImage(s->dpy, DefaultVisual(s->dpy, screen), DefaultDepth(s->dpy, screen),
+                        ZPixmap, NULL, &item->shm, s->tile->width, s->tile->height);
+        if (item->data == NULL) {
+                free(item);
+                return NULL;
+        }
+        item->shm.shmid = shmget(IPC_PRIVATE, (size_t) item->data->bytes_per_line * item->data->height, IPC_CREAT | 0600);
+        if (item->shm.shmid == -1) {
+                XDestroyImage(item->data);
+                free(item);
+                return NULL;
+        }
+        item->shm.shmaddr = item->data->data = shmat(item->shm.shmid, NULL, 0);
+        item->shm.readOnly = False;
+
+        shm_attach_failed = false;
+        XErrorHandler prev_handler = XSetErrorHandler(shm_error_handler);
+        bool attached = item->shm.shmaddr != (char *) -1 && XShmAttach(s->dpy, &item->shm);
+        XSync(s->dpy, False);
+        XSetErrorHandler(prev_handler);
+        shmctl(item->shm.shmid, IPC_RMID, NULL); // destroyed after both sides detach
+
+        if (!attached || shm_attach_failed) {
+                if (item->shm.shmaddr != (char *) -1) {
+                        shmdt(item->shm.shmaddr);
+                }
+                XDestroyImage(item->data);
+                free(item);
+                return NULL;
+        }
+        return item;
+}
+#endif // HAVE_XSHM
+
+static void free_item(struct vidcap_screen_x11_state *s, struct grabbed_data *item)
+{
+#ifdef HAVE_XSHM
+        if (item->shm.shmaddr != NULL) {
+                XShmDetach(s->dpy, &item->shm);
+                XDestroyImage(item->data); // doesn't free SHM data
+                shmdt(item->shm.shmaddr);
+                free(item);
+                return;
+        }
+#endif
+        (void) s;
+        XDestroyImage(item->data);
+        free(item);
+}
+
+/// grabs the screen into a reused SHM image or a newly allocated one
+static struct grabbed_data *grab_image(struct vidcap_screen_x11_state *s)
+{
+#ifdef HAVE_XSHM
+        if (s->use_shm) {
+                pthread_mutex_lock(&s->lock);
+                struct grabbed_data *item = s->free_items;
+                if (item != NULL) {
+                        s->free_items = item->next;
+                }
+                pthread_mutex_unlock(&s->lock);
+                if (item == NULL) {
+                        item = alloc_shm_item(s);
+                }
+                if (item != NULL && XShmGetImage(s->dpy, s->root, item->data, s->x, s->y, AllPlanes)) {
+                        return item;
+                }
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot use MIT-SHM, falling back to XGetImage.\n");
+                s->use_shm = false;
+                if (item != NULL) {
+                        free_item(s, item);
+                }
+        }
+#endif
+        struct grabbed_data *new_item = calloc(1, sizeof(struct grabbed_data));
+        new_item->data = XGetImage(s->dpy,s->root, s->x, s->y, s->tile->width, s->tile->height, AllPlanes, ZPixmap);
+        assert(new_item->data != NULL);
+        return new_item;
+}
+
+/**
+ * @returns true if the screen (or cursor position) changed since the last
+ * grab or if the keepalive interval elapsed
+ */
+static bool screen_changed(struct vidcap_screen_x11_state *s, int cursor_x, int cursor_y)
+{
+        if (!s->use_damage) {
+                return true;
+        }
+        bool changed = cursor_x != s->last_cursor_x || cursor_y != s->last_cursor_y ||
+                get_time_in_ns() - s->last_grab_time > DAMAGE_KEEPALIVE_NS;
+#ifdef HAVE_XDAMAGE
+        while (XPending(s->dpy) > 0) {
+                XEvent ev;
+                XNextEvent(s->dpy, &ev);
+                if (ev.type == s->damage_event_base + XDamageNotify) {
+                        changed = true;
+                }
+        }
+        if (changed) {
+                XDamageSubtract(s->dpy, s->damage, None, None);
+        }
+#endif
+        return changed;
+}
+
 static void *grab_thread(void *args)
 {
         struct vidcap_screen_x11_state *s = args;
 
         while(!s->should_exit_worker) {
-                struct grabbed_data *new_item = malloc(sizeof(struct grabbed_data));
-
+                int cursor_x = 0;
+                int cursor_y = 0;
 #ifdef HAVE_XFIXES
                 XFixesCursorImage *cursor =
                         XFixesGetCursorImage (s->dpy);
+                if (cursor) {
+                        cursor_x = cursor->x;
+                        cursor_y = cursor->y;
+                }
+#endif // HAVE_XFIXES
+                if (!screen_changed(s, cursor_x, cursor_y)) {
+#ifdef HAVE_XFIXES
+                        XFree(cursor);
 #endif // HAVE_XFIXES
-                new_item->data = XGetImage(s->dpy,s->root, s->x, s->y, s->tile->width, s->tile->height, AllPlanes, ZPixmap);
-                assert(new_item->data != NULL);
+                        usleep(DAMAGE_POLL_US);
+                        continue;
+                }
+                s->last_cursor_x = cursor_x;
+                s->last_cursor_y = cursor_y;
+                s->last_grab_time = get_time_in_ns();
+
+                struct grabbed_data *new_item = grab_image(s);
 
 #ifdef HAVE_XFIXES
                 if (cursor) {
                         uint32_t *image_data = (uint32_t *)(void *) new_item->data->data;
+                        const int stride = new_item->data->bytes_per_line / 4;
                         for(int x = 0; x < cursor->width; ++x) {
                                 for(int y = 0; y < cursor->height; ++y) {
                                         if(cursor->x + x >= (int) s->tile->width ||
@@ -203,14 +401,14 @@ static void *grab_thread(void *args)
                                         int r1 = cursor_pix >> 16 & 0xff,
                                             g1 = cursor_pix >> 8 & 0xff,
                                             b1 = cursor_pix >> 0 & 0xff;
-                                        uint_fast32_t image_pix = image_data[cursor->x + x + (cursor->y + y) * s->tile->width];
+                                        uint_fast32_t image_pix = image_data[cursor->x + x + (cursor->y + y) * stride];
                                         int r2 = image_pix >> 16 & 0xff,
                                             g2 = image_pix >> 8 & 0xff,
                                             b2 = image_pix >> 0 & 0xff;
                                         float scale_image = (float) (255 - alpha)/ 255;
                                         float scale_cursor = (float) alpha / 255;
 
-                                        image_data[cursor->x + x + (cursor->y + y) * s->tile->width] =
+                                        image_data[cursor->x + x + (cursor->y + y) * stride] =
                                                 ((int) (r1 * scale_cursor + r2 * scale_image) & 0xff) << 16 |
                                                 ((int) (g1 * scale_cursor + g2 * scale_image) & 0xff) << 8 |
                                                 ((int) (b1 * scale_cursor + b2 * scale_image) & 0xff) << 0;
@@ -312,6 +510,10 @@ static _Bool parse_fmt(struct vidcap_screen_x11_state *s, char *fmt) {
                                 val = strchr(val, '+') + 1;
                                 s->y = atoi(val);
                         }
+                } else if (strcmp(tok, "noshm") == 0) {
+                        s->use_shm = false;
+                } else if (strcmp(tok, "damage") == 0) {
+                        s->use_damage = true;
                 } else {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option \"%s\"!\n", tok);
                         return 0;
@@ -340,6 +542,7 @@ static int vidcap_screen_x11_init(struct vidcap_params *params, void **state)
                 return VIDCAP_INIT_FAIL;
         }
         s->cpu_count = get_cpu_core_count();
+        s->use_shm = true;
 
 #ifndef HAVE_XFIXES
         fprintf(stderr, "[Screen capture] Compiled without XFixes library, cursor won't be shown!\n");
@@ -392,12 +595,21 @@ static void vidcap_screen_x11_done(void *state)
                 while(s->queue_len > 0) {
                         struct grabbed_data *item = s->head;
                         s->head = s->head->next;
-                        XDestroyImage(item->data);
-                        free(item);
+                        free_item(s, item);
                         s->queue_len -= 1;
                 }
+                while (s->free_items != NULL) {
+                        struct grabbed_data *item = s->free_items;
+                        s->free_items = item->next;
+                        free_item(s, item);
+                }
         }
         pthread_mutex_unlock(&s->lock);
+#ifdef HAVE_XDAMAGE
+        if (s->damage != 0) {
+                XDamageDestroy(s->dpy, s->damage);
+        }
+#endif
 
         if(s->tile)
                 free(s->tile->data);
@@ -448,10 +660,21 @@ static struct video_frame * vidcap_screen_x11_grab(void *state, struct audio_fra
          * some configurations, but seems to work currently. To be corrected if there is an
          * opposite case.
          */
-        parallel_pix_conv(s->tile->height, s->tile->data, vc_get_linesize(s->tile->width, RGB), &item->data->data[0], vc_get_linesize(s->tile->width, RGBA), vc_copylineABGRtoRGB, s->cpu_count);
+        parallel_pix_conv(s->tile->height, s->tile->data, vc_get_linesize(s->tile->width, RGB), &item->data->data[0], item->data->bytes_per_line, vc_copylineABGRtoRGB, s->cpu_count);
 
-        XDestroyImage(item->data);
-        free(item);
+#ifdef HAVE_XSHM
+        if (item->shm.shmaddr != NULL) { // return SHM image for reuse
+                pthread_mutex_lock(&s->lock);
+                item->next = s->free_items;
+                s->free_items = item;
+                pthread_mutex_unlock(&s->lock);
+                item = NULL;
+        }
+#endif
+        if (item != NULL) {
+                XDestroyImage(item->data);
+                free(item);
+        }
 
         if(s->fps > 0.0) {
                 struct timeval cur_time;
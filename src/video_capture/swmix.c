@@ -64,6 +64,14 @@
 #include "video_capture.h"
 
 #define MAX_AUDIO_LEN (1024*1024)
+#define MOD_NAME "[swmix] "
+#define DISABLE_PBO_PARAM_NAME "swmix-disable-pbo"
+#define OUT_BUFFER_COUNT 4 ///< network + completed + being read back + being rendered
+#define UPLOAD_PBO_COUNT 2 ///< per slave - one being uploaded, one being filled
+#define PBO_WAIT_TIMEOUT_NS 100000000 ///< 100 ms
+#if defined GL_MAP_PERSISTENT_BIT && !defined __APPLE__
+#define HAVE_PERSISTENT_PBO 1
+#endif
 
 typedef enum {
         BICUBIC,
@@ -222,6 +230,14 @@ struct state_slave {
         bool                audio_captured;
 };
 
+/// persistently mapped PBO with a fence signalling end of its GPU use
+struct swmix_pbo {
+        GLuint              id;
+        char               *ptr;
+        size_t              size;
+        GLsync              fence;
+};
+
 struct vidcap_swmix_state {
         struct state_slave *slaves;
         int                 devices_cnt;
@@ -231,6 +247,8 @@ struct vidcap_swmix_state {
         GLuint              tex_output_uyvy;
         GLuint              fbo;
         GLuint              fbo_uyvy;
+        bool                use_pbo;   ///< persistent PBOs supported and enabled
+        struct swmix_pbo    out_pbo[OUT_BUFFER_COUNT]; ///< backs output buffers if progressive
 
         struct video_frame *frame;
         char               *network_buffer;
@@ -283,8 +301,93 @@ struct slave_data {
 
         decoder_t           decoder;
         codec_t             decoder_from, decoder_to;
+
+        bool                use_pbo;
+        struct swmix_pbo    upload_pbo[UPLOAD_PBO_COUNT];
+        int                 upload_idx;
 };
 
+/**
+ * @returns mapped pointer, NULL if persistent PBO cannot be created (not
+ * supported by the GL implementation or disabled)
+ */
+static char *create_persistent_pbo(struct swmix_pbo *pbo, GLenum target, size_t size,
+                GLbitfield access)
+{
+#ifdef HAVE_PERSISTENT_PBO
+        const GLbitfield flags = access | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &pbo->id);
+        glBindBuffer(target, pbo->id);
+        glBufferStorage(target, size, NULL, flags);
+        pbo->ptr = glMapBufferRange(target, 0, size, flags);
+        glBindBuffer(target, 0);
+        if (pbo->ptr == NULL) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot map persistent PBO!\n");
+                glDeleteBuffers(1, &pbo->id);
+                pbo->id = 0;
+                return NULL;
+        }
+        pbo->size = size;
+        pbo->fence = NULL;
+        return pbo->ptr;
+#else
+        UNUSED(pbo), UNUSED(target), UNUSED(size), UNUSED(access);
+        return NULL;
+#endif
+}
+
+static void destroy_pbo(struct swmix_pbo *pbo)
+{
+#ifdef HAVE_PERSISTENT_PBO
+        if (pbo->fence != NULL) {
+                glDeleteSync(pbo->fence);
+        }
+        if (pbo->id != 0) {
+                glDeleteBuffers(1, &pbo->id); // unmaps as well
+        }
+#endif
+        memset(pbo, 0, sizeof *pbo);
+}
+
+/// waits until the GPU is done with the PBO (upload read or readback written)
+static void wait_pbo(struct swmix_pbo *pbo)
+{
+#ifdef HAVE_PERSISTENT_PBO
+        if (pbo->fence == NULL) {
+                return;
+        }
+        if (glClientWaitSync(pbo->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                PBO_WAIT_TIMEOUT_NS) == GL_TIMEOUT_EXPIRED) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Timeout waiting for PBO transfer!\n");
+        }
+        glDeleteSync(pbo->fence);
+        pbo->fence = NULL;
+#else
+        UNUSED(pbo);
+#endif
+}
+
+static void fence_pbo(struct swmix_pbo *pbo)
+{
+#ifdef HAVE_PERSISTENT_PBO
+        pbo->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#else
+        UNUSED(pbo);
+#endif
+}
+
+static bool persistent_pbo_supported(void)
+{
+#ifdef HAVE_PERSISTENT_PBO
+        if (get_commandline_param(DISABLE_PBO_PARAM_NAME) != NULL) {
+                return false;
+        }
+        return glewIsSupported("GL_ARB_buffer_storage GL_ARB_sync");
+#else
+        return false;
+#endif
+}
+
 static struct slave_data *init_slave_data(struct vidcap_swmix_state *s, FILE *config) {
         struct slave_data *slaves_data = (struct slave_data *)
                 calloc(s->devices_cnt, sizeof(struct slave_data));
@@ -313,6 +416,7 @@ static struct slave_data *init_slave_data(struct vidcap_swmix_state *s, FILE *co
                 }
 
                 glGenFramebuffers(1, &slaves_data[i].fbo);
+                slaves_data[i].use_pbo = s->use_pbo;
 
                 slaves_data[i].fb_aspect = (double) s->frame->tiles[0].width /
                         s->frame->tiles[0].height;
@@ -353,6 +457,9 @@ static void destroy_slave_data(struct slave_data *data, int count) {
         for(int i = 0; i < count; ++i) {
                 glDeleteTextures(2, data[i].texture);
                 glDeleteFramebuffers(1, &data[i].fbo);
+                for (int j = 0; j < UPLOAD_PBO_COUNT; ++j) {
+                        destroy_pbo(&data[i].upload_pbo[j]);
+                }
         }
         free(data);
 }
@@ -386,6 +493,17 @@ static void reconfigure_slave_rendering(struct slave_data *s, struct video_desc
         }
         glBindTexture(GL_TEXTURE_2D, 0);
 
+        if (s->use_pbo) {
+                const size_t size = vc_get_datalen(desc.width, desc.height, desc.color_spec);
+                for (int i = 0; i < UPLOAD_PBO_COUNT; ++i) {
+                        destroy_pbo(&s->upload_pbo[i]);
+                        if (create_persistent_pbo(&s->upload_pbo[i], GL_PIXEL_UNPACK_BUFFER,
+                                                size, GL_MAP_WRITE_BIT) == NULL) {
+                                s->use_pbo = false;
+                        }
+                }
+        }
+
         double video_aspect = (double) desc.width / desc.height;
         double fb_aspect = (double) s->fb_aspect * s->width / s->height;
         double width = s->width;
@@ -534,15 +652,25 @@ static void load_texture(struct slave_data *s, GLuint from_uyvy)
         int src_height = s->current_frame->tiles[0].height;
         int src_width = s->current_frame->tiles[0].width;
         unsigned char *data = (unsigned char *) s->current_frame->tiles[0].data;
+        const size_t out_len = (size_t) src_height * vc_get_linesize(src_width, out_codec);
+        struct swmix_pbo *pbo = NULL;
+        if (s->use_pbo && s->upload_pbo[s->upload_idx].size >= out_len) {
+                // the other PBO is possibly still being uploaded from
+                pbo = &s->upload_pbo[s->upload_idx];
+                s->upload_idx = (s->upload_idx + 1) % UPLOAD_PBO_COUNT;
+                wait_pbo(pbo);
+        }
         unsigned char *tmp = NULL, *in_gl_buffer = data;
         if (decoder) {
-                tmp = in_gl_buffer = (unsigned char *) malloc(src_height *
-                                vc_get_linesize(src_width, out_codec));
+                tmp = in_gl_buffer = pbo ? (unsigned char *) pbo->ptr
+                        : (unsigned char *) malloc(out_len);
                 for (int i = 0; i < src_height; ++i) {
-                        decoder(tmp + i * vc_get_linesize(src_width, out_codec),
+                        decoder(in_gl_buffer + i * vc_get_linesize(src_width, out_codec),
                                         data + i * vc_get_linesize(src_width, in_codec),
                                         vc_get_linesize(src_width, out_codec), 0, 8, 16);
                 }
+        } else if (pbo) {
+                memcpy(pbo->ptr, data, out_len);
         }
 
         if(out_codec == UYVY) {
@@ -550,9 +678,17 @@ static void load_texture(struct slave_data *s, GLuint from_uyvy)
         } else {
                 glBindTexture(GL_TEXTURE_2D, s->texture[0]);
         }
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
-                        width, src_height, format, GL_UNSIGNED_BYTE, in_gl_buffer);
-        free(tmp);
+        if (pbo) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->id);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+                                width, src_height, format, GL_UNSIGNED_BYTE, NULL);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                fence_pbo(pbo);
+        } else {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+                                width, src_height, format, GL_UNSIGNED_BYTE, in_gl_buffer);
+                free(tmp);
+        }
 
         if(out_codec == UYVY) {
                 glUseProgram(from_uyvy);
@@ -598,6 +734,39 @@ static void render_slave(struct slave_data *s, interpolation_t interpolation, GL
         glEnd();
 }
 
+static struct swmix_pbo *get_out_pbo(struct vidcap_swmix_state *s, const char *buffer)
+{
+        for (int i = 0; i < OUT_BUFFER_COUNT; ++i) {
+                if (s->out_pbo[i].ptr != NULL && s->out_pbo[i].ptr == buffer) {
+                        return &s->out_pbo[i];
+                }
+        }
+        return NULL;
+}
+
+/// hands the completed buffer over to vidcap_swmix_grab() when next frame time is due
+static void publish_frame(struct vidcap_swmix_state *s, char *buffer, char *audio_data,
+                int audio_len, struct timeval *t0)
+{
+        double sec;
+        struct timeval t;
+        do {
+                gettimeofday(&t, NULL);
+                sec = tv_diff(t, *t0);
+        } while(sec < 1.0 / s->frame->fps);
+        *t0 = t;
+
+        pthread_mutex_lock(&s->lock);
+        while(s->completed_buffer != NULL) {
+                pthread_cond_wait(&s->frame_sent_cv, &s->lock);
+        }
+        s->completed_buffer = buffer;
+        s->completed_audio_buffer = audio_data;
+        s->completed_audio_buffer_len = audio_len;
+        pthread_cond_signal(&s->frame_ready_cv);
+        pthread_mutex_unlock(&s->lock);
+}
+
 static void *master_worker(void *arg)
 {
         struct vidcap_swmix_state *s = (struct vidcap_swmix_state *) arg;
@@ -623,6 +792,10 @@ static void *master_worker(void *arg)
         char *tmp_buffer = (char *) malloc(s->frame->tiles[0].data_len);
 
         char *current_buffer = NULL;
+        // frame N-1 is being read back to this buffer while frame N is rendered
+        char *pending_buffer = NULL;
+        char *pending_audio = NULL;
+        int pending_audio_len = 0;
 
         while(1) {
                 pthread_mutex_lock(&s->lock);
@@ -748,10 +921,21 @@ static void *master_worker(void *arg)
                 } else {
                         read_buf = tmp_buffer;
                 }
-                glReadPixels(0, 0, width,
-                                s->frame->tiles[0].height,
-                                format, GL_UNSIGNED_BYTE,
-                                read_buf);
+                struct swmix_pbo *out_pbo = get_out_pbo(s, read_buf);
+                if (out_pbo) { // asynchronous, completion is waited for next iteration
+                        glBindBuffer(GL_PIXEL_PACK_BUFFER, out_pbo->id);
+                        glReadPixels(0, 0, width,
+                                        s->frame->tiles[0].height,
+                                        format, GL_UNSIGNED_BYTE,
+                                        NULL);
+                        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                        fence_pbo(out_pbo);
+                } else {
+                        glReadPixels(0, 0, width,
+                                        s->frame->tiles[0].height,
+                                        format, GL_UNSIGNED_BYTE,
+                                        read_buf);
+                }
                 glBindFramebuffer(GL_FRAMEBUFFER, 0);
                 glBindTexture(GL_TEXTURE_2D, 0);
 
@@ -766,30 +950,31 @@ static void *master_worker(void *arg)
                 }
 
                 if(field == 0) {
-                        // wait until next frame time is due
-                        double sec;
-                        struct timeval t;
-                        do {
-                                gettimeofday(&t, NULL);
-                                sec = tv_diff(t, t0);
-                        } while(sec < 1.0 / s->frame->fps);
-                        t0 = t;
-
-                        pthread_mutex_lock(&s->lock);
-                        while(s->completed_buffer != NULL) {
-                                pthread_cond_wait(&s->frame_sent_cv, &s->lock);
+                        if (out_pbo) {
+                                if (pending_buffer) {
+                                        wait_pbo(get_out_pbo(s, pending_buffer));
+                                        publish_frame(s, pending_buffer, pending_audio,
+                                                        pending_audio_len, &t0);
+                                }
+                                pending_buffer = current_buffer;
+                                pending_audio = audio_data;
+                                pending_audio_len = audio_len;
+                        } else {
+                                publish_frame(s, current_buffer, audio_data, audio_len, &t0);
                         }
-                        s->completed_buffer = current_buffer;
-                        s->completed_audio_buffer = audio_data;
-                        s->completed_audio_buffer_len = audio_len;
                         current_buffer = NULL;
-                        pthread_cond_signal(&s->frame_ready_cv);
-                        pthread_mutex_unlock(&s->lock);
                         field = 0;
                 }
 
         }
 
+        if (pending_buffer) {
+                wait_pbo(get_out_pbo(s, pending_buffer));
+                pthread_mutex_lock(&s->lock);
+                simple_linked_list_append(s->free_buffer_queue, pending_buffer);
+                pthread_mutex_unlock(&s->lock);
+                free(pending_audio);
+        }
         free(tmp_buffer);
 
         glDeleteProgram(from_uyvy);
@@ -1144,6 +1329,9 @@ vidcap_swmix_init(struct vidcap_params *params, void **state)
         }
 
         gl_context_make_current(&s->gl_context);
+        s->use_pbo = persistent_pbo_supported();
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Persistent PBO transfers %s.\n",
+                        s->use_pbo ? "enabled" : "disabled");
 
         {
                 char *bicubic = strdup(bicubic_template);
@@ -1191,15 +1379,23 @@ vidcap_swmix_init(struct vidcap_params *params, void **state)
         glGenFramebuffers(1, &s->fbo);
         glGenFramebuffers(1, &s->fbo_uyvy);
 
-        gl_context_make_current(NULL);
-
         s->frame->tiles[0].data_len = vc_get_linesize(s->frame->tiles[0].width,
                                 s->frame->color_spec) * s->frame->tiles[0].height;
-        for(int i = 0; i < 3; ++i) {
-                char *buffer = (char *) malloc(s->frame->tiles[0].data_len);
+        for(int i = 0; i < OUT_BUFFER_COUNT; ++i) {
+                char *buffer = NULL;
+                // interlaced output is merged from fields on CPU, keep synchronous
+                if (s->use_pbo && desc.interlacing == PROGRESSIVE) {
+                        buffer = create_persistent_pbo(&s->out_pbo[i], GL_PIXEL_PACK_BUFFER,
+                                        s->frame->tiles[0].data_len, GL_MAP_READ_BIT);
+                }
+                if (buffer == NULL) {
+                        buffer = (char *) malloc(s->frame->tiles[0].data_len);
+                }
                 simple_linked_list_append(s->free_buffer_queue, buffer);
         }
 
+        gl_context_make_current(NULL);
+
         pthread_create(&s->master_thread_id, NULL, master_worker, (void *) s);
         for(int i = 0; i < s->devices_cnt; ++i) {
                 pthread_create(&(s->slaves[i].thread_id), NULL, slave_worker, (void *) &s->slaves[i]);
@@ -1252,11 +1448,13 @@ vidcap_swmix_done(void *state)
                 pthread_join(s->master_thread_id, NULL);
         }
 
-        if(s->completed_buffer)
+        if(s->completed_buffer && !get_out_pbo(s, s->completed_buffer))
                 free(s->completed_buffer);
         char *buf = NULL;
         while ((buf = simple_linked_list_pop(s->free_buffer_queue)) != NULL) {
-                free(buf);
+                if (!get_out_pbo(s, buf)) {
+                        free(buf);
+                }
         }
 
         if (s->slaves) {
@@ -1288,6 +1486,9 @@ vidcap_swmix_done(void *state)
         if (s->fbo_uyvy) {
                 glDeleteFramebuffers(1, &s->fbo_uyvy);
         }
+        for (int i = 0; i < OUT_BUFFER_COUNT; ++i) {
+                destroy_pbo(&s->out_pbo[i]);
+        }
 
         gl_context_make_current(NULL);
         destroy_gl_context(&s->gl_context);
@@ -1348,6 +1549,10 @@ vidcap_swmix_grab(void *state, struct audio_frame **audio)
 	return s->frame;
 }
 
+ADD_TO_PARAM(DISABLE_PBO_PARAM_NAME, "* " DISABLE_PBO_PARAM_NAME "\n"
+                "  Use synchronous texture upload and readback in SW mix instead of\n"
+                "  persistently mapped PBOs.\n");
+
 static const struct video_capture_info vidcap_swmix_info = {
         vidcap_swmix_probe,
         vidcap_swmix_init,
@@ -64,6 +64,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>                          // for open
+#include <sys/mman.h>                       // for mlock, mmap, munmap
+#include <sys/stat.h>                       // for fstat
+#include <unistd.h>                         // for close
+#endif
 
 #include "audio/types.h"
 #include "audio/utils.h"
@@ -95,6 +101,7 @@ enum {
 #define AUDIO_BUFFER_SAMPLES (AUDIO_SAMPLE_RATE * BUFFER_SEC)
 #define DEFAULT_FORMAT ((struct video_desc) { 1920, 1080, UYVY, 25.0, INTERLACED_MERGED, 1 })
 #define DEFAULT_PATTERN "bars"
+#define DEFAULT_RING_FRAMES 8
 
 struct audio_len_pattern {
         int count;
@@ -106,6 +113,17 @@ static const int alen_pattern_5994[] = { 801, 801, 800, 801, 801 };
 static const int alen_pattern_11988[] = { 400, 401, 400, 401, 400 };
 _Static_assert(sizeof alen_pattern_2997 <= sizeof ((struct audio_len_pattern *) 0)->samples && sizeof alen_pattern_5994 <= sizeof ((struct audio_len_pattern *) 0)->samples, "insufficient length");
 
+/// frames of a Y4M or PAM/PNM file with multiple frames, mapped to memory
+struct file_sequence {
+        char *map;
+        size_t map_len;
+        size_t *offsets; ///< of the frame data in map
+        size_t count;
+        int y4m_subsampling; ///< 0 for PAM
+        int bitdepth; ///< Y4M bit depth, PAM maxval
+        char *converted; ///< DEFAULT_RING_FRAMES converted frames, NULL if served directly from map
+};
+
 struct testcard_state {
         long long audio_frames;
         long long video_frames;
@@ -129,6 +147,14 @@ struct testcard_state {
         bool grab_audio;
         bool still_image;
         char pattern[128];
+
+        int ring_frames; ///< pre-rendered frames (0 - use generator directly)
+        bool unique;     ///< stamp frame counter into each frame
+        char *ring;      ///< ring_frames * data_len bytes, page-locked if possible
+        size_t ring_len;
+        bool ring_mmapped;
+
+        struct file_sequence *seq; ///< played instead of the generator if set
 };
 
 static void
@@ -311,6 +337,14 @@ static struct video_desc parse_format(char **fmt, char **save_ptr) {
         return desc;
 }
 
+static void pam_to_rg48(int width, int height, int maxval, const unsigned char *data, char *out_data) {
+        const uint16_t *in = (const uint16_t *)(const void *) data;
+        uint16_t *out = (uint16_t *)(void *) out_data;
+        for (size_t i = 0; i < (size_t) width * height * 3; ++i) {
+                *out++ = ntohs(*in++) * ((1<<16U) / (maxval + 1));
+        }
+}
+
 static size_t testcard_load_from_file_pam(const char *filename, struct video_desc *desc, char **in_file_contents) {
         struct pam_metadata info;
         unsigned char *data = NULL;
@@ -333,11 +367,8 @@ static size_t testcard_load_from_file_pam(const char *filename, struct video_des
         size_t data_len = vc_get_datalen(desc->width, desc->height, desc->color_spec);
         *in_file_contents = (char  *) malloc(data_len);
         if (desc->color_spec == RG48) {
-                uint16_t *in = (uint16_t *)(void *) data;
-                uint16_t *out = (uint16_t *)(void *) *in_file_contents;
-                for (size_t i = 0; i < (size_t) info.width * info.height * 3; ++i) {
-                        *out++ = ntohs(*in++) * ((1<<16U) / (info.maxval + 1));
-                }
+                pam_to_rg48(info.width, info.height, info.maxval, data,
+                            *in_file_contents);
         } else {
                 memcpy(*in_file_contents, data, data_len);
         }
@@ -345,6 +376,40 @@ static size_t testcard_load_from_file_pam(const char *filename, struct video_des
         return data_len;
 }
 
+/// converts planar Y4M data to UYVY (8 bit) or Y416
+static bool y4m_convert(int subsampling, int bitdepth, unsigned width, unsigned height,
+                        const unsigned char *data, unsigned char *converted) {
+        switch (subsampling) {
+        case Y4M_SUBS_420:
+                if (bitdepth == DEPTH8) {
+                        i420_8_to_uyvy(width, height, data, converted);
+                } else {
+                        i420_16_to_y416((int) width, (int) height, data,
+                                        converted, bitdepth);
+                }
+                return true;
+        case Y4M_SUBS_422:
+                if (bitdepth == DEPTH8) {
+                        i422_8_to_uyvy(width, height, data, converted);
+                } else {
+                        i422_16_to_y416((int) width, (int) height, data,
+                                        converted, bitdepth);
+                }
+                return true;
+        case Y4M_SUBS_444:
+                if (bitdepth == DEPTH8) {
+                        i444_8_to_uyvy(width, height, data, converted);
+                } else {
+                        i444_16_to_y416((int) width, (int) height, data,
+                                        converted, bitdepth);
+                }
+                return true;
+        default:
+                MSG(ERROR, "Wrong Y4M subsampling: %d", subsampling);
+                return false;
+        }
+}
+
 static size_t testcard_load_from_file_y4m(const char *filename, struct video_desc *desc, char **in_file_contents) {
         struct y4m_metadata info;
         unsigned char *data = NULL;
@@ -364,36 +429,8 @@ static size_t testcard_load_from_file_y4m(const char *filename, struct video_des
         size_t data_len = vc_get_datalen(desc->width, desc->height, desc->color_spec);
         unsigned char *converted = malloc(data_len);
 
-        switch (info.subsampling) {
-        case Y4M_SUBS_420:
-                if (info.bitdepth == DEPTH8) {
-                        i420_8_to_uyvy(desc->width, desc->height, data,
-                                       converted);
-                } else {
-                        i420_16_to_y416((int) desc->width, (int) desc->height,
-                                        data, converted, info.bitdepth);
-                }
-                break;
-        case Y4M_SUBS_422:
-                if (info.bitdepth == DEPTH8) {
-                        i422_8_to_uyvy(desc->width, desc->height, data,
-                                       converted);
-                } else {
-                        i422_16_to_y416((int) desc->width, (int) desc->height,
-                                        data, converted, info.bitdepth);
-                }
-                break;
-        case Y4M_SUBS_444:
-                if (info.bitdepth == DEPTH8) {
-                        i444_8_to_uyvy(desc->width, desc->height, data,
-                                       converted);
-                } else {
-                        i444_16_to_y416((int) desc->width, (int) desc->height,
-                                        data, converted, info.bitdepth);
-                }
-                break;
-        default:
-                MSG(ERROR, "Wrong Y4M subsampling: %d", info.subsampling);
+        if (!y4m_convert(info.subsampling, info.bitdepth, desc->width,
+                         desc->height, data, converted)) {
                 free(converted);
                 return 0;
         }
@@ -452,21 +489,197 @@ static size_t testcard_load_from_file(const char *filename, struct video_desc *d
         return data_len;
 }
 
+static void free_sequence(struct file_sequence *seq)
+{
+        if (seq == NULL) {
+                return;
+        }
+#ifndef _WIN32
+        munmap(seq->map, seq->map_len);
+#endif
+        free(seq->offsets);
+        free(seq->converted);
+        free(seq);
+}
+
+/**
+ * Maps a Y4M or PAM/PNM file containing multiple frames so that the frames
+ * are played from the mapping. 8-bit Y4M 4:2:0 (as I420), 8-bit RGB and RGBA
+ * are passed without any copy, other formats are converted per frame.
+ *
+ * @returns NULL if the file is not a (supported) sequence, the file is then
+ *          loaded as a single picture
+ */
+static struct file_sequence *open_sequence(const char *filename, struct video_desc *desc)
+{
+#ifdef _WIN32
+        (void) filename, (void) desc;
+        return NULL;
+#else
+        struct file_sequence seq = { 0 };
+        if (ends_with(filename, ".y4m")) {
+                struct y4m_metadata info;
+                if ((seq.count = y4m_read_index(filename, &info, &seq.offsets)) <= 1 ||
+                    info.bitdepth < DEPTH8 || info.subsampling < Y4M_SUBS_420 ||
+                    info.subsampling > Y4M_SUBS_444) {
+                        free(seq.offsets);
+                        return NULL;
+                }
+                seq.y4m_subsampling = info.subsampling;
+                seq.bitdepth = info.bitdepth;
+                desc->width = info.width;
+                desc->height = info.height;
+                if (info.subsampling == Y4M_SUBS_420 && info.bitdepth == DEPTH8 &&
+                    info.width % 2 == 0 && info.height % 2 == 0) {
+                        desc->color_spec = I420;
+                } else {
+                        desc->color_spec = info.bitdepth == DEPTH8 ? UYVY : Y416;
+                }
+        } else if (ends_with(filename, ".pam") || ends_with(filename, ".pnm") || ends_with(filename, ".ppm")) {
+                struct pam_metadata info;
+                if ((seq.count = pam_read_index(filename, &info, &seq.offsets)) <= 1 ||
+                    (info.depth != 3 && (info.depth != 4 || info.maxval != 255))) {
+                        free(seq.offsets);
+                        return NULL;
+                }
+                seq.bitdepth = info.maxval;
+                desc->width = info.width;
+                desc->height = info.height;
+                desc->color_spec = info.depth == 4 ? RGBA : info.maxval == 255 ? RGB : RG48;
+        } else {
+                return NULL;
+        }
+
+        int fd = open(filename, O_RDONLY);
+        struct stat sb;
+        if (fd == -1 || fstat(fd, &sb) != 0) {
+                MSG(ERROR, "Cannot open %s: %s\n", filename, ug_strerror(errno));
+                if (fd != -1) {
+                        close(fd);
+                }
+                free(seq.offsets);
+                return NULL;
+        }
+        seq.map_len = sb.st_size;
+        // private - downstream may modify the frames in place
+        seq.map = mmap(NULL, seq.map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (seq.map == MAP_FAILED) {
+                MSG(ERROR, "Cannot map %s: %s\n", filename, ug_strerror(errno));
+                free(seq.offsets);
+                return NULL;
+        }
+        // hints only, failures are harmless
+        madvise(seq.map, seq.map_len, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+        madvise(seq.map, seq.map_len, MADV_HUGEPAGE);
+#endif
+        if (desc->color_spec != I420 && desc->color_spec != RGB && desc->color_spec != RGBA) {
+                seq.converted = malloc(DEFAULT_RING_FRAMES *
+                                       vc_get_datalen(desc->width, desc->height, desc->color_spec));
+        }
+
+        struct file_sequence *ret = malloc(sizeof *ret);
+        *ret = seq;
+        MSG(INFO, "Playing %zu frames mapped from %s%s.\n", seq.count, filename,
+            seq.converted != NULL ? " (converted)" : "");
+        return ret;
+#endif
+}
+
+/// @returns data of current frame - pointing to the mapping or converted
+static char *sequence_get_frame(struct testcard_state *s, struct tile *tile)
+{
+        struct file_sequence *seq = s->seq;
+        char *src = seq->map + seq->offsets[s->video_frames % seq->count];
+        if (seq->converted == NULL) {
+                return src;
+        }
+        // the buffer was last returned DEFAULT_RING_FRAMES grabs ago
+        char *dst = seq->converted + (s->video_frames % DEFAULT_RING_FRAMES) * tile->data_len;
+        if (seq->y4m_subsampling != 0) {
+                y4m_convert(seq->y4m_subsampling, seq->bitdepth, tile->width,
+                            tile->height, (unsigned char *) src,
+                            (unsigned char *) dst);
+        } else {
+                pam_to_rg48((int) tile->width, (int) tile->height, seq->bitdepth,
+                            (unsigned char *) src, dst);
+        }
+        return dst;
+}
+
+/**
+ * Pre-renders ring_frames consecutive generator outputs so that grab only
+ * rotates the pointer. The buffer is locked in memory (best effort) so that
+ * the benchmark isn't skewed by page faults.
+ */
+static bool
+prerender_ring(struct testcard_state *s)
+{
+        const size_t data_len = s->frame->tiles[0].data_len;
+        s->ring_len = data_len * s->ring_frames;
+#ifndef _WIN32
+        void *ptr = mmap(NULL, s->ring_len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr != MAP_FAILED) {
+                s->ring = ptr;
+                s->ring_mmapped = true;
+                if (mlock(s->ring, s->ring_len) != 0) {
+                        MSG(WARNING, "Cannot lock %zu B of pre-rendered frames: %s\n",
+                            s->ring_len, ug_strerror(errno));
+                }
+        }
+#endif
+        if (s->ring == NULL && (s->ring = malloc(s->ring_len)) == NULL) {
+                MSG(ERROR, "Cannot allocate %zu B for %d pre-rendered frames!\n",
+                    s->ring_len, s->ring_frames);
+                return false;
+        }
+        for (int i = 0; i < s->ring_frames; ++i) {
+                memcpy(s->ring + i * data_len,
+                       video_pattern_generator_next_frame(s->generator),
+                       data_len);
+        }
+        MSG(VERBOSE, "Pre-rendered %d frames (%zu B).\n", s->ring_frames,
+            s->ring_len);
+        return true;
+}
+
+static void
+free_ring(struct testcard_state *s)
+{
+        if (s->ring == NULL) {
+                return;
+        }
+#ifndef _WIN32
+        if (s->ring_mmapped) {
+                munmap(s->ring, s->ring_len);
+                return;
+        }
+#endif
+        free(s->ring);
+}
+
 static void show_help(bool full) {
         printf("testcard options:\n");
-        color_printf(TBOLD(TRED("\t-t testcard") "[:size=<width>x<height>][:fps=<fps>][:codec=<codec>]") "[:file=<filename>][:p][:s=<X>x<Y>][:i|:sf][:still][:pattern=<pattern>] " TBOLD("| -t testcard:[full]help\n"));
+        color_printf(TBOLD(TRED("\t-t testcard") "[:size=<width>x<height>][:fps=<fps>][:codec=<codec>]") "[:file=<filename>][:p][:s=<X>x<Y>][:i|:sf][:still][:pattern=<pattern>][:ring[=<n>]][:unique] " TBOLD("| -t testcard:[full]help\n"));
         color_printf("or\n");
         color_printf(TBOLD(TRED("\t-t testcard") ":<width>:<height>:<fps>:<codec>") "[:other_opts]\n");
         color_printf("where\n");
         color_printf(TBOLD("\t  file ") "      - use file for input data instead of predefined pattern\n"
-                               "\t               (raw or PAM/PNM/Y4M)\n");
+                               "\t               (raw or PAM/PNM/Y4M), Y4M or PAM/PNM with multiple frames is\n"
+                               "\t               played from the file mapped to memory (unless " TBOLD("still") ")\n");
         color_printf(TBOLD("\t  fps  ") "      - frames per second (with optional 'i' suffix for interlaced)\n");
         color_printf(TBOLD("\t  i|sf ") "      - send as interlaced or segmented frame\n");
         color_printf(TBOLD("\t  mode ") "      - use specified mode (use 'mode=help' for list)\n");
         color_printf(TBOLD("\t   p   ") "      - pan with frame\n");
         color_printf(TBOLD("\tpattern") "      - pattern to use, use \"" TBOLD("pattern=help") "\" for options\n");
+        color_printf(TBOLD("\t ring  ") "      - pre-render <n> frames (default %d) to locked memory and cycle\n"
+                     "\t               them without any per-frame work (for high-rate benchmarking)\n", DEFAULT_RING_FRAMES);
         color_printf(TBOLD("\t   s   ") "      - split the frames into XxY separate tiles (currently defunct)\n");
         color_printf(TBOLD("\t still ") "      - send still image\n");
+        color_printf(TBOLD("\t unique") "      - stamp frame number to the beginning of each frame\n"
+                     "\t               so that every frame content differs (implies " TBOLD("ring") ")\n");
         if (full) {
                 color_printf(TBOLD("       afrequency") "    - embedded audio frequency\n");
                 color_printf(TBOLD("\t frames") "      - total number of video "
@@ -546,6 +759,16 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
                         log_msg(LOG_LEVEL_WARNING, "[testcard] Deprecated 'sf' option. Use format testcard:1920:1080:25sf:UYVY instead!\n");
                 } else if (strcmp(tmp, "still") == 0) {
                         s->still_image = true;
+                } else if (IS_PREFIX(tmp, "ring")) {
+                        s->ring_frames = strchr(tmp, '=') != NULL
+                                             ? atoi(strchr(tmp, '=') + 1)
+                                             : DEFAULT_RING_FRAMES;
+                        if (s->ring_frames <= 0) {
+                                MSG(ERROR, "Wrong ring length: %s\n", tmp);
+                                goto error;
+                        }
+                } else if (strcmp(tmp, "unique") == 0) {
+                        s->unique = true;
                 } else if (IS_KEY_PREFIX(tmp, "pattern")) {
                         const char *pattern = strchr(tmp, '=') + 1;
                         strncpy(s->pattern, pattern, sizeof s->pattern - 1);
@@ -599,14 +822,21 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
         }
 
         if (filename) {
-                if ((in_file_contents_size = testcard_load_from_file(filename, &desc, &in_file_contents, desc.color_spec == VIDEO_CODEC_NONE)) == 0) {
+                if (!s->still_image && (s->seq = open_sequence(filename, &desc)) != NULL) {
+                        if (s->ring_frames > 0 || s->unique || s->pan != 0) {
+                                MSG(WARNING, "Options ring, unique and p are ignored for a sequence.\n");
+                                s->ring_frames = 0;
+                                s->unique = false;
+                                s->pan = 0;
+                        }
+                } else if ((in_file_contents_size = testcard_load_from_file(filename, &desc, &in_file_contents, desc.color_spec == VIDEO_CODEC_NONE)) == 0) {
                         goto error;
                 }
         }
         desc.color_spec = IF_NOT_NULL_ELSE(desc.color_spec, DEFAULT_FORMAT.color_spec);
         desc.fps = IF_NOT_NULL_ELSE(desc.fps, DEFAULT_FORMAT.fps);
 
-        if (!s->still_image && codec_is_planar(desc.color_spec)) {
+        if (!s->still_image && s->seq == NULL && codec_is_planar(desc.color_spec)) {
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "Planar pixel format '%s', using still picture.\n", get_codec_name(desc.color_spec));
                 s->still_image = true;
         }
@@ -614,15 +844,24 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
         s->frame = vf_alloc_desc(desc);
         s->frame->flags |= TIMESTAMP_VALID;
 
-        s->generator = video_pattern_generator_create(s->pattern, s->frame->tiles[0].width, s->frame->tiles[0].height, s->frame->color_spec,
-                        s->still_image ? 0 : vc_get_linesize(desc.width, desc.color_spec) + s->pan);
-        if (!s->generator) {
-                ret = strstr(s->pattern, "help") != NULL ? VIDCAP_INIT_NOERR : VIDCAP_INIT_FAIL;
-                goto error;
+        if (s->seq == NULL) {
+                s->generator = video_pattern_generator_create(s->pattern, s->frame->tiles[0].width, s->frame->tiles[0].height, s->frame->color_spec,
+                                s->still_image ? 0 : vc_get_linesize(desc.width, desc.color_spec) + s->pan);
+                if (!s->generator) {
+                        ret = strstr(s->pattern, "help") != NULL ? VIDCAP_INIT_NOERR : VIDCAP_INIT_FAIL;
+                        goto error;
+                }
         }
         if (in_file_contents_size > 0) {
                 video_pattern_generator_fill_data(s->generator, in_file_contents);
         }
+        if (s->unique && s->ring_frames == 0) {
+                // do not stamp into the (shared) generator data
+                s->ring_frames = DEFAULT_RING_FRAMES;
+        }
+        if (s->ring_frames > 0 && !prerender_ring(s)) {
+                goto error;
+        }
 
         s->last_frame_time = get_time_in_ns();
 
@@ -657,6 +896,9 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
 
 error:
         free(fmt);
+        free_ring(s);
+        free_sequence(s->seq);
+        video_pattern_generator_destroy(s->generator);
         vf_free(s->frame);
         free(in_file_contents);
         free(s);
@@ -674,6 +916,8 @@ static void vidcap_testcard_done(void *state)
                 vf_free(s->tiled);
         }
         vf_free(s->frame);
+        free_ring(s);
+        free_sequence(s->seq);
         video_pattern_generator_destroy(s->generator);
         free(s->audio_data);
         free(s);
@@ -722,7 +966,23 @@ static struct video_frame *vidcap_testcard_grab(void *arg, struct audio_frame **
 
         *audio = vidcap_testcard_get_audio(state);
 
-        vf_get_tile(state->frame, 0)->data = video_pattern_generator_next_frame(state->generator);
+        struct tile *tile = vf_get_tile(state->frame, 0);
+        if (state->ring != NULL) {
+                // the slot was last returned ring_frames grabs ago
+                tile->data = state->ring + (state->video_frames %
+                                            state->ring_frames) *
+                                               tile->data_len;
+                if (state->unique) {
+                        uint64_t frame_num = state->video_frames;
+                        memcpy(tile->data, &frame_num,
+                               MIN(sizeof frame_num, tile->data_len));
+                }
+        } else if (state->seq != NULL) {
+                tile->data = sequence_get_frame(state, tile);
+        } else {
+                tile->data = video_pattern_generator_next_frame(
+                    state->generator);
+        }
 
         if (state->tiled) {
                 /* update tile data instead */
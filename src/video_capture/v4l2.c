@@ -55,6 +55,7 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -70,6 +71,7 @@ enum {
 
 #include "debug.h"
 #include "host.h"
+#include "hwaccel_drm.h"
 #include "lib_common.h"
 #include "tv.h"
 #include "utils/color_out.h"
@@ -83,11 +85,44 @@ enum {
 /* prototypes of functions defined in this module */
 static void print_fps(int fd, struct v4l2_frmivalenum *param);
 
+// width, height, pixelformat and field are accessed through fmt.pix also for multi-planar formats
+static_assert(offsetof(struct v4l2_pix_format, field) == offsetof(struct v4l2_pix_format_mplane, field),
+                "single and multi-planar formats should share the leading members");
+
+/**
+ * Formats that can be exported as DRM PRIME (DRM fourcc equals to V4L2 one
+ * unless stated otherwise). Semi-planar formats in a single V4L2 plane have
+ * the chroma plane right after the luma.
+ */
+static const struct {
+        uint32_t v4l2_fcc;
+        uint32_t drm_fcc;
+        int drm_planes;
+} v4l2_drm_map[] = {
+        { V4L2_PIX_FMT_YUYV, v4l2_fourcc('Y', 'U', 'Y', 'V'), 1 },
+        { V4L2_PIX_FMT_UYVY, v4l2_fourcc('U', 'Y', 'V', 'Y'), 1 },
+        { V4L2_PIX_FMT_NV12, v4l2_fourcc('N', 'V', '1', '2'), 2 },
+        { V4L2_PIX_FMT_NV12M, v4l2_fourcc('N', 'V', '1', '2'), 2 },
+        { V4L2_PIX_FMT_NV16, v4l2_fourcc('N', 'V', '1', '6'), 2 },
+#ifdef V4L2_PIX_FMT_P010
+        { V4L2_PIX_FMT_P010, v4l2_fourcc('P', '0', '1', '0'), 2 },
+#endif
+#ifdef V4L2_PIX_FMT_XBGR32
+        { V4L2_PIX_FMT_XBGR32, v4l2_fourcc('X', 'R', '2', '4'), 1 }, // B-G-R-X in memory
+        { V4L2_PIX_FMT_ABGR32, v4l2_fourcc('A', 'R', '2', '4'), 1 },
+#endif
+};
+
 struct vidcap_v4l2_state {
         struct video_desc desc;
 
         int fd;
+        enum v4l2_buf_type buf_type; ///< single or multi-planar capture
         struct v4l2_buffer_data buffers[MAX_BUF_COUNT];
+        _Bool dmabuf; ///< lend buffers exported as dmabufs (DRM_PRIME frames)
+        uint32_t drm_format;
+        int drm_planes;
+        uint32_t pitches[VIDEO_MAX_PLANES];
 
         _Bool permissive; ///< do not fail if parameters (size, FPS...) not set exactly
 #ifdef HAVE_LIBV4LCONVERT
@@ -110,6 +145,8 @@ struct vidcap_v4l2_state {
 struct v4l2_dispose_deq_buffer_data {
         struct vidcap_v4l2_state *s;
         struct v4l2_buffer buf;
+        struct v4l2_plane planes[VIDEO_MAX_PLANES]; ///< buf.m.planes if multi-planar
+        struct drm_prime_frame drm; ///< tile data of DRM_PRIME frames
 };
 
 static void enqueue_all_finished_frames(struct vidcap_v4l2_state *s) {
@@ -123,12 +160,58 @@ static void enqueue_all_finished_frames(struct vidcap_v4l2_state *s) {
         }
 }
 
+/// exports all planes of all buffers with VIDIOC_EXPBUF
+static bool export_dmabufs(struct vidcap_v4l2_state *s) {
+        for (int i = 0; i < s->buffer_count; ++i) {
+                for (unsigned p = 0; p < s->buffers[i].num_planes; ++p) {
+                        struct v4l2_exportbuffer expbuf = { .type = s->buf_type, .index = i, .plane = p,
+                                .flags = O_RDONLY | O_CLOEXEC };
+                        if (ioctl(s->fd, VIDIOC_EXPBUF, &expbuf) != 0) {
+                                log_perror(LOG_LEVEL_ERROR, MOD_NAME "Unable to export buffer (VIDIOC_EXPBUF)");
+                                return false;
+                        }
+                        s->buffers[i].planes[p].dmabuf_fd = expbuf.fd;
+                }
+        }
+        return true;
+}
+
+/**
+ * Describes the dequeued buffer as a DRM PRIME frame, the pixel data are not
+ * touched. The mapping stays valid until the buffer is queued back.
+ */
+static void fill_drm_prime_frame(struct vidcap_v4l2_state *s, struct v4l2_dispose_deq_buffer_data *data) {
+        struct drm_prime_frame *drm = &data->drm;
+        const struct v4l2_buffer_data *buffer = &s->buffers[data->buf.index];
+        const bool mplane = V4L2_TYPE_IS_MULTIPLANAR(s->buf_type);
+
+        memset(drm, 0, sizeof *drm);
+        drm->in_fence_fd = -1;
+        drm->drm_format = s->drm_format;
+        drm->fd_count = buffer->num_planes;
+        drm->planes = s->drm_planes;
+        for (unsigned p = 0; p < buffer->num_planes; ++p) {
+                drm->dmabuf_fds[p] = buffer->planes[p].dmabuf_fd;
+        }
+        for (int p = 0; p < s->drm_planes; ++p) {
+                drm->pitches[p] = s->pitches[p];
+                drm->modifiers[p] = 0; // DRM_FORMAT_MOD_LINEAR
+                if ((unsigned) p < buffer->num_planes) {
+                        drm->fd_indices[p] = p;
+                        drm->offsets[p] = mplane ? data->planes[p].data_offset : 0;
+                } else { // contiguous - the plane follows the previous one
+                        drm->fd_indices[p] = drm->fd_indices[p - 1];
+                        drm->offsets[p] = drm->offsets[p - 1] + s->pitches[p - 1] * s->desc.height;
+                }
+        }
+}
+
 static void vidcap_v4l2_common_cleanup(struct vidcap_v4l2_state *s) {
         if (!s) {
                 return;
         }
 
-        int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        int type = s->buf_type;
         if (s->fd != -1 && ioctl(s->fd, VIDIOC_STREAMOFF, &type) != 0) {
                 log_perror(LOG_LEVEL_ERROR, MOD_NAME "Stream stopping error");
         };
@@ -141,13 +224,7 @@ static void vidcap_v4l2_common_cleanup(struct vidcap_v4l2_state *s) {
         }
         pthread_mutex_unlock(&s->lock);
 
-        for (int i = 0; i < s->buffer_count; ++i) {
-                if (s->buffers[i].start) {
-                        if (-1 == munmap(s->buffers[i].start, s->buffers[i].length)) {
-                                log_perror(LOG_LEVEL_ERROR, MOD_NAME "munmap");
-                        }
-                }
-        }
+        unmap_v4l2_buffers(s->buffers, s->buffer_count);
 
         pthread_cond_destroy(&s->cv);
         pthread_mutex_destroy(&s->lock);
@@ -196,6 +273,13 @@ static void print_fps(int fd, struct v4l2_frmivalenum *param) {
         }
 }
 
+/// single-planar API is preferred if the device supports both
+static enum v4l2_buf_type get_capture_buf_type(uint32_t device_caps) {
+        return (device_caps & V4L2_CAP_VIDEO_CAPTURE) != 0 || (device_caps & V4L2_CAP_VIDEO_CAPTURE_MPLANE) == 0
+                ? V4L2_BUF_TYPE_VIDEO_CAPTURE
+                : V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+}
+
 static void write_fcc(char *out, int pixelformat){
         out[4] = '\0';
 
@@ -212,7 +296,7 @@ static void show_help(_Bool full)
         color_printf(TBOLD(
             TRED("\t-t v4l2[:device=<dev>]")
                 "[:codec=<pixel_fmt>][:size=<width>x<height>][:tpf=<tpf>|:fps=<"
-                "fps>][:buffers=<bufcnt>][:convert=<conv>][:permissive]")
+                "fps>][:buffers=<bufcnt>][:convert=<conv>][:permissive][:dmabuf]")
             "\n");
         color_printf("\t" TBOLD("-t v4l2:[short]help") "\n");
         printf("where\n");
@@ -233,6 +317,8 @@ static void show_help(_Bool full)
 #endif
         printf("\n");
         printf("\t\tpermissive - do not fail if configuration values (size, FPS) are adjusted by driver and not set exactly\n");
+        printf("\t\tdmabuf - export the capture buffers as dmabufs and pass them as DRM_PRIME frames (no copy, also NV12/P010),\n"
+               "\t\t         only for consumers able to import DRM_PRIME\n");
         printf("\n");
 
         printf("Available devices:\n");
@@ -255,8 +341,9 @@ static void show_help(_Bool full)
                         log_perror(LOG_LEVEL_WARNING, MOD_NAME "Unable to query device capabilities");
                 }
 
-                log_msg(LOG_LEVEL_VERBOSE, "Device %s capabilities: %#x (CAP_VIDEO_CAPTURE = %#x)\n", name, capab.device_caps, V4L2_CAP_VIDEO_CAPTURE);
-                if (!(capab.device_caps & V4L2_CAP_VIDEO_CAPTURE)){
+                log_msg(LOG_LEVEL_VERBOSE, "Device %s capabilities: %#x (CAP_VIDEO_CAPTURE = %#x, CAP_VIDEO_CAPTURE_MPLANE = %#x)\n",
+                                name, capab.device_caps, V4L2_CAP_VIDEO_CAPTURE, V4L2_CAP_VIDEO_CAPTURE_MPLANE);
+                if (!(capab.device_caps & (V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_VIDEO_CAPTURE_MPLANE))){
                         goto next_device;
                 }
 
@@ -264,12 +351,12 @@ static void show_help(_Bool full)
 
                 struct v4l2_fmtdesc format;
                 memset(&format, 0, sizeof(format));
-                format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                format.type = get_capture_buf_type(capab.device_caps);
                 format.index = 0;
 
                 struct v4l2_format fmt;
                 memset(&fmt, 0, sizeof(fmt));
-                fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                fmt.type = get_capture_buf_type(capab.device_caps);
                 if (ioctl(fd, VIDIOC_G_FMT, &fmt) != 0) {
                         log_perror(LOG_LEVEL_WARNING, MOD_NAME "Unable to get video format");
                         goto next_device;
@@ -384,7 +471,7 @@ static void vidcap_v4l2_probe(struct device_info **available_cards, int *count,
                         log_perror(LOG_LEVEL_WARNING, MOD_NAME "Unable to query device capabilities");
                 }
 
-                if (!(capab.device_caps & V4L2_CAP_VIDEO_CAPTURE)){
+                if (!(capab.device_caps & (V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_VIDEO_CAPTURE_MPLANE))){
                         goto next_device;
                 }
 
@@ -396,7 +483,7 @@ static void vidcap_v4l2_probe(struct device_info **available_cards, int *count,
 
                 struct v4l2_fmtdesc format;
                 memset(&format, 0, sizeof(format));
-                format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                format.type = get_capture_buf_type(capab.device_caps);
                 format.index = 0;
 
                 int fmt_idx = 0;
@@ -512,6 +599,7 @@ struct parsed_opts {
         uint32_t denominator;
         int buffer_count;
         bool permissive;
+        bool dmabuf;
         codec_t v4l2_convert_to;
 };
 
@@ -566,6 +654,8 @@ parse_fmt(char *fmt, struct parsed_opts *opts)
 #endif
                 } else if (IS_PREFIX(item, "permissive")) {
                         opts->permissive = 1;
+                } else if (IS_PREFIX(item, "dmabuf")) {
+                        opts->dmabuf = true;
                 } else {
                         MSG(ERROR, "Invalid configuration argument: %s\n",
                             item);
@@ -613,15 +703,16 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
 
         s->buffer_count = opts.buffer_count;
         s->permissive= opts.permissive;
+        s->dmabuf = opts.dmabuf;
 
         static_assert(V4L2_PROBE_MAX < 100, "Pattern below has place only for 2 digits");
         char dev_name_try[] = "/dev/videoXX";
         if (opts.dev_name != NULL) {
-                s->fd = try_open_v4l2_device(LOG_LEVEL_ERROR, opts.dev_name, V4L2_CAP_VIDEO_CAPTURE);
+                s->fd = try_open_v4l2_device(LOG_LEVEL_ERROR, opts.dev_name, V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_VIDEO_CAPTURE_MPLANE);
         } else {
                 for (int i = 0; i < V4L2_PROBE_MAX; ++i) {
                         snprintf(dev_name_try, sizeof dev_name_try, "/dev/video%d", i);
-                        s->fd = try_open_v4l2_device(LOG_LEVEL_WARNING, dev_name_try, V4L2_CAP_VIDEO_CAPTURE);
+                        s->fd = try_open_v4l2_device(LOG_LEVEL_WARNING, dev_name_try, V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_VIDEO_CAPTURE_MPLANE);
                         if (s->fd != -1) {
                                 opts.dev_name = dev_name_try;
                                 break;
@@ -632,7 +723,15 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
                 goto error;
         }
 
-        struct v4l2_format fmt = { .type = V4L2_BUF_TYPE_VIDEO_CAPTURE };
+        struct v4l2_capability capab = { 0 };
+        if (ioctl(s->fd, VIDIOC_QUERYCAP, &capab) != 0) {
+                log_perror(LOG_LEVEL_ERROR, MOD_NAME "Unable to query device capabilities");
+                goto error;
+        }
+        s->buf_type = get_capture_buf_type(capab.device_caps);
+        const bool mplane = V4L2_TYPE_IS_MULTIPLANAR(s->buf_type);
+
+        struct v4l2_format fmt = { .type = s->buf_type };
         if (ioctl(s->fd, VIDIOC_G_FMT, &fmt) != 0) {
                 log_perror(LOG_LEVEL_ERROR, MOD_NAME "Unable to get video format");
                 goto error;
@@ -654,7 +753,13 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
         }
 
         fmt.fmt.pix.field = V4L2_FIELD_ANY;
-        fmt.fmt.pix.bytesperline = 0;
+        if (mplane) {
+                for (unsigned i = 0; i < VIDEO_MAX_PLANES; ++i) {
+                        fmt.fmt.pix_mp.plane_fmt[i].bytesperline = 0;
+                }
+        } else {
+                fmt.fmt.pix.bytesperline = 0;
+        }
 
         struct v4l2_format req_fmt = fmt;
         if (ioctl(s->fd, VIDIOC_S_FMT, &fmt) != 0) {
@@ -678,7 +783,7 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
                 goto error;
         }
 
-        assert(fmt.type == V4L2_BUF_TYPE_VIDEO_CAPTURE);
+        assert(fmt.type == s->buf_type);
         memcpy(&s->src_fmt, &fmt, sizeof(fmt));
         memcpy(&s->dst_fmt, &fmt, sizeof(fmt));
         s->dst_fmt.fmt.pix.bytesperline = 0;
@@ -695,7 +800,29 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
 
         s->desc.tile_count = 1;
 
-        if (opts.v4l2_convert_to == VC_NONE) {
+        if (s->dmabuf) {
+                if (opts.v4l2_convert_to != VC_NONE) {
+                        MSG(ERROR, "Conversion cannot be combined with dmabuf!\n");
+                        goto error;
+                }
+                for (unsigned i = 0; i < sizeof v4l2_drm_map / sizeof v4l2_drm_map[0]; ++i) {
+                        if (v4l2_drm_map[i].v4l2_fcc == fmt.fmt.pix.pixelformat) {
+                                s->drm_format = v4l2_drm_map[i].drm_fcc;
+                                s->drm_planes = v4l2_drm_map[i].drm_planes;
+                        }
+                }
+                if (s->drm_format == 0) {
+                        MSG(ERROR, "Format %.4s cannot be exported as DRM PRIME!\n",
+                            (const char *) &fmt.fmt.pix.pixelformat);
+                        goto error;
+                }
+                // a single-plane contiguous semi-planar buffer has chroma with the luma pitch
+                for (int i = 0; i < s->drm_planes; ++i) {
+                        s->pitches[i] = !mplane ? fmt.fmt.pix.bytesperline
+                                : fmt.fmt.pix_mp.plane_fmt[MIN(i, fmt.fmt.pix_mp.num_planes - 1)].bytesperline;
+                }
+                s->desc.color_spec = DRM_PRIME;
+        } else if (opts.v4l2_convert_to == VC_NONE) {
                 s->desc.color_spec = get_v4l2_to_ug(fmt.fmt.pix.pixelformat);
                 if (s->desc.color_spec == VIDEO_CODEC_NONE) {
                         char fcc[5];
@@ -724,6 +851,11 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
                 s->desc.color_spec = opts.v4l2_convert_to;
 #endif
         }
+        if (mplane && !s->dmabuf && (opts.v4l2_convert_to != VC_NONE || fmt.fmt.pix_mp.num_planes != 1)) {
+                MSG(ERROR, "Format %.4s of the multi-planar device can be captured only with dmabuf!\n",
+                    (const char *) &fmt.fmt.pix.pixelformat);
+                goto error;
+        }
 
         unsigned i = 0;
         for ( ; i < sizeof v4l2_field_map / sizeof v4l2_field_map[0]; ++i) {
@@ -751,7 +883,7 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
         struct v4l2_requestbuffers reqbuf;
 
         memset(&reqbuf, 0, sizeof(reqbuf));
-        reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        reqbuf.type = s->buf_type;
         reqbuf.memory = V4L2_MEMORY_MMAP;
         reqbuf.count = s->buffer_count;
 
@@ -759,6 +891,9 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
                 goto error;
         }
         s->buffer_count = reqbuf.count;
+        if (s->dmabuf && !export_dmabufs(s)) {
+                goto error;
+        }
 
         if(ioctl(s->fd, VIDIOC_STREAMON, &reqbuf.type) != 0) {
                 log_perror(LOG_LEVEL_ERROR, MOD_NAME "Unable to start stream");
@@ -824,10 +959,17 @@ static struct video_frame * vidcap_v4l2_grab(void *state, struct audio_frame **a
 
         *audio = NULL;
 
+        const bool mplane = V4L2_TYPE_IS_MULTIPLANAR(s->buf_type);
+        struct v4l2_plane planes[VIDEO_MAX_PLANES];
         struct v4l2_buffer buf;
         memset(&buf, 0, sizeof(buf));
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.type = s->buf_type;
         buf.memory = V4L2_MEMORY_MMAP;
+        if (mplane) {
+                memset(planes, 0, sizeof planes);
+                buf.m.planes = planes;
+                buf.length = VIDEO_MAX_PLANES;
+        }
 
         if(ioctl(s->fd, VIDIOC_DQBUF, &buf) != 0) {
                 log_perror(LOG_LEVEL_ERROR, MOD_NAME "Unable to dequeue buffer");
@@ -846,7 +988,7 @@ static struct video_frame * vidcap_v4l2_grab(void *state, struct audio_frame **a
                 int ret = v4lconvert_convert(s->convert,
                                 &s->src_fmt,  /*  in */
                                 &s->dst_fmt, /*  in */
-                                s->buffers[buf.index].start,
+                                s->buffers[buf.index].planes[0].start,
                                 buf.bytesused,
                                 (unsigned char *) out->tiles[0].data,
                                 out->tiles[0].data_len);
@@ -873,8 +1015,22 @@ static struct video_frame * vidcap_v4l2_grab(void *state, struct audio_frame **a
                         malloc(sizeof(struct v4l2_dispose_deq_buffer_data));
                 frame_data->s = s;
                 memcpy(&frame_data->buf, &buf, sizeof(buf));
-                out->tiles[0].data = s->buffers[frame_data->buf.index].start;
-                out->tiles[0].data_len = frame_data->buf.bytesused;
+                if (mplane) {
+                        memcpy(frame_data->planes, planes, sizeof planes);
+                        frame_data->buf.m.planes = frame_data->planes;
+                }
+                // the buffer is lent to the frame until disposed
+                if (s->dmabuf) {
+                        fill_drm_prime_frame(s, frame_data);
+                        out->tiles[0].data = (char *) &frame_data->drm;
+                        out->tiles[0].data_len = sizeof frame_data->drm;
+                } else if (mplane) {
+                        out->tiles[0].data = (char *) s->buffers[buf.index].planes[0].start + planes[0].data_offset;
+                        out->tiles[0].data_len = planes[0].bytesused - planes[0].data_offset;
+                } else {
+                        out->tiles[0].data = s->buffers[frame_data->buf.index].planes[0].start;
+                        out->tiles[0].data_len = frame_data->buf.bytesused;
+                }
                 out->callbacks.dispose_udata = frame_data;
         }
 
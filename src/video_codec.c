@@ -75,6 +75,12 @@
 
 #ifdef __SSSE3__
 #include "tmmintrin.h"
+#define HAVE_SSSE3_BSWAP 1
+#else
+#define HAVE_SSSE3_BSWAP 0
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
 #endif
 
 char pixfmt_conv_pref[] = "dsc"; ///< bitdepth, subsampling, color space
@@ -485,8 +491,12 @@ bool codec_is_const_size(codec_t codec)
         return false;
 }
 
+/**
+ * @retval true if the codec is a (GPU) surface that is passed to the display
+ * without download (the frame data contain only the surface description)
+ */
 bool codec_is_hw_accelerated(codec_t codec) {
-        return codec == HW_VDPAU;
+        return codec == HW_VDPAU || codec == DRM_PRIME;
 }
 
 /**
@@ -701,17 +711,144 @@ static void vc_deinterlace_unaligned(unsigned char *src, long src_linesize, int
 }
 #endif
 
+bool vc_avg_lines_supported(codec_t codec)
+{
+        if (is_codec_opaque(codec) && codec_is_planar(codec)) {
+                return false;
+        }
+        const int bpp = get_bits_per_component(codec);
+        return bpp == 8 || bpp == 16 || codec == v210 || codec == R10k ||
+               codec == R12L;
+}
+
+/**
+ * Computes rounded average of 2 lines. Used by deinterlacers.
+ *
+ * dst may be the same as src1 or src2. 8- and 16-bit formats are averaged
+ * per byte/word, v210 and R10k per 10-bit component in a 32-bit word (SIMD
+ * within a register - carries from the lower components are masked out).
+ *
+ * @returns false on unsupported codecs (see vc_avg_lines_supported())
+ */
+bool vc_avg_lines(codec_t codec, size_t linesize, const unsigned char *src1, const unsigned char *src2, unsigned char *dst)
+{
+        if (!vc_avg_lines_supported(codec)) {
+                return false;
+        }
+        const int bpp = get_bits_per_component(codec);
+        size_t x = 0;
+        if (bpp == 8 || bpp == 16) {
+#ifdef __SSE2__
+                for ( ; x + 16 <= linesize; x += 16) {
+                        const __m128i i1 = _mm_loadu_si128((__m128i const *)(const void *) (src1 + x));
+                        const __m128i i2 = _mm_loadu_si128((__m128i const *)(const void *) (src2 + x));
+                        const __m128i res = bpp == 8 ? _mm_avg_epu8(i1, i2) : _mm_avg_epu16(i1, i2);
+                        _mm_storeu_si128((__m128i *)(void *) (dst + x), res);
+                }
+#endif
+                if (bpp == 8) {
+                        for ( ; x < linesize; ++x) {
+                                dst[x] = (src1[x] + src2[x] + 1) >> 1;
+                        }
+                } else {
+                        const uint16_t *s16_1 = (const void *) src1;
+                        const uint16_t *s16_2 = (const void *) src2;
+                        uint16_t *d16 = (void *) dst;
+                        for (x /= 2; x < linesize / 2; ++x) {
+                                d16[x] = (s16_1[x] + s16_2[x] + 1) >> 1;
+                        }
+                }
+        } else if (codec == v210 || codec == R10k) {
+                // (a | b) - ((a ^ b) >> 1) == ceil((a + b) / 2) per component
+                // if LSBs of "a ^ b" are cleared; padding bits are zeroed
+                const uint32_t used = codec == v210 ? 0x3FFFFFFFU : 0xFFFFFFFCU;
+                const uint32_t lsbs = codec == v210 ? 1U << 20 | 1U << 10 | 1U
+                                                    : 1U << 22 | 1U << 12 | 1U << 2;
+                const uint32_t mask = used & ~lsbs;
+#ifdef __SSSE3__
+                const __m128i bswap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+#endif
+#ifdef __SSE2__
+                const __m128i vused = _mm_set1_epi32((int) used);
+                const __m128i vmask = _mm_set1_epi32((int) mask);
+                for ( ; x + 16 <= linesize && (codec == v210 || HAVE_SSSE3_BSWAP); x += 16) {
+                        __m128i i1 = _mm_loadu_si128((__m128i const *)(const void *) (src1 + x));
+                        __m128i i2 = _mm_loadu_si128((__m128i const *)(const void *) (src2 + x));
+#ifdef __SSSE3__
+                        if (codec == R10k) {
+                                i1 = _mm_shuffle_epi8(i1, bswap);
+                                i2 = _mm_shuffle_epi8(i2, bswap);
+                        }
+#endif
+                        __m128i res = _mm_sub_epi32(_mm_and_si128(_mm_or_si128(i1, i2), vused),
+                                        _mm_srli_epi32(_mm_and_si128(_mm_xor_si128(i1, i2), vmask), 1));
+#ifdef __SSSE3__
+                        if (codec == R10k) {
+                                res = _mm_shuffle_epi8(res, bswap);
+                        }
+#endif
+                        _mm_storeu_si128((__m128i *)(void *) (dst + x), res);
+                }
+#endif
+                const uint32_t *s32_1 = (const void *) src1;
+                const uint32_t *s32_2 = (const void *) src2;
+                uint32_t *d32 = (void *) dst;
+                for (x /= 4; x < linesize / 4; ++x) {
+                        uint32_t v1 = codec == R10k ? ntohl(s32_1[x]) : s32_1[x];
+                        uint32_t v2 = codec == R10k ? ntohl(s32_2[x]) : s32_2[x];
+                        uint32_t out = ((v1 | v2) & used) - (((v1 ^ v2) & mask) >> 1);
+                        d32[x] = codec == R10k ? htonl(out) : out;
+                }
+        } else if (codec == R12L) {
+                const uint32_t *s32_1 = (const void *) src1;
+                const uint32_t *s32_2 = (const void *) src2;
+                uint32_t *d32 = (void *) dst;
+                int shift = 0;
+                uint32_t remain1 = 0;
+                uint32_t remain2 = 0;
+                uint32_t out = 0;
+                for (x = 0; x < linesize / 4; ++x) {
+                        uint32_t in1 = *s32_1++;
+                        uint32_t in2 = *s32_2++;
+                        if (shift > 0) {
+                                remain1 = remain1 | (in1 & ((1<<((shift + 12) % 32)) - 1)) << (32-shift);
+                                remain2 = remain2 | (in2 & ((1<<((shift + 12) % 32)) - 1)) << (32-shift);
+                                uint32_t ret = (remain1 + remain2 + 1) / 2;
+                                out |= ret << shift;
+                                *d32++ = out;
+                                out = ret >> (32-shift);
+                                shift = (shift + 12) % 32;
+                                in1 >>= shift;
+                                in2 >>= shift;
+                        }
+                        while (shift <= 32 - 12) {
+                                out |= ((((in1 & 0xfff) + (in2 & 0xfff)) + 1) / 2) << shift;
+                                in1 >>= 12;
+                                in2 >>= 12;
+                                shift += 12;
+                        }
+                        if (shift == 32) {
+                                *d32++ = out;
+                                out = 0;
+                                shift = 0;
+                        } else {
+                                remain1 = in1;
+                                remain2 = in2;
+                        }
+                }
+        }
+        return true;
+}
+
 /**
  * Extended version of vc_deinterlace(). The former version was in-place only.
  * This allows to output to a different buffer while it can still be used in-place.
  *
  * @returns false on unsupported codecs
  */
-// Sibling of this function is in double-framerate.cpp:avg_lines so consider
-// porting changes made here there.
 bool vc_deinterlace_ex(codec_t codec, unsigned char *src, size_t src_linesize, unsigned char *dst, size_t dst_pitch, size_t lines)
 {
-        if (is_codec_opaque(codec) && codec_is_planar(codec)) {
+        if (!vc_avg_lines_supported(codec)) {
                 return false;
         }
         if (lines == 1) {
@@ -719,124 +856,9 @@ bool vc_deinterlace_ex(codec_t codec, unsigned char *src, size_t src_linesize, u
                 return true;
         }
         DEBUG_TIMER_START(vc_deinterlace_ex);
-        int bpp = get_bits_per_component(codec);
         for (size_t y = 0; y < lines - 1; y += 1) {
                 unsigned char *s = src + y * src_linesize;
-                unsigned char *d = dst + y * dst_pitch;
-                if (bpp == 8 || bpp == 16) {
-                        size_t x = 0;
-#ifdef __SSSE3__
-                        if (bpp == 8) {
-                                for ( ; x < src_linesize / 16; ++x) {
-                                        __m128i i1 = _mm_lddqu_si128((__m128i const*)(const void *) s);
-                                        __m128i i2 = _mm_lddqu_si128((__m128i const*)(const void *) (s + src_linesize));
-                                        __m128i res = _mm_avg_epu8(i1, i2);
-                                        _mm_storeu_si128((__m128i *)(void *) d, res);
-                                        s += 16;
-                                        d += 16;
-                                }
-                        } else {
-                                for ( ; x < src_linesize / 16; ++x) {
-                                        __m128i i1 = _mm_lddqu_si128((__m128i const*)(const void *) s);
-                                        __m128i i2 = _mm_lddqu_si128((__m128i const*)(const void *) (s + src_linesize));
-                                        __m128i res = _mm_avg_epu16(i1, i2);
-                                        _mm_storeu_si128((__m128i *)(void *) d, res);
-                                        s += 16;
-                                        d += 16;
-                                }
-                        }
-#endif
-                        x *= 16;
-                        if (bpp  == 8) {
-                                for ( ; x < src_linesize; ++x) {
-                                        int val = (*s + s[src_linesize] + 1) >> 1;
-                                        *d++ = val;
-                                        s++;
-                                }
-                        } else {
-                                uint16_t *d16 = (void *) d;
-                                uint16_t *s16 = (void *) s;
-                                for ( ; x < src_linesize / 2; ++x) {
-                                        int val = (*s16 + s16[src_linesize / 2] + 1) >> 1;
-                                        *d16++ = val;
-                                        s16++;
-                                }
-                        }
-                } else if (codec == v210) {
-                        uint32_t *s32 = (void *) s;
-                        uint32_t *d32 = (void *) d;
-                        for (size_t x = 0; x < src_linesize / 16; ++x) {
-                                #pragma GCC unroll 4
-                                for (size_t y = 0; y < 4; ++y) {
-                                        uint32_t v1 = *s32;
-                                        uint32_t v2 = s32[src_linesize / 4];
-                                        uint32_t out =
-                                                (((v1 >> 20        ) + (v2 >> 20        ) + 1) / 2) << 20 |
-                                                (((v1 >> 10 & 0x3ff) + (v2 >> 10 & 0x3ff) + 1) / 2) << 10 |
-                                                (((v1       & 0x3ff) + (v2       & 0x3ff) + 1) / 2);
-                                        *d32++ = out;
-                                        s32++;
-                                }
-                        }
-                } else if (codec == R10k) {
-                        uint32_t *s32 = (void *) s;
-                        uint32_t *d32 = (void *) d;
-                        for (size_t x = 0; x < src_linesize / 16; ++x) {
-                                #pragma GCC unroll 4
-                                for (size_t y = 0; y < 4; ++y) {
-                                        uint32_t v1 = ntohl(*s32);
-                                        uint32_t v2 = ntohl(s32[src_linesize / 4]);
-                                        uint32_t out =
-                                                (((v1 >> 22        ) + (v2 >> 22        ) + 1) / 2) << 22 |
-                                                (((v1 >> 12 & 0x3ff) + (v2 >> 12 & 0x3ff) + 1) / 2) << 12 |
-                                                (((v1 >>  2 & 0x3ff) + (v2 >>  2 & 0x3ff) + 1) / 2) << 2;
-                                        *d32++ = htonl(out);
-                                        s32++;
-                                }
-                        }
-                } else if (codec == R12L) {
-                        uint32_t *s32 = (void *) s;
-                        uint32_t *d32 = (void *) d;
-                        int shift = 0;
-                        uint32_t remain1 = 0;
-                        uint32_t remain2 = 0;
-                        uint32_t out = 0;
-                        for (size_t x = 0; x < src_linesize / 36; ++x) {
-                                #pragma GCC unroll 8
-                                for (size_t y = 0; y < 8; ++y) {
-                                        uint32_t in1 = *s32;
-                                        uint32_t in2 = s32[src_linesize / 4];
-                                        if (shift > 0) {
-                                                remain1 = remain1 | (in1 & ((1<<((shift + 12) % 32)) - 1)) << (32-shift);
-                                                remain2 = remain2 | (in2 & ((1<<((shift + 12) % 32)) - 1)) << (32-shift);
-                                                uint32_t ret = (remain1 + remain2 + 1) / 2;
-                                                out |= ret << shift;
-                                                *d32++ = out;
-                                                out = ret >> (32-shift);
-                                                shift = (shift + 12) % 32;
-                                                in1 >>= shift;
-                                                in2 >>= shift;
-                                        }
-                                        while (shift <= 32 - 12) {
-                                                out |= ((((in1 & 0xfff) + (in2 & 0xfff)) + 1) / 2) << shift;
-                                                in1 >>= 12;
-                                                in2 >>= 12;
-                                                shift += 12;
-                                        }
-                                        if (shift == 32) {
-                                                *d32++ = out;
-                                                out = 0;
-                                                shift = 0;
-                                        } else {
-                                                remain1 = in1;
-                                                remain2 = in2;
-                                        }
-                                        s32++;
-                                }
-                        }
-                } else {
-                        return false;
-                }
+                vc_avg_lines(codec, src_linesize, s, s + src_linesize, dst + y * dst_pitch);
         }
         memcpy(dst + (lines - 1) * dst_pitch, dst + (lines - 2) * dst_pitch, src_linesize); // last line
         DEBUG_TIMER_STOP(vc_deinterlace_ex);
@@ -103,6 +103,8 @@ bool codec_is_planar(codec_t codec) __attribute__((const));
 
 void vc_deinterlace(unsigned char *src, long src_linesize, int lines);
 bool vc_deinterlace_ex(codec_t codec, unsigned char *src, size_t src_linesize, unsigned char *dst, size_t dst_pitch, size_t lines);
+bool vc_avg_lines_supported(codec_t codec) __attribute__((const));
+bool vc_avg_lines(codec_t codec, size_t linesize, const unsigned char *src1, const unsigned char *src2, unsigned char *dst);
 
 bool clear_video_buffer(unsigned char *data, size_t linesize, size_t pitch, size_t height, codec_t color_spec);
 
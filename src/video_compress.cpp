@@ -38,22 +38,27 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <atomic>
 #include <cassert>
 #include <cinttypes>
+#include <condition_variable>
 #include <cstdio>
 #include <cstring>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "host.h"
 #include "messaging.h"
 #include "module.h"
 #include "tv.h"
-#include "utils/synchronized_queue.h"
+#include "utils/frame_trace.h"
+#include "utils/lockfree_queue.h"
+#include "utils/numa.h"
 #include "utils/thread.h"
 #include "utils/vf_split.h"
-#include "utils/worker.h"
 #include "video.h"
 #include "video_compress.h"
 #include "lib_common.h"
@@ -66,6 +71,121 @@ using namespace std;
 struct compress_state;
 
 namespace {
+/**
+ * @brief Long-lived thread compressing tiles of one driver state
+ *
+ * Used by the synchronous tile API so that each per-tile state is always
+ * processed by the same thread without spawning a task per tile and frame.
+ */
+class tile_worker {
+public:
+        tile_worker(struct module *state, compress_tile_t callback)
+            : state(state), callback(callback),
+              thr(&tile_worker::run, this) {}
+        ~tile_worker() {
+                {
+                        lock_guard<mutex> lk(lock);
+                        should_exit = true;
+                }
+                cv.notify_one();
+                thr.join();
+        }
+        void push(shared_ptr<video_frame> frame) {
+                {
+                        lock_guard<mutex> lk(lock);
+                        job = std::move(frame);
+                        has_job = true;
+                }
+                cv.notify_one();
+        }
+        shared_ptr<video_frame> pop() {
+                unique_lock<mutex> lk(lock);
+                cv.wait(lk, [this] { return has_result; });
+                has_result = false;
+                return std::move(result);
+        }
+
+private:
+        void run() {
+                set_thread_name("compress_tile");
+                ug_numa_bind_thread();
+                unique_lock<mutex> lk(lock);
+                while (true) {
+                        cv.wait(lk, [this] { return has_job || should_exit; });
+                        if (should_exit) {
+                                return;
+                        }
+                        shared_ptr<video_frame> frame = std::move(job);
+                        has_job = false;
+                        lk.unlock();
+                        // strided tiles (capture filter split) are linearized here, in parallel
+                        shared_ptr<video_frame> ret = callback(state, vf_get_contiguous(std::move(frame)));
+                        lk.lock();
+                        result = std::move(ret);
+                        has_result = true;
+                        cv.notify_one();
+                }
+        }
+
+        struct module *state;
+        compress_tile_t callback;
+        mutex lock;
+        condition_variable cv;
+        bool has_job = false;
+        bool has_result = false;
+        bool should_exit = false;
+        shared_ptr<video_frame> job;
+        shared_ptr<video_frame> result;
+        thread thr;
+};
+
+/**
+ * @brief Recycled single-tile wrapper of a tile of a multi-tile frame
+ *
+ * The wrapper is reused if nobody holds the previously returned one,
+ * otherwise a new one is allocated (as vf_separate_tiles() does).
+ */
+struct tile_wrapper {
+        ~tile_wrapper() { vf_free(frame); }
+        struct video_frame *frame = nullptr;
+        shared_ptr<video_frame> parent; ///< frame the tile belongs to
+        atomic<bool> used{false};
+};
+
+shared_ptr<video_frame> wrap_tile(const shared_ptr<tile_wrapper> &w,
+                                  const shared_ptr<video_frame> &frame,
+                                  unsigned idx)
+{
+        struct video_desc desc = video_desc_from_frame(frame.get());
+        desc.tile_count = 1;
+        if (w->used.exchange(true, memory_order_acquire)) {
+                auto holder = new shared_ptr<video_frame>(frame);
+                shared_ptr<video_frame> ret(vf_alloc_desc(desc), [holder](struct video_frame *f) {
+                        delete holder;
+                        vf_free(f);
+                });
+                ret->tiles[0].data_len = frame->tiles[idx].data_len;
+                ret->tiles[0].data = frame->tiles[idx].data;
+                ret->tiles[0].pitch = frame->tiles[idx].pitch;
+                vf_copy_metadata(ret.get(), frame.get());
+                return ret;
+        }
+        if (w->frame == nullptr ||
+            !video_desc_eq(video_desc_from_frame(w->frame), desc)) {
+                vf_free(w->frame);
+                w->frame = vf_alloc_desc(desc);
+        }
+        w->frame->tiles[0].data_len = frame->tiles[idx].data_len;
+        w->frame->tiles[0].data = frame->tiles[idx].data;
+        w->frame->tiles[0].pitch = frame->tiles[idx].pitch;
+        vf_copy_metadata(w->frame, frame.get());
+        w->parent = frame;
+        return shared_ptr<video_frame>(w->frame, [w](struct video_frame *) {
+                w->parent = nullptr;
+                w->used.store(false, memory_order_release);
+        });
+}
+
 /**
  * @brief This structure represents real internal compress state
  */
@@ -86,6 +206,8 @@ public:
         ~compress_state_real();
         const video_compress_info    *funcs;            ///< handle for the driver
         vector<struct module *> state;                  ///< driver internal states
+        vector<unique_ptr<tile_worker>> tile_workers;   ///< sync tile API workers for state[1..]
+        vector<shared_ptr<tile_wrapper>> tile_wrappers; ///< sync tile API input wrappers
         string              compress_options; ///< compress options (for reconfiguration)
         volatile bool       discard_frames;   ///< this class is no longer active
 };
@@ -100,7 +222,7 @@ public:
 struct compress_state {
         struct module mod;               ///< compress module data
         struct compress_state_real *ptr; ///< pointer to real compress state
-        synchronized_queue<shared_ptr<video_frame>, 1> queue;
+        lockfree_queue<shared_ptr<video_frame>, 1> queue;
         bool poisoned = false;
 };
 
@@ -292,7 +414,9 @@ static bool check_state_count(unsigned tile_count, struct compress_state *proxy)
                 size_t old_size = s->state.size();
                 s->state.resize(tile_count);
                 for (unsigned int i = old_size; i < s->state.size(); ++i) {
+                        set_init_tile_index(i);
                         s->state[i] = s->funcs->init_func(&proxy->mod, s->compress_options.c_str());
+                        set_init_tile_index(0);
                         if(!s->state[i]) {
                                 LOG(LOG_LEVEL_ERROR) << MOD_NAME
                                     "Compression initialization failed\n";
@@ -332,11 +456,12 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
         }
         if (frame) {
                 frame->compress_start = get_time_in_ns();
+                frame_trace_event(frame->trace_id, FRAME_TRACE_COMPRESS_START);
         }
 
         if (s->funcs->compress_frame_async_push_func) {
                 assert(s->funcs->compress_frame_async_pop_func);
-                s->funcs->compress_frame_async_push_func(s->state[0], frame);
+                s->funcs->compress_frame_async_push_func(s->state[0], vf_get_contiguous(frame));
                 return;
         }
         if (s->funcs->compress_tile_async_push_func) {
@@ -352,8 +477,9 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
 
                 vector<shared_ptr<video_frame>> separate_tiles = vf_separate_tiles(frame);
 
-                for(unsigned i = 0; i < separate_tiles.size(); i++){
-                        s->funcs->compress_tile_async_push_func(s->state[i], separate_tiles[i]);
+                // the first tile last - a state may compress it synchronously in push
+                for (unsigned i = separate_tiles.size(); i-- > 0; ) {
+                        s->funcs->compress_tile_async_push_func(s->state[i], vf_get_contiguous(separate_tiles[i]));
                 }
                 return;
         }
@@ -367,7 +493,7 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
         shared_ptr<video_frame> sync_api_frame;
         do {
                 if (s->funcs->compress_frame_func) {
-                        sync_api_frame = s->funcs->compress_frame_func(s->state[0], frame);
+                        sync_api_frame = s->funcs->compress_frame_func(s->state[0], vf_get_contiguous(frame));
                 } else if(s->funcs->compress_tile_func) {
                         sync_api_frame = compress_frame_tiles(proxy, frame);
                 } else {
@@ -380,6 +506,7 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
                         return;
                 }
                 sync_api_frame->compress_end = get_time_in_ns();
+                frame_trace_event(sync_api_frame->trace_id, FRAME_TRACE_COMPRESS_END);
                 proxy->queue.push(sync_api_frame);
                 frame = nullptr;
         } while (true);
@@ -390,33 +517,12 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
  * The worker callbacks here are optimization - all tiles are processed concurrently.
  * @{
  */
-/**
- * @brief Auxiliary structure passed to worker thread.
- */
-struct compress_worker_data {
-        struct module *state;      ///< compress driver status
-        shared_ptr<video_frame> frame; ///< uncompressed tile to be compressed
-
-        compress_tile_t callback;  ///< tile compress callback
-        shared_ptr<video_frame> ret; ///< OUT - returned compressed tile, NULL if failed
-};
-
-/**
- * @brief This function is callback passed to a "thread pool"
- * @param arg @ref compress_worker_data
- * @return @ref compress_worker_data (same as input)
- */
-static void *compress_tile_callback(void *arg) {
-        compress_worker_data *s = (compress_worker_data *) arg;
-
-        s->ret = s->callback(s->state, s->frame);
-
-        return s;
-}
-
 /**
  * Compresses video frame with tiles API
  *
+ * The first tile is compressed by the calling thread, the others by
+ * per-state @ref tile_worker "workers".
+ *
  * @param         proxy         compress state
  * @param[in]     frame         uncompressed frame
  * @return                      compressed video frame, may be NULL if compression failed
@@ -425,44 +531,40 @@ static shared_ptr<video_frame> compress_frame_tiles(struct compress_state *proxy
                 shared_ptr<video_frame> frame)
 {
         struct compress_state_real *s = proxy->ptr;
-        const int tile_cnt = (int) proxy->ptr->state.size();
-        vector<shared_ptr<video_frame>> separate_tiles;
+        if (frame && !check_state_count(frame->tile_count, proxy)) {
+                return nullptr;
+        }
+        const int tile_cnt = (int) s->state.size();
+        for (int i = (int) s->tile_workers.size() + 1; i < tile_cnt; ++i) {
+                s->tile_workers.emplace_back(new tile_worker(s->state[i],
+                                        s->funcs->compress_tile_func));
+        }
+        while ((int) s->tile_wrappers.size() < tile_cnt) {
+                s->tile_wrappers.push_back(make_shared<tile_wrapper>());
+        }
+
+        vector<shared_ptr<video_frame>> separate_tiles(tile_cnt);
         if (frame) {
-                if (!check_state_count(frame->tile_count, proxy)) {
-                        return nullptr;
+                for (int i = 0; i < tile_cnt; ++i) {
+                        separate_tiles[i] = wrap_tile(s->tile_wrappers[i], frame, i);
                 }
-                separate_tiles = vf_separate_tiles(frame);
-        } else {
-                separate_tiles.resize(tile_cnt);
         }
-
         // frame pointer may no longer be valid
         frame = NULL;
 
-        vector<task_result_handle_t> task_handle(tile_cnt);
-
-        vector <compress_worker_data> data_tile(tile_cnt);
-        for (int i = 0; i < tile_cnt; ++i) {
-                struct compress_worker_data *data = &data_tile[i];
-                data->state = s->state[i];
-                data->frame = separate_tiles[i];
-                data->callback = s->funcs->compress_tile_func;
-
-                task_handle[i] = task_run_async(compress_tile_callback, data);
+        for (int i = 1; i < tile_cnt; ++i) {
+                s->tile_workers[i - 1]->push(std::move(separate_tiles[i]));
         }
 
-        vector<shared_ptr<video_frame>> compressed_tiles(separate_tiles.size());
-
-        bool failed = false;
-        for(unsigned int i = 0; i < separate_tiles.size(); ++i) {
-                struct compress_worker_data *data = (struct compress_worker_data *)
-                        wait_task(task_handle[i]);
-
-                if(!data->ret) {
+        vector<shared_ptr<video_frame>> compressed_tiles(tile_cnt);
+        compressed_tiles[0] = s->funcs->compress_tile_func(s->state[0],
+                        vf_get_contiguous(std::move(separate_tiles[0])));
+        bool failed = !compressed_tiles[0];
+        for (int i = 1; i < tile_cnt; ++i) {
+                compressed_tiles[i] = s->tile_workers[i - 1]->pop();
+                if (!compressed_tiles[i]) {
                         failed = true;
                 }
-
-                compressed_tiles[i] = data->ret;
         }
 
         if (failed) {
@@ -501,6 +603,7 @@ compress_state_real::~compress_state_real()
         if (asynch_consumer_thread.joinable()) {
                 asynch_consumer_thread.join();
         }
+        tile_workers.clear();
 
         for(unsigned int i = 0; i < state.size(); ++i) {
                 module_done(state[i]);
@@ -511,8 +614,10 @@ namespace {
 void compress_state_real::async_tile_consumer(struct compress_state *s)
 {
         set_thread_name(__func__);
+        ug_numa_bind_thread();
         vector<shared_ptr<video_frame>> compressed_tiles;
         unsigned expected_seq = 0;
+        bool numbered = false; ///< frames have seq set
         while (true) {
                 bool fail = false;
                 for(unsigned i = 0; i < state.size(); i++){
@@ -528,7 +633,9 @@ void compress_state_real::async_tile_consumer(struct compress_state *s)
                                 return;
                         }
 
-                        if(ret->seq > expected_seq){
+                        if (ret->seq > expected_seq && i == 0 && !numbered) {
+                                expected_seq = ret->seq; // first numbered frame
+                        } else if(ret->seq > expected_seq){
                                 log_msg(LOG_LEVEL_ERROR,
                                                 "Expected sequence number %u but got %u!\n",
                                                 expected_seq,
@@ -552,19 +659,25 @@ void compress_state_real::async_tile_consumer(struct compress_state *s)
                         continue;
 
                 if (!discard_frames) {
+                        frame_trace_event(compressed_tiles[0]->trace_id, FRAME_TRACE_COMPRESS_END);
                         s->queue.push(vf_merge_tiles(compressed_tiles));
                 }
                 //If frames are not numbered they always have seq = 0
-                if(expected_seq > 0) expected_seq++;
+                numbered = numbered || expected_seq > 0;
+                if (numbered) expected_seq++;
         }
 }
 
 void compress_state_real::async_consumer(struct compress_state *s)
 {
         set_thread_name(__func__);
+        ug_numa_bind_thread();
         while (true) {
                 auto frame = funcs->compress_frame_async_pop_func(state[0]);
                 if (!discard_frames) {
+                        if (frame) {
+                                frame_trace_event(frame->trace_id, FRAME_TRACE_COMPRESS_END);
+                        }
                         s->queue.push(frame);
 
                 }
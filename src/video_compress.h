@@ -62,6 +62,16 @@
  * s->mod.deleter = vcompress_xy_free;
  * module_register(&s->mod, s->parent);
  * ```
+ *
+ * #### Frame fragments
+ * To lower latency below a frame time, a module may output a compressed
+ * frame (with exactly one tile) in several parts as soon as they are
+ * complete (eg. slices). Each part is returned as a separate frame with
+ * video_frame::fragment set, same video_frame::frame_fragment_id for all
+ * parts of the frame, tile::offset set to the part position within the
+ * frame and video_frame::last_fragment set for the last part. For H.264/HEVC
+ * fragments must contain whole NAL units. Senders not able to transmit
+ * fragments get the frame reassembled.
  */
 #ifndef __video_compress_h
 #define __video_compress_h
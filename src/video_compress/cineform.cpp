@@ -96,7 +96,10 @@ struct state_video_compress_cineform{
         uint32_t frame_seq_in;
         uint32_t frame_seq_out;
 
-        std::queue<std::unique_ptr<video_frame, decltype(&vf_free)>> frame_queue;
+        /// source frames (for metadata) indexed by CFHD frame number
+        std::map<uint32_t, std::unique_ptr<video_frame, decltype(&vf_free)>> frame_queue;
+        /// encoded frames that the pool returned ahead of frame_seq_out
+        std::map<uint32_t, std::shared_ptr<video_frame>> reorder_buf;
 
         bool started;
         bool stop;
@@ -127,7 +130,7 @@ struct {
         const char *opt_str;
 } usage_opts[] = {
         {"Quality", "quality", "specifies encode quality, range 1-6 (default: 4)", ":quality="},
-        {"Threads", "num_threads", "specifies number of threads for encoding (default: " TOSTRING(DEFAULT_THREAD_COUNT) ")", ":num_threads="},
+        {"Threads", "num_threads", "specifies number of encoder instances working on alternating frames, 0 for number of CPU cores (default: " TOSTRING(DEFAULT_THREAD_COUNT) ")", ":num_threads="},
         {"Pool size", "pool_size", "specifies the size of encoding pool (default: " TOSTRING(DEFAULT_POOL_SIZE) ")", ":pool_size="},
 };
 
@@ -193,6 +196,9 @@ static struct module * cineform_compress_init(struct module *parent, const char
                 return ret > 0 ? static_cast<module*>(INIT_NOERR) : nullptr;
         }
 
+        if (s->requested_threads <= 0) {
+                s->requested_threads = get_cpu_core_count();
+        }
         log_msg(LOG_LEVEL_NOTICE, "[cineform] : Threads: %d.\n", s->requested_threads);
         CFHD_Error status = CFHD_ERROR_OKAY;
         status = CFHD_CreateEncoderPool(&s->encoderPoolRef,
@@ -366,11 +372,12 @@ static void cineform_compress_push(struct module *state, std::shared_ptr<video_f
                 video_frame *dummy_ptr = dummy.get();
 
                 s->stop = true;
-                s->frame_queue.push(std::move(dummy));
+                const uint32_t seq = s->frame_seq_in++;
+                s->frame_queue.emplace(seq, std::move(dummy));
                 lock.unlock();
 
                 status = CFHD_EncodeAsyncSample(s->encoderPoolRef,
-                                s->frame_seq_in++,
+                                seq,
                                 dummy_ptr->tiles[0].data,
                                 vc_get_linesize(s->precompress_desc.width, s->precompress_desc.color_spec),
                                 nullptr);
@@ -395,24 +402,27 @@ static void cineform_compress_push(struct module *state, std::shared_ptr<video_f
         std::unique_ptr<video_frame, decltype(&vf_free)> frame_copy(get_copy(s, tx.get()), vf_free);
         video_frame *frame_ptr = frame_copy.get();
 
-        s->frame_queue.push(std::move(frame_copy));
+        const uint32_t seq = s->frame_seq_in++;
+        s->frame_queue.emplace(seq, std::move(frame_copy));
 
 #ifdef MEASUREMENT
         struct timespec t_0;
         clock_gettime(CLOCK_MONOTONIC_RAW, &t_0);
 
-        s->times_map[s->frame_seq_in] = t_0;
+        s->times_map[seq] = t_0;
 #endif
         lock.unlock();
 
         status = CFHD_EncodeAsyncSample(s->encoderPoolRef,
-                        s->frame_seq_in++,
+                        seq,
                         frame_ptr->tiles[0].data,
                         vc_get_linesize(s->precompress_desc.width, s->precompress_desc.color_spec),
                         nullptr);
 
         if(status != CFHD_ERROR_OKAY){
                 log_msg(LOG_LEVEL_ERROR, "[cineform] Failed to push sample to encode pool\n");
+                lock.lock();
+                s->frame_queue.erase(seq);
                 return;
         }
 }
@@ -432,41 +442,30 @@ static void timespec_diff(struct timespec *start, struct timespec *stop,
 }
 #endif
 
-static std::shared_ptr<video_frame> cineform_compress_pop(struct module *state)
+/**
+ * Waits for next sample from the encoder pool. The pool runs multiple encoder
+ * instances, so the samples may be returned out of order - the caller
+ * (cineform_compress_pop()) reorders them by the frame number.
+ */
+static std::shared_ptr<video_frame> wait_for_sample(struct state_video_compress_cineform *s, uint32_t *frame_num)
 {
-        struct state_video_compress_cineform *s = (struct state_video_compress_cineform *) state->priv_data;
-
-        std::unique_lock<std::mutex> lock(s->mutex);
-
-        if(s->stop){
-                CFHD_SampleBufferRef buf;
-                uint32_t frame_num;
-                while(CFHD_TestForSample(s->encoderPoolRef, &frame_num, &buf) == CFHD_ERROR_OKAY){
-                        CFHD_ReleaseSampleBuffer(s->encoderPoolRef, buf);
-                }
-                return {};
-        }
-
-        const auto& started = s->started;
-        while(!started)
-                s->cv.wait(lock, [&started](){return started;});
-
-        lock.unlock();
-
         CFHD_Error status = CFHD_ERROR_OKAY;
-        uint32_t frame_num;
         CFHD_SampleBufferRef buf;
         status = CFHD_WaitForSample(s->encoderPoolRef,
-                        &frame_num,
+                        frame_num,
                         &buf);
 #if MEASUREMENT
         struct timespec t_0, t_1, t_res;
         clock_gettime(CLOCK_MONOTONIC_RAW, &t_1);
-        t_0 = s->times_map[frame_num];
+        {
+                std::lock_guard<std::mutex> lk(s->mutex);
+                t_0 = s->times_map[*frame_num];
+                s->times_map.erase(*frame_num);
+        }
 
         timespec_diff(&t_0, &t_1, &t_res);
 
-        printf("[cineform] Encoding %u frame took %f miliseconds.\n", frame_num, t_res.tv_nsec / 1000000.0);
+        printf("[cineform] Encoding %u frame took %f miliseconds.\n", *frame_num, t_res.tv_nsec / 1000000.0);
 #endif
         if(status != CFHD_ERROR_OKAY){
                 log_msg(LOG_LEVEL_ERROR, "[cineform] Failed to wait for sample %d\n", status);
@@ -478,6 +477,7 @@ static std::shared_ptr<video_frame> cineform_compress_pop(struct module *state)
                         static_cast<std::tuple<CFHD_EncoderPoolRef, CFHD_SampleBufferRef> *>(frame->callbacks.dispose_udata);
                 if(t)
                         CFHD_ReleaseSampleBuffer(std::get<0>(*t), std::get<1>(*t));
+                delete t;
                 vf_free(frame);
         };
 
@@ -489,19 +489,78 @@ static std::shared_ptr<video_frame> cineform_compress_pop(struct module *state)
         out->tiles[0].data_len = encoded_len;
         if(status != CFHD_ERROR_OKAY){
                 log_msg(LOG_LEVEL_ERROR, "[cineform] Failed to get sample data\n");
+                CFHD_ReleaseSampleBuffer(s->encoderPoolRef, buf);
+                out->tiles[0].data = nullptr;
                 return {};
         }
         out->callbacks.dispose_udata = new std::tuple<CFHD_EncoderPoolRef, CFHD_SampleBufferRef>(s->encoderPoolRef, buf);
-        out->seq = frame_num;
+        out->seq = *frame_num;
+
+        return out;
+}
+
+static std::shared_ptr<video_frame> cineform_compress_pop(struct module *state)
+{
+        struct state_video_compress_cineform *s = (struct state_video_compress_cineform *) state->priv_data;
+
+        std::unique_lock<std::mutex> lock(s->mutex);
+
+        if(s->stop){
+                CFHD_SampleBufferRef buf;
+                uint32_t frame_num;
+                while(CFHD_TestForSample(s->encoderPoolRef, &frame_num, &buf) == CFHD_ERROR_OKAY){
+                        CFHD_ReleaseSampleBuffer(s->encoderPoolRef, buf);
+                }
+                return {};
+        }
+
+        const auto& started = s->started;
+        while(!started)
+                s->cv.wait(lock, [&started](){return started;});
+
+        lock.unlock();
+
+        std::shared_ptr<video_frame> out;
+        uint32_t frame_num = 0;
+        while (true) {
+                lock.lock();
+                auto it = s->reorder_buf.find(s->frame_seq_out);
+                if (it == s->reorder_buf.end() && !s->reorder_buf.empty() &&
+                                s->reorder_buf.size() >= (size_t) s->requested_pool_size) {
+                        // frame_seq_out was lost (failed to encode), skip to the oldest available one
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Frame %u missing, skipping.\n", s->frame_seq_out);
+                        s->frame_queue.erase(s->frame_seq_out);
+                        it = s->reorder_buf.begin();
+                        s->frame_seq_out = it->first;
+                }
+                if (it != s->reorder_buf.end()) {
+                        frame_num = it->first;
+                        out = std::move(it->second);
+                        s->reorder_buf.erase(it);
+                        break;
+                }
+                lock.unlock();
+
+                out = wait_for_sample(s, &frame_num);
+                if (!out) {
+                        return {};
+                }
+                lock.lock();
+                if (frame_num == s->frame_seq_out) {
+                        break;
+                }
+                s->reorder_buf.emplace(frame_num, std::move(out));
+                lock.unlock();
+        }
+        s->frame_seq_out = frame_num + 1;
 
-        lock.lock();
-        if(s->frame_queue.empty()){
+        auto src = s->frame_queue.find(frame_num);
+        if(src == s->frame_queue.end()){
                 log_msg(LOG_LEVEL_ERROR, "[cineform] Failed to pop\n");
         } else {
-                auto &src = s->frame_queue.front();
-                vf_copy_metadata(out.get(), src.get());
+                vf_copy_metadata(out.get(), src->second.get());
+                s->frame_queue.erase(src);
         }
-        s->frame_queue.pop();
 
         out->compress_end = get_time_in_ns();
 
@@ -48,6 +48,7 @@
 #include "config.h"
 #endif // HAVE_CONFIG_H
 
+#include <algorithm>
 #include <cassert>
 #include <climits>
 #include <condition_variable>
@@ -63,9 +64,11 @@
 #include "debug.h"
 #include "host.h"
 #include "lib_common.h"
+#include "messaging.h"
 #include "module.h"
 #include "tv.h"
 #include "utils/color_out.h"
+#include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/video_frame_pool.h"
 #include "video.h"
@@ -84,8 +87,8 @@
 
 #define NOOP ((void) 0)
 #define DEFAULT_QUALITY 0.7
-/// default max size of state_video_compress_j2k::pool and also value
-/// for state_video_compress_j2k::max_in_frames
+/// default max size of state_video_compress_j2k::pool and minimal value
+/// for state_video_compress_j2k::max_in_frames if not set explicitly
 #define DEFAULT_POOL_SIZE 4
 /// number of frames that encoder encodes at moment
 #define DEFAULT_TILE_LIMIT 1
@@ -97,35 +100,13 @@ using std::stod;
 using std::shared_ptr;
 using std::unique_lock;
 
-#ifdef HAVE_CUDA
-struct cmpto_j2k_enc_cuda_host_buffer_data_allocator
-    : public video_frame_pool_allocator {
-        void *allocate(size_t size) override
-        {
-                void *ptr = nullptr;
-                if (CUDA_WRAPPER_SUCCESS !=
-                    cuda_wrapper_malloc_host(&ptr, size)) {
-                        MSG(ERROR, "Cannot allocate host buffer: %s\n",
-                            cuda_wrapper_last_error_string());
-                        return nullptr;
-                }
-                return ptr;
-        }
-        void deallocate(void *ptr) override { cuda_wrapper_free(ptr); }
-        [[nodiscard]] video_frame_pool_allocator *clone() const override
-        {
-                return new cmpto_j2k_enc_cuda_host_buffer_data_allocator(*this);
-        }
-};
-using allocator = cmpto_j2k_enc_cuda_host_buffer_data_allocator;
-#else
-using allocator = default_data_allocator;
-#endif
+using allocator = pinned_data_allocator;
 
 struct state_video_compress_j2k {
-        state_video_compress_j2k(long long int bitrate, unsigned int pool_size, int mct)
+        state_video_compress_j2k(long long int bitrate, unsigned int pool_size,
+                                 unsigned int in_flight, int mct)
             : rate(bitrate), mct(mct), pool(pool_size, allocator()),
-              max_in_frames(pool_size)
+              max_in_frames(in_flight)
         {
         }
 
@@ -322,7 +303,8 @@ struct {
         {"Quality", "quant_coeff", "Quality in range [0-1], default: " TOSTRING(DEFAULT_QUALITY), ":quality=", false},
         {"Mem limit", "mem_limit", "CUDA device memory limit (in bytes), default: " TOSTRING(DEFAULT_MEM_LIMIT), ":mem_limit=", false},
         {"Tile limit", "tile_limit", "Number of tiles encoded at moment (less to reduce latency, more to increase performance, 0 means infinity), default: " TOSTRING(DEFAULT_TILE_LIMIT), ":tile_limit=", false},
-        {"Pool size", "pool_size", "Total number of tiles encoder can hold at moment (same meaning as above), default: " TOSTRING(DEFAULT_POOL_SIZE) ", should be greater than <t>", ":pool_size=", false},
+        {"Pool size", "pool_size", "Total number of tiles encoder can hold at moment (same meaning as above), default: " TOSTRING(DEFAULT_POOL_SIZE) " or 2x number of tiles encoded by all devices if greater, should be greater than <t>", ":pool_size=", false},
+        {"In flight", "in_flight", "Max number of frames between push and pop, default: same as pool size", ":in_flight=", false},
         {"Use MCT", "mct", "use MCT", ":mct", true},
 };
 
@@ -371,7 +353,8 @@ static struct module * j2k_compress_init(struct module *parent, const char *c_cf
         long long int bitrate = 0;
         long long int mem_limit = DEFAULT_MEM_LIMIT;
         unsigned int tile_limit = DEFAULT_TILE_LIMIT;
-        unsigned int pool_size = DEFAULT_POOL_SIZE;
+        unsigned int pool_size = 0;
+        unsigned int in_flight = 0;
 
         const auto *version = cmpto_j2k_enc_get_version();
         LOG(LOG_LEVEL_INFO) << MOD_NAME << "Using codec version: " << (version == nullptr ? "(unknown)" : version->name) << "\n";
@@ -393,6 +376,8 @@ static struct module * j2k_compress_init(struct module *parent, const char *c_cf
                         ASSIGN_CHECK_VAL(tile_limit, strchr(item, '=') + 1, 0);
                 } else if (strncasecmp("pool_size=", item, strlen("pool_size=")) == 0) {
                         ASSIGN_CHECK_VAL(pool_size, strchr(item, '=') + 1, 1);
+                } else if (strncasecmp("in_flight=", item, strlen("in_flight=")) == 0) {
+                        ASSIGN_CHECK_VAL(in_flight, strchr(item, '=') + 1, 1);
                 } else if (strcasecmp("help", item) == 0) {
                         usage();
                         return static_cast<module*>(INIT_NOERR);
@@ -407,13 +392,33 @@ static struct module * j2k_compress_init(struct module *parent, const char *c_cf
                 return nullptr;
         }
 
-        auto *s = new state_video_compress_j2k(bitrate, pool_size, mct);
+        // with tiled video, every tile has own state, preferring own device
+        unsigned int devices[MAX_CUDA_DEVICES];
+        const unsigned int device_count = get_cuda_devices_for_tile(get_init_tile_index(), devices);
+
+        /*
+         * Auto-tune the depth so that every device has a frame queued while
+         * encoding another one - with the fixed default, the second and
+         * further GPUs starved when encoding large (8K) frames.
+         */
+        if (pool_size == 0) {
+                pool_size = std::max<unsigned int>(DEFAULT_POOL_SIZE,
+                                2 * device_count * std::max(tile_limit, 1U));
+        }
+        if (in_flight == 0) {
+                in_flight = pool_size;
+        }
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Using " << device_count
+                << " CUDA device(s) (first " << devices[0] << "), pool size " << pool_size
+                << ", max. " << in_flight << " frames in flight\n";
+
+        auto *s = new state_video_compress_j2k(bitrate, pool_size, in_flight, mct);
 
         struct cmpto_j2k_enc_ctx_cfg *ctx_cfg;
         CHECK_OK(cmpto_j2k_enc_ctx_cfg_create(&ctx_cfg), "Context configuration create",
                         goto error);
-        for (unsigned int i = 0; i < cuda_devices_count; ++i) {
-                CHECK_OK(cmpto_j2k_enc_ctx_cfg_add_cuda_device(ctx_cfg, cuda_devices[i], mem_limit, tile_limit),
+        for (unsigned int i = 0; i < device_count; ++i) {
+                CHECK_OK(cmpto_j2k_enc_ctx_cfg_add_cuda_device(ctx_cfg, devices[i], mem_limit, tile_limit),
                                 "Setting CUDA device", goto error);
         }
 
@@ -464,6 +469,35 @@ static void release_cstream(void * custom_data, size_t custom_data_size, const v
         udata->frame.~shared_ptr<video_frame>();
 }
 
+/// handles bitrate change (eg. from sender rate control), applied from next frame
+static void j2k_check_messages(struct state_video_compress_j2k *s)
+{
+        struct message *msg = nullptr;
+        while ((msg = check_message(&s->module_data))) {
+                auto *data = (struct msg_change_compress_data *) msg;
+                const char *cfg = data->config_string;
+                long long rate = 0;
+                if (IS_KEY_PREFIX(cfg, "bitrate") || IS_KEY_PREFIX(cfg, "rate")) {
+                        rate = unit_evaluate(strchr(cfg, '=') + 1, nullptr);
+                }
+                if (rate <= 0) {
+                        log_msg(LOG_LEVEL_ERROR, "[J2K] Unsupported message: %s\n", cfg);
+                        free_message(msg, new_response(RESPONSE_NOT_IMPL, NULL));
+                        continue;
+                }
+                s->rate = rate;
+                if (s->saved_desc.fps > 0) {
+                        CHECK_OK(cmpto_j2k_enc_cfg_set_rate_limit(s->enc_settings,
+                                                CMPTO_J2K_ENC_COMP_MASK_ALL,
+                                                CMPTO_J2K_ENC_RES_MASK_ALL, s->rate / 8 / s->saved_desc.fps),
+                                        "Setting rate limit",
+                                        NOOP);
+                }
+                log_msg(LOG_LEVEL_VERBOSE, "[J2K] Rate set to %lld bps\n", rate);
+                free_message(msg, new_response(RESPONSE_OK, NULL));
+        }
+}
+
 #define HANDLE_ERROR_COMPRESS_PUSH if (img) cmpto_j2k_enc_img_destroy(img); return
 static void j2k_compress_push(struct module *state, std::shared_ptr<video_frame> tx)
 {
@@ -477,6 +511,8 @@ static void j2k_compress_push(struct module *state, std::shared_ptr<video_frame>
                 return;
         }
 
+        j2k_check_messages(s);
+
         const struct video_desc desc = video_desc_from_frame(tx.get());
         if (!video_desc_eq(s->saved_desc, desc)) {
                 int ret = configure_with(s, desc);
@@ -56,35 +56,19 @@ using namespace std;
 
 namespace {
 
-struct cuda_buffer_data_allocator : public video_frame_pool_allocator {
-        void *allocate(size_t size) override {
-                void *ptr;
-                if (CUDA_WRAPPER_SUCCESS != cuda_wrapper_malloc_host(&ptr,
-                                        size)) {
-                        return NULL;
-                }
-                return ptr;
-        }
-        void deallocate(void *ptr) override {
-                cuda_wrapper_free(ptr);
-        }
-        video_frame_pool_allocator *clone() const override {
-                return new cuda_buffer_data_allocator(*this);
-        }
-};
-
 struct state_video_compress_cuda_dxt {
         struct module       module_data;
         struct video_desc   saved_desc;
-        char               *in_buffer;      ///< for decoded data
+        char               *in_buffer;      ///< for decoded data (pinned)
         char               *cuda_uyvy_buffer; ///< same as in_buffer but in device memory
         char               *cuda_in_buffer;  ///< same as in_buffer but in device memory
         char               *cuda_out_buffer;  ///< same as in_buffer but in device memory
         codec_t             in_codec;
         codec_t             out_codec;
         decoder_t           decoder;
+        cuda_wrapper_stream_t stream;       ///< from the shared pool
 
-        video_frame_pool pool{0, cuda_buffer_data_allocator()};
+        video_frame_pool pool{0, pinned_data_allocator()};
 };
 
 static void cuda_dxt_compress_done(struct module *mod);
@@ -120,10 +104,8 @@ struct module *cuda_dxt_compress_init(struct module *parent,
 
 static void cleanup(struct state_video_compress_cuda_dxt *s)
 {
-        if (s->in_buffer) {
-                free(s->in_buffer);
-                s->in_buffer = NULL;
-        }
+        cuda_wrapper_pinned_pool_release(s->in_buffer);
+        s->in_buffer = NULL;
         if (s->cuda_uyvy_buffer) {
                 cuda_wrapper_free(s->cuda_uyvy_buffer);
                 s->cuda_uyvy_buffer = NULL;
@@ -162,7 +144,17 @@ static bool configure_with(struct state_video_compress_cuda_dxt *s, struct video
                 }
         }
 
-        s->in_buffer = (char *) malloc(desc.width * desc.height * 3);
+        if (s->stream == NULL && cuda_wrapper_stream_pool_get(cuda_devices[0],
+                                &s->stream) != CUDA_WRAPPER_SUCCESS) {
+                fprintf(stderr, "Could not get CUDA stream: %s\n", cuda_wrapper_last_error_string());
+                return false;
+        }
+
+        if (CUDA_WRAPPER_SUCCESS != cuda_wrapper_pinned_pool_alloc((void **) &s->in_buffer,
+                                desc.width * desc.height * 3)) {
+                fprintf(stderr, "Could not allocate input buffer.\n");
+                return false;
+        }
 
         if (CUDA_WRAPPER_SUCCESS != cuda_wrapper_malloc((void **) &s->cuda_in_buffer,
                                 desc.width * desc.height * 3)) {
@@ -225,21 +217,21 @@ shared_ptr<video_frame> cuda_dxt_compress_tile(struct module *mod, shared_ptr<vi
         }
 
         if (s->in_codec == UYVY) {
-                if (cuda_wrapper_memcpy(s->cuda_uyvy_buffer, in_buffer, tx->tiles[0].width *
+                if (cuda_wrapper_memcpy_async(s->cuda_uyvy_buffer, in_buffer, tx->tiles[0].width *
                                         tx->tiles[0].height * 2,
-                                        CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE) != CUDA_WRAPPER_SUCCESS) {
+                                        CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE, s->stream) != CUDA_WRAPPER_SUCCESS) {
                         fprintf(stderr, "Memcpy failed: %s\n", cuda_wrapper_last_error_string());
                         return NULL;
                 }
                 if (cuda_yuv422_to_yuv444(s->cuda_uyvy_buffer, s->cuda_in_buffer,
                                         tx->tiles[0].width *
-                                        tx->tiles[0].height, 0) != CUDA_WRAPPER_SUCCESS) {
+                                        tx->tiles[0].height, s->stream) != CUDA_WRAPPER_SUCCESS) {
                         fprintf(stderr, "Kernel failed: %s\n", cuda_wrapper_last_error_string());
                 }
         } else {
-                if (cuda_wrapper_memcpy(s->cuda_in_buffer, in_buffer, tx->tiles[0].width *
+                if (cuda_wrapper_memcpy_async(s->cuda_in_buffer, in_buffer, tx->tiles[0].width *
                                         tx->tiles[0].height * 3,
-                                        CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE) != CUDA_WRAPPER_SUCCESS) {
+                                        CUDA_WRAPPER_MEMCPY_HOST_TO_DEVICE, s->stream) != CUDA_WRAPPER_SUCCESS) {
                         fprintf(stderr, "Memcpy failed: %s\n", cuda_wrapper_last_error_string());
                         return NULL;
                 }
@@ -262,17 +254,18 @@ shared_ptr<video_frame> cuda_dxt_compress_tile(struct module *mod, shared_ptr<vi
                 }
         }
         int ret = cuda_dxt_enc_func(s->cuda_in_buffer, s->cuda_out_buffer,
-                        s->saved_desc.width, s->saved_desc.height, 0);
+                        s->saved_desc.width, s->saved_desc.height, s->stream);
         if (ret != 0) {
                 fprintf(stderr, "Encoding failed: %s\n", cuda_wrapper_last_error_string());
                 return NULL;
         }
 
         shared_ptr<video_frame> out = s->pool.get_frame();
-        if (cuda_wrapper_memcpy(out->tiles[0].data,
+        if (cuda_wrapper_memcpy_async(out->tiles[0].data,
                                 s->cuda_out_buffer,
                                 out->tiles[0].data_len,
-                                CUDA_WRAPPER_MEMCPY_DEVICE_TO_HOST) != CUDA_WRAPPER_SUCCESS) {
+                                CUDA_WRAPPER_MEMCPY_DEVICE_TO_HOST, s->stream) != CUDA_WRAPPER_SUCCESS ||
+                        cuda_wrapper_stream_synchronize(s->stream) != CUDA_WRAPPER_SUCCESS) {
                 fprintf(stderr, "Memcpy failed: %s\n", cuda_wrapper_last_error_string());
                 return NULL;
         }
@@ -55,7 +55,9 @@
 #include "video.h"
 #include "video_compress.h"
 
+#include <array>
 #include <memory>
+#include <queue>
 
 using namespace std;
 
@@ -78,6 +80,9 @@ struct state_video_compress_rtdxt {
         struct gl_context gl_context;
 
         video_frame_pool pool;
+
+        int frames_in_flight; ///< frames compressed before the first is returned
+        queue<array<char, VF_METADATA_SIZE>> metadata; ///< of the frames in flight
 };
 
 static int configure_with(struct state_video_compress_rtdxt *s, struct video_frame *frame);
@@ -210,6 +215,9 @@ static int configure_with(struct state_video_compress_rtdxt *s, struct video_fra
         return TRUE;
 }
 
+ADD_TO_PARAM("rtdxt-frames-in-flight", "* rtdxt-frames-in-flight=<n>\n"
+                "  number of frames RTDXT compresses before returning the first one (default 1),\n"
+                "  the GPU readback overlaps with processing of next frames, increases latency by <n>-1 frames\n");
 struct module *dxt_glsl_compress_init(struct module *parent, const char *opts)
 {
         struct state_video_compress_rtdxt *s;
@@ -249,6 +257,18 @@ struct module *dxt_glsl_compress_init(struct module *parent, const char *opts)
 
         gl_context_make_current(NULL);
 
+        s->frames_in_flight = 1;
+        if (get_commandline_param("rtdxt-frames-in-flight") != nullptr) {
+                s->frames_in_flight = atoi(get_commandline_param("rtdxt-frames-in-flight"));
+                if (s->frames_in_flight <= 0 || s->frames_in_flight > DXT_ENCODER_MAX_IN_FLIGHT) {
+                        log_msg(LOG_LEVEL_ERROR, "[RTDXT] Wrong frames in flight count: %s (max %d)\n",
+                                        get_commandline_param("rtdxt-frames-in-flight"), DXT_ENCODER_MAX_IN_FLIGHT);
+                        destroy_gl_context(&s->gl_context);
+                        delete s;
+                        return NULL;
+                }
+        }
+
         module_init_default(&s->module_data);
         s->module_data.cls = MODULE_CLASS_DATA;
         s->module_data.priv_data = s;
@@ -279,14 +299,17 @@ shared_ptr<video_frame> dxt_glsl_compress(struct module *mod, shared_ptr<video_f
                         return NULL;
         }
 
-        shared_ptr<video_frame> out_frame = s->pool.get_frame();
-
         for (x = 0; x < tx->tile_count; ++x) {
                 struct tile *in_tile = vf_get_tile(tx.get(), x);
-                struct tile *out_tile = vf_get_tile(out_frame.get(), x);
+                // decode directly to the upload buffer if possible (it must not be read)
+                unsigned char *decoded = s->interlaced_input ? nullptr :
+                        dxt_encoder_get_upload_buffer(s->encoder[x]);
+                if (decoded == nullptr) {
+                        decoded = (unsigned char *) s->decoded.get();
+                }
 
                 line1 = (unsigned char *) in_tile->data;
-                line2 = (unsigned char *) s->decoded.get();
+                line2 = decoded;
 
                 for (i = 0; i < (int) in_tile->height; ++i) {
                         s->decoder(line2, line1, s->encoder_input_linesize,
@@ -296,13 +319,26 @@ shared_ptr<video_frame> dxt_glsl_compress(struct module *mod, shared_ptr<video_f
                 }
 
                 if(s->interlaced_input)
-                        vc_deinterlace((unsigned char *) s->decoded.get(), s->encoder_input_linesize,
+                        vc_deinterlace(decoded, s->encoder_input_linesize,
                                         in_tile->height);
 
-                dxt_encoder_compress(s->encoder[x],
-                                (unsigned char *) s->decoded.get(),
-                                (unsigned char *) out_tile->data);
+                dxt_encoder_compress_start(s->encoder[x], decoded);
+        }
+        s->metadata.emplace();
+        vf_store_metadata(tx.get(), s->metadata.back().data());
+
+        if (dxt_encoder_in_flight(s->encoder[0]) < s->frames_in_flight) {
+                gl_context_make_current(NULL);
+                return {};
+        }
+
+        shared_ptr<video_frame> out_frame = s->pool.get_frame();
+        for (x = 0; x < out_frame->tile_count; ++x) {
+                dxt_encoder_compress_finish(s->encoder[x],
+                                (unsigned char *) vf_get_tile(out_frame.get(), x)->data);
         }
+        vf_restore_metadata(out_frame.get(), s->metadata.front().data());
+        s->metadata.pop();
 
         gl_context_make_current(NULL);
 
@@ -54,7 +54,7 @@
 #include "module.h"
 #include "tv.h"
 #include "utils/color_out.h"
-#include "utils/synchronized_queue.h"
+#include "utils/lockfree_queue.h"
 #include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_compress.h"
@@ -114,7 +114,7 @@ public:
         void worker();
         void compress(shared_ptr<video_frame> frame);
 
-        synchronized_queue<shared_ptr<struct video_frame>, 1> m_in_queue; ///< queue for uncompressed frames
+        lockfree_queue<shared_ptr<struct video_frame>, 1> m_in_queue; ///< queue for uncompressed frames
         thread                                   m_thread_id;
         bool                                     m_occupied; ///< protected by state_video_compress_gpujpeg::m_occupancy_lock
 };
@@ -124,7 +124,7 @@ private:
         state_video_compress_gpujpeg(struct module *parent, const char *opts);
 
         vector<struct encoder_state *> m_workers;
-        bool                           m_uses_worker_threads; ///< true if cuda_devices_count > 1
+        bool                           m_uses_worker_threads; ///< true if more than one worker (multiple devices or pipeline)
 
         map<uint32_t, shared_ptr<struct video_frame>> m_out_frames; ///< frames decoded out of order
         uint32_t m_in_seq;  ///< seq of next frame to be encoded
@@ -154,10 +154,11 @@ public:
         int                     m_quality;
         bool                    m_force_interleaved = false;
         bool                    m_compress_alpha = false;
+        int                     m_pipeline_depth = 1; ///< number of encoder instances per CUDA device
         int                     m_subsampling = 0; // 444, 422 or 420; 0 -> autoselect
         enum gpujpeg_color_space m_use_internal_codec = GPUJPEG_NONE; // requested internal codec
 
-        synchronized_queue<shared_ptr<struct video_frame>, 1> m_out_queue; ///< queue for compressed frames
+        lockfree_queue<shared_ptr<struct video_frame>, 1> m_out_queue; ///< queue for compressed frames
         mutex                                                 m_occupancy_lock;
         condition_variable                                    m_worker_finished;
 };
@@ -169,7 +170,8 @@ public:
  * CUDA device is used to avoid context switches that introduce some overhead
  * (measured ~4% performance drop).
  *
- * When there are multiple CUDA devices to be used, it is called from encoder_state::worker().
+ * When there are multiple CUDA devices to be used or pipelining is enabled,
+ * it is called from encoder_state::worker().
  */
 void encoder_state::compress(shared_ptr<video_frame> frame)
 {
@@ -193,7 +195,8 @@ void encoder_state::compress(shared_ptr<video_frame> frame)
 
 /**
  * Worker thread that is used if multiple CUDA devices are used - every device
- * has its own thread.
+ * has its own thread. With pipeline=<n>, there are n workers per device so
+ * that upload, encode and download of consecutive frames can overlap.
  */
 void encoder_state::worker() {
         while (true) {
@@ -374,6 +377,12 @@ bool state_video_compress_gpujpeg::parse_fmt(char *fmt)
                         } else if (strstr(tok, "subsampling=") == tok) {
                                 m_subsampling = atoi(tok + strlen("subsampling="));
                                 assert(set<int>({444, 422, 420}).count(m_subsampling) == 1);
+                        } else if (strstr(tok, "pipeline=") == tok) {
+                                m_pipeline_depth = atoi(tok + strlen("pipeline="));
+                                if (m_pipeline_depth < 1) {
+                                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Error: Pipeline depth should be positive!\n");
+                                        return false;
+                                }
                         } else if (strcmp(tok, "alpha") == 0) {
 #if GPUJPEG_VERSION_INT < GPUJPEG_MK_VERSION_INT(0, 20, 2)
                                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "GPUJPEG v0.20.2 is required for alpha support, %s found.\n",
@@ -419,20 +428,38 @@ state_video_compress_gpujpeg::state_video_compress_gpujpeg(struct module *parent
 
 /**
  * Creates GPUJPEG encoding state and creates GPUJPEG workers for every GPU that
- * will be used for compression (if cuda_devices_count > 1).
+ * will be used for compression (if cuda_devices_count > 1 or pipeline depth is > 1).
+ *
+ * Workers of different devices are interleaved so that free worker selection in
+ * push() spreads consecutive frames over GPUs first. With tiled video, every
+ * tile has own state beginning with the device assigned to the tile.
  */
 state_video_compress_gpujpeg *state_video_compress_gpujpeg::create(struct module *parent, const char *opts) {
         assert(cuda_devices_count > 0);
 
         auto ret = new state_video_compress_gpujpeg(parent, opts);
 
-        for (unsigned int i = 0; i < cuda_devices_count; ++i) {
-                ret->m_workers.push_back(new encoder_state(ret, cuda_devices[i]));
+        const unsigned int tile_idx = get_init_tile_index();
+        unsigned int devices[MAX_CUDA_DEVICES];
+        const unsigned int device_count = get_cuda_devices_for_tile(tile_idx, devices);
+        for (int j = 0; j < ret->m_pipeline_depth; ++j) {
+                for (unsigned int i = 0; i < device_count; ++i) {
+                        ret->m_workers.push_back(new encoder_state(ret, devices[i]));
+                }
         }
 
-        if (cuda_devices_count > 1) {
+        // tiles other than the first are pushed before it, so they must not block
+        if (ret->m_workers.size() > 1 || tile_idx > 0) {
                 ret->m_uses_worker_threads = true;
         }
+        if (tile_idx > 0 || device_count == 1) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Tile %u uses CUDA device %u.\n",
+                                tile_idx, devices[0]);
+        }
+        if (ret->m_pipeline_depth > 1) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Using %d encoder instances per CUDA device.\n",
+                                ret->m_pipeline_depth);
+        }
 
         if (ret->m_uses_worker_threads) {
                 for (auto worker : ret->m_workers) {
@@ -475,6 +502,11 @@ static const struct {
         {"Alpha", "alpha", "alpha",
                 "\t\tCompress (keep) alpha channel of RGBA.\n",
                 ":alpha", true},
+        {"Pipeline", "pipeline", "pipeline",
+                "\t\tNumber of encoder instances per GPU (default 1). Frames are\n"
+                        "\t\tdistributed in a ring so that host-device transfers of one\n"
+                        "\t\tframe overlap with encoding of another. Increases latency.\n",
+                ":pipeline=", false},
 };
 
 struct module * gpujpeg_compress_init(struct module *parent, const char *opts)
@@ -488,7 +520,7 @@ struct module * gpujpeg_compress_init(struct module *parent, const char *opts)
 
         if(opts && strcmp(opts, "help") == 0) {
                 col() << "GPUJPEG comperssion usage:\n";
-                col() << "\t" << TBOLD(TRED("-c GPUJPEG") << "[:<quality>[:<restart_interval>]][:interleaved][:RGB|Y601|Y601full|Y709]][:subsampling=<sub>][:alpha]\n");
+                col() << "\t" << TBOLD(TRED("-c GPUJPEG") << "[:<quality>[:<restart_interval>]][:interleaved][:RGB|Y601|Y601full|Y709]][:subsampling=<sub>][:alpha][:pipeline=<n>]\n");
                 col() << "where\n";
 
                 for(const auto& i : usage_opts){
@@ -731,10 +763,10 @@ const struct video_compress_info gpujpeg_info = {
         gpujpeg_compress_init,
         NULL,
         NULL,
-        gpujpeg_compress_push,
-        gpujpeg_compress_pull,
         NULL,
         NULL,
+        gpujpeg_compress_push, // tile API - every tile has own state (and CUDA device)
+        gpujpeg_compress_pull,
         get_gpujpeg_module_info
 };
 
@@ -748,10 +780,10 @@ const struct video_compress_info deprecated_jpeg_info = {
         gpujpeg_compress_init_deprecated,
         NULL,
         NULL,
-        gpujpeg_compress_push,
-        gpujpeg_compress_pull,
         NULL,
         NULL,
+        gpujpeg_compress_push,
+        gpujpeg_compress_pull,
         NULL
 };
 
@@ -37,16 +37,23 @@
 
 #define __STDC_CONSTANT_MACROS
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cinttypes>
 #include <cmath>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>                        // for strcmp, strlen, strstr, strchr
+#include <fstream>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <regex>
 #include <set>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <thread>
@@ -54,6 +61,8 @@
 #include <vector>
 
 #include "config.h"
+#include "config_unix.h"  // gethostname
+#include "config_win32.h" // -||-
 #include "debug.h"
 #include "host.h"
 #include "lib_common.h"
@@ -67,6 +76,7 @@
 #include "tv.h"
 #include "ug_runtime_error.hpp"
 #include "utils/color_out.h"
+#include "utils/fs.h"
 #include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/string.h" // replace_all
@@ -154,6 +164,7 @@ struct setparam_param {
         double              requested_bpp = 0;
         double              requested_crf = -1;
         int                 requested_cqp = -1;
+        unsigned int        cuda_device = 0; ///< NVENC GPU, assigned to the compressed tile
 };
 
 typedef struct {
@@ -175,6 +186,8 @@ static void show_encoder_help(string const &name);
 static void print_codec_supp_pix_fmts(const enum AVPixelFormat *first);
 void usage(bool full);
 static void cleanup(struct state_video_compress_libav *s);
+static void ctx_cache_clear(struct state_video_compress_libav *s);
+static bool warm_up(struct state_video_compress_libav *s, const char *cfg);
 
 static map<codec_t, codec_params_t> codec_params = {
         { H264, codec_params_t{
@@ -246,8 +259,11 @@ struct aux_header {
         size_t buf_len = 0;
 };
 
+static std::atomic<int> lavc_instances{0}; ///< encoder instances in the process
+
 struct state_video_compress_libav {
         state_video_compress_libav(struct module *parent) {
+                lavc_instances += 1;
                 module_init_default(&module_data);
                 module_data.cls = MODULE_CLASS_DATA;
                 module_data.priv_data = this;
@@ -255,6 +271,7 @@ struct state_video_compress_libav {
                 module_register(&module_data, parent);
         }
         ~state_video_compress_libav() {
+                lavc_instances -= 1;
                 av_packet_free(&pkt);
                 to_lavc_vid_conv_destroy(&pixfmt_conversion);
         }
@@ -263,6 +280,7 @@ struct state_video_compress_libav {
 
         struct video_desc   saved_desc{};
         struct to_lavc_vid_conv *pixfmt_conversion = nullptr;
+        enum AVPixelFormat  conv_pix_fmt = AV_PIX_FMT_NONE; ///< output of pixfmt_conversion
         AVPacket           *pkt = av_packet_alloc();
         // for every core - parts of the above
         AVCodecContext     *codec_ctx = nullptr;
@@ -283,7 +301,6 @@ struct state_video_compress_libav {
         set<string>         blacklist_opts; ///< options that has been processed by setparam handlers and should not be passed to codec
 
         bool hwenc = false;
-        AVFrame *hwframe = nullptr;
 
 #ifdef HAVE_SWSCALE
         struct SwsContext *sws_ctx = nullptr;
@@ -298,6 +315,20 @@ struct state_video_compress_libav {
         int64_t   max_pts_diff_reported    = 0;
 
         map<int64_t, char[VF_METADATA_SIZE]> metadata_storage;
+
+        /// opened encoder kept for instant reconfiguration (lavc-ctx-cache)
+        struct cached_config {
+                struct video_desc desc;
+                struct video_desc compressed_desc;
+                AVCodecContext *codec_ctx;
+                struct to_lavc_vid_conv *pixfmt_conversion;
+                enum AVPixelFormat conv_pix_fmt;
+                struct aux_header aux_header;
+                bool hwenc;
+        };
+        list<cached_config> ctx_cache; ///< most recently used first
+        unsigned            ctx_cache_size = 0;
+        bool                force_keyframe = false; ///< next frame is the first one from a cached encoder
 };
 
 struct codec_encoders_decoders{
@@ -672,6 +703,9 @@ struct module * libavcodec_compress_init(struct module *parent, const char *opts
 
         char *fmt = strdup(opts);
         struct state_video_compress_libav *s = new state_video_compress_libav(parent);
+        unsigned int devices[MAX_CUDA_DEVICES];
+        get_cuda_devices_for_tile(get_init_tile_index(), devices);
+        s->params.cuda_device = devices[0];
         int ret = -1;
         try {
                 ret = parse_fmt(s, fmt);
@@ -685,6 +719,17 @@ struct module * libavcodec_compress_init(struct module *parent, const char *opts
                 return ret > 0 ? static_cast<module*>(INIT_NOERR) : NULL;
         }
 
+        const char *warmup_cfg = get_commandline_param("lavc-warmup");
+        if (const char *cache_size = get_commandline_param("lavc-ctx-cache")) {
+                s->ctx_cache_size = atoi(cache_size);
+        } else if (warmup_cfg != nullptr) { // keep the warmed-up encoders
+                s->ctx_cache_size = count(warmup_cfg, warmup_cfg + strlen(warmup_cfg), ',') + 1;
+        }
+        if (warmup_cfg != nullptr && !warm_up(s, warmup_cfg)) {
+                module_done(&s->module_data);
+                return NULL;
+        }
+
         return &s->module_data;
 }
 
@@ -976,8 +1021,6 @@ static bool try_open_codec(struct state_video_compress_libav *s,
                         return false;
                 }
                 s->hwenc = true;
-                s->hwframe = av_frame_alloc();
-                av_hwframe_get_buffer(s->codec_ctx->hw_frames_ctx, s->hwframe, 0);
                 pix_fmt = AV_PIX_FMT_NV12;
                 log_msg(LOG_LEVEL_INFO, MOD_NAME "Using VA-API with sw format %s\n", av_get_pix_fmt_name(pix_fmt));
         }
@@ -1052,6 +1095,7 @@ static bool configure_swscale(struct state_video_compress_libav *s, struct video
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Failed to get sws input conversion.\n"); // shouldn't happen normally, but user may choose imposible codec
                 return false;
         }
+        s->conv_pix_fmt = sws_in_format;
 
         s->sws_ctx = getSwsContext(desc.width,
                         desc.height,
@@ -1124,6 +1168,227 @@ try_open_remaining_pixfmts(state_video_compress_libav *s, video_desc desc,
         return AV_PIX_FMT_NONE;
 }
 
+#define PROBE_FRAMES 12 ///< frames encoded per probed configuration (1st third is warm-up)
+#define PROBE_CACHE_FILE "ultragrid-lavc-probe.txt"
+ADD_TO_PARAM("lavc-probe", "* lavc-probe[=no-cache]\n"
+                "  Benchmark available encoders and pixel formats with synthetic frames on\n"
+                "  (re)configuration and use the best one meeting the frame time. Results\n"
+                "  are cached in " PROBE_CACHE_FILE " in the temporary directory.\n");
+
+namespace {
+struct probe_result {
+        string encoder;
+        AVPixelFormat pix_fmt = AV_PIX_FMT_NONE;
+};
+
+string get_probe_key(struct state_video_compress_libav *s, struct video_desc desc,
+                     codec_t ug_codec)
+{
+        char hostname[256] = "";
+        gethostname(hostname, sizeof hostname - 1);
+        ostringstream oss;
+        oss << hostname << "|" << desc.width << "x" << desc.height << "@"
+            << desc.fps << "|" << get_codec_name(desc.color_spec) << "|"
+            << get_codec_name(ug_codec) << "|"
+            << (s->req_encoder.empty() ? "auto" : s->req_encoder);
+        for (auto const &opt : s->lavc_opts) {
+                oss << "|" << opt.first << "=" << opt.second;
+        }
+        return oss.str();
+}
+
+string get_probe_cache_path() {
+        return string(get_temp_dir()) + PROBE_CACHE_FILE;
+}
+
+/// cache line format: <key>\t<encoder>\t<pixfmt>
+bool probe_cache_lookup(string const &key, probe_result *res)
+{
+        ifstream in(get_probe_cache_path());
+        string line;
+        while (getline(in, line)) {
+                istringstream iss(line);
+                string k, enc, fmt;
+                if (getline(iss, k, '\t') && getline(iss, enc, '\t') &&
+                    getline(iss, fmt) && k == key) {
+                        res->encoder = enc;
+                        res->pix_fmt = av_get_pix_fmt(fmt.c_str());
+                }
+        }
+        return res->pix_fmt != AV_PIX_FMT_NONE;
+}
+
+void probe_cache_store(string const &key, probe_result const &res)
+{
+        ofstream out(get_probe_cache_path(), ios::app);
+        out << key << "\t" << res.encoder << "\t"
+            << av_get_pix_fmt_name(res.pix_fmt) << "\n";
+        if (!out) {
+                MSG(WARNING, "Cannot store probe result to %s\n",
+                    get_probe_cache_path().c_str());
+        }
+}
+
+/**
+ * Encodes PROBE_FRAMES synthetic frames including UG->AV conversion
+ * @returns average time per frame in sec (excluding warm-up) or -1 on error
+ */
+double probe_config(struct state_video_compress_libav *s, struct video_desc desc,
+                    codec_t ug_codec, const AVCodec *codec, AVPixelFormat pix_fmt)
+{
+        if (!try_open_codec(s, pix_fmt, desc, ug_codec, codec)) {
+                return -1;
+        }
+        struct to_lavc_vid_conv *conv = to_lavc_vid_conv_init(
+            desc.color_spec, desc.width, desc.height, pix_fmt,
+            s->conv_thread_count);
+        if (conv == nullptr) {
+                avcodec_free_context(&s->codec_ctx);
+                return -1;
+        }
+        // noise so that the encoder cannot take a shortcut
+        vector<char> in(vc_get_datalen(desc.width, desc.height, desc.color_spec) + MAX_PADDING);
+        unsigned rnd = 1;
+        for (auto &c : in) {
+                rnd = rnd * 1103515245U + 12345U;
+                c = (char) (rnd >> 16);
+        }
+        AVPacket *pkt = av_packet_alloc();
+        time_ns_t t_start = 0;
+        bool ok = true;
+        for (int i = 0; i < PROBE_FRAMES && ok; ++i) {
+                if (i == PROBE_FRAMES / 3) {
+                        t_start = get_time_in_ns();
+                }
+                AVFrame *frame = to_lavc_vid_conv(conv, in.data());
+                ok = frame != nullptr;
+                if (ok) {
+                        frame->pts = i;
+                        ok = avcodec_send_frame(s->codec_ctx, frame) == 0;
+                }
+                while (ok && avcodec_receive_packet(s->codec_ctx, pkt) == 0) {
+                        av_packet_unref(pkt);
+                }
+        }
+        const time_ns_t duration = get_time_in_ns() - t_start;
+        av_packet_free(&pkt);
+        to_lavc_vid_conv_destroy(&conv);
+        avcodec_free_context(&s->codec_ctx);
+        return ok ? duration / NS_IN_SEC_DBL / (PROBE_FRAMES - PROBE_FRAMES / 3)
+                  : -1;
+}
+
+/**
+ * Tries requested pixel formats (in preference order) with all encoders
+ * for ug_codec (or just the requested one).
+ *
+ * The first pixel format for which an encoder meets the frame time is taken
+ * with its fastest encoder (so that fastest 8-bit 4:2:0 is not taken over
+ * deeper/less subsampled formats that are fast enough); if none meets, the
+ * overall fastest configuration is returned.
+ *
+ * HW-frame (VA-API) formats are not probed.
+ */
+probe_result probe_fastest(struct state_video_compress_libav *s, struct video_desc desc,
+                           codec_t ug_codec, const AVCodec *default_codec)
+{
+        vector<const AVCodec *> encoders;
+        if (s->req_encoder.empty()) {
+                void *it = nullptr;
+                while (const AVCodec *c = av_codec_iterate(&it)) {
+                        if (av_codec_is_encoder(c) && c->id == default_codec->id &&
+                            (c->capabilities & AV_CODEC_CAP_EXPERIMENTAL) == 0) {
+                                encoders.push_back(c);
+                        }
+                }
+        } else {
+                encoders.push_back(default_codec);
+        }
+
+        const double frame_time = 1 / desc.fps;
+        probe_result fastest;
+        double fastest_time = -1;
+        list<enum AVPixelFormat> requested =
+            get_requested_pix_fmts(desc.color_spec, s->req_conv_prop);
+        for (AVPixelFormat fmt : requested) {
+                probe_result best;
+                double best_time = -1;
+                for (const AVCodec *codec : encoders) {
+                        list<enum AVPixelFormat> one{ fmt };
+                        apply_blacklist(one, codec->name);
+                        auto one_it = one.cbegin();
+                        const AVPixFmtDescriptor *fmt_desc = av_pix_fmt_desc_get(fmt);
+                        if (fmt_desc == nullptr ||
+                            (fmt_desc->flags & AV_PIX_FMT_FLAG_HWACCEL) != 0U ||
+                            get_first_matching_pix_fmt(one_it, one.cend(), codec->pix_fmts) == AV_PIX_FMT_NONE) {
+                                continue;
+                        }
+                        double t = probe_config(s, desc, ug_codec, codec, fmt);
+                        MSG(VERBOSE, "Probe %s with %s: %f ms/frame\n",
+                            codec->name, av_get_pix_fmt_name(fmt),
+                            t * MS_IN_SEC_DBL);
+                        if (t < 0) {
+                                continue;
+                        }
+                        if (best_time < 0 || t < best_time) {
+                                best_time = t;
+                                best = { codec->name, fmt };
+                        }
+                }
+                if (best_time >= 0 && best_time < frame_time) {
+                        return best;
+                }
+                if (best_time >= 0 && (fastest_time < 0 || best_time < fastest_time)) {
+                        fastest_time = best_time;
+                        fastest = best;
+                }
+        }
+        if (fastest_time >= 0) {
+                MSG(WARNING, "No probed configuration meets frame time %f ms, "
+                             "using the fastest one (%f ms)\n",
+                    frame_time * MS_IN_SEC_DBL, fastest_time * MS_IN_SEC_DBL);
+        }
+        return fastest;
+}
+
+/**
+ * Runs (or looks up cached) probe and applies the result - replaces codec
+ * and moves the selected pixel format to the head of the requested list.
+ */
+void apply_probe(struct state_video_compress_libav *s, struct video_desc desc,
+                 codec_t ug_codec, const AVCodec **codec,
+                 list<enum AVPixelFormat> &requested_pix_fmt)
+{
+        const char *param = get_commandline_param("lavc-probe");
+        const bool use_cache = strcmp(param, "no-cache") != 0;
+        const string key = get_probe_key(s, desc, ug_codec);
+        probe_result res;
+        if (use_cache && probe_cache_lookup(key, &res)) {
+                MSG(VERBOSE, "Using cached probe result for %s\n", key.c_str());
+        } else {
+                MSG(NOTICE, "Probing encoders and pixel formats...\n");
+                res = probe_fastest(s, desc, ug_codec, *codec);
+                if (res.pix_fmt == AV_PIX_FMT_NONE) {
+                        MSG(WARNING, "Probing failed, using default selection\n");
+                        return;
+                }
+                if (use_cache) {
+                        probe_cache_store(key, res);
+                }
+        }
+        const AVCodec *probed = avcodec_find_encoder_by_name(res.encoder.c_str());
+        if (probed == nullptr || (*codec)->id != probed->id) {
+                MSG(WARNING, "Probed encoder %s not usable\n", res.encoder.c_str());
+                return;
+        }
+        MSG(NOTICE, "Probe selected encoder %s with pixfmt %s\n",
+            probed->name, av_get_pix_fmt_name(res.pix_fmt));
+        *codec = probed;
+        requested_pix_fmt.remove(res.pix_fmt);
+        requested_pix_fmt.push_front(res.pix_fmt);
+}
+} // end of anonymous namespace
+
 static bool configure_with(struct state_video_compress_libav *s, struct video_desc desc)
 {
         s->saved_desc = {};
@@ -1141,6 +1406,10 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
         if ((codec = get_av_codec(s, &ug_codec, codec_is_a_rgb(desc.color_spec))) == nullptr) {
                 return false;
         }
+        list<enum AVPixelFormat> requested_pix_fmt = get_requested_pix_fmts(desc.color_spec, s->req_conv_prop);
+        if (get_commandline_param("lavc-probe") != nullptr) {
+                apply_probe(s, desc, ug_codec, &codec, requested_pix_fmt);
+        }
         log_msg(LOG_LEVEL_NOTICE, "[lavc] Using codec: %s, encoder: %s\n",
                         get_codec_name(ug_codec), codec->name);
 
@@ -1148,7 +1417,6 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
         // It is done in a loop because some pixel formats that are reported
         // by codec can actually fail (typically YUV444 in hevc_nvenc for Maxwell
         // cards).
-        list<enum AVPixelFormat> requested_pix_fmt = get_requested_pix_fmts(desc.color_spec, s->req_conv_prop);
         apply_blacklist(requested_pix_fmt, codec->name);
         auto requested_pix_fmt_it = requested_pix_fmt.cbegin();
         set<AVPixelFormat> fmts_tried;
@@ -1193,6 +1461,7 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
         s->mov_avg_frames = s->mov_avg_comp_duration = 0;
 
         to_lavc_vid_conv_destroy(&s->pixfmt_conversion);
+        s->conv_pix_fmt = pix_fmt;
         if ((s->pixfmt_conversion = to_lavc_vid_conv_init(desc.color_spec, desc.width, desc.height, pix_fmt, s->conv_thread_count)) == nullptr) {
                 if (!configure_swscale(s, desc, pix_fmt)) {
                         return false;
@@ -1428,6 +1697,286 @@ receive_packet(state_video_compress_libav *s)
         return out_vf_from_pkt(s, s->pkt);
 }
 
+ADD_TO_PARAM("lavc-no-shared-conv", "* lavc-no-shared-conv\n"
+                "  Do not share pixel format conversions of a frame among encoder instances\n");
+
+namespace {
+/**
+ * Conversions of input frames shared by all encoder instances of the process.
+ * If more encoders compress the same frame (eg. reflector recompress ports
+ * with different settings), the frame is converted to each AVPixelFormat only
+ * once and the other encoders get a reference.
+ *
+ * Entries are identified by the frame owner (shared_ptr control block), so
+ * that reused frame memory is never mistaken for the converted frame.
+ */
+struct shared_conv_cache {
+        struct entry {
+                std::weak_ptr<video_frame> frame;
+                enum AVPixelFormat pix_fmt;
+                AVFrame *converted; ///< nullptr if not shareable
+                bool done;        ///< false while being converted
+        };
+        std::mutex lock;
+        std::condition_variable cv;
+        list<entry> entries;
+} conv_cache;
+} // end of anonymous namespace
+
+static bool same_frame(const std::weak_ptr<video_frame> &a, const shared_ptr<video_frame> &b)
+{
+        return !a.owner_before(b) && !b.owner_before(a);
+}
+
+/**
+ * @returns reference to conversion of tx done by another encoder (to be freed
+ *          with av_frame_free()) or nullptr - if *owner is then set, the
+ *          caller converts and passes the result to shared_conv_publish()
+ */
+static AVFrame *shared_conv_acquire(const shared_ptr<video_frame> &tx, enum AVPixelFormat pix_fmt, bool *owner)
+{
+        std::unique_lock<std::mutex> lk(conv_cache.lock);
+        conv_cache.entries.remove_if([](shared_conv_cache::entry &e) {
+                if (!e.done || !e.frame.expired()) {
+                        return false;
+                }
+                av_frame_free(&e.converted);
+                return true;
+        });
+        *owner = false;
+        for (auto &e : conv_cache.entries) {
+                if (e.pix_fmt == pix_fmt && same_frame(e.frame, tx)) {
+                        conv_cache.cv.wait(lk, [&e] { return e.done; });
+                        return e.converted ? av_frame_clone(e.converted) : nullptr;
+                }
+        }
+        conv_cache.entries.push_back({tx, pix_fmt, nullptr, false});
+        *owner = true;
+        return nullptr;
+}
+
+static void shared_conv_publish(const shared_ptr<video_frame> &tx, enum AVPixelFormat pix_fmt, const AVFrame *converted)
+{
+        {
+                std::lock_guard<std::mutex> lk(conv_cache.lock);
+                for (auto &e : conv_cache.entries) {
+                        if (!e.done && e.pix_fmt == pix_fmt && same_frame(e.frame, tx)) {
+                                // only frames owning their buffers can be shared
+                                e.converted = converted != nullptr && converted->buf[0] != nullptr
+                                        ? av_frame_clone(converted) : nullptr;
+                                e.done = true;
+                                break;
+                        }
+                }
+        }
+        conv_cache.cv.notify_all();
+}
+
+ADD_TO_PARAM("lavc-no-zero-copy", "* lavc-no-zero-copy\n"
+                "  Let libavcodec copy input frames not needing conversion instead of\n"
+                "  referencing the capture buffer\n");
+/**
+ * If the frame returned by to_lavc_vid_conv() just points to the tile data
+ * (no conversion), it is not ref-counted and avcodec_send_frame() would copy
+ * it. Wrap it instead in AVBufferRef holding a reference to the video_frame
+ * so that the (pooled) capture buffer is passed to the encoder directly.
+ *
+ * @returns new AVFrame referencing tx or nullptr if not applicable
+ */
+static AVFrame *wrap_input_frame(const shared_ptr<video_frame> &tx,
+                                 const AVFrame *frame)
+{
+        if (frame->buf[0] != nullptr ||
+            get_commandline_param("lavc-no-zero-copy") != nullptr) {
+                return nullptr;
+        }
+        // keep the alignment an av_frame_get_buffer()-allocated copy would have
+        for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->data[i] != nullptr;
+             ++i) {
+                if ((uintptr_t) frame->data[i] % 32 != 0 ||
+                    frame->linesize[i] % 32 != 0) {
+                        return nullptr;
+                }
+        }
+        auto *ref = new shared_ptr<video_frame>(tx);
+        AVBufferRef *buf = av_buffer_create(
+            (uint8_t *) tx->tiles[0].data, tx->tiles[0].data_len,
+            [](void *opaque, uint8_t *) {
+                    delete (shared_ptr<video_frame> *) opaque;
+            },
+            ref, AV_BUFFER_FLAG_READONLY);
+        if (buf == nullptr) {
+                delete ref;
+                return nullptr;
+        }
+        AVFrame *wrapped = av_frame_alloc();
+        if (wrapped == nullptr) {
+                av_buffer_unref(&buf);
+                return nullptr;
+        }
+        av_frame_copy_props(wrapped, frame);
+        wrapped->format = frame->format;
+        wrapped->width = frame->width;
+        wrapped->height = frame->height;
+        memcpy(wrapped->data, frame->data, sizeof wrapped->data);
+        memcpy(wrapped->linesize, frame->linesize, sizeof wrapped->linesize);
+        wrapped->buf[0] = buf;
+        return wrapped;
+}
+
+ADD_TO_PARAM("lavc-ctx-cache", "* lavc-ctx-cache=<n>\n"
+                "  Keep <n> recently used encoders opened, switching back to a cached input\n"
+                "  format is then instant (default 0, number of lavc-warmup formats if given).\n"
+                "  Only encoders supporting flush can be cached, the first frame is an intra frame.\n");
+/**
+ * Stores currently used encoder to the cache
+ */
+static void ctx_cache_store(struct state_video_compress_libav *s)
+{
+        if (s->ctx_cache_size == 0 || s->codec_ctx == nullptr) {
+                return;
+        }
+#ifdef HAVE_SWSCALE
+        if (s->sws_ctx != nullptr) {
+                return;
+        }
+#endif
+#ifdef AV_CODEC_CAP_ENCODER_FLUSH
+        if ((s->codec_ctx->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH) == 0) {
+                return;
+        }
+        // drop what was not fetched and frames buffered by the encoder
+        AVPacket *pkt = av_packet_alloc();
+        while (avcodec_receive_packet(s->codec_ctx, pkt) == 0) {
+                av_packet_unref(pkt);
+        }
+        av_packet_free(&pkt);
+        avcodec_flush_buffers(s->codec_ctx);
+
+        s->ctx_cache.push_front({ s->saved_desc, s->compressed_desc, s->codec_ctx,
+                        s->pixfmt_conversion, s->conv_pix_fmt, s->aux_header, s->hwenc });
+        s->codec_ctx = nullptr;
+        s->pixfmt_conversion = nullptr;
+        s->saved_desc = {};
+        while (s->ctx_cache.size() > s->ctx_cache_size) {
+                avcodec_free_context(&s->ctx_cache.back().codec_ctx);
+                to_lavc_vid_conv_destroy(&s->ctx_cache.back().pixfmt_conversion);
+                s->ctx_cache.pop_back();
+        }
+#endif
+}
+
+static void ctx_cache_clear(struct state_video_compress_libav *s)
+{
+        for (auto &c : s->ctx_cache) {
+                avcodec_free_context(&c.codec_ctx);
+                to_lavc_vid_conv_destroy(&c.pixfmt_conversion);
+        }
+        s->ctx_cache.clear();
+}
+
+/**
+ * Stores current encoder to the cache and takes the one for desc (if cached)
+ * @retval true encoder for desc was taken from the cache
+ */
+static bool ctx_cache_swap(struct state_video_compress_libav *s, struct video_desc desc)
+{
+        if (s->ctx_cache_size == 0) {
+                return false;
+        }
+        ctx_cache_store(s);
+        for (auto it = s->ctx_cache.begin(); it != s->ctx_cache.end(); ++it) {
+                if (!video_desc_eq_excl_param(it->desc, desc, PARAM_TILE_COUNT)) {
+                        continue;
+                }
+                cleanup(s); // if the current encoder was not cacheable
+                to_lavc_vid_conv_destroy(&s->pixfmt_conversion);
+                s->saved_desc = it->desc;
+                s->params.desc = it->desc;
+                s->compressed_desc = it->compressed_desc;
+                s->codec_ctx = it->codec_ctx;
+                s->pixfmt_conversion = it->pixfmt_conversion;
+                s->conv_pix_fmt = it->conv_pix_fmt;
+                s->aux_header = it->aux_header;
+                s->hwenc = it->hwenc;
+                s->mov_avg_frames = s->mov_avg_comp_duration = 0;
+                s->force_keyframe = true;
+                s->ctx_cache.erase(it);
+                MSG(VERBOSE, "Using cached encoder for %s\n", video_desc_to_string(desc));
+                return true;
+        }
+        return false;
+}
+
+#define WARMUP_FRAMES 2
+ADD_TO_PARAM("lavc-warmup", "* lavc-warmup=<fmt>[,<fmt>...]\n"
+                "  Open encoders for expected input formats (<codec>:<w>x<h>[@<fps>], eg. UYVY:1920x1080@60)\n"
+                "  and encode " TOSTRING(WARMUP_FRAMES) " synthetic frames on startup to avoid the delay on the first frame.\n");
+/**
+ * Opens encoders for the configured formats and lets them encode a few
+ * black frames so that the lazily initialized parts (GPU context, encoder
+ * session, conversion kernels) are ready, the encoders are then cached
+ * (if possible).
+ */
+static bool warm_up(struct state_video_compress_libav *s, const char *cfg)
+{
+        char *tmp = strdup(cfg);
+        char *save_ptr = nullptr;
+        char *item = tmp;
+        bool ret = true;
+        while (ret && (item = strtok_r(item, ",", &save_ptr)) != nullptr) {
+                struct video_desc desc{};
+                desc.fps = 30;
+                desc.tile_count = 1;
+                desc.interlacing = PROGRESSIVE;
+                char *dims = strchr(item, ':');
+                if (dims != nullptr) {
+                        *dims++ = '\0';
+                        desc.color_spec = get_codec_from_name(item);
+                }
+                if (dims == nullptr || desc.color_spec == VIDEO_CODEC_NONE ||
+                    sscanf(dims, "%ux%u@%lf", &desc.width, &desc.height, &desc.fps) < 2 ||
+                    desc.width == 0 || desc.height == 0 || desc.fps <= 0) {
+                        MSG(ERROR, "Wrong warm-up format: %s\n", item);
+                        ret = false;
+                        break;
+                }
+                item = nullptr;
+                MSG(VERBOSE, "Warming up encoder for %s\n", video_desc_to_string(desc));
+                if (!configure_with(s, desc)) {
+                        MSG(ERROR, "Cannot configure encoder for warm-up format %s\n",
+                            video_desc_to_string(desc));
+                        ret = false;
+                        break;
+                }
+                if (s->pixfmt_conversion != nullptr && !s->hwenc) {
+                        vector<char> in(vc_get_datalen(desc.width, desc.height, desc.color_spec) + MAX_PADDING);
+                        AVPacket *pkt = av_packet_alloc();
+                        for (int i = 0; i < WARMUP_FRAMES; ++i) {
+                                AVFrame *frame = to_lavc_vid_conv(s->pixfmt_conversion, in.data());
+                                if (frame == nullptr) {
+                                        break;
+                                }
+                                frame->pts = s->cur_pts++;
+                                if (avcodec_send_frame(s->codec_ctx, frame) != 0) {
+                                        break;
+                                }
+                                while (avcodec_receive_packet(s->codec_ctx, pkt) == 0) {
+                                        av_packet_unref(pkt);
+                                }
+                        }
+                        av_packet_free(&pkt);
+                }
+                ctx_cache_store(s);
+                if (s->codec_ctx != nullptr) { // not cacheable
+                        cleanup(s);
+                }
+        }
+        free(tmp);
+        s->saved_desc = {};
+        return ret;
+}
+
 static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
 {
         auto *s = (state_video_compress_libav *) mod->priv_data;
@@ -1435,20 +1984,60 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
 
         libavcodec_check_messages(s);
 
+        // already compressed with the requested codec (eg. by file:nodecode)
+        if (tx && tx->color_spec == (s->requested_codec_id == VIDEO_CODEC_NONE
+                                             ? DEFAULT_CODEC
+                                             : s->requested_codec_id)) {
+                log_msg_once(LOG_LEVEL_NOTICE, to_fourcc('L', 'P', 'A', 'S'),
+                             MOD_NAME "Input already is %s, passing through.\n",
+                             get_codec_name(tx->color_spec));
+                return tx;
+        }
+
         if (tx && !video_desc_eq_excl_param(video_desc_from_frame(tx.get()),
                                             s->saved_desc, PARAM_TILE_COUNT)) {
-                cleanup(s);
-                if (!configure_with(s, video_desc_from_frame(tx.get()))) {
-                        return {};
+                if (!ctx_cache_swap(s, video_desc_from_frame(tx.get()))) {
+                        cleanup(s);
+                        if (!configure_with(s, video_desc_from_frame(tx.get()))) {
+                                return {};
+                        }
                 }
         }
 
         if (!tx) { // reading further encoded frames
+                if (s->codec_ctx == nullptr) { // passthrough only so far
+                        return {};
+                }
                 return receive_packet(s);
         }
 
         time_ns_t t0 = get_time_in_ns();
-        struct AVFrame *frame = to_lavc_vid_conv(s->pixfmt_conversion, tx->tiles[0].data);
+        struct AVFrame *frame = nullptr;
+        bool conv_owner = false;
+        if (lavc_instances > 1 && get_commandline_param("lavc-no-shared-conv") == nullptr) {
+                frame = shared_conv_acquire(tx, s->conv_pix_fmt, &conv_owner);
+                if (frame != nullptr) {
+                        cleanup_callbacks.emplace_back(frame, [](void *f) {
+                                AVFrame *av_frame = (AVFrame *) f;
+                                av_frame_free(&av_frame);
+                        });
+                }
+        }
+        if (frame == nullptr) {
+                frame = to_lavc_vid_conv(s->pixfmt_conversion, tx->tiles[0].data);
+                if (frame != nullptr) {
+                        if (AVFrame *wrapped = wrap_input_frame(tx, frame)) {
+                                frame = wrapped;
+                                cleanup_callbacks.emplace_back(frame, [](void *f) {
+                                        AVFrame *av_frame = (AVFrame *) f;
+                                        av_frame_free(&av_frame);
+                                });
+                        }
+                }
+                if (conv_owner) {
+                        shared_conv_publish(tx, s->conv_pix_fmt, frame);
+                }
+        }
         if (!frame) {
                 return {};
         }
@@ -1457,8 +2046,29 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
         debug_file_dump("lavc-avframe", serialize_video_avframe, frame);
 #ifdef HWACC_VAAPI
         if(s->hwenc){
-                av_hwframe_transfer_data(s->hwframe, frame, 0);
-                frame = s->hwframe;
+                // take a new surface from the pool for every frame - the
+                // previous ones may still be referenced by the encoder, so
+                // the upload can overlap with its processing
+                AVFrame *hwframe = av_frame_alloc();
+                int ret = hwframe == nullptr
+                              ? AVERROR(ENOMEM)
+                              : av_hwframe_get_buffer(
+                                    s->codec_ctx->hw_frames_ctx, hwframe, 0);
+                if (ret == 0) {
+                        ret = av_hwframe_transfer_data(hwframe, frame, 0);
+                }
+                if (ret < 0) {
+                        print_libav_error(LOG_LEVEL_ERROR,
+                                          MOD_NAME "Cannot upload frame", ret);
+                        av_frame_free(&hwframe);
+                        return {};
+                }
+                av_frame_copy_props(hwframe, frame);
+                cleanup_callbacks.emplace_back(hwframe, [](void *f) {
+                        AVFrame *av_frame = (AVFrame *) f;
+                        av_frame_free(&av_frame);
+                });
+                frame = hwframe;
         }
 #endif
 
@@ -1477,6 +2087,8 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
         time_ns_t t2 = get_time_in_ns();
 
         /* encode the image */
+        frame->pict_type = s->force_keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+        s->force_keyframe = false;
         frame->pts = s->cur_pts++;
         store_metadata(s, tx.get(), frame->pts);
         if (int ret = avcodec_send_frame(s->codec_ctx, frame)) {
@@ -1525,8 +2137,6 @@ static void cleanup(struct state_video_compress_libav *s)
                 avcodec_free_context(&s->codec_ctx);
         }
 
-        av_frame_free(&s->hwframe);
-
 #ifdef HAVE_SWSCALE
         sws_freeContext(s->sws_ctx);
         s->sws_ctx = nullptr;
@@ -1539,6 +2149,7 @@ static void libavcodec_compress_done(struct module *mod)
         struct state_video_compress_libav *s = (struct state_video_compress_libav *) mod->priv_data;
 
         cleanup(s);
+        ctx_cache_clear(s);
 
         delete s;
 }
@@ -1882,7 +2493,7 @@ static void configure_nvenc(AVCodecContext *codec_ctx, struct setparam_param *pa
 
         check_av_opt_set<const char *>(codec_ctx->priv_data, "rc", DEFAULT_NVENC_RC);
         check_av_opt_set<int>(codec_ctx->priv_data, "spatial_aq", 0);
-        check_av_opt_set<int>(codec_ctx->priv_data, "gpu", cuda_devices[0]);
+        check_av_opt_set<int>(codec_ctx->priv_data, "gpu", param->cuda_device);
         check_av_opt_set<int>(codec_ctx->priv_data, "delay", 0); // 2'd increase throughput 2x at expense of higher latency
         check_av_opt_set<int>(codec_ctx->priv_data, "zerolatency", 1, "zero latency operation (no reordering delay)");
         check_av_opt_set<const char *>(codec_ctx->priv_data, "b_ref_mode", "disabled", 0);
@@ -2094,6 +2705,28 @@ static void setparam_vp8_vp9(AVCodecContext *codec_ctx, struct setparam_param *p
         check_av_opt_set<int>(codec_ctx->priv_data, "rc_lookahead", 0);
 }
 
+/**
+ * Changes bitrate of the opened encoder without reinitialization (used by
+ * the sender rate control). Encoders like libx264 or NVENC reconfigure
+ * the rate control when noticing the changed AVCodecContext values.
+ */
+static bool set_live_bitrate(struct state_video_compress_libav *s,
+                             long long bitrate)
+{
+        AVCodecContext *ctx = s->codec_ctx;
+        if (ctx == nullptr || ctx->bit_rate <= 0 || bitrate <= 0) {
+                return false;
+        }
+        const double ratio = (double) bitrate / ctx->bit_rate;
+        ctx->rc_max_rate = llround(ctx->rc_max_rate * ratio);
+        ctx->rc_buffer_size = (int) (ctx->rc_buffer_size * ratio);
+        ctx->bit_rate_tolerance = (int) (ctx->bit_rate_tolerance * ratio);
+        ctx->bit_rate = bitrate;
+        s->params.requested_bitrate = bitrate;
+        MSG(VERBOSE, "Bitrate changed to %.2f Mbps\n", bitrate / 1e6);
+        return true;
+}
+
 static void libavcodec_check_messages(struct state_video_compress_libav *s)
 {
         struct message *msg;
@@ -2101,6 +2734,17 @@ static void libavcodec_check_messages(struct state_video_compress_libav *s)
                 struct msg_change_compress_data *data =
                         (struct msg_change_compress_data *) msg;
                 struct response *r;
+                const char *cfg = data->config_string;
+                if (IS_KEY_PREFIX(cfg, "bitrate") && strchr(cfg, ':') == nullptr &&
+                    s->codec_ctx != nullptr) { // bitrate only - try without reconfiguration
+                        if (set_live_bitrate(s, unit_evaluate(strchr(cfg, '=') + 1, nullptr))) {
+                                free_message(msg, new_response(RESPONSE_OK, NULL));
+                                continue;
+                        }
+                        MSG(VERBOSE, "Encoder not bitrate-controlled, ignoring %s\n", cfg);
+                        free_message(msg, new_response(RESPONSE_NOT_IMPL, NULL));
+                        continue;
+                }
                 if (parse_fmt(s, data->config_string) == 0) {
                         log_msg(LOG_LEVEL_NOTICE, "[Libavcodec] Compression successfully changed.\n");
                         r = new_response(RESPONSE_OK, NULL);
@@ -2109,6 +2753,7 @@ static void libavcodec_check_messages(struct state_video_compress_libav *s)
                         r = new_response(RESPONSE_INT_SERV_ERR, NULL);
                 }
                 memset(&s->saved_desc, 0, sizeof(s->saved_desc));
+                ctx_cache_clear(s); // configured with old parameters
                 free_message(msg, r);
         }
 
@@ -45,6 +45,7 @@
 #include <string.h>
 #include <string>
 #include "debug.h"
+#include "host.h"
 #include "video_codec.h"
 #include "video_decompress.h"
 #include "lib_common.h"
@@ -151,7 +152,9 @@ static bool try_initialize_decompress(const video_decompress_info *vdi,
                 struct state_decompress **decompress_state, int substreams)
 {
         for(int i = 0; i < substreams; ++i) {
+                set_init_tile_index(i);
                 decompress_state[i] = decompress_init(vdi);
+                set_init_tile_index(0);
 
                 if (!decompress_state[i]) {
                         for(int j = 0; j < i; ++j) {
@@ -61,6 +61,11 @@ struct state_decompress;
  * can be passed to decompressor. Otherwise, broken frame is discarded.
  */
 #define DECOMPRESS_PROPERTY_ACCEPTS_CORRUPTED_FRAME  1          /* int */
+/**
+ * Number of frames the output lags behind the input for pipelined
+ * decompressors (decompress returns DECODER_NO_FRAME until it is filled).
+ */
+#define DECOMPRESS_PROPERTY_OUTPUT_DELAY             2          /* int */
 
 /**
  * initializes decompression and returns internal state
@@ -49,12 +49,34 @@
 #include "video.h"
 #include "video_decompress.h"
 #include "utils/macros.h" // to_fourcc
+#include "utils/worker.h"
 
 #include "CFHDTypes.h"
 #include "CFHDDecoder.h"
 
 #include <vector>
 
+#define MOD_NAME "[cineform] "
+
+struct state_cineform_decompress;
+
+/**
+ * Single CFHD decoder. If more instances are used, frames are assigned to
+ * them round-robin and decoded asynchronously.
+ */
+struct cineform_dec_instance {
+        struct state_cineform_decompress *parent;
+        CFHD_DecoderRef  decoderRef;
+        bool             prepared_to_decode;
+        std::vector<unsigned char> conv_buf;
+
+        // async decoding (instances > 1)
+        std::vector<unsigned char> src; ///< copy of compressed frame
+        std::vector<unsigned char> dst; ///< decoded frame (pitch as requested by reconfigure)
+        task_result_handle_t task;      ///< pending decode, nullptr if idle
+        bool             decoded;       ///< result of the last decode
+};
+
 struct state_cineform_decompress {
         int              width, height;
         int              pitch;
@@ -67,16 +89,31 @@ struct state_cineform_decompress {
         void (*convert)(unsigned char *dst_buffer,
                         unsigned char *src_buffer,
                         int width, int height, int pitch);
-        std::vector<unsigned char> conv_buf;
 
-        bool             prepared_to_decode;
+        std::vector<cineform_dec_instance> instances;
+        unsigned         next_instance; ///< instance to be used for next frame
 
-        CFHD_DecoderRef decoderRef;
         CFHD_MetadataRef metadataRef;
 
         struct video_desc saved_desc;
 };
 
+/// waits for all pending asynchronous decodes, results are discarded
+static void flush_instances(struct state_cineform_decompress *s)
+{
+        for (auto &inst : s->instances) {
+                if (inst.task != nullptr) {
+                        wait_task(inst.task);
+                        inst.task = nullptr;
+                }
+                inst.prepared_to_decode = false;
+        }
+        s->next_instance = 0;
+}
+
+ADD_TO_PARAM("cineform-dec-instances", "* cineform-dec-instances=<n>\n"
+                "  number of Cineform decoders working on alternating frames (default 1),\n"
+                "  increases latency by <n>-1 frames\n");
 static void * cineform_decompress_init(void)
 {
         struct state_cineform_decompress *s;
@@ -85,17 +122,40 @@ static void * cineform_decompress_init(void)
 
         s->width = s->height = s->pitch = s->decode_linesize = 0;
         s->convert = nullptr;
-        s->prepared_to_decode = false;
+        s->next_instance = 0;
+
+        int instance_count = 1;
+        if (get_commandline_param("cineform-dec-instances") != nullptr) {
+                instance_count = atoi(get_commandline_param("cineform-dec-instances"));
+                if (instance_count <= 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong decoder instance count: %s\n",
+                                        get_commandline_param("cineform-dec-instances"));
+                        delete s;
+                        return nullptr;
+                }
+        }
 
         CFHD_Error status;
-        status = CFHD_OpenDecoder(&s->decoderRef, nullptr);
-        if(status != CFHD_ERROR_OKAY){
-                log_msg(LOG_LEVEL_ERROR, "[cineform] Failed to open decoder\n");
+        s->instances.resize(instance_count);
+        for (auto &inst : s->instances) {
+                inst.parent = s;
+                inst.prepared_to_decode = false;
+                inst.task = nullptr;
+                inst.decoded = false;
+                status = CFHD_OpenDecoder(&inst.decoderRef, nullptr);
+                if(status != CFHD_ERROR_OKAY){
+                        log_msg(LOG_LEVEL_ERROR, "[cineform] Failed to open decoder\n");
+                }
+        }
+        if (instance_count > 1) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Using %d decoder instances.\n", instance_count);
         }
         status = CFHD_OpenMetadata(&s->metadataRef);
         if(status != CFHD_ERROR_OKAY){
                 log_msg(LOG_LEVEL_ERROR, "[cineform] Failed to open metadata\n");
-                CFHD_CloseDecoder(s->decoderRef);
+                for (auto &inst : s->instances) {
+                        CFHD_CloseDecoder(inst.decoderRef);
+                }
         }
 
         return s;
@@ -106,7 +166,10 @@ static void cineform_decompress_done(void *state)
         struct state_cineform_decompress *s =
                 (struct state_cineform_decompress *) state;
 
-        CFHD_CloseDecoder(s->decoderRef);
+        flush_instances(s);
+        for (auto &inst : s->instances) {
+                CFHD_CloseDecoder(inst.decoderRef);
+        }
         CFHD_CloseMetadata(s->metadataRef);
         delete s;
 }
@@ -173,7 +236,7 @@ static const struct {
 static bool configure_with(struct state_cineform_decompress *s,
                 struct video_desc desc)
 {
-        s->prepared_to_decode = false;
+        flush_instances(s);
         s->saved_desc = desc;
 
         if(s->out_codec == VIDEO_CODEC_NONE){
@@ -215,10 +278,11 @@ static int cineform_decompress_reconfigure(void *state, struct video_desc desc,
 }
 
 static bool prepare(struct state_cineform_decompress *s,
+                struct cineform_dec_instance *inst,
                 unsigned char *src,
                 unsigned int src_len)
 {
-        if(s->prepared_to_decode){
+        if(inst->prepared_to_decode){
                 return true;
         }
 
@@ -227,7 +291,7 @@ static bool prepare(struct state_cineform_decompress *s,
         int actualWidth;
         int actualHeight;
         CFHD_PixelFormat actualFormat;
-        status = CFHD_PrepareToDecode(s->decoderRef,
+        status = CFHD_PrepareToDecode(inst->decoderRef,
                         s->saved_desc.width,
                         s->saved_desc.height,
                         s->decode_codec,
@@ -246,16 +310,16 @@ static bool prepare(struct state_cineform_decompress *s,
                 int actualPitch;
                 CFHD_GetImagePitch(actualWidth, actualFormat, &actualPitch);
                 assert(actualPitch == s->decode_linesize);
-                s->conv_buf.resize(s->height * s->decode_linesize);
+                inst->conv_buf.resize(s->height * s->decode_linesize);
         } else {
-                s->conv_buf.clear();
+                inst->conv_buf.clear();
         }
         if(status != CFHD_ERROR_OKAY){
                 log_msg(LOG_LEVEL_ERROR, "[cineform] Failed to prepare for decoding\n");
                 return false;
         } 
 
-        s->prepared_to_decode = true;
+        inst->prepared_to_decode = true;
         return true;
 }
 
@@ -268,7 +332,7 @@ static decompress_status probe_internal_cineform(struct state_cineform_decompres
         CFHD_PixelFormat fmt_list[64];
         int count = 0;
 
-        status = CFHD_GetOutputFormats(s->decoderRef,
+        status = CFHD_GetOutputFormats(s->instances[0].decoderRef,
                                        src,
                                        src_len,
                                        fmt_list,
@@ -350,6 +414,42 @@ static decompress_status probe_internal(struct state_cineform_decompress *s,
         return probe_internal_cineform(s, src, src_len, internal_prop);
 }
 
+/// decodes single frame with given decoder instance (including pixfmt conversion)
+static bool decode_sample(struct state_cineform_decompress *s,
+                struct cineform_dec_instance *inst,
+                unsigned char *src, unsigned int src_len, unsigned char *dst)
+{
+        if(!prepare(s, inst, src, src_len)){
+                return false;
+        }
+
+        unsigned char *decode_dst = s->convert ? inst->conv_buf.data() : dst;
+        int pitch = s->convert ? s->decode_linesize : s->pitch;
+
+        CFHD_Error status = CFHD_DecodeSample(inst->decoderRef,
+                        src,
+                        src_len,
+                        decode_dst,
+                        pitch);
+
+        if(status != CFHD_ERROR_OKAY){
+                log_msg(LOG_LEVEL_ERROR, "[cineform] Failed to decode %i\n", status);
+                return false;
+        }
+        if(s->convert){
+                s->convert(dst, decode_dst, s->width, s->height, s->pitch);
+        }
+        return true;
+}
+
+static void *decode_task(void *arg)
+{
+        auto *inst = static_cast<cineform_dec_instance *>(arg);
+        inst->decoded = decode_sample(inst->parent, inst, inst->src.data(),
+                        inst->src.size(), inst->dst.data());
+        return nullptr;
+}
+
 static decompress_status cineform_decompress(void *state, unsigned char *dst, unsigned char *src,
                 unsigned int src_len, int frame_seq, struct video_frame_callbacks *callbacks,
                 struct pixfmt_desc *internal_prop)
@@ -359,34 +459,34 @@ static decompress_status cineform_decompress(void *state, unsigned char *dst, un
         struct state_cineform_decompress *s = (struct state_cineform_decompress *) state;
         decompress_status res = DECODER_NO_FRAME;
 
-        CFHD_Error status;
-
         if(s->out_codec == VIDEO_CODEC_NONE){
                 return probe_internal(s, src, src_len, internal_prop);
         }
 
-        if(!prepare(s, src, src_len)){
-                return res;
+        if (s->instances.size() == 1) {
+                return decode_sample(s, &s->instances[0], src, src_len, dst)
+                        ? DECODER_GOT_FRAME : DECODER_NO_FRAME;
         }
 
-        unsigned char *decode_dst = s->convert ? s->conv_buf.data() : dst;
-        int pitch = s->convert ? s->decode_linesize : s->pitch;
-
-        status = CFHD_DecodeSample(s->decoderRef,
-                        src,
-                        src_len,
-                        decode_dst,
-                        pitch);
-
-        if(status == CFHD_ERROR_OKAY){
-                if(s->convert){
-                        s->convert(dst, decode_dst, s->width, s->height, s->pitch);
+        /*
+         * Instances are used round-robin, so the one selected holds the
+         * oldest frame in flight - return it and submit the current one.
+         */
+        auto &inst = s->instances[s->next_instance];
+        s->next_instance = (s->next_instance + 1) % s->instances.size();
+        if (inst.task != nullptr) {
+                wait_task(inst.task);
+                inst.task = nullptr;
+                if (inst.decoded) {
+                        memcpy(dst, inst.dst.data(), inst.dst.size());
+                        res = DECODER_GOT_FRAME;
                 }
-                res = DECODER_GOT_FRAME;
-        } else {
-                log_msg(LOG_LEVEL_ERROR, "[cineform] Failed to decode %i\n", status);
         }
 
+        inst.src.assign(src, src + src_len);
+        inst.dst.resize((size_t) s->pitch * s->height);
+        inst.task = task_run_async(decode_task, &inst);
+
         return res;
 }
 
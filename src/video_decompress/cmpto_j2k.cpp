@@ -71,6 +71,7 @@
 
 #include <cmpto_j2k_dec.h>
 
+#include <algorithm>
 #include <mutex>
 #include <queue>
 #include <utility>
@@ -78,7 +79,8 @@
 constexpr const int DEFAULT_TILE_LIMIT = 2;
 /// maximal size of queue for decompressed frames
 constexpr const int DEFAULT_MAX_QUEUE_SIZE = 2;
-/// maximal number of concurrently decompressed frames
+/// maximal number of concurrently decompressed frames (per device, at least
+/// 2x tile limit is used)
 constexpr const int DEFAULT_MAX_IN_FRAMES = 4;
 constexpr const int64_t DEFAULT_MEM_LIMIT = 1000000000LL;
 constexpr const char *MOD_NAME = "[J2K dec.] ";
@@ -210,14 +212,14 @@ ADD_TO_PARAM("j2k-dec-tile-limit", "* j2k-dec-tile-limit=<limit>\n"
 ADD_TO_PARAM("j2k-dec-queue-len", "* j2k-queue-len=<len>\n"
                                 "  max queue len\n");
 ADD_TO_PARAM("j2k-dec-encoder-queue", "* j2k-encoder-queue=<len>\n"
-                                "  max number of frames held by encoder\n");
+                                "  max number of frames held by encoder (default scales with number of CUDA devices)\n");
 static void * j2k_decompress_init(void)
 {
         struct state_decompress_j2k *s = NULL;
         long long int mem_limit = DEFAULT_MEM_LIMIT;
         unsigned int tile_limit = DEFAULT_TILE_LIMIT;
         unsigned int queue_len = DEFAULT_MAX_QUEUE_SIZE;
-        unsigned int encoder_in_frames = DEFAULT_MAX_IN_FRAMES;
+        unsigned int encoder_in_frames = 0;
         int ret;
 
         if (get_commandline_param("j2k-dec-mem-limit")) {
@@ -236,6 +238,18 @@ static void * j2k_decompress_init(void)
         if (get_commandline_param("j2k-dec-encoder-queue")) {
                 encoder_in_frames = atoi(get_commandline_param("j2k-dec-encoder-queue"));
         }
+        // one state per tile (substream), preferring own device
+        unsigned int devices[MAX_CUDA_DEVICES];
+        const unsigned int device_count = get_cuda_devices_for_tile(get_init_tile_index(), devices);
+
+        if (encoder_in_frames == 0) {
+                encoder_in_frames = device_count *
+                                    max<unsigned int>(DEFAULT_MAX_IN_FRAMES,
+                                                      2 * tile_limit);
+        }
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Using " << device_count
+                               << " CUDA device(s) (first " << devices[0] << "), max. " << encoder_in_frames
+                               << " frames in flight\n";
 
         const auto *version = cmpto_j2k_dec_get_version();
         LOG(LOG_LEVEL_INFO) << MOD_NAME << "Using codec version: " << (version == nullptr ? "(unknown)" : version->name) << "\n";
@@ -244,8 +258,8 @@ static void * j2k_decompress_init(void)
 
         struct cmpto_j2k_dec_ctx_cfg *ctx_cfg;
         CHECK_OK(cmpto_j2k_dec_ctx_cfg_create(&ctx_cfg), "Error creating dec cfg", goto error);
-        for (unsigned int i = 0; i < cuda_devices_count; ++i) {
-                CHECK_OK(cmpto_j2k_dec_ctx_cfg_add_cuda_device(ctx_cfg, cuda_devices[i], mem_limit, tile_limit),
+        for (unsigned int i = 0; i < device_count; ++i) {
+                CHECK_OK(cmpto_j2k_dec_ctx_cfg_add_cuda_device(ctx_cfg, devices[i], mem_limit, tile_limit),
                                 "Error setting CUDA device", goto error);
         }
 
@@ -0,0 +1,149 @@
+/**
+ * @file   video_decompress/cuda_conv.cpp
+ *
+ * Uncompressed pixel format conversion offloaded to CUDA (see
+ * @ref cuda_pix_conv). It is an alternative to the line decoders selected when
+ * requested with "--param decoder-cuda-conv".
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cassert>
+#include <cstdlib>
+
+#include "debug.h"
+#include "lib_common.h"
+#include "types.h"
+#include "utils/cuda_pix_conv.h"
+#include "video_codec.h"
+#include "video_decompress.h"
+
+#define MOD_NAME "[cuda_conv] "
+
+struct cuda_conv_decompress_state {
+        struct video_desc desc{};
+        codec_t out_codec = VIDEO_CODEC_NONE;
+        int pitch = 0;
+        struct cuda_pix_conv *conv = nullptr;
+};
+
+static void *
+cuda_conv_decompress_init(void)
+{
+        return new cuda_conv_decompress_state();
+}
+
+static int
+cuda_conv_decompress_reconfigure(void *state, struct video_desc desc,
+                                 int rshift, int gshift, int bshift, int pitch,
+                                 codec_t out_codec)
+{
+        auto *s = (struct cuda_conv_decompress_state *) state;
+        cuda_pix_conv_destroy(s->conv);
+        s->conv = cuda_pix_conv_init(desc.color_spec, out_codec,
+                                     (int) desc.width, (int) desc.height,
+                                     rshift, gshift, bshift);
+        if (s->conv == nullptr) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot initialize %s->%s conversion!\n",
+                        get_codec_name(desc.color_spec), get_codec_name(out_codec));
+                return false;
+        }
+        s->desc      = desc;
+        s->out_codec = out_codec;
+        s->pitch     = pitch;
+        return true;
+}
+
+static decompress_status
+cuda_conv_decompress(void *state, unsigned char *dst, unsigned char *buffer,
+                     unsigned int src_len, int frame_seq,
+                     struct video_frame_callbacks *callbacks,
+                     struct pixfmt_desc           *internal_prop)
+{
+        (void) frame_seq, (void) callbacks, (void) internal_prop;
+        auto *s = (struct cuda_conv_decompress_state *) state;
+        if (src_len < vc_get_datalen(s->desc.width, s->desc.height,
+                                     s->desc.color_spec)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Short frame (%u B)!\n", src_len);
+                return DECODER_NO_FRAME;
+        }
+        if (!cuda_pix_conv_frame(s->conv, dst, s->pitch, buffer)) {
+                return DECODER_NO_FRAME;
+        }
+        return DECODER_GOT_FRAME;
+}
+
+static int
+cuda_conv_decompress_get_property(void *state, int property, void *val,
+                                  size_t *len)
+{
+        (void) state;
+
+        if (property == DECOMPRESS_PROPERTY_ACCEPTS_CORRUPTED_FRAME) {
+                assert(*len >= sizeof(int));
+                *(int *) val = true;
+                *len         = sizeof(int);
+                return true;
+        }
+        return false;
+}
+
+static void
+cuda_conv_decompress_done(void *state)
+{
+        auto *s = (struct cuda_conv_decompress_state *) state;
+        cuda_pix_conv_destroy(s->conv);
+        delete s;
+}
+
+static int
+cuda_conv_decompress_get_priority(codec_t compression,
+                                  struct pixfmt_desc internal, codec_t ugc)
+{
+        (void) internal;
+        enum {
+                PRIO_NA     = -1,
+                PRIO_NORMAL = 500,
+        };
+        return cuda_pix_conv_supported(compression, ugc) ? PRIO_NORMAL
+                                                          : PRIO_NA;
+}
+
+static const struct video_decompress_info cuda_conv_info = {
+        cuda_conv_decompress_init,         cuda_conv_decompress_reconfigure,
+        cuda_conv_decompress,              cuda_conv_decompress_get_property,
+        cuda_conv_decompress_done,         cuda_conv_decompress_get_priority,
+};
+
+REGISTER_MODULE(cuda_conv, &cuda_conv_info, LIBRARY_CLASS_VIDEO_DECOMPRESS,
+                VIDEO_DECOMPRESS_ABI_VERSION);
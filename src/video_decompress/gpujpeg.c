@@ -3,7 +3,7 @@
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2011-2024 CESNET
+ * Copyright (c) 2011-2026 CESNET
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -40,6 +40,7 @@
 #include "config_unix.h"
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
+#include "cuda_wrapper.h"
 #include "debug.h"
 #include "host.h"
 #include "video.h"
@@ -49,6 +50,7 @@
 #include <libgpujpeg/gpujpeg_version.h>
 //#include "compat/platform_semaphore.h"
 #include <pthread.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include "lib_common.h"
@@ -60,24 +62,63 @@
 #define NEW_PARAM_IMG_NO_COMP_COUNT
 #endif
 
+#define MAX_DEPTH 4
+
+enum worker_state {
+        WORKER_IDLE,
+        WORKER_BUSY,
+        WORKER_DONE,
+        WORKER_EXIT,
+};
+
+/**
+ * Decoder of one frame in flight (for gpujpeg-dec-depth > 1), every GPUJPEG
+ * decoder uses own CUDA stream so the upload, decode and download of the
+ * frames overlap.
+ */
+struct gpujpeg_worker {
+        pthread_t thread;
+        pthread_mutex_t lock;
+        pthread_cond_t cv;
+        enum worker_state state;
+        bool success;
+
+        struct gpujpeg_decoder *decoder;
+        int cuda_device;
+        unsigned char *in;   ///< compressed frame
+        size_t in_len;
+        size_t in_alloc;
+        unsigned char *out;  ///< decoded frame (pinned if CUDA is available)
+};
+
 struct state_decompress_gpujpeg {
         struct gpujpeg_decoder *decoder;
+        int cuda_device; ///< assigned to the tile (substream) being decoded
 
         struct video_desc desc;
         int rshift, gshift, bshift;
         int pitch;
         codec_t out_codec;
-};
 
-static int configure_with(struct state_decompress_gpujpeg *s, struct video_desc desc);
+        int depth; ///< number of frames in flight, output lags by depth-1 frames
+        struct gpujpeg_worker workers[MAX_DEPTH];
+        int next;       ///< worker to receive the next frame
+        int in_flight;
+};
 
-static int configure_with(struct state_decompress_gpujpeg *s, struct video_desc desc)
+static bool direct_output(struct state_decompress_gpujpeg *s)
 {
-        s->desc = desc;
+        return s->pitch == vc_get_linesize(s->desc.width, s->out_codec) &&
+               (s->out_codec == UYVY || s->out_codec == RGB ||
+                (s->out_codec == RGBA && s->rshift == 0 && s->gshift == 8 &&
+                 s->bshift == 16));
+}
 
-        s->decoder = gpujpeg_decoder_create(NULL);
-        if(!s->decoder) {
-                return FALSE;
+static struct gpujpeg_decoder *create_decoder(struct state_decompress_gpujpeg *s, struct video_desc desc)
+{
+        struct gpujpeg_decoder *decoder = gpujpeg_decoder_create(NULL);
+        if(!decoder) {
+                return NULL;
         }
 
         // setting verbosity - a bit tricky now, gpujpeg_decoder_init needs to be called with some "valid" data
@@ -93,16 +134,16 @@ static int configure_with(struct state_decompress_gpujpeg *s, struct video_desc
         param_image.color_space = GPUJPEG_YCBCR_BT709; // assume now BT.709 as default - this is mainly applicable for FFmpeg-encoded
                                                        // JPEGs that doesn't indicate explicitly color spec (no JFIF marker, only CS=ITU601
                                                        // for BT.601 limited range - not enabled by UG encoder because FFmpeg emits it also for 709)
-        int rc = gpujpeg_decoder_init(s->decoder, &param, &param_image);
+        int rc = gpujpeg_decoder_init(decoder, &param, &param_image);
         assert(rc == 0);
 
         switch (s->out_codec) {
         case I420:
-                gpujpeg_decoder_set_output_format(s->decoder, GPUJPEG_YCBCR_BT709,
+                gpujpeg_decoder_set_output_format(decoder, GPUJPEG_YCBCR_BT709,
                                 GPUJPEG_420_U8_P0P1P2);
                 break;
         case RGBA:
-                gpujpeg_decoder_set_output_format(s->decoder, GPUJPEG_RGB,
+                gpujpeg_decoder_set_output_format(decoder, GPUJPEG_RGB,
                                 s->out_codec == RGBA && s->rshift == 0 && s->gshift == 8 && s->bshift == 16 && vc_get_linesize(desc.width, RGBA) == s->pitch ?
 #ifdef NEW_PARAM_IMG_NO_COMP_COUNT
                                 GPUJPEG_4444_U8_P0123 : GPUJPEG_444_U8_P012);
@@ -111,11 +152,11 @@ static int configure_with(struct state_decompress_gpujpeg *s, struct video_desc
 #endif
                 break;
         case RGB:
-                gpujpeg_decoder_set_output_format(s->decoder, GPUJPEG_RGB,
+                gpujpeg_decoder_set_output_format(decoder, GPUJPEG_RGB,
                                 GPUJPEG_444_U8_P012);
                 break;
         case UYVY:
-                gpujpeg_decoder_set_output_format(s->decoder, GPUJPEG_YCBCR_BT709,
+                gpujpeg_decoder_set_output_format(decoder, GPUJPEG_YCBCR_BT709,
                                 GPUJPEG_422_U8_P1020);
                 break;
         case VIDEO_CODEC_NONE:
@@ -124,9 +165,132 @@ static int configure_with(struct state_decompress_gpujpeg *s, struct video_desc
                 assert("Invalid codec!" && 0);
         }
 
+        return decoder;
+}
+
+/// @returns codec that the decoder outputs when not writing directly to dst
+static codec_t decoder_out_codec(struct state_decompress_gpujpeg *s)
+{
+        return s->out_codec == RGBA && !direct_output(s) ? RGB : s->out_codec;
+}
+
+static void copy_output(struct state_decompress_gpujpeg *s, unsigned char *dst, const unsigned char *src)
+{
+        const int linesize = vc_get_linesize(s->desc.width, s->out_codec);
+        const int src_linesize = vc_get_linesize(s->desc.width, decoder_out_codec(s));
+        for (unsigned i = 0u; i < s->desc.height; i++) {
+                if (s->out_codec == RGBA) {
+                        vc_copylineRGBtoRGBA(dst, src, linesize,
+                                        s->rshift, s->gshift, s->bshift);
+                } else {
+                        assert(s->out_codec == UYVY || s->out_codec == I420 || s->out_codec == RGB);
+                        memcpy(dst, src, linesize);
+                }
+
+                dst += s->pitch;
+                src += src_linesize;
+        }
+}
+
+static void *worker_thread(void *arg)
+{
+        struct gpujpeg_worker *w = arg;
+        gpujpeg_set_device(w->cuda_device);
+
+        pthread_mutex_lock(&w->lock);
+        while (true) {
+                while (w->state != WORKER_BUSY && w->state != WORKER_EXIT) {
+                        pthread_cond_wait(&w->cv, &w->lock);
+                }
+                if (w->state == WORKER_EXIT) {
+                        break;
+                }
+                pthread_mutex_unlock(&w->lock);
+
+                struct gpujpeg_decoder_output decoder_output;
+                gpujpeg_decoder_output_set_custom(&decoder_output, w->out);
+                int ret = gpujpeg_decoder_decode(w->decoder, w->in, w->in_len, &decoder_output);
+
+                pthread_mutex_lock(&w->lock);
+                w->success = ret == 0;
+                w->state = WORKER_DONE;
+                pthread_cond_signal(&w->cv);
+        }
+        pthread_mutex_unlock(&w->lock);
+        return NULL;
+}
+
+/// waits until the worker finishes and marks it idle
+static bool worker_collect(struct gpujpeg_worker *w)
+{
+        pthread_mutex_lock(&w->lock);
+        while (w->state == WORKER_BUSY) {
+                pthread_cond_wait(&w->cv, &w->lock);
+        }
+        bool ret = w->state == WORKER_DONE && w->success;
+        w->state = WORKER_IDLE;
+        pthread_mutex_unlock(&w->lock);
+        return ret;
+}
+
+static void free_pinned(void *ptr)
+{
+#ifdef HAVE_CUDA
+        cuda_wrapper_pinned_pool_release(ptr);
+#else
+        free(ptr);
+#endif
+}
+
+static void *alloc_pinned(size_t size)
+{
+#ifdef HAVE_CUDA
+        void *ptr = NULL;
+        if (cuda_wrapper_pinned_pool_alloc(&ptr, size) != CUDA_WRAPPER_SUCCESS) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot allocate pinned buffer: %s\n",
+                                cuda_wrapper_last_error_string());
+                return NULL;
+        }
+        return ptr;
+#else
+        return malloc(size);
+#endif
+}
+
+static void drain_workers(struct state_decompress_gpujpeg *s)
+{
+        for (int i = 0; i < s->depth; ++i) {
+                worker_collect(&s->workers[i]);
+        }
+        s->next = 0;
+        s->in_flight = 0;
+}
+
+static int configure_with(struct state_decompress_gpujpeg *s, struct video_desc desc)
+{
+        s->desc = desc;
+
+        if (s->depth == 1 || s->out_codec == VIDEO_CODEC_NONE) {
+                s->decoder = create_decoder(s, desc);
+                return s->decoder != NULL;
+        }
+
+        const size_t out_len = vc_get_datalen(desc.width, desc.height, decoder_out_codec(s));
+        for (int i = 0; i < s->depth; ++i) {
+                struct gpujpeg_worker *w = &s->workers[i];
+                w->decoder = create_decoder(s, desc);
+                w->out = alloc_pinned(out_len);
+                if (w->decoder == NULL || w->out == NULL) {
+                        return FALSE;
+                }
+        }
         return TRUE;
 }
 
+ADD_TO_PARAM("gpujpeg-dec-depth", "* gpujpeg-dec-depth=<n>\n"
+                "  number of frames decoded concurrently by GPUJPEG (default 1, max " TOSTRING(MAX_DEPTH) "),\n"
+                "  increases latency by <n>-1 frames\n");
+
 static void * gpujpeg_decompress_init(void)
 {
         if (gpujpeg_version() >> 8 != GPUJPEG_VERSION_INT >> 8) {
@@ -139,20 +303,58 @@ static void * gpujpeg_decompress_init(void)
         }
 
         struct state_decompress_gpujpeg *s = (struct state_decompress_gpujpeg *) calloc(1, sizeof(struct state_decompress_gpujpeg));
+        s->depth = 1;
+        if (get_commandline_param("gpujpeg-dec-depth") != NULL) {
+                s->depth = atoi(get_commandline_param("gpujpeg-dec-depth"));
+                if (s->depth <= 0 || s->depth > MAX_DEPTH) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong depth: %s\n",
+                                        get_commandline_param("gpujpeg-dec-depth"));
+                        free(s);
+                        return NULL;
+                }
+        }
+
+        unsigned int devices[MAX_CUDA_DEVICES];
+        get_cuda_devices_for_tile(get_init_tile_index(), devices);
+        s->cuda_device = devices[0];
 
         int ret;
-        printf("Initializing CUDA device %d...\n", cuda_devices[0]);
-        ret = gpujpeg_init_device(cuda_devices[0], TRUE);
+        printf("Initializing CUDA device %d...\n", s->cuda_device);
+        ret = gpujpeg_init_device(s->cuda_device, TRUE);
         if(ret != 0) {
-                log_msg(LOG_LEVEL_ERROR, MOD_NAME "initializing CUDA device %d failed.\n", cuda_devices[0]);
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "initializing CUDA device %d failed.\n", s->cuda_device);
                 free(s);
                 return NULL;
         }
 
+        for (int i = 0; i < s->depth && s->depth > 1; ++i) {
+                struct gpujpeg_worker *w = &s->workers[i];
+                w->cuda_device = s->cuda_device;
+                pthread_mutex_init(&w->lock, NULL);
+                pthread_cond_init(&w->cv, NULL);
+                pthread_create(&w->thread, NULL, worker_thread, w);
+        }
 
         return s;
 }
 
+static void destroy_decoders(struct state_decompress_gpujpeg *s)
+{
+        if(s->decoder) {
+                gpujpeg_decoder_destroy(s->decoder);
+                s->decoder = NULL;
+        }
+        for (int i = 0; i < s->depth && s->depth > 1; ++i) {
+                struct gpujpeg_worker *w = &s->workers[i];
+                if (w->decoder) {
+                        gpujpeg_decoder_destroy(w->decoder);
+                        w->decoder = NULL;
+                }
+                free_pinned(w->out);
+                w->out = NULL;
+        }
+}
+
 static int gpujpeg_decompress_reconfigure(void *state, struct video_desc desc,
                 int rshift, int gshift, int bshift, int pitch, codec_t out_codec)
 {
@@ -174,9 +376,10 @@ static int gpujpeg_decompress_reconfigure(void *state, struct video_desc desc,
                 s->rshift = rshift;
                 s->gshift = gshift;
                 s->bshift = bshift;
-                if(s->decoder) {
-                        gpujpeg_decoder_destroy(s->decoder);
+                if (s->depth > 1) {
+                        drain_workers(s);
                 }
+                destroy_decoders(s);
                 return configure_with(s, desc);
         }
 }
@@ -246,6 +449,41 @@ static decompress_status gpujpeg_probe_internal_codec(unsigned char *buffer, siz
 	return DECODER_GOT_CODEC;
 }
 
+/**
+ * Passes the frame to the next worker and returns the oldest frame in flight
+ * once the pipeline is full.
+ */
+static decompress_status decompress_pipelined(struct state_decompress_gpujpeg *s,
+                unsigned char *dst, const unsigned char *buffer, unsigned int src_len)
+{
+        struct gpujpeg_worker *w = &s->workers[s->next];
+        assert(w->state == WORKER_IDLE);
+        if (w->in_alloc < src_len) {
+                free(w->in);
+                w->in = malloc(src_len);
+                w->in_alloc = src_len;
+        }
+        memcpy(w->in, buffer, src_len);
+        w->in_len = src_len;
+        pthread_mutex_lock(&w->lock);
+        w->state = WORKER_BUSY;
+        pthread_cond_signal(&w->cv);
+        pthread_mutex_unlock(&w->lock);
+        s->next = (s->next + 1) % s->depth;
+        s->in_flight += 1;
+
+        if (s->in_flight < s->depth) {
+                return DECODER_NO_FRAME;
+        }
+        struct gpujpeg_worker *oldest = &s->workers[s->next];
+        s->in_flight -= 1;
+        if (!worker_collect(oldest)) {
+                return DECODER_NO_FRAME;
+        }
+        copy_output(s, dst, oldest->out);
+        return DECODER_GOT_FRAME;
+}
+
 static decompress_status gpujpeg_decompress(void *state, unsigned char *dst, unsigned char *buffer,
                 unsigned int src_len, int frame_seq, struct video_frame_callbacks *callbacks, struct pixfmt_desc *internal_prop)
 {
@@ -254,27 +492,24 @@ static decompress_status gpujpeg_decompress(void *state, unsigned char *dst, uns
         struct state_decompress_gpujpeg *s = (struct state_decompress_gpujpeg *) state;
         int ret;
         struct gpujpeg_decoder_output decoder_output;
-        int linesize;
 
         if (s->out_codec == VIDEO_CODEC_NONE) {
                 return gpujpeg_probe_internal_codec(buffer, src_len, internal_prop);
         }
 
-        linesize = vc_get_linesize(s->desc.width, s->out_codec);
-        
-        gpujpeg_set_device(cuda_devices[0]);
+        gpujpeg_set_device(s->cuda_device);
 
-        if (s->pitch == linesize && (s->out_codec == UYVY || s->out_codec == RGB
-                                || (s->out_codec == RGBA && s->rshift == 0 && s->gshift == 8 && s->bshift == 16)
-                        )) {
+        if (s->depth > 1) {
+                return decompress_pipelined(s, dst, buffer, src_len);
+        }
+
+        if (direct_output(s)) {
                 gpujpeg_decoder_output_set_custom(&decoder_output, dst);
                 //int data_decompressed_size = decoder_output.data_size;
                     
                 ret = gpujpeg_decoder_decode(s->decoder, (uint8_t*) buffer, src_len, &decoder_output);
                 if (ret != 0) return DECODER_NO_FRAME;
         } else {
-                unsigned char *line_src, *line_dst;
-                
                 gpujpeg_decoder_output_set_default(&decoder_output);
                 decoder_output.type = GPUJPEG_DECODER_OUTPUT_INTERNAL_BUFFER;
                 //int data_decompressed_size = decoder_output.data_size;
@@ -282,21 +517,8 @@ static decompress_status gpujpeg_decompress(void *state, unsigned char *dst, uns
                 ret = gpujpeg_decoder_decode(s->decoder, (uint8_t*) buffer, src_len, &decoder_output);
 
                 if (ret != 0) return DECODER_NO_FRAME;
-                
-                line_dst = dst;
-                line_src = decoder_output.data;
-                for (unsigned i = 0u; i < s->desc.height; i++) {
-                        if (s->out_codec == RGBA) {
-                                vc_copylineRGBtoRGBA(line_dst, line_src, linesize,
-                                                s->rshift, s->gshift, s->bshift);
-                        } else {
-                                assert(s->out_codec == UYVY || s->out_codec == I420);
-                                memcpy(line_dst, line_src, linesize);
-                        }
-                                
-                        line_dst += s->pitch;
-                        line_src += vc_get_linesize(s->desc.width, s->out_codec);
-                }
+
+                copy_output(s, dst, decoder_output.data);
         }
 
         return DECODER_GOT_FRAME;
@@ -304,8 +526,7 @@ static decompress_status gpujpeg_decompress(void *state, unsigned char *dst, uns
 
 static int gpujpeg_decompress_get_property(void *state, int property, void *val, size_t *len)
 {
-        struct state_decompress *s = (struct state_decompress *) state;
-        UNUSED(s);
+        struct state_decompress_gpujpeg *s = (struct state_decompress_gpujpeg *) state;
         int ret = FALSE;
 
         switch(property) {
@@ -316,6 +537,13 @@ static int gpujpeg_decompress_get_property(void *state, int property, void *val,
                                 ret = TRUE;
                         }
                         break;
+                case DECOMPRESS_PROPERTY_OUTPUT_DELAY:
+                        if(*len >= sizeof(int)) {
+                                *(int *) val = s->depth - 1;
+                                *len = sizeof(int);
+                                ret = TRUE;
+                        }
+                        break;
                 default:
                         ret = FALSE;
         }
@@ -327,9 +555,19 @@ static void gpujpeg_decompress_done(void *state)
 {
         struct state_decompress_gpujpeg *s = (struct state_decompress_gpujpeg *) state;
 
-        if(s->decoder) {
-                gpujpeg_decoder_destroy(s->decoder);
+        for (int i = 0; i < s->depth && s->depth > 1; ++i) {
+                struct gpujpeg_worker *w = &s->workers[i];
+                worker_collect(w);
+                pthread_mutex_lock(&w->lock);
+                w->state = WORKER_EXIT;
+                pthread_cond_signal(&w->cv);
+                pthread_mutex_unlock(&w->lock);
+                pthread_join(w->thread, NULL);
+                pthread_mutex_destroy(&w->lock);
+                pthread_cond_destroy(&w->cv);
+                free(w->in);
         }
+        destroy_decoders(s);
         free(s);
 }
 
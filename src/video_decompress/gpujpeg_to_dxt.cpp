@@ -3,7 +3,7 @@
  * @author Martin Pulec  <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2012-2023, CESNET z. s. p. o.
+ * Copyright (c) 2012-2026, CESNET z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -46,6 +46,7 @@
 #include <pthread.h>
 #include <stdlib.h>
 
+#include "cuda_wrapper.h"
 #include "libgpujpeg/gpujpeg_decoder.h"
 #include "libgpujpeg/gpujpeg_version.h"
 
@@ -57,13 +58,14 @@
 #include "video_decompress.h"
 
 #define MOD_NAME "[GPUJPEG to DXT] "
+#define MAX_DEPTH 4 ///< max workers per CUDA device
 
 namespace {
 
 struct thread_data {
         thread_data() :
                 gpujpeg_decoder(0), desc(), out_codec(), ppb(), dxt_out_buff(0),
-                cuda_dev_index(-1)
+                host_out_buff(0), stream(0), cuda_device(-1)
         {}
         synchronized_queue<msg *, 1> m_in;
         // currently only for output frames
@@ -73,9 +75,11 @@ struct thread_data {
         struct video_desc        desc;
         codec_t                  out_codec;
         int                      ppb;
-        char                    *dxt_out_buff;
+        char                    *dxt_out_buff;  ///< device memory
+        char                    *host_out_buff; ///< pinned, referenced by msg_decoded
+        cuda_wrapper_stream_t    stream; ///< shared by the decoder and DXT kernel
 
-        int                      cuda_dev_index;
+        int                      cuda_device;
 };
 
 struct msg_reconfigure : public msg {
@@ -96,15 +100,22 @@ struct msg_frame : public msg {
                 data_len = len;
         }
         ~msg_frame() {
-                delete data;
+                delete[] data;
         }
         char *data;
         int data_len;
 };
 
+/// output of the worker, the data are valid until next frame is passed to it
+struct msg_decoded : public msg {
+        explicit msg_decoded(const char *d) : data(d) {}
+        const char *data;
+};
+
 struct state_decompresss_gpujpeg_to_dxt {
-        struct thread_data       thread_data[MAX_CUDA_DEVICES];
-        pthread_t                thread_id[MAX_CUDA_DEVICES];
+        struct thread_data       thread_data[MAX_CUDA_DEVICES * MAX_DEPTH];
+        pthread_t                thread_id[MAX_CUDA_DEVICES * MAX_DEPTH];
+        unsigned int             worker_count;
 
         struct video_desc        desc;
         int                      ppb;
@@ -149,23 +160,25 @@ static void *worker_thread(void *arg)
                         gpujpeg_decoder_decode(s->gpujpeg_decoder, (uint8_t *) frame_msg->data, frame_msg->data_len,
                                         &decoder_output);
 
+                        // decoded image stays in the device memory, only
+                        // the DXT result is downloaded
                         if (s->out_codec == DXT1) {
                                 cuda_rgb_to_dxt1(decoder_output.data, s->dxt_out_buff, s->desc.width,
-                                                -s->desc.height, 0);
+                                                -s->desc.height, s->stream);
                         } else {
                                 cuda_rgb_to_dxt6(decoder_output.data, s->dxt_out_buff, s->desc.width,
-                                                -s->desc.height, 0);
+                                                -s->desc.height, s->stream);
                         }
 
-                        msg_frame *output_frame = new msg_frame(s->desc.width * s->desc.height / s->ppb);
-
-                        if (cuda_wrapper_memcpy((char*) output_frame->data, s->dxt_out_buff,
-                                                output_frame->data_len,
-                                                CUDA_WRAPPER_MEMCPY_DEVICE_TO_HOST) !=
+                        if (cuda_wrapper_memcpy_async(s->host_out_buff, s->dxt_out_buff,
+                                                s->desc.width * s->desc.height / s->ppb,
+                                                CUDA_WRAPPER_MEMCPY_DEVICE_TO_HOST, s->stream) !=
+                                        CUDA_WRAPPER_SUCCESS ||
+                                        cuda_wrapper_stream_synchronize(s->stream) !=
                                         CUDA_WRAPPER_SUCCESS) {
-                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "unable to copy from device.");
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "unable to copy from device.\n");
                         }
-                        s->m_out.push(output_frame);
+                        s->m_out.push(new msg_decoded(s->host_out_buff));
 
                         delete frame_msg;
                 }
@@ -176,10 +189,15 @@ static void *worker_thread(void *arg)
         }
 
         cuda_wrapper_free(s->dxt_out_buff);
+        cuda_wrapper_pinned_pool_release(s->host_out_buff);
 
         return NULL;
 }
 
+ADD_TO_PARAM("gpujpeg-to-dxt-depth", "* gpujpeg-to-dxt-depth=<n>\n"
+                "  number of frames in flight per CUDA device, each with own stream (default 1),\n"
+                "  increases latency by <n>-1 frames (for single device)\n");
+
 static void * gpujpeg_to_dxt_decompress_init(void)
 {
         struct state_decompresss_gpujpeg_to_dxt *s;
@@ -189,17 +207,32 @@ static void * gpujpeg_to_dxt_decompress_init(void)
         s->free = 0;
         s->occupied_count = 0;
 
-        for(unsigned int i = 0; i < cuda_devices_count; ++i) {
-                int ret = gpujpeg_init_device(cuda_devices[i], TRUE);
+        int depth = 1;
+        if (get_commandline_param("gpujpeg-to-dxt-depth") != nullptr) {
+                depth = atoi(get_commandline_param("gpujpeg-to-dxt-depth"));
+                if (depth <= 0 || depth > MAX_DEPTH) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong depth: %s (max %d)\n",
+                                        get_commandline_param("gpujpeg-to-dxt-depth"), MAX_DEPTH);
+                        delete s;
+                        return NULL;
+                }
+        }
+        // with tiled video, every tile has own state, preferring own device
+        unsigned int devices[MAX_CUDA_DEVICES];
+        const unsigned int device_count = get_cuda_devices_for_tile(get_init_tile_index(), devices);
+        s->worker_count = device_count * depth;
+
+        for(unsigned int i = 0; i < device_count; ++i) {
+                int ret = gpujpeg_init_device(devices[i], TRUE);
                 if(ret != 0) {
-                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "initializing CUDA device %d failed.\n", cuda_devices[0]);
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "initializing CUDA device %d failed.\n", devices[i]);
                         delete s;
                         return NULL;
                 }
         }
 
-        for(unsigned int i = 0; i < cuda_devices_count; ++i) {
-                s->thread_data[i].cuda_dev_index = i;
+        for(unsigned int i = 0; i < s->worker_count; ++i) {
+                s->thread_data[i].cuda_device = devices[i % device_count];
                 int ret = pthread_create(&s->thread_id[i], NULL, worker_thread,  &s->thread_data[i]);
                 assert(ret == 0);
         }
@@ -210,12 +243,9 @@ static void * gpujpeg_to_dxt_decompress_init(void)
 static void flush(struct state_decompresss_gpujpeg_to_dxt *s)
 {
         if (s->occupied_count > 0) {
-                for (unsigned int i = 0; i < cuda_devices_count; ++i) {
-                        if (i == s->free)
-                                continue;
-                        struct msg_frame *completed =
-                                dynamic_cast<msg_frame *>(s->thread_data[(s->free+1)%cuda_devices_count].m_out.pop());
-                        delete completed;
+                // the busy workers are those preceding s->free
+                for (unsigned int i = 1; i <= s->occupied_count; ++i) {
+                        delete s->thread_data[(s->free + s->worker_count - i) % s->worker_count].m_out.pop();
                 }
                 s->occupied_count = 0;
         }
@@ -247,7 +277,7 @@ static int gpujpeg_to_dxt_decompress_reconfigure(void *state, struct video_desc
 
         flush(s);
 
-        for(unsigned int i = 0; i < cuda_devices_count; ++i) {
+        for(unsigned int i = 0; i < s->worker_count; ++i) {
                 msg_reconfigure *reconf = new msg_reconfigure;
                 reconf->desc = desc;
                 reconf->out_codec = out_codec;
@@ -277,25 +307,35 @@ static int reconfigure_thread(struct thread_data *s, struct video_desc desc, int
                 gpujpeg_decoder_destroy(s->gpujpeg_decoder);
                 s->gpujpeg_decoder = NULL;
         } else {
-                gpujpeg_init_device(cuda_devices[s->cuda_dev_index], 0);
+                gpujpeg_init_device(s->cuda_device, 0);
         }
 
         if(s->dxt_out_buff != NULL) {
                 cuda_wrapper_free(s->dxt_out_buff);
                 s->dxt_out_buff = NULL;
         }
+        cuda_wrapper_pinned_pool_release(s->host_out_buff);
+        s->host_out_buff = NULL;
 
-        if(cuda_wrapper_malloc_host((void **) &s->dxt_out_buff, desc.width * desc.height / ppb)
-                        != CUDA_WRAPPER_SUCCESS) {
+        if(cuda_wrapper_malloc((void **) &s->dxt_out_buff, desc.width * desc.height / ppb)
+                        != CUDA_WRAPPER_SUCCESS ||
+                        cuda_wrapper_pinned_pool_alloc((void **) &s->host_out_buff,
+                                desc.width * desc.height / ppb) != CUDA_WRAPPER_SUCCESS) {
                 fprintf(stderr, "Could not allocate CUDA output buffer.\n");
                 return false;
         }
+        if (s->stream == NULL && cuda_wrapper_stream_pool_get(
+                                s->cuda_device, &s->stream) != CUDA_WRAPPER_SUCCESS) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot get CUDA stream: %s\n",
+                                cuda_wrapper_last_error_string());
+                return false;
+        }
         //gpujpeg_init_device(cuda_device, GPUJPEG_OPENGL_INTEROPERABILITY);
 
 #if LIBGPUJPEG_API_VERSION <= 2
         s->gpujpeg_decoder = gpujpeg_decoder_create();
 #else
-        s->gpujpeg_decoder = gpujpeg_decoder_create(NULL);
+        s->gpujpeg_decoder = gpujpeg_decoder_create((cudaStream_t) s->stream);
 #endif
         if(!s->gpujpeg_decoder) {
                 log_msg(LOG_LEVEL_ERROR, "Creating GPUJPEG decoder failed.\n");
@@ -306,7 +346,7 @@ static int reconfigure_thread(struct thread_data *s, struct video_desc desc, int
 }
 
 static decompress_status gpujpeg_to_dxt_decompress(void *state, unsigned char *dst, unsigned char *buffer,
-                unsigned int src_len, int frame_seq, video_frame_callbacks * /* callbacks */, codec_t * /* internal_codec */)
+                unsigned int src_len, int frame_seq, video_frame_callbacks * /* callbacks */, struct pixfmt_desc * /* internal_prop */)
 {
         struct state_decompresss_gpujpeg_to_dxt *s = (struct state_decompresss_gpujpeg_to_dxt *) state;
         UNUSED(frame_seq);
@@ -314,17 +354,17 @@ static decompress_status gpujpeg_to_dxt_decompress(void *state, unsigned char *d
         msg_frame *message = new msg_frame(src_len);
         memcpy(message->data, buffer, src_len);
 
-        if(s->occupied_count < cuda_devices_count - 1) {
+        if(s->occupied_count < s->worker_count - 1) {
                 s->thread_data[s->free].m_in.push(message);
-                s->free = s->free + 1; // should not exceed cuda_device_count
+                s->free = s->free + 1; // should not exceed worker_count
                 s->occupied_count += 1;
         } else {
                 s->thread_data[s->free].m_in.push(message);
 
-                s->free = (s->free + 1) % cuda_devices_count;
+                s->free = (s->free + 1) % s->worker_count;
 
-                struct msg_frame *completed =
-                        dynamic_cast<msg_frame *>(s->thread_data[s->free].m_out.pop());
+                struct msg_decoded *completed =
+                        dynamic_cast<msg_decoded *>(s->thread_data[s->free].m_out.pop());
                 assert(completed != NULL);
                 memcpy(dst, completed->data, s->desc.width * s->desc.height / s->ppb);
 
@@ -354,12 +394,12 @@ static void gpujpeg_to_dxt_decompress_done(void *state)
 
         flush(s);
 
-        for(unsigned int i = 0; i < cuda_devices_count; ++i) {
+        for(unsigned int i = 0; i < s->worker_count; ++i) {
                 msg_quit *quit_msg = new msg_quit;
                 s->thread_data[i].m_in.push(quit_msg);
         }
 
-        for(unsigned int i = 0; i < cuda_devices_count; ++i) {
+        for(unsigned int i = 0; i < s->worker_count; ++i) {
                 pthread_join(s->thread_id[i], NULL);
         }
 
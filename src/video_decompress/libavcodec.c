@@ -95,6 +95,7 @@ struct state_libavcodec_decompress {
         } sws;
 
         struct hw_accel_state hwaccel;
+        unsigned int cuda_device; ///< for CUVID/NVDEC, assigned to the decoded tile
 
         _Bool sps_vps_found; ///< to avoid initial error flood, start decoding after SPS (H.264) or VPS (HEVC) was received
 
@@ -201,7 +202,7 @@ static void set_codec_context_params(struct state_libavcodec_decompress *s)
 
         if (strstr(s->codec_ctx->codec->name, "cuvid") != NULL) {
                 char gpu[3];
-                snprintf(gpu, sizeof gpu, "%u", cuda_devices[0]);
+                snprintf(gpu, sizeof gpu, "%u", s->cuda_device);
                 check_av_opt_set(s->codec_ctx->priv_data, "gpu", gpu);
         }
 }
@@ -458,6 +459,10 @@ static void * libavcodec_decompress_init(void)
 
         hwaccel_state_init(&s->hwaccel);
 
+        unsigned int devices[MAX_CUDA_DEVICES];
+        get_cuda_devices_for_tile(get_init_tile_index(), devices);
+        s->cuda_device = devices[0];
+
         return s;
 }
 
@@ -544,10 +549,15 @@ static int hwacc_cuda_init(struct AVCodecContext *s, struct hw_accel_state *stat
 {
         UNUSED(out_codec);
 
+        const struct state_libavcodec_decompress *dec = s->opaque;
+        char device[16];
+        snprintf(device, sizeof device, "%u", dec->cuda_device);
         AVBufferRef *device_ref = NULL;
-        int ret = create_hw_device_ctx(AV_HWDEVICE_TYPE_CUDA, &device_ref);
-        if(ret < 0)
+        int ret = av_hwdevice_ctx_create(&device_ref, AV_HWDEVICE_TYPE_CUDA, device, NULL, 0);
+        if(ret < 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to create CUDA device %s!\n", device);
                 return ret;
+        }
 
         state->tmp_frame = av_frame_alloc();
         if(!state->tmp_frame){
@@ -1147,8 +1157,7 @@ static void libavcodec_decompress_done(void *state)
  * This should be take into account existing conversions.
  */
 static int libavcodec_decompress_get_priority(codec_t compression, struct pixfmt_desc internal, codec_t ugc) {
-        if (internal.accel_type != HWACCEL_NONE &&
-            hw_accel_to_ug_pixfmt(internal.accel_type) == ugc) {
+        if (hw_accel_can_output(internal.accel_type, ugc)) {
                 return VDEC_PRIO_PREFERRED;
         }
 
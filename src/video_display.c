@@ -62,12 +62,16 @@
 #include "config.h"
 #include "config_unix.h"
 #include "config_win32.h"
+#include "compat/usleep.h"
 #include "debug.h"
+#include "host.h"
 #include "lib_common.h"
 #include "module.h"
 #include "tv.h"
 #include "utils/color_out.h"
+#include "utils/frame_drops.h"
 #include "utils/macros.h"
+#include "utils/numa.h"
 #include "utils/thread.h"
 #include "video.h"
 #include "video_display.h"
@@ -76,6 +80,9 @@
 
 #define DISPLAY_MAGIC 0x01ba7ef1
 #define MOD_NAME "[display] "
+#define PACING_DROP_PERIODS 2   ///< frames later than this count of frame periods are dropped
+#define PACING_MAX_WAIT_NS  NS_IN_SEC ///< larger lead is considered a timestamp discontinuity
+#define PACING_REPORT_NS    (5 * NS_IN_SEC)
 
 /// @brief This struct represents initialized video display state.
 struct display {
@@ -94,6 +101,13 @@ struct display {
 
         time_ns_t t0;
         int frames;
+
+        // presentation time pacing (enabled with pacing_enabled)
+        _Bool pacing_enabled;
+        long long pacing_delay_ns; ///< added to video_frame::presentation_time
+        time_ns_t pacing_t0;
+        int pacing_frames, pacing_dropped;
+        long long pacing_skew_sum, pacing_skew_max; ///< achieved - target
 };
 
 void list_video_display_devices(bool full)
@@ -172,6 +186,13 @@ int initialize_video_display(struct module *parent, const char *requested_displa
         d->t0 = get_time_in_ns();
         d->display_name = strdup(requested_display);
 
+        const char *pacing = get_commandline_param("display-pacing");
+        if (pacing != NULL) {
+                d->pacing_enabled = 1;
+                d->pacing_delay_ns = (long long) (atof(pacing) * 1000 * 1000);
+                d->pacing_t0 = d->t0;
+        }
+
         *out = d;
         return 0;
 }
@@ -211,6 +232,7 @@ bool display_needs_mainloop(struct display *d)
 static void *display_run_helper(void *args)
 {
         set_thread_name("display");
+        ug_numa_bind_thread();
         struct display *d = args;
         assert(d->magic == DISPLAY_MAGIC);
         d->funcs->run(d->state);
@@ -333,9 +355,62 @@ struct video_frame *display_get_frame(struct display *d)
         }
 }
 
+ADD_TO_PARAM("display-pacing", "* display-pacing[=<delay_ms>]\n"
+                "  Hold received frames until their presentation time (derived from RTP\n"
+                "  timestamps) plus delay_ms, drop frames that are late by more than "
+                TOSTRING(PACING_DROP_PERIODS) " frame\n"
+                "  periods. Using the same delay on all receivers keeps video walls in sync.\n");
+static void display_pacing_report(struct display *d, time_ns_t now)
+{
+        if (now - d->pacing_t0 < PACING_REPORT_NS) {
+                return;
+        }
+        if (d->pacing_frames > 0 || d->pacing_dropped > 0) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Presentation skew avg %.2f ms, max %.2f ms, %d late frames dropped\n",
+                                d->pacing_frames > 0 ? (double) d->pacing_skew_sum / d->pacing_frames / MS_IN_NS_DBL : 0.0,
+                                (double) d->pacing_skew_max / MS_IN_NS_DBL, d->pacing_dropped);
+        }
+        d->pacing_t0 = now;
+        d->pacing_frames = d->pacing_dropped = 0;
+        d->pacing_skew_sum = d->pacing_skew_max = 0;
+}
+
+/**
+ * Waits until presentation time of the frame.
+ * @retval false the frame is too late and should be dropped
+ */
+static bool display_pace_frame(struct display *d, const struct video_frame *frame)
+{
+        if (frame->presentation_time == 0) {
+                return true;
+        }
+        const time_ns_t target = frame->presentation_time + d->pacing_delay_ns;
+        time_ns_t now = get_time_in_ns();
+        const long long period_ns = d->saved_desc.fps > 0 ? (long long) (NS_IN_SEC_DBL / d->saved_desc.fps) : 0;
+        if (now - target > PACING_DROP_PERIODS * period_ns) {
+                d->pacing_dropped += 1;
+                frame_drop_record(FRAME_DROP_DISPLAY_LATE, 1);
+                display_pacing_report(d, now);
+                return false;
+        }
+        if (target > now && target - now < PACING_MAX_WAIT_NS) {
+                usleep((target - now) / US_IN_NS);
+                now = get_time_in_ns();
+        }
+        const long long skew = now - target;
+        d->pacing_skew_sum += skew;
+        d->pacing_skew_max = MAX(d->pacing_skew_max, skew);
+        d->pacing_frames += 1;
+        display_pacing_report(d, now);
+        return true;
+}
+
 static bool display_frame_helper(struct display *d, struct video_frame *frame, long long timeout_ns)
 {
         bool ret = d->funcs->putf(d->state, frame, timeout_ns);
+        if (!ret && timeout_ns != PUTF_DISCARD) {
+                frame_drop_record(FRAME_DROP_DISPLAY_BUSY, 1);
+        }
         if (!d->funcs->generic_fps_indicator_prefix) {
                 return ret;
         }
@@ -376,6 +451,13 @@ bool display_put_frame(struct display *d, struct video_frame *frame, long long t
                 return d->funcs->putf(d->state, frame, timeout_ns);
         }
 
+        if (d->pacing_enabled && !display_pace_frame(d, frame)) {
+                if (!d->postprocess) { // postprocess frames are owned by the postprocessor
+                        d->funcs->putf(d->state, frame, PUTF_DISCARD);
+                }
+                return false;
+        }
+
         if (!d->postprocess) {
                 return display_frame_helper(d, frame, timeout_ns);
         }
@@ -511,6 +593,24 @@ bool display_ctl_property(struct display *d, int property, void *val, size_t *le
                 *(int *) val = PITCH_DEFAULT;
                 *len = sizeof(int);
                 return true;
+        case DISPLAY_PROPERTY_ACCEPTS_FOREIGN_FRAMES: // postprocessor input
+                return false;
+        case DISPLAY_PROPERTY_INPUT_ROI:
+                return vo_postprocess_get_property(d->postprocess, VO_PP_PROPERTY_INPUT_ROI, val, len);
+        case DISPLAY_PROPERTY_VIDEO_MODE:
+                {
+                        // tiles are merged for the postprocessor (see display_reconfigure())
+                        bool pp_does_change_tiling_mode = false;
+                        size_t nlen = sizeof pp_does_change_tiling_mode;
+                        vo_postprocess_get_property(d->postprocess, VO_PP_DOES_CHANGE_TILING_MODE,
+                                        &pp_does_change_tiling_mode, &nlen);
+                        if (pp_does_change_tiling_mode || *len < sizeof(int)) {
+                                return d->funcs->ctl_property(d->state, property, val, len);
+                        }
+                        *(int *) val = DISPLAY_PROPERTY_VIDEO_MERGED;
+                        *len = sizeof(int);
+                        return true;
+                }
         case DISPLAY_PROPERTY_CODECS:
                 {
                         codec_t display_codecs[VIDEO_CODEC_COUNT];
@@ -583,6 +683,82 @@ bool display_reconfigure_audio(struct display *d, int quant_samples, int channel
         return d->funcs->reconfigure_audio(d->state, quant_samples, channels, sample_rate);
 }
 
+static unsigned char *splash_rgb;
+static pthread_once_t splash_decoded = PTHREAD_ONCE_INIT;
+
+/**
+ * Decodes the QOI op stream (RGB only, without header) generated by
+ * data/scripts/splashscreen_encode.py.
+ */
+static void decode_splashscreen(void)
+{
+        enum {
+                QOI_OP_INDEX = 0x00,
+                QOI_OP_DIFF  = 0x40,
+                QOI_OP_LUMA  = 0x80,
+                QOI_OP_RUN   = 0xc0,
+                QOI_OP_RGB   = 0xfe,
+                QOI_MASK_2   = 0xc0,
+        };
+        const size_t len = (size_t) splash_width * splash_height * 3;
+        unsigned char *out = malloc(len);
+        if (out == NULL) {
+                return;
+        }
+        unsigned char index[64][3] = { { 0 } };
+        unsigned char px[3] = { 0, 0, 0 };
+        const unsigned char *in = splash_qoi;
+        const unsigned char *const in_end = splash_qoi + sizeof splash_qoi;
+        size_t pos = 0;
+
+        while (pos < len && in < in_end) {
+                const unsigned char op = *in++;
+                int run = 1;
+                if (op == QOI_OP_RGB) {
+                        memcpy(px, in, sizeof px);
+                        in += 3;
+                } else if ((op & QOI_MASK_2) == QOI_OP_INDEX) {
+                        memcpy(px, index[op], sizeof px);
+                } else if ((op & QOI_MASK_2) == QOI_OP_DIFF) {
+                        px[0] += ((op >> 4) & 0x3) - 2;
+                        px[1] += ((op >> 2) & 0x3) - 2;
+                        px[2] += (op & 0x3) - 2;
+                } else if ((op & QOI_MASK_2) == QOI_OP_LUMA) {
+                        const int dg = (op & 0x3f) - 32;
+                        const unsigned char drb = *in++;
+                        px[0] += dg - 8 + (drb >> 4);
+                        px[1] += dg;
+                        px[2] += dg - 8 + (drb & 0xf);
+                } else { // QOI_OP_RUN
+                        run = (op & 0x3f) + 1;
+                }
+                memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64],
+                       px, sizeof px);
+                for (; run > 0 && pos < len; --run, pos += 3) {
+                        memcpy(out + pos, px, sizeof px);
+                }
+        }
+        assert(pos == len);
+        splash_rgb = out;
+}
+
+/**
+ * @returns splashscreen as packed RGB of splash_width x splash_height pixels
+ * (decoded on first use and cached for the rest of the process lifetime)
+ * or NULL on failure; @p width and @p height are filled in when not NULL
+ */
+const unsigned char *get_splashscreen_rgb(unsigned *width, unsigned *height)
+{
+        pthread_once(&splash_decoded, decode_splashscreen);
+        if (width != NULL) {
+                *width = splash_width;
+        }
+        if (height != NULL) {
+                *height = splash_height;
+        }
+        return splash_rgb;
+}
+
 /**
  * @returns default UG splashscreen, caller is obliged to call vf_free() on the result
  */
@@ -599,8 +775,11 @@ struct video_frame *get_splashscreen()
 
         struct video_frame *frame = vf_alloc_desc_data(desc);
 
-        const char *data = splash_data;
         memset(frame->tiles[0].data, 0, frame->tiles[0].data_len);
+        const unsigned char *data = get_splashscreen_rgb(NULL, NULL);
+        if (data == NULL) {
+                return frame;
+        }
         for (unsigned int y = 0; y < splash_height; ++y) {
                 char *line = frame->tiles[0].data;
                 line += vc_get_linesize(frame->tiles[0].width,
@@ -610,7 +789,8 @@ struct video_frame *get_splashscreen()
                                 (frame->tiles[0].width - splash_width)/2,
                                 frame->color_spec);
                 for (unsigned int x = 0; x < splash_width; ++x) {
-                        HEADER_PIXEL(data,line);
+                        memcpy(line, data, 3);
+                        data += 3;
                         line += 4;
                 }
         }
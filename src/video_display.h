@@ -135,6 +135,10 @@ enum display_property {
         DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES = 5, ///< whether display supports receiving data from - returns (struct multi_sources_supp_info *)
                                                      ///< multiple network sources concurrently
         DISPLAY_PROPERTY_AUDIO_FORMAT = 6, ///< @see audio_display_info::query_format - in/out parameter is struct audio_desc
+        DISPLAY_PROPERTY_ACCEPTS_FOREIGN_FRAMES = 7, ///< putf() accepts frames not obtained with getf() - bool
+                                                     ///< (data read only, released just with vf_free())
+        DISPLAY_PROPERTY_INPUT_ROI = 8, ///< part of the (merged) frame that is actually shown - struct video_roi,
+                                        ///< whole frame if not supported; currently reported by postprocessors only
 };
 
 #define PITCH_DEFAULT -1 ///< default pitch, i. e. respective linesize
@@ -209,6 +213,7 @@ bool                     display_reconfigure_audio(struct display *d, int quant_
 /** @} */ // end of display_audio
 
 struct video_frame *get_splashscreen(void);
+const unsigned char *get_splashscreen_rgb(unsigned *width, unsigned *height);
 const char         *get_audio_conn_flag_name(int audio_init_flag);
 
 #ifdef __cplusplus
@@ -39,12 +39,14 @@
 #include <condition_variable>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
 #include <string_view>
+#include <vector>
 
 #include "debug.h"
 #include "host.h"
@@ -97,6 +99,8 @@ struct Participant{
         unsigned width = 0;
         unsigned height = 0;
 
+        bool updated = false; ///< new frame since last composition
+
         cv::Mat luma;
         cv::Mat chroma;
 };
@@ -104,6 +108,7 @@ struct Participant{
 void Participant::frame_recieved(unique_frame &&f){
         frame = std::move(f);
         last_time_recieved = clock::now();
+        updated = true;
 
         src_w = frame->tiles[0].width;
         src_h = frame->tiles[0].height;
@@ -203,6 +208,7 @@ private:
         void recompute_layout();
         void tiled_layout();
         void one_big_layout();
+        void pack_rect(unsigned x, unsigned y, unsigned w, unsigned h);
 
         unsigned width;
         unsigned height;
@@ -212,6 +218,10 @@ private:
 
         cv::Mat mixed_luma;
         cv::Mat mixed_chroma;
+        /// packed UYVY composite - only areas of updated participants are
+        /// redrawn unless redraw_all is set (layout change)
+        std::vector<unsigned char> mixed_uyvy;
+        bool redraw_all = true;
 
         std::map<uint32_t, Participant> participants;
 };
@@ -223,6 +233,7 @@ Video_mixer::Video_mixer(int width, int height, Layout layout):
 {
         mixed_luma.create(cv::Size(width, height), CV_8UC1);
         mixed_chroma.create(cv::Size(width / 2, height), CV_8UC2);
+        mixed_uyvy.resize(vc_get_datalen(width, height, UYVY));
 }
 
 void Video_mixer::tiled_layout(){
@@ -264,6 +275,7 @@ void Video_mixer::one_big_layout(){
 void Video_mixer::recompute_layout(){
         mixed_luma.setTo(16);
         mixed_chroma.setTo(128);
+        redraw_all = true;
 
         if(!primary_ssrc && !participants.empty()){
                 primary_ssrc = participants.begin()->first;
@@ -320,7 +332,10 @@ void Video_mixer::get_mixed(video_frame *result){
 
         for(auto&& [ssrc, p] : participants){
                 (void) ssrc;
-                p.to_cv_frame();
+                if(!p.updated && !redraw_all)
+                        continue;
+                if(p.updated)
+                        p.to_cv_frame();
 
                 PROFILE_DETAIL("resize participant");
                 cv::Size l_size(p.width, p.height);
@@ -328,46 +343,67 @@ void Video_mixer::get_mixed(video_frame *result){
                 cv::resize(p.luma, mixed_luma(cv::Rect(p.x, p.y, p.width, p.height)), l_size, 0, 0);
                 cv::resize(p.chroma, mixed_chroma(cv::Rect(p.x / 2, p.y, p.width / 2, p.height)), c_size, 0, 0);
                 PROFILE_DETAIL("");
+
+                if(!redraw_all)
+                        pack_rect(p.x, p.y, p.width, p.height);
+                p.updated = false;
+        }
+        if(redraw_all){
+                pack_rect(0, 0, width, height);
+                redraw_all = false;
         }
 
-        unsigned char *dst = reinterpret_cast<unsigned char *>(result->tiles[0].data);
-        unsigned char *chroma_src = mixed_chroma.ptr(0);
-        unsigned char *luma_src = mixed_luma.ptr(0);
-        assert(mixed_luma.isContinuous() && mixed_chroma.isContinuous());
-        PROFILE_DETAIL("Convert to ug frame");
-        unsigned dst_len = result->tiles[0].data_len;
+        PROFILE_DETAIL("Copy to ug frame");
+        memcpy(result->tiles[0].data, mixed_uyvy.data(),
+                        std::min<size_t>(result->tiles[0].data_len, mixed_uyvy.size()));
+}
+
+/// converts area of mixed_luma and mixed_chroma to mixed_uyvy
+void Video_mixer::pack_rect(unsigned x, unsigned y, unsigned w, unsigned h){
+        PROFILE_FUNC;
+        x &= ~1U; // UYVY macropixel boundary
+        w = std::min((w + 1) & ~1U, width - x);
+        h = std::min(h, height - y);
+        const size_t dst_pitch = vc_get_linesize(width, UYVY);
+
+        for(unsigned row = y; row < y + h; row++){
+                unsigned char *dst = mixed_uyvy.data() + row * dst_pitch + 2 * x;
+                const unsigned char *chroma_src = mixed_chroma.ptr(row) + x;
+                const unsigned char *luma_src = mixed_luma.ptr(row) + x;
+                unsigned dst_len = 2 * w;
 
 #ifdef __SSSE3__
-        __m128i y_shuff = _mm_set_epi8(7, -1, 6, -1, 5, -1, 4, -1, 3, -1, 2, -1, 1, -1, 0, -1);
-        __m128i uv_shuff = _mm_set_epi8(-1, 7, -1, 6, -1, 5, -1, 4, -1, 3, -1, 2, -1, 1, -1, 0);
-        while(dst_len >= 32){
-               __m128i luma = _mm_load_si128((__m128i const*)(const void *) luma_src); 
-               luma_src += 16;
-               __m128i chroma = _mm_load_si128((__m128i const*)(const void *) chroma_src); 
-               chroma_src += 16;
-
-               __m128i res = _mm_or_si128(_mm_shuffle_epi8(luma, y_shuff), _mm_shuffle_epi8(chroma, uv_shuff));
-               _mm_storeu_si128((__m128i *)(void *) dst, res);
-               dst += 16;
-
-               luma = _mm_bsrli_si128(luma, 8);
-               chroma = _mm_bsrli_si128(chroma, 8);
-
-               res = _mm_or_si128(_mm_shuffle_epi8(luma, y_shuff), _mm_shuffle_epi8(chroma, uv_shuff));
-               _mm_storeu_si128((__m128i *)(void *) dst, res);
-               dst += 16;
-
-               dst_len -= 32;
-        }
+                __m128i y_shuff = _mm_set_epi8(7, -1, 6, -1, 5, -1, 4, -1, 3, -1, 2, -1, 1, -1, 0, -1);
+                __m128i uv_shuff = _mm_set_epi8(-1, 7, -1, 6, -1, 5, -1, 4, -1, 3, -1, 2, -1, 1, -1, 0);
+                while(dst_len >= 32){
+                        __m128i luma = _mm_loadu_si128((__m128i const*)(const void *) luma_src);
+                        luma_src += 16;
+                        __m128i chroma = _mm_loadu_si128((__m128i const*)(const void *) chroma_src);
+                        chroma_src += 16;
+
+                        __m128i res = _mm_or_si128(_mm_shuffle_epi8(luma, y_shuff), _mm_shuffle_epi8(chroma, uv_shuff));
+                        _mm_storeu_si128((__m128i *)(void *) dst, res);
+                        dst += 16;
+
+                        luma = _mm_bsrli_si128(luma, 8);
+                        chroma = _mm_bsrli_si128(chroma, 8);
+
+                        res = _mm_or_si128(_mm_shuffle_epi8(luma, y_shuff), _mm_shuffle_epi8(chroma, uv_shuff));
+                        _mm_storeu_si128((__m128i *)(void *) dst, res);
+                        dst += 16;
+
+                        dst_len -= 32;
+                }
 #endif
 
-        while(dst_len >= 4){
-                *dst++ = *chroma_src++;
-                *dst++ = *luma_src++;
-                *dst++ = *chroma_src++;
-                *dst++ = *luma_src++;
+                while(dst_len >= 4){
+                        *dst++ = *chroma_src++;
+                        *dst++ = *luma_src++;
+                        *dst++ = *chroma_src++;
+                        *dst++ = *luma_src++;
 
-                dst_len -= 4;
+                        dst_len -= 4;
+                }
         }
 }
 
@@ -49,6 +49,7 @@
 #include <array>
 #include <atomic>                                // for atomic, __atomic_base
 #include <cctype>                                // for isdigit, toupper
+#include <climits>                               // for UINT_MAX
 #include <chrono>
 #include <cinttypes>
 #include <cmath>                                 // for ceil, fabs
@@ -157,6 +158,14 @@ class PlaybackDelegate : public IDeckLinkVideoOutputCallback // , public IDeckLi
 
         unsigned m_min_sched_frames = DEFAULT_MIN_SCHED_FRAMES;
         unsigned m_max_sched_frames = DEFAULT_MAX_SCHED_FRAMES;
+        // adaptive depth - m_min_sched_frames grows on underflow up to
+        // m_adapt_max - SCHED_RANGE and shrinks after ADAPT_STABLE_FRAMES
+        // frames without an underflow
+        bool m_adaptive = false;
+        unsigned m_adapt_max = DEFAULT_MAX_SCHED_FRAMES;
+        unsigned m_stable_frames = 0;
+        unsigned m_buffered_min = UINT_MAX;
+        unsigned m_buffered_max = 0;
         BMDTimeValue frameRateDuration{};
         BMDTimeScale frameRateScale{};
 
@@ -167,6 +176,8 @@ class PlaybackDelegate : public IDeckLinkVideoOutputCallback // , public IDeckLi
                 DEFAULT_MAX_SCHED_FRAMES =
                     DEFAULT_MIN_SCHED_FRAMES + SCHED_RANGE,
                 MAX_UNPROC_QUEUE_SIZE = 10,
+                ADAPT_MIN_SCHED_FRAMES   = 1,
+                ADAPT_STABLE_FRAMES      = 600, ///< 10 s @60p (20 s @30p)
         };
 
         void SetDecklinkOutput(IDeckLinkOutput *ido) { m_deckLinkOutput = ido; }
@@ -176,6 +187,9 @@ class PlaybackDelegate : public IDeckLinkVideoOutputCallback // , public IDeckLi
                 frameRateScale    = fs;
         }
         void SetSynchronized(const char *cfg);
+        void AdaptDepth(bool underflow);
+        /// @returns count of frames that may be held by the device
+        unsigned GetMaxSchedFrames() const { return m_adaptive ? m_adapt_max : m_max_sched_frames; }
         bool Preroll(struct state_decklink *s);
         void Reset();
         void ResetAudio() { m_audio_sync_ts = audio_sync_val::deinit; }
@@ -249,10 +263,20 @@ void PlaybackDelegate::PrintStats()
 {
         auto now = chrono::high_resolution_clock::now();
         if (chrono::duration_cast<chrono::seconds>(now - t0).count() >= 5) {
+                string buffered;
+                if (m_buffered_max > 0) {
+                        buffered = ", buffered " + to_string(m_buffered_min) +
+                                   "-" + to_string(m_buffered_max) +
+                                   " frames (target " +
+                                   to_string(m_min_sched_frames) + "-" +
+                                   to_string(m_max_sched_frames) + ")";
+                        m_buffered_min = UINT_MAX;
+                        m_buffered_max = 0;
+                }
                 LOG(LOG_LEVEL_VERBOSE)
                     << MOD_NAME << frames_late << " frames late, "
                     << frames_dropped << " dropped, " << frames_flushed
-                    << " flushed cumulative\n";
+                    << " flushed cumulative" << buffered << "\n";
                 t0 = now;
         }
 }
@@ -428,6 +452,36 @@ bool PlaybackDelegate::EnqueueFrame(DeckLinkFrame *deckLinkFrame)
         return false;
 }
 
+/**
+ * Adjusts the scheduled-frame window in the adaptive mode - increases it
+ * immediately when the device buffer underflows, decreases it after a while
+ * of stable playback (then surplus frames are dismissed by ScheduleNextFrame()
+ * so the latency goes down).
+ */
+void PlaybackDelegate::AdaptDepth(bool underflow)
+{
+        if (underflow) {
+                m_stable_frames = 0;
+                if (m_max_sched_frames < m_adapt_max) {
+                        m_min_sched_frames += 1;
+                        m_max_sched_frames += 1;
+                        MSG(VERBOSE, "Underflow, increasing scheduled frames to %u-%u\n",
+                            m_min_sched_frames, m_max_sched_frames);
+                }
+                return;
+        }
+        if (++m_stable_frames < ADAPT_STABLE_FRAMES) {
+                return;
+        }
+        m_stable_frames = 0;
+        if (m_min_sched_frames > ADAPT_MIN_SCHED_FRAMES) {
+                m_min_sched_frames -= 1;
+                m_max_sched_frames -= 1;
+                MSG(VERBOSE, "Stable playback, decreasing scheduled frames to %u-%u\n",
+                    m_min_sched_frames, m_max_sched_frames);
+        }
+}
+
 void PlaybackDelegate::ScheduleNextFrame()
 {
         uint32_t i = 0;
@@ -435,6 +489,8 @@ void PlaybackDelegate::ScheduleNextFrame()
         LOG(LOG_LEVEL_DEBUG) << MOD_NAME << __func__ << " - " << i << " frames buffered\n";
 
         const unique_lock<mutex> lk(schedLock);
+        m_buffered_min = min(m_buffered_min, i);
+        m_buffered_max = max(m_buffered_max, i);
         while (!schedFrames.empty()) {
                 DeckLinkFrame *f = schedFrames.front();
                 schedFrames.pop();
@@ -466,8 +522,14 @@ void PlaybackDelegate::ScheduleNextFrame()
         }
 
         if (i >= m_min_sched_frames || lastSchedFrame == nullptr) {
+                if (m_adaptive && lastSchedFrame != nullptr) {
+                        AdaptDepth(false);
+                }
                 return;
         }
+        if (m_adaptive) {
+                AdaptDepth(true);
+        }
         for (; i < (m_min_sched_frames + m_max_sched_frames + 1) / 2; ++i) {
                 LOG(LOG_LEVEL_WARNING) << MOD_NAME "Missing frame\n";
                 m_audio_sync_ts = audio_sync_val::resync;
@@ -574,6 +636,11 @@ show_help(bool full, const char *query_prop_fcc = nullptr)
                       << PlaybackDelegate::DEFAULT_MIN_SCHED_FRAMES
                       << "/, M - max sched\n\t\tframes /default "
                       << PlaybackDelegate::DEFAULT_MAX_SCHED_FRAMES << "/), shortcut sync\n";
+                col() << SBOLD("\tsynchronized=adaptive[,M]")
+                      << " scheduled mode with minimal latency - number of scheduled\n\t\tframes "
+                         "grows on underflow up to M /default "
+                      << PlaybackDelegate::DEFAULT_MAX_SCHED_FRAMES
+                      << "/ and shrinks\n\t\twhen stable\n";
                 col() << SBOLD("\tconversion") << "\toutput size conversion, can be:\n" <<
                                 SBOLD("\t\tnone") << " - no conversion\n" <<
                                 SBOLD("\t\tltbx") << " - down-converted letterbox SD\n" <<
@@ -670,6 +737,50 @@ allocate_new_decklink_frame(struct state_decklink *s)
                          s->pixelFormat, s->buffer_pool, s->requested_hdr_mode);
 }
 
+/// @returns true if pooled frame can be used for current video format
+static bool
+decklink_frame_usable(struct state_decklink *s, DeckLinkFrame *frame)
+{
+        const int linesize =
+            vc_get_linesize(s->vid_desc.width, s->vid_desc.color_spec);
+        if (s->stereo && dynamic_cast<DeckLink3DFrame *>(frame) == nullptr) {
+                return false;
+        }
+        return frame->GetWidth() == (long) s->vid_desc.width &&
+               frame->GetHeight() == (long) s->vid_desc.height &&
+               frame->GetRowBytes() == linesize &&
+               frame->GetPixelFormat() == s->pixelFormat;
+}
+
+/**
+ * Preallocates frames for the output so that no frame needs to be created
+ * while playing. Frames of a previous format are freed.
+ */
+static void
+fill_frame_pool(struct state_decklink *s, unsigned count)
+{
+        size_t pooled = 0;
+        {
+                lock_guard<mutex> lg(s->buffer_pool.lock);
+                queue<DeckLinkFrame *> usable;
+                while (!s->buffer_pool.frame_queue.empty()) {
+                        auto *frame = s->buffer_pool.frame_queue.front();
+                        s->buffer_pool.frame_queue.pop();
+                        if (decklink_frame_usable(s, frame)) {
+                                usable.push(frame);
+                        } else {
+                                delete frame;
+                        }
+                }
+                pooled = usable.size();
+                s->buffer_pool.frame_queue = std::move(usable);
+        }
+        for (; pooled < count; ++pooled) {
+                // releasing last reference returns the frame to the pool
+                allocate_new_decklink_frame(s)->Release();
+        }
+}
+
 static struct video_frame *
 display_decklink_getf(void *state)
 {
@@ -691,21 +802,14 @@ display_decklink_getf(void *state)
         };
         out->callbacks.dispose = dispose;
 
-        const int linesize = vc_get_linesize(s->vid_desc.width, s->vid_desc.color_spec);
         DeckLinkFrame *deckLinkFrame = nullptr;
         lock_guard<mutex> lg(s->buffer_pool.lock);
 
         while (!s->buffer_pool.frame_queue.empty()) {
-                auto tmp = s->buffer_pool.frame_queue.front();
-                DeckLinkFrame *frame =
-                    s->stereo ? dynamic_cast<DeckLink3DFrame *>(tmp)
-                              : dynamic_cast<DeckLinkFrame *>(tmp);
+                auto *frame = s->buffer_pool.frame_queue.front();
                 s->buffer_pool.frame_queue.pop();
-                if (!frame || // wrong type
-                    frame->GetWidth() != (long)s->vid_desc.width ||
-                    frame->GetHeight() != (long)s->vid_desc.height ||
-                    frame->GetRowBytes() != linesize || frame->GetPixelFormat() != s->pixelFormat) {
-                        tmp->Release();
+                if (!decklink_frame_usable(s, frame)) {
+                        delete frame; // ref count is 0
                 } else {
                         deckLinkFrame = frame;
                         deckLinkFrame->AddRef();
@@ -713,6 +817,7 @@ display_decklink_getf(void *state)
                 }
         }
         if (!deckLinkFrame) {
+                MSG(DEBUG, "Frame pool empty, allocating new frame\n");
                 deckLinkFrame = allocate_new_decklink_frame(s);
         }
         out->callbacks.dispose_udata = (void *) deckLinkFrame;
@@ -1059,6 +1164,8 @@ display_decklink_reconfigure(void *state, struct video_desc desc)
                 }
         }
 
+        fill_frame_pool(s, s->low_latency ? 2 : s->delegate.GetMaxSchedFrames() + 2);
+
         if (!s->low_latency) {
                 // Provide this class as a delegate to a video output interface
                 s->deckLinkOutput->SetScheduledFrameCompletionCallback(
@@ -1078,7 +1185,7 @@ PlaybackDelegate::Preroll(struct state_decklink *s)
 {
         auto *f = allocate_new_decklink_frame(s);
         for (unsigned i = 0;
-             i < (m_min_sched_frames + m_min_sched_frames + 1) / 2; ++i) {
+             i < (m_min_sched_frames + m_max_sched_frames + 1) / 2; ++i) {
                 f->AddRef();
                 const bool ret = EnqueueFrame(f);
                 assert(ret);
@@ -1149,6 +1256,16 @@ PlaybackDelegate::SetSynchronized(const char *cfg)
                 return;
         }
         cfg += 1;
+        if (strncasecmp(cfg, "adaptive", strlen("adaptive")) == 0) {
+                m_adaptive = true;
+                m_min_sched_frames = ADAPT_MIN_SCHED_FRAMES;
+                m_max_sched_frames = ADAPT_MIN_SCHED_FRAMES + SCHED_RANGE;
+                if (strchr(cfg, ',') != nullptr) {
+                        m_adapt_max = max<int>(stoi(strchr(cfg, ',') + 1),
+                                               m_max_sched_frames);
+                }
+                return;
+        }
         m_min_sched_frames = stoi(cfg);
         if (strchr(cfg, ',') != nullptr) {
                 m_max_sched_frames = stoi(strchr(cfg, ',') + 1);
@@ -1568,10 +1685,11 @@ static void display_decklink_done(void *state)
         RELEASE_IF_NOT_NULL(s->deckLinkOutput);
         RELEASE_IF_NOT_NULL(s->deckLink);
 
+        s->delegate.Reset(); // return held frames to the pool
         while (!s->buffer_pool.frame_queue.empty()) {
-                auto tmp = s->buffer_pool.frame_queue.front();
+                auto *tmp = s->buffer_pool.frame_queue.front();
                 s->buffer_pool.frame_queue.pop();
-                tmp->Release();
+                delete tmp;
         }
 
         delete s->timecode;
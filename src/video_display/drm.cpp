@@ -49,12 +49,19 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <poll.h>
 #include <unistd.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <drm_fourcc.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <algorithm>
 
@@ -62,10 +69,12 @@
 #include "host.h"
 #include "lib_common.h"
 #include "pixfmt_conv.h"
+#include "tv.h"
 #include "utils/color_out.h"
 #include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/text.h"
+#include "utils/thread.h"
 #include "utils/string_view_utils.hpp"
 #include "video.h"
 #include "video_codec.h"
@@ -74,6 +83,11 @@
 
 #define MOD_NAME "[drm] "
 
+#define PAGE_FLIP_TIMEOUT_MS 100
+#define MAX_PRIME_FB_CACHE 64
+#define FB_RING_SIZE 3 ///< scanned out + pending flip + drawn/queued
+#define STATS_INTERVAL_NS (5 * NS_IN_SEC)
+
 namespace{
         struct frame_deleter{ void operator()(video_frame *f){ vf_free(f); } };
         using frame_uniq = std::unique_ptr<video_frame, frame_deleter>;
@@ -102,6 +116,9 @@ namespace{
         struct drm_prop_deleter{ void operator()(drmModePropertyPtr p) { drmModeFreeProperty(p); } };
         using Drm_property_uniq = std::unique_ptr<drmModePropertyRes, drm_prop_deleter>;
 
+        struct drm_atomic_req_deleter{ void operator()(drmModeAtomicReqPtr r) { drmModeAtomicFree(r); } };
+        using Drm_atomic_req_uniq = std::unique_ptr<drmModeAtomicReq, drm_atomic_req_deleter>;
+
         class Fd_uniq{
         public:
                 Fd_uniq() = default;
@@ -251,7 +268,7 @@ namespace{
                 };
 
                 void unref(uint32_t handle){
-                        int refs = handle_map[handle]--;
+                        int refs = --handle_map[handle];
                         assert(refs >= 0 && "Unref called on invalid handle");
 
                         if(refs == 0){
@@ -312,6 +329,24 @@ namespace{
 } //anon namespace
   //
 
+/// property IDs used by atomic commits
+struct Atomic_props {
+        uint32_t plane_fb_id = 0;
+        uint32_t plane_crtc_id = 0;
+        uint32_t plane_src_x = 0;
+        uint32_t plane_src_y = 0;
+        uint32_t plane_src_w = 0;
+        uint32_t plane_src_h = 0;
+        uint32_t plane_crtc_x = 0;
+        uint32_t plane_crtc_y = 0;
+        uint32_t plane_crtc_w = 0;
+        uint32_t plane_crtc_h = 0;
+        uint32_t plane_in_fence_fd = 0; ///< optional
+        uint32_t crtc_mode_id = 0;
+        uint32_t crtc_active = 0;
+        uint32_t conn_crtc_id = 0;
+};
+
 struct Drm_state {
         Fd_uniq dri_fd;
 
@@ -325,6 +360,11 @@ struct Drm_state {
 
         std::set<uint32_t> supported_drm_formats;
         bool prime_support = false;
+        uint32_t primary_plane_id = 0;
+
+        bool atomic = false; ///< atomic modesetting API is used
+        Atomic_props props;
+        uint32_t mode_blob_id = 0;
 
         drmModeModeInfoPtr mode_info;
 };
@@ -343,12 +383,24 @@ struct Framebuffer{
         MemoryMapping map;
 };
 
-struct Drm_prime_fb{
-        frame_uniq frame;
+/* Framebuffer imported from a prime buffer. The decoder recycles a limited
+ * set of surfaces, so the framebuffers are cached and reused instead of
+ * AddFB/RmFB per frame. The GEM handles are held by the cache entry, which
+ * keeps handle values unique while the entry exists.
+ */
+struct Prime_fb_cache_entry{
         Gem_handle_manager::Handle gem_objects[4] = {};
         Fb_id_uniq id;
 };
 
+/// framebuffer passed to the display - dumb buffer from the ring or imported prime frame
+struct Scanout_fb{
+        uint32_t fb_id = 0; ///< 0 if none
+        int ring_idx = -1; ///< index to drm_display_state::fb_ring for dumb buffers
+        frame_uniq frame; ///< holds the decoder surface until the fb is off-screen
+        int in_fence_fd = -1; ///< fence to be waited for before scanout (atomic only)
+};
+
 struct drm_display_state {
         std::string cfg;
         std::string device_path;
@@ -361,10 +413,27 @@ struct drm_display_state {
 
         Framebuffer splashscreen;
 
-        Framebuffer back_buffer;
-        Framebuffer front_buffer;
+        std::vector<Framebuffer> fb_ring;
+        std::vector<bool> fb_ring_busy;
+
+        std::map<std::vector<uint64_t>, Prime_fb_cache_entry> prime_fb_cache;
 
-        Drm_prime_fb drm_prime_fb;
+        /* Presentation state (protected by lock). Flips are committed
+         * nonblocking, completion is handled by event_thread which also
+         * commits the queued fb (newer frame replaces the queued one).
+         */
+        std::mutex lock;
+        std::condition_variable flip_cv;
+        Scanout_fb scanout; ///< currently scanned out
+        Scanout_fb pending; ///< waiting for page flip
+        Scanout_fb queued; ///< to be flipped when pending flip completes
+        bool crtc_set = false; ///< mode set with current fb format, page flips can be used
+        int frames_replaced = 0;
+        time_ns_t stats_t0 = 0;
+
+        std::thread event_thread;
+        std::atomic<bool> should_exit = false;
+        bool force_legacy = false;
 
         video_desc desc;
         frame_uniq frame;
@@ -474,6 +543,65 @@ static int64_t get_property(int dri, drmModeObjectPropertiesPtr props, std::stri
         return -1;
 }
 
+static uint32_t get_property_id(int dri, uint32_t obj_id, uint32_t obj_type, std::string_view name){
+        Drm_object_properties_uniq props(drmModeObjectGetProperties(dri, obj_id, obj_type));
+        if(!props)
+                return 0;
+
+        for(unsigned i = 0; i < props->count_props; i++){
+                Drm_property_uniq prop(drmModeGetProperty(dri, props->props[i]));
+                if(prop && prop->name == name)
+                        return prop->prop_id;
+        }
+        return 0;
+}
+
+/**
+ * Enables atomic modesetting if supported by the driver and all needed
+ * properties are present. Otherwise legacy SetCrtc/PageFlip is used.
+ */
+static bool init_atomic(drm_display_state *s){
+        int dri = s->drm.dri_fd.get();
+        if(drmSetClientCap(dri, DRM_CLIENT_CAP_ATOMIC, 1) != 0){
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Atomic modesetting not supported, using legacy API\n");
+                return false;
+        }
+
+        auto& p = s->drm.props;
+        const uint32_t plane = s->drm.primary_plane_id;
+        const uint32_t crtc = s->drm.crtc->crtc_id;
+        const uint32_t conn = s->drm.connector->connector_id;
+        p.plane_fb_id = get_property_id(dri, plane, DRM_MODE_OBJECT_PLANE, "FB_ID");
+        p.plane_crtc_id = get_property_id(dri, plane, DRM_MODE_OBJECT_PLANE, "CRTC_ID");
+        p.plane_src_x = get_property_id(dri, plane, DRM_MODE_OBJECT_PLANE, "SRC_X");
+        p.plane_src_y = get_property_id(dri, plane, DRM_MODE_OBJECT_PLANE, "SRC_Y");
+        p.plane_src_w = get_property_id(dri, plane, DRM_MODE_OBJECT_PLANE, "SRC_W");
+        p.plane_src_h = get_property_id(dri, plane, DRM_MODE_OBJECT_PLANE, "SRC_H");
+        p.plane_crtc_x = get_property_id(dri, plane, DRM_MODE_OBJECT_PLANE, "CRTC_X");
+        p.plane_crtc_y = get_property_id(dri, plane, DRM_MODE_OBJECT_PLANE, "CRTC_Y");
+        p.plane_crtc_w = get_property_id(dri, plane, DRM_MODE_OBJECT_PLANE, "CRTC_W");
+        p.plane_crtc_h = get_property_id(dri, plane, DRM_MODE_OBJECT_PLANE, "CRTC_H");
+        p.plane_in_fence_fd = get_property_id(dri, plane, DRM_MODE_OBJECT_PLANE, "IN_FENCE_FD");
+        p.crtc_mode_id = get_property_id(dri, crtc, DRM_MODE_OBJECT_CRTC, "MODE_ID");
+        p.crtc_active = get_property_id(dri, crtc, DRM_MODE_OBJECT_CRTC, "ACTIVE");
+        p.conn_crtc_id = get_property_id(dri, conn, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID");
+
+        const uint32_t required[] = { p.plane_fb_id, p.plane_crtc_id, p.plane_src_x, p.plane_src_y,
+                p.plane_src_w, p.plane_src_h, p.plane_crtc_x, p.plane_crtc_y, p.plane_crtc_w,
+                p.plane_crtc_h, p.crtc_mode_id, p.crtc_active, p.conn_crtc_id };
+        for(uint32_t id : required){
+                if(id == 0){
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Missing atomic property, using legacy API\n");
+                        drmSetClientCap(dri, DRM_CLIENT_CAP_ATOMIC, 0);
+                        return false;
+                }
+        }
+
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using atomic modesetting%s\n",
+                        p.plane_in_fence_fd ? " (with IN_FENCE_FD)" : "");
+        return true;
+}
+
 static bool probe_drm_formats(drm_display_state *s){
         int dri = s->drm.dri_fd.get();
         Drm_plane_res_uniq plane_res(drmModeGetPlaneResources(dri));
@@ -494,6 +622,7 @@ static bool probe_drm_formats(drm_display_state *s){
                         continue;
                 }
                 if(get_property(dri, props.get(), "type") == DRM_PLANE_TYPE_PRIMARY){
+                        s->drm.primary_plane_id = plane->plane_id;
                         primary_plane = std::move(plane);
                         break;
                 }
@@ -697,6 +826,8 @@ static bool setup_crtc(drm_display_state *s){
                 return false;
         }
 
+        s->drm.atomic = !s->force_legacy && init_atomic(s);
+
         return true;
 }
 
@@ -765,26 +896,193 @@ static Framebuffer create_dumb_fb(int dri, int width, int height, uint32_t pix_f
         return buf;
 }
 
-static bool set_framebuffer(drm_display_state *s, uint32_t fb_id){
+static void add_plane_props(drm_display_state *s, drmModeAtomicReq *req, const Scanout_fb& fb){
+        const auto& p = s->drm.props;
+        const uint32_t plane = s->drm.primary_plane_id;
+        const uint64_t w = s->drm.mode_info->hdisplay;
+        const uint64_t h = s->drm.mode_info->vdisplay;
+
+        drmModeAtomicAddProperty(req, plane, p.plane_fb_id, fb.fb_id);
+        drmModeAtomicAddProperty(req, plane, p.plane_crtc_id, s->drm.crtc->crtc_id);
+        drmModeAtomicAddProperty(req, plane, p.plane_src_x, 0);
+        drmModeAtomicAddProperty(req, plane, p.plane_src_y, 0);
+        drmModeAtomicAddProperty(req, plane, p.plane_src_w, w << 16);
+        drmModeAtomicAddProperty(req, plane, p.plane_src_h, h << 16);
+        drmModeAtomicAddProperty(req, plane, p.plane_crtc_x, 0);
+        drmModeAtomicAddProperty(req, plane, p.plane_crtc_y, 0);
+        drmModeAtomicAddProperty(req, plane, p.plane_crtc_w, w);
+        drmModeAtomicAddProperty(req, plane, p.plane_crtc_h, h);
+        if(fb.in_fence_fd >= 0 && p.plane_in_fence_fd != 0){
+                drmModeAtomicAddProperty(req, plane, p.plane_in_fence_fd, fb.in_fence_fd);
+        }
+}
+
+/// sets the mode with fb (blocking)
+static bool modeset(drm_display_state *s, const Scanout_fb& fb){
+        int dri = s->drm.dri_fd.get();
         int res = 0;
-        res = drmModeSetCrtc(s->drm.dri_fd.get(), s->drm.crtc->crtc_id,
-                        fb_id, 0, 0, &s->drm.connector->connector_id, 1, s->drm.mode_info);
+        if(s->drm.atomic){
+                if(s->drm.mode_blob_id != 0){
+                        drmModeDestroyPropertyBlob(dri, s->drm.mode_blob_id);
+                        s->drm.mode_blob_id = 0;
+                }
+                res = drmModeCreatePropertyBlob(dri, s->drm.mode_info, sizeof *s->drm.mode_info, &s->drm.mode_blob_id);
+                if(res != 0){
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Failed to create mode blob (%d)\n", res);
+                        return false;
+                }
+                Drm_atomic_req_uniq req(drmModeAtomicAlloc());
+                const auto& p = s->drm.props;
+                drmModeAtomicAddProperty(req.get(), s->drm.connector->connector_id, p.conn_crtc_id, s->drm.crtc->crtc_id);
+                drmModeAtomicAddProperty(req.get(), s->drm.crtc->crtc_id, p.crtc_mode_id, s->drm.mode_blob_id);
+                drmModeAtomicAddProperty(req.get(), s->drm.crtc->crtc_id, p.crtc_active, 1);
+                add_plane_props(s, req.get(), fb);
+                res = drmModeAtomicCommit(dri, req.get(), DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr);
+        } else {
+                res = drmModeSetCrtc(dri, s->drm.crtc->crtc_id,
+                                fb.fb_id, 0, 0, &s->drm.connector->connector_id, 1, s->drm.mode_info);
+        }
         if(res < 0){
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Failed to set crtc (%d)\n", res);
+                s->crtc_set = false;
                 return false;
         }
+        s->crtc_set = true;
         return true;
 }
 
-static void draw_splash(drm_display_state *s){
+/// commits nonblocking page flip, completion is signalized by an event
+static bool commit_flip(drm_display_state *s, const Scanout_fb& fb){
         int res = 0;
-        res = drmModeSetCrtc(s->drm.dri_fd.get(), s->drm.crtc->crtc_id,
-                        s->splashscreen.id.get().id, 0, 0, &s->drm.connector->connector_id, 1, s->drm.mode_info);
-        if(res < 0){
-                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Failed to set crtc (%d)\n", res);
+        if(s->drm.atomic){
+                Drm_atomic_req_uniq req(drmModeAtomicAlloc());
+                add_plane_props(s, req.get(), fb);
+                res = drmModeAtomicCommit(s->drm.dri_fd.get(), req.get(),
+                                DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, s);
+        } else {
+                res = drmModePageFlip(s->drm.dri_fd.get(), s->drm.crtc->crtc_id,
+                                fb.fb_id, DRM_MODE_PAGE_FLIP_EVENT, s);
+        }
+        if(res != 0){
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Page flip failed (%d)\n", res);
+                return false;
+        }
+        return true;
+}
+
+/// returns the fb resources (ring buffer, decoder frame) for reuse, lock must be held
+static void retire(drm_display_state *s, Scanout_fb& fb){
+        if(fb.ring_idx >= 0 && fb.ring_idx < (int) s->fb_ring_busy.size()){
+                s->fb_ring_busy[fb.ring_idx] = false;
+        }
+        if(fb.frame){
+                vf_recycle(fb.frame.get());
+                s->free_frames.push_back(std::move(fb.frame));
+        }
+        fb = {};
+}
+
+/// pending fb is now scanned out, lock must be held
+static void flip_done(drm_display_state *s){
+        retire(s, s->scanout);
+        s->scanout = std::move(s->pending);
+        s->pending = {};
+        if(s->queued.fb_id != 0){
+                if(commit_flip(s, s->queued)){
+                        s->pending = std::move(s->queued);
+                        s->queued = {};
+                } else {
+                        retire(s, s->queued);
+                        s->crtc_set = false; // mode set on next frame
+                }
+        }
+
+        time_ns_t now = get_time_in_ns();
+        if(now - s->stats_t0 > STATS_INTERVAL_NS){
+                if(s->frames_replaced > 0){
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "%d frame(s) replaced by newer before scanout\n", s->frames_replaced);
+                }
+                s->frames_replaced = 0;
+                s->stats_t0 = now;
+        }
+        s->flip_cv.notify_all();
+}
+
+static void page_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec,
+                unsigned int tv_usec, void *user_data)
+{
+        UNUSED(fd), UNUSED(sequence), UNUSED(tv_sec), UNUSED(tv_usec);
+        auto s = static_cast<drm_display_state *>(user_data);
+        std::lock_guard<std::mutex> lk(s->lock);
+        if(s->pending.fb_id != 0){ // may be already handled on timeout
+                flip_done(s);
+        }
+}
+
+static void drm_event_thread(drm_display_state *s){
+        set_thread_name("drm_events");
+        drmEventContext ev_ctx = {};
+        ev_ctx.version = 2;
+        ev_ctx.page_flip_handler = page_flip_handler;
+
+        while(!s->should_exit){
+                pollfd pfd = { s->drm.dri_fd.get(), POLLIN, 0 };
+                if(poll(&pfd, 1, PAGE_FLIP_TIMEOUT_MS) > 0){
+                        drmHandleEvent(s->drm.dri_fd.get(), &ev_ctx);
+                }
+        }
+}
+
+/**
+ * Waits until the framebuffer passed to the last page flip is scanned out.
+ * Queued fb should be retired before not to be flipped meanwhile.
+ */
+static void wait_for_flip(drm_display_state *s, std::unique_lock<std::mutex>& lk){
+        if(!s->flip_cv.wait_for(lk, std::chrono::milliseconds(PAGE_FLIP_TIMEOUT_MS),
+                                [s]{ return s->pending.fb_id == 0; })){
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Page flip timeout\n");
+                flip_done(s);
         }
 }
 
+/**
+ * Passes the fb to the display without waiting for vblank - it is flipped
+ * immediately if no flip is pending, otherwise it is queued (replacing
+ * the previously queued one) and flipped from the event thread.
+ */
+static bool present(drm_display_state *s, std::unique_lock<std::mutex>& lk, Scanout_fb&& fb){
+        if(s->crtc_set && s->pending.fb_id != 0){
+                if(s->queued.fb_id != 0){
+                        retire(s, s->queued);
+                        s->frames_replaced += 1;
+                }
+                s->queued = std::move(fb);
+                return true;
+        }
+        if(s->crtc_set && commit_flip(s, fb)){
+                s->pending = std::move(fb);
+                return true;
+        }
+
+        retire(s, s->queued);
+        wait_for_flip(s, lk);
+        if(!modeset(s, fb)){
+                retire(s, fb);
+                return false;
+        }
+        retire(s, s->scanout);
+        s->scanout = std::move(fb);
+        return true;
+}
+
+static void draw_splash(drm_display_state *s){
+        std::unique_lock<std::mutex> lk(s->lock);
+        s->crtc_set = false;
+        Scanout_fb fb;
+        fb.fb_id = s->splashscreen.id.get().id;
+        present(s, lk, std::move(fb));
+}
+
 static void draw_frame(Framebuffer *dst, video_frame *src, bool center = true){
         auto dst_p = static_cast<char *>(dst->map.get());
         auto src_p = static_cast<char *>(src->tiles[0].data);
@@ -861,6 +1159,8 @@ static void *display_drm_init(struct module *parent, const char *cfg, unsigned i
                         s->device_path = val;
                 } else if(key == "connector"){
                         s->req_connector = val;
+                } else if(key == "legacy"){
+                        s->force_legacy = true;
                 } else if(key == "mode"){
                         auto res = tokenize(val, '@');
                         auto rate = tokenize(val, '@');
@@ -881,11 +1181,19 @@ static void *display_drm_init(struct module *parent, const char *cfg, unsigned i
         if(help_requested){
                 color_printf("\n");
                 color_printf("DRM display\n");
-                color_printf(TBOLD(TRED("\t-t drm"))"[:dev=<path>][:connector=<c>][:mode=<w>x<h>[@<rate>]]\n");
+                color_printf(TBOLD(TRED("\t-t drm"))"[:dev=<path>][:connector=<c>][:mode=<w>x<h>[@<rate>]][:legacy]\n");
                 color_printf("where:\n");
                 color_printf(TBOLD("\tpath") "        - Path to the DRI device. If not specified /dev/video[0..32] are tried.\n");
                 color_printf(TBOLD("\tconnector") "   - The physical connector the display device is plugged into.\n");
                 color_printf(TBOLD("\tmode") "        - Video mode to use. If not specified, the preferred mode is used. \n");
+                color_printf(TBOLD("\tlegacy") "      - Use legacy modesetting API even if atomic is available.\n");
+                color_printf("\n");
+                color_printf("Frames are page-flipped on vblank without blocking the decoder, if a newer frame\n"
+                                "arrives before the flip, the older is replaced (dropped).\n");
+                color_printf("\n");
+                color_printf("Hardware decoded video (" TBOLD("--param use-hw-accel") ", VAAPI or DRM PRIME eg. with V4L2 M2M decoders)\n"
+                                "is displayed without CPU copies - decoder surfaces are imported as framebuffers\n"
+                                "and page-flipped, they are returned to the decoder after being scanned out.\n");
                 color_printf("\n");
                 print_connectors(s.get());
                 return INIT_NOERR;
@@ -899,6 +1207,9 @@ static void *display_drm_init(struct module *parent, const char *cfg, unsigned i
 
         draw_splash(s.get());
 
+        s->stats_t0 = get_time_in_ns();
+        s->event_thread = std::thread(drm_event_thread, s.get());
+
         return s.release();
 }
 
@@ -906,18 +1217,30 @@ static void display_drm_done(void *state)
 {
         auto s = std::unique_ptr<drm_display_state>(static_cast<drm_display_state *>(state));
 
+        {
+                std::unique_lock<std::mutex> lk(s->lock);
+                retire(s.get(), s->queued);
+                wait_for_flip(s.get(), lk);
+        }
+        s->should_exit = true;
+        s->event_thread.join();
+
         int res = 0;
         res = drmModeSetCrtc(s->drm.dri_fd.get(), s->drm.crtc->crtc_id, s->drm.crtc->buffer_id,
                        s->drm.crtc->x , s->drm.crtc->y, &s->drm.connector->connector_id, 1, &s->drm.crtc->mode);
         if(res < 0){
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Failed to restore original crtc (%d)\n", res);
         }
+        if(s->drm.mode_blob_id != 0){
+                drmModeDestroyPropertyBlob(s->drm.dri_fd.get(), s->drm.mode_blob_id);
+        }
 }
 
 static struct video_frame *display_drm_getf(void *state)
 {
         auto s = static_cast<drm_display_state *>(state);
 
+        std::lock_guard<std::mutex> lk(s->lock);
         while(!s->free_frames.empty()){
                 auto frame = std::move(s->free_frames.back());
                 s->free_frames.pop_back();
@@ -930,25 +1253,49 @@ static struct video_frame *display_drm_getf(void *state)
         return vf_alloc_desc_data(s->desc);
 }
 
-static bool swap_buffers(drm_display_state *s){
-        std::swap(s->front_buffer, s->back_buffer);
-        return set_framebuffer(s, s->front_buffer.id.get().id);
+static void prune_prime_fb_cache(drm_display_state *s){
+        for(auto it = s->prime_fb_cache.begin(); it != s->prime_fb_cache.end();){
+                uint32_t id = it->second.id.get().id;
+                if(id == s->scanout.fb_id || id == s->pending.fb_id || id == s->queued.fb_id){
+                        ++it;
+                } else {
+                        it = s->prime_fb_cache.erase(it);
+                }
+        }
 }
 
-static Drm_prime_fb drm_fb_from_frame(drm_display_state *s, frame_uniq frame){
+/**
+ * Imports the prime buffer as a framebuffer (or reuses already imported one).
+ * No pixel data is touched by CPU.
+ */
+static Scanout_fb drm_fb_from_frame(drm_display_state *s, frame_uniq frame){
         assert(frame->color_spec == DRM_PRIME);
 
-        Drm_prime_fb fb;
+        Scanout_fb fb;
         fb.frame = std::move(frame);
         auto drm_frame = (drm_prime_frame *) fb.frame->tiles[0].data;
+        fb.in_fence_fd = drm_frame->in_fence_fd;
 
+        Prime_fb_cache_entry entry;
         for(int i = 0; i < drm_frame->fd_count; i++){
-                fb.gem_objects[i] = s->drm.gem_manager->get_handle(drm_frame->dmabuf_fds[i]);
+                entry.gem_objects[i] = s->drm.gem_manager->get_handle(drm_frame->dmabuf_fds[i]);
         }
 
         uint32_t handles[4] = {};
+        std::vector<uint64_t> key = { fb.frame->tiles[0].width, fb.frame->tiles[0].height, drm_frame->drm_format };
         for(int i = 0; i < drm_frame->planes; i++){
-                handles[i] = fb.gem_objects[drm_frame->fd_indices[i]].get();
+                handles[i] = entry.gem_objects[drm_frame->fd_indices[i]].get();
+                key.insert(key.end(), { handles[i], drm_frame->pitches[i], drm_frame->offsets[i], drm_frame->modifiers[i] });
+        }
+
+        auto it = s->prime_fb_cache.find(key);
+        if(it != s->prime_fb_cache.end()){
+                fb.fb_id = it->second.id.get().id;
+                return fb;
+        }
+
+        if(s->prime_fb_cache.size() >= MAX_PRIME_FB_CACHE){
+                prune_prime_fb_cache(s);
         }
 
         int res = 0;
@@ -957,9 +1304,12 @@ static Drm_prime_fb drm_fb_from_frame(drm_display_state *s, frame_uniq frame){
                         handles, drm_frame->pitches, drm_frame->offsets, drm_frame->modifiers, &fb_id.id, DRM_MODE_FB_MODIFIERS);
         if(res != 0){
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Failed to add FB\n");
+                return fb;
         }
         fb_id.dri_fd = s->drm.dri_fd.get();
-        fb.id = Fb_id_uniq(fb_id);
+        entry.id = Fb_id_uniq(fb_id);
+        fb.fb_id = fb_id.id;
+        s->prime_fb_cache.emplace(std::move(key), std::move(entry));
 
         return fb;
 }
@@ -969,13 +1319,13 @@ static void recycle_frame(drm_display_state *s, frame_uniq& frame){
         s->free_frames.push_back(std::move(frame));
 }
 
-static void recycle_prime_frame(drm_display_state *s, Drm_prime_fb& fb){
-        frame_uniq frame = std::move(fb.frame);
-        fb = {};
-        if(frame){
-                vf_recycle(frame.get());
-                s->free_frames.push_back(std::move(frame));
+/// @returns index of the ring fb that is not in use or -1
+static int get_free_ring_fb(drm_display_state *s){
+        for(unsigned i = 0; i < s->fb_ring_busy.size(); i++){
+                if(!s->fb_ring_busy[i])
+                        return i;
         }
+        return -1;
 }
 
 static bool display_drm_putf(void *state, struct video_frame *f, long long flags)
@@ -987,6 +1337,7 @@ static bool display_drm_putf(void *state, struct video_frame *f, long long flags
         }
 
         auto s = static_cast<drm_display_state *>(state);
+        std::unique_lock<std::mutex> lk(s->lock);
 
         if(flags == PUTF_DISCARD){
                 recycle_frame(s, frame);
@@ -994,21 +1345,36 @@ static bool display_drm_putf(void *state, struct video_frame *f, long long flags
         }
 
         if(frame->color_spec == DRM_PRIME){
-                Drm_prime_fb fb = drm_fb_from_frame(s, std::move(frame));
-                if(!set_framebuffer(s, fb.id.get().id)){
+                Scanout_fb fb = drm_fb_from_frame(s, std::move(frame));
+                if(fb.fb_id == 0){
+                        retire(s, fb);
                         return false;
                 }
+                return present(s, lk, std::move(fb));
+        }
 
-                recycle_prime_frame(s, s->drm_prime_fb);
-                s->drm_prime_fb = std::move(fb);
-                return true;
+        int idx = get_free_ring_fb(s);
+        if(idx < 0 && s->queued.ring_idx >= 0){
+                // overwrite the queued frame (it would be replaced anyway)
+                retire(s, s->queued);
+                s->frames_replaced += 1;
+                idx = get_free_ring_fb(s);
+        }
+        if(idx < 0){
+                recycle_frame(s, frame);
+                return false;
         }
+        s->fb_ring_busy[idx] = true;
 
-        draw_frame(&s->back_buffer, frame.get());
-        recycle_frame(s, frame);
-        swap_buffers(s);
+        lk.unlock();
+        draw_frame(&s->fb_ring[idx], frame.get());
+        lk.lock();
 
-        return true;
+        recycle_frame(s, frame);
+        Scanout_fb fb;
+        fb.fb_id = s->fb_ring[idx].id.get().id;
+        fb.ring_idx = idx;
+        return present(s, lk, std::move(fb));
 }
 
 static bool get_codecs(drm_display_state *s, void *val, size_t *len){
@@ -1067,6 +1433,17 @@ static bool display_drm_reconfigure(void *state, struct video_desc desc)
 
         s->frame.reset(vf_alloc_desc_data(desc));
 
+        std::unique_lock<std::mutex> lk(s->lock);
+        retire(s, s->queued);
+        wait_for_flip(s, lk);
+        s->crtc_set = false; // format may change, do a full mode set first
+        if(s->scanout.ring_idx >= 0){ // ring is going to be recreated
+                retire(s, s->scanout);
+        }
+        s->fb_ring.clear();
+        s->fb_ring_busy.clear();
+        prune_prime_fb_cache(s);
+
         uint32_t pix_fmt;
 
         switch(desc.color_spec){
@@ -1109,9 +1486,10 @@ static bool display_drm_reconfigure(void *state, struct video_desc desc)
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "Video resolution is larger than framebuffer. Only part of video frames will be visible\n");
         }
 
-        s->front_buffer = create_dumb_fb(s->drm.dri_fd.get(), s->drm.mode_info->hdisplay, s->drm.mode_info->vdisplay, pix_fmt);
-        s->back_buffer = create_dumb_fb(s->drm.dri_fd.get(), s->drm.mode_info->hdisplay, s->drm.mode_info->vdisplay, pix_fmt);
-
+        for(int i = 0; i < FB_RING_SIZE; i++){
+                s->fb_ring.push_back(create_dumb_fb(s->drm.dri_fd.get(), s->drm.mode_info->hdisplay, s->drm.mode_info->vdisplay, pix_fmt));
+        }
+        s->fb_ring_busy.assign(FB_RING_SIZE, false);
 
         return true;
 }
@@ -50,13 +50,15 @@
 #include "lib_common.h"
 #include "utils/color_out.h"
 #include "utils/macros.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_display.h"
 
 #define MOD_NAME "[dump] "
 
 struct dump_display_state {
-        struct video_frame *f;
+        void *pool; ///< frames are passed to the exporter thread without copying
+        struct video_desc desc;
         int frames;
         struct exporter *e;
         size_t max_tile_data_len;
@@ -95,6 +97,7 @@ static void *display_dump_init(struct module *parent, const char *cfg, unsigned
                 free(s);
                 return NULL;
         }
+        s->pool = video_frame_pool_init((struct video_desc){ 0 }, 0);
         return s;
 }
 
@@ -102,30 +105,30 @@ static void display_dump_done(void *state)
 {
         struct dump_display_state *s = state;
 
-        vf_free(s->f);
-        export_destroy(s->e);
+        export_destroy(s->e); // waits for the queued frames
+        video_frame_pool_destroy(s->pool);
         free(s);
 }
 
 static struct video_frame *display_dump_getf(void *state)
 {
         struct dump_display_state *s = state;
-        for (unsigned int i = 0; i < s->f->tile_count; ++i) {
-                if (is_codec_opaque(s->f->color_spec)) {
-                        s->f->tiles[i].data_len = s->max_tile_data_len;
-                }
-        }
-        return s->f;
+        struct video_frame *f = video_frame_pool_get_disposable_frame(s->pool);
+        f->decoder_overrides_data_len = is_codec_opaque(s->desc.color_spec) != 0 ? TRUE : FALSE;
+        return f;
 }
 
 static bool display_dump_putf(void *state, struct video_frame *frame, long long flags)
 {
         struct dump_display_state *s = state;
-        if (frame == NULL || flags == PUTF_DISCARD) {
+        if (frame == NULL) {
+                return true;
+        }
+        if (flags == PUTF_DISCARD) {
+                VIDEO_FRAME_DISPOSE(frame);
                 return true;
         }
-        assert(frame == s->f);
-        export_video(s->e, frame);
+        export_video_take(s->e, frame);
 
         return true;
 }
@@ -161,17 +164,11 @@ static bool display_dump_get_property(void *state, int property, void *val, size
 static bool display_dump_reconfigure(void *state, struct video_desc desc)
 {
         struct dump_display_state *s = state;
-        vf_free(s->f);
-        s->f = vf_alloc_desc(desc);
-        s->f->decoder_overrides_data_len = is_codec_opaque(desc.color_spec) != 0 ? TRUE : FALSE;
-        s->max_tile_data_len = MIN(8 * desc.width * desc.height, 1000000UL);
-        for (unsigned int i = 0; i < s->f->tile_count; ++i) {
-                if (is_codec_opaque(desc.color_spec)) {
-                        s->f->tiles[i].data_len = s->max_tile_data_len;
-                }
-                s->f->tiles[i].data = (char *) malloc(s->f->tiles[i].data_len);
-        }
-        s->f->callbacks.data_deleter = vf_data_deleter;
+        s->desc = desc;
+        s->max_tile_data_len = is_codec_opaque(desc.color_spec)
+                                   ? MIN(8 * desc.width * desc.height, 1000000UL)
+                                   : vc_get_datalen(desc.width, desc.height, desc.color_spec);
+        video_frame_pool_reconfigure(s->pool, desc, s->max_tile_data_len);
 
         return true;
 }
@@ -41,6 +41,10 @@
  * when compression is enabled (output is not NUT), accepted audio format
  * is restricted to 16-bit mono or stereo. We do not have to implement the
  * whole stack of conversions (or utilize libavresample).
+ *
+ * Compressed video (H.264, HEVC, MJPEG) is not decoded if the container
+ * supports the codec - the received frames are muxed as packets directly
+ * (stream copy).
  */
 
 #include <assert.h>
@@ -56,10 +60,13 @@
 #include "libavcodec/lavc_common.h"
 #include "libavcodec/to_lavc_vid_conv.h"
 #include "libavcodec/utils.h"
+#include "rtp/rtpdec_h264.h"
+#include "rtp/rtpenc_h264.h"
 #include "tv.h"
 #include "types.h"
 #include "utils/color_out.h"
 #include "utils/fs.h"
+#include "utils/list.h"
 #include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/text.h"
@@ -72,6 +79,7 @@
 
 enum {
         DEFAULT_MAX_AV_DIFF_NS = 84 * MS_IN_NS, // 2 24p frames
+        DEFAULT_QUEUE_LEN      = 5, ///< frames buffered if the writer stalls
 };
 
 struct output_stream {
@@ -80,7 +88,7 @@ struct output_stream {
         long long int       next_pts;
         time_ns_t           next_frm_time;
         union {
-                struct video_frame *vid_frm;
+                struct simple_linked_list *vid_frms; ///< queued for worker
                 AVFrame            *aud_frm;
         };
 };
@@ -92,8 +100,12 @@ struct state_file {
         struct output_stream video;
         struct video_desc    video_desc;
         struct to_lavc_vid_conv *video_conv;
+        bool                 stream_copy; ///< video is compressed, mux as is
+        bool                 transcode; ///< disable stream copy
+        bool                 got_keyframe; ///< stream copy started
         char                 filename[MAX_PATH_SIZE];
         time_ns_t            max_av_diff_ns; ///< max A/V diff in ns
+        int                  max_queue_len;
         pthread_t            thread_id;
         pthread_mutex_t      lock;
         pthread_cond_t       cv;
@@ -131,7 +143,13 @@ display_file_done(void *state)
         if (!(s->format_ctx->oformat->flags & AVFMT_NOFILE)) {
                 avio_closep(&s->format_ctx->pb);
         }
-        vf_free(s->video.vid_frm);
+        if (s->video.vid_frms != NULL) {
+                struct video_frame *f = NULL;
+                while ((f = simple_linked_list_pop(s->video.vid_frms)) != NULL) {
+                        vf_free(f);
+                }
+                simple_linked_list_destroy(s->video.vid_frms);
+        }
         av_frame_free(&s->audio.aud_frm);
         to_lavc_vid_conv_destroy(&s->video_conv);
         free(s);
@@ -141,10 +159,14 @@ static void
 usage(bool full)
 {
         color_printf("Display " TBOLD("file") " syntax:\n\n");
-        color_printf("\t" TBOLD(TRED("file") "[:name=<filename>]") " | " TBOLD(
+        color_printf("\t" TBOLD(TRED("file") "[:name=<filename>][:queue_len=<n>][:transcode]") " | " TBOLD(
             "file:[full]help") "\n\n");
         color_printf("where\n\n");
         color_printf("\t" TBOLD("<filename>") " - output file name\n");
+        color_printf("\t" TBOLD("queue_len") " - frames buffered if the "
+                     "writing stalls (default %d)\n", DEFAULT_QUEUE_LEN);
+        color_printf("\t" TBOLD("transcode") " - decode and encode also "
+                     "compressed video (default is stream copy)\n");
         if (full) {
                 color_printf(
                     "\t" TBOLD("max_av_diff") " - allowed A/V descync length "
@@ -171,6 +193,15 @@ parse_fmt(struct state_file *s, char *fmt)
                 char *val = strchr(item, '=') + 1;
                 if (IS_KEY_PREFIX(item, "file") || IS_KEY_PREFIX(item, "name")) {
                         snprintf(s->filename, sizeof s->filename, "%s", val);
+                } else if (IS_KEY_PREFIX(item, "queue_len")) {
+                        s->max_queue_len = (int) strtol(val, NULL, 10);
+                        if (s->max_queue_len <= 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME
+                                        "Wrong queue length: %s\n", val);
+                                return false;
+                        }
+                } else if (strcmp(item, "transcode") == 0) {
+                        s->transcode = true;
                 } else if (IS_KEY_PREFIX(item, "max_av_diff")) {
                         s->max_av_diff_ns =
                             (time_ns_t) (strtod(val, NULL) * NS_IN_SEC_DBL);
@@ -196,6 +227,7 @@ display_file_init(struct module *parent, const char *fmt, unsigned int flags)
         struct state_file *s = calloc(1, sizeof *s);
         snprintf(s->filename, sizeof s->filename, "%s", DEFAULT_FILENAME);
         s->max_av_diff_ns = DEFAULT_MAX_AV_DIFF_NS;
+        s->max_queue_len  = DEFAULT_QUEUE_LEN;
         char *fmt_c     = strdup(fmt);
         bool  parse_ret = parse_fmt(s, fmt_c);
         free(fmt_c);
@@ -214,6 +246,7 @@ display_file_init(struct module *parent, const char *fmt, unsigned int flags)
                 assert(s->format_ctx != NULL);
         }
         s->is_nut       = !strcmp(s->format_ctx->oformat->name, "nut");
+        s->video.vid_frms = simple_linked_list_init();
         s->video.st     = avformat_new_stream(s->format_ctx, NULL);
         s->video.st->id = 0;
 
@@ -271,6 +304,17 @@ display_file_getf(void *state)
 {
         struct state_file  *s   = state;
 
+        if (s->stream_copy) {
+                struct video_frame *out = vf_alloc_desc(s->video_desc);
+                out->decoder_overrides_data_len = true;
+                // raw RGBA size is enough for any compressed frame
+                out->tiles[0].data_len =
+                    vc_get_datalen(s->video_desc.width, s->video_desc.height, RGBA);
+                out->tiles[0].data = malloc(out->tiles[0].data_len +
+                                            AV_INPUT_BUFFER_PADDING_SIZE);
+                out->callbacks.data_deleter = vf_data_deleter;
+                return out;
+        }
         if (file_get_pix_fmt(s->is_nut, s->video_desc.color_spec) !=
             get_ug_to_av_pixfmt(s->video_desc.color_spec)) {
                 return vf_alloc_desc_data(s->video_desc); // conv needed
@@ -308,14 +352,16 @@ display_file_putf(void *state, struct video_frame *frame, long long timeout_ns)
                 pthread_cond_signal(&s->cv);
                 return true;
         }
-        bool ret = true;
-        if (s->video.vid_frm != NULL) {
-                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Video frame dropped!\n");
-                vf_free(s->video.vid_frm);
-                ret = false;
-        }
-        s->video.vid_frm = frame;
+        // the writer may temporarily stall (disk, muxer), so keep a few
+        // frames instead of dropping right away
+        bool ret = simple_linked_list_append_if_less(s->video.vid_frms, frame,
+                                                     s->max_queue_len);
         pthread_mutex_unlock(&s->lock);
+        if (!ret) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Video queue full, "
+                        "frame dropped!\n");
+                vf_free(frame);
+        }
         pthread_cond_signal(&s->cv);
         return ret;
 }
@@ -341,6 +387,17 @@ display_file_get_property(void *state, int property, void *val, size_t *len)
         case DISPLAY_PROPERTY_CODECS: {
                 codec_t codecs[VIDEO_CODEC_COUNT] = { 0 };
                 int     count                     = 0;
+                const codec_t copy_codecs[] = { H264, H265, MJPG };
+                for (unsigned i = 0;
+                     i < sizeof copy_codecs / sizeof copy_codecs[0] && !s->transcode;
+                     ++i) {
+                        if (avformat_query_codec(
+                                s->format_ctx->oformat,
+                                get_ug_to_av_codec(copy_codecs[i]),
+                                FF_COMPLIANCE_NORMAL) == 1) {
+                                codecs[count++] = copy_codecs[i];
+                        }
+                }
                 if (s->is_nut) {
                         codecs[count++] = R10k;
                         codecs[count++] = R12L;
@@ -391,7 +448,8 @@ display_file_reconfigure(void *state, struct video_desc desc)
 {
         struct state_file *s = state;
 
-        s->video_desc = desc;
+        s->video_desc  = desc;
+        s->stream_copy = is_codec_opaque(desc.color_spec);
         return true;
 }
 
@@ -500,7 +558,9 @@ configure_audio(struct state_file *s, struct audio_desc aud_desc,
         aud_ctx_set_ch_layout(s->audio.enc, aud_desc.ch_count, s->is_nut);
         s->audio.enc->sample_rate = aud_desc.sample_rate;
         s->audio.st->time_base    = (AVRational){ 1, aud_desc.sample_rate };
-        s->video.enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        if (s->video.enc != NULL) { // NULL if stream copy
+                s->video.enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
 
         int ret = avcodec_open2(s->audio.enc, codec, NULL);
         if (ret < 0) {
@@ -532,6 +592,16 @@ configure_video(struct state_file *s, struct video_desc vid_desc)
 {
         s->video.st->time_base = (AVRational){ get_framerate_d(vid_desc.fps),
                                                get_framerate_n(vid_desc.fps) };
+        if (is_codec_opaque(vid_desc.color_spec)) {
+                AVCodecParameters *par = s->video.st->codecpar;
+                par->codec_type        = AVMEDIA_TYPE_VIDEO;
+                par->codec_id          = get_ug_to_av_codec(vid_desc.color_spec);
+                par->width             = (int) vid_desc.width;
+                par->height            = (int) vid_desc.height;
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Stream copy of %s video.\n",
+                        get_codec_name(vid_desc.color_spec));
+                return true;
+        }
         const enum AVCodecID codec_id =
             s->is_nut ? AV_CODEC_ID_RAWVIDEO
                       : s->format_ctx->oformat->video_codec;
@@ -798,6 +868,86 @@ write_frame:
         }
 }
 
+/**
+ * @returns whether the compressed frame may start the stream - JPEG always,
+ * H.264/HEVC if it begins with parameter sets or IDR
+ */
+static bool
+is_keyframe(const struct video_frame *vid_frm)
+{
+        if (vid_frm->color_spec != H264 && vid_frm->color_spec != H265) {
+                return true;
+        }
+        const bool hevc = vid_frm->color_spec == H265;
+        const unsigned char *nal = rtpenc_get_first_nal(
+            (const unsigned char *) vid_frm->tiles[0].data,
+            vid_frm->tiles[0].data_len, hevc);
+        if (nal == NULL) {
+                return false;
+        }
+        const int nalu_type = NALU_HDR_GET_TYPE(nal[0], hevc);
+        return nalu_type == NAL_H264_SPS || nalu_type == NAL_H264_IDR ||
+               nalu_type == NAL_HEVC_VPS || nalu_type == NAL_HEVC_SPS;
+}
+
+static void
+free_copied_frame(void *opaque, uint8_t *data)
+{
+        (void) data;
+        vf_free(opaque);
+}
+
+/**
+ * Muxes the compressed frame without decoding. The packet references the
+ * frame data, which is freed when the muxer releases the packet.
+ *
+ * A/V sync correction is not applied - compressed frames cannot be dropped
+ * or duplicated without breaking the stream.
+ */
+static void
+copy_video_frame(struct state_file *s, struct video_frame *vid_frm,
+                 AVPacket *pkt)
+{
+        const bool key = is_keyframe(vid_frm);
+        if (!s->got_keyframe) {
+                if (!key) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Waiting for "
+                                "key frame, frame skipped.\n");
+                        vf_free(vid_frm);
+                        return;
+                }
+                s->got_keyframe = true;
+        }
+
+        const int len = (int) vid_frm->tiles[0].data_len;
+        memset(vid_frm->tiles[0].data + len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        pkt->buf = av_buffer_create((uint8_t *) vid_frm->tiles[0].data,
+                                    len + AV_INPUT_BUFFER_PADDING_SIZE,
+                                    free_copied_frame, vid_frm, 0);
+        if (pkt->buf == NULL) {
+                vf_free(vid_frm);
+                return;
+        }
+        pkt->data         = pkt->buf->data;
+        pkt->size         = len;
+        pkt->flags        = key ? AV_PKT_FLAG_KEY : 0;
+        pkt->pts = pkt->dts = s->video.next_pts++;
+        pkt->duration     = 1;
+        pkt->stream_index = s->video.st->index;
+        av_packet_rescale_ts(pkt,
+                             (AVRational){ get_framerate_d(s->video_desc.fps),
+                                           get_framerate_n(s->video_desc.fps) },
+                             s->video.st->time_base);
+        const int ret = av_interleaved_write_frame(s->format_ctx, pkt);
+        if (ret < 0) {
+                error_msg(MOD_NAME "error writting video packet: %s\n",
+                          av_err2str(ret));
+        }
+        av_packet_unref(pkt);
+        s->video.next_frm_time = get_time_in_ns() +
+                                 (long long) (NS_IN_SEC / s->video_desc.fps);
+}
+
 static void *
 worker(void *arg)
 {
@@ -812,22 +962,22 @@ worker(void *arg)
 
         pthread_mutex_lock(&s->lock);
         while (!s->should_exit) {
-                while (s->audio.aud_frm == NULL && s->video.vid_frm == NULL &&
+                while (s->audio.aud_frm == NULL &&
+                       simple_linked_list_size(s->video.vid_frms) == 0 &&
                        !s->should_exit) {
                         pthread_cond_wait(&s->cv, &s->lock);
                 }
                 if (s->should_exit) {
                         break;
                 }
-                if (s->video.vid_frm) {
+                if (simple_linked_list_size(s->video.vid_frms) > 0) {
                         vf_free(vid_frm);
-                        vid_frm = s->video.vid_frm;
+                        vid_frm = simple_linked_list_pop(s->video.vid_frms);
                 }
                 if (s->audio.aud_frm) {
                         av_frame_free(&aud_frm);
                         aud_frm = s->audio.aud_frm;
                 }
-                s->video.vid_frm = NULL;
                 s->audio.aud_frm = NULL;
                 pthread_mutex_unlock(&s->lock);
 
@@ -835,6 +985,7 @@ worker(void *arg)
                         if (!initialize(s, &saved_vid_desc, vid_frm,
                                         &saved_aud_desc, aud_frm,
                                         &tmp_aud_frm)) {
+                                pthread_mutex_lock(&s->lock);
                                 continue;
                         }
                 }
@@ -843,6 +994,7 @@ worker(void *arg)
                                   aud_frm)) {
                         error_msg(MOD_NAME "Reconfiguration not implemented. "
                                            "Let us know if desired.\n");
+                        pthread_mutex_lock(&s->lock);
                         continue;
                 }
 
@@ -851,8 +1003,12 @@ worker(void *arg)
                         av_frame_free(&aud_frm);
                 }
                 if (vid_frm) {
-                        write_video_frame(s, vid_frm, pkt);
-                        vf_free(vid_frm);
+                        if (is_codec_opaque(vid_frm->color_spec)) {
+                                copy_video_frame(s, vid_frm, pkt); // takes ownership
+                        } else {
+                                write_video_frame(s, vid_frm, pkt);
+                                vf_free(vid_frm);
+                        }
                         vid_frm = NULL;
                 }
                 pthread_mutex_lock(&s->lock);
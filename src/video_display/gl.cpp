@@ -62,6 +62,7 @@
 #include <queue>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
 
 #include "color.h"
@@ -79,6 +80,7 @@
 #include "utils/color_out.h"
 #include "utils/macros.h" // OPTIMIZED_FOR
 #include "utils/ref_count.hpp"
+#include "utils/thread.h"
 #include "video.h"
 #include "video_display.h"
 
@@ -89,10 +91,17 @@
 #define GL_DISABLE_10B_OPT_PARAM_NAME "gl-disable-10b"
 #define GL_WINDOW_HINT_OPT_PARAM_NAME "glfw-window-hint" ///< @todo TOREMOVE
 #define MAX_BUFFER_SIZE 1
+#define PBO_RING_SIZE 3 ///< number of persistently mapped PBOs (in-flight frames)
+#define UPLOAD_TEX_COUNT 3 ///< upload thread textures - presented + ready + being uploaded
+#define UPLOAD_STATS_INTERVAL_S 5
+#if defined GL_MAP_PERSISTENT_BIT && !defined __APPLE__
+#define HAVE_PERSISTENT_PBO 1
+#endif
 #define ADAPTIVE_VSYNC -1
 #define SYSTEM_VSYNC 0xFE
 #define SINGLE_BUF 0xFF // use single buffering instead of double
 
+#include "gl_dmabuf.hpp"
 #include "gl_vdpau.hpp"
 
 using std::begin;
@@ -115,6 +124,7 @@ using std::stol;
 using std::string;
 using std::string_view;
 using std::swap;
+using std::thread;
 using std::unique_lock;
 using std::unordered_map;
 using std::vector;
@@ -326,12 +336,35 @@ void main()
 } // main end
 )raw";
 
+/// NV12/P010 imported from DRM PRIME - Y in image, CbCr in image_uv
+static const char *nv12_to_rgb_fp = R"raw(
+#version 110
+uniform sampler2D image;
+uniform sampler2D image_uv;
+void main()
+{
+        vec3 yuv;
+        yuv.r = texture2D(image, gl_TexCoord[0].xy).r;
+        yuv.gb = texture2D(image_uv, gl_TexCoord[0].xy).rg;
+        yuv.r = Y_SCALED_PLACEHOLDER * (yuv.r - 0.0625);
+        yuv.g = yuv.g - 0.5;
+        yuv.b = yuv.b - 0.5;
+        gl_FragColor.r = yuv.r + R_CR_PLACEHOLDER * yuv.b;
+        gl_FragColor.g = yuv.r + G_CB_PLACEHOLDER * yuv.g + G_CR_PLACEHOLDER * yuv.b;
+        gl_FragColor.b = yuv.r + B_CB_PLACEHOLDER * yuv.g;
+        gl_FragColor.a = 1.0;
+}
+)raw";
+
 unordered_map<codec_t, const char *> glsl_programs = {
         { UYVY, uyvy_to_rgb_fp },
         { Y416, yuva_to_rgb_fp },
         { v210, v210_to_rgb_fp },
         { DXT1_YUV, fp_display_dxt1_yuv },
         { DXT5, fp_display_dxt5ycocg },
+#ifdef HWACC_GL_DMABUF
+        { DRM_PRIME, nv12_to_rgb_fp },
+#endif
 };
 
 static constexpr pair<int64_t, string_view> keybindings[] = {
@@ -353,9 +386,12 @@ static bool display_gl_reconfigure(void *state, struct video_desc desc);
 static void gl_draw(double ratio, double bottom_offset, bool double_buf);
 static void gl_change_aspect(struct state_gl *s, int width, int height);
 static void gl_resize(GLFWwindow *win, int width, int height);
-static void gl_render_glsl(struct state_gl *s, char *data);
+static void gl_render_glsl(struct state_gl *s, char *data, GLuint fbo, GLuint tex);
 static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc);
 static void gl_process_frames(struct state_gl *s);
+static void gl_process_uploaded(struct state_gl *s);
+static void gl_present_uploaded(struct state_gl *s);
+static void gl_present(struct state_gl *s);
 static void glfw_key_callback(GLFWwindow* win, int key, int scancode, int action, int mods);
 static void glfw_mouse_callback(GLFWwindow *win, double x, double y);
 static void glfw_close_callback(GLFWwindow *win);
@@ -377,6 +413,7 @@ struct state_gl {
         GLuint fbo_id = 0;
         GLuint texture_display = 0;
         GLuint texture_raw = 0;
+        GLuint texture_uv = 0; ///< chroma plane of DRM_PRIME
         GLuint pbo_id = 0;
 
         /* For debugging... */
@@ -434,8 +471,51 @@ struct state_gl {
         struct state_vdpau vdp;
 #endif
         bool         vdp_interop = false;
+#ifdef HWACC_GL_DMABUF
+        struct state_dmabuf_import dmabuf;
+#endif
+        bool         dmabuf_import = false;
         vector<char> scratchpad; ///< scratchpad sized WxHx8
 
+        bool persistent_pbo = false; ///< decoder writes directly to persistently mapped PBOs
+#ifdef HAVE_PERSISTENT_PBO
+        struct pbo_slot {
+                GLuint id;
+                GLsync fence;               ///< signalled when the last upload from the PBO finished
+                struct video_frame *frame;  ///< frame with tiles[0].data pointing to the mapping
+        };
+        vector<pbo_slot> pbo_ring;           ///< modified only by render thread with lock held
+        vector<struct video_frame *> pbo_free; ///< ring frames that can be passed to decoder
+        vector<struct video_frame *> pbo_retired; ///< frames to be destroyed by render thread
+        struct video_desc pbo_ring_desc{};  ///< desc for which pbo_ring was allocated
+#endif
+
+        /// texture upload and conversion in a thread with a shared context
+        enum upload_mode_t { UPLOAD_INLINE, UPLOAD_LATENCY, UPLOAD_SMOOTH } upload_mode = UPLOAD_INLINE;
+        struct upload_thread_state {
+                GLFWwindow *window = nullptr; ///< hidden window owning the shared context
+                thread      worker;
+                bool        should_exit = false;
+                struct slot {
+                        GLuint tex;
+                        GLsync draw_fence; ///< signalled when drawing from tex finished
+                        steady_clock::time_point ready_time;
+                } slots[UPLOAD_TEX_COUNT]{};
+                queue<int> free_slots;
+                queue<int> ready_slots;      ///< completely uploaded textures to be presented
+                int        presented = -1;   ///< touched only by render thread
+                bool       reconf_pending = false; ///< render thread should reconfigure to reconf_desc
+                struct video_desc reconf_desc{};
+                condition_variable cv;
+                struct {
+                        steady_clock::time_point start;
+                        long long presented;
+                        long long dropped;
+                        duration<double> upload_sum, upload_max;
+                        duration<double> wait_sum, wait_max;
+                } stats{};
+        } upload; ///< guarded by lock unless noted otherwise
+
         state_gl(struct module *parent) {
                 module_init_default(&mod);
                 mod.cls = MODULE_CLASS_DATA;
@@ -461,6 +541,9 @@ struct state_gl {
 static constexpr codec_t gl_supp_codecs[] = {
 #ifdef HWACC_VDPAU
         HW_VDPAU,
+#endif
+#ifdef HWACC_GL_DMABUF
+        DRM_PRIME,
 #endif
         UYVY,
         v210,
@@ -474,6 +557,204 @@ static constexpr codec_t gl_supp_codecs[] = {
         DXT5
 };
 
+/**
+ * @defgroup gl_pbo_ring Persistently mapped PBO ring
+ * If GL_ARB_buffer_storage is available, display_gl_getf() hands out frames
+ * whose data live directly in persistently mapped pixel unpack buffers, so
+ * that the upload doesn't need an extra memcpy to a mapped PBO.
+ *
+ * Ring is (re)created and destroyed solely by the render thread (owning the
+ * GL context). Frames returned by the decoder are kept in pbo_free, frames
+ * with obsolete format are put to pbo_retired and freed by the render thread.
+ * Reuse of a frame is guarded by a fence placed after its upload.
+ * @{
+ */
+static bool gl_pbo_ring_usable(codec_t codec)
+{
+        // R10k needs byte swap, DXT, VDPAU and DRM PRIME take a different upload path
+        return codec != R10k && codec != DXT1 && codec != DXT1_YUV &&
+               codec != DXT5 && codec != HW_VDPAU && codec != DRM_PRIME &&
+               codec != VIDEO_CODEC_NONE;
+}
+
+#ifdef HAVE_PERSISTENT_PBO
+static struct state_gl::pbo_slot *gl_pbo_find(struct state_gl *s, const char *data)
+{
+        for (auto &slot : s->pbo_ring) {
+                if (slot.frame->tiles[0].data == data) {
+                        return &slot;
+                }
+        }
+        return nullptr;
+}
+
+static void gl_pbo_slot_destroy(struct state_gl *s, struct video_frame *f)
+{
+        for (auto it = s->pbo_ring.begin(); it != s->pbo_ring.end(); ++it) {
+                if (it->frame == f) {
+                        glDeleteSync(it->fence);
+                        glDeleteBuffers(1, &it->id); // unmaps the buffer
+                        s->pbo_ring.erase(it);
+                        break;
+                }
+        }
+        vf_free(f);
+}
+#endif
+
+/// @returns true if there is work for gl_pbo_ring_update(); lock must be held
+static bool gl_pbo_ring_needs_update(struct state_gl *s)
+{
+#ifdef HAVE_PERSISTENT_PBO
+        return s->persistent_pbo && (!s->pbo_retired.empty() ||
+                        !video_desc_eq(s->pbo_ring_desc, s->current_desc));
+#else
+        UNUSED(s);
+        return false;
+#endif
+}
+
+/// destroys retired ring frames and allocates ring for new format; render thread, lock held
+static void gl_pbo_ring_update(struct state_gl *s)
+{
+#ifdef HAVE_PERSISTENT_PBO
+        if (!gl_pbo_ring_needs_update(s)) {
+                return;
+        }
+        for (auto *f : s->pbo_retired) {
+                gl_pbo_slot_destroy(s, f);
+        }
+        s->pbo_retired.clear();
+        if (video_desc_eq(s->pbo_ring_desc, s->current_desc)) {
+                return;
+        }
+        // frames currently being held elsewhere are retired once returned to display_gl_getf()
+        for (auto *f : s->pbo_free) {
+                gl_pbo_slot_destroy(s, f);
+        }
+        s->pbo_free.clear();
+        s->pbo_ring_desc = s->current_desc;
+        if (!gl_pbo_ring_usable(s->current_desc.color_spec)) {
+                return;
+        }
+
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        for (int i = 0; i < PBO_RING_SIZE; ++i) {
+                struct video_frame *f = vf_alloc_desc(s->current_desc);
+                f->tiles[0].data_len = vc_get_linesize(f->tiles[0].width, f->color_spec) * f->tiles[0].height;
+                const GLsizeiptr size = f->tiles[0].data_len + MAX_PADDING;
+                GLuint id = 0;
+                glGenBuffers(1, &id);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, id);
+                glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+                void *ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                if (ptr == nullptr) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot map persistent PBO, using regular buffers.\n");
+                        glDeleteBuffers(1, &id);
+                        vf_free(f);
+                        break;
+                }
+                f->tiles[0].data = static_cast<char *>(ptr);
+                vf_clear(f);
+                s->pbo_ring.push_back({ id, nullptr, f });
+                s->pbo_free.push_back(f);
+        }
+        MSG(DEBUG, "Allocated %zu persistent PBOs for %s\n", s->pbo_free.size(),
+            video_desc_to_string(s->current_desc));
+#else
+        UNUSED(s);
+#endif
+}
+
+/// waits until GPU finished reading frame data uploaded from the ring; render thread
+static void gl_pbo_wait(struct state_gl *s, struct video_frame *f)
+{
+#ifdef HAVE_PERSISTENT_PBO
+        struct state_gl::pbo_slot *slot = f == nullptr ? nullptr : gl_pbo_find(s, f->tiles[0].data);
+        if (slot == nullptr || slot->fence == nullptr) {
+                return;
+        }
+        if (glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100'000'000) == GL_TIMEOUT_EXPIRED) {
+                MSG(WARNING, "Timeout waiting for PBO upload to finish!\n");
+        }
+        glDeleteSync(slot->fence);
+        slot->fence = nullptr;
+#else
+        UNUSED(s), UNUSED(f);
+#endif
+}
+
+/// returns recycled frame to the appropriate free list; lock must be held
+static void gl_put_free_frame(struct state_gl *s, struct video_frame *f)
+{
+#ifdef HAVE_PERSISTENT_PBO
+        for (const auto &slot : s->pbo_ring) {
+                if (slot.frame == f) {
+                        s->pbo_free.push_back(f);
+                        return;
+                }
+        }
+#endif
+        s->free_frame_queue.push(f);
+}
+
+/// @returns free ring frame matching current_desc or nullptr; lock must be held
+static struct video_frame *gl_pbo_get_free_frame(struct state_gl *s)
+{
+#ifdef HAVE_PERSISTENT_PBO
+        while (!s->pbo_free.empty()) {
+                struct video_frame *f = s->pbo_free.back();
+                s->pbo_free.pop_back();
+                if (video_desc_eq(video_desc_from_frame(f), s->current_desc)) {
+                        return f;
+                }
+                s->pbo_retired.push_back(f);
+        }
+#else
+        UNUSED(s);
+#endif
+        return nullptr;
+}
+
+/**
+ * Uploads data to the currently bound texture from the ring PBO
+ * @returns false if data doesn't belong to the ring
+ */
+static bool gl_pbo_upload(struct state_gl *s, const char *data, GLint width, GLuint format, GLenum type)
+{
+#ifdef HAVE_PERSISTENT_PBO
+        struct state_gl::pbo_slot *slot = gl_pbo_find(s, data);
+        if (slot == nullptr) {
+                return false;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->id);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, s->current_display_desc.height, format, type, nullptr);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteSync(slot->fence); // frame may be uploaded repeatedly (render last)
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        return true;
+#else
+        UNUSED(s), UNUSED(data), UNUSED(width), UNUSED(format), UNUSED(type);
+        return false;
+#endif
+}
+
+/// releases GL objects of the ring, frames themselves are freed by display_gl_done()
+static void gl_pbo_ring_destroy(struct state_gl *s)
+{
+#ifdef HAVE_PERSISTENT_PBO
+        for (auto &slot : s->pbo_ring) {
+                glDeleteSync(slot.fence);
+                glDeleteBuffers(1, &slot.id);
+        }
+        s->pbo_ring.clear();
+#else
+        UNUSED(s);
+#endif
+}
+/// @}
+
 static void gl_print_monitors(bool fullhelp) {
         if (ref_count_init_once<int>()(glfwInit, glfw_init_count).value_or(GLFW_TRUE) == GLFW_FALSE) {
                 LOG(LOG_LEVEL_ERROR) << "Cannot initialize GLFW!\n";
@@ -530,6 +811,7 @@ static void gl_show_help(bool full) {
         col() << TBOLD("\taspect=<w>/<h>") << "\trequested video aspect (eg. 16/9). Leave unset if PAR = 1.\n";
         col() << TBOLD("\tcursor")      << "\t\tshow visible cursor\n";
         col() << TBOLD("\td[force]")    << "\tdeinterlace (optionally forcing deinterlace of progressive video)\n";
+        col() << TBOLD("\tegl")         << "\t\tcreate the GL context with EGL (zero-copy DRM PRIME, eg. VAAPI, import even on X11)\n";
         col() << TBOLD("\tfs[=<monitor>]") << "\tfullscreen with optional display specification\n";
         col() << TBOLD("\tgamma[=<val>]")
               << "\tgamma value to be added _in addition_ to the hardware "
@@ -542,8 +824,12 @@ static void gl_show_help(bool full) {
               << SUNDERLINE("modeset=size") << " - set only size\n";
         col() << TBOLD("\tnodecorate") << "\tdisable window decorations\n";
         col() << TBOLD("\tnovsync")     << "\t\tdo not turn sync on VBlank\n";
-        col() << TBOLD("\t[no]pbo")     << "\t\tWhether or not use PBO (ignore if not sure)\n";
+        col() << TBOLD("\t[no]pbo")     << "\t\tWhether or not use PBO (ignore if not sure), PBOs are mapped persistently if supported\n";
         col() << TBOLD("\tsingle")      << "\t\tuse single buffer (instead of double-buffering)\n";
+        col() << TBOLD("\tupload-thread[=latency]")
+              << "\tupload and convert frames in a separate thread while\n"
+                 "\t\t\tthe previous one is presented; frames are presented in\n"
+                 "\t\t\torder or, with " TBOLD("latency") ", only the newest uploaded one\n";
         col() << TBOLD("\tsize=<ratio>%")
               << "\tspecifies desired size of window relative\n"
                  "\t\t\tto native resolution (in percents)\n";
@@ -749,8 +1035,15 @@ static void *display_gl_parse_fmt(struct state_gl *s, char *ptr) {
                         if (strchr(tok, '/')) {
                                 s->gamma /= stof(strchr(tok, '/') + 1);
                         }
+                } else if (!strcasecmp(tok, "egl")) {
+                        s->window_hints[GLFW_CONTEXT_CREATION_API] = GLFW_EGL_CONTEXT_API;
                 } else if (!strcasecmp(tok, "hide-window")) {
                         s->window_hints[GLFW_VISIBLE] = GLFW_FALSE;
+                } else if (strcmp(tok, "upload-thread") == 0 ||
+                           strcmp(tok, "upload-thread=smooth") == 0) {
+                        s->upload_mode = state_gl::UPLOAD_SMOOTH;
+                } else if (strcmp(tok, "upload-thread=latency") == 0) {
+                        s->upload_mode = state_gl::UPLOAD_LATENCY;
                 } else if (strcasecmp(tok, "pbo") == 0 || strcasecmp(tok, "nopbo") == 0) {
                         s->use_pbo = strcasecmp(tok, "pbo") == 0 ? 1 : 0;
                 } else if (strstr(tok, "size=") == tok ||
@@ -874,6 +1167,14 @@ display_gl_reconfigure(void *state, struct video_desc desc)
 
         assert(find(begin(gl_supp_codecs), end(gl_supp_codecs),
                     desc.color_spec) != end(gl_supp_codecs));
+        if (desc.color_spec == HW_VDPAU && s->upload_mode != state_gl::UPLOAD_INLINE) {
+                MSG(ERROR, "VDPAU interop cannot be used with upload thread!\n");
+                return false;
+        }
+        if (desc.color_spec == DRM_PRIME && s->upload_mode != state_gl::UPLOAD_INLINE) {
+                MSG(ERROR, "DRM PRIME import cannot be used with upload thread!\n");
+                return false;
+        }
         if (get_bits_per_component(desc.color_spec) > 8) {
                 LOG(LOG_LEVEL_WARNING) << MOD_NAME "Displaying 10+ bits - performance degradation may occur, consider '--param " GL_DISABLE_10B_OPT_PARAM_NAME "'\n";
         }
@@ -881,7 +1182,11 @@ display_gl_reconfigure(void *state, struct video_desc desc)
                 LOG(LOG_LEVEL_WARNING) << MOD_NAME "Receiving interlaced video but deinterlacing is off - suggesting toggling it on (press 'd' or pass cmdline option)\n";
         }
 
-        s->current_desc = desc;
+        {
+                lock_guard<mutex> lk(s->lock);
+                s->current_desc = desc;
+        }
+        s->new_frame_ready_cv.notify_one(); // let render thread allocate PBO ring
 
         return true;
 }
@@ -1103,12 +1408,28 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
         else if (desc.color_spec == HW_VDPAU) {
                 s->vdp.init();
         }
+#endif
+#ifdef HWACC_GL_DMABUF
+        else if (desc.color_spec == DRM_PRIME) {
+                // the planes are bound to texture_raw and texture_uv in upload_texture()
+                glActiveTexture(GL_TEXTURE0 + 0);
+                glBindTexture(GL_TEXTURE_2D,s->texture_display);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                                desc.width, desc.height, 0,
+                                GL_RGBA, GL_UNSIGNED_BYTE,
+                                NULL);
+                s->dmabuf.init();
+                s->current_program = s->PHandles.at(DRM_PRIME);
+        }
 #endif
         if (s->current_program) {
                 glUseProgram(s->current_program);
                 if (GLint l = glGetUniformLocation(s->current_program, "image"); l != -1) {
                         glUniform1i(l, 2);
                 }
+                if (GLint l = glGetUniformLocation(s->current_program, "image_uv"); l != -1) {
+                        glUniform1i(l, 3);
+                }
                 if (GLint l = glGetUniformLocation(s->current_program, "imageWidth"); l != -1) {
                         glUniform1f(l, (GLfloat) desc.width);
                 }
@@ -1158,13 +1479,18 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
         s->current_display_desc = desc;
 }
 
-static void gl_render(struct state_gl *s, char *data)
+/**
+ * Uploads data and converts it (if needed) to texture tex
+ * @param fbo framebuffer used for the conversion (FBOs are not shared between contexts)
+ */
+static void gl_render(struct state_gl *s, char *data, GLuint fbo, GLuint tex)
 {
         gl_check_error();
 
         if (s->current_program) {
-                gl_render_glsl(s, data);
+                gl_render_glsl(s, data, fbo, tex);
         } else {
+                glBindTexture(GL_TEXTURE_2D, tex);
                 upload_texture(s, data);
         }
 
@@ -1219,6 +1545,36 @@ draw_pause()
         gl_check_error();
 }
 
+/// draws texture_display to the window (render thread)
+static void gl_present(struct state_gl *s)
+{
+        glBindTexture(GL_TEXTURE_2D, s->texture_display);
+        if (s->deinterlace == state_gl::deint::force || (s->deinterlace == state_gl::deint::on && s->current_display_desc.interlacing == INTERLACED_MERGED)) {
+                glUseProgram(s->PHandle_deint);
+        }
+        gl_draw(s->aspect, (s->dxt_height - s->current_display_desc.height) / (float) s->dxt_height * 2, s->vsync != SINGLE_BUF);
+        glUseProgram(0);
+        if (s->paused) {
+                draw_pause();
+        }
+
+        // publish to Syphon/Spout
+        if (s->syphon_spout) {
+#ifdef HAVE_SYPHON
+                syphon_server_publish(s->syphon_spout, s->current_display_desc.width, s->current_display_desc.height, s->texture_display);
+#elif defined HAVE_SPOUT
+                spout_sender_sendframe(s->syphon_spout, s->current_display_desc.width, s->current_display_desc.height, s->texture_display);
+                glBindTexture(GL_TEXTURE_2D, s->texture_display);
+#endif // HAVE_SPOUT
+        }
+
+        if (s->vsync == SINGLE_BUF) {
+                glFlush();
+        } else {
+                glfwSwapBuffers(s->window);
+        }
+}
+
 static void gl_process_frames(struct state_gl *s)
 {
         struct video_frame *frame;
@@ -1259,11 +1615,17 @@ static void gl_process_frames(struct state_gl *s)
                 }
         }
 
+        if (s->upload.window != nullptr) {
+                gl_process_uploaded(s);
+                return;
+        }
+
         {
                 unique_lock<mutex> lk(s->lock);
                 double timeout = min(2.0 / s->current_display_desc.fps, 0.1);
                 s->new_frame_ready_cv.wait_for(lk, duration<double>(timeout), [s] {
-                                return s->frame_queue.size() > 0;});
+                                return s->frame_queue.size() > 0 || gl_pbo_ring_needs_update(s);});
+                gl_pbo_ring_update(s);
                 if (s->frame_queue.size() == 0) {
                         return;
                 }
@@ -1280,7 +1642,8 @@ static void gl_process_frames(struct state_gl *s)
                                 swap(frame, s->current_frame);
                         }
                         vf_recycle(s->current_frame);
-                        s->free_frame_queue.push(s->current_frame);
+                        gl_pbo_wait(s, s->current_frame);
+                        gl_put_free_frame(s, s->current_frame);
                 }
                 s->current_frame = frame;
         }
@@ -1288,39 +1651,226 @@ static void gl_process_frames(struct state_gl *s)
         if (!video_desc_eq(video_desc_from_frame(frame), s->current_display_desc)) {
                 gl_reconfigure_screen(s, video_desc_from_frame(frame));
         }
+        gl_render(s, frame->tiles[0].data, s->fbo_id, s->texture_display);
+        gl_present(s);
+        log_msg(LOG_LEVEL_DEBUG, "Render buffer %dx%d\n", frame->tiles[0].width, frame->tiles[0].height);
+        {
+                unique_lock<mutex> lk(s->lock);
+                pop_frame(s, lk);
+        }
+}
+
+/**
+ * @defgroup gl_upload_thread Upload thread
+ * With "upload-thread", frames are uploaded and converted to one of
+ * UPLOAD_TEX_COUNT textures by a dedicated thread with a context shared with
+ * the main window, so that a large upload of frame N+1 doesn't eat the time
+ * budget of presenting frame N. The render (GLFW main) thread only draws
+ * and swaps, it also keeps doing reconfiguration because window must be
+ * manipulated from the main thread.
+ * @{
+ */
+/// allocates other upload textures same as texture_display (allocated by gl_reconfigure_screen)
+static void gl_upload_alloc_textures(struct state_gl *s)
+{
+        GLint internal_format = 0;
+        GLint width = 0;
+        GLint height = 0;
+        GLint compressed = GL_FALSE;
+        GLint compressed_size = 0;
         glBindTexture(GL_TEXTURE_2D, s->texture_display);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internal_format);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed) {
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressed_size);
+        }
+        for (auto &slot : s->upload.slots) {
+                if (slot.tex == s->texture_display) {
+                        continue;
+                }
+                glBindTexture(GL_TEXTURE_2D, slot.tex);
+                if (compressed) {
+                        glCompressedTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, compressed_size, nullptr);
+                } else {
+                        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                }
+        }
+        glBindTexture(GL_TEXTURE_2D, s->texture_display);
+        gl_check_error();
+}
 
-        gl_render(s, frame->tiles[0].data);
-        if (s->deinterlace == state_gl::deint::force || (s->deinterlace == state_gl::deint::on && s->current_display_desc.interlacing == INTERLACED_MERGED)) {
-                glUseProgram(s->PHandle_deint);
+static void gl_upload_print_stats(struct state_gl *s, steady_clock::time_point now)
+{
+        auto &st = s->upload.stats;
+        if (st.start == steady_clock::time_point{}) {
+                st.start = now;
+                return;
         }
-        gl_draw(s->aspect, (s->dxt_height - s->current_display_desc.height) / (float) s->dxt_height * 2, s->vsync != SINGLE_BUF);
-        glUseProgram(0);
-        if (s->paused) {
-                draw_pause();
+        if (now - st.start < seconds(UPLOAD_STATS_INTERVAL_S) || st.presented == 0) {
+                return;
         }
+        const long long uploaded = st.presented + st.dropped;
+        MSG(INFO, "Upload thread (%s): %lld frames presented, %lld dropped, "
+            "upload avg %.2f max %.2f ms, ready to present avg %.2f max %.2f ms\n",
+            s->upload_mode == state_gl::UPLOAD_LATENCY ? "latency" : "smooth",
+            st.presented, st.dropped,
+            1000.0 * st.upload_sum.count() / (double) uploaded, 1000.0 * st.upload_max.count(),
+            1000.0 * st.wait_sum.count() / (double) st.presented, 1000.0 * st.wait_max.count());
+        st = {};
+        st.start = now;
+}
 
-        // publish to Syphon/Spout
-        if (s->syphon_spout) {
-#ifdef HAVE_SYPHON
-                syphon_server_publish(s->syphon_spout, frame->tiles[0].width, frame->tiles[0].height, s->texture_display);
-#elif defined HAVE_SPOUT
-                spout_sender_sendframe(s->syphon_spout, frame->tiles[0].width, frame->tiles[0].height, s->texture_display);
-                glBindTexture(GL_TEXTURE_2D, s->texture_display);
-#endif // HAVE_SPOUT
-        }
+/// draws the presented upload texture and fences its use (render thread)
+static void gl_present_uploaded(struct state_gl *s)
+{
+        auto &slot = s->upload.slots[s->upload.presented];
+        s->texture_display = slot.tex;
+        gl_present(s);
+        glDeleteSync(slot.draw_fence);
+        slot.draw_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
 
-        if (s->vsync == SINGLE_BUF) {
-                glFlush();
-        } else {
-                glfwSwapBuffers(s->window);
+/// render thread counterpart of gl_upload_thread()
+static void gl_process_uploaded(struct state_gl *s)
+{
+        unique_lock<mutex> lk(s->lock);
+        double timeout = min(2.0 / s->current_display_desc.fps, 0.1);
+        s->upload.cv.wait_for(lk, duration<double>(timeout), [s] {
+                        return s->upload.reconf_pending || !s->upload.ready_slots.empty();});
+        if (s->upload.reconf_pending) {
+                while (!s->upload.ready_slots.empty()) { // uploaded with the old format
+                        s->upload.free_slots.push(s->upload.ready_slots.front());
+                        s->upload.ready_slots.pop();
+                }
+                lk.unlock(); // upload thread waits until we are done
+                gl_reconfigure_screen(s, s->upload.reconf_desc);
+                gl_upload_alloc_textures(s);
+                lk.lock();
+                s->upload.reconf_pending = false;
+                s->upload.cv.notify_all();
+        }
+        if (s->upload.ready_slots.empty()) {
+                if (s->paused && s->upload.presented != -1) { // upload thread drops frames when paused
+                        lk.unlock();
+                        gl_present_uploaded(s);
+                }
+                return;
         }
-        log_msg(LOG_LEVEL_DEBUG, "Render buffer %dx%d\n", frame->tiles[0].width, frame->tiles[0].height);
-        {
-                unique_lock<mutex> lk(s->lock);
-                pop_frame(s, lk);
+        const int idx = s->upload.ready_slots.front();
+        s->upload.ready_slots.pop();
+        const int prev = s->upload.presented;
+        s->upload.presented = idx;
+        lk.unlock();
+
+        gl_present_uploaded(s);
+        const auto &slot = s->upload.slots[idx];
+        const auto now = steady_clock::now();
+        log_msg(LOG_LEVEL_DEBUG, "Render buffer %dx%d\n", s->current_display_desc.width, s->current_display_desc.height);
+
+        lk.lock();
+        if (prev != -1) {
+                s->upload.free_slots.push(prev);
+                s->upload.cv.notify_all();
+        }
+        auto &st = s->upload.stats;
+        st.presented += 1;
+        st.wait_sum += now - slot.ready_time;
+        st.wait_max = std::max<duration<double>>(st.wait_max, now - slot.ready_time);
+        gl_upload_print_stats(s, now);
+}
+
+static void gl_upload_thread(struct state_gl *s)
+{
+        set_thread_name("gl_upload");
+        glfwMakeContextCurrent(s->upload.window);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glEnable(GL_TEXTURE_2D);
+        GLuint fbo = 0;
+        glGenFramebuffersEXT(1, &fbo);
+
+        unique_lock<mutex> lk(s->lock);
+        while (!s->upload.should_exit) {
+                s->new_frame_ready_cv.wait(lk, [s] {
+                                return s->upload.should_exit || s->frame_queue.size() > 0 ||
+                                        gl_pbo_ring_needs_update(s);});
+                gl_pbo_ring_update(s);
+                if (s->upload.should_exit || s->frame_queue.size() == 0) {
+                        continue;
+                }
+                struct video_frame *frame = s->frame_queue.front();
+                if (!frame) { // poison pill, the window is being closed
+                        break;
+                }
+                s->frame_queue.pop();
+                s->frame_consumed_cv.notify_one();
+                if (s->paused) {
+                        vf_recycle(frame);
+                        gl_put_free_frame(s, frame);
+                        continue;
+                }
+                if (!video_desc_eq(video_desc_from_frame(frame), s->current_display_desc)) {
+                        s->upload.reconf_desc = video_desc_from_frame(frame);
+                        s->upload.reconf_pending = true;
+                        s->upload.cv.notify_all();
+                }
+                s->upload.cv.wait(lk, [s] {
+                                return s->upload.should_exit || (!s->upload.reconf_pending &&
+                                        !s->upload.free_slots.empty());});
+                if (s->upload.should_exit) {
+                        vf_recycle(frame);
+                        gl_put_free_frame(s, frame);
+                        break;
+                }
+                const int idx = s->upload.free_slots.front();
+                s->upload.free_slots.pop();
+                lk.unlock();
+
+                auto &slot = s->upload.slots[idx];
+                const auto t0 = steady_clock::now();
+                if (slot.draw_fence != nullptr) { // previous presentation of the texture
+                        glWaitSync(slot.draw_fence, 0, GL_TIMEOUT_IGNORED);
+                        glDeleteSync(slot.draw_fence);
+                        slot.draw_fence = nullptr;
+                }
+                gl_render(s, frame->tiles[0].data, fbo, slot.tex);
+                GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000) == GL_TIMEOUT_EXPIRED) {
+                        MSG(WARNING, "Timeout waiting for upload to finish!\n");
+                }
+                glDeleteSync(fence);
+                gl_pbo_wait(s, frame); // already finished, just releases the fence
+                const auto t1 = steady_clock::now();
+
+                lk.lock();
+                slot.ready_time = t1;
+                auto &st = s->upload.stats;
+                st.upload_sum += t1 - t0;
+                st.upload_max = std::max<duration<double>>(st.upload_max, t1 - t0);
+                // keep the last frame for screenshots
+                if (s->current_frame != nullptr) {
+                        vf_recycle(s->current_frame);
+                        gl_put_free_frame(s, s->current_frame);
+                }
+                s->current_frame = frame;
+                if (s->upload_mode == state_gl::UPLOAD_LATENCY) {
+                        // present only the newest complete frame
+                        while (!s->upload.ready_slots.empty()) {
+                                s->upload.free_slots.push(s->upload.ready_slots.front());
+                                s->upload.ready_slots.pop();
+                                st.dropped += 1;
+                        }
+                }
+                s->upload.ready_slots.push(idx);
+                s->upload.cv.notify_all();
         }
+        lk.unlock();
+
+        glDeleteFramebuffersEXT(1, &fbo);
+        glfwMakeContextCurrent(nullptr);
 }
+/// @}
 
 static int64_t translate_glfw_to_ug(int key, int mods) {
         key = tolower(key);
@@ -1387,7 +1937,10 @@ static bool display_gl_process_key(struct state_gl *s, long long int key)
                                       : "Unpaused");
                         break;
                 case K_ALT('s'):
-                        screenshot(s->current_frame);
+                        {
+                                lock_guard<mutex> lk(s->lock); // may be replaced by upload thread
+                                screenshot(s->current_frame);
+                        }
                         break;
                 case K_ALT('m'):
                         s->show_cursor = (state_gl::show_cursor_t) (((int) s->show_cursor + 1) % 3);
@@ -1467,6 +2020,12 @@ static void display_gl_print_depth() {
 
 static void display_gl_render_last(GLFWwindow *win) {
         auto *s = (struct state_gl *) glfwGetWindowUserPointer(win);
+        if (s->upload.window != nullptr) {
+                if (s->upload.presented != -1) {
+                        gl_present_uploaded(s);
+                }
+                return;
+        }
         unique_lock<mutex> lk(s->lock);
         auto *f = s->current_frame;
         s->current_frame = nullptr;
@@ -1474,6 +2033,7 @@ static void display_gl_render_last(GLFWwindow *win) {
         if (!f) {
                 return;
         }
+        gl_pbo_wait(s, f); // may be dropped to free list by putf
         // redraw last frame
         display_gl_putf(s, f, PUTF_NONBLOCK);
 }
@@ -1742,6 +2302,13 @@ static bool display_gl_init_opengl(struct state_gl *s)
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
+        glGenTextures(1, &s->texture_uv);
+        glBindTexture(GL_TEXTURE_2D, s->texture_uv);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
         for (auto &it : glsl_programs) {
                 GLuint prog = gl_substitute_compile_link(vert, it.second);
                 if (prog == 0U) {
@@ -1764,8 +2331,36 @@ static bool display_gl_init_opengl(struct state_gl *s)
         glGenFramebuffersEXT(1, &s->fbo_id);
 
         glGenBuffersARB(1, &s->pbo_id);
+#ifdef HAVE_PERSISTENT_PBO
+        s->persistent_pbo = s->use_pbo && GLEW_ARB_buffer_storage;
+#endif
+        MSG(VERBOSE, "Persistently mapped PBOs %s\n", s->persistent_pbo ? "enabled" : "disabled");
+
+        if (s->upload_mode != state_gl::UPLOAD_INLINE) {
+                glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+                if ((s->upload.window = glfwCreateWindow(1, 1, "", nullptr, s->window)) == nullptr) {
+                        MSG(ERROR, "Cannot create shared context for upload thread!\n");
+                        return false;
+                }
+                for (int i = 0; i < UPLOAD_TEX_COUNT; ++i) {
+                        if (i == 0) {
+                                s->upload.slots[i].tex = s->texture_display;
+                        } else {
+                                glGenTextures(1, &s->upload.slots[i].tex);
+                                glBindTexture(GL_TEXTURE_2D, s->upload.slots[i].tex);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                        }
+                        s->upload.free_slots.push(i);
+                }
+        }
 
         s->vdp_interop = vdp_interop_supported();
+#ifdef HWACC_GL_DMABUF
+        s->dmabuf_import = state_dmabuf_import::supported();
+#endif
 
         glfwMakeContextCurrent(nullptr);
 
@@ -1780,10 +2375,24 @@ static void display_gl_cleanup_opengl(struct state_gl *s){
         for (auto &it : s->PHandles) {
                 glDeleteProgram(it.second);
         }
+        for (auto &slot : s->upload.slots) {
+                glDeleteSync(slot.draw_fence);
+                if (slot.tex != s->texture_display) { // texture_display is one of the slots
+                        glDeleteTextures(1, &slot.tex);
+                }
+        }
         glDeleteTextures(1, &s->texture_display);
         glDeleteTextures(1, &s->texture_raw);
+        glDeleteTextures(1, &s->texture_uv);
+#ifdef HWACC_GL_DMABUF
+        s->dmabuf.uninit();
+#endif
         glDeleteFramebuffersEXT(1, &s->fbo_id);
         glDeleteBuffersARB(1, &s->pbo_id);
+        gl_pbo_ring_destroy(s);
+        if (s->upload.window != nullptr) {
+                glfwDestroyWindow(s->upload.window);
+        }
         glfwDestroyWindow(s->window);
 
         if (s->syphon_spout) {
@@ -1800,11 +2409,23 @@ static void display_gl_run(void *arg)
         struct state_gl *s = 
                 (struct state_gl *) arg;
 
+        if (s->upload.window != nullptr) {
+                s->upload.worker = thread(gl_upload_thread, s);
+        }
         glfwMakeContextCurrent(s->window);
         while (!glfwWindowShouldClose(s->window)) {
                 glfwPollEvents();
                 gl_process_frames(s);
         }
+        if (s->upload.worker.joinable()) {
+                {
+                        lock_guard<mutex> lk(s->lock);
+                        s->upload.should_exit = true;
+                }
+                s->new_frame_ready_cv.notify_one();
+                s->upload.cv.notify_all();
+                s->upload.worker.join();
+        }
         glfwMakeContextCurrent(nullptr);
 }
 
@@ -1878,6 +2499,16 @@ static void upload_texture(struct state_gl *s, char *data)
                 s->vdp.loadFrame(reinterpret_cast<hw_vdpau_frame *>(data));
                 return;
         }
+#endif
+#ifdef HWACC_GL_DMABUF
+        if (s->current_display_desc.color_spec == DRM_PRIME) {
+                // texture_raw is bound to the active unit (2) by gl_render_glsl()
+                s->dmabuf.load_frame(reinterpret_cast<drm_prime_frame *>(data),
+                                     s->current_display_desc.width,
+                                     s->current_display_desc.height,
+                                     s->texture_raw, s->texture_uv);
+                return;
+        }
 #endif
         if (s->current_display_desc.color_spec == DXT1 || s->current_display_desc.color_spec == DXT1_YUV || s->current_display_desc.color_spec == DXT5) {
                 upload_compressed_texture(s, data);
@@ -1910,6 +2541,9 @@ static void upload_texture(struct state_gl *s, char *data)
                 }
                 DEBUG_TIMER_STOP(process_r10k);
         };
+        if (gl_pbo_upload(s, data, width, format, type)) {
+                return;
+        }
         int data_size = vc_get_linesize(s->current_display_desc.width, s->current_display_desc.color_spec) * s->current_display_desc.height;
         if (s->use_pbo) {
                 glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, s->pbo_id); // current pbo
@@ -1956,13 +2590,13 @@ static bool check_rpi_pbo_quirks()
 #endif
 }
 
-static void gl_render_glsl(struct state_gl *s, char *data)
+static void gl_render_glsl(struct state_gl *s, char *data, GLuint fbo, GLuint tex)
 {
         int status;
         glBindTexture(GL_TEXTURE_2D, 0);
-        glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, s->fbo_id);
+        glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
         gl_check_error();
-        glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, s->texture_display, 0);
+        glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, tex, 0);
         status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
         assert(status == GL_FRAMEBUFFER_COMPLETE_EXT);
         glActiveTexture(GL_TEXTURE0 + 2);
@@ -2005,7 +2639,7 @@ static void gl_render_glsl(struct state_gl *s, char *data)
         glUseProgram(0);
         glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
         glActiveTexture(GL_TEXTURE0 + 0);
-        glBindTexture(GL_TEXTURE_2D, s->texture_display);
+        glBindTexture(GL_TEXTURE_2D, tex);
 }    
 
 static void gl_draw(double ratio, double bottom_offset, bool double_buf)
@@ -2076,6 +2710,9 @@ display_gl_get_property(void *state, int property, void *val, size_t *len)
                         if (c == HW_VDPAU && !s->vdp_interop) {
                                 return false;
                         }
+                        if (c == DRM_PRIME && !s->dmabuf_import) {
+                                return false;
+                        }
                         return true;
                 };
                 const codec_t *endptr =
@@ -2125,6 +2762,14 @@ static void display_gl_done(void *state)
         }
 
         vf_free(s->current_frame);
+#ifdef HAVE_PERSISTENT_PBO
+        for (auto *f : s->pbo_free) {
+                vf_free(f);
+        }
+        for (auto *f : s->pbo_retired) {
+                vf_free(f);
+        }
+#endif
 
         delete s;
 }
@@ -2136,6 +2781,9 @@ static struct video_frame * display_gl_getf(void *state)
 
         lock_guard<mutex> lock(s->lock);
 
+        if (struct video_frame *buffer = gl_pbo_get_free_frame(s)) {
+                return buffer;
+        }
         while (s->free_frame_queue.size() > 0) {
                 struct video_frame *buffer = s->free_frame_queue.front();
                 s->free_frame_queue.pop();
@@ -2169,7 +2817,7 @@ static bool display_gl_putf(void *state, struct video_frame *frame, long long ti
         switch (timeout_ns) {
                 case PUTF_DISCARD:
                         vf_recycle(frame);
-                        s->free_frame_queue.push(frame);
+                        gl_put_free_frame(s, frame);
                         return 0;
                 case PUTF_BLOCKING:
                         s->frame_consumed_cv.wait(lk, [s]{return s->frame_queue.size() < MAX_BUFFER_SIZE;});
@@ -2183,7 +2831,7 @@ static bool display_gl_putf(void *state, struct video_frame *frame, long long ti
         if (s->frame_queue.size() >= MAX_BUFFER_SIZE) {
                 LOG(LOG_LEVEL_INFO) << MOD_NAME << "1 frame(s) dropped!\n";
                 vf_recycle(frame);
-                s->free_frame_queue.push(frame);
+                gl_put_free_frame(s, frame);
                 return false;
         }
         s->frame_queue.push(frame);
@@ -0,0 +1,188 @@
+/**
+ * @file   video_display/gl_dmabuf.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // defined HAVE_CONFIG_H
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <cinttypes>
+#include <cstring>
+#include <poll.h>
+
+#include "debug.h"
+#include "gl_dmabuf.hpp"
+#include "hwaccel_drm.h"
+
+#define MOD_NAME "[GL dmabuf] "
+
+#define DRM_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | \
+                ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+#define DRM_FORMAT_R8     DRM_FOURCC('R', '8', ' ', ' ')
+#define DRM_FORMAT_R16    DRM_FOURCC('R', '1', '6', ' ')
+#define DRM_FORMAT_GR88   DRM_FOURCC('G', 'R', '8', '8')
+#define DRM_FORMAT_GR1616 DRM_FOURCC('G', 'R', '3', '2')
+#define DRM_FORMAT_NV12   DRM_FOURCC('N', 'V', '1', '2')
+#define DRM_FORMAT_P010   DRM_FOURCC('P', '0', '1', '0')
+#define DRM_FORMAT_MOD_INVALID 0x00ffffffffffffffULL
+
+#define FENCE_TIMEOUT_MS 100
+
+bool state_dmabuf_import::supported()
+{
+        EGLDisplay dpy = eglGetCurrentDisplay();
+        if (dpy == EGL_NO_DISPLAY || eglGetCurrentContext() == EGL_NO_CONTEXT) {
+                MSG(VERBOSE, "Not an EGL context, DRM PRIME import disabled.\n");
+                return false;
+        }
+        const char *egl_ext = eglQueryString(dpy, EGL_EXTENSIONS);
+        const char *gl_ext = (const char *) glGetString(GL_EXTENSIONS);
+        if (egl_ext == nullptr || strstr(egl_ext, "EGL_EXT_image_dma_buf_import") == nullptr ||
+                        gl_ext == nullptr || strstr(gl_ext, "GL_OES_EGL_image") == nullptr) {
+                MSG(VERBOSE, "EGL_EXT_image_dma_buf_import or GL_OES_EGL_image not supported.\n");
+                return false;
+        }
+        return true;
+}
+
+bool state_dmabuf_import::init()
+{
+        dpy = eglGetCurrentDisplay();
+        create_image = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
+        destroy_image = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
+        image_target_texture = (void (*)(GLenum, void *)) eglGetProcAddress("glEGLImageTargetTexture2DOES");
+        if (dpy == EGL_NO_DISPLAY || create_image == nullptr || destroy_image == nullptr ||
+                        image_target_texture == nullptr) {
+                MSG(ERROR, "Cannot get EGL image functions!\n");
+                return false;
+        }
+        const char *egl_ext = eglQueryString(dpy, EGL_EXTENSIONS);
+        has_modifiers = strstr(egl_ext, "EGL_EXT_image_dma_buf_import_modifiers") != nullptr;
+        return true;
+}
+
+void state_dmabuf_import::destroy_images()
+{
+        for (auto &img : images) {
+                if (img != EGL_NO_IMAGE_KHR) {
+                        destroy_image(dpy, img);
+                        img = EGL_NO_IMAGE_KHR;
+                }
+        }
+}
+
+void state_dmabuf_import::uninit()
+{
+        if (destroy_image != nullptr) {
+                destroy_images();
+        }
+}
+
+bool state_dmabuf_import::load_frame(const struct drm_prime_frame *frame, int width, int height,
+                GLuint tex_y, GLuint tex_uv)
+{
+        uint32_t plane_formats[2];
+        if (frame->drm_format == DRM_FORMAT_NV12) {
+                plane_formats[0] = DRM_FORMAT_R8;
+                plane_formats[1] = DRM_FORMAT_GR88;
+        } else if (frame->drm_format == DRM_FORMAT_P010) {
+                plane_formats[0] = DRM_FORMAT_R16;
+                plane_formats[1] = DRM_FORMAT_GR1616;
+        } else {
+                if (frame->drm_format != last_unsupported_format) {
+                        MSG(ERROR, "Unsupported DRM format 0x%08" PRIx32 " (NV12 and P010 are supported)!\n",
+                                        frame->drm_format);
+                        last_unsupported_format = frame->drm_format;
+                }
+                return false;
+        }
+        if (frame->planes != 2) {
+                MSG(ERROR, "Expected 2 planes, got %d!\n", frame->planes);
+                return false;
+        }
+
+        if (frame->in_fence_fd >= 0) { // producer still writing to the buffer (explicit sync)
+                struct pollfd pfd = { frame->in_fence_fd, POLLIN, 0 };
+                if (poll(&pfd, 1, FENCE_TIMEOUT_MS) != 1) {
+                        MSG(WARNING, "Timeout waiting for the buffer fence!\n");
+                }
+        }
+
+        destroy_images(); // previous frame was already rendered
+        for (int p = 0; p < 2; ++p) {
+                EGLint attrs[32];
+                int i = 0;
+                attrs[i++] = EGL_WIDTH;
+                attrs[i++] = p == 0 ? width : (width + 1) / 2;
+                attrs[i++] = EGL_HEIGHT;
+                attrs[i++] = p == 0 ? height : (height + 1) / 2;
+                attrs[i++] = EGL_LINUX_DRM_FOURCC_EXT;
+                attrs[i++] = (EGLint) plane_formats[p];
+                attrs[i++] = EGL_DMA_BUF_PLANE0_FD_EXT;
+                attrs[i++] = frame->dmabuf_fds[frame->fd_indices[p]];
+                attrs[i++] = EGL_DMA_BUF_PLANE0_OFFSET_EXT;
+                attrs[i++] = (EGLint) frame->offsets[p];
+                attrs[i++] = EGL_DMA_BUF_PLANE0_PITCH_EXT;
+                attrs[i++] = (EGLint) frame->pitches[p];
+                if (has_modifiers && frame->modifiers[p] != DRM_FORMAT_MOD_INVALID) {
+                        attrs[i++] = EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT;
+                        attrs[i++] = (EGLint) (frame->modifiers[p] & 0xFFFFFFFFU);
+                        attrs[i++] = EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT;
+                        attrs[i++] = (EGLint) (frame->modifiers[p] >> 32U);
+                }
+                attrs[i++] = EGL_NONE;
+                images[p] = create_image(dpy, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, nullptr, attrs);
+                if (images[p] == EGL_NO_IMAGE_KHR) {
+                        MSG(ERROR, "Cannot import plane %d: EGL error 0x%x\n", p, eglGetError());
+                        destroy_images();
+                        return false;
+                }
+        }
+
+        GLint unit = GL_TEXTURE0;
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &unit);
+        glActiveTexture(unit + 1);
+        glBindTexture(GL_TEXTURE_2D, tex_uv);
+        image_target_texture(GL_TEXTURE_2D, images[1]);
+        glActiveTexture(unit);
+        glBindTexture(GL_TEXTURE_2D, tex_y);
+        image_target_texture(GL_TEXTURE_2D, images[0]);
+        return true;
+}
+
+/* vim: set expandtab sw=8: */
@@ -0,0 +1,81 @@
+/**
+ * @file   video_display/gl_dmabuf.hpp
+ *
+ * Zero-copy import of DRM_PRIME frames (dmabufs exported eg. by VAAPI
+ * decoder or V4L2/PipeWire capture) to GL textures with
+ * EGL_EXT_image_dma_buf_import. Requires the GL context to be created
+ * with EGL (default on Wayland, with X11 use the "egl" option of GL display).
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GL_DMABUF_HPP_4B7E2A91_D03C_4F5E_8A16_93C5E0B7D248
+#define GL_DMABUF_HPP_4B7E2A91_D03C_4F5E_8A16_93C5E0B7D248
+
+#ifdef HWACC_GL_DMABUF
+
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+struct drm_prime_frame;
+
+struct state_dmabuf_import {
+        /// @returns true if the current GL context is EGL and supports the import
+        static bool supported();
+
+        bool init();
+        void uninit();
+        /**
+         * Imports the luma and chroma planes of a NV12/P010 frame as textures
+         * tex_y (R, bound to the active texture unit) and tex_uv (RG, bound to
+         * the next unit). The images are kept until next call (or uninit()),
+         * the frame itself needs to live only until rendered.
+         */
+        bool load_frame(const struct drm_prime_frame *frame, int width, int height,
+                        GLuint tex_y, GLuint tex_uv);
+
+private:
+        void destroy_images();
+
+        EGLDisplay dpy = EGL_NO_DISPLAY;
+        PFNEGLCREATEIMAGEKHRPROC create_image = nullptr;
+        PFNEGLDESTROYIMAGEKHRPROC destroy_image = nullptr;
+        void (*image_target_texture)(GLenum target, void *image) = nullptr; ///< glEGLImageTargetTexture2DOES
+        bool has_modifiers = false;
+        EGLImageKHR images[2] = { EGL_NO_IMAGE_KHR, EGL_NO_IMAGE_KHR };
+        uint32_t last_unsupported_format = 0;
+};
+
+#endif // defined HWACC_GL_DMABUF
+#endif // defined GL_DMABUF_HPP_4B7E2A91_D03C_4F5E_8A16_93C5E0B7D248
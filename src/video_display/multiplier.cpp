@@ -44,8 +44,11 @@
 #include "lib_common.h"
 #include "video.h"
 #include "video_display.h"
+#include "video_frame.h"
+#include "utils/stream_copy.h"
 #include "utils/string_view_utils.hpp"
 
+#include <atomic>
 #include <condition_variable>
 #include <vector>
 #include <memory>
@@ -62,10 +65,51 @@ static constexpr int SKIP_FIRST_N_FRAMES_IN_STREAM = 5;
 namespace{
 struct disp_deleter{ void operator()(display *d){ display_done(d); } };
 using unique_disp = std::unique_ptr<struct display, disp_deleter>;
+
+/**
+ * Frame shared by the displays accepting foreign frames
+ * (DISPLAY_PROPERTY_ACCEPTS_FOREIGN_FRAMES). Each display gets a view
+ * referencing the data, the frame is freed when the last view is.
+ */
+struct shared_frame {
+        std::atomic<int> refs{1};
+        struct video_frame *frame;
+};
+
+void shared_frame_unref(shared_frame *sf) {
+        if (sf->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                vf_free(sf->frame);
+                delete sf;
+        }
+}
+
+void shared_frame_view_deleter(struct video_frame *view) {
+        shared_frame_unref(static_cast<shared_frame *>(view->callbacks.dispose_udata));
+}
+
+struct video_frame *shared_frame_get_view(shared_frame *sf) {
+        struct video_frame *view = vf_alloc_desc(video_desc_from_frame(sf->frame));
+        vf_copy_metadata(view, sf->frame);
+        for (unsigned i = 0; i < view->tile_count; ++i) {
+                view->tiles[i].data = sf->frame->tiles[i].data;
+                view->tiles[i].data_len = sf->frame->tiles[i].data_len;
+        }
+        sf->refs.fetch_add(1, std::memory_order_relaxed);
+        view->callbacks.data_deleter = shared_frame_view_deleter;
+        view->callbacks.dispose_udata = sf;
+        return view;
+}
+
+bool display_accepts_foreign_frames(struct display *d) {
+        bool val = false;
+        size_t len = sizeof val;
+        return display_ctl_property(d, DISPLAY_PROPERTY_ACCEPTS_FOREIGN_FRAMES, &val, &len) && val;
+}
 }
 
 struct state_multiplier {
         std::vector<unique_disp> displays;
+        std::vector<bool> accepts_foreign_frames; ///< indexed as displays, updated on reconf
 
         struct video_desc desc;
 
@@ -132,8 +176,10 @@ static void check_reconf(struct state_multiplier *s, struct video_desc *current_
         }
         *current_desc = desc;
         fprintf(stderr, "RECONFIGURED\n");
+        s->accepts_foreign_frames.clear();
         for (auto &disp : s->displays) {
                 display_reconfigure(disp.get(), desc, VIDEO_NORMAL);
+                s->accepts_foreign_frames.push_back(display_accepts_foreign_frames(disp.get()));
         }
 }
 
@@ -168,13 +214,20 @@ static void display_multiplier_worker(void *state)
 
                 check_reconf(s, &display_desc, video_desc_from_frame(frame));
 
-                for (auto& disp : s->displays) {
-                        struct video_frame *real_display_frame = display_get_frame(disp.get());
-                        memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
-                        display_put_frame(disp.get(), real_display_frame, PUTF_BLOCKING);
+                auto *sf = new shared_frame;
+                sf->frame = frame;
+                for (size_t i = 0; i < s->displays.size(); ++i) {
+                        struct display *disp = s->displays[i].get();
+                        if (s->accepts_foreign_frames[i]) {
+                                display_put_frame(disp, shared_frame_get_view(sf), PUTF_BLOCKING);
+                                continue;
+                        }
+                        struct video_frame *real_display_frame = display_get_frame(disp);
+                        ug_stream_copy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
+                        display_put_frame(disp, real_display_frame, PUTF_BLOCKING);
                 }
 
-                vf_free(frame);
+                shared_frame_unref(sf);
         }
 }
 
@@ -247,6 +300,15 @@ static bool display_multiplier_get_property(void *state, int property, void *val
 {
         auto *s = (state_multiplier *) state;
 
+        if (property == DISPLAY_PROPERTY_ACCEPTS_FOREIGN_FRAMES) { // frames are just read by the worker
+                if (*len < sizeof(bool)) {
+                        return false;
+                }
+                *(bool *) val = true;
+                *len = sizeof(bool);
+                return true;
+        }
+
         //TODO Find common properties, for now just return properties of the first display
         return display_ctl_property(s->displays[0].get(), property, val, len);
 }
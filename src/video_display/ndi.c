@@ -59,6 +59,7 @@
 #include "utils/color_out.h"
 #include "utils/macros.h" // OPTIMIZED_FOR
 #include "utils/misc.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_display.h"
 
@@ -78,10 +79,14 @@ struct display_ndi {
         char *video_metadata;
         struct video_desc desc;
         struct audio_desc audio_desc;
+        void *pool; ///< frames passed to the decoder, sent without copying
         struct video_frame *send_frame; ///< frame that is just being asynchronously sent
 
         ndi_disp_convert_t *convert;
-        char *convert_buffer; ///< for codecs that need conversion (eg. Y216->P216)
+        /// for codecs that need conversion (eg. Y216->P216), one may be
+        /// being sent while converting to the other
+        char *convert_buffer[2];
+        int convert_buffer_idx;
 };
 
 static void display_ndi_probe(struct device_info **available_cards, int *count, void (**deleter)(void *))
@@ -107,13 +112,29 @@ static const struct {
         { Y416, NDIlib_FourCC_type_PA16, ndi_disp_convert_Y416_to_PA16 },
 };
 
+/**
+ * Waits until the SDK releases the frame passed to the last async send
+ * and returns it to the pool.
+ */
+static void ndi_disp_flush(struct display_ndi *s)
+{
+        s->NDIlib->send_send_video_v2(s->pNDI_send, NULL);
+        VIDEO_FRAME_DISPOSE(s->send_frame);
+        s->send_frame = NULL;
+}
+
 static bool display_ndi_reconfigure(void *state, struct video_desc desc)
 {
         struct display_ndi *s = (struct display_ndi *) state;
 
+        ndi_disp_flush(s);
         s->desc = desc;
-        free(s->convert_buffer);
-        s->convert_buffer = malloc(MAX_BPS * desc.width * desc.height + MAX_PADDING);
+        video_frame_pool_reconfigure(s->pool, desc, vc_get_datalen(desc.width, desc.height, desc.color_spec));
+        for (int i = 0; i < 2; ++i) {
+                free(s->convert_buffer[i]);
+                s->convert_buffer[i] = NULL;
+        }
+        s->convert = NULL;
 
         s->NDI_video_frame.xres = s->desc.width;
         s->NDI_video_frame.yres = s->desc.height;
@@ -124,6 +145,11 @@ static bool display_ndi_reconfigure(void *state, struct video_desc desc)
                 }
         }
         assert(s->NDI_video_frame.FourCC != 0);
+        if (s->convert != NULL) {
+                for (int i = 0; i < 2; ++i) {
+                        s->convert_buffer[i] = malloc(MAX_BPS * desc.width * desc.height + MAX_PADDING);
+                }
+        }
         s->NDI_video_frame.frame_rate_N = get_framerate_n(desc.fps);
         s->NDI_video_frame.frame_rate_D = get_framerate_d(desc.fps);
         s->NDI_video_frame.frame_format_type = desc.interlacing == PROGRESSIVE ? NDIlib_frame_format_type_progressive : NDIlib_frame_format_type_interleaved;
@@ -250,6 +276,7 @@ static void *display_ndi_init(struct module *parent, const char *fmt, unsigned i
         }
 
         s->NDI_video_frame.p_metadata = s->video_metadata = ndi_disp_format_video_metadata();
+        s->pool = video_frame_pool_init((struct video_desc){ 0 }, 0);
 
         return s;
 }
@@ -258,11 +285,14 @@ static void display_ndi_done(void *state)
 {
         struct display_ndi *s = (struct display_ndi *) state;
 
+        ndi_disp_flush(s);
         s->NDIlib->send_destroy(s->pNDI_send);
-        free(s->convert_buffer);
+        for (int i = 0; i < 2; ++i) {
+                free(s->convert_buffer[i]);
+        }
         s->NDIlib->destroy();
         close_ndi_library(s->lib);
-        vf_free(s->send_frame);
+        video_frame_pool_destroy(s->pool);
         free(s->video_metadata);
         free(s);
 }
@@ -271,7 +301,7 @@ static struct video_frame *display_ndi_getf(void *state)
 {
         struct display_ndi *s = (struct display_ndi *) state;
 
-        return vf_alloc_desc_data(s->desc);
+        return video_frame_pool_get_disposable_frame(s->pool);
 }
 
 static void ndi_disp_convert_Y216_to_P216(const struct video_frame *f, char *out)
@@ -318,6 +348,9 @@ static void ndi_disp_convert_Y416_to_PA16(const struct video_frame *f, char *out
 
 /**
  * flag = PUTF_NONBLOCK is not implemented
+ *
+ * The frame (or the converted buffer) is passed to the NDI async send
+ * without copying, the call doesn't wait for the previous frame to be sent.
  */
 static bool display_ndi_putf(void *state, struct video_frame *frame, long long flag)
 {
@@ -328,24 +361,27 @@ static bool display_ndi_putf(void *state, struct video_frame *frame, long long f
         }
 
         if (flag == PUTF_DISCARD) {
-                vf_free(frame);
+                VIDEO_FRAME_DISPOSE(frame);
                 return true;
         }
 
-        s->NDIlib->send_send_video_v2(s->pNDI_send, NULL); // wait for the async frame to be processed
-        vf_free(s->send_frame);
-        s->send_frame = NULL;
-
+        struct video_frame *to_send = NULL;
         if (s->convert != NULL) {
-                s->convert(frame, s->convert_buffer);
-                s->NDI_video_frame.p_data = (uint8_t *) s->convert_buffer;
-                vf_free(frame);
+                char *out = s->convert_buffer[s->convert_buffer_idx];
+                s->convert_buffer_idx ^= 1;
+                s->convert(frame, out);
+                s->NDI_video_frame.p_data = (uint8_t *) out;
+                VIDEO_FRAME_DISPOSE(frame);
         } else {
                 s->NDI_video_frame.p_data = (uint8_t *) frame->tiles[0].data;
-                s->send_frame = frame;
+                to_send = frame;
         }
 
+        // the SDK holds the buffer until the next send call returns, so
+        // the previous frame can be released only now
         s->NDIlib->send_send_video_async_v2(s->pNDI_send, &s->NDI_video_frame);
+        VIDEO_FRAME_DISPOSE(s->send_frame);
+        s->send_frame = to_send;
 
         return true;
 }
@@ -273,8 +273,10 @@ void Texture::load_frame(int w, int h,
                 GlBuffer *pbo = static_cast<GlBuffer *>(f->callbacks.dispose_udata);
 
                 glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->get());
-                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-                f->tiles[0].data = nullptr;
+                if(!pbo->is_persistent()){
+                        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                        f->tiles[0].data = nullptr;
+                }
                 src_data = nullptr;
         }
 
@@ -303,6 +305,29 @@ void Texture::allocate(){
 }
 
 
+void *GlBuffer::map_persistent(GLenum target, GLsizeiptr size){
+#ifdef __APPLE__
+        (void) target, (void) size;
+        return nullptr;
+#else
+        if(!GLEW_ARB_buffer_storage || persistent)
+                return nullptr;
+
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, size, nullptr, flags);
+        void *ptr = glMapBufferRange(target, 0, size, flags);
+        if(!ptr){
+                // immutable storage cannot be reallocated, start over
+                glDeleteBuffers(1, &buf_id);
+                glGenBuffers(1, &buf_id);
+                glBindBuffer(target, buf_id);
+                return nullptr;
+        }
+        persistent = true;
+        return ptr;
+#endif
+}
+
 void Framebuffer::attach_texture(GLuint tex){
         glBindTexture(GL_TEXTURE_2D, tex);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
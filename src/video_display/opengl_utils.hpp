@@ -275,6 +275,21 @@ public:
                 return buf_id;
         }
 
+        /**
+         * Allocates immutable storage and maps it persistently for writing
+         * (GL_ARB_buffer_storage). The mapping stays valid while the buffer is
+         * used as a source of GL commands, until the buffer is destroyed.
+         *
+         * @param target target the buffer is bound to
+         * @returns mapped memory or nullptr on failure
+         */
+        void *map_persistent(GLenum target, GLsizeiptr size);
+
+        /**
+         * Returns true if the buffer was mapped by map_persistent()
+         */
+        bool is_persistent() const { return persistent; }
+
         GlBuffer(const GlBuffer&) = delete;
         GlBuffer(GlBuffer&& o) { swap(o); }
         GlBuffer& operator=(const GlBuffer&) = delete;
@@ -283,9 +298,11 @@ public:
 private:
         void swap(GlBuffer& o){
                 std::swap(buf_id, o.buf_id);
+                std::swap(persistent, o.persistent);
         }
 
         GLuint buf_id = 0;
+        bool persistent = false;
 };
 
 class Frame_convertor{
@@ -73,7 +73,6 @@
 #include "module.h"
 #include "video.h"
 #include "video_display.h"
-#include "video_display/splashscreen.h"
 
 #include "opengl_utils.hpp"
 #include "opengl_panorama.hpp"
@@ -408,6 +407,8 @@ struct state_xrgl{
         std::condition_variable free_frame_ready_cv;
 
         std::vector<video_frame *> dispose_frame_pool;
+
+        bool persistent_pbo = false; ///< decoder writes to persistently mapped PBOs
 };
 
 static std::vector<XrViewConfigurationView> get_views(Openxr_state& xr_state){
@@ -513,6 +514,10 @@ static void recycle_frame(video_frame *f){
         if(!pbo){
                 return;
         }
+        if(pbo->is_persistent()){
+                // stays mapped, upload already finished in PanoramaScene::put_frame()
+                return;
+        }
         glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->get());
         if(f->tiles[0].data){
                 glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
@@ -522,18 +527,18 @@ static void recycle_frame(video_frame *f){
 
 static void delete_frame(video_frame *f){
         GlBuffer *pbo = static_cast<GlBuffer *>(f->callbacks.dispose_udata);
-        vf_free(f);
 
-        if(!pbo){
-                return;
-        }
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->get());
-        if(f->tiles[0].data){
-                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        if(pbo){
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->get());
+                if(f->tiles[0].data && !pbo->is_persistent()){
+                        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                }
+
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                delete pbo; // persistent mapping is released with the buffer
         }
-         
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-        delete pbo;
+        f->tiles[0].data = nullptr;
+        vf_free(f);
 }
 
 static video_frame *allocate_frame(state_xrgl *s){
@@ -542,6 +547,17 @@ static video_frame *allocate_frame(state_xrgl *s){
         buffer->callbacks.dispose_udata = pbo;
         glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->get());
 
+        if(s->persistent_pbo){
+                buffer->tiles[0].data = static_cast<char *>(
+                                pbo->map_persistent(GL_PIXEL_UNPACK_BUFFER, buffer->tiles[0].data_len));
+                if(buffer->tiles[0].data){
+                        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                        return buffer;
+                }
+                log_msg(LOG_LEVEL_WARNING, "Cannot map persistent PBO, using regular buffers.\n");
+                s->persistent_pbo = false;
+        }
+
         map_new_buffer(buffer);
 
         return buffer;
@@ -551,6 +567,7 @@ static void worker(state_xrgl *s){
         PROFILE_FUNC;
         s->window.make_worker_context_current();
         std::unique_lock<std::mutex> lk(s->lock);
+        s->persistent_pbo = GLEW_ARB_buffer_storage;
         for(size_t i = 0; i < MAX_BUFFER_SIZE; i++){
                 video_frame *buf = vf_alloc(1);
                 GlBuffer *pbo = new GlBuffer();
@@ -589,6 +606,13 @@ static void worker(state_xrgl *s){
                         PROFILE_DETAIL("put_frame");
                         video_frame *frame = s->frame_queue.front();
                         s->frame_queue.pop();
+                        // upload only the newest frame, the older would be
+                        // replaced before the render loop could show them
+                        while(frame && !s->frame_queue.empty()){
+                                s->dispose_frame_pool.push_back(frame);
+                                frame = s->frame_queue.front();
+                                s->frame_queue.pop();
+                        }
                         lk.unlock();
                         if(!frame){
                                 SDL_Event event;
@@ -680,6 +704,7 @@ static void display_xrgl_run(void *state){
         projection_layer.views = projection_views.data();
 
         std::vector<XrView> views(view_count);
+        std::vector<uint32_t> buf_idxs(view_count);
 
         for(auto& view : views){
                 view.type = XR_TYPE_VIEW;
@@ -796,44 +821,6 @@ static void display_xrgl_run(void *state){
 
                 }
 
-                XrViewLocateInfo view_locate_info;
-                view_locate_info.type = XR_TYPE_VIEW_LOCATE_INFO;
-                view_locate_info.displayTime = frame_state.predictedDisplayTime;
-                view_locate_info.viewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO; //Assuming stereo view exists. TODO: do it properly and enumerate types first
-                view_locate_info.space = space.get();
-
-                XrViewState view_state;
-                view_state.type = XR_TYPE_VIEW_STATE;
-                view_state.next = nullptr;
-
-                uint32_t located_views = 0;
-                result = xrLocateViews(session.get(),
-                                &view_locate_info,
-                                &view_state,
-                                view_count,
-                                &located_views,
-                                views.data());
-
-                if (!XR_SUCCEEDED(result)){
-                        log_msg(LOG_LEVEL_ERROR, "Failed to locate views!\n");
-                        break;
-                }
-
-                /*
-                   printf("View: %f %f %f %f, %f %f %f, fov = %f %f %f %f\n",
-                   views[1].pose.orientation.x,
-                   views[1].pose.orientation.y,
-                   views[1].pose.orientation.z,
-                   views[1].pose.orientation.w,
-                   views[1].pose.position.x,
-                   views[1].pose.position.y,
-                   views[1].pose.position.z,
-                   views[1].fov.angleLeft,
-                   views[1].fov.angleRight,
-                   views[1].fov.angleUp,
-                   views[1].fov.angleDown);
-                   */
-
                 XrFrameBeginInfo frame_begin_info;
                 frame_begin_info.type = XR_TYPE_FRAME_BEGIN_INFO;
                 frame_begin_info.next = nullptr;
@@ -845,8 +832,15 @@ static void display_xrgl_run(void *state){
                         break;
                 }
 
-                for(unsigned i = 0; i < view_count; i++){
-                        PROFILE_DETAIL("render view");
+                /* Acquire all swapchain images first - waiting for them may
+                 * block, so the views are located (late-latched) only
+                 * afterwards, right before the rendering. The compositor then
+                 * reprojects the layer from exactly the pose it was rendered
+                 * with. */
+                bool should_render = frame_state.shouldRender;
+                unsigned acquired_count = 0;
+                for(unsigned i = 0; i < view_count && should_render; i++){
+                        PROFILE_DETAIL("acquire swapchain");
 
                         XrSwapchainImageAcquireInfo swapchain_image_acquire_info;
                         swapchain_image_acquire_info.type = XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO;
@@ -860,8 +854,10 @@ static void display_xrgl_run(void *state){
 
                         if(!XR_SUCCEEDED(result)){
                                 log_msg(LOG_LEVEL_ERROR, "Failed to acquire swapchain image!\n");
+                                should_render = false;
                                 break;
                         }
+                        acquired_count = i + 1;
 
                         XrSwapchainImageWaitInfo swapchain_image_wait_info;
                         swapchain_image_wait_info.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO;
@@ -871,8 +867,49 @@ static void display_xrgl_run(void *state){
                         result = xrWaitSwapchainImage(swapchains[i].get(), &swapchain_image_wait_info);
                         if(!XR_SUCCEEDED(result)){
                                 log_msg(LOG_LEVEL_ERROR, "failed to wait for swapchain image!\n");
+                                should_render = false;
+                                break;
+                        }
+
+                        buf_idxs[i] = buf_idx;
+                }
+                if(!should_render){
+                        for(unsigned i = 0; i < acquired_count; i++){
+                                XrSwapchainImageReleaseInfo release_info{};
+                                release_info.type = XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO;
+                                xrReleaseSwapchainImage(swapchains[i].get(), &release_info);
+                        }
+                }
+
+                if(should_render){
+                        PROFILE_DETAIL("locate views");
+                        XrViewLocateInfo view_locate_info;
+                        view_locate_info.type = XR_TYPE_VIEW_LOCATE_INFO;
+                        view_locate_info.displayTime = frame_state.predictedDisplayTime;
+                        view_locate_info.viewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO; //Assuming stereo view exists. TODO: do it properly and enumerate types first
+                        view_locate_info.space = space.get();
+
+                        XrViewState view_state;
+                        view_state.type = XR_TYPE_VIEW_STATE;
+                        view_state.next = nullptr;
+
+                        uint32_t located_views = 0;
+                        result = xrLocateViews(session.get(),
+                                        &view_locate_info,
+                                        &view_state,
+                                        view_count,
+                                        &located_views,
+                                        views.data());
+
+                        if (!XR_SUCCEEDED(result)){
+                                log_msg(LOG_LEVEL_ERROR, "Failed to locate views!\n");
                                 break;
                         }
+                }
+
+                for(unsigned i = 0; i < view_count && should_render; i++){
+                        PROFILE_DETAIL("render view");
+                        uint32_t buf_idx = buf_idxs[i];
 
                         projection_views[i].pose = views[i].pose;
                         projection_views[i].fov = views[i].fov;
@@ -957,7 +994,7 @@ static void display_xrgl_run(void *state){
                 XrFrameEndInfo frame_end_info;
                 frame_end_info.type = XR_TYPE_FRAME_END_INFO;
                 frame_end_info.displayTime = frame_state.predictedDisplayTime;
-                frame_end_info.layerCount = 1;
+                frame_end_info.layerCount = should_render ? 1 : 0;
                 frame_end_info.layers = &composition_layers;
                 frame_end_info.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE;
                 frame_end_info.next = nullptr;
@@ -54,7 +54,6 @@
 #include "module.h"
 #include "video.h"
 #include "video_display.h"
-#include "video_display/splashscreen.h"
 
 #include "opengl_utils.hpp"
 #include "opengl_panorama.hpp"
@@ -56,8 +56,10 @@
 #include "lib_common.h"
 #include "messaging.h"
 #include "module.h"
+#include "tv.h"
 #include "utils/color_out.h"
 #include "utils/list.h"
+#include "utils/macros.h"
 #include "video_display.h"
 #include "video.h"
 
@@ -74,13 +76,15 @@
 
 #define SDL2_DEINTERLACE_IMPOSSIBLE_MSG_ID 0x327058e5
 #define MAGIC_SDL2   0x3cc234a1
-#define BUFFER_COUNT   2
+#define DEFAULT_BUFFER_COUNT 3 ///< decoded frame, frame being rendered + 1 queued
+#define MIN_BUFFER_COUNT 2
+#define DROP_REPORT_INTERVAL_NS (5 * NS_IN_SEC)
 #define MOD_NAME "[SDL] "
 
 struct state_sdl2;
 
 static void show_help(void);
-static void display_frame(struct state_sdl2 *s, struct video_frame *frame);
+static void display_frame(struct state_sdl2 *s, struct video_frame *frame, bool redraw);
 static struct video_frame *display_sdl2_getf(void *state);
 static void display_sdl2_new_message(struct module *mod);
 static int display_sdl2_reconfigure_real(void *state, struct video_desc desc);
@@ -122,7 +126,12 @@ struct state_sdl2 {
         struct video_frame     *last_frame;
 
         struct simple_linked_list *free_frame_queue;
+        int                     buffer_count; ///< number of streaming textures
 
+        // drop statistics (protected by lock)
+        int                     dropped_late; ///< skipped by renderer - newer frame already queued
+        int                     dropped_full; ///< no free texture in putf
+        time_ns_t               drop_report_t0;
 };
 
 static const char *deint_to_string(enum deint val) {
@@ -145,7 +154,47 @@ static const struct {
 
 #define SDL_CHECK(cmd) do { int ret = cmd; if (ret < 0) { log_msg(LOG_LEVEL_ERROR, MOD_NAME "Error (%s): %s\n", #cmd, SDL_GetError());} } while(0)
 
-static void display_frame(struct state_sdl2 *s, struct video_frame *frame)
+/// @note to be called with lock held
+static void report_drops(struct state_sdl2 *s)
+{
+        const time_ns_t now = get_time_in_ns();
+        if (now - s->drop_report_t0 < DROP_REPORT_INTERVAL_NS) {
+                return;
+        }
+        if (s->dropped_late + s->dropped_full > 0) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "%d frame(s) dropped in last %g s (%d late, %d no free buffer)\n",
+                                s->dropped_late + s->dropped_full, (double) (now - s->drop_report_t0) / NS_IN_SEC_DBL,
+                                s->dropped_late, s->dropped_full);
+        }
+        s->dropped_late = s->dropped_full = 0;
+        s->drop_report_t0 = now;
+}
+
+/**
+ * Returns the frame to the free queue without rendering if a newer frame
+ * is already waiting in the event queue (the rendering thread is late).
+ */
+static bool drop_if_late(struct state_sdl2 *s, struct video_frame *frame)
+{
+        SDL_Event next;
+        if (SDL_PeepEvents(&next, 1, SDL_PEEKEVENT, s->sdl_user_new_frame_event, s->sdl_user_new_frame_event) != 1 ||
+                        next.user.data1 == NULL) {
+                return false;
+        }
+        pthread_mutex_lock(&s->lock);
+        simple_linked_list_append(s->free_frame_queue, frame);
+        s->dropped_late += 1;
+        report_drops(s);
+        pthread_mutex_unlock(&s->lock);
+        pthread_cond_signal(&s->frame_consumed_cv);
+        return true;
+}
+
+/**
+ * @param redraw only redraw the frame (s->last_frame) after window change,
+ *               the frame is already in the free queue
+ */
+static void display_frame(struct state_sdl2 *s, struct video_frame *frame, bool redraw)
 {
         if (!frame) {
                 return;
@@ -168,7 +217,7 @@ static void display_frame(struct state_sdl2 *s, struct video_frame *frame)
         SDL_CHECK(SDL_LockTexture(texture, NULL, (void **) &frame->tiles[0].data, &pitch));
         assert(pitch == s->texture_pitch);
 
-        if (frame == s->last_frame) {
+        if (redraw) {
                 return; // we are only redrawing on window resize
         }
 
@@ -262,7 +311,10 @@ static void display_sdl2_run(void *arg)
                         if (sdl_event.user.data1 == NULL) { // poison pill received
                                 break;
                         }
-                        display_frame(s, (struct video_frame *) sdl_event.user.data1);
+                        struct video_frame *frame = sdl_event.user.data1;
+                        if (!drop_if_late(s, frame)) {
+                                display_frame(s, frame, false);
+                        }
                 } else if (sdl_event.type == s->sdl_user_new_message_event) {
                         struct msg_universal *msg;
                         while ((msg = (struct msg_universal *) check_message(&s->mod))) {
@@ -307,9 +359,9 @@ static void display_sdl2_run(void *arg)
                                         || sdl_event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
                                 // clear both buffers
                                 SDL_RenderClear(s->renderer);
-                                display_frame(s, s->last_frame);
+                                display_frame(s, s->last_frame, true);
                                 SDL_RenderClear(s->renderer);
-                                display_frame(s, s->last_frame);
+                                display_frame(s, s->last_frame, true);
                         }
                 } else if (sdl_event.type == SDL_QUIT) {
                         exit_uv(0);
@@ -338,7 +390,7 @@ static void show_help(void)
         color_printf(TBOLD(
             TRED("\t-d sdl") "[[:fs|:d|:display=<didx>|:driver=<drv>|:novsync|:"
                              "renderer=<ridx>|:nodecorate|:size[=WxH]|:window_"
-                             "flags=<f>|:keep-aspect]*|:help]") "\n");
+                             "flags=<f>|:keep-aspect|:buffers=<n>]*|:help]") "\n");
         printf("where:\n");
         color_printf(TBOLD("\td[force]") " - deinterlace (force even for progresive video)\n");
         color_printf(TBOLD("\t      fs") " - fullscreen\n");
@@ -349,6 +401,7 @@ static void show_help(void)
                 color_printf("%s" TBOLD("%s"), (i == 0 ? "" : ", "), SDL_GetVideoDriver(i));
         }
         color_printf("\n");
+        color_printf(TBOLD("         buffers") " - number of streaming textures (default " TOSTRING(DEFAULT_BUFFER_COUNT) ")\n");
         color_printf(TBOLD("     keep-aspect") " - keep window aspect ratio respecive to the video\n");
         color_printf(TBOLD("         novsync") " - disable sync on VBlank\n");
         color_printf(TBOLD("      nodecorate") " - disable window border\n");
@@ -459,7 +512,7 @@ static void vf_sdl_texture_data_deleter(struct video_frame *buf) {
 static bool recreate_textures(struct state_sdl2 *s, struct video_desc desc) {
         cleanup_frames(s);
 
-        for (int i = 0; i < BUFFER_COUNT; ++i) {
+        for (int i = 0; i < s->buffer_count; ++i) {
                 SDL_Texture *texture = SDL_CreateTexture(s->renderer, get_ug_to_sdl_format(desc.color_spec), SDL_TEXTUREACCESS_STREAMING, desc.width, desc.height);
                 if (!texture) {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to create texture: %s\n", SDL_GetError());
@@ -539,7 +592,7 @@ static void loadSplashscreen(struct state_sdl2 *s) {
         struct video_frame *splash = display_sdl2_getf(s);
         memcpy(splash->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
         vf_free(frame);
-        display_frame(s, splash); // don't be tempted to use _putf() - it will use event queue and there may arise a race-condition with recv thread
+        display_frame(s, splash, false); // don't be tempted to use _putf() - it will use event queue and there may arise a race-condition with recv thread
 }
 
 static bool set_size(struct state_sdl2 *s, const char *tok)
@@ -583,6 +636,7 @@ static void *display_sdl2_init(struct module *parent, const char *fmt, unsigned
         s->x = s->y = SDL_WINDOWPOS_UNDEFINED;
         s->renderer_idx = -1;
         s->vsync = true;
+        s->buffer_count = DEFAULT_BUFFER_COUNT;
 
         if (fmt == NULL) {
                 fmt = "";
@@ -598,6 +652,13 @@ static void *display_sdl2_init(struct module *parent, const char *fmt, unsigned
                         s->display_idx = atoi(tok + strlen("display="));
                 } else if (strncmp(tok, "driver=", strlen("driver=")) == 0) {
                         driver = tok + strlen("driver=");
+                } else if (strstr(tok, "buffers=") == tok) {
+                        s->buffer_count = atoi(tok + strlen("buffers="));
+                        if (s->buffer_count < MIN_BUFFER_COUNT) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "At least %d buffers needed!\n", MIN_BUFFER_COUNT);
+                                free(s);
+                                return NULL;
+                        }
                 } else if (strcmp(tok, "fs") == 0) {
                         s->fs = true;
                 } else if (strcmp(tok, "help") == 0) {
@@ -685,6 +746,7 @@ static void *display_sdl2_init(struct module *parent, const char *fmt, unsigned
         s->sdl_user_reconfigure_event = s->sdl_user_new_frame_event + 2;
 
         s->free_frame_queue = simple_linked_list_init();
+        s->drop_report_t0 = get_time_in_ns();
 
         for (unsigned int i = 0; i < sizeof keybindings / sizeof keybindings[0]; ++i) {
                 if (keybindings[i].key == 'q') { // don't report 'q' to avoid accidental close - user can use Ctrl-c there
@@ -777,7 +839,8 @@ static bool display_sdl2_putf(void *state, struct video_frame *frame, long long
         }
         if (frame != NULL && simple_linked_list_size(s->free_frame_queue) == 0) {
                 simple_linked_list_append(s->free_frame_queue, frame);
-                log_msg(LOG_LEVEL_INFO, MOD_NAME "1 frame(s) dropped!\n");
+                s->dropped_full += 1;
+                report_drops(s);
                 pthread_mutex_unlock(&s->lock);
                 return false;
         }
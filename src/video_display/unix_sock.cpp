@@ -73,6 +73,8 @@
 #define DEFAULT_SCALE_W 960
 #define DEFAULT_SCALE_H 540
 
+#define DEFAULT_SHM_SLOTS 4
+
 using ipc_frame_conv_func_t = bool (*)(struct Ipc_frame *dst,
                 const struct video_frame *src,
                 codec_t codec,
@@ -104,6 +106,8 @@ struct state_unix_sock {
         int target_height = -1;
 
         bool ignore_putf_blocking = false;
+        int shm_slots = 0;
+        int every = 1; ///< publish only every n-th frame
 
         ipc_frame_conv_func_t ipc_conv = ipc_frame_from_ug_frame;
 
@@ -114,7 +118,7 @@ struct state_unix_sock {
 static void show_help(){
         col() << "unix_socket/preview display. The two display are identical apart from their defaults and the fact that preview never blocks on putf().\n";
         col() << "usage:\n";
-        col() << TBOLD(TRED("\t-d (unix_socket|preview)") << "[:path=<path>][:target_size=<w>x<h>]")
+        col() << TBOLD(TRED("\t-d (unix_socket|preview)") << "[:path=<path>][:target_size=<w>x<h>][:hq|:box][:every=<n>][:shm[=<slots>]]")
                 << "\n\n";
         col() << "options:\n";
         col() << TBOLD("\tpath=<path>")           << "\tpath to unix socket to connect to. Defaults are \""
@@ -123,6 +127,9 @@ static void show_help(){
         col() << TBOLD("\ttarget_size=<w>x<h>")<< "\tScales the video frame so that the total number of pixel is around <w>x<h>. If -1x-1 is passed, no scaling takes place."
                 << "Defaults are -1x-1 for unix_sock and " TOSTRING(DEFAULT_SCALE_W) "x" TOSTRING(DEFAULT_SCALE_H) " for preview.\n";
         col() << TBOLD("\thq")           << "\tUse higher quality downscale\n";
+        col() << TBOLD("\tbox")          << "\tAverage the downscaled pixels (box filter), MJPG streams are not decompressed but previewed from JPEG DC coefficients\n";
+        col() << TBOLD("\tevery=<n>")    << "\tPublish only every n-th frame\n";
+        col() << TBOLD("\tshm[=<slots>]") << "\tPass frames in a shared-memory ring (default " TOSTRING(DEFAULT_SHM_SLOTS) " slots) instead of the socket, Linux only. The reader must support it.\n";
 }
 
 static void *display_unix_sock_init(struct module *parent,
@@ -161,6 +168,21 @@ static void *display_unix_sock_init(struct module *parent,
                         socket_path += tokenize(tok, '=');
                 } else if(key == "hq"){
                         s->ipc_conv = ipc_frame_from_ug_frame_hq;
+                } else if(key == "box"){
+                        s->ipc_conv = ipc_frame_from_ug_frame_box;
+                } else if(key == "every"){
+                        auto val = tokenize(tok, '=');
+                        if(!parse_num(val, s->every) || s->every < 1){
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong frame interval\n");
+                                return nullptr;
+                        }
+                } else if(key == "shm"){
+                        s->shm_slots = DEFAULT_SHM_SLOTS;
+                        auto val = tokenize(tok, '=');
+                        if(!val.empty() && (!parse_num(val, s->shm_slots) || s->shm_slots < 2)){
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong number of shm slots\n");
+                                return nullptr;
+                        }
                 } else if(key == "target_size"){
                         auto val = tokenize(tok, '=');
                         if(!parse_num(tokenize(val, 'x'), s->target_width)
@@ -179,6 +201,9 @@ static void *display_unix_sock_init(struct module *parent,
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to init ipc writer for path %s\n", socket_path.c_str());
                 return nullptr;
         }
+        if(s->shm_slots > 0 && !ipc_frame_writer_enable_shm(s->frame_writer.get(), s->shm_slots)){
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Shared memory not supported, using socket.\n");
+        }
 
         s->thread_id = std::thread(display_unix_sock_run, s.get());
         return s.release();
@@ -188,6 +213,7 @@ static void display_unix_sock_run(void *state)
 {
         auto s = static_cast<state_unix_sock *>(state);
         int skipped = 0;
+        int frame_counter = 0;
 
         while (1) {
                 auto frame = [&]{
@@ -209,12 +235,25 @@ static void display_unix_sock_run(void *state)
                         continue;
                 }
 
+                if (frame_counter++ % s->every != 0) {
+                        continue;
+                }
+
                 const tile *tile = &frame->tiles[0];
 
                 int scale = ipc_frame_get_scale_factor(tile->width, tile->height,
                                 s->target_width, s->target_height);
 
-                if(!s->ipc_conv(s->ipc_frame.get(), frame.get(),
+                Ipc_frame *dst = s->ipc_frame.get();
+                if(s->shm_slots > 0){
+                        // upper bound of what ipc_conv needs incl. scratch space
+                        size_t max_len = vc_get_linesize(tile->width, RGB) * tile->height + tile->data_len;
+                        if(auto *shm_frame = ipc_frame_writer_get_shm_frame(s->frame_writer.get(), max_len)){
+                                dst = shm_frame;
+                        }
+                }
+
+                if(!s->ipc_conv(dst, frame.get(),
                                         RGB, scale))
                 {
                         log_msg(LOG_LEVEL_WARNING, MOD_NAME "Unable to convert\n");
@@ -222,7 +261,7 @@ static void display_unix_sock_run(void *state)
                 }
 
                 errno = 0;
-                if(!ipc_frame_writer_write(s->frame_writer.get(), s->ipc_frame.get())){
+                if(!ipc_frame_writer_write(s->frame_writer.get(), dst)){
                         perror(MOD_NAME "Unable to send frame");
                         continue;
                 }
@@ -273,20 +312,27 @@ static bool display_unix_sock_putf(void *state, struct video_frame *frame, long
 
 static bool display_unix_sock_get_property(void *state, int property, void *val, size_t *len)
 {
-        UNUSED(state);
-        codec_t codecs[] = {UYVY, RGBA, RGB};
+        auto s = static_cast<state_unix_sock *>(state);
+        // MJPG is previewed from DC coefficients without decompression
+        codec_t codecs[] = {MJPG, UYVY, RGBA, RGB};
+        size_t codecs_len = sizeof codecs;
+        codec_t *codecs_start = codecs;
+        if(s->ipc_conv != ipc_frame_from_ug_frame_box){
+                codecs_start += 1;
+                codecs_len -= sizeof codecs[0];
+        }
         enum interlacing_t supported_il_modes[] = {PROGRESSIVE, INTERLACED_MERGED, SEGMENTED_FRAME};
         int rgb_shift[] = {0, 8, 16};
 
         switch (property) {
                 case DISPLAY_PROPERTY_CODECS:
-                        if(sizeof(codecs) <= *len) {
-                                memcpy(val, codecs, sizeof(codecs));
+                        if(codecs_len <= *len) {
+                                memcpy(val, codecs_start, codecs_len);
                         } else {
                                 return false;
                         }
 
-                        *len = sizeof(codecs);
+                        *len = codecs_len;
                         break;
                 case DISPLAY_PROPERTY_RGB_SHIFT:
                         if(sizeof(rgb_shift) > *len) {
@@ -299,6 +345,10 @@ static bool display_unix_sock_get_property(void *state, int property, void *val,
                         *(int *) val = PITCH_DEFAULT;
                         *len = sizeof(int);
                         break;
+                case DISPLAY_PROPERTY_ACCEPTS_FOREIGN_FRAMES: // only read and vf_free()d
+                        *(bool *) val = true;
+                        *len = sizeof(bool);
+                        break;
                 case DISPLAY_PROPERTY_SUPPORTED_IL_MODES:
                         if(sizeof(supported_il_modes) <= *len) {
                                 memcpy(val, supported_il_modes, sizeof(supported_il_modes));
@@ -187,13 +187,7 @@ static void deinit_device(struct display_v4l2_state *s) {
                 log_perror(LOG_LEVEL_ERROR, MOD_NAME "Stream stopping error");
         }
 
-        for (int i = 0; i < BUFFERS; ++i) {
-                if (s->buffers[i].start) {
-                        if (-1 == munmap(s->buffers[i].start, s->buffers[i].length)) {
-                                log_perror(LOG_LEVEL_ERROR, MOD_NAME "munmap");
-                        }
-                }
-        }
+        unmap_v4l2_buffers(s->buffers, BUFFERS);
         s->stream_started = 0;
 }
 
@@ -216,7 +210,7 @@ static struct video_frame *display_v4l2_getf(void *state)
                 return NULL;
         }
 
-        s->f->tiles[0].data = s->buffers[s->buf.index].start;
+        s->f->tiles[0].data = s->buffers[s->buf.index].planes[0].start;
 
         return s->f;
 }
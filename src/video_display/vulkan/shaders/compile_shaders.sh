@@ -3,9 +3,11 @@
 #set correct glslc location
 GLSLC=glslc
 
+# run from this directory (v210 and R12L conversions are also built by make)
+SOURCE_PATH=.
 DEST_PATH=../../../../share/ultragrid/vulkan_shaders
 
-declare -a SHADERS=("render.vert" "render.frag" "RGB10A2_conv.comp" "UYVA16_conv.comp" "UYVY8_conv.comp")
+declare -a SHADERS=("render.vert" "render.frag" "RGB10A2_conv.comp" "UYVA16_conv.comp" "UYVY8_conv.comp" "v210_conv.comp" "R12L_conv.comp")
 
 for shader in ${SHADERS[@]}; do
 	echo "$GLSLC $SOURCE_PATH/$shader -o $DEST_PATH/$shader.spv"
@@ -386,31 +386,56 @@ void VulkanContext::create_logical_device() {
                 .setPQueuePriorities(priorities.data())
                 .setQueueCount(1);
 
+        std::vector<const char*> gpu_extensions = required_gpu_extensions;
+#ifdef VULKAN_DISPLAY_TIMELINE_SEMAPHORE
+        const std::vector<const char*> timeline_extension = { VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME };
+        const bool timeline_extension_present = check_device_extensions(false, timeline_extension, gpu);
+        vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_feature{};
+#endif
+
         vk::DeviceCreateInfo device_info{};
         device_info
                 .setPNext(nullptr)
                 .setQueueCreateInfoCount(1)
-                .setPQueueCreateInfos(&queue_info)
-                .setEnabledExtensionCount(static_cast<uint32_t>(required_gpu_extensions.size()))
-                .setPpEnabledExtensionNames(required_gpu_extensions.data());
+                .setPQueueCreateInfos(&queue_info);
 
         vk::PhysicalDeviceFeatures2 features2{};
         vk::PhysicalDeviceSamplerYcbcrConversionFeatures yCbCr_feature{};
         if (vulkan_version == VK_API_VERSION_1_1) {
                 features2.setPNext(&yCbCr_feature);
+#ifdef VULKAN_DISPLAY_TIMELINE_SEMAPHORE
+                if (timeline_extension_present) {
+                        yCbCr_feature.setPNext(&timeline_feature);
+                }
+#endif
                 gpu.getFeatures2(&features2);
                 if (yCbCr_feature.samplerYcbcrConversion) {
                         yCbCr_supported = true;
                         device_info.setPNext(&features2);
                         vulkan_log_msg(LogLevel::info, "yCbCr feature supported.");
                 }
+#ifdef VULKAN_DISPLAY_TIMELINE_SEMAPHORE
+                if (timeline_feature.timelineSemaphore) {
+                        timeline_semaphore_supported = true;
+                        gpu_extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+                        device_info.setPNext(&features2);
+                        vulkan_log_msg(LogLevel::info, "Timeline semaphores supported.");
+                }
+#endif
         }
+        device_info
+                .setEnabledExtensionCount(static_cast<uint32_t>(gpu_extensions.size()))
+                .setPpEnabledExtensionNames(gpu_extensions.data());
 
         //reset features
         features2 = vk::PhysicalDeviceFeatures2{};
         features2.setPNext(&yCbCr_feature);
 
         device = gpu.createDevice(device_info);
+        if (timeline_semaphore_supported) {
+                device_dispatcher = std::make_unique<vk::DispatchLoaderDynamic>((VkInstance) instance,
+                        vkGetInstanceProcAddr, (VkDevice) device, vkGetDeviceProcAddr);
+        }
 }
 
 void VulkanContext::create_swap_chain(vk::SwapchainKHR&& old_swapchain) {
@@ -421,6 +446,7 @@ void VulkanContext::create_swap_chain(vk::SwapchainKHR&& old_swapchain) {
 
                 swapchain_atributes.format = get_surface_format(gpu, surface);
                 swapchain_atributes.mode = get_present_mode(gpu, surface, preferred_present_mode);
+                vulkan_log_msg(LogLevel::verbose, "Present mode: " + vk::to_string(swapchain_atributes.mode));
 
                 vk::Extent2D swapchain_image_size;
                 swapchain_image_size.width = std::clamp(window_parameters.width,
@@ -570,6 +596,7 @@ void VulkanContext::destroy() {
                 destroy_swapchain_views();
                 device.destroy(swapchain);
                 device.destroy();
+                device_dispatcher = nullptr;
         }
         if (instance) {
                 instance.destroy(surface);
@@ -41,6 +41,9 @@
 static_assert(VK_HEADER_VERSION > 100); // minimum Vulkan SDK version is 1.1.101
 //Newer versions can be downloaded from the official website:
 //https://vulkan.lunarg.com/sdk/home
+#ifdef VK_KHR_timeline_semaphore // SDK 1.1.124+
+#define VULKAN_DISPLAY_TIMELINE_SEMAPHORE 1
+#endif
 
 //remove leaking macros
 #undef min
@@ -137,6 +140,9 @@ class VulkanContext {
         vk::PhysicalDevice gpu;
         vk::Device device;
         bool yCbCr_supported = false;
+        bool timeline_semaphore_supported = false;
+        /// device-level dispatcher for VK_KHR_timeline_semaphore (not part of Vulkan 1.1)
+        std::unique_ptr<vk::DispatchLoaderDynamic> device_dispatcher{};
 
         uint32_t queue_family_index = no_queue_index_found;
         vk::Queue queue;
@@ -160,6 +166,8 @@ public:
         vk::PhysicalDevice get_gpu() { return gpu; }
         vk::Device get_device() { return device; }
         bool is_yCbCr_supported() const { return yCbCr_supported; }
+        bool is_timeline_semaphore_supported() const { return timeline_semaphore_supported; }
+        const vk::DispatchLoaderDynamic& get_device_dispatcher() const { return *device_dispatcher; }
         uint32_t get_queue_family_index() { return queue_family_index; }
         vk::Queue get_queue() { return queue; }
         vk::SwapchainKHR get_swapchain() { return swapchain; }
@@ -247,6 +247,7 @@ void VulkanDisplay::init(VulkanInstance&& instance, vk::SurfaceKHR surface, uint
 
         context.create_framebuffers(render_pipeline.get_render_pass());
 
+        transfer_image_limit = initial_image_count;
         available_images.reserve(initial_image_count);
         for (uint32_t i = 0; i < initial_image_count; i++) {
                 transfer_images.emplace_back(device, i);
@@ -265,6 +266,18 @@ void VulkanDisplay::init(VulkanInstance&& instance, vk::SurfaceKHR surface, uint
         for(auto& resources: frame_resources){
                 free_frame_resources.emplace_back(&resources);
         }
+
+#ifdef VULKAN_DISPLAY_TIMELINE_SEMAPHORE
+        if (context.is_timeline_semaphore_supported()) {
+                vk::SemaphoreTypeCreateInfoKHR type_info{};
+                type_info
+                        .setSemaphoreType(vk::SemaphoreTypeKHR::eTimeline)
+                        .setInitialValue(timeline_value);
+                vk::SemaphoreCreateInfo semaphore_info{};
+                semaphore_info.setPNext(&type_info);
+                timeline_semaphore = device.createSemaphore(semaphore_info);
+        }
+#endif
 }
 
 void VulkanDisplay::destroy_format_dependent_resources(){
@@ -290,6 +303,7 @@ void VulkanDisplay::destroy() {
                                 device.destroy(resources.image_acquired_semaphore);
                                 device.destroy(resources.image_rendered_semaphore);
                         }
+                        device.destroy(timeline_semaphore);
                         destroy_format_dependent_resources();
                         render_pipeline.destroy(device);
                         conversion_pipeline.destroy(device);
@@ -312,6 +326,10 @@ bool VulkanDisplay::is_image_description_supported(ImageDescription description)
                 return true;
         }
 
+        if (!std::ifstream(path_to_shaders + "/" + format_info.conversion_shader + ".comp.spv").good()){
+                return false;
+        }
+
         return is_format_supported(context.get_gpu(), context.is_yCbCr_supported(), description.size,
                 format_info.conversion_image_format, vk::ImageTiling::eOptimal,
                 vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage);
@@ -410,6 +428,10 @@ TransferImageImpl& VulkanDisplay::acquire_transfer_image() {
         if (result != nullptr){
                 return *result;
         }
+        if (transfer_image_limit != 0 && transfer_images.size() >= transfer_image_limit) {
+                // ring is exhausted, wait for the render thread to release an image
+                return *available_img_queue.wait_pop();
+        }
         uint32_t id = transfer_images.size();
         transfer_images.emplace_back(device, id);
         return transfer_images.back();
@@ -505,6 +527,40 @@ void VulkanDisplay::reconfigure(const TransferImageImpl& transfer_image){
         render_pipeline.update_render_area( render_area_size, current_image_description.size);
 }
 
+/// returns images (and their frame resources) already processed by the GPU
+void VulkanDisplay::release_rendered_images() {
+        std::scoped_lock lock{device_mutex};
+#ifdef VULKAN_DISPLAY_TIMELINE_SEMAPHORE
+        if (timeline_semaphore) {
+                const uint64_t finished = device.getSemaphoreCounterValueKHR(timeline_semaphore,
+                        context.get_device_dispatcher());
+                while (!rendered_images.empty() && rendered_images.front().timeline_value <= finished) {
+                        free_frame_resources.push_back(rendered_images.front().gpu_commands);
+                        available_img_queue.wait_push(rendered_images.front().image);
+                        rendered_images.pop();
+                }
+                return;
+        }
+#endif
+        while (!rendered_images.empty()){
+                auto* first_image = rendered_images.front().image;
+                auto result = device.waitForFences(first_image->is_available_fence, VK_TRUE, 0);
+                if (result == vk::Result::eSuccess){
+                        device.resetFences(first_image->is_available_fence);
+                        free_frame_resources.push_back(rendered_images.front().gpu_commands);
+                        rendered_images.pop();
+                        assert(first_image != nullptr);
+                        available_img_queue.wait_push(first_image);
+                }
+                else if (result == vk::Result::eTimeout){
+                        break;
+                }
+                else {
+                        throw VulkanError{"Waiting for fence failed."};
+                }
+        }
+}
+
 bool VulkanDisplay::display_queued_image() {
         auto window_parameters = window->get_window_parameters();
         if (window_parameters.is_minimized()) {
@@ -512,26 +568,7 @@ bool VulkanDisplay::display_queued_image() {
                 return false;
         }
 
-        {
-                std::scoped_lock lock{device_mutex};
-                while (!rendered_images.empty()){
-                        auto* first_image = rendered_images.front().image;
-                        auto result = device.waitForFences(first_image->is_available_fence, VK_TRUE, 0);
-                        if (result == vk::Result::eSuccess){
-                                device.resetFences(first_image->is_available_fence);
-                                free_frame_resources.push_back(rendered_images.front().gpu_commands);
-                                rendered_images.pop();
-                                assert(first_image != nullptr);
-                                available_img_queue.wait_push(first_image);
-                        }
-                        else if (result == vk::Result::eTimeout){
-                                break;
-                        }
-                        else {
-                                throw VulkanError{"Waiting for fence failed."};
-                        }
-                }
-        }
+        release_rendered_images();
 
         if(free_frame_resources.empty()){
                 return false;
@@ -596,10 +633,27 @@ bool VulkanDisplay::display_queued_image() {
                 .setSignalSemaphoreCount(1)
                 .setPSignalSemaphores(&resources.image_rendered_semaphore);
 
-        context.get_queue().submit(submit_info, transfer_image.is_available_fence);
+        vk::Fence submit_fence = transfer_image.is_available_fence;
+#ifdef VULKAN_DISPLAY_TIMELINE_SEMAPHORE
+        const std::array signal_semaphores{ resources.image_rendered_semaphore, timeline_semaphore };
+        const std::array<uint64_t, 2> signal_values{ 0 /* binary, ignored */, timeline_value + 1 };
+        vk::TimelineSemaphoreSubmitInfoKHR timeline_info{};
+        if (timeline_semaphore) {
+                timeline_info
+                        .setSignalSemaphoreValueCount(signal_values.size())
+                        .setPSignalSemaphoreValues(signal_values.data());
+                submit_info
+                        .setPNext(&timeline_info)
+                        .setSignalSemaphoreCount(signal_semaphores.size())
+                        .setPSignalSemaphores(signal_semaphores.data());
+                submit_fence = nullptr;
+                timeline_value += 1;
+        }
+#endif
+        context.get_queue().submit(submit_info, submit_fence);
 
         frame_resources_used_by_gpu = true;
-        rendered_images.emplace(RenderedImage{&transfer_image, &resources});
+        rendered_images.emplace(RenderedImage{&transfer_image, &resources, timeline_value});
 
         auto swapchain = context.get_swapchain();
         vk::PresentInfoKHR present_info{};
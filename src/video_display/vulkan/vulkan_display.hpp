@@ -104,6 +104,8 @@ class VulkanDisplay {
 
         using TransferImageImpl = detail::TransferImageImpl;
         std::deque<TransferImageImpl> transfer_images{};
+        /// maximal count of transfer images, 0 means that images are allocated on demand
+        uint32_t transfer_image_limit = 0;
 
         /// available_img_queue - producer is the render thread, consumer is the provided thread
         detail::ConcurrentQueue<TransferImageImpl*> available_img_queue{};
@@ -115,11 +117,17 @@ class VulkanDisplay {
         struct RenderedImage{
                 TransferImageImpl* image;
                 detail::PerFrameResources* gpu_commands;
+                uint64_t timeline_value; ///< value of timeline_semaphore signalled when the image is released
         };
         std::queue<RenderedImage> rendered_images;
 
+        /// if supported, replaces per-image fences - one counter query retires all finished images
+        vk::Semaphore timeline_semaphore;
+        uint64_t timeline_value = 0;
+
         bool destroyed = false;
 private:
+        void release_rendered_images();
         void bind_transfer_image(TransferImageImpl& image, detail::PerFrameResources& resources);
         //void create_transfer_image(transfer_image*& result, image_description description);
         [[nodiscard]] TransferImageImpl& acquire_transfer_image();
@@ -152,6 +160,10 @@ public:
                 }
         }
 
+        /**
+         * @param transfer_image_count  size of the transfer image ring; if 0, images are
+         *                              allocated on demand
+         */
         void init(VulkanInstance&& instance, vk::SurfaceKHR surface, uint32_t transfer_image_count,
                 WindowChangedCallback& window, uint32_t gpu_index = no_gpu_selected,
                 std::string path_to_shaders = "./shaders", bool vsync = true, bool tearing_permitted = false);
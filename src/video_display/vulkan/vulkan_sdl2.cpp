@@ -58,7 +58,6 @@
 #include "module.h"
 #include "utils/color_out.h"
 #include "video_display.h"
-#include "video_display/splashscreen.h"
 #include "video.h"
 #include "utils/fs.h"
 //remove leaking macros
@@ -462,7 +461,7 @@ void show_help() {
         
         col() << "VULKAN_SDL2 options:\n";
         col() << SBOLD(SRED("\t-d vulkan_sdl2")
-                        << "[:d|:fs|:keep-aspect|:nocursor|:nodecorate|:novsync|:tearing|:validation|:display=<dis_id>|"
+                        << "[:d|:fs|:keep-aspect|:mailbox|:nocursor|:nodecorate|:novsync|:tearing|:validation|:buffers=<n>|:display=<dis_id>|"
                         ":driver=<drv>|:gpu=<gpu_id>|:pos=<x>,<y>|:size=<W>x<H>|:window_flags=<f>|:help])") << "\n";
 
         col() << ("\twhere:\n");
@@ -471,11 +470,13 @@ void show_help() {
         col() << SBOLD("\t              fs") << " - fullscreen\n";
         
         col() << SBOLD("\t     keep-aspect") << " - keep window aspect ratio respecive to the video\n";
+        col() << SBOLD("\t         mailbox") << " - present the newest frame on vblank without tearing (lowest latency, same as novsync without tearing)\n";
         col() << SBOLD("\t        nocursor") << " - hides cursor\n";
         col() << SBOLD("\t      nodecorate") << " - disable window border\n";
         col() << SBOLD("\t         novsync") << " - disable vsync\n";
         col() << SBOLD("\t         tearing") << " - permits screen tearing\n";
         col() << SBOLD("\t      validation") << " - enable vulkan validation layers\n";
+        col() << SBOLD("\t     buffers=<n>") << " - use a fixed ring of n transfer images (default: allocated on demand)\n";
 
         col() << SBOLD("\tdisplay=<dis_id>") << " - display index, available indices: ";
         sdl2_print_displays();
@@ -505,7 +506,7 @@ struct CodecToVulkanFormat{
 // Ultragrid to VulkanDisplay Format mapping
 const std::vector<CodecToVulkanFormat>& get_ug_to_vkd_format_mapping(state_vulkan_sdl2& s){
         //the backup vkd::Format must follow the corrresponding native vkd::Format 
-        constexpr std::array<CodecToVulkanFormat, 10> format_mapping {{
+        constexpr std::array<CodecToVulkanFormat, 12> format_mapping {{
                 {RGBA, vkd::Format::RGBA8},
                 {RGB,  vkd::Format::RGB8},
                 {UYVY, vkd::Format::UYVY8_422},
@@ -515,6 +516,8 @@ const std::vector<CodecToVulkanFormat>& get_ug_to_vkd_format_mapping(state_vulka
                 {Y416, vkd::Format::UYVA16_422_conv},
                 {R10k, vkd::Format::RGB10A2_conv},
                 {RG48, vkd::Format::RGB16},
+                {v210, vkd::Format::V210_conv},
+                {R12L, vkd::Format::R12L_conv},
         }};
 
         static std::vector<CodecToVulkanFormat> supported_formats_mapping{};
@@ -564,22 +567,28 @@ bool display_vulkan_reconfigure(void* state, video_desc desc) {
 
 /**
  * Load splashscreen
- * Function loads graphic data from header file "splashscreen.h", where are
- * stored splashscreen data in RGB format.
+ * Function copies the splashscreen decoded by get_splashscreen_rgb()
+ * (packed RGB) to the transfer image.
  */
 void draw_splashscreen(state_vulkan_sdl2& s) {
+        unsigned splash_width = 0;
+        unsigned splash_height = 0;
+        const unsigned char* source = get_splashscreen_rgb(&splash_width, &splash_height);
+        if (source == nullptr) {
+                return;
+        }
         vkd::TransferImage image;
         try {
                 image = s.vulkan->acquire_image({splash_width, splash_height, vkd::Format::RGBA8});
         } 
         catch (std::exception& e) { log_and_exit_uv(e); return; }
-        const char* source = splash_data;
         char* dest = reinterpret_cast<char*>(image.get_memory_ptr());
         auto padding = image.get_row_pitch() - splash_width * 4;
 
         for (unsigned row = 0; row < splash_height; row++) {
                 for (unsigned int col = 0; col < splash_width; col++) {
-                        HEADER_PIXEL(source, dest);
+                        memcpy(dest, source, 3);
+                        source += 3;
                         dest += 4;
                 }
                 dest += padding;
@@ -607,6 +616,7 @@ struct command_line_arguments {
         int x = SDL_WINDOWPOS_UNDEFINED;
         int y = SDL_WINDOWPOS_UNDEFINED;
 
+        uint32_t transfer_image_count = initial_frame_count;
         uint32_t window_flags = 0 ; ///< user requested flags
         uint32_t gpu_idx = vkd::no_gpu_selected;
         std::string driver{};
@@ -652,10 +662,20 @@ bool parse_command_line_arguments(command_line_arguments& args, state_vulkan_sdl
                         args.window_flags |= SDL_WINDOW_BORDERLESS;
                 } else if (token == "novsync") {
                         args.vsync = false;
+                } else if (token == "mailbox") {
+                        args.vsync = false;
+                        args.tearing_permitted = false;
                 } else if (token == "tearing") {
                         args.tearing_permitted = true;
                 } else if (token == "validation") {
                         args.validation = true;
+                } else if (starts_with(token, "buffers=")) {
+                        constexpr auto pos = "buffers="sv.size();
+                        const int count = svtoi(token.substr(pos));
+                        if (count <= 0) {
+                                throw std::runtime_error{ std::string(token) };
+                        }
+                        args.transfer_image_count = count;
                 } else if (starts_with(token, "display=")) {
                         constexpr auto pos = "display="sv.size();
                         args.display_idx = svtoi(token.substr(pos));
@@ -841,7 +861,7 @@ void* display_vulkan_init(module* parent, const char* fmt, unsigned int flags) {
 #endif
                 s->vulkan = new vkd::VulkanDisplay{};
                 s->vulkan->init(std::move(instance), vk::SurfaceKHR(surface),
-                                initial_frame_count, *s->window_callback,
+                                args.transfer_image_count, *s->window_callback,
                                 args.gpu_idx, std::move(path_to_shaders),
                                 args.vsync, args.tearing_permitted);
                 LOG(LOG_LEVEL_NOTICE) << MOD_NAME "Vulkan display initialised." << std::endl;
@@ -35,21 +35,48 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // defined HAVE_CONFIG_H
+
 #include <assert.h>                     // for assert
 #include <compat/platform_semaphore.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>                   // for PRIu32
 #include <pthread.h>
 #include <stdint.h>                     // for uint32_t
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>                     // for memcpy, memset, strdup
 
+#include "debug.h"
+#include "host.h"
+#include "rtp/rtpenc_h264.h"            // for rtpenc_frame_is_keyframe
+#include "tv.h"                         // for get_time_in_ns
 #include "types.h"                      // for tile, video_frame, video_desc
 #include "utils/fs.h"                   // for MAX_PATH_SIZE
+#include "utils/macros.h"               // for to_fourcc
+#include "utils/misc.h"                 // for ug_strerror
 #include "video_codec.h"
 #include "video_export.h"
 #include "video_frame.h"                // for video_desc_from_frame, video_...
 
 #define MAX_QUEUE_SIZE 300
+#define DIRECT_IO_ALIGN 4096
+#define MOD_NAME "[Video export] "
+#define DEFAULT_PREALLOC_MIB 256
+
+#ifdef O_DIRECT
+ADD_TO_PARAM("video-export-direct-io", "* video-export-direct-io\n"
+                "  Write exported video frames with O_DIRECT (bypassing page cache).\n");
+#endif
+ADD_TO_PARAM("video-export-container", "* video-export-container[=<prealloc_MiB>]\n"
+                "  Append exported video frames to a single file " VIDEO_EXPORT_CONTAINER_DATA " indexed\n"
+                "  by " VIDEO_EXPORT_CONTAINER_INDEX " instead of a file per frame. The file is preallocated\n"
+                "  by <prealloc_MiB> chunks (default " TOSTRING(DEFAULT_PREALLOC_MIB) ", Linux only).\n");
 
 /*
  * we do not need to have possible stalls, so IO is performend in a separate thread
@@ -58,9 +85,15 @@ static void *video_export_thread(void *arg);
 void output_summary(struct video_export *s);
 
 struct output_entry {
-        char *filename;
+        char *filename; ///< NULL if writing to container
+        uint32_t frame_idx;
+        unsigned int tile_idx;
+        int64_t timestamp;
+        uint32_t flags; ///< VIDEO_EXPORT_INDEX_* flags
         char *data;
         int data_len;
+        bool data_owned; ///< data is a copy, otherwise points to (a tile of) a taken frame
+        struct video_frame *frame; ///< taken frame to be disposed after write, may be NULL
 
         struct output_entry *next;
 };
@@ -78,9 +111,157 @@ struct video_export {
 
         struct video_desc saved_desc;
 
+        bool direct_io;
+        char *bounce_buf; ///< aligned buffer for O_DIRECT writes
+        size_t bounce_buf_len;
+
+        // container (video-export-container), used by the export thread
+        int container_fd; ///< -1 if not writing to container
+        bool container_direct; ///< container_fd opened with O_DIRECT
+        FILE *index;
+        uint64_t data_offset; ///< next (aligned) write position
+        uint64_t data_end; ///< end of the data written so far
+        uint64_t prealloc_end;
+        uint64_t prealloc_chunk;
+
         pthread_t thread_id;
 };
 
+static bool write_all(int fd, const char *data, size_t len)
+{
+        while (len > 0) {
+                ssize_t ret = write(fd, data, len);
+                if (ret <= 0) {
+                        return false;
+                }
+                data += ret;
+                len -= ret;
+        }
+        return true;
+}
+
+static bool ensure_bounce_buf(struct video_export *s, size_t len)
+{
+        if (s->bounce_buf_len >= len) {
+                return true;
+        }
+        aligned_free(s->bounce_buf);
+        s->bounce_buf = aligned_malloc(len, DIRECT_IO_ALIGN);
+        s->bounce_buf_len = s->bounce_buf ? len : 0;
+        return s->bounce_buf != NULL;
+}
+
+#ifdef O_DIRECT
+
+/**
+ * Writes the data bypassing page cache. The block-aligned part is written
+ * with O_DIRECT from an aligned buffer, the remainder without it.
+ *
+ * @retval false if failed (eg. FS doesn't support O_DIRECT), the caller
+ *               should fall back to buffered write
+ */
+static bool write_direct(struct video_export *s, const char *filename, const char *data, size_t len)
+{
+        const size_t aligned_len = len / DIRECT_IO_ALIGN * DIRECT_IO_ALIGN;
+        if (aligned_len == 0) {
+                return false;
+        }
+        if ((uintptr_t) data % DIRECT_IO_ALIGN != 0) {
+                if (!ensure_bounce_buf(s, aligned_len)) {
+                        return false;
+                }
+                memcpy(s->bounce_buf, data, aligned_len);
+        }
+        const char *aligned_data = (uintptr_t) data % DIRECT_IO_ALIGN == 0 ? data : s->bounce_buf;
+
+        int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+        if (fd == -1) {
+                return false;
+        }
+        bool ret = write_all(fd, aligned_data, aligned_len);
+        if (ret && aligned_len < len) {
+                ret = fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT) == 0 &&
+                        write_all(fd, data + aligned_len, len - aligned_len);
+        }
+        if (close(fd) != 0) {
+                ret = false;
+        }
+        return ret;
+}
+#endif
+
+static void write_buffered(const char *filename, const char *data, size_t len)
+{
+        FILE *out = fopen(filename, "wb");
+        if (out == NULL) {
+                perror("fopen");
+                return;
+        }
+        if (fwrite(data, len, 1, out) != 1) {
+                perror("fwrite");
+        }
+        fclose(out);
+}
+
+/**
+ * Appends the tile to the container at the next aligned offset and records it
+ * in the index. With O_DIRECT, the last partial block is zero-padded in the
+ * bounce buffer, the rest is written directly if the data are aligned.
+ */
+static void write_container(struct video_export *s, const struct output_entry *e)
+{
+        const size_t padded_len = (e->data_len + VIDEO_EXPORT_CONTAINER_ALIGN - 1) /
+                VIDEO_EXPORT_CONTAINER_ALIGN * VIDEO_EXPORT_CONTAINER_ALIGN;
+#ifdef __linux__
+        if (s->data_offset + padded_len > s->prealloc_end) {
+                // KEEP_SIZE - reserve the space but let the file size grow with the data
+                if (fallocate(s->container_fd, FALLOC_FL_KEEP_SIZE, (off_t) s->prealloc_end,
+                                        (off_t) s->prealloc_chunk) != 0) {
+                        log_msg_once(LOG_LEVEL_WARNING, to_fourcc('V', 'E', 'F', 'A'),
+                                        MOD_NAME "Cannot preallocate container: %s\n", ug_strerror(errno));
+                }
+                s->prealloc_end += s->prealloc_chunk;
+        }
+#endif
+        bool ret = false;
+        if (s->container_direct) {
+                const size_t body_len = (uintptr_t) e->data % DIRECT_IO_ALIGN == 0
+                        ? e->data_len / VIDEO_EXPORT_CONTAINER_ALIGN * VIDEO_EXPORT_CONTAINER_ALIGN
+                        : 0;
+                const size_t tail_len = padded_len - body_len;
+                if (ensure_bounce_buf(s, tail_len)) {
+                        memcpy(s->bounce_buf, e->data + body_len, e->data_len - body_len);
+                        memset(s->bounce_buf + (e->data_len - body_len), 0,
+                                        tail_len - (e->data_len - body_len));
+                        ret = write_all(s->container_fd, e->data, body_len) &&
+                                write_all(s->container_fd, s->bounce_buf, tail_len);
+                }
+        } else {
+                ret = write_all(s->container_fd, e->data, e->data_len) &&
+                        lseek(s->container_fd, (off_t) (s->data_offset + padded_len), SEEK_SET) != (off_t) -1;
+        }
+        if (!ret) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot write frame %" PRIu32 " to container: %s\n",
+                                e->frame_idx, ug_strerror(errno));
+                // keep the position aligned for the next write
+                lseek(s->container_fd, (off_t) (s->data_offset + padded_len), SEEK_SET);
+        } else {
+                struct video_export_index_entry rec = {
+                        .offset = s->data_offset,
+                        .data_len = e->data_len,
+                        .frame = e->frame_idx,
+                        .tile = e->tile_idx,
+                        .flags = e->flags,
+                        .timestamp = e->timestamp,
+                };
+                if (fwrite(&rec, sizeof rec, 1, s->index) != 1) {
+                        perror(MOD_NAME "index fwrite");
+                }
+                s->data_end = s->data_offset + e->data_len;
+        }
+        s->data_offset += padded_len;
+}
+
 static void *video_export_thread(void *arg)
 {
         struct video_export *s = (struct video_export *) arg;
@@ -105,16 +286,27 @@ static void *video_export_thread(void *arg)
                         return NULL;
                 }
 
-                FILE *out = fopen(current->filename, "wb");
-                if (out == NULL) {
-                        perror("fopen");
-                } else {
-                        if (fwrite(current->data, current->data_len, 1, out) != 1) {
-                                perror("fwrite");
+                bool written = false;
+                if (s->container_fd != -1) {
+                        write_container(s, current);
+                        written = true;
+                }
+#ifdef O_DIRECT
+                if (!written && s->direct_io) {
+                        written = write_direct(s, current->filename, current->data, current->data_len);
+                        if (!written) {
+                                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('V', 'E', 'D', 'I'),
+                                                MOD_NAME "Direct I/O write failed, using buffered.\n");
                         }
-                        fclose(out);
                 }
-                free(current->data);
+#endif
+                if (!written) {
+                        write_buffered(current->filename, current->data, current->data_len);
+                }
+                if (current->data_owned) {
+                        free(current->data);
+                }
+                VIDEO_FRAME_DISPOSE(current->frame);
                 free(current->filename);
                 free(current);
         }
@@ -122,6 +314,56 @@ static void *video_export_thread(void *arg)
         // never get here
 }
 
+static bool open_container(struct video_export *s, const char *prealloc_mib)
+{
+        s->prealloc_chunk = (uint64_t) (atoi(prealloc_mib) > 0 ? atoi(prealloc_mib) : DEFAULT_PREALLOC_MIB) << 20U;
+
+        char name[MAX_PATH_SIZE];
+        snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_CONTAINER_DATA, s->path);
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef _WIN32
+        flags |= O_BINARY;
+#endif
+#ifdef O_DIRECT
+        if (s->direct_io) {
+                s->container_fd = open(name, flags | O_DIRECT, 0666);
+                s->container_direct = s->container_fd != -1;
+                if (s->container_fd == -1) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot open %s with O_DIRECT, using buffered.\n", name);
+                }
+        }
+#endif
+        if (s->container_fd == -1) {
+                s->container_fd = open(name, flags, 0666);
+        }
+        if (s->container_fd == -1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot open %s: %s\n", name, ug_strerror(errno));
+                return false;
+        }
+
+        snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_CONTAINER_INDEX, s->path);
+        s->index = fopen(name, "wb");
+        if (s->index == NULL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot open %s: %s\n", name, ug_strerror(errno));
+                close(s->container_fd);
+                return false;
+        }
+        return true;
+}
+
+static void close_container(struct video_export *s)
+{
+        if (s->container_fd == -1) {
+                return;
+        }
+        // release the preallocated space past the data
+        if (ftruncate(s->container_fd, (off_t) s->data_end) != 0) {
+                perror(MOD_NAME "ftruncate");
+        }
+        close(s->container_fd);
+        fclose(s->index);
+}
+
 struct video_export * video_export_init(const char *path)
 {
         struct video_export *s = calloc(1, sizeof *s);
@@ -135,9 +377,20 @@ struct video_export * video_export_init(const char *path)
         s->head = s->tail = NULL;
 
         memset(&s->saved_desc, 0, sizeof(s->saved_desc));
+#ifdef O_DIRECT
+        s->direct_io = get_commandline_param("video-export-direct-io") != NULL;
+#endif
+        s->container_fd = -1;
+        const char *container = get_commandline_param("video-export-container");
+        if (container != NULL && !open_container(s, container)) {
+                free(s->path);
+                free(s);
+                return NULL;
+        }
 
         if(pthread_create(&s->thread_id, NULL, video_export_thread, s) != 0) {
                 fprintf(stderr, "[Video exporter] Failed to create thread.\n");
+                close_container(s);
                 free(s);
                 return NULL;
         }
@@ -194,12 +447,84 @@ void video_export_destroy(struct video_export *s)
                 if(s->total > 0) {
                         output_summary(s);
                 }
+                close_container(s);
 
+                aligned_free(s->bounce_buf);
                 free(s->path);
                 free(s);
         }
 }
 
+/// @returns false if the format changed (frame should not be exported)
+static bool check_format(struct video_export *s, const struct video_frame *frame)
+{
+        if(s->saved_desc.width == 0) {
+                s->saved_desc = video_desc_from_frame(frame);
+        } else {
+                if(!video_desc_eq(s->saved_desc, video_desc_from_frame(frame))) {
+                        fprintf(stderr, "[Video export] Format change detected, not exporting.\n");
+                        return false;
+                }
+        }
+        return true;
+}
+
+static uint32_t get_index_flags(const struct video_frame *frame, unsigned int tile_idx)
+{
+        if (!is_codec_interframe(frame->color_spec)) {
+                return VIDEO_EXPORT_INDEX_KEYFRAME;
+        }
+        if (frame->color_spec == H264 || frame->color_spec == H265) {
+                const struct tile *t = &frame->tiles[tile_idx];
+                return rtpenc_frame_is_keyframe((const unsigned char *) t->data,
+                                t->data_len, frame->color_spec == H265)
+                        ? VIDEO_EXPORT_INDEX_KEYFRAME : 0;
+        }
+        return 0;
+}
+
+static struct output_entry *create_entry(struct video_export *s, const struct video_frame *frame, unsigned int tile_idx)
+{
+        struct output_entry *entry = calloc(1, sizeof(struct output_entry));
+
+        entry->data_len = frame->tiles[tile_idx].data_len;
+        entry->frame_idx = s->total;
+        entry->tile_idx = tile_idx;
+        entry->timestamp = (frame->flags & TIMESTAMP_VALID) != 0
+                ? frame->timestamp
+                : (int64_t) (get_time_in_ns() / (NS_IN_SEC_DBL / kHz90));
+        if (s->container_fd != -1) {
+                entry->flags = get_index_flags(frame, tile_idx);
+                return entry;
+        }
+        entry->filename = malloc(MAX_PATH_SIZE);
+
+        if(frame->tile_count == 1) {
+                snprintf(entry->filename, MAX_PATH_SIZE, "%s/%08d.%s", s->path,
+                         s->total,
+                         get_codec_file_extension(frame->color_spec));
+        } else {
+                // add also tile index
+                snprintf(entry->filename, MAX_PATH_SIZE, "%s/%08d_%d.%s", s->path,
+                         s->total, tile_idx,
+                         get_codec_file_extension(frame->color_spec));
+        }
+        return entry;
+}
+
+/// @note s->lock must be held
+static void enqueue(struct video_export *s, struct output_entry *entry)
+{
+        if(s->head) {
+                s->tail->next = entry;
+                s->tail = entry;
+        } else {
+                s->head = s->tail = entry;
+        }
+        s->queue_len += 1;
+        platform_sem_post(&s->semaphore);
+}
+
 void video_export(struct video_export *s, struct video_frame *frame)
 {
         if(!s) {
@@ -209,35 +534,16 @@ void video_export(struct video_export *s, struct video_frame *frame)
         assert(frame != NULL);
         s->total += 1;
 
-        if(s->saved_desc.width == 0) {
-                s->saved_desc = video_desc_from_frame(frame);
-        } else {
-                if(!video_desc_eq(s->saved_desc, video_desc_from_frame(frame))) {
-                        fprintf(stderr, "[Video export] Format change detected, not exporting.\n");
-                        return;
-                }
+        if (!check_format(s, frame)) {
+                return;
         }
 
         for (unsigned int i = 0; i < frame->tile_count; ++i) {
                 assert(frame->tiles[i].data != NULL && frame->tiles[i].data_len != 0);
 
-                struct output_entry *entry = malloc(sizeof(struct output_entry));
-
-                entry->data_len = frame->tiles[i].data_len;
+                struct output_entry *entry = create_entry(s, frame, i);
                 entry->data = (char *) malloc(entry->data_len);
-                entry->filename = malloc(MAX_PATH_SIZE);
-                entry->next = NULL;
-
-                if(frame->tile_count == 1) {
-                        snprintf(entry->filename, MAX_PATH_SIZE, "%s/%08d.%s", s->path,
-                                 s->total,
-                                 get_codec_file_extension(frame->color_spec));
-                } else {
-                        // add also tile index
-                        snprintf(entry->filename, MAX_PATH_SIZE, "%s/%08d_%d.%s", s->path,
-                                 s->total, i,
-                                 get_codec_file_extension(frame->color_spec));
-                }
+                entry->data_owned = true;
                 memcpy(entry->data, frame->tiles[i].data, entry->data_len);
 
                 pthread_mutex_lock(&s->lock);
@@ -249,21 +555,48 @@ void video_export(struct video_export *s, struct video_frame *frame)
                                                 s->total); // we increment total size to keep the index
                                 pthread_mutex_unlock(&s->lock);
                                 free(entry->data);
+                                free(entry->filename);
                                 free(entry);
                                 return;
                         }
 
-                        if(s->head) {
-                                s->tail->next = entry;
-                                s->tail = entry;
-                        } else {
-                                s->head = s->tail = entry;
-                        }
-                        s->queue_len += 1;
+                        enqueue(s, entry);
                 }
                 pthread_mutex_unlock(&s->lock);
-
-                platform_sem_post(&s->semaphore);
         }
 }
 
+void video_export_take(struct video_export *s, struct video_frame *frame)
+{
+        if(!s) {
+                VIDEO_FRAME_DISPOSE(frame);
+                return;
+        }
+
+        assert(frame != NULL);
+        s->total += 1;
+
+        if (!check_format(s, frame)) {
+                VIDEO_FRAME_DISPOSE(frame);
+                return;
+        }
+
+        pthread_mutex_lock(&s->lock);
+        // all tiles must fit, the entries share the frame
+        if(s->queue_len + (int) frame->tile_count > MAX_QUEUE_SIZE) {
+                pthread_mutex_unlock(&s->lock);
+                fprintf(stderr, "[Video export] Maximal queue size (%d) exceeded, not saving frame %d.\n",
+                                MAX_QUEUE_SIZE, s->total);
+                VIDEO_FRAME_DISPOSE(frame);
+                return;
+        }
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                assert(frame->tiles[i].data != NULL && frame->tiles[i].data_len != 0);
+                struct output_entry *entry = create_entry(s, frame, i);
+                entry->data = frame->tiles[i].data;
+                // entries are written in order, the last one disposes
+                entry->frame = i == frame->tile_count - 1 ? frame : NULL;
+                enqueue(s, entry);
+        }
+        pthread_mutex_unlock(&s->lock);
+}
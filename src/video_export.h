@@ -38,8 +38,42 @@
 #ifndef _VIDEO_EXPORT_H_
 #define _VIDEO_EXPORT_H_
 
+#ifndef __cplusplus
+#include <stdint.h>
+#else
+#include <cstdint>
+#endif
+
 #define VIDEO_EXPORT_SUMMARY_VERSION 1
 
+/**
+ * @name single-file container
+ * With "--param video-export-container", the tiles are appended to
+ * VIDEO_EXPORT_CONTAINER_DATA instead of individual files, each starting at
+ * a VIDEO_EXPORT_CONTAINER_ALIGN boundary. VIDEO_EXPORT_CONTAINER_INDEX
+ * contains one struct video_export_index_entry (host byte order) per written
+ * tile, ordered by frame and tile. video.info is written as usual.
+ *
+ * The index lets the import seek to a frame in constant time (frames are
+ * normally stored densely) and, for inter-frame codecs, to the nearest
+ * keyframe. Indices not having any VIDEO_EXPORT_INDEX_KEYFRAME flag set
+ * (older ones or codecs not inspected) are treated as all-intra.
+ * @{
+ */
+#define VIDEO_EXPORT_CONTAINER_DATA  "video.data"
+#define VIDEO_EXPORT_CONTAINER_INDEX "video.index"
+#define VIDEO_EXPORT_CONTAINER_ALIGN 4096
+#define VIDEO_EXPORT_INDEX_KEYFRAME  0x1U ///< the frame can be decoded on its own
+struct video_export_index_entry {
+        uint64_t offset;    ///< in VIDEO_EXPORT_CONTAINER_DATA
+        uint32_t data_len;
+        uint32_t frame;     ///< frame number as in the file name (1-based)
+        uint32_t tile;
+        uint32_t flags;     ///< VIDEO_EXPORT_INDEX_* flags
+        int64_t  timestamp; ///< 90 kHz; from the source if set, otherwise time of export
+};
+/// @}
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
@@ -50,6 +84,11 @@ struct video_frame;
 struct video_export * video_export_init(const char *path);
 void video_export_destroy(struct video_export *state);
 void video_export(struct video_export *state, struct video_frame *frame);
+/**
+ * Same as video_export() but the frame data are not copied - the frame is
+ * disposed (VIDEO_FRAME_DISPOSE) after it is written (or dropped).
+ */
+void video_export_take(struct video_export *state, struct video_frame *frame);
 
 #ifdef __cplusplus
 }
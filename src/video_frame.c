@@ -52,6 +52,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <math.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -71,11 +72,128 @@
 
 #define MOD_NAME "[video frame] "
 
+/**
+ * @name Frame header cache
+ * Frame structs (with inline tiles) are created and destroyed several times
+ * per frame (decoder, tile splitting, filters), so the headers with up to
+ * VF_CACHE_TILES tiles are kept in a per-thread cache. Since frames are
+ * usually freed in a different thread than allocated (eg. decoder ->
+ * display), the surplus is moved to a shared list.
+ * @{
+ */
+#define VF_CACHE_TILES 4
+#define VF_CACHE_SIZE offsetof(struct video_frame, tiles[VF_CACHE_TILES])
+#define VF_THREAD_CACHE_MAX 16
+#define VF_SHARED_CACHE_MAX 64
+
+#if defined __SANITIZE_ADDRESS__ // keep use-after-free detectable
+#define VF_NO_CACHE
+#elif defined __has_feature
+#if __has_feature(address_sanitizer)
+#define VF_NO_CACHE
+#endif
+#endif
+
+#ifndef VF_NO_CACHE
+struct vf_cache_entry {
+        struct vf_cache_entry *next;
+};
+
+struct vf_thread_cache {
+        struct vf_cache_entry *head;
+        int count;
+};
+
+static _Thread_local struct vf_thread_cache vf_thread_cache;
+static pthread_key_t vf_thread_cache_key;
+static pthread_once_t vf_thread_cache_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t vf_shared_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct vf_cache_entry *vf_shared_cache;
+static int vf_shared_cache_count;
+
+static void vf_thread_cache_destroy(void *arg)
+{
+        struct vf_thread_cache *cache = arg;
+        while (cache->head != NULL) {
+                struct vf_cache_entry *e = cache->head;
+                cache->head = e->next;
+                free(e);
+        }
+        cache->count = 0;
+}
+
+static void vf_thread_cache_key_init(void)
+{
+        pthread_key_create(&vf_thread_cache_key, vf_thread_cache_destroy);
+}
+
+static struct video_frame *vf_cache_get(void)
+{
+        struct vf_thread_cache *cache = &vf_thread_cache;
+        if (cache->head == NULL) { // take half of the shared cache
+                pthread_mutex_lock(&vf_shared_cache_lock);
+                while (vf_shared_cache != NULL && cache->count < VF_THREAD_CACHE_MAX / 2) {
+                        struct vf_cache_entry *e = vf_shared_cache;
+                        vf_shared_cache = e->next;
+                        vf_shared_cache_count -= 1;
+                        e->next = cache->head;
+                        cache->head = e;
+                        cache->count += 1;
+                }
+                pthread_mutex_unlock(&vf_shared_cache_lock);
+                if (cache->head == NULL) {
+                        return NULL;
+                }
+        }
+        struct vf_cache_entry *e = cache->head;
+        cache->head = e->next;
+        cache->count -= 1;
+        memset(e, 0, VF_CACHE_SIZE);
+        return (struct video_frame *)(void *) e;
+}
+
+static void vf_cache_put(struct video_frame *buf)
+{
+        struct vf_thread_cache *cache = &vf_thread_cache;
+        struct vf_cache_entry *e = (struct vf_cache_entry *)(void *) buf;
+        if (cache->count < VF_THREAD_CACHE_MAX) {
+                if (cache->head == NULL && cache->count == 0) {
+                        pthread_once(&vf_thread_cache_once, vf_thread_cache_key_init);
+                        pthread_setspecific(vf_thread_cache_key, cache);
+                }
+                e->next = cache->head;
+                cache->head = e;
+                cache->count += 1;
+                return;
+        }
+        pthread_mutex_lock(&vf_shared_cache_lock);
+        if (vf_shared_cache_count < VF_SHARED_CACHE_MAX) {
+                e->next = vf_shared_cache;
+                vf_shared_cache = e;
+                vf_shared_cache_count += 1;
+                e = NULL;
+        }
+        pthread_mutex_unlock(&vf_shared_cache_lock);
+        free(e);
+}
+#endif // !defined VF_NO_CACHE
+/// @}
+
 struct video_frame * vf_alloc(int count)
 {
         struct video_frame *buf;
         assert(count > 0);
-        
+
+#ifndef VF_NO_CACHE
+        if (count <= VF_CACHE_TILES) {
+                buf = vf_cache_get();
+                if (buf == NULL) {
+                        // always allocate the full size so that entry can be reused
+                        buf = (struct video_frame *) calloc(1, VF_CACHE_SIZE);
+                }
+        } else
+#endif
         buf = (struct video_frame *) calloc(1, offsetof (struct video_frame, tiles[count]));
         assert(buf != NULL);
         
@@ -163,6 +281,13 @@ void vf_free(struct video_frame *buf)
         if (buf->callbacks.data_deleter) {
                 buf->callbacks.data_deleter(buf);
         }
+#ifndef VF_NO_CACHE
+        // tile_count may have been lowered but never raised over allocated
+        if (buf->tile_count <= VF_CACHE_TILES) {
+                vf_cache_put(buf);
+                return;
+        }
+#endif
         free(buf);
 }
 
@@ -412,8 +537,18 @@ struct video_frame *vf_get_copy(struct video_frame *original_frame) {
 
         for(int i = 0; i < (int) frame_copy->tile_count; ++i) {
                 frame_copy->tiles[i].data = (char *) malloc(frame_copy->tiles[i].data_len);
-                memcpy(frame_copy->tiles[i].data, original_frame->tiles[i].data,
-                                frame_copy->tiles[i].data_len);
+                if (original_frame->tiles[i].pitch == 0) {
+                        memcpy(frame_copy->tiles[i].data, original_frame->tiles[i].data,
+                                        frame_copy->tiles[i].data_len);
+                        continue;
+                }
+                // strided tile (vf_split_view()) - the copy is contiguous
+                size_t linesize = vc_get_linesize(frame_copy->tiles[i].width, frame_copy->color_spec);
+                for (unsigned y = 0; y < frame_copy->tiles[i].height; ++y) {
+                        memcpy(frame_copy->tiles[i].data + y * linesize,
+                                        original_frame->tiles[i].data + (size_t) y * original_frame->tiles[i].pitch,
+                                        linesize);
+                }
         }
 
         if(frame_copy->callbacks.copy){
@@ -135,7 +135,8 @@ struct tile * vf_get_tile(struct video_frame *buf, int pos);
 /**
  * @brief Makes deep copy of the video frame
  *
- * Copied data are automatically freeed by vf_free()
+ * Copied data are automatically freeed by vf_free(). Tiles of the copy are
+ * always contiguous, even if the original ones are strided (tile::pitch).
  */
 struct video_frame * vf_get_copy(struct video_frame *original_frame);
 /**
@@ -40,6 +40,7 @@
 #include <string>
 #include <utility>
 
+#include "capture_filter.h"
 #include "debug.h"
 #include "export.h"
 #include "host.h"
@@ -53,6 +54,7 @@
 #include "tfrc.h"
 #include "transmit.h"
 #include "tv.h"
+#include "utils/numa.h"
 #include "utils/thread.h"
 #include "utils/vf_split.h"
 #include "video.h"
@@ -118,6 +120,10 @@ video_rxtx::~video_rxtx() {
                 send(NULL);
                 compress_pop(m_compression);
         }
+        for (auto &layer : m_simulcast_layers) {
+                layer.rxtx = nullptr;
+                capture_filter_destroy(layer.filter);
+        }
         compress_done(m_compression);
         module_done(&m_receiver_mod);
         module_done(&m_sender_mod);
@@ -155,6 +161,7 @@ void video_rxtx::send(shared_ptr<video_frame> frame) {
         if (!frame && m_poisoned) {
                 return;
         }
+        send_simulcast(frame);
         compress_frame(m_compression, frame);
         if (!frame) {
                 m_poisoned = true;
@@ -176,6 +183,7 @@ void video_rxtx::check_sender_messages() {
 
 void *video_rxtx::sender_loop() {
         set_thread_name(__func__);
+        ug_numa_bind_thread();
         struct video_desc saved_vid_desc;
 
         memset(&saved_vid_desc, 0, sizeof(saved_vid_desc));
@@ -190,6 +198,21 @@ void *video_rxtx::sender_loop() {
                         break;
                 }
 
+                if (tx_frame->fragment) {
+                        // the fragments are collected also for the exporter
+                        shared_ptr<video_frame> whole = m_fragments.add(tx_frame.get());
+                        if (whole) {
+                                export_video(m_exporter, whole.get());
+                                m_frames_sent += 1;
+                        }
+                        if (accepts_fragments()) {
+                                send_frame(std::move(tx_frame));
+                        } else if (whole) {
+                                send_frame(std::move(whole));
+                        }
+                        continue;
+                }
+
                 export_video(m_exporter, tx_frame.get());
 
                 send_frame(std::move(tx_frame));
@@ -200,6 +223,102 @@ void *video_rxtx::sender_loop() {
         return NULL;
 }
 
+static void shared_frame_dispose(struct video_frame *frame)
+{
+        delete static_cast<shared_ptr<video_frame> *>(frame->callbacks.dispose_udata);
+        vf_free(frame);
+}
+
+/**
+ * Passes the frame through the layer filters (each layer continues from the
+ * previous one, so that a scale pyramid is computed once) and to the layer
+ * compressions that run in parallel in their own threads.
+ */
+void video_rxtx::send_simulcast(shared_ptr<video_frame> const &frame)
+{
+        shared_ptr<video_frame> in = frame;
+        for (auto &layer : m_simulcast_layers) {
+                if (in) {
+                        // the filter disposes its input - hold the reference
+                        struct video_frame *f = vf_alloc_desc(video_desc_from_frame(in.get()));
+                        for (unsigned i = 0; i < f->tile_count; ++i) {
+                                f->tiles[i].data = in->tiles[i].data;
+                                f->tiles[i].data_len = in->tiles[i].data_len;
+                        }
+                        f->flags = in->flags;
+                        f->timestamp = in->timestamp;
+                        f->seq = in->seq;
+                        f->callbacks.dispose_udata = new shared_ptr<video_frame>(in);
+                        f->callbacks.dispose = shared_frame_dispose;
+                        struct video_frame *out = capture_filter(layer.filter, f);
+                        if (out == nullptr) {
+                                return; // frame dropped by the filter
+                        }
+                        in = shared_ptr<video_frame>(out, [](struct video_frame *frame) {
+                                VIDEO_FRAME_DISPOSE(frame);
+                        });
+                }
+                layer.rxtx->send(in);
+        }
+}
+
+ADD_TO_PARAM("video-simulcast", "* video-simulcast=<filter>@<compression>[@<port>][+...]\n"
+                "  Send also additional layers of the captured video (UltraGrid RTP only), eg.\n"
+                "  'resize:1280x720@libavcodec:codec=H.264:bitrate=2M'. The capture filter of\n"
+                "  the layer is applied to the output of the previous one. Without <port> the\n"
+                "  layer is sent to the same port with own SSRC (to be selected by a reflector).\n");
+bool video_rxtx::init_simulcast(const char *cfg, map<string, param_u> const &params)
+{
+        auto vri = static_cast<const video_rxtx_info *>(load_library("ultragrid_rtp", LIBRARY_CLASS_VIDEO_RXTX, VIDEO_RXTX_ABI_VERSION));
+        if (vri == nullptr) {
+                return false;
+        }
+        string tmp = cfg;
+        char *save_ptr = nullptr;
+        for (char *item = strtok_r(tmp.data(), "+", &save_ptr); item != nullptr;
+                        item = strtok_r(nullptr, "+", &save_ptr)) {
+                char *compression = strchr(item, '@');
+                if (compression == nullptr) {
+                        log_msg(LOG_LEVEL_ERROR, "[simulcast] Wrong layer config: %s!\n", item);
+                        return false;
+                }
+                *compression++ = '\0';
+                auto layer_params = params;
+                layer_params["compression"].str = compression;
+                layer_params["rxtx_mode"].i = MODE_SENDER;
+                layer_params["rx_port"].i = 0;
+                layer_params["exporter"].ptr = nullptr;
+                layer_params["display_device"].ptr = nullptr;
+                if (char *port = strchr(compression, '@')) {
+                        *port++ = '\0';
+                        layer_params["tx_port"].i = atoi(port);
+                }
+
+                simulcast_layer layer{};
+                if (capture_filter_init(m_parent, item, &layer.filter) != 0) {
+                        log_msg(LOG_LEVEL_ERROR, "[simulcast] Cannot initialize filter %s!\n", item);
+                        return false;
+                }
+                try {
+                        layer.rxtx = std::unique_ptr<video_rxtx>(vri->create(layer_params));
+                } catch (...) {
+                        capture_filter_destroy(layer.filter);
+                        throw;
+                }
+                if (!layer.rxtx) {
+                        capture_filter_destroy(layer.filter);
+                        return false;
+                }
+                layer.rxtx->m_port_id = "simulcast" + std::to_string(m_simulcast_layers.size() + 1);
+                layer.rxtx->start();
+                log_msg(LOG_LEVEL_INFO, "[simulcast] Layer %zu: %s, %s, port %d.\n",
+                                m_simulcast_layers.size() + 1, item, compression,
+                                layer_params.at("tx_port").i);
+                m_simulcast_layers.push_back(std::move(layer));
+        }
+        return true;
+}
+
 video_rxtx *video_rxtx::create(string const & proto, std::map<std::string, param_u> const &params)
 {
         auto vri = static_cast<const video_rxtx_info *>(load_library(proto.c_str(), LIBRARY_CLASS_VIDEO_RXTX, VIDEO_RXTX_ABI_VERSION));
@@ -210,6 +329,25 @@ video_rxtx *video_rxtx::create(string const & proto, std::map<std::string, param
         if (!ret) {
                 return nullptr;
         }
+        auto simulcast = params.find("simulcast");
+        if (simulcast != params.end() && simulcast->second.str != nullptr) {
+                if (proto != "ultragrid_rtp" || (ret->m_rxtx_mode & MODE_SENDER) == 0) {
+                        log_msg(LOG_LEVEL_ERROR, "[simulcast] Only UltraGrid RTP sender supports simulcast!\n");
+                        delete ret;
+                        return nullptr;
+                }
+                bool ok = false;
+                try {
+                        ok = ret->init_simulcast(simulcast->second.str, params);
+                } catch (...) {
+                        delete ret;
+                        throw;
+                }
+                if (!ok) {
+                        delete ret;
+                        return nullptr;
+                }
+        }
         ret->start();
         return ret;
 }
@@ -42,11 +42,14 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "module.h"
+#include "utils/vf_split.h"
 
-#define VIDEO_RXTX_ABI_VERSION 3
+#define VIDEO_RXTX_ABI_VERSION 4
 
+struct capture_filter;
 struct display;
 struct module;
 struct video_compress;
@@ -102,9 +105,13 @@ protected:
 private:
         void start();
         virtual void send_frame(std::shared_ptr<video_frame>) noexcept = 0;
+        /// @retval true send_frame() accepts frame fragments (video_frame::fragment)
+        virtual bool accepts_fragments() const noexcept { return false; }
         virtual void *(*get_receiver_thread() noexcept)(void *arg) = 0;
         static void *sender_thread(void *args);
         void *sender_loop();
+        bool init_simulcast(const char *cfg, std::map<std::string, param_u> const &params);
+        void send_simulcast(std::shared_ptr<struct video_frame> const &frame);
         virtual struct response *process_sender_message(struct msg_sender *) {
                 return NULL;
         }
@@ -112,9 +119,18 @@ private:
         struct compress_state *m_compression;
         pthread_mutex_t m_lock;
         struct exporter *m_exporter;
+        vf_fragment_assembler m_fragments;
 
         pthread_t m_thread_id;
         bool m_poisoned, m_joined;
+
+        /// additional stream of the same capture sent by own video_rxtx, the
+        /// input of each layer is the output of the previous layer filter
+        struct simulcast_layer {
+                struct capture_filter *filter;
+                std::unique_ptr<video_rxtx> rxtx;
+        };
+        std::vector<simulcast_layer> m_simulcast_layers;
 };
 
 class video_rxtx_loader {
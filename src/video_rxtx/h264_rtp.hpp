@@ -53,6 +53,7 @@ public:
         void join() override;
 private:
         virtual void send_frame(std::shared_ptr<video_frame>) noexcept override;
+        bool accepts_fragments() const noexcept override { return true; }
         virtual void *(*get_receiver_thread() noexcept)(void *arg) override {
                 return NULL;
         }
@@ -92,6 +92,7 @@ rtp_video_rxtx::process_sender_message(struct msg_sender *msg)
                 }
                 MSG(NOTICE, "Changed receiver to %s.\n", msg->receiver);
                 destroy_rtp_device(old_device);
+                tx_probe_path_mtu(m_tx, m_network_device);
         } break;
         case SENDER_MSG_CHANGE_PORT: {
                 assert(m_rxtx_mode == MODE_SENDER); // sender only
@@ -118,6 +119,7 @@ rtp_video_rxtx::process_sender_message(struct msg_sender *msg)
                 }
                 MSG(NOTICE, "Changed TX port to %d.\n", msg->tx_port);
                 destroy_rtp_device(old_device);
+                tx_probe_path_mtu(m_tx, m_network_device);
         } break;
         case SENDER_MSG_CHANGE_FEC: {
                 lock_guard<mutex> lock(m_network_devices_lock);
@@ -169,11 +171,34 @@ rtp_video_rxtx::process_sender_message(struct msg_sender *msg)
                         return new_response(RESPONSE_INT_SERV_ERR, nullptr);
                 }
                 destroy_rtp_device(old_device);
+                tx_probe_path_mtu(m_tx, m_network_device);
                 MSG(NOTICE,
                     "Changed SSRC from 0x%08" PRIx32 " to "
                     "0x%08" PRIx32 ".\n",
                     old_ssrc, rtp_my_ssrc(m_network_device));
         } break;
+        case SENDER_MSG_ADD_RECEIVER: {
+                lock_guard<mutex> lock(m_network_devices_lock);
+                if (!rtp_add_destination(m_network_device, msg->dest.addr,
+                                         msg->dest.rtp_port,
+                                         msg->dest.rtcp_port)) {
+                        MSG(ERROR, "Cannot add receiver %s:%d.\n",
+                            msg->dest.addr, msg->dest.rtp_port);
+                        return new_response(RESPONSE_INT_SERV_ERR, nullptr);
+                }
+                MSG(NOTICE, "Added receiver %s:%d.\n", msg->dest.addr,
+                    msg->dest.rtp_port);
+        } break;
+        case SENDER_MSG_REMOVE_RECEIVER: {
+                lock_guard<mutex> lock(m_network_devices_lock);
+                if (!rtp_remove_destination(m_network_device, msg->dest.addr,
+                                            msg->dest.rtp_port,
+                                            msg->dest.rtcp_port)) {
+                        return new_response(RESPONSE_NOT_FOUND, nullptr);
+                }
+                MSG(NOTICE, "Removed receiver %s:%d.\n", msg->dest.addr,
+                    msg->dest.rtp_port);
+        } break;
         case SENDER_MSG_GET_STATUS:
         case SENDER_MSG_MUTE:
         case SENDER_MSG_UNMUTE:
@@ -215,6 +240,9 @@ rtp_video_rxtx::rtp_video_rxtx(map<string, param_u> const &params) :
                                         params.at("bitrate").ll)) == NULL) {
                 throw ug_runtime_error("Unable to initialize transmitter", EXIT_FAIL_TRANSMIT);
         }
+        if ((m_rxtx_mode & MODE_SENDER) != 0) {
+                tx_probe_path_mtu(m_tx, m_network_device);
+        }
 
         // The idea of doing that is to display help on '-f ldgm:help' even if UG would exit
         // immediatelly. The encoder is actually created by a message.
@@ -264,6 +292,8 @@ void rtp_video_rxtx::display_buf_increase_warning(int size)
 
 }
 
+ADD_TO_PARAM("rtp-packet-pool", "* rtp-packet-pool\n"
+                "  Allocate received video packets from a per-session pool instead of malloc\n");
 struct rtp *rtp_video_rxtx::initialize_network(const char *addr, int recv_port,
                 int send_port, struct pdb *participants, int force_ip_version,
                 const char *mcast_if, int ttl)
@@ -285,6 +315,9 @@ struct rtp *rtp_video_rxtx::initialize_network(const char *addr, int recv_port,
         }
         rtp_set_option(device, RTP_OPT_WEAK_VALIDATION, TRUE);
         rtp_set_option(device, RTP_OPT_PROMISC, TRUE);
+        if (get_commandline_param("rtp-packet-pool") != nullptr) {
+                rtp_set_option(device, RTP_OPT_PACKET_POOL, TRUE);
+        }
         rtp_set_sdes(device, rtp_my_ssrc(device),
                      RTCP_SDES_TOOL, PACKAGE_STRING, strlen(PACKAGE_STRING));
         if (strcmp(addr, IN6_BLACKHOLE_SERVER_MODE_STR) == 0) {
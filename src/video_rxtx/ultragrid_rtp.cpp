@@ -56,6 +56,7 @@
 #include "module.h"
 #include "pdb.h"
 #include "rtp/ldgm.h"
+#include "rtp/net_udp.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
 #include "rtp/video_decoders.h"
@@ -63,8 +64,13 @@
 #include "tfrc.h"
 #include "transmit.h"
 #include "tv.h"
+#include "utils/frame_trace.h"
+#include "utils/macros.h"
+#include "utils/metrics.h"
+#include "utils/numa.h"
 #include "utils/thread.h"
 #include "utils/vf_split.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_compress.h"
 #include "video_decompress.h"
@@ -72,21 +78,228 @@
 #include "video_rxtx.hpp"
 #include "video_rxtx/ultragrid_rtp.hpp"
 #include "ug_runtime_error.hpp"
-#include "utils/worker.h"
 
 #include <chrono>
+#include <cinttypes>
 #include <sstream>
 #include <utility>
 
+#define DEFAULT_ADAPTIVE_DELAY_MIN_MS 1
+#define DEFAULT_ADAPTIVE_DELAY_MAX_MS 100
+#define DEFAULT_ARQ_PACKETS 8192
+#define MAX_NACKS_PER_ITERATION 256
+#define RX_DROPS_CHECK_INTERVAL_NS (5 * NS_IN_SEC)
+/// recv buffer is not auto-increased above this on kernel drops
+#define RX_AUTO_RECV_BUF_MAX (256 * 1024 * 1024)
+/// receiver wait without a pending pbuf event (the loop is woken by packets
+/// and messages, this bounds the reaction to m_should_exit and housekeeping)
+#define RX_MAX_WAIT_NS (100 * NS_IN_MS)
+/// RTCP socket is not waited on by rtp_recv_r(), poll it with rtcp-inline
+#define RX_RTCP_INLINE_MAX_WAIT_NS NS_IN_MS
+/// frames waiting for the send stage (see tx-send-queue)
+#define DEFAULT_SEND_QUEUE_LEN 1
+#define RX_OVERLOAD_CHECK_INTERVAL_NS NS_IN_SEC
+/// per mille of frames dropped by a busy decoder/display considered overload
+#define RX_OVERLOAD_THRESHOLD 50
+/// consecutive intervals over (below) the threshold to start (stop) reporting
+#define RX_OVERLOAD_SUSTAIN 2
+
 using namespace std;
 
+/**
+ * Watches the receive-side drops below the playout buffer (kernel socket
+ * buffer overflows and the UDP reader queue), the playout buffer drops are
+ * reported by pbuf itself.
+ */
+struct rx_drops_monitor {
+        struct udp_rx_drops last{};
+        time_ns_t last_check = 0;
+        bool recv_buf_limited = false; ///< recv buffer cannot be increased further
+        struct metric *socket = metric_register(
+            METRIC_COUNTER, "ug_rx_socket_drops",
+            "Packets dropped by the kernel (socket buffer overflow).", nullptr);
+        struct metric *queue_full = metric_register(
+            METRIC_COUNTER, "ug_rx_reader_queue_full",
+            "UDP reader thread stalls on a full queue (udp-queue-len).", nullptr);
+
+        ~rx_drops_monitor() {
+                metric_unregister(socket);
+                metric_unregister(queue_full);
+        }
+        /// increases the recv buffer (up to RX_AUTO_RECV_BUF_MAX) on kernel drops
+        void check(struct rtp *dev, time_ns_t now, int *recv_buf_size,
+                   struct control_state *control);
+};
+
+void rx_drops_monitor::check(struct rtp *dev, time_ns_t now, int *recv_buf_size,
+                             struct control_state *control)
+{
+        if (now - last_check < RX_DROPS_CHECK_INTERVAL_NS) {
+                return;
+        }
+        last_check = now;
+        struct udp_rx_drops cur{};
+        rtp_get_rx_drops(dev, &cur);
+        if (cur.socket < last.socket || cur.queue_full < last.queue_full) {
+                last = {}; // device was recreated
+        }
+        const long long socket_drops = cur.socket > 0 ? cur.socket - max(last.socket, 0LL) : 0;
+        const long long queue_stalls = cur.queue_full - last.queue_full;
+        last = cur;
+        metric_inc(socket, socket_drops);
+        metric_inc(queue_full, queue_stalls);
+        ostringstream oss;
+        oss << "rx_drops socket " << cur.socket << " queue_full " << cur.queue_full;
+        control_report_stats(control, oss.str());
+        if (socket_drops == 0 && queue_stalls == 0) {
+                return;
+        }
+        log_msg(LOG_LEVEL_WARNING, "[RTP] Receive drops in last %d s: %lld in the kernel "
+                        "(socket buffer), reader queue full %lld times.\n",
+                        (int) (RX_DROPS_CHECK_INTERVAL_NS / NS_IN_SEC), socket_drops, queue_stalls);
+        if (queue_stalls > 0) {
+                log_msg(LOG_LEVEL_WARNING, "[RTP] The receiver doesn't keep up with the UDP "
+                                "reader, consider increasing --param udp-queue-len.\n");
+        }
+        if (socket_drops == 0 || recv_buf_limited) {
+                return;
+        }
+        const int new_size = (int) min<long long>(2LL * max(*recv_buf_size, 1),
+                                                 RX_AUTO_RECV_BUF_MAX);
+        if (new_size <= *recv_buf_size) {
+                recv_buf_limited = true;
+                return;
+        }
+        if (rtp_set_recv_buf(dev, new_size)) {
+                log_msg(LOG_LEVEL_NOTICE, "[RTP] Increased recv buffer to %d B.\n", new_size);
+                *recv_buf_size = new_size;
+        } else {
+                rtp_video_rxtx::display_buf_increase_warning(new_size);
+                recv_buf_limited = true;
+        }
+}
+
+/**
+ * Reports sustained decoder/display overload of the individual senders
+ * with rtp_send_overload_report() so that they can reduce the stream
+ * instead of us dropping the frames after receiving and FEC-decoding them.
+ * While overloaded, the report is repeated each interval (the sender
+ * restores the stream when the reports stop), recovery is announced with
+ * level 0.
+ */
+struct rx_overload_monitor {
+        struct source {
+                unsigned long frames = 0;
+                unsigned long drops = 0;
+                time_ns_t last_check = 0;
+                int over = 0;  ///< consecutive intervals over the threshold
+                int under = 0; ///< consecutive intervals below the threshold
+                bool reporting = false;
+        };
+        map<uint32_t, source> sources;
+
+        void check(struct rtp *dev, uint32_t ssrc, struct state_video_decoder *decoder,
+                   time_ns_t now);
+};
+
+void rx_overload_monitor::check(struct rtp *dev, uint32_t ssrc,
+                                struct state_video_decoder *decoder, time_ns_t now)
+{
+        source &src = sources[ssrc];
+        if (now - src.last_check < RX_OVERLOAD_CHECK_INTERVAL_NS) {
+                return;
+        }
+        unsigned long frames = 0;
+        unsigned long drops = 0;
+        video_decoder_get_busy_drops(decoder, &frames, &drops);
+        const unsigned long frames_diff = frames - src.frames;
+        const unsigned long drops_diff = drops - src.drops;
+        const bool first = src.last_check == 0;
+        src.frames = frames;
+        src.drops = drops;
+        src.last_check = now;
+        if (first || frames_diff == 0) {
+                return;
+        }
+        const int level = (int) min(1000UL, drops_diff * 1000 / frames_diff);
+        if (level >= RX_OVERLOAD_THRESHOLD) {
+                src.over += 1;
+                src.under = 0;
+        } else {
+                src.under += 1;
+                src.over = 0;
+        }
+        if (!src.reporting && src.over >= RX_OVERLOAD_SUSTAIN) {
+                log_msg(LOG_LEVEL_WARNING, "[RTP] Dropping %.1f%% of frames from 0x%08" PRIx32
+                                " (decoder or display busy), asking the sender to reduce the stream.\n",
+                                level / 10.0, ssrc);
+                src.reporting = true;
+        } else if (src.reporting && src.under >= RX_OVERLOAD_SUSTAIN) {
+                log_msg(LOG_LEVEL_NOTICE, "[RTP] Keeping up with 0x%08" PRIx32 " again.\n", ssrc);
+                rtp_send_overload_report(dev, ssrc, 0);
+                src.reporting = false;
+        }
+        if (src.reporting) {
+                rtp_send_overload_report(dev, ssrc, level);
+        }
+}
+
+/// decoding of one participant's playout buffer in receiver_loop()
+struct rx_decode_job {
+        struct pdb_e *cp;
+        time_ns_t now;
+        bool decoded; ///< a frame was passed to the decoder
+};
+
+static void rx_decode_participants(size_t start, size_t end, void *udata)
+{
+        auto *jobs = (struct rx_decode_job *) udata;
+        for (size_t i = start; i < end; ++i) {
+                jobs[i].decoded = pbuf_decode(jobs[i].cp->playout_buffer, jobs[i].now,
+                                decode_video_frame, jobs[i].cp->decoder_state) != 0;
+        }
+}
+
 ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &params) :
         rtp_video_rxtx(params), m_send_bytes_total(0)
 {
         m_decoder_mode = (enum video_mode) params.at("decoder_mode").l;
         m_display_device = (struct display *) params.at("display_device").ptr;
         m_requested_encryption = (const char *) params.at("encryption").ptr;
-        m_async_sending = false;
+        if (get_commandline_param("tx-zerocopy") != nullptr) {
+                if (m_requested_encryption != nullptr) {
+                        log_msg(LOG_LEVEL_WARNING, "Zero-copy send is not available with encryption.\n");
+                } else {
+                        m_zerocopy = true;
+                }
+        }
+
+        if (const char *adaptive = get_commandline_param("video-adaptive-delay")) {
+                m_adaptive_delay_min = DEFAULT_ADAPTIVE_DELAY_MIN_MS / 1000.0;
+                m_adaptive_delay_max = DEFAULT_ADAPTIVE_DELAY_MAX_MS / 1000.0;
+                if (strlen(adaptive) > 0) {
+                        double min_ms = 0;
+                        double max_ms = 0;
+                        if (sscanf(adaptive, "%lf:%lf", &min_ms, &max_ms) != 2 ||
+                            min_ms < 0 || max_ms < min_ms || max_ms == 0) {
+                                throw ug_runtime_error("Wrong video-adaptive-delay "
+                                                       "bounds: "s + adaptive + "\n");
+                        }
+                        m_adaptive_delay_min = min_ms / 1000.0;
+                        m_adaptive_delay_max = max_ms / 1000.0;
+                }
+        }
+
+        if (const char *arq = get_commandline_param("rtp-arq")) {
+                m_arq_packets = strlen(arq) > 0 ? atoi(arq) : DEFAULT_ARQ_PACKETS;
+                if (m_arq_packets <= 0) {
+                        throw ug_runtime_error("Wrong rtp-arq buffer size: "s + arq + "\n");
+                }
+        }
+
+        if (const char *stripes = get_commandline_param("video-stripe")) {
+                init_stripes(stripes);
+        }
 
         if (get_commandline_param("decoder-use-codec") != nullptr && "help"s == get_commandline_param("decoder-use-codec")) {
                 destroy_video_decoder(new_video_decoder(m_display_device));
@@ -94,20 +307,98 @@ ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &p
         }
 
         m_control = (struct control_state *) get_module(get_root_module(static_cast<struct module *>(params.at("parent").ptr)), "control");
+
+        if ((m_rxtx_mode & MODE_RECEIVER) != 0) {
+                m_receiver_mod.priv_data = this;
+                pthread_mutex_lock(&m_receiver_mod.lock);
+                m_receiver_mod.new_message = receiver_new_message;
+                pthread_mutex_unlock(&m_receiver_mod.lock);
+        }
+
+        if ((m_rxtx_mode & MODE_SENDER) != 0) {
+                int queue_len = DEFAULT_SEND_QUEUE_LEN;
+                if (const char *len = get_commandline_param("tx-send-queue")) {
+                        queue_len = atoi(len);
+                        if (queue_len <= 0) {
+                                throw ug_runtime_error("Wrong tx-send-queue length: "s + len + "\n");
+                        }
+                }
+                m_send_queue.set_max_len(queue_len);
+                m_send_thread = thread(&ultragrid_rtp_video_rxtx::send_loop, this);
+        }
+}
+
+/// wakes the receiver loop to process the message immediately
+void ultragrid_rtp_video_rxtx::receiver_new_message(struct module *mod)
+{
+        auto *s = static_cast<ultragrid_rtp_video_rxtx *>(mod->priv_data);
+        lock_guard<mutex> lock(s->m_network_devices_lock);
+        rtp_recv_wake(s->m_network_device);
 }
 
 ultragrid_rtp_video_rxtx::~ultragrid_rtp_video_rxtx()
 {
+        pthread_mutex_lock(&m_receiver_mod.lock);
+        m_receiver_mod.new_message = nullptr;
+        pthread_mutex_unlock(&m_receiver_mod.lock);
+        stop_send_thread();
+        for (auto *stripe : m_stripes) {
+                rtp_done(stripe); // no BYE - the SSRC is the one of m_network_device
+        }
         for (auto d : m_display_copies) {
                 display_done(d);
         }
 }
 
+/**
+ * Creates additional RTP sessions for the video-stripe links, the packets of
+ * the stream of m_network_device are distributed over them and the original
+ * session by tx_send_striped().
+ */
+void ultragrid_rtp_video_rxtx::init_stripes(const char *cfg)
+{
+        string tmp = cfg;
+        char *save_ptr = nullptr;
+        for (char *addr = strtok_r(tmp.data(), "+", &save_ptr); addr != nullptr;
+                        addr = strtok_r(nullptr, "+", &save_ptr)) {
+                const char *iface = m_requested_mcast_if;
+                if (char *delim = strchr(addr, '@')) {
+                        *delim = '\0';
+                        iface = delim + 1;
+                }
+                struct rtp *stripe = rtp_init_if(addr, iface, 0, m_send_port_number,
+                                m_requested_ttl, 5 * 1024 * 1024, FALSE, rtp_recv_callback,
+                                (uint8_t *) m_participants, m_force_ip_version, false);
+                if (stripe == nullptr) {
+                        throw ug_runtime_error("Cannot initialize video stripe "s + addr + "!\n",
+                                        EXIT_FAIL_NETWORK);
+                }
+                // the own SSRC is going to be replaced by the striped one
+                struct pdb_e *item = nullptr;
+                if (pdb_remove(m_participants, rtp_my_ssrc(stripe), &item) == 0) {
+                        pdb_destroy_item(item);
+                }
+                rtp_set_option(stripe, RTP_OPT_WEAK_VALIDATION, TRUE);
+                rtp_set_send_buf(stripe, INITIAL_VIDEO_SEND_BUFFER_SIZE);
+                m_stripes.push_back(stripe);
+                log_msg(LOG_LEVEL_INFO, "[RTP] Video is striped also to %s:%d.\n",
+                                addr, m_send_port_number);
+        }
+}
+
 void ultragrid_rtp_video_rxtx::join()
 {
         video_rxtx::join();
-        unique_lock<mutex> lk(m_async_sending_lock);
-        m_async_sending_cv.wait(lk, [this]{return !m_async_sending;});
+        stop_send_thread();
+}
+
+/// sends the frames queued - the last one is sent before the thread exits
+void ultragrid_rtp_video_rxtx::stop_send_thread()
+{
+        if (m_send_thread.joinable()) {
+                m_send_queue.push({});
+                m_send_thread.join();
+        }
 }
 
 void *ultragrid_rtp_video_rxtx::receiver_thread(void *arg) {
@@ -125,37 +416,87 @@ ultragrid_rtp_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame) noexcept
 {
         m_video_desc = video_desc_from_frame(tx_frame.get());
         if (m_fec_state) {
+                const struct frame_trace_stamps stamps = frame_trace_save(tx_frame.get());
                 tx_frame = m_fec_state->encode(tx_frame);
+                if (tx_frame) {
+                        frame_trace_restore(tx_frame.get(), stamps);
+                        frame_trace_event(stamps.trace_id, FRAME_TRACE_FEC);
+                }
         }
 
-        auto data = new pair<ultragrid_rtp_video_rxtx *, shared_ptr<video_frame>>(this, tx_frame);
-
-        unique_lock<mutex> lk(m_async_sending_lock);
-        m_async_sending_cv.wait(lk, [this]{return !m_async_sending;});
-        m_async_sending = true;
-        task_run_async_detached(ultragrid_rtp_video_rxtx::send_frame_async_callback,
-                        (void *) data);
+        if (!tx_frame) { // FEC may have not produced output
+                return;
+        }
+        // blocks if the send stage is behind (up to tx-send-queue frames)
+        m_send_queue.push(std::move(tx_frame));
 }
 
-void *ultragrid_rtp_video_rxtx::send_frame_async_callback(void *arg) {
-        auto data = (pair<ultragrid_rtp_video_rxtx *, shared_ptr<video_frame>> *) arg;
-
-        data->first->send_frame_async(data->second);
-        delete data;
-
-        return NULL;
+void ultragrid_rtp_video_rxtx::send_loop()
+{
+        set_thread_name("video_send");
+        while (shared_ptr<video_frame> tx_frame = m_send_queue.pop()) {
+                send_frame_async(std::move(tx_frame));
+        }
 }
 
 
+ADD_TO_PARAM("video-adaptive-delay", "* video-adaptive-delay[=<min_ms>:<max_ms>]\n"
+                "  Adapt video playout delay to measured jitter and frame completion latency\n"
+                "  within given bounds (default " TOSTRING(DEFAULT_ADAPTIVE_DELAY_MIN_MS) ":"
+                TOSTRING(DEFAULT_ADAPTIVE_DELAY_MAX_MS) " ms) instead of fixed frame time.\n");
+ADD_TO_PARAM("tx-zerocopy", "* tx-zerocopy\n"
+                "  Send video with MSG_ZEROCOPY (Linux) - frame data are not copied to the kernel but\n"
+                "  the sender waits until the NIC completes the transmission. Worthwhile for large\n"
+                "  (uncompressed) frames with GSO (udp-gso) or jumbo frames.\n");
+ADD_TO_PARAM("rtp-arq", "* rtp-arq[=<packets>]\n"
+                "  Selective retransmission of lost video packets - the receiver requests\n"
+                "  the packets that can still arrive before the frame playout time (RTCP\n"
+                "  NACK), sender keeps last <packets> (default " TOSTRING(DEFAULT_ARQ_PACKETS) ").\n"
+                "  Must be set on both sides, can be combined with FEC.\n");
+ADD_TO_PARAM("rtcp-inline", "* rtcp-inline\n"
+                "  Process RTCP of the received video in the receiving thread instead of own one.\n");
+ADD_TO_PARAM("tx-send-queue", "* tx-send-queue=<frames>\n"
+                "  Number of frames (default " TOSTRING(DEFAULT_SEND_QUEUE_LEN) ") that may wait for the video send stage\n"
+                "  (encryption, pacing, send) while next ones are processed (FEC).\n");
+ADD_TO_PARAM("video-stripe", "* video-stripe=<addr>[@<iface>][+<addr>[@<iface>]...]\n"
+                "  Stripe video packets round-robin also over given additional links (eg. NICs\n"
+                "  with receiver addresses <addr>), <iface> chooses the interface for multicast.\n"
+                "  The receiver reassembles one stream, only must listen on all the addresses.\n");
 void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame)
 {
         lock_guard<mutex> lock(m_network_devices_lock);
 
-        tx_send(m_tx, tx_frame.get(), m_network_device);
+        if (m_zerocopy && !rtp_zerocopy_enabled(m_network_device)) {
+                // (re)enable also for the device recreated by a control message
+                m_zerocopy = rtp_enable_zerocopy(m_network_device);
+        }
+        if (m_arq_packets > 0 && rtp_get_rtx_overhead(m_network_device) == 0 &&
+                        !rtp_enable_rtx(m_network_device, m_arq_packets)) {
+                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('A', 'R', 'Q', 'S'),
+                                "Cannot enable packet retransmission!\n");
+        }
+        if (m_stripes.empty()) {
+                tx_send(m_tx, tx_frame.get(), m_network_device);
+        } else {
+                vector<struct rtp *> sessions{ m_network_device };
+                for (auto *stripe : m_stripes) {
+                        // the device may have been recreated by a control message
+                        if (!rtp_set_stream_owner(stripe, m_network_device)) {
+                                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('S', 'T', 'R', 'P'),
+                                                "Cannot reassign video stripe!\n");
+                                continue;
+                        }
+                        sessions.push_back(stripe);
+                }
+                tx_send_striped(m_tx, tx_frame.get(), sessions.data(), (int) sessions.size());
+        }
+        // keep the frame (returned to its pool when tx_frame is released)
+        // until the NIC is done with it
+        rtp_zerocopy_wait(m_network_device);
 
         if ((m_rxtx_mode & MODE_RECEIVER) == 0) { // otherwise receiver thread does the stuff...
                 time_ns_t curr_time = get_time_in_ns();
-                uint32_t ts = (curr_time - m_start_time) / 100'000 * 9; // at 90000 Hz
+                uint32_t ts = get_local_mediatime(); // same timeline as the data (SR NTP <-> RTP mapping)
                 rtp_update(m_network_device, curr_time);
                 rtp_send_ctrl(m_network_device, ts, nullptr, curr_time);
 
@@ -166,11 +507,6 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
                         ret = rtcp_recv_r(m_network_device, &timeout, ts);
                 } while (!m_should_exit && ret);
         }
-
-        m_async_sending_lock.lock();
-        m_async_sending = false;
-        m_async_sending_lock.unlock();
-        m_async_sending_cv.notify_all();
 }
 
 void ultragrid_rtp_video_rxtx::receiver_process_messages()
@@ -276,9 +612,13 @@ struct vcodec_state *ultragrid_rtp_video_rxtx::new_video_decoder(struct display
 void *ultragrid_rtp_video_rxtx::receiver_loop()
 {
         set_thread_name(__func__);
+        ug_numa_bind_thread();
         struct pdb_e *cp;
         int fr;
         int last_buf_size = rtp_get_recv_buf(m_network_device);
+        rx_drops_monitor drops_monitor;
+        rx_overload_monitor overload_monitor;
+        vector<rx_decode_job> decode_jobs;
 
 #ifdef SHARED_DECODER
         struct vcodec_state *shared_decoder = new_video_decoder(m_display_device);
@@ -291,16 +631,24 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
 
         fr = 1;
 
-        time_ns_t last_not_timeout = 0;
+        // RTCP is processed by own thread unless requested otherwise
+        bool rtcp_inline = get_commandline_param("rtcp-inline") != nullptr;
 
+        time_ns_t next_event = 0; // earliest pbuf deadline
         while (!m_should_exit) {
                 struct timeval timeout;
                 /* Housekeeping and RTCP... */
                 time_ns_t curr_time = get_time_in_ns();
-                uint32_t ts = (m_start_time - curr_time) / 100'000 * 9; // at 90000 Hz
+                uint32_t ts = get_local_mediatime(); // same timeline as the data (SR NTP <-> RTP mapping)
 
-                rtp_update(m_network_device, curr_time);
-                rtp_send_ctrl(m_network_device, ts, nullptr, curr_time);
+                // (re)started also for a device recreated by a message, no-op if running
+                if (!rtcp_inline && !rtp_ctrl_thread_start(m_network_device, get_local_mediatime)) {
+                        rtcp_inline = true;
+                }
+                if (rtcp_inline) {
+                        rtp_update(m_network_device, curr_time);
+                        rtp_send_ctrl(m_network_device, ts, nullptr, curr_time);
+                }
 
                 /* Receive packets from the network... The timeout is adjusted */
                 /* to match the video capture rate, so the transmitter works.  */
@@ -310,26 +658,27 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                         fr = 0;
                 }
 
+                // wait for a packet, a message (receiver_new_message()) or
+                // the next frame playout/removal/NACK deadline
+                const long long max_wait = rtcp_inline ? RX_RTCP_INLINE_MAX_WAIT_NS : RX_MAX_WAIT_NS;
+                const long long wait_ns = max(0LL, min<long long>(next_event - curr_time, max_wait));
                 timeout.tv_sec = 0;
-                //timeout.tv_usec = 999999 / 59.94;
-                // use longer timeout when we are not receivng any data
-                if ((curr_time - last_not_timeout) > NS_IN_SEC) {
-                        timeout.tv_usec = 100000;
-                } else {
-                        timeout.tv_usec = 1000;
-                }
+                timeout.tv_usec = (wait_ns + US_IN_NS - 1) / US_IN_NS;
                 const bool ret = rtp_recv_r(m_network_device, &timeout, ts);
+                curr_time = get_time_in_ns();
 
                 // timeout
                 if (!ret) {
                         // processing is needed here in case we are not receiving any data
                         receiver_process_messages();
                         //printf("Failed to receive data\n");
-                } else {
-                        last_not_timeout = curr_time;
                 }
 
+                drops_monitor.check(m_network_device, curr_time, &last_buf_size, m_control);
+
                 /* Decode and render for each participant in the conference... */
+                next_event = LLONG_MAX;
+                decode_jobs.clear();
                 pdb_iter_t it;
                 cp = pdb_iter_init(m_participants, &it);
                 while (cp != NULL) {
@@ -374,15 +723,37 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                                         break;
                                 }
 #endif // SHARED_DECODER
+                                pbuf_set_placement(cp->playout_buffer, &video_decoder_placement,
+                                                ((struct vcodec_state *) cp->decoder_state)->decoder);
+                                if (m_adaptive_delay_max > 0) {
+                                        pbuf_set_adaptive_delay(cp->playout_buffer,
+                                                        m_adaptive_delay_min, m_adaptive_delay_max);
+                                }
+                                if (m_arq_packets > 0) {
+                                        pbuf_enable_nack(cp->playout_buffer);
+                                }
                         }
 
-                        struct vcodec_state *vdecoder_state = (struct vcodec_state *) cp->decoder_state;
+                        decode_jobs.push_back({cp, curr_time, false});
+                        cp = pdb_iter_next(&it);
+                }
+                pdb_iter_done(&it);
 
-                        /* Decode and render video... */
-                        if (pbuf_decode
-                            (cp->playout_buffer, curr_time, decode_video_frame, vdecoder_state)) {
-                                fr = 1;
-                        }
+                /* Decode and render video... */
+                // the participants have own playout buffers and decoders so
+                // they are drained in parallel (the packets are inserted to
+                // the buffers by this thread, which waits here)
+#ifdef SHARED_DECODER
+                rx_decode_participants(0, decode_jobs.size(), decode_jobs.data());
+#else
+                task_parallel_for(decode_jobs.size(), 1, 0, rx_decode_participants,
+                                decode_jobs.data());
+#endif // SHARED_DECODER
+
+                for (auto &job : decode_jobs) {
+                        cp = job.cp;
+                        struct vcodec_state *vdecoder_state = (struct vcodec_state *) cp->decoder_state;
+                        fr = fr || job.decoded;
 
                         if(vdecoder_state && vdecoder_state->decoded % 100 == 99) {
                                 int new_size = vdecoder_state->max_frame_size * 110ull / 100;
@@ -396,10 +767,23 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                                 }
                         }
 
+                        if (vdecoder_state) {
+                                overload_monitor.check(m_network_device, cp->ssrc,
+                                                vdecoder_state->decoder, curr_time);
+                        }
+
+                        if (m_arq_packets > 0) {
+                                uint16_t seqs[MAX_NACKS_PER_ITERATION];
+                                const int count = pbuf_get_nacks(cp->playout_buffer, get_time_in_ns(),
+                                                seqs, MAX_NACKS_PER_ITERATION);
+                                if (count > 0) {
+                                        rtp_send_nack(m_network_device, cp->ssrc, seqs, count);
+                                }
+                        }
+
                         pbuf_remove(cp->playout_buffer, curr_time);
-                        cp = pdb_iter_next(&it);
+                        next_event = min(next_event, pbuf_next_event(cp->playout_buffer, curr_time));
                 }
-                pdb_iter_done(&it);
         }
 
 #ifdef SHARED_DECODER
@@ -41,11 +41,15 @@
 #include "video_rxtx.hpp"
 #include "video_rxtx/rtp.hpp"
 
-#include <condition_variable>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/synchronized_queue.h"
 
 struct control_state;
 
@@ -62,14 +66,17 @@ private:
         static void *receiver_thread(void *arg);
         virtual void send_frame(std::shared_ptr<video_frame>) noexcept override;
         void *receiver_loop();
-        static void *send_frame_async_callback(void *arg);
+        void send_loop();
         virtual void send_frame_async(std::shared_ptr<video_frame>);
+        void stop_send_thread();
         virtual void *(*get_receiver_thread() noexcept)(void *arg) override;
 
         void receiver_process_messages();
+        static void receiver_new_message(struct module *mod);
         void remove_display_from_decoders();
         struct vcodec_state *new_video_decoder(struct display *d);
         static void destroy_video_decoder(void *state);
+        void init_stripes(const char *cfg);
 
         enum video_mode  m_decoder_mode;
         struct display  *m_display_device;
@@ -78,13 +85,19 @@ private:
                                                       ///< multiple decoders, here are
                                                       ///< saved forked states
         const char      *m_requested_encryption;
+        bool             m_zerocopy = false; ///< tx-zerocopy requested
+        double           m_adaptive_delay_min = 0; ///< video-adaptive-delay bounds [s],
+        double           m_adaptive_delay_max = 0; ///< disabled if max is 0
+        int              m_arq_packets = 0; ///< rtp-arq retransmission buffer size, disabled if 0
+        std::vector<struct rtp *> m_stripes; ///< additional links of video-stripe
 
         /**
-         * This variables serve as a notification when asynchronous sending exits
+         * Send stage - frames processed by send_frame() (FEC) are sent
+         * (encrypted, paced) by m_send_thread, so that FEC of next frame
+         * overlaps with sending of the current one. Empty pointer stops the thread.
          * @{ */
-        bool             m_async_sending;
-        std::condition_variable m_async_sending_cv;
-        std::mutex       m_async_sending_lock;
+        synchronized_queue<std::shared_ptr<video_frame>, 1> m_send_queue;
+        std::thread      m_send_thread;
         /// @}
 
         long long int m_send_bytes_total;
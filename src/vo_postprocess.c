@@ -268,16 +268,16 @@ bool vo_postprocess_get_property(struct vo_postprocess_state *s, int property, v
 
         if (simple_linked_list_size(s->postprocessors) == 1 || property == VO_PP_DOES_CHANGE_TILING_MODE) {
                 struct vo_postprocess_state_single *state = simple_linked_list_last(s->postprocessors);
-                return state->funcs->get_property(state, property, val, len);
+                return state->funcs->get_property(state->state, property, val, len);
         }
 
         /** @todo
          * This is not corrrect in a generic case - the codec may be acceptable for first filter but
          * the output of the filter may be unacceptable for the following filter (or later on).
          */
-        if (property == VO_PP_PROPERTY_CODECS) {
+        if (property == VO_PP_PROPERTY_CODECS || property == VO_PP_PROPERTY_INPUT_ROI) {
                 struct vo_postprocess_state_single *state = simple_linked_list_first(s->postprocessors);
-                return state->funcs->get_property(state, property, val, len);
+                return state->funcs->get_property(state->state, property, val, len);
         }
 
         return false;
@@ -49,6 +49,7 @@ extern "C" {
 /*          property                               type                   default          */
 #define VO_PP_PROPERTY_CODECS                0 /*  codec_t[]          all uncompressed     */
 #define VO_PP_DOES_CHANGE_TILING_MODE        1 /*  bool                    false           */
+#define VO_PP_PROPERTY_INPUT_ROI             2 /*  struct video_roi        whole frame     */
 
 #define VO_PP_ABI_VERSION 7
 
@@ -62,10 +62,26 @@ struct state_crop {
         struct video_frame *in;
 };
 
+/// offsets clamped so that the cropped area fits into the frame
+static void get_offsets(const struct state_crop *s, int *xoff, int *yoff)
+{
+        *xoff = s->xoff + s->out_desc.width > s->in_desc.width ? (int) (s->in_desc.width - s->out_desc.width) : s->xoff;
+        *yoff = s->yoff + s->out_desc.height > s->in_desc.height ? (int) (s->in_desc.height - s->out_desc.height) : s->yoff;
+}
+
 static bool crop_get_property(void *state, int property, void *val, size_t *len)
 {
-        UNUSED(state), UNUSED(property), UNUSED(val), UNUSED(len);
-        return false;
+        struct state_crop *s = state;
+        if (property != VO_PP_PROPERTY_INPUT_ROI || s->in == NULL || *len < sizeof(struct video_roi)) {
+                return false;
+        }
+        int xoff = 0;
+        int yoff = 0;
+        get_offsets(s, &xoff, &yoff);
+        struct video_roi roi = { xoff, yoff, s->out_desc.width, s->out_desc.height };
+        memcpy(val, &roi, sizeof roi);
+        *len = sizeof roi;
+        return true;
 }
 
 static void usage(_Bool capture_filter) {
@@ -155,10 +171,11 @@ static bool crop_postprocess(void *state, struct video_frame *in, struct video_f
 
         struct state_crop *s = state;
         int src_linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
-        int xoff = s->xoff + out->tiles[0].width > in->tiles[0].width ? in->tiles[0].width - out->tiles[0].width : (unsigned) s->xoff;
+        int xoff = 0;
+        int yoff = 0;
+        get_offsets(s, &xoff, &yoff);
         int xoff_bytes = (int) (xoff * get_bpp(in->color_spec)) / get_pf_block_bytes(in->color_spec)
                 * get_pf_block_bytes(in->color_spec);
-        int yoff = s->yoff + out->tiles[0].height > in->tiles[0].height ? in->tiles[0].height - out->tiles[0].height : (unsigned) s->yoff;
 
         for (int y = 0 ; y < (int) out->tiles[0].height; y++) {
                 memcpy(out->tiles[0].data + y * req_pitch,
@@ -234,7 +251,8 @@ static const struct vo_postprocess_info vo_pp_crop_info = {
 static const struct capture_filter_info capture_filter_crop_info = {
         cf_crop_init,
         crop_done,
-        cf_crop_filter
+        cf_crop_filter,
+        NULL,
 };
 
 REGISTER_MODULE(crop, &vo_pp_crop_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
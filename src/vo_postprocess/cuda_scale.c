@@ -0,0 +1,234 @@
+/**
+ * @file   vo_postprocess/cuda_scale.c
+ *
+ * GPU scaler for displays that do not use OpenGL (DeckLink, NDI etc.). The
+ * input frame is uploaded once, scaled, converted and optionally
+ * deinterlaced by CUDA and downloaded directly to the display frame.
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "lib_common.h"
+#include "utils/color_out.h"
+#include "utils/cuda_scale.h"
+#include "utils/macros.h"
+#include "video.h"
+#include "video_display.h"
+#include "vo_postprocess.h"
+
+#define MOD_NAME "[cuda_scale] "
+
+struct state_cuda_scale {
+        int width;
+        int height;
+        codec_t out_codec;
+        enum cuda_scale_deint deint;
+
+        struct video_desc out_desc;
+        struct video_frame *in;
+        struct cuda_scale *scale;
+};
+
+static bool cuda_scale_pp_get_property(void *state, int property, void *val, size_t *len)
+{
+        UNUSED(state);
+        codec_t supported[] = { CUDA_SCALE_IN_PIXFMT_INIT };
+
+        if (property != VO_PP_PROPERTY_CODECS) {
+                return false;
+        }
+        if (*len < sizeof supported) {
+                *len = 0;
+        } else {
+                memcpy(val, supported, sizeof supported);
+                *len = sizeof supported;
+        }
+        return true;
+}
+
+static void usage(void)
+{
+        color_printf("GPU (CUDA) scaling, pixel format conversion and deinterlacing. Intended for\n"
+                        "displays not using OpenGL, the result is downloaded directly to the display frame.\n\n");
+        color_printf("Usage:\n");
+        color_printf("\t" TBOLD(TRED("-p cuda_scale") "[:size=<w>x<h>][:codec=<c>][:deinterlace=bob|blend]") "\n\n");
+        color_printf("\t" TBOLD("size") "        - output size (default input size)\n");
+        color_printf("\t" TBOLD("codec") "       - output pixel format, display must support it (default same as input)\n");
+        color_printf("\t" TBOLD("deinterlace") " - " TBOLD("bob") " interpolates upper field, "
+                        TBOLD("blend") " averages adjacent lines\n\n");
+        color_printf("Supported input codecs:");
+        codec_t in_codecs[] = { CUDA_SCALE_IN_PIXFMT_INIT };
+        for (unsigned i = 0; i < sizeof in_codecs / sizeof in_codecs[0]; ++i) {
+                color_printf(" %s", get_codec_name(in_codecs[i]));
+        }
+        color_printf("\nSupported output codecs:");
+        codec_t out_codecs[] = { CUDA_SCALE_OUT_PIXFMT_INIT };
+        for (unsigned i = 0; i < sizeof out_codecs / sizeof out_codecs[0]; ++i) {
+                color_printf(" %s", get_codec_name(out_codecs[i]));
+        }
+        color_printf("\n\n");
+}
+
+static void *cuda_scale_pp_init(const char *config)
+{
+        if (strcmp(config, "help") == 0) {
+                usage();
+                return NULL;
+        }
+
+        struct state_cuda_scale *s = calloc(1, sizeof *s);
+        s->out_codec = VIDEO_CODEC_NONE;
+
+        char *tmp = strdup(config);
+        char *config_copy = tmp;
+        char *item = NULL;
+        char *save_ptr = NULL;
+        while ((item = strtok_r(config_copy, ":", &save_ptr))) {
+                config_copy = NULL;
+                if (strstr(item, "size=") == item && strchr(item, 'x') != NULL) {
+                        s->width = atoi(strchr(item, '=') + 1);
+                        s->height = atoi(strchr(item, 'x') + 1);
+                        if (s->width > 0 && s->height > 0) {
+                                continue;
+                        }
+                } else if (strstr(item, "codec=") == item) {
+                        s->out_codec = get_codec_from_name(strchr(item, '=') + 1);
+                        if (cuda_scale_supported(UYVY, s->out_codec)) {
+                                continue;
+                        }
+                } else if (strcmp(item, "deinterlace=bob") == 0) {
+                        s->deint = CUDA_SCALE_DEINT_BOB;
+                        continue;
+                } else if (strcmp(item, "deinterlace=blend") == 0) {
+                        s->deint = CUDA_SCALE_DEINT_BLEND;
+                        continue;
+                }
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong config: %s!\n", item);
+                free(tmp);
+                free(s);
+                return NULL;
+        }
+        free(tmp);
+
+        return s;
+}
+
+static bool cuda_scale_pp_reconfigure(void *state, struct video_desc desc)
+{
+        struct state_cuda_scale *s = state;
+
+        vf_free(s->in);
+        s->in = NULL;
+        cuda_scale_destroy(s->scale);
+
+        s->out_desc = desc;
+        if (s->width != 0) {
+                s->out_desc.width = s->width;
+                s->out_desc.height = s->height;
+        }
+        if (s->out_codec != VIDEO_CODEC_NONE) {
+                s->out_desc.color_spec = s->out_codec;
+        }
+        if (s->deint != CUDA_SCALE_DEINT_NONE && desc.interlacing == INTERLACED_MERGED) {
+                s->out_desc.interlacing = PROGRESSIVE;
+        }
+
+        s->scale = cuda_scale_init(desc.color_spec, desc.width, desc.height,
+                        s->out_desc.color_spec, s->out_desc.width, s->out_desc.height,
+                        s->out_desc.interlacing == desc.interlacing ? CUDA_SCALE_DEINT_NONE : s->deint);
+        if (s->scale == NULL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot initialize %s -> %s!\n",
+                                video_desc_to_string(desc), get_codec_name(s->out_desc.color_spec));
+                return false;
+        }
+
+        // the decoder writes directly to the page-locked upload buffer
+        s->in = vf_alloc_desc(desc);
+        s->in->tiles[0].data = (char *) cuda_scale_get_src_buffer(s->scale);
+
+        return true;
+}
+
+static struct video_frame *cuda_scale_pp_getf(void *state)
+{
+        struct state_cuda_scale *s = state;
+        return s->in;
+}
+
+static bool cuda_scale_pp_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
+{
+        struct state_cuda_scale *s = state;
+        UNUSED(in);
+        assert(in == s->in);
+        return cuda_scale_frame(s->scale, (unsigned char *) out->tiles[0].data, req_pitch);
+}
+
+static void cuda_scale_pp_done(void *state)
+{
+        struct state_cuda_scale *s = state;
+
+        vf_free(s->in);
+        cuda_scale_destroy(s->scale);
+        free(s);
+}
+
+static void cuda_scale_pp_get_out_desc(void *state, struct video_desc *out, int *in_display_mode, int *out_frames)
+{
+        *out = ((struct state_cuda_scale *) state)->out_desc;
+
+        *in_display_mode = DISPLAY_PROPERTY_VIDEO_MERGED;
+        *out_frames = 1;
+}
+
+static const struct vo_postprocess_info vo_pp_cuda_scale_info = {
+        cuda_scale_pp_init,
+        cuda_scale_pp_reconfigure,
+        cuda_scale_pp_getf,
+        cuda_scale_pp_get_out_desc,
+        cuda_scale_pp_get_property,
+        cuda_scale_pp_postprocess,
+        cuda_scale_pp_done,
+};
+
+REGISTER_MODULE(cuda_scale, &vo_pp_cuda_scale_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
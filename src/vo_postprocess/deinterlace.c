@@ -46,6 +46,8 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/macros.h"     // for MIN
+#include "utils/parallel_conv.h"
 #include "video.h"
 #include "video_frame.h"
 #include "vo_postprocess.h"
@@ -147,6 +149,26 @@ static struct video_frame * deinterlace_getf(void *state)
         return s->out;
 }
 
+struct blend_job {
+        codec_t codec;
+        const unsigned char *in;
+        unsigned char *out;
+        size_t linesize;
+        int height;
+};
+
+/// blends lines y and y+1 to y (the last line is the same as the previous one)
+static void blend_rows(int y_start, int y_end, void *arg)
+{
+        const struct blend_job *j = arg;
+        for (int y = y_start; y < y_end; ++y) {
+                const int y1 = MIN(y, j->height - 2);
+                const unsigned char *src = j->in + (size_t) y1 * j->linesize;
+                vc_avg_lines(j->codec, j->linesize, src, src + j->linesize,
+                                j->out + (size_t) y * j->linesize);
+        }
+}
+
 static bool deinterlace_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
 {
         assert (req_pitch == vc_get_linesize(in->tiles[0].width, in->color_spec));
@@ -162,13 +184,27 @@ static bool deinterlace_postprocess(void *state, struct video_frame *in, struct
                 return true;
         }
 
-        if (!vc_deinterlace_ex(in->color_spec, (unsigned char *) in->tiles[0].data, vc_get_linesize(in->tiles[0].width, in->color_spec),
-                                (unsigned char *) out->tiles[0].data, vc_get_linesize(out->tiles[0].width, in->color_spec),
-                                in->tiles[0].height)) {
+        if (!vc_avg_lines_supported(in->color_spec)) {
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot deinterlace, unsupported pixel format '%s'!\n", get_codec_name(in->color_spec));
                 memcpy(out->tiles[0].data, in->tiles[0].data, in->tiles[0].data_len);
+                return true;
+        }
+        if (in->tiles[0].height < 2 || in->tiles[0].data == out->tiles[0].data) {
+                vc_deinterlace_ex(in->color_spec, (unsigned char *) in->tiles[0].data, vc_get_linesize(in->tiles[0].width, in->color_spec),
+                                (unsigned char *) out->tiles[0].data, vc_get_linesize(out->tiles[0].width, in->color_spec),
+                                in->tiles[0].height);
+                return true;
         }
 
+        struct blend_job job = {
+                .codec = in->color_spec,
+                .in = (unsigned char *) in->tiles[0].data,
+                .out = (unsigned char *) out->tiles[0].data,
+                .linesize = vc_get_linesize(in->tiles[0].width, in->color_spec),
+                .height = (int) in->tiles[0].height,
+        };
+        parallel_rows(job.height, blend_rows, &job, 0);
+
         return true;
 }
 
@@ -230,7 +266,8 @@ static const struct vo_postprocess_info vo_pp_deinterlace_info = {
 static const struct capture_filter_info capture_filter_deinterlace_info = {
         cf_deinterlace_init,
         deinterlace_done,
-        cf_deinterlace_filter
+        cf_deinterlace_filter,
+        NULL,
 };
 
 REGISTER_MODULE(deinterlace_blend, &vo_pp_deinterlace_blend_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
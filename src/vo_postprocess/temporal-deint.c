@@ -52,6 +52,8 @@
 #include "lib_common.h"
 #include "tv.h"
 #include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/parallel_conv.h"
 #include "utils/text.h"
 #include "video.h"
 #include "video_display.h"
@@ -211,218 +213,105 @@ static struct video_frame * common_getf(void *state)
         return s->in;
 }
 
-/// @todo perhaps suboptimal
-static void perform_df(struct state_df *s, struct video_frame *in, struct video_frame *out, int req_pitch)
-{
-        if(in != NULL) {
-                char *src = s->buffers[(s->buffer_current + 1) % 2] + vc_get_linesize(s->in->tiles[0].width, s->in->color_spec);
-                char *dst = out->tiles[0].data + req_pitch;
-                for (unsigned y = 0; y < out->tiles[0].height; y += 2) {
-                        memcpy(dst, src, vc_get_linesize(s->in->tiles[0].width, s->in->color_spec));
-                        dst += 2 * req_pitch;
-                        src += 2 * vc_get_linesize(s->in->tiles[0].width, s->in->color_spec);
-                }
-                src = s->buffers[s->buffer_current];
-                dst = out->tiles[0].data;
-                for (unsigned y = 1; y < out->tiles[0].height; y += 2) {
-                        memcpy(dst, src, vc_get_linesize(s->in->tiles[0].width, s->in->color_spec));
-                        dst += 2 * req_pitch;
-                        src += 2 * vc_get_linesize(s->in->tiles[0].width, s->in->color_spec);
-                }
-        } else {
-                char *src = s->buffers[s->buffer_current];
-                char *dst = out->tiles[0].data;
-                for (unsigned y = 0; y < out->tiles[0].height; ++y) {
-                        memcpy(dst, src, vc_get_linesize(s->in->tiles[0].width, s->in->color_spec));
-                        dst += req_pitch;
-                        src += vc_get_linesize(s->in->tiles[0].width, s->in->color_spec);
-                }
-        }
+struct deint_job {
+        const struct state_df *s;
+        bool first_field; ///< the frame was just received (otherwise 2nd field is output)
+        bool blend;       ///< the algorithm averages lines (DF with "d", LINEAR)
+        char *out;
+        int pitch;
+        int linesize;
+        int height;
+};
 
-        if (s->deinterlace) {
-                if (!vc_deinterlace_ex(out->color_spec,
-                                (unsigned char *) out->tiles[0].data, vc_get_linesize(out->tiles[0].width, out->color_spec),
-                                (unsigned char *) out->tiles[0].data, vc_get_linesize(out->tiles[0].width, out->color_spec),
-                                out->tiles[0].height)) {
-                         log_msg_once(LOG_LEVEL_ERROR, DFR_DEINTERLACE_IMPOSSIBLE_MSG_ID, MOD_NAME "Cannot deinterlace, unsupported pixel format '%s'!\n", get_codec_name(out->color_spec));
-                }
-        }
+/// row y of the frame woven from last 2 frames (odd lines of the previous)
+static const char *df_woven_line(const struct deint_job *j, int y)
+{
+        const struct state_df *s = j->s;
+        const char *buf = j->first_field && y % 2 == 1
+                ? s->buffers[(s->buffer_current + 1) % 2]
+                : s->buffers[s->buffer_current];
+        return buf + (size_t) y * j->linesize;
 }
 
-static void perform_bob(struct state_df *s, struct video_frame *in, struct video_frame *out, int pitch)
+/**
+ * Determines source of output line y - it is either a copy of *a or the
+ * average of *a and *b (if *b != NULL).
+ */
+static void get_src_lines(const struct deint_job *j, int y, const char **a, const char **b)
 {
-        int linesize = vc_get_linesize(s->in->tiles[0].width, s->in->color_spec);
-        char *dst = out->tiles[0].data;
-        char *src = s->buffers[s->buffer_current] + (in ? 0 : linesize);
-        if (in == NULL) {
-                memcpy(dst, src, linesize); // copy first line up
-                dst += pitch; // then copy every even line to subsequent odd line
-        }
-        unsigned y = in ? 0 : 1;
-        for ( ; y < out->tiles[0].height - 1; y += 2) {
-                memcpy(dst, src, linesize);
-                memcpy(dst + pitch, src, linesize);
-                dst += 2 * pitch;
-                src += 2 * linesize;
-        }
-        if (y < out->tiles[0].height) {
-                memcpy(dst, dst - pitch, linesize);
+        const char *cur = j->s->buffers[j->s->buffer_current];
+        const int field = j->first_field ? 0 : 1; // parity of the output field lines
+        *b = NULL;
+        switch (j->s->algo) {
+        case DF:
+                if (!j->blend || j->height < 2) {
+                        *a = df_woven_line(j, y);
+                } else { // last line is the same as the previous one
+                        const int y1 = MIN(y, j->height - 2);
+                        *a = df_woven_line(j, y1);
+                        *b = df_woven_line(j, y1 + 1);
+                }
+                return;
+        case BOB:
+                y = y % 2 == field ? y : y == 0 ? 1 : y - 1;
+                *a = cur + (size_t) MIN(y, j->height - 1) * j->linesize;
+                return;
+        case LINEAR:
+                if (y % 2 == field || y == 0) {
+                        *a = cur + (size_t) MIN(y + (y % 2 != field), j->height - 1) * j->linesize;
+                        return;
+                }
+                *a = cur + (size_t) (y - 1) * j->linesize;
+                if (j->blend && y + 1 < j->height) {
+                        *b = cur + (size_t) (y + 1) * j->linesize;
+                }
+                return;
         }
 }
 
-/// copied from vc_deinterlace_ex
-///
-/// consider merging with vc_deinterlace_ex but perhaps not needed (that func
-/// has slightly different structure - always averages 2 adjacent lines and
-/// writes the result twice to those. This version also uses GCC generic
-/// vectorization support instead of SSE (performs fast if vector_size==16)
-static bool avg_lines(codec_t codec, size_t linesize, char *src1, char *src2, char *dst)
+static void deint_rows(int y_start, int y_end, void *arg)
 {
-        char *s1 = (char *) src1;
-        char *s2 = (char *) src2;
-        char *d = (char *) dst;
-        if (is_codec_opaque(codec) && codec_is_planar(codec)) {
-                return false;
-        }
-        int bpp = get_bits_per_component(codec);
-        if (bpp == 8 || bpp == 16) {
-                size_t x = 0;
-                if (bpp == 8) {
-                        typedef unsigned char v16uc __attribute__ ((vector_size (16)));
-                        for ( ; x < linesize / 16; ++x) {
-                                v16uc i1, i2;
-                                memcpy(&i1, s1, sizeof i1);
-                                memcpy(&i2, s2, sizeof i2);
-                                v16uc res = ((i1 / 2) + (i2 / 2) + (i1 % 2 + i1 % 2) / 2);
-                                memcpy(d, &res, sizeof res);
-                                s1 += 16;
-                                s2 += 16;
-                                d += 16;
-                        }
-                } else {
-                        typedef unsigned short v16us __attribute__ ((vector_size (16)));
-                        for ( ; x < linesize / 16; ++x) {
-                                v16us i1, i2;
-                                memcpy(&i1, s1, sizeof i1);
-                                memcpy(&i2, s2, sizeof i2);
-                                v16us res = ((i1 / 2) + (i2 / 2) + (i1 % 2 + i1 % 2) / 2);
-                                memcpy(d, &res, sizeof res);
-                                s1 += 16;
-                                s2 += 16;
-                                d += 16;
-                        }
-                }
-                x *= 16;
-                if (bpp  == 8) {
-                        for ( ; x < linesize; ++x) {
-                                *d++ = (*s1++ + *s2++ + 1) >> 1;
-                        }
+        const struct deint_job *j = arg;
+        const codec_t codec = j->s->in->color_spec;
+        for (int y = y_start; y < y_end; ++y) {
+                unsigned char *dst = (unsigned char *) j->out + (size_t) y * j->pitch;
+                const char *a = NULL;
+                const char *b = NULL;
+                get_src_lines(j, y, &a, &b);
+                if (b == NULL) {
+                        memcpy(dst, a, j->linesize);
                 } else {
-                        uint16_t *d16 = (uint16_t *)(void *) d;
-                        uint16_t *s16_1 = (uint16_t *)(void *) s1;
-                        uint16_t *s16_2 = (uint16_t *)(void *) s2;
-                        for ( ; x < linesize / 2; ++x) {
-                                *d16++ = (*s16_1++ + *s16_2++ + 1) >> 1;
-                        }
-                }
-        } else if (codec == v210) {
-                uint32_t *s32_1 = (uint32_t *)(void *) s1;
-                uint32_t *s32_2 = (uint32_t *)(void *) s2;
-                uint32_t *d32 = (uint32_t *)(void *) d;
-                for (size_t x = 0; x < linesize / 16; ++x) {
-                        #pragma GCC unroll 4
-                        for (int y = 0; y < 4; ++y) {
-                                uint32_t v1 = *s32_1++;
-                                uint32_t v2 = *s32_2++;
-                                *d32++ =
-                                        (((v1 >> 20        ) + (v2 >> 20        ) + 1) / 2) << 20 |
-                                        (((v1 >> 10 & 0x3ff) + (v2 >> 10 & 0x3ff) + 1) / 2) << 10 |
-                                        (((v1       & 0x3ff) + (v2       & 0x3ff) + 1) / 2);
-                        }
-                }
-        } else if (codec == R10k) {
-                uint32_t *s32_1 = (uint32_t *)(void *) s1;
-                uint32_t *s32_2 = (uint32_t *)(void *) s2;
-                uint32_t *d32 = (uint32_t *)(void *) d;
-                for (size_t x = 0; x < linesize / 4; ++x) {
-                        #pragma GCC unroll 4
-                        for (int y = 0; y < 4; ++y) {
-                                uint32_t v1 = ntohl(*s32_1++);
-                                uint32_t v2 = ntohl(*s32_2++);
-                                *d32++ =
-                                        (((v1 >> 22        ) + (v2 >> 22        ) + 1) / 2) << 22 |
-                                        (((v1 >> 12 & 0x3ff) + (v2 >> 12 & 0x3ff) + 1) / 2) << 12 |
-                                        (((v1 >>  2 & 0x3ff) + (v2 >>  2 & 0x3ff) + 1) / 2) << 2;
-                        }
-                }
-        } else if (codec == R12L) {
-                uint32_t *s32_1 = (uint32_t *)(void *) s1;
-                uint32_t *s32_2 = (uint32_t *)(void *) s2;
-                uint32_t *d32 = (uint32_t *)(void *) d;
-                int shift = 0;
-                uint32_t remain1 = 0;
-                uint32_t remain2 = 0;
-                uint32_t out = 0;
-                for (size_t x = 0; x < linesize / 16; ++x) {
-                        #pragma GCC unroll 8
-                        for (int y = 0; y < 4; ++y) {
-                                uint32_t in1 = *s32_1++;
-                                uint32_t in2 = *s32_2++;
-                                if (shift > 0) {
-                                        remain1 = remain1 | (in1 & ((1<<((shift + 12) % 32)) - 1)) << (32-shift);
-                                        remain2 = remain2 | (in2 & ((1<<((shift + 12) % 32)) - 1)) << (32-shift);
-                                        uint32_t ret = (remain1 + remain2 + 1) / 2;
-                                        out |= ret << shift;
-                                        *d32++ = out;
-                                        out = ret >> (32-shift);
-                                        shift = (shift + 12) % 32;
-                                        in1 >>= shift;
-                                        in2 >>= shift;
-                                }
-                                while (shift <= 32 - 12) {
-                                        out |= ((((in1 & 0xfff) + (in2 & 0xfff)) + 1) / 2) << shift;
-                                        in1 >>= 12;
-                                        in2 >>= 12;
-                                        shift += 12;
-                                }
-                                if (shift == 32) {
-                                        *d32++ = out;
-                                        out = 0;
-                                        shift = 0;
-                                } else {
-                                        remain1 = in1;
-                                        remain2 = in2;
-                                }
-                        }
+                        vc_avg_lines(codec, j->linesize, (const unsigned char *) a,
+                                        (const unsigned char *) b, dst);
                 }
-        } else {
-                return false;
         }
-        return true;
 }
 
-static void perform_linear(struct state_df *s, struct video_frame *in, struct video_frame *out, int pitch)
+/**
+ * Outputs one field (the first one if in != NULL, the second otherwise).
+ * The output is computed per line so that the work can be split to bands of
+ * lines processed in parallel.
+ */
+static void perform_deint(struct state_df *s, struct video_frame *in, struct video_frame *out, int pitch)
 {
-        int linesize = vc_get_linesize(s->in->tiles[0].width, s->in->color_spec);
-        char *src = s->buffers[s->buffer_current] + (in ? 0 : linesize);
-        char *dst = out->tiles[0].data;
-        if (in == NULL) {
-                memcpy(dst, src, linesize); // copy first line up
-                dst += pitch; // then copy every even line to subsequent odd line
-        }
-        unsigned y = in ? 0 : 1;
-        for ( ; y < out->tiles[0].height - 2; y += 2) {
-                memcpy(dst, src, linesize);
-                if (!avg_lines(out->color_spec, linesize, src, src + 2 * linesize, dst + pitch)) {
-                        memcpy(dst + pitch, src, linesize); // fallback bob
+        const codec_t codec = s->in->color_spec;
+        bool blend = s->algo == LINEAR || (s->algo == DF && s->deinterlace);
+        if (blend && !vc_avg_lines_supported(codec)) {
+                if (s->algo == DF) { // LINEAR falls back to bob silently
+                        log_msg_once(LOG_LEVEL_ERROR, DFR_DEINTERLACE_IMPOSSIBLE_MSG_ID, MOD_NAME "Cannot deinterlace, unsupported pixel format '%s'!\n", get_codec_name(codec));
                 }
-                dst += 2 * pitch;
-                src += 2 * linesize;
-        }
-        for ( ; y < out->tiles[0].height; y++) { // last line(s) if needed
-                memcpy(dst, src, linesize);
-                dst += pitch;
+                blend = false;
         }
+        struct deint_job job = {
+                .s = s,
+                .first_field = in != NULL,
+                .blend = blend,
+                .out = out->tiles[0].data,
+                .pitch = pitch,
+                .linesize = vc_get_linesize(s->in->tiles[0].width, codec),
+                .height = (int) out->tiles[0].height,
+        };
+        parallel_rows(job.height, deint_rows, &job, 0);
 }
 
 /// @param in  may be NULL
@@ -431,17 +320,7 @@ static bool common_postprocess(void *state, struct video_frame *in, struct video
         struct state_df *s = (struct state_df *) state;
 
         if (s->in->interlacing == INTERLACED_MERGED || s->force) {
-                switch (s->algo) {
-                        case DF:
-                                perform_df(s, in, out, req_pitch);
-                                break;
-                        case BOB:
-                                perform_bob(s, in, out, req_pitch);
-                                break;
-                        case LINEAR:
-                                perform_linear(s, in, out, req_pitch);
-                                break;
-                }
+                perform_deint(s, in, out, req_pitch);
         } else {
                 s->in->tiles[0].data = s->buffers[0]; // always write to first buffer
                 if (in) {
@@ -66,6 +66,7 @@
 #include "vo_postprocess.h"
 #include "utils/color_out.h"
 #include "utils/macros.h"
+#include "utils/overlay.h"
 #include "utils/string.h" // replace_all
 #include "utils/text.h"
 
@@ -75,7 +76,6 @@ struct state_text {
         size_t data_size;
         char *text;
         int req_x, req_y, req_h;
-        int width;                 // pixels
         int text_base_y;
         int margin_x, margin_y;
         
@@ -88,8 +88,8 @@ struct state_text {
         struct video_desc saved_desc;
 
         DrawingWand *dw;
-        MagickWand *wand_bg;
         MagickWand *wand_text;
+        struct overlay *overlay; ///< rendered text in the video pixel format
 };
 
 static bool text_get_property(void *state, int property, void *val, size_t *len)
@@ -195,21 +195,19 @@ text_postprocess_reconfigure(void *state, struct video_desc desc)
         vf_free(s->in);
         if (s->wand_text)
                 DestroyMagickWand(s->wand_text);
-        if (s->wand_bg)
-                DestroyMagickWand(s->wand_bg);
         if (s->dw)
                 DestroyDrawingWand(s->dw);
+        overlay_destroy(s->overlay);
         s->in = 0;
-        s->wand_bg = 0;
         s->wand_text = 0;
         s->dw = 0;
+        s->overlay = NULL;
 
         s->in = vf_alloc_desc_data(desc);
 
         s->margin_x = s->req_x == -1 ? (int) desc.width / MARGIN_X_DIV : s->req_x;
         s->margin_y = s->req_y == -1 ? (int) desc.height / MARGIN_Y_DIV : s->req_y;
         s->text_height_pt = s->req_h == -1 ? (int) desc.height / TEXT_H_DIV : s->req_h;
-        s->width = MIN(s->margin_x + strlen(s->text) * s->text_height_pt, desc.width);
         s->text_base_y = MIN(s->margin_y + s->text_height_pt, (int) desc.height);
 
 
@@ -250,18 +248,15 @@ text_postprocess_reconfigure(void *state, struct video_desc desc)
                DestroyPixelWand(pw);
         }
 
-        s->wand_bg = NewMagickWand();
-        status = MagickSetFormat(s->wand_bg, colorspace);
         s->wand_text = NewMagickWand();
-        status &= MagickSetFormat(s->wand_text, colorspace);
+        status = MagickSetFormat(s->wand_text, colorspace);
         if(status != MagickTrue) {
                 log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickSetFormat failed!\n");
                 return false;
         }
 
 
-        status = MagickSetDepth(s->wand_bg, 8);
-        status &= MagickSetDepth(s->wand_text, 8);
+        status = MagickSetDepth(s->wand_text, 8);
         assert(status == MagickTrue && "[text vo_pp.] MagickSetDepth failed");
         
         PixelWand *transparent_bg = NewPixelWand();
@@ -301,7 +296,22 @@ text_postprocess_reconfigure(void *state, struct video_desc desc)
 
         DestroyPixelWand(transparent_bg);
 
-        return true;
+        // the text is static so it is rasterized, converted and
+        // premultiplied only here; only blending is done per frame
+        unsigned char *rgba = malloc((size_t) s->text_width_px * s->text_height_px * 4);
+        status = MagickExportImagePixels(s->wand_text, 0, 0, s->text_width_px,
+                        s->text_height_px, "RGBA", CharPixel, rgba);
+        if (status != MagickTrue) {
+                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickExportImagePixels failed!\n");
+                free(rgba);
+                return false;
+        }
+        // for UYVY, the colors above are specified directly as YCbCr
+        s->overlay = overlay_create(rgba, s->text_width_px, s->text_height_px,
+                        desc.color_spec, desc.color_spec == UYVY);
+        free(rgba);
+
+        return s->overlay != NULL;
 }
 
 static struct video_frame * text_getf(void *state)
@@ -313,87 +323,12 @@ static struct video_frame * text_getf(void *state)
 
 static bool text_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
 {
-        MagickBooleanType status;
         struct state_text *s = (struct state_text *) state;
 
-        int dst_linesize = vc_get_linesize(s->width, in->color_spec);
-        int src_linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
-
-        int im_height_px = in->tiles[0].height;
-
-        // copy over just the relevant "stripe"
-        // cannot copy just the rectangle because pixel formats
-        // are not necessarily byte aligned
-        char *stripe = malloc((size_t) s->text_height_px * dst_linesize);
-        assert(stripe != NULL && "Malloc failed");
-        for (ptrdiff_t y = 0; y < s->text_height_px; y++) {
-                // skip what is out-of-bounds
-                if (y + s->margin_y < 0) {
-                        y += -s->margin_y - 1;
-                        continue;
-                }
-                if (y + s->margin_y >= im_height_px)
-                        break;
-
-                // copy what isn't
-                memcpy(stripe + (y) * dst_linesize,
-                       in->tiles[0].data + (y + s->margin_y) * src_linesize, 
-                       dst_linesize);
-        }
-
-        // read image stripe into ImageMagick
-        MagickRemoveImage(s->wand_bg);
-
-        status = MagickSetSize(s->wand_bg, s->width, s->text_height_px);
-        assert(status == MagickTrue && "[text vo_pp.] MagickSetSize failed -- ");
-
-        status = MagickReadImageBlob(s->wand_bg, stripe, s->text_height_px * dst_linesize);
-        if (status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickReadImageBlob failed!\n");
-                return false;
-        }
-
-        // compose it with text
-#ifdef WAND7
-        status = MagickCompositeImage(s->wand_bg, s->wand_text, OverCompositeOp, true, s->margin_x, 0);
-#else
-        status = MagickCompositeImage(s->wand_bg, s->wand_text, OverCompositeOp, s->margin_x, 0);
-#endif
-        if (status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickCompositeImage failed!\n");
-                return false;
-        }
-
-        // extract the composed data
-        unsigned char *data;
-        size_t data_len;
-        data = MagickGetImageBlob(s->wand_bg, &data_len);
-        assert(data != NULL && "[text vo_pp.] MagickGetImageBlob failed!");
-
-        // send the input stream...
         memcpy(out->tiles[0].data, in->tiles[0].data, in->tiles[0].data_len);
+        overlay_blend(s->overlay, out->tiles[0].data, out->tiles[0].width,
+                        out->tiles[0].height, req_pitch, s->margin_x, s->margin_y);
 
-        // ...and the text stripe on top of it
-        // if ((int) data_len == s->text_height_pt * dstlinesize) {
-                for (int y = 0; y < s->text_height_px; y++) {
-                        // again, skip what is oob
-                        if (y + s->margin_y < 0) {
-                                y += - s->margin_y - 1; // 1 == don't y++ on continue
-                                continue;
-                        }
-                        if (y + s->margin_y >= im_height_px) {
-                                break;
-                        }
-
-                        memcpy(out->tiles[0].data + (y + s->margin_y) * req_pitch,
-                               data + y * dst_linesize,
-                               dst_linesize);
-                }
-        // }
-
-        free(data);
-
-        free(stripe);
         return true;
 }
 
@@ -428,9 +363,9 @@ static void text_done(void *state)
 
         vf_free(s->in);
 
-        DestroyMagickWand(s->wand_bg);
         DestroyMagickWand(s->wand_text);
         DestroyDrawingWand(s->dw);
+        overlay_destroy(s->overlay);
 
         free(s->data);
         free(s->text);
@@ -460,7 +395,8 @@ static const struct vo_postprocess_info vo_pp_text_info = {
 static const struct capture_filter_info capture_filter_text_info = {
         cf_text_init,
         text_done,
-        cf_text_filter
+        cf_text_filter,
+        NULL,
 };
 
 
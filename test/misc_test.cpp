@@ -4,17 +4,27 @@
 #include "config_win32.h"
 #endif
 
+#include <atomic>
 #include <list>
 #include <sstream>
+#include <thread>
+#include <vector>
 
 #include "types.h"
+#include "utils/packet_counter.h"
 #include "utils/string.h"
+#include "utils/synchronized_queue.h"
+#include "utils/wait_obj.h"
+#include "utils/worker.h"
 #include "unit_common.h"
 #include "video.h"
 #include "video_frame.h"
 
 extern "C" {
+        int misc_test_event_queue();
+        int misc_test_packet_counter();
         int misc_test_replace_all();
+        int misc_test_task_parallel_for();
         int misc_test_video_desc_io_op_symmetry();
 }
 
@@ -23,6 +33,55 @@ using namespace std;
 #ifdef __clang__
 #pragma clang diagnostic ignored "-Wstring-concatenation"
 #endif
+/// queue hand-off must not lose wake-ups, timed wait must time out
+int misc_test_event_queue()
+{
+        constexpr int count = 100000;
+        synchronized_queue<int, 2> q;
+        long long sum = 0;
+        std::thread consumer([&] {
+                for (int i = 0; i < count; ++i) {
+                        sum += q.pop();
+                }
+        });
+        for (int i = 0; i < count; ++i) {
+                q.push(i);
+        }
+        consumer.join();
+        ASSERT_EQUAL((long long) count * (count - 1) / 2, sum);
+        int val = 0;
+        ASSERT(!q.timed_pop(val, std::chrono::milliseconds(10)));
+
+        for (int i = 0; i < 100; ++i) {
+                wait_obj w;
+                std::thread notifier([&w] { w.notify(); });
+                w.wait();
+                notifier.join();
+        }
+        return 0;
+}
+
+int misc_test_packet_counter()
+{
+        struct packet_counter *pc = packet_counter_init(2);
+        packet_counter_register_packet(pc, 0, 0, 0, 100);
+        packet_counter_register_packet(pc, 0, 0, 200, 100); // 100-200 lost
+        packet_counter_register_packet(pc, 0, 0, 0, 100);   // duplicate
+        packet_counter_register_packet(pc, 0, 1, 0, 50);
+        packet_counter_register_packet(pc, 1, 0, 50, 50);   // reordered
+        packet_counter_register_packet(pc, 1, 0, 0, 60);    // overlapping
+        ASSERT_EQUAL(100 + 100 + 50 + 100, packet_counter_get_total_bytes(pc));
+        ASSERT_EQUAL(300 + 50 + 100, packet_counter_get_all_bytes(pc));
+        packet_counter_register_packet(pc, 0, 0, 100, 100); // fills the gap
+        ASSERT_EQUAL(450, packet_counter_get_total_bytes(pc));
+        packet_counter_clear(pc);
+        ASSERT_EQUAL(0, packet_counter_get_total_bytes(pc));
+        packet_counter_register_packet(pc, 1, 7, 0, 10);
+        ASSERT_EQUAL(10, packet_counter_get_all_bytes(pc));
+        packet_counter_destroy(pc);
+        return 0;
+}
+
 int misc_test_replace_all()
 {
         char test[][20] =         { DELDEL DELDEL DELDEL, DELDEL DELDEL,               "XYZX" DELDEL, "XXXyX" };
@@ -36,6 +95,44 @@ int misc_test_replace_all()
         return 0;
 }
 
+static void count_items(size_t start, size_t end, void *udata)
+{
+        auto *items = static_cast<vector<atomic<int>> *>(udata);
+        for (size_t i = start; i < end; ++i) {
+                (*items)[i] += 1;
+        }
+}
+
+static void *nested_parallel_for(void *arg)
+{
+        task_parallel_for(1000, 1, 0, count_items, arg);
+        return arg;
+}
+
+/// each item must be processed exactly once, also if nested in tasks
+int misc_test_task_parallel_for()
+{
+        vector<atomic<int>> items(10000);
+        task_parallel_for(items.size(), 7, 0, count_items, &items);
+        for (auto &i : items) {
+                ASSERT_EQUAL(1, i.load());
+        }
+
+        vector<vector<atomic<int>>> nested(8);
+        struct task_group *g = task_group_create();
+        for (auto &n : nested) {
+                n = vector<atomic<int>>(1000);
+                task_group_run(g, nested_parallel_for, &n);
+        }
+        task_group_destroy(g);
+        for (auto &n : nested) {
+                for (auto &i : n) {
+                        ASSERT_EQUAL(1, i.load());
+                }
+        }
+        return 0;
+}
+
 int misc_test_video_desc_io_op_symmetry()
 {
         const std::list<video_desc> test_desc = {
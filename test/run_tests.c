@@ -86,7 +86,10 @@ DECLARE_TEST(get_framerate_test_3000);
 DECLARE_TEST(get_framerate_test_free);
 DECLARE_TEST(gpujpeg_test_simple);
 DECLARE_TEST(libavcodec_test_get_decoder_from_uv_to_uv);
+DECLARE_TEST(misc_test_event_queue);
+DECLARE_TEST(misc_test_packet_counter);
 DECLARE_TEST(misc_test_replace_all);
+DECLARE_TEST(misc_test_task_parallel_for);
 DECLARE_TEST(misc_test_video_desc_io_op_symmetry);
 
 struct {
@@ -119,7 +122,10 @@ struct {
         DEFINE_TEST(get_framerate_test_free),
         DEFINE_TEST(gpujpeg_test_simple),
         DEFINE_TEST(libavcodec_test_get_decoder_from_uv_to_uv),
+        DEFINE_TEST(misc_test_event_queue),
+        DEFINE_TEST(misc_test_packet_counter),
         DEFINE_TEST(misc_test_replace_all),
+        DEFINE_TEST(misc_test_task_parallel_for),
         DEFINE_TEST(misc_test_video_desc_io_op_symmetry),
 };
 
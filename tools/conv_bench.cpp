@@ -0,0 +1,491 @@
+/**
+ * @file   tools/conv_bench.cpp
+ * @brief  Benchmark of UltraGrid pixel format conversions
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Times every line decoder returned by get_decoder_from_to() - directly
+ * and through parallel_pix_conv() - and, if compiled with libavcodec, every
+ * conversion offered by to_lavc_vid_conv (as listed by
+ * get_available_pix_fmts()) and from_lavc_vid_conv (get_av_to_uv_conversion())
+ * for given frame sizes and thread counts. The results are printed as CSV or
+ * JSON for regression tracking. The "cost" output has the format of the cache
+ * used by "--param conv-cost" so it can be stored there directly.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_LAVC
+#include "libavcodec/from_lavc_vid_conv.h"
+#include "libavcodec/lavc_common.h"
+#include "libavcodec/to_lavc_vid_conv.h"
+#include "libavcodec/utils.h"
+#endif
+#include "debug.h"
+#include "host.h"
+#include "pixfmt_conv.h"
+#include "tv.h"
+#include "types.h"
+#include "utils/misc.h"
+#include "utils/parallel_conv.h"
+#include "video_codec.h"
+
+using std::mt19937;
+using std::string;
+using std::vector;
+
+#define DEFAULT_ITERATIONS 5
+
+enum output_fmt {
+        OUT_CSV,
+        OUT_JSON,
+        OUT_COST,
+};
+
+enum conv_kind {
+        KIND_UV = 1 << 0,
+        KIND_TO_LAVC = 1 << 1,
+        KIND_FROM_LAVC = 1 << 2,
+        KIND_ALL = KIND_UV | KIND_TO_LAVC | KIND_FROM_LAVC,
+};
+
+struct bench_opts {
+        int iterations = DEFAULT_ITERATIONS;
+        enum output_fmt out_fmt = OUT_CSV;
+        int kinds = KIND_ALL;
+        codec_t filter = VIDEO_CODEC_NONE; ///< bench only conversions from/to this codec
+};
+
+struct frame_size {
+        int width;
+        int height;
+};
+
+struct result {
+        const char *kind;
+        string in;
+        string out;
+        struct frame_size size;
+        int threads;
+        double avg_ms;
+        double min_ms;
+};
+
+static void usage(const char *progname)
+{
+        printf("Usage:\n\t%s [-n <iterations>] [-s <sizes>] [-t <threads>] [-c <codec>] [-k <kinds>]\n"
+               "\t\t[-f csv|json|cost] [--param <params>]\n\n", progname);
+        printf("where\n"
+               "\t-n <iterations> - number of timed conversions of each frame (default %d)\n"
+               "\t-s <sizes>      - comma-separated frame sizes (default 1920x1080,3840x2160,7680x4320)\n"
+               "\t-t <threads>    - comma-separated thread counts, 0 for all cores (default 1,0)\n"
+               "\t-c <codec>      - measure only conversions from or to <codec>\n"
+               "\t-k <kinds>      - comma-separated subset of uv,to_lavc,from_lavc (default all)\n"
+               "\t-f <format>     - output format, \"cost\" prints single-thread line decoder costs\n"
+               "\t                  of the first size in the format of the \"--param conv-cost\" cache\n\n",
+               DEFAULT_ITERATIONS);
+}
+
+static vector<string> split(const char *str)
+{
+        vector<string> ret;
+        string item;
+        for (const char *c = str; ; ++c) {
+                if (*c == ',' || *c == '\0') {
+                        if (!item.empty()) {
+                                ret.push_back(item);
+                        }
+                        item.clear();
+                        if (*c == '\0') {
+                                break;
+                        }
+                } else {
+                        item += *c;
+                }
+        }
+        return ret;
+}
+
+static void fill_random(unsigned char *data, size_t len)
+{
+        mt19937 gen(1);
+        for (size_t i = 0; i < len; ++i) {
+                data[i] = gen();
+        }
+}
+
+static void print_header(const struct bench_opts &opts)
+{
+        switch (opts.out_fmt) {
+        case OUT_CSV:
+                printf("kind,in,out,width,height,threads,avg_ms,min_ms,mpix_per_s\n");
+                break;
+        case OUT_JSON:
+                printf("[\n");
+                break;
+        case OUT_COST:
+                printf("# <in> <out> <ns per pixel>\n");
+                break;
+        }
+}
+
+static void print_footer(const struct bench_opts &opts)
+{
+        if (opts.out_fmt == OUT_JSON) {
+                printf("\n]\n");
+        }
+}
+
+static void print_result(const struct bench_opts &opts, const struct result &r)
+{
+        static bool first = true;
+        const double pixels = (double) r.size.width * r.size.height;
+        switch (opts.out_fmt) {
+        case OUT_CSV:
+                printf("%s,%s,%s,%d,%d,%d,%.3f,%.3f,%.1f\n", r.kind, r.in.c_str(), r.out.c_str(),
+                                r.size.width, r.size.height, r.threads, r.avg_ms, r.min_ms,
+                                pixels / r.avg_ms / 1000.0);
+                break;
+        case OUT_JSON:
+                printf("%s  {\"kind\": \"%s\", \"in\": \"%s\", \"out\": \"%s\", \"width\": %d, "
+                                "\"height\": %d, \"threads\": %d, \"avg_ms\": %.3f, \"min_ms\": %.3f, "
+                                "\"mpix_per_s\": %.1f}", first ? "" : ",\n", r.kind, r.in.c_str(),
+                                r.out.c_str(), r.size.width, r.size.height, r.threads, r.avg_ms,
+                                r.min_ms, pixels / r.avg_ms / 1000.0);
+                break;
+        case OUT_COST:
+                printf("%s %s %f\n", r.in.c_str(), r.out.c_str(), r.min_ms * 1000.0 * 1000.0 / pixels);
+                break;
+        }
+        first = false;
+        fflush(stdout);
+}
+
+/**
+ * Runs conv once to warm up caches and then the requested number of times.
+ */
+template<typename conv_t>
+static void time_conversion(const struct bench_opts &opts, struct result *r, conv_t conv)
+{
+        conv();
+        double sum = 0;
+        double best = 1e30;
+        for (int i = 0; i < opts.iterations; ++i) {
+                const time_ns_t t0 = get_time_in_ns();
+                conv();
+                const double ms = (double) (get_time_in_ns() - t0) / NS_IN_MS;
+                sum += ms;
+                best = std::min(best, ms);
+        }
+        r->avg_ms = sum / opts.iterations;
+        r->min_ms = best;
+}
+
+static bool filter_match(const struct bench_opts &opts, codec_t in, codec_t out)
+{
+        return opts.filter == VIDEO_CODEC_NONE || opts.filter == in || opts.filter == out;
+}
+
+static void bench_uv(const struct bench_opts &opts, struct frame_size sz, const vector<int> &threads)
+{
+        for (int i = VIDEO_CODEC_FIRST; i < VIDEO_CODEC_COUNT; ++i) {
+                const codec_t in = (codec_t) i;
+                if (is_codec_opaque(in) || codec_is_planar(in)) {
+                        continue;
+                }
+                for (int j = VIDEO_CODEC_FIRST; j < VIDEO_CODEC_COUNT; ++j) {
+                        const codec_t out = (codec_t) j;
+                        decoder_t decode = get_decoder_from_to(in, out);
+                        if (decode == nullptr || !filter_match(opts, in, out)) {
+                                continue;
+                        }
+                        const int in_linesize = vc_get_linesize(sz.width, in);
+                        const int out_linesize = vc_get_linesize(sz.width, out);
+                        vector<unsigned char> in_buf((size_t) in_linesize * sz.height + MAX_PADDING);
+                        vector<unsigned char> out_buf((size_t) out_linesize * sz.height + MAX_PADDING);
+                        fill_random(in_buf.data(), in_buf.size());
+                        for (int t : threads) {
+                                struct result r{"uv", get_codec_name(in), get_codec_name(out), sz, t, 0, 0};
+                                if (t == 1) {
+                                        time_conversion(opts, &r, [&]() {
+                                                for (int y = 0; y < sz.height; ++y) {
+                                                        decode(out_buf.data() + (size_t) y * out_linesize,
+                                                                        in_buf.data() + (size_t) y * in_linesize,
+                                                                        out_linesize, DEFAULT_R_SHIFT,
+                                                                        DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+                                                }
+                                        });
+                                } else {
+                                        time_conversion(opts, &r, [&]() {
+                                                parallel_pix_conv(sz.height, (char *) out_buf.data(), out_linesize,
+                                                                (const char *) in_buf.data(), in_linesize, decode,
+                                                                t);
+                                        });
+                                        r.threads = t == 0 ? get_cpu_core_count() : t;
+                                }
+                                print_result(opts, r);
+                        }
+                }
+        }
+}
+
+#ifdef HAVE_LAVC
+static void bench_to_lavc(const struct bench_opts &opts, struct frame_size sz, const vector<int> &threads)
+{
+        for (int i = VIDEO_CODEC_FIRST; i < VIDEO_CODEC_COUNT; ++i) {
+                const codec_t in = (codec_t) i;
+                if (is_codec_opaque(in)) {
+                        continue;
+                }
+                enum AVPixelFormat fmts[AV_PIX_FMT_NB];
+                const int fmt_count = get_available_pix_fmts(in, to_lavc_req_prop{TO_LAVC_REQ_PROP_INIT}, fmts);
+                if (fmt_count == 0) {
+                        continue;
+                }
+                vector<unsigned char> in_buf(vc_get_datalen(sz.width, sz.height, in) + MAX_PADDING);
+                fill_random(in_buf.data(), in_buf.size());
+                for (int f = 0; f < fmt_count; ++f) {
+                        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmts[f]);
+                        if (desc == nullptr || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL) != 0 ||
+                                        !filter_match(opts, in, get_av_to_ug_pixfmt(fmts[f]))) {
+                                continue;
+                        }
+                        for (int t : threads) {
+                                const int thread_count = t == 0 ? get_cpu_core_count() : t;
+                                struct to_lavc_vid_conv *conv = to_lavc_vid_conv_init(in, sz.width, sz.height,
+                                                fmts[f], thread_count);
+                                if (conv == nullptr) {
+                                        continue;
+                                }
+                                struct result r{"to_lavc", get_codec_name(in), desc->name, sz, thread_count, 0, 0};
+                                time_conversion(opts, &r, [&]() {
+                                        to_lavc_vid_conv(conv, (char *) in_buf.data());
+                                });
+                                to_lavc_vid_conv_destroy(&conv);
+                                print_result(opts, r);
+                        }
+                }
+        }
+}
+
+static void bench_from_lavc(const struct bench_opts &opts, struct frame_size sz)
+{
+        for (int i = 0; i < AV_PIX_FMT_NB; ++i) {
+                const enum AVPixelFormat av_fmt = (enum AVPixelFormat) i;
+                const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(av_fmt);
+                if (desc == nullptr || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL) != 0) {
+                        continue;
+                }
+                AVFrame *frame = nullptr;
+                for (int j = VIDEO_CODEC_FIRST; j < VIDEO_CODEC_COUNT; ++j) {
+                        const codec_t out = (codec_t) j;
+                        if (is_codec_opaque(out) || codec_is_planar(out) ||
+                                        !filter_match(opts, get_av_to_ug_pixfmt(av_fmt), out)) {
+                                continue;
+                        }
+                        av_to_uv_convert_t *conv = get_av_to_uv_conversion(av_fmt, out);
+                        if (conv == nullptr) {
+                                continue;
+                        }
+                        if (frame == nullptr) {
+                                frame = av_frame_alloc();
+                                frame->format = av_fmt;
+                                frame->width = sz.width;
+                                frame->height = sz.height;
+                                if (av_frame_get_buffer(frame, 0) < 0) {
+                                        av_frame_free(&frame);
+                                        av_to_uv_conversion_destroy(&conv);
+                                        break;
+                                }
+                                for (int b = 0; b < AV_NUM_DATA_POINTERS && frame->buf[b] != nullptr; ++b) {
+                                        fill_random(frame->buf[b]->data, frame->buf[b]->size);
+                                }
+                        }
+                        const int pitch = vc_get_linesize(sz.width, out);
+                        vector<char> out_buf((size_t) pitch * sz.height + MAX_PADDING);
+                        struct result r{"from_lavc", desc->name, get_codec_name(out), sz, 1, 0, 0};
+                        time_conversion(opts, &r, [&]() {
+                                av_to_uv_convert(conv, out_buf.data(), frame, sz.width, sz.height,
+                                                pitch, nullptr);
+                        });
+                        av_to_uv_conversion_destroy(&conv);
+                        print_result(opts, r);
+                }
+                av_frame_free(&frame);
+        }
+}
+#endif // defined HAVE_LAVC
+
+int main(int argc, char *argv[])
+{
+        log_level = LOG_LEVEL_WARNING; // keep the conversion messages out of the output
+        struct init_data *init = common_preinit(argc, argv);
+        if (init == nullptr) {
+                return 2;
+        }
+
+        struct bench_opts opts;
+        vector<string> size_strs{"1920x1080", "3840x2160", "7680x4320"};
+        vector<string> thread_strs{"1", "0"};
+        static struct option getopt_options[] = {
+                {"help", no_argument, nullptr, 'h'},
+                {"param", required_argument, nullptr, 'O'},
+                {"verbose", optional_argument, nullptr, 'V'},
+                { nullptr, 0, nullptr, 0 }
+        };
+        int ch = 0;
+        while ((ch = getopt_long(argc, argv, "c:f:hk:n:s:t:V", getopt_options, nullptr)) != -1) {
+                switch (ch) {
+                case 'c':
+                        opts.filter = get_codec_from_name(optarg);
+                        if (opts.filter == VIDEO_CODEC_NONE) {
+                                fprintf(stderr, "Unknown codec: %s\n", optarg);
+                                common_cleanup(init);
+                                return 1;
+                        }
+                        break;
+                case 'f':
+                        if (strcmp(optarg, "csv") == 0) {
+                                opts.out_fmt = OUT_CSV;
+                        } else if (strcmp(optarg, "json") == 0) {
+                                opts.out_fmt = OUT_JSON;
+                        } else if (strcmp(optarg, "cost") == 0) {
+                                opts.out_fmt = OUT_COST;
+                        } else {
+                                fprintf(stderr, "Unknown output format: %s\n", optarg);
+                                common_cleanup(init);
+                                return 1;
+                        }
+                        break;
+                case 'k':
+                        opts.kinds = 0;
+                        for (const auto &kind : split(optarg)) {
+                                if (kind == "uv") {
+                                        opts.kinds |= KIND_UV;
+                                } else if (kind == "to_lavc") {
+                                        opts.kinds |= KIND_TO_LAVC;
+                                } else if (kind == "from_lavc") {
+                                        opts.kinds |= KIND_FROM_LAVC;
+                                } else {
+                                        fprintf(stderr, "Unknown conversion kind: %s\n", kind.c_str());
+                                        common_cleanup(init);
+                                        return 1;
+                                }
+                        }
+                        break;
+                case 'n':
+                        opts.iterations = atoi(optarg);
+                        break;
+                case 's':
+                        size_strs = split(optarg);
+                        break;
+                case 't':
+                        thread_strs = split(optarg);
+                        break;
+                case 'O':
+                        if (!parse_params(optarg, false)) {
+                                common_cleanup(init);
+                                return 1;
+                        }
+                        break;
+                case 'V': // handled in common_preinit
+                        break;
+                case 'h':
+                        usage(argv[0]);
+                        common_cleanup(init);
+                        return 0;
+                default:
+                        usage(argv[0]);
+                        common_cleanup(init);
+                        return 1;
+                }
+        }
+        if (opts.iterations <= 0) {
+                fprintf(stderr, "Wrong iteration count!\n");
+                common_cleanup(init);
+                return 1;
+        }
+
+        vector<struct frame_size> sizes;
+        for (const auto &s : size_strs) {
+                struct frame_size sz{};
+                if (sscanf(s.c_str(), "%dx%d", &sz.width, &sz.height) != 2 || sz.width <= 0 || sz.height <= 0) {
+                        fprintf(stderr, "Wrong frame size: %s\n", s.c_str());
+                        common_cleanup(init);
+                        return 1;
+                }
+                sizes.push_back(sz);
+        }
+        vector<int> threads;
+        for (const auto &t : thread_strs) {
+                threads.push_back(std::max(atoi(t.c_str()), 0));
+        }
+        if (opts.out_fmt == OUT_COST) { // single-thread line decoders of one size only
+                sizes.resize(1);
+                threads = { 1 };
+                opts.kinds = KIND_UV;
+        }
+
+        print_header(opts);
+        for (const auto &sz : sizes) {
+                if ((opts.kinds & KIND_UV) != 0) {
+                        bench_uv(opts, sz, threads);
+                }
+#ifdef HAVE_LAVC
+                if ((opts.kinds & KIND_TO_LAVC) != 0) {
+                        bench_to_lavc(opts, sz, threads);
+                }
+                if ((opts.kinds & KIND_FROM_LAVC) != 0) { // not parallelized
+                        bench_from_lavc(opts, sz);
+                }
+#endif
+        }
+        print_footer(opts);
+
+        common_cleanup(init);
+        return 0;
+}
@@ -0,0 +1,341 @@
+/**
+ * @file   tools/fec_bench.cpp
+ * @brief  Benchmark of FEC encoders and decoders as used by transmit.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Runs FEC encoders created by fec::create_from_config() and the matching
+ * decoders (fec::create_from_desc()) over frames split to packets exactly as
+ * transmit.cpp does and drops the packets according to a loss model - either
+ * random (Bernoulli) or bursty (Gilbert model with given mean burst length).
+ * Reports encode and decode throughput, per-frame latency and the ratio of
+ * fully recovered frames.
+ *
+ * GPU LDGM is benchmarked with "--param ldgm-device=GPU".
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/fec.h"
+#include "rtp/rtp_types.h"
+#include "transmit.h"
+#include "types.h"
+#include "utils/misc.h"
+#include "video_frame.h"
+
+using std::mt19937;
+using std::shared_ptr;
+using std::string;
+using std::uniform_real_distribution;
+using std::unique_ptr;
+using std::vector;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+#define DEFAULT_FRAMES 100
+#define DEFAULT_MTU 1500
+#define IPV4_UDP_RTP_HDR_LEN (20 + 8 + 12) ///< see get_tx_hdr_len() in transmit.cpp
+
+static const char *const default_configs[] = {
+        "LDGM cfg 256:64:5",
+        "LDGM cfg 1024:256:6",
+        "RS cfg 200:240",
+};
+
+struct bench_opts {
+        int frames = DEFAULT_FRAMES;
+        int mtu = DEFAULT_MTU;
+        double burst = 0; ///< mean burst length in packets, 0 for random loss
+        unsigned int seed = 1;
+};
+
+/**
+ * Gilbert loss model - transition probabilities are set so that the stationary
+ * loss equals the requested one and the mean length of a loss burst is
+ * burst_len packets. Without a burst length, the losses are independent.
+ */
+class loss_model {
+public:
+        loss_model(double loss, double burst_len, unsigned int seed) : m_gen(seed) {
+                if (burst_len >= 1.0 && loss > 0.0 && loss < 1.0) {
+                        m_p_bad_good = 1.0 / burst_len;
+                        m_p_good_bad = loss / (burst_len * (1.0 - loss));
+                } else {
+                        m_p_good_bad = loss;
+                        m_p_bad_good = 1.0;
+                }
+        }
+        bool lost() {
+                const double r = m_dist(m_gen);
+                m_bad = m_bad ? r >= m_p_bad_good : r < m_p_good_bad;
+                return m_bad;
+        }
+private:
+        mt19937 m_gen;
+        uniform_real_distribution<double> m_dist{0.0, 1.0};
+        double m_p_good_bad, m_p_bad_good;
+        bool m_bad = false;
+};
+
+struct timing {
+        double sum = 0;
+        double max = 0;
+        void add(double t) {
+                sum += t;
+                this->max = std::max(this->max, t);
+        }
+};
+
+static void usage(const char *progname)
+{
+        printf("Usage:\n\t%s [-n <frames>] [-s <sizes>] [-l <loss_pct>] [-b <burst>] [-m <mtu>]\n"
+               "\t\t[-r <seed>] [--param <params>] [<fec_cfg> ...]\n\n", progname);
+        printf("where\n"
+               "\t-n <frames>   - number of frames per measurement (default %d)\n"
+               "\t-s <sizes>    - comma-separated frame sizes in bytes, SI suffixes allowed (default 100k,1M,8M)\n"
+               "\t-l <loss_pct> - comma-separated packet loss percentages (default 0,1,5)\n"
+               "\t-b <burst>    - mean loss burst length in packets (default random loss)\n"
+               "\t-m <mtu>      - MTU that the frame is packetized for (default %d)\n"
+               "\t-r <seed>     - seed of the loss pattern\n"
+               "\t<fec_cfg>     - FEC configuration as passed to fec::create_from_config(),\n"
+               "\t                eg. \"LDGM cfg <k>:<m>:<c>\" or \"RS cfg <k>:<n>\"\n\n"
+               "Use \"--param ldgm-device=GPU\" to benchmark GPU LDGM.\n", DEFAULT_FRAMES, DEFAULT_MTU);
+}
+
+static vector<string> split(const char *str)
+{
+        vector<string> ret;
+        string item;
+        for (const char *c = str; ; ++c) {
+                if (*c == ',' || *c == '\0') {
+                        if (!item.empty()) {
+                                ret.push_back(item);
+                        }
+                        item.clear();
+                        if (*c == '\0') {
+                                break;
+                        }
+                } else {
+                        item += *c;
+                }
+        }
+        return ret;
+}
+
+/// @returns false if the FEC cannot be initialized
+static bool run_bench(const char *cfg, size_t frame_size, double loss, const struct bench_opts &opts)
+{
+        unique_ptr<fec> encoder(fec::create_from_config(cfg));
+        if (!encoder) {
+                fprintf(stderr, "Unable to initialize FEC \"%s\"!\n", cfg);
+                return false;
+        }
+
+        vector<char> data(frame_size);
+        mt19937 gen(opts.seed);
+        std::generate(data.begin(), data.end(), [&gen]() { return (char) gen(); });
+        struct video_desc desc{1920, 1080, UYVY, 30.0, PROGRESSIVE, 1};
+        shared_ptr<video_frame> in(vf_alloc_desc(desc), vf_free);
+        in->tiles[0].data = data.data();
+        in->tiles[0].data_len = frame_size;
+
+        timing enc_time, dec_time;
+        shared_ptr<video_frame> out;
+        for (int i = 0; i < opts.frames; ++i) {
+                out.reset(); // let the encoder reuse the buffer
+                auto t0 = steady_clock::now();
+                out = encoder->encode(in);
+                enc_time.add(duration<double>(steady_clock::now() - t0).count());
+        }
+
+        unique_ptr<fec> decoder(fec::create_from_desc(out->fec_params));
+        if (!decoder) {
+                fprintf(stderr, "Unable to initialize FEC decoder for \"%s\"!\n", cfg);
+                return false;
+        }
+        const int buf_len = out->tiles[0].data_len;
+        const vector<int> packet_sizes = tx_get_packet_sizes(out.get(), 0,
+                        opts.mtu - IPV4_UDP_RTP_HDR_LEN - (int) sizeof(fec_payload_hdr_t));
+        vector<char> received(buf_len + 64);
+        loss_model losses(loss, opts.burst, opts.seed);
+        int recovered = 0;
+        long long lost_packets = 0;
+        for (int i = 0; i < opts.frames; ++i) {
+                fec_ranges ranges;
+                int pos = 0;
+                for (int len : packet_sizes) {
+                        if (losses.lost()) {
+                                memset(received.data() + pos, 0, len);
+                                lost_packets += 1;
+                        } else {
+                                memcpy(received.data() + pos, out->tiles[0].data + pos, len);
+                                ranges.emplace_back(pos, len);
+                        }
+                        pos += len;
+                }
+                fec_ranges_normalize(ranges);
+
+                char *dec_out = nullptr;
+                int dec_len = 0;
+                auto t0 = steady_clock::now();
+                const bool ret = decoder->decode(received.data(), buf_len, &dec_out, &dec_len, ranges);
+                dec_time.add(duration<double>(steady_clock::now() - t0).count());
+                if (ret && dec_len == (int) (frame_size + sizeof(video_payload_hdr_t)) &&
+                                memcmp(dec_out + sizeof(video_payload_hdr_t), data.data(), frame_size) == 0) {
+                        recovered += 1;
+                }
+        }
+
+        const double mb = (double) frame_size * opts.frames / 1000 / 1000;
+        printf("%-22s %9s %5.1f%% %6.1f%% %9.1f %7.3f %7.3f %9.1f %7.3f %7.3f %8.1f%%\n", cfg,
+                        format_in_si_units(frame_size), loss * 100.0,
+                        100.0 * lost_packets / ((double) packet_sizes.size() * opts.frames),
+                        mb / enc_time.sum, enc_time.sum / opts.frames * 1000, enc_time.max * 1000,
+                        mb / dec_time.sum, dec_time.sum / opts.frames * 1000, dec_time.max * 1000,
+                        100.0 * recovered / opts.frames);
+        return true;
+}
+
+int main(int argc, char *argv[])
+{
+        log_level = LOG_LEVEL_WARNING; // keep the FEC init messages out of the table
+        struct init_data *init = common_preinit(argc, argv);
+        if (init == nullptr) {
+                return 2;
+        }
+
+        struct bench_opts opts;
+        vector<string> sizes{"100k", "1M", "8M"};
+        vector<string> losses{"0", "1", "5"};
+        static struct option getopt_options[] = {
+                {"help", no_argument, nullptr, 'h'},
+                {"param", required_argument, nullptr, 'O'},
+                {"verbose", optional_argument, nullptr, 'V'},
+                { nullptr, 0, nullptr, 0 }
+        };
+        int ch = 0;
+        while ((ch = getopt_long(argc, argv, "b:hl:m:n:r:s:V", getopt_options, nullptr)) != -1) {
+                switch (ch) {
+                case 'b':
+                        opts.burst = atof(optarg);
+                        break;
+                case 'l':
+                        losses = split(optarg);
+                        break;
+                case 'm':
+                        opts.mtu = atoi(optarg);
+                        break;
+                case 'n':
+                        opts.frames = atoi(optarg);
+                        break;
+                case 'r':
+                        opts.seed = atoi(optarg);
+                        break;
+                case 's':
+                        sizes = split(optarg);
+                        break;
+                case 'O':
+                        if (!parse_params(optarg, false)) {
+                                common_cleanup(init);
+                                return 1;
+                        }
+                        break;
+                case 'V': // handled in common_preinit
+                        break;
+                case 'h':
+                        usage(argv[0]);
+                        common_cleanup(init);
+                        return 0;
+                default:
+                        usage(argv[0]);
+                        common_cleanup(init);
+                        return 1;
+                }
+        }
+        if (opts.frames <= 0 || opts.mtu <= IPV4_UDP_RTP_HDR_LEN + (int) sizeof(fec_payload_hdr_t)) {
+                fprintf(stderr, "Wrong frame count or MTU!\n");
+                common_cleanup(init);
+                return 1;
+        }
+
+        vector<const char *> configs(argv + optind, argv + argc);
+        if (configs.empty()) {
+                configs.assign(std::begin(default_configs), std::end(default_configs));
+        }
+
+        printf("Loss model: %s, MTU %d B, %d frames per measurement\n\n",
+                        opts.burst >= 1.0 ? ("bursts of " + std::to_string(opts.burst) + " packets (mean)").c_str() : "random",
+                        opts.mtu, opts.frames);
+        printf("%-22s %9s %6s %7s %9s %7s %7s %9s %7s %7s %9s\n", "config", "size", "loss", "real",
+                        "enc MB/s", "avg ms", "max ms", "dec MB/s", "avg ms", "max ms", "recovered");
+        int ret = 0;
+        for (const char *cfg : configs) {
+                for (const auto &size_str : sizes) {
+                        const long long size = unit_evaluate(size_str.c_str(), nullptr);
+                        if (size <= 0) {
+                                fprintf(stderr, "Wrong frame size: %s\n", size_str.c_str());
+                                common_cleanup(init);
+                                return 1;
+                        }
+                        for (const auto &loss : losses) {
+                                if (!run_bench(cfg, size, atof(loss.c_str()) / 100.0, opts)) {
+                                        ret = 1;
+                                        goto next_config;
+                                }
+                        }
+                }
+next_config:
+                ;
+        }
+
+        common_cleanup(init);
+        return ret;
+}
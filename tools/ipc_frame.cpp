@@ -33,6 +33,9 @@ bool ipc_frame_parse_header(Ipc_frame_header *hdr, const char *buf){
         hdr->height = read_int(buf + 4);
         hdr->data_len = read_int(buf + 8);
         hdr->color_spec = static_cast<Ipc_frame_color_spec>(read_int(buf + 12));
+        hdr->flags = read_int(buf + 16);
+        hdr->shm_offset = read_int(buf + 20);
+        hdr->shm_seq = read_int(buf + 24);
 
         return true;
 }
@@ -43,6 +46,9 @@ void ipc_frame_write_header(const struct Ipc_frame_header *hdr, char *dst){
         write_int(dst + 4, hdr->height);
         write_int(dst + 8, hdr->data_len);
         write_int(dst + 12, hdr->color_spec);
+        write_int(dst + 16, hdr->flags);
+        write_int(dst + 20, hdr->shm_offset);
+        write_int(dst + 24, hdr->shm_seq);
 }
 
 Ipc_frame *ipc_frame_new(){
@@ -51,15 +57,20 @@ Ipc_frame *ipc_frame_new(){
         frame->header.height = 0;
         frame->header.data_len = 0;
         frame->header.color_spec = IPC_FRAME_COLOR_NONE;
+        frame->header.flags = 0;
+        frame->header.shm_offset = 0;
+        frame->header.shm_seq = 0;
 
         frame->data = nullptr;
         frame->alloc_size = 0;
+        frame->foreign_data = false;
 
         return frame;
 }
 
 void ipc_frame_free(Ipc_frame *frame){
-        free(frame->data);
+        if(!frame->foreign_data)
+                free(frame->data);
         free(frame);
 }
 
@@ -67,6 +78,9 @@ bool ipc_frame_reserve(Ipc_frame *frame, size_t size){
         if(size <= frame->alloc_size)
                 return true;
 
+        if(frame->foreign_data)
+                return false;
+
         auto newbuf = static_cast<char *>(realloc(frame->data, size));
         if(!newbuf)
                 return false;
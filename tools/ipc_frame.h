@@ -6,6 +6,9 @@
 
 #define IPC_FRAME_HEADER_LEN 128
 
+/// frame data are not sent over the socket but placed in a shared-memory ring
+#define IPC_FRAME_FLAG_SHM 1
+
 enum Ipc_frame_color_spec{
         IPC_FRAME_COLOR_NONE = 0,
         IPC_FRAME_COLOR_RGBA = 1,
@@ -18,6 +21,10 @@ struct Ipc_frame_header{
         int height;
         int data_len;
         enum Ipc_frame_color_spec color_spec;
+
+        int flags; ///< IPC_FRAME_FLAG_*
+        unsigned shm_offset; ///< data offset in the shm ring (IPC_FRAME_FLAG_SHM)
+        unsigned shm_seq; ///< slot sequence number (IPC_FRAME_FLAG_SHM)
 };
 
 struct Ipc_frame{
@@ -25,6 +32,7 @@ struct Ipc_frame{
         char *data;
 
         size_t alloc_size;
+        bool foreign_data; ///< data not owned by the frame (eg. shm), cannot be reallocated
 };
 
 bool ipc_frame_parse_header(struct Ipc_frame_header *hdr, const char *buf);
@@ -5,14 +5,17 @@
 #include "debug.h"
 #endif
 
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstdint>
 #include <vector>
 
 #include "ipc_frame_ug.h"
 #include "ipc_frame.h"
 #include "pixfmt_conv.h"
 #include "types.h"
+#include "utils/jpeg_reader.h"
 #include "video_codec.h"
 
 namespace {
@@ -36,78 +39,79 @@ void scale_frame(char *dst, char *src,
         }
 }
 
-}//anon namespace
-
-bool ipc_frame_from_ug_frame_hq(struct Ipc_frame *dst,
-                const struct video_frame *src,
-                codec_t codec,
-                unsigned scale_factor)
+/**
+ * Same output layout as scale_frame(), but each output pixel is an average of
+ * the whole f x f source block. Only 8-bit packed formats are supported, see
+ * box_scale_supported(). Vertical pass runs over whole lines to let the
+ * compiler vectorize it.
+ */
+void box_scale_frame(char *dst, const char *src,
+                int src_w, int src_h,
+                int f, codec_t codec)
 {
-        assert(codec == RGB);
-
-        if(!src)
-                return false;
-
-        decoder_t dec = get_decoder_from_to(src->color_spec, codec);
-        if(!dec){
-                return false;
-        }
-
-        dst->header.width = src->tiles[0].width;
-        dst->header.height = src->tiles[0].height;
-        dst->header.color_spec = static_cast<Ipc_frame_color_spec>(codec);
-
-        if(scale_factor != 0){
-                int block_size_px = get_pf_block_pixels(codec);
-                int block_count = (dst->header.width + block_size_px - 1) / block_size_px;
-                dst->header.width = (block_count / scale_factor) * block_size_px;
-                dst->header.height /= scale_factor;
-        }
-
-        int dst_frame_size = get_bpp(codec) * dst->header.width * dst->header.height;
-        if(!ipc_frame_reserve(dst, dst_frame_size))
-                return false;
-
-        dst->header.data_len = dst_frame_size;
-
-        char *scale_src = nullptr;
-        std::vector<unsigned char> rgb_frame;
+        const int src_line_len = vc_get_linesize(src_w, codec);
+        const int block_px = get_pf_block_pixels(codec);
+        const int out_w = ((src_w + block_px - 1) / block_px / f) * block_px;
+        const int out_h = src_h / f;
+        const int dst_line_len = vc_get_linesize(out_w, codec);
+        const uint32_t div = f * f;
+        std::vector<uint32_t> acc(src_line_len);
+
+        for(int oy = 0; oy < out_h; oy++){
+                std::fill(acc.begin(), acc.end(), 0);
+                for(int y = oy * f; y < (oy + 1) * f; y++){
+                        const auto *line = reinterpret_cast<const unsigned char *>(src) + y * src_line_len;
+                        for(int i = 0; i < src_line_len; i++){
+                                acc[i] += line[i];
+                        }
+                }
 
-        if(dec == vc_memcpy)
-                scale_src = src->tiles[0].data;
-        else{
-                auto rgb_line_len = vc_get_linesize(src->tiles[0].width, codec);
-                unsigned char *dec_dst = nullptr;
-                if(scale_factor != 0){
-                        rgb_frame.resize(rgb_line_len * src->tiles[0].height);
-                        scale_src = (char *) rgb_frame.data();
-                        dec_dst = (unsigned char *) scale_src;
-                } else {
-                        dec_dst = (unsigned char *) dst->data;
+                auto *out = reinterpret_cast<unsigned char *>(dst) + oy * dst_line_len;
+                if(codec == UYVY){
+                        for(int ox = 0; ox < out_w; ox += 2){
+                                uint32_t y[2] = {};
+                                uint32_t u = 0;
+                                uint32_t v = 0;
+                                for(int i = 0; i < 2; i++){
+                                        for(int k = 0; k < f; k++){
+                                                int px = std::min((ox + i) * f + k, src_w - 1);
+                                                const uint32_t *mp = &acc[px / 2 * 4];
+                                                y[i] += mp[1 + px % 2 * 2];
+                                                u += mp[0];
+                                                v += mp[2];
+                                        }
+                                }
+                                *out++ = (u + div) / (2 * div);
+                                *out++ = (y[0] + div / 2) / div;
+                                *out++ = (v + div) / (2 * div);
+                                *out++ = (y[1] + div / 2) / div;
+                        }
+                        continue;
                 }
 
-                for(unsigned i = 0; i < src->tiles[0].height; i++){
-                        dec(dec_dst + rgb_line_len * i,
-                                        (unsigned char *) src->tiles[0].data + vc_get_linesize(src->tiles[0].width, src->color_spec) * i,
-                                        rgb_line_len,
-                                        0, 8, 16);
+                const int bpp = get_bpp(codec);
+                for(int ox = 0; ox < out_w; ox++){
+                        const uint32_t *px = &acc[ox * f * bpp];
+                        for(int c = 0; c < bpp; c++){
+                                uint32_t sum = 0;
+                                for(int k = 0; k < f; k++){
+                                        sum += px[k * bpp + c];
+                                }
+                                *out++ = (sum + div / 2) / div;
+                        }
                 }
         }
+}
 
-        if(scale_factor == 0)
-                return true;
-
-        scale_frame(dst->data, scale_src,
-                        src->tiles[0].width, src->tiles[0].height,
-                        scale_factor, codec);
-
-        return true;
+bool box_scale_supported(codec_t codec){
+        return codec == RGB || codec == BGR || codec == RGBA || codec == UYVY;
 }
 
-bool ipc_frame_from_ug_frame(struct Ipc_frame *dst,
+bool ipc_frame_from_ug_frame_common(struct Ipc_frame *dst,
                 const struct video_frame *src,
                 codec_t codec,
-                unsigned scale_factor)
+                unsigned scale_factor,
+                bool box)
 {
         if(!src)
                 return false;
@@ -159,10 +163,15 @@ bool ipc_frame_from_ug_frame(struct Ipc_frame *dst,
                 }
                 dec_src = (unsigned char *) scale_dst;
 
-                scale_frame(scale_dst, src->tiles[0].data,
-                                src->tiles[0].width, src->tiles[0].height,
-                                scale_factor, src->color_spec);
-
+                if(box && scale_factor > 1){
+                        box_scale_frame(scale_dst, src->tiles[0].data,
+                                        src->tiles[0].width, src->tiles[0].height,
+                                        scale_factor, src->color_spec);
+                } else {
+                        scale_frame(scale_dst, src->tiles[0].data,
+                                        src->tiles[0].width, src->tiles[0].height,
+                                        scale_factor, src->color_spec);
+                }
         }
 
 
@@ -183,6 +192,138 @@ bool ipc_frame_from_ug_frame(struct Ipc_frame *dst,
         return true;
 }
 
+/**
+ * Builds the preview from JPEG DC coefficients (1/8 of the resolution)
+ * without fully decoding the frame, the rest of the scale factor is done
+ * by a box filter.
+ */
+bool ipc_frame_from_mjpg_dc(struct Ipc_frame *dst,
+                const struct video_frame *src,
+                unsigned scale_factor)
+{
+        static thread_local jpeg_info info;
+        auto *jpeg = reinterpret_cast<uint8_t *>(src->tiles[0].data);
+        if(jpeg_read_info(jpeg, src->tiles[0].data_len, &info) != 0)
+                return false;
+
+        const int dc_w = (info.width + 7) / 8;
+        const int dc_h = (info.height + 7) / 8;
+        const int f = std::max<int>(std::lround(scale_factor / 8.0), 1);
+
+        dst->header.width = dc_w / f;
+        dst->header.height = dc_h / f;
+        dst->header.color_spec = IPC_FRAME_COLOR_RGB;
+        dst->header.data_len = vc_get_linesize(dst->header.width, RGB) * dst->header.height;
+
+        size_t dc_len = vc_get_linesize(dc_w, RGB) * dc_h;
+        if(!ipc_frame_reserve(dst, f == 1 ? dc_len : dst->header.data_len + dc_len))
+                return false;
+
+        if(f == 1){
+                return jpeg_decode_dc_rgb(&info, jpeg + src->tiles[0].data_len,
+                                reinterpret_cast<uint8_t *>(dst->data));
+        }
+
+        char *dc_img = dst->data + dst->header.data_len;
+        if(!jpeg_decode_dc_rgb(&info, jpeg + src->tiles[0].data_len,
+                                reinterpret_cast<uint8_t *>(dc_img)))
+                return false;
+
+        box_scale_frame(dst->data, dc_img, dc_w, dc_h, f, RGB);
+        return true;
+}
+
+}//anon namespace
+
+bool ipc_frame_from_ug_frame_hq(struct Ipc_frame *dst,
+                const struct video_frame *src,
+                codec_t codec,
+                unsigned scale_factor)
+{
+        assert(codec == RGB);
+
+        if(!src)
+                return false;
+
+        decoder_t dec = get_decoder_from_to(src->color_spec, codec);
+        if(!dec){
+                return false;
+        }
+
+        dst->header.width = src->tiles[0].width;
+        dst->header.height = src->tiles[0].height;
+        dst->header.color_spec = static_cast<Ipc_frame_color_spec>(codec);
+
+        if(scale_factor != 0){
+                int block_size_px = get_pf_block_pixels(codec);
+                int block_count = (dst->header.width + block_size_px - 1) / block_size_px;
+                dst->header.width = (block_count / scale_factor) * block_size_px;
+                dst->header.height /= scale_factor;
+        }
+
+        int dst_frame_size = get_bpp(codec) * dst->header.width * dst->header.height;
+        if(!ipc_frame_reserve(dst, dst_frame_size))
+                return false;
+
+        dst->header.data_len = dst_frame_size;
+
+        char *scale_src = nullptr;
+        std::vector<unsigned char> rgb_frame;
+
+        if(dec == vc_memcpy)
+                scale_src = src->tiles[0].data;
+        else{
+                auto rgb_line_len = vc_get_linesize(src->tiles[0].width, codec);
+                unsigned char *dec_dst = nullptr;
+                if(scale_factor != 0){
+                        rgb_frame.resize(rgb_line_len * src->tiles[0].height);
+                        scale_src = (char *) rgb_frame.data();
+                        dec_dst = (unsigned char *) scale_src;
+                } else {
+                        dec_dst = (unsigned char *) dst->data;
+                }
+
+                for(unsigned i = 0; i < src->tiles[0].height; i++){
+                        dec(dec_dst + rgb_line_len * i,
+                                        (unsigned char *) src->tiles[0].data + vc_get_linesize(src->tiles[0].width, src->color_spec) * i,
+                                        rgb_line_len,
+                                        0, 8, 16);
+                }
+        }
+
+        if(scale_factor == 0)
+                return true;
+
+        scale_frame(dst->data, scale_src,
+                        src->tiles[0].width, src->tiles[0].height,
+                        scale_factor, codec);
+
+        return true;
+}
+
+bool ipc_frame_from_ug_frame(struct Ipc_frame *dst,
+                const struct video_frame *src,
+                codec_t codec,
+                unsigned scale_factor)
+{
+        return ipc_frame_from_ug_frame_common(dst, src, codec, scale_factor, false);
+}
+
+bool ipc_frame_from_ug_frame_box(struct Ipc_frame *dst,
+                const struct video_frame *src,
+                codec_t codec,
+                unsigned scale_factor)
+{
+        if(!src)
+                return false;
+
+        if(src->color_spec == MJPG && codec == RGB && scale_factor != 0)
+                return ipc_frame_from_mjpg_dc(dst, src, scale_factor);
+
+        return ipc_frame_from_ug_frame_common(dst, src, codec, scale_factor,
+                        box_scale_supported(src->color_spec));
+}
+
 int ipc_frame_get_scale_factor(int src_w, int src_h, int target_w, int target_h){
         if(target_w== -1 || target_h== -1)
                 return 0;
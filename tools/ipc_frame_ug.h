@@ -29,6 +29,20 @@ bool ipc_frame_from_ug_frame_hq(struct Ipc_frame *dst,
                 codec_t codec,
                 unsigned scale_factor);
 
+/**
+ * @brief Same as ipc_frame_from_ug_frame, but downscale with a box filter
+ *
+ * Each output pixel is an average of the scale_factor x scale_factor source
+ * block (RGB, BGR, RGBA and UYVY, other formats are point-sampled). MJPG
+ * frames are not decompressed, the preview is built from JPEG DC
+ * coefficients (1/8 resolution) and further box-filtered if scale_factor is
+ * greater than 8.
+ */
+bool ipc_frame_from_ug_frame_box(struct Ipc_frame *dst,
+                const struct video_frame *src,
+                codec_t codec,
+                unsigned scale_factor);
+
 bool ipc_frame_write_to_fd(const struct Ipc_frame *f, int fd);
 
 int ipc_frame_get_scale_factor(int src_w, int src_h, int target_w, int target_h);
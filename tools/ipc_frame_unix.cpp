@@ -24,6 +24,14 @@ typedef int fd_t;
 typedef SOCKET fd_t;
 #endif
 
+#ifdef __linux__
+#include <atomic>
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define IPC_FRAME_SHM
+#endif
+
 #include <cerrno>
 #include "ipc_frame_unix.h"
 
@@ -46,6 +54,23 @@ struct Wsa_guard{
         }
         Wsa_guard& operator=(Wsa_guard&&) = delete; //Make class unmovable and uncopyable
 };
+
+#ifdef IPC_FRAME_SHM
+/*
+ * Shared-memory ring layout: slot_count slots of equal size, each starting
+ * with a cache line holding the slot sequence number (seqlock) followed by
+ * frame data. The sequence number is odd while the writer fills the slot.
+ * The descriptor sent over the socket carries the offset and the (even)
+ * sequence number; the reader drops the frame if the number has changed
+ * after copying the data out (the writer has overtaken it).
+ */
+constexpr size_t SHM_SLOT_HDR_LEN = 64;
+constexpr size_t SHM_PAGE_LEN = 4096;
+
+std::atomic<uint32_t> *shm_slot_seq(char *slot){
+        return reinterpret_cast<std::atomic<uint32_t> *>(slot);
+}
+#endif
 } //anon namespace
 
 
@@ -54,8 +79,39 @@ struct Ipc_frame_reader{
         fd_t listen_fd;
         fd_t data_fd;
         std::string path;
+
+#ifdef IPC_FRAME_SHM
+        char *shm_ptr = nullptr;
+        size_t shm_len = 0;
+#endif
 };
 
+#ifdef IPC_FRAME_SHM
+static void reader_unmap_shm(Ipc_frame_reader *reader){
+        if(reader->shm_ptr)
+                munmap(reader->shm_ptr, reader->shm_len);
+        reader->shm_ptr = nullptr;
+        reader->shm_len = 0;
+}
+
+static bool reader_map_shm(Ipc_frame_reader *reader, int fd){
+        reader_unmap_shm(reader);
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size <= 0){
+                close(fd);
+                return false;
+        }
+        void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if(ptr == MAP_FAILED)
+                return false;
+
+        reader->shm_ptr = static_cast<char *>(ptr);
+        reader->shm_len = st.st_size;
+        return true;
+}
+#endif
+
 Ipc_frame_reader *ipc_frame_reader_new(const char *path){
         auto reader = std::make_unique<Ipc_frame_reader>();
         reader->path = path;
@@ -97,6 +153,9 @@ void ipc_frame_reader_free(struct Ipc_frame_reader *reader){
 
         UNLINK(reader->path.c_str());
 
+#ifdef IPC_FRAME_SHM
+        reader_unmap_shm(reader);
+#endif
         delete reader;
 }
 
@@ -114,6 +173,46 @@ static size_t blocking_read(fd_t fd, char *dst, size_t size){
         return bytes_read;
 }
 
+/**
+ * Reads the frame header. With shm transport, the ring memfd may be attached
+ * to it (SCM_RIGHTS) - the ring is then (re)mapped.
+ */
+static bool read_header(Ipc_frame_reader *reader, char *dst){
+#ifdef IPC_FRAME_SHM
+        struct iovec iov;
+        iov.iov_base = dst;
+        iov.iov_len = IPC_FRAME_HEADER_LEN;
+        union {
+                char buf[CMSG_SPACE(sizeof(int))];
+                struct cmsghdr align;
+        } control;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        ssize_t read_now = recvmsg(reader->data_fd, &msg, MSG_CMSG_CLOEXEC);
+        if(read_now <= 0)
+                return false;
+
+        for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+                if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS){
+                        int fd = -1;
+                        memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+                        if(!reader_map_shm(reader, fd))
+                                return false;
+                }
+        }
+
+        size_t rest = IPC_FRAME_HEADER_LEN - read_now;
+        return blocking_read(reader->data_fd, dst + read_now, rest) == rest;
+#else
+        return blocking_read(reader->data_fd, dst, IPC_FRAME_HEADER_LEN) == IPC_FRAME_HEADER_LEN;
+#endif
+}
+
 static bool socket_read_avail(fd_t fd){
         if(fd == INVALID_SOCKET)
                 return false;
@@ -157,10 +256,33 @@ void ipc_frame_reader_wait_connect(struct Ipc_frame_reader *reader){
         reader->data_fd = accept(reader->listen_fd, nullptr, 0);
 }
 
+#ifdef IPC_FRAME_SHM
+enum class Shm_read_result{ ok, overtaken, error };
+
+static Shm_read_result shm_frame_read(Ipc_frame_reader *reader, Ipc_frame *dst){
+        const size_t offset = dst->header.shm_offset;
+        if(!reader->shm_ptr || offset < SHM_SLOT_HDR_LEN
+                        || offset + dst->header.data_len > reader->shm_len)
+                return Shm_read_result::error;
+
+        auto seq = shm_slot_seq(reader->shm_ptr + offset - SHM_SLOT_HDR_LEN);
+        if(seq->load(std::memory_order_acquire) != dst->header.shm_seq)
+                return Shm_read_result::overtaken;
+
+        memcpy(dst->data, reader->shm_ptr + offset, dst->header.data_len);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(seq->load(std::memory_order_relaxed) != dst->header.shm_seq)
+                return Shm_read_result::overtaken;
+
+        return Shm_read_result::ok;
+}
+#endif
+
 static bool do_frame_read(Ipc_frame_reader *reader, Ipc_frame *dst){
         char header_buf[IPC_FRAME_HEADER_LEN];
 
-        if(blocking_read(reader->data_fd, header_buf, IPC_FRAME_HEADER_LEN) != IPC_FRAME_HEADER_LEN)
+        if(!read_header(reader, header_buf))
                 return false;
 
         if(!ipc_frame_parse_header(&dst->header, header_buf))
@@ -169,6 +291,23 @@ static bool do_frame_read(Ipc_frame_reader *reader, Ipc_frame *dst){
         if(!ipc_frame_reserve(dst, dst->header.data_len))
                 return false;
 
+#ifdef IPC_FRAME_SHM
+        while(dst->header.flags & IPC_FRAME_FLAG_SHM){
+                switch(shm_frame_read(reader, dst)){
+                case Shm_read_result::ok:
+                        return true;
+                case Shm_read_result::error:
+                        return false;
+                case Shm_read_result::overtaken: // torn frame, take the next one
+                        break;
+                }
+                if(!read_header(reader, header_buf)
+                                || !ipc_frame_parse_header(&dst->header, header_buf)
+                                || !ipc_frame_reserve(dst, dst->header.data_len))
+                        return false;
+        }
+#endif
+
         int read_data = blocking_read(reader->data_fd, dst->data, dst->header.data_len);
 
         return read_data == dst->header.data_len;
@@ -186,6 +325,17 @@ bool ipc_frame_reader_read(Ipc_frame_reader *reader, Ipc_frame *dst){
 
 struct Ipc_frame_writer{
         fd_t data_fd;
+
+#ifdef IPC_FRAME_SHM
+        int shm_slot_count = 0; ///< 0 - shm transport disabled
+        int shm_fd = -1;
+        char *shm_ptr = nullptr;
+        size_t shm_slot_len = 0;
+        int shm_cur_slot = 0;
+        bool shm_fd_sent = false;
+        bool shm_slot_pending = false; ///< current slot taken, not yet written
+        Ipc_frame_uniq shm_frame;
+#endif
 };
 
 Ipc_frame_writer *ipc_frame_writer_new(const char *path){
@@ -214,10 +364,100 @@ Ipc_frame_writer *ipc_frame_writer_new(const char *path){
         return writer.release();
 }
 
+#ifdef IPC_FRAME_SHM
+static void writer_unmap_shm(Ipc_frame_writer *writer){
+        if(writer->shm_ptr)
+                munmap(writer->shm_ptr, writer->shm_slot_len * writer->shm_slot_count);
+        if(writer->shm_fd != -1)
+                close(writer->shm_fd);
+        writer->shm_ptr = nullptr;
+        writer->shm_fd = -1;
+        writer->shm_slot_len = 0;
+}
+
+static bool writer_map_shm(Ipc_frame_writer *writer, size_t data_len){
+        writer_unmap_shm(writer);
+
+        size_t slot_len = (SHM_SLOT_HDR_LEN + data_len + SHM_PAGE_LEN - 1) / SHM_PAGE_LEN * SHM_PAGE_LEN;
+        size_t len = slot_len * writer->shm_slot_count;
+        if(len > UINT32_MAX) // offsets are sent as 32-bit
+                return false;
+
+        writer->shm_fd = memfd_create("ug_ipc_frame", MFD_CLOEXEC);
+        if(writer->shm_fd == -1)
+                return false;
+        if(ftruncate(writer->shm_fd, len) != 0){
+                writer_unmap_shm(writer);
+                return false;
+        }
+        void *ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, writer->shm_fd, 0);
+        if(ptr == MAP_FAILED){
+                writer_unmap_shm(writer);
+                return false;
+        }
+        writer->shm_ptr = static_cast<char *>(ptr);
+        writer->shm_slot_len = slot_len;
+        writer->shm_cur_slot = 0;
+        writer->shm_fd_sent = false;
+        writer->shm_slot_pending = false;
+        return true;
+}
+#endif
+
+bool ipc_frame_writer_enable_shm(struct Ipc_frame_writer *writer, int slot_count){
+#ifdef IPC_FRAME_SHM
+        if(slot_count < 2)
+                return false;
+
+        writer->shm_slot_count = slot_count;
+        writer->shm_frame.reset(ipc_frame_new());
+        writer->shm_frame->foreign_data = true;
+        return true;
+#else
+        (void) writer, (void) slot_count;
+        return false;
+#endif
+}
+
+struct Ipc_frame *ipc_frame_writer_get_shm_frame(struct Ipc_frame_writer *writer, size_t size){
+#ifdef IPC_FRAME_SHM
+        if(writer->shm_slot_count == 0)
+                return nullptr;
+
+        if(writer->shm_slot_len < SHM_SLOT_HDR_LEN + size){
+                if(!writer_map_shm(writer, size)){
+                        perror("ipc_frame_writer_get_shm_frame");
+                        writer->shm_slot_count = 0;
+                        return nullptr;
+                }
+        }
+
+        if(!writer->shm_slot_pending){
+                writer->shm_cur_slot = (writer->shm_cur_slot + 1) % writer->shm_slot_count;
+                char *slot = writer->shm_ptr + writer->shm_cur_slot * writer->shm_slot_len;
+                // odd - being written
+                shm_slot_seq(slot)->fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                writer->shm_slot_pending = true;
+        }
+
+        Ipc_frame *f = writer->shm_frame.get();
+        f->data = writer->shm_ptr + writer->shm_cur_slot * writer->shm_slot_len + SHM_SLOT_HDR_LEN;
+        f->alloc_size = writer->shm_slot_len - SHM_SLOT_HDR_LEN;
+        return f;
+#else
+        (void) writer, (void) size;
+        return nullptr;
+#endif
+}
+
 void ipc_frame_writer_free(struct Ipc_frame_writer *writer){
         if(writer->data_fd != INVALID_SOCKET)
                 CLOSESOCKET(writer->data_fd);
 
+#ifdef IPC_FRAME_SHM
+        writer_unmap_shm(writer);
+#endif
         delete writer;
 }
 
@@ -237,7 +477,73 @@ void block_write(fd_t fd, void *buf, size_t size){
 
 } //anon namespace
 
-bool ipc_frame_writer_write(struct Ipc_frame_writer *writer, const struct Ipc_frame *f){
+#ifdef IPC_FRAME_SHM
+/// sends the header, attaching the ring memfd if the reader doesn't have it yet
+static void shm_send_header(Ipc_frame_writer *writer, char *header){
+        if(writer->shm_fd_sent){
+                block_write(writer->data_fd, header, IPC_FRAME_HEADER_LEN);
+                return;
+        }
+
+        struct iovec iov;
+        iov.iov_base = header;
+        iov.iov_len = IPC_FRAME_HEADER_LEN;
+        union {
+                char buf[CMSG_SPACE(sizeof(int))];
+                struct cmsghdr align;
+        } control;
+        memset(&control, 0, sizeof(control));
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &writer->shm_fd, sizeof(int));
+
+        ssize_t ret = sendmsg(writer->data_fd, &msg, MSG_NOSIGNAL);
+        if(ret == -1)
+                return;
+        writer->shm_fd_sent = true;
+        block_write(writer->data_fd, header + ret, IPC_FRAME_HEADER_LEN - ret);
+}
+
+static bool socket_write(Ipc_frame_writer *writer, const Ipc_frame *f);
+
+static bool shm_write(Ipc_frame_writer *writer, const Ipc_frame *f){
+        Ipc_frame *slot_frame = writer->shm_frame.get();
+        if(f != slot_frame){
+                if(!ipc_frame_writer_get_shm_frame(writer, f->header.data_len))
+                        return socket_write(writer, f); // shm disabled
+                memcpy(slot_frame->data, f->data, f->header.data_len);
+                slot_frame->header = f->header;
+        } else if(!writer->shm_slot_pending){ // already sent
+                return false;
+        }
+
+        char *slot = writer->shm_ptr + writer->shm_cur_slot * writer->shm_slot_len;
+        uint32_t seq = shm_slot_seq(slot)->fetch_add(1, std::memory_order_release) + 1;
+        writer->shm_slot_pending = false;
+
+        Ipc_frame_header hdr = slot_frame->header;
+        hdr.flags |= IPC_FRAME_FLAG_SHM;
+        hdr.shm_offset = slot - writer->shm_ptr + SHM_SLOT_HDR_LEN;
+        hdr.shm_seq = seq;
+
+        std::array<char, IPC_FRAME_HEADER_LEN> header;
+        ipc_frame_write_header(&hdr, header.data());
+
+        errno = 0;
+        shm_send_header(writer, header.data());
+        return errno == 0;
+}
+#endif
+
+static bool socket_write(Ipc_frame_writer *writer, const Ipc_frame *f){
         std::array<char, IPC_FRAME_HEADER_LEN> header;
 
         ipc_frame_write_header(&f->header, header.data());
@@ -249,3 +555,10 @@ bool ipc_frame_writer_write(struct Ipc_frame_writer *writer, const struct Ipc_fr
         return errno == 0;
 }
 
+bool ipc_frame_writer_write(struct Ipc_frame_writer *writer, const struct Ipc_frame *f){
+#ifdef IPC_FRAME_SHM
+        if(writer->shm_slot_count > 0)
+                return shm_write(writer, f);
+#endif
+        return socket_write(writer, f);
+}
@@ -21,6 +21,24 @@ void ipc_frame_writer_free(struct Ipc_frame_writer *writer);
 
 bool ipc_frame_writer_write(struct Ipc_frame_writer *writer, const struct Ipc_frame *f);
 
+/**
+ * Switches the writer to shared-memory transport - frame data are placed in
+ * a memfd-backed ring of slot_count slots and only the header is sent over
+ * the socket. Linux only.
+ *
+ * @returns false if not supported, the socket transport is used then
+ */
+bool ipc_frame_writer_enable_shm(struct Ipc_frame_writer *writer, int slot_count);
+/**
+ * Returns frame with data pointing directly to the next ring slot, so that it
+ * can be filled in place and passed to ipc_frame_writer_write() without a copy.
+ * The frame is owned by the writer and valid until the next call.
+ *
+ * @param size  maximal data size that will be written
+ * @returns NULL if shm is not enabled
+ */
+struct Ipc_frame *ipc_frame_writer_get_shm_frame(struct Ipc_frame_writer *writer, size_t size);
+
 #ifdef __cplusplus
 #include <memory>
 struct Ipc_frame_reader_deleter{
@@ -0,0 +1,606 @@
+/**
+ * @file   tools/pipeline_bench.cpp
+ * @brief  End-to-end benchmark of the UltraGrid pipeline over localhost
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * For each combination of the given frame sizes, compressions and FECs runs
+ * an UltraGrid receiver (dummy display) and sender (testcard) over localhost
+ * and measures in the steady state (after a warm-up):
+ * - sustained frame rate - displayed frames (receiver glass-latency count)
+ * - packet loss - from the receiver's ug_rx_packets_* metrics
+ * - latency p50/p99/max per stage - from the receiver's "glass_latency" stats
+ *   (p50 is a frame-weighted average of the reported 5 s intervals, p99 and
+ *   max are the maximum)
+ * - CPU usage per thread name of both processes (from /proc, Linux only)
+ *
+ * The results are printed as CSV or JSON for regression tracking.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <map>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::vector;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+#define DEFAULT_DURATION 10
+#define DEFAULT_WARMUP 3
+#define DEFAULT_FPS 60
+#define DEFAULT_PORT 5004
+#define DEFAULT_CONTROL_PORT 15004
+#define STARTUP_TIMEOUT_MS 10000
+#define EXIT_TIMEOUT_MS 5000
+
+enum output_fmt {
+        OUT_CSV,
+        OUT_JSON,
+};
+
+struct bench_opts {
+        vector<string> sizes{"1920x1080"};
+        vector<string> compressions{"none"};
+        vector<string> fecs{"none"};
+        string encryption; ///< passphrase, empty if disabled
+        double fps = DEFAULT_FPS;
+        int duration = DEFAULT_DURATION;
+        int warmup = DEFAULT_WARMUP;
+        int port = DEFAULT_PORT;
+        int control_port = DEFAULT_CONTROL_PORT; ///< receiver, sender uses +1
+        string uv = "bin/uv";
+        enum output_fmt out_fmt = OUT_CSV;
+        bool verbose = false;
+};
+
+struct latency {
+        double p50 = 0; ///< frame-weighted average of the intervals
+        double p99 = 0;
+        double max = 0;
+};
+
+struct result {
+        string size;
+        string compression;
+        string fec;
+        double fps = 0;
+        double loss_pct = 0;
+        long long frames = 0; ///< in reported stats intervals (latency weight)
+        map<string, latency> latency_ms; ///< by stage
+        map<string, double> cpu_tx;      ///< sender, % of one core by thread name
+        map<string, double> cpu_rx;      ///< receiver
+};
+
+static void usage(const char *progname)
+{
+        printf("Usage:\n\t%s [-s <sizes>] [-c <compressions>] [-F <fecs>] [-e <key>] [-r <fps>]\n"
+               "\t\t[-d <secs>] [-w <secs>] [-u <uv>] [-P <port>] [-C <port>] [-f csv|json] [-v]\n\n",
+               progname);
+        printf("where\n"
+               "\t-s <sizes>        - comma-separated frame sizes (default 1920x1080)\n"
+               "\t-c <compressions> - semicolon-separated -c arguments (default none)\n"
+               "\t-F <fecs>         - semicolon-separated -f arguments (default none)\n"
+               "\t-e <key>          - enable encryption with the passphrase\n"
+               "\t-r <fps>          - testcard frame rate (default %d)\n"
+               "\t-d <secs>         - measured duration of each run (default %d)\n"
+               "\t-w <secs>         - warm-up before the measurement (default %d)\n"
+               "\t-u <uv>           - UltraGrid executable (default bin/uv)\n"
+               "\t-P <port>         - RTP port (default %d)\n"
+               "\t-C <port>         - receiver control port, sender uses the next one (default %d)\n"
+               "\t-f <format>       - output format (default csv)\n"
+               "\t-v                - show the output of UltraGrid processes\n\n",
+               DEFAULT_FPS, DEFAULT_DURATION, DEFAULT_WARMUP, DEFAULT_PORT,
+               DEFAULT_CONTROL_PORT);
+}
+
+static vector<string> split(const char *str, char delim)
+{
+        vector<string> ret;
+        std::istringstream iss(str);
+        string item;
+        while (std::getline(iss, item, delim)) {
+                if (!item.empty()) {
+                        ret.push_back(item);
+                }
+        }
+        return ret;
+}
+
+static pid_t spawn(const vector<string> &args, bool verbose)
+{
+        if (verbose) {
+                fprintf(stderr, "Running:");
+                for (const auto &a : args) {
+                        fprintf(stderr, " %s", a.c_str());
+                }
+                fprintf(stderr, "\n");
+        }
+        const pid_t pid = fork();
+        if (pid != 0) {
+                return pid;
+        }
+        if (!verbose) {
+                const int fd = open("/dev/null", O_RDWR);
+                dup2(fd, STDIN_FILENO);
+                dup2(fd, STDOUT_FILENO);
+                dup2(fd, STDERR_FILENO);
+                close(fd);
+        }
+        vector<char *> argv;
+        for (const auto &a : args) {
+                argv.push_back(const_cast<char *>(a.c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        perror(argv[0]);
+        _exit(127);
+}
+
+static void terminate(pid_t pid)
+{
+        kill(pid, SIGINT);
+        for (int i = 0; i < EXIT_TIMEOUT_MS / 10; ++i) {
+                if (waitpid(pid, nullptr, WNOHANG) == pid) {
+                        return;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        fprintf(stderr, "Process %d did not exit, killing it.\n", (int) pid);
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+}
+
+/// @returns connected socket, -1 if the process exited or timeout expired
+static int connect_control(int port, pid_t pid)
+{
+        struct sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        for (int i = 0; i < STARTUP_TIMEOUT_MS / 100; ++i) {
+                if (waitpid(pid, nullptr, WNOHANG) == pid) {
+                        return -1;
+                }
+                const int fd = socket(AF_INET, SOCK_STREAM, 0);
+                if (connect(fd, (struct sockaddr *) &addr, sizeof addr) == 0) {
+                        return fd;
+                }
+                close(fd);
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        return -1;
+}
+
+/// @returns body of the /metrics HTTP response
+static string get_metrics(int port, pid_t pid)
+{
+        const int fd = connect_control(port, pid);
+        if (fd == -1) {
+                return {};
+        }
+        const char *req = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        if (write(fd, req, strlen(req)) < 0) {
+                close(fd);
+                return {};
+        }
+        string resp;
+        char buf[4096];
+        ssize_t len = 0;
+        while ((len = read(fd, buf, sizeof buf)) > 0) {
+                resp.append(buf, len);
+        }
+        close(fd);
+        const size_t body = resp.find("\r\n\r\n");
+        return body == string::npos ? string() : resp.substr(body + 4);
+}
+
+/// @returns sum of the samples with the name prefix (eg. including labels)
+static double metric_sum(const string &metrics, const string &prefix)
+{
+        double sum = 0;
+        std::istringstream iss(metrics);
+        string line;
+        while (std::getline(iss, line)) {
+                if (line.compare(0, prefix.length(), prefix) == 0) {
+                        const size_t sp = line.rfind(' ');
+                        sum += sp != string::npos ? atof(line.c_str() + sp + 1) : 0;
+                }
+        }
+        return sum;
+}
+
+/// @returns CPU time (utime + stime) in clock ticks by thread name
+static map<string, long long> get_thread_cpu(pid_t pid)
+{
+        map<string, long long> ret;
+        const string task_dir = "/proc/" + std::to_string(pid) + "/task";
+        DIR *dir = opendir(task_dir.c_str());
+        if (dir == nullptr) {
+                return ret;
+        }
+        while (struct dirent *ent = readdir(dir)) {
+                if (ent->d_name[0] == '.') {
+                        continue;
+                }
+                FILE *f = fopen((task_dir + "/" + ent->d_name + "/stat").c_str(), "r");
+                if (f == nullptr) {
+                        continue;
+                }
+                char line[1024] = "";
+                const bool read_ok = fgets(line, sizeof line, f) != nullptr;
+                fclose(f);
+                char *name_start = strchr(line, '(');
+                char *name_end = strrchr(line, ')');
+                if (!read_ok || name_start == nullptr || name_end == nullptr) {
+                        continue;
+                }
+                const string name(name_start + 1, name_end);
+                // fields after the name: state(3) ... utime(14) stime(15)
+                unsigned long long utime = 0;
+                unsigned long long stime = 0;
+                if (sscanf(name_end + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                           &utime, &stime) == 2) {
+                        ret[name] += (long long) (utime + stime);
+                }
+        }
+        closedir(dir);
+        return ret;
+}
+
+static map<string, double> cpu_usage(const map<string, long long> &start,
+                                     const map<string, long long> &end, double secs)
+{
+        map<string, double> ret;
+        const double ticks = (double) sysconf(_SC_CLK_TCK);
+        for (const auto &t : end) {
+                const auto it = start.find(t.first);
+                const long long delta = t.second - (it != start.end() ? it->second : 0);
+                ret[t.first] = delta / ticks / secs * 100.0;
+        }
+        return ret;
+}
+
+/**
+ * Parses a "stats glass_latency frames <n> <stage> <p50>/<p99>/<max> ..." line.
+ */
+static void parse_latency(const string &line, struct result *res)
+{
+        std::istringstream iss(line);
+        string word;
+        long long frames = 0;
+        iss >> word >> word >> word >> frames; // "stats glass_latency frames <n>"
+        if (frames <= 0) {
+                return;
+        }
+        string stage;
+        string vals;
+        while (iss >> stage >> vals) {
+                double p50 = 0;
+                double p99 = 0;
+                double max = 0;
+                if (sscanf(vals.c_str(), "%lf/%lf/%lf", &p50, &p99, &max) != 3) {
+                        continue;
+                }
+                latency &l = res->latency_ms[stage];
+                l.p50 = (l.p50 * res->frames + p50 * frames) / (res->frames + frames);
+                l.p99 = std::max(l.p99, p99);
+                l.max = std::max(l.max, max);
+        }
+        res->frames += frames;
+}
+
+/// reads stats lines from the control socket for given duration
+static void read_stats(int fd, double secs, struct result *res)
+{
+        string buf;
+        const auto end = steady_clock::now() + duration<double>(secs);
+        while (steady_clock::now() < end) {
+                const int timeout_ms = (int) std::chrono::duration_cast<std::chrono::milliseconds>(
+                                end - steady_clock::now()).count();
+                struct pollfd pfd = { fd, POLLIN, 0 };
+                if (poll(&pfd, 1, std::max(timeout_ms, 0)) <= 0) {
+                        continue;
+                }
+                char data[4096];
+                const ssize_t len = read(fd, data, sizeof data);
+                if (len <= 0) {
+                        return;
+                }
+                buf.append(data, len);
+                size_t pos = 0;
+                while ((pos = buf.find("\r\n")) != string::npos) {
+                        const string line = buf.substr(0, pos);
+                        buf.erase(0, pos + 2);
+                        if (res != nullptr && line.compare(0, 20, "stats glass_latency ") == 0) {
+                                parse_latency(line, res);
+                        }
+                }
+        }
+}
+
+static bool run(const struct bench_opts &opts, struct result *res)
+{
+        const string port = std::to_string(opts.port);
+        vector<string> rx_args{opts.uv, "-d", "dummy", "-P", port, "--control-port",
+                               std::to_string(opts.control_port)};
+        vector<string> tx_args{opts.uv, "-t", "testcard:size=" + res->size + ":fps=" +
+                               std::to_string(opts.fps) + ":ring", "-c", res->compression,
+                               "--param", "glass-latency", "-P", port, "--control-port",
+                               std::to_string(opts.control_port + 1)};
+        if (res->fec != "none") {
+                tx_args.insert(tx_args.end(), { "-f", res->fec });
+        }
+        if (!opts.encryption.empty()) {
+                rx_args.insert(rx_args.end(), { "--encryption", opts.encryption });
+                tx_args.insert(tx_args.end(), { "--encryption", opts.encryption });
+        }
+        tx_args.emplace_back("localhost");
+
+        const pid_t rx = spawn(rx_args, opts.verbose);
+        const int stats_fd = connect_control(opts.control_port, rx);
+        if (stats_fd == -1) {
+                fprintf(stderr, "Receiver failed to start!\n");
+                terminate(rx);
+                return false;
+        }
+        const pid_t tx = spawn(tx_args, opts.verbose);
+        const char *stats_on = "stats on\r\n";
+        bool ok = write(stats_fd, stats_on, strlen(stats_on)) > 0;
+
+        read_stats(stats_fd, opts.warmup, nullptr);
+        ok = ok && waitpid(tx, nullptr, WNOHANG) == 0;
+        const string metrics_start = ok ? get_metrics(opts.control_port, rx) : string();
+        const auto cpu_tx_start = get_thread_cpu(tx);
+        const auto cpu_rx_start = get_thread_cpu(rx);
+        const auto t0 = steady_clock::now();
+
+        if (ok) {
+                read_stats(stats_fd, opts.duration, res);
+        }
+
+        const string metrics_end = ok ? get_metrics(opts.control_port, rx) : string();
+        const double secs = duration<double>(steady_clock::now() - t0).count();
+        res->cpu_tx = cpu_usage(cpu_tx_start, get_thread_cpu(tx), secs);
+        res->cpu_rx = cpu_usage(cpu_rx_start, get_thread_cpu(rx), secs);
+        ok = ok && waitpid(tx, nullptr, WNOHANG) == 0 && !metrics_end.empty();
+        close(stats_fd);
+        terminate(tx);
+        terminate(rx);
+        if (!ok) {
+                fprintf(stderr, "Sender or receiver failed!\n");
+                return false;
+        }
+
+        const char *frames_metric = "ug_glass_latency_seconds_count{stage=\"total\"}";
+        res->fps = (metric_sum(metrics_end, frames_metric) -
+                    metric_sum(metrics_start, frames_metric)) / secs;
+        const double expected = metric_sum(metrics_end, "ug_rx_packets_expected_total") -
+                                metric_sum(metrics_start, "ug_rx_packets_expected_total");
+        const double received = metric_sum(metrics_end, "ug_rx_packets_received_total") -
+                                metric_sum(metrics_start, "ug_rx_packets_received_total");
+        res->loss_pct = expected > 0 ? std::max(expected - received, 0.0) / expected * 100.0 : 0;
+        return true;
+}
+
+static double total_cpu(const map<string, double> &cpu)
+{
+        double sum = 0;
+        for (const auto &t : cpu) {
+                sum += t.second;
+        }
+        return sum;
+}
+
+static void print_header(const struct bench_opts &opts)
+{
+        switch (opts.out_fmt) {
+        case OUT_CSV:
+                printf("size,compression,fec,encryption,fps,loss_pct,total_p50_ms,total_p99_ms,"
+                       "total_max_ms,sender_cpu_pct,receiver_cpu_pct\n");
+                break;
+        case OUT_JSON:
+                printf("[\n");
+                break;
+        }
+}
+
+static void print_footer(const struct bench_opts &opts)
+{
+        if (opts.out_fmt == OUT_JSON) {
+                printf("\n]\n");
+        }
+}
+
+static string json_cpu(const map<string, double> &cpu)
+{
+        std::ostringstream oss;
+        oss << "{";
+        for (auto it = cpu.begin(); it != cpu.end(); ++it) {
+                char val[32];
+                snprintf(val, sizeof val, "%.1f", it->second);
+                oss << (it == cpu.begin() ? "" : ", ") << "\"" << it->first << "\": " << val;
+        }
+        oss << "}";
+        return oss.str();
+}
+
+static void print_result(const struct bench_opts &opts, const struct result &r)
+{
+        static bool first = true;
+        const latency total = r.latency_ms.count("total") ? r.latency_ms.at("total") : latency{};
+        switch (opts.out_fmt) {
+        case OUT_CSV:
+                printf("%s,\"%s\",\"%s\",%d,%.2f,%.4f,%.2f,%.2f,%.2f,%.1f,%.1f\n", r.size.c_str(),
+                       r.compression.c_str(), r.fec.c_str(), !opts.encryption.empty(), r.fps,
+                       r.loss_pct, total.p50, total.p99, total.max, total_cpu(r.cpu_tx),
+                       total_cpu(r.cpu_rx));
+                break;
+        case OUT_JSON: {
+                std::ostringstream lat;
+                for (auto it = r.latency_ms.begin(); it != r.latency_ms.end(); ++it) {
+                        char val[128];
+                        snprintf(val, sizeof val, "{\"p50\": %.2f, \"p99\": %.2f, \"max\": %.2f}",
+                                 it->second.p50, it->second.p99, it->second.max);
+                        lat << (it == r.latency_ms.begin() ? "" : ", ") << "\"" << it->first
+                            << "\": " << val;
+                }
+                printf("%s  {\"size\": \"%s\", \"compression\": \"%s\", \"fec\": \"%s\", "
+                       "\"encryption\": %s, \"fps\": %.2f, \"loss_pct\": %.4f, "
+                       "\"latency_ms\": {%s}, \"cpu_pct\": {\"sender\": %s, \"receiver\": %s}}",
+                       first ? "" : ",\n", r.size.c_str(), r.compression.c_str(), r.fec.c_str(),
+                       opts.encryption.empty() ? "false" : "true", r.fps, r.loss_pct,
+                       lat.str().c_str(), json_cpu(r.cpu_tx).c_str(), json_cpu(r.cpu_rx).c_str());
+                break;
+        }
+        }
+        first = false;
+        fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+        struct bench_opts opts;
+        static struct option getopt_options[] = {
+                {"help", no_argument, nullptr, 'h'},
+                { nullptr, 0, nullptr, 0 }
+        };
+        int ch = 0;
+        while ((ch = getopt_long(argc, argv, "C:c:d:e:F:f:hP:r:s:u:vw:", getopt_options, nullptr)) != -1) {
+                switch (ch) {
+                case 'C':
+                        opts.control_port = atoi(optarg);
+                        break;
+                case 'c':
+                        opts.compressions = split(optarg, ';');
+                        break;
+                case 'd':
+                        opts.duration = atoi(optarg);
+                        break;
+                case 'e':
+                        opts.encryption = optarg;
+                        break;
+                case 'F':
+                        opts.fecs = split(optarg, ';');
+                        break;
+                case 'f':
+                        if (strcmp(optarg, "csv") == 0) {
+                                opts.out_fmt = OUT_CSV;
+                        } else if (strcmp(optarg, "json") == 0) {
+                                opts.out_fmt = OUT_JSON;
+                        } else {
+                                fprintf(stderr, "Unknown output format: %s\n", optarg);
+                                return 1;
+                        }
+                        break;
+                case 'P':
+                        opts.port = atoi(optarg);
+                        break;
+                case 'r':
+                        opts.fps = atof(optarg);
+                        break;
+                case 's':
+                        opts.sizes = split(optarg, ',');
+                        break;
+                case 'u':
+                        opts.uv = optarg;
+                        break;
+                case 'v':
+                        opts.verbose = true;
+                        break;
+                case 'w':
+                        opts.warmup = atoi(optarg);
+                        break;
+                case 'h':
+                        usage(argv[0]);
+                        return 0;
+                default:
+                        usage(argv[0]);
+                        return 1;
+                }
+        }
+        if (opts.duration <= 0 || opts.warmup < 0 || opts.fps <= 0 || opts.sizes.empty()
+                        || opts.compressions.empty() || opts.fecs.empty()) {
+                fprintf(stderr, "Wrong argument!\n");
+                return 1;
+        }
+        if (access(opts.uv.c_str(), X_OK) != 0) {
+                fprintf(stderr, "Cannot execute %s: %s\n", opts.uv.c_str(), strerror(errno));
+                return 1;
+        }
+
+        int failed = 0;
+        print_header(opts);
+        for (const auto &size : opts.sizes) {
+                for (const auto &compression : opts.compressions) {
+                        for (const auto &fec : opts.fecs) {
+                                struct result res;
+                                res.size = size;
+                                res.compression = compression;
+                                res.fec = fec;
+                                if (!run(opts, &res)) {
+                                        failed += 1;
+                                }
+                                print_result(opts, res);
+                        }
+                }
+        }
+        print_footer(opts);
+        return failed == 0 ? 0 : 1;
+}
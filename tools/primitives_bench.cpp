@@ -0,0 +1,560 @@
+/**
+ * @file   tools/primitives_bench.cpp
+ * @brief  Microbenchmarks of UltraGrid concurrency primitives
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Measures the primitives used on the hot paths with the current
+ * implementations linked from UltraGrid, so that a replacement may be
+ * compared on each platform:
+ * - synchronized_queue - 1:1 and N:1 throughput, hand-over latency
+ * - ring_buffer, audio_buffer - 1:1 (single producer, single consumer)
+ *   throughput of the given chunk size
+ * - video_frame_pool - get+dispose in one thread, 1:1 frame hand-over to a
+ *   releasing thread and N concurrent getters
+ * - wait_obj - wakeup latency (ping-pong)
+ * - worker - task_run_async()+wait_task() round trip, task_run_parallel()
+ * - simple_linked_list - append+pop (not thread-safe, single thread only)
+ *
+ * Compare with tools/queue_bench for lockfree_queue.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "debug.h"
+#include "host.h"
+#include "types.h"
+#include "utils/audio_buffer.h"
+#include "utils/list.h"
+#include "utils/ring_buffer.h"
+#include "utils/synchronized_queue.h"
+#include "utils/video_frame_pool.h"
+#include "utils/wait_obj.h"
+#include "utils/worker.h"
+#include "video_frame.h"
+
+using std::string;
+using std::thread;
+using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+#define DEFAULT_ITEMS 1000000
+#define DEFAULT_SAMPLES 10000
+#define DEFAULT_CHUNK 4096
+#define RING_SIZE (1024 * 1024)
+#define POOL_FRAMES 4
+#define POISON (-1LL)
+
+enum output_fmt {
+        OUT_TABLE,
+        OUT_CSV,
+};
+
+struct bench_opts {
+        int items = DEFAULT_ITEMS;
+        int samples = DEFAULT_SAMPLES;
+        int chunk = DEFAULT_CHUNK;
+        int producers = 4;
+        enum output_fmt out_fmt = OUT_TABLE;
+};
+
+struct result {
+        double ops_per_sec = 0;
+        vector<long long> latencies; ///< ns, may be empty
+};
+
+static long long now_ns()
+{
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void print_header(const bench_opts &opts)
+{
+        if (opts.out_fmt == OUT_CSV) {
+                printf("primitive,test,ops_per_sec,avg_us,p50_us,p99_us,max_us\n");
+                return;
+        }
+        printf("%d items, %d latency samples, chunk %d B, %d producer(s) in N:1 tests\n\n",
+               opts.items, opts.samples, opts.chunk, opts.producers);
+        printf("%-20s %-18s %12s %9s %9s %9s %9s\n", "primitive", "test", "ops/s",
+               "avg us", "p50 us", "p99 us", "max us");
+}
+
+static void print_result(const bench_opts &opts, const char *name, const string &test,
+                         result &res)
+{
+        double avg = 0;
+        double p50 = 0;
+        double p99 = 0;
+        double max = 0;
+        auto &lat = res.latencies;
+        if (!lat.empty()) {
+                std::sort(lat.begin(), lat.end());
+                double sum = 0;
+                for (long long l : lat) {
+                        sum += l;
+                }
+                avg = sum / lat.size() / 1000.0;
+                p50 = lat[lat.size() / 2] / 1000.0;
+                p99 = lat[lat.size() * 99 / 100] / 1000.0;
+                max = lat.back() / 1000.0;
+        }
+        if (opts.out_fmt == OUT_CSV) {
+                printf("%s,%s,%.0f,%.3f,%.3f,%.3f,%.3f\n", name, test.c_str(),
+                       res.ops_per_sec, avg, p50, p99, max);
+        } else if (lat.empty()) {
+                printf("%-20s %-18s %12.0f\n", name, test.c_str(), res.ops_per_sec);
+        } else {
+                printf("%-20s %-18s %12.0f %9.3f %9.3f %9.3f %9.3f\n", name, test.c_str(),
+                       res.ops_per_sec, avg, p50, p99, max);
+        }
+        fflush(stdout);
+}
+
+/// @param producers count of threads pushing concurrently to the consumer
+static result queue_throughput(const bench_opts &opts, int producers)
+{
+        synchronized_queue<long long, -1> queue;
+        const int per_producer = opts.items / producers;
+        const long long start = now_ns();
+        thread consumer([&queue, producers] {
+                int finished = 0;
+                while (finished < producers) {
+                        if (queue.pop() == POISON) {
+                                finished += 1;
+                        }
+                }
+        });
+        vector<thread> threads;
+        for (int i = 0; i < producers; ++i) {
+                threads.emplace_back([&queue, per_producer] {
+                        for (long long j = 1; j <= per_producer; ++j) {
+                                queue.push(j);
+                        }
+                        queue.push(POISON);
+                });
+        }
+        for (auto &t : threads) {
+                t.join();
+        }
+        consumer.join();
+        result res;
+        res.ops_per_sec = (double) per_producer * producers / ((now_ns() - start) / 1e9);
+        return res;
+}
+
+/// push to pop latency with the consumer waiting (queue mostly empty)
+static result queue_latency(const bench_opts &opts)
+{
+        synchronized_queue<long long, 1> queue;
+        result res;
+        res.latencies.reserve(opts.samples);
+        thread consumer([&queue, &res] {
+                long long sent = 0;
+                while ((sent = queue.pop()) != POISON) {
+                        res.latencies.push_back(now_ns() - sent);
+                }
+        });
+        const long long start = now_ns();
+        for (int i = 0; i < opts.samples; ++i) {
+                // let the consumer fall asleep
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                queue.push(now_ns());
+        }
+        queue.push(POISON);
+        consumer.join();
+        res.ops_per_sec = opts.samples / ((now_ns() - start) / 1e9);
+        return res;
+}
+
+/**
+ * single writer and reader spinning (yielding) on full/empty buffer
+ *
+ * @param write called with chunk, returns false if there was no space
+ * @param read  returns read bytes
+ */
+template<typename write_t, typename read_t>
+static result spsc_throughput(const bench_opts &opts, write_t write, read_t read)
+{
+        const long long total = (long long) opts.items * opts.chunk / 16;
+        std::atomic<bool> writer_done{false};
+        long long read_bytes = 0;
+        const long long start = now_ns();
+        thread reader([&] {
+                vector<char> buf(opts.chunk);
+                while (read_bytes < total) {
+                        const int ret = read(buf.data(), opts.chunk);
+                        if (ret > 0) {
+                                read_bytes += ret;
+                        } else if (writer_done) {
+                                break;
+                        } else {
+                                std::this_thread::yield();
+                        }
+                }
+        });
+        vector<char> buf(opts.chunk, 'x');
+        for (long long written = 0; written < total; ) {
+                if (write(buf.data(), opts.chunk)) {
+                        written += opts.chunk;
+                } else {
+                        std::this_thread::yield();
+                }
+        }
+        writer_done = true;
+        reader.join();
+        result res;
+        res.ops_per_sec = (double) read_bytes / opts.chunk / ((now_ns() - start) / 1e9);
+        return res;
+}
+
+static result ring_buffer_throughput(const bench_opts &opts)
+{
+        struct ring_buffer *ring = ring_buffer_init(RING_SIZE);
+        result res = spsc_throughput(opts,
+                [ring](const char *data, int len) {
+                        if (ring_get_available_write_size(ring) < len) {
+                                return false;
+                        }
+                        ring_buffer_write(ring, data, len);
+                        return true;
+                },
+                [ring](char *data, int len) { return ring_buffer_read(ring, data, len); });
+        ring_buffer_destroy(ring);
+        return res;
+}
+
+/// writer keeps the fill around the target so that the buffer doesn't drop
+static result audio_buffer_throughput(const bench_opts &opts)
+{
+        struct audio_buffer *buf = audio_buffer_init(48000, 4, 2, 50);
+        result res = spsc_throughput(opts,
+                [buf](const char *data, int len) {
+                        int fill = 0;
+                        int target = 0;
+                        audio_buffer_get_fill(buf, &fill, &target);
+                        if (fill > target) {
+                                return false;
+                        }
+                        audio_buffer_write(buf, data, len);
+                        return true;
+                },
+                [buf](char *data, int len) { return audio_buffer_read(buf, data, len); });
+        audio_buffer_destroy(buf);
+        return res;
+}
+
+static struct video_desc pool_desc()
+{
+        return video_desc{1920, 1080, UYVY, 30.0, PROGRESSIVE, 1};
+}
+
+static result pool_single(const bench_opts &opts)
+{
+        void *pool = video_frame_pool_init(pool_desc(), POOL_FRAMES);
+        result res;
+        res.latencies.reserve(opts.samples);
+        const long long start = now_ns();
+        for (int i = 0; i < opts.items; ++i) {
+                const long long t0 = i < opts.samples ? now_ns() : 0;
+                struct video_frame *f = video_frame_pool_get_disposable_frame(pool);
+                VIDEO_FRAME_DISPOSE(f);
+                if (i < opts.samples) {
+                        res.latencies.push_back(now_ns() - t0);
+                }
+        }
+        res.ops_per_sec = opts.items / ((now_ns() - start) / 1e9);
+        video_frame_pool_destroy(pool);
+        return res;
+}
+
+/// frames are disposed by another thread like a compressed frame by sender
+static result pool_handover(const bench_opts &opts)
+{
+        void *pool = video_frame_pool_init(pool_desc(), POOL_FRAMES);
+        synchronized_queue<struct video_frame *, -1> queue;
+        const int count = opts.items / 10;
+        const long long start = now_ns();
+        thread releaser([&queue] {
+                struct video_frame *f = nullptr;
+                while ((f = queue.pop()) != nullptr) {
+                        VIDEO_FRAME_DISPOSE(f);
+                }
+        });
+        for (int i = 0; i < count; ++i) {
+                queue.push(video_frame_pool_get_disposable_frame(pool));
+        }
+        queue.push(nullptr);
+        releaser.join();
+        result res;
+        res.ops_per_sec = count / ((now_ns() - start) / 1e9);
+        video_frame_pool_destroy(pool);
+        return res;
+}
+
+static result pool_contended(const bench_opts &opts)
+{
+        void *pool = video_frame_pool_init(pool_desc(), 0);
+        const int per_thread = opts.items / 10 / opts.producers;
+        const long long start = now_ns();
+        vector<thread> threads;
+        for (int i = 0; i < opts.producers; ++i) {
+                threads.emplace_back([pool, per_thread] {
+                        for (int j = 0; j < per_thread; ++j) {
+                                struct video_frame *f = video_frame_pool_get_disposable_frame(pool);
+                                VIDEO_FRAME_DISPOSE(f);
+                        }
+                });
+        }
+        for (auto &t : threads) {
+                t.join();
+        }
+        result res;
+        res.ops_per_sec = (double) per_thread * opts.producers / ((now_ns() - start) / 1e9);
+        video_frame_pool_destroy(pool);
+        return res;
+}
+
+/// one-way wakeup latency is taken as a half of a ping-pong round trip
+static result wait_obj_wakeup(const bench_opts &opts)
+{
+        struct wait_obj *ping = wait_obj_init();
+        struct wait_obj *pong = wait_obj_init();
+        thread peer([&] {
+                for (int i = 0; i < opts.samples; ++i) {
+                        wait_obj_wait(ping);
+                        wait_obj_reset(ping);
+                        wait_obj_notify(pong);
+                }
+        });
+        result res;
+        res.latencies.reserve(opts.samples);
+        const long long start = now_ns();
+        for (int i = 0; i < opts.samples; ++i) {
+                const long long t0 = now_ns();
+                wait_obj_notify(ping);
+                wait_obj_wait(pong);
+                wait_obj_reset(pong);
+                res.latencies.push_back((now_ns() - t0) / 2);
+        }
+        res.ops_per_sec = 2.0 * opts.samples / ((now_ns() - start) / 1e9);
+        peer.join();
+        wait_obj_done(ping);
+        wait_obj_done(pong);
+        return res;
+}
+
+static void *empty_task(void *arg)
+{
+        return arg;
+}
+
+static result worker_round_trip(const bench_opts &opts)
+{
+        result res;
+        res.latencies.reserve(opts.samples);
+        const long long start = now_ns();
+        for (int i = 0; i < opts.samples; ++i) {
+                const long long t0 = now_ns();
+                wait_task(task_run_async(empty_task, nullptr));
+                res.latencies.push_back(now_ns() - t0);
+        }
+        res.ops_per_sec = opts.samples / ((now_ns() - start) / 1e9);
+        return res;
+}
+
+/// latency of the whole task_run_parallel() call
+static result worker_parallel(const bench_opts &opts)
+{
+        vector<char> data(opts.producers);
+        vector<void *> ret(opts.producers);
+        result res;
+        const int count = opts.samples / 10;
+        res.latencies.reserve(count);
+        const long long start = now_ns();
+        for (int i = 0; i < count; ++i) {
+                const long long t0 = now_ns();
+                task_run_parallel(empty_task, opts.producers, data.data(), 1, ret.data());
+                res.latencies.push_back(now_ns() - t0);
+        }
+        res.ops_per_sec = count / ((now_ns() - start) / 1e9);
+        return res;
+}
+
+static result list_append_pop(const bench_opts &opts)
+{
+        struct simple_linked_list *list = simple_linked_list_init();
+        int item = 0;
+        const int depth = 8; // keep some items in the list like a frame queue
+        for (int i = 0; i < depth; ++i) {
+                simple_linked_list_append(list, &item);
+        }
+        const long long start = now_ns();
+        for (int i = 0; i < opts.items; ++i) {
+                simple_linked_list_append(list, &item);
+                simple_linked_list_pop(list);
+        }
+        result res;
+        res.ops_per_sec = opts.items / ((now_ns() - start) / 1e9);
+        simple_linked_list_destroy(list);
+        return res;
+}
+
+static void usage(const char *progname)
+{
+        printf("Usage:\n\t%s [-n <items>] [-m <samples>] [-b <chunk>] [-p <producers>]\n"
+               "\t\t[-f table|csv] [--param <p>]\n\n", progname);
+        printf("where\n"
+               "\t-n <items>     - items passed in the throughput tests (default %d)\n"
+               "\t-m <samples>   - latency samples (default %d)\n"
+               "\t-b <chunk>     - chunk size of ring buffer tests in bytes (default %d)\n"
+               "\t-p <producers> - threads in N:1 tests and parallel tasks (default 4)\n"
+               "\t-f <format>    - output format (default table)\n"
+               "\t--param <p>    - UltraGrid params, eg. frame-pool-hugepages\n",
+               DEFAULT_ITEMS, DEFAULT_SAMPLES, DEFAULT_CHUNK);
+}
+
+int main(int argc, char *argv[])
+{
+        log_level = LOG_LEVEL_WARNING;
+        struct init_data *init = common_preinit(argc, argv);
+        if (init == nullptr) {
+                return 2;
+        }
+
+        struct bench_opts opts;
+        static struct option getopt_options[] = {
+                {"help", no_argument, nullptr, 'h'},
+                {"param", required_argument, nullptr, 'O'},
+                {"verbose", optional_argument, nullptr, 'V'},
+                { nullptr, 0, nullptr, 0 }
+        };
+        int ch = 0;
+        while ((ch = getopt_long(argc, argv, "b:f:hm:n:p:V", getopt_options, nullptr)) != -1) {
+                switch (ch) {
+                case 'b':
+                        opts.chunk = atoi(optarg);
+                        break;
+                case 'f':
+                        if (strcmp(optarg, "table") == 0) {
+                                opts.out_fmt = OUT_TABLE;
+                        } else if (strcmp(optarg, "csv") == 0) {
+                                opts.out_fmt = OUT_CSV;
+                        } else {
+                                fprintf(stderr, "Unknown output format: %s\n", optarg);
+                                common_cleanup(init);
+                                return 1;
+                        }
+                        break;
+                case 'm':
+                        opts.samples = atoi(optarg);
+                        break;
+                case 'n':
+                        opts.items = atoi(optarg);
+                        break;
+                case 'p':
+                        opts.producers = atoi(optarg);
+                        break;
+                case 'O':
+                        if (!parse_params(optarg, false)) {
+                                common_cleanup(init);
+                                return 1;
+                        }
+                        break;
+                case 'V': // handled in common_preinit
+                        break;
+                case 'h':
+                        usage(argv[0]);
+                        common_cleanup(init);
+                        return 0;
+                default:
+                        usage(argv[0]);
+                        common_cleanup(init);
+                        return 1;
+                }
+        }
+        if (opts.producers <= 0 || opts.items < opts.producers * 10 || opts.samples < 10
+                        || opts.chunk <= 0 || opts.chunk > RING_SIZE / 2) {
+                fprintf(stderr, "Wrong argument!\n");
+                common_cleanup(init);
+                return 1;
+        }
+
+        const string n_1 = std::to_string(opts.producers) + ":1";
+        print_header(opts);
+        result res = queue_throughput(opts, 1);
+        print_result(opts, "synchronized_queue", "throughput 1:1", res);
+        res = queue_throughput(opts, opts.producers);
+        print_result(opts, "synchronized_queue", "throughput " + n_1, res);
+        res = queue_latency(opts);
+        print_result(opts, "synchronized_queue", "push-pop", res);
+        res = ring_buffer_throughput(opts);
+        print_result(opts, "ring_buffer", "throughput 1:1", res);
+        res = audio_buffer_throughput(opts);
+        print_result(opts, "audio_buffer", "throughput 1:1", res);
+        res = pool_single(opts);
+        print_result(opts, "video_frame_pool", "get-dispose", res);
+        res = pool_handover(opts);
+        print_result(opts, "video_frame_pool", "throughput 1:1", res);
+        res = pool_contended(opts);
+        print_result(opts, "video_frame_pool", "throughput " + n_1, res);
+        res = wait_obj_wakeup(opts);
+        print_result(opts, "wait_obj", "wakeup", res);
+        res = worker_round_trip(opts);
+        print_result(opts, "worker", "async-wait", res);
+        res = worker_parallel(opts);
+        print_result(opts, "worker", "parallel " + std::to_string(opts.producers), res);
+        res = list_append_pop(opts);
+        print_result(opts, "simple_linked_list", "append-pop", res);
+
+        common_cleanup(init);
+        return 0;
+}
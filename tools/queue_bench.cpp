@@ -0,0 +1,225 @@
+/**
+ * @file   tools/queue_bench.cpp
+ * @brief  Benchmark of synchronized_queue vs. lockfree_queue
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Passes items between producer and consumer threads through both queue
+ * implementations in two scenarios:
+ * - throughput - producers push as fast as possible, reports items per second
+ * - paced - a single producer pushes at given rate (frame rate like), so the
+ *   consumer usually sleeps; reports the hand-over latency (push to pop)
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <thread>
+#include <vector>
+
+#include "utils/lockfree_queue.h"
+#include "utils/synchronized_queue.h"
+
+using std::thread;
+using std::vector;
+using std::chrono::duration;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+#define DEFAULT_ITEMS 1000000
+#define DEFAULT_PACED_ITEMS 300
+#define DEFAULT_RATE 60
+#define POISON (-1LL)
+
+struct bench_opts {
+        int items = DEFAULT_ITEMS;
+        int paced_items = DEFAULT_PACED_ITEMS;
+        double rate = DEFAULT_RATE;
+        int len = 1;
+        int producers = 1;
+        int consumers = 1;
+};
+
+static long long now_ns()
+{
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+template<typename queue_t>
+static void run_throughput(const char *name, const bench_opts &opts)
+{
+        queue_t queue;
+        queue.set_max_len(opts.len);
+        const int per_producer = opts.items / opts.producers;
+
+        vector<thread> threads;
+        const long long start = now_ns();
+        for (int i = 0; i < opts.consumers; ++i) {
+                threads.emplace_back([&queue] {
+                        while (queue.pop() != POISON) {
+                        }
+                });
+        }
+        vector<thread> producers;
+        for (int i = 0; i < opts.producers; ++i) {
+                producers.emplace_back([&queue, per_producer] {
+                        for (long long j = 1; j <= per_producer; ++j) {
+                                queue.push(j);
+                        }
+                });
+        }
+        for (auto &t : producers) {
+                t.join();
+        }
+        for (int i = 0; i < opts.consumers; ++i) {
+                queue.push(POISON);
+        }
+        for (auto &t : threads) {
+                t.join();
+        }
+        const double secs = (now_ns() - start) / 1e9;
+        printf("%-22s %-10s %12.0f %9s %9s %9s\n", name, "throughput",
+               per_producer * opts.producers / secs, "", "", "");
+}
+
+template<typename queue_t>
+static void run_paced(const char *name, const bench_opts &opts)
+{
+        queue_t queue;
+        queue.set_max_len(opts.len);
+        vector<long long> latencies;
+        latencies.reserve(opts.paced_items);
+
+        thread consumer([&queue, &latencies] {
+                long long sent = 0;
+                while ((sent = queue.pop()) != POISON) {
+                        latencies.push_back(now_ns() - sent);
+                }
+        });
+        const auto period = duration<double>(1.0 / opts.rate);
+        auto next = steady_clock::now();
+        for (int i = 0; i < opts.paced_items; ++i) {
+                next += duration_cast<steady_clock::duration>(period);
+                std::this_thread::sleep_until(next);
+                queue.push(now_ns());
+        }
+        queue.push(POISON);
+        consumer.join();
+
+        std::sort(latencies.begin(), latencies.end());
+        double sum = 0;
+        for (long long l : latencies) {
+                sum += l;
+        }
+        printf("%-22s %-10s %12s %9.2f %9.2f %9.2f\n", name, "paced", "",
+               sum / latencies.size() / 1000.0,
+               latencies[latencies.size() * 99 / 100] / 1000.0,
+               latencies.back() / 1000.0);
+}
+
+static void usage(const char *progname)
+{
+        printf("Usage:\n\t%s [-n <items>] [-l <len>] [-p <producers>] [-c <consumers>]\n"
+               "\t\t[-r <rate>] [-m <paced_items>]\n\n", progname);
+        printf("where\n"
+               "\t-n <items>       - items passed in the throughput test (default %d)\n"
+               "\t-l <len>         - queue length (default 1)\n"
+               "\t-p <producers>   - producer threads in the throughput test (default 1)\n"
+               "\t-c <consumers>   - consumer threads in the throughput test (default 1)\n"
+               "\t-r <rate>        - push rate of the paced test in Hz (default %d)\n"
+               "\t-m <paced_items> - items passed in the paced test (default %d)\n",
+               DEFAULT_ITEMS, DEFAULT_RATE, DEFAULT_PACED_ITEMS);
+}
+
+int main(int argc, char *argv[])
+{
+        struct bench_opts opts;
+        static struct option getopt_options[] = {
+                {"help", no_argument, nullptr, 'h'},
+                { nullptr, 0, nullptr, 0 }
+        };
+        int ch = 0;
+        while ((ch = getopt_long(argc, argv, "c:hl:m:n:p:r:", getopt_options, nullptr)) != -1) {
+                switch (ch) {
+                case 'c':
+                        opts.consumers = atoi(optarg);
+                        break;
+                case 'l':
+                        opts.len = atoi(optarg);
+                        break;
+                case 'm':
+                        opts.paced_items = atoi(optarg);
+                        break;
+                case 'n':
+                        opts.items = atoi(optarg);
+                        break;
+                case 'p':
+                        opts.producers = atoi(optarg);
+                        break;
+                case 'r':
+                        opts.rate = atof(optarg);
+                        break;
+                case 'h':
+                        usage(argv[0]);
+                        return 0;
+                default:
+                        usage(argv[0]);
+                        return 1;
+                }
+        }
+        if (opts.items < opts.producers || opts.paced_items <= 0 || opts.len <= 0
+                        || opts.producers <= 0 || opts.consumers <= 0 || opts.rate <= 0) {
+                fprintf(stderr, "Wrong argument!\n");
+                return 1;
+        }
+
+        printf("Queue length %d, %d producer(s), %d consumer(s), paced at %.2f Hz\n\n",
+               opts.len, opts.producers, opts.consumers, opts.rate);
+        printf("%-22s %-10s %12s %9s %9s %9s\n", "queue", "test", "items/s",
+               "avg us", "p99 us", "max us");
+        run_throughput<synchronized_queue<long long, 1>>("synchronized_queue", opts);
+        run_throughput<lockfree_queue<long long, 1>>("lockfree_queue", opts);
+        run_paced<synchronized_queue<long long, 1>>("synchronized_queue", opts);
+        run_paced<lockfree_queue<long long, 1>>("lockfree_queue", opts);
+        return 0;
+}